@@ -51,7 +51,7 @@ void Gsm_Coder (
 	word	* dp  = S->dp0 + 120;	/* [ -120...-1 ] */
 	word	* dpp = dp;		/* [ 0...39 ]	 */
 
-	static word e[50];
+	word	e[50] = {0};
 
 	word	so[160];
 
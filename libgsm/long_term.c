@@ -201,31 +201,16 @@ static void Calculation_of_the_LTP_parameters (
 
 	for (lambda = 40; lambda <= 120; lambda++) {
 
-# undef STEP
-#		define STEP(k) 	(longword)wt[k] * dp[k - lambda]
-
-		register longword L_result;
-
-		L_result  = STEP(0)  ; L_result += STEP(1) ;
-		L_result += STEP(2)  ; L_result += STEP(3) ;
-		L_result += STEP(4)  ; L_result += STEP(5)  ;
-		L_result += STEP(6)  ; L_result += STEP(7)  ;
-		L_result += STEP(8)  ; L_result += STEP(9)  ;
-		L_result += STEP(10) ; L_result += STEP(11) ;
-		L_result += STEP(12) ; L_result += STEP(13) ;
-		L_result += STEP(14) ; L_result += STEP(15) ;
-		L_result += STEP(16) ; L_result += STEP(17) ;
-		L_result += STEP(18) ; L_result += STEP(19) ;
-		L_result += STEP(20) ; L_result += STEP(21) ;
-		L_result += STEP(22) ; L_result += STEP(23) ;
-		L_result += STEP(24) ; L_result += STEP(25) ;
-		L_result += STEP(26) ; L_result += STEP(27) ;
-		L_result += STEP(28) ; L_result += STEP(29) ;
-		L_result += STEP(30) ; L_result += STEP(31) ;
-		L_result += STEP(32) ; L_result += STEP(33) ;
-		L_result += STEP(34) ; L_result += STEP(35) ;
-		L_result += STEP(36) ; L_result += STEP(37) ;
-		L_result += STEP(38) ; L_result += STEP(39) ;
+		/* |wt[k]| <= 2**9 after the scaling above, so the sum fits
+		 * in 32 bits: summed as int, the compiler can vectorise it
+		 * with 16-bit multiply-adds.
+		 */
+		register word	* dpl = dp - lambda;
+		int		sum = 0;
+		longword	L_result;
+
+		for (k = 0; k <= 39; k++) sum += wt[k] * dpl[k];
+		L_result = sum;
 
 		if (L_result > L_max) {
 
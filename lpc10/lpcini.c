@@ -23,10 +23,13 @@ extern int lpcini_(void);
 
 /* Common Block Declarations */
 
+/* Only ever read once initialized here (as lpcini_ used to on each call,
+   which was a data race between streams initialized on different threads) */
+
 struct {
     integer order, lframe;
     logical corrp;
-} contrl_;
+} contrl_ = { 10, 180, TRUE_ };
 
 #define contrl_1 contrl_
 
@@ -124,9 +127,8 @@ struct {
 /*      common /contrl/ fsi, fso, fpi, fpo, fbi, fbo, pbin, fmsg, fdebug */
 /*      common /contrl/ quant, nbits */
 /*      common /contrl/ nframe, nunsfm, iclip, maxosp, listl, lincnt */
-    contrl_1.order = 10;
-    contrl_1.lframe = 180;
-    contrl_1.corrp = TRUE_;
+/*  contrl_1.order = 10, .lframe = 180 and .corrp = TRUE_ are now given */
+/*  by the initializer of contrl_ above. */
     return 0;
 } /* lpcini_ */
 
@@ -6,8 +6,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#ifdef HAVE_UNISTD_H
+  #include <unistd.h>
+#endif
 
-#define BUFLEN 512
+#define BUFLEN 8192
+#define MEMLEN (1 << 24) /* Bytes of channels to keep in memory when writing */
 
 /* Private data used by writer */
 typedef struct{
@@ -15,7 +19,13 @@ typedef struct{
   uint32_t left;
   off_t ch0_pos;
   sox_uint8_t buf[4][BUFLEN];
-  FILE* tmp[4];
+  size_t buffered;      /* Frames in buf, to be written */
+  sox_bool in_place;    /* Writing each channel straight to its place */
+  uint32_t width;       /* In place: the frames expected in each channel */
+  uint32_t placed;      /* In place: frames written to each channel */
+  sox_uint8_t * mem[4]; /* Else, the channels are kept in memory; */
+  size_t mem_len, mem_size;
+  FILE* tmp[4];         /* or, beyond MEMLEN, in temporary files */
 } priv_t;
 
 static void svxwriteheader(sox_format_t *, size_t);
@@ -209,21 +219,112 @@ static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t nsamp)
 /*======================================================================*/
 /*                         8SVXSTARTWRITE                               */
 /*======================================================================*/
+
+/* The channels follow each other in the BODY, so are written straight to
+ * their places if the file is seekable and their length known (or there
+ * is just one); otherwise they are kept, in memory while that takes no
+ * more than MEMLEN bytes, then in a temporary file each, until the end. */
 static int startwrite(sox_format_t * ft)
+{
+        priv_t * p = (priv_t * ) ft->priv;
+        uint64_t frames = ft->signal.length / ft->signal.channels;
+
+        p->nsamples = 0;
+        if (ft->seekable && frames <= UINT32_MAX &&
+            (ft->signal.channels == 1 || (frames && !ft->io_async))) {
+                p->in_place = sox_true;
+                p->width = frames;
+                svxwriteheader(ft, (size_t)frames * ft->signal.channels);
+                p->ch0_pos = lsx_tell(ft);
+        }
+        return(SOX_SUCCESS);
+}
+
+/* Adds n frames of each channel, from data, to those kept */
+static int keep(sox_format_t * ft, sox_uint8_t (* data)[BUFLEN], size_t n)
 {
         priv_t * p = (priv_t * ) ft->priv;
         size_t i;
 
-        /* open channel output files */
-        for (i = 0; i < ft->signal.channels; i++) {
-                if ((p->tmp[i] = lsx_tmpfile()) == NULL)
-                {
-                        lsx_fail_errno(ft,errno,"Can't open channel output file");
-                        return(SOX_EOF);
+        if (!p->tmp[0] && (p->mem_len + n) * ft->signal.channels > MEMLEN) {
+                for (i = 0; i < ft->signal.channels; i++) {
+                        if ((p->tmp[i] = lsx_tmpfile()) == NULL ||
+                            fwrite(p->mem[i], (size_t)1, p->mem_len, p->tmp[i]) != p->mem_len)
+                        {
+                                lsx_fail_errno(ft,errno,"Can't write channel output file");
+                                return(SOX_EOF);
+                        }
+                        free(p->mem[i]);
+                        p->mem[i] = NULL;
                 }
         }
+        if (p->tmp[0]) {
+                for (i = 0; i < ft->signal.channels; i++)
+                        if (fwrite(data[i], (size_t)1, n, p->tmp[i]) != n)
+                        {
+                                lsx_fail_errno(ft,errno,"Can't write channel output file");
+                                return(SOX_EOF);
+                        }
+                return(SOX_SUCCESS);
+        }
+        if (p->mem_len + n > p->mem_size) {
+                p->mem_size = max(p->mem_size * 2, p->mem_len + n);
+                for (i = 0; i < ft->signal.channels; i++)
+                        p->mem[i] = lsx_realloc(p->mem[i], p->mem_size);
+        }
+        for (i = 0; i < ft->signal.channels; i++)
+                memcpy(p->mem[i] + p->mem_len, data[i], n);
+        p->mem_len += n;
+        return(SOX_SUCCESS);
+}
 
-        p->nsamples = 0;
+/* The length has turned out not to be that expected, so the channels are
+ * no longer in their places; takes them back to keep with any others. */
+static int unplace(sox_format_t * ft)
+{
+        priv_t * p = (priv_t * ) ft->priv;
+        sox_uint8_t (* data)[BUFLEN] = lsx_malloc(sizeof(p->buf));
+        size_t done, n, i;
+        int rc = SOX_SUCCESS;
+
+        lsx_debug("writing channels in place abandoned after %lu frames",
+                  (unsigned long)p->placed);
+        p->in_place = sox_false;
+        for (done = 0; rc == SOX_SUCCESS && done < p->placed; done += n) {
+                n = min(BUFLEN, p->placed - done);
+                for (i = 0; rc == SOX_SUCCESS && i < ft->signal.channels; i++)
+                        if (lsx_seeki(ft, p->ch0_pos + (off_t)(i * p->width + done), SEEK_SET) ||
+                            lsx_readbuf(ft, data[i], n) != n)
+                        {
+                                lsx_fail_errno(ft,errno,"Can't read back channel %lu",(unsigned long)i);
+                                rc = SOX_EOF;
+                        }
+                if (rc == SOX_SUCCESS)
+                        rc = keep(ft, data, n);
+        }
+        free(data);
+        return rc;
+}
+
+/* Writes out, or keeps, the frames in buf */
+static int flush(sox_format_t * ft)
+{
+        priv_t * p = (priv_t * ) ft->priv;
+        size_t n = p->buffered, i;
+
+        p->buffered = 0;
+        if (p->in_place && ft->signal.channels > 1 && p->placed + n > p->width &&
+            unplace(ft) != SOX_SUCCESS)
+                return(SOX_EOF);
+        if (!p->in_place)
+                return keep(ft, p->buf, n);
+        for (i = 0; i < ft->signal.channels; i++) {
+                if ((ft->signal.channels > 1 &&
+                     lsx_seeki(ft, p->ch0_pos + (off_t)(i * p->width + p->placed), SEEK_SET)) ||
+                    lsx_writebuf(ft, p->buf[i], n) != n)
+                        return(SOX_EOF);
+        }
+        p->placed += n;
         return(SOX_SUCCESS);
 }
 
@@ -236,17 +337,15 @@ static size_t write_samples(sox_format_t * ft, const sox_sample_t *buf, size_t l
         priv_t * p = (priv_t * ) ft->priv;
         SOX_SAMPLE_LOCALS;
 
-        unsigned char datum;
         size_t done = 0, i;
 
-        p->nsamples += len;
-
         while(done < len) {
-                for (i = 0; i < ft->signal.channels; i++) {
-                        datum = SOX_SAMPLE_TO_SIGNED_8BIT(*buf++, ft->clips);
-                        putc(datum, p->tmp[i]);
-                }
+                for (i = 0; i < ft->signal.channels; i++)
+                        p->buf[i][p->buffered] = SOX_SAMPLE_TO_SIGNED_8BIT(*buf++, ft->clips);
                 done += ft->signal.channels;
+                p->nsamples += ft->signal.channels;
+                if (++p->buffered == BUFLEN && flush(ft) != SOX_SUCCESS)
+                        break;
         }
         return (done);
 }
@@ -260,21 +359,59 @@ static int stopwrite(sox_format_t * ft)
         priv_t * p = (priv_t * ) ft->priv;
 
         size_t i, len;
-        char svxbuf[512];
+        uint64_t end = 0;
+
+        if (p->buffered && flush(ft) != SOX_SUCCESS)
+                return(SOX_EOF);
+        if (p->in_place && ft->signal.channels > 1 && p->placed != p->width &&
+            unplace(ft) != SOX_SUCCESS)
+                return(SOX_EOF);
+
+        if (p->in_place) {
+                /* add a pad byte if BODY size is odd */
+                if (lsx_seeki(ft, p->ch0_pos + (off_t)p->nsamples, SEEK_SET))
+                        return(SOX_EOF);
+                if(p->nsamples % 2 != 0)
+                    lsx_writeb(ft, '\0');
+                if (p->placed == p->width)
+                        return(SOX_SUCCESS);
+                if (lsx_seeki(ft, (off_t)0, SEEK_SET))
+                {
+                        lsx_fail_errno(ft,errno,"Can't rewind output file to rewrite 8SVX header");
+                        return(SOX_EOF);
+                }
+                svxwriteheader(ft, (size_t) p->nsamples);
+                return(SOX_SUCCESS);
+        }
 
+        if (p->ch0_pos) { /* was in place: rewrite it all */
+                end = p->ch0_pos + (uint64_t)p->width * ft->signal.channels;
+                if (lsx_seeki(ft, (off_t)0, SEEK_SET))
+                {
+                        lsx_fail_errno(ft,errno,"Can't rewind output file to rewrite 8SVX file");
+                        return(SOX_EOF);
+                }
+        }
         svxwriteheader(ft, (size_t) p->nsamples);
 
         /* append all channel pieces to channel 0 */
         /* close temp files */
         for (i = 0; i < ft->signal.channels; i++) {
+                if (!p->tmp[i]) {
+                        len = lsx_writebuf(ft, p->mem[i], p->mem_len);
+                        free(p->mem[i]);
+                        if (len != p->mem_len)
+                          return SOX_EOF;
+                        continue;
+                }
                 if (fseeko(p->tmp[i], (off_t)0, 0))
                 {
                         lsx_fail_errno (ft,errno,"Can't rewind channel output file %lu",(unsigned long)i);
                         return(SOX_EOF);
                 }
                 while (!feof(p->tmp[i])) {
-                        len = fread(svxbuf, (size_t) 1, (size_t) 512, p->tmp[i]);
-                        if (lsx_writebuf(ft, svxbuf, len) != len) {
+                        len = fread(p->buf[0], (size_t) 1, (size_t) BUFLEN, p->tmp[i]);
+                        if (lsx_writebuf(ft, p->buf[0], len) != len) {
                           lsx_fail_errno (ft,errno,"Can't write channel output file %lu",(unsigned long)i);
                           return SOX_EOF;
                         }
@@ -286,6 +423,16 @@ static int stopwrite(sox_format_t * ft)
         if(p->nsamples % 2 != 0)
             lsx_writeb(ft, '\0');
 
+#ifdef HAVE_UNISTD_H
+        /* Cut off what was written in place beyond the new end */
+        if (end > (uint64_t)lsx_tell(ft) && (fflush((FILE*)ft->fp) ||
+            ftruncate(fileno((FILE*)ft->fp), (off_t)lsx_tell(ft))))
+        {
+                lsx_fail_errno(ft,errno,"Can't truncate 8SVX file");
+                return(SOX_EOF);
+        }
+#endif
+
         return(SOX_SUCCESS);
 }
 
@@ -336,7 +483,7 @@ LSX_FORMAT_HANDLER(svx)
     names, SOX_FILE_BIG_END|SOX_FILE_MONO|SOX_FILE_STEREO|SOX_FILE_QUAD,
     startread, read_samples, NULL,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -167,6 +167,34 @@ const char *lsx_ms_adpcm_block_expand_i(
   return errmsg;
 }
 
+/* lsx_ms_adpcm_blocks_expand_i() expands nblocks whole blocks, which follow
+ * one another in ibuff, as many calls of lsx_ms_adpcm_block_expand_i() would;
+ * priv needs states for chans*nblocks channels. */
+const char *lsx_ms_adpcm_blocks_expand_i(
+        void *priv,
+        unsigned chans,          /* total channels             */
+        int nCoef,
+        const short *coef,
+        const unsigned char *ibuff,/* input buffer[nblocks*blockAlign] */
+        size_t blockAlign,
+        SAMPL *obuff,       /* output samples, nblocks*n*chans */
+        int n,              /* samples to decode PER channel, per block */
+        size_t nblocks,
+        unsigned threads    /* blocks to expand at once */
+)
+{
+  MsState_t *state = priv;
+  long i, bad = 0;
+
+  #pragma omp parallel for if(threads > 1 && nblocks > 1) \
+      num_threads(threads) schedule(static) reduction(+:bad)
+  for (i = 0; i < (long)nblocks; ++i)
+    bad += lsx_ms_adpcm_block_expand_i(state + (size_t)i*chans, chans,
+        nCoef, coef, ibuff + (size_t)i*blockAlign,
+        obuff + (size_t)i*n*chans, n) != NULL;
+  return bad? "MSADPCM bpred >= nCoef, arbitrarily using 0\n" : NULL;
+}
+
 static int AdpcmMashS(
         unsigned ch,              /* channel number to encode, REQUIRE 0 <= ch < chans  */
         unsigned chans,           /* total channels */
@@ -175,12 +203,12 @@ static int AdpcmMashS(
         const SAMPL *ibuff,  /* ibuff[] is interleaved input samples */
         int n,               /* samples to encode PER channel */
         int *iostep,         /* input/output step, REQUIRE 16 <= *st <= 0x7fff */
-        unsigned char *obuff /* output buffer[blockAlign], or NULL for no output  */
+        unsigned char *obuff,/* output buffer[blockAlign], or NULL for no output  */
+        unsigned char *codes /* codes[n*chans], interleaved as ibuff; with obuff */
 )
 {
         const SAMPL *ip, *itop;
-        unsigned char *op;
-        int ox = 0;      /*  */
+        unsigned char *op, *cp = NULL;
         int d, v0, v1, step;
         double d2;       /* long long is okay also, speed abt the same */
 
@@ -204,8 +232,7 @@ static int AdpcmMashS(
                 op[0] = v0; op[1] = v0>>8;
                 op += 2*chans;       /* skip to v1 */
                 op[0] = v1; op[1] = v1>>8;
-                op = obuff+7*chans;  /* point to base of output nibbles */
-                ox = 4*ch;
+                cp = codes + 2*chans + ch; /* nibbles are packed later */
         }
         for (; ip < itop; ip+=chans) {
                 int vlin,d3,dp,c;
@@ -232,8 +259,8 @@ static int AdpcmMashS(
                 d2 += d3*d3; /* update square-error */
 
                 if (op) {   /* if we want output, put it in proper place */
-                        op[ox>>3] |= (ox&4)? c:(c<<4);
-                        ox += 4*chans;
+                        *cp = c;
+                        cp += chans;
                         lsx_debug_more("%.1x",c);
 
                 }
@@ -250,56 +277,238 @@ static int AdpcmMashS(
         return (int) sqrt(d2);
 }
 
+/* For each of the 7 standard coef sets, the trials give the rms errors of
+ * compression beginning with step-value s0 (d0[k]), and with the
+ * slightly forward-adjusted step-value s1[k] (d1[k]). */
+typedef void (* AdpcmTrials_t)(unsigned ch, unsigned chans, SAMPL v[2],
+    const SAMPL *ip, int n, int s0, int d0[7], int d1[7], int s1[7]);
+
+static void AdpcmTrials_c(unsigned ch, unsigned chans, SAMPL v[2],
+    const SAMPL *ip, int n, int s0, int d0[7], int d1[7], int s1[7])
+{
+        int n0,ss,k;
+
+        n0 = n/2; if (n0>32) n0=32;
+        for (k=0; k<7; k++) {
+                ss = s0;
+                d0[k]=AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[k], ip, n, &ss, NULL, NULL); /* with step s0 */
+
+                ss = s0;
+                AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[k], ip, n0, &ss, NULL, NULL);
+                lsx_debug_more(" s32 %d\n",ss);
+                ss = s1[k] = (3*s0+ss)/4;
+                d1[k]=AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[k], ip, n, &ss, NULL, NULL); /* with step s1 */
+        }
+}
+
+#if defined HAVE_LSX_TARGET
+  #define HAVE_ADPCM_SSE41 1  /* Built regardless of -m options */
+  #include <smmintrin.h>
+  #define ADPCM_TARGET LSX_TARGET("sse4.1")
+#endif
+
+#if defined HAVE_ADPCM_SSE41
+/* AdpcmMashS(), without output, of the 7 coef sets at once (& an 8th, of
+ * 0s, to fill 2 vectors), each from its own step-value; results are
+ * identical.  The division is done as 4 compare-and-subtract steps, which
+ * also give code*step, and the step-adjust table is looked up with pshufb. */
+ADPCM_TARGET static void AdpcmMash8(
+        unsigned ch,
+        unsigned chans,
+        SAMPL v[2],
+        const SAMPL *ibuff,
+        int n,
+        int step[8],        /* input/output steps, as *iostep */
+        int d[8]            /* rms errors, or NULL if not wanted */
+)
+{
+        const SAMPL *ip = ibuff + ch + 2*chans, *itop = ibuff + n*chans;
+        __m128i const lo16 = _mm_set1_epi32(0xffff);
+        __m128i const min16 = _mm_set1_epi32(-0x8000), max16 = _mm_set1_epi32(0x7fff);
+        __m128i const one = _mm_set1_epi32(1), eight = _mm_set1_epi32(8);
+        __m128i const sixteen = _mm_set1_epi32(16);
+        __m128i const idx = _mm_set1_epi32((int)0x80808000); /* bytes 1-3 -> 0 */
+        __m128i tab_lo, tab_hi, c[2], s[2], v0[2], v1[2], sum[2][2];
+        unsigned char lo[16], hi[16];
+        short coefs[16] = {0};          /* The 7 pairs, then zeros */
+        sox_int64_t sums[8];
+        double d2;
+        int i, j, e;
+
+        for (i = 0; i < 16; ++i) {
+                lo[i] = stepAdjustTable[i] & 0xff;
+                hi[i] = stepAdjustTable[i] >> 8;
+        }
+        tab_lo = _mm_loadu_si128((__m128i const *)lo);
+        tab_hi = _mm_loadu_si128((__m128i const *)hi);
+        memcpy(coefs, lsx_ms_adpcm_i_coef, sizeof(lsx_ms_adpcm_i_coef));
+        c[0] = _mm_loadu_si128((__m128i const *)coefs);
+        c[1] = _mm_loadu_si128((__m128i const *)coefs + 1);
+        for (j = 0; j < 2; ++j) {
+                s[j] = _mm_loadu_si128((__m128i const *)(step + 4*j));
+                v0[j] = _mm_set1_epi32(v[0]);
+                v1[j] = _mm_set1_epi32(v[1]);
+                sum[j][0] = sum[j][1] = _mm_setzero_si128();
+        }
+        e = ibuff[ch] - v[1];
+        d2 = e*e;
+        e = ibuff[ch+chans] - v[0];
+        d2 += e*e;
+
+        for (; ip < itop; ip += chans) {
+                __m128i const x = _mm_set1_epi32(*ip);
+                for (j = 0; j < 2; ++j) {     /* 2 independent chains */
+                        __m128i vlin, dp, r, q, t, m, f;
+                        int b;
+
+                        vlin = _mm_or_si128(_mm_slli_epi32(v1[j], 16), _mm_and_si128(v0[j], lo16));
+                        vlin = _mm_srai_epi32(_mm_madd_epi16(vlin, c[j]), 8);
+                        r = dp = _mm_add_epi32(_mm_sub_epi32(x, vlin), _mm_add_epi32(
+                            _mm_slli_epi32(s[j], 3), _mm_srai_epi32(s[j], 1)));
+                        q = _mm_setzero_si128();
+                        for (b = 3; b >= 0; --b) { /* q = dp>0? min(dp/step,15) : 0 */
+                                t = _mm_sll_epi32(s[j], _mm_cvtsi32_si128(b));
+                                m = _mm_cmpgt_epi32(r, _mm_sub_epi32(t, one));
+                                r = _mm_sub_epi32(r, _mm_and_si128(m, t));
+                                q = _mm_or_si128(q, _mm_and_si128(m, _mm_set1_epi32(1 << b)));
+                        }
+                        dp = _mm_sub_epi32(_mm_sub_epi32(dp, r), _mm_slli_epi32(s[j], 3));
+
+                        v1[j] = v0[j];
+                        v0[j] = _mm_min_epi32(_mm_max_epi32(_mm_add_epi32(vlin, dp), min16), max16);
+
+                        t = _mm_sub_epi32(x, v0[j]);
+                        t = _mm_mullo_epi32(t, t);
+                        sum[j][0] = _mm_add_epi64(sum[j][0], _mm_cvtepi32_epi64(t));
+                        sum[j][1] = _mm_add_epi64(sum[j][1], _mm_cvtepi32_epi64(_mm_srli_si128(t, 8)));
+
+                        q = _mm_or_si128(_mm_xor_si128(q, eight), idx);
+                        f = _mm_or_si128(_mm_shuffle_epi8(tab_lo, q),
+                            _mm_slli_epi32(_mm_shuffle_epi8(tab_hi, q), 8));
+                        s[j] = _mm_max_epi32(_mm_srai_epi32(_mm_mullo_epi32(f, s[j]), 8), sixteen);
+                }
+        }
+        for (j = 0; j < 2; ++j) {
+                _mm_storeu_si128((__m128i *)(step + 4*j), s[j]);
+                _mm_storeu_si128((__m128i *)(sums + 4*j), sum[j][0]);
+                _mm_storeu_si128((__m128i *)(sums + 4*j + 2), sum[j][1]);
+        }
+        if (d) for (i = 0; i < 8; ++i) /* Sums are exact, so order is moot */
+                d[i] = (int) sqrt((d2 + sums[i]) / n);
+}
+
+ADPCM_TARGET static void AdpcmTrials_sse41(unsigned ch, unsigned chans,
+    SAMPL v[2], const SAMPL *ip, int n, int s0, int d0[7], int d1[7], int s1[7])
+{
+        int n0,k,st[8],d[8];
+
+        n0 = n/2; if (n0>32) n0=32;
+        for (k=0; k<8; k++) st[k] = s0;
+        AdpcmMash8(ch, chans, v, ip, n0, st, NULL);
+        for (k=0; k<7; k++) s1[k] = st[k] = (3*s0+st[k])/4;
+        AdpcmMash8(ch, chans, v, ip, n, st, d);
+        for (k=0; k<7; k++) d1[k] = d[k];
+        for (k=0; k<8; k++) st[k] = s0;
+        AdpcmMash8(ch, chans, v, ip, n, st, d);
+        for (k=0; k<7; k++) d0[k] = d[k];
+}
+#endif
+
+static AdpcmTrials_t AdpcmTrials = AdpcmTrials_c;
+
+void lsx_adpcm_dispatch(unsigned cpu)
+{
+#if defined HAVE_ADPCM_SSE41
+  if (cpu & LSX_CPU_SSE41)
+    AdpcmTrials = AdpcmTrials_sse41;
+#endif
+  (void)cpu;
+}
+
 static inline void AdpcmMashChannel(
         unsigned ch,             /* channel number to encode, REQUIRE 0 <= ch < chans  */
         unsigned chans,          /* total channels */
         const SAMPL *ip,    /* ip[] is interleaved input samples */
         int n,              /* samples to encode PER channel, REQUIRE */
         int *st,            /* input/output steps, 16<=st[i] */
-        unsigned char *obuff /* output buffer[blockAlign] */
+        unsigned char *obuff,/* output buffer[blockAlign] */
+        unsigned char *codes /* codes[n*chans] */
 )
 {
         SAMPL v[2];
-        int n0,s0,s1,ss,smin;
+        int s0,smin,d0[7],d1[7],s1[7];
         int dmin,k,kmin;
 
-        n0 = n/2; if (n0>32) n0=32;
         if (*st<16) *st = 16;
         v[1] = ip[ch];
         v[0] = ip[ch+chans];
 
-        dmin = 0; kmin = 0; smin = 0;
         /* for each of 7 standard coeff sets, we try compression
          * beginning with last step-value, and with slightly
          * forward-adjusted step-value, taking best of the 14
          */
+        s0 = *st;
+        AdpcmTrials(ch, chans, v, ip, n, s0, d0, d1, s1);
+        dmin = 0; kmin = 0; smin = 0;
         for (k=0; k<7; k++) {
-                int d0,d1;
-                ss = s0 = *st;
-                d0=AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[k], ip, n, &ss, NULL); /* with step s0 */
-
-                s1 = s0;
-                AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[k], ip, n0, &s1, NULL);
-                lsx_debug_more(" s32 %d\n",s1);
-                ss = s1 = (3*s0+s1)/4;
-                d1=AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[k], ip, n, &ss, NULL); /* with step s1 */
-                if (!k || d0<dmin || d1<dmin) {
+                if (!k || d0[k]<dmin || d1[k]<dmin) {
                         kmin = k;
-                        if (d0<=d1) {
-                                dmin = d0;
+                        if (d0[k]<=d1[k]) {
+                                dmin = d0[k];
                                 smin = s0;
                         }else{
-                                dmin = d1;
-                                smin = s1;
+                                dmin = d1[k];
+                                smin = s1[k];
                         }
                 }
         }
         *st = smin;
         lsx_debug_more("kmin %d, smin %5d, ",kmin,smin);
-        AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[kmin], ip, n, st, obuff);
+        AdpcmMashS(ch, chans, v, lsx_ms_adpcm_i_coef[kmin], ip, n, st, obuff, codes);
         obuff[ch] = kmin;
 }
 
+/* lsx_ms_adpcm_blocks_mash_i() compresses nblocks blocks, as many calls of
+ * lsx_ms_adpcm_block_mash_i() would.  Each channel's step carries from block
+ * to block, so it is the channels that are compressed at once, up to threads
+ * of them. */
+void lsx_ms_adpcm_blocks_mash_i(
+        unsigned chans,          /* total channels */
+        const SAMPL *ip,    /* ip[nblocks*n*chans] is interleaved input samples */
+        int n,              /* samples to encode PER channel, per block */
+        int *st,            /* input/output steps, 16<=st[i] */
+        unsigned char *obuff,      /* output buffer[nblocks*blockAlign] */
+        int blockAlign,     /* >= 7*chans + chans*(n-2)/2.0    */
+        size_t nblocks,
+        unsigned threads
+)
+{
+        unsigned char *codes = lsx_malloc((size_t)n*chans*nblocks);
+        size_t i;
+        int ch;
+
+        lsx_debug_more("AdpcmMashI(chans %d, ip %p, n %d, st %p, obuff %p, bA %d, blocks %lu)\n",
+            chans, (void *)ip, n, (void *)st, obuff, blockAlign, (unsigned long)nblocks);
+
+        #pragma omp parallel for if(threads > 1 && chans > 1) \
+            num_threads(threads) schedule(static) private(i)
+        for (ch=0; ch<(int)chans; ch++)
+                for (i=0; i<nblocks; i++)
+                        AdpcmMashChannel((unsigned)ch, chans, ip + i*n*chans, n,
+                            st+ch, obuff + i*blockAlign, codes + i*n*chans);
+
+        for (i=0; i<nblocks; i++) { /* Pack the codes 2 to a byte */
+                unsigned char *p = obuff + i*blockAlign + 7*chans;
+                unsigned char const *c = codes + i*n*chans + 2*chans;
+                unsigned char const *ctop = c + (n-2)*chans;
+
+                for (; c+1 < ctop; c += 2) *p++ = (c[0]<<4) | c[1];
+                if (c < ctop) *p++ = c[0]<<4;
+                while (p < obuff + (i+1)*blockAlign) *p++ = 0;
+        }
+        free(codes);
+}
+
 void lsx_ms_adpcm_block_mash_i(
         unsigned chans,          /* total channels */
         const SAMPL *ip,    /* ip[n*chans] is interleaved input samples */
@@ -309,16 +518,7 @@ void lsx_ms_adpcm_block_mash_i(
         int blockAlign      /* >= 7*chans + chans*(n-2)/2.0    */
 )
 {
-        unsigned ch;
-        unsigned char *p;
-
-        lsx_debug_more("AdpcmMashI(chans %d, ip %p, n %d, st %p, obuff %p, bA %d)\n",
-            chans, (void *)ip, n, (void *)st, obuff, blockAlign);
-
-        for (p=obuff+7*chans; p<obuff+blockAlign; p++) *p=0;
-
-        for (ch=0; ch<chans; ch++)
-                AdpcmMashChannel(ch, chans, ip, n, st+ch, obuff);
+        lsx_ms_adpcm_blocks_mash_i(chans, ip, n, st, obuff, blockAlign, (size_t)1, 1);
 }
 
 /*
@@ -42,6 +42,21 @@ extern const char *lsx_ms_adpcm_block_expand_i(
 	int n               /* samples to decode PER channel, REQUIRE n % 8 == 1  */
 );
 
+/* lsx_ms_adpcm_blocks_expand_i() does so for nblocks whole blocks, up to
+ * threads at once; priv is from lsx_ms_adpcm_alloc(chans*nblocks) */
+extern const char *lsx_ms_adpcm_blocks_expand_i(
+	void *priv,
+	unsigned chans,          /* total channels             */
+	int nCoef,
+	const short *coef,
+	const unsigned char *ibuff,/* input buffer[nblocks*blockAlign] */
+	size_t blockAlign,
+	SAMPL *obuff,       /* output samples, nblocks*n*chans */
+	int n,              /* samples to decode PER channel */
+	size_t nblocks,
+	unsigned threads
+);
+
 extern void lsx_ms_adpcm_block_mash_i(
 	unsigned chans,          /* total channels */
 	const SAMPL *ip,    /* ip[n*chans] is interleaved input samples */
@@ -51,6 +66,18 @@ extern void lsx_ms_adpcm_block_mash_i(
 	int blockAlign      /* >= 7*chans + n/2          */
 );
 
+/* mash nblocks blocks; up to threads channels at once */
+extern void lsx_ms_adpcm_blocks_mash_i(
+	unsigned chans,          /* total channels */
+	const SAMPL *ip,    /* ip[nblocks*n*chans] is interleaved input samples */
+	int n,              /* samples to encode PER channel */
+	int *st,            /* input/output steps, 16<=st[i] */
+	unsigned char *obuff,      /* output buffer[nblocks*blockAlign] */
+	int blockAlign,     /* >= 7*chans + n/2          */
+	size_t nblocks,
+	unsigned threads
+);
+
 /* Some helper functions for computing samples/block and blockalign */
 
 /*
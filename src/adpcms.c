@@ -100,6 +100,112 @@ int lsx_adpcm_encode(int sample, adpcm_t * p)
   return code;
 }
 
+/* Decodes frames of codes for each of lanes states (which must be of the
+ * same type), codes[i * lanes + l] being the i-th code for state l, to out[]
+ * likewise.  The lanes may be the channels of a stream or independent
+ * streams; each depends only on its own last state, so they are decoded side
+ * by side: a frame at a time here, so that the lanes' chains overlap, or 8
+ * lanes to a vector by the AVX2 kernel. */
+static void decode_lanes_c(adpcm_t * p, size_t lanes, uint8_t const * codes,
+    size_t frames, short * out, size_t first_lane)
+{
+  size_t i, l;
+
+  for (i = 0; i < frames; ++i, codes += lanes, out += lanes)
+    for (l = first_lane; l < lanes; ++l)
+      out[l] = (short)lsx_adpcm_decode(codes[l], p + l);
+}
+
+#if defined HAVE_LSX_TARGET
+  #define HAVE_ADPCMS_AVX2 1  /* Built regardless of -m options */
+  #include <immintrin.h>
+  #define ADPCMS_TARGET LSX_TARGET("avx2")
+#endif
+
+#if defined HAVE_ADPCMS_AVX2
+/* lsx_adpcm_decode for 8 lanes at a time (lanes 0 to 8n - 1); the step and
+ * step-change tables are looked up by gathers.  Results are identical. */
+ADPCMS_TARGET static size_t decode_lanes_avx2(adpcm_t * p, size_t lanes,
+    uint8_t const * codes, size_t frames, short * out)
+{
+  adpcm_setup_t const * setup = &p->setup;
+  __m256i const sign = _mm256_set1_epi32(setup->sign);
+  __m256i const mag_mask = _mm256_set1_epi32(setup->sign - 1);
+  __m256i const mask = _mm256_set1_epi32(setup->mask);
+  __m256i const one = _mm256_set1_epi32(1), zero = _mm256_setzero_si256();
+  __m256i const min16 = _mm256_set1_epi32(min_sample);
+  __m256i const max16 = _mm256_set1_epi32(max_sample);
+  __m256i const max_index = _mm256_set1_epi32(setup->max_step_index);
+  __m128i const shift = _mm_cvtsi32_si128(setup->shift + 1);
+  size_t g, i, l, groups = lanes / 8;
+
+  for (g = 0; g < groups; ++g) {
+    adpcm_t * q = p + 8 * g;
+    uint8_t const * c = codes + 8 * g;
+    short * o = out + 8 * g;
+    int last[8], index[8], errors[8];
+    __m256i x, k, e = zero;
+
+    for (l = 0; l < 8; ++l)
+      last[l] = q[l].last_output, index[l] = q[l].step_index;
+    x = _mm256_loadu_si256((__m256i const *)last);
+    k = _mm256_loadu_si256((__m256i const *)index);
+    for (i = 0; i < frames; ++i, c += lanes, o += lanes) {
+      __m256i code = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const *)c));
+      __m256i mag = _mm256_and_si256(code, mag_mask);
+      __m256i step = _mm256_i32gather_epi32(setup->steps, k, 4);
+      __m256i neg = _mm256_cmpeq_epi32(_mm256_and_si256(code, sign), sign);
+      __m256i d = _mm256_or_si256(_mm256_slli_epi32(mag, 1), one);
+      __m256i grace = _mm256_and_si256(_mm256_sra_epi32(step, shift), mask);
+      __m256i bad;
+
+      d = _mm256_and_si256(_mm256_sra_epi32(_mm256_mullo_epi32(step, d), shift), mask);
+      d = _mm256_sub_epi32(_mm256_xor_si256(d, neg), neg);
+      d = _mm256_add_epi32(d, x);
+      bad = _mm256_or_si256(
+          _mm256_cmpgt_epi32(_mm256_sub_epi32(min16, grace), d),
+          _mm256_cmpgt_epi32(d, _mm256_add_epi32(max16, grace)));
+      e = _mm256_sub_epi32(e, bad);
+      x = _mm256_min_epi32(_mm256_max_epi32(d, min16), max16);
+      k = _mm256_add_epi32(k, _mm256_i32gather_epi32(setup->changes, mag, 4));
+      k = _mm256_min_epi32(_mm256_max_epi32(k, zero), max_index);
+      _mm_storeu_si128((__m128i *)o, _mm_packs_epi32(
+            _mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1)));
+    }
+    _mm256_storeu_si256((__m256i *)last, x);
+    _mm256_storeu_si256((__m256i *)index, k);
+    _mm256_storeu_si256((__m256i *)errors, e);
+    for (l = 0; l < 8; ++l) {
+      q[l].last_output = last[l], q[l].step_index = index[l];
+      q[l].errors += errors[l];
+    }
+  }
+  return 8 * groups;
+}
+#endif
+
+static sox_bool use_avx2;
+
+void lsx_adpcms_dispatch(unsigned cpu)
+{
+#if defined HAVE_ADPCMS_AVX2
+  use_avx2 = !!(cpu & LSX_CPU_AVX2);
+#endif
+  (void)cpu;
+}
+
+void lsx_adpcm_decode_lanes(adpcm_t * p, size_t lanes, uint8_t const * codes,
+    size_t frames, short * out)
+{
+  size_t first_lane = 0;
+
+#if defined HAVE_ADPCMS_AVX2
+  if (use_avx2 && lanes >= 8)
+    first_lane = decode_lanes_avx2(p, lanes, codes, frames, out);
+#endif
+  if (first_lane < lanes)
+    decode_lanes_c(p, lanes, codes, frames, out, first_lane);
+}
 
 /*
  * Format methods
@@ -127,6 +233,9 @@ void lsx_adpcm_reset(adpcm_io_t * state, sox_encoding_t type)
   state->store.flag = 0;
 
   lsx_adpcm_init(&state->encoder, (type == SOX_ENCODING_OKI_ADPCM) ? 1 : 0, 0);
+  for (state->lane = 0; state->lane < state->channels; ++state->lane)
+    state->decoders[state->lane] = state->encoder;
+  state->lane = 0;
 }
 
 /******************************************************************************
@@ -149,9 +258,14 @@ void lsx_adpcm_reset(adpcm_io_t * state, sox_encoding_t type)
 static int adpcm_start(sox_format_t * ft, adpcm_io_t * state, sox_encoding_t type)
 {
   /* setup file info */
-  state->file.buf = lsx_malloc(sox_globals.bufsiz);
-  state->file.size = sox_globals.bufsiz;
-  ft->signal.channels = 1;
+  state->file.buf = lsx_malloc(ft->context->bufsiz);
+  state->file.size = ft->context->bufsiz;
+  /* Reading, each channel has its own state, the nibbles interleaved */
+  if (ft->mode == 'r' && ft->signal.channels > 1) {
+    state->channels = ft->signal.channels;
+    state->decoders = lsx_malloc(state->channels * sizeof(*state->decoders));
+  }
+  else ft->signal.channels = 1;
 
   lsx_adpcm_reset(state, type);
 
@@ -183,28 +297,51 @@ int lsx_adpcm_ima_start(sox_format_t * ft, adpcm_io_t * state)
 
 size_t lsx_adpcm_read(sox_format_t * ft, adpcm_io_t * state, sox_sample_t * buffer, size_t len)
 {
-  size_t n = 0;
-  uint8_t byte;
-  int16_t word;
-
-  if (len && state->store.flag) {
-    word = lsx_adpcm_decode(state->store.byte, &state->encoder);
-    *buffer++ = SOX_SIGNED_16BIT_TO_SAMPLE(word, ft->clips);
-    state->store.flag = 0;
-    ++n;
+  adpcm_t * dec = state->decoders? state->decoders : &state->encoder;
+  size_t chans = state->decoders? state->channels : 1;
+  size_t n = 0, i, k, want, bytes, got;
+
+  if (!state->codes) {
+    state->codes = lsx_malloc(2 * state->file.size + 1); /* 1 held over */
+    state->pcm = lsx_malloc(2 * state->file.size * sizeof(*state->pcm));
   }
-  while (n < len && lsx_read_b_buf(ft, &byte, (size_t) 1) == 1) {
-    word = lsx_adpcm_decode(byte >> 4, &state->encoder);
-    *buffer++ = SOX_SIGNED_16BIT_TO_SAMPLE(word, ft->clips);
-
-    if (++n < len) {
-      word = lsx_adpcm_decode(byte, &state->encoder);
-      *buffer++ = SOX_SIGNED_16BIT_TO_SAMPLE(word, ft->clips);
-      ++n;
-    } else {
-      state->store.byte = byte;
+  while (n < len) {
+    uint8_t * codes = state->codes, * bytes_in = (uint8_t *)state->file.buf;
+    short * pcm = state->pcm;
+
+    want = min(len - n, 2 * state->file.size);
+    k = 0;
+    if (state->store.flag) {
+      codes[k++] = state->store.byte & 15;
+      state->store.flag = 0;
+    }
+    bytes = (want - k + 1) / 2;
+    got = lsx_read_b_buf(ft, bytes_in, bytes);
+    for (i = 0; i < got; ++i) {
+      codes[k++] = bytes_in[i] >> 4;
+      codes[k++] = bytes_in[i] & 15;
+    }
+    if (k > want) {       /* Keep the last nibble for next time */
+      state->store.byte = bytes_in[got - 1];
       state->store.flag = 1;
+      --k;
     }
+    if (!k)
+      break;
+
+    /* Up to the first whole frame, the whole frames, then the rest: */
+    for (i = 0; i < k && state->lane; ++i, state->lane = (state->lane + 1) % chans)
+      pcm[i] = (short)lsx_adpcm_decode(codes[i], dec + state->lane);
+    want = (k - i) / chans;
+    lsx_adpcm_decode_lanes(dec, chans, codes + i, want, pcm + i);
+    for (i += want * chans; i < k; ++i, state->lane = (state->lane + 1) % chans)
+      pcm[i] = (short)lsx_adpcm_decode(codes[i], dec + state->lane);
+
+    for (i = 0; i < k; ++i)
+      buffer[n + i] = SOX_SIGNED_16BIT_TO_SAMPLE(pcm[i], ft->clips);
+    n += k;
+    if (got < bytes)
+      break;
   }
   return n;
 }
@@ -221,9 +358,16 @@ size_t lsx_adpcm_read(sox_format_t * ft, adpcm_io_t * state, sox_sample_t * buff
 
 int lsx_adpcm_stopread(sox_format_t * ft UNUSED, adpcm_io_t * state)
 {
-  if (state->encoder.errors)
-    lsx_warn("%s: ADPCM state errors: %u", ft->filename, state->encoder.errors);
+  unsigned i, errors = state->decoders? 0 : state->encoder.errors;
+
+  for (i = 0; i < state->channels; ++i)
+    errors += state->decoders[i].errors;
+  if (errors)
+    lsx_warn("%s: ADPCM state errors: %u", ft->filename, errors);
   free(state->file.buf);
+  free(state->decoders);
+  free(state->codes);
+  free(state->pcm);
 
   return (SOX_SUCCESS);
 }
@@ -34,9 +34,15 @@ typedef struct {
 void lsx_adpcm_init(adpcm_t * p, int type, int first_sample);
 int lsx_adpcm_decode(int code, adpcm_t * p);
 int lsx_adpcm_encode(int sample, adpcm_t * p);
+void lsx_adpcm_decode_lanes(adpcm_t * p, size_t lanes, uint8_t const * codes,
+    size_t frames, short * out);
 
 typedef struct {
   adpcm_t encoder;
+  adpcm_t * decoders;           /* Per channel, if reading more than one */
+  unsigned channels, lane;      /* lane: the channel of the next sample */
+  uint8_t * codes;              /* Read: unpacked, & */
+  short * pcm;                  /* decoded */
   struct {
     uint8_t byte;               /* write store */
     uint8_t flag;
@@ -27,10 +27,11 @@ LSX_FORMAT_HANDLER(aifc)
     0};
   static sox_format_handler_t const sox_aifc_format = {SOX_LIB_VERSION_CODE,
     "AIFF-C (not compressed), defined in DAVIC 1.4 Part 9 Annex B",
-    names, SOX_FILE_BIG_END,
+    names, SOX_FILE_BIG_END | SOX_FILE_MMAP | SOX_FILE_RAWPCM | SOX_FILE_CLONE,
     lsx_aiffstartread, lsx_rawread, lsx_aiffstopread,
     lsx_aifcstartwrite, lsx_rawwrite, lsx_aifcstopwrite,
-    lsx_rawseek, write_encodings, NULL, 0
+    lsx_rawseek, write_encodings, NULL, 0, NULL, lsx_aiff_rewrite_comments,
+    NULL, NULL
   };
   return &sox_aifc_format;
 }
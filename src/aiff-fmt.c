@@ -24,10 +24,11 @@ LSX_FORMAT_HANDLER(aiff)
   static unsigned const write_encodings[] = {
     SOX_ENCODING_SIGN2, 32, 24, 16, 8, 0, 0};
   static sox_format_handler_t const sox_aiff_format = {SOX_LIB_VERSION_CODE,
-    "AIFF files used on Apple IIc/IIgs and SGI", names, SOX_FILE_BIG_END,
+    "AIFF files used on Apple IIc/IIgs and SGI", names, SOX_FILE_BIG_END | SOX_FILE_MMAP | SOX_FILE_RAWPCM | SOX_FILE_CLONE,
     lsx_aiffstartread, lsx_rawread, lsx_aiffstopread,
     lsx_aiffstartwrite, lsx_rawwrite, lsx_aiffstopwrite,
-    lsx_rawseek, write_encodings, NULL, 0
+    lsx_rawseek, write_encodings, NULL, 0, NULL, lsx_aiff_rewrite_comments,
+    NULL, NULL
   };
   return &sox_aiff_format;
 }
@@ -710,7 +710,7 @@ static int aiffwriteheader(sox_format_t * ft, uint64_t nframes)
 
           /* time stamp of comment, Unix knows of time from 1/1/1970,
              Apple knows time from 1/1/1904 */
-          lsx_writedw(ft, (unsigned)((sox_globals.repeatable? 0 : time(NULL)) + 2082844800));
+          lsx_writedw(ft, (unsigned)((ft->context->repeatable? 0 : time(NULL)) + 2082844800));
 
           /* A marker ID of 0 indicates the comment is not associated
              with a marker */
@@ -932,6 +932,39 @@ static int aifcwriteheader(sox_format_t * ft, uint64_t nframes)
         return(SOX_SUCCESS);
 }
 
+/* As aiffwriteheader, the comments become one COMT chunk; any ANNO chunks
+ * (read as comments too) are replaced by it. */
+int lsx_aiff_rewrite_comments(char const * path, sox_comments_t comments)
+{
+  static char const * const ids[] = {"COMT", "ANNO", NULL};
+  char * text = lsx_cat_comments(comments);
+  size_t len = strlen(text), padded = len + (len & 1);
+  unsigned char * data = NULL;
+  uint32_t stamp;
+  int result;
+
+  if (comments && *comments) {
+    if (padded > 65535) {
+      lsx_fail("`%s': comments too long for an AIFF COMT chunk", path);
+      free(text);
+      return SOX_EOF;
+    }
+    stamp = (sox_globals.repeatable? 0 : time(NULL)) + 2082844800;
+    data = lsx_calloc(10 + padded, sizeof(*data));
+    data[1] = 1;                  /* One comment, */
+    data[2] = stamp >> 24, data[3] = stamp >> 16 & 255;
+    data[4] = stamp >> 8 & 255, data[5] = stamp & 255;
+    /* with marker ID 0, */
+    data[8] = padded >> 8, data[9] = padded & 255;
+    memcpy(data + 10, text, len);
+  }
+  result = lsx_rewrite_chunk(path, "FORM", sox_true, ids, NULL, "FLLR",
+      "COMT", data, data? 10 + padded : 0);
+  free(data);
+  free(text);
+  return result;
+}
+
 static double read_ieee_extended(sox_format_t * ft)
 {
         unsigned char buf[10];
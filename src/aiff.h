@@ -20,3 +20,4 @@ int lsx_aiffstartwrite(sox_format_t * ft);
 int lsx_aiffstopwrite(sox_format_t * ft);
 int lsx_aifcstartwrite(sox_format_t * ft);
 int lsx_aifcstopwrite(sox_format_t * ft);
+int lsx_aiff_rewrite_comments(char const * path, sox_comments_t comments);
@@ -137,8 +137,8 @@ static int setup(sox_format_t * ft)
   else lsx_debug("snd_pcm_hw_params_get_sbits can't tell precision: %s",
            snd_strerror(err));
 
-  /* Set buf_len > > sox_globals.bufsiz for no underrun: */
-  p->buf_len = sox_globals.bufsiz * 8 / formats[p->format].bytes /
+  /* Set buf_len > > ft->context->bufsiz for no underrun: */
+  p->buf_len = ft->context->bufsiz * 8 / formats[p->format].bytes /
       ft->signal.channels;
   _(snd_pcm_hw_params_get_buffer_size_min, (params, &min));
   _(snd_pcm_hw_params_get_buffer_size_max, (params, &max));
@@ -373,7 +373,7 @@ LSX_FORMAT_HANDLER(alsa)
     "Advanced Linux Sound Architecture device driver",
     names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
     setup, read_, stop, setup, write_, stop_write,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -341,7 +341,7 @@ sox_format_handler_t const * AMR_FORMAT_FN(void)
     names, SOX_FILE_MONO,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, write_rates, sizeof(priv_t)
+    NULL, write_encodings, write_rates, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -35,7 +35,7 @@ static int startwrite(sox_format_t * ft)
 {
   priv_t * ao = (priv_t *)ft->priv;
 
-  ao->buf_size = sox_globals.bufsiz - (sox_globals.bufsiz % (ft->encoding.bits_per_sample >> 3));
+  ao->buf_size = ft->context->bufsiz - (ft->context->bufsiz % (ft->encoding.bits_per_sample >> 3));
   ao->buf_size *= (ft->encoding.bits_per_sample >> 3);
   ao->buf = lsx_malloc(ao->buf_size);
 
@@ -128,7 +128,7 @@ LSX_FORMAT_HANDLER(ao)
     "Xiph's libao device driver", names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
     NULL, NULL, NULL,
     startwrite, write_samples, stopwrite,
-    NULL, encodings, NULL, sizeof(priv_t)
+    NULL, encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
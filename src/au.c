@@ -79,46 +79,45 @@ static sox_encoding_t sox_enc(uint32_t ft_encoding, unsigned * size)
   }
 }
 
+#define G72X_BYTES 1024     /* Codes are read from the file a block at a time */
+
 typedef struct {        /* For G72x decoding: */
   struct g72x_state state;
   int (*dec_routine)(int i, int out_coding, struct g72x_state *state_ptr);
   unsigned int in_buffer;
   int in_bits;
+  unsigned char bytes[G72X_BYTES];
+  size_t pos, len;      /* Of the unused bytes in bytes[] */
 } priv_t;
 
 /*
- * Unpack input codes and pass them back as bytes.
- * Returns 1 if there is residual input, returns -1 if eof, else returns 0.
- * (Adapted from Sun's decode.c.)
+ * Unpack input codes (adapted from Sun's decode.c) and decode them.  Bytes
+ * are taken from a block read ahead; since G.72x files cannot seek, the
+ * block need never be discarded.
  */
-static int unpack_input(sox_format_t * ft, unsigned char *code)
-{
-  priv_t * p = (priv_t *) ft->priv;
-  unsigned char           in_byte;
-
-  if (p->in_bits < (int)ft->encoding.bits_per_sample) {
-    if (lsx_read_b_buf(ft, &in_byte, (size_t) 1) != 1) {
-      *code = 0;
-      return -1;
-    }
-    p->in_buffer |= (in_byte << p->in_bits);
-    p->in_bits += 8;
-  }
-  *code = p->in_buffer & ((1 << ft->encoding.bits_per_sample) - 1);
-  p->in_buffer >>= ft->encoding.bits_per_sample;
-  p->in_bits -= ft->encoding.bits_per_sample;
-  return p->in_bits > 0;
-}
-
 static size_t dec_read(sox_format_t *ft, sox_sample_t *buf, size_t samp)
 {
   priv_t * p = (priv_t *)ft->priv;
-  unsigned char code;
+  int bits = (int)ft->encoding.bits_per_sample;
+  unsigned mask = (1u << bits) - 1;
   size_t done;
 
-  for (done = 0; samp > 0 && unpack_input(ft, &code) >= 0; ++done, --samp)
-    *buf++ = SOX_SIGNED_16BIT_TO_SAMPLE(
-        (*p->dec_routine)(code, AUDIO_ENCODING_LINEAR, &p->state),);
+  for (done = 0; done < samp; ++done) {
+    if (p->in_bits < bits) {
+      if (p->pos == p->len) {
+        p->len = lsx_read_b_buf(ft, p->bytes, sizeof(p->bytes));
+        p->pos = 0;
+        if (!p->len)
+          break;
+      }
+      p->in_buffer |= (unsigned)p->bytes[p->pos++] << p->in_bits;
+      p->in_bits += 8;
+    }
+    buf[done] = SOX_SIGNED_16BIT_TO_SAMPLE((*p->dec_routine)(
+          (int)(p->in_buffer & mask), AUDIO_ENCODING_LINEAR, &p->state),);
+    p->in_buffer >>= bits;
+    p->in_bits -= bits;
+  }
   return done;
 }
 
@@ -228,10 +227,10 @@ LSX_FORMAT_HANDLER(au)
     0};
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
     "PCM file format used widely on Sun systems",
-    names, SOX_FILE_BIG_END | SOX_FILE_REWIND,
+    names, SOX_FILE_BIG_END | SOX_FILE_REWIND | SOX_FILE_RAWPCM,
     startread, lsx_rawread, NULL,
     write_header, lsx_rawwrite, NULL,
-    lsx_rawseek, write_encodings, NULL, sizeof(priv_t)
+    lsx_rawseek, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
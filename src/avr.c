@@ -281,7 +281,7 @@ LSX_FORMAT_HANDLER(avr)
     names, SOX_FILE_BIG_END | SOX_FILE_MONO | SOX_FILE_STEREO,
     startread, lsx_rawread, NULL,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
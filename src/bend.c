@@ -34,6 +34,7 @@
 
 #include "sox_i.h"
 #include <assert.h>
+#include <float.h>
 
 #define MAX_FRAME_LENGTH 8192
 
@@ -54,7 +55,9 @@ typedef struct {
 
   float gInFIFO[MAX_FRAME_LENGTH];
   float gOutFIFO[MAX_FRAME_LENGTH];
-  double gFFTworksp[2 * MAX_FRAME_LENGTH];
+  float gFFTworksp[MAX_FRAME_LENGTH];
+  float window[MAX_FRAME_LENGTH];           /* Hann */
+  float expct[MAX_FRAME_LENGTH / 2 + 1];    /* Phase advance per step, wrapped */
   float gLastPhase[MAX_FRAME_LENGTH / 2 + 1];
   float gSumPhase[MAX_FRAME_LENGTH / 2 + 1];
   float gOutputAccum[2 * MAX_FRAME_LENGTH];
@@ -139,10 +142,15 @@ static int start(sox_effect_t * effp)
 {
   priv_t *p = (priv_t *) effp->priv;
   unsigned i;
+  int k;
 
   int n = effp->in_signal.rate / p->frame_rate + .5;
   for (p->fftFrameSize = 2; n > 2; p->fftFrameSize <<= 1, n >>= 1);
   assert(p->fftFrameSize <= MAX_FRAME_LENGTH);
+  for (k = 0; k < p->fftFrameSize; ++k)
+    p->window[k] = -.5 * cos(2 * M_PI * k / p->fftFrameSize) + .5;
+  for (k = 0; k <= p->fftFrameSize / 2; ++k)   /* k * 2pi / ovsamp */
+    p->expct[k] = 2 * M_PI * (k % p->ovsamp) / p->ovsamp;
   p->shift = 1;
   parse(effp, 0, effp->in_signal.rate); /* Re-parse now rate is known */
   p->in_pos = p->bends_pos = 0;
@@ -152,22 +160,121 @@ static int start(sox_effect_t * effp)
   return SOX_EFF_NULL;
 }
 
+/* The vocoder's per-bin conversions between rectangular and polar form use
+ * these approximations (good to about 2e-6 rad), branch-free so that the
+ * loops using them vectorise. */
+
+static float wrap(float x) /* To [-pi, pi] */
+{
+  float n = x * (float)(.5 / M_PI);
+  n = (n + 12582912.f) - 12582912.f;   /* Round to nearest; |n| < 2^22 */
+  return x - n * (float)(2 * M_PI);
+}
+
+static float fast_atan2(float y, float x)
+{
+  float ax = fabsf(x), ay = fabsf(y);
+  float hi = max(ax, ay), lo = min(ax, ay);
+  float a = lo / max(hi, FLT_MIN), s = a * a;
+  float r = a * (.99997726f + s * (-.33262347f + s * (.19354346f +
+        s * (-.11643287f + s * (.05265332f + s * -.01172120f)))));
+
+  r = (ay > ax? (float)(M_PI / 2) : 0) + (ay > ax? -r : r);
+  r = (x < 0? (float)M_PI : 0) + (x < 0? -r : r);
+  return y < 0? -r : r;
+}
+
+static void fast_sincos(float x, float * s, float * c) /* |x| <= pi */
+{
+  float q = (x * (float)(2 / M_PI) + 12582912.f) - 12582912.f;
+  float r = x - q * (float)(M_PI / 2), r2 = r * r;
+  float sr = r + r * r2 * (-1.f/6 + r2 * (1.f/120 + r2 * (-1.f/5040)));
+  float cr = 1 + r2 * (-.5f + r2 * (1.f/24 + r2 * (-1.f/720 + r2 * (1.f/40320))));
+  int quad = (int)q & 3;
+
+  *s = quad == 0? sr : quad == 1? cr : quad == 2? -sr : -cr;
+  *c = quad == 0? cr : quad == 1? -sr : quad == 2? -cr : sr;
+}
+
+/* Shifts the pitch of one frame, with a real DFT of length n (whose layout
+ * is x[0] = re(0), x[1] = re(n/2), x[2k] = re(k), x[2k+1] = -im(k)) */
+static void process_frame(priv_t * p, float pitchShift, float freqPerBin)
+{
+  int k, n = p->fftFrameSize, n2 = n / 2;
+  int stepSize = n / p->ovsamp, inFifoLatency = n - stepSize;
+  long index;
+  float * x = p->gFFTworksp, gain = 2.f / (n2 * p->ovsamp);
+  float * re = p->gSynMagn, * im = p->gSynFreq; /* Free until shifting */
+
+  for (k = 0; k < n; k++)
+    x[k] = p->gInFIFO[k] * p->window[k];
+
+  /* ***************** ANALYSIS ******************* */
+  lsx_safe_rdft_f(n, 1, x);
+  re[0] = x[0], im[0] = 0;
+  re[n2] = x[1], im[n2] = 0;
+  for (k = 1; k < n2; k++)
+    re[k] = x[2 * k], im[k] = - x[2 * k + 1];
+  for (k = 0; k <= n2; k++) {
+    float phase = fast_atan2(im[k], re[k]);
+    float tmp = wrap(phase - p->gLastPhase[k] - p->expct[k]);
+
+    p->gLastPhase[k] = phase;
+    /* the k-th partial's true frequency, from its deviation from the bin's */
+    p->gAnaFreq[k] = (k + p->ovsamp * tmp * (float)(.5 / M_PI)) * freqPerBin;
+  }
+  for (k = 0; k <= n2; k++)  /* Apart, as sqrt (setting errno) won't vectorise */
+    p->gAnaMagn[k] = 2 * sqrt(re[k] * re[k] + im[k] * im[k]);
+
+  /* this does the actual pitch shifting */
+  memset(p->gSynMagn, 0, n * sizeof(float));
+  memset(p->gSynFreq, 0, n * sizeof(float));
+  for (k = 0; k <= n2; k++) {
+    index = k * pitchShift;
+    if (index <= n2) {
+      p->gSynMagn[index] += p->gAnaMagn[k];
+      p->gSynFreq[index] = p->gAnaFreq[k] * pitchShift;
+    }
+  }
+
+  /* ***************** SYNTHESIS ******************* */
+  re = p->gAnaMagn, im = p->gAnaFreq;           /* Free after shifting */
+  for (k = 0; k <= n2; k++) {
+    float tmp = (p->gSynFreq[k] / freqPerBin - k) * (float)(2 * M_PI) / p->ovsamp;
+    float s, c;
+
+    p->gSumPhase[k] = wrap(p->gSumPhase[k] + tmp + p->expct[k]);
+    fast_sincos(p->gSumPhase[k], &s, &c);
+    re[k] = p->gSynMagn[k] * c;
+    im[k] = - p->gSynMagn[k] * s;
+  }
+  for (k = 1; k < n2; k++)
+    x[2 * k] = re[k], x[2 * k + 1] = im[k];
+  x[0] = 2 * re[0], x[1] = 2 * re[n2];  /* The real inverse halves these */
+  lsx_safe_rdft_f(n, -1, x);
+
+  /* do windowing and add to output accumulator */
+  for (k = 0; k < n; k++)
+    p->gOutputAccum[k] += gain * p->window[k] * x[k];
+  for (k = 0; k < stepSize; k++)
+    p->gOutFIFO[k] = p->gOutputAccum[k];
+
+  memmove(p->gOutputAccum, /* shift accumulator */
+      p->gOutputAccum + stepSize, n * sizeof(float));
+
+  for (k = 0; k < inFifoLatency; k++) /* move input FIFO */
+    p->gInFIFO[k] = p->gInFIFO[k + stepSize];
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
                 sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t *p = (priv_t *) effp->priv;
   size_t i, len = *isamp = *osamp = min(*isamp, *osamp);
-  double magn, phase, tmp, window, real, imag;
-  double freqPerBin, expct;
-  long k, qpd, index, inFifoLatency, stepSize, fftFrameSize2;
+  long inFifoLatency = p->fftFrameSize - p->fftFrameSize / p->ovsamp;
   float pitchShift = p->shift;
+  float freqPerBin = effp->in_signal.rate / p->fftFrameSize;
 
-  /* set up some handy variables */
-  fftFrameSize2 = p->fftFrameSize / 2;
-  stepSize = p->fftFrameSize / p->ovsamp;
-  freqPerBin = effp->in_signal.rate / p->fftFrameSize;
-  expct = 2. * M_PI * (double) stepSize / (double) p->fftFrameSize;
-  inFifoLatency = p->fftFrameSize - stepSize;
   if (!p->gRover)
     p->gRover = inFifoLatency;
 
@@ -198,97 +305,7 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
       }
 
       p->gRover = inFifoLatency;
-
-      /* do windowing and re,im interleave */
-      for (k = 0; k < p->fftFrameSize; k++) {
-        window = -.5 * cos(2 * M_PI * k / (double) p->fftFrameSize) + .5;
-        p->gFFTworksp[2 * k] = p->gInFIFO[k] * window;
-        p->gFFTworksp[2 * k + 1] = 0.;
-      }
-
-      /* ***************** ANALYSIS ******************* */
-      lsx_safe_cdft(2 * p->fftFrameSize, 1, p->gFFTworksp);
-
-      /* this is the analysis step */
-      for (k = 0; k <= fftFrameSize2; k++) {
-        /* de-interlace FFT buffer */
-        real = p->gFFTworksp[2 * k];
-        imag = - p->gFFTworksp[2 * k + 1];
-
-        /* compute magnitude and phase */
-        magn = 2. * sqrt(real * real + imag * imag);
-        phase = atan2(imag, real);
-
-        /* compute phase difference */
-        tmp = phase - p->gLastPhase[k];
-        p->gLastPhase[k] = phase;
-
-        tmp -= (double) k *expct; /* subtract expected phase difference */
-
-        /* map delta phase into +/- Pi interval */
-        qpd = tmp / M_PI;
-        if (qpd >= 0)
-          qpd += qpd & 1;
-        else qpd -= qpd & 1;
-        tmp -= M_PI * (double) qpd;
-
-        /* get deviation from bin frequency from the +/- Pi interval */
-        tmp = p->ovsamp * tmp / (2. * M_PI);
-
-        /* compute the k-th partials' true frequency */
-        tmp = (double) k *freqPerBin + tmp * freqPerBin;
-
-        /* store magnitude and true frequency in analysis arrays */
-        p->gAnaMagn[k] = magn;
-        p->gAnaFreq[k] = tmp;
-
-      }
-
-      /* this does the actual pitch shifting */
-      memset(p->gSynMagn, 0, p->fftFrameSize * sizeof(float));
-      memset(p->gSynFreq, 0, p->fftFrameSize * sizeof(float));
-      for (k = 0; k <= fftFrameSize2; k++) {
-        index = k * pitchShift;
-        if (index <= fftFrameSize2) {
-          p->gSynMagn[index] += p->gAnaMagn[k];
-          p->gSynFreq[index] = p->gAnaFreq[k] * pitchShift;
-        }
-      }
-
-      for (k = 0; k <= fftFrameSize2; k++) { /* SYNTHESIS */
-        /* get magnitude and true frequency from synthesis arrays */
-        magn = p->gSynMagn[k], tmp = p->gSynFreq[k];
-        tmp -= (double) k *freqPerBin; /* subtract bin mid frequency */
-        tmp /= freqPerBin; /* get bin deviation from freq deviation */
-        tmp = 2. * M_PI * tmp / p->ovsamp; /* take p->ovsamp into account */
-        tmp += (double) k *expct; /* add the overlap phase advance back in */
-        p->gSumPhase[k] += tmp; /* accumulate delta phase to get bin phase */
-        phase = p->gSumPhase[k];
-        /* get real and imag part and re-interleave */
-        p->gFFTworksp[2 * k] = magn * cos(phase);
-        p->gFFTworksp[2 * k + 1] = - magn * sin(phase);
-      }
-
-      for (k = p->fftFrameSize + 2; k < 2 * p->fftFrameSize; k++)
-        p->gFFTworksp[k] = 0.; /* zero negative frequencies */
-
-      lsx_safe_cdft(2 * p->fftFrameSize, -1, p->gFFTworksp);
-
-      /* do windowing and add to output accumulator */
-      for (k = 0; k < p->fftFrameSize; k++) {
-        window =
-            -.5 * cos(2. * M_PI * (double) k / (double) p->fftFrameSize) + .5;
-        p->gOutputAccum[k] +=
-            2. * window * p->gFFTworksp[2 * k] / (fftFrameSize2 * p->ovsamp);
-      }
-      for (k = 0; k < stepSize; k++)
-        p->gOutFIFO[k] = p->gOutputAccum[k];
-
-      memmove(p->gOutputAccum, /* shift accumulator */
-          p->gOutputAccum + stepSize, p->fftFrameSize * sizeof(float));
-
-      for (k = 0; k < inFifoLatency; k++) /* move input FIFO */
-        p->gInFIFO[k] = p->gInFIFO[k + stepSize];
+      process_frame(p, (float)pitchShift, (float)freqPerBin);
     }
   }
   return SOX_SUCCESS;
@@ -319,7 +336,8 @@ sox_effect_handler_t const *lsx_bend_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "bend", "[-f frame-rate(25)] [-o over-sample(16)] {start,cents,end}",
-    0, create, start, flow, 0, stop, lsx_kill, sizeof(priv_t)
+    0, create, start, flow, 0, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -58,6 +58,17 @@ int lsx_biquad_getopts(sox_effect_t * effp, int argc, char **argv,
 }
 
 
+/* Returns how many samples it takes for the response to an impulse to fall
+ * to 2^-64 of its peak (or thereabouts), from the radius of the further pole;
+ * HUGE_VAL if the filter is unstable. */
+static double history(double a1, double a2)
+{
+  double d = a1 * a1 - 4 * a2, r = d < 0? sqrt(a2) :
+    (fabs(a1) + sqrt(d)) * .5;
+
+  return r >= 1? HUGE_VAL : r < 1e-6? 2 : 2 + 64 * log(2.) / -log(r);
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -69,9 +80,17 @@ static int start(sox_effect_t * effp)
   p->a1 /= p->a0;
 
   p->o2 = p->o1 = p->i2 = p->i1 = 0;
+  p->ramp = 0;
+  effp->history = history(p->a1, p->a2) / effp->in_signal.rate;
   return SOX_SUCCESS;
 }
 
+int lsx_biquad_reset(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  p->o2 = p->o1 = p->i2 = p->i1 = 0;
+  return SOX_SUCCESS;
+}
 
 int lsx_biquad_start(sox_effect_t * effp)
 {
@@ -142,13 +161,51 @@ int lsx_biquad_start(sox_effect_t * effp)
 }
 
 
+/* Has the filter's coefficients (as set by a filter's design, before
+ * lsx_biquad_start) ramp, sample by sample, to those of q, so that a change
+ * to the filter (see sox_effect_update) doesn't click.  The filters on the
+ * way are stable if both ends are, since the region of (a1, a2) in which a
+ * biquad is stable (a triangle) is convex. */
+int lsx_biquad_update(sox_effect_t * effp, biquad_t const * q)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double const * k = &q->b0;
+  size_t i;
+
+  p->gain = q->gain;
+  p->fc = q->fc;
+  p->width = q->width;
+  p->width_type = q->width_type;
+  p->filter_type = q->filter_type;
+  p->ramp = lsx_update_ramp(effp);
+  for (i = 0; i < 6; ++i) {
+    p->target[i] = k[i] / q->a0;
+    p->step[i] = (p->target[i] - (&p->b0)[i]) / p->ramp;
+  }
+  return SOX_SUCCESS;
+}
+
+static void ramp(priv_t * p)
+{
+  double * k = &p->b0;
+  size_t i;
+
+  if (--p->ramp)
+    for (i = 0; i < 6; ++i)
+      k[i] += p->step[i];
+  else memcpy(k, p->target, sizeof(p->target));
+}
+
 int lsx_biquad_flow(sox_effect_t * effp, const sox_sample_t *ibuf,
     sox_sample_t *obuf, size_t *isamp, size_t *osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t len = *isamp = *osamp = min(*isamp, *osamp);
   while (len--) {
-    double o0 = *ibuf*p->b0 + p->i1*p->b1 + p->i2*p->b2 - p->o1*p->a1 - p->o2*p->a2;
+    double o0;
+    if (p->ramp)
+      ramp(p);
+    o0 = *ibuf*p->b0 + p->i1*p->b1 + p->i2*p->b2 - p->o1*p->a1 - p->o2*p->a2;
     p->i2 = p->i1, p->i1 = *ibuf++;
     p->o2 = p->o1, p->o1 = o0;
     *obuf++ = SOX_ROUND_CLIP_COUNT(o0, effp->clips);
@@ -156,6 +213,113 @@ int lsx_biquad_flow(sox_effect_t * effp, const sox_sample_t *ibuf,
   return SOX_SUCCESS;
 }
 
+/* A run of biquad effects (e.g. a multi-band EQ built from several
+ * equalizer effects) is fused into one cascade of second-order sections,
+ * that takes the channels together, as vector lanes, and passes over the
+ * audio once (lsx_sos_filter); so is a lone biquad effect (e.g. deemph) on
+ * more than one channel, rather than running a flow per channel.  The
+ * sections' outputs are rounded and clipped, one to the next, just as if
+ * they were separate effects, so the result is unchanged. */
+
+typedef struct {
+  size_t   num_sections;
+  double   * coefs;          /* b0 b1 b2 a1 a2, per section */
+  double   * state;          /* i1 i2 o1 o2, per section, each per channel */
+  char     * name;           /* E.g. "bass+treble" */
+} cascade_t;
+
+static int cascade_flow(sox_effect_t * effp, const sox_sample_t *ibuf,
+    sox_sample_t *obuf, size_t *isamp, size_t *osamp)
+{
+  cascade_t * p = (cascade_t *)effp->priv;
+  size_t chans = effp->in_signal.channels;
+  size_t len = *isamp = *osamp = min(*isamp, *osamp) / chans * chans;
+
+  lsx_sos_filter(p->coefs, p->num_sections, p->state, chans, ibuf, obuf,
+      len / chans, &effp->clips);
+  return SOX_SUCCESS;
+}
+
+static int cascade_reset(sox_effect_t * effp)
+{
+  cascade_t * p = (cascade_t *)effp->priv;
+  memset(p->state, 0, 4 * p->num_sections * effp->in_signal.channels *
+      sizeof(*p->state));
+  return SOX_SUCCESS;
+}
+
+static int cascade_kill(sox_effect_t * effp)
+{
+  cascade_t * p = (cascade_t *)effp->priv;
+  free(p->coefs);
+  free(p->state);
+  free(p->name);
+  return SOX_SUCCESS;
+}
+
+static void add_section(sox_effect_t * effp, priv_t const * q, char const * name)
+{
+  cascade_t * p = (cascade_t *)effp->priv;
+  double * k;
+  char * old_name = p->name;
+
+  p->coefs = lsx_realloc(p->coefs, 5 * (p->num_sections + 1) * sizeof(*k));
+  k = p->coefs + 5 * p->num_sections++;
+  k[0] = q->b0, k[1] = q->b1, k[2] = q->b2, k[3] = q->a1, k[4] = q->a2;
+  p->name = lsx_malloc((old_name? strlen(old_name) + 1 : 0) + strlen(name) + 1);
+  sprintf(p->name, "%s%s%s", old_name? old_name : "", old_name? "+" : "", name);
+  free(old_name);
+  free(p->state);
+  p->state = lsx_calloc(4 * p->num_sections * effp->in_signal.channels,
+      sizeof(*p->state));
+  effp->handler.name = p->name;
+}
+
+/* Makes a biquad effect, of which the first `started' flows have been
+ * started, a cascade of its one section, on all channels */
+static void make_cascade(sox_effect_t * effp, size_t started)
+{
+  priv_t const * q = (priv_t *)effp->priv;
+  cascade_t * p = lsx_effect_calloc(effp, 1, sizeof(*p));
+  size_t f;
+
+  for (f = 0; f < started; ++f) {
+    effp[f].handler.stop(&effp[f]);
+    effp[f].priv = NULL;  /* Freed with the arena */
+  }
+  effp->priv = p;
+  add_section(effp, q, effp->handler.name);
+  effp->flows = 1;
+  effp->handler.flags |= SOX_EFF_MCHAN;
+  effp->handler.flow = cascade_flow;
+  effp->handler.kill = cascade_kill;
+  effp->handler.reset = cascade_reset;
+  effp->handler.update = NULL;
+  effp->handler.priv_size = sizeof(*p);
+}
+
+sox_bool lsx_biquad_fuse(sox_effects_chain_t * chain, sox_effect_t * effp)
+{
+  sox_effect_t * last = chain->length? chain->effects[chain->length - 1] : NULL;
+
+  if (effp->handler.flow != lsx_biquad_flow)
+    return sox_false;
+  if (!last || (last->handler.flow != lsx_biquad_flow &&
+        last->handler.flow != cascade_flow)) {
+    if (effp->flows > 1) {  /* Only flow 0 has been started */
+      make_cascade(effp, (size_t)1);
+      lsx_debug("%u channels filtered together", effp->in_signal.channels);
+    }
+    return sox_false;
+  }
+
+  if (last->handler.flow == lsx_biquad_flow)
+    make_cascade(last, last->flows);
+  add_section(last, (priv_t *)effp->priv, effp->handler.name);
+  last->history += effp->history;
+  return sox_true;
+}
+
 static int create(sox_effect_t * effp, int argc, char * * argv)
 {
   priv_t             * p = (priv_t *)effp->priv;
@@ -168,11 +332,23 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static int update(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t q;
+  sox_effect_t e = *effp;
+
+  memset(&q, 0, sizeof(q));
+  e.priv = &q;
+  return create(&e, argc, argv) == SOX_SUCCESS?
+    lsx_biquad_update(effp, &q) : SOX_EOF;
+}
+
 sox_effect_handler_t const * lsx_biquad_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "biquad", "b0 b1 b2 a0 a1 a2", 0,
-    create, lsx_biquad_start, lsx_biquad_flow, NULL, NULL, NULL, sizeof(priv_t)
+    "biquad", "b0 b1 b2 a0 a1 a2", SOX_EFF_LINEAR | SOX_EFF_RTSAFE,
+    create, lsx_biquad_start, lsx_biquad_flow, NULL, NULL, NULL, sizeof(priv_t),
+    lsx_biquad_reset, NULL, NULL, update
   };
   return &handler;
 }
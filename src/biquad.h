@@ -66,6 +66,9 @@ typedef struct {
 
   sox_sample_t i1, i2;     /* Filter memory */
   double      o1, o2;      /* Filter memory */
+
+  double target[6], step[6]; /* Coefficients, while ramping to new ones */
+  size_t ramp;             /* Samples left to ramp */
 } biquad_t;
 
 int lsx_biquad_getopts(sox_effect_t * effp, int n, char **argv,
@@ -74,5 +77,7 @@ int lsx_biquad_getopts(sox_effect_t * effp, int n, char **argv,
 int lsx_biquad_start(sox_effect_t * effp);
 int lsx_biquad_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                         size_t *isamp, size_t *osamp);
+int lsx_biquad_reset(sox_effect_t * effp);
+int lsx_biquad_update(sox_effect_t * effp, biquad_t const * q);
 
 #endif
@@ -155,7 +155,8 @@ static void make_poly_from_roots(
       poly[j] -= poly[j - 1] * roots[i];
 }
 
-static int start(sox_effect_t * effp)
+/* Sets the filter's coefficients (not normalised) from its options */
+static int design(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
   double w0, A, alpha, mult;
@@ -384,27 +385,55 @@ static int start(sox_effect_t * effp)
   }
   if (effp->in_signal.mult)
     *effp->in_signal.mult /= mult;
-  return lsx_biquad_start(effp);
+  return SOX_SUCCESS;
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int result = design(effp);
+
+  if (result == SOX_EFF_NULL && effp->global_info->global_info->updatable)
+    p->b0 = 1, result = SOX_SUCCESS; /* Kept, passing all, for update */
+  return result == SOX_SUCCESS? lsx_biquad_start(effp) : result;
+}
+
+static int update(sox_effect_t * effp, int argc, char **argv)
+{
+  priv_t q;
+  sox_effect_t e = *effp;
+  int result;
+
+  memset(&q, 0, sizeof(q));
+  e.priv = &q;
+  e.in_signal.mult = NULL;
+  if (effp->handler.getopts(&e, argc, argv) != SOX_SUCCESS ||
+      (result = design(&e)) == SOX_EOF)
+    return SOX_EOF;
+  if (result == SOX_EFF_NULL)
+    q.b0 = 1;
+  return lsx_biquad_update(effp, &q);
 }
 
 
 #define BIQUAD_EFFECT(name,group,usage,flags) \
 sox_effect_handler_t const * lsx_##name##_effect_fn(void) { \
   static sox_effect_handler_t handler = { \
-    #name, usage, flags, \
-    group##_getopts, start, lsx_biquad_flow, 0, 0, 0, sizeof(biquad_t)\
+    #name, usage, flags | SOX_EFF_RTSAFE, \
+    group##_getopts, start, lsx_biquad_flow, 0, 0, 0, sizeof(biquad_t), \
+    lsx_biquad_reset, NULL, NULL, update \
   }; \
   return &handler; \
 }
 
-BIQUAD_EFFECT(highpass,  hilo2,    "[-1|-2] frequency [width[q|o|h|k](0.707q)]", 0)
-BIQUAD_EFFECT(lowpass,   hilo2,    "[-1|-2] frequency [width[q|o|h|k]](0.707q)", 0)
-BIQUAD_EFFECT(bandpass,  bandpass, "[-c] frequency width[h|k|q|o]", 0)
-BIQUAD_EFFECT(bandreject,bandrej,  "frequency width[h|k|q|o]", 0)
-BIQUAD_EFFECT(allpass,   allpass,  "frequency width[h|k|q|o]", 0)
-BIQUAD_EFFECT(bass,      tone,     "gain [frequency(100) [width[s|h|k|q|o]](0.5s)]", 0)
-BIQUAD_EFFECT(treble,    tone,     "gain [frequency(3000) [width[s|h|k|q|o]](0.5s)]", 0)
-BIQUAD_EFFECT(equalizer, equalizer,"frequency width[q|o|h|k] gain", 0)
-BIQUAD_EFFECT(band,      band,     "[-n] center [width[h|k|q|o]]", 0)
-BIQUAD_EFFECT(deemph,    deemph,   NULL, 0)
-BIQUAD_EFFECT(riaa,      riaa,     NULL, 0)
+BIQUAD_EFFECT(highpass,  hilo2,    "[-1|-2] frequency [width[q|o|h|k](0.707q)]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(lowpass,   hilo2,    "[-1|-2] frequency [width[q|o|h|k]](0.707q)", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(bandpass,  bandpass, "[-c] frequency width[h|k|q|o]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(bandreject,bandrej,  "frequency width[h|k|q|o]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(allpass,   allpass,  "frequency width[h|k|q|o]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(bass,      tone,     "gain [frequency(100) [width[s|h|k|q|o]](0.5s)]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(treble,    tone,     "gain [frequency(3000) [width[s|h|k|q|o]](0.5s)]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(equalizer, equalizer,"frequency width[q|o|h|k] gain", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(band,      band,     "[-n] center [width[h|k|q|o]]", SOX_EFF_LINEAR)
+BIQUAD_EFFECT(deemph,    deemph,   NULL, SOX_EFF_LINEAR)
+BIQUAD_EFFECT(riaa,      riaa,     NULL, SOX_EFF_LINEAR)
@@ -0,0 +1,473 @@
+/* libSoX effects: branches of an effects chain
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * An effects chain may fan out into branches, and branches fan back in, so
+ * that e.g. several outputs are made from one decode of the input.  Where a
+ * chain branches, it has a `tee' effect, which passes its input on unchanged
+ * and also pushes it through each of its branches (see lsx_flow_branch);
+ * each branch is a chain of its own, whose first effect, `branch', just holds
+ * what is pushed.  A branch ends either with an output, or with a `join'
+ * effect, which hands its audio to a `merge' effect further down the chain
+ * it came from, to be mixed back in there.  Since a tee pushes each block
+ * through its branches before passing it on, the merge has by then had the
+ * branch's share of it, less any that the branch's effects are holding on to.
+ *
+ * A branch made asynchronous (sox_set_branch_async), e.g. one that ends with
+ * a slow encoder, is instead run on a thread of its own whilst
+ * sox_flow_effects runs the chain it branches from (see flow_effects_helped):
+ * the tee hands its input to the thread through a bounded ring buffer,
+ * waiting only when that is full.
+ */
+
+#include "sox_i.h"
+#include "fifo.h"
+#include "ringbuf.h"
+
+typedef struct {
+  sox_effects_chain_t * chain;
+  sox_bool stopped;           /* Has taken its last input */
+  size_t   async_bufs;        /* Size of its queue, in units of bufsiz */
+  sox_bool async;             /* Is running on a thread of its own */
+  ringbuf_t ring;             /* Samples queued for it */
+  size_t   eof;               /* Nothing more will be queued */
+  size_t   done;              /* It has taken its last input */
+  sox_bool merged;            /* Ends with a join (so is never asynchronous) */
+} branch_t;
+
+typedef struct {
+  branch_t * branches;
+  size_t num_branches;
+  sox_bool started;
+} tee_t;
+
+/* Queues len samples (whole frames) for an asynchronous branch, waiting
+ * for room if need be, unless the branch has stopped taking them */
+static void queue(branch_t * b, sox_sample_t const * buf, size_t len,
+    unsigned chans)
+{
+  unsigned waits = 0;
+
+  while (len && !ringbuf_load(&b->done)) {
+    size_t n = min(len, ringbuf_space(&b->ring));
+    n -= n % chans;
+    if (n) {
+      ringbuf_write(&b->ring, n, buf);
+      buf += n, len -= n, waits = 0;
+    }
+    else lsx_thread_wait(&waits);
+  }
+}
+
+static int tee_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  tee_t * p = (tee_t *)effp->priv;
+  size_t i, len = *isamp = *osamp = min(*isamp, *osamp);
+
+  memcpy(obuf, ibuf, len * sizeof(*obuf));  /* Before ibuf is shared */
+  for (i = 0; i < p->num_branches; ++i) {
+    branch_t * b = &p->branches[i];
+    if (b->async)
+      queue(b, ibuf, len, effp->in_signal.channels);
+    else {
+      if (!p->started)
+        lsx_start_branch(b->chain);
+      if (!b->stopped && lsx_flow_branch(b->chain, ibuf, len) != SOX_SUCCESS)
+        b->stopped = sox_true;
+    }
+  }
+  p->started = sox_true;
+  return SOX_SUCCESS;
+}
+
+/* Drains the branches that are still taking input */
+static void drain_branches(tee_t * p)
+{
+  size_t i;
+
+  for (i = 0; i < p->num_branches; ++i) {
+    branch_t * b = &p->branches[i];
+    if (b->async)
+      ringbuf_store(&b->eof, (size_t)1);  /* Its thread drains it */
+    else {
+      if (p->started && !b->stopped)
+        lsx_drain_branch(b->chain);
+      b->stopped = sox_true;
+    }
+  }
+}
+
+static int tee_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  (void)obuf, *osamp = 0;
+  drain_branches((tee_t *)effp->priv);
+  return SOX_EOF;
+}
+
+/* If the chain stopped short of draining the tee (e.g. a later trim ended
+ * it), its branches still end with what they have been given */
+static int tee_stop(sox_effect_t * effp)
+{
+  drain_branches((tee_t *)effp->priv);
+  return SOX_SUCCESS;
+}
+
+static int tee_kill(sox_effect_t * effp)
+{
+  tee_t * p = (tee_t *)effp->priv;
+  size_t i;
+
+  for (i = 0; i < p->num_branches; ++i)
+    sox_delete_effects_chain(p->branches[i].chain);
+  free(p->branches);
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * tee_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "tee", NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INTERNAL,
+    NULL, NULL, tee_flow, tee_drain, tee_stop, tee_kill, sizeof(tee_t), NULL,
+    NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+static sox_effect_handler_t const * branch_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "branch", NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INTERNAL,
+    NULL, NULL, NULL, NULL, NULL, NULL, 0, NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+sox_effects_chain_t * sox_add_branch(sox_effects_chain_t * chain,
+    sox_encodinginfo_t const * out_enc)
+{
+  sox_effect_t * tee, * effp;
+  sox_effects_chain_t * branch;
+  sox_signalinfo_t signal;
+  tee_t * p;
+
+  if (!chain->length)
+    return NULL;
+  tee = chain->effects[chain->length - 1];
+  if (tee->handler.flow != tee_flow) {
+    signal = tee->out_signal;
+    effp = sox_create_effect(tee_effect_fn());
+    if (sox_add_effect(chain, effp, &signal, &signal) != SOX_SUCCESS) {
+      free(effp);
+      return NULL;
+    }
+    free(effp);
+    tee = chain->effects[chain->length - 1];
+  }
+  branch = sox_create_context_effects_chain(chain->global_info.global_info,
+      chain->in_enc, out_enc);
+  signal = tee->out_signal;
+  effp = sox_create_effect(branch_effect_fn());
+  if (sox_add_effect(branch, effp, &signal, &signal) != SOX_SUCCESS) {
+    free(effp);
+    sox_delete_effects_chain(branch);
+    return NULL;
+  }
+  free(effp);
+
+  p = (tee_t *)tee->priv;
+  lsx_revalloc(p->branches, p->num_branches + 1);
+  memset(&p->branches[p->num_branches], 0, sizeof(*p->branches));
+  p->branches[p->num_branches++].chain = branch;
+  return branch;
+}
+
+/* The branch_t of branch, if it was started from one of the chain's tees */
+static branch_t * find_branch(sox_effects_chain_t const * chain,
+    sox_effects_chain_t const * branch)
+{
+  size_t e, i;
+
+  for (e = 0; e < chain->length; ++e) {
+    tee_t const * p = (tee_t *)chain->effects[e]->priv;
+    if (chain->effects[e]->handler.flow == tee_flow)
+      for (i = 0; i < p->num_branches; ++i)
+        if (p->branches[i].chain == branch)
+          return &p->branches[i];
+  }
+  return NULL;
+}
+
+int sox_set_branch_async(sox_effects_chain_t * chain,
+    sox_effects_chain_t * branch, size_t bufs)
+{
+  branch_t * b = find_branch(chain, branch);
+
+  if (!b)
+    return SOX_EOF;
+  b->async_bufs = bufs;
+  return SOX_SUCCESS;
+}
+
+/* The chain's nth branch that is asynchronous: set to be, if all, else
+ * running as such */
+static branch_t * async_branch(sox_effects_chain_t * chain, size_t n,
+    sox_bool all)
+{
+  size_t e, i;
+
+  for (e = 0; e < chain->length; ++e) {
+    tee_t * p = (tee_t *)chain->effects[e]->priv;
+    if (chain->effects[e]->handler.flow == tee_flow)
+      for (i = 0; i < p->num_branches; ++i)
+        if ((all? p->branches[i].async_bufs != 0 : p->branches[i].async) &&
+            !n--)
+          return &p->branches[i];
+  }
+  return NULL;
+}
+
+sox_bool lsx_has_async_branches(sox_effects_chain_t * chain)
+{
+  return async_branch(chain, (size_t)0, sox_true) != NULL;
+}
+
+/* Readies the chain's asynchronous branches to run on threads of their own;
+ * returns how many there are */
+size_t lsx_start_async_branches(sox_effects_chain_t * chain)
+{
+  branch_t * b;
+  size_t n, count = 0;
+
+  for (n = 0; (b = async_branch(chain, n, sox_true)) != NULL; ++n) {
+    ringbuf_create(&b->ring, sizeof(sox_sample_t),
+        b->async_bufs * chain->global_info.global_info->bufsiz);
+    b->eof = b->done = 0;
+    b->async = !b->stopped && !b->merged;
+    count += b->async;
+  }
+  return count;
+}
+
+/* Tells the chain's asynchronous branches that nothing more is to come
+ * (the chain may have stopped without draining its tees) */
+void lsx_end_async_branches(sox_effects_chain_t * chain)
+{
+  branch_t * b;
+  size_t n;
+
+  for (n = 0; (b = async_branch(chain, n, sox_false)) != NULL; ++n)
+    ringbuf_store(&b->eof, (size_t)1);
+}
+
+/* After lsx_start_async_branches: if they did not run (no threads could be
+ * had), the branches are to be run as others */
+void lsx_finish_async_branches(sox_effects_chain_t * chain, sox_bool ran)
+{
+  branch_t * b;
+  size_t n;
+
+  for (n = 0; (b = async_branch(chain, n, sox_true)) != NULL; ++n) {
+    if (b->async && ran)
+      b->stopped = sox_true;
+    b->async = sox_false;
+    ringbuf_delete(&b->ring);
+  }
+}
+
+/* Runs the chain's nth asynchronous branch, on the calling thread, until
+ * it has been drained */
+void lsx_serve_async_branch(sox_effects_chain_t * chain, size_t n)
+{
+  branch_t * b = async_branch(chain, n, sox_false);
+  unsigned chans = b->chain->effects[0]->out_signal.channels, waits = 0;
+  size_t bufsiz = chain->global_info.global_info->bufsiz;
+  size_t len = bufsiz - bufsiz % chans;
+  sox_sample_t * buf = lsx_malloc(len * sizeof(*buf));
+
+  lsx_start_branch(b->chain);
+  while (sox_true) {
+    sox_bool eof = ringbuf_load(&b->eof) != 0; /* Before looking at the ring */
+    size_t got = ringbuf_read(&b->ring, len, buf);
+
+    if (got) {
+      waits = 0;
+      if (lsx_flow_branch(b->chain, buf, got) != SOX_SUCCESS)
+        break;
+    }
+    else if (eof) {
+      lsx_drain_branch(b->chain);
+      break;
+    }
+    else lsx_thread_wait(&waits);
+  }
+  ringbuf_store(&b->done, (size_t)1);
+  free(buf);
+}
+
+/*---------------------------------- Merge -----------------------------------*/
+
+typedef struct {
+  fifo_t held;                /* The chain's audio, awaiting the branch's */
+  fifo_t branch;              /* The branch's audio, awaiting the chain's */
+  sox_bool branch_done;
+} merge_t;
+
+typedef struct {merge_t * merge;} join_t;
+
+static int merge_start(sox_effect_t * effp)
+{
+  merge_t * p = (merge_t *)effp->priv;
+
+  fifo_create(&p->held, sizeof(sox_sample_t));
+  fifo_create(&p->branch, sizeof(sox_sample_t));
+  p->branch_done = sox_false;
+  return SOX_SUCCESS;
+}
+
+/* Outputs the sum of the next n samples of each side, either of which may
+ * have fewer (and is then padded with silence) */
+static void mix(sox_effect_t * effp, sox_sample_t * obuf, size_t n)
+{
+  merge_t * p = (merge_t *)effp->priv;
+  size_t a = min(n, fifo_occupancy(&p->held));
+  size_t b = min(n, fifo_occupancy(&p->branch)), i;
+  sox_sample_t const * x = fifo_read(&p->held, a, NULL);
+  sox_sample_t const * y = fifo_read(&p->branch, b, NULL);
+
+  for (i = 0; i < n; ++i) {
+    double d = (double)(i < a? x[i] : 0) + (i < b? y[i] : 0);
+    obuf[i] = SOX_ROUND_CLIP_COUNT(d, effp->clips);
+  }
+}
+
+static int merge_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  merge_t * p = (merge_t *)effp->priv;
+  size_t n;
+
+  fifo_write(&p->held, *isamp, ibuf);
+  n = min(*osamp, fifo_occupancy(&p->held));
+  if (!p->branch_done)
+    n = min(n, fifo_occupancy(&p->branch));
+  mix(effp, obuf, *osamp = n);
+  return SOX_SUCCESS;
+}
+
+static int merge_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  merge_t * p = (merge_t *)effp->priv;
+  size_t n = max(fifo_occupancy(&p->held), fifo_occupancy(&p->branch));
+
+  *osamp -= *osamp % effp->out_signal.channels;
+  mix(effp, obuf, *osamp = min(n, *osamp));
+  return *osamp? SOX_SUCCESS : SOX_EOF;
+}
+
+static int merge_stop(sox_effect_t * effp)
+{
+  merge_t * p = (merge_t *)effp->priv;
+
+  fifo_delete(&p->held);
+  fifo_delete(&p->branch);
+  return SOX_SUCCESS;
+}
+
+static int join_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  join_t * p = (join_t *)effp->priv;
+
+  (void)obuf, *osamp = 0;
+  fifo_write(&p->merge->branch, *isamp, ibuf);
+  return SOX_SUCCESS;
+}
+
+static int join_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  join_t * p = (join_t *)effp->priv;
+
+  (void)obuf, *osamp = 0;
+  p->merge->branch_done = sox_true;
+  return SOX_EOF;
+}
+
+static sox_effect_handler_t const * merge_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "merge", NULL, SOX_EFF_MCHAN | SOX_EFF_INTERNAL,
+    NULL, merge_start, merge_flow, merge_drain, merge_stop, NULL,
+    sizeof(merge_t), NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+static sox_effect_handler_t const * join_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "join", NULL, SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INTERNAL,
+    NULL, NULL, join_flow, join_drain, NULL, NULL, sizeof(join_t), NULL,
+    NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+int sox_add_merge(sox_effects_chain_t * chain, sox_effects_chain_t * branch,
+    sox_signalinfo_t * in)
+{
+  branch_t * b = find_branch(chain, branch);
+  sox_effect_t * effp;
+  sox_signalinfo_t signal;
+
+  if (!b) {
+    lsx_fail("can't merge a chain that is not a branch of this one");
+    return SOX_EOF;
+  }
+  signal = branch->effects[branch->length - 1]->out_signal;
+  if (signal.rate != in->rate || signal.channels != in->channels) {
+    lsx_fail("can't merge a branch of %gHz %u-channel audio with %gHz %u-channel",
+        signal.rate, signal.channels, in->rate, in->channels);
+    return SOX_EOF;
+  }
+  effp = sox_create_effect(merge_effect_fn());
+  if (sox_add_effect(chain, effp, in, in) != SOX_SUCCESS) {
+    free(effp);
+    return SOX_EOF;
+  }
+  free(effp);
+
+  effp = sox_create_effect(join_effect_fn());
+  ((join_t *)effp->priv)->merge = (merge_t *)chain->effects[chain->length - 1]->priv;
+  if (sox_add_effect(branch, effp, &signal, &signal) != SOX_SUCCESS) {
+    free(effp);
+    return SOX_EOF;
+  }
+  free(effp);
+  b->merged = sox_true;
+  return SOX_SUCCESS;
+}
+
+sox_bool lsx_has_merge(sox_effects_chain_t const * chain)
+{
+  size_t e;
+
+  for (e = 0; e < chain->length; ++e)
+    if (chain->effects[e]->handler.flow == merge_flow)
+      return sox_true;
+  return sox_false;
+}
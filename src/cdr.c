@@ -43,7 +43,7 @@ LSX_FORMAT_HANDLER(cdr)
     names, SOX_FILE_BIG_END|SOX_FILE_STEREO,
     start, lsx_rawread, NULL,
     NULL, lsx_rawwrite, stopwrite,
-    lsx_rawseek, write_encodings, write_rates, 0
+    lsx_rawseek, write_encodings, write_rates, 0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -70,20 +70,22 @@
 #define MOD_TRIANGLE    1
 #define MAX_CHORUS      7
 
+#define BLOCK_LEN 1024 /* Samples processed per block */
+
 typedef struct {
         int     num_chorus;
         int     modulation[MAX_CHORUS];
-        int     counter;
-        long    phase[MAX_CHORUS];
-        float   *chorusbuf;
+        lsx_delay_t chorusbuf;
         float   in_gain, out_gain;
         float   delay[MAX_CHORUS], decay[MAX_CHORUS];
         float   speed[MAX_CHORUS], depth[MAX_CHORUS];
         long    length[MAX_CHORUS];
-        int     *lookup_tab[MAX_CHORUS];
+        lsx_lfo_t lookup_tab[MAX_CHORUS];
         int     depth_samples[MAX_CHORUS], samples[MAX_CHORUS];
         int maxsamples;
         unsigned int fade_out;
+        float   d_in[BLOCK_LEN], d_out[BLOCK_LEN];
+        double  line_in[BLOCK_LEN], delays[BLOCK_LEN], tap[BLOCK_LEN];
 } priv_t;
 
 /*
@@ -198,17 +200,15 @@ static int sox_chorus_start(sox_effect_t * effp)
                         return (SOX_EOF);
                 }
                 chorus->length[i] = effp->in_signal.rate / chorus->speed[i];
-                chorus->lookup_tab[i] = lsx_malloc(sizeof (int) * chorus->length[i]);
 
                 if (chorus->modulation[i] == MOD_SINE)
-                  lsx_generate_wave_table(SOX_WAVE_SINE, SOX_INT, chorus->lookup_tab[i],
+                  lsx_lfo_create(&chorus->lookup_tab[i], SOX_WAVE_SINE, SOX_INT,
                                          (size_t)chorus->length[i], 0., (double)chorus->depth_samples[i], 0.);
                 else
-                  lsx_generate_wave_table(SOX_WAVE_TRIANGLE, SOX_INT, chorus->lookup_tab[i],
+                  lsx_lfo_create(&chorus->lookup_tab[i], SOX_WAVE_TRIANGLE, SOX_INT,
                                          (size_t)chorus->length[i],
                                          (double)(chorus->samples[i] - 1 - 2 * chorus->depth_samples[i]),
                                          (double)(chorus->samples[i] - 1), 3 * M_PI_2);
-                chorus->phase[i] = 0;
 
                 if ( chorus->samples[i] > chorus->maxsamples )
                   chorus->maxsamples = chorus->samples[i];
@@ -222,11 +222,8 @@ static int sox_chorus_start(sox_effect_t * effp)
         lsx_warn("chorus: warning >>> gain-out can cause saturation or clipping of output <<<");
 
 
-        chorus->chorusbuf = lsx_malloc(sizeof (float) * chorus->maxsamples);
-        for ( i = 0; i < chorus->maxsamples; i++ )
-                chorus->chorusbuf[i] = 0.0;
+        lsx_delay_create(&chorus->chorusbuf, (size_t)chorus->maxsamples, (size_t)BLOCK_LEN);
 
-        chorus->counter = 0;
         chorus->fade_out = chorus->maxsamples;
 
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
@@ -234,6 +231,52 @@ static int sox_chorus_start(sox_effect_t * effp)
         return (SOX_SUCCESS);
 }
 
+/*
+ * Process len samples from ibuf (or silence if ibuf is NULL) to obuf,
+ * a block at a time: the block is added to the delay line, then each
+ * chorus's modulated delays for the block are looked up and read back.
+ */
+static void chorus_process(sox_effect_t * effp, const sox_sample_t *ibuf,
+                   sox_sample_t *obuf, size_t len)
+{
+        priv_t * chorus = (priv_t *) effp->priv;
+        int i;
+        size_t j, n;
+        sox_sample_t out;
+
+        for (; len; len -= n) {
+                n = min(len, BLOCK_LEN);
+                if (ibuf) {
+                        /* Store delays as 24-bit signed longs */
+                        for ( j = 0; j < n; j++ ) {
+                                chorus->d_in[j] = (float) *ibuf++ / 256;
+                                chorus->d_out[j] = chorus->d_in[j] * chorus->in_gain;
+                                chorus->line_in[j] = chorus->d_in[j];
+                        }
+                        lsx_delay_write(&chorus->chorusbuf, chorus->line_in, n);
+                }
+                else {
+                        memset(chorus->d_out, 0, n * sizeof(*chorus->d_out));
+                        lsx_delay_write(&chorus->chorusbuf, NULL, n);
+                }
+                for ( i = 0; i < chorus->num_chorus; i++ ) {
+                        lsx_lfo_read(&chorus->lookup_tab[i], (size_t)0, chorus->delays, n);
+                        lsx_lfo_advance(&chorus->lookup_tab[i], n);
+                        for ( j = 0; j < n; j++ )  /* 0 is the whole buffer */
+                                if (!chorus->delays[j])
+                                        chorus->delays[j] = chorus->maxsamples;
+                        lsx_delay_read_var(&chorus->chorusbuf, chorus->delays, chorus->tap, n);
+                        for ( j = 0; j < n; j++ )
+                                chorus->d_out[j] += (float)chorus->tap[j] * chorus->decay[i];
+                }
+                /* Adjust the output volume and size to 24 bit */
+                for ( j = 0; j < n; j++ ) {
+                        out = SOX_24BIT_CLIP_COUNT((sox_sample_t) (chorus->d_out[j] * chorus->out_gain), effp->clips);
+                        *obuf++ = out * 256;
+                }
+        }
+}
+
 /*
  * Processed signed long samples from ibuf to obuf.
  * Return number of samples processed.
@@ -241,34 +284,10 @@ static int sox_chorus_start(sox_effect_t * effp)
 static int sox_chorus_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                    size_t *isamp, size_t *osamp)
 {
-        priv_t * chorus = (priv_t *) effp->priv;
-        int i;
-        float d_in, d_out;
-        sox_sample_t out;
         size_t len = min(*isamp, *osamp);
         *isamp = *osamp = len;
 
-        while (len--) {
-                /* Store delays as 24-bit signed longs */
-                d_in = (float) *ibuf++ / 256;
-                /* Compute output first */
-                d_out = d_in * chorus->in_gain;
-                for ( i = 0; i < chorus->num_chorus; i++ )
-                        d_out += chorus->chorusbuf[(chorus->maxsamples +
-                        chorus->counter - chorus->lookup_tab[i][chorus->phase[i]]) %
-                        chorus->maxsamples] * chorus->decay[i];
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * chorus->out_gain;
-                out = SOX_24BIT_CLIP_COUNT((sox_sample_t) d_out, effp->clips);
-                *obuf++ = out * 256;
-                /* Mix decay of delay and input */
-                chorus->chorusbuf[chorus->counter] = d_in;
-                chorus->counter =
-                        ( chorus->counter + 1 ) % chorus->maxsamples;
-                for ( i = 0; i < chorus->num_chorus; i++ )
-                        chorus->phase[i]  =
-                                ( chorus->phase[i] + 1 ) % chorus->length[i];
-        }
+        chorus_process(effp, ibuf, obuf, len);
         /* processed all samples */
         return (SOX_SUCCESS);
 }
@@ -279,35 +298,10 @@ static int sox_chorus_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sa
 static int sox_chorus_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
         priv_t * chorus = (priv_t *) effp->priv;
-        size_t done;
-        int i;
+        size_t done = min(*osamp, chorus->fade_out);
 
-        float d_in, d_out;
-        sox_sample_t out;
-
-        done = 0;
-        while ( ( done < *osamp ) && ( done < chorus->fade_out ) ) {
-                d_in = 0;
-                d_out = 0;
-                /* Compute output first */
-                for ( i = 0; i < chorus->num_chorus; i++ )
-                        d_out += chorus->chorusbuf[(chorus->maxsamples +
-                chorus->counter - chorus->lookup_tab[i][chorus->phase[i]]) %
-                chorus->maxsamples] * chorus->decay[i];
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * chorus->out_gain;
-                out = SOX_24BIT_CLIP_COUNT((sox_sample_t) d_out, effp->clips);
-                *obuf++ = out * 256;
-                /* Mix decay of delay and input */
-                chorus->chorusbuf[chorus->counter] = d_in;
-                chorus->counter =
-                        ( chorus->counter + 1 ) % chorus->maxsamples;
-                for ( i = 0; i < chorus->num_chorus; i++ )
-                        chorus->phase[i]  =
-                                ( chorus->phase[i] + 1 ) % chorus->length[i];
-                done++;
-                chorus->fade_out--;
-        }
+        chorus_process(effp, NULL, obuf, done);
+        chorus->fade_out -= done;
         /* samples played, it remains */
         *osamp = done;
         if (chorus->fade_out == 0)
@@ -324,25 +318,22 @@ static int sox_chorus_stop(sox_effect_t * effp)
         priv_t * chorus = (priv_t *) effp->priv;
         int i;
 
-        free(chorus->chorusbuf);
-        chorus->chorusbuf = NULL;
-        for ( i = 0; i < chorus->num_chorus; i++ ) {
-                free(chorus->lookup_tab[i]);
-                chorus->lookup_tab[i] = NULL;
-        }
+        lsx_delay_delete(&chorus->chorusbuf);
+        for ( i = 0; i < chorus->num_chorus; i++ )
+                lsx_lfo_delete(&chorus->lookup_tab[i]);
         return (SOX_SUCCESS);
 }
 
 static sox_effect_handler_t sox_chorus_effect = {
   "chorus",
   "gain-in gain-out delay decay speed depth [ -s | -t ]",
-  SOX_EFF_LENGTH | SOX_EFF_GAIN,
+  SOX_EFF_LENGTH | SOX_EFF_GAIN | SOX_EFF_RTSAFE,
   sox_chorus_getopts,
   sox_chorus_start,
   sox_chorus_flow,
   sox_chorus_drain,
   sox_chorus_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_chorus_effect_fn(void)
@@ -45,6 +45,8 @@
 
 typedef struct {
   sox_compandt_t transfer_fn;
+  sox_compandt_t old_transfer_fn; /* Cross-faded from, after an update */
+  size_t ramp, ramp_len;    /* Frames left of, and in, the cross-fade */
 
   struct {
     double attack_times[2]; /* 0:attack_time, 1:decay_time */
@@ -134,10 +136,24 @@ static int getopts(sox_effect_t * effp, int argc, char * * argv)
   return SOX_SUCCESS;
 }
 
+/* Convert attack and decay rates using number of samples */
+static void convert_times(sox_effect_t * effp, priv_t * l)
+{
+  unsigned i, j;
+
+  for (i = 0; i < l->expectedChannels; ++i)
+    for (j = 0; j < 2; ++j)
+      if (l->channels[i].attack_times[j] > 1.0/effp->out_signal.rate)
+        l->channels[i].attack_times[j] = 1.0 -
+          exp(-1.0/(effp->out_signal.rate * l->channels[i].attack_times[j]));
+      else
+        l->channels[i].attack_times[j] = 1.0;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * l = (priv_t *) effp->priv;
-  unsigned i, j;
+  unsigned i;
 
   lsx_debug("%i input channel(s) expected: actually %i",
       l->expectedChannels, effp->out_signal.channels);
@@ -147,14 +163,8 @@ static int start(sox_effect_t * effp)
   if (!lsx_compandt_show(&l->transfer_fn, effp->global_info->plot))
     return SOX_EOF;
 
-  /* Convert attack and decay rates using number of samples */
-  for (i = 0; i < l->expectedChannels; ++i)
-    for (j = 0; j < 2; ++j)
-      if (l->channels[i].attack_times[j] > 1.0/effp->out_signal.rate)
-        l->channels[i].attack_times[j] = 1.0 -
-          exp(-1.0/(effp->out_signal.rate * l->channels[i].attack_times[j]));
-      else
-        l->channels[i].attack_times[j] = 1.0;
+  convert_times(effp, l);
+  l->ramp = 0;
 
   /* Allocate the delay buffer */
   l->delay_buf_size = l->delay * effp->out_signal.rate * effp->out_signal.channels;
@@ -163,6 +173,7 @@ static int start(sox_effect_t * effp)
   l->delay_buf_index = 0;
   l->delay_buf_cnt = 0;
   l->delay_buf_full= 0;
+  effp->latency = l->delay;
 
   return SOX_SUCCESS;
 }
@@ -182,6 +193,20 @@ static void doVolume(double *v, double samp, priv_t * l, int chan)
     *v += delta * l->channels[chan].attack_times[1];
 }
 
+/*
+ * The output level for the given volume, cross-fading, after an update,
+ * from the old transfer function to the new
+ */
+static double transfer(priv_t * l, double level_in_lin)
+{
+  double level_out_lin = lsx_compandt(&l->transfer_fn, level_in_lin);
+
+  if (l->ramp)
+    level_out_lin += (lsx_compandt(&l->old_transfer_fn, level_in_lin) -
+        level_out_lin) * l->ramp / l->ramp_len;
+  return level_out_lin;
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                     size_t *isamp, size_t *osamp)
 {
@@ -213,7 +238,7 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
     for (chan = 0; chan < filechans; ++chan) {
       int ch = l->expectedChannels > 1 ? chan : 0;
       double level_in_lin = l->channels[ch].volume;
-      double level_out_lin = lsx_compandt(&l->transfer_fn, level_in_lin);
+      double level_out_lin = transfer(l, level_in_lin);
       double checkbuf;
 
       if (l->delay_buf_size <= 0) {
@@ -237,6 +262,8 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
         l->delay_buf_index %= l->delay_buf_size;
       }
     }
+    if (l->ramp)
+      --l->ramp;
   }
 
   *isamp = idone; *osamp = odone;
@@ -250,15 +277,18 @@ static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 
   if (l->delay_buf_full == 0)
     l->delay_buf_index = 0;
-  while (done+effp->out_signal.channels <= *osamp && l->delay_buf_cnt > 0)
+  while (done+effp->out_signal.channels <= *osamp && l->delay_buf_cnt > 0) {
     for (chan = 0; chan < effp->out_signal.channels; ++chan) {
       int c = l->expectedChannels > 1 ? chan : 0;
       double level_in_lin = l->channels[c].volume;
-      double level_out_lin = lsx_compandt(&l->transfer_fn, level_in_lin);
+      double level_out_lin = transfer(l, level_in_lin);
       obuf[done++] = l->delay_buf[l->delay_buf_index++] * level_out_lin;
       l->delay_buf_index %= l->delay_buf_size;
       l->delay_buf_cnt--;
     }
+    if (l->ramp)
+      --l->ramp;
+  }
   *osamp = done;
   return l->delay_buf_cnt > 0 ? SOX_SUCCESS : SOX_EOF;
 }
@@ -276,6 +306,7 @@ static int lsx_kill(sox_effect_t * effp)
   priv_t * l = (priv_t *) effp->priv;
 
   lsx_compandt_kill(&l->transfer_fn);
+  lsx_compandt_kill(&l->old_transfer_fn);
   free(l->channels);
   free(l->arg0);
   free(l->arg1);
@@ -283,11 +314,56 @@ static int lsx_kill(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
+/*
+ * Change the transfer function, gain, and attack & decay times while running
+ * (but not the number of them, nor the delay).  The new transfer function
+ * and gain are cross-faded in; the volumes kept go on as they were.
+ */
+static int update(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t * l = (priv_t *) effp->priv, new_l;
+  sox_effect_t e = *effp;
+  unsigned i;
+  int result;
+
+  memset(&new_l, 0, sizeof(new_l));
+  e.priv = &new_l;
+  if ((result = getopts(&e, argc, argv)) != SOX_SUCCESS)
+    ;
+  else if (new_l.expectedChannels != l->expectedChannels) {
+    lsx_fail("can't change the number of attack/decay pairs while running");
+    result = SOX_EOF;
+  }
+  else if (new_l.delay != l->delay) {
+    lsx_fail("can't change the delay while running");
+    result = SOX_EOF;
+  }
+  if (result != SOX_SUCCESS) {
+    lsx_kill(&e);
+    return SOX_EOF;
+  }
+  convert_times(effp, &new_l);
+  for (i = 0; i < l->expectedChannels; ++i) {
+    l->channels[i].attack_times[0] = new_l.channels[i].attack_times[0];
+    l->channels[i].attack_times[1] = new_l.channels[i].attack_times[1];
+  }
+  lsx_compandt_kill(&l->old_transfer_fn);
+  l->old_transfer_fn = l->transfer_fn;
+  l->transfer_fn = new_l.transfer_fn;
+  l->ramp = l->ramp_len = lsx_update_ramp(effp);
+  free(new_l.channels);
+  free(l->arg0), l->arg0 = new_l.arg0;
+  free(l->arg1), l->arg1 = new_l.arg1;
+  free(l->arg2), l->arg2 = new_l.arg2;
+  return SOX_SUCCESS;
+}
+
 sox_effect_handler_t const * lsx_compand_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "compand", compand_usage, SOX_EFF_MCHAN | SOX_EFF_GAIN,
-    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+    "compand", compand_usage, SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_RTSAFE,
+    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, update
   };
   return &handler;
 }
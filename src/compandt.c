@@ -136,6 +136,22 @@ static void prepare_transfer_fn(sox_compandt_t * t)
   t->out_min_lin= exp(t->segments[1].y);
 }
 
+/* The curve is smooth in the log domain, so sampling it a fraction of an
+ * octave apart (as in the floating-point representation), and interpolating,
+ * saves a log & an exp per sample, with error well under 0.01dB. */
+static void make_table(sox_compandt_t * t)
+{
+  int e, k, n;
+
+  frexp(t->in_min_lin, &t->table_exp);
+  n = (1 - t->table_exp + 1) * LSX_COMPANDT_STEPS + 1;
+  t->table = lsx_malloc(n * sizeof(*t->table));
+  for (e = t->table_exp, n = 0; e <= 2; ++e)
+    for (k = 0; k < LSX_COMPANDT_STEPS && (e <= 1 || !k); ++k, ++n)
+      t->table[n] = lsx_compandt_exact(t,
+          ldexp(1 + (double)k / LSX_COMPANDT_STEPS, e - 1));
+}
+
 static sox_bool parse_transfer_value(char const * text, double * value)
 {
   char dummy;     /* To check for extraneous chars. */
@@ -219,11 +235,13 @@ sox_bool lsx_compandt_parse(sox_compandt_t * t, char * points, char * gain)
 #undef s
 
   prepare_transfer_fn(t);
+  make_table(t);
   return sox_true;
 }
 
 void lsx_compandt_kill(sox_compandt_t * p)
 {
   free(p->segments);
+  free(p->table);
 }
 
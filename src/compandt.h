@@ -26,14 +26,18 @@ typedef struct {
   double out_min_lin;
   double outgain_dB;        /* Post processor gain */
   double curve_dB;
+  double * table;           /* Output for input at 2^(e-1) * (1 + k/steps) */
+  int table_exp;            /* The least e in the table */
 } sox_compandt_t;
 
+#define LSX_COMPANDT_STEPS 128  /* Table entries per octave of input */
+
 sox_bool lsx_compandt_parse(sox_compandt_t * t, char * points, char * gain);
 sox_bool lsx_compandt_show(sox_compandt_t * t, sox_plot_t plot);
 void    lsx_compandt_kill(sox_compandt_t * p);
 
 /* Place in header to allow in-lining */
-static double lsx_compandt(sox_compandt_t * t, double in_lin)
+static double lsx_compandt_exact(sox_compandt_t * t, double in_lin)
 {
   struct sox_compandt_segment * s;
   double in_log, out_log;
@@ -41,7 +45,7 @@ static double lsx_compandt(sox_compandt_t * t, double in_lin)
   if (in_lin <= t->in_min_lin)
     return t->out_min_lin;
 
-  in_log = log(in_lin);
+  in_log = log(min(in_lin, 1)); /* The last segment starts at 0 dB */
 
   for (s = t->segments + 1; in_log > s[1].x; ++s);
 
@@ -50,3 +54,21 @@ static double lsx_compandt(sox_compandt_t * t, double in_lin)
 
   return exp(out_log);
 }
+
+/* As lsx_compandt_exact, but interpolated from the table (for speed) */
+static double lsx_compandt(sox_compandt_t * t, double in_lin)
+{
+  double pos;
+  int e, i;
+
+  if (in_lin <= t->in_min_lin)
+    return t->out_min_lin;
+
+  pos = (2 * frexp(in_lin, &e) - 1) * LSX_COMPANDT_STEPS;
+  if (e > 1)
+    return lsx_compandt_exact(t, in_lin);
+  i = (int)pos;
+  pos -= i;
+  i += (e - t->table_exp) * LSX_COMPANDT_STEPS;
+  return t->table[i] + pos * (t->table[i + 1] - t->table[i]);
+}
@@ -15,35 +15,123 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+/* The curve is tabulated by the shared waveshaper (see waveshaper.c),
+ * which may also over-sample it (-o) to reduce aliasing. */
+
 #include "sox_i.h"
+#include "waveshaper.h"
+
+#define BLOCK ((size_t)2048) /* Samples shaped at a time */
 
-typedef struct {double contrast;} priv_t;
+typedef struct {
+  double           contrast;
+  unsigned         factor;
+  lsx_waveshaper_t shaper;
+  double           * buf;
+  size_t           skip, flush;  /* The shaper's delay, at each end */
+} priv_t;
 
 static int create(sox_effect_t * effp, int argc, char * * argv)
 {
   priv_t * p = (priv_t *)effp->priv;
+  lsx_getopt_t optstate;
+  int c;
+
   p->contrast = 75;
-  --argc, ++argv;
+  p->factor = 1;
+  lsx_getopt_init(argc, argv, "+o:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'o', factor, 1, 4)
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  if (p->factor == 3) {
+    lsx_fail("over-sampling factor must be 1, 2 or 4");
+    return SOX_EOF;
+  }
+  argc -= optstate.ind, argv += optstate.ind;
   do {NUMERIC_PARAMETER(contrast, 0, 100)} while (0);
   p->contrast /= 750; /* shift range to 0 to 0.1333, default 0.1 */
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static double curve(double x, void * data)
+{
+  double d = x * M_PI_2;
+  return sin(d + *(double *)data * sin(d * 4));
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  /* Over-sampling may overshoot full scale a little, so a margin */
+  lsx_waveshaper_table(&p->shaper, curve, &p->contrast, -1.5, 1.5, (size_t)1536);
+  lsx_waveshaper_start(&p->shaper, p->factor, BLOCK);
+  p->buf = lsx_malloc(BLOCK * sizeof(*p->buf));
+  p->skip = p->flush = p->shaper.delay;
+  return SOX_SUCCESS;
+}
+
+/* Shapes len (<= BLOCK) samples of ibuf (or silence, if NULL) to obuf,
+ * returning the number written. */
+static size_t process(priv_t * p, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t len)
+{
+  double * x = p->buf;
+  size_t i, skip = min(p->skip, len);
+
+  for (i = 0; i < len; ++i)
+    x[i] = ibuf? ibuf[i] * (1. / (SOX_SAMPLE_MAX + 1.)) : 0;
+  lsx_waveshaper_shape(&p->shaper, x, len);
+  p->skip -= skip;
+  for (i = skip; i < len; ++i) {
+    double d = x[i] < -1? -1 : x[i] > 1? 1 : x[i];
+    *obuf++ = d * SOX_SAMPLE_MAX;
+  }
+  return len - skip;
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t len = *isamp = *osamp = min(*isamp, *osamp);
-  while (len--) {
-    double d = *ibuf++ * (-M_PI_2 / SOX_SAMPLE_MIN);
-    *obuf++ = sin(d + p->contrast * sin(d * 4)) * SOX_SAMPLE_MAX;
+  size_t n, len = *isamp = min(*isamp, *osamp);
+
+  for (*osamp = 0; len; ibuf += n, len -= n) {
+    n = min(len, BLOCK);
+    *osamp += process(p, ibuf, obuf + *osamp, n);
+  }
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t n, done = 0;
+
+  for (; p->flush && done < *osamp; p->flush -= n) {
+    n = min(min(p->flush, *osamp - done), BLOCK);
+    done += process(p, NULL, obuf + done, n);
   }
+  *osamp = done;
+  return p->flush? SOX_SUCCESS : SOX_EOF;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  lsx_waveshaper_stop(&p->shaper);
+  free(p->buf);
   return SOX_SUCCESS;
 }
 
 sox_effect_handler_t const * lsx_contrast_effect_fn(void)
 {
-  static sox_effect_handler_t handler = {"contrast", "[enhancement (75)]",
-    0, create, NULL, flow, NULL, NULL, NULL, sizeof(priv_t)};
+  static sox_effect_handler_t handler = {"contrast",
+    "[-o factor] [enhancement (75)]"
+    "\n  -o factor  Over-sample by 2 or 4 to reduce aliasing",
+    SOX_EFF_INPLACE | SOX_EFF_RTSAFE, create, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
   return &handler;
 }
@@ -0,0 +1,256 @@
+/* libSoX effect: convolve: partitioned convolution  (c) 2026 SoX contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Convolves the audio with the impulse responses (IRs) in an audio file:
+ * one for all channels (a mono file), one per channel (a file with as many
+ * channels as the audio), or a matrix of them (a file with the square of
+ * that many: its channel i * channels + o takes input channel i to output
+ * channel o; so, for `true stereo', LL, LR, RL, RR).  Each IR is split into
+ * partitions of block_len taps, transformed once (lsx_set_dft_partitions).
+ * Each block of input is transformed once per channel and kept for as many
+ * blocks as there are partitions (the frequency-domain delay line); an
+ * output channel's block is then the inverse transform of the sum of the
+ * products of the delay line's spectra with its IRs' partitions.  So there
+ * is one transform per channel each way however many IRs there are, and
+ * the latency is one block, however long the IRs.  The sums are done in
+ * bands of the spectrum, concurrently. */
+
+#include "sox_i.h"
+#include "dft_filter.h"
+#include <string.h>
+
+#define BAND 512          /* Spectrum elements summed as one work item */
+
+typedef struct {
+  char const   * filename;
+  double       block_len;
+  unsigned     channels, num_irs;
+  dft_filter_t * irs;     /* Each IR's partitions' DFTs */
+  size_t       dft_length, num_parts, fdl_pos;
+  double       * fdl;     /* Per channel: DFTs of the last num_parts blocks */
+  double       * in;      /* Per channel: the previous and current blocks */
+  double       * out;     /* Per channel: a block's DFT, then its output */
+  size_t       pos, out_pos, out_len;
+  uint64_t     samples_in, samples_out, target;
+  sox_bool     flushing;
+} priv_t;
+
+static int getopts(sox_effect_t * effp, int argc, char **argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int c;
+  lsx_getopt_t optstate;
+  lsx_getopt_init(argc, argv, "+b:", NULL, lsx_getopt_flag_none, 1, &optstate);
+
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'b', block_len, 16, 65536)
+    default: lsx_fail("unknown option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  if (argc != 1)
+    return lsx_usage(effp);
+  p->filename = argv[0];
+  return SOX_SUCCESS;
+}
+
+/* The IR from input channel i to output channel o, or NULL if none */
+static dft_filter_t const * ir_for(priv_t const * p, unsigned i, unsigned o)
+{
+  if (p->channels > 1 && p->num_irs == p->channels * p->channels)
+    return &p->irs[i * p->channels + o];
+  return i != o? NULL : &p->irs[p->num_irs == 1? 0 : o];
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned c, k;
+  size_t len, block_len, want;
+  double * h;
+
+  p->channels = effp->in_signal.channels;
+  if (!(h = lsx_read_audio_file(effp, p->filename, &p->num_irs, &len)))
+    return SOX_EOF;
+  if (p->num_irs != 1 && p->num_irs != p->channels &&
+      p->num_irs != p->channels * p->channels) {
+    lsx_fail("impulse response `%s' has %u channels; it must have 1, %u or %u",
+        p->filename, p->num_irs, p->channels, p->channels * p->channels);
+    free(h);
+    return SOX_EOF;
+  }
+  if (!len || len > (size_t)SOX_INT_MAX(31) >> 1) {
+    lsx_fail("impulse response `%s' is %s", p->filename, len? "too long" : "empty");
+    free(h);
+    return SOX_EOF;
+  }
+
+  /* A power of 2, from -b or --dft-block if given: */
+  want = p->block_len? (size_t)p->block_len : sox_globals.log2_dft_block_size?
+    (size_t)1 << sox_globals.log2_dft_block_size : 1024;
+  for (block_len = 16; block_len < want; block_len <<= 1);
+  p->dft_length = 2 * block_len;
+  p->irs = lsx_calloc(p->num_irs, sizeof(*p->irs));
+  for (k = 0; k < p->num_irs; ++k)
+    lsx_set_dft_partitions(&p->irs[k], h + k * len, (int)len, (int)block_len);
+  free(h);
+  p->num_parts = (size_t)p->irs[0].num_parts;
+  lsx_debug("%u IRs of %lu taps in %lu partitions of %lu", p->num_irs,
+      (unsigned long)len, (unsigned long)p->num_parts, (unsigned long)block_len);
+
+  c = p->channels;
+  p->fdl = lsx_calloc((size_t)c * p->num_parts * p->dft_length, sizeof(*p->fdl));
+  p->in = lsx_calloc((size_t)c * p->dft_length, sizeof(*p->in));
+  p->out = lsx_calloc((size_t)c * p->dft_length, sizeof(*p->out));
+  p->fdl_pos = 0;
+  p->pos = p->out_pos = p->out_len = 0;
+  p->samples_in = p->samples_out = 0;
+  p->flushing = sox_false;
+
+  effp->out_signal.length = SOX_UNKNOWN_LEN;
+  if (effp->in_signal.length != SOX_UNKNOWN_LEN)
+    effp->out_signal.length = effp->in_signal.length +
+      (effp->in_signal.length? (len - 1) * c : 0);
+  effp->history = (double)len / effp->in_signal.rate;
+  lsx_effect_set_block(effp, block_len * c);
+  return SOX_SUCCESS;
+}
+
+/* Sums, for output channel o, the products over elements [begin, +BAND) */
+static void sum_band(priv_t * p, unsigned o, size_t begin)
+{
+  size_t const n = p->dft_length, parts = p->num_parts, end = min(n, begin + BAND);
+  double * y = p->out + o * n;
+  unsigned i;
+  size_t j;
+
+  memset(y + begin, 0, (end - begin) * sizeof(*y));
+  for (i = 0; i < p->channels; ++i) {
+    dft_filter_t const * ir = ir_for(p, i, o);
+    if (ir) for (j = 0; j < parts; ++j)
+      lsx_dft_mac(y, ir->coefs + j * n, p->fdl +
+          (i * parts + (p->fdl_pos + parts - j) % parts) * n, (int)begin, (int)end);
+  }
+}
+
+/* Convolves a whole block of input, giving a block of output */
+static void process_block(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  sox_context_t const * context = effp->global_info->global_info;
+  size_t const n = p->dft_length, block_len = n / 2;
+  long const chans = (long)p->channels, bands = (long)((n + BAND - 1) / BAND);
+  size_t threads = lsx_effect_threads(effp, (size_t)p->channels);
+  long i;
+
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+  for (i = 0; i < chans; ++i) {
+    double * in = p->in + (size_t)i * n;
+    double * x = p->fdl + ((size_t)i * p->num_parts + p->fdl_pos) * n;
+    memcpy(x, in, n * sizeof(*x));
+    memmove(in, in + block_len, block_len * sizeof(*in));
+    lsx_safe_rdft((int)n, 1, x);
+  }
+  lsx_threads_give(context, threads);
+
+  threads = lsx_effect_threads(effp, (size_t)(chans * bands));
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+  for (i = 0; i < chans * bands; ++i)
+    sum_band(p, (unsigned)(i / bands), (size_t)(i % bands) * BAND);
+  lsx_threads_give(context, threads);
+
+  threads = lsx_effect_threads(effp, (size_t)p->channels);
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+  for (i = 0; i < chans; ++i)
+    lsx_safe_rdft((int)n, -1, p->out + (size_t)i * n);
+  lsx_threads_give(context, threads);
+
+  p->fdl_pos = (p->fdl_pos + 1) % p->num_parts;
+  p->pos = p->out_pos = 0;
+  p->out_len = block_len;
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+                sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t const n = p->dft_length, block_len = n / 2;
+  size_t i, c, idone = 0, odone = min(*osamp / p->channels, p->out_len - p->out_pos);
+  SOX_SAMPLE_LOCALS;
+
+  if (p->flushing)
+    odone = min(odone, (size_t)(p->target - p->samples_out));
+  for (i = 0; i < odone; ++i, ++p->out_pos) for (c = 0; c < p->channels; ++c)
+    *obuf++ = SOX_FLOAT_64BIT_TO_SAMPLE(p->out[c * n + block_len + p->out_pos], effp->clips);
+  p->samples_out += odone;
+
+  if (p->out_pos == p->out_len && !p->flushing) {
+    idone = min(*isamp / p->channels, block_len - p->pos);
+    for (i = 0; i < idone; ++i, ++p->pos) for (c = 0; c < p->channels; ++c)
+      p->in[c * n + block_len + p->pos] = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf++,);
+    p->samples_in += idone;
+    if (p->pos == block_len)
+      process_block(effp);
+  }
+  *isamp = idone * p->channels;
+  *osamp = odone * p->channels;
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t const n = p->dft_length, block_len = n / 2;
+  static size_t isamp = 0;
+  size_t c;
+
+  if (!p->flushing) {   /* The output includes the IRs' tails */
+    p->flushing = sox_true;
+    p->target = p->samples_in? p->samples_in + (uint64_t)p->irs[0].num_taps - 1 : 0;
+  }
+  if (p->out_pos == p->out_len && p->samples_out < p->target) {
+    for (c = 0; c < p->channels; ++c)
+      memset(p->in + c * n + block_len + p->pos, 0,
+          (block_len - p->pos) * sizeof(*p->in));
+    process_block(effp);
+  }
+  return flow(effp, 0, obuf, &isamp, osamp);
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned k;
+
+  for (k = 0; k < p->num_irs; ++k)
+    free(p->irs[k].coefs);
+  free(p->irs);
+  free(p->fdl);
+  free(p->in);
+  free(p->out);
+  return SOX_SUCCESS;
+}
+
+sox_effect_handler_t const * lsx_convolve_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "convolve", "[-b block-length] impulse-response-file",
+    SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_GAIN,
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
+  };
+  return &handler;
+}
@@ -246,13 +246,13 @@ static int setup(sox_format_t *ft, int is_input)
     ft->signal.rate = stream_desc.mSampleRate;
   }
 
-  ac->bufsize = sox_globals.bufsiz / sizeof(sox_sample_t) * Buffactor;
+  ac->bufsize = ft->context->bufsiz / sizeof(sox_sample_t) * Buffactor;
   ac->bufrd = 0;
   ac->bufwr = 0;
   ac->bufrdavail = 0;
   ac->buf = lsx_malloc(ac->bufsize * sizeof(float));
 
-  buf_size = sox_globals.bufsiz / sizeof(sox_sample_t) * sizeof(float);
+  buf_size = ft->context->bufsiz / sizeof(sox_sample_t) * sizeof(float);
   property_size = sizeof(buf_size);
   status = AudioDeviceSetProperty(ac->adid, NULL, 0, is_input,
                                   kAudioDevicePropertyBufferSize,
@@ -412,7 +412,7 @@ LSX_FORMAT_HANDLER(coreaudio)
     names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
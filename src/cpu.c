@@ -0,0 +1,71 @@
+/* libSoX CPU features: detected once, by sox_init, for kernels that have
+ * versions for several instruction sets to choose between at run-time.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "sox_i.h"
+
+/* Until sox_init, none: each kernel's function pointer starts at its
+ * portable version, so libSoX works (if slower) without it. */
+static unsigned features;
+
+static unsigned detect(void)
+{
+  unsigned f = 0;
+
+#if defined HAVE_LSX_TARGET
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2"))
+    f |= LSX_CPU_SSE2;
+  if (__builtin_cpu_supports("ssse3"))
+    f |= LSX_CPU_SSSE3;
+  if (__builtin_cpu_supports("sse4.1"))
+    f |= LSX_CPU_SSE41;
+  if (__builtin_cpu_supports("avx"))
+    f |= LSX_CPU_AVX;
+  if (__builtin_cpu_supports("avx2"))
+    f |= LSX_CPU_AVX2;
+  if (__builtin_cpu_supports("fma"))
+    f |= LSX_CPU_FMA;
+#if __GNUC__ >= 5
+  if (__builtin_cpu_supports("avx512f"))
+    f |= LSX_CPU_AVX512F;
+#endif
+#elif defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+  f |= LSX_CPU_SSE2;
+#endif
+#if defined __ARM_NEON && defined __aarch64__
+  f |= LSX_CPU_NEON; /* Part of the base AArch64 instruction set */
+#endif
+  return f;
+}
+
+unsigned lsx_cpu_features(void)
+{
+  return features;
+}
+
+/* Each module with such kernels has its dispatch function called here, to
+ * fill in its function pointers before any thread can use them. */
+void lsx_cpu_init(void)
+{
+  features = detect();
+  lsx_raw_dispatch(features);
+  lsx_rate_dispatch(features);
+  lsx_adpcm_dispatch(features);
+  lsx_adpcms_dispatch(features);
+}
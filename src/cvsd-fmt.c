@@ -26,7 +26,8 @@ LSX_FORMAT_HANDLER(cvsd)
     names, SOX_FILE_MONO,
     lsx_cvsdstartread, lsx_cvsdread, lsx_cvsdstopread,
     lsx_cvsdstartwrite, lsx_cvsdwrite, lsx_cvsdstopwrite,
-    lsx_rawseek, write_encodings, NULL, sizeof(cvsd_priv_t)
+    lsx_rawseek, write_encodings, NULL, sizeof(cvsd_priv_t), NULL, NULL,
+    NULL, NULL
   };
   return &handler;
 }
@@ -108,7 +109,7 @@ LSX_FORMAT_HANDLER(cvu)
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
     "Headerless Continuously Variable Slope Delta modulation (unfiltered)",
     names, SOX_FILE_MONO, start, cvsdread, NULL, start, cvsdwrite, NULL,
-    lsx_rawseek, write_encodings, NULL, sizeof(priv_t)
+    lsx_rawseek, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -39,6 +39,11 @@
  *     (16 -> 32 floats), but keeps the memory from having to
  *     be copied so many times.  56% speed increase decoding;
  *     less than 5% encoding speed increase.
+ *
+ * Oct. 2026 - Bits are coded a block at a time: the filters are applied
+ *   to a whole block (each output or bit being a lane for the compiler
+ *   to vectorise), apart from the serial delta modulation, and bytes are
+ *   read and written a block at a time.  Results are unchanged.
  */
 
 #include "sox_i.h"
@@ -55,106 +60,51 @@
 
 typedef cvsd_priv_t priv_t;
 
-static int debug_count = 0;
-
 /* ---------------------------------------------------------------------- */
 
-/* This float_conv() function is not used as more specialized/optimized
- * versions exist below.  However, those new versions are tied to
- * very percise filters defined in cvsdfilt.h.  If those are modified
- * or different filters are found to be required, this function may
- * be needed.  Thus I leave it here for possible future use, but commented
- * out to avoid compiler warnings about it not being used.
-static float float_conv(float const *fp1, float const *fp2,int n)
-{
-        float res = 0;
-        for(; n > 0; n--)
-                res += (*fp1++) * (*fp2++);
-        return res;
-}
-*/
+/* The specialized filters below are tied to the very precise filters defined
+ * in cvsdfilt.h.  If those are modified or different filters are found to be
+ * required, a general float_conv() (sum of fp1[i] * fp2[i]) may be needed.
+ *
+ * Each output (or bit) is summed in the order it always has been, so that
+ * results are unchanged; the compiler vectorises across outputs instead.
+ */
 
-static float float_conv_enc(float const *fp1, float const *fp2)
+static void enc_filter(float const * x, float const * f, float * out, size_t n)
 {
-    /* This is a specialzed version of float_conv() for encoding
-     * which simply assumes a CVSD_ENC_FILTERLEN (16) length of
-     * the two arrays and unrolls that loop.
-     *
-     * fp1 should be the enc.input_filter array and must be 
-     * CVSD_ENC_FILTERLEN (16) long.
-     *
-     * fp2 should be one of the enc_filter_xx_y() tables listed
-     * in cvsdfilt.h.  At minimum, fp2 must be CVSD_ENC_FILTERLEN
-     * (16) entries long.
+    /* For encoding: out[i] is the dot product of the CVSD_ENC_FILTERLEN
+     * (16) samples up to x[i + 15] (newest first) with the enc_filter_xx_y()
+     * table f.  x[0] is thus the oldest sample used.
      */
-    float res = 0;
-
-    /* unrolling loop */ 
-    res += fp1[0] * fp2[0];
-    res += fp1[1] * fp2[1];
-    res += fp1[2] * fp2[2];
-    res += fp1[3] * fp2[3];
-    res += fp1[4] * fp2[4];
-    res += fp1[5] * fp2[5];
-    res += fp1[6] * fp2[6];
-    res += fp1[7] * fp2[7];
-    res += fp1[8] * fp2[8];
-    res += fp1[9] * fp2[9];
-    res += fp1[10] * fp2[10];
-    res += fp1[11] * fp2[11];
-    res += fp1[12] * fp2[12];
-    res += fp1[13] * fp2[13];
-    res += fp1[14] * fp2[14];
-    res += fp1[15] * fp2[15];
-
-    return res;
+    size_t i;
+    int j;
+
+    for (i = 0; i < n; ++i)
+        out[i] = x[i + 15] * f[0];
+    for (j = 1; j < CVSD_ENC_FILTERLEN; ++j)
+        for (i = 0; i < n; ++i)
+            out[i] += x[i + 15 - j] * f[j];
 }
 
-static float float_conv_dec(float const *fp1, float const *fp2)
+static inline void dec_filter(float const * x, float const * f, float * out,
+    size_t n, unsigned k)
 {
-    /* This is a specialzed version of float_conv() for decoding
-     * which assumes a specific length and structure to the data
-     * in fp2.
-     *
-     * fp1 should be the dec.output_filter array and must be 
-     * CVSD_DEC_FILTERLEN (48) long.
-     *
-     * fp2 should be one of the dec_filter_xx() tables listed
-     * in cvsdfilt.h.  fp2 is assumed to be CVSD_DEC_FILTERLEN
-     * (48) entries long, is assumed to have 0.0 in the last
-     * entry, and is a symmetrical mirror around fp2[23] (ie,
-     * fp2[22] == fp2[24], fp2[0] == fp2[47], etc).
+    /* For decoding: out[i] is the dot product of the CVSD_DEC_FILTERLEN
+     * (48) bits up to x[i * k + 46] (newest first) with the dec_filter_xx()
+     * table f, outputs being k bits apart.  f is assumed to have 0.0 in
+     * the last entry, and to be a symmetrical mirror around f[23] (ie,
+     * f[22] == f[24], f[0] == f[46], etc), so x[i * k] is the oldest bit used.
      */
-    float res = 0;
-
-    /* unrolling loop, also taking advantage of the symmetry
-    * of the sampling rate array*/
-    res += (fp1[0] + fp1[46]) * fp2[0];
-    res += (fp1[1] + fp1[45]) * fp2[1];
-    res += (fp1[2] + fp1[44]) * fp2[2];
-    res += (fp1[3] + fp1[43]) * fp2[3];
-    res += (fp1[4] + fp1[42]) * fp2[4];
-    res += (fp1[5] + fp1[41]) * fp2[5];
-    res += (fp1[6] + fp1[40]) * fp2[6];
-    res += (fp1[7] + fp1[39]) * fp2[7];
-    res += (fp1[8] + fp1[38]) * fp2[8];
-    res += (fp1[9] + fp1[37]) * fp2[9];
-    res += (fp1[10] + fp1[36]) * fp2[10];
-    res += (fp1[11] + fp1[35]) * fp2[11];
-    res += (fp1[12] + fp1[34]) * fp2[12];
-    res += (fp1[13] + fp1[33]) * fp2[13];
-    res += (fp1[14] + fp1[32]) * fp2[14];
-    res += (fp1[15] + fp1[31]) * fp2[15];
-    res += (fp1[16] + fp1[30]) * fp2[16];
-    res += (fp1[17] + fp1[29]) * fp2[17];
-    res += (fp1[18] + fp1[28]) * fp2[18];
-    res += (fp1[19] + fp1[27]) * fp2[19];
-    res += (fp1[20] + fp1[26]) * fp2[20];
-    res += (fp1[21] + fp1[25]) * fp2[21];
-    res += (fp1[22] + fp1[24]) * fp2[22];
-    res += (fp1[23]) * fp2[23];
-
-    return res;
+    size_t i;
+    int j;
+
+    for (i = 0; i < n; ++i)
+        out[i] = (x[i * k + 46] + x[i * k]) * f[0];
+    for (j = 1; j < 23; ++j)
+        for (i = 0; i < n; ++i)
+            out[i] += (x[i * k + 46 - j] + x[i * k + j]) * f[j];
+    for (i = 0; i < n; ++i)
+        out[i] += x[i * k + 23] * f[23];
 }
 
 /* ---------------------------------------------------------------------- */
@@ -226,10 +176,8 @@ int lsx_cvsdstartread(sox_format_t * ft)
         /*
          * zero the filter
          */
-        for(fp1 = p->c.dec.output_filter, i = CVSD_DEC_FILTERLEN*2; i > 0; i--)
+        for(fp1 = p->c.dec.output_filter, i = CVSD_DEC_FILTERLEN; i > 0; i--)
                 *fp1++ = 0;
-        /* initialize mirror circular buffer offset to anything sane. */
-        p->c.dec.offset = CVSD_DEC_FILTERLEN - 1;
 
         return (SOX_SUCCESS);
 }
@@ -249,11 +197,9 @@ int lsx_cvsdstartwrite(sox_format_t * ft)
         /*
          * zero the filter
          */
-        for(fp1 = p->c.enc.input_filter, i = CVSD_ENC_FILTERLEN*2; i > 0; i--)
+        for(fp1 = p->c.enc.input_filter, i = CVSD_ENC_FILTERLEN; i > 0; i--)
                 *fp1++ = 0;
         p->c.enc.recon_int = 0;
-        /* initialize mirror circular buffer offset to anything sane. */
-        p->c.enc.offset = CVSD_ENC_FILTERLEN - 1;
 
         return(SOX_SUCCESS);
 }
@@ -291,64 +237,65 @@ int lsx_cvsdstopread(sox_format_t * ft)
 size_t lsx_cvsdread(sox_format_t * ft, sox_sample_t *buf, size_t nsamp)
 {
         priv_t *p = (priv_t *) ft->priv;
+        unsigned k = 4 / p->com.phase_inc; /* bits per output */
+        float *hist = p->c.dec.output_filter, *bits = hist + CVSD_DEC_FILTERLEN;
+        float out[CVSD_BLOCK / 2];
+        unsigned char bytes[CVSD_BLOCK / 8];
         size_t done = 0;
-        float oval;
 
         while (done < nsamp) {
-                if (!p->bit.cnt) {
-                        if (lsx_read_b_buf(ft, &(p->bit.shreg), (size_t) 1) != 1)
-                                return done;
-                        p->bit.cnt = 8;
-                        p->bit.mask = 1;
+                /* the first output is due after this block's bit number first */
+                size_t first = (4 - p->com.phase) / p->com.phase_inc - 1;
+                size_t n = min(nsamp - done, CVSD_BLOCK / k);
+                size_t nbits = first + 1 + (n - 1) * k, nbytes = 0, got = 0;
+                size_t i, j;
+
+                if (nbits > p->bit.cnt) {
+                        nbytes = (nbits - p->bit.cnt + 7) / 8;
+                        got = lsx_read_b_buf(ft, bytes, nbytes);
+                        if (got < nbytes) {
+                                nbits = min(nbits, p->bit.cnt + got * 8);
+                                n = nbits > first ? (nbits - first - 1) / k + 1 : 0;
+                        }
                 }
                 /*
-                 * handle one bit
+                 * handle the block's bits
                  */
-                p->bit.cnt--;
-                p->com.overload = ((p->com.overload << 1) |
-                                   (!!(p->bit.shreg & p->bit.mask))) & 7;
-                p->bit.mask <<= 1;
-                p->com.mla_int *= p->com.mla_tc0;
-                if ((p->com.overload == 0) || (p->com.overload == 7))
-                        p->com.mla_int += p->com.mla_tc1;
-
-                /* shift output filter window in mirror cirular buffer. */
-                if (p->c.dec.offset != 0)
-                        --p->c.dec.offset;
-                else p->c.dec.offset = CVSD_DEC_FILTERLEN - 1;
-                /* write into both halves of the mirror circular buffer */
-                if (p->com.overload & 1)
-                {
-                        p->c.dec.output_filter[p->c.dec.offset] = p->com.mla_int;
-                        p->c.dec.output_filter[p->c.dec.offset + CVSD_DEC_FILTERLEN] = p->com.mla_int;
-                }
-                else
-                {
-                        p->c.dec.output_filter[p->c.dec.offset] = -p->com.mla_int;
-                        p->c.dec.output_filter[p->c.dec.offset + CVSD_DEC_FILTERLEN] = -p->com.mla_int;
+                for (i = j = 0; i < nbits; ++i) {
+                        if (!p->bit.cnt) {
+                                p->bit.shreg = bytes[j++];
+                                p->bit.cnt = 8;
+                                p->bit.mask = 1;
+                        }
+                        p->bit.cnt--;
+                        p->com.overload = ((p->com.overload << 1) |
+                                           (!!(p->bit.shreg & p->bit.mask))) & 7;
+                        p->bit.mask <<= 1;
+                        p->com.mla_int *= p->com.mla_tc0;
+                        if ((p->com.overload == 0) || (p->com.overload == 7))
+                                p->com.mla_int += p->com.mla_tc1;
+                        bits[i] = (p->com.overload & 1) ?
+                                p->com.mla_int : -p->com.mla_int;
                 }
+                p->com.phase = (p->com.phase + nbits * p->com.phase_inc) & 3;
 
                 /*
-                 * check if the next output is due
+                 * filter the outputs that were due
                  */
-                p->com.phase += p->com.phase_inc;
-                if (p->com.phase >= 4) {
-                        oval = float_conv_dec(
-                                p->c.dec.output_filter + p->c.dec.offset,
-                                (p->cvsd_rate < 24000) ?
-                                dec_filter_16 : dec_filter_32);
-                        lsx_debug_more("input %d %f\n", debug_count, p->com.mla_int);
-                        lsx_debug_more("recon %d %f\n", debug_count, oval);
-                        debug_count++;
-
-                        if (oval > p->com.v_max)
-                                p->com.v_max = oval;
-                        if (oval < p->com.v_min)
-                                p->com.v_min = oval;
-                        *buf++ = (oval * ((float)SOX_SAMPLE_MAX));
-                        done++;
+                if (k == 2)
+                        dec_filter(bits + first - 46, dec_filter_16, out, n, 2);
+                else dec_filter(bits + first - 46, dec_filter_32, out, n, 4);
+                for (i = 0; i < n; ++i) {
+                        if (out[i] > p->com.v_max)
+                                p->com.v_max = out[i];
+                        if (out[i] < p->com.v_min)
+                                p->com.v_min = out[i];
+                        *buf++ = (out[i] * ((float)SOX_SAMPLE_MAX));
                 }
-                p->com.phase &= 3;
+                done += n;
+                memmove(hist, hist + nbits, CVSD_DEC_FILTERLEN * sizeof(*hist));
+                if (got < nbytes)
+                        break;
         }
         return done;
 }
@@ -358,66 +305,57 @@ size_t lsx_cvsdread(sox_format_t * ft, sox_sample_t *buf, size_t nsamp)
 size_t lsx_cvsdwrite(sox_format_t * ft, const sox_sample_t *buf, size_t nsamp)
 {
         priv_t *p = (priv_t *) ft->priv;
+        unsigned k = 4 / p->com.phase_inc; /* bits per input */
+        float const * const * filters = (p->cvsd_rate < 24000) ?
+                enc_filter_16 : enc_filter_32;
+        float *hist = p->c.enc.input_filter, *in = hist + CVSD_ENC_FILTERLEN;
+        float inval[CVSD_BLOCK];
+        unsigned char bytes[CVSD_BLOCK / 8];
         size_t done = 0;
-        float inval;
 
-        for(;;) {
+        while (done < nsamp) {
+                size_t n = min(nsamp - done, CVSD_BLOCK / k), nbytes = 0;
+                size_t i;
+                unsigned j;
+
+                for (i = 0; i < n; ++i)
+                        in[i] = (*buf++) / ((float)SOX_SAMPLE_MAX);
+                /* insert input filter here!  One row of inval per phase */
+                for (j = 0; j < k; ++j)
+                        enc_filter(in - CVSD_ENC_FILTERLEN + 1, filters[j],
+                                   inval + j * n, n);
                 /*
-                 * check if the next input is due
+                 * encode the block's bits
                  */
-                if (p->com.phase >= 4) {
-                        if (done >= nsamp)
-                                return done;
-
-                        /* shift input filter window in mirror cirular buffer. */
-                        if (p->c.enc.offset != 0)
-                                --p->c.enc.offset;
-                        else p->c.enc.offset = CVSD_ENC_FILTERLEN - 1;
-
-                        /* write into both halves of the mirror circular buffer */
-                        p->c.enc.input_filter[p->c.enc.offset] = 
-                                 p->c.enc.input_filter[p->c.enc.offset 
-                                     + CVSD_ENC_FILTERLEN] = 
-                                                (*buf++) /
-                                                    ((float)SOX_SAMPLE_MAX);
-                        done++;
+                for (i = 0; i < n; ++i) for (j = 0; j < k; ++j) {
+                        p->com.overload = (((p->com.overload << 1) |
+                                            (inval[j * n + i] >  p->c.enc.recon_int)) & 7);
+                        p->com.mla_int *= p->com.mla_tc0;
+                        if ((p->com.overload == 0) || (p->com.overload == 7))
+                                p->com.mla_int += p->com.mla_tc1;
+                        if (p->com.mla_int > p->com.v_max)
+                                p->com.v_max = p->com.mla_int;
+                        if (p->com.mla_int < p->com.v_min)
+                                p->com.v_min = p->com.mla_int;
+                        if (p->com.overload & 1) {
+                                p->c.enc.recon_int += p->com.mla_int;
+                                p->bit.shreg |= p->bit.mask;
+                        } else
+                                p->c.enc.recon_int -= p->com.mla_int;
+                        if ((++(p->bit.cnt)) >= 8) {
+                                bytes[nbytes++] = p->bit.shreg;
+                                p->bit.shreg = p->bit.cnt = 0;
+                                p->bit.mask = 1;
+                        } else
+                                p->bit.mask <<= 1;
                 }
-                p->com.phase &= 3;
-                /* insert input filter here! */
-                inval = float_conv_enc(
-                                   p->c.enc.input_filter + p->c.enc.offset,
-                                   (p->cvsd_rate < 24000) ?
-                                   (enc_filter_16[(p->com.phase >= 2)]) :
-                                   (enc_filter_32[p->com.phase]));
-                /*
-                 * encode one bit
-                 */
-                p->com.overload = (((p->com.overload << 1) |
-                                    (inval >  p->c.enc.recon_int)) & 7);
-                p->com.mla_int *= p->com.mla_tc0;
-                if ((p->com.overload == 0) || (p->com.overload == 7))
-                        p->com.mla_int += p->com.mla_tc1;
-                if (p->com.mla_int > p->com.v_max)
-                        p->com.v_max = p->com.mla_int;
-                if (p->com.mla_int < p->com.v_min)
-                        p->com.v_min = p->com.mla_int;
-                if (p->com.overload & 1) {
-                        p->c.enc.recon_int += p->com.mla_int;
-                        p->bit.shreg |= p->bit.mask;
-                } else
-                        p->c.enc.recon_int -= p->com.mla_int;
-                if ((++(p->bit.cnt)) >= 8) {
-                        lsx_writeb(ft, p->bit.shreg);
-                        p->bytes_written++;
-                        p->bit.shreg = p->bit.cnt = 0;
-                        p->bit.mask = 1;
-                } else
-                        p->bit.mask <<= 1;
-                p->com.phase += p->com.phase_inc;
-                lsx_debug_more("input %d %f\n", debug_count, inval);
-                lsx_debug_more("recon %d %f\n", debug_count, p->c.enc.recon_int);
-                debug_count++;
+                memmove(hist, hist + n, CVSD_ENC_FILTERLEN * sizeof(*hist));
+                if (lsx_write_b_buf(ft, bytes, nbytes) != nbytes)
+                        return done;
+                p->bytes_written += nbytes;
+                done += n;
         }
+        return done;
 }
 
 /* ---------------------------------------------------------------------- */
@@ -577,7 +515,7 @@ static void make_dvms_hdr(sox_format_t * ft, struct dvms_header *hdr)
                 len = sizeof(hdr->Filename)-1;
         memcpy(hdr->Filename, ft->filename, len);
         hdr->Id = hdr->State = 0;
-        hdr->Unixtime = sox_globals.repeatable? 0 : time(NULL);
+        hdr->Unixtime = ft->context->repeatable? 0 : time(NULL);
         hdr->Usender = hdr->Ureceiver = 0;
         hdr->Length = p->bytes_written;
         hdr->Srate = p->cvsd_rate/100;
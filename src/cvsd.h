@@ -23,6 +23,7 @@
 
 #define CVSD_ENC_FILTERLEN 16  /* PCM sampling rate */
 #define CVSD_DEC_FILTERLEN 48  /* CVSD sampling rate */
+#define CVSD_BLOCK 1024        /* Most bits coded at a time */
 
 typedef struct {
   struct {
@@ -36,15 +37,13 @@ typedef struct {
   } com;
   union {
     struct {
-      /* mirror circular buffer */
-      float output_filter[CVSD_DEC_FILTERLEN*2];
-      unsigned offset; /* into output_filter; always in first half */
+      /* the last bits decoded, oldest first, then a block's bits */
+      float output_filter[CVSD_DEC_FILTERLEN + CVSD_BLOCK];
     } dec;
     struct {
       float recon_int;
-      /* mirror circular buffer */
-      float input_filter[CVSD_ENC_FILTERLEN*2];
-      unsigned offset; /* into input_filter; always in first half */
+      /* the last samples input, oldest first, then a block's samples */
+      float input_filter[CVSD_ENC_FILTERLEN + CVSD_BLOCK / 2];
     } enc;
   } c;
   struct {
@@ -156,7 +156,7 @@ LSX_FORMAT_HANDLER(dat)
     "Textual representation of the sampled audio", names, 0,
     sox_datstartread, sox_datread, NULL,
     sox_datstartwrite, sox_datwrite, NULL,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -150,13 +150,13 @@ static sox_effect_handler_t sox_dcshift_effect = {
    "shift [ limitergain ]\n"
    "\tThe peak limiter has a gain much less than 1.0 (ie 0.05 or 0.02) which\n"
    "\tis only used on peaks to prevent clipping. (default is no limiter)",
-   SOX_EFF_MCHAN | SOX_EFF_GAIN,
+   SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_SEEK | SOX_EFF_INPLACE | SOX_EFF_RTSAFE,
    sox_dcshift_getopts,
    sox_dcshift_start,
    sox_dcshift_flow,
    NULL,
    sox_dcshift_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_dcshift_effect_fn(void)
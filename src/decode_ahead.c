@@ -0,0 +1,229 @@
+/* libSoX decode-ahead of input files
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* For an input file given to sox_set_decode_ahead, sox_read comes here.
+ * Whilst sox_flow_effects runs, services (lsx_decode_ahead_serve, each on a
+ * thread of its own) call the format handlers to decode into a ring buffer
+ * of samples per file, so that several files (e.g. stems being mixed) are
+ * decoded at once, and alongside the effects.  A service claims a file that
+ * has yet to be decoded to its end, and keeps to it until it has been; it
+ * may then claim another (e.g. the next of a sequence of files, given to
+ * sox_set_decode_ahead as the flow runs).
+ *
+ * The ring itself needs no lock, but a file's lock is held whilst its
+ * handler is called: if the ring has run dry, the caller takes the lock and
+ * decodes directly, so it never waits for a service to catch up, and
+ * outside sox_flow_effects all reading is done so.  The list of files is
+ * locked whilst a service looks for a file (taking the file's lock only if
+ * it is free), or whilst a file is closed (waiting for the file's lock).
+ */
+
+#include "sox_i.h"
+#include "ringbuf.h"
+#include <string.h>
+
+typedef struct {
+  sox_format_t * ft;
+  ringbuf_t    ring;         /* Samples decoded ahead */
+  sox_sample_t * block;      /* The service's decode buffer */
+  size_t       block_len;
+  size_t       eof;          /* Has been decoded to the end */
+  uint64_t     decoded;      /* Samples decoded, as ft->olength */
+  size_t       claimed;      /* 1 + the number of its service, or 0 */
+  omp_lock_t   lock;
+} decode_ahead_t;
+
+static decode_ahead_t * * aheads;  /* The files decoding ahead */
+static size_t num_aheads;
+UNUSED static omp_lock_t aheads_lock;
+static sox_bool aheads_lock_ready;
+
+size_t lsx_decode_ahead_pending(void)
+{
+  return num_aheads;
+}
+
+/* Returns the number of services to run: one per file yet to be decoded */
+size_t lsx_decode_ahead_start(void)
+{
+  size_t i, n = 0;
+
+  for (i = 0; i < num_aheads; ++i)
+    n += !aheads[i]->eof;
+  return n;
+}
+
+void lsx_decode_ahead_stop(void)
+{
+  size_t i;
+
+  for (i = 0; i < num_aheads; ++i)
+    aheads[i]->claimed = 0;
+}
+
+/* Returns sox_true if there was anything to do */
+static sox_bool decode(decode_ahead_t * a)
+{
+  sox_format_t * ft = a->ft;
+  size_t len = a->block_len, n;
+
+  if (a->eof || ringbuf_space(&a->ring) < len)
+    return sox_false;
+  if (ft->signal.length != SOX_UNSPEC)
+    len = min(len, ft->signal.length - a->decoded);
+  n = len? lsx_decode(ft, a->block, len) : 0;
+  ringbuf_write(&a->ring, n, a->block);
+  a->decoded += n;
+  if (!n)
+    ringbuf_store(&a->eof, (size_t)1);
+  return sox_true;
+}
+
+/* Returns the file that service n is to decode now, locked, or NULL */
+static decode_ahead_t * claim(size_t n)
+{
+  decode_ahead_t * a = NULL;
+  size_t i;
+
+  omp_set_lock(&aheads_lock);
+  for (i = 0; i < num_aheads && !a; ++i)
+    if (aheads[i]->claimed == n + 1) {
+      if (ringbuf_load(&aheads[i]->eof))
+        aheads[i]->claimed = 0;
+      else a = aheads[i];
+    }
+  for (i = 0; i < num_aheads && !a; ++i)
+    if (!aheads[i]->claimed && !ringbuf_load(&aheads[i]->eof))
+      (a = aheads[i])->claimed = n + 1;
+  if (a && !omp_test_lock(&a->lock))
+    a = NULL;  /* The caller is reading it; try again later */
+  omp_unset_lock(&aheads_lock);
+  return a;
+}
+
+/* Decodes a file at a time until *stop is set */
+void lsx_decode_ahead_serve(size_t n, size_t * stop)
+{
+  unsigned waits = 0;
+
+  while (!ringbuf_load(stop)) {
+    decode_ahead_t * a = claim(n);
+    sox_bool busy = sox_false;
+
+    if (a) {
+      busy = decode(a);
+      omp_unset_lock(&a->lock);
+    }
+    if (busy)
+      waits = 0;
+    else lsx_thread_wait(&waits);
+  }
+}
+
+size_t lsx_decode_ahead_read(sox_format_t * ft, sox_sample_t * buf, size_t len)
+{
+  decode_ahead_t * a = ft->decode_ahead;
+  size_t done, n;
+
+  done = ringbuf_read(&a->ring, len, buf);  /* Needs no lock */
+  if (done == len)
+    return done;
+  omp_set_lock(&a->lock);
+  done += ringbuf_read(&a->ring, len - done, buf + done);
+  if (done < len && !a->eof) {  /* The ring is dry: decode directly */
+    n = lsx_decode(ft, buf + done, len - done);
+    a->decoded += n;
+    done += n;
+    if (!n)
+      ringbuf_store(&a->eof, (size_t)1);
+  }
+  omp_unset_lock(&a->lock);
+  return done;
+}
+
+/* Samples decoded ahead are discarded only if the handler's seek succeeds */
+int lsx_decode_ahead_seek(sox_format_t * ft, uint64_t offset)
+{
+  decode_ahead_t * a = ft->decode_ahead;
+  int result;
+
+  omp_set_lock(&a->lock);
+  if (ft->decode_cache)  /* Not read back (see sox_set_decode_ahead) */
+    lsx_decode_cache_seek(ft, offset);
+  result = (*ft->handler.seek)(ft, offset);
+  if (result == SOX_SUCCESS) {
+    while (ringbuf_read(&a->ring, a->block_len, a->block));
+    a->decoded = offset;
+    ringbuf_store(&a->eof, (size_t)0);
+  }
+  omp_unset_lock(&a->lock);
+  return result;
+}
+
+void lsx_decode_ahead_close(sox_format_t * ft)
+{
+  decode_ahead_t * a = ft->decode_ahead;
+  size_t i;
+
+  if (!a)
+    return;
+  omp_set_lock(&aheads_lock);
+  for (i = 0; aheads[i] != a; ++i);
+  aheads[i] = aheads[--num_aheads];
+  omp_set_lock(&a->lock);    /* Waits for a service to finish with it */
+  omp_unset_lock(&a->lock);
+  omp_unset_lock(&aheads_lock);
+  omp_destroy_lock(&a->lock);
+  ringbuf_delete(&a->ring);
+  free(a->block);
+  free(a);
+  ft->decode_ahead = NULL;
+}
+
+int sox_set_decode_ahead(sox_format_t * ft, unsigned buffers)
+{
+  decode_ahead_t * a;
+  size_t chans = max(ft->signal.channels, 1);
+
+  if (ft->mode != 'r' || buffers < 1) {
+    lsx_fail_errno(ft, SOX_EINVAL,
+        "decode-ahead needs an input file and at least 1 buffer");
+    return SOX_EOF;
+  }
+  if (ft->decode_ahead || !ft->handler.read || lsx_decode_cache_hit(ft) ||
+      (ft->handler.flags & SOX_FILE_DEVICE) ||
+      !(sox_version_info()->flags & sox_version_have_threads))
+    return SOX_SUCCESS;  /* Nothing to gain */
+  if (!aheads_lock_ready) {
+    omp_init_lock(&aheads_lock);
+    aheads_lock_ready = sox_true;
+  }
+  ft->decode_ahead = a = lsx_calloc(1, sizeof(*a));
+  a->ft = ft;
+  a->block_len = max(ft->context->bufsiz - ft->context->bufsiz % chans, chans);
+  a->block = lsx_malloc(a->block_len * sizeof(*a->block));
+  a->decoded = ft->olength;
+  ringbuf_create(&a->ring, sizeof(sox_sample_t), buffers * a->block_len);
+  omp_init_lock(&a->lock);
+  omp_set_lock(&aheads_lock);
+  lsx_revalloc(aheads, num_aheads + 1);
+  aheads[num_aheads++] = a;
+  omp_unset_lock(&aheads_lock);
+  lsx_debug("`%s': decoding ahead %u buffers of %" PRIuPTR " samples",
+      ft->filename, buffers, a->block_len);
+  return SOX_SUCCESS;
+}
@@ -0,0 +1,326 @@
+/* libSoX decoded-audio cache of input files
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* With the context's decode_cache_path, an input file of a compressed
+ * encoding (e.g. MP3, FLAC, Opus) is, the first time that it is read from
+ * start to end, also written, as decoded, to a file in that directory,
+ * named by the hash of a key: the file's name, identity, size and
+ * modification & status-change times (to the nanosecond, where stat gives
+ * them), how it is to be read, and the version of libSoX.  When a file
+ * with that key is opened later, its reads and seeks (now sample-accurate,
+ * whatever the format) are served from a memory-map of the cache file, and
+ * its decoder is not called.
+ *
+ * The cache file is local, so in the machine's byte order:
+ *   DECODED_MAGIC (16 bytes); the number of samples (64-bit; 0 until the
+ *   file is complete); the key's length (32-bit) and the key; padding to a
+ *   multiple of 8 bytes; then the samples, as sox_sample_t.
+ * It is written under a temporary name, and renamed only once all of the
+ * audio has been decoded; a seek before then abandons it.  (Decode-ahead
+ * reads through lsx_decode, so through here, and is not used when reading
+ * back.) */
+
+#include "sox_i.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_UNISTD_H
+  #include <unistd.h>
+#endif
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  #include <sys/mman.h>
+#endif
+
+#define DECODED_MAGIC "SoX decoded PCM\n"
+#define HEADER_LEN (sizeof(DECODED_MAGIC) - 1 + 8 + 4)
+
+typedef struct {
+  char         * key;
+  char         * name;      /* The cache file's */
+  char         * tmp;       /* If it is being written: the temporary file's */
+  FILE         * file;      /* Being written, or (if not mapped) read */
+  sox_bool     hit;         /* Being read back */
+  sox_bool     complete;    /* Being written, and all of the audio has been */
+  void         * map;       /* If read back: the whole file, mapped */
+  size_t       map_size;
+  sox_sample_t const * data;
+  uint64_t     data_start;  /* Offset of the samples in the file */
+  uint64_t     len, pos;    /* Samples: in all, and (if read back) the next */
+} decode_cache_t;
+
+/* Encodings that cost little more to decode than to read back */
+static sox_bool is_cheap(sox_encoding_t e)
+{
+  return e == SOX_ENCODING_SIGN2 || e == SOX_ENCODING_UNSIGNED ||
+    e == SOX_ENCODING_FLOAT || e == SOX_ENCODING_ULAW ||
+    e == SOX_ENCODING_ALAW || e == SOX_ENCODING_UNKNOWN;
+}
+
+static char * make_key(sox_format_t const * ft, struct stat const * st)
+{
+  char * key = lsx_malloc(strlen(ft->filename) + strlen(ft->filetype) + 512);
+
+  sprintf(key, "%s\n%s\n%s\n%.17g %.17g %.17g %.17g %.17g %.17g %.17g\n"
+      "%.17g %u %u %.17g\n%u %u %u %u %u %u",
+      sox_version(), ft->filetype, ft->filename,
+      (double)st->st_dev, (double)st->st_ino, (double)st->st_size,
+      (double)st->st_mtime, (double)ST_MTIME_NSEC(*st),
+      (double)st->st_ctime, (double)ST_CTIME_NSEC(*st),
+      ft->signal.rate, ft->signal.channels,
+      ft->signal.precision, (double)ft->signal.length,
+      ft->encoding.encoding, ft->encoding.bits_per_sample,
+      ft->encoding.reverse_bytes, ft->encoding.reverse_nibbles,
+      ft->encoding.reverse_bits, ft->encoding.opposite_endian);
+  return key;
+}
+
+static char * make_name(char const * path, char const * key)
+{
+  char * name = lsx_malloc(strlen(path) + 32);
+  uint64_t hash = 14695981039346656037u; /* FNV-1a, as for design files */
+
+  for (; *key; ++key)
+    hash = (hash ^ (unsigned char)*key) * 1099511628211u;
+  sprintf(name, "%s/%08lx%08lx.pcm", path,
+      (unsigned long)(hash >> 32), (unsigned long)(hash & 0xffffffff));
+  return name;
+}
+
+/* Opens the cache file for reading back, if it is complete and for c->key */
+static sox_bool load(decode_cache_t * c)
+{
+  size_t key_len = strlen(c->key);
+  char magic[sizeof(DECODED_MAGIC) - 1], * k = NULL;
+  uint64_t len;
+  uint32_t n;
+  struct stat st;
+  sox_bool ok;
+
+  if (!(c->file = fopen(c->name, "rb")))
+    return sox_false;
+  c->data_start = (HEADER_LEN + key_len + 7) & ~(uint64_t)7;
+  ok = fread(magic, sizeof(magic), (size_t)1, c->file) == 1 &&
+    !memcmp(magic, DECODED_MAGIC, sizeof(magic)) &&
+    fread(&len, sizeof(len), (size_t)1, c->file) == 1 && len &&
+    fread(&n, sizeof(n), (size_t)1, c->file) == 1 && n == key_len &&
+    fread(k = lsx_malloc(key_len), key_len, (size_t)1, c->file) == 1 &&
+    !memcmp(k, c->key, key_len) && !fstat(fileno(c->file), &st) &&
+    (uint64_t)st.st_size == c->data_start + len * sizeof(sox_sample_t);
+  free(k);
+  if (!ok) {
+    fclose(c->file);
+    c->file = NULL;
+    return sox_false;
+  }
+  c->len = len;
+  c->pos = 0;
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if ((uint64_t)st.st_size == (size_t)st.st_size) {
+    void * map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+        fileno(c->file), (off_t)0);
+    if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+      madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+      c->map = map;
+      c->map_size = (size_t)st.st_size;
+      c->data = (sox_sample_t const *)((char const *)map + c->data_start);
+      fclose(c->file);
+      c->file = NULL;
+    }
+  }
+#endif
+  if (c->file && fseeko(c->file, (off_t)c->data_start, SEEK_SET)) {
+    fclose(c->file);
+    c->file = NULL;
+    return sox_false;
+  }
+  return c->hit = sox_true;
+}
+
+/* Stops writing the cache file, and removes it */
+static void drop(decode_cache_t * c)
+{
+  fclose(c->file);
+  c->file = NULL;
+  unlink(c->tmp);
+  free(c->tmp);
+  c->tmp = NULL;
+}
+
+/* Completes the cache file written, and gives it its name */
+static int finish(decode_cache_t * c)
+{
+  int result = fseeko(c->file, (off_t)(sizeof(DECODED_MAGIC) - 1), SEEK_SET) ||
+    fwrite(&c->len, sizeof(c->len), (size_t)1, c->file) != 1;
+
+  result |= fclose(c->file);
+  c->file = NULL;
+  if (!result && rename(c->tmp, c->name)) {
+    unlink(c->name);  /* Some systems will not rename over a file */
+    result = rename(c->tmp, c->name);
+  }
+  if (result) {
+    lsx_warn("can't keep `%s': %s", c->name, strerror(errno));
+    unlink(c->tmp);
+  }
+  else lsx_debug("kept `%s'", c->name);
+  free(c->tmp);
+  c->tmp = NULL;
+  return result? SOX_EOF : SOX_SUCCESS;
+}
+
+void lsx_decode_cache_open(sox_format_t * ft)
+{
+  char const * path = ft->context->decode_cache_path;
+  decode_cache_t * c;
+  struct stat st;
+  uint32_t key_len;
+  size_t pad;
+
+  if (!path || ft->mode != 'r' || ft->probe || ft->io_type != lsx_io_file ||
+      (ft->handler.flags & SOX_FILE_DEVICE) || !ft->handler.read ||
+      !ft->signal.channels || is_cheap(ft->encoding.encoding) ||
+      stat(ft->filename, &st) || (st.st_mode & S_IFMT) != S_IFREG)
+    return;
+  c = lsx_calloc(1, sizeof(*c));
+  c->key = make_key(ft, &st);
+  c->name = make_name(path, c->key);
+
+  if (load(c)) {
+    lsx_report("reading `%s' as decoded in `%s'", ft->filename, c->name);
+    ft->signal.length = c->len;
+    ft->length_estimated = sox_false;
+    ft->seekable = sox_true;
+    ft->decode_cache = c;
+    return;
+  }
+
+  c->tmp = lsx_malloc(strlen(c->name) + 48);
+#ifdef HAVE_UNISTD_H
+  sprintf(c->tmp, "%s.%lu.%lx.tmp", c->name, (unsigned long)getpid(),
+      (unsigned long)(uintptr_t)ft);
+#else
+  sprintf(c->tmp, "%s.%lx.tmp", c->name, (unsigned long)(uintptr_t)ft);
+#endif
+  key_len = (uint32_t)strlen(c->key);
+  c->data_start = (HEADER_LEN + key_len + 7) & ~(uint64_t)7;
+  pad = (size_t)(c->data_start - HEADER_LEN - key_len);
+  if (!(c->file = fopen(c->tmp, "wb")) ||
+      fwrite(DECODED_MAGIC, sizeof(DECODED_MAGIC) - 1, (size_t)1, c->file) != 1 ||
+      fwrite(&c->len, sizeof(c->len), (size_t)1, c->file) != 1 ||
+      fwrite(&key_len, sizeof(key_len), (size_t)1, c->file) != 1 ||
+      fwrite(c->key, (size_t)key_len, (size_t)1, c->file) != 1 ||
+      (pad && fwrite("\0\0\0\0\0\0\0", pad, (size_t)1, c->file) != 1)) {
+    lsx_warn("can't write `%s': %s", c->tmp, strerror(errno));
+    if (c->file)
+      drop(c);
+    free(c->tmp);
+    free(c->name);
+    free(c->key);
+    free(c);
+  }
+  else {
+    lsx_debug("writing `%s' for `%s'", c->tmp, ft->filename);
+    ft->decode_cache = c;
+  }
+}
+
+sox_bool lsx_decode_cache_hit(sox_format_t const * ft)
+{
+  decode_cache_t const * c = (decode_cache_t const *)ft->decode_cache;
+  return c && c->hit;
+}
+
+/* As lsx_decode: from the cache, or from the handler, keeping what it gives */
+size_t lsx_decode_cache_read(sox_format_t * ft, sox_sample_t * buf, size_t len)
+{
+  decode_cache_t * c = (decode_cache_t *)ft->decode_cache;
+  size_t actual;
+
+  if (c->hit) {
+    len = (size_t)min(len, c->len - c->pos);
+    if (c->data)
+      memcpy(buf, c->data + c->pos, len * sizeof(*buf));
+    else len = fread(buf, sizeof(*buf), len, c->file);
+    c->pos += len;
+    return len;
+  }
+  actual = (*ft->handler.read)(ft, buf, len);
+  if (actual > len)
+    actual = 0;
+  if (!c->file || c->complete)
+    return actual;
+  if (actual && fwrite(buf, sizeof(*buf), actual, c->file) != actual) {
+    lsx_warn("can't write `%s': %s", c->tmp, strerror(errno));
+    drop(c);
+    return actual;
+  }
+  c->len += actual;
+  if ((!actual && len && !ft->sox_errno) || (ft->signal.length != SOX_UNSPEC &&
+        !ft->length_estimated && c->len == ft->signal.length))
+    c->complete = sox_true;
+  return actual;
+}
+
+/* Returns SOX_SUCCESS if the seek was served from the cache; else the
+ * handler is to seek, and the cache file being written is kept if it is
+ * complete (e.g. after gain -n has scanned the file), else abandoned */
+int lsx_decode_cache_seek(sox_format_t * ft, uint64_t offset)
+{
+  decode_cache_t * c = (decode_cache_t *)ft->decode_cache;
+
+  if (!c->hit && c->file) {
+    if (c->complete)
+      finish(c);
+    else {
+      lsx_debug("`%s' seeked; not kept", ft->filename);
+      drop(c);
+    }
+  }
+  if (!c->hit || offset > c->len ||
+      (!c->data && fseeko(c->file, (off_t)(c->data_start +
+          offset * sizeof(sox_sample_t)), SEEK_SET)))
+    return SOX_EOF;
+  c->pos = offset;
+  return SOX_SUCCESS;
+}
+
+void lsx_decode_cache_close(sox_format_t * ft)
+{
+  decode_cache_t * c = (decode_cache_t *)ft->decode_cache;
+
+  if (!c)
+    return;
+  if (c->file && !c->hit) {
+    if (c->complete)
+      finish(c);
+    else drop(c);
+  }
+  if (c->file)
+    fclose(c->file);
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (c->map)
+    munmap(c->map, c->map_size);
+#endif
+  free(c->name);
+  free(c->key);
+  free(c);
+  ft->decode_cache = NULL;
+}
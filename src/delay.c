@@ -15,16 +15,31 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+/* The least of the channels' delays is inserted as silence before any
+ * audio, as by pad, so needs no buffer; each channel then buffers just the
+ * difference between its delay and the least (so, if all are delayed
+ * equally, nothing at all).  A difference that is more than the channel's
+ * share of LSX_STORE_MEMORY MiB is held in a memory-mapped temporary file
+ * rather than in memory. */
+
 #include "sox_i.h"
 #include <string.h>
 
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  #include <sys/mman.h>
+#endif
+#ifdef HAVE_UNISTD_H
+  #include <unistd.h>
+#endif
+
 typedef struct {
   size_t argc;
   struct { char *str; uint64_t delay; } *args;
-  uint64_t *max_delay;
-  uint64_t delay, pre_pad, pad;
+  struct { uint64_t max, min; } *delays; /* Shared by all flows */
+  uint64_t delay, pre_pad, pad, insert;
   size_t buffer_size, buffer_index;
   sox_sample_t * buffer;
+  size_t map_len;            /* Non-0 if buffer is mapped from a file */
   sox_bool drain_started;
 } priv_t;
 
@@ -36,7 +51,7 @@ static int lsx_kill(sox_effect_t * effp)
   for (i = 0; i < p->argc; ++i)
     free(p->args[i].str);
   free(p->args);
-  free(p->max_delay);
+  free(p->delays);
   return SOX_SUCCESS;
 }
 
@@ -48,7 +63,7 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   --argc, ++argv;
   p->argc = argc;
   p->args = lsx_calloc(p->argc, sizeof(*p->args));
-  p->max_delay = lsx_malloc(sizeof(*p->max_delay));
+  p->delays = lsx_malloc(sizeof(*p->delays));
   for (i = 0; i < p->argc; ++i) {
     char const * next = lsx_parseposition(0., p->args[i].str = lsx_strdup(argv[i]), NULL, (uint64_t)0, (uint64_t)0, '=');
     if (!next || *next) {
@@ -59,9 +74,43 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   return SOX_SUCCESS;
 }
 
+static sox_sample_t * buffer_create(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t size = p->buffer_size * sizeof(*p->buffer);
+
+  p->map_len = 0;
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (size > ((size_t)LSX_STORE_MEMORY << 20) / effp->in_signal.channels) {
+    FILE * f = lsx_tmpfile();
+    void * map = MAP_FAILED;
+
+    if (f && !ftruncate(fileno(f), (off_t)size))
+      map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+          fileno(f), (off_t)0);
+    if (map != MAP_FAILED) {
+      lsx_debug("channel %" PRIuPTR ": %" PRIuPTR " samples held in a temporary file",
+          effp->flow, p->buffer_size);
+      p->map_len = size;
+    }
+    else lsx_warn("can't map temporary file: %s", strerror(errno));
+    if (f)
+      fclose(f); /* auto-deleted by lsx_tmpfile; the mapping remains */
+    if (map != MAP_FAILED)
+      return map;
+  }
+#endif
+  return lsx_malloc(size);
+}
+
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (p->map_len)
+    munmap(p->buffer, p->map_len);
+  else
+#endif
   free(p->buffer);
   return SOX_SUCCESS;
 }
@@ -69,7 +118,7 @@ static int stop(sox_effect_t * effp)
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  uint64_t max_delay = 0, last_seen = 0, delay;
+  uint64_t max_delay = 0, min_delay, last_seen = 0, delay;
   uint64_t in_length = effp->in_signal.length != SOX_UNKNOWN_LEN ?
     effp->in_signal.length / effp->in_signal.channels : SOX_UNKNOWN_LEN;
 
@@ -79,6 +128,7 @@ static int start(sox_effect_t * effp)
       lsx_fail("too few input channels");
       return SOX_EOF;
     }
+    min_delay = p->argc < effp->in_signal.channels? 0 : UINT64_MAX;
     for (i = 0; i < p->argc; ++i) {
       if (!lsx_parseposition(effp->in_signal.rate, p->args[i].str, &delay, last_seen, in_length, '=') || delay == SOX_UNKNOWN_LEN) {
         lsx_fail("Position relative to end of audio specified, but audio length is unknown");
@@ -88,22 +138,26 @@ static int start(sox_effect_t * effp)
       if (delay > max_delay) {
         max_delay = delay;
       }
+      min_delay = min(min_delay, delay);
     }
-    *p->max_delay = max_delay;
+    p->delays->max = max_delay;
+    p->delays->min = min_delay;
     if (max_delay == 0)
       return SOX_EFF_NULL;
     effp->out_signal.length = effp->in_signal.length != SOX_UNKNOWN_LEN ?
        effp->in_signal.length + max_delay * effp->in_signal.channels :
        SOX_UNKNOWN_LEN;
-    lsx_debug("extending audio by %" PRIu64 " samples", max_delay);
+    lsx_debug("extending audio by %" PRIu64 " samples, of which %" PRIu64
+        " are inserted before it", max_delay, min_delay);
   }
 
-  max_delay = *p->max_delay;
-  if (effp->flow < p->argc)
-    p->buffer_size = p->args[effp->flow].delay;
+  max_delay = p->delays->max;
+  p->insert = p->delays->min;
+  p->buffer_size = effp->flow < p->argc?
+      (size_t)(p->args[effp->flow].delay - p->insert) : 0;
   p->buffer_index = p->delay = p->pre_pad = 0;
-  p->pad = max_delay - p->buffer_size;
-  p->buffer = lsx_malloc(p->buffer_size * sizeof(*p->buffer));
+  p->pad = max_delay - p->insert - p->buffer_size;
+  p->buffer = buffer_create(effp);
   p->drain_started = sox_false;
   return SOX_SUCCESS;
 }
@@ -112,8 +166,16 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t len = *isamp = *osamp = min(*isamp, *osamp);
+  size_t len;
 
+  if (p->insert) { /* The same in every flow, so they stay in step */
+    len = *osamp = min(p->insert, *osamp);
+    memset(obuf, 0, len * sizeof(*obuf));
+    p->insert -= len;
+    *isamp = 0;
+    return SOX_SUCCESS;
+  }
+  len = *isamp = *osamp = min(*isamp, *osamp);
   if (!p->buffer_size)
     memcpy(obuf, ibuf, len * sizeof(*obuf));
   else for (; len; --len) {
@@ -140,8 +202,10 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
          flow() has not yet output enough silence to reach the
          desired delay. */
   }
-  len = *osamp = min(p->pre_pad + p->delay + p->pad, *osamp);
+  len = *osamp = min(p->insert + p->pre_pad + p->delay + p->pad, *osamp);
 
+  for (; p->insert && len; --p->insert, --len)
+    *obuf++ = 0;
   for (; p->pre_pad && len; --p->pre_pad, --len)
     *obuf++ = 0;
   for (; p->delay && len; --p->delay, --len) {
@@ -156,8 +220,9 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 sox_effect_handler_t const * lsx_delay_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "delay", "{position}", SOX_EFF_LENGTH | SOX_EFF_MODIFY,
-    create, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+    "delay", "{position}", SOX_EFF_LENGTH | SOX_EFF_MODIFY | SOX_EFF_RTSAFE,
+    create, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
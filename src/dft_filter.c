@@ -23,115 +23,383 @@
 typedef dft_filter_t filter_t;
 typedef dft_filter_priv_t priv_t;
 
-void lsx_set_dft_filter(dft_filter_t *f, double *h, int n, int post_peak)
+/* With --dft-block, a filter whose DFT would be longer than two blocks is
+ * split into partitions of block_len taps, each convolved (by overlap-save
+ * with DFTs of 2 * block_len) with a correspondingly delayed input block. */
+static void set_partitions(dft_filter_t * f, double const * h, int block_len)
+{
+  int i, j;
+
+  f->block_len = block_len;
+  f->num_parts = (f->num_taps + block_len - 1) / block_len;
+  f->dft_length = 2 * block_len;
+  f->coefs = lsx_calloc((size_t)f->num_parts * f->dft_length, sizeof(*f->coefs));
+  for (j = 0; j < f->num_parts; ++j) {
+    double * coefs = f->coefs + j * f->dft_length;
+    for (i = 0; i < block_len && j * block_len + i < f->num_taps; ++i)
+      coefs[i] = h[j * block_len + i] / f->dft_length * 2;
+    lsx_safe_rdft(f->dft_length, 1, coefs);
+  }
+  lsx_debug_more("%i taps in %i partitions", f->num_taps, f->num_parts);
+}
+
+/* For effects with their own partitioned convolution (e.g. convolve): sets
+ * up f with h split into partitions of block_len taps, as above */
+void lsx_set_dft_partitions(dft_filter_t * f, double const * h, int n, int block_len)
+{
+  f->num_taps = n;
+  f->post_peak = 0;
+  set_partitions(f, h, block_len);
+}
+
+/* Adds the product of the DFTs (from lsx_safe_rdft) x and coefs to output,
+ * over the elements [begin, end), begin and end being even */
+void lsx_dft_mac(double * output, double const * coefs, double const * x,
+    int begin, int end)
 {
   int i;
+
+  if (!begin) {
+    output[0] += coefs[0] * x[0];
+    output[1] += coefs[1] * x[1];
+    begin = 2;
+  }
+  for (i = begin; i < end; i += 2) {
+    output[i  ] += coefs[i  ] * x[i] - coefs[i+1] * x[i+1];
+    output[i+1] += coefs[i+1] * x[i] + coefs[i  ] * x[i+1];
+  }
+}
+
+/* Shorter filters are convolved directly (with dft_length 0), rather than
+ * by DFT, which (as measured with SSE2) would cost more than it saves. */
+#define DIRECT_MAX_TAPS 48
+
+static void set_dft_filter(dft_filter_t *f, double const *h, int n, int post_peak)
+{
+  int i, block_len = 1 << sox_globals.log2_dft_block_size;
   f->num_taps = n;
   f->post_peak = post_peak;
+  if (n < DIRECT_MAX_TAPS) {
+    f->dft_length = 0;
+    f->coefs = lsx_memdup(h, n * sizeof(*h));
+    lsx_debug_more("%i taps, convolved directly", n);
+    return;
+  }
   f->dft_length = lsx_set_dft_length(f->num_taps);
+  if (sox_globals.log2_dft_block_size && f->dft_length > 2 * block_len) {
+    set_partitions(f, h, block_len);
+    return;
+  }
   f->coefs = lsx_calloc(f->dft_length, sizeof(*f->coefs));
   for (i = 0; i < f->num_taps; ++i)
     f->coefs[(i + f->dft_length - f->num_taps + 1) & (f->dft_length - 1)] = h[i] / f->dft_length * 2;
   lsx_safe_rdft(f->dft_length, 1, f->coefs);
+}
+
+void lsx_set_dft_filter(dft_filter_t *f, double *h, int n, int post_peak)
+{
+  set_dft_filter(f, h, n, post_peak);
   free(h);
 }
 
-static int start(sox_effect_t * effp)
+/* As lsx_set_dft_filter, but h is from lsx_design_get/put (and is released) */
+void lsx_set_dft_filter_design(dft_filter_t *f, double const *h, int n, int post_peak)
+{
+  set_dft_filter(f, h, n, post_peak);
+  lsx_design_release(h);
+}
+
+static void reset_state(priv_t * p)
+{
+  filter_t const * f = p->filter_ptr;
+  int zeros = f->post_peak + f->block_len; /* Partitions need a block more */
+
+  fifo_clear(&p->input_fifo);
+  memset(fifo_reserve(&p->input_fifo, zeros), 0, sizeof(double) * zeros);
+  fifo_clear(&p->output_fifo);
+  if (f->num_parts) {
+    memset(p->fdl, 0, (size_t)f->num_parts * f->dft_length * sizeof(*p->fdl));
+    p->fdl_pos = 0;
+    p->skip = f->num_taps - 1; /* To align output as filter() does */
+  }
+  p->samples_in = p->samples_out = 0;
+}
+
+static int reset(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *) effp->priv;
 
+  p->switching = sox_false;
+  reset_state(p->cheaper? p->cheap : p);
+  return SOX_SUCCESS;
+}
+
+static void start_state(sox_effect_t * effp, priv_t * p)
+{
+  filter_t const * f = p->filter_ptr;
+
   fifo_create(&p->input_fifo, (int)sizeof(double));
-  memset(fifo_reserve(&p->input_fifo,
-        p->filter_ptr->post_peak), 0, sizeof(double) * p->filter_ptr->post_peak);
   fifo_create(&p->output_fifo, (int)sizeof(double));
+  fifo_limit(&p->input_fifo, effp->global_info->global_info->fifo_max,
+      2 * (size_t)f->dft_length);
+  fifo_limit(&p->output_fifo, effp->global_info->global_info->fifo_max,
+      2 * (size_t)f->dft_length);
+  if (f->num_parts)
+    p->fdl = lsx_calloc((size_t)f->num_parts * f->dft_length, sizeof(*p->fdl));
+  reset_state(p);
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *) effp->priv;
+
+  filter_t const * f = p->filter_ptr;
+
+  start_state(effp, p);
+  /* The filter's look-ahead, plus the input a block needs beyond it */
+  effp->latency = (f->num_taps - 1 - f->post_peak + (f->num_parts?
+      f->block_len : f->dft_length? f->dft_length - f->num_taps : 0)) /
+      effp->in_signal.rate;
+  effp->history = f->num_taps / effp->in_signal.rate;
+  /* Offline, blocks may be transformed in parallel; see filter() */
+  p->threads = effp->global_info->global_info->use_threads &&
+      effp->global_info->global_info->chain_mode != SOX_CHAIN_REALTIME?
+      effp->global_info->global_info : NULL;
+  /* The input consumed, and output given, by each transform: */
+  if (f->dft_length)
+    lsx_effect_set_block(effp, (size_t)(f->num_parts?
+          f->block_len : f->dft_length - f->num_taps + 1));
+  p->cheaper = p->switching = sox_false;
+  if (p->cheap_ptr && p->cheap_ptr->num_taps) {
+    p->cheap = lsx_calloc(1, sizeof(*p->cheap));
+    p->cheap->filter_ptr = p->cheap_ptr;
+    start_state(effp, p->cheap);
+    effp->degrade_steps = 1;
+  }
   return SOX_SUCCESS;
 }
 
-static void filter(priv_t * p)
+static void filter_partitioned(priv_t * p)
 {
-  int i, num_in = max(0, fifo_occupancy(&p->input_fifo));
+  int j, num_in = max(0, fifo_occupancy(&p->input_fifo));
   filter_t const * f = p->filter_ptr;
-  int const overlap = f->num_taps - 1;
+  int const block_len = f->block_len;
+  int skip = min(p->skip, block_len);
   double * output;
 
   while (num_in >= f->dft_length) {
-    double const * input = fifo_read_ptr(&p->input_fifo);
-    fifo_read(&p->input_fifo, f->dft_length - overlap, NULL);
-    num_in -= f->dft_length - overlap;
+    double * x = p->fdl + p->fdl_pos * f->dft_length;
+    memcpy(x, fifo_read_ptr(&p->input_fifo), f->dft_length * sizeof(*x));
+    fifo_read(&p->input_fifo, block_len, NULL);
+    num_in -= block_len;
+    lsx_safe_rdft(f->dft_length, 1, x);
 
     output = fifo_reserve(&p->output_fifo, f->dft_length);
-    fifo_trim_by(&p->output_fifo, overlap);
-    memcpy(output, input, f->dft_length * sizeof(*output));
-
-    lsx_safe_rdft(f->dft_length, 1, output);
-    output[0] *= f->coefs[0];
-    output[1] *= f->coefs[1];
-    for (i = 2; i < f->dft_length; i += 2) {
-      double tmp = output[i];
-      output[i  ] = f->coefs[i  ] * tmp - f->coefs[i+1] * output[i+1];
-      output[i+1] = f->coefs[i+1] * tmp + f->coefs[i  ] * output[i+1];
+    memset(output, 0, f->dft_length * sizeof(*output));
+    for (j = 0; j < f->num_parts; ++j) {
+      double const * coefs = f->coefs + j * f->dft_length;
+      x = p->fdl + (p->fdl_pos - j + f->num_parts) % f->num_parts * f->dft_length;
+      lsx_dft_mac(output, coefs, x, 0, f->dft_length);
     }
+    p->fdl_pos = (p->fdl_pos + 1) % f->num_parts;
     lsx_safe_rdft(f->dft_length, -1, output);
+    memmove(output, output + block_len + skip,
+        (block_len - skip) * sizeof(*output));
+    fifo_trim_by(&p->output_fifo, block_len + skip);
+    p->skip -= skip;
+    skip = min(p->skip, block_len);
+  }
+}
+
+/* Overlap-save: multiplies the DFT at output by the filter's */
+static void convolve(filter_t const * f, double * output)
+{
+  int i;
+
+  output[0] *= f->coefs[0];
+  output[1] *= f->coefs[1];
+  for (i = 2; i < f->dft_length; i += 2) {
+    double tmp = output[i];
+    output[i  ] = f->coefs[i  ] * tmp - f->coefs[i+1] * output[i+1];
+    output[i+1] = f->coefs[i+1] * tmp + f->coefs[i  ] * output[i+1];
   }
 }
 
+static void filter(priv_t * p)
+{
+  int num_in = max(0, fifo_occupancy(&p->input_fifo));
+  filter_t const * f = p->filter_ptr;
+  int const overlap = f->num_taps - 1, step = f->dft_length - overlap;
+  double const * input;
+  double * output;
+  long i, n;
+
+  if (f->num_parts) {
+    filter_partitioned(p);
+    return;
+  }
+  if (!f->dft_length) {
+    if (num_in > overlap) {
+      input = fifo_read_ptr(&p->input_fifo);
+      output = fifo_reserve(&p->output_fifo, num_in - overlap);
+      lsx_fir_convolve(f->coefs, f->num_taps, input + overlap, output,
+          (size_t)(num_in - overlap));
+      fifo_read(&p->input_fifo, num_in - overlap, NULL);
+    }
+    return;
+  }
+  if (num_in < f->dft_length)
+    return;
+
+  /* The blocks are independent, so are transformed as a batch (on
+   * threads, if allowed, or by the FFT back-end), each in its own
+   * dft_length of output, then closed up. */
+  n = (num_in - f->dft_length) / step + 1;
+  input = fifo_read_ptr(&p->input_fifo);
+  output = fifo_reserve(&p->output_fifo, (int)n * f->dft_length);
+  for (i = 0; i < n; ++i)
+    memcpy(output + i * f->dft_length, input + i * step,
+        f->dft_length * sizeof(*output));
+  lsx_safe_rdft_batch(f->dft_length, 1, (size_t)n, output, p->threads);
+  for (i = 0; i < n; ++i)
+    convolve(f, output + i * f->dft_length);
+  lsx_safe_rdft_batch(f->dft_length, -1, (size_t)n, output, p->threads);
+  for (i = 1; i < n; ++i)
+    memmove(output + i * step, output + i * f->dft_length, step * sizeof(*output));
+  fifo_trim_by(&p->output_fifo, (int)n * overlap);
+  fifo_read(&p->input_fifo, (int)n * step, NULL);
+}
+
+/* The filters being aligned, the output that the filter being switched to
+ * gives for the input from the switch on is cross-faded in, once that is
+ * past its history */
+static void switch_filter(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  priv_t * a = p->cheaper? p->cheap : p, * b = p->cheaper? p : p->cheap;
+
+  reset_state(b);
+  p->cheap_skip = (uint64_t)b->filter_ptr->num_taps;
+  p->lead = a->samples_in + p->cheap_skip - a->samples_out;
+  p->fade = p->fade_len = lsx_update_ramp(effp);
+  p->switching = sox_true;
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
                 sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
-  priv_t * p = (priv_t *)effp->priv;
-  size_t odone = min(*osamp, (size_t)fifo_occupancy(&p->output_fifo));
+  priv_t * p = (priv_t *)effp->priv, * a, * b = NULL;
+  size_t odone, i;
+  double const * s;
 
-  double const * s = fifo_read(&p->output_fifo, (int)odone, NULL);
+  if (p->cheap && ibuf && !p->switching && (effp->degrade != 0) != p->cheaper)
+    switch_filter(effp);
+  a = p->cheaper? p->cheap : p;
+  odone = min(*osamp, (size_t)fifo_occupancy(&a->output_fifo));
+  if (p->switching) {   /* Output comes from a, then both, then b */
+    b = p->cheaper? p : p->cheap;
+    i = (size_t)min(p->cheap_skip, (uint64_t)fifo_occupancy(&b->output_fifo));
+    fifo_read(&b->output_fifo, (int)i, NULL);
+    b->samples_out += i;
+    p->cheap_skip -= i;
+    odone = p->lead? (size_t)min(odone, p->lead) : p->cheap_skip? 0 :
+      min(min(odone, p->fade), (size_t)fifo_occupancy(&b->output_fifo));
+  }
+
+  s = fifo_read(&a->output_fifo, (int)odone, NULL);
+  a->samples_out += odone;
+  if (b && !p->lead) {
+    double const * s1 = fifo_read(&b->output_fifo, (int)odone, NULL);
+    b->samples_out += odone;
+    if (p->mix_len < odone)
+      p->mix = lsx_realloc(p->mix, (p->mix_len = odone) * sizeof(*p->mix));
+    for (i = 0; i < odone; ++i)
+      p->mix[i] = s1[i] + (s[i] - s1[i]) * (p->fade - i) / p->fade_len;
+    s = p->mix;
+  }
   lsx_save_samples(obuf, s, odone, &effp->clips);
-  p->samples_out += odone;
 
   if (*isamp && odone < *osamp) {
-    double * t = fifo_write(&p->input_fifo, (int)*isamp, NULL);
-    p->samples_in += *isamp;
+    double * t;
+    /* Take no more than the FIFOs have room for (see fifo_limit) */
+    *isamp = min(*isamp, min(fifo_room(&a->input_fifo), fifo_room(&a->output_fifo)));
+    if (b)
+      *isamp = min(*isamp, min(fifo_room(&b->input_fifo), fifo_room(&b->output_fifo)));
+    *isamp = max(1, *isamp);
+    t = fifo_write(&a->input_fifo, (int)*isamp, NULL);
+    a->samples_in += *isamp;
     lsx_load_samples(t, ibuf, *isamp);
-    filter(p);
+    if (b) {
+      fifo_write(&b->input_fifo, (int)*isamp, t);
+      b->samples_in += *isamp;
+      filter(b);
+    }
+    filter(a);
   }
   else *isamp = 0;
   *osamp = odone;
+
+  if (b && p->lead)
+    p->lead -= odone;
+  else if (b && (p->fade -= odone) == 0)
+    p->cheaper = !p->cheaper, p->switching = sox_false;
   return SOX_SUCCESS;
 }
 
 static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 {
-  priv_t * p = (priv_t *)effp->priv;
+  priv_t * p = (priv_t *)effp->priv, * a = p->cheaper? p->cheap : p;
   static size_t isamp = 0;
-  size_t remaining = p->samples_in > p->samples_out ?
-      (size_t)(p->samples_in - p->samples_out) : 0;
+  size_t remaining = a->samples_in > a->samples_out ?
+      (size_t)(a->samples_in - a->samples_out) : 0;
   double * buff = lsx_calloc(1024, sizeof(*buff));
 
+  p->switching = sox_false;  /* The switch, if any, is abandoned */
   if (remaining > 0) {
-    while ((size_t)fifo_occupancy(&p->output_fifo) < remaining) {
-      fifo_write(&p->input_fifo, 1024, buff);
-      p->samples_in += 1024;
-      filter(p);
+    while ((size_t)fifo_occupancy(&a->output_fifo) < remaining) {
+      fifo_write(&a->input_fifo, 1024, buff);
+      a->samples_in += 1024;
+      filter(a);
     }
-    fifo_trim_to(&p->output_fifo, (int)remaining);
-    p->samples_in = 0;
+    fifo_trim_to(&a->output_fifo, (int)remaining);
+    a->samples_in = 0;
   }
   free(buff);
   return flow(effp, 0, obuf, &isamp, osamp);
 }
 
-static int stop(sox_effect_t * effp)
+static void stop_state(priv_t * p)
 {
-  priv_t * p = (priv_t *) effp->priv;
-
+  lsx_debug("FIFOs' high-water marks: input %lu, output %lu bytes",
+      (unsigned long)p->input_fifo.high_water,
+      (unsigned long)p->output_fifo.high_water);
   fifo_delete(&p->input_fifo);
   fifo_delete(&p->output_fifo);
+  free(p->fdl);
   free(p->filter_ptr->coefs);
   memset(p->filter_ptr, 0, sizeof(*p->filter_ptr));
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *) effp->priv;
+
+  stop_state(p);
+  if (p->cheap) {
+    stop_state(p->cheap);
+    free(p->cheap);
+    p->cheap = NULL;
+  }
+  free(p->mix);
+  p->mix = NULL, p->mix_len = 0;
   return SOX_SUCCESS;
 }
 
 sox_effect_handler_t const * lsx_dft_filter_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    NULL, NULL, SOX_EFF_GAIN, NULL, start, flow, drain, stop, NULL, 0
+    NULL, NULL, SOX_EFF_GAIN | SOX_EFF_LINEAR, NULL, start, flow, drain, stop, NULL, 0, reset,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -4,13 +4,32 @@
 
 typedef struct {
   int        dft_length, num_taps, post_peak;
-  double     * coefs;
+  int        block_len, num_parts; /* If partitioned; then dft_length is */
+  double     * coefs;              /* 2 * block_len, with num_parts DFTs */
 } dft_filter_t;
 
-typedef struct {
+typedef struct dft_filter_priv_t {
   uint64_t   samples_in, samples_out;
   fifo_t     input_fifo, output_fifo;
   dft_filter_t   filter, * filter_ptr;
+  double     * fdl;      /* If partitioned: DFTs of the last num_parts blocks */
+  int        fdl_pos, skip;
+  sox_context_t const * threads; /* If whole blocks may be transformed in
+                                   * parallel, the context to take them from */
+  /* For the governor (see sox_effect_t.degrade): a cheaper filter, with
+   * the same alignment, that the effect's start may design, as filter_ptr's;
+   * the state of running it; and the cross-fade of a switch to it or back */
+  dft_filter_t   cheap_filter, * cheap_ptr;
+  struct dft_filter_priv_t * cheap;
+  sox_bool   cheaper, switching;
+  uint64_t   lead, cheap_skip; /* Output due before the cross-fade; to discard */
+  size_t     fade, fade_len;   /* Frames left of, and in, the cross-fade */
+  double     * mix;
+  size_t     mix_len;
 } dft_filter_priv_t;
 
 void lsx_set_dft_filter(dft_filter_t * f, double * h, int n, int post_peak);
+void lsx_set_dft_filter_design(dft_filter_t * f, double const * h, int n, int post_peak);
+void lsx_set_dft_partitions(dft_filter_t * f, double const * h, int n, int block_len);
+void lsx_dft_mac(double * output, double const * coefs, double const * x,
+    int begin, int end);
@@ -21,9 +21,7 @@
 
 #include "sox_i.h"
 #include <assert.h>
-
-#undef RANQD1
-#define RANQD1 ranqd1(p->ranqd1)
+#include <string.h>
 
 typedef enum { /* Collection of various filters from the net */
   Shape_none, Shape_lipshitz, Shape_f_weighted, Shape_modified_e_weighted,
@@ -249,6 +247,8 @@ static const filter_t filters[] = {
 };
 
 #define MAX_N 20
+#define BLOCK_LEN 1024 /* Samples processed per block */
+#define LANES 8        /* Random numbers made per step */
 
 typedef struct {
   filter_name_t filter_name;
@@ -263,8 +263,34 @@ typedef struct {
   double const  * coefs;
   sox_bool      dither_off;
   sox_effect_handler_flow flow;
+
+  uint32_t      lanes[LANES], leap_mult, leap_add;
+  int32_t       draws[2 * BLOCK_LEN + LANES];
+  size_t        draws_pos, draws_len;
 } priv_t;
 
+/* Returns at least n (<= 2 * BLOCK_LEN) random numbers, to be consumed in
+ * order; the caller then advances draws_pos by the number used.  These are
+ * the same sequence that ranqd1(p->ranqd1) would give, but are made LANES at
+ * a time: each lane steps the generator LANES places on at once. */
+static int32_t const * draws(priv_t * p, size_t n)
+{
+  size_t i, j, have = p->draws_len - p->draws_pos;
+
+  if (have < n) {
+    uint32_t lanes[LANES];
+    memcpy(lanes, p->lanes, sizeof(lanes));
+    memmove(p->draws, p->draws + p->draws_pos, have * sizeof(*p->draws));
+    for (i = have; i < n; i += LANES) for (j = 0; j < LANES; ++j) {
+      p->draws[i + j] = (int32_t)lanes[j];
+      lanes[j] = lanes[j] * p->leap_mult + p->leap_add;
+    }
+    memcpy(p->lanes, lanes, sizeof(lanes));
+    p->draws_len = i, p->draws_pos = 0;
+  }
+  return p->draws + p->draws_pos;
+}
+
 #define CONVOLVE _ _ _ _
 #define NAME flow_iir_4
 #define IIR
@@ -297,9 +323,36 @@ static int flow_no_shape(sox_effect_t * effp, const sox_sample_t * ibuf,
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t len = *isamp = *osamp = min(*isamp, *osamp);
+  double const scale = 1. / (1 << (32 - p->prec));
+  int const lo = -(1 << (p->prec-1)), hi = SOX_INT_MAX(p->prec);
+  int const shift = 32 - p->prec;
 
-  while (len--) {
-    if (p->auto_detect) {
+  while (len) {
+    size_t n = min(len, BLOCK_LEN), i;
+    int32_t const * r = draws(p, 2 * n);
+    len -= n;
+
+    if (!p->auto_detect) { /* Straight through, without branches on the data */
+      size_t clips = 0;
+      for (i = 0; i < n; ++i) {
+        int32_t r1, r2;
+        double d;
+        int k;
+        if (p->alt_tpdf)
+          r1 = r[i] >> p->prec, r2 = -(i? r[i - 1] >> p->prec : p->r);
+        else r1 = r[2 * i] >> p->prec, r2 = r[2 * i + 1] >> p->prec;
+        d = ((double)ibuf[i] + r1 + r2) * scale;
+        k = d < 0? d - .5 : d + .5;
+        clips += k <= lo || k > hi;
+        obuf[i] = k <= lo? SOX_SAMPLE_MIN : k > hi? hi << shift : k << shift;
+      }
+      if (p->alt_tpdf)
+        p->r = r[n - 1] >> p->prec, r += n;
+      else r += 2 * n;
+      effp->clips += clips;
+      ibuf += n, obuf += n, p->num_output += n;
+    }
+    else for (; n; --n) {
       p->history = (p->history << 1) +
           !!(*ibuf & (((unsigned)-1) >> p->prec));
       if (p->history && p->dither_off) {
@@ -309,23 +362,95 @@ static int flow_no_shape(sox_effect_t * effp, const sox_sample_t * ibuf,
         p->dither_off = sox_true;
         lsx_debug("flow %" PRIuPTR ": off @ %" PRIu64, effp->flow, p->num_output);
       }
+
+      if (!p->dither_off) {
+        int32_t r1 = *r++ >> p->prec;
+        double d = ((double)*ibuf++ + r1 + (p->alt_tpdf? -p->r : (*r++ >> p->prec))) * scale;
+        int i = d < 0? d - .5 : d + .5;
+        p->r = r1;
+        if (i <= lo)
+          ++effp->clips, *obuf = SOX_SAMPLE_MIN;
+        else if (i > hi)
+          ++effp->clips, *obuf = hi << shift;
+        else *obuf = i << shift;
+        ++obuf;
+      }
+      else
+        *obuf++ = *ibuf++;
+      ++p->num_output;
+    }
+    p->draws_pos = r - p->draws;
+  }
+  return SOX_SUCCESS;
+}
+
+/* The fused output stage (see sox_fuse_output): as flow_no_shape without
+ * auto-detect, but to packed 16-bit values in one pass.  The values are
+ * those that lsx_rawwrite would make from flow_no_shape's output. */
+static void pack_no_shape(sox_effect_t * effp, const sox_sample_t * ibuf,
+    uint8_t * obuf, size_t len, size_t stride, sox_bool swap)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double const scale = 1. / (1 << (32 - p->prec));
+  int const lo = -(1 << (p->prec-1)), hi = SOX_INT_MAX(p->prec);
+  int const shift = 16 - p->prec;
+
+  while (len) {
+    size_t n = min(len, BLOCK_LEN), i, clips = 0;
+    int32_t const * r = draws(p, 2 * n);
+    len -= n;
+
+    for (i = 0; i < n; ++i) {
+      int32_t r1, r2;
+      double d;
+      int k;
+      uint16_t x;
+      if (p->alt_tpdf)
+        r1 = r[i] >> p->prec, r2 = -(i? r[i - 1] >> p->prec : p->r);
+      else r1 = r[2 * i] >> p->prec, r2 = r[2 * i + 1] >> p->prec;
+      d = ((double)ibuf[i * stride] + r1 + r2) * scale;
+      k = d < 0? d - .5 : d + .5;
+      clips += k <= lo || k > hi;
+      k = k <= lo? lo : k > hi? hi : k;
+      x = (uint16_t)((unsigned)k << shift);
+      if (swap)
+        x = (uint16_t)(x << 8 | x >> 8);
+      memcpy(obuf + 2 * i * stride, &x, sizeof(x));
     }
+    if (p->alt_tpdf)
+      p->r = r[n - 1] >> p->prec, r += n;
+    else r += 2 * n;
+    effp->clips += clips;
+    ibuf += n * stride, obuf += 2 * n * stride, p->num_output += n;
+    p->draws_pos = r - p->draws;
+  }
+}
+
+static int pack(sox_effect_t * effp, const sox_sample_t * ibuf,
+    void * obuf, size_t len, size_t stride, sox_bool swap)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  sox_sample_t in[BLOCK_LEN], out[BLOCK_LEN];
+  uint8_t * o = obuf;
 
-    if (!p->dither_off) {
-      int32_t r = RANQD1 >> p->prec;
-      double d = ((double)*ibuf++ + r + (p->alt_tpdf? -p->r : (RANQD1 >> p->prec))) / (1 << (32 - p->prec));
-      int i = d < 0? d - .5 : d + .5;
-      p->r = r;
-      if (i <= (-1 << (p->prec-1)))
-        ++effp->clips, *obuf = SOX_SAMPLE_MIN;
-      else if (i > (int)SOX_INT_MAX(p->prec))
-        ++effp->clips, *obuf = SOX_INT_MAX(p->prec) << (32 - p->prec);
-      else *obuf = i << (32 - p->prec);
-      ++obuf;
+  if (p->flow == flow_no_shape) {
+    pack_no_shape(effp, ibuf, o, len, stride, swap);
+    return SOX_SUCCESS;
+  }
+  /* Noise-shaped: each output is quantised (there being no auto-detect),
+   * so is narrowed by just a shift. */
+  while (len) {
+    size_t n = min(len, BLOCK_LEN), i;
+    for (i = 0; i < n; ++i)
+      in[i] = ibuf[i * stride];
+    p->flow(effp, in, out, &n, &n);
+    for (i = 0; i < n; ++i) {
+      uint16_t x = (uint16_t)(out[i] >> 16);
+      if (swap)
+        x = (uint16_t)(x << 8 | x >> 8);
+      memcpy(o + 2 * i * stride, &x, sizeof(x));
     }
-    else
-      *obuf++ = *ibuf++;
-    ++p->num_output;
+    len -= n, ibuf += n * stride, o += 2 * n * stride;
   }
   return SOX_SUCCESS;
 }
@@ -353,6 +478,24 @@ static int getopts(sox_effect_t * effp, int argc, char * * argv)
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static void seed(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  uint32_t x;
+  int i;
+
+  p->ranqd1 = ranqd1(effp->global_info->global_info->ranqd1) + effp->flow;
+  /* Set up draws() to continue the sequence from p->ranqd1: */
+  x = p->ranqd1;
+  p->leap_mult = 1, p->leap_add = 0;
+  for (i = 0; i < LANES; ++i) {
+    p->lanes[i] = x = x * 1664525u + 1013904223u;
+    p->leap_mult *= 1664525u;
+    p->leap_add = p->leap_add * 1664525u + 1013904223u;
+  }
+  p->draws_pos = p->draws_len = 0;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -404,7 +547,12 @@ static int start(sox_effect_t * effp)
       mult = dB_to_linear(f->gain_cB * 0.1);
     }
   }
-  p->ranqd1 = ranqd1(sox_globals.ranqd1) + effp->flow;
+  if (!p->auto_detect && p->prec <= 16)
+    effp->pack = pack;
+  seed(effp);
+  /* The auto-detect register holds 32 samples, and the noise-shaping filter's
+   * state soon decays; beyond these, the output is just different noise: */
+  effp->history = (32 + 4 * MAX_N) / effp->in_signal.rate;
   if (effp->in_signal.mult) /* (Takes account of ostart mult (sox.c). */
     *effp->in_signal.mult *= (SOX_SAMPLE_MAX - (1 << (31 - p->prec)) *
         (2 * mult + 1)) / (SOX_SAMPLE_MAX - (1 << (31 - p->prec)));
@@ -418,6 +566,20 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
   return p->flow(effp, ibuf, obuf, isamp, osamp);
 }
 
+static int reset(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  memset(p->previous_errors, 0, sizeof(p->previous_errors));
+  memset(p->previous_outputs, 0, sizeof(p->previous_outputs));
+  p->pos = 0;
+  p->num_output = 0;
+  p->history = p->r = 0;
+  p->dither_off = sox_false;
+  seed(effp);
+  return SOX_SUCCESS;
+}
+
 sox_effect_handler_t const * lsx_dither_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
@@ -430,7 +592,8 @@ sox_effect_handler_t const * lsx_dither_effect_fn(void)
     "\n           shibata, low-shibata, high-shibata."
     "\n  -a       Automatically turn on & off dithering as needed (use with caution!)"
     "\n  -p bits  Override the target sample precision",
-    SOX_EFF_PREC, getopts, start, flow, 0, 0, 0, sizeof(priv_t)
+    SOX_EFF_PREC | SOX_EFF_RTSAFE, getopts, start, flow, 0, 0, 0, sizeof(priv_t), reset,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -67,7 +67,7 @@ sox_effect_handler_t const * lsx_divide_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "divide", NULL, SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_ALPHA,
-    NULL, start, flow, NULL, stop, NULL, sizeof(priv_t)
+    NULL, start, flow, NULL, stop, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -79,7 +79,8 @@ static int flow(sox_effect_t *effp, const sox_sample_t *ibuf,
 sox_effect_handler_t const *lsx_downsample_effect_fn(void)
 {
   static sox_effect_handler_t handler = {"downsample", "[factor (2)]",
-    SOX_EFF_RATE | SOX_EFF_MODIFY,
-    create, start, flow, NULL, NULL, NULL, sizeof(priv_t)};
+    SOX_EFF_RATE | SOX_EFF_MODIFY | SOX_EFF_RTSAFE,
+    create, start, flow, NULL, NULL, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
   return &handler;
 }
@@ -26,7 +26,7 @@ LSX_FORMAT_HANDLER(dvms)
     names, SOX_FILE_MONO,
     lsx_dvmsstartread, lsx_cvsdread, lsx_cvsdstopread,
     lsx_dvmsstartwrite, lsx_cvsdwrite, lsx_dvmsstopwrite,
-    NULL, write_encodings, NULL, sizeof(cvsd_priv_t)
+    NULL, write_encodings, NULL, sizeof(cvsd_priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -52,16 +52,29 @@ static const sox_sample_t filt[32 * 2] = {
     4,    0};
 
 #define NUMTAPS array_length(filt)
-typedef struct {sox_sample_t tap[NUMTAPS];} priv_t; /* FIR filter z^-1 delays */
+#define BLOCK_LEN 1024
+
+/* The filter runs over the interleaved samples (so each output is of both
+ * channels), each scaled down as an integer first; the sums are then exact
+ * whatever their order, so are done by lsx_fir_convolve. */
+typedef struct {
+  double h[NUMTAPS];
+  double x[NUMTAPS - 1 + BLOCK_LEN]; /* FIR filter z^-1 delays, then input */
+  double y[BLOCK_LEN];
+} priv_t;
 
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
+  size_t i;
+
   if (effp->in_signal.rate != 44100 || effp->in_signal.channels != 2) {
     lsx_fail("works only with stereo audio sampled at 44100Hz (i.e. CDDA)");
     return SOX_EOF;
   }
-  memset(p->tap, 0, NUMTAPS * sizeof(*p->tap)); /* zero tap memory */
+  for (i = 0; i < NUMTAPS; ++i)
+    p->h[i] = filt[i];
+  memset(p->x, 0, (NUMTAPS - 1) * sizeof(*p->x)); /* zero tap memory */
   if (effp->in_signal.mult)
     *effp->in_signal.mult *= dB_to_linear(-4.4);
   return SOX_SUCCESS;
@@ -71,18 +84,17 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
                 sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t i, len = *isamp = *osamp = min(*isamp, *osamp);
-
-  while (len--) {       /* update taps and calculate output */
-    double output = 0;
+  double * x = p->x + NUMTAPS - 1;
+  size_t i, n, len = *isamp = *osamp = min(*isamp, *osamp);
 
-    for (i = NUMTAPS - 1; i; --i) {
-      p->tap[i] = p->tap[i - 1];
-      output += p->tap[i] * filt[i];
-    }
-    p->tap[0] = *ibuf++ / 64; /* scale output */
-    output += p->tap[0] * filt[0];
-    *obuf++ = SOX_ROUND_CLIP_COUNT(output, effp->clips);
+  for (; len; len -= n) {
+    n = min(len, BLOCK_LEN);
+    for (i = 0; i < n; ++i)
+      x[i] = *ibuf++ / 64; /* scale output */
+    lsx_fir_convolve(p->h, (int)NUMTAPS, x, p->y, n);
+    for (i = 0; i < n; ++i)
+      *obuf++ = SOX_ROUND_CLIP_COUNT(p->y[i], effp->clips);
+    memmove(p->x, p->x + n, (NUMTAPS - 1) * sizeof(*p->x));
   }
   return SOX_SUCCESS;
 }
@@ -91,7 +103,7 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
 
 sox_effect_handler_t const *lsx_earwax_effect_fn(void)
 {
-  static sox_effect_handler_t handler = {"earwax", NULL, SOX_EFF_MCHAN,
-    NULL, start, flow, NULL, NULL, NULL, sizeof(priv_t)};
+  static sox_effect_handler_t handler = {"earwax", NULL, SOX_EFF_MCHAN | SOX_EFF_RTSAFE,
+    NULL, start, flow, NULL, NULL, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL};
   return &handler;
 }
@@ -0,0 +1,511 @@
+/* libSoX effect: EBU R128 / ITU-R BS.1770 loudness meter
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio is passed unmodified.  Each channel is K-weighted (BS.1770's
+ * shelving & high-pass biquads) and its mean square gathered in 100ms
+ * sub-blocks; momentary (400ms) and short-term (3s) loudness are formed
+ * from these at 10Hz, and gated at the end to give integrated loudness and
+ * loudness range (EBU Tech 3342).  True peak is measured with 4x
+ * up-sampling by two stages of rate's half-band FIR. */
+
+#include "sox_i.h"
+#include <string.h>
+
+#define SUB_BLOCKS     30                   /* 3s of 100ms sub-blocks */
+#define LUFS(e)        (-.691 + 10 * log10(e))
+#define ENERGY(lufs)   pow(10., ((lufs) + .691) / 10)
+
+typedef struct {
+  double     z[2][2];          /* K-weighting biquads' state */
+  double     * up[2];          /* Up-samplers' history & input */
+} chan_t;
+
+typedef struct {
+  double     b[2][3], a[2][3]; /* K-weighting biquads */
+  double     * coefs;          /* Half-band FIR (2x odd taps) */
+  int        num_coefs;
+  double     * work;
+  chan_t     * chans;
+  double     * weights;
+
+  size_t     max_len;          /* Of a sub-block */
+  uint64_t   samples, begin, next, count;  /* Sub-blocks */
+  double     sum, sums[SUB_BLOCKS];
+  uint64_t   lens[SUB_BLOCKS];
+
+  double     * blocks, * short_terms, max_momentary, max_short_term, peak;
+  size_t     num_blocks, num_short_terms, max_blocks, max_short_terms;
+
+  /* Sub-blocks are of the whole of the audio (see sox_effect_t.span); those
+   * of the span that can't yet be in momentary or short-term blocks of
+   * their own are kept for sox_effect_merge: */
+  uint64_t   pos;              /* Input seen, in or out of the span */
+  uint64_t   local;            /* Sub-blocks all in the span */
+  sox_bool   begun, head;      /* The span began in a sub-block; this one */
+  double     head_sum, first_sums[SUB_BLOCKS - 1];
+  uint64_t   head_len, first_lens[SUB_BLOCKS - 1];
+} priv_t;
+
+static void append(double * * list, size_t * n, size_t * max, double x)
+{
+  if (*n == *max)
+    *list = lsx_realloc(*list, (*max = max(64, *max * 2)) * sizeof(**list));
+  (*list)[(*n)++] = x;
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double rate = effp->in_signal.rate, K, Vh, Vb, a0;
+  double const * coefs;
+  unsigned i, chans = effp->in_signal.channels;
+  size_t n;
+
+  /* Pre-filter: high-shelf of about +4dB above 1.5kHz */
+  K = tan(M_PI * 1681.974450955533 / rate);
+  Vh = pow(10., 3.999843853973347 / 20);
+  Vb = pow(Vh, .4996667741545416);
+  a0 = 1 + K / .7071752369554196 + K * K;
+  p->b[0][0] = (Vh + Vb * K / .7071752369554196 + K * K) / a0;
+  p->b[0][1] = 2 * (K * K - Vh) / a0;
+  p->b[0][2] = (Vh - Vb * K / .7071752369554196 + K * K) / a0;
+  p->a[0][1] = 2 * (K * K - 1) / a0;
+  p->a[0][2] = (1 - K / .7071752369554196 + K * K) / a0;
+
+  /* RLB weighting: high-pass at about 38Hz */
+  K = tan(M_PI * 38.13547087602444 / rate);
+  a0 = 1 + K / .5003270373238773 + K * K;
+  p->b[1][0] = 1, p->b[1][1] = -2, p->b[1][2] = 1;
+  p->a[1][1] = 2 * (K * K - 1) / a0;
+  p->a[1][2] = (1 - K / .5003270373238773 + K * K) / a0;
+
+  coefs = lsx_half_band_coefs(&p->num_coefs);
+  p->coefs = lsx_malloc(p->num_coefs * sizeof(*p->coefs));
+  for (i = 0; i < (unsigned)p->num_coefs; ++i)
+    p->coefs[i] = 2 * coefs[i];
+  p->max_len = n = max(rate / 10 + 1.5, 2 * p->num_coefs); /* Max. sub-block length */
+  p->work = lsx_malloc(2 * n * sizeof(*p->work));
+  p->chans = lsx_calloc(chans, sizeof(*p->chans));
+  p->weights = lsx_malloc(chans * sizeof(*p->weights));
+  for (i = 0; i < chans; ++i) {
+    p->chans[i].up[0] = lsx_calloc(2 * p->num_coefs + n, sizeof(double));
+    p->chans[i].up[1] = lsx_calloc(2 * p->num_coefs + 2 * n, sizeof(double));
+    /* Surrounds are weighted +1.5dB & LFE excluded, assuming 5.0 or 5.1
+     * in the usual (WAV) order; other layouts are weighted equally. */
+    p->weights[i] = 1;
+    if ((chans == 5 && i >= 3) || (chans == 6 && i >= 4))
+      p->weights[i] = 1.41;
+    if (chans == 6 && i == 3)
+      p->weights[i] = 0;
+  }
+  p->samples = p->begin = p->count = 0;
+  p->next = rate / 10 + .5;
+  p->pos = p->local = 0;
+  p->begun = p->head = sox_false;
+  p->head_sum = p->head_len = 0;
+  p->sum = 0;
+  p->max_momentary = p->max_short_term = p->peak = 0;
+  p->num_blocks = p->num_short_terms = 0;
+  effp->span_history = .5;   /* For K-weighting to settle within rounding */
+  return SOX_SUCCESS;
+}
+
+/* Interpolate by a half-band FIR (c is 2x its odd taps): `in' holds 2n
+ * samples of history then m new ones; mid[k] is given the value half-way
+ * between the new sample k - n and the one following it. */
+static void half_band(double const * c, int n, double const * in, size_t m,
+    double * mid)
+{
+  size_t k;
+  int j;
+
+  for (k = 0; k < m; ++k)
+    mid[k] = 0;
+  for (in += n, j = 0; j < n; ++j)    /* Loop over k innermost to vectorise */
+    for (k = 0; k < m; ++k)
+      mid[k] += c[j] * (in[k - j] + in[k + j + 1]);
+}
+
+static double peak(double const * x, size_t n, double peak)
+{
+  size_t i;
+  for (i = 0; i < n; ++i)
+    peak = max(peak, fabs(x[i]));
+  return peak;
+}
+
+/* K-weight n samples of one channel (at the given stride), returning the sum
+ * of their squares, and track their true peak. */
+static double channel(priv_t * p, chan_t * c, sox_sample_t const * ibuf,
+    size_t n, size_t stride)
+{
+  double z00 = c->z[0][0], z01 = c->z[0][1], z10 = c->z[1][0], z11 = c->z[1][1];
+  size_t i, h = 2 * p->num_coefs;
+  double sum = 0, * x = c->up[0] + h, * y = c->up[1] + h;
+
+  for (i = 0; i < n; ++i, ibuf += stride) {
+    double y0, y1;
+
+    x[i] = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf,);
+    y0 = p->b[0][0] * x[i] + z00;
+    z00 = p->b[0][1] * x[i] - p->a[0][1] * y0 + z01;
+    z01 = p->b[0][2] * x[i] - p->a[0][2] * y0;
+    y1 = y0 + z10;          /* b = 1, -2, 1 */
+    z10 = -2 * y0 - p->a[1][1] * y1 + z11;
+    z11 = y0 - p->a[1][2] * y1;
+    sum += y1 * y1;
+  }
+  c->z[0][0] = z00, c->z[0][1] = z01, c->z[1][0] = z10, c->z[1][1] = z11;
+
+  /* True peak: 4x up-sampled by two 2x stages */
+  half_band(p->coefs, p->num_coefs, c->up[0], n, p->work);
+  for (i = 0; i < n; ++i)
+    y[2 * i] = c->up[0][p->num_coefs + i], y[2 * i + 1] = p->work[i];
+  half_band(p->coefs, p->num_coefs, c->up[1], 2 * n, p->work);
+  p->peak = peak(y, 2 * n, peak(p->work, 2 * n, p->peak));
+  memmove(c->up[0], c->up[0] + n, h * sizeof(*x));   /* Keep the history */
+  memmove(c->up[1], c->up[1] + 2 * n, h * sizeof(*y));
+  return sum;
+}
+
+/* Mean square over the most recent n sub-blocks */
+static double energy(priv_t const * p, unsigned n)
+{
+  double sum = 0;
+  uint64_t len = 0;
+  unsigned i;
+
+  for (i = 0; i < n; ++i) {
+    unsigned j = (p->count - 1 - i) % SUB_BLOCKS;
+    sum += p->sums[j];
+    len += p->lens[j];
+  }
+  return sum / len;
+}
+
+/* A sub-block of the given sum of squares & length is complete; adds to the
+ * momentary (if m) and short-term (if s) loudness the blocks ending with it */
+static void complete(priv_t * p, double sum, uint64_t len, sox_bool m,
+    sox_bool s)
+{
+  unsigned i = p->count++ % SUB_BLOCKS;
+  double e;
+
+  if (p->head) {
+    p->head_sum = sum, p->head_len = len, p->head = sox_false;
+    return;
+  }
+  p->sums[i] = sum;
+  p->lens[i] = len;
+  if (p->local < SUB_BLOCKS - 1)
+    p->first_sums[p->local] = sum, p->first_lens[p->local] = len;
+  ++p->local;
+
+  if (m && p->local >= 4) {            /* Momentary: 400ms */
+    e = energy(p, 4);
+    append(&p->blocks, &p->num_blocks, &p->max_blocks, e);
+    p->max_momentary = max(p->max_momentary, e);
+  }
+  if (s && p->local >= SUB_BLOCKS) {   /* Short-term: 3s */
+    e = energy(p, SUB_BLOCKS);
+    append(&p->short_terms, &p->num_short_terms, &p->max_short_terms, e);
+    p->max_short_term = max(p->max_short_term, e);
+  }
+}
+
+static void sub_block_done(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  complete(p, p->sum, p->samples - p->begin, sox_true, sox_true);
+  p->begin = p->samples;
+  p->sum = 0;
+  p->next = effp->in_signal.rate * (p->count + 1) / 10 + .5;
+}
+
+/* Sub-blocks are kept to those of the whole of the audio, of which the span
+ * (set once the effect has started) may be a part */
+static void span_start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double rate = effp->in_signal.rate;
+
+  p->samples = p->begin = effp->span.offset;
+  for (p->count = p->samples * 10 / rate; p->count &&
+      (uint64_t)(rate * p->count / 10 + .5) > p->samples; --p->count);
+  while ((uint64_t)(rate * (p->count + 1) / 10 + .5) <= p->samples)
+    ++p->count;
+  p->next = rate * (p->count + 1) / 10 + .5;
+  p->begun = p->head = p->samples != (uint64_t)(rate * p->count / 10 + .5);
+}
+
+/* Runs the filters over input outside of the span: before it, to settle
+ * them; after it, for the true peak of the span's end, which lags. */
+static void settle(priv_t * p, sox_sample_t const * ibuf, size_t len,
+    size_t chans, sox_bool keep_peak)
+{
+  double peak = p->peak;
+  size_t i, n;
+
+  for (; len; len -= n, ibuf += n * chans) {
+    n = min(len, p->max_len);
+    for (i = 0; i < chans; ++i)
+      channel(p, &p->chans[i], ibuf + i, n, chans);
+  }
+  if (!keep_peak)
+    p->peak = peak;
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, i, n, lead, in;
+  size_t len = min(*isamp, *osamp) / chans;
+
+  *isamp = *osamp = len * chans;
+  memcpy(obuf, ibuf, len * chans * sizeof(*obuf));
+  if (!p->pos && effp->span.offset)
+    span_start(effp);
+  in = lsx_span(effp, p->pos, len, &lead);
+  p->pos += len;
+  settle(p, ibuf, lead, chans, sox_false);
+  for (ibuf += lead * chans, len -= lead + in; in; in -= n, ibuf += n * chans) {
+    n = min(in, p->next - p->samples);
+    for (i = 0; i < chans; ++i)
+      p->sum += p->weights[i] * channel(p, &p->chans[i], ibuf + i, n, chans);
+    if ((p->samples += n) == p->next)
+      sub_block_done(effp);
+  }
+  settle(p, ibuf, len, chans, sox_true);
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, n = 2 * p->num_coefs, i;
+  sox_sample_t * zeros;
+
+  (void)obuf, *osamp = 0;
+  if (effp->span.length) /* Not the end of the audio */
+    return SOX_SUCCESS;
+  zeros = lsx_calloc(n * chans, sizeof(*zeros));
+  for (i = 0; i < chans; ++i)          /* Flush the up-samplers */
+    channel(p, &p->chans[i], zeros + i, n, chans);
+  free(zeros);
+  return SOX_SUCCESS;
+}
+
+static int compare(void const * a, void const * b)
+{
+  double x = *(double const *)a, y = *(double const *)b;
+  return x < y? -1 : x > y;
+}
+
+/* Mean of those of the n energies above the threshold t; *k is their number */
+static double gated(double const * e, size_t n, double t, size_t * k)
+{
+  double sum = 0;
+  size_t i;
+
+  for (*k = i = 0; i < n; ++i)
+    if (e[i] > t)
+      sum += e[i], ++*k;
+  return *k? sum / *k : 0;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double integrated = 0, threshold = 0, lra_lo = 0, lra_hi = 0, t, * l;
+  size_t i, j, k;
+
+  /* Integrated: absolute gate at -70LUFS, then relative gate at -10LU */
+  if (gated(p->blocks, p->num_blocks, ENERGY(-70), &k) > 0) {
+    threshold = gated(p->blocks, p->num_blocks, ENERGY(-70), &k) / 10;
+    threshold = max(threshold, ENERGY(-70));
+    integrated = gated(p->blocks, p->num_blocks, threshold, &k);
+  }
+
+  /* Range: as above, but relative gate at -20LU; 10th to 95th percentile */
+  t = gated(p->short_terms, p->num_short_terms, ENERGY(-70), &k) / 100;
+  t = max(t, ENERGY(-70));
+  l = lsx_malloc((p->num_short_terms + 1) * sizeof(*l));
+  for (i = j = 0; i < p->num_short_terms; ++i)
+    if (p->short_terms[i] > t)
+      l[j++] = LUFS(p->short_terms[i]);
+  if (j) {
+    qsort(l, j, sizeof(*l), compare);
+    lra_lo = l[(size_t)((j - 1) * .1 + .5)];
+    lra_hi = l[(size_t)((j - 1) * .95 + .5)];
+  }
+  free(l);
+
+  if (!p->samples)
+    lsx_warn("no audio");
+  else {
+    fprintf(stderr, "Integrated     %7.1f LUFS\n", LUFS(integrated));
+    fprintf(stderr, "Threshold      %7.1f LUFS\n", LUFS(threshold));
+    fprintf(stderr, "LRA            %7.1f LU\n", lra_hi - lra_lo);
+    fprintf(stderr, "LRA low        %7.1f LUFS\n", j? lra_lo : LUFS(0.));
+    fprintf(stderr, "LRA high       %7.1f LUFS\n", j? lra_hi : LUFS(0.));
+    fprintf(stderr, "Momentary max  %7.1f LUFS\n", LUFS(p->max_momentary));
+    fprintf(stderr, "Short-term max %7.1f LUFS\n", LUFS(p->max_short_term));
+    fprintf(stderr, "True peak      %7.1f dBTP\n", linear_to_dB(p->peak));
+  }
+
+  for (i = 0; i < effp->in_signal.channels; ++i) {
+    free(p->chans[i].up[0]);
+    free(p->chans[i].up[1]);
+  }
+  free(p->chans);
+  free(p->work);
+  free(p->coefs);
+  free(p->weights);
+  free(p->blocks);
+  free(p->short_terms);
+  p->blocks = p->short_terms = NULL;
+  p->max_blocks = p->max_short_terms = 0;
+  return SOX_SUCCESS;
+}
+
+static void partial_list(lsx_partial_t * s, double * * list, size_t * n,
+    size_t * max)
+{
+  uint64_t len = *n;
+  size_t i;
+
+  lsx_partial_u64(s, &len);
+  if (s->reading) {
+    if (len > (s->size - min(s->pos, s->size)) / sizeof(**list)) {
+      s->error = sox_true;
+      return;
+    }
+    *n = *max = len;
+    *list = lsx_calloc(*n, sizeof(**list));
+  }
+  for (i = 0; i < len; ++i)
+    lsx_partial_f64(s, &(*list)[i]);
+}
+
+/* Writes or reads what has been gathered, as a partial result: where the
+ * span started, and whether in a sub-block; the sub-blocks kept (see priv_t),
+ * the most recent, and the one being filled; then the loudness blocks */
+static void partial(lsx_partial_t * s, priv_t * p, uint64_t * start,
+    uint64_t * begun)
+{
+  uint64_t head = p->head, i;
+
+  lsx_partial_u64(s, start);
+  lsx_partial_u64(s, begun);
+  lsx_partial_u64(s, &p->count);
+  lsx_partial_u64(s, &p->local);
+  lsx_partial_u64(s, &head);
+  p->head = head != 0;
+  lsx_partial_f64(s, &p->head_sum);
+  lsx_partial_u64(s, &p->head_len);
+  for (i = 0; i < min(p->local, SUB_BLOCKS - 1); ++i) {
+    lsx_partial_f64(s, &p->first_sums[i]);
+    lsx_partial_u64(s, &p->first_lens[i]);
+  }
+  for (i = 0; i < SUB_BLOCKS; ++i) {
+    lsx_partial_f64(s, &p->sums[i]);
+    lsx_partial_u64(s, &p->lens[i]);
+  }
+  lsx_partial_u64(s, &p->begin);
+  lsx_partial_u64(s, &p->samples);
+  lsx_partial_f64(s, &p->sum);
+  lsx_partial_f64(s, &p->max_momentary);
+  lsx_partial_f64(s, &p->max_short_term);
+  lsx_partial_f64(s, &p->peak);
+  partial_list(s, &p->blocks, &p->num_blocks, &p->max_blocks);
+  partial_list(s, &p->short_terms, &p->num_short_terms, &p->max_short_terms);
+}
+
+static size_t save(sox_effect_t * effp, void * buf, size_t len)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  uint64_t start = effp->span.offset, begun = p->begun;
+  lsx_partial_t s;
+
+  memset(&s, 0, sizeof(s));
+  s.data = buf, s.size = len;
+  partial(&s, p, &start, &begun);
+  return s.pos;
+}
+
+/* The partial result follows what has been gathered: the sub-block being
+ * filled is joined with its first, then the loudness blocks that take in
+ * sub-blocks from both are formed, before its own are added. */
+static int merge(sox_effect_t * effp, void const * buf, size_t len)
+{
+  priv_t * p = (priv_t *)effp->priv, q = *p;
+  uint64_t start, begun, i;
+  lsx_partial_t s;
+  int result = SOX_SUCCESS;
+
+  memset(&s, 0, sizeof(s));
+  s.data = (unsigned char *)buf, s.size = len, s.reading = sox_true;
+  q.blocks = q.short_terms = NULL;
+  partial(&s, &q, &start, &begun);
+  if (s.error || s.pos != len || start != p->samples ||
+      (!begun && p->samples != p->begin))
+    result = SOX_EOF;
+  else if (begun && q.head) {          /* It is all in the one sub-block */
+    p->sum += q.sum;
+    p->samples = q.samples;
+    p->peak = max(p->peak, q.peak);
+  }
+  else {
+    if (begun)
+      complete(p, p->sum + q.head_sum, p->samples - p->begin + q.head_len,
+          sox_true, sox_true);
+    for (i = 0; i < min(q.local, SUB_BLOCKS - 1); ++i)
+      complete(p, q.first_sums[i], q.first_lens[i], i < 3, sox_true);
+    if (q.local > SUB_BLOCKS - 1) {
+      memcpy(p->sums, q.sums, sizeof(p->sums));
+      memcpy(p->lens, q.lens, sizeof(p->lens));
+      p->local += q.local - (SUB_BLOCKS - 1);
+    }
+    for (i = 0; i < q.num_blocks; ++i)
+      append(&p->blocks, &p->num_blocks, &p->max_blocks, q.blocks[i]);
+    for (i = 0; i < q.num_short_terms; ++i)
+      append(&p->short_terms, &p->num_short_terms, &p->max_short_terms,
+          q.short_terms[i]);
+    p->max_momentary = max(p->max_momentary, q.max_momentary);
+    p->max_short_term = max(p->max_short_term, q.max_short_term);
+    p->peak = max(p->peak, q.peak);
+    p->count = q.count;
+    p->begin = q.begin;
+    p->samples = q.samples;
+    p->sum = q.sum;
+    p->next = effp->in_signal.rate * (p->count + 1) / 10 + .5;
+  }
+  free(q.blocks);
+  free(q.short_terms);
+  return result;
+}
+
+sox_effect_handler_t const * lsx_ebur128_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"ebur128", NULL,
+    SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+    NULL, start, flow, drain, stop, NULL, sizeof(priv_t), NULL, save, merge,
+    NULL};
+  return &handler;
+}
@@ -45,20 +45,23 @@
 #include "sox_i.h"
 
 #include <stdlib.h> /* Harmless, and prototypes atof() etc. --dgc */
+#include <string.h>
 
 #define DELAY_BUFSIZ ( 50 * 50U * 1024 )
 #define MAX_ECHOS 7     /* 24 bit x ( 1 + MAX_ECHOS ) = */
                         /* 24 bit x 8 = 32 bit !!!      */
 
 /* Private data for SKEL file */
+#define BLOCK_LEN 1024 /* Samples processed per block */
+
 typedef struct {
-        int     counter;
         int     num_delays;
-        double  *delay_buf;
+        lsx_delay_t delay_line;
         float   in_gain, out_gain;
         float   delay[MAX_ECHOS], decay[MAX_ECHOS];
         ptrdiff_t samples[MAX_ECHOS], maxsamples;
         size_t fade_out;
+        double  d_in[BLOCK_LEN], d_out[BLOCK_LEN], tap[BLOCK_LEN];
 } priv_t;
 
 /* Private data for SKEL file */
@@ -101,7 +104,6 @@ static int sox_echo_start(sox_effect_t * effp)
         priv_t * echo = (priv_t *) effp->priv;
         int i;
         float sum_in_volume;
-        long j;
 
         echo->maxsamples = 0;
         if ( echo->in_gain < 0.0 )
@@ -145,16 +147,13 @@ static int sox_echo_start(sox_effect_t * effp)
                 if ( echo->samples[i] > echo->maxsamples )
                         echo->maxsamples = echo->samples[i];
         }
-        echo->delay_buf = lsx_malloc(sizeof (double) * echo->maxsamples);
-        for ( j = 0; j < echo->maxsamples; ++j )
-                echo->delay_buf[j] = 0.0;
+        lsx_delay_create(&echo->delay_line, (size_t)echo->maxsamples, (size_t)BLOCK_LEN);
         /* Be nice and check the hint with warning, if... */
         sum_in_volume = 1.0;
         for ( i = 0; i < echo->num_delays; i++ )
                 sum_in_volume += echo->decay[i];
         if ( sum_in_volume * echo->in_gain > 1.0 / echo->out_gain )
                 lsx_warn("echo: warning >>> gain-out can cause saturation of output <<<");
-        echo->counter = 0;
         echo->fade_out = echo->maxsamples;
 
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
@@ -163,38 +162,56 @@ static int sox_echo_start(sox_effect_t * effp)
 }
 
 /*
- * Processed signed long samples from ibuf to obuf.
- * Return number of samples processed.
+ * Process len samples from ibuf (or silence if ibuf is NULL) to obuf,
+ * a block at a time: the block is added to the delay line, then each
+ * delay's samples for the whole block are read back at once.
  */
-static int sox_echo_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
-                 size_t *isamp, size_t *osamp)
+static void echo_process(sox_effect_t * effp, const sox_sample_t *ibuf,
+                 sox_sample_t *obuf, size_t len)
 {
         priv_t * echo = (priv_t *) effp->priv;
         int j;
-        double d_in, d_out;
+        size_t i, n;
         sox_sample_t out;
-        size_t len = min(*isamp, *osamp);
-        *isamp = *osamp = len;
 
-        while (len--) {
-                /* Store delays as 24-bit signed longs */
-                d_in = (double) *ibuf++ / 256;
-                /* Compute output first */
-                d_out = d_in * echo->in_gain;
+        for (; len; len -= n) {
+                n = min(len, BLOCK_LEN);
+                if (ibuf) {
+                        /* Store delays as 24-bit signed longs */
+                        for ( i = 0; i < n; i++ ) {
+                                echo->d_in[i] = (double) *ibuf++ / 256;
+                                echo->d_out[i] = echo->d_in[i] * echo->in_gain;
+                        }
+                        lsx_delay_write(&echo->delay_line, echo->d_in, n);
+                }
+                else {
+                        memset(echo->d_out, 0, n * sizeof(*echo->d_out));
+                        lsx_delay_write(&echo->delay_line, NULL, n);
+                }
                 for ( j = 0; j < echo->num_delays; j++ ) {
-                        d_out += echo->delay_buf[
-(echo->counter + echo->maxsamples - echo->samples[j]) % echo->maxsamples]
-                        * echo->decay[j];
+                        lsx_delay_read(&echo->delay_line, (size_t)echo->samples[j], echo->tap, n);
+                        for ( i = 0; i < n; i++ )
+                                echo->d_out[i] += echo->tap[i] * echo->decay[j];
                 }
                 /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echo->out_gain;
-                out = SOX_24BIT_CLIP_COUNT((sox_sample_t) d_out, effp->clips);
-                *obuf++ = out * 256;
-                /* Store input in delay buffer */
-                echo->delay_buf[echo->counter] = d_in;
-                /* Adjust the counter */
-                echo->counter = ( echo->counter + 1 ) % echo->maxsamples;
+                for ( i = 0; i < n; i++ ) {
+                        out = SOX_24BIT_CLIP_COUNT((sox_sample_t) (echo->d_out[i] * echo->out_gain), effp->clips);
+                        *obuf++ = out * 256;
+                }
         }
+}
+
+/*
+ * Processed signed long samples from ibuf to obuf.
+ * Return number of samples processed.
+ */
+static int sox_echo_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+                 size_t *isamp, size_t *osamp)
+{
+        size_t len = min(*isamp, *osamp);
+        *isamp = *osamp = len;
+
+        echo_process(effp, ibuf, obuf, len);
         /* processed all samples */
         return (SOX_SUCCESS);
 }
@@ -205,32 +222,11 @@ static int sox_echo_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
 static int sox_echo_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
         priv_t * echo = (priv_t *) effp->priv;
-        double d_in, d_out;
-        sox_sample_t out;
-        int j;
-        size_t done;
+        size_t done = min(*osamp, echo->fade_out);
 
-        done = 0;
         /* drain out delay samples */
-        while ( ( done < *osamp ) && ( done < echo->fade_out ) ) {
-                d_in = 0;
-                d_out = 0;
-                for ( j = 0; j < echo->num_delays; j++ ) {
-                        d_out += echo->delay_buf[
-(echo->counter + echo->maxsamples - echo->samples[j]) % echo->maxsamples]
-                        * echo->decay[j];
-                }
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echo->out_gain;
-                out = SOX_24BIT_CLIP_COUNT((sox_sample_t) d_out, effp->clips);
-                *obuf++ = out * 256;
-                /* Store input in delay buffer */
-                echo->delay_buf[echo->counter] = d_in;
-                /* Adjust the counters */
-                echo->counter = ( echo->counter + 1 ) % echo->maxsamples;
-                done++;
-                echo->fade_out--;
-        };
+        echo_process(effp, NULL, obuf, done);
+        echo->fade_out -= done;
         /* samples played, it remains */
         *osamp = done;
         if (echo->fade_out == 0)
@@ -243,21 +239,20 @@ static int sox_echo_stop(sox_effect_t * effp)
 {
         priv_t * echo = (priv_t *) effp->priv;
 
-        free(echo->delay_buf);
-        echo->delay_buf = NULL;
+        lsx_delay_delete(&echo->delay_line);
         return (SOX_SUCCESS);
 }
 
 static sox_effect_handler_t sox_echo_effect = {
   "echo",
   "gain-in gain-out delay decay [ delay decay ... ]",
-  SOX_EFF_LENGTH | SOX_EFF_GAIN,
+  SOX_EFF_LENGTH | SOX_EFF_GAIN | SOX_EFF_RTSAFE,
   sox_echo_getopts,
   sox_echo_start,
   sox_echo_flow,
   sox_echo_drain,
   sox_echo_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_echo_effect_fn(void)
@@ -41,20 +41,23 @@
 #include "sox_i.h"
 
 #include <stdlib.h> /* Harmless, and prototypes atof() etc. --dgc */
+#include <string.h>
 
 #define DELAY_BUFSIZ ( 50 * 50U * 1024 )
 #define MAX_ECHOS 7     /* 24 bit x ( 1 + MAX_ECHOS ) = */
                         /* 24 bit x 8 = 32 bit !!!      */
 
 /* Private data for SKEL file */
+#define BLOCK_LEN 1024 /* Samples processed per block */
+
 typedef struct {
-        int     counter[MAX_ECHOS];
         int     num_delays;
-        double  *delay_buf;
+        lsx_delay_t delay_line[MAX_ECHOS];
         float   in_gain, out_gain;
         float   delay[MAX_ECHOS], decay[MAX_ECHOS];
-        ptrdiff_t samples[MAX_ECHOS], pointer[MAX_ECHOS];
+        ptrdiff_t samples[MAX_ECHOS];
         size_t sumsamples;
+        double  d_in[BLOCK_LEN], d_out[BLOCK_LEN], line_in[BLOCK_LEN], tap[BLOCK_LEN];
 } priv_t;
 
 /* Private data for SKEL file */
@@ -100,7 +103,6 @@ static int sox_echos_start(sox_effect_t * effp)
         priv_t * echos = (priv_t *) effp->priv;
         int i;
         float sum_in_volume;
-        unsigned long j;
 
         if ( echos->in_gain < 0.0 )
         {
@@ -140,13 +142,10 @@ static int sox_echos_start(sox_effect_t * effp)
                     lsx_fail("echos: decay must be less than 1.0!" );
                     return (SOX_EOF);
                 }
-                echos->counter[i] = 0;
-                echos->pointer[i] = echos->sumsamples;
                 echos->sumsamples += echos->samples[i];
         }
-        echos->delay_buf = lsx_malloc(sizeof (double) * echos->sumsamples);
-        for ( j = 0; j < echos->sumsamples; ++j )
-                echos->delay_buf[j] = 0.0;
+        for ( i = 0; i < echos->num_delays; i++ )
+                lsx_delay_create(&echos->delay_line[i], (size_t)echos->samples[i], (size_t)BLOCK_LEN);
         /* Be nice and check the hint with warning, if... */
         sum_in_volume = 1.0;
         for ( i = 0; i < echos->num_delays; i++ )
@@ -160,44 +159,63 @@ static int sox_echos_start(sox_effect_t * effp)
 }
 
 /*
- * Processed signed long samples from ibuf to obuf.
- * Return number of samples processed.
+ * Process len samples from ibuf (or silence if ibuf is NULL) to obuf,
+ * a block at a time.  Each delay is fed with the input to the delay
+ * before it, plus the input (with silence, just the former).
  */
-static int sox_echos_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
-                size_t *isamp, size_t *osamp)
+static void echos_process(sox_effect_t * effp, const sox_sample_t *ibuf,
+                sox_sample_t *obuf, size_t len)
 {
         priv_t * echos = (priv_t *) effp->priv;
         int j;
-        double d_in, d_out;
+        size_t i, n;
         sox_sample_t out;
-        size_t len = min(*isamp, *osamp);
-        *isamp = *osamp = len;
 
-        while (len--) {
-                /* Store delays as 24-bit signed longs */
-                d_in = (double) *ibuf++ / 256;
-                /* Compute output first */
-                d_out = d_in * echos->in_gain;
-                for ( j = 0; j < echos->num_delays; j++ ) {
-                        d_out += echos->delay_buf[echos->counter[j] + echos->pointer[j]] * echos->decay[j];
+        for (; len; len -= n) {
+                n = min(len, BLOCK_LEN);
+                if (ibuf) {
+                        /* Store delays as 24-bit signed longs */
+                        for ( i = 0; i < n; i++ ) {
+                                echos->d_in[i] = (double) *ibuf++ / 256;
+                                echos->d_out[i] = echos->d_in[i] * echos->in_gain;
+                        }
+                }
+                else {
+                        memset(echos->d_in, 0, n * sizeof(*echos->d_in));
+                        memset(echos->d_out, 0, n * sizeof(*echos->d_out));
                 }
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echos->out_gain;
-                out = SOX_24BIT_CLIP_COUNT((sox_sample_t) d_out, effp->clips);
-                *obuf++ = out * 256;
                 /* Mix decay of delays and input */
                 for ( j = 0; j < echos->num_delays; j++ ) {
+                        lsx_delay_t * line = &echos->delay_line[j];
                         if ( j == 0 )
-                                echos->delay_buf[echos->counter[j] + echos->pointer[j]] = d_in;
-                        else
-                                echos->delay_buf[echos->counter[j] + echos->pointer[j]] =
-                                   echos->delay_buf[echos->counter[j-1] + echos->pointer[j-1]] + d_in;
+                                memcpy(echos->line_in, echos->d_in, n * sizeof(*echos->d_in));
+                        else if (ibuf)
+                                for ( i = 0; i < n; i++ )
+                                        echos->line_in[i] += echos->d_in[i];
+                        lsx_delay_write(line, echos->line_in, n);
+                        lsx_delay_read(line, (size_t)echos->samples[j], echos->tap, n);
+                        for ( i = 0; i < n; i++ )
+                                echos->d_out[i] += echos->tap[i] * echos->decay[j];
+                }
+                /* Adjust the output volume and size to 24 bit */
+                for ( i = 0; i < n; i++ ) {
+                        out = SOX_24BIT_CLIP_COUNT((sox_sample_t) (echos->d_out[i] * echos->out_gain), effp->clips);
+                        *obuf++ = out * 256;
                 }
-                /* Adjust the counters */
-                for ( j = 0; j < echos->num_delays; j++ )
-                        echos->counter[j] =
-                           ( echos->counter[j] + 1 ) % echos->samples[j];
         }
+}
+
+/*
+ * Processed signed long samples from ibuf to obuf.
+ * Return number of samples processed.
+ */
+static int sox_echos_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+                size_t *isamp, size_t *osamp)
+{
+        size_t len = min(*isamp, *osamp);
+        *isamp = *osamp = len;
+
+        echos_process(effp, ibuf, obuf, len);
         /* processed all samples */
         return (SOX_SUCCESS);
 }
@@ -208,38 +226,11 @@ static int sox_echos_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sam
 static int sox_echos_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
         priv_t * echos = (priv_t *) effp->priv;
-        double d_in, d_out;
-        sox_sample_t out;
-        int j;
-        size_t done;
+        size_t done = min(*osamp, echos->sumsamples);
 
-        done = 0;
         /* drain out delay samples */
-        while ( ( done < *osamp ) && ( done < echos->sumsamples ) ) {
-                d_in = 0;
-                d_out = 0;
-                for ( j = 0; j < echos->num_delays; j++ ) {
-                        d_out += echos->delay_buf[echos->counter[j] + echos->pointer[j]] * echos->decay[j];
-                }
-                /* Adjust the output volume and size to 24 bit */
-                d_out = d_out * echos->out_gain;
-                out = SOX_24BIT_CLIP_COUNT((sox_sample_t) d_out, effp->clips);
-                *obuf++ = out * 256;
-                /* Mix decay of delays and input */
-                for ( j = 0; j < echos->num_delays; j++ ) {
-                        if ( j == 0 )
-                                echos->delay_buf[echos->counter[j] + echos->pointer[j]] = d_in;
-                        else
-                                echos->delay_buf[echos->counter[j] + echos->pointer[j]] =
-                                   echos->delay_buf[echos->counter[j-1] + echos->pointer[j-1]];
-                }
-                /* Adjust the counters */
-                for ( j = 0; j < echos->num_delays; j++ )
-                        echos->counter[j] =
-                           ( echos->counter[j] + 1 ) % echos->samples[j];
-                done++;
-                echos->sumsamples--;
-        };
+        echos_process(effp, NULL, obuf, done);
+        echos->sumsamples -= done;
         /* samples played, it remains */
         *osamp = done;
         if (echos->sumsamples == 0)
@@ -254,22 +245,23 @@ static int sox_echos_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osam
 static int sox_echos_stop(sox_effect_t * effp)
 {
         priv_t * echos = (priv_t *) effp->priv;
+        int i;
 
-        free(echos->delay_buf);
-        echos->delay_buf = NULL;
+        for ( i = 0; i < echos->num_delays; i++ )
+                lsx_delay_delete(&echos->delay_line[i]);
         return (SOX_SUCCESS);
 }
 
 static sox_effect_handler_t sox_echos_effect = {
   "echos",
   "gain-in gain-out delay decay [ delay decay ... ]",
-  SOX_EFF_LENGTH | SOX_EFF_GAIN,
+  SOX_EFF_LENGTH | SOX_EFF_GAIN | SOX_EFF_RTSAFE,
   sox_echos_getopts,
   sox_echos_start,
   sox_echos_flow,
   sox_echos_drain,
   sox_echos_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_echos_effect_fn(void)
@@ -22,6 +22,11 @@
 #ifdef HAVE_STRINGS_H
   #include <strings.h>
 #endif
+#include <time.h>
+#if !defined HAVE_CLOCK_GETTIME && defined HAVE_SYS_TIME_H
+  #include <sys/time.h>
+#endif
+#include "ringbuf.h"
 
 #define DEBUG_EFFECTS_CHAIN 0
 
@@ -41,6 +46,12 @@ int lsx_flow_copy(sox_effect_t * effp UNUSED, const sox_sample_t * ibuf,
   return SOX_SUCCESS;
 }
 
+/* Reset for an effect that keeps no state between flow calls */
+int lsx_reset_stateless(sox_effect_t * effp UNUSED)
+{
+  return SOX_SUCCESS;
+}
+
 /* Inform no more samples to drain */
 static int default_drain(sox_effect_t * effp UNUSED, sox_sample_t *obuf UNUSED, size_t *osamp)
 {
@@ -69,7 +80,9 @@ sox_effect_t * sox_create_effect(sox_effect_handler_t const * eh)
   if (!effp->handler.stop   ) effp->handler.stop    = default_function;
   if (!effp->handler.kill   ) effp->handler.kill    = default_function;
 
-  effp->priv = lsx_calloc(1, effp->handler.priv_size);
+  effp->arena = lsx_arena_create(effp->handler.priv_size);
+  effp->priv = effp->handler.priv_size?
+      lsx_effect_calloc(effp, 1, effp->handler.priv_size) : NULL;
 
   return effp;
 } /* sox_create_effect */
@@ -82,34 +95,45 @@ int sox_effect_options(sox_effect_t *effp, int argc, char * const argv[])
   argv2[0] = (char *)effp->handler.name;
   memcpy(argv2 + 1, argv, argc * sizeof(*argv2));
   result = effp->handler.getopts(effp, argc + 1, argv2);
-  free(argv2);
+  lsx_free(argv2);
   return result;
 } /* sox_effect_options */
 
 /* Effects chain: */
 
-sox_effects_chain_t * sox_create_effects_chain(
+sox_effects_chain_t * sox_create_context_effects_chain(sox_context_t * context,
     sox_encodinginfo_t const * in_enc, sox_encodinginfo_t const * out_enc)
 {
   sox_effects_chain_t * result = lsx_calloc(1, sizeof(sox_effects_chain_t));
   result->global_info = *sox_get_effects_globals();
+  result->global_info.global_info = context;
   result->in_enc = in_enc;
   result->out_enc = out_enc;
   return result;
+} /* sox_create_context_effects_chain */
+
+sox_effects_chain_t * sox_create_effects_chain(
+    sox_encodinginfo_t const * in_enc, sox_encodinginfo_t const * out_enc)
+{
+  return sox_create_context_effects_chain(&sox_globals, in_enc, out_enc);
 } /* sox_create_effects_chain */
 
 void sox_delete_effects_chain(sox_effects_chain_t *ecp)
 {
+    if (ecp && ecp->pulling)
+        lsx_free(ecp->il_buf);
     if (ecp && ecp->length)
         sox_delete_effects(ecp);
-    free(ecp->effects);
-    free(ecp);
+    lsx_free(ecp->effects);
+    lsx_free(ecp);
 } /* sox_delete_effects_chain */
 
-/* Effect can call in start() or flow() to set minimum input size to flow() */
+/* Effect can call in start() or flow() to set minimum input size to flow();
+ * from start(), the input buffer is made big enough for it, whereas later,
+ * it must already be */
 int lsx_effect_set_imin(sox_effect_t * effp, size_t imin)
 {
-  if (imin > sox_globals.bufsiz / effp->flows) {
+  if (effp->ibufsiz && imin > effp->ibufsiz / effp->flows) {
     lsx_fail("sox_bufsiz not big enough");
     return SOX_EOF;
   }
@@ -118,6 +142,14 @@ int lsx_effect_set_imin(sox_effect_t * effp, size_t imin)
   return SOX_SUCCESS;
 }
 
+/* Effect can call in start() to say how many samples (per flow) it would
+ * best be given, and give, in each call of flow(); the buffers on either
+ * side are then made at least that big (within reason) */
+void lsx_effect_set_block(sox_effect_t * effp, size_t block)
+{
+  effp->block = block;
+}
+
 /* Effects table to be extended in steps of EFF_TABLE_STEP */
 #define EFF_TABLE_STEP 8
 
@@ -127,7 +159,7 @@ int lsx_effect_set_imin(sox_effect_t * effp, size_t imin)
  * output rate and channels the effect does produce are written back to *in,
  * ready for the next effect in the chain.
  */
-int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signalinfo_t * in, sox_signalinfo_t const * out)
+static int add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signalinfo_t * in, sox_signalinfo_t const * out)
 {
   int ret, (*start)(sox_effect_t * effp) = effp->handler.start;
   size_t f;
@@ -152,21 +184,37 @@ int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signali
     (effp->handler.flags & SOX_EFF_MCHAN)? 1 : effp->in_signal.channels;
   effp->clips = 0;
   effp->imin = 0;
+  effp->history = (effp->handler.flags & SOX_EFF_SEEK)? 0 : HUGE_VAL;
   eff0 = *effp, eff0.priv = lsx_memdup(eff0.priv, eff0.handler.priv_size);
   eff0.in_signal.mult = NULL; /* Only used in channel 0 */
   ret = start(effp);
   if (ret == SOX_EFF_NULL) {
     lsx_report("has no effect in this configuration");
-    free(eff0.priv);
+    lsx_free(eff0.priv);
     effp->handler.kill(effp);
-    free(effp->priv);
+    lsx_mem_release(&effp->mem, effp->chain_mem);
+    lsx_arena_free(effp->arena);
+    effp->arena = NULL;
     effp->priv = NULL;
     return SOX_SUCCESS;
   }
   if (ret != SOX_SUCCESS) {
-    free(eff0.priv);
+    lsx_free(eff0.priv);
     return SOX_EOF;
   }
+  if ((!chain->global_info.global_info->updatable &&
+        (lsx_biquad_fuse(chain, effp) || lsx_vol_fuse(chain, effp))) ||
+      lsx_rate_fuse(chain, effp)) {
+    lsx_report("fused with the previous effect");
+    *in = chain->effects[chain->length - 1][0].out_signal;
+    lsx_free(eff0.priv);
+    effp->handler.kill(effp);
+    lsx_mem_release(&effp->mem, effp->chain_mem);
+    lsx_arena_free(effp->arena);
+    effp->arena = NULL;
+    effp->priv = NULL;
+    return SOX_SUCCESS;
+  }
   if (in->mult)
     lsx_debug("mult=%g", *in->mult);
 
@@ -194,22 +242,38 @@ int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signali
   chain->effects[chain->length] =
     lsx_calloc(effp->flows, sizeof(chain->effects[chain->length][0]));
   chain->effects[chain->length][0] = *effp;
+  lsx_mem_tag(&chain->effects[chain->length][0].mem, effp->chain_mem);
 
   for (f = 1; f < effp->flows; ++f) {
     chain->effects[chain->length][f] = eff0;
     chain->effects[chain->length][f].flow = f;
-    chain->effects[chain->length][f].priv = lsx_memdup(eff0.priv, eff0.handler.priv_size);
+    chain->effects[chain->length][f].priv = eff0.priv? memcpy(
+        lsx_effect_calloc(effp, 1, eff0.handler.priv_size), eff0.priv,
+        eff0.handler.priv_size) : NULL;
     if (start(&chain->effects[chain->length][f]) != SOX_SUCCESS) {
-      free(eff0.priv);
+      lsx_free(eff0.priv);
       return SOX_EOF;
     }
   }
 
   ++chain->length;
-  free(eff0.priv);
+  lsx_free(eff0.priv);
   return SOX_SUCCESS;
 }
 
+int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signalinfo_t * in, sox_signalinfo_t const * out)
+{
+  lsx_mem_tag_t saved;
+  int ret;
+
+  effp->chain_mem = &chain->mem;
+  memset(&effp->mem, 0, sizeof(effp->mem));
+  saved = lsx_mem_tag(&effp->mem, effp->chain_mem);
+  ret = add_effect(chain, effp, in, out);
+  lsx_mem_untag(saved);
+  return ret;
+}
+
 /* An effect's output buffer (effp->obuf) generally has this layout:
  *   |. . . A1A2A3B1B2B3C1C2C3. . . . . . . . . . . . . . . . . . |
  *    ^0    ^obeg             ^oend                               ^bufsiz
@@ -229,6 +293,13 @@ int sox_add_effect(sox_effects_chain_t * chain, sox_effect_t * effp, sox_signali
  * at position obeg/flows and ends before oend/flows.  In case bufsiz
  * is not evenly divisible by flows, there will be an unused area at
  * the very end of the output buffer.
+ * Here, bufsiz is the effect's own obufsiz: sox_globals.bufsiz, or more
+ * where this effect or the next wants more for its imin or block (see
+ * size_buffers()).
+ * An MCHAN effect that has SOX_EFF_PLANAR set may be given its input,
+ * and asked for its output, in the uninterleaved form too (effp->planar),
+ * with one channel buffer per channel; this is chosen (by set_planar())
+ * where it saves a conversion.
  * The interleave() and deinterleave() functions convert between these
  * two representations.
  */
@@ -237,58 +308,274 @@ static void interleave(size_t flows, size_t length, sox_sample_t *from,
 static void deinterleave(size_t flows, size_t length, sox_sample_t *from,
     sox_sample_t *to, size_t bufsiz, size_t offset);
 
+/* Number of channel buffers in effp's input (1 if interleaved) */
+static size_t in_planes(sox_effect_t const * effp)
+{
+  return effp->flows > 1? effp->flows :
+    effp->planar? effp->in_signal.channels : 1;
+}
+
+/* Number of channel buffers in effp's output (1 if interleaved) */
+static size_t out_planes(sox_effect_t const * effp)
+{
+  return effp->flows > 1? effp->flows :
+    effp->planar? effp->out_signal.channels : 1;
+}
+
+/* Number of channel buffers in which effects[n] must leave its output */
+static size_t next_planes(sox_effects_chain_t const * chain, size_t n)
+{
+  return n + 1 == chain->length? 1 : in_planes(chain->effects[n + 1]);
+}
+
+/* With the context's float_chain, an effect that has set flow_float
+ * (effp->use_float) is given, and gives, float samples.  These share the
+ * 32-bit storage of the sox_sample_t buffers, so are converted in place
+ * where an effect's output goes to an effect of the other kind; clipping
+ * happens (and is counted) only there.
+ */
+static sox_bool next_float(sox_effects_chain_t const * chain, size_t n)
+{
+  return n + 1 < chain->length && chain->effects[n + 1]->use_float;
+}
+
+/* Convert length samples, starting at offset in a buffer laid out in the
+ * given number of channel buffers, to or from float */
+static void convert_samples(sox_sample_t * buf, size_t bufsiz,
+    sox_bool to_float, size_t planes, size_t offset, size_t length,
+    sox_uint64_t * clips)
+{
+  size_t flow_offs = bufsiz / planes, f, i;
+  SOX_SAMPLE_LOCALS;
+
+  length /= planes;
+  for (f = 0; f < planes; ++f) {
+    sox_sample_t * p = buf + f * flow_offs + offset / planes;
+    float * q = (float *)p;
+    if (to_float) for (i = 0; i < length; ++i)
+      q[i] = p[i] * (float)(1. / (SOX_SAMPLE_MAX + 1.));
+    else for (i = 0; i < length; ++i)
+      p[i] = SOX_FLOAT_32BIT_TO_SAMPLE(q[i], *clips);
+  }
+}
+
+/* With the context's profile (or governor, which is steered by the same
+ * counters), flow_effect and drain_effect time each call of an effect, and
+ * the rearranging of its buffers that follows */
+typedef struct {double wall, cpu;} times_t;
+#define timed(context) ((context)->profile || (context)->governor)
+
+static times_t get_times(void)
+{
+  times_t times;
+#if defined HAVE_CLOCK_GETTIME
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  times.wall = t.tv_sec + t.tv_nsec * 1e-9;
+#elif defined HAVE_GETTIMEOFDAY
+  struct timeval t;
+
+  gettimeofday(&t, NULL);
+  times.wall = t.tv_sec + t.tv_usec * 1e-6;
+#else
+  times.wall = (double)clock() / CLOCKS_PER_SEC;
+#endif
+#if defined HAVE_CLOCK_GETTIME && defined CLOCK_THREAD_CPUTIME_ID
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  times.cpu = t.tv_sec + t.tv_nsec * 1e-9;
+#else
+  times.cpu = (double)clock() / CLOCKS_PER_SEC;
+#endif
+  return times;
+}
+
+/* Adds to effp's stats a call of its flow (or drain) that ran from t0 to t1,
+ * followed by rearranging its buffers until now */
+static void add_stats(sox_effect_t * effp, sox_bool drain, times_t t0,
+    times_t t1, size_t isamp, size_t osamp)
+{
+  sox_effect_stats_t * s = &effp->stats;
+  times_t t2 = get_times();
+
+  if (drain)
+    ++s->drains;
+  else ++s->flows;
+  s->samples_in += isamp;
+  s->samples_out += osamp;
+  s->wall_time += t1.wall - t0.wall;
+  s->cpu_time += t1.cpu - t0.cpu;
+  s->interleave_time += t2.wall - t1.wall;
+}
+
+/* With realtime_safe, the allocations that an effect makes in flow and
+ * drain are counted (from its memory counters, which lsx_realloc keeps
+ * whilst it is tagged), to be reported when the chain has run. */
+static void count_rt_allocations(sox_effect_t * effp,
+    sox_uint64_t allocations, sox_uint64_t allocated)
+{
+  sox_effect_t * effp0 = effp - effp->flow;
+
+  if (effp0->mem.allocations != allocations || effp0->mem.allocated != allocated) {
+    sox_uint64_t n = max(effp0->mem.allocations - allocations, 1);
+#ifdef HAVE_OPENMP
+    #pragma omp atomic
+#endif
+    effp0->rt_allocations += n;
+  }
+}
+
+/* Flows a SOX_EFF_OPTIONAL effect that the governor has bypassed: its input
+ * is passed on as it is, without the effect seeing it */
+static int bypass(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  size_t chans = effp->flows > 1? 1 : effp->in_signal.channels, c;
+  size_t planes = effp->planar? chans : 1, n = min(*isamp, *osamp) / chans;
+
+  if (obuf != ibuf) for (c = 0; c < planes; ++c)
+    memcpy(obuf + (planes > 1? c * lsx_oplane_size(effp) : 0),
+        ibuf + (planes > 1? c * lsx_iplane_size(effp) : 0),
+        n * chans / planes * sizeof(*obuf));
+  *isamp = *osamp = n * chans;
+  return SOX_SUCCESS;
+}
+
+static int call_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  sox_mem_stats_t * mem = &effp[-(ptrdiff_t)effp->flow].mem;
+  lsx_mem_tag_t saved = lsx_mem_tag(mem, effp->chain_mem);
+  sox_uint64_t allocations = mem->allocations, allocated = mem->allocated;
+  int ret;
+
+  lsx_trace4(flow__entry, effp->handler.name, effp->flow, *isamp, *osamp);
+  ret = effp->degrade && (effp->handler.flags & SOX_EFF_OPTIONAL)?
+    bypass(effp, ibuf, obuf, isamp, osamp) : effp->use_float?
+    effp->flow_float(effp, (float const *)ibuf, (float *)obuf,
+        isamp, osamp) :
+    effp->handler.flow(effp, ibuf, obuf, isamp, osamp);
+  lsx_trace5(flow__return, effp->handler.name, effp->flow, *isamp, *osamp,
+      ret);
+  if (effp->global_info->global_info->realtime_safe)
+    count_rt_allocations(effp, allocations, allocated);
+  lsx_mem_untag(saved);
+  return ret;
+}
+
+static int call_drain(sox_effect_t * effp, sox_sample_t * obuf,
+    size_t * osamp)
+{
+  sox_mem_stats_t * mem = &effp[-(ptrdiff_t)effp->flow].mem;
+  lsx_mem_tag_t saved = lsx_mem_tag(mem, effp->chain_mem);
+  sox_uint64_t allocations = mem->allocations, allocated = mem->allocated;
+  int ret;
+
+  lsx_trace3(drain__entry, effp->handler.name, effp->flow, *osamp);
+  if (!effp->use_float)
+    ret = effp->handler.drain(effp, obuf, osamp);
+  else if (effp->drain_float)
+    ret = effp->drain_float(effp, (float *)obuf, osamp);
+  else ret = default_drain(effp, obuf, osamp);
+  lsx_trace4(drain__return, effp->handler.name, effp->flow, *osamp, ret);
+  if (effp->global_info->global_info->realtime_safe)
+    count_rt_allocations(effp, allocations, allocated);
+  lsx_mem_untag(saved);
+  return ret;
+}
+
+/* A SOX_EFF_INPLACE effect may be flowed in place: where its output
+ * buffer is empty and its input starts at the beginning of a buffer of the
+ * same size and layout, the effect reads and writes the same samples, so
+ * nothing is copied between buffers (and an analysis-only effect writes
+ * nothing).  The two buffers are then swapped beforehand or, if the output
+ * is to be (de)interleaved anyway, the input buffer serves as il_buf.  Not
+ * when the input buffer is lent by lsx_flow_branch, which takes it back. */
+static sox_bool in_place(sox_effects_chain_t const * chain, size_t n)
+{
+  sox_effect_t const * effp1 = chain->effects[n - 1];
+  sox_effect_t const * effp = chain->effects[n];
+  size_t frame = effp->flows > 1? effp->flows : effp->in_signal.channels;
+
+  return (effp->handler.flags & SOX_EFF_INPLACE) &&
+    !(n == 1 && chain->input_lent) && effp->oend == 0 && effp1->obeg == 0 &&
+    effp1->oend % frame == 0 && effp1->obufsiz == effp->obufsiz &&
+    in_planes(effp) == out_planes(effp);
+}
+
 static int flow_effect(sox_effects_chain_t * chain, size_t n)
 {
+  sox_context_t const * context = chain->global_info.global_info;
   sox_effect_t *effp1 = chain->effects[n - 1];
   sox_effect_t *effp = chain->effects[n];
   int effstatus = SOX_SUCCESS;
   size_t f = 0;
   size_t idone = effp1->oend - effp1->obeg;
-  size_t obeg = sox_globals.bufsiz - effp->oend;
-  sox_bool il_change = (effp->flows == 1) !=
-      (chain->length == n + 1 || chain->effects[n+1]->flows == 1);
+  size_t obeg = effp->obufsiz - effp->oend;
+  size_t planes = out_planes(effp), nplanes = next_planes(chain, n);
+  sox_bool il_change = (planes > 1) != (nplanes > 1);
+  sox_bool inplace = in_place(chain, n);
+  sox_sample_t * ibuf = effp1->obuf;
+  sox_sample_t * il_buf = inplace && il_change? ibuf : chain->il_buf;
+  times_t t0 = {0, 0}, t1 = {0, 0};
 #if DEBUG_EFFECTS_CHAIN
   size_t pre_idone = idone;
   size_t pre_odone = obeg;
 #endif
 
+  if (inplace && !il_change) {
+    effp1->obuf = effp->obuf;
+    effp->obuf = ibuf;
+  }
+  if (timed(context))
+    t0 = get_times();
   if (effp->flows == 1) {     /* Run effect on all channels at once */
+    sox_sample_t *obuf = il_change ? il_buf : effp->obuf;
     idone -= idone % effp->in_signal.channels;
-    effstatus = effp->handler.flow(effp, effp1->obuf + effp1->obeg,
-                    il_change ? chain->il_buf : effp->obuf + effp->oend,
+    effstatus = call_flow(effp,
+                    ibuf + effp1->obeg / in_planes(effp),
+                    obuf + (planes > 1 || !il_change ? effp->oend / planes : 0),
                     &idone, &obeg);
     if (obeg % effp->out_signal.channels != 0) {
       lsx_fail("multi-channel effect flowed asymmetrically!");
       effstatus = SOX_EOF;
     }
-    if (il_change)
-      deinterleave(chain->effects[n+1]->flows, obeg, chain->il_buf,
-          effp->obuf, sox_globals.bufsiz, effp->oend);
+    if (timed(context))
+      t1 = get_times();
+    if (il_change && planes > 1)
+      interleave(planes, obeg, il_buf, effp->obufsiz,
+          effp->oend, effp->obuf + effp->oend);
+    else if (il_change)
+      deinterleave(nplanes, obeg, il_buf,
+          effp->obuf, effp->obufsiz, effp->oend);
   } else {               /* Run effect on each channel individually */
-    sox_sample_t *obuf = il_change ? chain->il_buf : effp->obuf;
-    size_t flow_offs = sox_globals.bufsiz/effp->flows;
+    sox_sample_t *obuf = il_change ? il_buf : effp->obuf;
+    size_t iflow_offs = effp1->obufsiz/effp->flows;
+    size_t flow_offs = effp->obufsiz/effp->flows;
     size_t idone_min = SOX_SIZE_MAX, idone_max = 0;
     size_t odone_min = SOX_SIZE_MAX, odone_max = 0;
+    size_t threads = context->use_threads?
+      lsx_threads_for(context, effp->flows) : 1;
 
 #ifdef HAVE_OPENMP_3_1
     #pragma omp parallel for \
-        if(sox_globals.use_threads) \
+        if(threads > 1) num_threads((int)threads) \
         schedule(static) default(none) \
-        shared(effp,effp1,idone,obeg,obuf,flow_offs,chain,n,effstatus) \
+        shared(effp,effp1,idone,obeg,ibuf,obuf,iflow_offs,flow_offs,chain,n,effstatus) \
         reduction(min:idone_min,odone_min) reduction(max:idone_max,odone_max)
 #elif defined HAVE_OPENMP
     #pragma omp parallel for \
-        if(sox_globals.use_threads) \
+        if(threads > 1) num_threads((int)threads) \
         schedule(static) default(none) \
-        shared(effp,effp1,idone,obeg,obuf,flow_offs,chain,n,effstatus) \
+        shared(effp,effp1,idone,obeg,ibuf,obuf,iflow_offs,flow_offs,chain,n,effstatus) \
         firstprivate(idone_min,odone_min,idone_max,odone_max) \
         lastprivate(idone_min,odone_min,idone_max,odone_max)
 #endif
     for (f = 0; f < effp->flows; ++f) {
       size_t idonec = idone / effp->flows;
       size_t odonec = obeg / effp->flows;
-      int eff_status_c = effp->handler.flow(&chain->effects[n][f],
-          effp1->obuf + f*flow_offs + effp1->obeg/effp->flows,
+      int eff_status_c = call_flow(&chain->effects[n][f],
+          ibuf + f*iflow_offs + effp1->obeg/effp->flows,
           obuf + f*flow_offs + effp->oend/effp->flows,
           &idonec, &odonec);
       idone_min = min(idonec, idone_min); idone_max = max(idonec, idone_max);
@@ -297,6 +584,7 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
       if (eff_status_c != SOX_SUCCESS)
         effstatus = SOX_EOF;
     }
+    lsx_threads_give(context, threads);
 
     if (idone_min != idone_max || odone_min != odone_max) {
       lsx_fail("flowed asymmetrically!");
@@ -304,25 +592,38 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
     }
     idone = effp->flows * idone_max;
     obeg = effp->flows * odone_max;
+    if (timed(context))
+      t1 = get_times();
 
     if (il_change)
-      interleave(effp->flows, obeg, chain->il_buf, sox_globals.bufsiz,
+      interleave(effp->flows, obeg, il_buf, effp->obufsiz,
           effp->oend, effp->obuf + effp->oend);
   }
   effp1->obeg += idone;
   if (effp1->obeg == effp1->oend)
     effp1->obeg = effp1->oend = 0;
+  else if (inplace) {   /* What it left has been overwritten */
+    lsx_fail("in-place effect did not take all of its input");
+    effp1->obeg = effp1->oend = 0;
+    effstatus = SOX_EOF;
+  }
   else if (effp1->oend - effp1->obeg < effp->imin) { /* Need to refill? */
-    size_t flow_offs = sox_globals.bufsiz/effp->flows;
-    for (f = 0; f < effp->flows; ++f)
+    size_t iplanes = in_planes(effp);
+    size_t flow_offs = effp1->obufsiz/iplanes;
+    for (f = 0; f < iplanes; ++f)
       memcpy(effp1->obuf + f * flow_offs,
-          effp1->obuf + f * flow_offs + effp1->obeg/effp->flows,
-          (effp1->oend - effp1->obeg)/effp->flows * sizeof(*effp1->obuf));
+          effp1->obuf + f * flow_offs + effp1->obeg/iplanes,
+          (effp1->oend - effp1->obeg)/iplanes * sizeof(*effp1->obuf));
     effp1->oend -= effp1->obeg;
     effp1->obeg = 0;
   }
 
+  if (effp->use_float != next_float(chain, n))
+    convert_samples(effp->obuf, effp->obufsiz, next_float(chain, n), nplanes, effp->oend, obeg,
+        &effp->clips);
   effp->oend += obeg;
+  if (timed(context))
+    add_stats(effp, sox_false, t0, t1, idone, obeg);
 
 #if DEBUG_EFFECTS_CHAIN
   lsx_report("\t" "flow:  %2" PRIuPTR " (%1" PRIuPTR ")  "
@@ -335,38 +636,48 @@ static int flow_effect(sox_effects_chain_t * chain, size_t n)
   return effstatus == SOX_SUCCESS? SOX_SUCCESS : SOX_EOF;
 }
 
-/* The same as flow_effect but with no input */
-static int drain_effect(sox_effects_chain_t * chain, size_t n)
+/* The same as flow_effect but with no input; gives at most max_len samples */
+static int drain_effect(sox_effects_chain_t * chain, size_t n, size_t max_len)
 {
+  sox_context_t const * context = chain->global_info.global_info;
   sox_effect_t *effp = chain->effects[n];
   int effstatus = SOX_SUCCESS;
   size_t f = 0;
-  size_t obeg = sox_globals.bufsiz - effp->oend;
-  sox_bool il_change = (effp->flows == 1) !=
-      (chain->length == n + 1 || chain->effects[n+1]->flows == 1);
+  size_t obeg = min(effp->obufsiz - effp->oend, max_len);
+  size_t planes = out_planes(effp), nplanes = next_planes(chain, n);
+  sox_bool il_change = (planes > 1) != (nplanes > 1);
+  times_t t0 = {0, 0}, t1 = {0, 0};
 #if DEBUG_EFFECTS_CHAIN
   size_t pre_odone = obeg;
 #endif
 
+  if (timed(context))
+    t0 = get_times();
   if (effp->flows == 1) { /* Run effect on all channels at once */
-    effstatus = effp->handler.drain(effp,
-                    il_change ? chain->il_buf : effp->obuf + effp->oend,
+    sox_sample_t *obuf = il_change ? chain->il_buf : effp->obuf;
+    effstatus = call_drain(effp,
+                    obuf + (planes > 1 || !il_change ? effp->oend / planes : 0),
                     &obeg);
     if (obeg % effp->out_signal.channels != 0) {
       lsx_fail("multi-channel effect drained asymmetrically!");
       effstatus = SOX_EOF;
     }
-    if (il_change)
-      deinterleave(chain->effects[n+1]->flows, obeg, chain->il_buf,
-          effp->obuf, sox_globals.bufsiz, effp->oend);
+    if (timed(context))
+      t1 = get_times();
+    if (il_change && planes > 1)
+      interleave(planes, obeg, chain->il_buf, effp->obufsiz,
+          effp->oend, effp->obuf + effp->oend);
+    else if (il_change)
+      deinterleave(nplanes, obeg, chain->il_buf,
+          effp->obuf, effp->obufsiz, effp->oend);
   } else {                       /* Run effect on each channel individually */
     sox_sample_t *obuf = il_change ? chain->il_buf : effp->obuf;
-    size_t flow_offs = sox_globals.bufsiz/effp->flows;
+    size_t flow_offs = effp->obufsiz/effp->flows;
     size_t odone_last = 0; /* Initialised to prevent warning */
 
     for (f = 0; f < effp->flows; ++f) {
       size_t odonec = obeg / effp->flows;
-      int eff_status_c = effp->handler.drain(&chain->effects[n][f],
+      int eff_status_c = call_drain(&chain->effects[n][f],
           obuf + f*flow_offs + effp->oend/effp->flows,
           &odonec);
       if (f && (odonec != odone_last)) {
@@ -380,15 +691,22 @@ static int drain_effect(sox_effects_chain_t * chain, size_t n)
     }
 
     obeg = effp->flows * odone_last;
+    if (timed(context))
+      t1 = get_times();
 
     if (il_change)
-      interleave(effp->flows, obeg, chain->il_buf, sox_globals.bufsiz,
+      interleave(effp->flows, obeg, chain->il_buf, effp->obufsiz,
           effp->oend, effp->obuf + effp->oend);
   }
   if (!obeg)   /* This is the only thing that drain has and flow hasn't */
     effstatus = SOX_EOF;
 
+  if (effp->use_float != next_float(chain, n))
+    convert_samples(effp->obuf, effp->obufsiz, next_float(chain, n), nplanes, effp->oend, obeg,
+        &effp->clips);
   effp->oend += obeg;
+  if (timed(context))
+    add_stats(effp, sox_true, t0, t1, (size_t)0, obeg);
 
 #if DEBUG_EFFECTS_CHAIN
   lsx_report("\t" "drain: %2" PRIuPTR " (%1" PRIuPTR ")  "
@@ -399,62 +717,514 @@ static int drain_effect(sox_effects_chain_t * chain, size_t n)
   return effstatus == SOX_SUCCESS? SOX_SUCCESS : SOX_EOF;
 }
 
-/* Flow data through the effects chain until an effect or callback gives EOF */
-int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_done, void * client_data), void * client_data)
+/* With use_threads, a run of consecutive per-channel effects (all with the
+ * same number of flows, and taking the same type of sample) is flowed by
+ * flow_run() in a single parallel region, rather than the threads being
+ * forked and joined for each call of each effect: each thread takes whole
+ * channels, and moves their samples as far through the run as they will go.
+ * Every channel flows the same way, so all finish with the same buffer
+ * positions, which are then those of the chain. */
+typedef struct {size_t obeg, oend;} run_pos_t;
+
+/* Returns the last effect of the run that starts at effects[n], or 0 if
+ * effects[n] is to be flowed alone by flow_effect */
+static size_t run_end(sox_effects_chain_t const * chain, size_t n)
 {
-  int flow_status = SOX_SUCCESS;
-  size_t e, source_e = 0;               /* effect indices */
-  size_t max_flows = 0;
-  sox_bool draining = sox_true;
+#ifdef HAVE_OPENMP
+  sox_effect_t const * effp = chain->effects[n];
+  size_t e = n;
+
+  if (!chain->global_info.global_info->use_threads || effp->flows < 2)
+    return 0;
+  while (e + 1 < chain->length && chain->effects[e + 1]->flows == effp->flows
+      && chain->effects[e + 1]->use_float == effp->use_float)
+    ++e;
+  return e;
+#else
+  (void)chain, (void)n;
+  return 0;
+#endif
+}
+
+/* Moves channel f's samples through effects[a..b]; pos[0..b-a+1] are the
+ * positions (as in sox_effect_t) of the output of effects[a-1..b].  Returns
+ * the index of an effect that gave SOX_EOF from its flow, or 0 */
+static size_t pump_channel(sox_effects_chain_t * chain, size_t a, size_t b,
+    size_t f, run_pos_t * pos, sox_bool il_change)
+{
+  sox_context_t const * context = chain->global_info.global_info;
+  size_t flows = chain->effects[a]->flows;
+  sox_bool moved = sox_true;
+  size_t e;
+
+  while (moved) for (moved = sox_false, e = a; e <= b; ++e) {
+    sox_effect_t * effp1 = chain->effects[e - 1], * effp = chain->effects[e];
+    run_pos_t * in = &pos[e - a], * out = &pos[e - a + 1];
+    sox_sample_t * obuf = e == b && il_change? chain->il_buf : effp->obuf;
+    size_t iflow_offs = effp1->obufsiz / flows, flow_offs = effp->obufsiz / flows;
+    size_t held;
+
+    while ((held = in->oend - in->obeg) != 0 && held >= effp->imin) {
+      size_t idone = held / flows, odone = (effp->obufsiz - out->oend) / flows;
+      times_t t0 = {0, 0};
+      int status;
+
+      if (timed(context) && !f)
+        t0 = get_times();
+      status = call_flow(&chain->effects[e][f],
+          effp1->obuf + f * iflow_offs + in->obeg / flows,
+          obuf + f * flow_offs + out->oend / flows, &idone, &odone);
+      if (timed(context) && !f)
+        add_stats(effp, sox_false, t0, get_times(), idone * flows, odone * flows);
+      in->obeg += idone * flows;
+      out->oend += odone * flows;
+      if (in->obeg == in->oend)
+        in->obeg = in->oend = 0;
+      else if (in->oend - in->obeg < effp->imin) { /* Need to refill? */
+        sox_sample_t * p = effp1->obuf + f * iflow_offs;
+        memmove(p, p + in->obeg / flows,
+            (in->oend - in->obeg) / flows * sizeof(*p));
+        in->oend -= in->obeg;
+        in->obeg = 0;
+      }
+      if (status != SOX_SUCCESS)
+        return e;
+      if (!idone && !odone)
+        break;   /* Its output is full, or it wants more input */
+      moved = sox_true;
+    }
+  }
+  return 0;
+}
+
+/* Flows the run effects[a..b] (see run_end); returns the index of an
+ * effect that gave SOX_EOF, or 0 */
+static size_t flow_run(sox_effects_chain_t * chain, size_t a, size_t b)
+{
+  sox_context_t const * context = chain->global_info.global_info;
+  sox_effect_t * effp = chain->effects[b];
+  size_t flows = effp->flows, len = b - a + 2, oend = effp->oend, f, e, k;
+  size_t nplanes = next_planes(chain, b);
+  sox_bool il_change = nplanes == 1;
+  run_pos_t * pos = lsx_malloc(flows * len * sizeof(*pos));
+  size_t * stopped = lsx_malloc(flows * sizeof(*stopped));
+  size_t threads = lsx_threads_for(context, flows);
+  times_t t1 = {0, 0};
+
+  for (f = 0; f < flows; ++f) for (e = 0; e < len; ++e) {
+    pos[f * len + e].obeg = chain->effects[a - 1 + e]->obeg;
+    pos[f * len + e].oend = chain->effects[a - 1 + e]->oend;
+  }
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) \
+      schedule(static) default(none) \
+      shared(chain, a, b, flows, len, pos, stopped, il_change)
+  for (f = 0; f < flows; ++f)
+    stopped[f] = pump_channel(chain, a, b, f, pos + f * len, il_change);
+  lsx_threads_give(context, threads);
+
+  k = stopped[0];
+  for (f = 1; f < flows; ++f)
+    if (stopped[f] != stopped[0] ||
+        memcmp(pos + f * len, pos, len * sizeof(*pos))) {
+      lsx_fail("flowed asymmetrically!");
+      k = b;
+      break;
+    }
+  for (e = 0; e < len; ++e) {
+    chain->effects[a - 1 + e]->obeg = pos[e].obeg;
+    chain->effects[a - 1 + e]->oend = pos[e].oend;
+  }
+  lsx_free(stopped);
+  lsx_free(pos);
+
+  /* As flow_effect, lay out and convert the run's output for the next */
+  if (timed(context))
+    t1 = get_times();
+  if (il_change)
+    interleave(flows, effp->oend - oend, chain->il_buf, effp->obufsiz,
+        oend, effp->obuf + oend);
+  if (effp->use_float != next_float(chain, b))
+    convert_samples(effp->obuf, effp->obufsiz, next_float(chain, b),
+        nplanes, oend, effp->oend - oend, &effp->clips);
+  if (timed(context))
+    effp->stats.interleave_time += get_times().wall - t1.wall;
+  return k;
+}
+
+#ifdef HAVE_OPENMP
+/* Pipelined operation (chain_mode == SOX_CHAIN_PIPELINED):
+ * each effect runs on a thread of its own, so that the throughput of the
+ * chain approaches that of its slowest effect rather than the sum of the
+ * costs of all of them.  Adjacent effects are joined by a lock-free ring
+ * buffer (ringbuf.h) through which interleaved samples are handed on.  Each thread drives its
+ * effect with flow_effect() and drain_effect(), as above, but through a
+ * private `view' of the chain in which the neighbouring effects are
+ * replaced by proxies: one whose obuf is the effect's input window, and one
+ * that asks for interleaved output.
+ */
+#define LINK_BUFS 4 /* Capacity of a link, in units of the producer's obufsiz */
+
+typedef struct {
+  ringbuf_t    ring;     /* Samples in transit */
+  size_t       eof;      /* Producer has finished */
+  size_t       closed;   /* Consumer has finished */
+} chain_link_t;
+
+typedef struct {
+  sox_effects_chain_t * chain;
+  chain_link_t * links;  /* links[n] joins effects[n] to effects[n + 1] */
+  sox_flow_effects_callback callback;
+  void         * client_data;
+  int          status;
+  size_t       abort;
+  size_t       finished; /* Number of stages that have finished */
+  size_t       io_stop;  /* All have, so lsx_io_async_serve may stop */
+  omp_lock_t   lock;
+} pipeline_t;
+
+static sox_bool pipeline_aborted(pipeline_t * p)
+{
+  return ringbuf_load(&p->abort) != 0;
+}
+
+static void pipeline_fail(pipeline_t * p, sox_bool abort)
+{
+  omp_set_lock(&p->lock);
+  p->status = SOX_EOF;
+  omp_unset_lock(&p->lock);
+  if (abort)
+    ringbuf_store(&p->abort, (size_t)1);
+}
+
+/* Hand on as much of the effect's output as the link will take; returns
+ * sox_false if the consumer has finished */
+static sox_bool link_put(chain_link_t * l, sox_effect_t * effp)
+{
+  if (ringbuf_load(&l->closed))
+    return sox_false;
+  effp->obeg += ringbuf_write(&l->ring, effp->oend - effp->obeg,
+      effp->obuf + effp->obeg);
+  if (effp->obeg == effp->oend)
+    effp->obeg = effp->oend = 0;
+  return sox_true;
+}
+
+/* Move whole wide samples from the link into the effect's input window,
+ * laid out as the effect expects; scratch must hold window->obufsiz
+ * samples.  Returns sox_false once the producer has finished and nothing
+ * remains */
+static sox_bool link_get(chain_link_t * l, sox_effect_t * window,
+    sox_effect_t const * effp, sox_sample_t * scratch)
+{
+  size_t chans = effp->in_signal.channels, planes = in_planes(effp);
+  size_t bufsiz = window->obufsiz;
+  size_t space = bufsiz / planes * planes - window->oend;
+  sox_bool eof = ringbuf_load(&l->eof) != 0; /* Before looking at the ring */
+  size_t occupancy = ringbuf_occupancy(&l->ring);
+  size_t n = min(space, occupancy);
+
+  n -= n % chans;
+  if (n) {
+    if (planes == 1)
+      ringbuf_read(&l->ring, n, window->obuf + window->oend);
+    else {
+      ringbuf_read(&l->ring, n, scratch);
+      deinterleave(planes, n, scratch, window->obuf, bufsiz,
+          window->oend);
+    }
+    window->oend += n;
+  }
+  return !eof || ringbuf_occupancy(&l->ring) >= chans;
+}
+
+static void link_finish(chain_link_t * l, sox_bool consumer)
+{
+  ringbuf_store(consumer? &l->closed : &l->eof, (size_t)1);
+}
+
+static void run_stage(pipeline_t * p, size_t n)
+{
+  sox_effects_chain_t * chain = p->chain;
+  sox_effect_t * effp = chain->effects[n];
+  chain_link_t * in = n? &p->links[n - 1] : NULL;
+  chain_link_t * out = n + 1 < chain->length? &p->links[n] : NULL;
+  sox_effect_t window, next, * effects[3];
+  sox_effects_chain_t view = *chain;
+  size_t e;
+  sox_bool draining = !in, done = sox_false;
+  unsigned waits = 0;
+  lsx_mem_tag_t saved = lsx_mem_tag(NULL, &chain->mem);
+
+  memset(&window, 0, sizeof(window));
+  memset(&next, 0, sizeof(next));
+  view.effects = effects;
+  view.length = 0;
+  if (in) {
+    window.obufsiz = chain->effects[n - 1]->obufsiz;
+    window.obuf = lsx_malloc(window.obufsiz * sizeof(*window.obuf));
+    effects[view.length++] = &window;
+  }
+  effects[e = view.length++] = effp;
+  if (out) {
+    next.flows = 1;
+    next.use_float = next_float(chain, n); /* Links carry the type taken */
+    effects[view.length++] = &next;
+  }
+  /* il_buf also serves as link_get's scratch */
+  view.il_buf = in_planes(effp) > 1 || out_planes(effp) > 1?
+    lsx_malloc(max(window.obufsiz, effp->obufsiz) * sizeof(*view.il_buf)) : NULL;
+  if (next.use_float)       /* Samples left over from a previous run */
+    convert_samples(effp->obuf, effp->obufsiz, sox_true, (size_t)1, effp->obeg,
+        effp->oend - effp->obeg, NULL);
+
+  while (!pipeline_aborted(p)) {
+    size_t ibeg = window.obeg, iend = window.oend, oend = effp->oend;
+
+    if (out && effp->oend > effp->obeg) {
+      if (!link_put(out, effp))
+        break;                      /* Consumer has finished */
+      if (effp->oend > effp->obeg) {
+        lsx_thread_wait(&waits);
+        continue;
+      }
+    }
+    if (done)
+      break;
+    if (!draining && !link_get(in, &window, effp, view.il_buf) &&
+        window.oend - window.obeg < max(effp->imin, 1))
+      draining = sox_true;          /* Producer has finished */
+    if (!draining && window.oend - window.obeg < max(effp->imin, 1)) {
+      lsx_thread_wait(&waits);
+      continue;
+    }
+
+    if (draining)
+      done = drain_effect(&view, e, SOX_SIZE_MAX) == SOX_EOF;
+    else if (flow_effect(&view, e) != SOX_SUCCESS) {
+      pipeline_fail(p, !out);
+      if (!out)
+        break;
+      link_finish(in, sox_true);
+      draining = sox_true;
+    }
+    else if (window.obeg == ibeg && window.oend == iend && effp->oend == oend)
+      lsx_thread_wait(&waits);           /* No progress */
+    else waits = 0;
+
+    if (!out && p->callback &&
+        p->callback(done, p->client_data) != SOX_SUCCESS) {
+      pipeline_fail(p, sox_true);   /* Client has requested to stop the flow. */
+      break;
+    }
+  }
+
+  if (out)
+    link_finish(out, sox_false);
+  if (in)
+    link_finish(in, sox_true);
+  if (next.use_float)
+    convert_samples(effp->obuf, effp->obufsiz, sox_false, (size_t)1, effp->obeg,
+        effp->oend - effp->obeg, &effp->clips);
+  lsx_free(view.il_buf);
+  lsx_free(window.obuf);
+  lsx_mem_untag(saved);
+}
+
+/* Returns sox_false if the threads needed could not be had */
+static sox_bool flow_effects_pipelined(sox_effects_chain_t * chain,
+    sox_flow_effects_callback callback, void * client_data, int * status)
+{
+  sox_context_t const * context = chain->global_info.global_info;
+  pipeline_t p;
+  size_t n, io = lsx_io_async_pending(); /* Has a thread of its own */
+  size_t threads = lsx_threads_take(context, chain->length + io);
+  sox_bool started = sox_false;
+
+  if (threads < chain->length + io) {
+    lsx_threads_give(context, threads);
+    return sox_false;
+  }
+  p.chain = chain;
+  p.callback = callback;
+  p.client_data = client_data;
+  p.status = SOX_SUCCESS;
+  p.abort = p.finished = p.io_stop = 0;
+  omp_init_lock(&p.lock);
+  lsx_valloc(p.links, chain->length - 1);
+  for (n = 0; n + 1 < chain->length; ++n) {
+    chain_link_t * l = &p.links[n];
+    ringbuf_create(&l->ring, sizeof(sox_sample_t),
+        LINK_BUFS * chain->effects[n]->obufsiz);
+    l->eof = l->closed = 0;
+  }
+
+  if (io)
+    lsx_io_async_start();
+  #pragma omp parallel num_threads((int)(chain->length + io)) \
+      default(none) shared(p, chain, started, io)
+  if ((size_t)omp_get_num_threads() == chain->length + io) {
+    size_t t = (size_t)omp_get_thread_num();
+
+    started = sox_true;
+    if (t == chain->length)
+      lsx_io_async_serve(&p.io_stop);
+    else {
+      run_stage(&p, t);
+      omp_set_lock(&p.lock);
+      if (++p.finished == chain->length)
+        ringbuf_store(&p.io_stop, (size_t)1);
+      omp_unset_lock(&p.lock);
+    }
+  }
+  if (io)
+    lsx_io_async_stop();
+
+  for (n = 0; n + 1 < chain->length; ++n)
+    ringbuf_delete(&p.links[n].ring);
+  lsx_free(p.links);
+  omp_destroy_lock(&p.lock);
+  lsx_threads_give(context, threads);
+  *status = p.status;
+  return started;
+}
+#endif
+
+/* Choose the layout of each SOX_EFF_PLANAR effect's buffers: uninterleaved
+ * if that is what the previous effect gives or the next one takes, so that
+ * a run of such effects needs at most one conversion.  The first effect (a
+ * client's input, e.g. from sox_read_planar) is uninterleaved too where the
+ * next one can take it so; the last (an output, e.g. to sox_write_planar)
+ * where the previous one gives it so. */
+static void set_planar(sox_effects_chain_t * chain)
+{
+  size_t e;
+
+  for (e = 0; e < chain->length; ++e) {
+    sox_effect_t * effp = chain->effects[e];
+    sox_effect_t const * next = e + 1 < chain->length? chain->effects[e + 1] : NULL;
+    effp->planar = effp->flows == 1 && chain->length > 1 &&
+      (effp->handler.flags & SOX_EFF_PLANAR) &&
+      ((e > 0 && out_planes(chain->effects[e - 1]) > 1) ||
+       (next && (next->flows > 1 ||
+         (e == 0 && (next->handler.flags & SOX_EFF_PLANAR)))));
+  }
+}
+
+/* Choose which effects exchange float samples */
+static void set_float(sox_effects_chain_t * chain)
+{
+  size_t e, f;
 
   for (e = 0; e < chain->length; ++e) {
+    sox_effect_t * effp = chain->effects[e];
+    sox_bool use_float = chain->global_info.global_info->float_chain && e > 0 &&
+      e + 1 < chain->length && effp->flow_float &&
+      (effp->drain_float || effp->handler.drain == default_drain);
+    for (f = 0; f < effp->flows; ++f)
+      chain->effects[e][f].use_float = use_float;
+  }
+}
+
+/* The interleave buffer must hold the largest of the effects' obufs */
+static sox_sample_t * new_il_buf(sox_effects_chain_t const * chain,
+    size_t max_planes)
+{
+  size_t e, size = 0;
+
+  if (max_planes < 2)
+    return NULL;
+  for (e = 0; e < chain->length; ++e)
+    size = max(size, chain->effects[e]->obufsiz);
+  return lsx_malloc(size * sizeof(sox_sample_t));
+}
+
+/* Allocates the interleave buffer if it might be needed and, if there are
+ * samples in an effect's output buffer, deinterleaves them (if the next
+ * effect is to take them so) and converts them to float (likewise). */
+static void unpack_buffers(sox_effects_chain_t * chain, size_t max_planes)
+{
+  size_t e;
+
+  chain->il_buf = new_il_buf(chain, max_planes);
+  for (e = 0; e + 1 < chain->length; e++) {
     sox_effect_t *effp = chain->effects[e];
-    effp->obuf =
-        lsx_realloc(effp->obuf, sox_globals.bufsiz * sizeof(*effp->obuf));
-      /* Memory will be freed by sox_delete_effect() later. */
-      /* Possibly there was already a buffer, if this is a used effect;
-         it may still contain samples in that case. */
-      if (effp->oend > sox_globals.bufsiz) {
-        lsx_warn("buffer size insufficient; buffered samples were dropped");
-        /* can only happen if bufsize has been reduced since the last run */
-        effp->obeg = effp->oend = 0;
-      }
-    max_flows = max(max_flows, effp->flows);
+    size_t n = effp->oend - effp->obeg;
+    if (n && next_planes(chain, e) > 1) {
+      memcpy(chain->il_buf, effp->obuf + effp->obeg, n * sizeof(*effp->obuf));
+      deinterleave(next_planes(chain, e), n, chain->il_buf, effp->obuf,
+          effp->obufsiz, effp->obeg);
+    }
+    if (n && next_float(chain, e))
+      convert_samples(effp->obuf, effp->obufsiz, sox_true, next_planes(chain, e),
+          effp->obeg, n, NULL);
   }
-  if (max_flows > 1) /* might need interleave buffer */
-    chain->il_buf = lsx_malloc(sox_globals.bufsiz * sizeof(sox_sample_t));
-  else
-    chain->il_buf = NULL;
+}
 
-  /* Go through the effects, and if there are samples in one of the
-     buffers, deinterleave it (if necessary).  */
+/* Undoes unpack_buffers */
+static void repack_buffers(sox_effects_chain_t * chain)
+{
+  size_t e;
+
+  /* If an effect's output buffer still has samples, and if it is
+     uninterleaved, then re-interleave it. Necessary since it might
+     be reused, and at that time possibly followed by an MCHAN effect.
+     Likewise, float samples are converted back to sox_sample_t. */
   for (e = 0; e + 1 < chain->length; e++) {
     sox_effect_t *effp = chain->effects[e];
-    if (effp->oend > effp->obeg && chain->effects[e+1]->flows > 1) {
-      sox_sample_t *sw = chain->il_buf; chain->il_buf = effp->obuf; effp->obuf = sw;
-      deinterleave(chain->effects[e+1]->flows, effp->oend - effp->obeg,
-          chain->il_buf, effp->obuf, sox_globals.bufsiz, effp->obeg);
+    size_t n = effp->oend - effp->obeg;
+    if (n && next_float(chain, e))
+      convert_samples(effp->obuf, effp->obufsiz, sox_false, next_planes(chain, e),
+          effp->obeg, n, &effp->clips);
+    if (n && next_planes(chain, e) > 1) {
+      memcpy(chain->il_buf, effp->obuf, effp->obufsiz * sizeof(*effp->obuf));
+      interleave(next_planes(chain, e), n, chain->il_buf, effp->obufsiz,
+          effp->obeg, effp->obuf + effp->obeg);
     }
   }
 
+  lsx_free(chain->il_buf);
+}
+
+static int flow_effects_serial(sox_effects_chain_t * chain,
+    sox_flow_effects_callback callback, void * client_data, size_t max_planes)
+{
+  int flow_status = SOX_SUCCESS;
+  size_t e, source_e = 0;               /* effect indices */
+  sox_bool draining = sox_true;
+
+  unpack_buffers(chain, max_planes);
+
   e = chain->length - 1;
   while (source_e < chain->length) {
 #define have_imin (e > 0 && e < chain->length && chain->effects[e - 1]->oend - chain->effects[e - 1]->obeg >= chain->effects[e]->imin)
-    size_t osize = chain->effects[e]->oend - chain->effects[e]->obeg;
-    if (e == source_e && (draining || !have_imin)) {
-      if (drain_effect(chain, e) == SOX_EOF) {
+    sox_bool drain = e == source_e && (draining || !have_imin);
+    size_t run = drain || e >= chain->length? 0 : run_end(chain, e);
+    size_t last = run? run : e, k;
+    size_t osize = last < chain->length?
+      chain->effects[last]->oend - chain->effects[last]->obeg : 0;
+    size_t isize = e > 0 && e < chain->length?
+      chain->effects[e - 1]->oend - chain->effects[e - 1]->obeg : 0;
+
+    if (drain) {
+      if (drain_effect(chain, e, SOX_SIZE_MAX) == SOX_EOF) {
         ++source_e;
         draining = sox_false;
       }
-    } else if (have_imin && flow_effect(chain, e) == SOX_EOF) {
+    } else if (have_imin && (k = run? flow_run(chain, e, last) :
+          flow_effect(chain, e) == SOX_EOF? e : 0) != 0) {
       flow_status = SOX_EOF;
-      if (e == chain->length - 1)
+      if (k == chain->length - 1)
         break;
-      source_e = e;
+      if (k != last)     /* Stopped within a run: move on what it has */
+        osize = 0;
+      source_e = e = last = k;
       draining = sox_true;
     }
-    if (e < chain->length && chain->effects[e]->oend - chain->effects[e]->obeg > osize) /* False for output */
-      ++e;
+    if (last < chain->length && chain->effects[last]->oend - chain->effects[last]->obeg > osize) /* False for output */
+      e = last + 1;
+    else if (!drain && have_imin && chain->effects[e - 1]->oend - chain->effects[e - 1]->obeg < isize)
+      ; /* Took part of its input, but gave nothing yet (e.g. as its FIFOs
+         * allow: see sox_globals_t.fifo_max): run it again on the rest */
     else if (e == source_e)
       draining = sox_true;
     else if (e < source_e)
@@ -468,22 +1238,513 @@ int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_
     }
   }
 
-  /* If an effect's output buffer still has samples, and if it is
-     uninterleaved, then re-interleave it. Necessary since it might
-     be reused, and at that time possibly followed by an MCHAN effect. */
-  for (e = 0; e + 1 < chain->length; e++) {
-    sox_effect_t *effp = chain->effects[e];
-    if (effp->oend > effp->obeg && chain->effects[e+1]->flows > 1) {
-      sox_sample_t *sw = chain->il_buf; chain->il_buf = effp->obuf; effp->obuf = sw;
-      interleave(chain->effects[e+1]->flows, effp->oend - effp->obeg,
-          chain->il_buf, sox_globals.bufsiz, effp->obeg, effp->obuf);
+  repack_buffers(chain);
+  return flow_status;
+}
+
+/* Realtime operation (chain_mode == SOX_CHAIN_REALTIME): on
+ * each tick, the first effect (e.g. the input) gives a block of at most
+ * realtime_block frames, which is then pushed through the chain as far as
+ * it will go (as for a branch), rather than each buffer being filled before
+ * its samples move on.  So the chain's latency is bounded by a block plus
+ * its effects' own delays (see sox_effects_chain_latency). */
+static size_t realtime_block_len(sox_effects_chain_t const * chain)
+{
+  sox_context_t const * context = chain->global_info.global_info;
+  size_t chans = chain->effects[0]->out_signal.channels, len =
+    context->realtime_block? context->realtime_block :
+    context->device_period? context->device_period : 256;
+
+  len = min(len, (chain->effects[0]->obufsiz? chain->effects[0]->obufsiz :
+        context->bufsiz) / chans);
+  return max(len, 1) * chans;
+}
+
+/* The governor (see sox_context_t.governor): over each window of 50ms of
+ * the audio, it compares the time that the effects between the source and
+ * the sink took (from their stats) with the audio's duration.  Above the
+ * limit, it lowers the chain's quality by a level; below half of it for 5
+ * seconds, it raises it by one.  Level 1 bypasses the SOX_EFF_OPTIONAL
+ * effects, if there are any; each level above that takes another of its
+ * degrade_steps from each effect that has them.  After a change, a window
+ * is let pass unjudged, as an effect may run both ways for a while. */
+#define GOVERNOR_WINDOW .05
+#define GOVERNOR_CALM   5.
+
+typedef struct {
+  unsigned level, levels;
+  sox_bool optional;       /* Whether level 1 is of the SOX_EFF_OPTIONAL */
+  double   busy, audio;    /* Seconds, at the start of the window */
+  double   calm;           /* Seconds of audio under half of the limit */
+  sox_bool hold;           /* Let the window pass unjudged */
+} governor_t;
+
+static void governor_init(sox_effects_chain_t * chain, governor_t * g)
+{
+  size_t e;
+
+  memset(g, 0, sizeof(*g));
+  for (e = 1; e + 1 < chain->length; ++e) {
+    sox_effect_t const * effp = chain->effects[e];
+    if (effp->handler.flags & SOX_EFF_OPTIONAL)
+      g->optional = sox_true;
+    else g->levels = max(g->levels, effp->degrade_steps);
+  }
+  g->levels += g->optional;
+  lsx_debug_more("governor: %u levels", g->levels);
+}
+
+static void governor_set(sox_effects_chain_t * chain, governor_t * g,
+    unsigned level, double load)
+{
+  size_t e, f;
+
+  for (e = 1; e + 1 < chain->length; ++e) {
+    sox_effect_t * effp = chain->effects[e];
+    unsigned degrade = effp->handler.flags & SOX_EFF_OPTIONAL? level != 0 :
+      min(effp->degrade_steps, level - min(level, (unsigned)g->optional));
+    if (degrade == effp->degrade)
+      continue;
+    if (degrade > effp->degrade)
+      ++effp->stats.degradations;
+    lsx_report("governor: %s (load %.0f%%)", effp->handler.flags &
+        SOX_EFF_OPTIONAL? degrade? "bypassed" : "restored" :
+        degrade > effp->degrade? "quality lowered" : "quality raised", load * 100);
+    for (f = 0; f < effp->flows; ++f)
+      effp[f].degrade = degrade;
+  }
+  g->level = level;
+  g->calm = 0;
+  g->hold = sox_true;
+}
+
+static void govern(sox_effects_chain_t * chain, governor_t * g)
+{
+  double limit = chain->global_info.global_info->governor;
+  sox_effect_t const * source = chain->effects[0];
+  double busy = 0, audio = source->stats.samples_out /
+    (source->out_signal.rate * source->out_signal.channels), load;
+  size_t e;
+
+  if (!g->levels || audio - g->audio < GOVERNOR_WINDOW)
+    return;
+  for (e = 1; e + 1 < chain->length; ++e)
+    busy += chain->effects[e]->stats.wall_time +
+      chain->effects[e]->stats.interleave_time;
+  load = (busy - g->busy) / (audio - g->audio);
+  if (g->hold)
+    g->hold = sox_false;
+  else if (load > limit && g->level < g->levels)
+    governor_set(chain, g, g->level + 1, load);
+  else if (load > limit * .5 || !g->level)
+    g->calm = 0;
+  else if ((g->calm += audio - g->audio) >= GOVERNOR_CALM)
+    governor_set(chain, g, g->level - 1, load);
+  g->busy = busy, g->audio = audio;
+}
+
+static size_t pump_effects(sox_effects_chain_t * chain, size_t from);
+static int drain_effects(sox_effects_chain_t * chain, size_t e);
+
+static int flow_effects_realtime(sox_effects_chain_t * chain,
+    sox_flow_effects_callback callback, void * client_data, size_t max_planes)
+{
+  sox_context_t const * context = chain->global_info.global_info;
+  int flow_status = SOX_SUCCESS;
+  size_t block = realtime_block_len(chain), k;
+  lsx_realtime_t saved;
+  governor_t governor;
+
+  unpack_buffers(chain, max_planes);
+  if (context->governor)
+    governor_init(chain, &governor);
+  if (context->realtime_safe) {
+    for (k = 0; k < chain->length; ++k) {  /* Bar the source and sink: */
+      sox_effect_t * effp = chain->effects[k];
+      effp->rt_allocations = 0;
+      if (k && k + 1 < chain->length && !(effp->handler.flags & SOX_EFF_RTSAFE))
+        lsx_warn("not known to be realtime-safe");
     }
+    saved = lsx_realtime_enter();
   }
+  for (;;) {
+    sox_bool exhausted = drain_effect(chain, (size_t)0, block) != SOX_SUCCESS;
 
-  free(chain->il_buf);
+    if ((k = pump_effects(chain, (size_t)0)) != 0) {
+      flow_status = SOX_EOF;
+      if (k + 1 < chain->length)
+        drain_effects(chain, k);
+      break;
+    }
+    if (exhausted) {
+      if (drain_effects(chain, (size_t)1) != SOX_SUCCESS)
+        flow_status = SOX_EOF;
+      if (callback && callback(sox_true, client_data) != SOX_SUCCESS)
+        flow_status = SOX_EOF;
+      break;
+    }
+    if (callback && callback(sox_false, client_data) != SOX_SUCCESS) {
+      flow_status = SOX_EOF; /* Client has requested to stop the flow. */
+      break;
+    }
+    if (context->governor)
+      govern(chain, &governor);
+  }
+  if (context->realtime_safe) {
+    lsx_realtime_leave(saved);
+    for (k = 0; k < chain->length; ++k) {
+      sox_effect_t * effp = chain->effects[k];
+      if (effp->rt_allocations)
+        lsx_warn("allocated memory %" PRIu64 " time(s) whilst running",
+            effp->rt_allocations);
+    }
+  }
+  repack_buffers(chain);
   return flow_status;
 }
 
+/* Runs the chain on the calling thread */
+static int flow_effects_inline(sox_effects_chain_t * chain,
+    sox_flow_effects_callback callback, void * client_data, size_t max_planes)
+{
+  return chain->global_info.global_info->chain_mode == SOX_CHAIN_REALTIME?
+    flow_effects_realtime(chain, callback, client_data, max_planes) :
+    flow_effects_serial(chain, callback, client_data, max_planes);
+}
+
+#ifdef HAVE_OPENMP
+/* As flow_effects_inline, with helpers on threads alongside: one for each of
+ * the chain's asynchronous branches (see branch.c), one for each input file
+ * decoding ahead (see decode_ahead.c), one for the lv2 effects' workers if
+ * there are any (see lv2.c), and lsx_io_async_serve if any file does
+ * asynchronous I/O.  The decoders and workers stop once the chain and
+ * branches have finished, and the I/O once they have too, since the branches
+ * may write to, and the decoders read from, such files. */
+static int flow_effects_helped(sox_effects_chain_t * chain,
+    sox_flow_effects_callback callback, void * client_data, size_t max_planes)
+{
+  sox_context_t const * context = chain->global_info.global_info;
+  int status = SOX_SUCCESS;
+  size_t io = lsx_io_async_pending(), branches = lsx_start_async_branches(chain);
+  size_t decoders = lsx_decode_ahead_start(), workers = lsx_lv2_work_pending();
+  size_t threads = 1 + branches + decoders + workers + io, finished = 0;
+  size_t granted = lsx_threads_take(context, threads);
+  size_t stop = 0, io_stop = 0;
+  sox_bool started = sox_false;
+
+  if (io)
+    lsx_io_async_start();
+  #pragma omp parallel if(granted == threads) num_threads((int)threads) default(none) \
+      shared(chain, callback, client_data, max_planes, status, threads, \
+          branches, decoders, workers, finished, stop, io_stop, started)
+  if ((size_t)omp_get_num_threads() == threads) {
+    size_t t = (size_t)omp_get_thread_num();
+
+    started = sox_true;
+    if (t > branches + decoders + workers)
+      lsx_io_async_serve(&io_stop);
+    else {
+      if (t > branches + decoders)
+        lsx_lv2_work_serve(&stop);
+      else if (t > branches)
+        lsx_decode_ahead_serve(t - branches - 1, &stop);
+      else if (t)
+        lsx_serve_async_branch(chain, t - 1);
+      else {
+        status = flow_effects_inline(chain, callback, client_data, max_planes);
+        lsx_end_async_branches(chain);
+      }
+      #pragma omp critical (flow_effects_helped)
+      {
+        if (++finished == branches + 1)
+          ringbuf_store(&stop, (size_t)1);
+        if (finished == branches + 1 + decoders + workers)
+          ringbuf_store(&io_stop, (size_t)1);
+      }
+    }
+  }
+  if (io)
+    lsx_io_async_stop();
+  lsx_decode_ahead_stop();
+  lsx_finish_async_branches(chain, started);
+  lsx_threads_give(context, granted);
+  if (started)
+    return status;
+  lsx_debug_more("not enough threads for the I/O, decoders, workers and branches");
+  return flow_effects_inline(chain, callback, client_data, max_planes);
+}
+#endif
+
+#define MAX_BLOCK_BUFS 64 /* Most, in units of bufsiz, that a block may ask */
+
+/* Sizes each effect's obuf, i.e. the link between it and the next: at least
+ * bufsiz, and enough to hold a block (see lsx_effect_set_block) of either
+ * effect, and the next one's imin, in each of the link's channel buffers */
+static void size_buffers(sox_effects_chain_t * chain)
+{
+  size_t bufsiz = chain->global_info.global_info->bufsiz;
+  size_t e, f;
+
+  for (e = 0; e < chain->length; ++e) {
+    sox_effect_t * effp = chain->effects[e];
+    sox_effect_t * next = e + 1 < chain->length? chain->effects[e + 1] : NULL;
+    size_t size = effp->block * effp->flows;
+
+    if (next)
+      size = max(size, next->block * next->flows);
+    size = max(bufsiz, min(size, MAX_BLOCK_BUFS * bufsiz));
+    if (next)
+      size = max(size, next->imin * next->flows);
+    for (f = 0; f < effp->flows; ++f)
+      chain->effects[e][f].obufsiz = size;
+    if (next) for (f = 0; f < next->flows; ++f)
+      chain->effects[e + 1][f].ibufsiz = size;
+  }
+}
+
+/* Gives each effect its output buffer and chooses the buffers' layouts;
+ * returns the most channel buffers that any effect's output has */
+static size_t prepare_effects(sox_effects_chain_t * chain)
+{
+  size_t e, max_planes = 0;
+
+  set_planar(chain);
+  set_float(chain);
+  size_buffers(chain);
+  for (e = 0; e < chain->length; ++e) {
+    sox_effect_t *effp = chain->effects[e];
+    effp->obuf =
+        lsx_realloc(effp->obuf, effp->obufsiz * sizeof(*effp->obuf));
+      /* Memory will be freed by sox_delete_effect() later. */
+      /* Possibly there was already a buffer, if this is a used effect;
+         it may still contain samples in that case. */
+      if (effp->oend > effp->obufsiz) {
+        lsx_warn("buffer size insufficient; buffered samples were dropped");
+        /* can only happen if bufsize has been reduced since the last run */
+        effp->obeg = effp->oend = 0;
+      }
+    max_planes = max(max_planes, out_planes(effp));
+  }
+  return max_planes;
+}
+
+/* Flow data through the effects chain until an effect or callback gives EOF */
+static int flow_effects(sox_effects_chain_t * chain,
+    sox_flow_effects_callback callback, void * client_data)
+{
+  int flow_status = SOX_SUCCESS;
+  size_t max_planes = prepare_effects(chain);
+
+#ifdef HAVE_OPENMP
+  if (chain->global_info.global_info->chain_mode == SOX_CHAIN_PIPELINED && chain->length > 1 &&
+      !lsx_has_merge(chain) && !lsx_has_async_branches(chain) &&
+      !lsx_decode_ahead_pending() && !omp_in_parallel()) {
+    if (flow_effects_pipelined(chain, callback, client_data, &flow_status))
+      return flow_status;
+    lsx_debug_more("not enough threads for a pipelined chain; running serially");
+  }
+  if ((lsx_io_async_pending() || lsx_decode_ahead_pending() ||
+        lsx_lv2_work_pending() || lsx_has_async_branches(chain)) &&
+      !omp_in_parallel())
+    return flow_effects_helped(chain, callback, client_data, max_planes);
+#endif
+  return flow_effects_inline(chain, callback, client_data, max_planes);
+}
+
+int sox_flow_effects(sox_effects_chain_t * chain, int (* callback)(sox_bool all_done, void * client_data), void * client_data)
+{
+  lsx_mem_tag_t saved = lsx_mem_tag(NULL, &chain->mem);
+  int flow_status = flow_effects(chain, callback, client_data);
+
+  lsx_mem_untag(saved);
+  return flow_status;
+}
+
+/* A branch (see branch.c) is not flowed by sox_flow_effects, but pushed a
+ * block at a time by its branch point, from within the flow of the chain
+ * that it branches from.  Its first effect holds the samples pushed, and
+ * pump_effects() moves them on as far as they will go; once there are no
+ * more to come, drain_effects() drains each effect in turn, as in
+ * flow_effects_serial. */
+
+void lsx_start_branch(sox_effects_chain_t * chain)
+{
+  chain->il_buf = new_il_buf(chain, prepare_effects(chain));
+}
+
+/* Flows the samples buffered in effects[from] onwards as far through the
+ * chain as they will go; returns the index of an effect that gave SOX_EOF
+ * from its flow, or 0 */
+static size_t pump_effects(sox_effects_chain_t * chain, size_t from)
+{
+  sox_bool moved = sox_true;
+  size_t e;
+
+  while (moved) for (moved = sox_false, e = from + 1; e < chain->length; ++e) {
+    sox_effect_t * effp1 = chain->effects[e - 1], * effp = chain->effects[e];
+    size_t held, last = run_end(chain, e);
+
+    if (last) {
+      size_t ibeg = effp1->obeg, iend = effp1->oend;
+      size_t oend = chain->effects[last]->oend, k;
+
+      if ((held = iend - ibeg) != 0 && held >= effp->imin) {
+        if ((k = flow_run(chain, e, last)) != 0)
+          return k;
+        if (effp1->obeg != ibeg || effp1->oend != iend ||
+            chain->effects[last]->oend != oend)
+          moved = sox_true;
+      }
+      e = last;
+      continue;
+    }
+    while ((held = effp1->oend - effp1->obeg) != 0 && held >= effp->imin) {
+      size_t oend = effp->oend;
+
+      if (flow_effect(chain, e) != SOX_SUCCESS)
+        return e;
+      if (effp1->oend - effp1->obeg == held && effp->oend == oend)
+        break;  /* Its output is full, or it wants more input */
+      moved = sox_true;
+    }
+  }
+  return 0;
+}
+
+/* Drains effects[e] onwards; returns SOX_EOF if the output gave EOF */
+static int drain_effects(sox_effects_chain_t * chain, size_t e)
+{
+  sox_bool draining = sox_true;
+
+  while (e < chain->length) {
+    size_t k = pump_effects(chain, e);
+
+    if (k == chain->length - 1)
+      return SOX_EOF;
+    if (k)
+      e = k, draining = sox_true;
+    else if (!draining)
+      ++e, draining = sox_true;
+    else if (drain_effect(chain, e, SOX_SIZE_MAX) != SOX_SUCCESS)
+      draining = sox_false;   /* Once its last output has moved on */
+  }
+  return SOX_SUCCESS;
+}
+
+/* Pushes len (interleaved) samples through the branch; returns SOX_EOF if
+ * it will take no more, having been drained from the effect that stopped */
+int lsx_flow_branch(sox_effects_chain_t * chain,
+    sox_sample_t const * buf, size_t len)
+{
+  sox_effect_t * effp = chain->effects[0];
+  size_t k = 0, planes = next_planes(chain, (size_t)0), f;
+  sox_sample_t * obuf = effp->obuf;
+
+  if (effp->oend == 0 && planes == 1 && !next_float(chain, (size_t)0) &&
+      chain->effects[1]->imin == 0) {
+    /* Flow straight from the branch point's input: it is not written to,
+     * and is kept only while it is read here */
+    effp->obuf = (sox_sample_t *)buf;
+    effp->oend = len, len = 0;
+    chain->input_lent = sox_true;
+    k = pump_effects(chain, (size_t)0);
+    chain->input_lent = sox_false;
+    if (effp->obeg != effp->oend)
+      memcpy(obuf, effp->obuf + effp->obeg,
+          (effp->oend - effp->obeg) * sizeof(*obuf));
+    effp->obuf = obuf;
+    effp->oend -= effp->obeg, effp->obeg = 0;
+  }
+  while (len && !k) {
+    size_t n, flow_offs = effp->obufsiz / planes;
+
+    if (effp->obeg) {
+      for (f = 0; f < planes; ++f)
+        memmove(obuf + f * flow_offs, obuf + f * flow_offs + effp->obeg / planes,
+            (effp->oend - effp->obeg) / planes * sizeof(*obuf));
+      effp->oend -= effp->obeg, effp->obeg = 0;
+    }
+    n = min(len, flow_offs * planes - effp->oend);
+    n -= n % effp->out_signal.channels;
+    if (!n) {
+      lsx_fail("branch stalled");
+      k = chain->length - 1;
+      break;
+    }
+    if (planes > 1)
+      deinterleave(planes, n, (sox_sample_t *)buf, obuf, effp->obufsiz,
+          effp->oend);
+    else memcpy(obuf + effp->oend, buf, n * sizeof(*obuf));
+    if (next_float(chain, (size_t)0))
+      convert_samples(obuf, effp->obufsiz, sox_true, planes, effp->oend, n, NULL);
+    effp->oend += n, buf += n, len -= n;
+    k = pump_effects(chain, (size_t)0);
+  }
+  if (!k)
+    return SOX_SUCCESS;
+  if (k + 1 < chain->length)
+    drain_effects(chain, k);
+  lsx_free(chain->il_buf);
+  chain->il_buf = NULL;
+  return SOX_EOF;
+}
+
+/* Drains the branch, once nothing more is to be pushed */
+int lsx_drain_branch(sox_effects_chain_t * chain)
+{
+  int status = drain_effects(chain, (size_t)0);
+
+  lsx_free(chain->il_buf);
+  chain->il_buf = NULL;
+  return status;
+}
+
+/* sox_effects_chain_pull runs the chain as drain_effects does a branch,
+ * but with the chain's input (effects[0]) drained as the first source, and
+ * stopping whenever the last effect holds enough for the caller; where it
+ * had got to is kept in the chain for the next call. */
+size_t sox_effects_chain_pull(sox_effects_chain_t * chain,
+    sox_sample_t * buf, size_t len)
+{
+  sox_effect_t * last = chain->length? chain->effects[chain->length - 1] : NULL;
+  size_t done = 0, n, k;
+  lsx_mem_tag_t saved;
+
+  if (!last)
+    return 0;
+  saved = lsx_mem_tag(NULL, &chain->mem);
+  if (!chain->pulling) {
+    unpack_buffers(chain, prepare_effects(chain));
+    chain->pulling = sox_true;
+    chain->pull_effect = 0;
+    chain->pull_draining = sox_true;
+  }
+  while (sox_true) {
+    n = min(len - done, last->oend - last->obeg);
+    memcpy(buf + done, last->obuf + last->obeg, n * sizeof(*buf));
+    done += n;
+    last->obeg += n;
+    if (last->obeg == last->oend)
+      last->obeg = last->oend = 0;
+    if (done == len || chain->pull_effect == chain->length)
+      break;
+    if ((k = pump_effects(chain, chain->pull_effect)) != 0)
+      chain->pull_effect = k, chain->pull_draining = sox_true;
+    else if (last->oend > last->obeg)
+      continue;
+    else if (!chain->pull_draining)
+      ++chain->pull_effect, chain->pull_draining = sox_true;
+    else if (drain_effect(chain, chain->pull_effect, SOX_SIZE_MAX) != SOX_SUCCESS)
+      chain->pull_draining = sox_false; /* Once its last output has moved on */
+  }
+  if (chain->pull_effect == chain->length && last->oend == last->obeg) {
+    repack_buffers(chain);  /* Frees il_buf; still pulling, so giving 0 */
+    chain->il_buf = NULL;
+  }
+  lsx_mem_untag(saved);
+  return done;
+}
+
 sox_uint64_t sox_effects_clips(sox_effects_chain_t * chain)
 {
   size_t i, f;
@@ -494,6 +1755,179 @@ sox_uint64_t sox_effects_clips(sox_effects_chain_t * chain)
   return clips;
 }
 
+double sox_effects_chain_latency(sox_effects_chain_t const * chain)
+{
+  double latency = 0;
+  size_t e;
+
+  for (e = 0; e < chain->length; ++e)
+    latency += chain->effects[e][0].latency;
+  if (chain->global_info.global_info->chain_mode == SOX_CHAIN_REALTIME && chain->length)
+    latency += realtime_block_len(chain) /
+      chain->effects[0]->out_signal.channels / chain->effects[0]->out_signal.rate;
+  return latency;
+}
+
+double sox_effects_chain_history(sox_effects_chain_t const * chain)
+{
+  double history = 0;
+  size_t e;
+
+  for (e = 0; e < chain->length; ++e)
+    history += chain->effects[e][0].history;
+  return history;
+}
+
+int sox_effects_chain_stats(sox_effects_chain_t const * chain, size_t n,
+    sox_effect_stats_t * stats)
+{
+  size_t f;
+
+  if (n >= chain->length)
+    return SOX_EOF;
+  *stats = chain->effects[n][0].stats;
+  stats->clips = 0;
+  for (f = 0; f < chain->effects[n][0].flows; ++f)
+    stats->clips += chain->effects[n][f].clips;
+  return SOX_SUCCESS;
+}
+
+int sox_effects_chain_adjust_rate(sox_effects_chain_t * chain, size_t n,
+    double ratio)
+{
+  if (n >= chain->length)
+    return SOX_EOF;
+  return lsx_rate_adjust(&chain->effects[n][0], ratio);
+}
+
+int sox_effects_chain_rate_feedback(sox_effects_chain_t * chain, size_t n,
+    double excess)
+{
+  if (n >= chain->length)
+    return SOX_EOF;
+  return lsx_rate_feedback(&chain->effects[n][0], excess);
+}
+
+int sox_effects_chain_memory(sox_effects_chain_t const * chain, size_t n,
+    sox_mem_stats_t * stats)
+{
+  if (n > chain->length)
+    return SOX_EOF;
+  *stats = n < chain->length? chain->effects[n][0].mem : chain->mem;
+  return SOX_SUCCESS;
+}
+
+/* The file of an input or output effect (whose priv is just that) */
+#define effect_file(effp) (*(sox_format_t * *)(effp)->priv)
+
+int sox_effects_chain_reset(sox_effects_chain_t * chain,
+    sox_format_t * in, sox_format_t * out)
+{
+  sox_effect_t * first = chain->length? chain->effects[0] : NULL;
+  sox_effect_t * last = chain->length? chain->effects[chain->length - 1] : NULL;
+  sox_encodinginfo_t const * old_in = NULL, * old_out = NULL;
+  size_t e, f;
+
+  for (e = 0; e < chain->length; ++e) {
+    sox_effect_t * effp = chain->effects[e];
+    if (!effp->handler.reset) {
+      lsx_debug("can't be reset");
+      return SOX_EOF;
+    }
+  }
+  if (in && (!first || first->handler.drain != lsx_input_effect_fn()->drain ||
+        in->mode != 'r' || in->signal.rate != first->out_signal.rate ||
+        in->signal.channels != first->out_signal.channels))
+    return SOX_EOF;
+  if (out && (!last || last->handler.flow != lsx_output_effect_fn()->flow ||
+        out->mode != 'w' || out->signal.rate != last->in_signal.rate ||
+        out->signal.channels != last->in_signal.channels))
+    return SOX_EOF;
+
+  /* Encodings pointed to in the old files now point to those in the new */
+  if (in) {
+    old_in = &effect_file(first)->encoding;
+    effect_file(first) = in;
+    if (chain->in_enc == old_in)
+      chain->in_enc = &in->encoding;
+  }
+  if (out) {
+    old_out = &effect_file(last)->encoding;
+    effect_file(last) = out;
+    if (chain->out_enc == old_out)
+      chain->out_enc = &out->encoding;
+  }
+
+  for (e = 0; e < chain->length; ++e) {
+    sox_effect_t * effp = chain->effects[e];
+    uint64_t clips = 0;
+
+    for (f = 0; f < effp->flows; ++f) {
+      if (old_in && effp[f].in_encoding == old_in)
+        effp[f].in_encoding = &in->encoding;
+      if (old_out && effp[f].out_encoding == old_out)
+        effp[f].out_encoding = &out->encoding;
+      lsx_mem_tag_t saved = lsx_mem_tag(&effp->mem, effp->chain_mem);
+      effp[f].handler.reset(&effp[f]);
+      lsx_mem_untag(saved);
+      clips += effp[f].clips;
+      effp[f].clips = 0;
+    }
+    if (clips)
+      lsx_warn("%s clipped %" PRIu64 " samples; decrease volume?",
+          effp->handler.name, clips);
+    effp->obeg = effp->oend = 0;
+    memset(&effp->stats, 0, sizeof(effp->stats));
+  }
+  if (chain->pulling) {
+    lsx_mem_tag_t saved = lsx_mem_tag(NULL, &chain->mem);
+    lsx_free(chain->il_buf);
+    lsx_mem_untag(saved);
+    chain->il_buf = NULL;
+    chain->pulling = sox_false;
+  }
+  return SOX_SUCCESS;
+}
+
+/* Seeks to the start of the first trim, less the history of the effects
+ * before it, which the trim is told it has read up to, so that the pre-roll
+ * primes those effects and is then discarded by it, as by --segments */
+int sox_effects_chain_seek(sox_effects_chain_t * chain, sox_format_t * ft,
+    sox_uint64_t * position)
+{
+  sox_effect_t * effp = NULL; /* The trim */
+  double history = 0;
+  uint64_t start, from;
+  size_t e;
+
+  if (!ft && chain->length &&
+      chain->effects[0]->handler.drain == lsx_input_effect_fn()->drain)
+    ft = effect_file(chain->effects[0]);
+  if (!ft || ft->mode != 'r' || !ft->seekable || !ft->handler.seek)
+    return SOX_EOF;
+  for (e = 1; e < chain->length && !effp; ++e) {
+    sox_effect_handler_t const * handler = &chain->effects[e]->handler;
+    if (handler->flow == lsx_trim_effect_fn()->flow)
+      effp = chain->effects[e];
+    else if (handler->flags & (SOX_EFF_RATE | SOX_EFF_LENGTH))
+      return SOX_EOF;
+    else history += chain->effects[e]->history;
+  }
+  if (!effp || history == HUGE_VAL || effp->in_signal.rate != ft->signal.rate ||
+      !(start = sox_trim_get_start(effp) / effp->in_signal.channels))
+    return SOX_EOF;
+  from = start - min(start, (uint64_t)ceil(history * ft->signal.rate));
+  if (ft->signal.length != SOX_UNKNOWN_LEN) /* Then the trim counts on */
+    from = min(from, ft->signal.length / ft->signal.channels);
+  if (from && sox_seek(ft, from * ft->signal.channels, SOX_SEEK_SET) != SOX_SUCCESS)
+    return SOX_EOF; /* Assuming that a failed seek stayed where it was */
+  lsx_trim_set_read(effp, from);
+  lsx_debug("sought to %" PRIu64 " for a start at %" PRIu64 ", through %"
+      PRIuPTR " effect(s)", from, start, e - 2);
+  *position = from;
+  return SOX_SUCCESS;
+}
+
 sox_uint64_t sox_stop_effect(sox_effect_t *effp)
 {
   size_t f;
@@ -508,6 +1942,7 @@ sox_uint64_t sox_stop_effect(sox_effect_t *effp)
 
 void sox_push_effect_last(sox_effects_chain_t *chain, sox_effect_t *effp)
 {
+  effp->chain_mem = &chain->mem;
   if (chain->length == chain->table_size) {
     chain->table_size += EFF_TABLE_STEP;
     lsx_debug_more("sox_push_effect_last: extending effects table, "
@@ -532,14 +1967,149 @@ sox_effect_t *sox_pop_effect_last(sox_effects_chain_t *chain)
     return NULL;
 } /* sox_pop_effect_last */
 
+sox_bool sox_fuse_output(sox_effects_chain_t * chain, sox_format_t * ft)
+{
+  sox_effect_t * effp = chain->length? chain->effects[chain->length - 1] : NULL;
+
+  if (!effp || !effp->pack || ft->mode != 'w' ||
+      !(ft->handler.flags & SOX_FILE_RAWPCM) ||
+      ft->encoding.encoding != SOX_ENCODING_SIGN2 ||
+      ft->encoding.bits_per_sample != 16 ||
+      effp->flows != ft->signal.channels ||
+      effp->out_signal.precision > 16)
+    return sox_false;
+  if (ft->quantiser)
+    sox_delete_effect(ft->quantiser);
+  /* Its memory is no longer the chain's: */
+  lsx_mem_release(&effp->mem, effp->chain_mem);
+  effp->chain_mem = NULL;
+  ft->quantiser = sox_pop_effect_last(chain);
+  return sox_true;
+}
+
+/* A partial result is: magic, version, the effect's name (its length, then
+ * that), the number of flows, then for each flow the size of its part (as
+ * given by the handler's save), then that */
+#define PARTIAL_MAGIC "SoX part"
+#define PARTIAL_VERSION 1
+
+/* Writes (or reads & checks) all but the flows' parts */
+static void partial_header(lsx_partial_t * s, sox_effect_t const * effp)
+{
+  char magic[sizeof(PARTIAL_MAGIC) - 1], name[64];
+  uint64_t version = PARTIAL_VERSION, len = strlen(effp->handler.name);
+  uint64_t flows = effp->flows;
+
+  memcpy(magic, PARTIAL_MAGIC, sizeof(magic));
+  memcpy(name, effp->handler.name, min(len, sizeof(name)));
+  lsx_partial_bytes(s, magic, sizeof(magic));
+  lsx_partial_u64(s, &version);
+  lsx_partial_u64(s, &len);
+  if (len > sizeof(name))
+    s->error = sox_true;
+  else lsx_partial_bytes(s, name, (size_t)len);
+  lsx_partial_u64(s, &flows);
+  if (s->reading && (memcmp(magic, PARTIAL_MAGIC, sizeof(magic)) ||
+        version != PARTIAL_VERSION || len != strlen(effp->handler.name) ||
+        memcmp(name, effp->handler.name, (size_t)len) ||
+        flows != effp->flows))
+    s->error = sox_true;
+}
+
+void * sox_effect_save(sox_effect_t * effp, size_t * len)
+{
+  lsx_partial_t s;
+  lsx_mem_tag_t saved;
+  uint64_t * lens;
+  size_t f;
+
+  if (!effp->handler.save)
+    return NULL;
+  memset(&s, 0, sizeof(s));
+  partial_header(&s, effp);
+  lens = lsx_malloc(effp->flows * sizeof(*lens));
+  saved = lsx_mem_tag(&effp->mem, effp->chain_mem);
+  for (f = 0; f < effp->flows; ++f) {
+    if (!(lens[f] = effp->handler.save(&effp[f], NULL, (size_t)0)))
+      break;
+    s.pos += sizeof(*lens) + lens[f];
+  }
+  if (f == effp->flows) {
+    s.data = lsx_malloc(s.size = s.pos);
+    s.pos = 0;
+    partial_header(&s, effp);
+    for (f = 0; f < effp->flows; ++f) {
+      lsx_partial_u64(&s, &lens[f]);
+      effp->handler.save(&effp[f], s.data + s.pos, (size_t)lens[f]);
+      s.pos += lens[f];
+    }
+    *len = s.size;
+  }
+  lsx_mem_untag(saved);
+  free(lens);
+  return s.data;
+}
+
+int sox_effect_merge(sox_effect_t * effp, void const * partial, size_t len)
+{
+  lsx_partial_t s;
+  lsx_mem_tag_t saved;
+  uint64_t n;
+  size_t f;
+  int result = SOX_SUCCESS;
+
+  memset(&s, 0, sizeof(s));
+  s.data = (unsigned char *)partial, s.size = len, s.reading = sox_true;
+  partial_header(&s, effp);
+  if (!effp->handler.merge)
+    s.error = sox_true;
+  saved = lsx_mem_tag(&effp->mem, effp->chain_mem);
+  for (f = 0; !s.error && result == SOX_SUCCESS && f < effp->flows; ++f) {
+    lsx_partial_u64(&s, &n);
+    if (!s.error && n <= s.size - s.pos) {
+      result = effp->handler.merge(&effp[f], s.data + s.pos, (size_t)n);
+      s.pos += n;
+    }
+    else s.error = sox_true;
+  }
+  lsx_mem_untag(saved);
+  if (result != SOX_SUCCESS || s.error || s.pos != s.size) {
+    lsx_fail("partial result is not of this effect, or is corrupt");
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+int sox_effect_update(sox_effect_t * effp, int argc, char * const argv[])
+{
+  lsx_mem_tag_t saved;
+  char * * argv2;
+  size_t f;
+  int result = SOX_SUCCESS;
+
+  if (!effp->handler.update) {
+    lsx_fail("%s: options can't be changed while it runs", effp->handler.name);
+    return SOX_EOF;
+  }
+  argv2 = lsx_malloc((argc + 1) * sizeof(*argv2));
+  argv2[0] = (char *)effp->handler.name;
+  memcpy(argv2 + 1, argv, argc * sizeof(*argv2));
+  saved = lsx_mem_tag(&effp->mem, effp->chain_mem);
+  for (f = 0; result == SOX_SUCCESS && f < effp->flows; ++f)
+    result = effp->handler.update(&effp[f], argc + 1, argv2);
+  lsx_mem_untag(saved);
+  lsx_free(argv2);
+  return result;
+}
+
 /* Free resources related to effect.
  * Note: This currently closes down the effect which might
  * not be obvious from name.
  */
 void sox_delete_effect(sox_effect_t *effp)
 {
+  lsx_mem_tag_t saved = lsx_mem_tag(&effp->mem, effp->chain_mem);
   uint64_t clips;
-  size_t f;
 
   if ((clips = sox_stop_effect(effp)) != 0)
     lsx_warn("%s clipped %" PRIu64 " samples; decrease volume?",
@@ -550,10 +2120,13 @@ void sox_delete_effect(sox_effect_t *effp)
       /* May or may not indicate a problem; it is normal if the user aborted
          processing, or if an effect like "trim" stopped early. */
   effp->handler.kill(effp); /* N.B. only one kill; not one per flow */
-  for (f = 0; f < effp->flows; ++f)
-    free(effp[f].priv);
-  free(effp->obuf);
-  free(effp);
+  lsx_mem_untag(saved);
+  lsx_mem_release(&effp->mem, effp->chain_mem); /* Whatever it still held */
+  lsx_arena_free(effp->arena);  /* All flows' priv */
+  saved = lsx_mem_tag(NULL, effp->chain_mem);
+  lsx_free(effp->obuf);
+  lsx_mem_untag(saved);
+  lsx_free(effp);
 }
 
 void sox_delete_effect_last(sox_effects_chain_t *chain)
@@ -596,22 +2169,244 @@ sox_get_effect_fns(void)
     return s_sox_effect_fns;
 }
 
+/* The effects by name: an open-addressed hash table, built on first use
+ * (the library's effects being fixed) and not changed after that */
+#define EFFECT_SLOTS 256        /* At least twice the number of effects */
+static sox_effect_handler_t const * effect_index[EFFECT_SLOTS];
+static sox_bool effects_indexed;
+
+static void index_effects(void)
+{
+  size_t e, i;
+
+  for (e = 0; s_sox_effect_fns[e]; ++e) {
+    sox_effect_handler_t const * eh = s_sox_effect_fns[e]();
+    if (eh && eh->name) {
+      for (i = lsx_hash_name(eh->name) & (EFFECT_SLOTS - 1); effect_index[i] &&
+          strcasecmp(effect_index[i]->name, eh->name); i = (i + 1) & (EFFECT_SLOTS - 1));
+      if (!effect_index[i])     /* Else the first of the name is kept */
+        effect_index[i] = eh;
+    }
+  }
+  effects_indexed = sox_true;
+}
+
 /* Find a named effect in the effects library */
 sox_effect_handler_t const * sox_find_effect(char const * name)
 {
-  int e;
-  sox_effect_fn_t const * fns = sox_get_effect_fns();
-  for (e = 0; fns[e]; ++e) {
-    const sox_effect_handler_t *eh = fns[e] ();
-    if (eh && eh->name && strcasecmp(eh->name, name) == 0)
+  sox_effect_handler_t const * eh;
+  size_t i;
+
+  #pragma omp critical(lsx_effect_index)
+  if (!effects_indexed)
+    index_effects();
+  for (i = lsx_hash_name(name) & (EFFECT_SLOTS - 1); (eh = effect_index[i]) != NULL;
+      i = (i + 1) & (EFFECT_SLOTS - 1))
+    if (strcasecmp(eh->name, name) == 0)
       return eh;                 /* Found it. */
-  }
   return NULL;
 }
 
 
 /*----------------------------- Helper functions -----------------------------*/
 
+/* The kernels below convert n wide samples between an interleaved buffer (il)
+ * and channel buffers that are stride samples apart (pl).  Common channel
+ * counts have their own kernel, chosen from a table by interleave() and
+ * deinterleave(); the others use the generic loops. */
+typedef void (*il_kernel_t)(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride);
+
+#define IL_KERNELS(N) \
+static void interleave_##N(size_t n, sox_sample_t *il, sox_sample_t *pl, \
+    size_t stride) \
+{ \
+  size_t i, f; \
+  for (i = 0; i < n; ++i, il += N) for (f = 0; f < N; ++f) \
+    il[f] = pl[f * stride + i]; \
+} \
+static void deinterleave_##N(size_t n, sox_sample_t *il, sox_sample_t *pl, \
+    size_t stride) \
+{ \
+  size_t i, f; \
+  for (f = 0; f < N; ++f, pl += stride) for (i = 0; i < n; ++i) \
+    pl[i] = il[i * N + f]; \
+}
+
+static void interleave_1(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride UNUSED)
+{
+  memcpy(il, pl, n * sizeof(*il));
+}
+
+static void deinterleave_1(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride UNUSED)
+{
+  memcpy(pl, il, n * sizeof(*pl));
+}
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+#define LD(p) _mm_loadu_si128((__m128i const *)(p))
+#define ST(p, x) _mm_storeu_si128((__m128i *)(p), x)
+
+/* Transposes the 4x4 matrix of 32-bit elements in r[0..3] */
+static void transpose4(__m128i * r)
+{
+  __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);
+  __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);
+  __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);
+  __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);
+  r[0] = _mm_unpacklo_epi64(t0, t1);
+  r[1] = _mm_unpackhi_epi64(t0, t1);
+  r[2] = _mm_unpacklo_epi64(t2, t3);
+  r[3] = _mm_unpackhi_epi64(t2, t3);
+}
+
+static void interleave_2(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  sox_sample_t * p1 = pl + stride;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4, il += 8) {
+    __m128i a = LD(pl + i), b = LD(p1 + i);
+    ST(il, _mm_unpacklo_epi32(a, b));
+    ST(il + 4, _mm_unpackhi_epi32(a, b));
+  }
+  for (; i < n; ++i, il += 2)
+    il[0] = pl[i], il[1] = p1[i];
+}
+
+static void deinterleave_2(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  sox_sample_t * p1 = pl + stride;
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4, il += 8) {
+    __m128i a = _mm_shuffle_epi32(LD(il), 0xd8);     /* A0 A1 B0 B1 */
+    __m128i b = _mm_shuffle_epi32(LD(il + 4), 0xd8); /* A2 A3 B2 B3 */
+    ST(pl + i, _mm_unpacklo_epi64(a, b));
+    ST(p1 + i, _mm_unpackhi_epi64(a, b));
+  }
+  for (; i < n; ++i, il += 2)
+    pl[i] = il[0], p1[i] = il[1];
+}
+
+/* Channels 0-3 or 4-7 of four wide samples are a transpose away: */
+#define IL_QUAD(il, pl, N) { \
+  __m128i r[4]; \
+  r[0] = LD(pl), r[1] = LD(pl + stride); \
+  r[2] = LD(pl + 2 * stride), r[3] = LD(pl + 3 * stride); \
+  transpose4(r); \
+  ST(il, r[0]), ST(il + N, r[1]), ST(il + 2 * N, r[2]), ST(il + 3 * N, r[3]); \
+}
+#define DEIL_QUAD(il, pl, N) { \
+  __m128i r[4]; \
+  r[0] = LD(il), r[1] = LD(il + N), r[2] = LD(il + 2 * N), r[3] = LD(il + 3 * N); \
+  transpose4(r); \
+  ST(pl, r[0]), ST(pl + stride, r[1]); \
+  ST(pl + 2 * stride, r[2]), ST(pl + 3 * stride, r[3]); \
+}
+
+static void interleave_4(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  size_t i = 0, f;
+  for (; i + 4 <= n; i += 4, il += 16)
+    IL_QUAD(il, pl + i, 4)
+  for (; i < n; ++i, il += 4) for (f = 0; f < 4; ++f)
+    il[f] = pl[f * stride + i];
+}
+
+static void deinterleave_4(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  size_t i = 0, f;
+  for (; i + 4 <= n; i += 4, il += 16)
+    DEIL_QUAD(il, pl + i, 4)
+  for (; i < n; ++i, il += 4) for (f = 0; f < 4; ++f)
+    pl[f * stride + i] = il[f];
+}
+
+static void interleave_6(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  sox_sample_t * p4 = pl + 4 * stride, * p5 = p4 + stride;
+  size_t i = 0, f;
+  for (; i + 4 <= n; i += 4, il += 24) {
+    __m128i a = LD(p4 + i), b = LD(p5 + i);
+    __m128i lo = _mm_unpacklo_epi32(a, b), hi = _mm_unpackhi_epi32(a, b);
+    IL_QUAD(il, pl + i, 6)
+    _mm_storel_epi64((__m128i *)(il + 4), lo);
+    _mm_storel_epi64((__m128i *)(il + 10), _mm_unpackhi_epi64(lo, lo));
+    _mm_storel_epi64((__m128i *)(il + 16), hi);
+    _mm_storel_epi64((__m128i *)(il + 22), _mm_unpackhi_epi64(hi, hi));
+  }
+  for (; i < n; ++i, il += 6) for (f = 0; f < 6; ++f)
+    il[f] = pl[f * stride + i];
+}
+
+static void deinterleave_6(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  sox_sample_t * p4 = pl + 4 * stride, * p5 = p4 + stride;
+  size_t i = 0, f;
+  for (; i + 4 <= n; i += 4, il += 24) {
+    __m128i a = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i const *)(il + 4)),
+        _mm_loadl_epi64((__m128i const *)(il + 10)));
+    __m128i b = _mm_unpacklo_epi64(_mm_loadl_epi64((__m128i const *)(il + 16)),
+        _mm_loadl_epi64((__m128i const *)(il + 22)));
+    DEIL_QUAD(il, pl + i, 6)
+    a = _mm_shuffle_epi32(a, 0xd8), b = _mm_shuffle_epi32(b, 0xd8);
+    ST(p4 + i, _mm_unpacklo_epi64(a, b));
+    ST(p5 + i, _mm_unpackhi_epi64(a, b));
+  }
+  for (; i < n; ++i, il += 6) for (f = 0; f < 6; ++f)
+    pl[f * stride + i] = il[f];
+}
+
+static void interleave_8(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  size_t i = 0, f;
+  for (; i + 4 <= n; i += 4, il += 32) {
+    IL_QUAD(il, pl + i, 8)
+    IL_QUAD(il + 4, pl + 4 * stride + i, 8)
+  }
+  for (; i < n; ++i, il += 8) for (f = 0; f < 8; ++f)
+    il[f] = pl[f * stride + i];
+}
+
+static void deinterleave_8(size_t n, sox_sample_t *il, sox_sample_t *pl,
+    size_t stride)
+{
+  size_t i = 0, f;
+  for (; i + 4 <= n; i += 4, il += 32) {
+    DEIL_QUAD(il, pl + i, 8)
+    DEIL_QUAD(il + 4, pl + 4 * stride + i, 8)
+  }
+  for (; i < n; ++i, il += 8) for (f = 0; f < 8; ++f)
+    pl[f * stride + i] = il[f];
+}
+
+#undef LD
+#undef ST
+#else
+IL_KERNELS(2)
+IL_KERNELS(4)
+IL_KERNELS(6)
+IL_KERNELS(8)
+#endif
+
+static const il_kernel_t interleavers[] = {
+  NULL, interleave_1, interleave_2, NULL, interleave_4, NULL, interleave_6,
+  NULL, interleave_8};
+static const il_kernel_t deinterleavers[] = {
+  NULL, deinterleave_1, deinterleave_2, NULL, deinterleave_4, NULL,
+  deinterleave_6, NULL, deinterleave_8};
+
 /* interleave() parameters:
  *   flows: number of samples per wide sample
  *   length: number of samples to copy
@@ -629,6 +2424,10 @@ static void interleave(size_t flows, size_t length, sox_sample_t *from,
   const size_t wide_samples = length/flows;
   const size_t flow_offs = bufsiz/flows;
   from += offset/flows;
+  if (flows < array_length(interleavers) && interleavers[flows]) {
+    interleavers[flows](wide_samples, to, from, flow_offs);
+    return;
+  }
   for (i = 0; i < wide_samples; i++) {
     sox_sample_t *inner_from = from + i;
     sox_sample_t *inner_to = to + i * flows;
@@ -657,6 +2456,10 @@ static void deinterleave(size_t flows, size_t length, sox_sample_t *from,
   const size_t flow_offs = bufsiz/flows;
   size_t f;
   to += offset/flows;
+  if (flows < array_length(deinterleavers) && deinterleavers[flows]) {
+    deinterleavers[flows](wide_samples, from, to, flow_offs);
+    return;
+  }
   for (f = 0; f < flows; f++) {
     sox_sample_t *inner_to = to + f*flow_offs;
     sox_sample_t *inner_from = from + f;
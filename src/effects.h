@@ -26,6 +26,7 @@
   EFFECT(channels)
   EFFECT(compand)
   EFFECT(contrast)
+  EFFECT(convolve)
   EFFECT(dcshift)
   EFFECT(deemph)
   EFFECT(delay)
@@ -34,10 +35,12 @@
   EFFECT(divide)
   EFFECT(downsample)
   EFFECT(earwax)
+  EFFECT(ebur128)
   EFFECT(echo)
   EFFECT(echos)
   EFFECT(equalizer)
   EFFECT(fade)
+  EFFECT(features)
   EFFECT(fir)
   EFFECT(firfit)
   EFFECT(flanger)
@@ -48,8 +51,12 @@
 #ifdef HAVE_LADSPA_H
   EFFECT(ladspa)
 #endif
+  EFFECT(limiter)
   EFFECT(loudness)
   EFFECT(lowpass)
+#ifdef HAVE_LILV_H
+  EFFECT(lv2)
+#endif
   EFFECT(mcompand)
   EFFECT(noiseprof)
   EFFECT(noisered)
@@ -60,6 +67,7 @@
   EFFECT(pad)
   EFFECT(phaser)
   EFFECT(pitch)
+  EFFECT(pvoc)
   EFFECT(rate)
   EFFECT(remix)
   EFFECT(repeat)
@@ -88,3 +96,4 @@
   EFFECT(upsample)
   EFFECT(vad)
   EFFECT(vol)
+  EFFECT(waveform)
@@ -23,6 +23,10 @@
 #include <string.h>
 #include <ctype.h>
 
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  #include <sys/mman.h>
+#endif
+
 int lsx_usage(sox_effect_t * effp)
 {
   if (effp->handler.usage)
@@ -134,6 +138,461 @@ void lsx_generate_wave_table(
   }
 }
 
+/* The ring is max_block samples longer than the longest delay, so that a
+ * block may be written in full before the delayed samples are read back. */
+void lsx_delay_create(lsx_delay_t * d, size_t max_delay, size_t max_block)
+{
+  d->len = max_delay + max_block;
+  d->pos = 0;
+  d->buf = lsx_calloc(d->len, sizeof(*d->buf));
+}
+
+/* Appends n (<= max_block) samples, or silence if in is NULL */
+void lsx_delay_write(lsx_delay_t * d, double const * in, size_t n)
+{
+  size_t n1 = min(n, d->len - d->pos);
+
+  if (in) {
+    memcpy(d->buf + d->pos, in, n1 * sizeof(*d->buf));
+    memcpy(d->buf, in + n1, (n - n1) * sizeof(*d->buf));
+  }
+  else {
+    memset(d->buf + d->pos, 0, n1 * sizeof(*d->buf));
+    memset(d->buf, 0, (n - n1) * sizeof(*d->buf));
+  }
+  if ((d->pos += n) >= d->len)
+    d->pos -= d->len;
+}
+
+/* For each of the last n samples written, gets the sample written delay
+ * (1 to max_delay) samples before it */
+void lsx_delay_read(lsx_delay_t const * d, size_t delay, double * out, size_t n)
+{
+  size_t i = d->pos + d->len - n - delay, n1;
+
+  if (i >= d->len)
+    i -= d->len;
+  n1 = min(n, d->len - i);
+  memcpy(out, d->buf + i, n1 * sizeof(*out));
+  memcpy(out + n1, d->buf, (n - n1) * sizeof(*out));
+}
+
+/* As lsx_delay_read, but with a delay for each sample */
+void lsx_delay_read_var(lsx_delay_t const * d, double const * delays,
+    double * out, size_t n)
+{
+  size_t i, j = d->pos + d->len - n;
+
+  for (i = 0; i < n; ++i, ++j) {
+    size_t k = j - (size_t)delays[i];
+    out[i] = d->buf[k >= d->len? k - d->len : k];
+  }
+}
+
+void lsx_delay_delete(lsx_delay_t * d)
+{
+  free(d->buf);
+  d->buf = NULL;
+}
+
+/* The wave is generated as data_type, then held as doubles, so that the
+ * values are exactly those of a table of that type. */
+void lsx_lfo_create(lsx_lfo_t * l, lsx_wave_t wave_type, sox_data_t data_type,
+    size_t len, double min, double max, double phase)
+{
+  size_t i;
+
+  l->len = len;
+  l->pos = 0;
+  l->table = lsx_malloc(len * sizeof(*l->table));
+  if (data_type == SOX_FLOAT) {
+    float * t = lsx_malloc(len * sizeof(*t));
+    lsx_generate_wave_table(wave_type, data_type, t, len, min, max, phase);
+    for (i = 0; i < len; ++i)
+      l->table[i] = t[i];
+    free(t);
+  }
+  else if (data_type == SOX_INT) {
+    int * t = lsx_malloc(len * sizeof(*t));
+    lsx_generate_wave_table(wave_type, data_type, t, len, min, max, phase);
+    for (i = 0; i < len; ++i)
+      l->table[i] = t[i];
+    free(t);
+  }
+  else lsx_generate_wave_table(wave_type, SOX_DOUBLE, l->table, len, min, max, phase);
+}
+
+/* Gets the next n values, from offset values ahead */
+void lsx_lfo_read(lsx_lfo_t const * l, size_t offset, double * out, size_t n)
+{
+  size_t i;
+
+  for (i = (l->pos + offset) % l->len; n; i = 0) {
+    size_t n1 = min(n, l->len - i);
+    memcpy(out, l->table + i, n1 * sizeof(*out));
+    out += n1, n -= n1;
+  }
+}
+
+void lsx_lfo_advance(lsx_lfo_t * l, size_t n)
+{
+  l->pos = (l->pos + n) % l->len;
+}
+
+void lsx_lfo_delete(lsx_lfo_t * l)
+{
+  free(l->table);
+  l->table = NULL;
+}
+
+/* Messages about a store are attributed to the effect that holds it */
+#define store_debug lsx_set_subsystem(s->name), lsx_debug_impl
+#define store_fail lsx_set_subsystem(s->name), lsx_fail_impl
+
+/* The store's memory buffer grows as it is written, up to max_memory MiB
+ * (rounded down to whole frames of effp's input) */
+void lsx_store_create(lsx_store_t * s, sox_effect_t const * effp,
+    double max_memory)
+{
+  double max_len = max_memory * 1024 * 1024 / sizeof(sox_sample_t);
+
+  memset(s, 0, sizeof(*s));
+  s->name = effp->handler.name;
+  s->max_len = max_len < (double)((size_t)-1 / sizeof(sox_sample_t))?
+      (size_t)max_len : (size_t)-1 / sizeof(sox_sample_t);
+  s->max_len -= s->max_len % effp->in_signal.channels;
+}
+
+static int store_spill(lsx_store_t * s)
+{
+  s->tmp_file = lsx_tmpfile();
+  if (s->tmp_file == NULL) {
+    store_fail("can't create temporary file: %s", strerror(errno));
+    return SOX_EOF;
+  }
+  store_debug("spilling to temporary file after %" PRIu64 " samples", s->len);
+  if (fwrite(s->buf, sizeof(*s->buf), (size_t)s->len, s->tmp_file) != s->len) {
+    store_fail("error writing temporary file: %s", strerror(errno));
+    return SOX_EOF;
+  }
+  lsx_free(s->buf);
+  s->buf = NULL;
+  s->buf_size = 0;
+  return SOX_SUCCESS;
+}
+
+int lsx_store_write(lsx_store_t * s, sox_sample_t const * buf, size_t len)
+{
+  if (!len)
+    return SOX_SUCCESS;
+  if (!s->tmp_file && s->len + len > s->buf_size) {
+    if (s->len + len > s->max_len) {
+      if (store_spill(s) != SOX_SUCCESS)
+        return SOX_EOF;
+    }
+    else {
+      s->buf_size = max(s->buf_size * 2, (size_t)s->len + len);
+      s->buf_size = min(s->buf_size, s->max_len);
+      s->buf = lsx_realloc(s->buf, s->buf_size * sizeof(*s->buf));
+    }
+  }
+  if (s->tmp_file) {
+    if (fwrite(buf, sizeof(*buf), len, s->tmp_file) != len) {
+      store_fail("error writing temporary file: %s", strerror(errno));
+      return SOX_EOF;
+    }
+  }
+  else memcpy(s->buf + s->len, buf, len * sizeof(*buf));
+  s->len += len;
+  return SOX_SUCCESS;
+}
+
+/* Called once all has been written, before any is read; a spilled store's
+ * file is then mapped if it can be */
+int lsx_store_seal(lsx_store_t * s)
+{
+  off_t size;
+
+  if (s->sealed || !s->tmp_file)
+    return s->sealed = sox_true, SOX_SUCCESS;
+  s->sealed = sox_true;
+  fflush(s->tmp_file);
+  size = ftello(s->tmp_file);
+  if (size < 0 || (uint64_t)size != s->len * sizeof(sox_sample_t)) {
+    store_fail("temporary file has incorrect size");
+    return SOX_EOF;
+  }
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (size && (size_t)size == (uint64_t)size) {
+    void * map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE,
+        fileno(s->tmp_file), (off_t)0);
+    if (map != MAP_FAILED) {
+      s->map = map;
+      s->map_len = size;
+    }
+  }
+#endif
+  return SOX_SUCCESS;
+}
+
+/* Returns the sealed store's samples, or NULL if they may only be read */
+sox_sample_t const * lsx_store_data(lsx_store_t const * s)
+{
+  return s->tmp_file? s->map : s->buf;
+}
+
+/* Gets len samples, from position pos, of the sealed store */
+int lsx_store_read(lsx_store_t * s, uint64_t pos, sox_sample_t * buf, size_t len)
+{
+  sox_sample_t const * data = lsx_store_data(s);
+
+  if (!len)
+    return SOX_SUCCESS;
+  if (data)
+    memcpy(buf, data + pos, len * sizeof(*buf));
+  else if (fseeko(s->tmp_file, (off_t)(pos * sizeof(*buf)), SEEK_SET) ||
+      fread(buf, sizeof(*buf), len, s->tmp_file) != len) {
+    store_fail("error reading temporary file: %s", strerror(errno));
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+/* Hints that len samples from position pos of a mapped store will be read
+ * soon; MADV_WILLNEED starts reading them in without waiting for them. */
+void lsx_store_prefetch(lsx_store_t const * s, uint64_t pos, size_t len)
+{
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP && defined MADV_WILLNEED
+  size_t const align = 1 << 16;    /* A multiple of the page size */
+  size_t begin, end;
+
+  if (!s->map || pos >= s->len)
+    return;
+  len = min(len, s->len - pos);
+  begin = (size_t)pos * sizeof(*s->map);
+  end = begin + len * sizeof(*s->map);
+  begin -= begin % align;
+  madvise((char *)s->map + begin, end - begin, MADV_WILLNEED);
+#else
+  (void)s, (void)pos, (void)len;
+#endif
+}
+
+void lsx_store_delete(lsx_store_t * s)
+{
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (s->map)
+    munmap(s->map, s->map_len);
+#endif
+  if (s->tmp_file)
+    fclose(s->tmp_file); /* auto-deleted by lsx_tmpfile */
+  lsx_free(s->buf);
+  memset(s, 0, sizeof(*s));
+}
+
+/* Whether ft may be read again from any position, so that an effect fed
+ * directly from it need not store the audio: it is seekable, and of an
+ * encoding in which seeking is exact */
+sox_bool lsx_rereadable(sox_format_t const * ft)
+{
+  sox_encoding_t e = ft->encoding.encoding;
+
+  return ft->seekable && ft->handler.seek &&
+    !(ft->encoding.bits_per_sample % 8) &&
+    (e == SOX_ENCODING_SIGN2 || e == SOX_ENCODING_UNSIGNED ||
+     e == SOX_ENCODING_FLOAT || e == SOX_ENCODING_ULAW ||
+     e == SOX_ENCODING_ALAW);
+}
+
+/* SOX_SAMPLE_TO_FLOAT_32BIT and SOX_FLOAT_32BIT_TO_SAMPLE for n samples that
+ * are step apart in the sox buffer, for plugin hosts (e.g. ladspa) whose
+ * plugins take float channel buffers; written without branches so that they
+ * vectorise, but giving the same results and clip counts */
+void lsx_samples_to_float(float * d, sox_sample_t const * s, size_t step,
+    size_t n, sox_uint64_t * clips)
+{
+  size_t i, c = 0;
+
+  for (i = 0; i < n; ++i) {
+    sox_sample_t x = s[i * step];
+    int over = x > SOX_SAMPLE_MAX - 64;
+    c += over;
+    x = over? 0 : (x + 64) & ~127;
+    d[i] = over? 1 : x * (float)(1. / (SOX_SAMPLE_MAX + 1.));
+  }
+  *clips += c;
+}
+
+void lsx_float_to_samples(sox_sample_t * d, size_t step, float const * s,
+    size_t n, sox_uint64_t * clips)
+{
+  size_t i, c = 0;
+
+  for (i = 0; i < n; ++i) {
+    float x = s[i] * (float)(SOX_SAMPLE_MAX + 1.);
+    int under = x < (float)SOX_SAMPLE_MIN;
+    int over = x >= (float)(SOX_SAMPLE_MAX + 1.);
+    c += under + (x > (float)(SOX_SAMPLE_MAX + 1.));
+    x = under | over? 0 : x;
+    d[i * step] = under? SOX_SAMPLE_MIN : over? SOX_SAMPLE_MAX :
+      (sox_sample_t)x;
+  }
+  *clips += c;
+}
+
+void lsx_partial_bytes(lsx_partial_t * s, void * x, size_t n)
+{
+  sox_bool fits = n <= s->size && s->pos <= s->size - n;
+
+  if (s->reading) {
+    if (fits)
+      memcpy(x, s->data + s->pos, n);
+    else memset(x, 0, n), s->error = sox_true;
+  }
+  else if (fits)
+    memcpy(s->data + s->pos, x, n);
+  s->pos += n;
+}
+
+void lsx_partial_u64(lsx_partial_t * s, uint64_t * x)
+{
+  unsigned char b[8];
+  int i;
+
+  for (i = 0; i < 8; ++i)
+    b[i] = (unsigned char)(*x >> (8 * i));
+  lsx_partial_bytes(s, b, sizeof(b));
+  if (s->reading)
+    for (*x = 0, i = 0; i < 8; ++i)
+      *x |= (uint64_t)b[i] << (8 * i);
+}
+
+void lsx_partial_i32(lsx_partial_t * s, int32_t * x)
+{
+  uint64_t u = (uint32_t)*x;
+
+  lsx_partial_u64(s, &u);
+  *x = (int32_t)(uint32_t)u;
+}
+
+void lsx_partial_f64(lsx_partial_t * s, double * x)
+{
+  uint64_t u;
+
+  assert_static(sizeof(u) == sizeof(*x), double_is_64_bits);
+  memcpy(&u, x, sizeof(u));
+  lsx_partial_u64(s, &u);
+  memcpy(x, &u, sizeof(u));
+}
+
+size_t lsx_span(sox_effect_t const * effp, uint64_t pos, size_t len,
+    size_t * lead)
+{
+  sox_effect_span_t const * span = &effp->span;
+  uint64_t end = span->length? span->lead_in + span->length : UINT64_MAX;
+
+  *lead = pos < span->lead_in? (size_t)min(len, span->lead_in - pos) : 0;
+  pos += *lead;
+  return pos < end? (size_t)min(len - *lead, end - pos) : 0;
+}
+
+int lsx_segments_open(sox_effect_t * effp, lsx_segments_t * s,
+    char const * filename)
+{
+  size_t len = strlen(filename);
+
+  memset(s, 0, sizeof(*s));
+  s->channels = effp->in_signal.channels;
+  s->json = len >= 5 && !strcmp(filename + len - 5, ".json");
+  if (!strcmp(filename, "-")) {
+    if (effp->global_info->global_info->stdout_in_use_by) {
+      lsx_fail("stdout already in use by `%s'", effp->global_info->global_info->stdout_in_use_by);
+      return SOX_EOF;
+    }
+    effp->global_info->global_info->stdout_in_use_by = effp->handler.name;
+    s->file = stdout;
+  }
+  else if (!(s->file = fopen(filename, "w"))) {
+    lsx_fail("can't open index file `%s': %s", filename, strerror(errno));
+    return SOX_EOF;
+  }
+  if (s->json)
+    fputs("[", s->file);
+  return SOX_SUCCESS;
+}
+
+void lsx_segments_measure(sox_sample_t const * buf, size_t n, double * peak,
+    double * sum2)
+{
+  double d, pk = *peak, sum = 0;
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    d = buf[i];
+    pk = max(pk, fabs(d));
+    sum += d * d;
+  }
+  *peak = pk, *sum2 += sum;
+}
+
+static int write_segment(lsx_segments_t * s)
+{
+  double peak = s->peak / ((double)SOX_SAMPLE_MAX + 1);
+  double rms = sqrt(s->sum2 / max(1, (s->end - s->start) * s->channels)) /
+      ((double)SOX_SAMPLE_MAX + 1);
+  int n;
+
+  if (s->json) {
+    n = fprintf(s->file, "%s\n  {\"start\": %" PRIu64 ", \"end\": %" PRIu64,
+        s->count? "," : "", s->start, s->end);
+    n = n < 0? n : peak? fprintf(s->file, ", \"peak\": %.2f, \"rms\": %.2f}",
+        linear_to_dB(peak), linear_to_dB(rms)) :
+      fprintf(s->file, ", \"peak\": null, \"rms\": null}");
+  }
+  else n = fprintf(s->file, "%" PRIu64 "s %" PRIu64 "s %.2f %.2f\n",
+      s->start, s->end, linear_to_dB(peak), linear_to_dB(rms));
+  ++s->count;
+  s->open = sox_false;
+  return n < 0? SOX_EOF : SOX_SUCCESS;
+}
+
+int lsx_segments_add(lsx_segments_t * s, uint64_t start, uint64_t end,
+    double peak, double sum2)
+{
+  int result = SOX_SUCCESS;
+
+  if (s->open && start <= s->end) {
+    if (end > s->end) {
+      s->end = end;
+      s->peak = max(s->peak, peak);
+      s->sum2 += sum2;
+    }
+    return result;
+  }
+  if (s->open)
+    result = write_segment(s);
+  s->open = end > start;
+  s->start = start, s->end = end;
+  s->peak = peak, s->sum2 = sum2;
+  return result;
+}
+
+int lsx_segments_close(sox_effect_t * effp, lsx_segments_t * s)
+{
+  int result = s->open? write_segment(s) : SOX_SUCCESS;
+
+  if (s->json && fputs(s->count? "\n]\n" : "]\n", s->file) < 0)
+    result = SOX_EOF;
+  if (fflush(s->file))
+    result = SOX_EOF;
+  if (s->file != stdout && fclose(s->file))
+    result = SOX_EOF;
+  if (result != SOX_SUCCESS)
+    lsx_fail("error writing index file: %s", strerror(errno));
+  s->file = NULL;
+  return result;
+}
+
 /*
  * lsx_parsesamples
  *
@@ -470,14 +929,55 @@ FILE * lsx_open_input_file(sox_effect_t * effp, char const * filename, sox_bool
   return file;
 }
 
+/* Reads the whole of an audio file (of any type that libSoX can read), e.g.
+ * an impulse response, giving its samples as doubles with each channel's
+ * contiguous (so length * channels in all), or NULL on failure; it should
+ * have the effect's sample-rate, and is used regardless if not. */
+double * lsx_read_audio_file(sox_effect_t * effp, char const * filename,
+    unsigned * channels, size_t * length)
+{
+  sox_format_t * ft = sox_open_read(filename, NULL, NULL, NULL);
+  sox_sample_t buf[8192];
+  double * x = NULL, * result = NULL;
+  size_t len, i, c, n = 0, alloc = 0;
+
+  if (!ft)
+    return NULL;
+  if (ft->signal.rate != effp->in_signal.rate)
+    lsx_warn("`%s' has sample-rate %g, not %g", filename,
+        ft->signal.rate, effp->in_signal.rate);
+  if (ft->signal.length != SOX_UNKNOWN_LEN)
+    lsx_valloc(x, alloc = (size_t)ft->signal.length);
+  while ((len = sox_read(ft, buf, array_length(buf))) > 0) {
+    if (n + len > alloc)
+      lsx_revalloc(x, alloc = max(2 * alloc, n + len));
+    for (i = 0; i < len; ++i)
+      x[n++] = SOX_SAMPLE_TO_FLOAT_64BIT(buf[i],);
+  }
+  if (ft->sox_errno)
+    lsx_fail("error reading `%s': %s", filename, ft->sox_errstr);
+  else {
+    *channels = ft->signal.channels;
+    *length = n / *channels;
+    lsx_valloc(result, *length * *channels + 1);
+    for (c = 0; c < *channels; ++c) for (i = 0; i < *length; ++i)
+      result[c * *length + i] = x[i * *channels + c];
+  }
+  free(x);
+  sox_close(ft);
+  return result;
+}
+
 int lsx_effects_init(void)
 {
   init_fft_cache();
+  init_design_cache();
   return SOX_SUCCESS;
 }
 
 int lsx_effects_quit(void)
 {
+  clear_design_cache();
   clear_fft_cache();
   return SOX_SUCCESS;
 }
@@ -25,67 +25,9 @@
 #include "sox_i.h"
 #include <assert.h>
 #include <string.h>
-
-/* Concurrent Control with "Readers" and "Writers", P.J. Courtois et al, 1971:*/
-
-#if defined HAVE_OPENMP
-
-typedef struct {
-  int readcount, writecount; /* initial value = 0 */
-  omp_lock_t mutex_1, mutex_2, mutex_3, w, r; /* initial value = 1 */
-} ccrw2_t; /* Problem #2: `writers-preference' */
-
-#define ccrw2_become_reader(p) do {\
-  omp_set_lock(&p.mutex_3);\
-    omp_set_lock(&p.r);\
-      omp_set_lock(&p.mutex_1);\
-        if (++p.readcount == 1) omp_set_lock(&p.w);\
-      omp_unset_lock(&p.mutex_1);\
-    omp_unset_lock(&p.r);\
-  omp_unset_lock(&p.mutex_3);\
-} while (0)
-#define ccrw2_cease_reading(p) do {\
-  omp_set_lock(&p.mutex_1);\
-    if (!--p.readcount) omp_unset_lock(&p.w);\
-  omp_unset_lock(&p.mutex_1);\
-} while (0)
-#define ccrw2_become_writer(p) do {\
-  omp_set_lock(&p.mutex_2);\
-    if (++p.writecount == 1) omp_set_lock(&p.r);\
-  omp_unset_lock(&p.mutex_2);\
-  omp_set_lock(&p.w);\
-} while (0)
-#define ccrw2_cease_writing(p) do {\
-  omp_unset_lock(&p.w);\
-  omp_set_lock(&p.mutex_2);\
-    if (!--p.writecount) omp_unset_lock(&p.r);\
-  omp_unset_lock(&p.mutex_2);\
-} while (0)
-#define ccrw2_init(p) do {\
-  omp_init_lock(&p.mutex_1);\
-  omp_init_lock(&p.mutex_2);\
-  omp_init_lock(&p.mutex_3);\
-  omp_init_lock(&p.w);\
-  omp_init_lock(&p.r);\
-} while (0)
-#define ccrw2_clear(p) do {\
-  omp_destroy_lock(&p.r);\
-  omp_destroy_lock(&p.w);\
-  omp_destroy_lock(&p.mutex_3);\
-  omp_destroy_lock(&p.mutex_2);\
-  omp_destroy_lock(&p.mutex_1);\
-} while (0)
-
-#else
-
-#define ccrw2_become_reader(x) (void)0
-#define ccrw2_cease_reading(x) (void)0
-#define ccrw2_become_writer(x) (void)0
-#define ccrw2_cease_writing(x) (void)0
-#define ccrw2_init(x) (void)0
-#define ccrw2_clear(x) (void)0
-
-#endif /* HAVE_OPENMP */
+#ifdef HAVE_DIRENT_H
+  #include <dirent.h>
+#endif
 
 /* Numerical Recipes cubic spline: */
 
@@ -156,75 +98,506 @@ int lsx_set_dft_length(int num_taps) /* Set to 4 x nearest power of 2 */
 }
 
 #include "fft4g.h"
-static int * lsx_fft_br;
-static double * lsx_fft_sc;
-static int fft_len = -1;
+
+/* Tables for each power-of-two length, built (once) by the first transform
+ * of that length and then only read, so that transforms need take no lock.
+ * A slot's tables are complete before the slot is published. */
+
+typedef struct {
+  int * br, * br_f;
+  double * sc;
+  float * sc_f;      /* For the single-precision transforms */
+} fft_tables_t;
+
+static fft_tables_t * fft_cache[32];
+static sox_bool fft_cache_ready;
 #if defined HAVE_OPENMP
-static ccrw2_t fft_cache_ccrw;
+static omp_lock_t fft_cache_lock;
 #endif
 
+static fft_tables_t * fft_cache_load(fft_tables_t * const * p)
+{
+#if defined __ATOMIC_ACQUIRE
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+  fft_tables_t * x = *(fft_tables_t * const volatile *)p;
+  #ifdef _OPENMP
+  #pragma omp flush
+  #endif
+  return x;
+#endif
+}
+
+static void fft_cache_store(fft_tables_t * * p, fft_tables_t * x)
+{
+#if defined __ATOMIC_RELEASE
+  __atomic_store_n(p, x, __ATOMIC_RELEASE);
+#else
+  #ifdef _OPENMP
+  #pragma omp flush
+  #endif
+  *(fft_tables_t * volatile *)p = x;
+#endif
+}
+
 void init_fft_cache(void)
 {
-  assert(lsx_fft_br == NULL);
-  assert(lsx_fft_sc == NULL);
-  assert(fft_len == -1);
-  ccrw2_init(fft_cache_ccrw);
-  fft_len = 0;
+  assert(!fft_cache_ready);
+#if defined HAVE_OPENMP
+  omp_init_lock(&fft_cache_lock);
+#endif
+  fft_cache_ready = sox_true;
 }
 
 void clear_fft_cache(void)
 {
-  assert(fft_len >= 0);
-  ccrw2_clear(fft_cache_ccrw);
-  free(lsx_fft_br);
-  free(lsx_fft_sc);
-  lsx_fft_sc = NULL;
-  lsx_fft_br = NULL;
-  fft_len = -1;
+  size_t i;
+
+  assert(fft_cache_ready);
+#if defined HAVE_OPENMP
+  omp_destroy_lock(&fft_cache_lock);
+#endif
+  for (i = 0; i < array_length(fft_cache); ++i) if (fft_cache[i]) {
+    free(fft_cache[i]->br);
+    free(fft_cache[i]->sc);
+    free(fft_cache[i]->br_f);
+    free(fft_cache[i]->sc_f);
+    free(fft_cache[i]);
+    fft_cache[i] = NULL;
+  }
+  fft_cache_ready = sox_false;
 }
 
-static sox_bool update_fft_cache(int len)
+static fft_tables_t * fft_tables(int len)
 {
+  int log2_len = 0;
+  fft_tables_t * t;
+
   assert(lsx_is_power_of_2(len));
-  assert(fft_len >= 0);
-  ccrw2_become_reader(fft_cache_ccrw);
-  if (len > fft_len) {
-    ccrw2_cease_reading(fft_cache_ccrw);
-    ccrw2_become_writer(fft_cache_ccrw);
-    if (len > fft_len) {
-      int old_n = fft_len;
-      fft_len = len;
-      lsx_fft_br = lsx_realloc(lsx_fft_br, dft_br_len(fft_len) * sizeof(*lsx_fft_br));
-      lsx_fft_sc = lsx_realloc(lsx_fft_sc, dft_sc_len(fft_len) * sizeof(*lsx_fft_sc));
-      if (!old_n)
-        lsx_fft_br[0] = 0;
-      return sox_true;
+  assert(fft_cache_ready);
+  while ((1 << log2_len) < len)
+    ++log2_len;
+  if (!(t = fft_cache_load(&fft_cache[log2_len]))) {
+#if defined HAVE_OPENMP
+    omp_set_lock(&fft_cache_lock);
+#endif
+    if (!(t = fft_cache[log2_len])) {
+      double * work = lsx_calloc((size_t)len, sizeof(*work));
+      float * work_f = lsx_calloc((size_t)len, sizeof(*work_f));
+      t = lsx_malloc(sizeof(*t));
+      t->br = lsx_malloc(dft_br_len(len) * sizeof(*t->br));
+      t->sc = lsx_malloc(dft_sc_len(len) * sizeof(*t->sc));
+      t->br_f = lsx_malloc(dft_br_len(len) * sizeof(*t->br_f));
+      t->sc_f = lsx_malloc(dft_sc_len(len) * sizeof(*t->sc_f));
+      t->br[0] = t->br_f[0] = 0;
+      lsx_trace1(fft__tables, len);
+      lsx_rdft(len, 1, work, t->br, t->sc); /* Makes both tables */
+      lsx_rdft_f(len, 1, work_f, t->br_f, t->sc_f);
+      free(work_f);
+      free(work);
+      fft_cache_store(&fft_cache[log2_len], t);
     }
-    ccrw2_cease_writing(fft_cache_ccrw);
-    ccrw2_become_reader(fft_cache_ccrw);
+#if defined HAVE_OPENMP
+    omp_unset_lock(&fft_cache_lock);
+#endif
   }
-  return sox_false;
+  return t;
 }
 
-static void done_with_fft_cache(sox_bool is_writer)
+void lsx_safe_rdft(int len, int type, double * d)
 {
-  if (is_writer)
-    ccrw2_cease_writing(fft_cache_ccrw);
-  else ccrw2_cease_reading(fft_cache_ccrw);
+  fft_tables_t const * t = fft_tables(len);
+  lsx_rdft(len, type, d, t->br, t->sc);
 }
 
-void lsx_safe_rdft(int len, int type, double * d)
+void lsx_safe_cdft(int len, int type, double * d)
 {
-  sox_bool is_writer = update_fft_cache(len);
-  lsx_rdft(len, type, d, lsx_fft_br, lsx_fft_sc);
-  done_with_fft_cache(is_writer);
+  fft_tables_t const * t = fft_tables(len);
+  lsx_cdft(len, type, d, t->br, t->sc);
 }
 
-void lsx_safe_cdft(int len, int type, double * d)
+void lsx_safe_rdft_f(int len, int type, float * d)
+{
+  fft_tables_t const * t = fft_tables(len);
+  lsx_rdft_f(len, type, d, t->br_f, t->sc_f);
+}
+
+void lsx_safe_cdft_f(int len, int type, float * d)
+{
+  fft_tables_t const * t = fft_tables(len);
+  lsx_cdft_f(len, type, d, t->br_f, t->sc_f);
+}
+
+/* Batches: count consecutive transforms of len at d, given to the client's
+ * back-end (sox_fft_backend_t) if big enough for it, else (or if it declines
+ * them) done here, on threads from context if not NULL. */
+static sox_fft_backend_t const * fft_backend(size_t count)
+{
+  sox_fft_backend_t const * b = sox_globals.fft_backend;
+  return b && count >= max(b->min_batch, 1) &&
+    sox_globals.chain_mode != SOX_CHAIN_REALTIME? b : NULL;
+}
+
+void lsx_safe_rdft_batch(int len, int type, size_t count, double * d,
+    sox_context_t const * context)
+{
+  sox_fft_backend_t const * b = fft_backend(count);
+  fft_tables_t const * t;
+  size_t threads;
+  long i;
+
+  if (b && b->rdft_batch(b->client_data, len, type, count, d) == SOX_SUCCESS)
+    return;
+  t = fft_tables(len);
+  threads = context? lsx_threads_for(context, count) : 1;
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) \
+      schedule(static)
+  for (i = 0; i < (long)count; ++i)
+    lsx_rdft(len, type, d + i * len, t->br, t->sc);
+  if (context)
+    lsx_threads_give(context, threads);
+}
+
+void lsx_safe_rdft_batch_f(int len, int type, size_t count, float * d,
+    sox_context_t const * context)
+{
+  sox_fft_backend_t const * b = fft_backend(count);
+  fft_tables_t const * t;
+  size_t threads;
+  long i;
+
+  if (b && b->rdft_batch_f &&
+      b->rdft_batch_f(b->client_data, len, type, count, d) == SOX_SUCCESS)
+    return;
+  t = fft_tables(len);
+  threads = context? lsx_threads_for(context, count) : 1;
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) \
+      schedule(static)
+  for (i = 0; i < (long)count; ++i)
+    lsx_rdft_f(len, type, d + i * len, t->br_f, t->sc_f);
+  if (context)
+    lsx_threads_give(context, threads);
+}
+
+/* Process-wide cache of filter designs, so that effects started many times
+ * with the same parameters design their filters once.  Each design is keyed
+ * on its name and parameters; it is kept, whilst memory allows, after its
+ * last user has released it, and is also kept on disk (as a file named by
+ * the key's hash) if sox_globals.design_cache_path is set. */
+
+typedef struct design {
+  struct design * next;
+  char       * key;
+  size_t     key_len;
+  double     * data;
+  int        len, extra, refs;
+} design_t;
+
+#define DESIGN_MAGIC "SoX design 1"
+#define DESIGNS_MAX_SIZE ((size_t)64 << 20) /* Bytes kept when not in use */
+static design_t * designs;                  /* Most recently used first */
+static size_t designs_size;
+#if defined HAVE_OPENMP
+static omp_lock_t designs_lock;
+#endif
+
+void init_design_cache(void)
+{
+#if defined HAVE_OPENMP
+  omp_init_lock(&designs_lock);
+#endif
+}
+
+static void delete_design(design_t * d)
+{
+  designs_size -= d->len * sizeof(*d->data);
+  free(d->key);
+  free(d->data);
+  free(d);
+}
+
+void clear_design_cache(void)
+{
+  while (designs) {
+    design_t * d = designs;
+    designs = d->next;
+    delete_design(d);
+  }
+#if defined HAVE_OPENMP
+  omp_destroy_lock(&designs_lock);
+#endif
+}
+
+static char * design_key(char const * name, double const * params,
+    int num_params, size_t * key_len)
+{
+  size_t name_len = strlen(name) + 1;
+  char * key = lsx_malloc(*key_len = name_len + num_params * sizeof(*params));
+  memcpy(key, name, name_len);
+  memcpy(key + name_len, params, num_params * sizeof(*params));
+  return key;
+}
+
+static uint64_t design_hash(char const * key, size_t key_len)
+{
+  uint64_t hash = 14695981039346656037u; /* FNV-1a */
+  size_t i;
+
+  for (i = 0; i < key_len; ++i)
+    hash = (hash ^ (unsigned char)key[i]) * 1099511628211u;
+  return hash;
+}
+
+static char * design_file_name(char const * key, size_t key_len)
+{
+  char const * path = sox_globals.design_cache_path;
+  char * name = lsx_malloc(strlen(path) + 32);
+  uint64_t hash = design_hash(key, key_len);
+
+  sprintf(name, "%s/%08lx%08lx.sox", path,
+      (unsigned long)(hash >> 32), (unsigned long)(hash & 0xffffffff));
+  return name;
+}
+
+/* Reads a design as written by save_design; if key is given, only if the
+ * design's key is the same */
+static design_t * read_design(FILE * file, char const * key, size_t key_len)
+{
+  char magic[sizeof(DESIGN_MAGIC)], * key1 = NULL;
+  design_t * d = NULL;
+  size_t key1_len;
+  int len, extra;
+
+  if (fread(magic, sizeof(magic), (size_t)1, file) == 1 &&
+      !memcmp(magic, DESIGN_MAGIC, sizeof(magic)) &&
+      fread(&key1_len, sizeof(key1_len), (size_t)1, file) == 1 &&
+      (key? key1_len == key_len : key1_len <= 4096)) {
+    key1 = lsx_malloc(key1_len);
+    if (fread(key1, key1_len, (size_t)1, file) == 1 &&
+        (!key || !memcmp(key, key1, key_len)) &&
+        fread(&len, sizeof(len), (size_t)1, file) == 1 && len > 0 &&
+        fread(&extra, sizeof(extra), (size_t)1, file) == 1) {
+      d = lsx_calloc(1, sizeof(*d));
+      d->data = lsx_malloc(len * sizeof(*d->data));
+      if (fread(d->data, sizeof(*d->data), (size_t)len, file) != (size_t)len) {
+        free(d->data);
+        free(d);
+        d = NULL;
+      }
+      else {
+        d->len = len, d->extra = extra;
+        d->key = key1, d->key_len = key1_len, key1 = NULL;
+      }
+    }
+    free(key1);
+  }
+  return d;
+}
+
+/* Loads the design of the given key from the cache directory; if found,
+ * takes the key, else leaves it to the caller */
+static design_t * load_design(char * key, size_t key_len)
+{
+  char * name = design_file_name(key, key_len);
+  FILE * file = fopen(name, "rb");
+  design_t * d = NULL;
+
+  if (file) {
+    d = read_design(file, key, key_len);
+    fclose(file);
+  }
+  if (d) {
+    lsx_debug_more("loaded design from `%s'", name);
+    free(d->key);
+    d->key = key;
+    designs_size += d->len * sizeof(*d->data);
+  }
+  free(name);
+  return d;
+}
+
+static void save_design(design_t const * d)
+{
+  char * name = design_file_name(d->key, d->key_len);
+  char * tmp_name = lsx_malloc(strlen(name) + 5);
+  FILE * file = fopen(strcat(strcpy(tmp_name, name), ".tmp"), "wb");
+  sox_bool ok = file &&
+    fwrite(DESIGN_MAGIC, sizeof(DESIGN_MAGIC), (size_t)1, file) == 1 &&
+    fwrite(&d->key_len, sizeof(d->key_len), (size_t)1, file) == 1 &&
+    fwrite(d->key, d->key_len, (size_t)1, file) == 1 &&
+    fwrite(&d->len, sizeof(d->len), (size_t)1, file) == 1 &&
+    fwrite(&d->extra, sizeof(d->extra), (size_t)1, file) == 1 &&
+    fwrite(d->data, sizeof(*d->data), (size_t)d->len, file) == (size_t)d->len;
+
+  if (file && fclose(file))
+    ok = sox_false;
+  if (!ok || rename(tmp_name, name)) {
+    lsx_debug_more("couldn't save design to `%s'", name);
+    remove(tmp_name);
+  }
+  free(tmp_name);
+  free(name);
+}
+
+/* Frees unused designs (least recently used first) whilst over the limit */
+static void trim_designs(void)
+{
+  design_t * * p = &designs, * * unused = NULL;
+
+  for (; *p; p = &(*p)->next)
+    if (!(*p)->refs)
+      unused = p;
+  if (designs_size > DESIGNS_MAX_SIZE && unused) {
+    design_t * d = *unused;
+    *unused = d->next;
+    delete_design(d);
+    trim_designs();
+  }
+}
+
+/* Returns the design (which is not to be modified) of the given name and
+ * parameters, with its length and an extra value (e.g. post_peak) if
+ * cached, or NULL if not.  Call lsx_design_release when done with it. */
+double const * lsx_design_get(char const * name, double const * params,
+    int num_params, int * len, int * extra)
+{
+  size_t key_len;
+  char * key = design_key(name, params, num_params, &key_len);
+  design_t * * p, * d;
+
+#if defined HAVE_OPENMP
+  omp_set_lock(&designs_lock);
+#endif
+  for (p = &designs; *p; p = &(*p)->next)
+    if ((*p)->key_len == key_len && !memcmp((*p)->key, key, key_len))
+      break;
+  if ((d = *p)) {
+    *p = d->next;
+    free(key);
+  }
+  else if (sox_globals.design_cache_path && (d = load_design(key, key_len)));
+  else free(key);
+  if (d) {
+    d->next = designs, designs = d;
+    ++d->refs;
+    *len = d->len;
+    *extra = d->extra;
+  }
+#if defined HAVE_OPENMP
+  omp_unset_lock(&designs_lock);
+#endif
+  return d? d->data : NULL;
+}
+
+/* Adds a design (which should have been allocated with lsx_malloc and is
+ * then owned by the cache) as if by lsx_design_get; returns data. */
+double const * lsx_design_put(char const * name, double const * params,
+    int num_params, double * data, int len, int extra)
+{
+  design_t * d = lsx_calloc(1, sizeof(*d));
+
+  d->key = design_key(name, params, num_params, &d->key_len);
+  d->data = data;
+  d->len = len;
+  d->extra = extra;
+  d->refs = 1;
+#if defined HAVE_OPENMP
+  omp_set_lock(&designs_lock);
+#endif
+  d->next = designs, designs = d;
+  designs_size += len * sizeof(*data);
+  if (sox_globals.design_cache_path)
+    save_design(d);
+  trim_designs();
+#if defined HAVE_OPENMP
+  omp_unset_lock(&designs_lock);
+#endif
+  return data;
+}
+
+void lsx_design_release(double const * data)
+{
+  design_t * d;
+
+#if defined HAVE_OPENMP
+  omp_set_lock(&designs_lock);
+#endif
+  for (d = designs; d && d->data != data; d = d->next);
+  assert(d && d->refs > 0);
+  --d->refs;
+  trim_designs();
+#if defined HAVE_OPENMP
+  omp_unset_lock(&designs_lock);
+#endif
+}
+
+/* Loads those designs in the cache directory not already held, until they
+ * would take more memory than is kept when unused; returns how many */
+static size_t load_designs(void)
+{
+  size_t n = 0;
+#ifdef HAVE_DIRENT_H
+  char const * path = sox_globals.design_cache_path;
+  DIR * dir = path? opendir(path) : NULL;
+  struct dirent * entry;
+  uint64_t * held = NULL;
+  size_t i, num_held = 0;
+  design_t * d;
+
+  if (!dir)
+    return 0;
+#if defined HAVE_OPENMP
+  omp_set_lock(&designs_lock);
+#endif
+  for (d = designs; d; d = d->next) {
+    lsx_revalloc(held, num_held + 1);
+    held[num_held++] = design_hash(d->key, d->key_len);
+  }
+  while ((entry = readdir(dir)) && designs_size < DESIGNS_MAX_SIZE) {
+    char * end, * name;
+    uint64_t hash = strtoull(entry->d_name, &end, 16);
+    FILE * file;
+
+    if (end != entry->d_name + 16 || strcmp(end, ".sox"))
+      continue;
+    for (i = 0; i < num_held && held[i] != hash; ++i);
+    if (i < num_held)
+      continue;
+    name = lsx_malloc(strlen(path) + strlen(entry->d_name) + 2);
+    sprintf(name, "%s/%s", path, entry->d_name);
+    if ((file = fopen(name, "rb"))) {
+      if ((d = read_design(file, NULL, (size_t)0)) &&
+          design_hash(d->key, d->key_len) == hash) {
+        d->next = designs, designs = d;
+        designs_size += d->len * sizeof(*d->data);
+        ++n;
+      }
+      else if (d) {
+        free(d->key);
+        free(d->data);
+        free(d);
+      }
+      fclose(file);
+    }
+    free(name);
+  }
+  trim_designs();
+#if defined HAVE_OPENMP
+  omp_unset_lock(&designs_lock);
+#endif
+  closedir(dir);
+  free(held);
+#endif
+  return n;
+}
+
+size_t sox_warm_caches(size_t max_dft_len)
 {
-  sox_bool is_writer = update_fft_cache(len);
-  lsx_cdft(len, type, d, lsx_fft_br, lsx_fft_sc);
-  done_with_fft_cache(is_writer);
+  size_t len;
+
+  for (len = 2; len <= max_dft_len && len <= (size_t)1 << 30; len <<= 1)
+    fft_tables((int)len);
+  return load_designs();
 }
 
 void lsx_power_spectrum(int n, double const * in, double * out)
@@ -252,6 +625,302 @@ void lsx_power_spectrum_f(int n, float const * in, float * out)
   free(work);
 }
 
+/* Finds the position at which a block of samples is most like (by least
+ * squares) a given one, as do tempo and splice, but by DFT cross-correlation
+ * rather than by summing the differences at each position.  Fill m->x with
+ * the (search - 1) * stride + n samples to be searched and m->y with the n
+ * samples to match, then call lsx_match; this returns the i (< search)
+ * that minimises the sum over j (< n) of (x[i * stride + j] - y[j])^2. */
+void lsx_match_create(lsx_match_t * m, size_t n, size_t search, size_t stride)
+{
+  size_t x_len = (search - 1) * stride + n;
+
+  m->n = n;
+  m->search = search;
+  m->stride = stride;
+  for (m->dft_length = 4; (size_t)m->dft_length < x_len; m->dft_length <<= 1);
+  m->x = lsx_malloc(m->dft_length * sizeof(*m->x));
+  m->y = lsx_malloc(m->dft_length * sizeof(*m->y));
+  m->energy = lsx_malloc(search * sizeof(*m->energy));
+}
+
+size_t lsx_match(lsx_match_t * m)
+{
+  size_t i, j, best_pos = 0, x_len = (m->search - 1) * m->stride + m->n;
+  double e = 0, diff, least_diff = 0, scale = 2. / m->dft_length;
+  double * x = m->x, * y = m->y;
+
+  for (j = 0; j < m->n; ++j)        /* Energy of x at each position */
+    e += sqr(x[j]);
+  for (i = 0; m->energy[i] = e, i + 1 < m->search; ++i)
+    for (j = i * m->stride; j < (i + 1) * m->stride; ++j)
+      e += sqr(x[j + m->n]) - sqr(x[j]);
+
+  memset(x + x_len, 0, (m->dft_length - x_len) * sizeof(*x));
+  memset(y + m->n, 0, (m->dft_length - m->n) * sizeof(*y));
+  lsx_safe_rdft(m->dft_length, 1, x);
+  lsx_safe_rdft(m->dft_length, 1, y);
+  x[0] *= y[0];                     /* x times the conjugate of y */
+  x[1] *= y[1];
+  for (j = 2; j < (size_t)m->dft_length; j += 2) {
+    double tmp = x[j];
+    x[j    ] = x[j] * y[j] + x[j + 1] * y[j + 1];
+    x[j + 1] = x[j + 1] * y[j] - tmp * y[j + 1];
+  }
+  lsx_safe_rdft(m->dft_length, -1, x); /* x[k] = scale * sum x[k+j] * y[j] */
+
+  for (i = 0; i < m->search; ++i) { /* Sum of squares less that of y */
+    diff = m->energy[i] - 2 * scale * x[i * m->stride];
+    if (!i || diff < least_diff)
+      least_diff = diff, best_pos = i;
+  }
+  return best_pos;
+}
+
+void lsx_match_delete(lsx_match_t * m)
+{
+  free(m->energy);
+  free(m->y);
+  free(m->x);
+}
+
+/* Direct convolution with a short FIR, for which a DFT (as by dft_filter)
+ * costs more than it saves: out[i] (i < len) is given the sum over j (< n)
+ * of h[j] * in[i - j], so the n - 1 samples before in[0] must hold the
+ * history; out must not overlap in.  A block of outputs at a time is
+ * accumulated tap by tap (four at once), so that each inner loop runs along
+ * the block and vectorises, and needs no circular indexing. */
+#define FIR_BLOCK 256
+
+void lsx_fir_convolve(double const * h, int n, double const * in,
+    double * out, size_t len)
+{
+  size_t i, j;
+
+  for (i = 0; i < len; i += FIR_BLOCK) {
+    size_t m = min(FIR_BLOCK, len - i);
+    double const * x = in + i;
+    double * o = out + i;
+    int k = 0;
+
+    memset(o, 0, m * sizeof(*o));
+    for (; k + 4 <= n; k += 4) {
+      double h0 = h[k], h1 = h[k + 1], h2 = h[k + 2], h3 = h[k + 3];
+      double const * x0 = x - k, * x1 = x0 - 1, * x2 = x0 - 2, * x3 = x0 - 3;
+      for (j = 0; j < m; ++j)
+        o[j] += h0 * x0[j] + h1 * x1[j] + h2 * x2[j] + h3 * x3[j];
+    }
+    for (; k < n; ++k) {
+      double hk = h[k];
+      double const * xk = x - k;
+      for (j = 0; j < m; ++j)
+        o[j] += hk * xk[j];
+    }
+  }
+}
+
+/* A cascade of second-order sections (biquads) over len frames of chans
+ * interleaved channels: coefs holds b0 b1 b2 a1 a2 (a0 being 1) per section,
+ * and state i1 i2 o1 o2 per section, each of those per channel (so chans
+ * apart).  Each section's output is rounded and clipped (as by
+ * SOX_ROUND_CLIP_COUNT) to give the next's input, or the output, just as if
+ * the sections were separate biquad effects.  The recursion is serial in
+ * time, so the channels are taken together instead, as vector lanes; and a
+ * block of frames is taken through each section in turn, with the section's
+ * state held in registers. */
+#define SOS_BLOCK 64
+
+static void sos_lane(double const * coefs, size_t num_sections,
+    double * state, size_t chans, sox_sample_t const * in, sox_sample_t * out,
+    size_t len, sox_uint64_t * clips)
+{
+  double x[SOS_BLOCK];
+  size_t i, j, s;
+
+  for (i = 0; i < len; i += SOS_BLOCK) {
+    size_t m = min(SOS_BLOCK, len - i);
+    for (j = 0; j < m; ++j)
+      x[j] = in[(i + j) * chans];
+    for (s = 0; s < num_sections; ++s) {
+      double const * k = coefs + 5 * s;
+      double * st = state + 4 * s * chans;
+      double i1 = st[0], i2 = st[chans], o1 = st[2 * chans], o2 = st[3 * chans];
+      for (j = 0; j < m; ++j) {
+        double o0 = x[j]*k[0] + i1*k[1] + i2*k[2] - o1*k[3] - o2*k[4];
+        i2 = i1, i1 = x[j];
+        o2 = o1, o1 = o0;
+        x[j] = (sox_sample_t)SOX_ROUND_CLIP_COUNT(o0, *clips);
+      }
+      st[0] = i1, st[chans] = i2, st[2 * chans] = o1, st[3 * chans] = o2;
+    }
+    for (j = 0; j < m; ++j)
+      out[(i + j) * chans] = (sox_sample_t)x[j];
+  }
+}
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAVE_SOS_PAIR
+
+/* As sos_lane, for two adjacent channels at once; the sums are formed in
+ * the same order, so the results are the same */
+static void sos_pair(double const * coefs, size_t num_sections,
+    double * state, size_t chans, sox_sample_t const * in, sox_sample_t * out,
+    size_t len, sox_uint64_t * clips)
+{
+  __m128d const sign = _mm_set1_pd(-0.), half = _mm_set1_pd(.5);
+  __m128d const hi = _mm_set1_pd(SOX_SAMPLE_MAX + .5);
+  __m128d const lo = _mm_set1_pd(SOX_SAMPLE_MIN - .5);
+  __m128d const max = _mm_set1_pd((double)SOX_SAMPLE_MAX);
+  __m128d const min = _mm_set1_pd((double)SOX_SAMPLE_MIN);
+  __m128d x[SOS_BLOCK];
+  size_t i, j, s, clipped = 0;
+
+  for (i = 0; i < len; i += SOS_BLOCK) {
+    size_t m = min(SOS_BLOCK, len - i);
+    for (j = 0; j < m; ++j)
+      x[j] = _mm_cvtepi32_pd(
+          _mm_loadl_epi64((__m128i const *)(in + (i + j) * chans)));
+    for (s = 0; s < num_sections; ++s) {
+      double const * k = coefs + 5 * s;
+      double * st = state + 4 * s * chans;
+      __m128d const k0 = _mm_set1_pd(k[0]), k1 = _mm_set1_pd(k[1]);
+      __m128d const k2 = _mm_set1_pd(k[2]), k3 = _mm_set1_pd(k[3]);
+      __m128d const k4 = _mm_set1_pd(k[4]);
+      __m128d i1 = _mm_loadu_pd(st), i2 = _mm_loadu_pd(st + chans);
+      __m128d o1 = _mm_loadu_pd(st + 2 * chans), o2 = _mm_loadu_pd(st + 3 * chans);
+      for (j = 0; j < m; ++j) {
+        __m128d o0 = _mm_add_pd(_mm_mul_pd(x[j], k0), _mm_mul_pd(i1, k1)), r;
+        int c;
+        o0 = _mm_add_pd(o0, _mm_mul_pd(i2, k2));
+        o0 = _mm_sub_pd(o0, _mm_mul_pd(o1, k3));
+        o0 = _mm_sub_pd(o0, _mm_mul_pd(o2, k4));
+        i2 = i1, i1 = x[j];
+        o2 = o1, o1 = o0;
+        c = _mm_movemask_pd(_mm_or_pd(_mm_cmpge_pd(o0, hi), _mm_cmple_pd(o0, lo)));
+        clipped += (size_t)((c & 1) + (c >> 1));
+        r = _mm_add_pd(o0, _mm_or_pd(_mm_and_pd(o0, sign), half)); /* +-.5 */
+        r = _mm_min_pd(_mm_max_pd(r, min), max); /* Then truncated, as by C */
+        x[j] = _mm_cvtepi32_pd(_mm_cvttpd_epi32(r));
+      }
+      _mm_storeu_pd(st, i1), _mm_storeu_pd(st + chans, i2);
+      _mm_storeu_pd(st + 2 * chans, o1), _mm_storeu_pd(st + 3 * chans, o2);
+    }
+    for (j = 0; j < m; ++j)
+      _mm_storel_epi64((__m128i *)(out + (i + j) * chans), _mm_cvttpd_epi32(x[j]));
+  }
+  *clips += clipped;
+}
+#endif
+
+void lsx_sos_filter(double const * coefs, size_t num_sections,
+    double * state, size_t chans, sox_sample_t const * in, sox_sample_t * out,
+    size_t len, sox_uint64_t * clips)
+{
+  size_t c = 0;
+
+#ifdef HAVE_SOS_PAIR
+  for (; c + 2 <= chans; c += 2)
+    sos_pair(coefs, num_sections, state + c, chans, in + c, out + c, len, clips);
+#endif
+  for (; c < chans; ++c)
+    sos_lane(coefs, num_sections, state + c, chans, in + c, out + c, len, clips);
+}
+
+/* Each of these replaces x[i], i < n, by a function of it: with fast not
+ * set, as given by libm; otherwise by a branch-free approximation that
+ * vectorises, over an argument range and to a maximum error as given.
+ * (--fast-math, sox_globals_t.fast_math, chooses which, for a chain.) */
+
+#define ROUND_MAGIC 6755399441055744. /* 1.5 * 2^52: adding it rounds to an
+                                         integer, held in the low bits */
+
+/* Relative error < 3e-10 for |x| <= 708 (and meaningless beyond) */
+void lsx_exp_n(double * x, size_t n, sox_bool fast)
+{
+  size_t i;
+
+  if (!fast) {
+    for (i = 0; i < n; ++i)
+      x[i] = exp(x[i]);
+    return;
+  }
+  for (i = 0; i < n; ++i) {
+    double k = x[i] * M_LOG2E + ROUND_MAGIC, q = k - ROUND_MAGIC;
+    double r = x[i] - q * 6.93147180369123816490e-01 /* ln 2, high part */
+                 - q * 1.90821492927058770002e-10 /* and low part */, s;
+    uint64_t u;
+
+    memcpy(&u, &k, sizeof(u));
+    u = (u + 1023) << 52;                 /* 2^q */
+    memcpy(&s, &u, sizeof(s));
+    x[i] = s * (1 + r * (1 + r * (1./2 + r * (1./6 + r * (1./24 +
+          r * (1./120 + r * (1./720 + r * (1./5040 + r * (1./40320)))))))));
+  }
+}
+
+/* Absolute error < 1e-11 for normal x > 0; x <= 0 gives about -308 */
+void lsx_log10_n(double * x, size_t n, sox_bool fast)
+{
+  size_t i;
+
+  if (!fast) {
+    for (i = 0; i < n; ++i)
+      x[i] = log10(x[i]);
+    return;
+  }
+  for (i = 0; i < n; ++i) {
+    double m, e, t, t2;
+    uint64_t u, v;
+
+    memcpy(&u, &x[i], sizeof(u));
+    u = (u & 0x7fffffffffffffff) + (0x3ff0000000000000 - 0x3fe6a09e667f3bcd);
+    v = (u >> 52) | 0x4330000000000000;           /* 2^52 + exponent */
+    memcpy(&e, &v, sizeof(e));
+    e -= 4503599627370496. + 1023;
+    u = (u & 0x000fffffffffffff) + 0x3fe6a09e667f3bcd;
+    memcpy(&m, &u, sizeof(m));                    /* [sqrt(.5), sqrt(2)) */
+    t = (m - 1) / (m + 1), t2 = t * t;            /* |t| < .172 */
+    x[i] = (e * M_LN2 + 2 * t * (1 + t2 * (1./3 + t2 * (1./5 + t2 * (1./7 +
+          t2 * (1./9 + t2 * (1./11))))))) * M_LOG10E;
+  }
+}
+
+/* sin (quad 0) or cos (quad 1); absolute error < 1e-11 for |x| < 2^20 */
+static void sincos_n(double * x, size_t n, sox_bool fast, unsigned quad)
+{
+  size_t i;
+
+  if (!fast) {
+    for (i = 0; i < n; ++i)
+      x[i] = quad? cos(x[i]) : sin(x[i]);
+    return;
+  }
+  for (i = 0; i < n; ++i) {
+    double k = x[i] * M_2_PI + ROUND_MAGIC, q = k - ROUND_MAGIC;
+    double r = x[i] - q * 1.57079632673412561417e+00 /* pi/2, high part */
+                    - q * 6.07710050650619224932e-11 /* and low part */;
+    double r2 = r * r, s, c;
+    uint64_t u, us, uc, odd;
+
+    s = r + r * r2 * (-1./6 + r2 * (1./120 + r2 * (-1./5040 +
+          r2 * (1./362880 + r2 * (-1./39916800)))));
+    c = 1 + r2 * (-1./2 + r2 * (1./24 + r2 * (-1./720 + r2 * (1./40320 +
+          r2 * (-1./3628800 + r2 * (1./479001600))))));
+    memcpy(&u, &k, sizeof(u));
+    u += quad;                            /* Quadrant, in the low 2 bits */
+    memcpy(&us, &s, sizeof(us));
+    memcpy(&uc, &c, sizeof(uc));
+    odd = -(u & 1);                       /* Select by masks, to vectorise */
+    us = ((uc & odd) | (us & ~odd)) ^ (u & 2) << 62;
+    memcpy(&x[i], &us, sizeof(us));
+  }
+}
+
+void lsx_sin_n(double * x, size_t n, sox_bool fast) {sincos_n(x, n, fast, 0);}
+void lsx_cos_n(double * x, size_t n, sox_bool fast) {sincos_n(x, n, fast, 1);}
+
 void lsx_apply_hann_f(float h[], const int num_points)
 {
   int i, m = num_points - 1;
@@ -578,7 +1247,59 @@ void lsx_plot_fir(double * h, int num_points, sox_rate_t rate, sox_plot_t type,
   #endif
 #endif
 
-#if defined lrint32
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+/* As lrint32 with FE_INVALID below, without the FP environment: values
+ * round to nearest (even), so those from SOX_SAMPLE_MAX + .5 up, and those
+ * below SOX_SAMPLE_MIN - .5 (or NaN), are clipped; found by compare. */
+void lsx_save_samples(sox_sample_t * const dest, double const * const src,
+    size_t const n, sox_uint64_t * const clips)
+{
+  __m128d const hi = _mm_set1_pd(SOX_SAMPLE_MAX + .5);
+  __m128d const lo = _mm_set1_pd(SOX_SAMPLE_MIN - .5);
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128d a = _mm_loadu_pd(src + i), b = _mm_loadu_pd(src + i + 2);
+    __m128d ha = _mm_cmpge_pd(a, hi), hb = _mm_cmpge_pd(b, hi);
+    __m128d la = _mm_cmpnge_pd(a, lo), lb = _mm_cmpnge_pd(b, lo);
+    __m128i r = _mm_unpacklo_epi64(_mm_cvtpd_epi32(a), _mm_cvtpd_epi32(b));
+    int m = _mm_movemask_pd(_mm_or_pd(ha, la)) << 2 |
+            _mm_movemask_pd(_mm_or_pd(hb, lb));
+
+    if (m) { /* Out of range gave SOX_SAMPLE_MIN; flip the highs to MAX */
+      r = _mm_xor_si128(r, _mm_castps_si128(_mm_shuffle_ps(
+          _mm_castpd_ps(ha), _mm_castpd_ps(hb), _MM_SHUFFLE(2, 0, 2, 0))));
+      *clips += (m & 1) + (m >> 1 & 1) + (m >> 2 & 1) + (m >> 3);
+    }
+    _mm_storeu_si128((__m128i *)(dest + i), r);
+  }
+  for (; i < n; ++i) {
+    if (src[i] >= SOX_SAMPLE_MAX + .5)
+      dest[i] = SOX_SAMPLE_MAX, ++*clips;
+    else if (!(src[i] >= SOX_SAMPLE_MIN - .5))
+      dest[i] = SOX_SAMPLE_MIN, ++*clips;
+    else dest[i] = _mm_cvtsd_si32(_mm_load_sd(src + i));
+  }
+}
+
+void lsx_load_samples(double * const dest, sox_sample_t const * const src,
+    size_t const n)
+{
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((__m128i const *)(src + i));
+    _mm_storeu_pd(dest + i, _mm_cvtepi32_pd(x));
+    _mm_storeu_pd(dest + i + 2, _mm_cvtepi32_pd(_mm_unpackhi_epi64(x, x)));
+  }
+  for (; i < n; ++i)
+    dest[i] = src[i];
+}
+
+#elif defined lrint32
 #define _ dest[i] = lrint32(src[i]), ++i,
 #pragma STDC FENV_ACCESS ON
 
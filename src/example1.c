@@ -84,7 +84,8 @@ static int output_flow(sox_effect_t *effp LSX_UNUSED, sox_sample_t const * ibuf,
 static sox_effect_handler_t const * input_handler(void)
 {
   static sox_effect_handler_t handler = {
-    "input", NULL, SOX_EFF_MCHAN, NULL, NULL, NULL, input_drain, NULL, NULL, 0
+    "input", NULL, SOX_EFF_MCHAN, NULL, NULL, NULL, input_drain, NULL, NULL, 0, NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -94,7 +95,8 @@ static sox_effect_handler_t const * input_handler(void)
 static sox_effect_handler_t const * output_handler(void)
 {
   static sox_effect_handler_t handler = {
-    "output", NULL, SOX_EFF_MCHAN, NULL, NULL, output_flow, NULL, NULL, NULL, 0
+    "output", NULL, SOX_EFF_MCHAN, NULL, NULL, output_flow, NULL, NULL, NULL, 0, NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
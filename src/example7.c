@@ -0,0 +1,116 @@
+/* Simple example of using SoX libraries
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifdef NDEBUG /* N.B. assert used with active statements so enable always. */
+#undef NDEBUG /* Must undef above assert.h or other that might include it. */
+#endif
+
+#include "sox.h"
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+ * Shows how to make several outputs from one decode of the input, by
+ * branching the effects chain.
+ *
+ * Reads an input file, and writes it unchanged to the first output file,
+ * resampled to 48kHz to the second, and mixed down to mono to the third.
+ *
+ * For example:
+ *
+ *   ./example7 input.flac copy.wav 48k.wav mono.wav
+ */
+
+/* Ends the given chain with an output to the given file */
+static void add_output(sox_effects_chain_t * chain, sox_format_t * out,
+    sox_signalinfo_t * signal)
+{
+  sox_effect_t * e = sox_create_effect(sox_find_effect("output"));
+  char * args[1];
+
+  args[0] = (char *)out, assert(sox_effect_options(e, 1, args) == SOX_SUCCESS);
+  assert(sox_add_effect(chain, e, signal, &out->signal) == SOX_SUCCESS);
+  free(e);
+}
+
+int main(int argc, char * argv[])
+{
+  static sox_format_t * in, * out[3]; /* input and output files */
+  sox_effects_chain_t * chain, * branch;
+  sox_effect_t * e;
+  char * args[10];
+  sox_signalinfo_t interm_signal, out_signal;
+
+  assert(argc == 5);
+  assert(sox_init() == SOX_SUCCESS);
+  assert((in = sox_open_read(argv[1], NULL, NULL, NULL)));
+  assert((out[0] = sox_open_write(argv[2], &in->signal, NULL, NULL, NULL, NULL)));
+  out_signal = in->signal;
+  out_signal.rate = 48000;
+  assert((out[1] = sox_open_write(argv[3], &out_signal, NULL, NULL, NULL, NULL)));
+  out_signal = in->signal;
+  out_signal.channels = 1;
+  assert((out[2] = sox_open_write(argv[4], &out_signal, NULL, NULL, NULL, NULL)));
+
+  chain = sox_create_effects_chain(&in->encoding, &out[0]->encoding);
+
+  interm_signal = in->signal; /* NB: deep copy */
+
+  e = sox_create_effect(sox_find_effect("input"));
+  args[0] = (char *)in, assert(sox_effect_options(e, 1, args) == SOX_SUCCESS);
+  assert(sox_add_effect(chain, e, &interm_signal, &in->signal) == SOX_SUCCESS);
+  free(e);
+
+  /* The first branch resamples; it starts from the decoded audio */
+  branch = sox_add_branch(chain, &out[1]->encoding);
+  assert(branch);
+  interm_signal = branch->effects[0]->out_signal;
+  if (interm_signal.rate != out[1]->signal.rate) {
+    e = sox_create_effect(sox_find_effect("rate"));
+    assert(sox_effect_options(e, 0, NULL) == SOX_SUCCESS);
+    assert(sox_add_effect(branch, e, &interm_signal, &out[1]->signal) == SOX_SUCCESS);
+    free(e);
+  }
+  add_output(branch, out[1], &interm_signal);
+
+  /* The second, from the same point, mixes down */
+  branch = sox_add_branch(chain, &out[2]->encoding);
+  assert(branch);
+  interm_signal = branch->effects[0]->out_signal;
+  if (interm_signal.channels != out[2]->signal.channels) {
+    e = sox_create_effect(sox_find_effect("channels"));
+    assert(sox_effect_options(e, 0, NULL) == SOX_SUCCESS);
+    assert(sox_add_effect(branch, e, &interm_signal, &out[2]->signal) == SOX_SUCCESS);
+    free(e);
+  }
+  add_output(branch, out[2], &interm_signal);
+
+  /* The chain itself goes on to the first output */
+  interm_signal = in->signal;
+  add_output(chain, out[0], &interm_signal);
+
+  sox_flow_effects(chain, NULL, NULL);
+
+  sox_delete_effects_chain(chain); /* Its branches too */
+  sox_close(out[2]);
+  sox_close(out[1]);
+  sox_close(out[0]);
+  sox_close(in);
+  sox_quit();
+
+  return 0;
+}
@@ -32,7 +32,8 @@ typedef struct { /* These are measured as samples */
 } priv_t;
 
 /* prototypes */
-static double fade_gain(uint64_t index, uint64_t range, int fadetype);
+static void fade_gains(double *gain, size_t n, uint64_t index, int down,
+                       uint64_t range, int type, sox_bool fast);
 
 /*
  * Process options
@@ -200,6 +201,43 @@ static int sox_fade_start(sox_effect_t * effp)
     return SOX_SUCCESS;
 }
 
+/* Frames whose gains are worked out together before being applied */
+#define FADE_BLOCK 256
+
+/*
+ * Scale n frames of chans channels by the fade curve starting at index
+ * (counting down if down is set).  The curve is evaluated once per frame
+ * rather than once per sample, and each block of gains is applied across
+ * all channels in one pass.
+ */
+static void fade_frames(const sox_sample_t *ibuf, sox_sample_t *obuf,
+                        size_t n, size_t chans, uint64_t index, int down,
+                        uint64_t range, int type, sox_bool fast)
+{
+    double gain[FADE_BLOCK];
+    size_t i, c, block;
+
+    for (; n; n -= block) {
+        block = min(n, FADE_BLOCK);
+        fade_gains(gain, block, index, down, range, type, fast);
+        index = down ? index - block : index + block;
+        if (chans == 1)
+            for (i = 0; i < block; i++)
+                obuf[i] = ibuf[i] * gain[i];
+        else if (chans == 2)
+            for (i = 0; i < block; i++) {
+                obuf[2 * i] = ibuf[2 * i] * gain[i];
+                obuf[2 * i + 1] = ibuf[2 * i + 1] * gain[i];
+            }
+        else
+            for (i = 0; i < block; i++)
+                for (c = 0; c < chans; c++)
+                    obuf[i * chans + c] = ibuf[i * chans + c] * gain[i];
+        ibuf += block * chans;
+        obuf += block * chans;
+    }
+}
+
 /*
  * Processed signed long samples from ibuf to obuf.
  * Return number of samples processed.
@@ -208,70 +246,47 @@ static int sox_fade_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
                  size_t *isamp, size_t *osamp)
 {
     priv_t * fade = (priv_t *) effp->priv;
-    /* len is total samples, chcnt counts channels */
-    int len = 0, t_output = 1, more_output = 1;
-    sox_sample_t t_ibuf;
-    size_t chcnt = 0;
-
-    len = ((*isamp > *osamp) ? *osamp : *isamp);
-
-    *osamp = 0;
-    *isamp = 0;
-
-    for(; len && more_output; len--)
-    {
-        t_ibuf = *ibuf;
-
-        if ((fade->samplesdone >= fade->in_start) &&
-            (!fade->do_out || fade->samplesdone < fade->out_stop))
-        { /* something to generate output */
-
-            if (fade->samplesdone < fade->in_stop)
-            { /* fade-in phase, increase gain */
-                *obuf = t_ibuf *
-                    fade_gain(fade->samplesdone - fade->in_start,
-                              fade->in_stop - fade->in_start,
-                              fade->in_fadetype);
-            } /* endif fade-in */
-            else if (!fade->do_out || fade->samplesdone < fade->out_start)
-            { /* steady gain phase */
-                *obuf = t_ibuf;
-            } /* endif  steady phase */
-            else
-            { /* fade-out phase, decrease gain */
-                *obuf = t_ibuf *
-                    fade_gain(fade->out_stop - fade->samplesdone,
-                              fade->out_stop - fade->out_start,
-                              fade->out_fadetype);
-            } /* endif fade-out */
-
-            if (!(!fade->do_out || fade->samplesdone < fade->out_stop))
-                more_output = 0;
-
-            t_output = 1;
+    size_t chans = effp->in_signal.channels;
+    sox_bool fast = effp->global_info->global_info->fast_math;
+    /* len and olen count whole frames in and out, done those output so far */
+    size_t len = min(*isamp, *osamp) / chans, olen = len, done, n;
+    uint64_t pos;
+
+    if (fade->do_out)
+        olen = fade->samplesdone >= fade->out_stop ? 0 :
+            min(olen, fade->out_stop - fade->samplesdone);
+
+    for (done = 0; done < olen; done += n) {
+        pos = fade->samplesdone + done;
+        if (pos < fade->in_stop)
+        { /* fade-in phase, increase gain */
+            n = min(olen - done, fade->in_stop - pos);
+            fade_frames(ibuf, obuf, n, chans, pos - fade->in_start, 0,
+                        fade->in_stop - fade->in_start, fade->in_fadetype,
+                        fast);
+        }
+        else if (!fade->do_out || pos < fade->out_start)
+        { /* steady gain phase, a straight copy */
+            n = fade->do_out ? min(olen - done, fade->out_start - pos) :
+                olen - done;
+            if (obuf != ibuf)
+                memcpy(obuf, ibuf, n * chans * sizeof(*obuf));
         }
         else
-        { /* No output generated */
-            t_output = 0;
-        } /* endif something to output */
-
-        *isamp += 1;
-        ibuf++;
-
-        if (t_output)
-        { /* Output generated, update pointers and counters */
-            obuf++;
-            *osamp += 1;
-        } /* endif t_output */
-
-        /* Process next channel */
-        chcnt++;
-        if (chcnt >= effp->in_signal.channels)
-        { /* all channels of this sample processed */
-            chcnt = 0;
-            fade->samplesdone += 1;
-        } /* endif all channels */
-    } /* endfor */
+        { /* fade-out phase, decrease gain */
+            n = olen - done;
+            fade_frames(ibuf, obuf, n, chans, fade->out_stop - pos, 1,
+                        fade->out_stop - fade->out_start, fade->out_fadetype,
+                        fast);
+        }
+        ibuf += n * chans;
+        obuf += n * chans;
+    }
+
+    /* Input past the stop position is consumed but not output */
+    fade->samplesdone += len;
+    *isamp = len * chans;
+    *osamp = olen * chans;
 
     /* If not more samples will be returned, let application know
      * this.
@@ -288,11 +303,8 @@ static int sox_fade_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
 static int sox_fade_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
     priv_t * fade = (priv_t *) effp->priv;
-    int len;
-    size_t t_chan = 0;
+    size_t len = *osamp / effp->in_signal.channels;
 
-    len = *osamp;
-    len -= len % effp->in_signal.channels;
     *osamp = 0;
 
     if (fade->do_out && fade->samplesdone < fade->out_stop &&
@@ -302,20 +314,13 @@ static int sox_fade_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp
         fade->endpadwarned = 1;
     } /* endif endpadwarned */
 
-    for (;len && (fade->do_out &&
-                  fade->samplesdone < fade->out_stop); len--)
+    if (fade->do_out && fade->samplesdone < fade->out_stop)
     {
-        *obuf = 0;
-        obuf++;
-        *osamp += 1;
-
-        t_chan++;
-        if (t_chan >= effp->in_signal.channels)
-        {
-            fade->samplesdone += 1;
-            t_chan = 0;
-        } /* endif channels */
-    } /* endfor */
+        len = min(len, fade->out_stop - fade->samplesdone);
+        memset(obuf, 0, len * effp->in_signal.channels * sizeof(*obuf));
+        fade->samplesdone += len;
+        *osamp = len * effp->in_signal.channels;
+    }
 
     if (fade->do_out && fade->samplesdone >= fade->out_stop)
         return SOX_EOF;
@@ -337,46 +342,58 @@ static int lsx_kill(sox_effect_t * effp)
     return (SOX_SUCCESS);
 }
 
-/* Function returns gain value 0.0 - 1.0 according index / range ratio
-* and -1.0 if  type is invalid
-* todo: to optimize performance calculate gain every now and then and interpolate */
-static double fade_gain(uint64_t index, uint64_t range, int type)
+/* Sets gain[i], i < n, to the gain (0.0 - 1.0) at index + i (or, if down,
+ * index - i) / range; the curve's functions are taken n at a time, so as
+ * fast approximations (lsx_sin_n, etc.) where fast is set. */
+static void fade_gains(double *gain, size_t n, uint64_t index, int down,
+                       uint64_t range, int type, sox_bool fast)
 {
-    double retval = 0.0, findex = 0.0;
+    size_t i;
 
     /* TODO: does it really have to be contrained to [0.0, 1.0]? */
-    findex = max(0.0, min(1.0, 1.0 * index / range));
+    for (i = 0; i < n; i++)
+        gain[i] = 1.0 * (down ? index - i : index + i) / range;
+    for (i = 0; i < n; i++)
+        gain[i] = max(0.0, min(1.0, gain[i]));
 
     switch (type) {
     case FADE_TRI :             /* triangle */
-      retval = findex;
       break;
 
     case FADE_QUARTER :         /* quarter of sinewave */
-      retval = sin(findex * M_PI / 2);
+      for (i = 0; i < n; i++)
+          gain[i] = gain[i] * M_PI / 2;
+      lsx_sin_n(gain, n, fast);
       break;
 
     case FADE_HALF :          /* half of sinewave... eh cosine wave */
-      retval = (1 - cos(findex * M_PI )) / 2 ;
+      for (i = 0; i < n; i++)
+          gain[i] = gain[i] * M_PI;
+      lsx_cos_n(gain, n, fast);
+      for (i = 0; i < n; i++)
+          gain[i] = (1 - gain[i]) / 2;
       break;
 
     case FADE_LOG :             /* logarithmic */
       /* 5 means 100 db attenuation. */
       /* TODO: should this be adopted with bit depth */
-      retval =  pow(0.1, (1 - findex) * 5);
+      if (!fast)
+          for (i = 0; i < n; i++)
+              gain[i] = pow(0.1, (1 - gain[i]) * 5);
+      else {
+          for (i = 0; i < n; i++)
+              gain[i] = (1 - gain[i]) * (5 * -M_LN10);
+          lsx_exp_n(gain, n, fast);
+      }
       break;
 
     case FADE_PAR :             /* inverted parabola */
-      retval = (1 - (1 - findex)  * (1 - findex));
+      for (i = 0; i < n; i++)
+          gain[i] = (1 - (1 - gain[i])  * (1 - gain[i]));
       break;
 
     /* TODO: more fade curves? */
-    default :                  /* Error indicating wrong fade curve */
-      retval = -1.0;
-      break;
     }
-
-    return retval;
 }
 
 static sox_effect_handler_t sox_fade_effect = {
@@ -384,13 +401,13 @@ static sox_effect_handler_t sox_fade_effect = {
   "[ type ] fade-in-length [ stop-position [ fade-out-length ] ]\n"
   "       Time is in hh:mm:ss.frac format.\n"
   "       Fade type one of q, h, t, l or p.",
-  SOX_EFF_MCHAN | SOX_EFF_LENGTH,
+  SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_INPLACE | SOX_EFF_RTSAFE,
   sox_fade_getopts,
   sox_fade_start,
   sox_fade_flow,
   sox_fade_drain,
   NULL,
-  lsx_kill, sizeof(priv_t)
+  lsx_kill, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_fade_effect_fn(void)
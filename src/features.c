@@ -0,0 +1,417 @@
+/* libSoX effect: features: log-mel filterbank energies & MFCCs, for ASR
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio is passed unmodified.  Each channel is cut into frames of `window'
+ * ms, every `hop' ms (with no partial frames at the ends), which are
+ * pre-emphasised and Hamming windowed, as in HTK and Kaldi, then (as in
+ * spectrogram) gathered into batches, each of whose frames is DFT'd (in
+ * parallel if multi-threaded) to its power spectrum.  Each triangular mel
+ * band's energy is then that spectrum's dot product with its weights, which
+ * are kept only for the bins in the band; its log (taking full scale as 1)
+ * is the value of the band, and the DCT-II (orthonormal) of the bands'
+ * values are the MFCCs.
+ *
+ * The frames go, in order, to the callback set by sox_set_features_callback,
+ * or else to a file of 32-bit little-endian floats (of each channel, if more
+ * than one), raw or as .npy (shape: frames, values). */
+
+#include "sox_i.h"
+#include <string.h>
+#include <errno.h>
+
+/* For SET_BINARY_MODE: */
+#include <fcntl.h>
+#ifdef HAVE_IO_H
+  #include <io.h>
+#endif
+
+#define BATCH 64          /* Frames transformed at once */
+#define MIN_ENERGY 1e-10  /* So that the log of a silent band is finite */
+#define NPY_HEADER_LEN 128
+
+typedef enum {Format_float, Format_npy} format_t;
+static lsx_enum_item const format_options[] = {
+  LSX_ENUM_ITEM(Format_,float)
+  LSX_ENUM_ITEM(Format_,npy)
+  {0, 0}};
+
+typedef struct {
+  /* Parameters */
+  double        window_ms, hop_ms, low, high, preemph;
+  int           num_bands, num_ceps, format;
+  char const    * filename;
+  sox_features_callback_t callback;
+  void          * client_data;
+
+  /* Per-channel work area */
+  int           WORK;     /* Start of work area is marked by this dummy variable. */
+  FILE          * file;
+  sox_bool      stopped;  /* The callback has asked for no more */
+  size_t        win_len, hop, dft_size, fill, skip, frames;
+  int           num_out, batched;
+  double        * buf, * window, * dfts;
+  int           * band_lo, * band_len, * band_at;
+  double        * weights, * dct;
+  float         * out;    /* A batch of frames' values */
+} priv_t;
+
+static int create(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  lsx_getopt_t optstate;
+  int c;
+
+  p->window_ms = 25, p->hop_ms = 10, p->preemph = .97;
+  p->num_bands = 40, p->num_ceps = 13, p->format = -1;
+  lsx_getopt_init(argc, argv, "+w:s:m:c:l:u:p:F:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'w', window_ms, 1, 1000)
+    GETOPT_NUMERIC(optstate, 's', hop_ms, 1, 1000)
+    GETOPT_NUMERIC(optstate, 'm', num_bands, 1, 256)
+    GETOPT_NUMERIC(optstate, 'c', num_ceps, 0, 256)
+    GETOPT_NUMERIC(optstate, 'l', low, 0, 1e6)
+    GETOPT_NUMERIC(optstate, 'u', high, 0, 1e6)
+    GETOPT_NUMERIC(optstate, 'p', preemph, 0, 1)
+    case 'F': p->format = lsx_enum_option(c, optstate.arg, format_options);
+      if (p->format == INT_MAX)
+        return lsx_usage(effp);
+      break;
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  if (p->num_ceps > p->num_bands) {
+    lsx_fail("there can be no more cepstral coefficients than mel bands");
+    return SOX_EOF;
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  if (argc == 1 && strcmp(argv[0], "-"))
+    p->filename = argv[0];
+  else if (argc > 1)
+    return lsx_usage(effp);
+  if (p->format < 0)
+    p->format = p->filename? Format_npy : Format_float;
+  if (p->format == Format_npy && !p->filename) {
+    lsx_fail("npy cannot be written to stdout");
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+int sox_set_features_callback(sox_effect_t * effp,
+    sox_features_callback_t callback, void * client_data)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  if (effp->handler.getopts != create)
+    return SOX_EOF;
+  p->callback = callback;
+  p->client_data = client_data;
+  return SOX_SUCCESS;
+}
+
+static double mel(double hz) {return 1127 * log(1 + hz / 700);}
+
+/* Each band's weights, for the bins from band_lo, band_len of them, are
+ * kept one band after another, from band_at */
+static void make_bands(sox_effect_t * effp, double high)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int b, k, n = 0, empty = 0, bins = p->dft_size / 2 + 1;
+  double lo = mel(p->low), step = (mel(high) - lo) / (p->num_bands + 1);
+
+  p->band_lo = lsx_calloc(p->num_bands, sizeof(*p->band_lo));
+  p->band_len = lsx_calloc(p->num_bands, sizeof(*p->band_len));
+  p->band_at = lsx_calloc(p->num_bands, sizeof(*p->band_at));
+  p->weights = lsx_malloc(2 * bins * sizeof(*p->weights)); /* Bands overlap 2 */
+  for (b = 0; b < p->num_bands; ++b) {
+    double left = lo + b * step, centre = left + step, right = centre + step;
+    p->band_at[b] = n;
+    for (k = 0; k < bins; ++k) {
+      double m = mel(effp->in_signal.rate * k / p->dft_size);
+      double w = m <= centre? (m - left) / step : (right - m) / step;
+      if (w > 0) {
+        if (!p->band_len[b])
+          p->band_lo[b] = k;
+        p->weights[n++] = w;
+        ++p->band_len[b];
+      }
+    }
+    empty += !p->band_len[b];
+  }
+  if (empty && !effp->flow)
+    lsx_warn("%i mel bands are narrower than the DFT's bins", empty);
+}
+
+static int open_file(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  char const * ext;
+  char * name;
+
+  if (!p->filename) {
+    if (effp->in_signal.channels > 1) {
+      lsx_fail("only one channel's features may be sent to stdout");
+      return SOX_EOF;
+    }
+    if (effp->global_info->global_info->stdout_in_use_by) {
+      lsx_fail("stdout already in use by `%s'", effp->global_info->global_info->stdout_in_use_by);
+      return SOX_EOF;
+    }
+    effp->global_info->global_info->stdout_in_use_by = effp->handler.name;
+    SET_BINARY_MODE(stdout);
+    p->file = stdout;
+    return SOX_SUCCESS;
+  }
+  /* As spectrogram: -<channel> before the extension, if more than one */
+  name = lsx_malloc(strlen(p->filename) + 16);
+  if (effp->in_signal.channels > 1) {
+    ext = strrchr(p->filename, '.');
+    if (!ext)
+      ext = p->filename + strlen(p->filename);
+    sprintf(name, "%.*s-%i%s", (int)(ext - p->filename), p->filename,
+        effp->flow + 1, ext);
+  }
+  else strcpy(name, p->filename);
+  if (!(p->file = fopen(name, "wb")))
+    lsx_fail("can't open features file `%s': %s", name, strerror(errno));
+  free(name);
+  return p->file? SOX_SUCCESS : SOX_EOF;
+}
+
+static int write_header(priv_t const * p)
+{
+  char h[NPY_HEADER_LEN + 1];
+  int n = sprintf(h + 10,
+      "{'descr': '<f4', 'fortran_order': False, 'shape': (%lu, %i), }",
+      (unsigned long)p->frames, p->num_out);
+
+  memcpy(h, "\223NUMPY\1\0", (size_t)8);
+  h[8] = (NPY_HEADER_LEN - 10) & 255, h[9] = (NPY_HEADER_LEN - 10) >> 8;
+  memset(h + 10 + n, ' ', (size_t)(NPY_HEADER_LEN - 11 - n));
+  h[NPY_HEADER_LEN - 1] = '\n';
+  return fwrite(h, (size_t)NPY_HEADER_LEN, (size_t)1, p->file) == 1?
+      SOX_SUCCESS : SOX_EOF;
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double high = p->high? p->high : effp->in_signal.rate / 2;
+  size_t i, j;
+
+  memset(&p->WORK, 0, sizeof(*p) - field_offset(priv_t, WORK));
+  if (high > effp->in_signal.rate / 2 || p->low >= high) {
+    lsx_fail("the mel bands must be between 0Hz and the Nyquist frequency, low to high");
+    return SOX_EOF;
+  }
+  p->win_len = max(2, p->window_ms * effp->in_signal.rate / 1000 + .5);
+  p->hop = max(1, p->hop_ms * effp->in_signal.rate / 1000 + .5);
+  for (p->dft_size = 16; p->dft_size < p->win_len; p->dft_size <<= 1);
+  p->num_out = p->num_ceps? p->num_ceps : p->num_bands;
+  lsx_debug("window=%lu hop=%lu dft_size=%lu", (unsigned long)p->win_len,
+      (unsigned long)p->hop, (unsigned long)p->dft_size);
+
+  if (!p->callback && (open_file(effp) != SOX_SUCCESS ||
+      (p->format == Format_npy && write_header(p) != SOX_SUCCESS)))
+    return SOX_EOF;
+
+  p->buf = lsx_calloc(p->win_len, sizeof(*p->buf));
+  p->window = lsx_malloc(p->win_len * sizeof(*p->window));
+  for (i = 0; i < p->win_len; ++i)   /* As HTK's, not lsx_apply_hamming's */
+    p->window[i] = .54 - .46 * cos(2 * M_PI * i / (p->win_len - 1));
+  p->dfts = lsx_calloc(BATCH * p->dft_size, sizeof(*p->dfts));
+  p->out = lsx_malloc(BATCH * p->num_out * sizeof(*p->out));
+  make_bands(effp, high);
+  if (p->num_ceps) {
+    p->dct = lsx_malloc(p->num_ceps * p->num_bands * sizeof(*p->dct));
+    for (i = 0; i < (size_t)p->num_ceps; ++i)
+      for (j = 0; j < (size_t)p->num_bands; ++j)
+        p->dct[i * p->num_bands + j] = sqrt((i? 2. : 1.) / p->num_bands) *
+            cos(M_PI * i * (j + .5) / p->num_bands);
+  }
+  if (!effp->flow)   /* Set up the FFT tables */
+    lsx_safe_rdft((int)p->dft_size, 1, p->dfts);
+  return SOX_SUCCESS;
+}
+
+/* In lanes of their own, as the sum may not be re-ordered otherwise */
+static double dot(double const * w, double const * x, int n)
+{
+  double s[4] = {0, 0, 0, 0};
+  int i, j;
+
+  for (i = 0; i + 4 <= n; i += 4)
+    for (j = 0; j < 4; ++j)
+      s[j] += w[i + j] * x[i + j];
+  for (; i < n; ++i)
+    s[0] += w[i] * x[i];
+  return s[0] + s[1] + s[2] + s[3];
+}
+
+/* Replaces the windowed frame d with its power spectrum, and puts its
+ * features in out; bands has room for the bands' values. */
+static void frame_features(priv_t const * p, double * d, float * out,
+    double * bands)
+{
+  int i, b, n = p->dft_size;
+  double d1;
+
+  lsx_safe_rdft(n, 1, d);
+  d1 = d[1];
+  d[0] = sqr(d[0]);
+  for (i = 1; i < n >> 1; ++i)
+    d[i] = sqr(d[2*i]) + sqr(d[2*i+1]);
+  d[n >> 1] = sqr(d1);
+
+  for (b = 0; b < p->num_bands; ++b)
+    bands[b] = log(max(MIN_ENERGY, dot(p->weights + p->band_at[b],
+        d + p->band_lo[b], p->band_len[b])));
+  if (!p->num_ceps)
+    for (b = 0; b < p->num_bands; ++b)
+      out[b] = bands[b];
+  else for (i = 0; i < p->num_ceps; ++i)
+    out[i] = dot(p->dct + i * p->num_bands, bands, p->num_bands);
+}
+
+/* Computes the batched frames (together, if there are enough of them) and
+ * hands them on, in order. */
+static int flush(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int i, j, n = p->batched;
+  size_t threads = lsx_effect_threads(effp, (size_t)n);
+
+  p->batched = 0;
+  #pragma omp parallel if(threads > 1) num_threads((int)threads) private(j)
+  {
+    double * bands = lsx_malloc(p->num_bands * sizeof(*bands));
+    #pragma omp for schedule(static)
+    for (j = 0; j < n; ++j)
+      frame_features(p, p->dfts + j * p->dft_size, p->out + j * p->num_out, bands);
+    free(bands);
+  }
+  lsx_threads_give(effp->global_info->global_info, threads);
+  if (p->callback) {
+    for (j = 0; j < n && !p->stopped; ++j)
+      if ((*p->callback)(p->client_data, (unsigned)effp->flow,
+            p->out + j * p->num_out, (size_t)p->num_out) != SOX_SUCCESS)
+        p->stopped = sox_true;
+    return SOX_SUCCESS;
+  }
+  if (MACHINE_IS_BIGENDIAN) for (i = 0; i < n * p->num_out; ++i) {
+    uint32_t x;
+    memcpy(&x, p->out + i, sizeof(x));
+    x = lsx_swapdw(x);
+    memcpy(p->out + i, &x, sizeof(x));
+  }
+  if (fwrite(p->out, sizeof(*p->out) * p->num_out, (size_t)n, p->file) != (size_t)n) {
+    lsx_fail("error writing features file: %s", strerror(errno));
+    return SOX_EOF;
+  }
+  p->frames += n;
+  return SOX_SUCCESS;
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t len = *isamp = *osamp = min(*isamp, *osamp), n, i;
+
+  memcpy(obuf, ibuf, len * sizeof(*obuf)); /* Pass on audio unaffected */
+
+  for (; len && !p->stopped; len -= n, ibuf += n) {
+    double * d;
+
+    if (p->skip) {
+      n = min(len, p->skip);
+      p->skip -= n;
+      continue;
+    }
+    n = min(len, p->win_len - p->fill);
+    for (i = 0; i < n; ++i)
+      p->buf[p->fill++] = SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[i],);
+    if (p->fill < p->win_len)
+      break;
+
+    d = p->dfts + p->batched * p->dft_size;   /* Pre-emphasise & window */
+    for (i = p->win_len - 1; i; --i)
+      d[i] = (p->buf[i] - p->preemph * p->buf[i - 1]) * p->window[i];
+    d[0] = p->buf[0] * (1 - p->preemph) * p->window[0];
+    memset(d + p->win_len, 0, (p->dft_size - p->win_len) * sizeof(*d));
+
+    if (p->hop < p->win_len) {
+      memmove(p->buf, p->buf + p->hop, (p->win_len - p->hop) * sizeof(*p->buf));
+      p->fill -= p->hop;
+    }
+    else p->fill = 0, p->skip = p->hop - p->win_len;
+    if (++p->batched == BATCH && flush(effp) != SOX_SUCCESS)
+      return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  (void)obuf, *osamp = 0;
+  return p->batched && !p->stopped? flush(effp) : SOX_SUCCESS;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int result = SOX_SUCCESS;
+
+  if (p->file) {
+    if (p->format == Format_npy && (fseeko(p->file, (off_t)0, SEEK_SET) ||
+        write_header(p) != SOX_SUCCESS))
+      result = SOX_EOF;
+    if (p->file == stdout? fflush(p->file) : fclose(p->file))
+      result = SOX_EOF;
+    if (result != SOX_SUCCESS)
+      lsx_fail("error writing features file: %s", strerror(errno));
+  }
+  free(p->buf);
+  free(p->window);
+  free(p->dfts);
+  free(p->out);
+  free(p->band_lo);
+  free(p->band_len);
+  free(p->band_at);
+  free(p->weights);
+  free(p->dct);
+  return result;
+}
+
+sox_effect_handler_t const * lsx_features_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"features",
+    "[-w ms] [-s ms] [-m bands] [-c ceps] [-l Hz] [-u Hz] [-p coef]\n"
+    "         [-F float|npy] [features-file]"
+    "\n  -w ms      Window (frame) length (25)"
+    "\n  -s ms      Hop (frame shift) (10)"
+    "\n  -m bands   Number of mel bands (40)"
+    "\n  -c ceps    Number of MFCCs; 0 for the log-mel energies (13)"
+    "\n  -l Hz      Lowest frequency of the mel bands (0)"
+    "\n  -u Hz      Highest frequency of the mel bands (Nyquist)"
+    "\n  -p coef    Pre-emphasis coefficient (0.97)"
+    "\n  -F format  32-bit float: raw, or npy (the default with a file name)",
+    SOX_EFF_MODIFY, create, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
+  return &handler;
+}
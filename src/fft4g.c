@@ -284,12 +284,10 @@ Appendix :
 
 #include <math.h>
 #include "fft4g.h"
+#include "fft4g_vec.h"
 
 #ifdef FFT4G_FLOAT
   #define double float
-  #define sin   sinf
-  #define cos   cosf
-  #define atan  atanf
 
   #define cdft  lsx_cdft_f
   #define rdft  lsx_rdft_f
@@ -312,6 +310,10 @@ static void cft1st(int n, double *a, double const *w);
 static void cftbsub(int n, double *a, double const *w);
 static void cftfsub(int n, double *a, double const *w);
 static void cftmdl(int n, int l, double *a, double const *w);
+#if defined FFT4G_VN
+static void cftlast_vec(int n, int l, double *a, int conj);
+static void cftmdl_vec(int n, int l, double *a, double const *w);
+#endif
 static void dctsub(int n, double *a, int nc, double const *c);
 static void dstsub(int n, double *a, int nc, double const *c);
 static void makect(int nc, int *ip, double *c);
@@ -319,6 +321,10 @@ static void makewt(int nw, int *ip, double *w);
 static void rftbsub(int n, double *a, int nc, double const *c);
 static void rftfsub(int n, double *a, int nc, double const *c);
 
+#if !defined FFT4G_FLOAT
+int lsx_fft4g_vec = 1;
+#endif
+
 
 void cdft(int n, int isgn, double *a, int *ip, double *w)
 {
@@ -931,6 +937,12 @@ static void cftfsub(int n, double *a, double const *w)
             l <<= 2;
         }
     }
+#if defined FFT4G_VN
+    if (lsx_fft4g_vec && !(l % FFT4G_VN)) {
+        cftlast_vec(n, l, a, 0);
+        return;
+    }
+#endif
     if ((l << 2) == n) {
         for (j = 0; j < l; j += 2) {
             j1 = j + l;
@@ -981,6 +993,12 @@ static void cftbsub(int n, double *a, double const *w)
             l <<= 2;
         }
     }
+#if defined FFT4G_VN
+    if (lsx_fft4g_vec && !(l % FFT4G_VN)) {
+        cftlast_vec(n, l, a, 1);
+        return;
+    }
+#endif
     if ((l << 2) == n) {
         for (j = 0; j < l; j += 2) {
             j1 = j + l;
@@ -1122,12 +1140,126 @@ static void cft1st(int n, double *a, double const *w)
 }
 
 
+#if defined FFT4G_VN
+
+/* Vector versions of cftmdl and of the last stage of cftfsub & cftbsub;
+ * each vector holds FFT4G_VN / 2 consecutive complex numbers, which have
+ * the same twiddle factor.  First half of a radix-4 butterfly at a, x0-x3 as
+ * in the scalar code but x3 times i: */
+
+#define VBFLY4(a, l) \
+    a0 = VLD(a), a1 = VLD(a + l), a2 = VLD(a + 2 * l), a3 = VLD(a + 3 * l), \
+    x0 = VADD(a0, a1), x1 = VSUB(a0, a1), \
+    x2 = VADD(a2, a3), x3 = VMULI(VSUB(a2, a3))
+
+
+static void cftlast_vec(int n, int l, double *a, int conj)
+{
+    int j;
+    VT a0, a1, a2, a3, x0, x1, x2, x3;
+    VT c = VSIGNS(0, conj);
+    
+    if ((l << 2) == n) {
+        for (j = 0; j < l; j += FFT4G_VN) {
+            VBFLY4(a + j, l);
+            VST(a + j, VXOR(VADD(x0, x2), c));
+            VST(a + j + 2 * l, VXOR(VSUB(x0, x2), c));
+            VST(a + j + l, VXOR(VADD(x1, x3), c));
+            VST(a + j + 3 * l, VXOR(VSUB(x1, x3), c));
+        }
+    } else {
+        for (j = 0; j < l; j += FFT4G_VN) {
+            a0 = VLD(a + j);
+            a1 = VLD(a + j + l);
+            VST(a + j, VXOR(VADD(a0, a1), c));
+            VST(a + j + l, VXOR(VSUB(a0, a1), c));
+        }
+    }
+}
+
+
+static void cftmdl_vec(int n, int l, double *a, double const *w)
+{
+    int j, k, k1, k2, m, m2;
+    double wk1r, wk1i, wk2i, wk3r, wk3i;
+    VT a0, a1, a2, a3, x0, x1, x2, x3, w1r, w1i, w2r, w2i, w3r, w3i;
+    
+    m = l << 2;
+    for (j = 0; j < l; j += FFT4G_VN) {
+        VBFLY4(a + j, l);
+        VST(a + j, VADD(x0, x2));
+        VST(a + j + 2 * l, VSUB(x0, x2));
+        VST(a + j + l, VADD(x1, x3));
+        VST(a + j + 3 * l, VSUB(x1, x3));
+    }
+    w1r = VSET1(w[2]);
+    for (j = m; j < l + m; j += FFT4G_VN) {
+        VBFLY4(a + j, l);
+        VST(a + j, VADD(x0, x2));
+        VST(a + j + 2 * l, VMULI(VSUB(x0, x2)));
+        x0 = VADD(x1, x3);
+        VST(a + j + l, VMUL(w1r, VADD(VDUPRE(x0), VNEGRE(VDUPIM(x0)))));
+        x0 = VSUB(x1, x3);
+        VST(a + j + 3 * l, VMUL(w1r, VSUB(VNEGRE(VDUPRE(x0)), VDUPIM(x0))));
+    }
+    k1 = 0;
+    m2 = 2 * m;
+    for (k = m2; k < n; k += m2) {
+        k1 += 2;
+        k2 = 2 * k1;
+        wk2i = w[k1 + 1];
+        wk1r = w[k2];
+        wk1i = w[k2 + 1];
+        wk3r = wk1r - 2 * wk2i * wk1i;
+        wk3i = 2 * wk2i * wk1r - wk1i;
+        w2r = VSET1(w[k1]);
+        w2i = VSET1(wk2i);
+        w1r = VSET1(wk1r);
+        w1i = VSET1(wk1i);
+        w3r = VSET1(wk3r);
+        w3i = VSET1(wk3i);
+        for (j = k; j < l + k; j += FFT4G_VN) {
+            VBFLY4(a + j, l);
+            VST(a + j, VADD(x0, x2));
+            VST(a + j + 2 * l, VCMUL(w2r, w2i, VSUB(x0, x2)));
+            VST(a + j + l, VCMUL(w1r, w1i, VADD(x1, x3)));
+            VST(a + j + 3 * l, VCMUL(w3r, w3i, VSUB(x1, x3)));
+        }
+        wk1r = w[k2 + 2];
+        wk1i = w[k2 + 3];
+        w1r = VSET1(wk1r);
+        w1i = VSET1(wk1i);
+        wk3r = wk1r - 2 * w[k1] * wk1i;
+        wk3i = 2 * w[k1] * wk1r - wk1i;
+        wk2i = -wk2i;
+        w3r = VSET1(wk3r);
+        w3i = VSET1(wk3i);
+        x0 = w2r, w2r = VSET1(wk2i), w2i = x0;
+        for (j = k + m; j < l + (k + m); j += FFT4G_VN) {
+            VBFLY4(a + j, l);
+            VST(a + j, VADD(x0, x2));
+            VST(a + j + 2 * l, VCMUL(w2r, w2i, VSUB(x0, x2)));
+            VST(a + j + l, VCMUL(w1r, w1i, VADD(x1, x3)));
+            VST(a + j + 3 * l, VCMUL(w3r, w3i, VSUB(x1, x3)));
+        }
+    }
+}
+
+#endif
+
+
 static void cftmdl(int n, int l, double *a, double const *w)
 {
     int j, j1, j2, j3, k, k1, k2, m, m2;
     double wk1r, wk1i, wk2r, wk2i, wk3r, wk3i;
     double x0r, x0i, x1r, x1i, x2r, x2i, x3r, x3i;
     
+#if defined FFT4G_VN
+    if (lsx_fft4g_vec && !(l % FFT4G_VN)) {
+        cftmdl_vec(n, l, a, w);
+        return;
+    }
+#endif
     m = l << 2;
     for (j = 0; j < l; j += 2) {
         j1 = j + l;
@@ -27,6 +27,10 @@ void lsx_ddst_f(int, int, float *, int *, float *);
 void lsx_dfct_f(int, float *, float *, int *, float *);
 void lsx_dfst_f(int, float *, float *, int *, float *);
 
+/* Whether the transforms use their vector kernels, where built (else the
+ * portable code; so sox_sample_test checks one against the other) */
+extern int lsx_fft4g_vec;
+
 #define dft_br_len(l) (2 + (1 << (int)(log(l / 2 + .5) / log(2.)) / 2))
 #define dft_sc_len(l) (l / 2)
 
@@ -0,0 +1,153 @@
+/* This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Vector operations on interleaved complex numbers for fft4g.c; a vector
+ * holds FFT4G_VN reals, i.e. FFT4G_VN / 2 complex numbers.  The widest set
+ * that the compiler targets is used (SSE2 or AVX on x86, NEON on AArch64);
+ * where there is none, FFT4G_VN is left undefined and fft4g.c is scalar.
+ *
+ * Each operation rounds as the scalar code does (negation & swapping are
+ * exact, and there is no contraction to fused multiply-add), so the vector
+ * kernels give the same results as the scalar ones.
+ *
+ * VSIGNS(re, im) has just the sign bit set in the real and/or imaginary
+ * parts, as flagged; VSET1 broadcasts a variable (an lvalue).
+ *
+ * Must be included before fft4g.c redefines `double'. */
+
+#if defined FFT4G_FLOAT
+
+#define VSIGN(neg)       ((neg)? -0x7fffffff - 1 : 0)
+
+#if defined __AVX__
+  #include <immintrin.h>
+  #define FFT4G_VN 8
+  #define VT             __m256
+  #define VLD(p)         _mm256_loadu_ps(p)
+  #define VST(p, x)      _mm256_storeu_ps(p, x)
+  #define VSET1(x)       _mm256_broadcast_ss(&(x))
+  #define VADD           _mm256_add_ps
+  #define VSUB           _mm256_sub_ps
+  #define VMUL           _mm256_mul_ps
+  #define VXOR           _mm256_xor_ps
+  #define VSWAP(x)       _mm256_permute_ps(x, 0xb1)
+  #define VDUPRE(x)      _mm256_moveldup_ps(x)
+  #define VDUPIM(x)      _mm256_movehdup_ps(x)
+  #define VSIGNS(re, im) _mm256_castsi256_ps(_mm256_set_epi32( \
+                           VSIGN(im), VSIGN(re), VSIGN(im), VSIGN(re), \
+                           VSIGN(im), VSIGN(re), VSIGN(im), VSIGN(re)))
+#elif defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define FFT4G_VN 4
+  #define VT             __m128
+  #define VLD(p)         _mm_loadu_ps(p)
+  #define VST(p, x)      _mm_storeu_ps(p, x)
+  #define VSET1(x)       _mm_load1_ps(&(x))
+  #define VADD           _mm_add_ps
+  #define VSUB           _mm_sub_ps
+  #define VMUL           _mm_mul_ps
+  #define VXOR           _mm_xor_ps
+  #define VSWAP(x)       _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 3, 0, 1))
+  #define VDUPRE(x)      _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 2, 0, 0))
+  #define VDUPIM(x)      _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 1, 1))
+  #define VSIGNS(re, im) _mm_castsi128_ps(_mm_set_epi32( \
+                           VSIGN(im), VSIGN(re), VSIGN(im), VSIGN(re)))
+#elif defined __ARM_NEON && defined __aarch64__
+  #include <arm_neon.h>
+  #define FFT4G_VN 4
+  #define VT             float32x4_t
+  #define VLD(p)         vld1q_f32(p)
+  #define VST(p, x)      vst1q_f32(p, x)
+  #define VSET1(x)       vld1q_dup_f32(&(x))
+  #define VADD           vaddq_f32
+  #define VSUB           vsubq_f32
+  #define VMUL           vmulq_f32
+  #define VXOR(x, y)     vreinterpretq_f32_u32(veorq_u32( \
+                           vreinterpretq_u32_f32(x), vreinterpretq_u32_f32(y)))
+  #define VSWAP(x)       vrev64q_f32(x)
+  #define VDUPRE(x)      vtrn1q_f32(x, x)
+  #define VDUPIM(x)      vtrn2q_f32(x, x)
+  #define VSIGNS(re, im) vreinterpretq_f32_u64(vdupq_n_u64( \
+                           (uint64_t)(uint32_t)VSIGN(im) << 32 | \
+                           (uint32_t)VSIGN(re)))
+#endif
+
+#else
+
+#define VSIGN(neg)       ((neg)? -0x7fffffffffffffffLL - 1 : 0LL)
+
+#if defined __AVX__
+  #include <immintrin.h>
+  #define FFT4G_VN 4
+  #define VT             __m256d
+  #define VLD(p)         _mm256_loadu_pd(p)
+  #define VST(p, x)      _mm256_storeu_pd(p, x)
+  #define VSET1(x)       _mm256_broadcast_sd(&(x))
+  #define VADD           _mm256_add_pd
+  #define VSUB           _mm256_sub_pd
+  #define VMUL           _mm256_mul_pd
+  #define VXOR           _mm256_xor_pd
+  #define VSWAP(x)       _mm256_permute_pd(x, 5)
+  #define VDUPRE(x)      _mm256_movedup_pd(x)
+  #define VDUPIM(x)      _mm256_permute_pd(x, 15)
+  #define VSIGNS(re, im) _mm256_castsi256_pd(_mm256_set_epi64x( \
+                           VSIGN(im), VSIGN(re), VSIGN(im), VSIGN(re)))
+#elif defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define FFT4G_VN 2
+  #define VT             __m128d
+  #define VLD(p)         _mm_loadu_pd(p)
+  #define VST(p, x)      _mm_storeu_pd(p, x)
+  #define VSET1(x)       _mm_load1_pd(&(x))
+  #define VADD           _mm_add_pd
+  #define VSUB           _mm_sub_pd
+  #define VMUL           _mm_mul_pd
+  #define VXOR           _mm_xor_pd
+  #define VSWAP(x)       _mm_shuffle_pd(x, x, 1)
+  #define VDUPRE(x)      _mm_unpacklo_pd(x, x)
+  #define VDUPIM(x)      _mm_unpackhi_pd(x, x)
+  #define VSIGNS(re, im) _mm_castsi128_pd(_mm_set_epi64x(VSIGN(im), VSIGN(re)))
+#elif defined __ARM_NEON && defined __aarch64__
+  #include <arm_neon.h>
+  #define FFT4G_VN 2
+  #define VT             float64x2_t
+  #define VLD(p)         vld1q_f64(p)
+  #define VST(p, x)      vst1q_f64(p, x)
+  #define VSET1(x)       vld1q_dup_f64(&(x))
+  #define VADD           vaddq_f64
+  #define VSUB           vsubq_f64
+  #define VMUL           vmulq_f64
+  #define VXOR(x, y)     vreinterpretq_f64_u64(veorq_u64( \
+                           vreinterpretq_u64_f64(x), vreinterpretq_u64_f64(y)))
+  #define VSWAP(x)       vextq_f64(x, x, 1)
+  #define VDUPRE(x)      vdupq_laneq_f64(x, 0)
+  #define VDUPIM(x)      vdupq_laneq_f64(x, 1)
+  #define VSIGNS(re, im) vreinterpretq_f64_u64(vcombine_u64( \
+                           vdup_n_u64((uint64_t)VSIGN(re)), \
+                           vdup_n_u64((uint64_t)VSIGN(im))))
+#endif
+
+#endif
+
+#if defined FFT4G_VN
+  /* x with its real parts negated; complex conjugate of x; i * x: */
+  #define VNEGRE(x)      VXOR(x, VSIGNS(1, 0))
+  #define VCONJ(x)       VXOR(x, VSIGNS(0, 1))
+  #define VMULI(x)       VNEGRE(VSWAP(x))
+  /* (wr + i * wi) * x, for wr & wi each set in all elements: */
+  #define VCMUL(wr, wi, x) VADD(VMUL(wr, x), VNEGRE(VMUL(wi, VSWAP(x))))
+#endif
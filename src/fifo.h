@@ -30,6 +30,8 @@ typedef struct {
   size_t item_size;    /* Size of each item in data */
   size_t begin;        /* Offset of the first byte to read. */
   size_t end;          /* 1 + Offset of the last byte byte to read. */
+  size_t max_allocation; /* If non-0, the bytes to hold, at most; see fifo_room */
+  size_t high_water;   /* Most bytes held at once. */
 } fifo_t;
 
 #define FIFO_MIN 0x4000
@@ -51,15 +53,22 @@ UNUSED static void * fifo_reserve(fifo_t * f, FIFO_SIZE_T n)
       void *p = f->data + f->end;
 
       f->end += n;
+      if (f->end - f->begin > f->high_water)
+        f->high_water = f->end - f->begin;
       return p;
     }
     if (f->begin > FIFO_MIN) {
+      lsx_trace2(fifo__compact, f, f->end - f->begin);
       memmove(f->data, f->data + f->begin, f->end - f->begin);
       f->end -= f->begin;
       f->begin = 0;
       continue;
     }
-    f->allocation += n;
+    /* Grow geometrically, so that a FIFO that backs up is copied a few
+     * times, not once for each write; but not far beyond its cap. */
+    f->allocation = max(f->allocation * 2, f->end + n);
+    if (f->max_allocation && f->allocation > f->max_allocation)
+      f->allocation = max(f->max_allocation, f->end + n);
     f->data = lsx_realloc(f->data, f->allocation);
   }
 }
@@ -103,17 +112,49 @@ UNUSED static void * fifo_read(fifo_t * f, FIFO_SIZE_T n, void * data)
 
 #define fifo_read_ptr(f) fifo_read(f, (FIFO_SIZE_T)0, NULL)
 
+/* Caps f at max(bytes, min_items items); 0 bytes: no cap.  The cap doesn't
+ * stop writes: an effect that would bound its memory takes no more input
+ * than fifo_room allows, and gives the rest back to the chain (backpressure).
+ * min_items should be at least what the effect needs to hold to progress. */
+UNUSED static void fifo_limit(fifo_t * f, size_t bytes, size_t min_items)
+{
+  f->max_allocation = bytes? max(bytes, min_items * f->item_size) : 0;
+}
+
+/* The items that may be written to f before it holds more than its cap */
+UNUSED static size_t fifo_room(fifo_t const * f)
+{
+  size_t held = f->end - f->begin;
+
+  if (!f->max_allocation)
+    return (size_t)-1 / f->item_size;
+  return held < f->max_allocation? (f->max_allocation - held) / f->item_size : 0;
+}
+
 UNUSED static void fifo_delete(fifo_t * f)
 {
-  free(f->data);
+  lsx_free(f->data);
 }
 
 UNUSED static void fifo_create(fifo_t * f, FIFO_SIZE_T item_size)
 {
   f->item_size = item_size;
   f->allocation = FIFO_MIN;
+  f->max_allocation = f->high_water = 0;
   f->data = lsx_malloc(f->allocation);
   fifo_clear(f);
 }
 
+/* Sizes f so that, whilst it never holds more than n items, writing to it
+ * never reallocates: compaction always makes room first. */
+UNUSED static void fifo_preallocate(fifo_t * f, FIFO_SIZE_T n)
+{
+  size_t allocation = FIFO_MIN + n * f->item_size;
+
+  if (allocation > f->allocation) {
+    f->allocation = allocation;
+    f->data = lsx_realloc(f->data, f->allocation);
+  }
+}
+
 #endif
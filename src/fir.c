@@ -17,10 +17,19 @@
 
 #include "sox_i.h"
 #include "dft_filter.h"
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  #include <sys/mman.h>
+#endif
+
+typedef enum {coefs_text, coefs_f32, coefs_f64, coefs_audio} coefs_format_t;
 
 typedef struct {
   dft_filter_priv_t  base;
   char const         * filename;
+  coefs_format_t     format;
   double             * h;
   int                n;
 } priv_t;
@@ -34,6 +43,18 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
 
   b->filter_ptr = &b->filter;
   --argc, ++argv;
+  if (argc >= 2 && !strcmp(*argv, "-t")) {  /* Not getopt: coefs may be < 0 */
+    if (!strcmp(argv[1], "f32"))
+      p->format = coefs_f32;
+    else if (!strcmp(argv[1], "f64"))
+      p->format = coefs_f64;
+    else return lsx_usage(effp);
+    argc -= 2, argv += 2;
+  }
+  else if (argc && !strcmp(*argv, "-a"))
+    p->format = coefs_audio, --argc, ++argv;
+  if (p->format != coefs_text && argc > 1)
+    return lsx_usage(effp);
   if (!argc)
     p->filename = "-"; /* default to stdin */
   else if (argc == 1)
@@ -46,6 +67,88 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static sox_bool set_num_coefs(sox_effect_t * effp, size_t n)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  if (n > (size_t)SOX_INT_MAX(31) >> 1) {
+    lsx_fail("too many coefficients in `%s'", p->filename);
+    return sox_false;
+  }
+  p->n = (int)n;
+  p->h = lsx_realloc(p->h, n * sizeof(*p->h));
+  return sox_true;
+}
+
+/* Reads raw, native-endian, f32 or f64 coefficients; a regular file is
+ * memory-mapped rather than copied through stdio */
+static sox_bool read_binary(sox_effect_t * effp, FILE * file)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t size = p->format == coefs_f32? sizeof(float) : sizeof(double);
+  size_t len = 0, alloc = 0, i;
+  char * data = NULL;
+  sox_bool mapped = sox_false, result = sox_false;
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  struct stat st;
+
+  if (!fstat(fileno(file), &st) && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (uint64_t)st.st_size == (size_t)st.st_size) {
+    void * map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+        fileno(file), (off_t)0);
+    if (map != MAP_FAILED)
+      data = map, len = (size_t)st.st_size, mapped = sox_true;
+  }
+#endif
+  if (!mapped) do {    /* E.g. a pipe */
+    alloc = max(alloc * 2, (size_t)1 << 16);
+    data = lsx_realloc(data, alloc);
+    len += fread(data + len, (size_t)1, alloc - len, file);
+  } while (len == alloc);
+  if (ferror(file))
+    lsx_fail("error reading coefficient file `%s'", p->filename);
+  else if (len % size)
+    lsx_fail("coefficient file `%s' is not a whole number of %s values",
+        p->filename, p->format == coefs_f32? "f32" : "f64");
+  else if (set_num_coefs(effp, len / size)) {
+    for (i = 0; i < len / size; ++i)
+      p->h[i] = p->format == coefs_f32?
+        ((float const *)data)[i] : ((double const *)data)[i];
+    result = sox_true;
+  }
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (mapped) {
+    munmap(data, len);
+    data = NULL;
+  }
+#endif
+  free(data);
+  return result;
+}
+
+/* Reads the coefficients as the samples of a (mono) audio file */
+static sox_bool read_audio(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned channels;
+  size_t n;
+  double * h = lsx_read_audio_file(effp, p->filename, &channels, &n);
+  sox_bool result = sox_false;
+
+  if (!h)
+    return sox_false;
+  if (channels != 1)
+    lsx_fail("impulse response `%s' has %u channels; it must have one",
+        p->filename, channels);
+  else if (set_num_coefs(effp, n)) {
+    memcpy(p->h, h, n * sizeof(*h));
+    result = sox_true;
+  }
+  free(h);
+  return result;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t        * p = (priv_t *)effp->priv;
@@ -55,7 +158,21 @@ static int start(sox_effect_t * effp)
   int           i;
 
   if (!f->num_taps) {
-    if (!p->n && p->filename) {
+    if (!p->n && p->filename && p->format == coefs_audio) {
+      if (!read_audio(effp))
+        return SOX_EOF;
+    }
+    else if (!p->n && p->filename && p->format != coefs_text) {
+      FILE * file = lsx_open_input_file(effp, p->filename, sox_false);
+      sox_bool ok;
+      if (!file)
+        return SOX_EOF;
+      ok = read_binary(effp, file);
+      if (file != stdin) fclose(file);
+      if (!ok)
+        return SOX_EOF;
+    }
+    else if (!p->n && p->filename) {
       FILE * file = lsx_open_input_file(effp, p->filename, sox_true);
       if (!file)
         return SOX_EOF;
@@ -97,7 +214,7 @@ sox_effect_handler_t const * lsx_fir_effect_fn(void)
   static sox_effect_handler_t handler;
   handler = *lsx_dft_filter_effect_fn();
   handler.name = "fir";
-  handler.usage = "[coef-file|coefs]";
+  handler.usage = "[-t f32|f64|-a] [coef-file|coefs]";
   handler.getopts = create;
   handler.start = start;
   handler.priv_size = sizeof(priv_t);
@@ -117,16 +117,31 @@ static int start(sox_effect_t * effp)
   dft_filter_t * f = p->base.filter_ptr;
 
   if (!f->num_taps) {
-    double * h;
+    double * key;
+    double const * design = NULL;
+    int i, n, post_peak, key_len;
+
     if (!p->num_knots && !read_knots(effp))
       return SOX_EOF;
-    h = make_filter(effp);
-    if (effp->global_info->plot != sox_plot_off) {
-      lsx_plot_fir(h, p->n, effp->in_signal.rate,
-          effp->global_info->plot, "SoX effect: firfit", -30., +30.);
-      return SOX_EOF;
+    key_len = 2 + 2 * p->num_knots;
+    lsx_valloc(key, key_len);
+    key[0] = p->n, key[1] = effp->in_signal.rate;
+    for (i = 0; i < p->num_knots; ++i)
+      key[2 + 2 * i] = p->knots[i].f, key[3 + 2 * i] = p->knots[i].gain;
+    if (effp->global_info->plot == sox_plot_off)
+      design = lsx_design_get("firfit", key, key_len, &n, &post_peak);
+    if (!design) {
+      double * h = make_filter(effp);
+      if (effp->global_info->plot != sox_plot_off) {
+        lsx_plot_fir(h, p->n, effp->in_signal.rate,
+            effp->global_info->plot, "SoX effect: firfit", -30., +30.);
+        free(key);
+        return SOX_EOF;
+      }
+      design = lsx_design_put("firfit", key, key_len, h, p->n, p->n >> 1);
     }
-    lsx_set_dft_filter(f, h, p->n, p->n >> 1);
+    free(key);
+    lsx_set_dft_filter_design(f, design, p->n, p->n >> 1);
   }
   return lsx_dft_filter_effect_fn()->start(effp);
 }
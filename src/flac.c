@@ -600,7 +600,8 @@ LSX_FORMAT_HANDLER(flac)
     "Free Lossless Audio CODEC compressed audio", names, 0,
     start_read, read_samples, stop_read,
     start_write, write_samples, stop_write,
-    seek, encodings, NULL, sizeof(priv_t)
+    seek, encodings, NULL, sizeof(priv_t), NULL, NULL,
+    NULL, NULL
   };
   return &handler;
 }
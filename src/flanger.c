@@ -23,6 +23,7 @@
 typedef enum {INTERP_LINEAR, INTERP_QUADRATIC} interp_t;
 
 #define MAX_CHANNELS 4
+#define BLOCK_LEN 1024 /* Frames processed per block */
 
 typedef struct {
   /* Parameters */
@@ -42,9 +43,8 @@ typedef struct {
   double     delay_last[MAX_CHANNELS];
 
   /* Low Frequency Oscillator */
-  float *    lfo;
-  size_t  lfo_length;
-  size_t  lfo_pos;
+  lsx_lfo_t  lfo;
+  double     lfo_block[BLOCK_LEN];
 
   /* Balancing */
   double     in_gain;
@@ -143,73 +143,83 @@ static int start(sox_effect_t * effp)
     f->delay_bufs[c] = lsx_calloc(f->delay_buf_length, sizeof(*f->delay_bufs[0]));
 
   /* Create the LFO lookup table: */
-  f->lfo_length = effp->in_signal.rate / f->speed;
-  f->lfo = lsx_calloc(f->lfo_length, sizeof(*f->lfo));
-  lsx_generate_wave_table(
+  lsx_lfo_create(
+      &f->lfo,
       f->wave_shape,
       SOX_FLOAT,
-      f->lfo,
-      f->lfo_length,
+      (size_t)(effp->in_signal.rate / f->speed),
       floor(f->delay_min * effp->in_signal.rate + .5),
       f->delay_buf_length - 2.,
       3 * M_PI_2);  /* Start the sweep at minimum delay (for mono at least) */
 
   lsx_debug("delay_buf_length=%" PRIuPTR " lfo_length=%" PRIuPTR "\n",
-      f->delay_buf_length, f->lfo_length);
+      f->delay_buf_length, f->lfo.len);
 
   return SOX_SUCCESS;
 }
 
 
 
+/* The channels are independent, so each is processed a block at a time,
+ * its delays having been looked up for the whole block; the feedback loop
+ * (with delays down to 0) still goes a sample at a time. */
 static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * f = (priv_t *) effp->priv;
   int c, channels = effp->in_signal.channels;
-  size_t len = (*isamp > *osamp ? *osamp : *isamp) / channels;
+  size_t len = (*isamp > *osamp ? *osamp : *isamp) / channels, n, i;
 
   *isamp = *osamp = len * channels;
 
-  while (len--) {
-    f->delay_buf_pos =
-      (f->delay_buf_pos + f->delay_buf_length - 1) % f->delay_buf_length;
+  for (; len; len -= n, ibuf += n * channels, obuf += n * channels) {
+    size_t pos = f->delay_buf_pos;
+
+    n = min(len, BLOCK_LEN);
     for (c = 0; c < channels; ++c) {
-      double delayed_0, delayed_1;
-      double delayed;
-      double in, out;
-      size_t channel_phase = c * f->lfo_length * f->channel_phase + .5;
-      double delay = f->lfo[(f->lfo_pos + channel_phase) % f->lfo_length];
-      double frac_delay = modf(delay, &delay);
-      size_t int_delay = (size_t)delay;
-
-      in = *ibuf++;
-      f->delay_bufs[c][f->delay_buf_pos] = in + f->delay_last[c] * f->feedback_gain;
-
-      delayed_0 = f->delay_bufs[c]
-        [(f->delay_buf_pos + int_delay++) % f->delay_buf_length];
-      delayed_1 = f->delay_bufs[c]
-        [(f->delay_buf_pos + int_delay++) % f->delay_buf_length];
-
-      if (f->interpolation == INTERP_LINEAR)
-        delayed = delayed_0 + (delayed_1 - delayed_0) * frac_delay;
-      else /* if (f->interpolation == INTERP_QUADRATIC) */
-      {
-        double a, b;
-        double delayed_2 = f->delay_bufs[c]
-          [(f->delay_buf_pos + int_delay++) % f->delay_buf_length];
-        delayed_2 -= delayed_0;
-        delayed_1 -= delayed_0;
-        a = delayed_2 *.5 - delayed_1;
-        b = delayed_1 * 2 - delayed_2 *.5;
-        delayed = delayed_0 + (a * frac_delay + b) * frac_delay;
+      size_t channel_phase = c * f->lfo.len * f->channel_phase + .5;
+      double * delay_buf = f->delay_bufs[c];
+
+      lsx_lfo_read(&f->lfo, channel_phase, f->lfo_block, n);
+      pos = f->delay_buf_pos;
+      for (i = 0; i < n; ++i) {
+        double delayed_0, delayed_1;
+        double delayed;
+        double in, out;
+        double delay = f->lfo_block[i];
+        double frac_delay = modf(delay, &delay);
+        size_t k = (pos = (pos? pos : f->delay_buf_length) - 1) + (size_t)delay;
+
+        in = ibuf[i * channels + c];
+        delay_buf[pos] = in + f->delay_last[c] * f->feedback_gain;
+
+        k -= k >= f->delay_buf_length? f->delay_buf_length : 0;
+        delayed_0 = delay_buf[k++];
+        k -= k >= f->delay_buf_length? f->delay_buf_length : 0;
+        delayed_1 = delay_buf[k++];
+
+        if (f->interpolation == INTERP_LINEAR)
+          delayed = delayed_0 + (delayed_1 - delayed_0) * frac_delay;
+        else /* if (f->interpolation == INTERP_QUADRATIC) */
+        {
+          double a, b;
+          double delayed_2;
+          k -= k >= f->delay_buf_length? f->delay_buf_length : 0;
+          delayed_2 = delay_buf[k];
+          delayed_2 -= delayed_0;
+          delayed_1 -= delayed_0;
+          a = delayed_2 *.5 - delayed_1;
+          b = delayed_1 * 2 - delayed_2 *.5;
+          delayed = delayed_0 + (a * frac_delay + b) * frac_delay;
+        }
+
+        f->delay_last[c] = delayed;
+        out = in * f->in_gain + delayed * f->delay_gain;
+        obuf[i * channels + c] = SOX_ROUND_CLIP_COUNT(out, effp->clips);
       }
-
-      f->delay_last[c] = delayed;
-      out = in * f->in_gain + delayed * f->delay_gain;
-      *obuf++ = SOX_ROUND_CLIP_COUNT(out, effp->clips);
     }
-    f->lfo_pos = (f->lfo_pos + 1) % f->lfo_length;
+    f->delay_buf_pos = pos;
+    lsx_lfo_advance(&f->lfo, n);
   }
 
   return SOX_SUCCESS;
@@ -225,7 +235,7 @@ static int stop(sox_effect_t * effp)
   for (c = 0; c < channels; ++c)
     free(f->delay_bufs[c]);
 
-  free(f->lfo);
+  lsx_lfo_delete(&f->lfo);
 
   memset(f, 0, sizeof(*f));
 
@@ -237,8 +247,9 @@ static int stop(sox_effect_t * effp)
 sox_effect_handler_t const * lsx_flanger_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "flanger", NULL, SOX_EFF_MCHAN,
-    getopts, start, flow, NULL, stop, NULL, sizeof(priv_t)};
+    "flanger", NULL, SOX_EFF_MCHAN | SOX_EFF_RTSAFE,
+    getopts, start, flow, NULL, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
   static char const * lines[] = {
     "[delay depth regen width speed shape phase interp]",
     "                  .",
@@ -18,6 +18,7 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define _GNU_SOURCE /* For fallocate and O_DIRECT */
 #include "sox_i.h"
 
 #include <assert.h>
@@ -33,6 +34,14 @@
   #include <io.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+  #include <unistd.h>
+#endif
+
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  #include <sys/mman.h>
+#endif
+
 #if HAVE_MAGIC
   #include <magic.h>
 #endif
@@ -40,62 +49,126 @@
 #define PIPE_AUTO_DETECT_SIZE 256 /* Only as much as we can rewind a pipe */
 #define AUTO_DETECT_SIZE 4096     /* For seekable file, so no restriction */
 
-static char const * auto_detect_format(sox_format_t * ft, char const * ext)
+/* Magic numbers of the formats known to SoX (whether built-in or plugins);
+ * formats not listed here may give their own in sox_format_handler_t. */
+static struct {
+  char const * name;
+  sox_format_signature_t sig;
+} const signatures[] = {
+  {"voc"   , {0,  20, "Creative Voice File\x1a", 0, 0, NULL}},
+  {"smp"   , {0,  17, "SOUND SAMPLE DATA"     , 0, 0, NULL}},
+  {"wve"   , {0,  15, "ALawSoundFile**"       , 0, 0, NULL}},
+  {"gsrt"  , {16,  9, "ring.bin"              , 0, 0, NULL}},
+  {"amr-wb", {0,   9, "#!AMR-WB\n"            , 0, 0, NULL}},
+  {"prc"   , {0,   8, "\x37\x00\x00\x10\x6d\x00\x00\x10", 0, 0, NULL}},
+  {"sph"   , {0,   7, "NIST_1A"               , 0, 0, NULL}},
+  {"amr-nb", {0,   6, "#!AMR\n"               , 0, 0, NULL}},
+  {"txw"   , {0,   6, "LM8953"                , 0, 0, NULL}},
+  {"sndt"  , {0,   6, "SOUND\x1a"             , 0, 0, NULL}},
+  {"vorbis", {0,   4, "OggS"                  , 29, 6, "vorbis"}},
+  {"opus"  , {0,   4, "OggS"                  , 28, 8, "OpusHead"}},
+  {"speex" , {0,   4, "OggS"                  , 28, 6, "Speex"}},
+  {"hcom"  , {65,  4, "FSSD"                  , 128,4, "HCOM"}},
+  {"wav"   , {0,   4, "RIFF"                  , 8,  4, "WAVE"}},
+  {"wav"   , {0,   4, "RIFX"                  , 8,  4, "WAVE"}},
+  {"wav"   , {0,   4, "RF64"                  , 8,  4, "WAVE"}},
+  {"aiff"  , {0,   4, "FORM"                  , 8,  4, "AIFF"}},
+  {"aifc"  , {0,   4, "FORM"                  , 8,  4, "AIFC"}},
+  {"8svx"  , {0,   4, "FORM"                  , 8,  4, "8SVX"}},
+  {"maud"  , {0,   4, "FORM"                  , 8,  4, "MAUD"}},
+  {"xa"    , {0,   4, "XA\0\0"                , 0, 0, NULL}},
+  {"xa"    , {0,   4, "XAI\0"                 , 0, 0, NULL}},
+  {"xa"    , {0,   4, "XAJ\0"                 , 0, 0, NULL}},
+  {"au"    , {0,   4, ".snd"                  , 0, 0, NULL}},
+  {"au"    , {0,   4, "dns."                  , 0, 0, NULL}},
+  {"au"    , {0,   4, "\0ds."                 , 0, 0, NULL}},
+  {"au"    , {0,   4, ".sd\0"                 , 0, 0, NULL}},
+  {"flac"  , {0,   4, "fLaC"                  , 0, 0, NULL}},
+  {"avr"   , {0,   4, "2BIT"                  , 0, 0, NULL}},
+  {"caf"   , {0,   4, "caff"                  , 0, 0, NULL}},
+  {"wv"    , {0,   4, "wvpk"                  , 0, 0, NULL}},
+  {"paf"   , {0,   4, " paf"                  , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\144\243\001\0"       , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\0\001\243\144"       , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\144\243\002\0"       , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\0\002\243\144"       , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\144\243\003\0"       , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\0\003\243\144"       , 0, 0, NULL}},
+  {"sf"    , {0,   4, "\144\243\004\0"       , 0, 0, NULL}},
+  {"sox"   , {0,   4, ".SoX"                  , 0, 0, NULL}},
+  {"sox"   , {0,   4, "XoS."                  , 0, 0, NULL}},
+};
+
+#define NSIGNATURES array_length(signatures)
+
+/* So that a header need be looked up only under its first byte, signatures
+ * with bytes at offset 0 are bucketed by their first byte (in table order);
+ * the few others go in bucket 256, which is always searched. */
+static unsigned char sig_index[NSIGNATURES];
+static unsigned char sig_bucket[258];  /* Start of each bucket in sig_index */
+
+static unsigned sig_key(sox_format_signature_t const * sig)
 {
-  char data[AUTO_DETECT_SIZE];
-  size_t len = lsx_readbuf(ft, data, ft->seekable? sizeof(data) : PIPE_AUTO_DETECT_SIZE);
-  #define CHECK(type, p2, l2, d2, p1, l1, d1) if (len >= p1 + l1 && \
-      !memcmp(data + p1, d1, (size_t)l1) && !memcmp(data + p2, d2, (size_t)l2)) return #type;
-  CHECK(voc   , 0, 0, ""     , 0, 20, "Creative Voice File\x1a")
-  CHECK(smp   , 0, 0, ""     , 0, 17, "SOUND SAMPLE DATA")
-  CHECK(wve   , 0, 0, ""     , 0, 15, "ALawSoundFile**")
-  CHECK(gsrt  , 0, 0, ""     , 16, 9, "ring.bin")
-  CHECK(amr-wb, 0, 0, ""     , 0,  9, "#!AMR-WB\n")
-  CHECK(prc   , 0, 0, ""     , 0,  8, "\x37\x00\x00\x10\x6d\x00\x00\x10")
-  CHECK(sph   , 0, 0, ""     , 0,  7, "NIST_1A")
-  CHECK(amr-nb, 0, 0, ""     , 0,  6, "#!AMR\n")
-  CHECK(txw   , 0, 0, ""     , 0,  6, "LM8953")
-  CHECK(sndt  , 0, 0, ""     , 0,  6, "SOUND\x1a")
-  CHECK(vorbis, 0, 4, "OggS" , 29, 6, "vorbis")
-  CHECK(opus  , 0, 4, "OggS" , 28, 8, "OpusHead")
-  CHECK(speex , 0, 4, "OggS" , 28, 6, "Speex")
-  CHECK(hcom  ,65, 4, "FSSD" , 128,4, "HCOM")
-  CHECK(wav   , 0, 4, "RIFF" , 8,  4, "WAVE")
-  CHECK(wav   , 0, 4, "RIFX" , 8,  4, "WAVE")
-  CHECK(wav   , 0, 4, "RF64" , 8,  4, "WAVE")
-  CHECK(aiff  , 0, 4, "FORM" , 8,  4, "AIFF")
-  CHECK(aifc  , 0, 4, "FORM" , 8,  4, "AIFC")
-  CHECK(8svx  , 0, 4, "FORM" , 8,  4, "8SVX")
-  CHECK(maud  , 0, 4, "FORM" , 8,  4, "MAUD")
-  CHECK(xa    , 0, 0, ""     , 0,  4, "XA\0\0")
-  CHECK(xa    , 0, 0, ""     , 0,  4, "XAI\0")
-  CHECK(xa    , 0, 0, ""     , 0,  4, "XAJ\0")
-  CHECK(au    , 0, 0, ""     , 0,  4, ".snd")
-  CHECK(au    , 0, 0, ""     , 0,  4, "dns.")
-  CHECK(au    , 0, 0, ""     , 0,  4, "\0ds.")
-  CHECK(au    , 0, 0, ""     , 0,  4, ".sd\0")
-  CHECK(flac  , 0, 0, ""     , 0,  4, "fLaC")
-  CHECK(avr   , 0, 0, ""     , 0,  4, "2BIT")
-  CHECK(caf   , 0, 0, ""     , 0,  4, "caff")
-  CHECK(wv    , 0, 0, ""     , 0,  4, "wvpk")
-  CHECK(paf   , 0, 0, ""     , 0,  4, " paf")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\144\243\001\0")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\0\001\243\144")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\144\243\002\0")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\0\002\243\144")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\144\243\003\0")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\0\003\243\144")
-  CHECK(sf    , 0, 0, ""     , 0,  4, "\144\243\004\0")
-  CHECK(sox   , 0, 0, ""     , 0,  4, ".SoX")
-  CHECK(sox   , 0, 0, ""     , 0,  4, "XoS.")
-
-  if (ext && !strcasecmp(ext, "snd"))
-  CHECK(sndr  , 7, 1, ""     , 0,  2, "\0")
-  #undef CHECK
+  return sig->offset == 0? (unsigned char)sig->bytes[0] :
+      sig->length2 && sig->offset2 == 0? (unsigned char)sig->bytes2[0] : 256;
+}
+
+static void index_signatures(void)
+{
+  unsigned i, count[257] = {0};
+
+  for (i = 0; i < NSIGNATURES; ++i)
+    ++count[sig_key(&signatures[i].sig)];
+  for (i = 0; i < 257; ++i)
+    sig_bucket[i + 1] = sig_bucket[i] + count[i];
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < NSIGNATURES; ++i) {
+    unsigned key = sig_key(&signatures[i].sig);
+    sig_index[sig_bucket[key] + count[key]++] = i;
+  }
+}
+
+static sox_bool sig_matches(sox_format_signature_t const * sig,
+    unsigned char const * data, size_t len)
+{
+  return len >= (size_t)sig->offset + sig->length &&
+    !memcmp(data + sig->offset, sig->bytes, (size_t)sig->length) &&
+    (!sig->length2 || (len >= (size_t)sig->offset2 + sig->length2 &&
+      !memcmp(data + sig->offset2, sig->bytes2, (size_t)sig->length2)));
+}
+
+static char const * signed_format(unsigned char const * data, size_t len);
+
+/* Looks up the format of a file from the header in data (the start of the
+ * file), which may be wherever the caller has it, so needn't be copied */
+static char const * detect_format(void const * header, size_t len, char const * ext)
+{
+  unsigned char const * data = header;
+  unsigned buckets[2], b, i;
+  char const * name;
+
+  #pragma omp critical(lsx_signature_index)
+  if (!sig_bucket[257])
+    index_signatures();
+  buckets[0] = len? data[0] : 256;
+  buckets[1] = 256;
+  for (b = buckets[0] == 256; b < 2; ++b)
+    for (i = sig_bucket[buckets[b]]; i < sig_bucket[buckets[b] + 1]; ++i)
+      if (sig_matches(&signatures[sig_index[i]].sig, data, len))
+        return signatures[sig_index[i]].name;
+
+  if ((name = signed_format(data, len)) != NULL)
+    return name;
+
+  if (ext && !strcasecmp(ext, "snd") && len >= 8 && !memcmp(data, "\0", (size_t)2)
+      && !data[7])
+    return "sndr";
 
 #if HAVE_MAGIC
   if (sox_globals.use_magic) {
-    static magic_t magic;
+    /* A cookie per thread: it may be used by one at a time only, and holds
+     * the text that magic_buffer returns */
+    static LSX_THREAD_LOCAL magic_t magic;
     char const * filetype = NULL;
     if (!magic) {
       magic = magic_open(MAGIC_MIME | MAGIC_SYMLINK);
@@ -115,6 +188,13 @@ static char const * auto_detect_format(sox_format_t * ft, char const * ext)
   return NULL;
 }
 
+static char const * auto_detect_format(sox_format_t * ft, char const * ext)
+{
+  char data[AUTO_DETECT_SIZE];
+  size_t len = lsx_readbuf(ft, data, ft->seekable? sizeof(data) : PIPE_AUTO_DETECT_SIZE);
+  return detect_format(data, len, ext);
+}
+
 static sox_encodings_info_t const s_sox_encodings_info[] = {
   {sox_encodings_none  , "n/a"          , "Unknown or not applicable"},
   {sox_encodings_none  , "Signed PCM"   , "Signed Integer PCM"},
@@ -331,12 +411,237 @@ static sox_bool is_seekable(sox_format_t const * ft)
   struct stat st;
 
   assert(ft);
+  if (ft->io_type == lsx_io_mem || ft->io_type == lsx_io_upload)
+    return sox_true;  /* An upload: back into its first part (see s3.c) */
   if (!ft->fp)
     return sox_false;
+  if (ft->io_type == lsx_io_url)
+    return lsx_http_seekable(ft->fp);
   fstat(fileno((FILE*)ft->fp), &st);
   return ((st.st_mode & S_IFMT) == S_IFREG);
 }
 
+/* Where the handler reads only through lsx_readbuf & co., a regular file
+ * may be read from a memory-map of it rather than through stdio, saving a
+ * copy of everything; if it cannot be mapped, stdio is used as usual. */
+static void map_input(sox_format_t * ft)
+{
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  sox_uint64_t size = lsx_filelength(ft);
+  off_t pos = lsx_tell(ft);
+  void * map;
+
+  if (!(ft->handler.flags & SOX_FILE_MMAP) || !ft->seekable ||
+      ft->io_type != lsx_io_file || !size || size != (size_t)size || pos < 0)
+    return;
+  map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE,
+      fileno((FILE*)ft->fp), (off_t)0);
+  if (map == MAP_FAILED)
+    return;
+#ifdef MADV_SEQUENTIAL
+  madvise(map, (size_t)size, MADV_SEQUENTIAL);
+#endif
+  ft->map = map;
+  ft->map_size = size;
+  ft->map_eof = sox_false;
+  ft->tell_off = pos;
+  free(ft->head);
+  ft->head = NULL;
+  lsx_debug("`%s': memory-mapped %" PRIu64 " bytes", ft->filename, size);
+#else
+  (void)ft;
+#endif
+}
+
+/* An input buffer is served directly as a map to handlers that read only
+ * through lsx_readbuf & co.; other handlers are given a stdio stream of it. */
+static int mem_input(sox_format_t * ft)
+{
+  void * buffer = (void *)ft->map;
+
+  if (ft->io_type != lsx_io_mem || !buffer ||
+      (ft->handler.flags & SOX_FILE_MMAP))
+    return SOX_SUCCESS;
+  ft->map = NULL;
+#ifdef HAVE_FMEMOPEN
+  ft->fp = fmemopen(buffer, (size_t)ft->map_size, "rb");
+#endif
+  if (!ft->fp) {
+    lsx_fail_errno(ft, errno, "can't read this file type from memory");
+    return SOX_EOF;
+  }
+  lsx_debug("`%s': reading %" PRIu64 " bytes through stdio", ft->filename, ft->map_size);
+  return SOX_SUCCESS;
+}
+
+/* An input file shared by a reader and its clones (see sox_open_read_clone),
+ * each reading it at its own offset: from its memory-map, or else with
+ * pread() on a descriptor of it; released by the last of them closed. */
+typedef struct {
+  unsigned refs;
+  void * map;           /* The reader's map, now owned here; or NULL */
+  sox_uint64_t size;
+  int fd;               /* For pread(), if not mapped; or -1 */
+} shared_input_t;
+
+static shared_input_t * share_input(sox_format_t * ft)
+{
+  shared_input_t * s = ft->shared;
+
+  if (!s) {
+    if (!ft->map && (!ft->fp || ft->io_type != lsx_io_file || !ft->seekable)) {
+      lsx_fail_errno(ft, SOX_ENOTSUP, "only seekable files can be cloned");
+      return NULL;
+    }
+    s = lsx_calloc(1, sizeof(*s));
+    s->fd = -1;
+    s->refs = 1;
+    if (ft->map)
+      s->map = ft->io_type != lsx_io_mem? (void *)ft->map : NULL;
+    else {
+#ifdef HAVE_PREAD
+      s->size = lsx_filelength(ft);
+      s->fd = dup(fileno((FILE*)ft->fp));
+#endif
+      if (s->fd == -1) {
+        lsx_fail_errno(ft, errno, "can't share input");
+        free(s);
+        return NULL;
+      }
+    }
+    ft->shared = s;
+  }
+  #pragma omp critical(lsx_shared_input)
+  ++s->refs;
+  return s;
+}
+
+static void unmap_input(sox_format_t * ft)
+{
+  shared_input_t * s = ft->shared;
+  unsigned refs = 0;
+
+  if (s) {
+    #pragma omp critical(lsx_shared_input)
+    refs = --s->refs;
+    if (refs)
+      return;
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+    if (s->map)
+      munmap(s->map, (size_t)ft->map_size);
+#endif
+    if (s->fd != -1)
+      close(s->fd);
+    free(s);
+    return;
+  }
+#if defined HAVE_SYS_MMAN_H && defined HAVE_MMAP
+  if (ft->map && ft->io_type != lsx_io_mem)
+    munmap((void *)ft->map, (size_t)ft->map_size);
+#endif
+}
+
+/* Reads up to len bytes at a clone's offset in its shared input's
+ * descriptor, as lsx_readbuf would. */
+size_t lsx_shared_read(sox_format_t * ft, void * buf, size_t len)
+{
+  size_t ret = 0;
+#ifdef HAVE_PREAD
+  shared_input_t const * s = ft->shared;
+
+  while (ret < len) {
+    ssize_t n = pread(s->fd, (char *)buf + ret, len - ret,
+        (off_t)(ft->tell_off + ret));
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        lsx_fail_errno(ft, errno, "lsx_readbuf");
+      ft->map_eof = sox_true;
+      break;
+    }
+    ret += (size_t)n;
+  }
+#else
+  (void)buf, (void)len;
+  ft->map_eof = sox_true;
+#endif
+  ft->tell_off += ret;
+  return ret;
+}
+
+/* With the context's write_block, a regular output file is written through
+ * a stdio buffer of whole page-aligned blocks, so reaches the disk in large
+ * aligned writes, with O_DIRECT too if direct_io is set (see
+ * lsx_end_direct_io).  The buffer is big enough for a handler's write of a
+ * bufsiz of samples to go through it rather than straight from the handler.
+ * Returns the size of the buffer, placed in ft->write_buf. */
+static size_t set_write_block(sox_format_t * ft, char const * path, char * * buf)
+{
+  sox_context_t const * context = ft->context;
+  size_t const page = 4096;
+  size_t block = (context->write_block + page - 1) / page * page;
+  size_t size = (8 * context->bufsiz / block + 1) * block;
+
+  ft->write_buf = lsx_malloc(size + page);
+  *buf = (char *)(((uintptr_t)ft->write_buf + page - 1) & ~(uintptr_t)(page - 1));
+#ifdef O_DIRECT
+  if (context->direct_io) {
+    int fd = fileno((FILE*)ft->fp), flags = fcntl(fd, F_GETFL);
+    ft->direct_io = flags != -1 && !fcntl(fd, F_SETFL, flags | O_DIRECT);
+    if (!ft->direct_io)
+      lsx_debug("`%s': O_DIRECT unavailable: %s", path, strerror(errno));
+  }
+#endif
+  lsx_debug("`%s': writing through %" PRIuPTR " bytes of blocks", path, size);
+  return size;
+}
+
+/* Reserves space for an output file's expected length (which may be
+ * approximate), without changing its size as seen by the handler; any not
+ * used is given back on close */
+static void preallocate(sox_format_t * ft)
+{
+#if defined HAVE_FALLOCATE && defined FALLOC_FL_KEEP_SIZE
+  sox_uint64_t bytes = ft->signal.length * ft->encoding.bits_per_sample / 8;
+
+  if (!ft->write_buf || !bytes || bytes != (sox_uint64_t)(off_t)bytes)
+    return;
+  bytes += ft->context->write_block;  /* Headers, etc. */
+  if (fallocate(fileno((FILE*)ft->fp), FALLOC_FL_KEEP_SIZE, (off_t)0, (off_t)bytes))
+    lsx_debug("`%s': not preallocated: %s", ft->filename, strerror(errno));
+  else lsx_debug("`%s': preallocated %" PRIu64 " bytes", ft->filename, bytes);
+#else
+  (void)ft;
+#endif
+}
+
+/* Writes with O_DIRECT must be of whole aligned blocks, so stop before
+ * anything (a seek, a flush, or the close) that may leave a partial one */
+void lsx_end_direct_io(sox_format_t * ft)
+{
+#ifdef O_DIRECT
+  int fd = fileno((FILE*)ft->fp), flags = fcntl(fd, F_GETFL);
+
+  if (flags != -1)
+    fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+#endif
+  ft->direct_io = sox_false;
+}
+
+/* Frees any space preallocated beyond the end of the file */
+static void release_preallocation(sox_format_t * ft)
+{
+#if defined HAVE_FALLOCATE && defined FALLOC_FL_KEEP_SIZE
+  struct stat st;
+
+  if (!fflush((FILE*)ft->fp) && !fstat(fileno((FILE*)ft->fp), &st))
+    ftruncate(fileno((FILE*)ft->fp), st.st_size);
+#else
+  (void)ft;
+#endif
+}
+
 /* check that all settings have been given */
 static int sox_checkformat(sox_format_t * ft)
 {
@@ -365,7 +670,8 @@ static int xfclose(FILE * file, lsx_io_type io_type)
 {
   return
 #ifdef HAVE_POPEN
-    io_type != lsx_io_file? pclose(file) :
+    (io_type == lsx_io_pipe || io_type == lsx_io_url) &&
+      !lsx_http_stream(file)? pclose(file) :
 #endif
     fclose(file);
 }
@@ -387,6 +693,10 @@ static FILE * xfopen(char const * identifier, char const * mode, lsx_io_type * i
 #endif
     return f;
   }
+  else if (lsx_http_handles(identifier)) {
+    *io_type = lsx_io_url;
+    return lsx_http_open(identifier);
+  }
   else if (is_url(identifier)) {
     FILE * f = NULL;
 #ifdef HAVE_POPEN
@@ -431,19 +741,24 @@ static void UNUSED rewind_pipe(FILE * fp)
 }
 
 static sox_format_t * open_read(
+    sox_context_t            * context,
     char               const * path,
-    void                     * buffer UNUSED,
-    size_t                     buffer_size UNUSED,
+    void                     * buffer,
+    size_t                     buffer_size,
     sox_signalinfo_t   const * signal,
     sox_encodinginfo_t const * encoding,
-    char               const * filetype)
+    char               const * filetype,
+    sox_bool                   probe)
 {
   sox_format_t * ft = lsx_calloc(1, sizeof(*ft));
   sox_format_handler_t const * handler;
-  char const * const io_types[] = {"file", "pipe", "file URL"};
+  char const * const io_types[] = {"file", "pipe", "file URL", "buffer"};
   char const * type = "";
-  size_t   input_bufsiz = sox_globals.input_bufsiz?
-      sox_globals.input_bufsiz : sox_globals.bufsiz;
+  size_t   input_bufsiz = context->input_bufsiz?
+      context->input_bufsiz : context->bufsiz;
+
+  ft->context = context;
+  ft->probe = probe;
 
   if (filetype) {
     if (!(handler = sox_find_format(filetype, sox_false))) {
@@ -463,23 +778,29 @@ static sox_format_t * open_read(
       SET_BINARY_MODE(stdin);
       ft->fp = stdin;
     }
+    else if (buffer) {  /* No copy is made: see mem_input */
+      ft->io_type = lsx_io_mem;
+      ft->map = buffer;
+      ft->map_size = buffer_size;
+      type = io_types[ft->io_type];
+    }
     else {
-      ft->fp =
-#ifdef HAVE_FMEMOPEN
-        buffer? fmemopen(buffer, buffer_size, "rb") :
-#endif
-        xfopen(path, "rb", &ft->io_type);
+      ft->fp = xfopen(path, "rb", &ft->io_type);
       type = io_types[ft->io_type];
       if (ft->fp == NULL) {
         lsx_fail("can't open input %s `%s': %s", type, path, strerror(errno));
         goto error;
       }
     }
-    if (setvbuf (ft->fp, NULL, _IOFBF, sizeof(char) * input_bufsiz)) {
+    if (ft->fp && setvbuf (ft->fp, NULL, _IOFBF, sizeof(char) * input_bufsiz)) {
       lsx_fail("Can't set read buffer");
       goto error;
     }
     ft->seekable = is_seekable(ft);
+    if (ft->seekable && context->header_prefetch &&
+        (ft->io_type == lsx_io_file || ft->io_type == lsx_io_url) &&
+        (!filetype || (ft->handler.flags & SOX_FILE_MMAP)))
+      lsx_prefetch(ft, context->header_prefetch);
   }
 
   if (!filetype) {
@@ -518,9 +839,13 @@ static sox_format_t * open_read(
       }
     }
     ft->handler = *handler;
+    if (!(ft->handler.flags & SOX_FILE_MMAP))
+      lsx_end_prefetch(ft);  /* Its handler may read through stdio */
     if (ft->handler.flags & SOX_FILE_NOSTDIO) {
-      xfclose(ft->fp, ft->io_type);
+      if (ft->fp)
+        xfclose(ft->fp, ft->io_type);
       ft->fp = NULL;
+      ft->map = NULL;
     }
   }
   if (!ft->handler.startread && !ft->handler.read) {
@@ -543,6 +868,12 @@ static sox_format_t * open_read(
     lsx_set_signal_defaults(ft);
 
   ft->priv = lsx_calloc(1, ft->handler.priv_size);
+  if (mem_input(ft) != SOX_SUCCESS) {
+    lsx_fail("can't open input %s `%s': %s", type, ft->filename, ft->sox_errstr);
+    goto error;
+  }
+  if (!probe)  /* A header is read as well through stdio */
+    map_input(ft);
   /* Read and write starters can change their formats. */
   if (ft->handler.startread && (*ft->handler.startread)(ft) != SOX_SUCCESS) {
     lsx_fail("can't open input %s `%s': %s", type, ft->filename, ft->sox_errstr);
@@ -566,9 +897,12 @@ static sox_format_t * open_read(
     if (signal->channels && signal->channels != ft->signal.channels)
       lsx_warn("can't set %u channels; using %u", signal->channels, ft->signal.channels);
   }
+  lsx_decode_cache_open(ft);
   return ft;
 
 error:
+  unmap_input(ft);
+  free(ft->head);
   if (ft->fp && ft->fp != stdin)
     xfclose(ft->fp, ft->io_type);
   free(ft->priv);
@@ -584,7 +918,17 @@ sox_format_t * sox_open_read(
     sox_encodinginfo_t const * encoding,
     char               const * filetype)
 {
-  return open_read(path, NULL, (size_t)0, signal, encoding, filetype);
+  return open_read(&sox_globals, path, NULL, (size_t)0, signal, encoding, filetype, sox_false);
+}
+
+sox_format_t * sox_open_context_read(
+    sox_context_t            * context,
+    char               const * path,
+    sox_signalinfo_t   const * signal,
+    sox_encodinginfo_t const * encoding,
+    char               const * filetype)
+{
+  return open_read(context, path, NULL, (size_t)0, signal, encoding, filetype, sox_false);
 }
 
 sox_format_t * sox_open_mem_read(
@@ -594,7 +938,89 @@ sox_format_t * sox_open_mem_read(
     sox_encodinginfo_t const * encoding,
     char               const * filetype)
 {
-  return open_read("", buffer, buffer_size, signal,encoding,filetype);
+  return open_read(&sox_globals, "", buffer, buffer_size, signal,encoding,filetype, sox_false);
+}
+
+sox_format_t * sox_open_probe(
+    char               const * path,
+    char               const * filetype)
+{
+  return open_read(&sox_globals, path, NULL, (size_t)0, NULL, NULL, filetype, sox_true);
+}
+
+sox_format_t * sox_open_read_clone(sox_format_t * ft)
+{
+  sox_format_t * clone;
+
+  if (ft->mode != 'r' || !(ft->handler.flags & SOX_FILE_CLONE) ||
+      !ft->handler.seek) {
+    lsx_fail("can't clone a reader of `%s'", ft->filename);
+    return NULL;
+  }
+  if (!share_input(ft)) {
+    lsx_fail("can't clone a reader of `%s': %s", ft->filename, ft->sox_errstr);
+    return NULL;
+  }
+  clone = lsx_malloc(sizeof(*clone));
+  *clone = *ft;
+  clone->filename = lsx_strdup(ft->filename);
+  clone->filetype = lsx_strdup(ft->filetype);
+  clone->oob.comments = sox_copy_comments(ft->oob.comments);
+  clone->priv = lsx_calloc(1, ft->handler.priv_size);
+  if (ft->handler.priv_size)
+    memcpy(clone->priv, ft->priv, ft->handler.priv_size);
+  clone->fp = NULL;     /* So it reads through the map or with pread() */
+  clone->head = NULL;
+  clone->io_async = clone->write_buf = NULL;
+  clone->decode_ahead = clone->decode_cache = NULL;
+  clone->quantiser = NULL;
+  clone->read_comments = NULL;
+  clone->clips = clone->olength = 0;
+  clone->sox_errno = SOX_SUCCESS;
+  clone->map_eof = sox_false;
+  if (!ft->map)
+    clone->map_size = ((shared_input_t *)ft->shared)->size;
+  if ((*clone->handler.seek)(clone, (uint64_t)0) != SOX_SUCCESS) {
+    lsx_fail("can't clone a reader of `%s': %s", ft->filename, clone->sox_errstr);
+    sox_close(clone);
+    return NULL;
+  }
+  return clone;
+}
+
+int sox_read_comments(sox_format_t * ft)
+{
+  int (*read_comments)(sox_format_t * ft) = ft->read_comments;
+
+  if (!read_comments)
+    return SOX_SUCCESS;
+  if (ft->decode_ahead) {
+    lsx_fail_errno(ft, SOX_EINVAL, "comments must be read before decoding ahead");
+    return SOX_EOF;
+  }
+  ft->read_comments = NULL;
+  return (*read_comments)(ft);
+}
+
+int sox_rewrite_comments(
+    char const * path,
+    char const * filetype,
+    sox_comments_t comments)
+{
+  sox_format_t * ft = sox_open_probe(path, filetype);
+  sox_format_handler_rewrite_comments rewrite = NULL;
+  int result = SOX_EOF;
+
+  if (!ft)
+    return SOX_EOF;
+  if (!ft->seekable || ft->io_type != lsx_io_file)
+    lsx_fail("can't rewrite `%s' in place: not a file", path);
+  else if (!(rewrite = ft->handler.rewrite_comments))
+    lsx_fail("can't rewrite `%s' in place: not supported by the `%s' format",
+        path, ft->filetype);
+  else result = SOX_SUCCESS;
+  sox_close(ft);
+  return result == SOX_SUCCESS? rewrite(path, comments) : result;
 }
 
 sox_bool sox_format_supports_encoding(
@@ -819,7 +1245,40 @@ sox_format_handler_t const * sox_write_handler(
   return handler;
 }
 
+/* For sox_open_write_resume: after startwrite has written the header again
+ * (with ft->olength set to olength, for the handler to count on from), goes
+ * on from offset, cutting off anything after it.  The header must have come
+ * out the same size, and each sample be written on its own (SOX_FILE_RAWPCM,
+ * with a plain encoding), for what was written before to be carried on. */
+static int resume_output(sox_format_t * ft, sox_uint64_t olength,
+    sox_uint64_t offset)
+{
+  sox_encoding_t e = ft->encoding.encoding;
+  sox_uint64_t start = offset - olength * (ft->encoding.bits_per_sample >> 3);
+
+  if (!(ft->handler.flags & SOX_FILE_RAWPCM) || ft->io_type != lsx_io_file ||
+      !ft->seekable || (ft->encoding.bits_per_sample & 7) ||
+      (e != SOX_ENCODING_SIGN2 && e != SOX_ENCODING_UNSIGNED &&
+       e != SOX_ENCODING_FLOAT && e != SOX_ENCODING_ULAW &&
+       e != SOX_ENCODING_ALAW)) {
+    lsx_fail_errno(ft, SOX_ENOTSUP, "only files of plain PCM can be resumed");
+    return SOX_EOF;
+  }
+  if (lsx_flush(ft) || start > offset || (sox_uint64_t)lsx_tell(ft) != start) {
+    lsx_fail_errno(ft, SOX_EHDR, "the header is not as it was");
+    return SOX_EOF;
+  }
+  if (ftruncate(fileno((FILE*)ft->fp), (off_t)offset) ||
+      lsx_seeki(ft, (off_t)offset, SEEK_SET) != SOX_SUCCESS) {
+    lsx_fail_errno(ft, errno, "%s", strerror(errno));
+    return SOX_EOF;
+  }
+  ft->tell_off = offset;
+  return SOX_SUCCESS;
+}
+
 static sox_format_t * open_write(
+    sox_context_t            * context,
     char               const * path,
     void                     * buffer UNUSED,
     size_t                     buffer_size UNUSED,
@@ -829,11 +1288,15 @@ static sox_format_t * open_write(
     sox_encodinginfo_t const * encoding,
     char               const * filetype,
     sox_oob_t          const * oob,
-    sox_bool           (*overwrite_permitted)(const char *filename))
+    sox_bool           (*overwrite_permitted)(const char *filename),
+    sox_uint64_t       const * resume)
 {
   sox_format_t * ft = lsx_calloc(sizeof(*ft), 1);
   sox_format_handler_t const * handler;
+  char * write_buf = NULL;
+  size_t write_bufsiz = context->bufsiz;
 
+  ft->context = context;
   if (!path || !signal) {
     lsx_fail("must specify file name and signal parameters to write file");
     goto error;
@@ -854,9 +1317,16 @@ static sox_format_t * open_write(
       SET_BINARY_MODE(stdout);
       ft->fp = stdout;
     }
+    else if (lsx_s3_handles(path) && !buffer && !buffer_ptr) {
+      ft->io_type = lsx_io_upload;
+      if (!(ft->fp = lsx_s3_open(path))) {
+        lsx_fail("can't open output file `%s': %s", path, strerror(errno));
+        goto error;
+      }
+    }
     else {
       struct stat st;
-      if (!stat(path, &st) && (st.st_mode & S_IFMT) == S_IFREG &&
+      if (!resume && !stat(path, &st) && (st.st_mode & S_IFMT) == S_IFREG &&
           (overwrite_permitted && !overwrite_permitted(path))) {
         lsx_fail("permission to overwrite `%s' denied", path);
         goto error;
@@ -866,20 +1336,23 @@ static sox_format_t * open_write(
         buffer? fmemopen(buffer, buffer_size, "w+b") :
         buffer_ptr? open_memstream(buffer_ptr, buffer_size_ptr) :
 #endif
-        fopen(path, "w+b");
+        fopen(path, resume? "r+b" : "w+b");
       if (ft->fp == NULL) {
         lsx_fail("can't open output file `%s': %s", path, strerror(errno));
         goto error;
       }
     }
 
+    ft->seekable = is_seekable(ft);
+    if (ft->seekable && context->write_block && ft->fp != stdout && !resume &&
+        ft->io_type == lsx_io_file && !buffer && !buffer_ptr)
+      write_bufsiz = set_write_block(ft, path, &write_buf);
     /* stdout tends to be line-buffered.  Override this */
     /* to be Full Buffering. */
-    if (setvbuf (ft->fp, NULL, _IOFBF, sizeof(char) * sox_globals.bufsiz)) {
+    if (setvbuf (ft->fp, write_buf, _IOFBF, sizeof(char) * write_bufsiz)) {
       lsx_fail("Can't set write buffer");
       goto error;
     }
-    ft->seekable = is_seekable(ft);
   }
 
   ft->filetype = lsx_strdup(filetype);
@@ -910,6 +1383,8 @@ static sox_format_t * open_write(
     lsx_warn("can't seek in output file `%s'; length in file header will be unspecified", ft->filename);
 
   ft->priv = lsx_calloc(1, ft->handler.priv_size);
+  if (resume)  /* For the handler to count on from */
+    ft->olength = resume[0];
   /* Read and write starters can change their formats. */
   if (ft->handler.startwrite && (ft->handler.startwrite)(ft) != SOX_SUCCESS){
     lsx_fail("can't open output file `%s': %s", ft->filename, ft->sox_errstr);
@@ -920,6 +1395,11 @@ static sox_format_t * open_write(
     lsx_fail("bad format for output file `%s': %s", ft->filename, ft->sox_errstr);
     goto error;
   }
+  if (resume && resume_output(ft, resume[0], resume[1]) != SOX_SUCCESS) {
+    lsx_fail("can't resume output file `%s': %s", ft->filename, ft->sox_errstr);
+    goto error;
+  }
+  preallocate(ft);
 
   if ((ft->handler.flags & SOX_FILE_DEVICE) && signal) {
     if (signal->rate && signal->rate != ft->signal.rate)
@@ -927,11 +1407,14 @@ static sox_format_t * open_write(
     if (signal->channels && signal->channels != ft->signal.channels)
       lsx_report("can't set %u channels; using %u", signal->channels, ft->signal.channels);
   }
+  if (ft->io_type == lsx_io_upload) /* Have a part uploaded as the next fills */
+    sox_set_io_async(ft, (unsigned)max(2, LSX_S3_PART_SIZE / context->bufsiz));
   return ft;
 
 error:
   if (ft->fp && ft->fp != stdout)
     xfclose(ft->fp, ft->io_type);
+  free(ft->write_buf);
   free(ft->priv);
   free(ft->filename);
   free(ft->filetype);
@@ -947,7 +1430,33 @@ sox_format_t * sox_open_write(
     sox_oob_t          const * oob,
     sox_bool           (*overwrite_permitted)(const char *filename))
 {
-  return open_write(path, NULL, (size_t)0, NULL, NULL, signal, encoding, filetype, oob, overwrite_permitted);
+  return open_write(&sox_globals, path, NULL, (size_t)0, NULL, NULL, signal, encoding, filetype, oob, overwrite_permitted, NULL);
+}
+
+sox_format_t * sox_open_write_resume(
+    char               const * path,
+    sox_signalinfo_t   const * signal,
+    sox_encodinginfo_t const * encoding,
+    char               const * filetype,
+    sox_oob_t          const * oob,
+    sox_uint64_t               olength,
+    sox_uint64_t               offset)
+{
+  sox_uint64_t const resume[2] = {olength, offset};
+
+  return open_write(&sox_globals, path, NULL, (size_t)0, NULL, NULL, signal, encoding, filetype, oob, NULL, resume);
+}
+
+sox_format_t * sox_open_context_write(
+    sox_context_t            * context,
+    char               const * path,
+    sox_signalinfo_t   const * signal,
+    sox_encodinginfo_t const * encoding,
+    char               const * filetype,
+    sox_oob_t          const * oob,
+    sox_bool           (*overwrite_permitted)(const char *filename))
+{
+  return open_write(context, path, NULL, (size_t)0, NULL, NULL, signal, encoding, filetype, oob, overwrite_permitted, NULL);
 }
 
 sox_format_t * sox_open_mem_write(
@@ -958,7 +1467,7 @@ sox_format_t * sox_open_mem_write(
     char               const * filetype,
     sox_oob_t          const * oob)
 {
-  return open_write("", buffer, buffer_size, NULL, NULL, signal, encoding, filetype, oob, NULL);
+  return open_write(&sox_globals, "", buffer, buffer_size, NULL, NULL, signal, encoding, filetype, oob, NULL, NULL);
 }
 
 sox_format_t * sox_open_memstream_write(
@@ -969,7 +1478,18 @@ sox_format_t * sox_open_memstream_write(
     char               const * filetype,
     sox_oob_t          const * oob)
 {
-  return open_write("", NULL, (size_t)0, buffer_ptr, buffer_size_ptr, signal, encoding, filetype, oob, NULL);
+  return open_write(&sox_globals, "", NULL, (size_t)0, buffer_ptr, buffer_size_ptr, signal, encoding, filetype, oob, NULL, NULL);
+}
+
+/* As sox_read, but straight from the format handler */
+size_t lsx_decode(sox_format_t * ft, sox_sample_t * buf, size_t len)
+{
+  size_t actual;
+
+  if (ft->decode_cache)
+    return lsx_decode_cache_read(ft, buf, len);
+  actual = ft->handler.read? (*ft->handler.read)(ft, buf, len) : 0;
+  return actual > len? 0 : actual;
 }
 
 size_t sox_read(sox_format_t * ft, sox_sample_t * buf, size_t len)
@@ -977,26 +1497,81 @@ size_t sox_read(sox_format_t * ft, sox_sample_t * buf, size_t len)
   size_t actual;
   if (ft->signal.length != SOX_UNSPEC)
     len = min(len, ft->signal.length - ft->olength);
-  actual = ft->handler.read? (*ft->handler.read)(ft, buf, len) : 0;
-  actual = actual > len? 0 : actual;
+  lsx_trace2(read__entry, ft->filename, len);
+  actual = ft->decode_ahead?
+      lsx_decode_ahead_read(ft, buf, len) : lsx_decode(ft, buf, len);
+  lsx_trace2(read__return, ft->filename, actual);
   ft->olength += actual;
   return actual;
 }
 
 size_t sox_write(sox_format_t * ft, const sox_sample_t *buf, size_t len)
 {
-  size_t actual = ft->handler.write? (*ft->handler.write)(ft, buf, len) : 0;
+  size_t actual;
+  lsx_trace2(write__entry, ft->filename, len);
+  actual = ft->handler.write? (*ft->handler.write)(ft, buf, len) : 0;
+  lsx_trace2(write__return, ft->filename, actual);
   ft->olength += actual;
   return actual;
 }
 
+size_t sox_read_planar(sox_format_t * ft, sox_sample_t * const * bufs, size_t len)
+{
+  size_t chans = max(ft->signal.channels, 1), actual, i, c;
+  sox_sample_t * buf;
+
+  if (ft->signal.length != SOX_UNSPEC)
+    len = min(len, (ft->signal.length - ft->olength) / chans);
+  if (ft->handler.read_planar && !ft->decode_ahead && !ft->decode_cache) {
+    lsx_trace2(read__entry, ft->filename, len * chans);
+    actual = (*ft->handler.read_planar)(ft, bufs, len);
+    if (actual > len)
+      actual = 0;
+    lsx_trace2(read__return, ft->filename, actual * chans);
+    ft->olength += actual * chans;
+    return actual;
+  }
+  buf = lsx_malloc(len * chans * sizeof(*buf));
+  actual = sox_read(ft, buf, len * chans) / chans;
+  for (c = 0; c < chans; ++c)
+    for (i = 0; i < actual; ++i)
+      bufs[c][i] = buf[i * chans + c];
+  free(buf);
+  return actual;
+}
+
+size_t sox_write_planar(sox_format_t * ft, sox_sample_t const * const * bufs, size_t len)
+{
+  size_t chans = max(ft->signal.channels, 1), actual, i, c;
+  sox_sample_t * buf;
+
+  if (ft->handler.write_planar) {
+    lsx_trace2(write__entry, ft->filename, len * chans);
+    actual = (*ft->handler.write_planar)(ft, bufs, len);
+    lsx_trace2(write__return, ft->filename, actual * chans);
+    ft->olength += actual * chans;
+    return actual;
+  }
+  buf = lsx_malloc(len * chans * sizeof(*buf));
+  for (c = 0; c < chans; ++c)
+    for (i = 0; i < len; ++i)
+      buf[i * chans + c] = bufs[c][i];
+  actual = sox_write(ft, buf, len * chans) / chans;
+  free(buf);
+  return actual;
+}
+
 int sox_close(sox_format_t * ft)
 {
   int result = SOX_SUCCESS;
 
+  lsx_decode_ahead_close(ft);
+  lsx_decode_cache_close(ft);
   if (ft->mode == 'r')
     result = ft->handler.stopread? (*ft->handler.stopread)(ft) : SOX_SUCCESS;
   else {
+    if (ft->direct_io)
+      lsx_end_direct_io(ft);
     if (ft->handler.flags & SOX_FILE_REWIND) {
       if (ft->olength != ft->signal.length && ft->seekable) {
         result = lsx_seeki(ft, (off_t)0, 0);
@@ -1008,8 +1583,20 @@ int sox_close(sox_format_t * ft)
     else result = ft->handler.stopwrite? (*ft->handler.stopwrite)(ft) : SOX_SUCCESS;
   }
 
-  if (ft->fp && ft->fp != stdin && ft->fp != stdout)
-    xfclose(ft->fp, ft->io_type);
+  if (lsx_io_async_close(ft) != SOX_SUCCESS)
+    result = SOX_EOF;
+  unmap_input(ft);
+  free(ft->head);
+  if (ft->quantiser)
+    sox_delete_effect(ft->quantiser);
+  if (ft->write_buf)
+    release_preallocation(ft);
+  if (ft->fp && ft->fp != stdin && ft->fp != stdout &&
+      xfclose(ft->fp, ft->io_type) && ft->io_type == lsx_io_upload) {
+    lsx_fail("`%s': upload failed", ft->filename);
+    result = SOX_EOF;
+  }
+  free(ft->write_buf);
   free(ft->priv);
   free(ft->filename);
   free(ft->filetype);
@@ -1025,11 +1612,22 @@ int sox_seek(sox_format_t * ft, sox_uint64_t offset, int whence)
     if (whence != SOX_SEEK_SET)
         return SOX_EOF; /* FIXME: return SOX_EINVAL */
 
+    if (ft->decode_cache && !ft->decode_ahead &&    /* Else, under its lock */
+        lsx_decode_cache_seek(ft, offset) == SOX_SUCCESS) {
+      ft->olength = offset;
+      return SOX_SUCCESS;
+    }
+
     /* If file is a seekable file and this handler supports seeking,
      * then invoke handler's function.
      */
-    if (ft->seekable && ft->handler.seek)
-      return (*ft->handler.seek)(ft, offset);
+    if (ft->seekable && ft->handler.seek) {
+      int result = ft->decode_ahead? lsx_decode_ahead_seek(ft, offset) :
+          (*ft->handler.seek)(ft, offset);
+      if (result == SOX_SUCCESS && ft->mode == 'r')
+        ft->olength = offset;     /* So that sox_read stops at the same end */
+      return result;
+    }
     return SOX_EOF; /* FIXME: return SOX_EBADF */
 }
 
@@ -1188,103 +1786,351 @@ sox_get_format_fns(void)
     return s_sox_format_fns;
 }
 
+/* The formats by name (an open-addressed hash table), with, for each name,
+ * the first handler of it and the first that is not a device (so that
+ * look-ups find what a search of the format table in order would); and the
+ * formats that give their own signatures.  Built on first use, and again
+ * only after plugins have been added to the format table. */
+static struct {
+  sox_bool built;
+  size_t mask;                          /* Slots, less 1 */
+  struct {
+    char const * name;
+    sox_format_handler_t const * any, * file;
+  } * by_name;
+  sox_format_handler_t const * * with_signatures; /* NULL-terminated */
+} format_index;
+
+static void unindex_formats(void)
+{
+  free(format_index.by_name);
+  free(format_index.with_signatures);
+  memset(&format_index, 0, sizeof(format_index));
+}
+
+static void index_formats(void)
+{
+  size_t f, n, i, names = 0, slots = 64, signed_formats = 0;
+
+  for (f = 0; s_sox_format_fns[f].fn; ++f)
+    for (n = 0; s_sox_format_fns[f].fn()->names[n]; ++n)
+      ++names;
+  while (slots < 2 * names)
+    slots <<= 1;
+  format_index.mask = slots - 1;
+  format_index.by_name = lsx_calloc(slots, sizeof(*format_index.by_name));
+  format_index.with_signatures = lsx_calloc(f + 1, sizeof(*format_index.with_signatures));
+  for (f = 0; s_sox_format_fns[f].fn; ++f) {
+    sox_format_handler_t const * handler = s_sox_format_fns[f].fn();
+
+    for (n = 0; handler->names[n]; ++n) {
+      char const * name = handler->names[n];
+      for (i = lsx_hash_name(name) & format_index.mask;
+          format_index.by_name[i].name &&
+          strcasecmp(format_index.by_name[i].name, name);
+          i = (i + 1) & format_index.mask);
+      if (!format_index.by_name[i].name) {
+        format_index.by_name[i].name = name;
+        format_index.by_name[i].any = handler;
+      }
+      if (!format_index.by_name[i].file && !(handler->flags & SOX_FILE_DEVICE))
+        format_index.by_name[i].file = handler;
+    }
+    if (handler->signatures && handler->signatures->length)
+      format_index.with_signatures[signed_formats++] = handler;
+  }
+  format_index.built = sox_true;
+}
+
+/* The name of the first format (e.g. a plugin) that gives its own signatures
+ * and whose signature data matches, or NULL.  The index is used only in
+ * lsx_format_index, as a plugin loaded on another thread may replace it. */
+static char const * signed_format(unsigned char const * data, size_t len)
+{
+  sox_format_handler_t const * const * f;
+  char const * name = NULL;
+
+  #pragma omp critical(lsx_format_index)
+  {
+    if (!format_index.built)
+      index_formats();
+    for (f = format_index.with_signatures; *f && !name; ++f) {
+      sox_format_signature_t const * sig = (*f)->signatures;
+      for (; sig->length && !name; ++sig)
+        if (sig_matches(sig, data, len))
+          name = (*f)->names[0];
+    }
+  }
+  return name;
+}
+
 #ifdef HAVE_LIBLTDL /* Plugin format handlers */
   static unsigned nformats = NSTATIC_FORMATS;
+  static sox_bool ltdl_initted = sox_false;
 
-  static int init_format(const char *file, lt_ptr data)
+  #define MANIFEST_NAME "formats.manifest"
+
+  /* The manifest (if installed) lists each plugin in PKGLIBDIR with the
+   * format names it handles, so that a plugin need be loaded only when one of
+   * its names is looked up.  Each line is: file-name name [name...]  */
+  static struct {
+    sox_bool read;
+    char * text;                /* The manifest, split into words in place */
+    struct {char const * name, * plugin;} * entries;
+    size_t num_entries;
+  } manifest;
+
+  static int ltdl_init(void)
+  {
+    int error;
+
+    if (ltdl_initted)
+      return SOX_SUCCESS;
+    if ((error = lt_dlinit()) != 0) {
+      lsx_fail("lt_dlinit failed with %d error(s): %s", error, lt_dlerror());
+      return SOX_EOF;
+    }
+    ltdl_initted = sox_true;
+    return SOX_SUCCESS;
+  }
+
+  /* Opens a plugin (given as its path less extension), returning its entry
+   * point, or NULL if it is not a compatible format plugin. */
+  static sox_format_fn_t open_plugin(const char *file)
   {
-    lt_dlhandle lth = lt_dlopenext(file);
     const char *end = file + strlen(file);
     const char prefix[] = "sox_fmt_";
     char fnname[MAX_NAME_LEN];
     char *start = strstr(file, prefix);
 
-    (void)data;
     if (start && (start += sizeof(prefix) - 1) < end) {
       int ret = snprintf(fnname, MAX_NAME_LEN,
           "lsx_%.*s_format_fn", (int)(end - start), start);
       if (ret > 0 && ret < (int)MAX_NAME_LEN) {
+        lt_dlhandle lth = lt_dlopenext(file);
         union {sox_format_fn_t fn; lt_ptr ptr;} ltptr;
-        ltptr.ptr = lt_dlsym(lth, fnname);
+        ltptr.ptr = lth? lt_dlsym(lth, fnname) : NULL;
         lsx_debug("opening format plugin `%s': library %p, entry point %p\n",
             fnname, (void *)lth, ltptr.ptr);
         if (ltptr.fn && (ltptr.fn()->sox_lib_version_code & ~255) ==
-            (SOX_LIB_VERSION_CODE & ~255)) { /* compatible version check */
-          if (nformats == MAX_FORMATS) {
-            lsx_warn("too many plugin formats");
-            return -1;
-          }
-          s_sox_format_fns[nformats++].fn = ltptr.fn;
-        }
+            (SOX_LIB_VERSION_CODE & ~255)) /* compatible version check */
+          return ltptr.fn;
+      }
+    }
+    return NULL;
+  }
+
+  static int init_format(const char *file, lt_ptr data)
+  {
+    sox_format_fn_t fn = open_plugin(file);
+    unsigned f;
+
+    (void)data;
+    if (fn) {
+      for (f = NSTATIC_FORMATS; f < nformats; ++f)
+        if (s_sox_format_fns[f].fn == fn)
+          return 0;               /* Already loaded (through the manifest) */
+      if (nformats == MAX_FORMATS) {
+        lsx_warn("too many plugin formats");
+        return -1;
       }
+      s_sox_format_fns[nformats++].fn = fn;
+      s_sox_format_fns[nformats].fn = NULL;
+      #pragma omp critical(lsx_format_index)
+      unindex_formats();
+    }
+    return 0;
+  }
+
+  static int list_format(const char *file, lt_ptr data)
+  {
+    sox_format_fn_t fn = open_plugin(file);
+    char const * base = strrchr(file, '/');
+    char const * const * names;
+
+    if (fn) {
+      fputs(base? base + 1 : file, (FILE *)data);
+      for (names = fn()->names; *names; ++names)
+        fprintf((FILE *)data, " %s", *names);
+      fputc('\n', (FILE *)data);
     }
     return 0;
   }
+
+  static void read_manifest(void)
+  {
+    FILE * file;
+    char * word, * plugin = NULL;
+    size_t len = 0;
+
+    manifest.read = sox_true;
+    if (!(file = fopen(PKGLIBDIR "/" MANIFEST_NAME, "r")))
+      return;
+    for (;;) { /* Read it whole */
+      manifest.text = lsx_realloc(manifest.text, len + 4097);
+      len += fread(manifest.text + len, 1, 4096, file);
+      if (feof(file) || ferror(file))
+        break;
+    }
+    manifest.text[len] = '\0';
+    fclose(file);
+
+    for (word = manifest.text; *word;) {
+      size_t n = strcspn(word, " \t\r\n");
+      char sep = word[n];
+      if (n) {
+        word[n] = '\0';
+        if (!plugin)
+          plugin = word;
+        else {
+          lsx_revalloc(manifest.entries, manifest.num_entries + 1);
+          manifest.entries[manifest.num_entries].name = word;
+          manifest.entries[manifest.num_entries++].plugin = plugin;
+        }
+      }
+      if (sep == '\n')
+        plugin = NULL;
+      word += n + (sep != '\0');
+    }
+    lsx_debug("read %" PRIuPTR " names from %s", manifest.num_entries,
+        PKGLIBDIR "/" MANIFEST_NAME);
+  }
+
+  /* Loads the plugin that the manifest says handles the named format.
+   * Returns whether this has added to the format table. */
+  static sox_bool load_listed_plugin(char const * name)
+  {
+    size_t i;
+    sox_bool loaded;
+
+    #pragma omp critical(lsx_ltdl)  /* See lsx_open_dllibrary */
+    {
+      unsigned old_nformats = nformats;
+      if (!plugins_initted) {   /* Else all are loaded already */
+        if (!manifest.read)
+          read_manifest();
+        for (i = 0; i < manifest.num_entries; ++i)
+          if (!strcasecmp(manifest.entries[i].name, name)) {
+            char * path = lsx_malloc(strlen(PKGLIBDIR) + strlen(manifest.entries[i].plugin) + 2);
+            sprintf(path, "%s/%s", PKGLIBDIR, manifest.entries[i].plugin);
+            if (ltdl_init() == SOX_SUCCESS)
+              init_format(path, NULL);
+            free(path);
+            break;
+          }
+      }
+      loaded = nformats != old_nformats;
+    }
+    return loaded;
+  }
 #endif
 
 int sox_format_init(void) /* Find & load format handlers.  */
 {
-  if (plugins_initted)
-    return SOX_EOF;
+  int ret = SOX_EOF;
 
-  plugins_initted = sox_true;
+  #pragma omp critical(lsx_ltdl)  /* See lsx_open_dllibrary */
+  if (!plugins_initted) {
+    plugins_initted = sox_true;
+    ret = SOX_SUCCESS;
 #ifdef HAVE_LIBLTDL
-  {
-    int error = lt_dlinit();
-    if (error) {
-      lsx_fail("lt_dlinit failed with %d error(s): %s", error, lt_dlerror());
-      return SOX_EOF;
-    }
-    lt_dlforeachfile(PKGLIBDIR, init_format, NULL);
-  }
+    if (ltdl_init() != SOX_SUCCESS)
+      ret = SOX_EOF;
+    else lt_dlforeachfile(PKGLIBDIR, init_format, NULL);
 #endif
-  return SOX_SUCCESS;
+  }
+  return ret;
 }
 
 void sox_format_quit(void) /* Cleanup things.  */
 {
+  unindex_formats();
 #ifdef HAVE_LIBLTDL
   int ret;
-  if (plugins_initted && (ret = lt_dlexit()) != 0)
+  if (ltdl_initted && (ret = lt_dlexit()) != 0)
     lsx_fail("lt_dlexit failed with %d error(s): %s", ret, lt_dlerror());
-  plugins_initted = sox_false;
+  ltdl_initted = sox_false;
   nformats = NSTATIC_FORMATS;
+  s_sox_format_fns[nformats].fn = NULL;
+  free(manifest.text);
+  free(manifest.entries);
+  memset(&manifest, 0, sizeof(manifest));
+  plugins_initted = sox_false;
 #endif
 }
 
-/* Find a named format in the formats library.
- *
- * (c) 2005-9 Chris Bagwell and SoX contributors.
- * Copyright 1991 Lance Norskog And Sundry Contributors.
- *
- * This source code is freely redistributable and may be used for any
- * purpose.  This copyright notice must be maintained.
- *
- * Lance Norskog, Sundry Contributors, Chris Bagwell and SoX contributors
- * are not responsible for the consequences of using this software.
- */
-sox_format_handler_t const * sox_find_format(char const * name0, sox_bool no_dev)
+int sox_write_format_manifest(char const * dir)
+{
+#ifdef HAVE_LIBLTDL
+  char * path, * tmp_path;
+  FILE * file;
+  int result = SOX_EOF;
+
+  if (ltdl_init() != SOX_SUCCESS)
+    return SOX_EOF;
+  dir = dir? dir : PKGLIBDIR;
+  path = lsx_malloc(strlen(dir) + sizeof("/" MANIFEST_NAME ".tmp"));
+  tmp_path = lsx_malloc(strlen(dir) + sizeof("/" MANIFEST_NAME ".tmp"));
+  sprintf(path, "%s/%s", dir, MANIFEST_NAME);
+  sprintf(tmp_path, "%s.tmp", path);
+  if (!(file = fopen(tmp_path, "w")))
+    lsx_fail("can't create `%s': %s", tmp_path, strerror(errno));
+  else {
+    lt_dlforeachfile(dir, list_format, file);
+    if (fclose(file) || rename(tmp_path, path)) {
+      lsx_fail("can't write `%s': %s", path, strerror(errno));
+      remove(tmp_path);
+    }
+    else result = SOX_SUCCESS;
+  }
+  free(tmp_path);
+  free(path);
+  return result;
+#else
+  (void)dir;
+  lsx_fail("this build of SoX does not use format plugins");
+  return SOX_EOF;
+#endif
+}
+
+static sox_format_handler_t const * find_loaded_format(char const * name,
+    sox_bool no_dev)
 {
-  size_t f, n;
+  size_t i;
+  sox_format_handler_t const * handler = NULL;
 
+  #pragma omp critical(lsx_format_index)
+  {
+    if (!format_index.built)
+      index_formats();
+    for (i = lsx_hash_name(name) & format_index.mask;
+        format_index.by_name[i].name; i = (i + 1) & format_index.mask)
+      if (!strcasecmp(format_index.by_name[i].name, name)) {
+        handler = no_dev? format_index.by_name[i].file : format_index.by_name[i].any;
+        break;
+      }
+  }
+  return handler;
+}
+
+sox_format_handler_t const * sox_find_format(char const * name0, sox_bool no_dev)
+{
   if (name0) {
     char * name = lsx_strdup(name0);
     char * pos = strchr(name, ';');
+    sox_format_handler_t const * handler;
     if (pos) /* Use only the 1st clause of a mime string */
       *pos = '\0';
-    for (f = 0; s_sox_format_fns[f].fn; ++f) {
-      sox_format_handler_t const * handler = s_sox_format_fns[f].fn();
-
-      if (!(no_dev && (handler->flags & SOX_FILE_DEVICE)))
-        for (n = 0; handler->names[n]; ++n)
-          if (!strcasecmp(handler->names[n], name)) {
-            free(name);
-            return handler;                 /* Found it. */
-          }
-    }
+    handler = find_loaded_format(name, no_dev);
+#ifdef HAVE_LIBLTDL
+    if (!handler && load_listed_plugin(name))
+      handler = find_loaded_format(name, no_dev);
+#endif
     free(name);
+    if (handler)
+      return handler;
   }
-  if (sox_format_init() == SOX_SUCCESS)   /* Try again with plugins */
+  if (sox_format_init() == SOX_SUCCESS)   /* Try again with all plugins */
     return sox_find_format(name0, no_dev);
   return NULL;
 }
@@ -62,6 +62,10 @@
   FORMAT(wav)
   FORMAT(wve)
   FORMAT(xa)
+#if defined HAVE_GETADDRINFO && defined HAVE_NETDB_H
+  FORMAT(rtp)
+  FORMAT(udp)
+#endif
 
 /*--------------------- Plugin or static format handlers ---------------------*/
 
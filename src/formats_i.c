@@ -22,6 +22,10 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <stdarg.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+  #include <unistd.h>
+#endif
 
 void lsx_fail_errno(sox_format_t * ft, int sox_errno, const char *fmt, ...)
 {
@@ -90,18 +94,107 @@ int lsx_check_read_params(sox_format_t * ft, unsigned channels,
   return SOX_EOF;
 }
 
+/* Is ft read at tell_off: from a memory-map, or with pread() as a clone
+ * (see sox_open_read_clone)? */
+#define POSITIONAL(ft) ((ft)->map || ((ft)->shared && !(ft)->fp))
+
+/* Consumes up to len bytes of a memory-mapped file or memory buffer, as
+ * fread() would; returns where they lie in the map. */
+static unsigned char const * map_read(sox_format_t * ft, size_t len,
+    size_t * nread)
+{
+  sox_uint64_t off = min(ft->tell_off, ft->map_size);
+
+  if (len > ft->map_size - off) {
+    len = ft->map_size - off;
+    ft->map_eof = sox_true;
+  }
+  ft->tell_off += len;
+  *nread = len;
+  return ft->map + off;
+}
+
+/* Reads up to len bytes from the start of a seekable input at once, so
+ * that its header is parsed from memory, with one request to the storage
+ * rather than one for each chunk read or skipped; reads and seeks are served
+ * from the head until they leave it (see lsx_end_prefetch). */
+void lsx_prefetch(sox_format_t * ft, size_t len)
+{
+  ft->head = lsx_malloc(len);
+  ft->head_len = fread(ft->head, (size_t)1, len, (FILE*)ft->fp);
+  if (!ft->head_len) {
+    free(ft->head);
+    ft->head = NULL;
+    rewind((FILE*)ft->fp);
+    return;
+  }
+  ft->tell_off = 0;
+  lsx_debug("`%s': prefetched %" PRIuPTR " bytes", ft->filename, ft->head_len);
+}
+
+/* Continues reading through stdio from where reading of the head got to. */
+void lsx_end_prefetch(sox_format_t * ft)
+{
+  if (!ft->head)
+    return;
+  if (ft->tell_off != ft->head_len &&
+      fseeko((FILE*)ft->fp, (off_t)ft->tell_off, SEEK_SET) == -1)
+    lsx_fail_errno(ft, errno, "%s", strerror(errno));
+  free(ft->head);
+  ft->head = NULL;
+}
+
 /* Read in a buffer of data of length len bytes.
  * Returns number of bytes read.
  */
 size_t lsx_readbuf(sox_format_t * ft, void *buf, size_t len)
 {
-  size_t ret = fread(buf, (size_t) 1, len, (FILE*)ft->fp);
-  if (ret != len && ferror((FILE*)ft->fp))
-    lsx_fail_errno(ft, errno, "lsx_readbuf");
-  ft->tell_off += ret;
+  size_t ret = 0;
+
+  lsx_trace2(readbuf__entry, ft->filename, len);
+  if (ft->head) {
+    ret = min(len, ft->head_len - min(ft->tell_off, ft->head_len));
+    memcpy(buf, ft->head + ft->tell_off, ret);
+    ft->tell_off += ret;
+    if (ret < len)
+      lsx_end_prefetch(ft);
+  }
+  if (ret == len)
+    ;
+  else if (ft->map) {
+    unsigned char const * p = map_read(ft, len, &ret);
+    memcpy(buf, p, ret);
+  }
+  else if (POSITIONAL(ft))
+    ret = lsx_shared_read(ft, buf, len);
+  else if (ft->io_async)
+    ret = lsx_io_async_read(ft, buf, len);
+  else {
+    size_t n = fread((char *)buf + ret, (size_t) 1, len - ret, (FILE*)ft->fp);
+    if (n != len - ret && ferror((FILE*)ft->fp))
+      lsx_fail_errno(ft, errno, "lsx_readbuf");
+    ft->tell_off += n;
+    ret += n;
+  }
+  lsx_trace2(readbuf__return, ft->filename, ret);
   return ret;
 }
 
+/* If the file is memory-mapped, consumes up to len items of the given size
+ * and returns a pointer to them as they lie in the file (so not twiddled,
+ * and aligned only as the file offset is); otherwise returns NULL. */
+void const * lsx_read_mapped(sox_format_t * ft, size_t size, size_t len,
+    size_t * nread)
+{
+  void const * p;
+
+  if (!ft->map)
+    return NULL;
+  p = map_read(ft, len * size, nread);
+  *nread /= size;
+  return p;
+}
+
 /* Skip input without seeking. */
 int lsx_skipbytes(sox_format_t * ft, size_t n)
 {
@@ -129,57 +222,109 @@ int lsx_padbytes(sox_format_t * ft, size_t n)
  */
 size_t lsx_writebuf(sox_format_t * ft, void const * buf, size_t len)
 {
-  size_t ret = fwrite(buf, (size_t) 1, len, (FILE*)ft->fp);
-  if (ret != len) {
-    lsx_fail_errno(ft, errno, "error writing output file");
-    clearerr((FILE*)ft->fp); /* Allows us to seek back to write header */
+  size_t ret;
+
+  lsx_trace2(writebuf__entry, ft->filename, len);
+  if (ft->io_async)
+    ret = lsx_io_async_write(ft, buf, len);
+  else {
+    ret = fwrite(buf, (size_t) 1, len, (FILE*)ft->fp);
+    if (ret != len) {
+      lsx_fail_errno(ft, errno, "error writing output file");
+      clearerr((FILE*)ft->fp); /* Allows us to seek back to write header */
+    }
+    ft->tell_off += ret;
   }
-  ft->tell_off += ret;
+  lsx_trace2(writebuf__return, ft->filename, ret);
   return ret;
 }
 
 sox_uint64_t lsx_filelength(sox_format_t * ft)
 {
   struct stat st;
-  int ret = ft->fp ? fstat(fileno((FILE*)ft->fp), &st) : 0;
+  int ret;
 
+  if (POSITIONAL(ft))
+    return ft->map_size;
+  if (ft->fp && ft->io_type == lsx_io_url)
+    return lsx_http_length(ft->fp);
+  ret = ft->fp ? fstat(fileno((FILE*)ft->fp), &st) : 0;
   return (!ret && (st.st_mode & S_IFREG))? (uint64_t)st.st_size : 0;
 }
 
 int lsx_flush(sox_format_t * ft)
 {
+  if (ft->direct_io)
+    lsx_end_direct_io(ft);
+  if (ft->io_async)
+    return lsx_io_async_flush(ft);
   return fflush((FILE*)ft->fp);
 }
 
 off_t lsx_tell(sox_format_t * ft)
 {
-  return ft->seekable? (off_t)ftello((FILE*)ft->fp) : (off_t)ft->tell_off;
+  return ft->seekable && !POSITIONAL(ft) && !ft->head && !ft->io_async? (off_t)ftello((FILE*)ft->fp) : (off_t)ft->tell_off;
 }
 
 int lsx_eof(sox_format_t * ft)
 {
+  if (POSITIONAL(ft))
+    return ft->map_eof;
+  if (ft->head)  /* Reading past it would have ended it */
+    return 0;
+  if (ft->io_async)
+    return lsx_io_async_eof(ft);
   return feof((FILE*)ft->fp);
 }
 
 int lsx_error(sox_format_t * ft)
 {
+  if (POSITIONAL(ft) || ft->head)
+    return 0;
+  if (ft->io_async)
+    return lsx_io_async_error(ft);
   return ferror((FILE*)ft->fp);
 }
 
 void lsx_rewind(sox_format_t * ft)
 {
-  rewind((FILE*)ft->fp);
+  if (ft->direct_io)
+    lsx_end_direct_io(ft);
+  if (POSITIONAL(ft))
+    ft->map_eof = sox_false;
+  else if (ft->head)
+    ;
+  else if (ft->io_async) {
+    lsx_io_async_seek(ft, (off_t)0, SEEK_SET);
+    lsx_io_async_clearerr(ft);
+  }
+  else rewind((FILE*)ft->fp);
   ft->tell_off = 0;
 }
 
 void lsx_clearerr(sox_format_t * ft)
 {
-  clearerr((FILE*)ft->fp);
+  if (POSITIONAL(ft))
+    ft->map_eof = sox_false;
+  else if (ft->head)
+    ;
+  else if (ft->io_async)
+    lsx_io_async_clearerr(ft);
+  else clearerr((FILE*)ft->fp);
   ft->sox_errno = 0;
 }
 
 int lsx_unreadb(sox_format_t * ft, unsigned b)
 {
+  if (POSITIONAL(ft) || ft->head) {   /* Can only be the byte just read */
+    if (!ft->tell_off)
+      return EOF;
+    --ft->tell_off;
+    ft->map_eof = sox_false;
+    return (int)b;
+  }
+  if (ft->io_async)
+    return lsx_io_async_unreadb(ft, b);
   return ungetc((int)b, ft->fp);
 }
 
@@ -191,7 +336,30 @@ int lsx_unreadb(sox_format_t * ft, unsigned b)
  */
 int lsx_seeki(sox_format_t * ft, off_t offset, int whence)
 {
-    if (ft->seekable == 0) {
+    if (ft->direct_io)
+        lsx_end_direct_io(ft);
+    if (ft->head) {
+        sox_uint64_t base = whence == SEEK_CUR? ft->tell_off : 0;
+        if (whence != SEEK_END && (offset >= 0 || (sox_uint64_t)-offset <= base) &&
+            base + offset <= ft->head_len) {
+            ft->tell_off = base + offset;
+            return ft->sox_errno = SOX_SUCCESS;
+        }
+        lsx_end_prefetch(ft);
+    }
+    if (POSITIONAL(ft)) {
+        sox_uint64_t base = whence == SEEK_CUR? ft->tell_off :
+                            whence == SEEK_END? ft->map_size : 0;
+        if (offset < 0 && (sox_uint64_t)-offset > base)
+            lsx_fail_errno(ft, EINVAL, "%s", strerror(EINVAL));
+        else {
+            ft->tell_off = base + offset;
+            ft->map_eof = sox_false;
+            ft->sox_errno = SOX_SUCCESS;
+        }
+    } else if (ft->io_async) {
+        lsx_io_async_seek(ft, offset, whence);
+    } else if (ft->seekable == 0) {
         /* If a stream peel off chars else EPERM */
         if (whence == SEEK_CUR) {
             while (offset > 0 && !feof((FILE*)ft->fp)) {
@@ -364,10 +532,17 @@ static uint8_t const cswap[256] = {
       sox_format_t * ft, ctype *buf, size_t len) \
   { \
     size_t n, nread; \
-    uint8_t *data = lsx_malloc(size * len); \
-    nread = lsx_readbuf(ft, data, len * size) / size; \
+    uint8_t *data = NULL; \
+    uint8_t const *p; \
+    if (ft->map) \
+      p = map_read(ft, len * size, &nread); \
+    else { \
+      p = data = lsx_malloc(size * len); \
+      nread = lsx_readbuf(ft, data, len * size); \
+    } \
+    nread /= size; \
     for (n = 0; n < nread; n++) \
-      buf[n] = sox_unpack ## size(data + n * size); \
+      buf[n] = sox_unpack ## size(p + n * size); \
     free(data); \
     return n; \
   }
@@ -483,3 +658,157 @@ int lsx_writef(sox_format_t * ft, double datum)
   float f = datum;
   return lsx_write_f_buf(ft, &f, (size_t) 1) == 1 ? SOX_SUCCESS : SOX_EOF;
 }
+
+/* For rewriting the comments of a file in place (see sox_rewrite_comments): */
+
+static uint32_t get32(unsigned char const * p, sox_bool big_endian)
+{
+  return big_endian? (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3] :
+                     (uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0];
+}
+
+static void put32(unsigned char * p, uint32_t x, sox_bool big_endian)
+{
+  int i;
+  for (i = 0; i < 4; ++i, x >>= 8)
+    p[big_endian? 3 - i : i] = x & 255;
+}
+
+static sox_bool write_at(FILE * fp, off_t pos, void const * buf, size_t len)
+{
+  return !fseeko(fp, pos, SEEK_SET) && fwrite(buf, (size_t)1, len, fp) == len;
+}
+
+/* Makes the space [pos, pos + len) a chunk with the given id, of zeros */
+static sox_bool write_filler(FILE * fp, off_t pos, off_t len,
+    char const * filler, sox_bool big_endian)
+{
+  static unsigned char const zeros[4096];
+  unsigned char hdr[8];
+
+  memcpy(hdr, filler, (size_t)4);
+  put32(hdr + 4, (uint32_t)(len - 8), big_endian);
+  if (!write_at(fp, pos, hdr, sizeof(hdr)))
+    return sox_false;
+  for (len -= 8; len > 0; len -= min(len, (off_t)sizeof(zeros)))
+    if (fwrite(zeros, (size_t)1, (size_t)min(len, (off_t)sizeof(zeros)), fp) !=
+        (size_t)min(len, (off_t)sizeof(zeros)))
+      return sox_false;
+  return sox_true;
+}
+
+typedef struct {off_t pos, end; sox_bool after;} chunk_t;
+
+/* Replaces the chunks of a RIFF or IFF file (WAV, AIFF) with the given ids
+ * (an id of 8 characters, e.g. "LISTINFO", also gives the chunk's type) by
+ * one chunk (id, len bytes of data), or by none if data is NULL, without
+ * moving the audio: the new chunk takes the place of the first old one in
+ * which it fits (leaving either no space or room for a filler chunk) and, if
+ * `after' is given, that follows the chunk with that id; old chunks at the
+ * end of the file are cut off, other old ones become filler, and the new
+ * chunk is otherwise appended. */
+int lsx_rewrite_chunk(char const * path, char const * magic,
+    sox_bool big_endian, char const * const * ids, char const * after,
+    char const * filler, char const * id, void const * data, size_t len)
+{
+  FILE * fp = fopen(path, "r+b");
+  unsigned char hdr[12];
+  chunk_t * chunks = NULL;
+  size_t n = 0, i, j;
+  off_t pos, next, end, tail, new_end, need = data? 8 + len + (len & 1) : 0;
+  sox_bool seen = !after, ok = sox_false;
+  char const * const * p;
+
+  if (!fp) {
+    lsx_fail("can't open `%s': %s", path, strerror(errno));
+    return SOX_EOF;
+  }
+  if (fread(hdr, (size_t)1, sizeof(hdr), fp) != sizeof(hdr) ||
+      memcmp(hdr, magic, (size_t)4)) {
+    lsx_fail("`%s' is not a %s file", path, magic);
+    goto done;
+  }
+  fseeko(fp, (off_t)0, SEEK_END);
+  end = ftello(fp);
+  if ((off_t)get32(hdr + 4, big_endian) + 8 != end) {
+    lsx_fail("`%s': the %s chunk's size is not the file's", path, magic);
+    goto done;
+  }
+  for (pos = 12; pos + 8 <= end; pos = next) {
+    unsigned char type[4];
+    uint32_t size;
+    sox_bool match = sox_false;
+
+    if (fseeko(fp, pos, SEEK_SET) || fread(hdr, (size_t)1, (size_t)8, fp) != 8)
+      break;
+    size = get32(hdr + 4, big_endian);
+    next = pos + 8 + (off_t)size + (size & 1);
+    if (next > end) {
+      lsx_fail("`%s': truncated `%.4s' chunk", path, (char *)hdr);
+      goto done;
+    }
+    for (p = ids; *p && !match; ++p)
+      match = !memcmp(hdr, *p, (size_t)4) && (strlen(*p) == 4 || (size >= 4 &&
+          !fseeko(fp, pos + 8, SEEK_SET) &&
+          fread(type, (size_t)1, (size_t)4, fp) == 4 &&
+          !memcmp(type, *p + 4, (size_t)4)));
+    if (match) {
+      chunks = lsx_realloc(chunks, (n + 1) * sizeof(*chunks));
+      chunks[n].pos = pos;
+      chunks[n].end = next;
+      chunks[n++].after = seen;
+    }
+    seen |= after && !memcmp(hdr, after, (size_t)4);
+  }
+
+  /* Where the file's run of old chunks at its end (if any) begins: */
+  for (tail = end, i = n; i && chunks[i - 1].end == tail; tail = chunks[--i].pos);
+#ifndef HAVE_UNISTD_H
+  tail = end;  /* Can't truncate */
+#endif
+  for (j = 0; data && j < n; ++j)
+    if (chunks[j].after && (chunks[j].end - chunks[j].pos == need ||
+        chunks[j].end - chunks[j].pos >= need + 8) && chunks[j].pos < tail)
+      break;
+  new_end = data && j == n? tail + need : tail;
+  if (new_end - 8 > (off_t)0xffffffff) {
+    lsx_fail("`%s': the file would be too large", path);
+    goto done;
+  }
+  for (i = 0; i < n && chunks[i].pos < tail; ++i)
+    if (i != j && !write_filler(fp, chunks[i].pos,
+          chunks[i].end - chunks[i].pos, filler, big_endian))
+      goto error;
+  if (data) {
+    pos = j < n? chunks[j].pos : tail;
+    memcpy(hdr, id, (size_t)4);
+    put32(hdr + 4, (uint32_t)len, big_endian);
+    if (!write_at(fp, pos, hdr, (size_t)8) ||
+        fwrite(data, (size_t)1, len, fp) != len ||
+        ((len & 1) && putc(0, fp) == EOF))
+      goto error;
+    if (j < n && chunks[j].end - chunks[j].pos > need && !write_filler(fp,
+          pos + need, chunks[j].end - chunks[j].pos - need, filler, big_endian))
+      goto error;
+  }
+  put32(hdr, (uint32_t)(new_end - 8), big_endian);
+  if (!write_at(fp, (off_t)4, hdr, (size_t)4) || fflush(fp))
+    goto error;
+#ifdef HAVE_UNISTD_H
+  if (new_end < end && ftruncate(fileno(fp), new_end))
+    goto error;
+#endif
+  lsx_debug("`%s': comment chunk %s", path, !data? "removed" :
+      j < n? "rewritten in place" : "appended");
+  ok = sox_true;
+  goto done;
+error:
+  lsx_fail("error rewriting `%s': %s", path, strerror(errno));
+done:
+  free(chunks);
+  if (fclose(fp) && ok) {
+    lsx_fail("error rewriting `%s': %s", path, strerror(errno));
+    ok = sox_false;
+  }
+  return ok? SOX_SUCCESS : SOX_EOF;
+}
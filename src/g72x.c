@@ -50,6 +50,11 @@
 #include "g711.h"
 #include "g72x.h"
 
+#if defined __GNUC__ && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+#define HAVE_BUILTIN_CLZ 1
+#else
+#define HAVE_BUILTIN_CLZ 0
+
 static const char LogTable256[] =
 {
         0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
@@ -69,9 +74,13 @@ static const char LogTable256[] =
         7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
         7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7
 };
+#endif
 
 static inline int log2plus1(int val)
 {
+#if HAVE_BUILTIN_CLZ
+        return 32 - __builtin_clz((unsigned int)val | 1);
+#else
         /* From http://graphics.stanford.edu/~seander/bithacks.html#IntegerLogLookup */
         unsigned int v = (unsigned int)val; /* 32-bit word to find the log of */
         unsigned r;     /* r will be lg(v) */
@@ -87,6 +96,7 @@ static inline int log2plus1(int val)
         }
 
         return r + 1;
+#endif
 }
 
 /*
@@ -95,16 +105,16 @@ static inline int log2plus1(int val)
  * quantizes the input val against the table of size short integers.
  * It returns i if table[i - 1] <= val < table[i].
  *
- * Using linear search for simple coding.
+ * The tables are in ascending order, so this is the number of entries
+ * that val is not less than; counted without branches.
  */
 static int quan(int val, short const *table, int size)
 {
-        int             i;
+        int             i, n = 0;
 
         for (i = 0; i < size; i++)
-                if (val < *table++)
-                        break;
-        return (i);
+                n += val >= table[i];
+        return (n);
 }
 
 /*
@@ -19,16 +19,18 @@
 #include "sox_i.h"
 #include <ctype.h>
 #include <string.h>
+#include <sys/stat.h>
 
 typedef struct {
   sox_bool      do_equalise, do_balance, do_balance_no_clip, do_limiter;
-  sox_bool      do_restore, make_headroom, do_normalise, do_scan;
+  sox_bool      do_restore, make_headroom, do_normalise, do_scan, scanned;
   double        fixed_gain; /* Valid only in channel 0 */
 
   double        mult, reclaim, rms, limiter;
   off_t         num_samples;
   sox_sample_t  min, max;
-  FILE          * tmp_file;
+  lsx_store_t   store;      /* Audio held while scanning */
+  uint64_t      pos;        /* Of the next sample to be read back */
 } priv_t;
 
 static int create(sox_effect_t * effp, int argc, char * * argv)
@@ -69,6 +71,8 @@ static int start(sox_effect_t * effp)
   priv_t * p = (priv_t *)effp->priv;
 
   if (effp->flow == 0) {
+    if (p->fixed_gain == 1 && !p->do_scan && !p->make_headroom && !p->do_limiter)
+      return SOX_EFF_NULL;
     if (p->do_restore) {
       if (!effp->in_signal.mult || *effp->in_signal.mult >= 1) {
         lsx_fail("can't reclaim headroom");
@@ -83,17 +87,18 @@ static int start(sox_effect_t * effp)
   p->mult = 0;
   p->max = 1;
   p->min = -1;
+  p->scanned = sox_false;
   if (p->do_scan) {
-    p->tmp_file = lsx_tmpfile();
-    if (p->tmp_file == NULL) {
-      lsx_fail("can't create temporary file: %s", strerror(errno));
-      return SOX_EOF;
-    }
+    lsx_store_create(&p->store, effp,
+        (double)LSX_STORE_MEMORY / effp->flows);
+    p->pos = 0;
   }
   if (p->do_limiter)
     p->limiter = (1 - 1 / p->fixed_gain) * (1. / SOX_SAMPLE_MAX);
   else if (p->fixed_gain == floor(p->fixed_gain) && !p->do_scan)
     effp->out_signal.precision = effp->in_signal.precision;
+  if (!p->do_scan) /* Else, the gain depends on all the audio */
+    effp->history = 0;
   return SOX_SUCCESS;
 }
 
@@ -103,11 +108,9 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
   priv_t * p = (priv_t *)effp->priv;
   size_t len;
 
-  if (p->do_scan) {
-    if (fwrite(ibuf, sizeof(*ibuf), *isamp, p->tmp_file) != *isamp) {
-      lsx_fail("error writing temporary file: %s", strerror(errno));
+  if (p->do_scan && !p->scanned) {
+    if (lsx_store_write(&p->store, ibuf, *isamp) != SOX_SUCCESS)
       return SOX_EOF;
-    }
     if (p->do_balance && !p->do_normalise)
       for (len = *isamp; len; --len, ++ibuf) {
         double d = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf, effp->clips);
@@ -129,7 +132,8 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     *osamp = 0; /* samples not output until drain */
   }
   else {
-    double mult = ((priv_t *)(effp - effp->flow)->priv)->fixed_gain;
+    double mult = p->scanned? p->mult :
+      ((priv_t *)(effp - effp->flow)->priv)->fixed_gain;
     len = *isamp = *osamp = min(*isamp, *osamp);
     if (!p->do_limiter) for (; len; --len, ++ibuf)
       *obuf++ = SOX_ROUND_CLIP_COUNT(*ibuf * mult, effp->clips);
@@ -152,7 +156,6 @@ static void start_drain(sox_effect_t * effp)
     for (i = 0; i < effp->flows; ++i) {
       priv_t * q = (priv_t *)(effp - effp->flow + i)->priv;
       max_rms = max(max_rms, sqrt(q->rms / q->num_samples));
-      rewind(q->tmp_file);
     }
     for (i = 0; i < effp->flows; ++i) {
       priv_t * q = (priv_t *)(effp - effp->flow + i)->priv;
@@ -173,7 +176,6 @@ static void start_drain(sox_effect_t * effp)
       double this_peak = max(q->max / max, q->min / (double)SOX_SAMPLE_MIN);
       max_peak = max(max_peak, this_peak);
       q->mult = p->fixed_gain / this_peak;
-      rewind(q->tmp_file);
     }
     for (i = 0; i < effp->flows; ++i) {
       priv_t * q = (priv_t *)(effp - effp->flow + i)->priv;
@@ -187,7 +189,6 @@ static void start_drain(sox_effect_t * effp)
       else p->mult = p->reclaim;
     }
     p->mult *= p->fixed_gain;
-    rewind(p->tmp_file);
   }
 }
 
@@ -199,14 +200,14 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 
   *osamp -= *osamp % effp->in_signal.channels;
 
-  if (p->do_scan) {
+  if (p->do_scan && !p->scanned) {
     if (!p->mult)
       start_drain(effp);
-    len = fread(obuf, sizeof(*obuf), *osamp, p->tmp_file);
-    if (len != *osamp && !feof(p->tmp_file)) {
-      lsx_fail("error reading temporary file: %s", strerror(errno));
-      result = SOX_EOF;
-    }
+    len = min(*osamp, p->store.len - p->pos);
+    if ((!p->store.sealed && lsx_store_seal(&p->store) != SOX_SUCCESS) ||
+        lsx_store_read(&p->store, p->pos, obuf, len) != SOX_SUCCESS)
+      len = 0, result = SOX_EOF;
+    p->pos += len;
     if (!p->do_limiter) for (*osamp = len; len; --len, ++obuf)
       *obuf = SOX_ROUND_CLIP_COUNT(*obuf * p->mult, effp->clips);
     else for (*osamp = len; len; --len) {
@@ -222,16 +223,100 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  if (p->do_scan)
-    fclose(p->tmp_file); /* auto-deleted by lsx_tmpfile */
+  lsx_store_delete(&p->store);
   return SOX_SUCCESS;
 }
 
+/* The following function allows a libSoX client to spare gain's scanning
+ * modes (-n, -e, etc.) from storing the audio: if the
+ * effect is fed directly, and unmodified, from a seekable file, then call
+ * sox_gain_scan() before the chain is run; it reads the file through, then
+ * seeks it back to the start.  The results of the scan are kept in the design
+ * cache, keyed on the file's identity, size and time-stamps, so with
+ * --design-cache, a later run on the same file need not read it twice. */
+
+int sox_gain_scan(sox_effect_t * effp, sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, i, j, len;
+  sox_sample_t * buf;
+  struct stat st;
+  double params[10], * data;
+  double const * stats = NULL;
+  int n = 0, extra, result = SOX_SUCCESS;
+  sox_bool keyed = sox_false;
+
+  if (!p->do_scan || p->scanned || effp->flow || ft->signal.channels != chans)
+    return SOX_EOF;
+  if (ft->io_type == lsx_io_file && !fstat(fileno((FILE*)ft->fp), &st)) {
+    params[0] = (double)st.st_dev;
+    params[1] = (double)st.st_ino;
+    params[2] = (double)st.st_size;
+    params[3] = (double)st.st_mtime;
+    params[4] = (double)ST_MTIME_NSEC(st);
+    params[5] = (double)st.st_ctime;
+    params[6] = (double)ST_CTIME_NSEC(st);
+    params[7] = ft->encoding.encoding;   /* Headerless files may be read */
+    params[8] = ft->encoding.bits_per_sample;   /* in different ways */
+    params[9] = ft->encoding.reverse_bytes;
+    keyed = sox_true;
+    stats = lsx_design_get("gain scan", params, 10, &n, &extra);
+  }
+  if (!stats) {
+    if (!ft->seekable || !ft->handler.seek ||
+        sox_seek(ft, (uint64_t)0, SOX_SEEK_SET) != SOX_SUCCESS)
+      return SOX_EOF;
+    lsx_report("scanning `%s'", ft->filename);
+    data = lsx_malloc(4 * chans * sizeof(*data)); /* max, min, sum x^2, n */
+    for (i = 0; i < chans; ++i) {
+      data[4 * i] = SOX_SAMPLE_MIN, data[4 * i + 1] = SOX_SAMPLE_MAX;
+      data[4 * i + 2] = data[4 * i + 3] = 0;
+    }
+    buf = lsx_malloc(ft->context->bufsiz * sizeof(*buf));
+    for (i = 0; (len = sox_read(ft, buf, ft->context->bufsiz - ft->context->bufsiz % chans));)
+      for (j = 0; j < len; ++j, i = (i + 1) % chans) {
+        double * d = data + 4 * i;
+        d[0] = max(d[0], buf[j]);
+        d[1] = min(d[1], buf[j]);
+        d[2] += sqr(SOX_SAMPLE_TO_FLOAT_64BIT(buf[j],));
+        ++d[3];
+      }
+    free(buf);
+    if (ft->sox_errno || sox_seek(ft, (uint64_t)0, SOX_SEEK_SET) != SOX_SUCCESS) {
+      lsx_fail("`%s': can't scan and rewind", ft->filename);
+      free(data);
+      return SOX_EINVAL;  /* The file may no longer be read */
+    }
+    stats = keyed?
+      lsx_design_put("gain scan", params, 10, data, 4 * (int)chans, 0) : data;
+  }
+  else if (n != 4 * (int)chans)
+    result = SOX_EOF;   /* Can't be, but nothing has been read */
+
+  if (result == SOX_SUCCESS) {
+    for (i = 0; i < chans; ++i) {
+      priv_t * q = (priv_t *)(effp + (effp->flows > 1? i : 0))->priv;
+      q->max = max(q->max, (sox_sample_t)stats[4 * i]);
+      q->min = min(q->min, (sox_sample_t)stats[4 * i + 1]);
+      q->rms += stats[4 * i + 2];
+      q->num_samples += (off_t)stats[4 * i + 3];
+    }
+    start_drain(effp);
+    for (i = 0; i < effp->flows; ++i)
+      ((priv_t *)(effp + i)->priv)->scanned = sox_true;
+  }
+  if (keyed)
+    lsx_design_release(stats);
+  else free((double *)stats);
+  return result;
+}
+
 sox_effect_handler_t const * lsx_gain_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "gain", NULL, SOX_EFF_GAIN,
-    create, start, flow, drain, stop, NULL, sizeof(priv_t)};
+    create, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
   static char const * lines[] = {
     "[-e|-b|-B|-r] [-n] [-l|-h] [gain-dB]",
     "-e\t Equalise channels: peak to that with max peak;",
@@ -47,10 +47,13 @@
 #define FRAMESIZE (size_t)33
 /* samples per gsm_frame */
 #define BLOCKSIZE 160
+/* groups of frames (one per channel) read or written at a time */
+#define GROUPS 32
 
 /* Private data */
 typedef struct {
         unsigned        channels;
+        unsigned        threads;
         gsm_signal      *samples;
         gsm_signal      *samplePtr;
         gsm_signal      *sampleTop;
@@ -85,9 +88,11 @@ static int gsmstart_rw(sox_format_t * ft, int w)
                         return (SOX_EOF);
                 }
         }
-        p->frames = lsx_malloc(p->channels*FRAMESIZE);
-        p->samples = lsx_malloc(BLOCKSIZE * (p->channels+1) * sizeof(gsm_signal));
-        p->sampleTop = p->samples + BLOCKSIZE*p->channels;
+        p->threads = ft->context->codec_threads > 1?
+            (unsigned)ft->context->codec_threads : 1;
+        p->frames = lsx_malloc(GROUPS*p->channels*FRAMESIZE);
+        p->samples = lsx_malloc(GROUPS*BLOCKSIZE*p->channels * sizeof(gsm_signal));
+        p->sampleTop = p->samples + GROUPS*BLOCKSIZE*p->channels;
         p->samplePtr = (w)? p->samples : p->sampleTop;
         return (SOX_SUCCESS);
 }
@@ -102,6 +107,46 @@ static int sox_gsmstartwrite(sox_format_t * ft)
         return gsmstart_rw(ft,1);
 }
 
+/*
+ * Encode or decode n groups of frames between p->frames and p->samples.
+ * A channel's state carries from frame to frame, so with --codec-threads
+ * it is the channels that are coded in parallel.
+ * Return non-zero on a decoding error.
+ */
+
+static int gsmcode(sox_format_t * ft, size_t n, sox_bool encode)
+{
+        priv_t *p = (priv_t *) ft->priv;
+        int ch, chans = (int)p->channels, failed = 0;
+        size_t threads = lsx_threads_take(ft->context,
+            (size_t)min(p->threads, p->channels));
+
+        #pragma omp parallel for if(threads > 1) \
+            num_threads((int)threads) schedule(static) reduction(|:failed)
+        for (ch=0; ch<chans; ch++) {
+                gsm_signal block[BLOCKSIZE];
+                size_t g;
+                int i;
+
+                for (g = 0; g < n && !failed; g++) {
+                        gsm_byte *frame = p->frames + (g*chans + ch)*FRAMESIZE;
+                        gsm_signal *gsp = p->samples + g*BLOCKSIZE*chans + ch;
+
+                        if (encode) {
+                                for (i=0; i<BLOCKSIZE; i++)
+                                        block[i] = gsp[i*chans];
+                                gsm_encode(p->handle[ch], block, frame);
+                        }
+                        else if (gsm_decode(p->handle[ch], frame, block) < 0)
+                                failed = 1;
+                        else for (i=0; i<BLOCKSIZE; i++)
+                                gsp[i*chans] = block[i];
+                }
+        }
+        lsx_threads_give(ft->context, threads);
+        return failed;
+}
+
 /*
  * Read up to len samples from file.
  * Convert to signed longs.
@@ -111,12 +156,9 @@ static int sox_gsmstartwrite(sox_format_t * ft)
 
 static size_t sox_gsmread(sox_format_t * ft, sox_sample_t *buf, size_t samp)
 {
-        size_t done = 0, r;
-        int ch, chans;
-        gsm_signal *gbuff;
+        size_t done = 0, n;
         priv_t *p = (priv_t *) ft->priv;
-
-        chans = p->channels;
+        size_t group = p->channels * FRAMESIZE;
 
         while (done < samp)
         {
@@ -126,28 +168,17 @@ static size_t sox_gsmread(sox_format_t * ft, sox_sample_t *buf, size_t samp)
 
                 if (done>=samp) break;
 
-                r = lsx_readbuf(ft, p->frames, p->channels * FRAMESIZE);
-                if (r != p->channels * FRAMESIZE)
+                n = lsx_readbuf(ft, p->frames, GROUPS * group) / group;
+                if (!n)
                   break;
 
-                p->samplePtr = p->samples;
-                for (ch=0; ch<chans; ch++) {
-                        int i;
-                        gsm_signal *gsp;
-
-                        gbuff = p->sampleTop;
-                        if (gsm_decode(p->handle[ch], p->frames + ch*FRAMESIZE, gbuff) < 0)
-                        {
-                                lsx_fail_errno(ft,errno,"error during GSM decode");
-                                return (0);
-                        }
-
-                        gsp = p->samples + ch;
-                        for (i=0; i<BLOCKSIZE; i++) {
-                                *gsp = *gbuff++;
-                                gsp += chans;
-                        }
+                if (gsmcode(ft, n, sox_false))
+                {
+                        lsx_fail_errno(ft,errno,"error during GSM decode");
+                        return (0);
                 }
+                p->samplePtr = p->samples;
+                p->sampleTop = p->samples + n*BLOCKSIZE*p->channels;
         }
 
         return done;
@@ -155,33 +186,19 @@ static size_t sox_gsmread(sox_format_t * ft, sox_sample_t *buf, size_t samp)
 
 static int gsmflush(sox_format_t * ft)
 {
-        int r, ch, chans;
-        gsm_signal *gbuff;
         priv_t *p = (priv_t *) ft->priv;
+        size_t n, group = BLOCKSIZE * p->channels;
 
-        chans = p->channels;
-
-        /* zero-fill samples as needed */
-        while (p->samplePtr < p->sampleTop)
+        /* zero-fill samples as needed, to the end of a group */
+        n = (size_t)(p->samplePtr - p->samples + group - 1) / group;
+        while (p->samplePtr < p->samples + n*group)
                 *(p->samplePtr)++ = 0;
 
-        gbuff = p->sampleTop;
-        for (ch=0; ch<chans; ch++) {
-                int i;
-                gsm_signal *gsp;
-
-                gsp = p->samples + ch;
-                for (i=0; i<BLOCKSIZE; i++) {
-                        gbuff[i] = *gsp;
-                        gsp += chans;
-                }
-                gsm_encode(p->handle[ch], gbuff, p->frames);
-                r = lsx_writebuf(ft, p->frames, FRAMESIZE);
-                if (r != FRAMESIZE)
-                {
-                        lsx_fail_errno(ft,errno,"write error");
-                        return(SOX_EOF);
-                }
+        gsmcode(ft, n, sox_true);
+        if (lsx_writebuf(ft, p->frames, n*p->channels*FRAMESIZE) != n*p->channels*FRAMESIZE)
+        {
+                lsx_fail_errno(ft,errno,"write error");
+                return(SOX_EOF);
         }
         p->samplePtr = p->samples;
 
@@ -249,7 +266,7 @@ LSX_FORMAT_HANDLER(gsm)
     "GSM 06.10 (full-rate) lossy speech compression", names, 0,
     sox_gsmstartread, sox_gsmread, sox_gsmstopread,
     sox_gsmstartwrite, sox_gsmwrite, sox_gsmstopwrite,
-    NULL, write_encodings, write_rates, sizeof(priv_t)
+    NULL, write_encodings, write_rates, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
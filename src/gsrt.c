@@ -120,8 +120,8 @@ static int start_read(sox_format_t * ft)
 static int start_write(sox_format_t * ft)
 {
   int i, encoding = ft_enc(ft->encoding.bits_per_sample, ft->encoding.encoding);
-  time_t now = sox_globals.repeatable? 0 : time(NULL);
-  struct tm const * t = sox_globals.repeatable? gmtime(&now) : localtime(&now);
+  time_t now = ft->context->repeatable? 0 : time(NULL);
+  struct tm const * t = ft->context->repeatable? gmtime(&now) : localtime(&now);
 
   int checksum = (VERSION_ >> 16) + VERSION_;
   checksum += t->tm_year + 1900;
@@ -199,7 +199,7 @@ LSX_FORMAT_HANDLER(gsrt)
     names, SOX_FILE_BIG_END | SOX_FILE_MONO,
     start_read, lsx_rawread, NULL,
     start_write, write_samples, stop_write,
-    lsx_rawseek, write_encodings, write_rates, 0
+    lsx_rawseek, write_encodings, write_rates, 0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
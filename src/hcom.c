@@ -49,17 +49,30 @@ typedef struct {
         short dict_rightson;
 } dictent;
 
+/* The reader decodes by looking up the next LUT_BITS bits of the stream:
+ * if they hold a whole code, its entry gives the leaf and its length;
+ * otherwise it gives the node reached, from which bits are taken singly. */
+#define LUT_BITS 10
+
+typedef struct {
+        unsigned char bits;     /* Taken from the stream */
+        short node;             /* Reached, in the dictionary */
+} lutent;
+
 typedef struct {
   /* Static data from the header */
   dictent *dictionary;
   int32_t checksum;
   int deltacompression;
+  lutent lut[1 << LUT_BITS];
   /* Engine state */
   long huffcount;
   long cksum;
-  int dictentry;
-  int nrbits;
-  uint32_t current;
+  int nrbits;                   /* Left in current */
+  uint64_t current;             /* Bits, left-aligned */
+  uint32_t word;                /* Last put in current */
+  unsigned char in[4096];       /* Read ahead of current */
+  size_t in_pos, in_len;
   short sample;
   /* Dictionary */
   dictent *de;
@@ -141,6 +154,11 @@ static int startread(sox_format_t * ft)
                 return (SOX_EOF);
         }
         lsx_readw(ft, &dictsize);
+        if (dictsize == 0 || dictsize > 511)
+        {
+                lsx_fail_errno(ft, SOX_EHDR, "Invalid dictionary");
+                return SOX_EOF;
+        }
 
         /* Translate to sox parameters */
         ft->encoding.encoding = SOX_ENCODING_HCOM;
@@ -169,6 +187,17 @@ static int startread(sox_format_t * ft)
         if (rc)
             return rc;
 
+        /* Tabulate where each possible LUT_BITS bits lead from the root */
+        for (i = 0; i < 1 << LUT_BITS; i++) {
+                int bits = 0, node = 0;
+                do node = i >> (LUT_BITS - 1 - bits) & 1?
+                        p->dictionary[node].dict_rightson :
+                        p->dictionary[node].dict_leftson;
+                while (++bits < LUT_BITS && p->dictionary[node].dict_leftson >= 0);
+                p->lut[i].bits = bits;
+                p->lut[i].node = node;
+        }
+
         /* Initialized the decompression engine */
         p->checksum = checksum;
         p->deltacompression = compresstype;
@@ -176,16 +205,39 @@ static int startread(sox_format_t * ft)
                 lsx_debug("HCOM data using value compression");
         p->huffcount = huffcount;
         p->cksum = 0;
-        p->dictentry = 0;
         p->nrbits = -1; /* Special case to get first byte */
+        p->in_pos = p->in_len = 0;
 
         return (SOX_SUCCESS);
 }
 
+/* Puts the next 32-bit word of the stream below the bits left in current;
+ * returns 0 at end of file */
+static int load(sox_format_t * ft)
+{
+        priv_t *p = (priv_t *) ft->priv;
+
+        if (p->in_len - p->in_pos < 4) {
+                p->in_len -= p->in_pos;
+                memmove(p->in, p->in + p->in_pos, p->in_len);
+                p->in_pos = 0;
+                p->in_len += lsx_readbuf(ft, p->in + p->in_len, sizeof(p->in) - p->in_len);
+                if (p->in_len < 4)
+                        return 0;
+        }
+        p->word = (uint32_t)p->in[p->in_pos] << 24 | p->in[p->in_pos + 1] << 16 |
+                p->in[p->in_pos + 2] << 8 | p->in[p->in_pos + 3];
+        p->in_pos += 4;
+        p->current |= (uint64_t)p->word << (32 - p->nrbits);
+        p->nrbits += 32;
+        p->cksum += p->word;
+        return 1;
+}
+
 static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t len)
 {
         register priv_t *p = (priv_t *) ft->priv;
-        int done = 0;
+        size_t done = 0;
         unsigned char sample_rate;
 
         if (p->nrbits < 0) {
@@ -200,46 +252,49 @@ static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t len)
                 *buf++ = SOX_UNSIGNED_8BIT_TO_SAMPLE(p->sample,);
                 p->huffcount--;
                 p->nrbits = 0;
+                p->current = 0;
                 done++;
                 len--;
                 if (len == 0)
                         return done;
         }
 
-        while (p->huffcount > 0) {
-                if(p->nrbits == 0) {
-                        lsx_readdw(ft, &(p->current));
-                        if (lsx_eof(ft))
+        while (p->huffcount > 0 && len > 0) {
+                lutent const * e;
+                int node = 0;
+
+                if (p->nrbits < LUT_BITS)
+                        load(ft); /* Perhaps not needed, so EOF is fine */
+                e = &p->lut[p->current >> (64 - LUT_BITS)];
+                if (e->bits <= p->nrbits) {
+                        node = e->node;
+                        p->current <<= e->bits;
+                        p->nrbits -= e->bits;
+                }
+                while (p->dictionary[node].dict_leftson >= 0) {
+                        if (p->nrbits == 0 && !load(ft))
                         {
                                 lsx_fail_errno(ft,SOX_EOF,"unexpected EOF in HCOM data");
-                                return (0);
+                                return done;
                         }
-                        p->cksum += p->current;
-                        p->nrbits = 32;
-                }
-                if(p->current & 0x80000000) {
-                        p->dictentry =
-                                p->dictionary[p->dictentry].dict_rightson;
-                } else {
-                        p->dictentry =
-                                p->dictionary[p->dictentry].dict_leftson;
-                }
-                p->current = p->current << 1;
-                p->nrbits--;
-                if(p->dictionary[p->dictentry].dict_leftson < 0) {
-                        short datum;
-                        datum = p->dictionary[p->dictentry].dict_rightson;
-                        if (!p->deltacompression)
-                                p->sample = 0;
-                        p->sample = (p->sample + datum) & 0xff;
-                        p->huffcount--;
-                        *buf++ = SOX_UNSIGNED_8BIT_TO_SAMPLE(p->sample,);
-                        p->dictentry = 0;
-                        done++;
-                        len--;
-                        if (len == 0)
-                                break;
+                        node = p->current >> 63?
+                                p->dictionary[node].dict_rightson :
+                                p->dictionary[node].dict_leftson;
+                        p->current <<= 1;
+                        p->nrbits--;
                 }
+                if (!p->deltacompression)
+                        p->sample = 0;
+                p->sample = (p->sample + p->dictionary[node].dict_rightson) & 0xff;
+                p->huffcount--;
+                *buf++ = SOX_UNSIGNED_8BIT_TO_SAMPLE(p->sample,);
+                done++;
+                len--;
+        }
+        /* A word read ahead but not reached is not part of the checksum */
+        if (p->huffcount == 0 && p->nrbits >= 32) {
+                p->cksum -= p->word;
+                p->nrbits -= 32;
         }
 
         return done;
@@ -249,6 +304,8 @@ static int stopread(sox_format_t * ft)
 {
         register priv_t *p = (priv_t *) ft->priv;
 
+        free(p->dictionary);
+        p->dictionary = NULL;
         if (p->huffcount != 0)
         {
                 lsx_fail_errno(ft,SOX_EFMT,"not all HCOM data read");
@@ -259,8 +316,6 @@ static int stopread(sox_format_t * ft)
                 lsx_fail_errno(ft,SOX_EFMT,"checksum error in HCOM data");
                 return (SOX_EOF);
         }
-        free(p->dictionary);
-        p->dictionary = NULL;
         return (SOX_SUCCESS);
 }
 
@@ -496,7 +551,7 @@ LSX_FORMAT_HANDLER(hcom)
     names, SOX_FILE_BIG_END|SOX_FILE_MONO,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, write_rates, sizeof(priv_t)
+    NULL, write_encodings, write_rates, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -74,7 +74,7 @@ LSX_FORMAT_HANDLER(htk)
     names, SOX_FILE_BIG_END | SOX_FILE_MONO | SOX_FILE_REWIND,
     start_read, lsx_rawread, NULL,
     write_header, lsx_rawwrite, NULL,
-    lsx_rawseek, write_encodings, NULL, 0
+    lsx_rawseek, write_encodings, NULL, 0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -0,0 +1,761 @@
+/* libSoX HTTP input
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Reads an http: URL as a stdio stream, so that format handlers need not
+ * know where their bytes come from.  Where the server honours byte-range
+ * requests, the stream is seekable: a seek merely moves the position, and
+ * the next read asks for the body from there (or skips forward a little
+ * on the response already under way).  Connections are HTTP/1.1 and kept
+ * alive; one left idle by a finished response is pooled, and reused by
+ * the next request to the same host, be it for this URL or another.
+ * lsx_http_exchange makes one-off requests (e.g. the uploads of s3.c) on
+ * the same pool of connections.
+ */
+
+#define _GNU_SOURCE
+#include "sox_i.h"
+
+#if defined HAVE_FOPENCOOKIE && defined HAVE_GETADDRINFO && defined HAVE_NETDB_H
+
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MAX_REDIRECTS 5
+#define MAX_POOLED    4
+#define SKIP_MAX      65536 /* Read through rather than re-request a gap */
+#define HEAD_MAX      8192  /* Longest response header line accepted */
+#define BACK_MAX      65536 /* Kept to serve stdio's seeks back a little */
+#define PROBE_SIZE    65536 /* Asked for first: often all the header needs */
+
+typedef struct {
+  char         * host, * port, * path;
+  int          fd;            /* -1 if no response is under way */
+  sox_bool     keep_alive;    /* The connection may take another request */
+  sox_bool     chunked;       /* Body is in chunked transfer-coding */
+  sox_uint64_t body_left;     /* Of the body (or of this chunk) */
+  sox_bool     body_sized;    /* body_left is known (else, to close) */
+  sox_bool     body_done;
+  off_t        pos;           /* Where the caller is */
+  off_t        stream_pos;    /* Of the next byte from the response */
+  off_t        length;        /* Of the resource, or -1 if not known */
+  sox_bool     ranges;        /* The server honours range requests */
+  size_t       buf_pos, buf_len;
+  char         buf[16384];    /* Received, not yet consumed */
+  size_t       back_len;
+  char         back[BACK_MAX]; /* The last bytes given to stdio */
+  char const   * want;        /* Name of a response header to keep, */
+  char         * wanted;      /* and its value */
+} http_t;
+
+typedef struct {
+  char * host, * port;
+  int  fd;
+} pooled_t;
+
+static pooled_t pool[MAX_POOLED];
+
+typedef struct {
+  FILE   * fp;
+  http_t * h;
+} stream_t;
+
+static stream_t * streams;     /* To find an http_t from its FILE */
+static size_t num_streams;
+
+static void pool_put(char const * host, char const * port, int fd)
+{
+  int old = -1;
+  size_t i;
+
+  #pragma omp critical(lsx_http_pool)
+  {
+    for (i = 0; i < MAX_POOLED && pool[i].host; ++i);
+    if (i == MAX_POOLED) {           /* Full, so forget the oldest */
+      old = pool[0].fd;
+      free(pool[0].host);
+      free(pool[0].port);
+      memmove(pool, pool + 1, sizeof(*pool) * (MAX_POOLED - 1));
+      i = MAX_POOLED - 1;
+    }
+    pool[i].host = lsx_strdup(host);
+    pool[i].port = lsx_strdup(port);
+    pool[i].fd = fd;
+  }
+  if (old >= 0)
+    close(old);
+}
+
+static int pool_get(char const * host, char const * port)
+{
+  int fd = -1;
+  size_t i;
+
+  #pragma omp critical(lsx_http_pool)
+  for (i = MAX_POOLED; fd < 0 && i--;)
+    if (pool[i].host && !strcasecmp(pool[i].host, host) &&
+        !strcmp(pool[i].port, port)) {
+      fd = pool[i].fd;
+      free(pool[i].host);
+      free(pool[i].port);
+      memmove(pool + i, pool + i + 1, sizeof(*pool) * (MAX_POOLED - 1 - i));
+      memset(pool + MAX_POOLED - 1, 0, sizeof(*pool));
+    }
+  return fd;
+}
+
+static int connect_to(char const * host, char const * port)
+{
+  struct addrinfo hints, * addrs, * a;
+  int fd = -1, err, one = 1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if ((err = getaddrinfo(host, port, &hints, &addrs))) {
+    lsx_fail("can't find host `%s': %s", host, gai_strerror(err));
+    errno = ENOENT;
+    return -1;
+  }
+  for (a = addrs; a && fd < 0; a = a->ai_next) {
+    if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) < 0)
+      continue;
+    if (connect(fd, a->ai_addr, a->ai_addrlen)) {
+      err = errno;
+      close(fd);
+      fd = -1;
+      errno = err;
+    }
+  }
+  freeaddrinfo(addrs);
+  if (fd >= 0)
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *)&one, (socklen_t)sizeof(one));
+  return fd;
+}
+
+/* Parses http://host[:port][/path]; returns sox_false if it is not one */
+static sox_bool parse_url(http_t * h, char const * url)
+{
+  char const * host, * end, * host_end, * port;
+
+  if (strncasecmp(url, "http://", (size_t)7))
+    return sox_false;
+  host = url + 7;
+  end = host + strcspn(host, "/?#");
+  if (*host == '[') {                      /* IPv6 literal */
+    if (!(host_end = memchr(host, ']', (size_t)(end - host))))
+      return sox_false;
+    port = host_end + 1;
+    ++host;
+  }
+  else {
+    host_end = memchr(host, ':', (size_t)(end - host));
+    port = host_end = host_end? host_end : end;
+  }
+  if (host_end == host || (port < end && *port != ':'))
+    return sox_false;
+  free(h->host), free(h->port), free(h->path);
+  h->host = lsx_malloc((size_t)(host_end - host) + 1);
+  memcpy(h->host, host, (size_t)(host_end - host));
+  h->host[host_end - host] = '\0';
+  if (port + 1 < end) {
+    h->port = lsx_malloc((size_t)(end - port));
+    memcpy(h->port, port + 1, (size_t)(end - port - 1));
+    h->port[end - port - 1] = '\0';
+  }
+  else h->port = lsx_strdup("80");
+  h->path = lsx_malloc(strlen(end) + 2);
+  sprintf(h->path, "%s%s", *end == '/'? "" : "/", end);
+  h->path[strcspn(h->path, "#")] = '\0';
+  return sox_true;
+}
+
+static sox_bool fill(http_t * h)
+{
+  ssize_t n;
+
+  if (h->buf_pos == h->buf_len)
+    h->buf_pos = h->buf_len = 0;
+  else if (h->buf_pos) {
+    memmove(h->buf, h->buf + h->buf_pos, h->buf_len - h->buf_pos);
+    h->buf_len -= h->buf_pos;
+    h->buf_pos = 0;
+  }
+  do n = recv(h->fd, h->buf + h->buf_len, sizeof(h->buf) - h->buf_len, 0);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    if (!n)
+      errno = ECONNRESET;
+    return sox_false;
+  }
+  h->buf_len += (size_t)n;
+  return sox_true;
+}
+
+/* Returns the next CRLF-terminated line of the response, without its
+ * terminator, or NULL on error */
+static char * get_line(http_t * h)
+{
+  char * line, * eol;
+
+  while (!(eol = memchr(h->buf + h->buf_pos, '\n', h->buf_len - h->buf_pos))) {
+    if (h->buf_len - h->buf_pos >= HEAD_MAX) {
+      errno = EPROTO;
+      return NULL;
+    }
+    if (!fill(h))
+      return NULL;
+  }
+  line = h->buf + h->buf_pos;
+  h->buf_pos = (size_t)(eol + 1 - h->buf);
+  if (eol > line && eol[-1] == '\r')
+    --eol;
+  *eol = '\0';
+  return line;
+}
+
+static sox_bool send_all(int fd, char const * data, size_t len)
+{
+  while (len) {
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return sox_false;
+    data += n;
+    len -= (size_t)n;
+  }
+  return sox_true;
+}
+
+static void disconnect(http_t * h)
+{
+  if (h->fd >= 0)
+    close(h->fd);
+  h->fd = -1;
+}
+
+/* Lets go of the current response, keeping the connection if it can take
+ * another request without much more reading */
+static void release(http_t * h)
+{
+  if (h->fd < 0)
+    return;
+  while (!h->body_done && h->keep_alive && h->body_sized && !h->chunked &&
+      h->body_left <= SKIP_MAX) {
+    size_t n;
+    if (h->buf_pos == h->buf_len && !fill(h))
+      break;
+    n = (size_t)min((sox_uint64_t)(h->buf_len - h->buf_pos), h->body_left);
+    h->buf_pos += n;
+    h->body_left -= n;
+    h->body_done = !h->body_left;
+  }
+  if (h->body_done && h->keep_alive && h->buf_pos == h->buf_len) {
+    pool_put(h->host, h->port, h->fd);
+    h->fd = -1;
+  }
+  else disconnect(h);
+}
+
+static int parse_headers(http_t * h, int * status, char * * location,
+    off_t * first, off_t * total)
+{
+  char * line;
+
+  if (!(line = get_line(h)))
+    return SOX_EOF;
+  if (strncmp(line, "HTTP/1.", (size_t)7) || !line[7] ||  /* Then line[8] is in */
+      sscanf(line + 8, " %d", status) != 1) {
+    errno = EPROTO;
+    return SOX_EOF;
+  }
+  h->keep_alive = line[7] != '0';
+  h->chunked = h->body_sized = h->body_done = sox_false;
+  h->body_left = 0;
+  *first = 0, *total = -1;
+  while ((line = get_line(h)) && *line) {
+    char * value = strchr(line, ':');
+    if (!value)
+      continue;
+    *value++ = '\0';
+    while (isspace((unsigned char)*value))
+      ++value;
+    if (!strcasecmp(line, "Content-Length")) {
+      h->body_left = strtoull(value, NULL, 10);
+      h->body_sized = sox_true;
+    }
+    else if (!strcasecmp(line, "Content-Range")) {
+      unsigned long long a, b, c;
+      int n = sscanf(value, "bytes %llu-%llu/%llu", &a, &b, &c);
+      if (n >= 2)
+        *first = (off_t)a;
+      if (n == 3)
+        *total = (off_t)c;
+    }
+    else if (!strcasecmp(line, "Transfer-Encoding"))
+      h->chunked = strstr(value, "chunked") != NULL;
+    else if (!strcasecmp(line, "Connection")) {
+      if (!strncasecmp(value, "close", (size_t)5))
+        h->keep_alive = sox_false;
+      else if (!strncasecmp(value, "keep-alive", (size_t)10))
+        h->keep_alive = sox_true;
+    }
+    else if (!strcasecmp(line, "Location") && location) {
+      free(*location);
+      *location = lsx_strdup(value);
+    }
+    else if (h->want && !strcasecmp(line, h->want)) {
+      free(h->wanted);
+      h->wanted = lsx_strdup(value);
+    }
+  }
+  if (!line)
+    return SOX_EOF;
+  if (h->chunked)
+    h->body_sized = sox_false;
+  h->body_done = (h->body_sized && !h->body_left) ||
+    *status == 204 || *status == 304 || (*status >= 100 && *status < 200);
+  return SOX_SUCCESS;
+}
+
+static size_t read_body(http_t * h, char * buf, size_t len);
+
+/* Asks for the resource from byte `from' to byte `to', or to its end if
+ * `to' is negative */
+static int request(http_t * h, off_t from, off_t to)
+{
+  int redirects = 0, tries, status = 0;
+  char * location = NULL;
+  off_t first, total;
+
+  for (;;) {
+    for (tries = 0; tries < 2; ++tries) {  /* A pooled socket may be stale */
+      char * req;
+      sox_bool pooled = sox_false;
+
+      h->buf_pos = h->buf_len = 0;
+      if (!tries && (h->fd = pool_get(h->host, h->port)) >= 0) {
+        lsx_debug_more("reusing connection to %s", h->host);
+        pooled = sox_true;
+      }
+      else if ((h->fd = connect_to(h->host, h->port)) < 0)
+        return SOX_EOF;
+      req = lsx_malloc(strlen(h->path) + strlen(h->host) + 200);
+      sprintf(req, "GET %s HTTP/1.1\r\nHost: %s%s%s\r\n"
+          "User-Agent: SoX/" PACKAGE_VERSION "\r\n", h->path, h->host,
+          strcmp(h->port, "80")? ":" : "", strcmp(h->port, "80")? h->port : "");
+      sprintf(req + strlen(req), "Range: bytes=%" PRIu64 "-", (sox_uint64_t)from);
+      if (to >= 0)
+        sprintf(req + strlen(req), "%" PRIu64, (sox_uint64_t)to);
+      strcat(req, "\r\n\r\n");
+      if (send_all(h->fd, req, strlen(req)) &&
+          parse_headers(h, &status, &location, &first, &total) == SOX_SUCCESS) {
+        free(req);
+        break;
+      }
+      free(req);
+      disconnect(h);
+      if (!pooled) {
+        free(location);
+        return SOX_EOF;
+      }
+    }
+    if (tries == 2) {
+      free(location);
+      return SOX_EOF;
+    }
+    if (status >= 300 && status < 400 && location && redirects++ < MAX_REDIRECTS) {
+      lsx_debug("redirected to `%s'", location);
+      release(h);
+      if (*location == '/') {
+        free(h->path);
+        h->path = location;
+        location = NULL;
+      }
+      else if (!parse_url(h, location)) {
+        lsx_fail("can't follow redirection to `%s'", location);
+        free(location);
+        errno = EPROTONOSUPPORT;
+        return SOX_EOF;
+      }
+      continue;
+    }
+    break;
+  }
+  free(location);
+
+  if (status == 206) {
+    if (first != from) {
+      lsx_fail("HTTP server returned the wrong range");
+      disconnect(h);
+      errno = EPROTO;
+      return SOX_EOF;
+    }
+    h->ranges = sox_true;
+    if (total >= 0)
+      h->length = total;
+  }
+  else if (status == 200) {
+    h->ranges = sox_false;
+    if (h->body_sized)
+      h->length = (off_t)h->body_left;
+    h->stream_pos = 0;
+    while (h->stream_pos < from) { /* Range ignored, so read up to it */
+      char junk[4096];
+      if (!read_body(h, junk, (size_t)min(from - h->stream_pos, (off_t)sizeof(junk)))) {
+        disconnect(h);
+        errno = EIO;
+        return SOX_EOF;
+      }
+    }
+  }
+  else if (status == 416) {   /* Seeked to the end */
+    if (h->length < 0 || h->length > from)
+      h->length = from;
+    h->body_done = sox_true;
+    release(h);
+  }
+  else {
+    lsx_fail("HTTP server returned status %i", status);
+    disconnect(h);
+    errno = status == 404 || status == 410? ENOENT :
+      status == 401 || status == 403? EACCES : EIO;
+    return SOX_EOF;
+  }
+  h->stream_pos = from;
+  h->back_len = 0;
+  return SOX_SUCCESS;
+}
+
+static size_t read_body(http_t * h, char * buf, size_t len)
+{
+  size_t done = 0;
+
+  while (done < len && !h->body_done && h->fd >= 0) {
+    size_t n;
+
+    if (h->chunked && !h->body_left) {
+      char * line;
+      if (h->body_sized && !get_line(h))   /* CRLF ending the last chunk */
+        break;
+      if (!(line = get_line(h)))
+        break;
+      h->body_left = strtoull(line, NULL, 16);
+      h->body_sized = sox_true;            /* i.e. inside a chunk */
+      if (!h->body_left) {                 /* Last chunk; skip trailers */
+        while ((line = get_line(h)) && *line);
+        h->body_done = line != NULL;
+        break;
+      }
+    }
+    if (h->buf_pos == h->buf_len && !fill(h)) {
+      if (!h->body_sized && !h->chunked)   /* Body ends on close */
+        h->body_done = sox_true, h->keep_alive = sox_false;
+      break;
+    }
+    n = min(len - done, h->buf_len - h->buf_pos);
+    if (h->body_sized)
+      n = (size_t)min((sox_uint64_t)n, h->body_left);
+    memcpy(buf + done, h->buf + h->buf_pos, n);
+    h->buf_pos += n;
+    done += n;
+    if (h->body_sized) {
+      h->body_left -= n;
+      if (!h->body_left && !h->chunked)
+        h->body_done = sox_true;
+    }
+  }
+  h->stream_pos += (off_t)done;
+  return done;
+}
+
+static ssize_t http_read(void * cookie, char * buf, size_t len)
+{
+  http_t * h = cookie;
+  size_t n;
+
+  if (h->length >= 0 && h->pos >= h->length)
+    return 0;
+  if (h->pos < h->stream_pos && h->stream_pos - h->pos <= (off_t)h->back_len) {
+    size_t back = (size_t)(h->stream_pos - h->pos);
+    n = min(len, back);
+    memcpy(buf, h->back + h->back_len - back, n);
+    h->pos += (off_t)n;
+    return (ssize_t)n;
+  }
+  if (h->fd >= 0 && h->pos != h->stream_pos) {
+    if (h->pos > h->stream_pos && h->pos - h->stream_pos <= SKIP_MAX) {
+      char junk[4096];
+      while (h->stream_pos < h->pos &&
+          read_body(h, junk, (size_t)min(h->pos - h->stream_pos, (off_t)sizeof(junk))));
+    }
+    if (h->pos != h->stream_pos)
+      release(h);
+  }
+  if (h->fd < 0 && (h->pos != h->stream_pos || h->ranges) &&
+      request(h, h->pos, (off_t)-1) != SOX_SUCCESS)
+    return -1;
+  n = read_body(h, buf, len);
+  h->pos = h->stream_pos;
+  if (n >= BACK_MAX)
+    memcpy(h->back, buf + n - BACK_MAX, h->back_len = BACK_MAX);
+  else {
+    size_t keep = min(h->back_len, BACK_MAX - n);
+    memmove(h->back, h->back + h->back_len - keep, keep);
+    memcpy(h->back + keep, buf, n);
+    h->back_len = keep + n;
+  }
+  if (h->body_done)
+    release(h);
+  else if (!n) {
+    disconnect(h);
+    return -1;
+  }
+  return (ssize_t)n;
+}
+
+static int http_seek(void * cookie, off64_t * offset, int whence)
+{
+  http_t * h = cookie;
+  off_t pos = whence == SEEK_SET? *offset :
+    whence == SEEK_CUR? h->pos + *offset :
+    h->length >= 0? h->length + *offset : -1;
+
+  if (!h->ranges && pos != h->pos) {
+    errno = ESPIPE;
+    return -1;
+  }
+  if (pos < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  *offset = h->pos = pos;
+  return 0;
+}
+
+static int http_close(void * cookie)
+{
+  http_t * h = cookie;
+  size_t i;
+
+  release(h);
+  #pragma omp critical(lsx_http_streams)
+  for (i = 0; i < num_streams; ++i)
+    if (streams[i].h == h) {
+      streams[i] = streams[--num_streams];
+      break;
+    }
+  free(h->host);
+  free(h->port);
+  free(h->path);
+  free(h->wanted);
+  free(h);
+  return 0;
+}
+
+static http_t * find(FILE * fp)
+{
+  http_t * h = NULL;
+  size_t i;
+
+  #pragma omp critical(lsx_http_streams)
+  for (i = 0; i < num_streams && !h; ++i)
+    if (streams[i].fp == fp)
+      h = streams[i].h;
+  return h;
+}
+
+sox_bool lsx_http_handles(char const * url)
+{
+  return !strncasecmp(url, "http:", (size_t)5);
+}
+
+FILE * lsx_http_open(char const * url)
+{
+  cookie_io_functions_t io = {http_read, NULL, http_seek, http_close};
+  http_t * h = lsx_calloc(1, sizeof(*h));
+  FILE * fp;
+
+  h->fd = -1;
+  h->length = -1;
+  if (!parse_url(h, url)) {
+    lsx_fail("can't parse URL `%s'", url);
+    http_close(h);
+    errno = EINVAL;
+    return NULL;
+  }
+  if (request(h, (off_t)0, (off_t)PROBE_SIZE - 1) != SOX_SUCCESS) {
+    http_close(h);
+    return NULL;
+  }
+  if (h->body_done)
+    release(h);
+  if (!(fp = fopencookie(h, "rb", io))) {
+    http_close(h);
+    return NULL;
+  }
+  #pragma omp critical(lsx_http_streams)
+  {
+    streams = lsx_realloc(streams, (num_streams + 1) * sizeof(*streams));
+    streams[num_streams].fp = fp;
+    streams[num_streams++].h = h;
+  }
+  lsx_debug("`%s': %s, %" PRId64 " bytes", url,
+      h->ranges? "seekable" : "not seekable", (sox_int64_t)h->length);
+  return fp;
+}
+
+sox_bool lsx_http_stream(FILE * fp)
+{
+  return find(fp) != NULL;
+}
+
+/* Sends a request with a body of len bytes, and reads all the response;
+ * on a pooled connection that turns out to be stale, tries once more on a
+ * new one.  headers (if not NULL) are CRLF-terminated lines to add.  The
+ * body of the response is given in *response (if not NULL; to be freed),
+ * and the value of its header named want in *wanted (likewise, if there
+ * is one).  Returns the status of the response, or -1 if there was none. */
+int lsx_http_exchange(char const * method, char const * url,
+    char const * headers, void const * body, size_t len, char * * response,
+    char const * want, char * * wanted)
+{
+  http_t * h = lsx_calloc(1, sizeof(*h));
+  int tries, status = -1;
+  char * req, * resp = NULL, chunk[4096];
+  size_t resp_len = 0, n;
+  off_t first, total;
+
+  h->fd = -1;
+  h->want = want;
+  if (!parse_url(h, url)) {
+    lsx_fail("can't parse URL `%s'", url);
+    http_close(h);
+    errno = EINVAL;
+    return -1;
+  }
+  req = lsx_malloc(strlen(method) + strlen(h->path) + strlen(h->host) +
+      strlen(h->port) + (headers? strlen(headers) : 0) + 200);
+  sprintf(req, "%s %s HTTP/1.1\r\nHost: %s%s%s\r\n"
+      "User-Agent: SoX/" PACKAGE_VERSION "\r\n"
+      "Content-Length: %" PRIuPTR "\r\n%s\r\n", method, h->path, h->host,
+      strcmp(h->port, "80")? ":" : "", strcmp(h->port, "80")? h->port : "",
+      len, headers? headers : "");
+  for (tries = 0; tries < 2; ++tries) {
+    sox_bool pooled = !tries && (h->fd = pool_get(h->host, h->port)) >= 0;
+
+    h->buf_pos = h->buf_len = 0;
+    if (!pooled && (h->fd = connect_to(h->host, h->port)) < 0)
+      break;
+    if (send_all(h->fd, req, strlen(req)) && send_all(h->fd, body, len) &&
+        parse_headers(h, &status, NULL, &first, &total) == SOX_SUCCESS)
+      break;
+    status = -1;
+    disconnect(h);
+    if (!pooled)
+      break;
+  }
+  free(req);
+  if (status >= 0) {
+    while ((n = read_body(h, chunk, sizeof(chunk))))
+      if (response) {
+        resp = lsx_realloc(resp, resp_len + n + 1);
+        memcpy(resp + resp_len, chunk, n);
+        resp_len += n;
+      }
+    if (!h->body_done)
+      status = -1, errno = EIO;
+  }
+  if (response) {
+    *response = resp? resp : lsx_calloc(1, (size_t)1);
+    (*response)[resp_len] = '\0';
+  }
+  else free(resp);
+  if (wanted) {
+    *wanted = h->wanted;
+    h->wanted = NULL;
+  }
+  http_close(h);
+  return status;
+}
+
+sox_bool lsx_http_seekable(FILE * fp)
+{
+  http_t * h = find(fp);
+  return h && h->ranges && h->length >= 0;
+}
+
+sox_uint64_t lsx_http_length(FILE * fp)
+{
+  http_t * h = find(fp);
+  return h && h->length > 0? (sox_uint64_t)h->length : 0;
+}
+
+#else
+
+sox_bool lsx_http_handles(char const * url)
+{
+  (void)url;
+  return sox_false;
+}
+
+FILE * lsx_http_open(char const * url)
+{
+  (void)url;
+  errno = EPROTONOSUPPORT;
+  return NULL;
+}
+
+sox_bool lsx_http_stream(FILE * fp)
+{
+  (void)fp;
+  return sox_false;
+}
+
+int lsx_http_exchange(char const * method, char const * url,
+    char const * headers, void const * body, size_t len, char * * response,
+    char const * want, char * * wanted)
+{
+  (void)method, (void)url, (void)headers, (void)body, (void)len;
+  (void)want;
+  if (response)
+    *response = NULL;
+  if (wanted)
+    *wanted = NULL;
+  errno = EPROTONOSUPPORT;
+  return -1;
+}
+
+sox_bool lsx_http_seekable(FILE * fp)
+{
+  (void)fp;
+  return sox_false;
+}
+
+sox_uint64_t lsx_http_length(FILE * fp)
+{
+  (void)fp;
+  return 0;
+}
+
+#endif
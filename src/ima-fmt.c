@@ -27,7 +27,8 @@ LSX_FORMAT_HANDLER(ima)
     "Raw IMA ADPCM", names, SOX_FILE_MONO,
     lsx_ima_start, lsx_vox_read, lsx_vox_stopread,
     lsx_ima_start, lsx_vox_write, lsx_vox_stopwrite,
-    lsx_rawseek, write_encodings, NULL, sizeof(adpcm_io_t)
+    lsx_vox_seek, write_encodings, NULL, sizeof(adpcm_io_t), NULL, NULL,
+    NULL, NULL
   };
   return &handler;
 }
@@ -47,20 +47,98 @@ static const int imaStepSizeTable[ISSTMAX + 1] = {
 /* -0 - -3, decrease step size */
 /* -4 - -7, increase step size */
 
-static unsigned char imaStateAdjustTable[ISSTMAX+1][8];
-
-void lsx_ima_init_table(void)
-{
-        int i,j,k;
-        for (i=0; i<=ISSTMAX; i++) {
-                for (j=0; j<8; j++) {
-                        k = i + imaStateAdjust(j);
-                        if (k<0) k=0;
-                        else if (k>ISSTMAX) k=ISSTMAX;
-                        imaStateAdjustTable[i][j] = k;
-                }
-        }
-}
+/* The state after each state and code: i + imaStateAdjust(j), clamped */
+static const unsigned char imaStateAdjustTable[ISSTMAX+1][8] = {
+        { 0,  0,  0,  0,  2,  4,  6,  8},
+        { 0,  0,  0,  0,  3,  5,  7,  9},
+        { 1,  1,  1,  1,  4,  6,  8, 10},
+        { 2,  2,  2,  2,  5,  7,  9, 11},
+        { 3,  3,  3,  3,  6,  8, 10, 12},
+        { 4,  4,  4,  4,  7,  9, 11, 13},
+        { 5,  5,  5,  5,  8, 10, 12, 14},
+        { 6,  6,  6,  6,  9, 11, 13, 15},
+        { 7,  7,  7,  7, 10, 12, 14, 16},
+        { 8,  8,  8,  8, 11, 13, 15, 17},
+        { 9,  9,  9,  9, 12, 14, 16, 18},
+        {10, 10, 10, 10, 13, 15, 17, 19},
+        {11, 11, 11, 11, 14, 16, 18, 20},
+        {12, 12, 12, 12, 15, 17, 19, 21},
+        {13, 13, 13, 13, 16, 18, 20, 22},
+        {14, 14, 14, 14, 17, 19, 21, 23},
+        {15, 15, 15, 15, 18, 20, 22, 24},
+        {16, 16, 16, 16, 19, 21, 23, 25},
+        {17, 17, 17, 17, 20, 22, 24, 26},
+        {18, 18, 18, 18, 21, 23, 25, 27},
+        {19, 19, 19, 19, 22, 24, 26, 28},
+        {20, 20, 20, 20, 23, 25, 27, 29},
+        {21, 21, 21, 21, 24, 26, 28, 30},
+        {22, 22, 22, 22, 25, 27, 29, 31},
+        {23, 23, 23, 23, 26, 28, 30, 32},
+        {24, 24, 24, 24, 27, 29, 31, 33},
+        {25, 25, 25, 25, 28, 30, 32, 34},
+        {26, 26, 26, 26, 29, 31, 33, 35},
+        {27, 27, 27, 27, 30, 32, 34, 36},
+        {28, 28, 28, 28, 31, 33, 35, 37},
+        {29, 29, 29, 29, 32, 34, 36, 38},
+        {30, 30, 30, 30, 33, 35, 37, 39},
+        {31, 31, 31, 31, 34, 36, 38, 40},
+        {32, 32, 32, 32, 35, 37, 39, 41},
+        {33, 33, 33, 33, 36, 38, 40, 42},
+        {34, 34, 34, 34, 37, 39, 41, 43},
+        {35, 35, 35, 35, 38, 40, 42, 44},
+        {36, 36, 36, 36, 39, 41, 43, 45},
+        {37, 37, 37, 37, 40, 42, 44, 46},
+        {38, 38, 38, 38, 41, 43, 45, 47},
+        {39, 39, 39, 39, 42, 44, 46, 48},
+        {40, 40, 40, 40, 43, 45, 47, 49},
+        {41, 41, 41, 41, 44, 46, 48, 50},
+        {42, 42, 42, 42, 45, 47, 49, 51},
+        {43, 43, 43, 43, 46, 48, 50, 52},
+        {44, 44, 44, 44, 47, 49, 51, 53},
+        {45, 45, 45, 45, 48, 50, 52, 54},
+        {46, 46, 46, 46, 49, 51, 53, 55},
+        {47, 47, 47, 47, 50, 52, 54, 56},
+        {48, 48, 48, 48, 51, 53, 55, 57},
+        {49, 49, 49, 49, 52, 54, 56, 58},
+        {50, 50, 50, 50, 53, 55, 57, 59},
+        {51, 51, 51, 51, 54, 56, 58, 60},
+        {52, 52, 52, 52, 55, 57, 59, 61},
+        {53, 53, 53, 53, 56, 58, 60, 62},
+        {54, 54, 54, 54, 57, 59, 61, 63},
+        {55, 55, 55, 55, 58, 60, 62, 64},
+        {56, 56, 56, 56, 59, 61, 63, 65},
+        {57, 57, 57, 57, 60, 62, 64, 66},
+        {58, 58, 58, 58, 61, 63, 65, 67},
+        {59, 59, 59, 59, 62, 64, 66, 68},
+        {60, 60, 60, 60, 63, 65, 67, 69},
+        {61, 61, 61, 61, 64, 66, 68, 70},
+        {62, 62, 62, 62, 65, 67, 69, 71},
+        {63, 63, 63, 63, 66, 68, 70, 72},
+        {64, 64, 64, 64, 67, 69, 71, 73},
+        {65, 65, 65, 65, 68, 70, 72, 74},
+        {66, 66, 66, 66, 69, 71, 73, 75},
+        {67, 67, 67, 67, 70, 72, 74, 76},
+        {68, 68, 68, 68, 71, 73, 75, 77},
+        {69, 69, 69, 69, 72, 74, 76, 78},
+        {70, 70, 70, 70, 73, 75, 77, 79},
+        {71, 71, 71, 71, 74, 76, 78, 80},
+        {72, 72, 72, 72, 75, 77, 79, 81},
+        {73, 73, 73, 73, 76, 78, 80, 82},
+        {74, 74, 74, 74, 77, 79, 81, 83},
+        {75, 75, 75, 75, 78, 80, 82, 84},
+        {76, 76, 76, 76, 79, 81, 83, 85},
+        {77, 77, 77, 77, 80, 82, 84, 86},
+        {78, 78, 78, 78, 81, 83, 85, 87},
+        {79, 79, 79, 79, 82, 84, 86, 88},
+        {80, 80, 80, 80, 83, 85, 87, 88},
+        {81, 81, 81, 81, 84, 86, 88, 88},
+        {82, 82, 82, 82, 85, 87, 88, 88},
+        {83, 83, 83, 83, 86, 88, 88, 88},
+        {84, 84, 84, 84, 87, 88, 88, 88},
+        {85, 85, 85, 85, 88, 88, 88, 88},
+        {86, 86, 86, 86, 88, 88, 88, 88},
+        {87, 87, 87, 87, 88, 88, 88, 88}
+};
 
 static void ImaExpandS(
         unsigned ch,             /* channel number to decode, REQUIRE 0 <= ch < chans  */
@@ -142,6 +220,27 @@ void lsx_ima_block_expand_i(
                 ImaExpandS(ch, chans, ibuff, obuff+ch, n, chans);
 }
 
+/* lsx_ima_blocks_expand_i() expands nblocks whole blocks, which follow one
+ * another in ibuff, as many calls of lsx_ima_block_expand_i() would */
+void lsx_ima_blocks_expand_i(
+        unsigned chans,          /* total channels             */
+        const unsigned char *ibuff,/* input buffer[nblocks*blockAlign] */
+        size_t blockAlign,
+        SAMPL *obuff,       /* output samples, nblocks*n*chans */
+        int n,              /* samples to decode PER channel, per block */
+        size_t nblocks,
+        unsigned threads    /* blocks to expand at once */
+)
+{
+        long i;
+
+        #pragma omp parallel for if(threads > 1 && nblocks > 1) \
+            num_threads(threads) schedule(static)
+        for (i = 0; i < (long)nblocks; i++)
+                lsx_ima_block_expand_i(chans, ibuff + (size_t)i*blockAlign,
+                    obuff + (size_t)i*n*chans, n);
+}
+
 /* lsx_ima_block_expand_m() outputs non-interleaved samples into chan separate output buffers */
 void lsx_ima_block_expand_m(
         unsigned chans,          /* total channels             */
@@ -309,6 +408,33 @@ void lsx_ima_block_mash_i(
                 ImaMashChannel(ch, chans, ip, n, st+ch, obuff, opt);
 }
 
+/* lsx_ima_blocks_mash_i() compresses nblocks blocks, as many calls of
+ * lsx_ima_block_mash_i() would.  Each channel's state carries from block to
+ * block, so it is the channels (whose output bytes are apart) that are
+ * compressed at once, up to threads of them. */
+void lsx_ima_blocks_mash_i(
+        unsigned chans,          /* total channels */
+        const SAMPL *ip,    /* ip[nblocks*n*chans] is interleaved input samples */
+        int n,              /* samples to encode PER channel, per block, REQUIRE n % 8 == 1 */
+        int *st,            /* input/output state, REQUIRE 0 <= *st <= ISSTMAX */
+        unsigned char *obuff, /* output buffer[nblocks*blockAlign] */
+        size_t blockAlign,
+        int opt,            /* non-zero allows some cpu-intensive code to improve output */
+        size_t nblocks,
+        unsigned threads
+)
+{
+        size_t i;
+        int ch;
+
+        #pragma omp parallel for if(threads > 1 && chans > 1) \
+            num_threads(threads) schedule(static) private(i)
+        for (ch=0; ch<(int)chans; ch++)
+                for (i=0; i<nblocks; i++)
+                        ImaMashChannel((unsigned)ch, chans, ip + i*n*chans, n,
+                            st+ch, obuff + i*blockAlign, opt);
+}
+
 /*
  * lsx_ima_samples_in(dataLen, chans, blockAlign, samplesPerBlock)
  *  returns the number of samples/channel which would go
@@ -23,12 +23,6 @@
 #define SAMPL short
 #endif
 
-/*
- * call lsx_ima_init_table() before any other Ima* functions,
- * to create the fast lookup tables
- */
-extern void lsx_ima_init_table(void);
-
 /* lsx_ima_block_expand_i() outputs interleaved samples into one output buffer */
 extern void lsx_ima_block_expand_i(
 	unsigned chans,          /* total channels             */
@@ -37,6 +31,17 @@ extern void lsx_ima_block_expand_i(
 	int n               /* samples to decode PER channel, REQUIRE n % 8 == 1  */
 );
 
+/* lsx_ima_blocks_expand_i() does so for nblocks whole blocks, up to threads at once */
+extern void lsx_ima_blocks_expand_i(
+	unsigned chans,          /* total channels             */
+	const unsigned char *ibuff,/* input buffer[nblocks*blockAlign] */
+	size_t blockAlign,
+	SAMPL *obuff,       /* output samples, nblocks*n*chans */
+	int n,              /* samples to decode PER channel, REQUIRE n % 8 == 1  */
+	size_t nblocks,
+	unsigned threads
+);
+
 /* lsx_ima_block_expand_m() outputs non-interleaved samples into chan separate output buffers */
 extern void lsx_ima_block_expand_m(
 	unsigned chans,          /* total channels             */
@@ -55,6 +60,19 @@ extern void lsx_ima_block_mash_i(
 	int opt             /* non-zero allows some cpu-intensive code to improve output */
 );
 
+/* mash nblocks blocks; up to threads channels at once */
+extern void lsx_ima_blocks_mash_i(
+	unsigned chans,          /* total channels */
+	const SAMPL *ip,    /* ip[] is interleaved input samples */
+	int n,              /* samples to encode PER channel, REQUIRE n % 8 == 1 */
+	int *st,            /* input/output state[chans], REQUIRE 0 <= st[ch] <= ISSTMAX */
+	unsigned char *obuff, /* output buffer[nblocks*blockAlign] */
+	size_t blockAlign,
+	int opt,            /* non-zero allows some cpu-intensive code to improve output */
+	size_t nblocks,
+	unsigned threads
+);
+
 /* Some helper functions for computing samples/block and blockalign */
 
 /*
@@ -51,7 +51,8 @@ sox_effect_handler_t const * lsx_input_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "input", NULL, SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_INTERNAL,
-    getopts, NULL, NULL, drain, NULL, NULL, sizeof(priv_t)
+    getopts, NULL, NULL, drain, NULL, NULL, sizeof(priv_t),
+    lsx_reset_stateless, NULL, NULL, NULL
   };
   return &handler;
 }
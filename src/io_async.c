@@ -0,0 +1,664 @@
+/* libSoX asynchronous file I/O
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* For a file given to sox_set_io_async, lsx_readbuf & lsx_writebuf (and
+ * the rest of formats_i.c) come here.  Whilst sox_flow_effects runs, a
+ * thread of its own (lsx_io_async_serve) reads ahead into, or writes out
+ * from, a ring buffer of bytes per file, so that a stall on slow storage
+ * need not stall the effects; at other times, the file is read and written
+ * directly, after anything already read ahead.
+ *
+ * Only the service touches the FILE whilst it runs, except when the caller
+ * has it `paused' (e.g. to seek or to flush): the caller sets pause and
+ * waits for the service to set paused (having written out anything queued),
+ * after which the service leaves the file alone until pause is cleared.
+ *
+ * With the context's io_uring, a seekable regular file is instead read or
+ * written by the service through an io_uring (Linux): rather than blocking
+ * in fread/fwrite on each file in turn, it queues a transfer for each file
+ * that has a block to read or write, submits the lot with one system call,
+ * and picks up the results as they complete, so that one service can keep
+ * many files going.  The transfers are at explicit offsets, into blocks
+ * registered with the kernel as fixed buffers (where they could be); the
+ * FILE's position is taken when the service takes the file on, and given
+ * back (with nothing left in flight) when it is paused or stops.
+ */
+
+#include "sox_i.h"
+#include "ringbuf.h"
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 64
+#endif
+
+typedef struct {
+  sox_format_t * ft;
+  ringbuf_t    ring;         /* Bytes read ahead, or yet to be written */
+  char         * block;      /* The service's transfer buffer */
+  size_t       block_size;
+  size_t       pause;        /* The caller wants the FILE to itself */
+  size_t       paused;       /* The service has let it have it */
+  size_t       eof;          /* The service has read to the end of file */
+  size_t       error;        /* errno of the service's failed read/write */
+  sox_bool     reported;     /* error has been passed on to the caller */
+  sox_bool     eof_seen;     /* A read came up short */
+  int          unread;       /* Byte given to lsx_unreadb, or EOF */
+#ifdef HAVE_IO_URING
+  sox_bool     uring;        /* Is being served through the io_uring */
+  sox_bool     in_flight;    /* Has a transfer queued or submitted */
+  off_t        offset;       /* Where the service's next transfer is */
+  size_t       len;          /* Bytes being written */
+  int          fixed;        /* Index of block as a fixed buffer, or -1 */
+  struct iovec iov;          /* Otherwise, block for READV/WRITEV */
+#endif
+} io_async_t;
+
+static io_async_t * * asyncs;  /* The files doing asynchronous I/O */
+static size_t num_asyncs;
+UNUSED static omp_lock_t asyncs_lock; /* Held by the service as it scans them */
+static sox_bool asyncs_lock_ready;
+static size_t serving;         /* Is lsx_io_async_serve (to be) running? */
+
+size_t lsx_io_async_pending(void)
+{
+  return num_asyncs != 0;
+}
+
+void lsx_io_async_start(void)
+{
+  size_t i;
+
+  for (i = 0; i < num_asyncs; ++i)
+    asyncs[i]->paused = asyncs[i]->eof = 0;
+  serving = 1;
+}
+
+void lsx_io_async_stop(void)
+{
+  serving = 0;
+}
+
+/* Returns sox_true if there was anything to do */
+static sox_bool serve(io_async_t * a, sox_bool drain)
+{
+  FILE * fp = a->ft->fp;
+  size_t n;
+
+  if (a->ft->mode == 'r') {
+    if (ringbuf_load(&a->eof) || ringbuf_space(&a->ring) < a->block_size)
+      return sox_false;
+    n = fread(a->block, (size_t)1, a->block_size, fp);
+    ringbuf_write(&a->ring, n, a->block);
+    if (n < a->block_size) {
+      if (ferror(fp))
+        ringbuf_store(&a->error, (size_t)(errno? errno : EIO));
+      ringbuf_store(&a->eof, (size_t)1);
+    }
+    return sox_true;
+  }
+  n = ringbuf_occupancy(&a->ring);
+  if (!n || (n < a->block_size && !drain))
+    return sox_false;
+  n = ringbuf_read(&a->ring, min(n, a->block_size), a->block);
+  if (fwrite(a->block, (size_t)1, n, fp) != n && !a->error) {
+    ringbuf_store(&a->error, (size_t)(errno? errno : EIO));
+    clearerr(fp); /* Allows us to seek back to write header */
+  }
+  return sox_true;
+}
+
+#ifdef HAVE_IO_URING
+typedef struct {
+  int          fd;           /* -1 if not (yet) set up */
+  unsigned     entries;
+  unsigned     to_submit;    /* Transfers queued but not yet submitted */
+  unsigned     in_flight;    /* Transfers queued or submitted */
+  unsigned     * sq_tail, * sq_mask, * sq_array;
+  unsigned     * cq_head, * cq_tail, * cq_mask;
+  struct io_uring_sqe * sqes;
+  struct io_uring_cqe * cqes;
+  void         * sq_ring, * cq_ring;
+  size_t       sq_size, cq_size, sqes_size;
+} uring_t;
+
+static sox_bool uring_wanted(io_async_t const * a)
+{
+  return a->ft->context->io_uring && a->ft->seekable &&
+    a->ft->io_type == lsx_io_file;
+}
+
+static void uring_close(uring_t * u)
+{
+  if (u->sqes != MAP_FAILED)
+    munmap(u->sqes, u->sqes_size);
+  if (u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+    munmap(u->cq_ring, u->cq_size);
+  if (u->sq_ring != MAP_FAILED)
+    munmap(u->sq_ring, u->sq_size);
+  if (u->fd >= 0)
+    close(u->fd);
+  u->fd = -1;
+}
+
+static sox_bool uring_open(uring_t * u)
+{
+  struct io_uring_params p;
+  char * sq, * cq;
+
+  memset(&p, 0, sizeof(p));
+  u->sq_ring = u->cq_ring = u->sqes = MAP_FAILED;
+  u->to_submit = u->in_flight = 0;
+  if ((u->fd = (int)syscall((long)__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+    return sox_false;
+  u->entries = p.sq_entries;
+  u->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    u->sq_size = u->cq_size = max(u->sq_size, u->cq_size);
+  u->sq_ring = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, u->fd, (off_t)IORING_OFF_SQ_RING);
+  u->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP)? u->sq_ring :
+    mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, u->fd, (off_t)IORING_OFF_CQ_RING);
+  u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, u->fd, (off_t)IORING_OFF_SQES);
+  if (u->sq_ring == MAP_FAILED || u->cq_ring == MAP_FAILED ||
+      u->sqes == MAP_FAILED) {
+    uring_close(u);
+    return sox_false;
+  }
+  sq = u->sq_ring, cq = u->cq_ring;
+  u->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+  u->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+  u->sq_array = (unsigned *)(sq + p.sq_off.array);
+  u->cq_head  = (unsigned *)(cq + p.cq_off.head);
+  u->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+  u->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return sox_true;
+}
+
+/* Sets up the io_uring, with the blocks of the files that want it (as yet)
+ * registered as fixed buffers; those that come later use READV/WRITEV */
+static sox_bool uring_start(uring_t * u)
+{
+  struct iovec * iov = lsx_calloc(num_asyncs, sizeof(*iov));
+  size_t i;
+  unsigned n = 0;
+
+  if (!uring_open(u)) {
+    lsx_debug("io_uring unavailable: %s", strerror(errno));
+    free(iov);
+    return sox_false;
+  }
+  for (i = 0; i < num_asyncs; ++i) {
+    io_async_t * a = asyncs[i];
+    a->fixed = -1;
+    if (uring_wanted(a)) {
+      a->fixed = (int)n;
+      iov[n].iov_base = a->block;
+      iov[n++].iov_len = a->block_size;
+    }
+  }
+  if (syscall((long)__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS,
+        iov, n) < 0) {
+    lsx_debug("io_uring buffers not registered: %s", strerror(errno));
+    for (i = 0; i < num_asyncs; ++i)
+      asyncs[i]->fixed = -1;
+  }
+  else lsx_debug("io_uring with %u fixed buffers", n);
+  free(iov);
+  return sox_true;
+}
+
+/* Submits what has been queued; waits for a completion if wait is set */
+static void uring_enter(uring_t * u, sox_bool wait)
+{
+  int n;
+
+  do n = (int)syscall((long)__NR_io_uring_enter, u->fd, u->to_submit,
+      wait? 1u : 0u, wait? IORING_ENTER_GETEVENTS : 0u, NULL, (size_t)0);
+  while (n < 0 && errno == EINTR);
+  if (n > 0)
+    u->to_submit -= min((unsigned)n, u->to_submit);
+}
+
+static void uring_queue(uring_t * u, io_async_t * a, size_t len)
+{
+  unsigned tail = *u->sq_tail, i = tail & *u->sq_mask;
+  struct io_uring_sqe * sqe = &u->sqes[i];
+  sox_bool write = a->ft->mode == 'w';
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = fileno((FILE*)a->ft->fp);
+  sqe->off = (uint64_t)a->offset;
+  sqe->user_data = (uint64_t)(uintptr_t)a;
+  if (a->fixed >= 0) {
+    sqe->opcode = write? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->addr = (uint64_t)(uintptr_t)a->block;
+    sqe->len = (unsigned)len;
+    sqe->buf_index = (uint16_t)a->fixed;
+  } else {
+    sqe->opcode = write? IORING_OP_WRITEV : IORING_OP_READV;
+    a->iov.iov_base = a->block;
+    a->iov.iov_len = len;
+    sqe->addr = (uint64_t)(uintptr_t)&a->iov;
+    sqe->len = 1;
+  }
+  u->sq_array[i] = i;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  a->in_flight = sox_true;
+  a->len = len;
+  ++u->to_submit, ++u->in_flight;
+}
+
+/* As serve, but queues the transfer (at most one per file at a time) */
+static sox_bool serve_uring(uring_t * u, io_async_t * a, sox_bool drain)
+{
+  size_t n;
+
+  if (a->in_flight || u->in_flight == u->entries)
+    return sox_false;
+  if (a->ft->mode == 'r') {
+    if (ringbuf_load(&a->eof) || ringbuf_space(&a->ring) < a->block_size)
+      return sox_false;
+    n = a->block_size;
+  } else {
+    n = ringbuf_occupancy(&a->ring);
+    if (!n || (n < a->block_size && !drain))
+      return sox_false;
+    n = ringbuf_read(&a->ring, min(n, a->block_size), a->block);
+  }
+  uring_queue(u, a, n);
+  return sox_true;
+}
+
+static void complete(io_async_t * a, int res)
+{
+  a->in_flight = sox_false;
+  if (res > 0)
+    a->offset += res;
+  if (a->ft->mode == 'r') {
+    if (res > 0)
+      ringbuf_write(&a->ring, (size_t)res, a->block);
+    else {
+      if (res < 0)
+        ringbuf_store(&a->error, (size_t)-res);
+      ringbuf_store(&a->eof, (size_t)1);
+    }
+  }
+  else if ((size_t)res != a->len && !a->error)
+    ringbuf_store(&a->error, (size_t)(res < 0? -res : ENOSPC));
+}
+
+/* Returns sox_true if any transfer had completed */
+static sox_bool uring_reap(uring_t * u)
+{
+  unsigned head = *u->cq_head;
+  unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+  sox_bool any = head != tail;
+
+  for (; head != tail; ++head, --u->in_flight) {
+    struct io_uring_cqe const * cqe = &u->cqes[head & *u->cq_mask];
+    complete((io_async_t *)(uintptr_t)cqe->user_data, cqe->res);
+  }
+  __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+  return any;
+}
+
+/* Takes on a file, from the position of its FILE (once flushed) */
+static void uring_adopt(io_async_t * a)
+{
+  FILE * fp = a->ft->fp;
+
+  if (a->ft->mode == 'w' && fflush(fp))
+    return;
+  a->offset = ftello(fp);
+  a->uring = a->offset >= 0;
+}
+
+/* Waits until nothing is in flight for the file (or, if it is an output,
+ * queued for it), then gives the FILE back, positioned after the service's
+ * last transfer */
+static void uring_release(uring_t * u, io_async_t * a)
+{
+  while (a->in_flight || (a->ft->mode == 'w' && !a->error &&
+        ringbuf_occupancy(&a->ring)))
+    if (a->in_flight || !serve_uring(u, a, sox_true)) {
+      uring_enter(u, !uring_reap(u));
+      uring_reap(u);
+    }
+  fseeko((FILE*)a->ft->fp, a->offset, SEEK_SET);
+  a->uring = sox_false;
+}
+#endif
+
+/* Runs until *stop is set, then writes out anything still queued */
+void lsx_io_async_serve(size_t * stop)
+{
+  unsigned waits = 0;
+  sox_bool stopping;
+  size_t i;
+#ifdef HAVE_IO_URING
+  uring_t u;
+  sox_bool tried_uring = sox_false;
+
+  u.fd = -1;
+#endif
+
+  do {
+    sox_bool busy = sox_false;
+
+    stopping = ringbuf_load(stop) != 0;
+    omp_set_lock(&asyncs_lock);
+#ifdef HAVE_IO_URING
+    if (u.fd >= 0)
+      busy = uring_reap(&u);
+#endif
+    for (i = 0; i < num_asyncs; ++i) {
+      io_async_t * a = asyncs[i];
+      if (ringbuf_load(&a->pause)) {
+#ifdef HAVE_IO_URING
+        if (a->uring)
+          uring_release(&u, a);
+#endif
+        while (a->ft->mode == 'w' && serve(a, sox_true));
+        if (!a->paused)
+          ringbuf_store(&a->paused, (size_t)1);
+        continue;
+      }
+      if (a->paused)
+        ringbuf_store(&a->paused, (size_t)0);
+#ifdef HAVE_IO_URING
+      if (!a->uring && uring_wanted(a)) {
+        if (!tried_uring)
+          tried_uring = sox_true, uring_start(&u);
+        if (u.fd >= 0)
+          uring_adopt(a);
+      }
+      if (a->uring) {
+        busy |= serve_uring(&u, a, stopping);
+        continue;
+      }
+#endif
+      while (serve(a, stopping))
+        busy = sox_true;
+    }
+#ifdef HAVE_IO_URING
+    if (u.to_submit)
+      uring_enter(&u, sox_false);
+    if (stopping)
+      for (i = 0; i < num_asyncs; ++i)
+        if (asyncs[i]->uring)
+          uring_release(&u, asyncs[i]);
+#endif
+    omp_unset_lock(&asyncs_lock);
+    if (busy)
+      waits = 0;
+    else if (!stopping)
+      lsx_thread_wait(&waits);
+  } while (!stopping);
+#ifdef HAVE_IO_URING
+  if (u.fd >= 0)
+    uring_close(&u);
+#endif
+}
+
+/* Has the service let the caller have the file to itself */
+static void io_pause(io_async_t * a)
+{
+  unsigned waits = 0;
+
+  if (!serving)
+    return;
+  while (ringbuf_load(&a->paused)) /* Service yet to see the last resume */
+    lsx_thread_wait(&waits);
+  ringbuf_store(&a->pause, (size_t)1);
+  while (!ringbuf_load(&a->paused))
+    lsx_thread_wait(&waits);
+}
+
+static void io_resume(io_async_t * a)
+{
+  if (serving)
+    ringbuf_store(&a->pause, (size_t)0);
+}
+
+static void discard(io_async_t * a)
+{
+  while (ringbuf_occupancy(&a->ring))
+    ringbuf_read(&a->ring, a->block_size, a->block);
+  a->eof_seen = sox_false;
+  a->unread = EOF;
+}
+
+size_t lsx_io_async_read(sox_format_t * ft, void * buf, size_t len)
+{
+  io_async_t * a = ft->io_async;
+  char * p = buf;
+  size_t done = 0;
+  unsigned waits = 0;
+
+  if (len && a->unread != EOF) {
+    *p = (char)a->unread;
+    a->unread = EOF;
+    ++done;
+  }
+  while (done < len) {
+    sox_bool eof = !serving || ringbuf_load(&a->eof); /* Before the ring */
+    size_t n = ringbuf_read(&a->ring, len - done, p + done);
+
+    done += n;
+    if (n)
+      waits = 0;
+    else if (!eof)
+      lsx_thread_wait(&waits);
+    else {
+      if (!serving)
+        done += fread(p + done, (size_t)1, len - done, (FILE*)ft->fp);
+      break;
+    }
+  }
+  if (done < len) {
+    a->eof_seen = sox_true;
+    if (lsx_io_async_error(ft)) {
+      lsx_fail_errno(ft, a->error? (int)a->error : errno, "lsx_readbuf");
+      a->reported = sox_true;
+    }
+  }
+  ft->tell_off += done;
+  return done;
+}
+
+size_t lsx_io_async_write(sox_format_t * ft, void const * buf, size_t len)
+{
+  io_async_t * a = ft->io_async;
+  char const * p = buf;
+  size_t done = 0;
+  unsigned waits = 0;
+
+  if (!serving)
+    done = fwrite(buf, (size_t)1, len, (FILE*)ft->fp);
+  else while (done < len && !ringbuf_load(&a->error)) {
+    size_t n = ringbuf_write(&a->ring, len - done, p + done);
+    done += n;
+    if (n)
+      waits = 0;
+    else lsx_thread_wait(&waits);
+  }
+  if (done != len) {
+    lsx_fail_errno(ft, a->error? (int)a->error : errno,
+        "error writing output file");
+    a->reported = sox_true;
+    if (!serving)
+      clearerr((FILE*)ft->fp); /* Allows us to seek back to write header */
+  }
+  ft->tell_off += done;
+  return done;
+}
+
+int lsx_io_async_flush(sox_format_t * ft)
+{
+  io_async_t * a = ft->io_async;
+  int result;
+
+  io_pause(a);
+  result = fflush((FILE*)ft->fp);
+  io_resume(a);
+  return a->error? EOF : result;
+}
+
+int lsx_io_async_seek(sox_format_t * ft, off_t offset, int whence)
+{
+  io_async_t * a = ft->io_async;
+
+  if (!ft->seekable) {
+    char trash[256];
+
+    if (whence != SEEK_CUR || offset < 0)
+      lsx_fail_errno(ft, SOX_EPERM, "file not seekable");
+    else {
+      ft->sox_errno = SOX_SUCCESS;
+      while (offset && !ft->sox_errno) {
+        size_t n = min((size_t)offset, sizeof(trash));
+        if (lsx_io_async_read(ft, trash, n) != n)
+          lsx_fail_errno(ft, SOX_EOF, "offset past EOF");
+        offset -= n;
+      }
+    }
+    return ft->sox_errno;
+  }
+  io_pause(a);
+  discard(a);
+  if (whence == SEEK_CUR)  /* From where the caller thinks it is */
+    offset += ft->tell_off, whence = SEEK_SET;
+  if (fseeko((FILE*)ft->fp, offset, whence) == -1)
+    lsx_fail_errno(ft, errno, "%s", strerror(errno));
+  else
+    ft->sox_errno = SOX_SUCCESS;
+  ft->tell_off = ftello((FILE*)ft->fp);
+  a->eof = 0;
+  io_resume(a);
+  return ft->sox_errno;
+}
+
+int lsx_io_async_eof(sox_format_t * ft)
+{
+  return ((io_async_t *)ft->io_async)->eof_seen;
+}
+
+int lsx_io_async_error(sox_format_t * ft)
+{
+  io_async_t * a = ft->io_async;
+  return a->error || (!serving && ferror((FILE*)ft->fp));
+}
+
+void lsx_io_async_clearerr(sox_format_t * ft)
+{
+  io_async_t * a = ft->io_async;
+
+  a->eof_seen = sox_false;
+  if (!serving)
+    clearerr((FILE*)ft->fp);
+}
+
+int lsx_io_async_unreadb(sox_format_t * ft, unsigned b)
+{
+  io_async_t * a = ft->io_async;
+
+  if (a->unread != EOF)
+    return EOF;
+  a->unread = (int)(b & 0xff);
+  a->eof_seen = sox_false;
+  --ft->tell_off;
+  return a->unread;
+}
+
+int lsx_io_async_close(sox_format_t * ft)
+{
+  io_async_t * a = ft->io_async;
+  int result = SOX_SUCCESS;
+  size_t i;
+
+  if (!a)
+    return result;
+  io_pause(a);
+  omp_set_lock(&asyncs_lock);
+  for (i = 0; asyncs[i] != a; ++i);
+  asyncs[i] = asyncs[--num_asyncs];
+  omp_unset_lock(&asyncs_lock);
+  if (a->error && !a->reported) {
+    lsx_fail_errno(ft, (int)a->error, "%s", strerror((int)a->error));
+    lsx_fail("`%s': %s", ft->filename, ft->sox_errstr);
+  }
+  if (a->error)
+    result = SOX_EOF;
+  ringbuf_delete(&a->ring);
+  free(a->block);
+  free(a);
+  ft->io_async = NULL;
+  return result;
+}
+
+int sox_set_io_async(sox_format_t * ft, unsigned buffers)
+{
+  io_async_t * a;
+
+  if (buffers < 2) {
+    lsx_fail_errno(ft, SOX_EINVAL, "asynchronous I/O needs at least 2 buffers");
+    return SOX_EOF;
+  }
+  if (ft->io_async || !ft->fp || ft->map ||
+      (ft->handler.flags & SOX_FILE_DEVICE) ||
+      !(sox_version_info()->flags & sox_version_have_threads))
+    return SOX_SUCCESS;  /* Nothing to gain */
+  if (!asyncs_lock_ready) {
+    omp_init_lock(&asyncs_lock);
+    asyncs_lock_ready = sox_true;
+  }
+  if (ft->direct_io)  /* The service's blocks are not aligned */
+    lsx_end_direct_io(ft);
+  lsx_end_prefetch(ft);
+  ft->io_async = a = lsx_calloc(1, sizeof(*a));
+  a->ft = ft;
+  a->block_size = ft->mode == 'r' && ft->context->input_bufsiz?
+      ft->context->input_bufsiz : ft->context->bufsiz;
+  a->block = lsx_malloc(a->block_size);
+  a->unread = EOF;
+#ifdef HAVE_IO_URING
+  a->fixed = -1;
+#endif
+  ringbuf_create(&a->ring, (size_t)1, buffers * a->block_size);
+  if (ft->seekable)
+    ft->tell_off = ftello((FILE*)ft->fp);
+  omp_set_lock(&asyncs_lock);
+  lsx_revalloc(asyncs, num_asyncs + 1);
+  asyncs[num_asyncs++] = a;
+  omp_unset_lock(&asyncs_lock);
+  lsx_debug("`%s': asynchronous I/O with %u buffers of %" PRIuPTR " bytes",
+      ft->filename, buffers, a->block_size);
+  return SOX_SUCCESS;
+}
@@ -53,6 +53,9 @@ sox_version_info_t const * sox_version_info(void)
 #endif
 #ifdef HAVE_FMEMOPEN
         sox_version_have_memopen +
+#endif
+#ifdef HAVE_IO_URING
+        sox_version_have_io_uring +
 #endif
         sox_version_none),
         /* version_code */
@@ -134,7 +137,31 @@ static sox_globals_t s_sox_globals = {
   NULL,            /* char       * tmp_path */
   sox_false,       /* sox_bool     use_magic */
   sox_false,       /* sox_bool     use_threads */
-  10               /* size_t       log2_dft_min_size */
+  10,              /* size_t       log2_dft_min_size */
+  SOX_CHAIN_SERIAL,/* sox_chain_mode_t chain_mode */
+  sox_false,       /* sox_bool     float_chain */
+  0,               /* size_t       log2_dft_block_size */
+  NULL,            /* char       * design_cache_path */
+  sox_false,       /* sox_bool     profile */
+  0,               /* size_t       codec_threads */
+  0,               /* size_t       device_period */
+  0,               /* unsigned     device_periods */
+  0,               /* size_t       realtime_block */
+  sox_false,       /* sox_bool     io_uring */
+  0,               /* size_t       write_block */
+  sox_false,       /* sox_bool     direct_io */
+  NULL,            /* char       * decode_cache_path */
+  0,               /* size_t       threads */
+  sox_false,       /* sox_bool     realtime_safe */
+  sox_false,       /* sox_bool     defer_comments */
+  65536,           /* size_t       header_prefetch */
+  NULL,            /* sox_fft_backend_t const * fft_backend */
+  sox_false,       /* sox_bool     gapless */
+  sox_false,       /* sox_bool     updatable */
+  0,               /* size_t       fifo_max */
+  sox_false,       /* sox_bool     device_poll */
+  sox_false,       /* sox_bool     fast_math */
+  0                /* double       governor */
 };
 
 sox_globals_t * sox_get_globals(void)
@@ -142,6 +169,19 @@ sox_globals_t * sox_get_globals(void)
     return &s_sox_globals;
 }
 
+sox_context_t * sox_create_context(void)
+{
+  sox_context_t * context = lsx_malloc(sizeof(*context));
+  *context = s_sox_globals;
+  return context;
+}
+
+void sox_delete_context(sox_context_t * context)
+{
+  if (context != &s_sox_globals)
+    free(context);
+}
+
 /* FIXME: Not thread safe using globals */
 static sox_effects_globals_t s_sox_effects_globals =
     {sox_plot_off, &s_sox_globals};
@@ -194,12 +234,21 @@ size_t sox_basename(char * base_buffer, size_t base_buffer_len, const char * fil
   }
 }
 
+/* Per thread, so that messages from handlers on different threads are each
+ * attributed to their own */
+static LSX_THREAD_LOCAL char const * subsystem;
+
+void lsx_set_subsystem(char const * name)
+{
+  subsystem = name;
+}
+
 #define SOX_MESSAGE_FUNCTION(name,level) \
 void name(char const * fmt, ...) { \
   va_list ap; \
   va_start(ap, fmt); \
   if (sox_globals.output_message_handler) \
-    (*sox_globals.output_message_handler)(level,sox_globals.subsystem,fmt,ap); \
+    (*sox_globals.output_message_handler)(level,subsystem,fmt,ap); \
   va_end(ap); \
 }
 
@@ -214,6 +263,7 @@ SOX_MESSAGE_FUNCTION(lsx_debug_most_impl , 6)
 
 int sox_init(void)
 {
+  lsx_cpu_init();
   return lsx_effects_init();
 }
 
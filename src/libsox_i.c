@@ -29,6 +29,20 @@
   #include <unistd.h>
 #endif
 
+#if defined _WIN32
+  #include <windows.h>
+  #define yield_thread() Sleep(0)
+  #define sleep_thread() Sleep(1)
+#else
+  #include <sched.h>
+  #define yield_thread() sched_yield()
+  #define sleep_thread() usleep(100)
+#endif
+
+#if defined HAVE_SYS_MMAN_H
+  #include <sys/mman.h>
+#endif
+
 #if defined(_MSC_VER) || defined(__MINGW32__)
   #define MKTEMP_X _O_BINARY|_O_TEMPORARY
 #else
@@ -114,3 +128,83 @@ FILE * lsx_tmpfile(void)
   lsx_debug("tmpfile()");
   return tmpfile();
 }
+
+/* For a thread waiting, without a lock, on another: yields at first, then
+ * sleeps a little at a time; waits counts the calls since there was last
+ * progress. */
+void lsx_thread_wait(unsigned * waits)
+{
+  if (++*waits < 64)
+    yield_thread();
+  else sleep_thread();
+}
+
+/* For sox_globals.realtime_safe: the calling thread is run at real-time
+ * priority (SCHED_FIFO; on Windows, MMCSS's `Pro Audio' task) and the
+ * process's memory, now and to come, locked into RAM, each where the system
+ * permits it; lsx_realtime_leave undoes this. */
+lsx_realtime_t lsx_realtime_enter(void)
+{
+  lsx_realtime_t saved;
+
+  memset(&saved, 0, sizeof(saved));
+#if defined HAVE_SYS_MMAN_H && defined MCL_FUTURE
+  if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    lsx_warn("can't lock memory: %s", strerror(errno));
+  else saved.locked = sox_true;
+#endif
+#if defined _WIN32
+  {
+    typedef HANDLE (WINAPI * set_t)(LPCSTR, LPDWORD);
+    HMODULE avrt = LoadLibraryA("avrt.dll");
+    set_t set = avrt? (set_t)GetProcAddress(avrt, "AvSetMmThreadCharacteristicsA") : NULL;
+    DWORD index = 0;
+
+    if (set && (saved.task = set("Pro Audio", &index)) != NULL)
+      saved.raised = sox_true;
+    else lsx_warn("can't raise the thread's priority (MMCSS)");
+  }
+#elif defined SCHED_FIFO
+  {
+    struct sched_param param;
+
+    saved.policy = sched_getscheduler(0);
+    sched_getparam(0, &param);
+    saved.priority = param.sched_priority;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = (sched_get_priority_min(SCHED_FIFO) +
+        sched_get_priority_max(SCHED_FIFO)) / 2;
+    if (sched_setscheduler(0, SCHED_FIFO, &param))
+      lsx_warn("can't raise the thread's priority: %s", strerror(errno));
+    else saved.raised = sox_true;
+  }
+#endif
+  lsx_debug("real-time priority %s, memory %s", saved.raised? "on" : "off",
+      saved.locked? "locked" : "not locked");
+  return saved;
+}
+
+void lsx_realtime_leave(lsx_realtime_t saved)
+{
+#if defined _WIN32
+  if (saved.raised) {
+    typedef BOOL (WINAPI * revert_t)(HANDLE);
+    HMODULE avrt = GetModuleHandleA("avrt.dll");
+    revert_t revert = avrt? (revert_t)GetProcAddress(avrt, "AvRevertMmThreadCharacteristics") : NULL;
+    if (revert)
+      revert(saved.task);
+  }
+#elif defined SCHED_FIFO
+  if (saved.raised) {
+    struct sched_param param;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = saved.priority;
+    sched_setscheduler(0, saved.policy, &param);
+  }
+#endif
+#if defined HAVE_SYS_MMAN_H && defined MCL_FUTURE
+  if (saved.locked)
+    munlockall();
+#endif
+}
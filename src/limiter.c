@@ -0,0 +1,296 @@
+/* libSoX effect: look-ahead peak limiter
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Each frame's peak (over all channels, so that they are limited alike) is
+ * that of its samples or, by default, its true peak: the greatest also of
+ * the 3 points between it and the next that 4x over-sampling finds.  The
+ * gain a frame needs (to bring its peak to the ceiling) is taken as the
+ * least over the look-ahead window (a sliding maximum of the peaks), then
+ * averaged over the window; since every frame's least gain is in each of
+ * the windows that are averaged for it, the average never exceeds it, so
+ * the gain reaches what a peak needs by the time it is output, smoothly
+ * and without overshoot.  It then recovers at the release rate.  The audio
+ * is delayed to match, and the gains applied a block at a time. */
+
+#include "sox_i.h"
+#include "fifo.h"
+#include "slidemax.h"
+#include <ctype.h>
+#include <string.h>
+
+#define TP_PHASES 4             /* True-peak over-sampling */
+#define TP_TAPS   13            /* Per phase, of the 49-tap filter */
+#define TP_DELAY  6             /* Input samples to the filter's centre */
+#define BLOCK     512           /* Frames */
+
+typedef struct {
+  double ceiling_dB, lookahead_ms, release_ms;
+  sox_bool sample_peak;
+
+  double ceiling, release, sum, env, least;
+  size_t window, delay, tp_delay, box_i, drained;
+  uint64_t frames, limited;
+  double * box;                 /* The last window gains */
+  slidemax_t peaks;
+  fifo_t audio;                 /* Delayed frames */
+  float tp[TP_PHASES - 1][TP_TAPS]; /* Phases 1 to 3, taps reversed */
+  float * history;              /* Per channel: TP_TAPS samples, twice */
+  size_t hist_i;
+  float * in, * out;            /* Converted (BLOCK frames) */
+  double gain[BLOCK];
+} priv_t;
+
+static int getopts(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  lsx_getopt_t optstate;
+  int c;
+
+  p->ceiling_dB = -1;
+  p->lookahead_ms = 5;
+  p->release_ms = 50;
+  lsx_getopt_init(argc, argv, "+sl:r:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  while (!(optstate.ind < argc && !optstate.curpos && /* Negative ceiling? */
+        argv[optstate.ind][0] == '-' && (isdigit((unsigned char)
+        argv[optstate.ind][1]) || argv[optstate.ind][1] == '.')) &&
+      (c = lsx_getopt(&optstate)) != -1) switch (c) {
+    case 's': p->sample_peak = sox_true; break;
+    GETOPT_NUMERIC(optstate, 'l', lookahead_ms, .1, 1000)
+    GETOPT_NUMERIC(optstate, 'r', release_ms, 1, 10000)
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  do {NUMERIC_PARAMETER(ceiling_dB, -60, 0)} while (0);
+  return argc? lsx_usage(effp) : SOX_SUCCESS;
+}
+
+static int flow_float(sox_effect_t *, float const *, float *, size_t *, size_t *);
+static int drain_float(sox_effect_t *, float *, size_t *);
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t i, k, chans = effp->in_signal.channels;
+
+  p->ceiling = dB_to_linear(p->ceiling_dB);
+  p->window = max(1, (size_t)(p->lookahead_ms * .001 * effp->in_signal.rate + .5));
+  p->release = 1 - exp(-1 / (p->release_ms * .001 * effp->in_signal.rate));
+  p->tp_delay = p->sample_peak? 0 : TP_DELAY;
+  p->delay = p->tp_delay + p->window - 1;
+  p->box = lsx_malloc(p->window * sizeof(*p->box));
+  for (i = 0; i < p->window; ++i)
+    p->box[i] = 1;
+  p->sum = (double)p->window;
+  p->env = p->least = 1;
+  p->box_i = p->drained = 0;
+  p->frames = p->limited = 0;
+  slidemax_create(&p->peaks, p->window);
+  fifo_create(&p->audio, chans * sizeof(float));
+  fifo_preallocate(&p->audio, p->delay + 2 * BLOCK);
+  if (!p->sample_peak) {
+    double * h = lsx_make_lpf(TP_PHASES * (TP_TAPS - 1) + 1, 1. / TP_PHASES,
+        7., 0., (double)TP_PHASES, sox_true);
+    for (k = 1; k < TP_PHASES; ++k)
+      for (i = 0; i < TP_TAPS; ++i) /* Last tap of each is beyond the filter */
+        p->tp[k - 1][i] = i? (float)h[k + TP_PHASES * (TP_TAPS - 1 - i)] : 0;
+    free(h);
+    p->history = lsx_calloc(chans * 2 * TP_TAPS, sizeof(*p->history));
+    p->hist_i = 0;
+  }
+  p->in = lsx_malloc(BLOCK * chans * sizeof(*p->in));
+  p->out = lsx_malloc(BLOCK * chans * sizeof(*p->out));
+  effp->latency = p->delay / effp->in_signal.rate;
+  effp->flow_float = flow_float;
+  effp->drain_float = drain_float;
+  return SOX_SUCCESS;
+}
+
+/* The peak of the frame tp_delay frames before in */
+static double peak(priv_t * p, float const * in, size_t chans)
+{
+  float m = 0;
+  size_t c, i, k;
+
+  if (p->sample_peak) {
+    for (c = 0; c < chans; ++c)
+      m = max(m, (float)fabs(in[c]));
+    return m;
+  }
+  for (c = 0; c < chans; ++c) {
+    float * h = p->history + c * 2 * TP_TAPS, * w;
+
+    h[p->hist_i] = h[p->hist_i + TP_TAPS] = in[c];
+    w = h + p->hist_i + 1;           /* Oldest to newest */
+    m = max(m, (float)fabs(w[TP_TAPS - 1 - TP_DELAY]));
+    for (k = 0; k < TP_PHASES - 1; ++k) {
+      float y = 0;
+      for (i = 0; i < TP_TAPS; ++i)
+        y += p->tp[k][i] * w[i];
+      m = max(m, (float)fabs(y));
+    }
+  }
+  p->hist_i = (p->hist_i + 1) % TP_TAPS;
+  return m;
+}
+
+/* The gain for the frame window - 1 frames before the one of peak x */
+static double envelope(priv_t * p, double x)
+{
+  double m = slidemax_push(&p->peaks, x);
+  double g = m > p->ceiling? p->ceiling / m : 1;
+
+  p->sum += g - p->box[p->box_i];
+  p->box[p->box_i] = g;
+  if (++p->box_i == p->window) {   /* Lest rounding errors build up */
+    size_t i;
+    p->box_i = 0;
+    for (p->sum = 0, i = 0; i < p->window; ++i)
+      p->sum += p->box[i];
+  }
+  g = p->sum / p->window;
+  p->env = g < p->env? g : p->env + (g - p->env) * p->release;
+  return p->env;
+}
+
+/* Takes n frames (at most BLOCK); gives those delay frames before them,
+ * but none before the first; returns how many */
+static size_t process(sox_effect_t * effp, float const * in, float * out,
+    size_t n)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, i, c, first, done;
+  float const * d;
+
+  fifo_write(&p->audio, n, in);
+  for (i = 0; i < n; ++i, in += chans) {
+    double x = peak(p, in, chans);
+    if (p->frames + i >= p->tp_delay)
+      p->gain[i] = envelope(p, x);
+  }
+  first = (size_t)(p->frames < p->delay? min(n, p->delay - p->frames) : 0);
+  p->frames += n;
+  done = n - first;
+  d = fifo_read(&p->audio, done, NULL);
+  for (i = 0; i < done; ++i) {
+    float g = (float)p->gain[first + i];
+    for (c = 0; c < chans; ++c)
+      out[i * chans + c] = d[i * chans + c] * g;
+  }
+  for (i = first; i < n; ++i) {
+    p->limited += p->gain[i] < 1;
+    p->least = min(p->least, p->gain[i]);
+  }
+  return done;
+}
+
+static int flow_float(sox_effect_t * effp, float const * ibuf, float * obuf,
+    size_t * isamp, size_t * osamp)
+{
+  size_t chans = effp->in_signal.channels;
+  size_t n = min(*isamp, *osamp) / chans, i, done = 0;
+
+  for (i = 0; i < n; i += BLOCK)
+    done += process(effp, ibuf + i * chans, obuf + done * chans,
+        min(n - i, BLOCK));
+  *isamp = n * chans;
+  *osamp = done * chans;
+  return SOX_SUCCESS;
+}
+
+static int drain_float(sox_effect_t * effp, float * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, done = 0;
+  size_t n = min(*osamp / chans, p->delay - p->drained);
+
+  memset(p->in, 0, min(n, BLOCK) * chans * sizeof(*p->in));
+  while (n) {
+    size_t k = min(n, BLOCK);
+    done += process(effp, p->in, obuf + done * chans, k);
+    p->drained += k;
+    n -= k;
+  }
+  *osamp = done * chans;
+  return p->drained < p->delay? SOX_SUCCESS : SOX_EOF;
+}
+
+static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels;
+  size_t n = min(*isamp, *osamp) / chans, i, k, done = 0;
+
+  for (i = 0; i < n; i += k) {
+    size_t m;
+    k = min(n - i, BLOCK);
+    lsx_samples_to_float(p->in, ibuf + i * chans, (size_t)1, k * chans,
+        &effp->clips);
+    m = process(effp, p->in, p->out, k);
+    lsx_float_to_samples(obuf + done * chans, (size_t)1, p->out, m * chans,
+        &effp->clips);
+    done += m;
+  }
+  *isamp = n * chans;
+  *osamp = done * chans;
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, done = 0;
+  size_t n = min(*osamp / chans, p->delay - p->drained);
+
+  memset(p->in, 0, min(n, BLOCK) * chans * sizeof(*p->in));
+  while (n) {
+    size_t k = min(n, BLOCK), m = process(effp, p->in, p->out, k);
+    lsx_float_to_samples(obuf + done * chans, (size_t)1, p->out, m * chans,
+        &effp->clips);
+    done += m;
+    p->drained += k;
+    n -= k;
+  }
+  *osamp = done * chans;
+  return p->drained < p->delay? SOX_SUCCESS : SOX_EOF;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  if (p->limited)
+    lsx_report("limited %g%% of the time, by up to %gdB",
+        100. * p->limited / max(p->frames - p->drained, 1), -linear_to_dB(p->least));
+  free(p->in);
+  free(p->out);
+  free(p->history);
+  free(p->box);
+  fifo_delete(&p->audio);
+  slidemax_delete(&p->peaks);
+  return SOX_SUCCESS;
+}
+
+sox_effect_handler_t const * lsx_limiter_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"limiter",
+    "[-s] [-l look-ahead-ms] [-r release-ms] [ceiling-dB]",
+    SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_RTSAFE, getopts, start, flow, drain, stop, NULL,
+    sizeof(priv_t), NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
@@ -103,15 +103,26 @@ static int start(sox_effect_t * effp)
     return SOX_EFF_NULL;
 
   if (!f->num_taps) {
-    double * h = make_filter(p->n, p->start, p->delta, effp->in_signal.rate);
-    if (effp->global_info->plot != sox_plot_off) {
-      char title[100];
-      sprintf(title, "SoX effect: loudness %g (%g)", p->delta, p->start);
-      lsx_plot_fir(h, p->n, effp->in_signal.rate,
-          effp->global_info->plot, title, p->delta - 5, 0.);
-      return SOX_EOF;
+    double key[4];
+    double const * design = NULL;
+    int n, post_peak;
+
+    key[0] = p->n, key[1] = p->start, key[2] = p->delta;
+    key[3] = effp->in_signal.rate;
+    if (effp->global_info->plot == sox_plot_off)
+      design = lsx_design_get("loudness", key, 4, &n, &post_peak);
+    if (!design) {
+      double * h = make_filter(p->n, p->start, p->delta, effp->in_signal.rate);
+      if (effp->global_info->plot != sox_plot_off) {
+        char title[100];
+        sprintf(title, "SoX effect: loudness %g (%g)", p->delta, p->start);
+        lsx_plot_fir(h, p->n, effp->in_signal.rate,
+            effp->global_info->plot, title, p->delta - 5, 0.);
+        return SOX_EOF;
+      }
+      design = lsx_design_put("loudness", key, 4, h, p->n, p->n >> 1);
     }
-    lsx_set_dft_filter(f, h, p->n, p->n >> 1);
+    lsx_set_dft_filter_design(f, design, p->n, p->n >> 1);
   }
   return lsx_dft_filter_effect_fn()->start(effp);
 }
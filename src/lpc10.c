@@ -25,101 +25,56 @@
 #include "../lpc10/lpc10.h"
 #endif
 
+/* Bytes per packed frame, and frames read or written at a time */
+#define FRAME_BYTES ((LPC10_BITS_IN_COMPRESSED_FRAME + 7) / 8)
+#define FRAMES 32
+
 /* Private data */
 typedef struct {
   struct lpc10_encoder_state *encst;
-  float speech[LPC10_SAMPLES_PER_FRAME];
-  unsigned samples;
+  float speech[FRAMES * LPC10_SAMPLES_PER_FRAME];
+  unsigned samples, nsamples;
+  uint8_t packed[FRAMES * FRAME_BYTES];
+  size_t npacked;
   struct lpc10_decoder_state *decst;
 } priv_t;
 
 /*
-  Write the bits in bits[0] through bits[len-1] to file f, in "packed"
+  Pack the bits in bits[0] through bits[len-1] into data, in "packed"
   format.
 
   bits is expected to be an array of len integer values, where each
   integer is 0 to represent a 0 bit, and any other value represents a
-  1 bit. This bit string is written to the file f in the form of
-  several 8 bit characters. If len is not a multiple of 8, then the
-  last character is padded with 0 bits -- the padding is in the least
-  significant bits of the last byte. The 8 bit characters are "filled"
-  in order from most significant bit to least significant.
+  1 bit. This bit string is packed into ceiling(len/8) 8 bit characters.
+  If len is not a multiple of 8, then the last character is padded with
+  0 bits -- the padding is in the least significant bits of the last
+  byte. The 8 bit characters are "filled" in order from most significant
+  bit to least significant.
 */
-static void write_bits(sox_format_t * ft, INT32 *bits, int len)
+static void pack_bits(uint8_t *data, INT32 const *bits, int len)
 {
   int i;
-  uint8_t mask; /* The next bit position within the variable "data" to
-                   place the next bit. */
-  uint8_t data; /* The contents of the next byte to place in the
-                   output. */
-
-  /* Fill in the array bits.
-   * The first compressed output bit will be the most significant
-   * bit of the byte, so initialize mask to 0x80.  The next byte of
-   * compressed data is initially 0, and the desired bits will be
-   * turned on below.
-   */
-  mask = 0x80;
-  data = 0;
-
-  for (i = 0; i < len; i++) {
-    /* Turn on the next bit of output data, if necessary. */
-    if (bits[i]) {
-      data |= mask;
-    }
-    /*
-     * If the byte data is full, determined by mask becoming 0,
-     * then write the byte to the output file, and reinitialize
-     * data and mask for the next output byte.  Also add the byte
-     * if (i == len-1), because if len is not a multiple of 8,
-     * then mask won't yet be 0.  */
-    mask >>= 1;
-    if ((mask == 0) || (i == len-1)) {
-      lsx_writeb(ft, data);
-      data = 0;
-      mask = 0x80;
-    }
-  }
+
+  memset(data, 0, (size_t)(len + 7) / 8);
+  for (i = 0; i < len; i++)
+    if (bits[i])
+      data[i >> 3] |= 0x80 >> (i & 7);
 }
 
 /*
-  Read bits from file f into bits[0] through bits[len-1], in "packed"
-  format.
-
-  Read ceiling(len/8) characters from file f, if that many are
-  available to read, otherwise read to the end of the file. The first
-  character's 8 bits, in order from MSB to LSB, are used to fill
-  bits[0] through bits[7]. The second character's bits are used to
-  fill bits[8] through bits[15], and so on. If ceiling(len/8)
-  characters are available to read, and len is not a multiple of 8,
-  then some of the least significant bits of the last character read
-  are completely ignored. Every entry of bits[] that is modified is
-  changed to either a 0 or a 1.
-
-  The number of bits successfully read is returned, and is always in
-  the range 0 to len, inclusive. If it is less than len, it will
-  always be a multiple of 8.
+  Unpack bits from data into bits[0] through bits[len-1], from "packed"
+  format: the first character's 8 bits, in order from MSB to LSB, are
+  used to fill bits[0] through bits[7], the second character's bits
+  bits[8] through bits[15], and so on. If len is not a multiple of 8,
+  then some of the least significant bits of the last character are
+  ignored. Every entry of bits[] is changed to either a 0 or a 1.
 */
-static int read_bits(sox_format_t * ft, INT32 *bits, int len)
+static void unpack_bits(INT32 *bits, uint8_t const *data, int len)
 {
   int i;
-  uint8_t c = 0;
-
-  /* Unpack the array bits into coded_frame. */
-  for (i = 0; i < len; i++) {
-    if (i % 8 == 0) {
-      lsx_read_b_buf(ft, &c, (size_t) 1);
-      if (lsx_eof(ft)) {
-        return (i);
-      }
-    }
-    if (c & (0x80 >> (i & 7))) {
-      bits[i] = 1;
-    } else {
-      bits[i] = 0;
-    }
-  }
-  return (len);
+
+  for (i = 0; i < len; i++)
+    bits[i] = (data[i >> 3] >> (7 - (i & 7))) & 1;
 }
 
 static int startread(sox_format_t * ft)
@@ -130,7 +85,7 @@ static int startread(sox_format_t * ft)
     fprintf(stderr, "lpc10 could not allocate decoder state");
     return SOX_EOF;
   }
-  lpc->samples = LPC10_SAMPLES_PER_FRAME;
+  lpc->samples = lpc->nsamples = 0;
   return lsx_check_read_params(ft, 1, 8000., SOX_ENCODING_LPC10, 0, (uint64_t)0, sox_false);
 }
 
@@ -143,10 +98,12 @@ static int startwrite(sox_format_t * ft)
     return SOX_EOF;
   }
   lpc->samples = 0;
+  lpc->npacked = 0;
 
   return SOX_SUCCESS;
 }
 
+/* Frames are read FRAMES at a time; a partial frame at the end is ignored */
 static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t len)
 {
   priv_t * lpc = (priv_t *)ft->priv;
@@ -155,23 +112,37 @@ static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t len)
   while (nread < len) {
     SOX_SAMPLE_LOCALS;
     /* Read more data if buffer is empty */
-    if (lpc->samples == LPC10_SAMPLES_PER_FRAME) {
+    if (lpc->samples == lpc->nsamples) {
       INT32 bits[LPC10_BITS_IN_COMPRESSED_FRAME];
+      size_t i, n = lsx_readbuf(ft, lpc->packed, sizeof(lpc->packed)) / FRAME_BYTES;
 
-      if (read_bits(ft, bits, LPC10_BITS_IN_COMPRESSED_FRAME) !=
-          LPC10_BITS_IN_COMPRESSED_FRAME)
+      if (!n)
         break;
-      lpc10_decode(bits, lpc->speech, lpc->decst);
+      for (i = 0; i < n; ++i) {
+        unpack_bits(bits, lpc->packed + i * FRAME_BYTES, LPC10_BITS_IN_COMPRESSED_FRAME);
+        lpc10_decode(bits, lpc->speech + i * LPC10_SAMPLES_PER_FRAME, lpc->decst);
+      }
       lpc->samples = 0;
+      lpc->nsamples = (unsigned)n * LPC10_SAMPLES_PER_FRAME;
     }
 
-    while (nread < len && lpc->samples < LPC10_SAMPLES_PER_FRAME)
+    while (nread < len && lpc->samples < lpc->nsamples)
       buf[nread++] = SOX_FLOAT_32BIT_TO_SAMPLE(lpc->speech[lpc->samples++], ft->clips);
   }
 
   return nread;
 }
 
+static int flush_packed(sox_format_t * ft)
+{
+  priv_t * lpc = (priv_t *)ft->priv;
+  size_t n = lpc->npacked;
+
+  lpc->npacked = 0;
+  return lsx_writebuf(ft, lpc->packed, n) == n? SOX_SUCCESS : SOX_EOF;
+}
+
+/* Each frame is encoded as it is filled, and written FRAMES at a time */
 static size_t write_samples(sox_format_t * ft, const sox_sample_t *buf, size_t len)
 {
   priv_t * lpc = (priv_t *)ft->priv;
@@ -188,8 +159,11 @@ static size_t write_samples(sox_format_t * ft, const sox_sample_t *buf, size_t l
       INT32 bits[LPC10_BITS_IN_COMPRESSED_FRAME];
 
       lpc10_encode(lpc->speech, bits, lpc->encst);
-      write_bits(ft, bits, LPC10_BITS_IN_COMPRESSED_FRAME);
+      pack_bits(lpc->packed + lpc->npacked, bits, LPC10_BITS_IN_COMPRESSED_FRAME);
       lpc->samples = 0;
+      if ((lpc->npacked += FRAME_BYTES) == sizeof(lpc->packed) &&
+          flush_packed(ft) != SOX_SUCCESS)
+        return 0;
     }
   }
 
@@ -208,10 +182,11 @@ static int stopread(sox_format_t * ft)
 static int stopwrite(sox_format_t * ft)
 {
   priv_t * lpc = (priv_t *)ft->priv;
+  int result = flush_packed(ft);
 
   free(lpc->encst);
 
-  return SOX_SUCCESS;
+  return result;
 }
 
 LSX_FORMAT_HANDLER(lpc10)
@@ -223,7 +198,7 @@ LSX_FORMAT_HANDLER(lpc10)
     "Low bandwidth, robotic sounding speech compression", names, SOX_FILE_MONO,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, write_rates, sizeof(priv_t)
+    NULL, write_encodings, write_rates, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -0,0 +1,838 @@
+/* LV2 effect support for sox
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Hosts an LV2 plugin, found (on LV2_PATH) and described through lilv.  As
+ * with ladspa, a plugin's audio ports take the channels in turn, and -r
+ * clones it to take more.  The plugin is run on a float buffer per port, in
+ * blocks of at most the chain's buffer size per channel (see
+ * lsx_effect_set_block), as it is told through the options and buf-size
+ * extensions; one that requires blocks all of the same length is given only
+ * whole blocks, with the last one padded out.  The worker extension's work
+ * is done by lsx_lv2_work_serve, on a thread of its own alongside the chain
+ * (see effects.c), or, where there is none, there and then.
+ */
+
+#include "sox_i.h"
+
+#ifdef HAVE_LILV_H
+
+#include "ringbuf.h"
+#include <string.h>
+#include <lilv/lilv.h>
+#include <lv2/atom/atom.h>
+#include <lv2/buf-size/buf-size.h>
+#include <lv2/core/lv2.h>
+#include <lv2/options/options.h>
+#include <lv2/parameters/parameters.h>
+#include <lv2/urid/urid.h>
+#include <lv2/worker/worker.h>
+
+#define WORK_RING  65536 /* Bytes that may be queued to or from a worker */
+#define ATOM_SIZE  8192  /* Bytes in each atom port's buffer */
+
+/* Requests from a plugin's run to its worker, and the worker's responses,
+ * pass through a ring each; an entry is its size (uint32_t) then its data */
+typedef struct {
+  ringbuf_t ring;
+  char * put;          /* An entry being written, by the one thread */
+  char * get;          /* An entry being read, by the other */
+} queue_t;
+
+typedef struct {
+  LV2_Worker_Interface const * iface;
+  LV2_Handle handle;
+  queue_t requests, responses;
+  LV2_Worker_Schedule schedule;
+} worker_t;
+
+/* The workers of all started lv2 effects; changed only outside the flow */
+static worker_t * * workers;
+static size_t num_workers;
+static size_t serving;     /* Whether lsx_lv2_work_serve is running */
+
+static void queue_create(queue_t * q)
+{
+  ringbuf_create(&q->ring, 1, WORK_RING);
+  q->put = lsx_malloc(WORK_RING);
+  q->get = lsx_malloc(WORK_RING);
+}
+
+static void queue_delete(queue_t * q)
+{
+  ringbuf_delete(&q->ring);
+  free(q->put);
+  free(q->get);
+}
+
+static LV2_Worker_Status queue_put(queue_t * q, uint32_t size,
+    void const * data)
+{
+  if (ringbuf_space(&q->ring) < sizeof(size) + size)
+    return LV2_WORKER_ERR_NO_SPACE;
+  memcpy(q->put, &size, sizeof(size));
+  memcpy(q->put + sizeof(size), data, size);
+  ringbuf_write(&q->ring, sizeof(size) + size, q->put);
+  return LV2_WORKER_SUCCESS;
+}
+
+/* Returns sox_true, with the entry's data in q->get, if there was one */
+static sox_bool queue_get(queue_t * q, uint32_t * size)
+{
+  if (ringbuf_occupancy(&q->ring) < sizeof(*size))
+    return sox_false;
+  ringbuf_read(&q->ring, sizeof(*size), size);
+  ringbuf_read(&q->ring, *size, q->get);
+  return sox_true;
+}
+
+static LV2_Worker_Status respond(LV2_Worker_Respond_Handle handle,
+    uint32_t size, void const * data)
+{
+  return queue_put(&((worker_t *)handle)->responses, size, data);
+}
+
+static LV2_Worker_Status schedule_work(LV2_Worker_Schedule_Handle handle,
+    uint32_t size, void const * data)
+{
+  worker_t * w = handle;
+
+  if (!ringbuf_load(&serving)) /* No worker thread, so work now */
+    return w->iface->work(w->handle, respond, w, size, data);
+  return queue_put(&w->requests, size, data);
+}
+
+/* Returns sox_true if there was anything to do */
+static sox_bool work(void)
+{
+  sox_bool busy = sox_false;
+  uint32_t size;
+  size_t i;
+
+  for (i = 0; i < num_workers; ++i) {
+    worker_t * w = workers[i];
+    while (queue_get(&w->requests, &size)) {
+      w->iface->work(w->handle, respond, w, size, w->requests.get);
+      busy = sox_true;
+    }
+  }
+  return busy;
+}
+
+/* Returns the number of threads wanted for lsx_lv2_work_serve: 0 or 1 */
+size_t lsx_lv2_work_pending(void)
+{
+  return num_workers != 0;
+}
+
+/* Does the workers' work until *stop is set */
+void lsx_lv2_work_serve(size_t * stop)
+{
+  unsigned waits = 0;
+
+  ringbuf_store(&serving, (size_t)1);
+  while (!ringbuf_load(stop)) {
+    if (work())
+      waits = 0;
+    else lsx_thread_wait(&waits);
+  }
+  work();
+  ringbuf_store(&serving, (size_t)0);
+}
+
+typedef enum {
+  port_unused, port_audio_in, port_audio_out, port_control_in,
+  port_control_out, port_atom_in, port_atom_out
+} port_kind_t;
+
+typedef struct {
+  /* Options and plugin description */
+  sox_bool clone;
+  LilvWorld * world;
+  LilvPlugin const * plugin;
+  uint32_t num_ports;
+  port_kind_t * kinds;
+  float * control;             /* Control port values */
+  uint32_t * inputs, * outputs; /* Audio port indices */
+  size_t input_count, output_count;
+
+  /* Instances, and what they are given */
+  LilvInstance * * instances;
+  size_t instance_count;
+  worker_t * workers;          /* One per instance, if the plugin has them */
+  char * atoms;                /* ATOM_SIZE bytes per atom port per instance */
+  char * * uris;               /* Mapped to URIDs 1, 2, ... */
+  size_t num_uris;
+  omp_lock_t uris_lock;
+  LV2_URID_Map map;
+  LV2_URID_Unmap unmap;
+  int32_t min_block, max_block;
+  float rate;
+  LV2_Options_Option options[5];
+  LV2_URID sequence, chunk;
+
+  /* Processing */
+  size_t block;                /* Frames per run, or most if not fixed */
+  sox_bool fixed;              /* Every run must be of block frames */
+  sox_bool inplace;            /* Output ports share input buffers */
+  float * buf;                 /* The ports' buffers, of block frames each */
+  float * * in, * * out;
+  size_t fill;                 /* Frames in the input buffers */
+  size_t out_pos, out_len;     /* Frames in the output buffers */
+} priv_t;
+
+static LV2_URID map_uri(LV2_URID_Map_Handle handle, char const * uri)
+{
+  priv_t * p = handle;
+  size_t i;
+
+  omp_set_lock(&p->uris_lock);
+  for (i = 0; i < p->num_uris && strcmp(p->uris[i], uri); ++i);
+  if (i == p->num_uris) {
+    lsx_revalloc(p->uris, i + 1);
+    p->uris[p->num_uris++] = lsx_strdup(uri);
+  }
+  omp_unset_lock(&p->uris_lock);
+  return (LV2_URID)i + 1;
+}
+
+static char const * unmap_uri(LV2_URID_Unmap_Handle handle, LV2_URID urid)
+{
+  priv_t * p = handle;
+  char const * uri;
+
+  omp_set_lock(&p->uris_lock);
+  uri = urid && urid <= p->num_uris? p->uris[urid - 1] : NULL;
+  omp_unset_lock(&p->uris_lock);
+  return uri;
+}
+
+static sox_bool is_a(priv_t const * p, LilvPort const * port, char const * uri)
+{
+  LilvNode * node = lilv_new_uri(p->world, uri);
+  sox_bool result = lilv_port_is_a(p->plugin, port, node);
+
+  lilv_node_free(node);
+  return result;
+}
+
+static sox_bool port_has(priv_t const * p, LilvPort const * port,
+    char const * uri)
+{
+  LilvNode * node = lilv_new_uri(p->world, uri);
+  sox_bool result = lilv_port_has_property(p->plugin, port, node);
+
+  lilv_node_free(node);
+  return result;
+}
+
+static sox_bool plugin_has(priv_t const * p, char const * uri)
+{
+  LilvNode * node = lilv_new_uri(p->world, uri);
+  sox_bool result = lilv_plugin_has_feature(p->plugin, node);
+
+  lilv_node_free(node);
+  return result;
+}
+
+static char const * port_symbol(priv_t const * p, uint32_t i)
+{
+  return lilv_node_as_string(lilv_port_get_symbol(p->plugin,
+        lilv_plugin_get_port_by_index(p->plugin, i)));
+}
+
+/*
+ * Process options
+ */
+static int getopts(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  LilvNode * uri;
+  float * min, * max, * def;
+  uint32_t i;
+  int c;
+  lsx_getopt_t optstate;
+  lsx_getopt_init(argc, argv, "+r", NULL, lsx_getopt_flag_none, 1, &optstate);
+
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    case 'r': p->clone = sox_true; break;
+    default: lsx_fail("unknown option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  if (argc < 1)
+    return lsx_usage(effp);
+
+  p->world = lilv_world_new();
+  lilv_world_load_all(p->world);
+  uri = lilv_new_uri(p->world, argv[0]);
+  if (uri)
+    p->plugin = lilv_plugins_get_by_uri(
+        lilv_world_get_all_plugins(p->world), uri);
+  lilv_node_free(uri);
+  if (!p->plugin) {
+    lsx_fail("no LV2 plugin <%s> found", argv[0]);
+    return SOX_EOF;
+  }
+  --argc, ++argv;
+
+  /* Sort the ports, and give the control inputs their default values */
+  p->num_ports = lilv_plugin_get_num_ports(p->plugin);
+  lsx_valloc(p->kinds, p->num_ports);
+  p->control = lsx_calloc(p->num_ports, sizeof(*p->control));
+  lsx_valloc(p->inputs, p->num_ports);
+  lsx_valloc(p->outputs, p->num_ports);
+  lsx_valloc(min, 3 * p->num_ports);
+  max = min + p->num_ports, def = max + p->num_ports;
+  lilv_plugin_get_port_ranges_float(p->plugin, min, max, def);
+  for (i = 0; i < p->num_ports; ++i) {
+    LilvPort const * port = lilv_plugin_get_port_by_index(p->plugin, i);
+    sox_bool input = is_a(p, port, LV2_CORE__InputPort);
+
+    if (is_a(p, port, LV2_CORE__AudioPort)) {
+      p->kinds[i] = input? port_audio_in : port_audio_out;
+      if (input)
+        p->inputs[p->input_count++] = i;
+      else p->outputs[p->output_count++] = i;
+    }
+    else if (is_a(p, port, LV2_CORE__ControlPort)) {
+      p->kinds[i] = input? port_control_in : port_control_out;
+      p->control[i] = def[i] == def[i]? def[i] : min[i] == min[i]? min[i] : 0;
+    }
+    else if (is_a(p, port, LV2_ATOM__AtomPort))
+      p->kinds[i] = input? port_atom_in : port_atom_out;
+    else if (port_has(p, port, LV2_CORE__connectionOptional))
+      p->kinds[i] = port_unused;
+    else {
+      lsx_fail("port `%s' is of a type that is not supported",
+          port_symbol(p, i));
+      free(min);
+      return SOX_EOF;
+    }
+  }
+  free(min);
+
+  /* Then the arguments: symbol=value, or else values in port order */
+  for (i = 0; argc; --argc, ++argv) {
+    char const * eq = strchr(*argv, '=');
+    char * end;
+    uint32_t j = i;
+    double d;
+
+    if (eq) {
+      for (j = 0; j < p->num_ports; ++j)
+        if (p->kinds[j] == port_control_in &&
+            strlen(port_symbol(p, j)) == (size_t)(eq - *argv) &&
+            !strncmp(*argv, port_symbol(p, j), (size_t)(eq - *argv)))
+          break;
+      if (j == p->num_ports) {
+        lsx_fail("no control port `%.*s'", (int)(eq - *argv), *argv);
+        return SOX_EOF;
+      }
+    }
+    else {
+      while (j < p->num_ports && p->kinds[j] != port_control_in)
+        ++j;
+      if (j == p->num_ports)
+        return lsx_usage(effp);
+      i = j + 1;
+    }
+    d = strtod(eq? eq + 1 : *argv, &end);
+    if (end == (eq? eq + 1 : *argv) || *end)
+      return lsx_usage(effp);
+    p->control[j] = (float)d;
+    lsx_debug("argument for port %u is %g", j, d);
+  }
+  return SOX_SUCCESS;
+}
+
+static sox_bool supported(LilvNode const * uri)
+{
+  static char const * const uris[] = {
+    LV2_URID__map, LV2_URID__unmap, LV2_OPTIONS__options,
+    LV2_BUF_SIZE__boundedBlockLength, LV2_BUF_SIZE__fixedBlockLength,
+    LV2_BUF_SIZE__powerOf2BlockLength, LV2_WORKER__schedule,
+    LV2_CORE__inPlaceBroken, LV2_BUF_SIZE__minBlockLength,
+    LV2_BUF_SIZE__maxBlockLength, LV2_BUF_SIZE__nominalBlockLength,
+    LV2_PARAMETERS__sampleRate};
+  size_t i;
+
+  for (i = 0; i < array_length(uris); ++i)
+    if (!strcmp(lilv_node_as_uri(uri), uris[i]))
+      return sox_true;
+  return sox_false;
+}
+
+/* Whether every feature or option in nodes is one supported; frees nodes */
+static sox_bool all_supported(LilvNodes * nodes)
+{
+  sox_bool result = sox_true;
+
+  LILV_FOREACH(nodes, i, nodes) {
+    LilvNode const * node = lilv_nodes_get(nodes, i);
+    if (!supported(node)) {
+      lsx_fail("plugin requires <%s>", lilv_node_as_uri(node));
+      result = sox_false;
+    }
+  }
+  lilv_nodes_free(nodes);
+  return result;
+}
+
+static int stop(sox_effect_t * effp);
+
+static void set_option(LV2_Options_Option * o, LV2_URID key, uint32_t size,
+    LV2_URID type, void const * value)
+{
+  o->context = LV2_OPTIONS_INSTANCE;
+  o->subject = 0;
+  o->key = key;
+  o->size = size;
+  o->type = type;
+  o->value = value;
+}
+
+static int flow_float(sox_effect_t * effp, float const * ibuf, float * obuf,
+    size_t * isamp, size_t * osamp);
+static int drain_float(sox_effect_t * effp, float * obuf, size_t * osamp);
+
+/*
+ * Prepare processing.
+ */
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned ichans = effp->in_signal.channels;
+  LilvNode * node;
+  LV2_Feature map_feature, unmap_feature, options_feature;
+  LV2_Feature bounded_feature, fixed_feature, pow2_feature, schedule_feature;
+  LV2_Feature const * features[8];
+  LV2_URID int_urid;
+  size_t i, h, n, atom_count = 0;
+  sox_bool ok, has_worker;
+
+  /* Check that the plugin requires nothing that we do not give */
+  node = lilv_new_uri(p->world, LV2_OPTIONS__requiredOption);
+  ok = all_supported(lilv_plugin_get_required_features(p->plugin)) &
+    all_supported(lilv_plugin_get_value(p->plugin, node));
+  lilv_node_free(node);
+  if (!ok)
+    return SOX_EOF;
+
+  /* As ladspa, clone the plugin with -r; else one instance takes all */
+  p->instance_count = 1;
+  if (p->input_count && p->input_count == p->output_count &&
+      ichans > p->input_count && ichans % p->input_count == 0 &&
+      ichans == effp->out_signal.channels) {
+    if (!p->clone) {
+      lsx_fail("expected %u input channel(s), found %u; consider using -r",
+               (unsigned)p->input_count, ichans);
+      return SOX_EOF;
+    }
+    p->instance_count = ichans / p->input_count;
+  }
+  else {
+    if (p->input_count < ichans) {
+      lsx_fail("fewer plugin input ports than input channels (%u < %u)",
+               (unsigned)p->input_count, ichans);
+      return SOX_EOF;
+    }
+    if (p->input_count > ichans)
+      lsx_warn("more plugin input ports than input channels (%u > %u)",
+               (unsigned)p->input_count, ichans);
+    if (p->output_count != effp->out_signal.channels) {
+      lsx_debug("changing output channels to match plugin output ports (%u => %u)",
+               effp->out_signal.channels, (unsigned)p->output_count);
+      effp->out_signal.channels = p->output_count;
+    }
+  }
+
+  /* Block length: that of the chain's buffer, and fixed (and a power of 2)
+   * only if the plugin insists */
+  p->block = effp->global_info->global_info->bufsiz /
+    max(ichans, effp->out_signal.channels);
+  p->fixed = plugin_has(p, LV2_BUF_SIZE__fixedBlockLength) ||
+    plugin_has(p, LV2_BUF_SIZE__powerOf2BlockLength);
+  if (plugin_has(p, LV2_BUF_SIZE__powerOf2BlockLength)) {
+    for (n = 1; n * 2 <= p->block; n *= 2);
+    p->block = n;
+  }
+  p->min_block = p->fixed? (int32_t)p->block : 1;
+  p->max_block = (int32_t)p->block;
+  p->rate = (float)effp->in_signal.rate;
+  lsx_effect_set_block(effp, p->block * ichans);
+
+  p->map.handle = p->unmap.handle = p;
+  p->map.map = map_uri;
+  p->unmap.unmap = unmap_uri;
+  p->uris = NULL;
+  p->num_uris = 0;
+  omp_init_lock(&p->uris_lock);
+  p->sequence = map_uri(p, LV2_ATOM__Sequence);
+  p->chunk = map_uri(p, LV2_ATOM__Chunk);
+  int_urid = map_uri(p, LV2_ATOM__Int);
+  set_option(&p->options[0], map_uri(p, LV2_BUF_SIZE__minBlockLength),
+      sizeof(int32_t), int_urid, &p->min_block);
+  set_option(&p->options[1], map_uri(p, LV2_BUF_SIZE__maxBlockLength),
+      sizeof(int32_t), int_urid, &p->max_block);
+  set_option(&p->options[2], map_uri(p, LV2_BUF_SIZE__nominalBlockLength),
+      sizeof(int32_t), int_urid, &p->max_block);
+  set_option(&p->options[3], map_uri(p, LV2_PARAMETERS__sampleRate),
+      sizeof(float), map_uri(p, LV2_ATOM__Float), &p->rate);
+  set_option(&p->options[4], 0, 0, 0, NULL);
+
+  map_feature.URI = LV2_URID__map, map_feature.data = &p->map;
+  unmap_feature.URI = LV2_URID__unmap, unmap_feature.data = &p->unmap;
+  options_feature.URI = LV2_OPTIONS__options;
+  options_feature.data = p->options;
+  bounded_feature.URI = LV2_BUF_SIZE__boundedBlockLength;
+  bounded_feature.data = NULL;
+  fixed_feature.URI = LV2_BUF_SIZE__fixedBlockLength;
+  fixed_feature.data = NULL;
+  pow2_feature.URI = LV2_BUF_SIZE__powerOf2BlockLength;
+  pow2_feature.data = NULL;
+  schedule_feature.URI = LV2_WORKER__schedule;
+  n = 0;
+  features[n++] = &map_feature;
+  features[n++] = &unmap_feature;
+  features[n++] = &options_feature;
+  features[n++] = &bounded_feature;
+  if (p->fixed) {
+    features[n++] = &fixed_feature;
+    if (!(p->block & (p->block - 1)))
+      features[n++] = &pow2_feature;
+  }
+  node = lilv_new_uri(p->world, LV2_WORKER__interface);
+  has_worker = plugin_has(p, LV2_WORKER__schedule) ||
+    lilv_plugin_has_extension_data(p->plugin, node);
+  lilv_node_free(node);
+  if (has_worker)
+    features[n++] = &schedule_feature;
+  features[n] = NULL;
+
+  /* Instantiate the plugin, with a worker for each instance */
+  lsx_Calloc(p->instances, p->instance_count);
+  if (has_worker)
+    lsx_Calloc(p->workers, p->instance_count);
+  for (h = 0; h < p->instance_count; ++h) {
+    worker_t * w = has_worker? &p->workers[h] : NULL;
+    if (w) {
+      w->schedule.handle = w;
+      w->schedule.schedule_work = schedule_work;
+      schedule_feature.data = &w->schedule;
+    }
+    p->instances[h] = lilv_plugin_instantiate(p->plugin, effp->in_signal.rate,
+        features);
+    if (!p->instances[h]) {
+      lsx_fail("could not instantiate plugin");
+      p->instance_count = h;
+      stop(effp);
+      return SOX_EOF;
+    }
+    if (w) {
+      w->iface = lilv_instance_get_extension_data(p->instances[h],
+          LV2_WORKER__interface);
+      if (w->iface) {
+        w->handle = lilv_instance_get_handle(p->instances[h]);
+        queue_create(&w->requests);
+        queue_create(&w->responses);
+        lsx_revalloc(workers, num_workers + 1);
+        workers[num_workers++] = w;
+      }
+    }
+  }
+
+  /* The audio ports' buffers: a block for each; the outputs may use the
+   * inputs' unless the plugin says otherwise, or an input is unused */
+  p->inplace = !plugin_has(p, LV2_CORE__inPlaceBroken) &&
+    p->input_count == p->output_count &&
+    p->input_count * p->instance_count == ichans;
+  n = p->instance_count * (p->input_count + (p->inplace? 0 : p->output_count));
+  p->buf = lsx_calloc(n * p->block, sizeof(*p->buf));
+  lsx_valloc(p->in, p->instance_count * p->input_count);
+  lsx_valloc(p->out, p->instance_count * p->output_count);
+  for (i = 0; i < p->instance_count * p->input_count; ++i)
+    p->in[i] = p->buf + i * p->block;
+  for (i = 0; i < p->instance_count * p->output_count; ++i)
+    p->out[i] = p->inplace? p->in[i] :
+      p->buf + (p->instance_count * p->input_count + i) * p->block;
+  p->fill = p->out_pos = p->out_len = 0;
+  effp->flow_float = flow_float;
+  effp->drain_float = drain_float;
+
+  for (i = 0; i < p->num_ports; ++i)
+    atom_count += p->kinds[i] == port_atom_in || p->kinds[i] == port_atom_out;
+  p->atoms = lsx_calloc(atom_count * p->instance_count, ATOM_SIZE);
+
+  /* Connect the ports, which stay so */
+  for (h = 0, n = 0; h < p->instance_count; ++h) {
+    for (i = 0; i < p->num_ports; ++i) {
+      void * data = NULL;
+      switch (p->kinds[i]) {
+        case port_control_in: case port_control_out:
+          data = &p->control[i]; break;
+        case port_atom_in: case port_atom_out:
+          data = p->atoms + n++ * ATOM_SIZE; break;
+        default: break;
+      }
+      lilv_instance_connect_port(p->instances[h], (uint32_t)i, data);
+    }
+    for (i = 0; i < p->input_count; ++i)
+      lilv_instance_connect_port(p->instances[h], p->inputs[i],
+          p->in[h * p->input_count + i]);
+    for (i = 0; i < p->output_count; ++i)
+      lilv_instance_connect_port(p->instances[h], p->outputs[i],
+          p->out[h * p->output_count + i]);
+    lilv_instance_activate(p->instances[h]);
+  }
+  return SOX_SUCCESS;
+}
+
+/* Run each instance over the block in the input buffers, to the output
+ * buffers, with its atom ports reset, and any work responses delivered */
+/* Hands a plugin the worker's responses so far */
+static void deliver(worker_t * w)
+{
+  uint32_t size;
+
+  while (queue_get(&w->responses, &size))
+    w->iface->work_response(w->handle, size, w->responses.get);
+}
+
+static void run(priv_t * p, size_t len)
+{
+  size_t h, i, n = 0;
+
+  for (h = 0; h < p->instance_count; ++h) {
+    worker_t * w = p->workers && p->workers[h].iface? &p->workers[h] : NULL;
+
+    for (i = 0; i < p->num_ports; ++i) {
+      LV2_Atom_Sequence * seq = (LV2_Atom_Sequence *)(p->atoms + n * ATOM_SIZE);
+      if (p->kinds[i] == port_atom_in) {
+        seq->atom.size = sizeof(LV2_Atom_Sequence_Body);
+        seq->atom.type = p->sequence;
+        seq->body.unit = seq->body.pad = 0;
+        ++n;
+      }
+      else if (p->kinds[i] == port_atom_out) {
+        seq->atom.size = ATOM_SIZE - sizeof(LV2_Atom);
+        seq->atom.type = p->chunk;
+        ++n;
+      }
+    }
+    lilv_instance_run(p->instances[h], (uint32_t)len);
+    if (w) {
+      deliver(w);
+      if (w->iface->end_run)
+        w->iface->end_run(w->handle);
+    }
+  }
+}
+
+/*
+ * Process from ibuf (sox_sample_t or, with is_float, float samples,
+ * interleaved or planar as the chain has set) to obuf.  Input is taken
+ * only once any output held from the last run has been given; for a fixed
+ * block length, it is held until a block is full, else it is run at once.
+ */
+static void process(sox_effect_t * effp, void const * ibuf, void * obuf,
+    size_t * ilen, size_t * olen, sox_bool is_float)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t ichans = effp->in_signal.channels, ochans = effp->out_signal.channels;
+  size_t istep = ichans, istride = 1, ostep = ochans, ostride = 1;
+  size_t idone = 0, odone = 0, c, i, n;
+
+  if (effp->planar) { /* Each channel's samples are in a buffer of its own */
+    istep = ostep = 1;
+    istride = lsx_iplane_size(effp);
+    ostride = lsx_oplane_size(effp);
+  }
+  /* Sample k of channel c is at buf[c * stride + k * step] */
+
+  for (;;) {
+    n = min(p->out_len - p->out_pos, *olen - odone);
+    for (c = 0; c < ochans; ++c) {
+      float const * s = p->out[c] + p->out_pos;
+      if (is_float) {
+        float * d = (float *)obuf + c * ostride + odone * ostep;
+        for (i = 0; i < n; ++i)
+          d[i * ostep] = s[i];
+      }
+      else lsx_float_to_samples((sox_sample_t *)obuf + c * ostride +
+          odone * ostep, ostep, s, n, &effp->clips);
+    }
+    p->out_pos += n, odone += n;
+    if (p->out_pos < p->out_len || idone == *ilen)
+      break;
+
+    n = min(p->block - p->fill, *ilen - idone);
+    for (c = 0; c < ichans; ++c) {
+      float * d = p->in[c] + p->fill;
+      if (is_float) {
+        float const * s = (float const *)ibuf + c * istride + idone * istep;
+        for (i = 0; i < n; ++i)
+          d[i] = s[i * istep];
+      }
+      else lsx_samples_to_float(d, (sox_sample_t const *)ibuf +
+          c * istride + idone * istep, istep, n, &effp->clips);
+    }
+    p->fill += n, idone += n;
+    if (p->fill == p->block || !p->fixed) {
+      run(p, p->fill);
+      p->out_len = p->fill;
+      p->out_pos = p->fill = 0;
+    }
+  }
+  *ilen = idone, *olen = odone;
+}
+
+static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  size_t ilen = *isamp / effp->in_signal.channels;
+  size_t olen = *osamp / effp->out_signal.channels;
+
+  process(effp, ibuf, obuf, &ilen, &olen, sox_false);
+  *isamp = ilen * effp->in_signal.channels;
+  *osamp = olen * effp->out_signal.channels;
+  return SOX_SUCCESS;
+}
+
+static int flow_float(sox_effect_t * effp, float const * ibuf, float * obuf,
+    size_t * isamp, size_t * osamp)
+{
+  size_t ilen = *isamp / effp->in_signal.channels;
+  size_t olen = *osamp / effp->out_signal.channels;
+
+  process(effp, ibuf, obuf, &ilen, &olen, sox_true);
+  *isamp = ilen * effp->in_signal.channels;
+  *osamp = olen * effp->out_signal.channels;
+  return SOX_SUCCESS;
+}
+
+/*
+ * Run any partial block, padded out with silence, and give what is held
+ */
+static int drain_any(sox_effect_t * effp, void * obuf, size_t * osamp,
+    sox_bool is_float)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t ilen = 0, olen = *osamp / effp->out_signal.channels, c;
+
+  if (p->fill && p->out_pos == p->out_len) {
+    for (c = 0; c < effp->in_signal.channels; ++c)
+      memset(p->in[c] + p->fill, 0, (p->block - p->fill) * sizeof(float));
+    run(p, p->block);
+    p->out_len = p->fill;
+    p->out_pos = p->fill = 0;
+  }
+  process(effp, NULL, obuf, &ilen, &olen, is_float);
+  *osamp = olen * effp->out_signal.channels;
+  return p->fill || p->out_pos < p->out_len? SOX_SUCCESS : SOX_EOF;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  return drain_any(effp, obuf, osamp, sox_false);
+}
+
+static int drain_float(sox_effect_t * effp, float * obuf, size_t * osamp)
+{
+  return drain_any(effp, obuf, osamp, sox_true);
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t h, i, j;
+
+  for (h = 0; h < p->instance_count; ++h) {
+    if (p->workers && p->workers[h].iface) /* The work is all done by now */
+      deliver(&p->workers[h]);
+    lilv_instance_deactivate(p->instances[h]);
+    lilv_instance_free(p->instances[h]);
+  }
+  for (h = 0; p->workers && h < p->instance_count; ++h) {
+    worker_t * w = &p->workers[h];
+    if (!w->iface)
+      continue;
+    for (i = j = 0; i < num_workers; ++i)
+      if (workers[i] != w)
+        workers[j++] = workers[i];
+    num_workers = j;
+    queue_delete(&w->requests);
+    queue_delete(&w->responses);
+  }
+  if (!num_workers) {
+    free(workers);
+    workers = NULL;
+  }
+  free(p->workers);
+  free(p->instances);
+  free(p->atoms);
+  free(p->buf);
+  free(p->in);
+  free(p->out);
+  for (i = 0; i < p->num_uris; ++i)
+    free(p->uris[i]);
+  free(p->uris);
+  omp_destroy_lock(&p->uris_lock);
+  p->workers = NULL;
+  p->instances = NULL;
+  p->atoms = NULL;
+  p->buf = NULL;
+  p->in = p->out = NULL;
+  p->instance_count = 0;
+  return SOX_SUCCESS;
+}
+
+static int lsx_kill(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  free(p->kinds);
+  free(p->control);
+  free(p->inputs);
+  free(p->outputs);
+  if (p->world)
+    lilv_world_free(p->world);
+  return SOX_SUCCESS;
+}
+
+sox_effect_handler_t const * lsx_lv2_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "lv2", "[-r] URI [ARGUMENT|SYMBOL=ARGUMENT...]",
+    SOX_EFF_MCHAN | SOX_EFF_CHAN | SOX_EFF_GAIN | SOX_EFF_PLANAR,
+    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+#else
+
+size_t lsx_lv2_work_pending(void)
+{
+  return 0;
+}
+
+void lsx_lv2_work_serve(size_t * stop)
+{
+  (void)stop;
+}
+
+#endif /* HAVE_LILV_H */
@@ -338,7 +338,7 @@ LSX_FORMAT_HANDLER(maud)
     names, SOX_FILE_BIG_END | SOX_FILE_MONO | SOX_FILE_STEREO,
     startread, lsx_rawread, lsx_rawstopread,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -64,11 +64,15 @@ typedef struct {
   size_t delay_size;    /* lookahead for this band (in samples) - function of delay, above */
   ptrdiff_t delay_buf_ptr; /* Index into delay_buf */
   size_t delay_buf_cnt; /* No. of active entries in delay_buf */
+  sox_sample_t *split;  /* This band's part of the input to flow */
+  sox_sample_t *out;    /* ... and its companded output */
+  sox_uint64_t clips;   /* Counted apart, as bands are companded in parallel */
 } comp_band_t;
 
 typedef struct {
   size_t nBands;
-  sox_sample_t *band_buf1, *band_buf2, *band_buf3;
+  sox_sample_t *band_buf1, *band_buf2; /* Input yet to be split into bands */
+  sox_sample_t *band_bufs;             /* Each band's split & out */
   size_t band_buf_len;
   size_t delay_buf_size;/* Size of delay_buf in samples */
   comp_band_t *bands;
@@ -170,7 +174,7 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   priv_t * c = (priv_t *) effp->priv;
   --argc, ++argv;
 
-  c->band_buf1 = c->band_buf2 = c->band_buf3 = 0;
+  c->band_buf1 = c->band_buf2 = c->band_bufs = 0;
   c->band_buf_len = 0;
 
   /* how many bands? */
@@ -225,6 +229,7 @@ static int start(sox_effect_t * effp)
     l->delay_size = c->bands[band].delay * effp->out_signal.rate * effp->out_signal.channels;
     if (l->delay_size > c->delay_buf_size)
       c->delay_buf_size = l->delay_size;
+    effp->latency = max(effp->latency, l->delay);
   }
 
   for (band=0;band<c->nBands;++band) {
@@ -272,7 +277,7 @@ static void doVolume(double *v, double samp, comp_band_t * l, size_t chan)
     *v += delta * l->decayRate[chan];
 }
 
-static int sox_mcompand_flow_1(sox_effect_t * effp, priv_t * c, comp_band_t * l, const sox_sample_t *ibuf, sox_sample_t *obuf, size_t len, size_t filechans)
+static int sox_mcompand_flow_1(priv_t * c, comp_band_t * l, const sox_sample_t *ibuf, sox_sample_t *obuf, size_t len, size_t filechans)
 {
   size_t idone, odone;
 
@@ -304,7 +309,7 @@ static int sox_mcompand_flow_1(sox_effect_t * effp, priv_t * c, comp_band_t * l,
 
       if (c->delay_buf_size <= 0) {
         checkbuf = ibuf[chan] * level_out_lin;
-        SOX_SAMPLE_CLIP_COUNT(checkbuf, effp->clips);
+        SOX_SAMPLE_CLIP_COUNT(checkbuf, l->clips);
         obuf[odone++] = checkbuf;
         idone++;
       } else {
@@ -323,7 +328,7 @@ static int sox_mcompand_flow_1(sox_effect_t * effp, priv_t * c, comp_band_t * l,
 
         if (l->delay_buf_cnt >= l->delay_size) {
           checkbuf = l->delay_buf[(l->delay_buf_ptr + c->delay_buf_size - l->delay_size)%c->delay_buf_size] * level_out_lin;
-          SOX_SAMPLE_CLIP_COUNT(checkbuf, effp->clips);
+          SOX_SAMPLE_CLIP_COUNT(checkbuf, l->clips);
           l->delay_buf[(l->delay_buf_ptr + c->delay_buf_size - l->delay_size)%c->delay_buf_size] = checkbuf;
         }
         if (l->delay_buf_cnt >= c->delay_buf_size) {
@@ -362,52 +367,60 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
   priv_t * c = (priv_t *) effp->priv;
   comp_band_t * l;
   size_t len = min(*isamp, *osamp);
-  size_t band, i;
-  sox_sample_t *abuf, *bbuf, *cbuf, *oldabuf, *ibuf_copy;
+  size_t i, threads;
+  int band;
+  sox_sample_t *abuf, *bbuf;
   double out;
 
   if (c->band_buf_len < len) {
     c->band_buf1 = lsx_realloc(c->band_buf1,len*sizeof(sox_sample_t));
     c->band_buf2 = lsx_realloc(c->band_buf2,len*sizeof(sox_sample_t));
-    c->band_buf3 = lsx_realloc(c->band_buf3,len*sizeof(sox_sample_t));
+    c->band_bufs = lsx_realloc(c->band_bufs,2*c->nBands*len*sizeof(sox_sample_t));
     c->band_buf_len = len;
   }
 
   len -= len % effp->out_signal.channels;
 
-  ibuf_copy = lsx_malloc(*isamp * sizeof(sox_sample_t));
-  memcpy(ibuf_copy, ibuf, *isamp * sizeof(sox_sample_t));
+  /* split ibuf into bands using filters (each taking the previous one's upper
+   * part), pipe each band through sox_mcompand_flow_1 (these in parallel),
+   * then add back together and write to obuf */
 
-  /* split ibuf into bands using filters, pipe each band through sox_mcompand_flow_1, then add back together and write to obuf */
+  memcpy(c->band_buf1, ibuf, len * sizeof(sox_sample_t));
+  for (band=0,abuf=c->band_buf1,bbuf=c->band_buf2;band<(int)c->nBands;++band) {
+    l = &c->bands[band];
+    l->out = c->band_bufs + 2 * band * len;
+    if (l->topfreq) {
+      l->split = l->out + len;
+      crossover_flow(effp, &l->filter, abuf, l->split, bbuf, len);
+      abuf = bbuf;
+      bbuf = abuf == c->band_buf1? c->band_buf2 : c->band_buf1;
+    }
+    else l->split = abuf;
+  }
+
+  threads = lsx_effect_threads(effp, c->nBands);
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+  for (band=0;band<(int)c->nBands;++band) {
+    comp_band_t * b = &c->bands[band];
+    (void)sox_mcompand_flow_1(c,b,b->split,b->out,len, (size_t)effp->out_signal.channels);
+  }
+  lsx_threads_give(effp->global_info->global_info, threads);
 
   memset(obuf,0,len * sizeof *obuf);
-  for (band=0,abuf=ibuf_copy,bbuf=c->band_buf2,cbuf=c->band_buf1;band<c->nBands;++band) {
+  for (band=0;band<(int)c->nBands;++band) {
     l = &c->bands[band];
-
-    if (l->topfreq)
-      crossover_flow(effp, &l->filter, abuf, bbuf, cbuf, len);
-    else {
-      bbuf = abuf;
-      abuf = cbuf;
-    }
-    if (abuf == ibuf_copy)
-      abuf = c->band_buf3;
-    (void)sox_mcompand_flow_1(effp, c,l,bbuf,abuf,len, (size_t)effp->out_signal.channels);
+    effp->clips += l->clips;
+    l->clips = 0;
     for (i=0;i<len;++i)
     {
-      out = (double)obuf[i] + (double)abuf[i];
+      out = (double)obuf[i] + (double)l->out[i];
       SOX_SAMPLE_CLIP_COUNT(out, effp->clips);
       obuf[i] = out;
     }
-    oldabuf = abuf;
-    abuf = cbuf;
-    cbuf = oldabuf;
   }
 
   *isamp = *osamp = len;
 
-  free(ibuf_copy);
-
   return SOX_SUCCESS;
 }
 
@@ -472,8 +485,9 @@ static int stop(sox_effect_t * effp)
   c->band_buf1 = NULL;
   free(c->band_buf2);
   c->band_buf2 = NULL;
-  free(c->band_buf3);
-  c->band_buf3 = NULL;
+  free(c->band_bufs);
+  c->band_bufs = NULL;
+  c->band_buf_len = 0;
 
   for (band = 0; band < c->nBands; band++) {
     l = &c->bands[band];
@@ -517,7 +531,8 @@ const sox_effect_handler_t *lsx_mcompand_effect_fn(void)
     "                 in-dB1,out-dB1[,in-dB2,out-dB2...]\n"
     "                [ gain [ initial-volume [ delay ] ] ]",
     SOX_EFF_MCHAN | SOX_EFF_GAIN,
-    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
 
   return &handler;
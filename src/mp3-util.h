@@ -178,7 +178,10 @@ static int add_tag(struct tag_info * info)
   return result;
 }
 
-static void read_comments(sox_format_t * ft)
+/* Reads the tags for comments, or (!comments) just the one at the start (so
+ * without seeking to the end) for its TLEN; with length, TLEN gives
+ * ft->signal.length, in ms. */
+static void read_comments(sox_format_t * ft, sox_bool comments, sox_bool length)
 {
   struct tag_info   info;
   id3_utf8_t        * utf8;
@@ -196,7 +199,7 @@ static void read_comments(sox_format_t * ft)
   ID3v2 at end (but before ID3v1 from end if there was one).
   */
 
-  if (0 == lsx_seeki(ft, -128, SEEK_END)) {
+  if (comments && 0 == lsx_seeki(ft, -128, SEEK_END)) {
     has_id3v1 =
       add_tag(&info) &&
       1 == ID3_TAG_VERSION_MAJOR(id3_tag_version(info.tag));
@@ -204,11 +207,11 @@ static void read_comments(sox_format_t * ft)
   if (0 == lsx_seeki(ft, 0, SEEK_SET)) {
     add_tag(&info);
   }
-  if (0 == lsx_seeki(ft, has_id3v1 ? -138 : -10, SEEK_END)) {
+  if (comments && 0 == lsx_seeki(ft, has_id3v1 ? -138 : -10, SEEK_END)) {
     add_tag(&info);
   }
   if (info.tag && info.tag->frames) {
-    for (i = 0; id3tagmap[i][0]; ++i) {
+    for (i = 0; comments && id3tagmap[i][0]; ++i) {
       if ((utf8 = utf8_id3tag_findframe(info.tag, id3tagmap[i][0], 0))) {
         char * comment = lsx_malloc(strlen(id3tagmap[i][1]) + 1 + strlen((char *)utf8) + 1);
         sprintf(comment, "%s=%s", id3tagmap[i][1], utf8);
@@ -217,7 +220,7 @@ static void read_comments(sox_format_t * ft)
         free(utf8);
       }
     }
-    if ((utf8 = utf8_id3tag_findframe(info.tag, "TLEN", 0))) {
+    if (length && (utf8 = utf8_id3tag_findframe(info.tag, "TLEN", 0))) {
       unsigned long tlen = strtoul((char *)utf8, NULL, 10);
       if (tlen > 0 && tlen < ULONG_MAX) {
         ft->signal.length= tlen; /* In ms; convert to samples later */
@@ -331,10 +334,12 @@ static size_t mp3_duration_ms(sox_format_t * ft)
       }
       else vbr |= mad_header.bitrate != initial_bitrate;
 
-      /* If not VBR, we can time just a few frames then extrapolate */
-      if (++frames == 25 && !vbr) {
+      /* If not VBR (or just probing), we can time just a few frames then
+       * extrapolate */
+      if (++frames == 25 && (!vbr || ft->probe)) {
         mad_timer_mult(&time, (double)(lsx_filelength(ft) - tagsize) / consumed);
-        lsx_debug("got approx. duration by CBR extrapolation");
+        ft->length_estimated = sox_true;
+        lsx_debug("got approx. duration by %s extrapolation", vbr? "VBR" : "CBR");
         break;
       }
     }
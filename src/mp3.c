@@ -225,6 +225,9 @@ typedef struct mp3_priv_t {
   mad_timer_t             Timer;
   ptrdiff_t               cursamp;
   size_t                  FrameCount;
+  double const            * index;      /* Byte offset of each frame */
+  int                     index_len, index_spf; /* spf: samples per frame */
+  sox_bool                index_failed;
   LSX_DLENTRIES_TO_PTRS(MAD_FUNC_ENTRIES, mad_dl);
 #endif /*HAVE_MAD_H*/
 
@@ -361,6 +364,17 @@ static int sox_mp3_inputtag(sox_format_t * ft)
     return rc;
 }
 
+#ifdef USING_ID3TAG
+/* The tags at the end of the file, left by startread (see defer_comments) */
+static int read_deferred_comments(sox_format_t * ft)
+{
+  off_t at = lsx_tell(ft);
+
+  read_comments(ft, sox_true, sox_false);
+  return lsx_seeki(ft, at, SEEK_SET);
+}
+#endif
+
 static int startread(sox_format_t * ft)
 {
   priv_t *p = (priv_t *) ft->priv;
@@ -378,13 +392,16 @@ static int startread(sox_format_t * ft)
   if (open_library_result)
     return SOX_EOF;
 
-  p->mp3_buffer_size = sox_globals.bufsiz;
+  p->mp3_buffer_size = ft->context->bufsiz;
   p->mp3_buffer = lsx_malloc(p->mp3_buffer_size);
 
   ft->signal.length = SOX_UNSPEC;
   if (ft->seekable) {
 #ifdef USING_ID3TAG
-    read_comments(ft);
+    sox_bool defer = ft->context->defer_comments;
+    read_comments(ft, !defer, sox_true);
+    if (defer)
+      ft->read_comments = read_deferred_comments;
     lsx_rewind(ft);
     if (!ft->signal.length)
 #endif
@@ -554,10 +571,172 @@ static int stopread(sox_format_t * ft)
   p->mad_stream_finish(&p->Stream);
 
   free(p->mp3_buffer);
+  if (p->index)
+    lsx_design_release(p->index);
   LSX_DLLIBRARY_CLOSE(p, mad_dl);
   return SOX_SUCCESS;
 }
 
+/* Returns the byte offsets of all the frames in the file (which must all
+ * hold the same number of samples), found by scanning their headers. */
+static double * scan_frames(sox_format_t * ft, int * len, int * spf)
+{
+  priv_t            * p = (priv_t *) ft->priv;
+  struct mad_stream stream;
+  struct mad_header header;
+  double            * offsets = NULL;
+  size_t            n = 0, alloc = 0;
+  sox_bool          depadded = sox_false, ok = sox_true;
+
+  p->mad_stream_init(&stream);
+  p->mad_header_init(&header);
+  *spf = 0;
+  lsx_rewind(ft);
+
+  do {  /* Read data from the MP3 file */
+    size_t leftover = stream.bufend - stream.next_frame, padding = 0, read;
+    off_t base = lsx_tell(ft) - (off_t)leftover; /* Offset of mp3_buffer */
+
+    if (leftover)
+      memmove(p->mp3_buffer, stream.next_frame, leftover);
+    read = lsx_readbuf(ft, p->mp3_buffer + leftover, p->mp3_buffer_size - leftover);
+    if (read == 0)
+      break;
+    for (; !depadded && padding < read && !p->mp3_buffer[padding]; ++padding);
+    depadded = sox_true;
+    p->mad_stream_buffer(&stream, p->mp3_buffer + padding, leftover + read - padding);
+
+    while (ok) {  /* Decode frame headers */
+      stream.error = MAD_ERROR_NONE;
+      if (p->mad_header_decode(&header, &stream) == -1) {
+        if (stream.error == MAD_ERROR_BUFLEN)
+          break;  /* Normal behaviour; get some more data from the file */
+        if (!MAD_RECOVERABLE(stream.error))
+          ok = sox_false;
+        else if (stream.error == MAD_ERROR_LOSTSYNC) {
+          size_t available = stream.bufend - stream.this_frame;
+          size_t tagsize = tagtype(stream.this_frame, available);
+          if (tagsize) {   /* It's some ID3 tags, so just skip */
+            if (tagsize >= available) {
+              lsx_seeki(ft, (off_t)(tagsize - available), SEEK_CUR);
+              depadded = sox_false;
+            }
+            p->mad_stream_skip(&stream, min(tagsize, available));
+          }
+        }
+        continue; /* Not an audio frame */
+      }
+      if (!*spf)
+        *spf = 32 * MAD_NSBSAMPLES(&header);
+      else if (*spf != 32 * (int)MAD_NSBSAMPLES(&header)) {
+        lsx_debug("frames vary in length; not indexing");
+        ok = sox_false;
+        break;
+      }
+      if (n == alloc)
+        offsets = lsx_realloc(offsets, (alloc = max(alloc * 2, 4096)) * sizeof(*offsets));
+      offsets[n++] = (double)(base + (stream.this_frame - p->mp3_buffer));
+    }
+  } while (ok && stream.error == MAD_ERROR_BUFLEN);
+
+  mad_header_finish(&header);
+  p->mad_stream_finish(&stream);
+  if (!ok || !n || n > INT_MAX) {
+    free(offsets);
+    return NULL;
+  }
+  lsx_debug("indexed %" PRIuPTR " frames", n);
+  *len = (int)n;
+  return offsets;
+}
+
+/* Gets the file's frame index from the design cache (and so from the
+ * --design-cache directory, if any), scanning the file to make it if
+ * need be.  It is keyed on the file's identity, size and time-stamps. */
+static sox_bool get_index(sox_format_t * ft)
+{
+  priv_t      * p = (priv_t *) ft->priv;
+  struct stat st;
+  double      params[7], * offsets;
+  int         len, spf;
+
+  if (p->index || p->index_failed)
+    return p->index != NULL;
+  p->index_failed = sox_true;
+  if (ft->io_type != lsx_io_file || fstat(fileno((FILE*)ft->fp), &st))
+    return sox_false;
+  params[0] = (double)st.st_dev;
+  params[1] = (double)st.st_ino;
+  params[2] = (double)st.st_size;
+  params[3] = (double)st.st_mtime;
+  params[4] = (double)ST_MTIME_NSEC(st);
+  params[5] = (double)st.st_ctime;
+  params[6] = (double)ST_CTIME_NSEC(st);
+  if (!(p->index = lsx_design_get("mp3 index", params, 7, &len, &spf))) {
+    if (!(offsets = scan_frames(ft, &len, &spf)))
+      return sox_false;
+    p->index = lsx_design_put("mp3 index", params, 7, offsets, len, spf);
+  }
+  p->index_len = len;
+  p->index_spf = spf;
+  p->index_failed = sox_false;
+  return sox_true;
+}
+
+#define RESERVOIR_MAX 1024 /* Bytes: main data may start in earlier frames */
+
+/* Seeks by the frame index, decoding from far enough before the frame
+ * wanted for its bit reservoir and the synthesis filter to be primed. */
+static int index_seek(sox_format_t * ft, uint64_t offset)
+{
+  priv_t * p = (priv_t *) ft->priv;
+  size_t frame, start;
+
+  if (!get_index(ft))
+    return SOX_EOF;
+  offset /= ft->signal.channels;
+  if ((frame = offset / p->index_spf) >= (size_t)p->index_len)
+    return SOX_EOF;
+  for (start = frame; start && (frame - start < 2 ||
+      p->index[frame] - p->index[start] < RESERVOIR_MAX); --start);
+  if (lsx_seeki(ft, (off_t)p->index[start], SEEK_SET) != SOX_SUCCESS)
+    return SOX_EOF;
+
+  mad_synth_finish(&p->Synth);
+  p->mad_frame_finish(&p->Frame);
+  p->mad_stream_finish(&p->Stream);
+  p->mad_stream_init(&p->Stream);
+  p->mad_frame_init(&p->Frame);
+  p->mad_synth_init(&p->Synth);
+  p->FrameCount = start;
+  p->Stream.error = MAD_ERROR_BUFLEN;
+
+  while (p->FrameCount <= frame) {
+    if (p->Stream.error == MAD_ERROR_BUFLEN && sox_mp3_input(ft) == SOX_EOF)
+      return SOX_EOF;
+    if (p->mad_frame_decode(&p->Frame, &p->Stream)) {
+      if (p->Stream.error == MAD_ERROR_BUFLEN)
+        continue;
+      if (p->Stream.error == MAD_ERROR_LOSTSYNC) {
+        sox_mp3_inputtag(ft);
+        continue;
+      }
+      /* Expected whilst priming (e.g. a bad data pointer), but not after */
+      if (!MAD_RECOVERABLE(p->Stream.error) || p->FrameCount == frame)
+        return SOX_EOF;
+      ++p->FrameCount;
+      continue;
+    }
+    ++p->FrameCount;
+    p->mad_synth_frame(&p->Synth, &p->Frame);
+  }
+  mad_timer_reset(&p->Timer);
+  p->mad_timer_add(&p->Timer, p->Frame.header.duration);
+  p->mad_timer_multiply(&p->Timer, (signed long)p->FrameCount);
+  p->cursamp = offset - frame * p->index_spf;
+  return SOX_SUCCESS;
+}
+
 static int sox_mp3seek(sox_format_t * ft, uint64_t offset)
 {
   priv_t   * p = (priv_t *) ft->priv;
@@ -567,6 +746,9 @@ static int sox_mp3seek(sox_format_t * ft, uint64_t offset)
   sox_bool depadded = sox_false;
   uint64_t to_skip_samples = 0;
 
+  if (index_seek(ft, offset) == SOX_SUCCESS)
+    return SOX_SUCCESS;
+
   /* Reset all */
   lsx_rewind(ft);
   mad_timer_reset(&p->Timer);
@@ -600,7 +782,7 @@ static int sox_mp3seek(sox_format_t * ft, uint64_t offset)
     p->mad_stream_buffer(&p->Stream, p->mp3_buffer + padding, leftover + read - padding);
 
     while (sox_true) {  /* Decode frame headers */
-      static unsigned short samples;
+      unsigned samples;
       p->Stream.error = MAD_ERROR_NONE;
 
       /* Not an audio frame */
@@ -679,25 +861,22 @@ static int startread(sox_format_t * ft)
 
 static void errorf(const char* fmt, va_list va)
 {
-  sox_globals.subsystem=__FILE__;
   if (sox_globals.output_message_handler)
-    (*sox_globals.output_message_handler)(1,sox_globals.subsystem,fmt,va);
+    (*sox_globals.output_message_handler)(1,__FILE__,fmt,va);
   return;
 }
 
 static void debugf(const char* fmt, va_list va)
 {
-  sox_globals.subsystem=__FILE__;
   if (sox_globals.output_message_handler)
-    (*sox_globals.output_message_handler)(4,sox_globals.subsystem,fmt,va);
+    (*sox_globals.output_message_handler)(4,__FILE__,fmt,va);
   return;
 }
 
 static void msgf(const char* fmt, va_list va)
 {
-  sox_globals.subsystem=__FILE__;
   if (sox_globals.output_message_handler)
-    (*sox_globals.output_message_handler)(3,sox_globals.subsystem,fmt,va);
+    (*sox_globals.output_message_handler)(3,__FILE__,fmt,va);
   return;
 }
 
@@ -922,10 +1101,10 @@ static int startwrite(sox_format_t * ft)
   if (openlibrary_result)
     return SOX_EOF;
 
-  p->mp3_buffer_size = LAME_BUFFER_SIZE(sox_globals.bufsiz / max(ft->signal.channels, 1));
+  p->mp3_buffer_size = LAME_BUFFER_SIZE(ft->context->bufsiz / max(ft->signal.channels, 1));
   p->mp3_buffer = lsx_malloc(p->mp3_buffer_size);
 
-  p->pcm_buffer_size = sox_globals.bufsiz * sizeof(float);
+  p->pcm_buffer_size = ft->context->bufsiz * sizeof(float);
   p->pcm_buffer = lsx_malloc(p->pcm_buffer_size);
 
   if (p->mp2) {
@@ -1115,6 +1294,9 @@ static int startwrite(sox_format_t * ft)
 
   if (!p->mp2) {
 #ifdef HAVE_LAME
+    /* The tag (Info, if CBR) gives the encoder delay and padding */
+    if (sox_globals.gapless && ft->seekable)
+      p->vbr_tag = 1;
     p->lame_set_bWriteVbrTag(p->gfp, p->vbr_tag);
 #endif
   }
@@ -1292,7 +1474,8 @@ LSX_FORMAT_HANDLER(mp3)
     "MPEG Layer 2/3 lossy audio compression", names, 0,
     startread, sox_mp3read, stopread,
     startwrite, sox_mp3write, stopwrite,
-    sox_mp3seek, write_encodings, write_rates, sizeof(priv_t)
+    sox_mp3seek, write_encodings, write_rates, sizeof(priv_t), NULL, NULL,
+    NULL, NULL
   };
   return &handler;
 }
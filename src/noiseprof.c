@@ -24,21 +24,70 @@
 #include <string.h>
 #include <errno.h>
 
-typedef struct {
-    float *sum;
-    int   *profilecount;
-
-    float *window;
-} chandata_t;
+/* For SET_BINARY_MODE: */
+#include <fcntl.h>
+#ifdef HAVE_IO_H
+  #include <io.h>
+#endif
 
 typedef struct {
     char* output_filename;
     FILE* output_file;
+    sox_bool binary;
 
-    chandata_t *chandata;
+    noise_stats_t *chandata;
     size_t bufdata;
+
+    uint64_t pos;       /* Wide samples seen, in or out of the span */
+    size_t start;       /* Where the span starts in its first window */
+    sox_bool whole;     /* Whether the window being filled began in the span */
+    float *head;        /* Each channel's part of a first window that began
+                         * before the span: kept for sox_effect_merge */
 } priv_t;
 
+void lsx_noise_stats_create(noise_stats_t * s)
+{
+    s->sum = lsx_calloc(FREQCOUNT, sizeof(double));
+    s->profilecount = lsx_calloc(FREQCOUNT, sizeof(int));
+    s->window = lsx_calloc(WINDOWSIZE, sizeof(float));
+    s->power = lsx_calloc(FREQCOUNT, sizeof(float));
+}
+
+/* Collect statistics from the complete window. */
+void lsx_noise_stats_collect(noise_stats_t * s)
+{
+    float *out = s->power;
+    int i;
+
+    lsx_power_spectrum_f(WINDOWSIZE, s->window, out);
+
+    for (i = 0; i < FREQCOUNT; i ++) {
+        if (out[i] > 0) {
+            float value = log(out[i]);
+            s->sum[i] += value;
+            s->profilecount[i] ++;
+        }
+    }
+}
+
+/* The profile: the mean log power in each bin, or 0 if none was seen */
+void lsx_noise_stats_mean(noise_stats_t const * s, float * mean)
+{
+    int i;
+
+    for (i = 0; i < FREQCOUNT; i ++)
+        mean[i] = s->profilecount[i] != 0 ?
+                s->sum[i] / s->profilecount[i] : 0;
+}
+
+void lsx_noise_stats_delete(noise_stats_t * s)
+{
+    free(s->sum);
+    free(s->profilecount);
+    free(s->window);
+    free(s->power);
+}
+
 /*
  * Get the filename, if any. We don't open it until sox_noiseprof_start.
  */
@@ -47,6 +96,10 @@ static int sox_noiseprof_getopts(sox_effect_t * effp, int argc, char **argv)
     priv_t * data = (priv_t *) effp->priv;
   --argc, ++argv;
 
+    if (argc && !strcmp(argv[0], "-b")) {
+        data->binary = sox_true;
+        --argc, ++argv;
+    }
     if (argc == 1) {
         data->output_filename = argv[0];
     } else if (argc > 1)
@@ -73,6 +126,9 @@ static int sox_noiseprof_start(sox_effect_t * effp)
       return SOX_EOF;
     }
     effp->global_info->global_info->stdout_in_use_by = effp->handler.name;
+    if (data->binary) {
+      SET_BINARY_MODE(stdout);
+    }
     data->output_file = stdout;
   }
   else if ((data->output_file = fopen(data->output_filename, "wb")) == NULL) {
@@ -81,32 +137,27 @@ static int sox_noiseprof_start(sox_effect_t * effp)
   }
 
   data->chandata = lsx_calloc(channels, sizeof(*(data->chandata)));
-  data->bufdata = 0;
-  for (i = 0; i < channels; i ++) {
-    data->chandata[i].sum = lsx_calloc(FREQCOUNT, sizeof(float));
-    data->chandata[i].profilecount = lsx_calloc(FREQCOUNT, sizeof(int));
-    data->chandata[i].window = lsx_calloc(WINDOWSIZE, sizeof(float));
-  }
+  data->bufdata = data->start = 0;
+  data->whole = sox_true;
+  data->pos = 0;
+  for (i = 0; i < channels; i ++)
+    lsx_noise_stats_create(&data->chandata[i]);
 
   return SOX_SUCCESS;
 }
 
-/* Collect statistics from the complete window on channel chan. */
-static void collect_data(chandata_t* chan) {
-    float *out = lsx_calloc(FREQCOUNT, sizeof(float));
-    int i;
-
-    lsx_power_spectrum_f(WINDOWSIZE, chan->window, out);
-
-    for (i = 0; i < FREQCOUNT; i ++) {
-        if (out[i] > 0) {
-            float value = log(out[i]);
-            chan->sum[i] += value;
-            chan->profilecount[i] ++;
-        }
-    }
+/*
+ * Windows are kept to those of the whole of the audio, of which the span
+ * (set once the effect has started) may be a part.
+ */
+static void span_start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *) effp->priv;
 
-    free(out);
+  p->bufdata = p->start = effp->span.offset % WINDOWSIZE;
+  p->whole = !p->start;
+  if (p->start && !p->head)
+    p->head = lsx_calloc(effp->in_signal.channels * WINDOWSIZE, sizeof(float));
 }
 
 /*
@@ -118,26 +169,38 @@ static int sox_noiseprof_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox
   priv_t * p = (priv_t *) effp->priv;
   size_t samp = min(*isamp, *osamp), dummy = 0; /* No need to clip count */
   size_t chans = effp->in_signal.channels;
-  size_t i, j, n = min(samp / chans, WINDOWSIZE - p->bufdata);
-
-  memcpy(obuf, ibuf, n * chans * sizeof(*obuf)); /* Pass on audio unaffected */
-  *isamp = *osamp = n * chans;
-
-  /* Collect data for every channel. */
-  for (i = 0; i < chans; i ++) {
-    SOX_SAMPLE_LOCALS;
-    chandata_t * chan = &(p->chandata[i]);
-    for (j = 0; j < n; j ++)
-      chan->window[j + p->bufdata] =
-        SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[i + j * chans], dummy);
-    if (n + p->bufdata == WINDOWSIZE)
-      collect_data(chan);
-  }
+  size_t len = samp / chans, i, j, n, lead;
+
+  if (obuf != ibuf) /* Pass on audio unaffected */
+    memcpy(obuf, ibuf, len * chans * sizeof(*obuf));
+  *isamp = *osamp = len * chans;
+
+  if (!p->pos)
+    span_start(effp);
+  n = lsx_span(effp, p->pos, len, &lead);
+  p->pos += len;
+  for (len = n, ibuf += lead * chans; len; len -= n, ibuf += n * chans) {
+    n = min(len, WINDOWSIZE - p->bufdata);
+
+    /* Collect data for every channel. */
+    for (i = 0; i < chans; i ++) {
+      SOX_SAMPLE_LOCALS;
+      noise_stats_t * chan = &(p->chandata[i]);
+      for (j = 0; j < n; j ++)
+        chan->window[j + p->bufdata] =
+          SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[i + j * chans], dummy);
+      if (n + p->bufdata == WINDOWSIZE) {
+        if (p->whole)
+          lsx_noise_stats_collect(chan);
+        else memcpy(p->head + i * WINDOWSIZE, chan->window, sizeof(float) * WINDOWSIZE);
+      }
+    }
 
-  p->bufdata += n;
-  assert(p->bufdata <= WINDOWSIZE);
-  if (p->bufdata == WINDOWSIZE)
-    p->bufdata = 0;
+    p->bufdata += n;
+    assert(p->bufdata <= WINDOWSIZE);
+    if (p->bufdata == WINDOWSIZE)
+      p->bufdata = 0, p->whole = sox_true;
+  }
 
   return SOX_SUCCESS;
 }
@@ -154,22 +217,22 @@ static int sox_noiseprof_drain(sox_effect_t * effp, sox_sample_t *obuf UNUSED, s
 
     *osamp = 0;
 
-    if (data->bufdata == 0) {
+    /* A window that is not the last, or not all in the span, is left for
+     * sox_effect_merge. */
+    if (data->bufdata == 0 || !data->whole || effp->span.length) {
         return SOX_EOF;
     }
 
     for (i = 0; i < tracks; i ++) {
         int j;
-        for (j = data->bufdata+1; j < WINDOWSIZE; j ++) {
+        for (j = data->bufdata; j < WINDOWSIZE; j ++) {
             data->chandata[i].window[j] = 0;
         }
-        collect_data(&(data->chandata[i]));
+        lsx_noise_stats_collect(&(data->chandata[i]));
     }
+    data->bufdata = 0;
 
-    if (data->bufdata == WINDOWSIZE || data->bufdata == 0)
-        return SOX_EOF;
-    else
-        return SOX_SUCCESS;
+    return SOX_EOF;
 }
 
 /*
@@ -178,43 +241,182 @@ static int sox_noiseprof_drain(sox_effect_t * effp, sox_sample_t *obuf UNUSED, s
 static int sox_noiseprof_stop(sox_effect_t * effp)
 {
     priv_t * data = (priv_t *) effp->priv;
+    uint32_t counts[2];
+    float mean[FREQCOUNT];
+    int result = SOX_SUCCESS;
     size_t i;
 
+    counts[0] = effp->in_signal.channels;
+    counts[1] = FREQCOUNT;
+    if (data->binary && (
+          fwrite(NOISE_PROFILE_MAGIC, NOISE_PROFILE_MAGIC_LEN, (size_t)1,
+            data->output_file) != 1 ||
+          fwrite(counts, sizeof(counts), (size_t)1, data->output_file) != 1))
+        result = SOX_EOF;
+
     for (i = 0; i < effp->in_signal.channels; i ++) {
         int j;
-        chandata_t* chan = &(data->chandata[i]);
-
-        fprintf(data->output_file, "Channel %lu: ", (unsigned long)i);
-
-        for (j = 0; j < FREQCOUNT; j ++) {
-            double r = chan->profilecount[j] != 0 ?
-                    chan->sum[j] / chan->profilecount[j] : 0;
-            fprintf(data->output_file, "%s%f", j == 0 ? "" : ", ", r);
+        noise_stats_t* chan = &(data->chandata[i]);
+
+        lsx_noise_stats_mean(chan, mean);
+        if (data->binary) {
+            if (result == SOX_SUCCESS &&
+                fwrite(mean, sizeof(mean), (size_t)1, data->output_file) != 1)
+                result = SOX_EOF;
+        } else {
+            fprintf(data->output_file, "Channel %lu: ", (unsigned long)i);
+            for (j = 0; j < FREQCOUNT; j ++)
+                fprintf(data->output_file, "%s%f", j == 0 ? "" : ", ", mean[j]);
+            fprintf(data->output_file, "\n");
         }
-        fprintf(data->output_file, "\n");
 
-        free(chan->sum);
-        free(chan->profilecount);
+        lsx_noise_stats_delete(chan);
     }
 
     free(data->chandata);
+    free(data->head);
+    data->head = NULL;
 
+    if (result != SOX_SUCCESS)
+        lsx_fail("error writing profile file: %s", strerror(errno));
     if (data->output_file != stdout)
         fclose(data->output_file);
 
-    return (SOX_SUCCESS);
+    return result;
+}
+
+/*
+ * Write or read what has been gathered, as a partial result: the position
+ * in the window, then for each channel the sums and counts, any kept first
+ * window (from where the span starts), and the window being filled (from
+ * its start, or the span's).
+ */
+static void partial(lsx_partial_t * s, priv_t * data, size_t chans,
+    uint64_t * final)
+{
+    uint64_t start = data->start, bufdata = data->bufdata, whole = data->whole;
+    size_t i, j;
+
+    lsx_partial_u64(s, &start);
+    lsx_partial_u64(s, &bufdata);
+    lsx_partial_u64(s, &whole);
+    lsx_partial_u64(s, final);
+    if (start >= WINDOWSIZE || bufdata >= WINDOWSIZE ||
+        (!whole && bufdata < start) || (!start && !whole))
+        s->error = sox_true;
+    if (s->error)
+        return;
+    data->start = start, data->bufdata = bufdata, data->whole = whole;
+    for (i = 0; i < chans; i ++) {
+        noise_stats_t * chan = &data->chandata[i];
+        for (j = 0; j < FREQCOUNT; j ++) {
+            double sum = chan->sum[j];
+            uint64_t count = chan->profilecount[j];
+            lsx_partial_f64(s, &sum);
+            lsx_partial_u64(s, &count);
+            chan->sum[j] = sum;
+            chan->profilecount[j] = count;
+        }
+        for (j = whole && start? start : WINDOWSIZE; j < WINDOWSIZE; j ++) {
+            double x = data->head[i * WINDOWSIZE + j];
+            lsx_partial_f64(s, &x);
+            data->head[i * WINDOWSIZE + j] = x;
+        }
+        for (j = whole? 0 : start; j < bufdata; j ++) {
+            double x = chan->window[j];
+            lsx_partial_f64(s, &x);
+            chan->window[j] = x;
+        }
+    }
+}
+
+static size_t sox_noiseprof_save(sox_effect_t * effp, void * buf, size_t len)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    uint64_t final = !effp->span.length;
+    lsx_partial_t s;
+
+    memset(&s, 0, sizeof(s));
+    s.data = buf, s.size = len;
+    partial(&s, data, (size_t)effp->in_signal.channels, &final);
+    return s.pos;
+}
+
+/*
+ * Add a partial result for the samples that follow those seen: the window
+ * being filled is continued by the partial's first, and is collected if
+ * that completes it (or it is the last).
+ */
+static int sox_noiseprof_merge(sox_effect_t * effp, void const * buf, size_t len)
+{
+    priv_t * data = (priv_t *) effp->priv, q = *data;
+    size_t chans = effp->in_signal.channels, i, j, n;
+    uint64_t final;
+    lsx_partial_t s;
+    int result = SOX_SUCCESS;
+
+    q.chandata = lsx_calloc(chans, sizeof(*q.chandata));
+    q.head = lsx_calloc(chans * WINDOWSIZE, sizeof(float));
+    for (i = 0; i < chans; i ++)
+        lsx_noise_stats_create(&q.chandata[i]);
+    memset(&s, 0, sizeof(s));
+    s.data = (unsigned char *)buf, s.size = len, s.reading = sox_true;
+    partial(&s, &q, chans, &final);
+    if (s.error || s.pos != len || q.start != data->bufdata)
+        result = SOX_EOF;
+
+    for (i = 0; result == SOX_SUCCESS && i < chans; i ++) {
+        noise_stats_t * chan = &data->chandata[i], * from = &q.chandata[i];
+
+        if (q.start) { /* Its first samples continue the window */
+            float const * x = q.whole? q.head + i * WINDOWSIZE : from->window;
+            n = q.whole? WINDOWSIZE : q.bufdata;
+            memcpy(chan->window + q.start, x + q.start, (n - q.start) * sizeof(float));
+            if (n == WINDOWSIZE && data->whole)
+                lsx_noise_stats_collect(chan);
+            else if (n == WINDOWSIZE)
+                memcpy(data->head + i * WINDOWSIZE, chan->window, sizeof(float) * WINDOWSIZE);
+        }
+        for (j = 0; j < FREQCOUNT; j ++) {
+            chan->sum[j] += from->sum[j];
+            chan->profilecount[j] += from->profilecount[j];
+        }
+        if (q.whole)
+            memcpy(chan->window, from->window, q.bufdata * sizeof(float));
+    }
+    if (result == SOX_SUCCESS) {
+        data->whole |= q.whole;
+        data->bufdata = q.bufdata;
+        if (final && data->bufdata && data->whole) {
+            for (i = 0; i < chans; i ++) {
+                for (j = data->bufdata; j < WINDOWSIZE; j ++)
+                    data->chandata[i].window[j] = 0;
+                lsx_noise_stats_collect(&data->chandata[i]);
+            }
+            data->bufdata = 0;
+        }
+    }
+
+    for (i = 0; i < chans; i ++)
+        lsx_noise_stats_delete(&q.chandata[i]);
+    free(q.chandata);
+    free(q.head);
+    return result;
 }
 
 static sox_effect_handler_t sox_noiseprof_effect = {
   "noiseprof",
-  "[profile-file]",
-  SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+  "[-b] [profile-file]",
+  SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INPLACE,
   sox_noiseprof_getopts,
   sox_noiseprof_start,
   sox_noiseprof_flow,
   sox_noiseprof_drain,
   sox_noiseprof_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL,
+  sox_noiseprof_save,
+  sox_noiseprof_merge,
+  NULL
 };
 
 const sox_effect_handler_t *lsx_noiseprof_effect_fn(void)
@@ -15,44 +15,44 @@
 #include <string.h>
 #include <assert.h>
 
+/* For SET_BINARY_MODE: */
+#include <fcntl.h>
+#ifdef HAVE_IO_H
+  #include <io.h>
+#endif
+
+/* All of a channel's buffers are allocated by start, so that no window
+ * (of which there are some 43 per second per channel) allocates memory. */
 typedef struct {
-    float *window;
-    float *lastwindow;
-    float *noisegate;
+    float *window;      /* Being filled, then reduced in place */
+    float *lastwindow;  /* The previous window, reduced */
+    float *spare;       /* To be the next window */
+    float *noisegate;   /* Mean log power of the noise, per bin */
+    float *gate;        /* Power below which a bin is noise */
     float *smoothing;
+    sox_bool primed;    /* Has lastwindow been reduced? */
+    uint64_t clips;
 } chandata_t;
 
 /* Holds profile information */
 typedef struct {
     char* profile_filename;
     float threshold;
+    char const * learn_str;
 
     chandata_t *chandata;
     size_t bufdata;
+    float *hann;        /* Synthesis window */
+
+    /* With -l, the profile is learnt from the first `learn' samples of each
+     * channel, which are held in store and then reduced like the rest */
+    uint64_t learn, learned;
+    noise_stats_t *stats;
+    size_t learnfill;   /* Samples in the stats' windows */
+    sox_sample_t *store;
+    size_t stored, replayed, store_size;
 } priv_t;
 
-static void FFT(unsigned NumSamples,
-         int InverseTransform,
-         const float *RealIn, float *ImagIn, float *RealOut, float *ImagOut)
-{
-  unsigned i;
-  double * work = malloc(2 * NumSamples * sizeof(*work));
-  for (i = 0; i < 2 * NumSamples; i += 2) {
-    work[i] = RealIn[i >> 1];
-    work[i + 1] = ImagIn? ImagIn[i >> 1] : 0;
-  }
-  lsx_safe_cdft(2 * (int)NumSamples, InverseTransform? -1 : 1, work);
-  if (InverseTransform) for (i = 0; i < 2 * NumSamples; i += 2) {
-    RealOut[i >> 1] = work[i] / NumSamples;
-    ImagOut[i >> 1] = work[i + 1] / NumSamples;
-  }
-  else for (i = 0; i < 2 * NumSamples; i += 2) {
-    RealOut[i >> 1] = work[i];
-    ImagOut[i >> 1] = work[i + 1];
-  }
-  free(work);
-}
-
 /*
  * Get the options. Default file is stdin (if the audio
  * input file isn't coming from there, of course!)
@@ -62,7 +62,15 @@ static int sox_noisered_getopts(sox_effect_t * effp, int argc, char **argv)
   priv_t * p = (priv_t *) effp->priv;
   --argc, ++argv;
 
-  if (argc > 0) {
+  if (argc > 1 && !strcmp(argv[0], "-l")) {
+    uint64_t dummy;
+    p->learn_str = argv[1];
+    if (!lsx_parsesamples(0., p->learn_str, &dummy, 't'))
+      return lsx_usage(effp);
+    argv += 2;
+    argc -= 2;
+  }
+  else if (argc > 0) {
     p->profile_filename = argv[0];
     ++argv;
     --argc;
@@ -76,28 +84,14 @@ static int sox_noisered_getopts(sox_effect_t * effp, int argc, char **argv)
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
-/*
- * Prepare processing.
- * Do all initializations.
- */
-static int sox_noisered_start(sox_effect_t * effp)
+/* Reads a profile as written by noiseprof (without -b) */
+static int read_text_profile(sox_effect_t * effp, FILE * ifp)
 {
     priv_t * data = (priv_t *) effp->priv;
     size_t fchannels = 0;
     size_t channels = effp->in_signal.channels;
     size_t i;
-    FILE * ifp = lsx_open_input_file(effp, data->profile_filename, sox_false);
 
-    if (!ifp)
-      return SOX_EOF;
-
-    data->chandata = lsx_calloc(channels, sizeof(*(data->chandata)));
-    data->bufdata = 0;
-    for (i = 0; i < channels; i ++) {
-        data->chandata[i].noisegate = lsx_calloc(FREQCOUNT, sizeof(float));
-        data->chandata[i].smoothing = lsx_calloc(FREQCOUNT, sizeof(float));
-        data->chandata[i].lastwindow = NULL;
-    }
     while (1) {
         unsigned long i1_ul;
         size_t i1;
@@ -110,15 +104,16 @@ static int sox_noisered_start(sox_effect_t * effp)
                     (unsigned long)i1, (unsigned long)fchannels);
             return SOX_EOF;
         }
-
-        data->chandata[fchannels].noisegate[0] = f1;
+        if (fchannels < channels)
+            data->chandata[fchannels].noisegate[0] = f1;
         for (i = 1; i < FREQCOUNT; i ++) {
             if (1 != fscanf(ifp, ", %f", &f1)) {
                 lsx_fail("noisered: Not enough data for channel %lu "
                         "(expected %d, got %lu)", (unsigned long)fchannels, FREQCOUNT, (unsigned long)i);
                 return SOX_EOF;
             }
-            data->chandata[fchannels].noisegate[i] = f1;
+            if (fchannels < channels)
+                data->chandata[fchannels].noisegate[i] = f1;
         }
         fchannels ++;
     }
@@ -127,8 +122,130 @@ static int sox_noisered_start(sox_effect_t * effp)
                 (unsigned long)channels, (unsigned long)fchannels);
         return SOX_EOF;
     }
+    return SOX_SUCCESS;
+}
+
+/* Reads a profile as written by noiseprof -b */
+static int read_binary_profile(sox_effect_t * effp, FILE * ifp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t channels = effp->in_signal.channels;
+    char magic[NOISE_PROFILE_MAGIC_LEN];
+    uint32_t counts[2];
+    sox_bool swap;
+    size_t i, j;
+
+    if (fread(magic, sizeof(magic), (size_t)1, ifp) != 1 ||
+        memcmp(magic, NOISE_PROFILE_MAGIC, sizeof(magic)) ||
+        fread(counts, sizeof(counts), (size_t)1, ifp) != 1) {
+        lsx_fail("noisered: invalid profile.");
+        return SOX_EOF;
+    }
+    swap = counts[1] != FREQCOUNT;
+    if (swap) {
+        counts[0] = lsx_swapdw(counts[0]);
+        counts[1] = lsx_swapdw(counts[1]);
+    }
+    if (counts[1] != FREQCOUNT) {
+        lsx_fail("noisered: invalid profile.");
+        return SOX_EOF;
+    }
+    if (counts[0] != channels) {
+        lsx_fail("noisered: channel mismatch: %lu in input, %lu in profile.",
+                (unsigned long)channels, (unsigned long)counts[0]);
+        return SOX_EOF;
+    }
+    for (i = 0; i < channels; i ++) {
+        float * gate = data->chandata[i].noisegate;
+        if (fread(gate, sizeof(*gate), (size_t)FREQCOUNT, ifp) != FREQCOUNT) {
+            lsx_fail("noisered: Not enough data for channel %lu", (unsigned long)i);
+            return SOX_EOF;
+        }
+        for (j = 0; swap && j < FREQCOUNT; j ++) {
+            uint32_t x;
+            memcpy(&x, &gate[j], sizeof(x));
+            x = lsx_swapdw(x);
+            memcpy(&gate[j], &x, sizeof(x));
+        }
+    }
+    return SOX_SUCCESS;
+}
+
+static int read_profile(sox_effect_t * effp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    FILE * ifp = lsx_open_input_file(effp, data->profile_filename, sox_false);
+    int c, result;
+
+    if (!ifp)
+      return SOX_EOF;
+    if (ifp == stdin) {
+      SET_BINARY_MODE(stdin);
+    }
+    c = getc(ifp);
+    ungetc(c, ifp);
+    result = c == NOISE_PROFILE_MAGIC[0] ?
+        read_binary_profile(effp, ifp) : read_text_profile(effp, ifp);
     if (ifp != stdin)
       fclose(ifp);
+    return result;
+}
+
+/* log(power) < noisegate + threshold*8, without a log() per bin */
+static void set_gates(priv_t * data, size_t channels)
+{
+    size_t c, i;
+
+    for (c = 0; c < channels; c ++)
+        for (i = 0; i < FREQCOUNT; i ++) {
+            chandata_t * chan = &data->chandata[c];
+            chan->gate[i] = exp(chan->noisegate[i] + data->threshold * 8.0);
+        }
+}
+
+/*
+ * Prepare processing.
+ * Do all initializations.
+ */
+static int sox_noisered_start(sox_effect_t * effp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t channels = effp->in_signal.channels;
+    size_t i;
+
+    if (data->learn_str) {
+        lsx_parsesamples(effp->in_signal.rate, data->learn_str, &data->learn, 't');
+        if (!data->learn) {
+            lsx_fail("no audio to learn the noise from");
+            return SOX_EOF;
+        }
+    }
+    data->chandata = lsx_calloc(channels, sizeof(*(data->chandata)));
+    data->bufdata = 0;
+    for (i = 0; i < channels; i ++) {
+        chandata_t * chan = &data->chandata[i];
+        chan->window = lsx_calloc(3 * WINDOWSIZE, sizeof(float));
+        chan->lastwindow = chan->window + WINDOWSIZE;
+        chan->spare = chan->lastwindow + WINDOWSIZE;
+        chan->noisegate = lsx_calloc(3 * FREQCOUNT, sizeof(float));
+        chan->gate = chan->noisegate + FREQCOUNT;
+        chan->smoothing = chan->gate + FREQCOUNT;
+    }
+    data->hann = lsx_malloc(WINDOWSIZE * sizeof(float));
+    for (i = 0; i < WINDOWSIZE; i ++)
+        data->hann[i] = 1;
+    lsx_apply_hann_f(data->hann, WINDOWSIZE);
+
+    if (data->learn_str) {
+        data->learned = data->learnfill = 0;
+        data->stored = data->replayed = data->store_size = 0;
+        data->stats = lsx_calloc(channels, sizeof(*data->stats));
+        for (i = 0; i < channels; i ++)
+            lsx_noise_stats_create(&data->stats[i]);
+    }
+    else if (read_profile(effp) != SOX_SUCCESS)
+        return SOX_EOF;
+    else set_gates(data, channels);
 
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
 
@@ -137,40 +254,37 @@ static int sox_noisered_start(sox_effect_t * effp)
 
 /* Mangle a single window. Each output sample (except the first and last
  * half-window) is the result of two distinct calls to this function,
- * due to overlapping windows. */
-static void reduce_noise(chandata_t* chan, float* window, double level)
+ * due to overlapping windows.
+ *
+ * One real DFT serves both to filter the window and to find which bins are
+ * noise: the latter wants the spectrum of the Hann-windowed audio, and
+ * windowing by (periodic) Hann is, in the frequency domain, convolving with
+ * {-1/4, 1/2, -1/4}.  In lsx_safe_rdft_f's layout, w[0] and w[1] are the
+ * (real) bins 0 and N/2, and w[2k], w[2k+1] bin k. */
+static void reduce_noise(chandata_t* chan, float* w, float const * hann)
 {
-    float *inr, *ini, *outr, *outi, *power;
     float *smoothing = chan->smoothing;
     int i;
 
-    inr = lsx_calloc(WINDOWSIZE * 5, sizeof(float));
-    ini = inr + WINDOWSIZE;
-    outr = ini + WINDOWSIZE;
-    outi = outr + WINDOWSIZE;
-    power = outi + WINDOWSIZE;
-
-    for (i = 0; i < FREQCOUNT; i ++)
-        assert(smoothing[i] >= 0 && smoothing[i] <= 1);
-
-    memcpy(inr, window, WINDOWSIZE*sizeof(float));
-
-    FFT(WINDOWSIZE, 0, inr, NULL, outr, outi);
-
-    memcpy(inr, window, WINDOWSIZE*sizeof(float));
-    lsx_apply_hann_f(inr, WINDOWSIZE);
-    lsx_power_spectrum_f(WINDOWSIZE, inr, power);
+    lsx_safe_rdft_f(WINDOWSIZE, 1, w);
 
     for (i = 0; i < FREQCOUNT; i ++) {
-        float smooth;
-        float plog;
-        plog = log(power[i]);
-        if (power[i] != 0 && plog < chan->noisegate[i] + level*8.0)
-            smooth = 0.0;
-        else
-            smooth = 1.0;
-
-        smoothing[i] = smooth * 0.5 + smoothing[i] * 0.5;
+        float re, im, power;
+        if (i == 0)
+            re = .5f * w[0] - .5f * w[2], im = 0;
+        else if (i == FREQCOUNT - 1)
+            re = .5f * w[1] - .5f * w[WINDOWSIZE - 2], im = 0;
+        else {
+            float re0 = i == 1? w[0] : w[2 * i - 2];
+            float im0 = i == 1? 0 : w[2 * i - 1];
+            float re1 = i == FREQCOUNT - 2? w[1] : w[2 * i + 2];
+            float im1 = i == FREQCOUNT - 2? 0 : w[2 * i + 3];
+            re = .5f * w[2 * i] - .25f * (re0 + re1);
+            im = .5f * w[2 * i + 1] - .25f * (im0 + im1);
+        }
+        power = re * re + im * im;
+        smoothing[i] = (power > 0 && power < chan->gate[i]? 0 : .5f) +
+            smoothing[i] * 0.5f;
     }
 
     /* Audacity says this code will eliminate tinkle bells.
@@ -185,74 +299,68 @@ static void reduce_noise(chandata_t* chan, float* window, double level)
             smoothing[i] = 0.0;
     }
 
-    outr[0] *= smoothing[0];
-    outi[0] *= smoothing[0];
-    outr[FREQCOUNT-1] *= smoothing[FREQCOUNT-1];
-    outi[FREQCOUNT-1] *= smoothing[FREQCOUNT-1];
-
+    w[0] *= smoothing[0];
+    w[1] *= smoothing[FREQCOUNT-1];
     for (i = 1; i < FREQCOUNT-1; i ++) {
-        int j = WINDOWSIZE - i;
-        float smooth = smoothing[i];
-
-        outr[i] *= smooth;
-        outi[i] *= smooth;
-        outr[j] *= smooth;
-        outi[j] *= smooth;
+        w[2 * i] *= smoothing[i];
+        w[2 * i + 1] *= smoothing[i];
     }
 
-    FFT(WINDOWSIZE, 1, outr, outi, inr, ini);
-    lsx_apply_hann_f(inr, WINDOWSIZE);
-
-    memcpy(window, inr, WINDOWSIZE*sizeof(float));
-
-    for (i = 0; i < FREQCOUNT; i ++)
-        assert(smoothing[i] >= 0 && smoothing[i] <= 1);
-
-    free(inr);
+    lsx_safe_rdft_f(WINDOWSIZE, -1, w);
+    for (i = 0; i < WINDOWSIZE; i ++)
+        w[i] *= hann[i] * (2.f / WINDOWSIZE);
 }
 
 /* Do window management once we have a complete window, including mangling
  * the current window. */
-static int process_window(sox_effect_t * effp, priv_t * data, unsigned chan_num, unsigned num_chans,
+static int process_window(priv_t * data, unsigned chan_num, unsigned num_chans,
                           sox_sample_t *obuf, unsigned len) {
     int j;
     float* nextwindow;
     int use = min(len, WINDOWSIZE)-min(len,(WINDOWSIZE/2));
     chandata_t *chan = &(data->chandata[chan_num]);
-    int first = (chan->lastwindow == NULL);
     SOX_SAMPLE_LOCALS;
 
-    if ((nextwindow = lsx_calloc(WINDOWSIZE, sizeof(float))) == NULL)
-        return SOX_EOF;
-
+    nextwindow = chan->spare;
     memcpy(nextwindow, chan->window+WINDOWSIZE/2,
            sizeof(float)*(WINDOWSIZE/2));
+    memset(nextwindow + WINDOWSIZE/2, 0, sizeof(float)*(WINDOWSIZE/2));
 
-    reduce_noise(chan, chan->window, data->threshold);
-    if (!first) {
+    reduce_noise(chan, chan->window, data->hann);
+    if (chan->primed) {
         for (j = 0; j < use; j ++) {
             float s = chan->window[j] + chan->lastwindow[WINDOWSIZE/2 + j];
             obuf[chan_num + num_chans * j] =
-                SOX_FLOAT_32BIT_TO_SAMPLE(s, effp->clips);
+                SOX_FLOAT_32BIT_TO_SAMPLE(s, chan->clips);
         }
-        free(chan->lastwindow);
     } else {
-        for (j = 0; j < use; j ++) {
-            assert(chan->window[j] >= -1 && chan->window[j] <= 1);
+        for (j = 0; j < use; j ++)
             obuf[chan_num + num_chans * j] =
-                SOX_FLOAT_32BIT_TO_SAMPLE(chan->window[j], effp->clips);
-        }
+                SOX_FLOAT_32BIT_TO_SAMPLE(chan->window[j], chan->clips);
+        chan->primed = sox_true;
     }
+    chan->spare = chan->lastwindow;
     chan->lastwindow = chan->window;
     chan->window = nextwindow;
 
     return use;
 }
 
+static void gather_clips(sox_effect_t * effp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t i;
+
+    for (i = 0; i < effp->in_signal.channels; i ++) {
+        effp->clips += data->chandata[i].clips;
+        data->chandata[i].clips = 0;
+    }
+}
+
 /*
  * Read in windows, and call process_window once we get a whole one.
  */
-static int sox_noisered_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+static void reduce(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                     size_t *isamp, size_t *osamp)
 {
     priv_t * data = (priv_t *) effp->priv;
@@ -260,9 +368,9 @@ static int sox_noisered_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_
     size_t tracks = effp->in_signal.channels;
     size_t track_samples = samp / tracks;
     size_t ncopy = min(track_samples, WINDOWSIZE-data->bufdata);
-    size_t whole_window = (ncopy + data->bufdata == WINDOWSIZE);
+    size_t whole_window = (ncopy + data->bufdata == WINDOWSIZE), threads;
     int oldbuf = data->bufdata;
-    size_t i;
+    int i;
 
     /* FIXME: Make this automatic for all effects */
     assert(effp->in_signal.channels == effp->out_signal.channels);
@@ -272,31 +380,133 @@ static int sox_noisered_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_
     else
         data->bufdata += ncopy;
 
-    /* Reduce noise on every channel. */
-    for (i = 0; i < tracks; i ++) {
+    /* Reduce noise on every channel; the channels are independent. */
+    threads = whole_window? lsx_effect_threads(effp, tracks) : 1;
+    #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+    for (i = 0; i < (int)tracks; i ++) {
         SOX_SAMPLE_LOCALS;
         chandata_t* chan = &(data->chandata[i]);
         size_t j;
 
-        if (chan->window == NULL)
-            chan->window = lsx_calloc(WINDOWSIZE, sizeof(float));
-
         for (j = 0; j < ncopy; j ++)
             chan->window[oldbuf + j] =
-                SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[i + tracks * j], effp->clips);
+                SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[i + tracks * j], chan->clips);
 
-        if (!whole_window)
-            continue;
-        else
-            process_window(effp, data, (unsigned) i, (unsigned) tracks, obuf, (unsigned) (oldbuf + ncopy));
+        if (whole_window)
+            process_window(data, (unsigned) i, (unsigned) tracks, obuf, (unsigned) (oldbuf + ncopy));
     }
+    lsx_threads_give(effp->global_info->global_info, threads);
+    gather_clips(effp);
 
     *isamp = tracks*ncopy;
     if (whole_window)
         *osamp = tracks*(WINDOWSIZE/2);
     else
         *osamp = 0;
+}
+
+/* Gathers the noise statistics from, and holds, len samples per channel */
+static void learn(sox_effect_t * effp, const sox_sample_t *ibuf, size_t len)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t tracks = effp->in_signal.channels, i, j, n;
+    sox_uint64_t dummy = 0; /* Clips are counted on the way out */
+
+    if (data->stored + len * tracks > data->store_size) {
+        data->store_size = max(2 * data->store_size, data->stored + len * tracks);
+        lsx_revalloc(data->store, data->store_size);
+    }
+    memcpy(data->store + data->stored, ibuf, len * tracks * sizeof(*ibuf));
+    data->stored += len * tracks;
+    data->learned += len;
+
+    for (; len; len -= n, ibuf += n * tracks) {
+        n = min(len, WINDOWSIZE - data->learnfill);
+        for (i = 0; i < tracks; i ++) {
+            SOX_SAMPLE_LOCALS;
+            noise_stats_t * stats = &data->stats[i];
+            for (j = 0; j < n; j ++)
+                stats->window[data->learnfill + j] =
+                    SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[i + j * tracks], dummy);
+            if (data->learnfill + n == WINDOWSIZE)
+                lsx_noise_stats_collect(stats);
+        }
+        data->learnfill = (data->learnfill + n) % WINDOWSIZE;
+    }
+}
+
+/* Makes the profile from the statistics, including any last part-window */
+static void end_learning(sox_effect_t * effp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t i;
+
+    for (i = 0; i < effp->in_signal.channels; i ++) {
+        noise_stats_t * stats = &data->stats[i];
+        if (data->learnfill) {
+            memset(stats->window + data->learnfill, 0,
+                (WINDOWSIZE - data->learnfill) * sizeof(float));
+            lsx_noise_stats_collect(stats);
+        }
+        lsx_noise_stats_mean(stats, data->chandata[i].noisegate);
+        lsx_noise_stats_delete(stats);
+    }
+    free(data->stats);
+    data->stats = NULL;
+    data->learn = data->learned;
+    set_gates(data, (size_t)effp->in_signal.channels);
+    lsx_debug("learnt the noise from %" PRIu64 " samples", data->learned);
+}
 
+/* Reduces the held samples, while there are any; returns whether it has
+ * given some output, or has more to give */
+static sox_bool replay(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t isamp, o;
+
+    if (!data->store)
+        return sox_false;
+    do {                /* Until a window is whole */
+        isamp = data->stored - data->replayed;
+        o = *osamp;
+        reduce(effp, data->store + data->replayed, obuf, &isamp, &o);
+        data->replayed += isamp;
+    } while (!o && isamp && data->replayed < data->stored);
+    *osamp = o;
+    if (data->replayed == data->stored) {
+        free(data->store);
+        data->store = NULL;
+    }
+    return *osamp || data->store;
+}
+
+static int sox_noisered_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+                    size_t *isamp, size_t *osamp)
+{
+    priv_t * data = (priv_t *) effp->priv;
+    size_t tracks = effp->in_signal.channels;
+    size_t learnt = 0, o = *osamp, i;
+
+    if (data->learned < data->learn) {
+        size_t len = min(*isamp / tracks, data->learn - data->learned);
+        learn(effp, ibuf, len);
+        learnt = len * tracks;
+        if (data->learned < data->learn) {
+            *isamp = learnt;
+            *osamp = 0;
+            return SOX_SUCCESS;
+        }
+        end_learning(effp); /* And go on, so as to give some output */
+    }
+    if (replay(effp, obuf, &o)) {
+        *isamp = learnt;
+        *osamp = o;
+        return SOX_SUCCESS;
+    }
+    i = *isamp - learnt;
+    reduce(effp, ibuf + learnt, obuf, &i, osamp);
+    *isamp = learnt + i;
     return SOX_SUCCESS;
 }
 
@@ -309,8 +519,17 @@ static int sox_noisered_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *o
     priv_t * data = (priv_t *)effp->priv;
     unsigned i;
     unsigned tracks = effp->in_signal.channels;
+    size_t o = *osamp;
+
+    if (data->learned < data->learn)
+        end_learning(effp);
+    if (replay(effp, obuf, &o)) {
+        *osamp = o;
+        return SOX_SUCCESS;
+    }
     for (i = 0; i < tracks; i ++)
-        *osamp = process_window(effp, data, i, tracks, obuf, (unsigned) data->bufdata);
+        *osamp = tracks * process_window(data, i, tracks, obuf, (unsigned) data->bufdata);
+    gather_clips(effp);
 
     /* FIXME: This is very picky.  osamp needs to be big enough to get all
      * remaining data or it will be discarded.
@@ -328,27 +547,32 @@ static int sox_noisered_stop(sox_effect_t * effp)
 
     for (i = 0; i < effp->in_signal.channels; i ++) {
         chandata_t* chan = &(data->chandata[i]);
-        free(chan->lastwindow);
-        free(chan->window);
-        free(chan->smoothing);
+        free(min(chan->window, min(chan->lastwindow, chan->spare)));
         free(chan->noisegate);
     }
 
+    for (i = 0; data->stats && i < effp->in_signal.channels; i ++)
+        lsx_noise_stats_delete(&data->stats[i]);
+    free(data->stats);
+    free(data->store);
     free(data->chandata);
+    free(data->hann);
+    data->stats = NULL;
+    data->store = NULL;
 
     return (SOX_SUCCESS);
 }
 
 static sox_effect_handler_t sox_noisered_effect = {
   "noisered",
-  "[profile-file [amount]]",
+  "[profile-file|-l duration [amount]]",
   SOX_EFF_MCHAN|SOX_EFF_LENGTH,
   sox_noisered_getopts,
   sox_noisered_start,
   sox_noisered_flow,
   sox_noisered_drain,
   sox_noisered_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_noisered_effect_fn(void)
@@ -24,3 +24,24 @@
 #define WINDOWSIZE 2048
 #define HALFWINDOW (WINDOWSIZE / 2)
 #define FREQCOUNT  (HALFWINDOW + 1)
+
+/* Noise statistics of a channel: the sum and count, per bin, of the log
+ * power of each whole window of noise put in window.  Gathered by
+ * noiseprof, and by noisered -l (see noiseprof.c). */
+typedef struct {
+    double *sum;
+    int   *profilecount;
+    float *window;
+    float *power;
+} noise_stats_t;
+
+void lsx_noise_stats_create(noise_stats_t * s);
+void lsx_noise_stats_collect(noise_stats_t * s);
+void lsx_noise_stats_mean(noise_stats_t const * s, float * mean);
+void lsx_noise_stats_delete(noise_stats_t * s);
+
+/* A binary profile (noiseprof -b) is this, then the channel count and
+ * FREQCOUNT as uint32_t, then each channel's FREQCOUNT mean log powers as
+ * float; all in the writer's byte order, which the counts show. */
+#define NOISE_PROFILE_MAGIC "\0SoX noise profile\n"
+#define NOISE_PROFILE_MAGIC_LEN (sizeof(NOISE_PROFILE_MAGIC) - 1)
@@ -52,7 +52,8 @@ LSX_FORMAT_HANDLER(nul)
   static const char * const names[] = {"null", NULL};
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
     NULL, names, SOX_FILE_DEVICE | SOX_FILE_PHONY | SOX_FILE_NOSTDIO,
-    startread, read_samples,NULL,NULL, write_samples,NULL,NULL, NULL, NULL, 0
+    startread, read_samples,NULL,NULL, write_samples,NULL,NULL, NULL, NULL, 0, NULL, NULL,
+    NULL, NULL
   };
   return &handler;
 }
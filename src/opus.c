@@ -229,7 +229,7 @@ LSX_FORMAT_HANDLER(opus)
     "Xiph.org's Opus lossy compression", names, 0,
     startread, read_samples, stopread,
     NULL, NULL, NULL,
-    seek, NULL, NULL, sizeof(priv_t)
+    seek, NULL, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
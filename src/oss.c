@@ -25,10 +25,12 @@
  */
 
 #include "sox_i.h"
+#include "fifo.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <poll.h>
 #ifdef HAVE_SYS_SOUNDCARD_H
   #include <sys/soundcard.h>
 #endif
@@ -58,8 +60,43 @@ typedef struct
     unsigned cOutput;
     int device;
     unsigned sample_shift;
+    sox_bool nonblock;   /* Driven by poll() (sox_globals.device_poll) */
+    fifo_t ring;         /* Then, bytes written, not yet taken by the device */
+    size_t cbRing;       /* Most bytes that the ring may hold */
 } priv_t;
 
+/* Waits until the device is ready for events; returns -1 on error */
+static int osswait(priv_t* pPriv, int events)
+{
+    struct pollfd pfd;
+
+    pfd.fd = pPriv->device;
+    pfd.events = (short)events;
+    return poll(&pfd, (nfds_t)1, -1) < 0 && errno != EINTR? -1 : 0;
+}
+
+/* Non-blocking: gives the device what it will take of the ring, waiting
+ * only for it to hold no more than cbKeep bytes */
+static int ossflush(sox_format_t* ft, size_t cbKeep)
+{
+    priv_t* pPriv = (priv_t*)ft->priv;
+    size_t cbHeld;
+
+    while ((cbHeld = fifo_occupancy(&pPriv->ring)) != 0) {
+        ssize_t cbWritten = write(pPriv->device, fifo_read_ptr(&pPriv->ring), cbHeld);
+        if (cbWritten > 0)
+            fifo_read(&pPriv->ring, (size_t)cbWritten, NULL);
+        else if ((cbWritten < 0 && errno != EAGAIN && errno != EINTR) ||
+            (cbHeld > cbKeep && osswait(pPriv, POLLOUT) < 0)) {
+            lsx_fail_errno(ft, errno, "Error writing to device");
+            return SOX_EOF;
+        }
+        else if (cbHeld <= cbKeep)
+            break;
+    }
+    return SOX_SUCCESS;
+}
+
 /* common r/w initialization code */
 static int ossinit(sox_format_t* ft)
 {
@@ -87,9 +124,11 @@ static int ossinit(sox_format_t* ft)
         lsx_report("Using user-specified device name: %s", szDevname);
     }
 
+    pPriv->nonblock = ft->context->device_poll;
     pPriv->device = open(
         szDevname,
-        ft->mode == 'r' ? O_RDONLY : O_WRONLY);
+        (ft->mode == 'r' ? O_RDONLY : O_WRONLY) |
+        (pPriv->nonblock ? O_NONBLOCK : 0));
     if (pPriv->device < 0) {
         lsx_fail_errno(ft, errno, "open failed for device: %s", szDevname);
         return SOX_EOF;
@@ -161,6 +200,21 @@ static int ossinit(sox_format_t* ft)
         return(SOX_EOF);
     }
 
+    /* Fragments as --device-period and --device-periods ask, for latency as
+     * low as ALSA gives; set before the format, as OSS requires */
+    if (ft->context->device_period || ft->context->device_periods) {
+        size_t cbPeriod = ft->context->device_period ?
+            ft->context->device_period * 2 * (samplesize >> 3) :
+            ft->context->bufsiz;
+        int log2 = 4; /* OSS's least: 16 bytes */
+        while (log2 < 24 && ((size_t)1 << log2) < cbPeriod)
+            ++log2;
+        tmp = (ft->context->device_periods ?
+            (int)min(ft->context->device_periods, 0x7fff) : 0x7fff) << 16 | log2;
+        if (ioctl(pPriv->device, SNDCTL_DSP_SETFRAGMENT, &tmp) < 0)
+            lsx_warn("Unable to set the device's fragments");
+    }
+
     /* Query the supported formats and find the best match
      */
     rc = ioctl(pPriv->device, SNDCTL_DSP_GETFMTS, &tmp);
@@ -241,13 +295,20 @@ static int ossinit(sox_format_t* ft)
         return (SOX_EOF);
     }
 
+    if (ioctl(pPriv->device, SNDCTL_DSP_GETBLKSIZE, &tmp) == 0)
+        lsx_report("%s; fragments of %d bytes",
+            pPriv->nonblock ? "non-blocking" : "blocking", tmp);
+
     if (ft->mode == 'r') {
         pPriv->cOutput = 0;
         pPriv->pOutput = NULL;
     } else {
-        size_t cbOutput = sox_globals.bufsiz;
+        size_t cbOutput = ft->context->bufsiz;
         pPriv->cOutput = cbOutput >> pPriv->sample_shift;
         pPriv->pOutput = lsx_malloc(cbOutput);
+        /* The chain may compute ahead by a --buffer's worth: */
+        fifo_create(&pPriv->ring, (size_t)1);
+        pPriv->cbRing = cbOutput;
     }
 
     return(SOX_SUCCESS);
@@ -257,10 +318,13 @@ static int ossstop(sox_format_t* ft)
 {
     priv_t* pPriv = (priv_t*)ft->priv;
     if (pPriv->device >= 0) {
+        if (pPriv->nonblock && ft->mode == 'w')
+            ossflush(ft, (size_t)0);
         close(pPriv->device);
     }
     if (pPriv->pOutput) {
         free(pPriv->pOutput);
+        fifo_delete(&pPriv->ring);
     }
     return SOX_SUCCESS;
 }
@@ -277,6 +341,14 @@ static size_t ossread(sox_format_t* ft, sox_sample_t* pOutput, size_t cOutput)
 
     while (cbOutputLeft) {
         cbRead = read(pPriv->device, pbOutput, cbOutputLeft);
+        if (cbRead < 0 && pPriv->nonblock && (errno == EAGAIN || errno == EINTR)) {
+            /* Give whatever whole frames are here, else wait for some */
+            size_t cbDone = (cOutput << pPriv->sample_shift) - cbOutputLeft;
+            if (cbDone && cbDone % (ft->signal.channels << pPriv->sample_shift) == 0)
+                break;
+            if (osswait(pPriv, POLLIN) == 0)
+                continue;
+        }
         if (cbRead <= 0) {
             if (cbRead < 0) {
                 lsx_fail_errno(ft, errno, "Error reading from device");
@@ -360,11 +432,16 @@ static size_t osswrite(
         size_t i;
         size_t cbStride;
         int cbWritten;
+        char* pOutput;
 
         cStride = cInputRemaining;
         if (cStride > pPriv->cOutput) {
             cStride = pPriv->cOutput;
         }
+        /* Non-blocking, encoded straight into the ring: */
+        pOutput = pPriv->nonblock ?
+            fifo_reserve(&pPriv->ring, cStride << pPriv->sample_shift) :
+            pPriv->pOutput;
 
         if (ft->encoding.reverse_bytes)
         {
@@ -372,19 +449,19 @@ static size_t osswrite(
             {
             case 0:
                 for (i = 0; i != cStride; i++) {
-                    ((sox_uint8_t*)pPriv->pOutput)[i] =
+                    ((sox_uint8_t*)pOutput)[i] =
                         SOX_SAMPLE_TO_UNSIGNED_8BIT(pInput[i], cClips);
                 }
                 break;
             case 1:
                 for (i = 0; i != cStride; i++) {
                     sox_int16_t s16 = SOX_SAMPLE_TO_SIGNED_16BIT(pInput[i], cClips);
-                    ((sox_int16_t*)pPriv->pOutput)[i] = lsx_swapw(s16);
+                    ((sox_int16_t*)pOutput)[i] = lsx_swapw(s16);
                 }
                 break;
             case 2:
                 for (i = 0; i != cStride; i++) {
-                    ((sox_int32_t*)pPriv->pOutput)[i] =
+                    ((sox_int32_t*)pOutput)[i] =
                         lsx_swapdw(SOX_SAMPLE_TO_SIGNED_32BIT(pInput[i], cClips));
                 }
                 break;
@@ -394,25 +471,33 @@ static size_t osswrite(
             {
             case 0:
                 for (i = 0; i != cStride; i++) {
-                    ((sox_uint8_t*)pPriv->pOutput)[i] =
+                    ((sox_uint8_t*)pOutput)[i] =
                         SOX_SAMPLE_TO_UNSIGNED_8BIT(pInput[i], cClips);
                 }
                 break;
             case 1:
                 for (i = 0; i != cStride; i++) {
-                    ((sox_int16_t*)pPriv->pOutput)[i] =
+                    ((sox_int16_t*)pOutput)[i] =
                         SOX_SAMPLE_TO_SIGNED_16BIT(pInput[i], cClips);
                 }
                 break;
             case 2:
                 for (i = 0; i != cStride; i++) {
-                    ((sox_int32_t*)pPriv->pOutput)[i] =
+                    ((sox_int32_t*)pOutput)[i] =
                         SOX_SAMPLE_TO_SIGNED_32BIT(pInput[i], cClips);
                 }
                 break;
             }
         }
 
+        cInputRemaining -= cStride;
+        pInput += cStride;
+        if (pPriv->nonblock) {
+            if (ossflush(ft, pPriv->cbRing) != SOX_SUCCESS)
+                return 0;
+            continue;
+        }
+
         cbStride = cStride << pPriv->sample_shift;
         i = 0;
         do {
@@ -423,9 +508,6 @@ static size_t osswrite(
                 return 0;
             }
         } while (i != cbStride);
-
-        cInputRemaining -= cStride;
-        pInput += cStride;
     }
 
     return cInput;
@@ -443,7 +525,7 @@ LSX_FORMAT_HANDLER(oss)
     names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
     ossinit, ossread, ossstop,
     ossinit, osswrite, ossstop,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
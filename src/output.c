@@ -52,7 +52,8 @@ sox_effect_handler_t const * lsx_output_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "output", NULL, SOX_EFF_MCHAN | SOX_EFF_INTERNAL,
-    getopts, NULL, flow, NULL, NULL, NULL, sizeof(priv_t)
+    getopts, NULL, flow, NULL, NULL, NULL, sizeof(priv_t),
+    lsx_reset_stateless, NULL, NULL, NULL
   };
   return &handler;
 }
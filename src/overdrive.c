@@ -15,16 +15,41 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+/* The clipping is memoryless, so is done a block at a time (and may be
+ * over-sampled, -o, by the shared waveshaper; see waveshaper.c); only the
+ * DC-blocking filter that follows it need run sample by sample. */
+
 #include "sox_i.h"
+#include "waveshaper.h"
+#include <string.h>
+
+#define BLOCK ((size_t)2048) /* Samples shaped at a time */
 
 typedef struct {
   double gain, colour, last_in, last_out, b0, b1, a1;
+  unsigned         factor;
+  lsx_waveshaper_t shaper;
+  double           * dry, * wet; /* dry is delayed to match the shaper */
+  size_t           skip, flush;  /* The shaper's delay, at each end */
 } priv_t;
 
 static int create(sox_effect_t * effp, int argc, char * * argv)
 {
   priv_t * p = (priv_t *)effp->priv;
-  --argc, ++argv;
+  lsx_getopt_t optstate;
+  int c;
+
+  p->factor = 1;
+  lsx_getopt_init(argc, argv, "+o:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'o', factor, 1, 4)
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  if (p->factor == 3) {
+    lsx_fail("over-sampling factor must be 1, 2 or 4");
+    return SOX_EOF;
+  }
+  argc -= optstate.ind, argv += optstate.ind;
   p->gain = p->colour = 20;
   do {
     NUMERIC_PARAMETER(gain, 0, 100)
@@ -35,6 +60,18 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   return argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static void clip(void * data, double * x, size_t len)
+{
+  priv_t const * p = (priv_t const *)data;
+  double gain = p->gain, colour = p->colour;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    double d = x[i] * gain + colour;
+    x[i] = d < -1? -2./3 : d > 1? 2./3 : d - d * d * d * (1./3);
+  }
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -42,30 +79,85 @@ static int start(sox_effect_t * effp)
   if (p->gain == 1)
     return SOX_EFF_NULL;
 
+  p->shaper.shape = clip;
+  p->shaper.data = p;
+  lsx_waveshaper_start(&p->shaper, p->factor, BLOCK);
+  p->skip = p->flush = p->shaper.delay;
+  p->dry = lsx_calloc(p->shaper.delay + BLOCK, sizeof(*p->dry));
+  p->wet = lsx_malloc(BLOCK * sizeof(*p->wet));
+  p->last_in = p->last_out = 0;
   return SOX_SUCCESS;
 }
 
+/* Distorts len (<= BLOCK) samples of ibuf (or silence, if NULL) to obuf,
+ * returning the number written. */
+static size_t process(priv_t * p, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t len)
+{
+  double * dry = p->dry + p->shaper.delay, * wet = p->wet;
+  double last_in = p->last_in, last_out = p->last_out;
+  size_t i, dummy = 0, skip = min(p->skip, len);
+
+  for (i = 0; i < len; ++i)
+    dry[i] = wet[i] = ibuf? SOX_SAMPLE_TO_FLOAT_64BIT(ibuf[i], dummy) : 0;
+  lsx_waveshaper_shape(&p->shaper, wet, len);
+  p->skip -= skip;
+  for (i = skip; i < len; ++i) {
+    last_out = wet[i] - last_in + .995 * last_out;
+    last_in = wet[i];
+    wet[i] = last_out;
+  }
+  p->last_in = last_in, p->last_out = last_out;
+  for (i = skip; i < len; ++i) {
+    SOX_SAMPLE_LOCALS;
+    *obuf++ = SOX_FLOAT_64BIT_TO_SAMPLE(p->dry[i] * .5 + wet[i] * .75, dummy);
+  }
+  memmove(p->dry, p->dry + len, p->shaper.delay * sizeof(*dry));
+  return len - skip;
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t dummy = 0, len = *isamp = *osamp = min(*isamp, *osamp);
-  while (len--) {
-    SOX_SAMPLE_LOCALS;
-    double d = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf++, dummy), d0 = d;
-    d *= p->gain;
-    d += p->colour;
-    d = d < -1? -2./3 : d > 1? 2./3 : d - d * d * d * (1./3);
-    p->last_out = d - p->last_in + .995 * p->last_out;
-    p->last_in = d;
-    *obuf++ = SOX_FLOAT_64BIT_TO_SAMPLE(d0 * .5 + p->last_out * .75, dummy);
+  size_t n, len = *isamp = min(*isamp, *osamp);
+
+  for (*osamp = 0; len; ibuf += n, len -= n) {
+    n = min(len, BLOCK);
+    *osamp += process(p, ibuf, obuf + *osamp, n);
   }
   return SOX_SUCCESS;
 }
 
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t n, done = 0;
+
+  for (; p->flush && done < *osamp; p->flush -= n) {
+    n = min(min(p->flush, *osamp - done), BLOCK);
+    done += process(p, NULL, obuf + done, n);
+  }
+  *osamp = done;
+  return p->flush? SOX_SUCCESS : SOX_EOF;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  lsx_waveshaper_stop(&p->shaper);
+  free(p->dry);
+  free(p->wet);
+  return SOX_SUCCESS;
+}
+
 sox_effect_handler_t const * lsx_overdrive_effect_fn(void)
 {
-  static sox_effect_handler_t handler = {"overdrive", "[gain [colour]]",
-    SOX_EFF_GAIN, create, start, flow, NULL, NULL, NULL, sizeof(priv_t)};
+  static sox_effect_handler_t handler = {"overdrive",
+    "[-o factor] [gain [colour]]"
+    "\n  -o factor  Over-sample by 2 or 4 to reduce aliasing",
+    SOX_EFF_GAIN | SOX_EFF_INPLACE | SOX_EFF_RTSAFE, create, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
   return &handler;
 }
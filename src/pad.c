@@ -173,8 +173,9 @@ static int lsx_kill(sox_effect_t * effp)
 sox_effect_handler_t const * lsx_pad_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "pad", "{length[@position]}", SOX_EFF_MCHAN|SOX_EFF_LENGTH|SOX_EFF_MODIFY,
-    create, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+    "pad", "{length[@position]}", SOX_EFF_MCHAN|SOX_EFF_LENGTH|SOX_EFF_MODIFY|SOX_EFF_RTSAFE,
+    create, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
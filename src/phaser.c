@@ -44,17 +44,18 @@
 #include "sox_i.h"
 #include <string.h>
 
+#define BLOCK_LEN 1024 /* Samples processed per block */
+
 typedef struct {
   double     in_gain, out_gain, delay_ms, decay, mod_speed;
   lsx_wave_t mod_type;
 
-  int        * mod_buf;
-  size_t     mod_buf_len;
-  int        mod_pos;
-            
+  lsx_lfo_t  mod;
+  double     mod_block[BLOCK_LEN];
+
   double     * delay_buf;
   size_t     delay_buf_len;
-  int        delay_pos;
+  size_t     delay_pos;
 } priv_t;
 
 static int getopts(sox_effect_t * effp, int argc, char * * argv)
@@ -98,12 +99,11 @@ static int start(sox_effect_t * effp)
   p->delay_buf_len = p->delay_ms * .001 * effp->in_signal.rate + .5;
   p->delay_buf = lsx_calloc(p->delay_buf_len, sizeof(*p->delay_buf));
 
-  p->mod_buf_len = effp->in_signal.rate / p->mod_speed + .5;
-  p->mod_buf = lsx_malloc(p->mod_buf_len * sizeof(*p->mod_buf));
-  lsx_generate_wave_table(p->mod_type, SOX_INT, p->mod_buf, p->mod_buf_len,
+  lsx_lfo_create(&p->mod, p->mod_type, SOX_INT,
+      (size_t)(effp->in_signal.rate / p->mod_speed + .5),
       1., (double)p->delay_buf_len, M_PI_2);
 
-  p->delay_pos = p->mod_pos = 0;
+  p->delay_pos = 0;
 
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* TODO: calculate actual length */
   return SOX_SUCCESS;
@@ -113,17 +113,25 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf,
     sox_sample_t *obuf, size_t *isamp, size_t *osamp)
 {
   priv_t * p = (priv_t *) effp->priv;
-  size_t len = *isamp = *osamp = min(*isamp, *osamp);
-
-  while (len--) {
-    double d = *ibuf++ * p->in_gain + p->delay_buf[
-      (p->delay_pos + p->mod_buf[p->mod_pos]) % p->delay_buf_len] * p->decay;
-    p->mod_pos = (p->mod_pos + 1) % p->mod_buf_len;
-    
-    p->delay_pos = (p->delay_pos + 1) % p->delay_buf_len;
-    p->delay_buf[p->delay_pos] = d;
-
-    *obuf++ = SOX_ROUND_CLIP_COUNT(d * p->out_gain, effp->clips);
+  size_t len = *isamp = *osamp = min(*isamp, *osamp), n, i;
+
+  /* The modulation is looked up a block at a time; with delays down to 1,
+   * the feedback loop goes a sample at a time. */
+  for (; len; len -= n) {
+    n = min(len, BLOCK_LEN);
+    lsx_lfo_read(&p->mod, (size_t)0, p->mod_block, n);
+    lsx_lfo_advance(&p->mod, n);
+    for (i = 0; i < n; ++i) {
+      size_t k = p->delay_pos + (size_t)p->mod_block[i];
+      double d = *ibuf++ * p->in_gain + p->delay_buf[
+        k < p->delay_buf_len? k : k - p->delay_buf_len] * p->decay;
+
+      if (++p->delay_pos == p->delay_buf_len)
+        p->delay_pos = 0;
+      p->delay_buf[p->delay_pos] = d;
+
+      *obuf++ = SOX_ROUND_CLIP_COUNT(d * p->out_gain, effp->clips);
+    }
   }
   return SOX_SUCCESS;
 }
@@ -133,7 +141,7 @@ static int stop(sox_effect_t * effp)
   priv_t * p = (priv_t *) effp->priv;
 
   free(p->delay_buf);
-  free(p->mod_buf);
+  lsx_lfo_delete(&p->mod);
   return SOX_SUCCESS;
 }
 
@@ -141,7 +149,8 @@ sox_effect_handler_t const * lsx_phaser_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "phaser", "gain-in gain-out delay decay speed [ -s | -t ]",
-    SOX_EFF_LENGTH | SOX_EFF_GAIN, getopts, start, flow, NULL, stop, NULL, sizeof(priv_t)
+    SOX_EFF_LENGTH | SOX_EFF_GAIN | SOX_EFF_RTSAFE, getopts, start, flow, NULL, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -443,7 +443,7 @@ LSX_FORMAT_HANDLER(prc)
     names, SOX_FILE_LIT_END | SOX_FILE_MONO,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    seek, write_encodings, write_rates, sizeof(priv_t)
+    seek, write_encodings, write_rates, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -0,0 +1,384 @@
+/* libSoX effect: Phase vocoder: change tempo and/or pitch  (c) 2026 SoX contributors
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Frames of the input, Hann-windowed, are taken every `ahop' samples and
+ * transformed.  The true frequency of each peak in the spectrum is found
+ * from the advance of its phase since the previous frame, and frames are
+ * resynthesised every `hop' samples, each peak's phase advancing by its
+ * frequency (times the pitch ratio); the bins around a peak keep their
+ * phases relative to it (`identity phase locking').  To shift the pitch,
+ * each bin is then moved to the bin nearest its frequency times the pitch
+ * ratio.  So the tempo is changed by the ratio of the hops and the pitch by
+ * moving bins, both in the one pass and with no resampling.  Each channel is
+ * independent, so the channels of a batch of frames are processed
+ * concurrently. */
+
+#include "sox_i.h"
+#include "fifo.h"
+#include <string.h>
+
+#define MAX_FRAMES 32  /* Most frames processed in a batch */
+#define PEAK_FLOOR 1e-7 /* Peaks are from -70dB of a frame's loudest bin */
+
+typedef struct {        /* Spectra are of bins complex values: */
+  float  * frame;      /* Windowed input, its spectrum, then the output */
+                       /* (+ 2, for a bins complex spectrum) */
+  float  * ola;        /* Overlap-add of output frames */
+  float  * xr, * xi;   /* Analysis spectrum */
+  float  * lr, * li;   /* Analysis spectrum of the last frame */
+  float  * yr, * yi;   /* Synthesis spectrum (before shifting) */
+  float  * pow;        /* Analysis power of each bin */
+  size_t * peaks;      /* Bins that are peaks in power */
+} chan_t;
+
+typedef struct {
+  /* Options: */
+  int      quality;    /* 0 quick, 1 default, 2 high */
+  double   factor;     /* Tempo; > 1 for faster */
+  double   cents;      /* Pitch shift */
+
+  /* Set up by start: */
+  size_t   channels, dft_length, bins, hop;
+  double   ahop, ratio, gain;
+  float    * window;
+  chan_t   * chans;
+  fifo_t   input_fifo, output_fifo;  /* Of wide (interleaved) samples */
+  double   origin;     /* Where the first frame starts in the input */
+  double   prev;       /* Where the last frame started in the input */
+  uint64_t frames;     /* Frames processed */
+  uint64_t dropped;    /* Input samples dropped from input_fifo */
+  uint64_t samples_in, samples_out, skip, target;
+  sox_bool flushing;
+} priv_t;
+
+static int getopts(sox_effect_t * effp, int argc, char **argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int c;
+  lsx_getopt_t optstate;
+  lsx_getopt_init(argc, argv, "+qh", NULL, lsx_getopt_flag_none, 1, &optstate);
+
+  p->quality = 1;
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    case 'q': p->quality = 0; break;
+    case 'h': p->quality = 2; break;
+    default: lsx_fail("unknown option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  if (!argc)
+    return lsx_usage(effp);
+  do {                    /* break-able block */
+    NUMERIC_PARAMETER(factor, 0.1  , 10  )
+    NUMERIC_PARAMETER(cents , -2400, 2400)
+  } while (0);
+  return argc? lsx_usage(effp) : SOX_SUCCESS;
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  static const double frame_ms[] = {23, 46, 93};
+  static const unsigned overlaps[] = {4, 4, 8};
+  size_t i, n = (size_t)(effp->in_signal.rate * frame_ms[p->quality] / 1000);
+  unsigned overlap = overlaps[p->quality];
+
+  if (p->factor == 1 && p->cents == 0)
+    return SOX_EFF_NULL;
+
+  p->channels = effp->in_signal.channels;
+  p->ratio = pow(2., p->cents / 1200);
+  for (p->dft_length = 256; p->dft_length * 3 / 2 < n; p->dft_length <<= 1);
+  p->bins = p->dft_length / 2 + 1;
+  p->hop = p->dft_length / overlap;
+  p->ahop = p->hop * p->factor;
+  /* Undo the inverse DFT's scaling, and the sum (3/8 per frame) of the
+   * overlapping squared Hann windows: */
+  p->gain = 2. / p->dft_length / (.375 * overlap);
+
+  p->window = lsx_malloc(p->dft_length * sizeof(*p->window));
+  for (i = 0; i < p->dft_length; ++i)
+    p->window[i] = .5 - .5 * cos(2 * M_PI * i / p->dft_length);
+  p->chans = lsx_calloc(p->channels, sizeof(*p->chans));
+  for (i = 0; i < p->channels; ++i) {
+    chan_t * c = &p->chans[i];
+    c->frame = lsx_malloc((p->dft_length + 2) * sizeof(*c->frame));
+    c->ola = lsx_calloc(p->dft_length, sizeof(*c->ola));
+    c->xr = lsx_malloc(p->bins * sizeof(*c->xr));
+    c->xi = lsx_malloc(p->bins * sizeof(*c->xi));
+    c->lr = lsx_calloc(p->bins, sizeof(*c->lr));
+    c->li = lsx_calloc(p->bins, sizeof(*c->li));
+    c->yr = lsx_calloc(p->bins, sizeof(*c->yr));
+    c->yi = lsx_calloc(p->bins, sizeof(*c->yi));
+    c->pow = lsx_malloc(p->bins * sizeof(*c->pow));
+    c->peaks = lsx_malloc(p->bins * sizeof(*c->peaks));
+  }
+
+  /* Frame m (from -overlap/2) starts at m * ahop - dft_length/2 in the
+   * input, and at m * hop - dft_length/2 in the output, so that output
+   * position 0 corresponds to input position 0, and the first frame
+   * containing input is complete.  The input is preceded by zeros, and the
+   * output (from -dft_length) skipped, accordingly. */
+  fifo_create(&p->input_fifo, p->channels * sizeof(float));
+  fifo_create(&p->output_fifo, p->channels * sizeof(float));
+  n = (size_t)ceil(overlap / 2 * p->ahop + p->dft_length / 2);
+  memset(fifo_reserve(&p->input_fifo, n), 0, n * p->channels * sizeof(float));
+  p->origin = n - (overlap / 2 * p->ahop + p->dft_length / 2);
+  p->prev = p->origin - p->ahop;
+  p->frames = p->dropped = 0;
+  p->skip = p->dft_length;
+  p->samples_in = p->samples_out = 0;
+  p->flushing = sox_false;
+
+  effp->out_signal.length = SOX_UNKNOWN_LEN;
+  if (effp->in_signal.length != SOX_UNKNOWN_LEN) {
+    uint64_t in_length = effp->in_signal.length / p->channels;
+    uint64_t out_length = in_length / p->factor + .5;
+    effp->out_signal.length = out_length * p->channels;
+  }
+  lsx_debug("dft_length=%" PRIuPTR " hop=%" PRIuPTR " ahop=%g ratio=%g",
+      p->dft_length, p->hop, p->ahop, p->ratio);
+  return SOX_SUCCESS;
+}
+
+static double wrap(double phase)  /* To [-pi, pi) */
+{
+  return phase - 2 * M_PI * floor(phase / (2 * M_PI) + .5);
+}
+
+/* Processes channel ch of a frame starting at in (interleaved), dh samples
+ * after the last; outputs hop samples to out (interleaved) */
+static void frame(priv_t * p, size_t ch, float const * in, double dh,
+    float * out)
+{
+  chan_t * c = &p->chans[ch];
+  size_t i, k, j, n = p->dft_length, bins = p->bins, npeaks;
+  float * f = c->frame, * t;
+  double expect = 2 * M_PI * dh / n, advance = 2 * M_PI * p->hop / n;
+  float floor_pow;
+
+  for (i = 0; i < n; ++i)
+    f[i] = in[i * p->channels] * p->window[i];
+  lsx_safe_rdft_f((int)n, 1, f);
+
+  /* Analysis.  N.B. the DFT's bins are at f[2k], -f[2k+1], bar the
+   * real-valued 0 and n/2 at f[0], f[1]. */
+  c->xr[0] = f[0], c->xi[0] = 0;
+  c->xr[bins - 1] = f[1], c->xi[bins - 1] = 0;
+  for (k = 1; k < bins - 1; ++k)
+    c->xr[k] = f[2 * k], c->xi[k] = -f[2 * k + 1];
+  for (floor_pow = 0, k = 0; k < bins; ++k) {
+    c->pow[k] = c->xr[k] * c->xr[k] + c->xi[k] * c->xi[k];
+    floor_pow = max(floor_pow, c->pow[k]);
+  }
+  floor_pow *= PEAK_FLOOR;
+  for (npeaks = 0, k = 0; k < bins; ++k)
+    if (c->pow[k] > floor_pow && (k == 0 || c->pow[k] > c->pow[k - 1]) &&
+        (k == bins - 1 || c->pow[k] >= c->pow[k + 1]))
+      c->peaks[npeaks++] = k;
+
+  /* Advance the phase of each peak by its frequency (times the pitch
+   * ratio), and lock the bins around it to it (`identity phase locking'),
+   * as far as the quietest bin between it and the next peak: i.e. rotate
+   * them all by the peak's change of phase, so only peaks need trig.  To
+   * shift the pitch, this region is moved as a whole to centre on the
+   * peak's new bin (where regions then overlap, they are added). */
+  memset(f, 0, (n + 2) * sizeof(*f));
+  t = f;  /* The (shifted) synthesis spectrum, as xr, xi */
+  for (k = 0, i = 0; i < npeaks; ++i) {
+    size_t peak = c->peaks[i], end = bins;
+    size_t shift = (size_t)(peak * p->ratio + .5) - peak; /* Mod 2^N */
+    double xr = c->xr[peak], xi = c->xi[peak], lr = c->lr[peak], li = c->li[peak];
+    double d = wrap(atan2(xi * lr - xr * li, xr * lr + xi * li) - peak * expect);
+    double w = (peak + d / expect) * p->ratio * advance, cw = cos(w), sw = sin(w);
+    double ur = c->yr[peak], ui = c->yi[peak], m = sqrt(ur * ur + ui * ui);
+    double er, ei, rr, ri;
+
+    if (m > 0)  /* e^i(last synthesis phase + w), without atan2: */
+      ur /= m, ui /= m;
+    else ur = 1, ui = 0;
+    er = ur * cw - ui * sw, ei = ur * sw + ui * cw;
+    m = 1 / sqrt(c->pow[peak]);   /* Rotation from xr, xi to that phase: */
+    rr = (er * xr + ei * xi) * m;
+    ri = (ei * xr - er * xi) * m;
+
+    if (i + 1 < npeaks)
+      for (end = j = peak; j < c->peaks[i + 1]; ++j)
+        if (c->pow[j] < c->pow[end])
+          end = j;
+    for (; k < end; ++k) {
+      c->yr[k] = c->xr[k] * rr - c->xi[k] * ri;
+      c->yi[k] = c->xr[k] * ri + c->xi[k] * rr;
+      if ((j = k + shift) < bins) {
+        t[2 * j] += c->yr[k];
+        t[2 * j + 1] += c->yi[k];
+      }
+    }
+  }
+  if (!npeaks) {  /* Silence */
+    memset(c->yr, 0, bins * sizeof(*c->yr));
+    memset(c->yi, 0, bins * sizeof(*c->yi));
+  }
+  memcpy(c->lr, c->xr, bins * sizeof(*c->xr));
+  memcpy(c->li, c->xi, bins * sizeof(*c->xi));
+
+  /* Synthesis: pack as the inverse DFT needs (see above) */
+  f[1] = f[2 * (bins - 1)];
+  for (k = 1; k < bins - 1; ++k)
+    f[2 * k + 1] = -f[2 * k + 1];
+  lsx_safe_rdft_f((int)n, -1, f);
+
+  for (i = 0; i < n; ++i)
+    c->ola[i] += f[i] * p->window[i] * p->gain;
+  for (i = 0; i < p->hop; ++i)
+    out[i * p->channels] = c->ola[i];
+  memmove(c->ola, c->ola + p->hop, (n - p->hop) * sizeof(*c->ola));
+  memset(c->ola + n - p->hop, 0, p->hop * sizeof(*c->ola));
+}
+
+/* Processes the frames that the input allows, in batches */
+static void process(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t starts[MAX_FRAMES];
+  double dhs[MAX_FRAMES];
+
+  while (sox_true) {
+    size_t k, frames = 0, avail = fifo_occupancy(&p->input_fifo);
+    float const * in = fifo_read_ptr(&p->input_fifo);
+    float * out;
+    int ch;
+    size_t threads;
+
+    for (; frames < MAX_FRAMES; ++frames, ++p->frames) {
+      /* From the frame count, so not depending on how input is buffered: */
+      double start = floor(p->origin + p->frames * p->ahop);
+      size_t i0 = (size_t)(start - p->dropped);
+      if (i0 + p->dft_length > avail)
+        break;
+      starts[frames] = i0;
+      dhs[frames] = start - p->prev;
+      p->prev = start;
+    }
+    if (!frames)
+      break;
+    out = fifo_reserve(&p->output_fifo, frames * p->hop);
+
+    threads = lsx_effect_threads(effp, p->channels);
+    #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+    for (ch = 0; ch < (int)p->channels; ++ch) {
+      size_t m;
+      for (m = 0; m < frames; ++m)
+        frame(p, (size_t)ch, in + starts[m] * p->channels + ch, dhs[m],
+            out + m * p->hop * p->channels + ch);
+    }
+    lsx_threads_give(effp->global_info->global_info, threads);
+
+    k = (size_t)(floor(p->origin + p->frames * p->ahop) - p->dropped);
+    k = min(k, avail);  /* Input no longer needed */
+    fifo_read(&p->input_fifo, k, NULL);
+    p->dropped += k;
+    if (p->skip) {
+      k = min(p->skip, fifo_occupancy(&p->output_fifo));
+      fifo_read(&p->output_fifo, k, NULL);
+      p->skip -= k;
+    }
+  }
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+                sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t i, odone = min(*osamp / p->channels, fifo_occupancy(&p->output_fifo));
+  float const * s;
+  SOX_SAMPLE_LOCALS;
+
+  if (p->flushing)
+    odone = min(odone, p->target - p->samples_out);
+  s = fifo_read(&p->output_fifo, odone, NULL);
+  for (i = 0; i < odone * p->channels; ++i)
+    *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(*s++, effp->clips);
+  p->samples_out += odone;
+
+  if (*isamp && odone < *osamp / p->channels) {
+    size_t n = *isamp / p->channels;
+    float * t = fifo_reserve(&p->input_fifo, n);
+    for (i = n * p->channels; i; --i)
+      *t++ = SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
+    *isamp = n * p->channels;
+    p->samples_in += n;
+    process(effp);
+  }
+  else *isamp = 0;
+
+  *osamp = odone * p->channels;
+  return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  static size_t isamp = 0;
+
+  if (!p->flushing) {  /* Pad with zeros until the output is complete */
+    p->flushing = sox_true;
+    p->target = p->samples_in / p->factor + .5;
+    while (p->samples_out + fifo_occupancy(&p->output_fifo) < p->target
+        || p->skip) {
+      memset(fifo_reserve(&p->input_fifo, p->dft_length), 0,
+          p->dft_length * p->channels * sizeof(float));
+      process(effp);
+    }
+  }
+  return flow(effp, 0, obuf, &isamp, osamp);
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t i;
+
+  for (i = 0; i < p->channels; ++i) {
+    chan_t * c = &p->chans[i];
+    free(c->frame);
+    free(c->ola);
+    free(c->xr);
+    free(c->xi);
+    free(c->lr);
+    free(c->li);
+    free(c->yr);
+    free(c->yi);
+    free(c->pow);
+    free(c->peaks);
+  }
+  free(p->chans);
+  free(p->window);
+  fifo_delete(&p->output_fifo);
+  fifo_delete(&p->input_fifo);
+  return SOX_SUCCESS;
+}
+
+sox_effect_handler_t const * lsx_pvoc_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {
+    "pvoc", "[-q | -h] factor [shift-in-cents]",
+    SOX_EFF_MCHAN | SOX_EFF_LENGTH,
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
+  };
+  return &handler;
+}
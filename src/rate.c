@@ -34,15 +34,10 @@
 #define malloc     lsx_malloc
 #define raw_coef_t double
 
-#if 0 /* For float32 version, as used in foobar */
-  #define sample_t   float
-  #define num_coefs4 ((num_coefs + 3) & ~3) /* align coefs for SSE */
-  #define coefs4_check(i) ((i) < num_coefs)
-#else
-  #define sample_t   double
-  #define num_coefs4 num_coefs
-  #define coefs4_check(i) 1
-#endif
+#define sample_t   double
+#define RATE_LANES 4   /* Most channels that a rate_t resamples in lock-step */
+#define num_coefs4 ((num_coefs + 3) & ~3) /* Pad FIRs for rate_dot(): */
+#define fir_len4(n) (((n) + 3) & ~3)      /* zeros follow the coefs */
 
 #if defined M_PIl
   #define hi_prec_clock_t long double /* __float128 is also a (slow) option */
@@ -50,20 +45,21 @@
   #define hi_prec_clock_t double
 #endif
 
-#define coef(coef_p, interp_order, fir_len, phase_num, coef_interp_num, fir_coef_num) coef_p[(fir_len) * ((interp_order) + 1) * (phase_num) + ((interp_order) + 1) * (fir_coef_num) + (interp_order - coef_interp_num)]
+/* Each phase has a row of fir_len coefs for each interpolation coef number */
+#define coef(coef_p, interp_order, fir_len, phase_num, coef_interp_num, fir_coef_num) coef_p[(fir_len) * ((interp_order) + 1) * (phase_num) + (fir_len) * (coef_interp_num) + (fir_coef_num)]
 
 static sample_t * prepare_coefs(raw_coef_t const * coefs, int num_coefs,
     int num_phases, int interp_order, int multiplier)
 {
   int i, j, length = num_coefs4 * num_phases;
-  sample_t * result = malloc(length * (interp_order + 1) * sizeof(*result));
+  sample_t * result = calloc(length * (interp_order + 1), sizeof(*result));
   double fm1 = coefs[0], f1 = 0, f2 = 0;
 
-  for (i = num_coefs4 - 1; i >= 0; --i)
+  for (i = num_coefs - 1; i >= 0; --i)
     for (j = num_phases - 1; j >= 0; --j) {
       double f0 = fm1, b = 0, c = 0, d = 0; /* = 0 to kill compiler warning */
       int pos = i * num_phases + j - 1;
-      fm1 = coefs4_check(i) && pos > 0 ? coefs[pos - 1] * multiplier : 0;
+      fm1 = pos > 0 ? coefs[pos - 1] * multiplier : 0;
       switch (interp_order) {
         case 1: b = f1 - f0; break;
         case 2: b = f1 - (.5 * (f2+f0) - f1) - f0; c = .5 * (f2+f0) - f1; break;
@@ -71,7 +67,7 @@ static sample_t * prepare_coefs(raw_coef_t const * coefs, int num_coefs,
         default: if (interp_order) assert(0);
       }
       #define coef_coef(x) \
-        coef(result, interp_order, num_coefs4, j, x, num_coefs4 - 1 - i)
+        coef(result, interp_order, num_coefs4, j, x, num_coefs - 1 - i)
       coef_coef(0) = f0;
       if (interp_order > 0) coef_coef(1) = b;
       if (interp_order > 1) coef_coef(2) = c;
@@ -83,12 +79,14 @@ static sample_t * prepare_coefs(raw_coef_t const * coefs, int num_coefs,
 }
 
 typedef struct { /* So generated filter coefs may be shared between channels */
-  sample_t   * poly_fir_coefs;
+  sample_t const * poly_fir_coefs; /* From lsx_design_get/put */
   dft_filter_t dft_filter[2];
 } rate_shared_t;
 
+/* A stage function runs stage input[k] of each of the lanes, into the fifo
+ * of the next stage (stage_output), as if it ran for each lane in turn */
 struct stage;
-typedef void (* stage_fn_t)(struct stage * input, fifo_t * output);
+typedef void (* stage_fn_t)(struct stage * input, int lanes);
 typedef struct stage {
   /* Common to all stage types: */
   stage_fn_t fn;
@@ -121,27 +119,9 @@ typedef struct stage {
 
 #define stage_occupancy(s) max(0, fifo_occupancy(&(s)->fifo) - (s)->pre_post)
 #define stage_read_p(s) ((sample_t *)fifo_read_ptr(&(s)->fifo) + (s)->pre)
+#define stage_output(s, lanes, k) (&(s)[(lanes) + (k)].fifo)
 
-static void cubic_stage_fn(stage_t * p, fifo_t * output_fifo)
-{
-  int i, num_in = stage_occupancy(p), max_num_out = 1 + num_in*p->out_in_ratio;
-  sample_t const * input = stage_read_p(p);
-  sample_t * output = fifo_reserve(output_fifo, max_num_out);
-
-  for (i = 0; p->at.parts.integer < num_in; ++i, p->at.all += p->step.all) {
-    sample_t const * s = input + p->at.parts.integer;
-    sample_t x = p->at.parts.fraction * (1 / MULT32);
-    sample_t b = .5*(s[1]+s[-1])-*s, a = (1/6.)*(s[2]-s[1]+s[-1]-*s-4*b);
-    sample_t c = s[1]-*s-a-b;
-    output[i] = ((a*x + b)*x + c)*x + *s;
-  }
-  assert(max_num_out - i >= 0);
-  fifo_trim_by(output_fifo, max_num_out - i);
-  fifo_read(&p->fifo, p->at.parts.integer, NULL);
-  p->at.parts.integer = 0;
-}
-
-static void dft_stage_fn(stage_t * p, fifo_t * output_fifo)
+static void dft_stage_fn1(stage_t * p, fifo_t * output_fifo)
 {
   sample_t * output, tmp;
   int i, j, num_in = max(0, fifo_occupancy(&p->fifo));
@@ -213,6 +193,14 @@ static void dft_stage_fn(stage_t * p, fifo_t * output_fifo)
   }
 }
 
+static void dft_stage_fn(stage_t * p, int lanes)
+{
+  int k;
+
+  for (k = 0; k < lanes; ++k)
+    dft_stage_fn1(&p[k], stage_output(p, lanes, k));
+}
+
 static void dft_stage_init(
     unsigned instance, double Fp, double Fs, double Fn, double att,
     double phase, stage_t * stage, int L, int M)
@@ -222,18 +210,26 @@ static void dft_stage_init(
   if (!f->num_taps) {
     int num_taps = 0, dft_length, i;
     int k = phase == 50 && lsx_is_power_of_2(L) && Fn == L? L << 1 : 4;
-    double * h = lsx_design_lpf(Fp, Fs, Fn, att, &num_taps, -k, -1.);
-
-    if (phase != 50)
-      lsx_fir_to_phase(&h, &num_taps, &f->post_peak, phase);
-    else f->post_peak = num_taps / 2;
+    double key[6];
+    double const * h;
+
+    key[0] = Fp, key[1] = Fs, key[2] = Fn, key[3] = att, key[4] = phase;
+    key[5] = k;
+    if (!(h = lsx_design_get("rate", key, 6, &num_taps, &f->post_peak))) {
+      double * h1 = lsx_design_lpf(Fp, Fs, Fn, att, &num_taps, -k, -1.);
+
+      if (phase != 50)
+        lsx_fir_to_phase(&h1, &num_taps, &f->post_peak, phase);
+      else f->post_peak = num_taps / 2;
+      h = lsx_design_put("rate", key, 6, h1, num_taps, f->post_peak);
+    }
 
     dft_length = lsx_set_dft_length(num_taps);
     f->coefs = calloc(dft_length, sizeof(*f->coefs));
     for (i = 0; i < num_taps; ++i)
       f->coefs[(i + dft_length - num_taps + 1) & (dft_length - 1)]
         = h[i] / dft_length * 2 * L;
-    free(h);
+    lsx_design_release(h);
     f->num_taps = num_taps;
     f->dft_length = dft_length;
     lsx_safe_rdft(dft_length, 1, f->coefs);
@@ -248,20 +244,35 @@ static void dft_stage_init(
   stage->dft_filter_num = instance;
 }
 
+#include "rate_dot.h"
+#include "rate_cubic.h"
+
+void lsx_rate_dispatch(unsigned cpu)
+{
+  rate_dot_init(cpu);
+  rate_cubic_init(cpu);
+}
+
 #include "rate_filters.h"
 
 typedef struct {
   double     factor;
-  uint64_t   samples_in, samples_out;
-  int        num_stages;
-  stage_t    * stages;
+  uint64_t   samples_in, samples_out; /* Of each lane */
+  int        arb;         /* Index of the arbitrary-ratio stage, or -1 */
+  double     arb_step;    /* Its step as set up, in input samples */
+  double     ratio;       /* Of its step now to arb_step (see rate_adjust) */
+  uint64_t   in_before;   /* Input (of each lane) before the ratio was set */
+  double     out_before;  /* The output due for that, at the ratios before */
+  int        num_stages, lanes;
+  stage_t    * stages;    /* Stage i of lane k is stages[i * lanes + k] */
+  stage_t    * initial;   /* The stages as set up, for rate_reset */
 } rate_t;
 
 #define pre_stage       p->stages[shift]
 #define arb_stage       p->stages[shift + have_pre_stage]
 #define post_stage      p->stages[shift + have_pre_stage + have_arb_stage]
 #define have_pre_stage  (preM  * preL  != 1)
-#define have_arb_stage  (arbM  * arbL  != 1)
+#define have_arb_stage  (arbM  * arbL  != 1 || range)
 #define have_post_stage (postM * postL != 1)
 
 #define TO_3dB(a)       ((1.6e-6*a-7.5e-4)*a+.646)
@@ -271,13 +282,37 @@ typedef enum {
   rolloff_none, rolloff_small /* <= 0.01 dB */, rolloff_medium /* <= 0.35 dB */
 } rolloff_t;
 
+static void rate_adjust(rate_t * p, double ratio);
+
+/* Empties the stages and returns each to its initial state (but for the
+ * ratio set by rate_adjust, which is kept) */
+static void rate_reset(rate_t * p)
+{
+  int i, n = p->num_stages * p->lanes;
+
+  for (i = 0; i < n; ++i) {
+    stage_t * s = &p->stages[i];
+    fifo_t fifo = s->fifo;
+    *s = p->initial[i], s->fifo = fifo;
+    fifo_clear(&s->fifo);
+    memset(fifo_reserve(&s->fifo, s->preload), 0, sizeof(sample_t)*s->preload);
+  }
+  for (; i < n + p->lanes; ++i)
+    fifo_clear(&p->stages[i].fifo);
+  p->samples_in = p->samples_out = p->in_before = 0, p->out_before = 0;
+  if (p->ratio != 1)
+    rate_adjust(p, p->ratio);
+}
+
 static void rate_init(
   /* Private work areas (to be supplied by the client):                       */
   rate_t * p,                /* Per audio channel.                            */
   rate_shared_t * shared,    /* Between channels (undergoing same rate change)*/
+  int lanes,                 /* Channels to resample in lock-step, <= RATE_LANES*/
                             
   /* Public parameters:                                             Typically */
   double factor,             /* Input rate divided by output rate.            */
+  double range,              /* Variable ratio: most by which it may vary.  0 */
   double bits,               /* Required bit-accuracy (pass + stop)  16|20|28 */
   double phase,              /* Linear/minimum etc. filter phase.       50    */
   double bw_pc,              /* Pass-band % (0dB pt.) to preserve.   91.3|98.4*/
@@ -307,8 +342,10 @@ static void rate_init(
   assert(85 <= anti_aliasing_pc && anti_aliasing_pc <= 100);
 
   p->factor = factor;
+  p->lanes = lanes;
+  p->ratio = 1;
   if (bits) while (!n++) {                               /* Determine stages: */
-    int try, L, M, x, maxL = interpolator > 0? 1 : mode? 2048 :
+    int try, L, M, x, maxL = range? 0 : interpolator > 0? 1 : mode? 2048 :
       ceil(max_coefs_size * 1000. / (U100_l * sizeof(sample_t)));
     double d, epsilon = 0, frac;
     upsample = arbM < 1;
@@ -318,7 +355,7 @@ static void rate_init(
     preL = 1 + (!preM && arbM < 2) + (upsample && mode), arbM *= preL;
     if ((frac = arbM - (int)arbM))
       epsilon = fabs((uint32_t)(frac * MULT32 + .5) / (frac * MULT32) - 1);
-    for (i = 1, rational = !frac; i <= maxL && !rational; ++i) {
+    for (i = 1, rational = !frac && !range; i <= maxL && !rational; ++i) {
       d = frac * i, try = d + .5;
       if ((rational = fabs(try / d - 1) <= epsilon)) {    /* No long doubles! */
         if (try == i)
@@ -412,14 +449,22 @@ static void rate_init(
         coefs_size / 1000 > max_coefs_size);
 
     if (!arb_stage.shared->poly_fir_coefs) {
-      int num_taps = num_coefs * phases - 1;
-      raw_coef_t * coefs = lsx_design_lpf(
-          Fp, Fs, Fn, attArb, &num_taps, phases, f->beta);
-      arb_stage.shared->poly_fir_coefs = prepare_coefs(
-          coefs, num_coefs, phases, order, 1);
+      int num_taps = num_coefs * phases - 1, len, unused;
+      double key[8];
+
+      key[0] = Fp, key[1] = Fs, key[2] = Fn, key[3] = attArb;
+      key[4] = num_coefs, key[5] = phases, key[6] = f->beta, key[7] = order;
+      if (!(arb_stage.shared->poly_fir_coefs =
+            lsx_design_get("rate-poly", key, 8, &len, &unused))) {
+        raw_coef_t * coefs = lsx_design_lpf(
+            Fp, Fs, Fn, attArb, &num_taps, phases, f->beta);
+        arb_stage.shared->poly_fir_coefs = lsx_design_put("rate-poly", key, 8,
+            prepare_coefs(coefs, num_coefs, phases, order, 1),
+            (int)(coefs_size / sizeof(sample_t)), 0);
+        free(coefs);
+      }
       lsx_debug("fir_len=%i phases=%i coef_interp=%i size=%s",
           num_coefs, phases, order, lsx_sigfigs3((double)coefs_size));
-      free(coefs);
     }
     arb_stage.fn = f1->fn;
     arb_stage.pre_post = num_coefs4 - 1;
@@ -439,84 +484,248 @@ static void rate_init(
     }
   }
 
+  p->arb = have_arb_stage? shift + have_pre_stage : -1;
+  p->arb_step = arbM;
+  if (range) {              /* Room for the output at the fastest step, etc. */
+    int64_t fastest = arbM * (1 - range) * MULT32 + .5;
+    arb_stage.out_in_ratio = MULT32 * arbL / fastest;
+    if (!bits)
+      arb_stage.pre_post = max(3, (int)(arbM * (1 + range)));
+  }
+
   if (have_post_stage)
     dft_stage_init(1, 1 - (1 - (1 - tbw0) *
         (upsample? factor * postL / postM : 1)) * tbw_tighten, Fs_a,
         (double)max(postL, postM), att, phase, &post_stage, postL, postM);
 
-  for (i = 0, s = p->stages; i < p->num_stages; ++i, ++s) {
-    fifo_create(&s->fifo, (int)sizeof(sample_t));
-    memset(fifo_reserve(&s->fifo, s->preload), 0, sizeof(sample_t)*s->preload);
+  for (i = 0, s = p->stages; i < p->num_stages; ++i, ++s)
     lsx_debug("%5i|%-5i preload=%i remL=%i",
         s->pre, s->pre_post - s->pre, s->preload, s->remL);
+  if (lanes > 1) {                      /* Each lane has a copy of each stage */
+    stage_t * stages = calloc((p->num_stages + 1) * lanes, sizeof(*stages));
+    for (i = 0; i < (p->num_stages + 1) * lanes; ++i)
+      stages[i] = p->stages[i / lanes];
+    free(p->stages);
+    p->stages = stages;
   }
-  fifo_create(&s->fifo, (int)sizeof(sample_t));
+  for (i = 0; i < (p->num_stages + 1) * lanes; ++i)
+    fifo_create(&p->stages[i].fifo, (int)sizeof(sample_t));
+  p->initial = lsx_memdup(p->stages,
+      p->num_stages * lanes * sizeof(*p->stages));
+  rate_reset(p);
 }
 
 static void rate_process(rate_t * p)
 {
-  stage_t * stage = p->stages;
   int i;
 
-  for (i = 0; i < p->num_stages; ++i, ++stage)
-    stage->fn(stage, &(stage+1)->fifo);
+  for (i = 0; i < p->num_stages; ++i) {
+    stage_t * stage = &p->stages[i * p->lanes];
+    stage->fn(stage, p->lanes);
+  }
+}
+
+/* Scales the step of each lane's arbitrary-ratio stage by ratio (within the
+ * range given to rate_init): the stage then takes ratio times as much input
+ * for each sample of its output.  Its filter stays as designed for the
+ * nominal ratio, and its clock runs on from where it is. */
+static void rate_adjust(rate_t * p, double ratio)
+{
+  int k;
+
+  p->out_before += (p->samples_in - p->in_before) / (p->factor * p->ratio);
+  p->in_before = p->samples_in;
+  for (k = 0; k < p->lanes; ++k) {
+    stage_t * s = &p->stages[p->arb * p->lanes + k];
+    if (s->use_hi_prec_clock)
+      s->step.hi_prec_clock = p->arb_step * ratio;
+    else s->step.all = p->arb_step * ratio * MULT32 + .5;
+  }
+  p->ratio = ratio;
+}
+
+#define rate_output_fifo(p, k) (&(p)->stages[(p)->num_stages * (p)->lanes + (k)].fifo)
+
+/* The lanes take their input, and give their output, in step: n samples to
+ * lane k, then to each of the others, before rate_process */
+static sample_t * rate_input(rate_t * p, int k, sample_t const * samples, size_t n)
+{
+  if (!k)
+    p->samples_in += n;
+  return fifo_write(&p->stages[k].fifo, (int)n, samples);
+}
+
+/* Caps each lane's output FIFO (see fifo_limit); its input is then taken
+ * only as rate_room allows, so that the other stages' FIFOs are bounded
+ * too, in proportion */
+static void rate_limit(rate_t * p, size_t bytes)
+{
+  int k;
+
+  for (k = 0; k < p->lanes; ++k)
+    fifo_limit(rate_output_fifo(p, k), bytes, FIFO_MIN / sizeof(sample_t));
+}
+
+/* The input (of each lane) that can be taken now without the output going
+ * over its cap, but at least 1 so as to progress */
+static size_t rate_room(rate_t * p, size_t n)
+{
+  double room = fifo_room(rate_output_fifo(p, 0)) * p->factor * p->ratio;
+
+  if (room < n)
+    n = room;
+  return max(n, 1);
 }
 
-static sample_t * rate_input(rate_t * p, sample_t const * samples, size_t n)
+/* The output available (the same in each lane) */
+static size_t rate_available(rate_t * p)
 {
-  p->samples_in += n;
-  return fifo_write(&p->stages[0].fifo, (int)n, samples);
+  return (size_t)fifo_occupancy(rate_output_fifo(p, 0));
 }
 
-static sample_t const * rate_output(rate_t * p, sample_t * samples, size_t * n)
+static sample_t const * rate_output(rate_t * p, int k, sample_t * samples, size_t * n)
 {
-  fifo_t * fifo = &p->stages[p->num_stages].fifo;
-  p->samples_out += *n = min(*n, (size_t)fifo_occupancy(fifo));
+  fifo_t * fifo = rate_output_fifo(p, k);
+  *n = min(*n, (size_t)fifo_occupancy(fifo));
+  if (!k)
+    p->samples_out += *n;
   return fifo_read(fifo, (int)*n, samples);
 }
 
 static void rate_flush(rate_t * p)
 {
-  fifo_t * fifo = &p->stages[p->num_stages].fifo;
-  uint64_t samples_out = p->samples_in / p->factor + .5;
+  uint64_t samples_out = p->out_before +
+      (p->samples_in - p->in_before) / (p->factor * p->ratio) + .5;
   size_t remaining = samples_out > p->samples_out ?
       (size_t)(samples_out - p->samples_out) : 0;
   sample_t * buff = calloc(1024, sizeof(*buff));
+  int k;
 
   if (remaining > 0) {
-    while ((size_t)fifo_occupancy(fifo) < remaining) {
-      rate_input(p, buff, (size_t) 1024);
+    while (rate_available(p) < remaining) {
+      for (k = 0; k < p->lanes; ++k)
+        rate_input(p, k, buff, (size_t) 1024);
       rate_process(p);
     }
-    fifo_trim_to(fifo, (int)remaining);
-    p->samples_in = 0;
+    for (k = 0; k < p->lanes; ++k)
+      fifo_trim_to(rate_output_fifo(p, k), (int)remaining);
+    p->samples_in = p->in_before = 0, p->out_before = 0;
   }
   free(buff);
 }
 
+/* Returns the most by which the output lags the input, in input samples:
+ * the sum of each stage's look-ahead (and, for a DFT stage, the input a
+ * block needs beyond it), each scaled by its input rate */
+static double rate_latency(rate_t const * p)
+{
+  double latency = 0, in_rate = 1; /* Of the stage, relative to the input */
+  int i;
+
+  for (i = 0; i < p->num_stages; ++i) {
+    stage_t const * s = &p->stages[i * p->lanes];
+    if (s->fn == dft_stage_fn) {
+      dft_filter_t const * f = &s->shared->dft_filter[s->dft_filter_num];
+      int m = s->step.parts.integer;
+      latency += (double)(f->dft_length - 1 - f->post_peak) / s->L / in_rate;
+      in_rate *= (double)s->L / (m > 0? m : 1 << -m);
+    } else {
+      latency += (s->pre_post - s->pre) / in_rate;
+      in_rate *= s->out_in_ratio? s->out_in_ratio : .5; /* Else half-band */
+    }
+  }
+  return latency;
+}
+
+/* Returns how far back input can still affect the output, in input samples:
+ * the sum of each stage's filter span, each scaled by its input rate */
+static double rate_history(rate_t const * p)
+{
+  double history = 0, in_rate = 1;
+  int i;
+
+  for (i = 0; i < p->num_stages; ++i) {
+    stage_t const * s = &p->stages[i * p->lanes];
+    if (s->fn == dft_stage_fn) {
+      dft_filter_t const * f = &s->shared->dft_filter[s->dft_filter_num];
+      int m = s->step.parts.integer;
+      history += (double)f->num_taps / s->L / in_rate;
+      in_rate *= (double)s->L / (m > 0? m : 1 << -m);
+    } else {
+      history += s->pre_post / in_rate;
+      in_rate *= s->out_in_ratio? s->out_in_ratio : .5;
+    }
+  }
+  return history;
+}
+
 static void rate_close(rate_t * p)
 {
-  rate_shared_t * shared = p->stages[0].shared;
   int i;
+  size_t high_water = 0;
 
-  for (i = 0; i <= p->num_stages; ++i)
+  for (i = 0; i < (p->num_stages + 1) * p->lanes; ++i) {
+    high_water += p->stages[i].fifo.high_water;
     fifo_delete(&p->stages[i].fifo);
+  }
+  lsx_debug("FIFOs' high-water marks: %lu bytes in all",
+      (unsigned long)high_water);
+  free(p->initial);
+  free(p->stages);
+}
+
+static void rate_shared_close(rate_shared_t * shared)
+{
   free(shared->dft_filter[0].coefs);
   free(shared->dft_filter[1].coefs);
-  free(shared->poly_fir_coefs);
+  if (shared->poly_fir_coefs)
+    lsx_design_release(shared->poly_fir_coefs);
   memset(shared, 0, sizeof(*shared));
-  free(p->stages);
 }
 
 /*------------------------------- SoX Wrapper --------------------------------*/
 
+/* The channels are resampled in groups of up to RATE_LANES, each group in
+ * lock-step (so that its poly-phase stage loads each coef once for all of
+ * them); the groups may run on threads of their own. */
+typedef struct {
+  rate_t          rate;
+  sox_sample_t    * buf;      /* A channel's samples, to or from interleaved */
+  size_t          buf_len;
+  sample_t        * mix;      /* A channel's cross-faded output */
+  size_t          mix_len;
+  sox_uint64_t    clips;
+} group_t;
+
+/* For the governor (see sox_effect_t.degrade), with linear phase, groups
+ * of channels are set up as well at cheaper tiers of quality: -h (if above
+ * that) and -q.  Being linear-phase, a tier's output is aligned with its
+ * input; so, to switch, the next tier is reset and fed alongside until its
+ * filters are full, and then cross-faded in, from the output due for the
+ * input at the reset, plus its history; so that this is whole, or nearly,
+ * the switch waits (for a few flows at most) for input that gives that.  A
+ * switch to a tier with longer filters delays the output, once, by the
+ * difference in their look-ahead. */
+#define TIERS 3
+
 typedef struct {
   sox_rate_t      out_rate;
   int             rolloff, coef_interp, max_coefs_size;
   double          bit_depth, phase, bw_0dB_pc, anti_aliasing_pc;
   sox_bool        use_hi_prec_clock, noIOpt, given_0dB_pt;
-  rate_t          rate;
-  rate_shared_t   shared, * shared_ptr;
+  double          range, time_constant; /* Of a variable ratio (-V, -T) */
+  double          excess, integral; /* Of lsx_rate_feedback's control */
+  uint64_t        fed_at;    /* Output (of each lane) at its last call */
+  group_t         * groups;  /* Of the tier running */
+  size_t          num_groups;
+  rate_shared_t   shared[TIERS];
+  group_t         * tiers[TIERS];
+  unsigned        num_tiers, tier, next_tier;
+  group_t         * next;    /* Of the tier being switched to, or NULL */
+  uint64_t        lead;      /* Output of groups due before the cross-fade */
+  uint64_t        skip;      /* Output of next to discard as its filters fill */
+  size_t          fade, fade_len; /* Frames left of, and in, the cross-fade */
+  unsigned        tries;     /* To start the switch aligned */
 } priv_t;
 
 static int create(sox_effect_t * effp, int argc, char **argv)
@@ -524,7 +733,7 @@ static int create(sox_effect_t * effp, int argc, char **argv)
   priv_t * p = (priv_t *) effp->priv;
   int c, quality;
   char * dummy_p, * found_at;
-  char const * opts = "+i:c:b:B:A:p:Q:R:d:MILafnost" "qlmghevu";
+  char const * opts = "+i:c:b:B:A:p:Q:R:d:V:T:MILafnost" "qlmghevu";
   char const * qopts = strchr(opts, 'q');
   double rej = 0, bw_3dB_pc = 0;
   sox_bool allow_aliasing = sox_false;
@@ -535,7 +744,7 @@ static int create(sox_effect_t * effp, int argc, char **argv)
   p->rolloff = rolloff_small;
   p->phase = 50;
   p->max_coefs_size = 400;
-  p->shared_ptr = &p->shared;
+  p->time_constant = 5;
 
   while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
     GETOPT_NUMERIC(optstate, 'i', coef_interp, -1, 2)
@@ -544,6 +753,8 @@ static int create(sox_effect_t * effp, int argc, char **argv)
     GETOPT_NUMERIC(optstate, 'B', bw_0dB_pc, 53, 99.5)
     GETOPT_NUMERIC(optstate, 'A', anti_aliasing_pc, 85, 100)
     GETOPT_NUMERIC(optstate, 'd', bit_depth, 15, 33)
+    GETOPT_NUMERIC(optstate, 'V', range, 1, 100000)
+    GETOPT_NUMERIC(optstate, 'T', time_constant, .1, 3600)
     GETOPT_LOCAL_NUMERIC(optstate, 'b', bw_3dB_pc, 74, 99.7)
     GETOPT_LOCAL_NUMERIC(optstate, 'R', rej, 90, 200)
     GETOPT_LOCAL_NUMERIC(optstate, 'Q', quality, 0, 7)
@@ -564,6 +775,7 @@ static int create(sox_effect_t * effp, int argc, char **argv)
       }
   }
   argc -= optstate.ind, argv += optstate.ind;
+  p->range *= 1e-6; /* From parts per million */
 
   if ((unsigned)quality < 2 && (p->bw_0dB_pc || bw_3dB_pc || p->phase != 50 ||
         allow_aliasing || rej || p->bit_depth || p->anti_aliasing_pc)) {
@@ -619,9 +831,13 @@ static int create(sox_effect_t * effp, int argc, char **argv)
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *) effp->priv;
+  sox_context_t const * context = effp->global_info->global_info;
   double out_rate = p->out_rate != 0 ? p->out_rate : effp->out_signal.rate;
+  size_t chans = effp->in_signal.channels, g;
+  double bits[TIERS];
+  unsigned t;
 
-  if (effp->in_signal.rate == out_rate)
+  if (effp->in_signal.rate == out_rate && !p->range)
     return SOX_EFF_NULL;
 
   if (effp->in_signal.mult)
@@ -629,28 +845,187 @@ static int start(sox_effect_t * effp)
 
   effp->out_signal.channels = effp->in_signal.channels;
   effp->out_signal.rate = out_rate;
-  rate_init(&p->rate, p->shared_ptr, effp->in_signal.rate/out_rate,p->bit_depth,
-      p->phase, p->bw_0dB_pc, p->anti_aliasing_pc, p->rolloff, !p->given_0dB_pt,
-      p->use_hi_prec_clock, p->coef_interp, p->max_coefs_size, p->noIOpt);
+  p->num_groups = (chans + RATE_LANES - 1) / RATE_LANES;
+  p->num_tiers = 1;
+  if (context->governor && context->chain_mode == SOX_CHAIN_REALTIME &&
+      p->phase == 50) {
+    if (p->bit_depth > 20)
+      bits[p->num_tiers++] = 20;
+    if (p->bit_depth > 0)
+      bits[p->num_tiers++] = 0;
+  }
+  for (t = 0; t < p->num_tiers; ++t) {
+    p->tiers[t] = lsx_calloc(p->num_groups, sizeof(*p->tiers[t]));
+    for (g = 0; g < p->num_groups; ++g) {
+      rate_t * r = &p->tiers[t][g].rate;
+      int lanes = (int)min(RATE_LANES, chans - g * RATE_LANES);
+      if (!t)
+        rate_init(r, &p->shared[t], lanes,
+            effp->in_signal.rate/out_rate, p->range, p->bit_depth,
+            p->phase, p->bw_0dB_pc, p->anti_aliasing_pc, p->rolloff, !p->given_0dB_pt,
+            p->use_hi_prec_clock, p->coef_interp, p->max_coefs_size, p->noIOpt);
+      else rate_init(r, &p->shared[t], lanes,  /* As create, for -h or -q */
+            effp->in_signal.rate/out_rate, p->range, bits[t], 50.,
+            100 - 5 / TO_3dB(bits[t] * linear_to_dB(2.)), 100.,
+            bits[t]? rolloff_small : rolloff_medium, sox_false,
+            p->use_hi_prec_clock, -1, 400, p->noIOpt);
+      rate_limit(r, context->fifo_max);
+    }
+  }
+  p->groups = p->tiers[0];
+  p->tier = 0, p->next = NULL;
+  effp->degrade_steps = p->num_tiers - 1;
+  effp->latency = rate_latency(&p->groups[0].rate) / effp->in_signal.rate;
+  effp->history = rate_history(&p->groups[0].rate) / effp->in_signal.rate;
   return SOX_SUCCESS;
 }
 
+/* Takes ilen samples of the input of each of the group's channels (from
+ * channel ch0 on) from ibuf, and resamples them */
+static void input_group(sox_effect_t * effp, group_t * q, size_t ch0,
+    sox_sample_t const * ibuf, size_t ilen)
+{
+  rate_t * r = &q->rate;
+  size_t chans = effp->in_signal.channels, i;
+  size_t step = effp->planar || chans == 1? 1 : chans;
+  int k;
+
+  for (k = 0; k < r->lanes; ++k) {
+    size_t ch = ch0 + (size_t)k;
+    sox_sample_t const * in = ibuf + (effp->planar? ch * lsx_iplane_size(effp) : ch);
+    sample_t * t = rate_input(r, k, NULL, ilen);
+
+    if (step > 1) for (i = 0; i < ilen; ++i)
+      q->buf[i] = in[i * step];
+    lsx_load_samples(t, step > 1? q->buf : in, ilen);
+  }
+  rate_process(r);
+}
+
+/* Gives olen samples of the output of each of the group's channels (from
+ * channel ch0 on) to obuf (cross-fading them, whilst fading, with those of
+ * x, the group of the next tier), then, if ilen, takes that many of each's
+ * input from ibuf and resamples them (as does x, if given); the buffers are
+ * planar or interleaved */
+static void flow_group(sox_effect_t * effp, group_t * q, group_t * x,
+    size_t ch0, sox_sample_t const * ibuf, sox_sample_t * obuf, size_t ilen,
+    size_t olen)
+{
+  priv_t const * p = (priv_t const *)effp->priv;
+  rate_t * r = &q->rate;
+  size_t chans = effp->in_signal.channels, i, n;
+  size_t step = effp->planar || chans == 1? 1 : chans;
+  sox_bool fading = x && !p->lead && p->fade;
+  int k;
+
+  if (step > 1 && q->buf_len < max(ilen, olen))
+    q->buf = lsx_realloc(q->buf, (q->buf_len = max(ilen, olen)) * sizeof(*q->buf));
+  if (x && step > 1 && x->buf_len < ilen)
+    x->buf = lsx_realloc(x->buf, (x->buf_len = ilen) * sizeof(*x->buf));
+  if (fading && q->mix_len < olen)
+    q->mix = lsx_realloc(q->mix, (q->mix_len = olen) * sizeof(*q->mix));
+  for (k = 0; k < r->lanes; ++k) {
+    size_t ch = ch0 + (size_t)k;
+    sox_sample_t * o = obuf + (effp->planar? ch * lsx_oplane_size(effp) : ch);
+    sample_t const * s;
+
+    n = olen;
+    s = rate_output(r, k, NULL, &n);
+    if (fading) {
+      sample_t const * s1 = rate_output(&x->rate, k, NULL, &n);
+      for (i = 0; i < n; ++i)
+        q->mix[i] = s1[i] + (s[i] - s1[i]) * (p->fade - i) / p->fade_len;
+      s = q->mix;
+    }
+    lsx_save_samples(step > 1? q->buf : o, s, n, &q->clips);
+    if (step > 1) for (i = 0; i < n; ++i)
+      o[i * step] = q->buf[i];
+  }
+  if (ilen) {
+    input_group(effp, q, ch0, ibuf, ilen);
+    if (x)
+      input_group(effp, x, ch0, ibuf, ilen);
+  }
+}
+
+/* Discards n samples of the output of each of the channels of the groups */
+static void discard(group_t * groups, size_t num_groups, size_t n)
+{
+  size_t g, len;
+  int k;
+
+  for (g = 0; g < num_groups; ++g) for (k = 0; k < groups[g].rate.lanes; ++k)
+    len = n, rate_output(&groups[g].rate, k, NULL, &len);
+}
+
+/* Starts the switch to the tier for effp->degrade, if not running */
+static void switch_tier(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned t = min(effp->degrade, p->num_tiers - 1);
+  rate_t const * r = &p->groups[0].rate;
+  double due = r->out_before +
+    (r->samples_in - r->in_before) / (r->factor * r->ratio);
+  size_t g;
+
+  if (t == p->tier)
+    return;
+  if (fabs(due - floor(due + .5)) > .25 && ++p->tries < 8)
+    return;  /* For alignment to within a quarter of a sample, if it comes */
+  p->tries = 0;
+  p->next = p->tiers[p->next_tier = t];
+  for (g = 0; g < p->num_groups; ++g) {
+    p->next[g].rate.ratio = p->groups[g].rate.ratio;
+    rate_reset(&p->next[g].rate);
+  }
+  p->skip = (uint64_t)(rate_history(&p->next[0].rate) / r->factor) + 1;
+  p->lead = (uint64_t)max(due + p->skip + .5 - r->samples_out, 0);
+  p->fade = p->fade_len = (size_t)(effp->out_signal.rate * .02) + 1;
+  lsx_debug("switching to tier %u of %u in %" PRIu64 " samples", t,
+      p->num_tiers, p->lead);
+}
+
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
                 sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t odone = *osamp;
-
-  sample_t const * s = rate_output(&p->rate, NULL, &odone);
-  lsx_save_samples(obuf, s, odone, &effp->clips);
-
-  if (*isamp && odone < *osamp) {
-    sample_t * t = rate_input(&p->rate, NULL, *isamp);
-    lsx_load_samples(t, ibuf, *isamp);
-    rate_process(&p->rate);
+  size_t chans = effp->in_signal.channels, threads;
+  size_t ilen = *isamp / chans, olen = *osamp / chans;
+  size_t odone = min(olen, rate_available(&p->groups[0].rate)), n;
+  int g;
+
+  if (p->num_tiers > 1 && !p->next && ibuf)
+    switch_tier(effp);
+  if (p->next) {  /* Output comes from groups, then both, then next */
+    n = (size_t)min(p->skip, rate_available(&p->next[0].rate));
+    discard(p->next, p->num_groups, n);
+    p->skip -= n;
+    odone = p->lead? (size_t)min(odone, p->lead) : p->skip? 0 :
+      min(min(odone, p->fade), rate_available(&p->next[0].rate));
+  }
+  if (odone == olen)
+    ilen = 0;
+  else if (ilen) {
+    ilen = rate_room(&p->groups[0].rate, ilen);
+    if (p->next)
+      ilen = min(ilen, rate_room(&p->next[0].rate, ilen));
+  }
+  threads = lsx_effect_threads(effp, p->num_groups);
+  #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+  for (g = 0; g < (int)p->num_groups; ++g)
+    flow_group(effp, &p->groups[g], p->next? &p->next[g] : NULL,
+        (size_t)g * RATE_LANES, ibuf, obuf, ilen, odone);
+  lsx_threads_give(effp->global_info->global_info, threads);
+  for (g = 0; g < (int)p->num_groups; ++g)
+    effp->clips += p->groups[g].clips, p->groups[g].clips = 0;
+  if (p->next && p->lead)
+    p->lead -= odone;
+  else if (p->next && (p->fade -= odone) == 0) {
+    p->groups = p->next, p->tier = p->next_tier, p->next = NULL;
+    p->fed_at = p->groups[0].rate.samples_out;
   }
-  else *isamp = 0;
-  *osamp = odone;
+  *isamp = ilen * chans;
+  *osamp = odone * chans;
   return SOX_SUCCESS;
 }
 
@@ -658,21 +1033,155 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
   static size_t isamp = 0;
-  rate_flush(&p->rate);
+  size_t g;
+
+  p->next = NULL;  /* The switch, if any, is abandoned */
+  for (g = 0; g < p->num_groups; ++g)
+    rate_flush(&p->groups[g].rate);
   return flow(effp, 0, obuf, &isamp, osamp);
 }
 
+static int reset(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  size_t g;
+
+  p->next = NULL;
+  for (g = 0; g < p->num_groups; ++g)
+    rate_reset(&p->groups[g].rate);
+  return SOX_SUCCESS;
+}
+
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *) effp->priv;
-  rate_close(&p->rate);
+  size_t g;
+  unsigned t;
+
+  for (t = 0; t < p->num_tiers; ++t) {
+    for (g = 0; g < p->num_groups; ++g) {
+      rate_close(&p->tiers[t][g].rate);
+      free(p->tiers[t][g].buf);
+      free(p->tiers[t][g].mix);
+    }
+    free(p->tiers[t]);
+    p->tiers[t] = NULL;
+    rate_shared_close(&p->shared[t]);
+  }
+  p->groups = p->next = NULL, p->num_groups = 0, p->num_tiers = 0;
+  p->excess = p->integral = 0, p->fed_at = 0;
   return SOX_SUCCESS;
 }
 
+/* The shortest of the half-band FIRs above, for use elsewhere (e.g. 2x
+ * up-sampling): odd taps only, from the centre outwards; the centre tap
+ * is .5 and the even taps are zero. */
+double const * lsx_half_band_coefs(int * num_coefs)
+{
+  *num_coefs = half_firs[0].num_coefs;
+  return half_fir_coefs_8;
+}
+
+/* Where rate follows rate, with the same options, and the rate between them
+ * is no lower than either of the other two (so narrows the band no more
+ * than would converting directly), the first is restarted to convert
+ * directly, or is removed if that leaves the rate unchanged. */
+sox_bool lsx_rate_fuse(sox_effects_chain_t * chain, sox_effect_t * effp)
+{
+  sox_effect_t * last = chain->length? chain->effects[chain->length - 1] : NULL;
+  priv_t * p, * q = (priv_t *)effp->priv;
+  sox_rate_t out_rate = effp->out_signal.rate;
+  double * mult;
+  size_t f;
+
+  if (!last || last->handler.start != start || effp->handler.start != start)
+    return sox_false;
+  p = (priv_t *)last->priv;
+  if (p->range || q->range)
+    return sox_false;
+  if (p->rolloff != q->rolloff || p->coef_interp != q->coef_interp ||
+      p->max_coefs_size != q->max_coefs_size || p->bit_depth != q->bit_depth ||
+      p->phase != q->phase || p->bw_0dB_pc != q->bw_0dB_pc ||
+      p->anti_aliasing_pc != q->anti_aliasing_pc ||
+      p->use_hi_prec_clock != q->use_hi_prec_clock || p->noIOpt != q->noIOpt ||
+      p->given_0dB_pt != q->given_0dB_pt ||
+      last->out_signal.rate < min(last->in_signal.rate, out_rate) ||
+      (last->in_signal.rate == out_rate && chain->length < 2))
+    return sox_false;
+
+  lsx_debug("%g -> %g -> %g Hz becomes %g -> %g Hz", last->in_signal.rate,
+      last->out_signal.rate, out_rate, last->in_signal.rate, out_rate);
+  stop(effp);
+  mult = last->in_signal.mult;
+  if (mult)
+    *mult /= .705;  /* Undo effp's start; the headroom is made once */
+  if (last->in_signal.rate == out_rate) {
+    if (mult)
+      *mult /= .705;  /* Likewise for last's */
+    sox_delete_effect_last(chain);
+    return sox_true;
+  }
+  for (f = 0; f < last->flows; ++f) {
+    stop(&last[f]);
+    ((priv_t *)last[f].priv)->out_rate = out_rate;
+    last[f].in_signal.mult = NULL;
+    start(&last[f]);
+    if (last[f].in_signal.length != SOX_UNKNOWN_LEN)
+      last[f].out_signal.length =
+        last[f].in_signal.length / last[f].in_signal.rate * out_rate + .5;
+  }
+  last->in_signal.mult = mult;
+  return sox_true;
+}
+
+/* Where effp is a rate effect given -V, runs it from now on at ratio times
+ * its nominal ratio of input to output (limited to the range given) */
+int lsx_rate_adjust(sox_effect_t * effp, double ratio)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t g;
+
+  if (effp->handler.start != start || !p->range || !p->groups)
+    return SOX_EINVAL;
+  ratio = range_limit(ratio, 1 - p->range, 1 + p->range);
+  for (g = 0; g < p->num_groups; ++g) {
+    rate_adjust(&p->groups[g].rate, ratio);
+    if (p->next)
+      rate_adjust(&p->next[g].rate, ratio);
+  }
+  return SOX_SUCCESS;
+}
+
+/* As lsx_rate_adjust, but with the ratio set by a proportional-integral
+ * controller from the excess (in seconds) of a buffer's fill over its
+ * target.  The excess drains at about (ratio - 1) seconds a second, so with
+ * time constant T, ratio = 1 + (2 * excess + integral / T) / T is critically
+ * damped.  As the fill of a buffer is measured between blocks of audio (the
+ * rate effect's own output comes in blocks), the excess is first smoothed,
+ * with time constant T / 4; the integral is limited to what can be had
+ * within the range (so that it does not wind up). */
+int lsx_rate_feedback(sox_effect_t * effp, double excess)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double T, dt, limit;
+  uint64_t out;
+
+  if (effp->handler.start != start || !p->range || !p->groups)
+    return SOX_EINVAL;
+  T = p->time_constant, limit = p->range * T * T;
+  out = p->groups[0].rate.samples_out;
+  dt = out > p->fed_at? (out - p->fed_at) / effp->out_signal.rate : 0;
+  p->fed_at = out;
+  p->excess += (excess - p->excess) * dt / (dt + T / 4);
+  p->integral = range_limit(p->integral + p->excess * dt, -limit, limit);
+  return lsx_rate_adjust(effp, 1 + (2 * p->excess + p->integral / T) / T);
+}
+
 sox_effect_handler_t const * lsx_rate_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "rate", 0, SOX_EFF_RATE, create, start, flow, drain, stop, 0, sizeof(priv_t)
+    "rate", 0, SOX_EFF_MCHAN | SOX_EFF_RATE | SOX_EFF_LINEAR | SOX_EFF_PLANAR, create, start, flow, drain, stop, 0, sizeof(priv_t), reset,
+    NULL, NULL, NULL
   };
   static char const * lines[] = {
     "[-q|-l|-m|-h|-v] [override-options] RATE[k]",
@@ -690,6 +1199,9 @@ sox_effect_handler_t const * lsx_rate_effect_fn(void)
     " -b 74-99.7   Any band-width %",
     " -p 0-100     Any phase response (0 = minimum, 25 = intermediate,",
     "              50 = linear, 100 = maximum)",
+    "              VARIABLE RATIO (with any quality)",
+    " -V PPM       Let the ratio vary by up to +/- PPM parts per million",
+    " -T SECONDS   Time constant of its feedback control (default 5)",
   };
   static char * usage;
   handler.usage = lsx_usage_lines(&usage, lines, array_length(lines));
@@ -0,0 +1,151 @@
+/* Effect: change sample rate  Copyright (c) 2008,12 robs@users.sourceforge.net
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The quick (rate -q) arbitrary-ratio stage: cubic interpolation between
+ * the 4 input samples about each output.  The clock is stepped, and the taps
+ * of each output found, for CUBIC_BLOCK outputs; these are then interpolated
+ * together, 2 or 4 at a time with SSE2 or AVX (as rate_cubic_init chooses),
+ * each by the same operations in the same order as one at a time, so that
+ * all versions give identical results. */
+
+#define CUBIC_BLOCK 8
+
+typedef void (* cubic_fn_t)(sample_t const * const * s, sample_t const * x,
+    sample_t * out);
+
+static sample_t cubic1(sample_t const * s, sample_t x)
+{
+  sample_t b = .5*(s[1]+s[-1])-*s, a = (1/6.)*(s[2]-s[1]+s[-1]-*s-4*b);
+  sample_t c = s[1]-*s-a-b;
+  return ((a*x + b)*x + c)*x + *s;
+}
+
+static void cubic_c(sample_t const * const * s, sample_t const * x,
+    sample_t * out)
+{
+  int j;
+
+  for (j = 0; j < CUBIC_BLOCK; ++j)
+    out[j] = cubic1(s[j], x[j]);
+}
+
+#if defined HAVE_RATE_DOT_SSE2
+LSX_TARGET("sse2")
+static void cubic_sse2(sample_t const * const * s, sample_t const * x,
+    sample_t * out)
+{
+  __m128d const half = _mm_set1_pd(.5), sixth = _mm_set1_pd(1/6.);
+  __m128d const four = _mm_set1_pd(4.);
+  int j;
+
+  for (j = 0; j < CUBIC_BLOCK; j += 2) {   /* Taps -1,0 and 1,2 of each: */
+    __m128d p = _mm_loadu_pd(s[j] - 1), q = _mm_loadu_pd(s[j + 1] - 1);
+    __m128d r = _mm_loadu_pd(s[j] + 1), t = _mm_loadu_pd(s[j + 1] + 1);
+    __m128d sm1 = _mm_unpacklo_pd(p, q), s0 = _mm_unpackhi_pd(p, q);
+    __m128d s1 = _mm_unpacklo_pd(r, t), s2 = _mm_unpackhi_pd(r, t);
+    __m128d xx = _mm_loadu_pd(x + j), a, b, c;
+
+    b = _mm_sub_pd(_mm_mul_pd(half, _mm_add_pd(s1, sm1)), s0);
+    a = _mm_mul_pd(sixth, _mm_sub_pd(_mm_sub_pd(_mm_add_pd(
+        _mm_sub_pd(s2, s1), sm1), s0), _mm_mul_pd(four, b)));
+    c = _mm_sub_pd(_mm_sub_pd(_mm_sub_pd(s1, s0), a), b);
+    _mm_storeu_pd(out + j, _mm_add_pd(_mm_mul_pd(_mm_add_pd(_mm_mul_pd(
+        _mm_add_pd(_mm_mul_pd(a, xx), b), xx), c), xx), s0));
+  }
+}
+#endif
+
+#if defined HAVE_RATE_DOT_AVX
+LSX_TARGET("avx")
+static void cubic_avx(sample_t const * const * s, sample_t const * x,
+    sample_t * out)
+{
+  __m256d const half = _mm256_set1_pd(.5), sixth = _mm256_set1_pd(1/6.);
+  __m256d const four = _mm256_set1_pd(4.);
+  int j;
+
+  for (j = 0; j < CUBIC_BLOCK; j += 4) {   /* Transpose the 4 taps of 4: */
+    __m256d r0 = _mm256_loadu_pd(s[j] - 1), r1 = _mm256_loadu_pd(s[j + 1] - 1);
+    __m256d r2 = _mm256_loadu_pd(s[j + 2] - 1), r3 = _mm256_loadu_pd(s[j + 3] - 1);
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+    __m256d sm1 = _mm256_permute2f128_pd(t0, t2, 0x20);
+    __m256d s0  = _mm256_permute2f128_pd(t1, t3, 0x20);
+    __m256d s1  = _mm256_permute2f128_pd(t0, t2, 0x31);
+    __m256d s2  = _mm256_permute2f128_pd(t1, t3, 0x31);
+    __m256d xx = _mm256_loadu_pd(x + j), a, b, c;
+
+    b = _mm256_sub_pd(_mm256_mul_pd(half, _mm256_add_pd(s1, sm1)), s0);
+    a = _mm256_mul_pd(sixth, _mm256_sub_pd(_mm256_sub_pd(_mm256_add_pd(
+        _mm256_sub_pd(s2, s1), sm1), s0), _mm256_mul_pd(four, b)));
+    c = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(s1, s0), a), b);
+    _mm256_storeu_pd(out + j, _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(
+        _mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(a, xx), b), xx), c), xx), s0));
+  }
+}
+#endif
+
+static cubic_fn_t cubic = cubic_c;
+
+static void cubic_stage_fn1(stage_t * p, fifo_t * output_fifo)
+{
+  int i, j, num_in = stage_occupancy(p), max_num_out = 1 + num_in*p->out_in_ratio;
+  sample_t const * input = stage_read_p(p), * s[CUBIC_BLOCK];
+  sample_t * output = fifo_reserve(output_fifo, max_num_out), x[CUBIC_BLOCK];
+  int64_t at = p->at.all, step = p->step.all; /* Integer part in the top 32 */
+  int64_t offset[CUBIC_BLOCK];
+
+  for (j = 0; j < CUBIC_BLOCK; ++j)
+    offset[j] = j * step;
+  for (i = 0; (int32_t)((at + offset[CUBIC_BLOCK - 1]) >> 32) < num_in;
+      i += CUBIC_BLOCK, at += CUBIC_BLOCK * step) {
+    for (j = 0; j < CUBIC_BLOCK; ++j) {
+      int64_t t = at + offset[j];
+      s[j] = input + (int32_t)(t >> 32);
+      x[j] = (uint32_t)t * (1 / MULT32);
+    }
+    cubic(s, x, output + i);
+  }
+  for (; (int32_t)(at >> 32) < num_in; ++i, at += step)
+    output[i] = cubic1(input + (int32_t)(at >> 32), (uint32_t)at * (1 / MULT32));
+  p->at.all = at;
+  assert(max_num_out - i >= 0);
+  fifo_trim_by(output_fifo, max_num_out - i);
+  fifo_read(&p->fifo, p->at.parts.integer, NULL);
+  p->at.parts.integer = 0;
+}
+
+static void cubic_stage_fn(stage_t * p, int lanes)
+{
+  int k;
+
+  for (k = 0; k < lanes; ++k)
+    cubic_stage_fn1(&p[k], stage_output(p, lanes, k));
+}
+
+static void rate_cubic_init(unsigned cpu)
+{
+#if defined HAVE_RATE_DOT_AVX
+  if (cpu & LSX_CPU_AVX)
+    cubic = cubic_avx;
+  else if (cpu & LSX_CPU_SSE2)
+    cubic = cubic_sse2;
+#elif defined HAVE_RATE_DOT_SSE2
+  cubic = cubic_sse2;
+#endif
+  (void)cpu;
+}
@@ -0,0 +1,151 @@
+/* Effect: change sample rate  Copyright (c) 2008,12 robs@users.sourceforge.net
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Dot products (of n samples, n a multiple of 4) for the poly-phase FIRs.
+ * Each version keeps 4 partial sums, for j mod 4, and adds them as
+ * (s0 + s1) + (s2 + s3), so all give identical results; the fastest that
+ * the CPU supports is chosen at run-time (by sox_init) by rate_dot_init().
+ * rate_dots does the same for several lanes (channels) against the same
+ * coefficients, with rate_dot2 and rate_dot4 from rate_dots.h. */
+
+#if defined HAVE_LSX_TARGET
+  #define HAVE_RATE_DOT_AVX 1
+  #include <immintrin.h>
+#elif defined __SSE2__ || (defined _M_IX86_FP && _M_IX86_FP >= 2) || \
+    defined _M_X64
+  #include <emmintrin.h>
+#endif
+#if defined HAVE_RATE_DOT_AVX || defined __SSE2__ || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2) || defined _M_X64
+  #define HAVE_RATE_DOT_SSE2 1
+#endif
+#if defined __ARM_NEON && defined __aarch64__
+  #define HAVE_RATE_DOT_NEON 1
+  #include <arm_neon.h>
+#endif
+
+typedef sample_t (* rate_dot_fn_t)(
+    sample_t const * a, sample_t const * b, int n);
+
+static sample_t rate_dot_c(sample_t const * a, sample_t const * b, int n)
+{
+  sample_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  int j;
+
+  for (j = 0; j < n; j += 4) {
+    s0 += a[j] * b[j];
+    s1 += a[j + 1] * b[j + 1];
+    s2 += a[j + 2] * b[j + 2];
+    s3 += a[j + 3] * b[j + 3];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+#if defined HAVE_RATE_DOT_SSE2
+LSX_TARGET("sse2")
+static sample_t rate_dot_sse2(sample_t const * a, sample_t const * b, int n)
+{
+  __m128d s01 = _mm_setzero_pd(), s23 = _mm_setzero_pd();
+  double s[4];
+  int j;
+
+  for (j = 0; j < n; j += 4) {
+    s01 = _mm_add_pd(s01,
+        _mm_mul_pd(_mm_loadu_pd(a + j), _mm_loadu_pd(b + j)));
+    s23 = _mm_add_pd(s23,
+        _mm_mul_pd(_mm_loadu_pd(a + j + 2), _mm_loadu_pd(b + j + 2)));
+  }
+  _mm_storeu_pd(s, s01);
+  _mm_storeu_pd(s + 2, s23);
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+#endif
+
+#if defined HAVE_RATE_DOT_AVX
+LSX_TARGET("avx")
+static sample_t rate_dot_avx(sample_t const * a, sample_t const * b, int n)
+{
+  __m256d sum = _mm256_setzero_pd();
+  double s[4];
+  int j;
+
+  for (j = 0; j < n; j += 4)   /* No FMA, so as to round as the others do */
+    sum = _mm256_add_pd(sum,
+        _mm256_mul_pd(_mm256_loadu_pd(a + j), _mm256_loadu_pd(b + j)));
+  _mm256_storeu_pd(s, sum);
+  return (s[0] + s[1]) + (s[2] + s[3]);
+}
+#endif
+
+#if defined HAVE_RATE_DOT_NEON
+static sample_t rate_dot_neon(sample_t const * a, sample_t const * b, int n)
+{
+  float64x2_t s01 = vdupq_n_f64(0), s23 = vdupq_n_f64(0);
+  int j;
+
+  for (j = 0; j < n; j += 4) {
+    s01 = vaddq_f64(s01, vmulq_f64(vld1q_f64(a + j), vld1q_f64(b + j)));
+    s23 = vaddq_f64(s23,
+        vmulq_f64(vld1q_f64(a + j + 2), vld1q_f64(b + j + 2)));
+  }
+  return (vgetq_lane_f64(s01, 0) + vgetq_lane_f64(s01, 1)) +
+         (vgetq_lane_f64(s23, 0) + vgetq_lane_f64(s23, 1));
+}
+#endif
+
+typedef void (* rate_dots_fn_t)(sample_t const * a,
+    sample_t const * const * b, int n, sample_t * sums);
+
+#define DOTS(isa) rate_dot2_##isa
+#define LANES 2
+#include "rate_dots.h"
+
+#define DOTS(isa) rate_dot4_##isa
+#define LANES 4
+#include "rate_dots.h"
+
+static rate_dot_fn_t rate_dot = rate_dot_c;
+static rate_dots_fn_t rate_dot2 = rate_dot2_c, rate_dot4 = rate_dot4_c;
+
+/* The dot products of a with each lane's b, 4 or 2 lanes at a time */
+static void rate_dots(sample_t const * a, sample_t const * const * b, int n,
+    int lanes, sample_t * sums)
+{
+  int k = 0;
+
+  for (; k + 4 <= lanes; k += 4)
+    rate_dot4(a, b + k, n, sums + k);
+  for (; k + 2 <= lanes; k += 2)
+    rate_dot2(a, b + k, n, sums + k);
+  if (k < lanes)
+    sums[k] = rate_dot(a, b[k], n);
+}
+
+static void rate_dot_init(unsigned cpu)
+{
+#if defined HAVE_RATE_DOT_AVX
+  if (cpu & LSX_CPU_AVX)
+    rate_dot = rate_dot_avx, rate_dot2 = rate_dot2_avx, rate_dot4 = rate_dot4_avx;
+  else if (cpu & LSX_CPU_SSE2)
+    rate_dot = rate_dot_sse2, rate_dot2 = rate_dot2_sse2, rate_dot4 = rate_dot4_sse2;
+#elif defined HAVE_RATE_DOT_SSE2
+  rate_dot = rate_dot_sse2, rate_dot2 = rate_dot2_sse2, rate_dot4 = rate_dot4_sse2;
+#elif defined HAVE_RATE_DOT_NEON
+  rate_dot = rate_dot_neon, rate_dot2 = rate_dot2_neon, rate_dot4 = rate_dot4_neon;
+#endif
+  (void)cpu;
+}
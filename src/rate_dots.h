@@ -0,0 +1,116 @@
+/* Effect: change sample rate  Copyright (c) 2008,12 robs@users.sourceforge.net
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The dot products of a with each of LANES vectors (b[k] for lane k), for
+ * channels resampled in lock-step: each coefficient loaded from a feeds all
+ * the lanes, and each lane's sum is formed as rate_dot (any version) would
+ * form it, so the result is the same as that of LANES calls of that. */
+
+static void DOTS(c)(sample_t const * a, sample_t const * const * b, int n,
+    sample_t * sums)
+{
+  sample_t s[LANES][4];
+  int j, k;
+
+  for (k = 0; k < LANES; ++k)
+    s[k][0] = s[k][1] = s[k][2] = s[k][3] = 0;
+  for (j = 0; j < n; j += 4)
+    for (k = 0; k < LANES; ++k) {
+      s[k][0] += a[j] * b[k][j];
+      s[k][1] += a[j + 1] * b[k][j + 1];
+      s[k][2] += a[j + 2] * b[k][j + 2];
+      s[k][3] += a[j + 3] * b[k][j + 3];
+    }
+  for (k = 0; k < LANES; ++k)
+    sums[k] = (s[k][0] + s[k][1]) + (s[k][2] + s[k][3]);
+}
+
+#if defined HAVE_RATE_DOT_SSE2
+LSX_TARGET("sse2")
+static void DOTS(sse2)(sample_t const * a, sample_t const * const * b, int n,
+    sample_t * sums)
+{
+  __m128d s01[LANES], s23[LANES];
+  double s[4];
+  int j, k;
+
+  for (k = 0; k < LANES; ++k)
+    s01[k] = s23[k] = _mm_setzero_pd();
+  for (j = 0; j < n; j += 4) {
+    __m128d a01 = _mm_loadu_pd(a + j), a23 = _mm_loadu_pd(a + j + 2);
+    for (k = 0; k < LANES; ++k) {
+      s01[k] = _mm_add_pd(s01[k], _mm_mul_pd(a01, _mm_loadu_pd(b[k] + j)));
+      s23[k] = _mm_add_pd(s23[k],
+          _mm_mul_pd(a23, _mm_loadu_pd(b[k] + j + 2)));
+    }
+  }
+  for (k = 0; k < LANES; ++k) {
+    _mm_storeu_pd(s, s01[k]);
+    _mm_storeu_pd(s + 2, s23[k]);
+    sums[k] = (s[0] + s[1]) + (s[2] + s[3]);
+  }
+}
+#endif
+
+#if defined HAVE_RATE_DOT_AVX
+LSX_TARGET("avx")
+static void DOTS(avx)(sample_t const * a, sample_t const * const * b, int n,
+    sample_t * sums)
+{
+  __m256d sum[LANES];
+  double s[4];
+  int j, k;
+
+  for (k = 0; k < LANES; ++k)
+    sum[k] = _mm256_setzero_pd();
+  for (j = 0; j < n; j += 4) {
+    __m256d x = _mm256_loadu_pd(a + j);
+    for (k = 0; k < LANES; ++k)   /* No FMA, as rate_dot_avx */
+      sum[k] = _mm256_add_pd(sum[k],
+          _mm256_mul_pd(x, _mm256_loadu_pd(b[k] + j)));
+  }
+  for (k = 0; k < LANES; ++k) {
+    _mm256_storeu_pd(s, sum[k]);
+    sums[k] = (s[0] + s[1]) + (s[2] + s[3]);
+  }
+}
+#endif
+
+#if defined HAVE_RATE_DOT_NEON
+static void DOTS(neon)(sample_t const * a, sample_t const * const * b, int n,
+    sample_t * sums)
+{
+  float64x2_t s01[LANES], s23[LANES];
+  int j, k;
+
+  for (k = 0; k < LANES; ++k)
+    s01[k] = s23[k] = vdupq_n_f64(0);
+  for (j = 0; j < n; j += 4) {
+    float64x2_t a01 = vld1q_f64(a + j), a23 = vld1q_f64(a + j + 2);
+    for (k = 0; k < LANES; ++k) {
+      s01[k] = vaddq_f64(s01[k], vmulq_f64(a01, vld1q_f64(b[k] + j)));
+      s23[k] = vaddq_f64(s23[k], vmulq_f64(a23, vld1q_f64(b[k] + j + 2)));
+    }
+  }
+  for (k = 0; k < LANES; ++k)
+    sums[k] = (vgetq_lane_f64(s01[k], 0) + vgetq_lane_f64(s01[k], 1)) +
+              (vgetq_lane_f64(s23[k], 0) + vgetq_lane_f64(s23[k], 1));
+}
+#endif
+
+#undef DOTS
+#undef LANES
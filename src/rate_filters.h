@@ -98,56 +98,46 @@ static struct {int num_coefs; stage_fn_t fn; float att;} const half_firs[] = {
 #define HI_PREC_CLOCK
 
 #define VAR_LENGTH p->n
-#define VAR_CONVOLVE while (j < FIR_LENGTH) _
 #define VAR_POLY_PHASE_BITS p->phase_bits
 
 #define FUNCTION vpoly0
 #define FIR_LENGTH VAR_LENGTH
-#define CONVOLVE VAR_CONVOLVE
 #include "rate_poly_fir0.h"
 
 #define FUNCTION vpoly1
 #define COEF_INTERP 1
 #define PHASE_BITS VAR_POLY_PHASE_BITS
 #define FIR_LENGTH VAR_LENGTH
-#define CONVOLVE VAR_CONVOLVE
 #include "rate_poly_fir.h"
 
 #define FUNCTION vpoly2
 #define COEF_INTERP 2
 #define PHASE_BITS VAR_POLY_PHASE_BITS
 #define FIR_LENGTH VAR_LENGTH
-#define CONVOLVE VAR_CONVOLVE
 #include "rate_poly_fir.h"
 
 #define FUNCTION vpoly3
 #define COEF_INTERP 3
 #define PHASE_BITS VAR_POLY_PHASE_BITS
 #define FIR_LENGTH VAR_LENGTH
-#define CONVOLVE VAR_CONVOLVE
 #include "rate_poly_fir.h"
 
 #undef HI_PREC_CLOCK
 
 #define U100_l 42
-#define poly_fir_convolve_U100 _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _ _
 #define FUNCTION U100_0
 #define FIR_LENGTH U100_l
-#define CONVOLVE poly_fir_convolve_U100
 #include "rate_poly_fir0.h"
 
 #define u100_l 11
-#define poly_fir_convolve_u100 _ _ _ _ _ _ _ _ _ _ _
 #define FUNCTION u100_0
 #define FIR_LENGTH u100_l
-#define CONVOLVE poly_fir_convolve_u100
 #include "rate_poly_fir0.h"
 
 #define FUNCTION u100_1
 #define COEF_INTERP 1
 #define PHASE_BITS 8
 #define FIR_LENGTH u100_l
-#define CONVOLVE poly_fir_convolve_u100
 #include "rate_poly_fir.h"
 #define u100_1_b 8
 
@@ -155,7 +145,6 @@ static struct {int num_coefs; stage_fn_t fn; float att;} const half_firs[] = {
 #define COEF_INTERP 2
 #define PHASE_BITS 6
 #define FIR_LENGTH u100_l
-#define CONVOLVE poly_fir_convolve_u100
 #include "rate_poly_fir.h"
 #define u100_2_b 6
 
@@ -19,19 +19,24 @@
 /* Input must be preceded and followed by LEN >> 1 samples. */
 
 #define _ sum += (input[-(2*j +1)] + input[(2*j +1)]) * COEFS[j], ++j;
-static void FUNCTION(stage_t * p, fifo_t * output_fifo)
+static void FUNCTION(stage_t * s, int lanes)
 {
-  sample_t const * input = stage_read_p(p);
-  int i, num_out = (stage_occupancy(p) + 1) / 2;
-  sample_t * output = fifo_reserve(output_fifo, num_out);
+  int k;
 
-  for (i = 0; i < num_out; ++i, input += 2) {
-    int j = 0;
-    sample_t sum = input[0] * .5;
-    CONVOLVE
-    output[i] = sum;
+  for (k = 0; k < lanes; ++k) {
+    stage_t * p = &s[k];
+    sample_t const * input = stage_read_p(p);
+    int i, num_out = (stage_occupancy(p) + 1) / 2;
+    sample_t * output = fifo_reserve(stage_output(s, lanes, k), num_out);
+
+    for (i = 0; i < num_out; ++i, input += 2) {
+      int j = 0;
+      sample_t sum = input[0] * .5;
+      CONVOLVE
+      output[i] = sum;
+    }
+    fifo_read(&p->fifo, 2 * num_out, NULL);
   }
-  fifo_read(&p->fifo, 2 * num_out, NULL);
 }
 #undef _
 #undef COEFS
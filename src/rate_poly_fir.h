@@ -16,75 +16,78 @@
  */
 
 /* Resample using an interpolated poly-phase FIR with length LEN.*/
-/* Input must be followed by LEN-1 samples. */
+/* Input must be followed by fir_len4(LEN)-1 samples. */
 
-#define a (coef(p->shared->poly_fir_coefs, COEF_INTERP, FIR_LENGTH, phase, 0,j))
-#define b (coef(p->shared->poly_fir_coefs, COEF_INTERP, FIR_LENGTH, phase, 1,j))
-#define c (coef(p->shared->poly_fir_coefs, COEF_INTERP, FIR_LENGTH, phase, 2,j))
-#define d (coef(p->shared->poly_fir_coefs, COEF_INTERP, FIR_LENGTH, phase, 3,j))
-#if COEF_INTERP == 0
-  #define _ sum += a *in[j], ++j;
-#elif COEF_INTERP == 1
-  #define _ sum += (b *x + a)*in[j], ++j;
+/* The convolution with the interpolated FIR is done as COEF_INTERP + 1
+ * convolutions (rate_dots) with the rows of interpolation coefs, for all the
+ * lanes at once: their clocks run in step, so they share the phase, and so
+ * the coefs, of each output sample; lane 0's stage keeps the clock. */
+#define n4 fir_len4(FIR_LENGTH)
+#define coefs (&coef(p->shared->poly_fir_coefs, COEF_INTERP, n4, phase, 0, 0))
+#if COEF_INTERP == 1
+  #define CONVOLVE_INTERP(k) (d[1][k] *x + d[0][k])
 #elif COEF_INTERP == 2
-  #define _ sum += ((c *x + b)*x + a)*in[j], ++j;
+  #define CONVOLVE_INTERP(k) ((d[2][k] *x + d[1][k])*x + d[0][k])
 #elif COEF_INTERP == 3
-  #define _ sum += (((d*x + c)*x + b)*x + a)*in[j], ++j;
+  #define CONVOLVE_INTERP(k) (((d[3][k]*x + d[2][k])*x + d[1][k])*x + d[0][k])
 #else
   #error COEF_INTERP
 #endif
+#define CONVOLVE(offset) do { \
+    for (k = 0; k < lanes; ++k) \
+      in[k] = input[k] + (offset); \
+    for (r = 0; r <= COEF_INTERP; ++r) \
+      rate_dots(coefs + r * n4, in, n4, lanes, d[r]); \
+    for (k = 0; k < lanes; ++k) \
+      output[k][i] = CONVOLVE_INTERP(k); \
+  } while (0)
 
-static void FUNCTION(stage_t * p, fifo_t * output_fifo)
+static void FUNCTION(stage_t * p, int lanes)
 {
-  sample_t const * input = stage_read_p(p);
-  int i, num_in = stage_occupancy(p), max_num_out = 1 + num_in*p->out_in_ratio;
-  sample_t * output = fifo_reserve(output_fifo, max_num_out);
+  sample_t const * input[RATE_LANES], * in[RATE_LANES];
+  sample_t * output[RATE_LANES], d[COEF_INTERP + 1][RATE_LANES];
+  int i, k, r, num_in = stage_occupancy(p), max_num_out = 1 + num_in*p->out_in_ratio;
+
+  for (k = 0; k < lanes; ++k) {
+    input[k] = stage_read_p(&p[k]);
+    output[k] = fifo_reserve(stage_output(p, lanes, k), max_num_out);
+  }
 
 #if defined HI_PREC_CLOCK
   if (p->use_hi_prec_clock) {
     hi_prec_clock_t at = p->at.hi_prec_clock;
     for (i = 0; (int)at < num_in; ++i, at += p->step.hi_prec_clock) {
-      sample_t const * in = input + (int)at;
       hi_prec_clock_t fraction = at - (int)at;
       int phase = fraction * (1 << PHASE_BITS);
-#if COEF_INTERP > 0
       sample_t x = fraction * (1 << PHASE_BITS) - phase;
-#endif
-      sample_t sum = 0;
-      int j = 0;
-      CONVOLVE
-      output[i] = sum;
+      CONVOLVE((int)at);
     }
-    fifo_read(&p->fifo, (int)at, NULL);
+    for (k = 0; k < lanes; ++k)
+      fifo_read(&p[k].fifo, (int)at, NULL);
     p->at.hi_prec_clock = at - (int)at;
   } else
 #endif
   {
     for (i = 0; p->at.parts.integer < num_in; ++i, p->at.all += p->step.all) {
-      sample_t const * in = input + p->at.parts.integer;
       uint32_t fraction = p->at.parts.fraction;
       int phase = fraction >> (32 - PHASE_BITS); /* high-order bits */
-#if COEF_INTERP > 0              /* low-order bits, scaled to [0,1) */
+      /* low-order bits, scaled to [0,1): */
       sample_t x = (sample_t) (fraction << PHASE_BITS) * (1 / MULT32);
-#endif
-      sample_t sum = 0;
-      int j = 0;
-      CONVOLVE
-      output[i] = sum;
+      CONVOLVE(p->at.parts.integer);
     }
-    fifo_read(&p->fifo, p->at.parts.integer, NULL);
+    for (k = 0; k < lanes; ++k)
+      fifo_read(&p[k].fifo, p->at.parts.integer, NULL);
     p->at.parts.integer = 0;
   }
   assert(max_num_out - i >= 0);
-  fifo_trim_by(output_fifo, max_num_out - i);
+  for (k = 0; k < lanes; ++k)
+    fifo_trim_by(stage_output(p, lanes, k), max_num_out - i);
 }
 
-#undef _
-#undef a
-#undef b
-#undef c
-#undef d
+#undef n4
+#undef coefs
 #undef COEF_INTERP
+#undef CONVOLVE_INTERP
 #undef CONVOLVE
 #undef FIR_LENGTH
 #undef FUNCTION
@@ -16,33 +16,40 @@
  */
 
 /* Resample using a non-interpolated poly-phase FIR with length LEN.*/
-/* Input must be followed by LEN-1 samples. */
+/* Input must be followed by fir_len4(LEN)-1 samples. */
+/* All the lanes at once, as in rate_poly_fir.h. */
 
-#define _ sum += (coef(p->shared->poly_fir_coefs, 0, FIR_LENGTH, divided.rem, 0, j)) *at[j], ++j;
+#define n4 fir_len4(FIR_LENGTH)
 
-static void FUNCTION(stage_t * p, fifo_t * output_fifo)
+static void FUNCTION(stage_t * p, int lanes)
 {
-  sample_t const * input = stage_read_p(p);
-  int i, num_in = stage_occupancy(p), max_num_out = 1 + num_in*p->out_in_ratio;
-  sample_t * output = fifo_reserve(output_fifo, max_num_out);
+  sample_t const * input[RATE_LANES], * in[RATE_LANES];
+  sample_t * output[RATE_LANES], d[RATE_LANES];
+  int i, k, num_in = stage_occupancy(p), max_num_out = 1 + num_in*p->out_in_ratio;
   div_t divided2;
 
+  for (k = 0; k < lanes; ++k) {
+    input[k] = stage_read_p(&p[k]);
+    output[k] = fifo_reserve(stage_output(p, lanes, k), max_num_out);
+  }
   for (i = 0; p->at.parts.integer < num_in * p->L; ++i, p->at.parts.integer += p->step.parts.integer) {
     div_t divided = div(p->at.parts.integer, p->L);
-    sample_t const * at = input + divided.quot;
-    sample_t sum = 0;
-    int j = 0;
-    CONVOLVE
-    output[i] = sum;
+    for (k = 0; k < lanes; ++k)
+      in[k] = input[k] + divided.quot;
+    rate_dots(&coef(p->shared->poly_fir_coefs, 0, n4, divided.rem, 0, 0),
+        in, n4, lanes, d);
+    for (k = 0; k < lanes; ++k)
+      output[k][i] = d[k];
   }
   assert(max_num_out - i >= 0);
-  fifo_trim_by(output_fifo, max_num_out - i);
   divided2 = div(p->at.parts.integer, p->L);
-  fifo_read(&p->fifo, divided2.quot, NULL);
+  for (k = 0; k < lanes; ++k) {
+    fifo_trim_by(stage_output(p, lanes, k), max_num_out - i);
+    fifo_read(&p[k].fifo, divided2.quot, NULL);
+  }
   p->at.parts.integer = divided2.rem;
 }
 
-#undef _
-#undef CONVOLVE
+#undef n4
 #undef FIR_LENGTH
 #undef FUNCTION
@@ -32,10 +32,10 @@ LSX_FORMAT_HANDLER(raw)
     SOX_ENCODING_FLOAT, 64, 32, 0,
     0};
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
-    "Raw PCM, mu-law, or A-law", names, 0,
+    "Raw PCM, mu-law, or A-law", names, SOX_FILE_MMAP | SOX_FILE_RAWPCM | SOX_FILE_CLONE,
     raw_start, lsx_rawread , NULL,
     raw_start, lsx_rawwrite, NULL,
-    lsx_rawseek, encodings, NULL, 0
+    lsx_rawseek, encodings, NULL, 0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -52,10 +52,10 @@ LSX_FORMAT_HANDLER(sln)
   static sox_rate_t const write_rates[] = {8000, 0};
   static sox_format_handler_t handler = {SOX_LIB_VERSION_CODE,
     "Asterisk PBX headerless format",
-    names, SOX_FILE_LIT_END|SOX_FILE_MONO,
+    names, SOX_FILE_LIT_END|SOX_FILE_MONO|SOX_FILE_MMAP|SOX_FILE_RAWPCM|SOX_FILE_CLONE,
     sln_start, lsx_rawread, NULL,
     NULL, lsx_rawwrite, NULL,
-    lsx_rawseek, write_encodings, write_rates, 0
+    lsx_rawseek, write_encodings, write_rates, 0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
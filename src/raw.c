@@ -9,6 +9,13 @@
 
 #include "sox_i.h"
 #include "g711.h"
+#include <string.h>
+#include "raw_vec.h"
+
+void lsx_raw_dispatch(unsigned cpu)
+{
+  raw_vec_init(cpu);
+}
 
 typedef sox_uint16_t sox_uint14_t;
 typedef sox_uint16_t sox_uint13_t;
@@ -16,8 +23,6 @@ typedef sox_int16_t sox_int14_t;
 typedef sox_int16_t sox_int13_t;
 #define SOX_ULAW_BYTE_TO_SAMPLE(d,clips)   SOX_SIGNED_16BIT_TO_SAMPLE(sox_ulaw2linear16(d),clips)
 #define SOX_ALAW_BYTE_TO_SAMPLE(d,clips)   SOX_SIGNED_16BIT_TO_SAMPLE(sox_alaw2linear16(d),clips)
-#define SOX_SAMPLE_TO_ULAW_BYTE(d,c) sox_14linear2ulaw(SOX_SAMPLE_TO_UNSIGNED(14,d,c) - 0x2000)
-#define SOX_SAMPLE_TO_ALAW_BYTE(d,c) sox_13linear2alaw(SOX_SAMPLE_TO_UNSIGNED(13,d,c) - 0x1000)
 
 int lsx_rawseek(sox_format_t * ft, uint64_t offset)
 {
@@ -66,18 +71,33 @@ int lsx_rawstart(sox_format_t * ft, sox_bool default_rate,
   return SOX_SUCCESS;
 }
 
+/* Can data of the given size be used as they lie in a memory-mapped file
+ * or memory buffer?  (A buffer, unlike a map, need not be page-aligned.) */
+static sox_bool is_as_is(sox_format_t * ft, size_t size)
+{
+  return ft->map && !((uintptr_t)(ft->map + ft->tell_off) % size) && !(size == 1?
+      ft->encoding.reverse_bits || ft->encoding.reverse_nibbles :
+      ft->encoding.reverse_bytes);
+}
+
 #define READ_SAMPLES_FUNC(type, size, sign, ctype, uctype, cast) \
   static size_t sox_read_ ## sign ## type ## _samples( \
       sox_format_t * ft, sox_sample_t *buf, size_t len) \
   { \
     size_t n, nread; \
     SOX_SAMPLE_LOCALS; \
-    ctype *data = lsx_malloc(sizeof(ctype) * len); \
+    ctype *copy = NULL; \
+    ctype const *data = \
+      size != sizeof(ctype) || !is_as_is(ft, (size_t)size)? NULL : \
+      lsx_read_mapped(ft, sizeof(ctype), len, &nread); \
     LSX_USE_VAR(sox_macro_temp_sample), LSX_USE_VAR(sox_macro_temp_double); \
-    nread = lsx_read_ ## type ## _buf(ft, (uctype *)data, len); \
+    if (!data) { \
+      data = copy = lsx_malloc(sizeof(ctype) * len); \
+      nread = lsx_read_ ## type ## _buf(ft, (uctype *)copy, len); \
+    } \
     for (n = 0; n < nread; n++) \
       *buf++ = cast(data[n], ft->clips); \
-    free(data); \
+    free(copy); \
     return nread; \
   }
 
@@ -86,14 +106,32 @@ READ_SAMPLES_FUNC(b, 1, s, int8_t, uint8_t, SOX_SIGNED_8BIT_TO_SAMPLE)
 READ_SAMPLES_FUNC(b, 1, ulaw, uint8_t, uint8_t, SOX_ULAW_BYTE_TO_SAMPLE)
 READ_SAMPLES_FUNC(b, 1, alaw, uint8_t, uint8_t, SOX_ALAW_BYTE_TO_SAMPLE)
 READ_SAMPLES_FUNC(w, 2, u, uint16_t, uint16_t, SOX_UNSIGNED_16BIT_TO_SAMPLE)
-READ_SAMPLES_FUNC(w, 2, s, int16_t, uint16_t, SOX_SIGNED_16BIT_TO_SAMPLE)
 READ_SAMPLES_FUNC(3, 3, u, sox_uint24_t, sox_uint24_t, SOX_UNSIGNED_24BIT_TO_SAMPLE)
-READ_SAMPLES_FUNC(3, 3, s, sox_int24_t, sox_uint24_t, SOX_SIGNED_24BIT_TO_SAMPLE)
 READ_SAMPLES_FUNC(dw, 4, u, uint32_t, uint32_t, SOX_UNSIGNED_32BIT_TO_SAMPLE)
-READ_SAMPLES_FUNC(dw, 4, s, int32_t, uint32_t, SOX_SIGNED_32BIT_TO_SAMPLE)
-READ_SAMPLES_FUNC(f, sizeof(float), su, float, float, SOX_FLOAT_32BIT_TO_SAMPLE)
 READ_SAMPLES_FUNC(df, sizeof(double), su, double, double, SOX_FLOAT_64BIT_TO_SAMPLE)
 
+/* The commonest types are converted by the raw_vec.h kernels instead. */
+#define READ_VEC_FUNC(type, size, sign, kernel) \
+  static size_t sox_read_ ## sign ## type ## _samples( \
+      sox_format_t * ft, sox_sample_t *buf, size_t len) \
+  { \
+    size_t nread; \
+    void *copy = NULL; \
+    void const *data = lsx_read_mapped(ft, (size_t)size, len, &nread); \
+    if (!data) { \
+      data = copy = lsx_malloc(size * len); \
+      nread = lsx_readbuf(ft, copy, size * len) / size; \
+    } \
+    ft->clips += kernel(buf, data, nread, ft->encoding.reverse_bytes != sox_option_no); \
+    free(copy); \
+    return nread; \
+  }
+
+READ_VEC_FUNC(w, 2, s, raw_unpack_s16)
+READ_VEC_FUNC(3, 3, s, raw_unpack_s24)
+READ_VEC_FUNC(dw, 4, s, raw_unpack_s32)
+READ_VEC_FUNC(f, sizeof(float), su, raw_unpack_f32)
+
 #define WRITE_SAMPLES_FUNC(type, size, sign, ctype, uctype, cast) \
   static size_t sox_write_ ## sign ## type ## _samples( \
       sox_format_t * ft, sox_sample_t const * buf, size_t len) \
@@ -112,17 +150,79 @@ READ_SAMPLES_FUNC(df, sizeof(double), su, double, double, SOX_FLOAT_64BIT_TO_SAM
 
 WRITE_SAMPLES_FUNC(b, 1, u, uint8_t, uint8_t, SOX_SAMPLE_TO_UNSIGNED_8BIT) 
 WRITE_SAMPLES_FUNC(b, 1, s, int8_t, uint8_t, SOX_SAMPLE_TO_SIGNED_8BIT)
-WRITE_SAMPLES_FUNC(b, 1, ulaw, uint8_t, uint8_t, SOX_SAMPLE_TO_ULAW_BYTE) 
-WRITE_SAMPLES_FUNC(b, 1, alaw, uint8_t, uint8_t, SOX_SAMPLE_TO_ALAW_BYTE)
 WRITE_SAMPLES_FUNC(w, 2, u, uint16_t, uint16_t, SOX_SAMPLE_TO_UNSIGNED_16BIT) 
-WRITE_SAMPLES_FUNC(w, 2, s, int16_t, uint16_t, SOX_SAMPLE_TO_SIGNED_16BIT)
 WRITE_SAMPLES_FUNC(3, 3, u, sox_uint24_t, sox_uint24_t, SOX_SAMPLE_TO_UNSIGNED_24BIT) 
-WRITE_SAMPLES_FUNC(3, 3, s, sox_int24_t, sox_uint24_t, SOX_SAMPLE_TO_SIGNED_24BIT)
 WRITE_SAMPLES_FUNC(dw, 4, u, uint32_t, uint32_t, SOX_SAMPLE_TO_UNSIGNED_32BIT) 
-WRITE_SAMPLES_FUNC(dw, 4, s, int32_t, uint32_t, SOX_SAMPLE_TO_SIGNED_32BIT)
-WRITE_SAMPLES_FUNC(f, sizeof(float), su, float, float, SOX_SAMPLE_TO_FLOAT_32BIT) 
 WRITE_SAMPLES_FUNC(df, sizeof (double), su, double, double, SOX_SAMPLE_TO_FLOAT_64BIT)
 
+/* Writes 16-bit samples through the output's quantiser (see
+ * sox_fuse_output): each channel goes through the quantiser's flow for it
+ * straight to the packed values, a block of whole wide samples at a time so
+ * as to stay in cache for the copy to the stdio buffer. */
+#define QUANTISE_BLOCK 4096
+
+static size_t raw_write_quantised(sox_format_t * ft, sox_sample_t const * buf, size_t len)
+{
+  size_t ch = ft->signal.channels, block = max(QUANTISE_BLOCK / ch, 1) * ch;
+  sox_bool swap = ft->encoding.reverse_bytes != sox_option_no;
+  uint8_t data[2 * QUANTISE_BLOCK];
+  size_t done = 0, n, c;
+
+  if (block > QUANTISE_BLOCK) {        /* More channels than the block */
+    lsx_fail_errno(ft, SOX_EFMT, "too many channels to quantise");
+    return 0;
+  }
+  for (; done < len; done += n) {
+    n = min(len - done, block);
+    for (c = 0; c < ch && c < n; ++c)
+      ft->quantiser[c].pack(&ft->quantiser[c], buf + done + c, data + 2 * c,
+          (n - c + ch - 1) / ch, ch, swap);
+    if (lsx_writebuf(ft, data, 2 * n) != 2 * n)
+      break;
+  }
+  return done;
+}
+
+#define WRITE_VEC_FUNC(type, size, sign, kernel) \
+  static size_t sox_write_ ## sign ## type ## _samples( \
+      sox_format_t * ft, sox_sample_t const * buf, size_t len) \
+  { \
+    size_t nwritten; \
+    void *data = lsx_malloc(size * len); \
+    ft->clips += kernel(data, buf, len, ft->encoding.reverse_bytes != sox_option_no); \
+    nwritten = lsx_writebuf(ft, data, size * len) / size; \
+    free(data); \
+    return nwritten; \
+  }
+
+WRITE_VEC_FUNC(w_vec, 2, s, raw_pack_s16)
+WRITE_VEC_FUNC(3, 3, s, raw_pack_s24)
+WRITE_VEC_FUNC(dw, 4, s, raw_pack_s32)
+WRITE_VEC_FUNC(f, sizeof(float), su, raw_pack_f32)
+
+static size_t sox_write_sw_samples(
+    sox_format_t * ft, sox_sample_t const * buf, size_t len)
+{
+  return ft->quantiser? raw_write_quantised(ft, buf, len) :
+      sox_write_sw_vec_samples(ft, buf, len);
+}
+
+/* As above, but written through lsx_write_b_buf for bit & nibble reversal */
+#define WRITE_LAW_FUNC(sign, kernel) \
+  static size_t sox_write_ ## sign ## b_samples( \
+      sox_format_t * ft, sox_sample_t const * buf, size_t len) \
+  { \
+    size_t nwritten; \
+    uint8_t *data = lsx_malloc(len); \
+    ft->clips += kernel(data, buf, len, sox_false); \
+    nwritten = lsx_write_b_buf(ft, data, len); \
+    free(data); \
+    return nwritten; \
+  }
+
+WRITE_LAW_FUNC(ulaw, raw_pack_ulaw)
+WRITE_LAW_FUNC(alaw, raw_pack_alaw)
+
 #define GET_FORMAT(type) \
 static ft_##type##_fn * type##_fn(sox_format_t * ft) { \
   switch (ft->encoding.bits_per_sample) { \
@@ -25,10 +25,10 @@ const sox_format_handler_t *lsx_ ## id ## _format_fn(void) { \
     SOX_ENCODING_ ## encoding, size, 0, 0}; \
   static sox_format_handler_t handler = { \
     SOX_LIB_VERSION_CODE, "Raw audio", \
-    names, flags, \
+    names, (flags) | SOX_FILE_MMAP | SOX_FILE_RAWPCM, \
     id ## _start, lsx_rawread , NULL, \
     id ## _start, lsx_rawwrite, NULL, \
-    NULL, write_encodings, NULL, 0 \
+    NULL, write_encodings, NULL, 0, NULL, NULL, NULL, NULL \
   }; \
   return &handler; \
 }
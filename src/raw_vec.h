@@ -0,0 +1,516 @@
+/* libSoX raw I/O: sample packing & unpacking kernels
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Conversion between sox_sample_t and n packed values of signed 16, 24 or
+ * 32-bit integer, or 32-bit float, data as they lie in a file (so maybe
+ * unaligned, and byte-swapped if swap is set).  Each returns the number of
+ * values clipped, and gives exactly the results of the SOX_..._TO_... macros
+ * that the scalar versions use; the fastest that the CPU supports is chosen
+ * at run-time (by sox_init) by raw_vec_init().  Also, encoding to u-law and A-law (swap
+ * unused), giving exactly the results of the g711.h tables. */
+
+#if defined HAVE_LSX_TARGET
+  #define HAVE_RAW_VEC_SSSE3 1  /* Built regardless of -m options */
+  #include <tmmintrin.h>
+  #define RAW_VEC_TARGET LSX_TARGET("ssse3")
+#endif
+
+typedef sox_uint64_t (* raw_unpack_fn_t)(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap);
+typedef sox_uint64_t (* raw_pack_fn_t)(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap);
+
+static sox_uint64_t unpack_s16_c(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  size_t i;
+
+  for (i = 0; i < n; ++i, p += 2) {
+    uint16_t x;
+    memcpy(&x, p, sizeof(x));
+    if (swap)
+      x = (uint16_t)(x << 8 | x >> 8);
+    d[i] = SOX_SIGNED_TO_SAMPLE(16, (int16_t)x);
+  }
+  return 0;
+}
+
+static sox_uint64_t unpack_s24_c(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  size_t i;
+
+  for (i = 0; i < n; ++i, p += 3) {
+    sox_int24_t x = swap == MACHINE_IS_BIGENDIAN?
+        p[0] | (p[1] << 8) | (p[2] << 16) : p[2] | (p[1] << 8) | (p[0] << 16);
+    d[i] = SOX_SIGNED_TO_SAMPLE(24, x);
+  }
+  return 0;
+}
+
+static sox_uint64_t unpack_s32_c(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  size_t i;
+
+  if (!swap)
+    memcpy(d, s, n * sizeof(*d));
+  else for (i = 0; i < n; ++i, p += 4) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    d[i] = (sox_sample_t)lsx_swapdw(x);
+  }
+  return 0;
+}
+
+static sox_uint64_t unpack_f32_c(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  sox_uint64_t clips = 0;
+  size_t i;
+  SOX_SAMPLE_LOCALS;
+
+  for (i = 0; i < n; ++i, p += 4) {
+    uint32_t u;
+    float x;
+    memcpy(&u, p, sizeof(u));
+    if (swap)
+      u = lsx_swapdw(u);
+    memcpy(&x, &u, sizeof(x));
+    d[i] = SOX_FLOAT_32BIT_TO_SAMPLE(x, clips);
+  }
+  return clips;
+}
+
+static sox_uint64_t pack_s16_c(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  sox_uint64_t clips = 0;
+  size_t i;
+  SOX_SAMPLE_LOCALS;
+
+  for (i = 0; i < n; ++i, p += 2) {
+    uint16_t x = SOX_SAMPLE_TO_SIGNED_16BIT(s[i], clips);
+    if (swap)
+      x = (uint16_t)(x << 8 | x >> 8);
+    memcpy(p, &x, sizeof(x));
+  }
+  return clips;
+}
+
+static sox_uint64_t pack_s24_c(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  sox_uint64_t clips = 0;
+  size_t i;
+  SOX_SAMPLE_LOCALS;
+
+  for (i = 0; i < n; ++i, p += 3) {
+    sox_uint24_t x = SOX_SAMPLE_TO_SIGNED_24BIT(s[i], clips);
+    if (swap == MACHINE_IS_BIGENDIAN)
+      p[0] = x & 0xff, p[1] = (x >> 8) & 0xff, p[2] = (x >> 16) & 0xff;
+    else p[2] = x & 0xff, p[1] = (x >> 8) & 0xff, p[0] = (x >> 16) & 0xff;
+  }
+  return clips;
+}
+
+static sox_uint64_t pack_s32_c(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  size_t i;
+
+  if (!swap)
+    memcpy(d, s, n * sizeof(*s));
+  else for (i = 0; i < n; ++i, p += 4) {
+    uint32_t x = (uint32_t)s[i];
+    x = lsx_swapdw(x);
+    memcpy(p, &x, sizeof(x));
+  }
+  return 0;
+}
+
+static sox_uint64_t pack_f32_c(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  sox_uint64_t clips = 0;
+  size_t i;
+  SOX_SAMPLE_LOCALS;
+
+  for (i = 0; i < n; ++i, p += 4) {
+    float x = SOX_SAMPLE_TO_FLOAT_32BIT(s[i], clips);
+    uint32_t u;
+    memcpy(&u, &x, sizeof(u));
+    if (swap)
+      u = lsx_swapdw(u);
+    memcpy(p, &u, sizeof(u));
+  }
+  return clips;
+}
+
+/* G.711 encoding is computed rather than looked up in a 16k or 8k table:
+ * converted to float, a magnitude's exponent and top 4 mantissa bits are
+ * the segment and quantisation bits of the code (less a constant). */
+
+static sox_uint64_t pack_ulaw_c(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  sox_uint64_t clips = 0;
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    int32_t v, neg, mag, bits;
+    float f;
+    if (s[i] > SOX_SAMPLE_MAX - (1 << 17))
+      v = 0x1fff, ++clips;
+    else v = (s[i] + (1 << 17)) >> 18;         /* 14-bit, rounded */
+    neg = v >> 31;
+    mag = min((v ^ neg) - neg, 0x1fde) + 0x21; /* Clipped & biased */
+    f = (float)mag;
+    memcpy(&bits, &f, sizeof(bits));
+    p[i] = (uint8_t)(((bits >> 19) - 0x840) ^ (0xff ^ (neg & 0x80)));
+  }
+  (void)swap;
+  return clips;
+}
+
+static sox_uint64_t pack_alaw_c(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  sox_uint64_t clips = 0;
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    int32_t v, neg, mag, bits;
+    float f;
+    if (s[i] > SOX_SAMPLE_MAX - (1 << 18))
+      v = 0xfff, ++clips;
+    else v = (s[i] + (1 << 18)) >> 19;         /* 13-bit, rounded */
+    neg = v >> 31;
+    mag = v ^ neg;                             /* i.e. -v - 1 if v < 0 */
+    f = (float)mag;
+    memcpy(&bits, &f, sizeof(bits));
+    p[i] = (uint8_t)((mag < 32? mag >> 1 : (bits >> 19) - 0x830) ^
+        (0x55 | (~neg & 0x80)));
+  }
+  (void)swap;
+  return clips;
+}
+
+#if defined HAVE_RAW_VEC_SSSE3
+
+/* Number of the 4 lanes of c that are set (seldom any) */
+RAW_VEC_TARGET
+static int raw_vec_count(__m128i c)
+{
+  int m = _mm_movemask_ps(_mm_castsi128_ps(c));
+  return m? (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + (m >> 3) : 0;
+}
+
+#define RAW_VEC_SELECT(c, x, y) \
+  _mm_or_si128(_mm_and_si128(c, x), _mm_andnot_si128(c, y))
+
+/* A byte shuffle's control, given as to _mm_setr_epi8 but packed into
+ * 32-bit lanes, so that no argument is narrower than an int */
+#define RAW_VEC_LANE(a,b,c,d) (int)(((unsigned)(a) & 255) | \
+    ((unsigned)(b) & 255) << 8 | ((unsigned)(c) & 255) << 16 | \
+    ((unsigned)(d) & 255) << 24)
+#define RAW_VEC_BYTES(a,b,c,d, e,f,g,h, i,j,k,l, m,n,o,p) _mm_setr_epi32( \
+    RAW_VEC_LANE(a,b,c,d), RAW_VEC_LANE(e,f,g,h), \
+    RAW_VEC_LANE(i,j,k,l), RAW_VEC_LANE(m,n,o,p))
+
+#define RAW_VEC_SWAP16 RAW_VEC_BYTES(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14)
+#define RAW_VEC_SWAP32 RAW_VEC_BYTES(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12)
+#define RAW_VEC_SAME   RAW_VEC_BYTES(0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15)
+
+/* A float constant in every lane, given by its bits (likewise) */
+#define RAW_VEC_F32(bits) _mm_castsi128_ps(_mm_set1_epi32(bits))
+
+RAW_VEC_TARGET
+static sox_uint64_t unpack_s16_ssse3(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  __m128i const order = swap? RAW_VEC_SWAP16 : RAW_VEC_SAME;
+  __m128i const zero = _mm_setzero_si128();
+  size_t i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i x = _mm_shuffle_epi8(
+        _mm_loadu_si128((__m128i const *)(p + 2 * i)), order);
+    _mm_storeu_si128((__m128i *)(d + i), _mm_unpacklo_epi16(zero, x));
+    _mm_storeu_si128((__m128i *)(d + i + 4), _mm_unpackhi_epi16(zero, x));
+  }
+  return unpack_s16_c(d + i, p + 2 * i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t unpack_s24_ssse3(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  __m128i const order = swap?   /* Into the top 3 bytes of each lane */
+    RAW_VEC_BYTES(-1,2,1,0, -1,5,4,3, -1,8,7,6, -1,11,10,9) :
+    RAW_VEC_BYTES(-1,0,1,2, -1,3,4,5, -1,6,7,8, -1,9,10,11);
+  size_t i;
+
+  for (i = 0; i + 6 <= n; i += 4)   /* Loads 16 bytes for 12 */
+    _mm_storeu_si128((__m128i *)(d + i), _mm_shuffle_epi8(
+        _mm_loadu_si128((__m128i const *)(p + 3 * i)), order));
+  return unpack_s24_c(d + i, p + 3 * i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t unpack_s32_ssse3(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  size_t i;
+
+  if (!swap)
+    return unpack_s32_c(d, s, n, swap);
+  for (i = 0; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i *)(d + i), _mm_shuffle_epi8(
+        _mm_loadu_si128((__m128i const *)(p + 4 * i)), RAW_VEC_SWAP32));
+  return unpack_s32_c(d + i, p + 4 * i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t unpack_f32_ssse3(
+    sox_sample_t * d, void const * s, size_t n, sox_bool swap)
+{
+  uint8_t const * p = s;
+  __m128i const order = swap? RAW_VEC_SWAP32 : RAW_VEC_SAME;
+  __m128 const scale = RAW_VEC_F32(0x4f000000);     /* 2^31 */
+  __m128 const lo = RAW_VEC_F32((int)0xcf000000);   /* -2^31 */
+  sox_uint64_t clips = 0;
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    /* x is exact, as in double; lanes at or above 2^31 convert to 2^31 - 1
+     * once inverted, and those below -2^31 convert to -2^31 anyway. */
+    __m128 x = _mm_mul_ps(scale, _mm_castsi128_ps(_mm_shuffle_epi8(
+        _mm_loadu_si128((__m128i const *)(p + 4 * i)), order)));
+    __m128 high = _mm_cmpge_ps(x, scale);
+    __m128i c = _mm_castps_si128(
+        _mm_or_ps(_mm_cmplt_ps(x, lo), _mm_cmpgt_ps(x, scale)));
+    _mm_storeu_si128((__m128i *)(d + i),
+        _mm_xor_si128(_mm_cvttps_epi32(x), _mm_castps_si128(high)));
+    clips += raw_vec_count(c);
+  }
+  return clips + unpack_f32_c(d + i, p + 4 * i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t pack_s16_ssse3(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  __m128i const order = swap? RAW_VEC_SWAP16 : RAW_VEC_SAME;
+  __m128i const max = _mm_set1_epi32(SOX_SAMPLE_MAX);
+  __m128i const limit = _mm_set1_epi32(SOX_SAMPLE_MAX - (1 << 15));
+  __m128i const round = _mm_set1_epi32(1 << 15);
+  sox_uint64_t clips = 0;
+  size_t i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i x0 = _mm_loadu_si128((__m128i const *)(s + i));
+    __m128i x1 = _mm_loadu_si128((__m128i const *)(s + i + 4));
+    __m128i c0 = _mm_cmpgt_epi32(x0, limit), c1 = _mm_cmpgt_epi32(x1, limit);
+    x0 = _mm_srai_epi32(RAW_VEC_SELECT(c0, max, _mm_add_epi32(x0, round)), 16);
+    x1 = _mm_srai_epi32(RAW_VEC_SELECT(c1, max, _mm_add_epi32(x1, round)), 16);
+    _mm_storeu_si128((__m128i *)(p + 2 * i),
+        _mm_shuffle_epi8(_mm_packs_epi32(x0, x1), order));
+    clips += raw_vec_count(c0) + raw_vec_count(c1);
+  }
+  return clips + pack_s16_c(p + 2 * i, s + i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t pack_s24_ssse3(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  __m128i const order = swap?   /* From the top 3 bytes of each lane */
+    RAW_VEC_BYTES(3,2,1, 7,6,5, 11,10,9, 15,14,13, -1,-1,-1,-1) :
+    RAW_VEC_BYTES(1,2,3, 5,6,7, 9,10,11, 13,14,15, -1,-1,-1,-1);
+  __m128i const max = _mm_set1_epi32(SOX_SAMPLE_MAX);
+  __m128i const limit = _mm_set1_epi32(SOX_SAMPLE_MAX - (1 << 7));
+  __m128i const round = _mm_set1_epi32(1 << 7);
+  sox_uint64_t clips = 0;
+  size_t i;
+
+  for (i = 0; i + 6 <= n; i += 4) {   /* Stores 16 bytes for 12 */
+    __m128i x = _mm_loadu_si128((__m128i const *)(s + i));
+    __m128i c = _mm_cmpgt_epi32(x, limit);
+    _mm_storeu_si128((__m128i *)(p + 3 * i), _mm_shuffle_epi8(
+        RAW_VEC_SELECT(c, max, _mm_add_epi32(x, round)), order));
+    clips += raw_vec_count(c);
+  }
+  return clips + pack_s24_c(p + 3 * i, s + i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t pack_s32_ssse3(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  size_t i;
+
+  if (!swap)
+    return pack_s32_c(d, s, n, swap);
+  for (i = 0; i + 4 <= n; i += 4)
+    _mm_storeu_si128((__m128i *)(p + 4 * i), _mm_shuffle_epi8(
+        _mm_loadu_si128((__m128i const *)(s + i)), RAW_VEC_SWAP32));
+  return pack_s32_c(p + 4 * i, s + i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t pack_f32_ssse3(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  __m128i const order = swap? RAW_VEC_SWAP32 : RAW_VEC_SAME;
+  __m128i const limit = _mm_set1_epi32(SOX_SAMPLE_MAX - 64);
+  __m128i const round = _mm_set1_epi32(64), mask = _mm_set1_epi32(~127);
+  __m128 const scale = RAW_VEC_F32(0x30000000);     /* 2^-31 */
+  __m128 const one = RAW_VEC_F32(0x3f800000);       /* 1 */
+  sox_uint64_t clips = 0;
+  size_t i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    /* With its low 7 bits cleared, x converts exactly, as in double */
+    __m128i x = _mm_loadu_si128((__m128i const *)(s + i));
+    __m128i c = _mm_cmpgt_epi32(x, limit);
+    __m128 y = _mm_mul_ps(scale, _mm_cvtepi32_ps(
+        _mm_and_si128(_mm_add_epi32(x, round), mask)));
+    y = _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(c), one),
+        _mm_andnot_ps(_mm_castsi128_ps(c), y));
+    _mm_storeu_si128((__m128i *)(p + 4 * i),
+        _mm_shuffle_epi8(_mm_castps_si128(y), order));
+    clips += raw_vec_count(c);
+  }
+  return clips + pack_f32_c(p + 4 * i, s + i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t pack_ulaw_ssse3(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  __m128i const max = _mm_set1_epi32(0x1fff);
+  __m128i const limit = _mm_set1_epi32(SOX_SAMPLE_MAX - (1 << 17));
+  __m128i const round = _mm_set1_epi32(1 << 17);
+  __m128i const clip = _mm_set1_epi32(0x1fde), bias = _mm_set1_epi32(0x21);
+  __m128i const base = _mm_set1_epi32(0x840);
+  __m128i const sign = _mm_set1_epi32(0x80), ones = _mm_set1_epi32(0xff);
+  sox_uint64_t clips = 0;
+  size_t i, j;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i code[2];
+    for (j = 0; j < 2; ++j) {
+      __m128i x = _mm_loadu_si128((__m128i const *)(s + i + 4 * j));
+      __m128i c = _mm_cmpgt_epi32(x, limit);
+      __m128i v = RAW_VEC_SELECT(c, max,
+          _mm_srai_epi32(_mm_add_epi32(x, round), 18));
+      __m128i mag = _mm_abs_epi32(v);
+      mag = _mm_add_epi32(RAW_VEC_SELECT(_mm_cmpgt_epi32(mag, clip), clip, mag), bias);
+      code[j] = _mm_xor_si128(
+          _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(mag)), 19), base),
+          _mm_xor_si128(ones, _mm_and_si128(_mm_srai_epi32(v, 31), sign)));
+      clips += raw_vec_count(c);
+    }
+    _mm_storel_epi64((__m128i *)(p + i), _mm_packus_epi16(
+        _mm_packs_epi32(code[0], code[1]), _mm_setzero_si128()));
+  }
+  return clips + pack_ulaw_c(p + i, s + i, n - i, swap);
+}
+
+RAW_VEC_TARGET
+static sox_uint64_t pack_alaw_ssse3(
+    void * d, sox_sample_t const * s, size_t n, sox_bool swap)
+{
+  uint8_t * p = d;
+  __m128i const max = _mm_set1_epi32(0xfff);
+  __m128i const limit = _mm_set1_epi32(SOX_SAMPLE_MAX - (1 << 18));
+  __m128i const round = _mm_set1_epi32(1 << 18);
+  __m128i const small = _mm_set1_epi32(31), base = _mm_set1_epi32(0x830);
+  __m128i const sign = _mm_set1_epi32(0x80), even = _mm_set1_epi32(0x55);
+  sox_uint64_t clips = 0;
+  size_t i, j;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    __m128i code[2];
+    for (j = 0; j < 2; ++j) {
+      __m128i x = _mm_loadu_si128((__m128i const *)(s + i + 4 * j));
+      __m128i c = _mm_cmpgt_epi32(x, limit);
+      __m128i v = RAW_VEC_SELECT(c, max,
+          _mm_srai_epi32(_mm_add_epi32(x, round), 19));
+      __m128i neg = _mm_srai_epi32(v, 31), mag = _mm_xor_si128(v, neg);
+      __m128i seg = _mm_sub_epi32(_mm_srli_epi32(
+          _mm_castps_si128(_mm_cvtepi32_ps(mag)), 19), base);
+      code[j] = _mm_xor_si128(RAW_VEC_SELECT(_mm_cmpgt_epi32(mag, small),
+          seg, _mm_srli_epi32(mag, 1)), _mm_or_si128(even, _mm_andnot_si128(neg, sign)));
+      clips += raw_vec_count(c);
+    }
+    _mm_storel_epi64((__m128i *)(p + i), _mm_packus_epi16(
+        _mm_packs_epi32(code[0], code[1]), _mm_setzero_si128()));
+  }
+  return clips + pack_alaw_c(p + i, s + i, n - i, swap);
+}
+
+#endif
+
+static raw_unpack_fn_t raw_unpack_s16 = unpack_s16_c;
+static raw_unpack_fn_t raw_unpack_s24 = unpack_s24_c;
+static raw_unpack_fn_t raw_unpack_s32 = unpack_s32_c;
+static raw_unpack_fn_t raw_unpack_f32 = unpack_f32_c;
+static raw_pack_fn_t raw_pack_s16 = pack_s16_c;
+static raw_pack_fn_t raw_pack_s24 = pack_s24_c;
+static raw_pack_fn_t raw_pack_s32 = pack_s32_c;
+static raw_pack_fn_t raw_pack_f32 = pack_f32_c;
+static raw_pack_fn_t raw_pack_ulaw = pack_ulaw_c;
+static raw_pack_fn_t raw_pack_alaw = pack_alaw_c;
+
+static void raw_vec_init(unsigned cpu)
+{
+#if defined HAVE_RAW_VEC_SSSE3
+  if (cpu & LSX_CPU_SSSE3) {
+    raw_unpack_s16 = unpack_s16_ssse3;
+    raw_unpack_s24 = unpack_s24_ssse3;
+    raw_unpack_s32 = unpack_s32_ssse3;
+    raw_unpack_f32 = unpack_f32_ssse3;
+    raw_pack_s16 = pack_s16_ssse3;
+    raw_pack_s24 = pack_s24_ssse3;
+    raw_pack_s32 = pack_s32_ssse3;
+    raw_pack_f32 = pack_f32_ssse3;
+    raw_pack_ulaw = pack_ulaw_ssse3;
+    raw_pack_alaw = pack_alaw_ssse3;
+  }
+#endif
+  (void)cpu;
+}
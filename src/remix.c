@@ -30,8 +30,13 @@ typedef struct {
       double   multiplier;
     } * in_specs;
   } * out_specs;
+  enum {mix_sum, mix_select, mix_identity} kernel; /* Chosen by compile() */
+  sox_bool * in_used;    /* Which input channels the sums need */
+  double * block;        /* Those channels, then a sum, for MIX_LEN frames */
 } priv_t;
 
+#define MIX_LEN 256     /* Frames summed at a time */
+
 #define PARSE(SEP, SCAN, VAR, MIN, SEPARATORS) do {\
   end = strpbrk(text, SEPARATORS); \
   if (end == text) \
@@ -110,6 +115,33 @@ static int show(priv_t *p)
   return SOX_SUCCESS;
 }
 
+/* Picks the kernel for flow(): if each output channel is just an input
+ * channel (at unity), then it is a straight copy (or a select/duplicate);
+ * otherwise, each output is summed, term by term, over a block of frames. */
+static void compile(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned i, j, in_channels = effp->in_signal.channels;
+
+  p->kernel = in_channels == p->num_out_channels? mix_identity : mix_select;
+  for (j = 0; j < p->num_out_channels; j++) {
+    if (p->out_specs[j].num_in_channels != 1 ||
+        p->out_specs[j].in_specs[0].multiplier != 1)
+      p->kernel = mix_sum;
+    else if (p->out_specs[j].in_specs[0].channel_num != j &&
+        p->kernel == mix_identity)
+      p->kernel = mix_select;
+  }
+  p->in_used = lsx_effect_calloc(effp, in_channels, sizeof(*p->in_used));
+  for (j = 0; j < p->num_out_channels; j++)
+    for (i = 0; i < p->out_specs[j].num_in_channels; i++)
+      p->in_used[p->out_specs[j].in_specs[i].channel_num] = sox_true;
+  p->block = p->kernel == mix_sum? lsx_effect_calloc(effp,
+      (in_channels + 1) * MIX_LEN, sizeof(*p->block)) : NULL;
+  lsx_debug("kernel=%s", p->kernel == mix_sum? "sum" :
+      p->kernel == mix_select? "select" : "identity");
+}
+
 static int create(sox_effect_t * effp, int argc, char * * argv)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -122,7 +154,8 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
     return SOX_EOF;
   }
   p->num_out_channels = argc;
-  p->out_specs = lsx_calloc(p->num_out_channels, sizeof(*p->out_specs));
+  p->out_specs =
+    lsx_effect_calloc(effp, p->num_out_channels, sizeof(*p->out_specs));
   return parse(effp, argv, 1); /* No channels yet; parse with dummy */
 }
 
@@ -155,23 +188,63 @@ static int start(sox_effect_t * effp)
   else
     effp->out_signal.precision = SOX_SAMPLE_PRECISION;
   show(p);
-  return SOX_SUCCESS;
+  compile(effp);
+  return p->kernel == mix_identity? SOX_EFF_NULL : SOX_SUCCESS;
 }
 
 static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  unsigned i, j, len;
-  len =  min(*isamp / effp->in_signal.channels, *osamp / effp->out_signal.channels);
-  *isamp = len * effp->in_signal.channels;
-  *osamp = len * effp->out_signal.channels;
+  unsigned i, j, ichans = effp->in_signal.channels;
+  unsigned ochans = effp->out_signal.channels;
+  size_t len, k, k0, n;
+  size_t istep = ichans, istride = 1, ostep = ochans, ostride = 1;
 
-  for (; len--; ibuf += effp->in_signal.channels) for (j = 0; j < effp->out_signal.channels; j++) {
-    double out = 0;
-    for (i = 0; i < p->out_specs[j].num_in_channels; i++)
-      out += ibuf[p->out_specs[j].in_specs[i].channel_num] * p->out_specs[j].in_specs[i].multiplier;
-    *obuf++ = SOX_ROUND_CLIP_COUNT(out, effp->clips);
+  len =  min(*isamp / ichans, *osamp / ochans);
+  *isamp = len * ichans;
+  *osamp = len * ochans;
+
+  if (effp->planar) { /* Each channel's samples are in a buffer of its own */
+    istep = ostep = 1;
+    istride = lsx_iplane_size(effp);
+    ostride = lsx_oplane_size(effp);
+  }
+  /* Sample k of channel c is at buf[c * stride + k * step] */
+
+  if (p->kernel == mix_identity && !effp->planar)
+    memcpy(obuf, ibuf, len * ichans * sizeof(*obuf));
+  else if (p->kernel != mix_sum) for (j = 0; j < ochans; j++) {
+    sox_sample_t const * in = ibuf + p->out_specs[j].in_specs[0].channel_num * istride;
+    sox_sample_t * out = obuf + j * ostride;
+    if (istep == 1 && ostep == 1)
+      memcpy(out, in, len * sizeof(*out));
+    else for (k = 0; k < len; k++)
+      out[k * ostep] = in[k * istep];
+  }
+  else for (k0 = 0; k0 < len; k0 += n) {
+    double * sum = p->block + ichans * MIX_LEN;
+    n = min(len - k0, MIX_LEN);
+    for (i = 0; i < ichans; i++) if (p->in_used[i]) {
+      sox_sample_t const * in = ibuf + i * istride + k0 * istep;
+      double * x = p->block + i * MIX_LEN;
+      for (k = 0; k < n; k++)
+        x[k] = in[k * istep];
+    }
+    for (j = 0; j < ochans; j++) {
+      sox_sample_t * out = obuf + j * ostride + k0 * ostep;
+      size_t clips = 0;
+      memset(sum, 0, n * sizeof(*sum));
+      for (i = 0; i < p->out_specs[j].num_in_channels; i++) {
+        double const * x = p->block + p->out_specs[j].in_specs[i].channel_num * MIX_LEN;
+        double mult = p->out_specs[j].in_specs[i].multiplier;
+        for (k = 0; k < n; k++)
+          sum[k] += x[k] * mult;
+      }
+      for (k = 0; k < n; k++)
+        out[k * ostep] = SOX_ROUND_CLIP_COUNT(sum[k], clips);
+      effp->clips += clips;
+    }
   }
   return SOX_SUCCESS;
 }
@@ -184,7 +257,6 @@ static int closedown(sox_effect_t * effp)
     free(p->out_specs[i].str);
     free(p->out_specs[i].in_specs);
   }
-  free(p->out_specs);
   return SOX_SUCCESS;
 }
 
@@ -192,8 +264,10 @@ sox_effect_handler_t const * lsx_remix_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "remix", "[-m|-a] [-p] <0|in-chan[v|p|i volume]{,in-chan[v|p|i volume]}>",
-    SOX_EFF_MCHAN | SOX_EFF_CHAN | SOX_EFF_GAIN | SOX_EFF_PREC,
-    create, start, flow, NULL, NULL, closedown, sizeof(priv_t)
+    SOX_EFF_MCHAN | SOX_EFF_CHAN | SOX_EFF_GAIN | SOX_EFF_PREC | SOX_EFF_PLANAR | SOX_EFF_SEEK |
+    SOX_EFF_LINEAR | SOX_EFF_TIMEINV | SOX_EFF_RTSAFE,
+    create, start, flow, NULL, NULL, closedown, sizeof(priv_t),
+    lsx_reset_stateless, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -223,7 +297,8 @@ static int channels_start(sox_effect_t * effp)
       p->num_out_channels : effp->out_signal.channels;
   unsigned i, j;
 
-  p->out_specs = lsx_calloc(num_out_channels, sizeof(*p->out_specs));
+  p->out_specs =
+    lsx_effect_calloc(effp, num_out_channels, sizeof(*p->out_specs));
   if (effp->in_signal.channels == num_out_channels)
     return SOX_EFF_NULL;
 
@@ -249,6 +324,7 @@ static int channels_start(sox_effect_t * effp)
   effp->out_signal.precision = (effp->in_signal.channels > num_out_channels) ?
     SOX_SAMPLE_PRECISION : effp->in_signal.precision;
   show(p);
+  compile(effp);
   return SOX_SUCCESS;
 }
 
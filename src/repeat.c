@@ -16,19 +16,36 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+/* The audio is held in an lsx_store_t (in memory, up to a limit, beyond which
+ * it spills to a temporary file) and read back from there for each repeat.
+ * Where the effect is fed directly from a seekable file, the client may
+ * instead call sox_repeat_from_file() to have the file itself read again, so
+ * that the audio need not be stored at all. */
+
 #include "sox_i.h"
 
 typedef struct {
   unsigned      num_repeats, remaining_repeats;
   uint64_t      num_samples, remaining_samples;
-  FILE          * tmp_file;
+  double        max_memory;   /* MiB to hold in memory before spilling */
+  lsx_store_t   store;        /* Audio held */
+  sox_format_t  * ft;         /* Or else read again from here */
 } priv_t;
 
 static int create(sox_effect_t * effp, int argc, char * * argv)
 {
   priv_t * p = (priv_t *)effp->priv;
+  int c;
+  lsx_getopt_t optstate;
+  lsx_getopt_init(argc, argv, "+m:", NULL, lsx_getopt_flag_none, 1, &optstate);
+
   p->num_repeats = 1;
-  --argc, ++argv;
+  p->max_memory = LSX_STORE_MEMORY;
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'm', max_memory, 0, 1e6)
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  argc -= optstate.ind, argv += optstate.ind;
   if (argc == 1 && !strcmp(*argv, "-")) {
     p->num_repeats = UINT_MAX;
     return SOX_SUCCESS;
@@ -43,10 +60,8 @@ static int start(sox_effect_t * effp)
   if (!p->num_repeats)
     return SOX_EFF_NULL;
 
-  if (!(p->tmp_file = lsx_tmpfile())) {
-    lsx_fail("can't create temporary file: %s", strerror(errno));
-    return SOX_EOF;
-  }
+  lsx_store_create(&p->store, effp, p->max_memory);
+  p->ft = NULL;
   p->num_samples = p->remaining_samples = 0;
   p->remaining_repeats = p->num_repeats;
   if (effp->in_signal.length != SOX_UNKNOWN_LEN && p->num_repeats != UINT_MAX)
@@ -63,10 +78,8 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
   priv_t * p = (priv_t *)effp->priv;
   size_t len = min(*isamp, *osamp);
   memcpy(obuf, ibuf, len * sizeof(*obuf));
-  if (fwrite(ibuf, sizeof(*ibuf), len, p->tmp_file) != len) {
-    lsx_fail("error writing temporary file: %s", strerror(errno));
+  if (!p->ft && lsx_store_write(&p->store, ibuf, len) != SOX_SUCCESS)
     return SOX_EOF;
-  }
   p->num_samples += len;
   *isamp = *osamp = len;
   return SOX_SUCCESS;
@@ -79,18 +92,30 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 
   *osamp -= *osamp % effp->in_signal.channels;
 
+  if (!p->num_samples)  /* Nothing to repeat */
+    p->remaining_repeats = 0;
+  else if (!p->ft && lsx_store_seal(&p->store) != SOX_SUCCESS)
+    return SOX_EOF;
   while ((p->remaining_samples || p->remaining_repeats) && odone < *osamp) {
     if (!p->remaining_samples) {
       p->remaining_samples = p->num_samples;
       if (p->remaining_repeats != UINT_MAX)
         --p->remaining_repeats;
-      rewind(p->tmp_file);
+      if (p->ft && sox_seek(p->ft, (uint64_t)0, SOX_SEEK_SET) != SOX_SUCCESS) {
+        lsx_fail("`%s': can't rewind", p->ft->filename);
+        return SOX_EOF;
+      }
     }
     n = min(p->remaining_samples, *osamp - odone);
-    if ((fread(obuf + odone, sizeof(*obuf), n, p->tmp_file)) != n) {
-      lsx_fail("error reading temporary file: %s", strerror(errno));
-      return SOX_EOF;
+    if (p->ft) {
+      if (sox_read(p->ft, obuf + odone, n) != n) {
+        lsx_fail("error reading `%s' again", p->ft->filename);
+        return SOX_EOF;
+      }
     }
+    else if (lsx_store_read(&p->store, p->num_samples - p->remaining_samples,
+          obuf + odone, n) != SOX_SUCCESS)
+      return SOX_EOF;
     p->remaining_samples -= n;
     odone += n;
   }
@@ -101,14 +126,32 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  fclose(p->tmp_file); /* auto-deleted by lsx_tmpfile */
+  lsx_store_delete(&p->store);
+  return SOX_SUCCESS;
+}
+
+/* The following function allows a libSoX client to spare the effect from
+ * storing the audio: if it is fed directly, and unmodified, from the given
+ * file, from its start, and that is seekable and of an encoding where
+ * seeking is exact, then calling sox_repeat_from_file() (before the chain is
+ * run) has the effect read the file again for each repeat. */
+
+int sox_repeat_from_file(sox_effect_t * effp, sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  if (p->num_samples || ft->signal.channels != effp->in_signal.channels ||
+      !lsx_rereadable(ft))
+    return SOX_EOF;
+  p->ft = ft;
   return SOX_SUCCESS;
 }
 
 sox_effect_handler_t const * lsx_repeat_effect_fn(void)
 {
-  static sox_effect_handler_t effect = {"repeat", "[count (1)]",
+  static sox_effect_handler_t effect = {"repeat", "[-m memory-MiB] [count (1)|-]",
     SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_MODIFY,
-    create, start, flow, drain, stop, NULL, sizeof(priv_t)};
+    create, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
   return &effect;
 }
@@ -21,80 +21,241 @@
 #include "fifo.h"
 
 #define lsx_zalloc(var, n) var = lsx_calloc(n, sizeof(*var))
-#define filter_advance(p) if (--(p)->ptr < (p)->buffer) (p)->ptr += (p)->size
 #define filter_delete(p) free((p)->buffer)
 
-typedef struct {
-  size_t  size;
-  float   * buffer, * ptr;
-  float   store;
-} filter_t;
+/* The filters are run a block at a time, where a block is no longer than any
+ * filter's delay, so that each filter reads only what was written before the
+ * block began.  The combs then differ only in their HF-damping state, so are
+ * run side by side, as the lanes of vectors (together with those of the
+ * other filter array of a stereo pair, which has the same input, or of the
+ * next channel, when more than two are reverberated independently); the
+ * allpasses need no state of their own, so each runs straight through its
+ * block.  Results are the same as running the filters a sample at a time. */
 
-static float comb_process(filter_t * p,  /* gcc -O2 will inline this */
-    float const * input, float const * feedback, float const * hf_damping)
-{
-  float output = *p->ptr;
-  p->store = output + (p->store - output) * *hf_damping;
-  *p->ptr = *input + p->store * *feedback;
-  filter_advance(p);
-  return output;
-}
+#if defined __SSE__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 1)
+  #define HAVE_REVERB_SSE 1
+  #include <xmmintrin.h>
+#endif
 
-static float allpass_process(filter_t * p,  /* gcc -O2 will inline this */
-    float const * input)
-{
-  float output = *p->ptr;
-  *p->ptr = *input + output * .5;
-  filter_advance(p);
-  return output - *input;
-}
+typedef struct {
+  size_t  size, pos;     /* Delay, & where in buffer it is read & written */
+  float   * buffer;
+} filter_t;
 
 static const size_t /* Filter delay lengths in samples (44100Hz sample-rate) */
   comb_lengths[] = {1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617},
   allpass_lengths[] = {225, 341, 441, 556};
 #define stereo_adjust 12
+#define num_combs 8      /* i.e. array_length(comb_lengths); 2 SSE vectors */
+#define max_block 256
+
+typedef float lanes_t[num_combs];
 
 typedef struct {
   filter_t comb   [array_length(comb_lengths)];
   filter_t allpass[array_length(allpass_lengths)];
+  float    store  [array_length(comb_lengths)];  /* HF-damping state */
+  size_t   block; /* Maximum samples per block */
 } filter_array_t;
 
+static void filter_create(filter_t * p, double size, size_t extra,
+    size_t * block)
+{
+  p->size = max(1, (size_t)(size + .5));
+  lsx_zalloc(p->buffer, p->size + extra);
+  *block = min(*block, p->size);
+}
+
 static void filter_array_create(filter_array_t * p, double rate,
     double scale, double offset)
 {
   size_t i;
   double r = rate * (1 / 44100.); /* Compensate for actual sample-rate */
 
+  p->block = max_block;
   for (i = 0; i < array_length(comb_lengths); ++i, offset = -offset)
-  {
-    filter_t * pcomb = &p->comb[i];
-    pcomb->size = (size_t)(scale * r * (comb_lengths[i] + stereo_adjust * offset) + .5);
-    pcomb->ptr = lsx_zalloc(pcomb->buffer, pcomb->size);
-  }
+    filter_create(&p->comb[i],
+        scale * r * (comb_lengths[i] + stereo_adjust * offset),
+        (size_t)max_block, &p->block);
   for (i = 0; i < array_length(allpass_lengths); ++i, offset = -offset)
-  {
-    filter_t * pallpass = &p->allpass[i];
-    pallpass->size = (size_t)(r * (allpass_lengths[i] + stereo_adjust * offset) + .5);
-    pallpass->ptr = lsx_zalloc(pallpass->buffer, pallpass->size);
+    filter_create(&p->allpass[i],
+        r * (allpass_lengths[i] + stereo_adjust * offset), (size_t)0,
+        &p->block);
+}
+
+/* Copies n samples from each comb, c[i][j], to lane i of d, d[j][i], and
+ * sets out[j] to their sum. */
+static void combs_read(float * const * c, lanes_t * d, size_t n,
+    float * out)
+{
+  size_t i, j = 0;
+
+#if defined HAVE_REVERB_SSE
+  for (; j + 4 <= n; j += 4) {
+    __m128 sum = _mm_setzero_ps();
+    for (i = num_combs; i; ) {
+      __m128 r0, r1, r2, r3;
+      i -= 4;
+      r0 = _mm_loadu_ps(c[i] + j)    , r1 = _mm_loadu_ps(c[i + 1] + j);
+      r2 = _mm_loadu_ps(c[i + 2] + j), r3 = _mm_loadu_ps(c[i + 3] + j);
+      sum = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(sum, r3), r2), r1), r0);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_ps(d[j] + i, r0)    , _mm_storeu_ps(d[j + 1] + i, r1);
+      _mm_storeu_ps(d[j + 2] + i, r2), _mm_storeu_ps(d[j + 3] + i, r3);
+    }
+    _mm_storeu_ps(out + j, sum);
+  }
+#endif
+  for (; j < n; ++j) {
+    out[j] = 0;
+    for (i = num_combs; i--;)
+      out[j] += d[j][i] = c[i][j];
   }
 }
 
-static void filter_array_process(filter_array_t * p,
-    size_t length, float const * input, float * output,
-    float const * feedback, float const * hf_damping, float const * gain)
+/* Copies lane i of d back to each comb */
+static void combs_write(float * const * c, lanes_t * d, size_t n)
+{
+  size_t i, j = 0;
+
+#if defined HAVE_REVERB_SSE
+  for (; j + 4 <= n; j += 4) for (i = 0; i < num_combs; i += 4) {
+    __m128 r0 = _mm_loadu_ps(d[j] + i)    , r1 = _mm_loadu_ps(d[j + 1] + i);
+    __m128 r2 = _mm_loadu_ps(d[j + 2] + i), r3 = _mm_loadu_ps(d[j + 3] + i);
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(c[i] + j, r0)    , _mm_storeu_ps(c[i + 1] + j, r1);
+    _mm_storeu_ps(c[i + 2] + j, r2), _mm_storeu_ps(c[i + 3] + j, r3);
+  }
+#endif
+  for (; j < n; ++j) for (i = 0; i < num_combs; ++i)
+    c[i][j] = d[j][i];
+}
+
+/* A comb's buffer has max_block spare samples at its end, so that a block
+ * may be read & written contiguously; any part of it in the spare samples
+ * is copied there from the start of the buffer beforehand and back after. */
+static void comb_unwrap(filter_t * p, size_t n)
 {
-  while (length--) {
-    float out = 0, in = *input++;
+  if (p->pos + n > p->size)
+    memcpy(p->buffer + p->size, p->buffer,
+        (p->pos + n - p->size) * sizeof(*p->buffer));
+}
+
+static void comb_rewrap(filter_t * p, size_t n)
+{
+  if ((p->pos += n) >= p->size) {
+    p->pos -= p->size;
+    memcpy(p->buffer, p->buffer + p->size, p->pos * sizeof(*p->buffer));
+  }
+}
+
+#if defined HAVE_REVERB_SSE
+static __m128 comb_lanes(__m128 * store, __m128 output, __m128 input,
+    __m128 feedback, __m128 hf_damping)
+{
+  *store = _mm_add_ps(output,
+      _mm_mul_ps(_mm_sub_ps(*store, output), hf_damping));
+  return _mm_add_ps(input, _mm_mul_ps(*store, feedback));
+}
+#endif
+
+/* Runs the combs' HF-damping (one-pole) filters, for 1 or 2 filter arrays
+ * (each with its input), over the n delayed samples in d, replacing each
+ * with the sample to be written back to its comb.  Two arrays make for twice
+ * as many lanes, which hides the latency of the filters' recursion. */
+static void combs_process(filter_array_t * p, size_t num_arrays,
+    lanes_t * const * d, size_t n, float const * const * input,
+    float feedback, float hf_damping)
+{
+  size_t a, i, j;
+
+#if defined HAVE_REVERB_SSE
+  __m128 fb = _mm_set1_ps(feedback), damping = _mm_set1_ps(hf_damping);
+  __m128 s0 = _mm_loadu_ps(p[0].store), s1 = _mm_loadu_ps(p[0].store + 4);
+
+  if (num_arrays == 2) {
+    __m128 s2 = _mm_loadu_ps(p[1].store), s3 = _mm_loadu_ps(p[1].store + 4);
+    for (j = 0; j < n; ++j) {
+      __m128 in0 = _mm_set1_ps(input[0][j]), in1 = _mm_set1_ps(input[1][j]);
+      float * d0 = d[0][j], * d1 = d[1][j];
+      _mm_storeu_ps(d0    , comb_lanes(&s0, _mm_loadu_ps(d0    ), in0, fb, damping));
+      _mm_storeu_ps(d0 + 4, comb_lanes(&s1, _mm_loadu_ps(d0 + 4), in0, fb, damping));
+      _mm_storeu_ps(d1    , comb_lanes(&s2, _mm_loadu_ps(d1    ), in1, fb, damping));
+      _mm_storeu_ps(d1 + 4, comb_lanes(&s3, _mm_loadu_ps(d1 + 4), in1, fb, damping));
+    }
+    _mm_storeu_ps(p[1].store, s2), _mm_storeu_ps(p[1].store + 4, s3);
+  }
+  else for (j = 0; j < n; ++j) {
+    __m128 in = _mm_set1_ps(input[0][j]);
+    float * d0 = d[0][j];
+    _mm_storeu_ps(d0    , comb_lanes(&s0, _mm_loadu_ps(d0    ), in, fb, damping));
+    _mm_storeu_ps(d0 + 4, comb_lanes(&s1, _mm_loadu_ps(d0 + 4), in, fb, damping));
+  }
+  _mm_storeu_ps(p[0].store, s0), _mm_storeu_ps(p[0].store + 4, s1);
+  (void)a, (void)i;
+#else
+  for (a = 0; a < num_arrays; ++a) {
+    float * store = p[a].store;
+    for (j = 0; j < n; ++j) for (i = 0; i < num_combs; ++i) {
+      float * x = &d[a][j][i];
+      store[i] = *x + (store[i] - *x) * hf_damping;
+      *x = input[a][j] + store[i] * feedback;
+    }
+  }
+#endif
+}
 
-    size_t i = array_length(comb_lengths) - 1;
-    do out += comb_process(p->comb + i, &in, feedback, hf_damping);
-    while (i--);
+static void allpass_process(filter_t * p, size_t n, float * x)
+{
+  size_t j, n1 = min(n, p->size - p->pos);
+  float * b = p->buffer + p->pos;
 
-    i = array_length(allpass_lengths) - 1;
-    do out = allpass_process(p->allpass + i, &out);
-    while (i--);
+  for (j = 0; j < n1; ++j) {
+    float output = b[j];
+    b[j] = x[j] + output * .5f;
+    x[j] = output - x[j];
+  }
+  for (b = p->buffer - n1; j < n; ++j) {
+    float output = b[j];
+    b[j] = x[j] + output * .5f;
+    x[j] = output - x[j];
+  }
+  p->pos = n == n1? p->pos + n : n - n1;
+}
 
-    *output++ = out * *gain;
+/* Runs 1 or 2 filter arrays, each with its input */
+static void filter_array_process(filter_array_t * p, size_t num_arrays,
+    size_t length, float const * const * input, float * const * output,
+    float const * feedback, float const * hf_damping, float const * gain)
+{
+  lanes_t d[2][max_block], * dp[2];
+  float out[2][max_block], * c[2][num_combs];
+  float const * in[2];
+  size_t a, i, j, n, k;
+
+  dp[0] = d[0], dp[1] = d[1];
+  for (k = 0; k < length; k += n) {
+    n = length - k;
+    in[0] = input[0] + k, in[1] = input[num_arrays - 1] + k;
+    for (a = 0; a < num_arrays; ++a) {
+      n = min(n, p[a].block);
+      for (i = 0; i < num_combs; ++i)
+        c[a][i] = p[a].comb[i].buffer + p[a].comb[i].pos;
+    }
+    for (a = 0; a < num_arrays; ++a) for (i = 0; i < num_combs; ++i)
+      comb_unwrap(&p[a].comb[i], n);
+    for (a = 0; a < num_arrays; ++a)
+      combs_read(c[a], d[a], n, out[a]);
+    combs_process(p, num_arrays, dp, n, in, *feedback, *hf_damping);
+    for (a = 0; a < num_arrays; ++a) {
+      combs_write(c[a], d[a], n);
+      for (i = 0; i < num_combs; ++i)
+        comb_rewrap(&p[a].comb[i], n);
+      for (i = array_length(allpass_lengths); i--;)
+        allpass_process(&p[a].allpass[i], n, out[a]);
+      for (j = 0; j < n; ++j)
+        output[a][k + j] = out[a][j] * *gain;
+    }
   }
 }
 
@@ -108,11 +269,16 @@ static void filter_array_delete(filter_array_t * p)
     filter_delete(&p->comb[i]);
 }
 
+/* A reverb has 1 filter array, or 2: either for the two sides of stereo
+ * output, with the same input, or, if paired, for two channels, each with
+ * its own input (and pre-delay) */
 typedef struct {
   float feedback;
   float hf_damping;
   float gain;
-  fifo_t input_fifo;
+  size_t num_arrays;
+  sox_bool paired;
+  fifo_t input_fifo[2];
   filter_array_t chan[2];
   float * out[2];
 } reverb_t;
@@ -124,6 +290,7 @@ static void reverb_create(reverb_t * p, double sample_rate_Hz,
     double hf_damping,     /* % */
     double pre_delay_ms,
     double stereo_depth,
+    sox_bool paired,
     size_t buffer_size,
     float * * out)
 {
@@ -137,30 +304,40 @@ static void reverb_create(reverb_t * p, double sample_rate_Hz,
   p->feedback = 1 - exp((reverberance - b) / (a * b));
   p->hf_damping = hf_damping / 100 * .3 + .2;
   p->gain = dB_to_linear(wet_gain_dB) * .015;
-  fifo_create(&p->input_fifo, sizeof(float));
-  memset(fifo_write(&p->input_fifo, delay, 0), 0, delay * sizeof(float));
-  for (i = 0; i <= ceil(depth); ++i) {
-    filter_array_create(p->chan + i, sample_rate_Hz, scale, i * depth);
+  p->paired = paired;
+  p->num_arrays = paired? 2 : (size_t)ceil(depth) + 1;
+  for (i = 0; i < (paired? 2u : 1u); ++i) {
+    fifo_create(&p->input_fifo[i], sizeof(float));
+    memset(fifo_write(&p->input_fifo[i], delay, 0), 0, delay * sizeof(float));
+  }
+  for (i = 0; i < p->num_arrays; ++i) {
+    filter_array_create(p->chan + i, sample_rate_Hz, scale,
+        paired? 0 : i * depth);
     out[i] = lsx_zalloc(p->out[i], buffer_size);
   }
 }
 
 static void reverb_process(reverb_t * p, size_t length)
 {
+  float const * in[2];
   size_t i;
-  for (i = 0; i < 2 && p->out[i]; ++i)
-    filter_array_process(p->chan + i, length, (float *) fifo_read_ptr(&p->input_fifo), p->out[i], &p->feedback, &p->hf_damping, &p->gain);
-  fifo_read(&p->input_fifo, length, NULL);
+
+  for (i = 0; i < p->num_arrays; ++i)
+    in[i] = fifo_read_ptr(&p->input_fifo[p->paired? i : 0]);
+  filter_array_process(p->chan, p->num_arrays, length, in, p->out, &p->feedback, &p->hf_damping, &p->gain);
+  for (i = 0; i < (p->paired? 2u : 1u); ++i)
+    fifo_read(&p->input_fifo[i], length, NULL);
 }
 
 static void reverb_delete(reverb_t * p)
 {
   size_t i;
-  for (i = 0; i < 2 && p->out[i]; ++i) {
+  for (i = 0; i < p->num_arrays; ++i) {
     free(p->out[i]);
     filter_array_delete(p->chan + i);
   }
-  fifo_delete(&p->input_fifo);
+  for (i = 0; i < (p->paired? 2u : 1u); ++i)
+    fifo_delete(&p->input_fifo[i]);
 }
 
 /*------------------------------- SoX Wrapper --------------------------------*/
@@ -171,10 +348,12 @@ typedef struct {
   sox_bool wet_only;
 
   size_t ichannels, ochannels;
+  sox_bool per_channel;    /* Channels reverberated independently */
+  size_t num_reverbs;      /* Per input channel, or pair of them if so */
   struct {
     reverb_t reverb;
-    float * dry, * wet[2];
-  } chan[2];
+    float * dry[2], * wet[2];
+  } * chan;
 } priv_t;
 
 static int getopts(sox_effect_t * effp, int argc, char **argv)
@@ -203,21 +382,21 @@ static int start(sox_effect_t * effp)
   priv_t * p = (priv_t *)effp->priv;
   size_t i;
 
-  p->ichannels = p->ochannels = 1;
   effp->out_signal.rate = effp->in_signal.rate;
   if (effp->in_signal.channels > 2 && p->stereo_depth) {
     lsx_warn("stereo-depth not applicable with >2 channels");
     p->stereo_depth = 0;
   }
-  if (effp->in_signal.channels == 1 && p->stereo_depth)
-    effp->out_signal.channels = p->ochannels = 2;
-  else effp->out_signal.channels = effp->in_signal.channels;
-  if (effp->in_signal.channels == 2 && p->stereo_depth)
-    p->ichannels = p->ochannels = 2;
-  else effp->flows = effp->in_signal.channels;
-  for (i = 0; i < p->ichannels; ++i) reverb_create(
+  p->per_channel = !p->stereo_depth;
+  p->ichannels = effp->in_signal.channels;
+  p->ochannels = p->per_channel? p->ichannels : 2;
+  p->num_reverbs = p->per_channel? (p->ichannels + 1) / 2 : p->ichannels;
+  effp->out_signal.channels = (unsigned)p->ochannels;
+  p->chan = lsx_calloc(p->num_reverbs, sizeof(*p->chan));
+  for (i = 0; i < p->num_reverbs; ++i) reverb_create(
     &p->chan[i].reverb, effp->in_signal.rate, p->wet_gain_dB, p->room_scale,
     p->reverberance, p->hf_damping, p->pre_delay_ms, p->stereo_depth,
+    p->per_channel && 2 * i + 1 < p->ichannels,
     effp->global_info->global_info->bufsiz / p->ochannels, p->chan[i].wet);
 
   if (effp->in_signal.mult)
@@ -229,23 +408,46 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
                 sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t c, i, w, len = min(*isamp / p->ichannels, *osamp / p->ochannels);
+  size_t c, i, w, threads, len = min(*isamp / p->ichannels, *osamp / p->ochannels);
+  long r;
   SOX_SAMPLE_LOCALS;
 
+  /* obuf may be bigger than the wet buffers (see lsx_effect_set_block) */
+  len = min(len, effp->global_info->global_info->bufsiz / p->ochannels);
   *isamp = len * p->ichannels, *osamp = len * p->ochannels;
+  if (p->per_channel) {   /* Channel c has input c & 1 of reverb c / 2 */
+    for (c = 0; c < p->ichannels; ++c)
+      p->chan[c >> 1].dry[c & 1] =
+        fifo_write(&p->chan[c >> 1].reverb.input_fifo[c & 1], len, 0);
+    for (i = 0; i < len; ++i) for (c = 0; c < p->ichannels; ++c)
+      p->chan[c >> 1].dry[c & 1][i] =
+        SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
+    threads = lsx_effect_threads(effp, p->num_reverbs);
+    #pragma omp parallel for if(threads > 1) num_threads((int)threads) \
+        schedule(static)
+    for (r = 0; r < (long)p->num_reverbs; ++r)
+      reverb_process(&p->chan[r].reverb, len);
+    lsx_threads_give(effp->global_info->global_info, threads);
+    for (i = 0; i < len; ++i) for (c = 0; c < p->ichannels; ++c) {
+      float out = (1 - p->wet_only) * p->chan[c >> 1].dry[c & 1][i] +
+        p->chan[c >> 1].wet[c & 1][i];
+      *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
+    }
+    return SOX_SUCCESS;
+  }
   for (c = 0; c < p->ichannels; ++c)
-    p->chan[c].dry = fifo_write(&p->chan[c].reverb.input_fifo, len, 0);
+    p->chan[c].dry[0] = fifo_write(&p->chan[c].reverb.input_fifo[0], len, 0);
   for (i = 0; i < len; ++i) for (c = 0; c < p->ichannels; ++c)
-    p->chan[c].dry[i] = SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
+    p->chan[c].dry[0][i] = SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
   for (c = 0; c < p->ichannels; ++c)
     reverb_process(&p->chan[c].reverb, len);
   if (p->ichannels == 2) for (i = 0; i < len; ++i) for (w = 0; w < 2; ++w) {
-    float out = (1 - p->wet_only) * p->chan[w].dry[i] +
+    float out = (1 - p->wet_only) * p->chan[w].dry[0][i] +
       .5 * (p->chan[0].wet[w][i] + p->chan[1].wet[w][i]);
     *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
   }
   else for (i = 0; i < len; ++i) for (w = 0; w < p->ochannels; ++w) {
-    float out = (1 - p->wet_only) * p->chan[0].dry[i] + p->chan[0].wet[w][i];
+    float out = (1 - p->wet_only) * p->chan[0].dry[0][i] + p->chan[0].wet[w][i];
     *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(out, effp->clips);
   }
   return SOX_SUCCESS;
@@ -255,8 +457,9 @@ static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t i;
-  for (i = 0; i < p->ichannels; ++i)
+  for (i = 0; i < p->num_reverbs; ++i)
     reverb_delete(&p->chan[i].reverb);
+  free(p->chan);
   return SOX_SUCCESS;
 }
 
@@ -271,7 +474,8 @@ sox_effect_handler_t const *lsx_reverb_effect_fn(void)
     " [pre-delay (0ms)"
     " [wet-gain (0dB)"
     "]]]]]]",
-    SOX_EFF_MCHAN, getopts, start, flow, NULL, stop, NULL, sizeof(priv_t)
+    SOX_EFF_MCHAN, getopts, start, flow, NULL, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -7,26 +7,50 @@
  */
 
 /*
- * "reverse" effect, uses a temporary file created by lsx_tmpfile().
+ * "reverse" effect.  The audio is held in an lsx_store_t: in memory, up to a
+ * limit, beyond which it spills to a temporary file; this is then
+ * memory-mapped (where possible) and walked backwards a block at a time.
+ * Where the effect is fed directly from a seekable file, the client may
+ * instead call sox_reverse_from_file() to have the file itself read
+ * backwards, so that the audio need not be stored at all.
  */
 
 #include "sox_i.h"
 #include <string.h>
 
+#define PREFETCH_LEN ((size_t)1 << 18) /* Samples of the spill map to hint */
+
 typedef struct {
-  off_t         pos;
-  FILE          * tmp_file;
+  double        max_memory;   /* MiB to hold in memory before spilling */
+  lsx_store_t   store;        /* Audio held */
+  sox_format_t  * ft;         /* Or else read backwards from here */
+  uint64_t      pos;          /* Samples yet to be output */
+  sox_bool      draining;
 } priv_t;
 
+static int getopts(sox_effect_t * effp, int argc, char **argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int c;
+  lsx_getopt_t optstate;
+  lsx_getopt_init(argc, argv, "+m:", NULL, lsx_getopt_flag_none, 1, &optstate);
+
+  p->max_memory = LSX_STORE_MEMORY;
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'm', max_memory, 0, 1e6)
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  return optstate.ind != argc? lsx_usage(effp) : SOX_SUCCESS;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
+
+  lsx_store_create(&p->store, effp, p->max_memory);
   p->pos = 0;
-  p->tmp_file = lsx_tmpfile();
-  if (p->tmp_file == NULL) {
-    lsx_fail("can't create temporary file: %s", strerror(errno));
-    return SOX_EOF;
-  }
+  p->ft = NULL;
+  p->draining = sox_false;
   return SOX_SUCCESS;
 }
 
@@ -34,38 +58,86 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  if (fwrite(ibuf, sizeof(*ibuf), *isamp, p->tmp_file) != *isamp) {
-    lsx_fail("error writing temporary file: %s", strerror(errno));
-    return SOX_EOF;
-  }
+
   (void)obuf, *osamp = 0; /* samples not output until drain */
-  return SOX_SUCCESS;
+  if (p->ft)
+    return SOX_SUCCESS; /* Nothing should come, but would come again */
+  return lsx_store_write(&p->store, ibuf, *isamp);
+}
+
+/* Reverse the order of whole frames (wide samples), in place */
+static void reverse(sox_sample_t * buf, size_t len, unsigned chans)
+{
+  sox_sample_t * i = buf, * j = buf + len - chans, t;
+  unsigned c;
+
+  if (chans == 1) for (; i < j; ++i, --j)
+    t = *i, *i = *j, *j = t;
+  else for (; i < j; i += chans, j -= chans) for (c = 0; c < chans; ++c)
+    t = i[c], i[c] = j[c], j[c] = t;
+}
+
+/* As reverse(), but from src to dst */
+static void copy_reversed(sox_sample_t * dst, sox_sample_t const * src,
+    size_t len, unsigned chans)
+{
+  size_t i;
+
+  if (chans == 1) for (i = 0; i < len; ++i)
+    dst[i] = src[len - 1 - i];
+  else for (src += len; len; len -= chans, dst += chans) {
+    src -= chans;
+    memcpy(dst, src, chans * sizeof(*dst));
+  }
+}
+
+/* Hint that the block of the map below the one now being output will be
+ * wanted next */
+static void prefetch(priv_t * p)
+{
+  size_t block = p->pos / PREFETCH_LEN;
+
+  if (block)
+    lsx_store_prefetch(&p->store, (block - 1) * PREFETCH_LEN, PREFETCH_LEN);
 }
 
 static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  int i, j;
+  unsigned chans = effp->in_signal.channels;
+  sox_sample_t const * data;
+  uint64_t old_pos = p->pos;
 
-  if (p->pos == 0) {
-    fflush(p->tmp_file);
-    p->pos = ftello(p->tmp_file);
-    if (p->pos % sizeof(sox_sample_t) != 0) {
-      lsx_fail("temporary file has incorrect size");
+  if (!p->draining) {
+    p->draining = sox_true;
+    if (!p->ft) {
+      if (lsx_store_seal(&p->store) != SOX_SUCCESS)
+        return SOX_EOF;
+      p->pos = p->store.len;
+      prefetch(p);
+    }
+    old_pos = p->pos;
+  }
+  *osamp -= *osamp % chans;
+  p->pos -= *osamp = min(*osamp, p->pos);
+
+  if (p->ft) {
+    if (sox_seek(p->ft, p->pos, SOX_SEEK_SET) != SOX_SUCCESS ||
+        sox_read(p->ft, obuf, *osamp) != *osamp) {
+      lsx_fail("error reading `%s' backwards", p->ft->filename);
       return SOX_EOF;
     }
-    p->pos /= sizeof(sox_sample_t);
+    reverse(obuf, *osamp, chans);
   }
-  p->pos -= *osamp = min((off_t)*osamp, p->pos);
-  fseeko(p->tmp_file, (off_t)(p->pos * sizeof(sox_sample_t)), SEEK_SET);
-  if (fread(obuf, sizeof(sox_sample_t), *osamp, p->tmp_file) != *osamp) {
-    lsx_fail("error reading temporary file: %s", strerror(errno));
-    return SOX_EOF;
+  else if ((data = lsx_store_data(&p->store)) != NULL) {
+    copy_reversed(obuf, data + p->pos, *osamp, chans);
+    if (old_pos / PREFETCH_LEN != p->pos / PREFETCH_LEN)
+      prefetch(p);
   }
-  for (i = 0, j = *osamp - 1; i < j; ++i, --j) { /* reverse the samples */
-    sox_sample_t temp = obuf[i];
-    obuf[i] = obuf[j];
-    obuf[j] = temp;
+  else if (*osamp) {
+    if (lsx_store_read(&p->store, p->pos, obuf, *osamp) != SOX_SUCCESS)
+      return SOX_EOF;
+    reverse(obuf, *osamp, chans);
   }
   return p->pos? SOX_SUCCESS : SOX_EOF;
 }
@@ -73,14 +145,52 @@ static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  fclose(p->tmp_file); /* auto-deleted by lsx_tmpfile */
+
+  lsx_store_delete(&p->store);
+  return SOX_SUCCESS;
+}
+
+/* The following function allows a libSoX client to spare the effect from
+ * storing the audio: if it is fed directly, and unmodified, from the given
+ * file, and that is seekable and of an encoding where seeking is exact, then
+ * calling sox_reverse_from_file() (before the chain is run) has the effect
+ * read the file backwards itself, leaving the file positioned at its end. */
+
+int sox_reverse_from_file(sox_effect_t * effp, sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned chans = effp->in_signal.channels;
+  sox_sample_t * buf;
+  size_t len;
+
+  if (p->draining || p->store.len || ft->signal.channels != chans ||
+      !lsx_rereadable(ft) || !ft->signal.length || ft->signal.length == SOX_IGNORE_LENGTH ||
+      ft->signal.length % chans)
+    return SOX_EOF;
+
+  /* Check that the file's length is good by reading its last frame */
+  buf = lsx_malloc(chans * sizeof(*buf));
+  len = sox_seek(ft, ft->signal.length - chans, SOX_SEEK_SET) == SOX_SUCCESS?
+      sox_read(ft, buf, (size_t)chans) : 0;
+  free(buf);
+  if (len != chans) {
+    if (sox_seek(ft, (uint64_t)0, SOX_SEEK_SET) != SOX_SUCCESS) {
+      lsx_fail("`%s': can't rewind", ft->filename);
+      return SOX_EINVAL;  /* The file may no longer be read */
+    }
+    return SOX_EOF;
+  }
+  p->ft = ft;
+  p->pos = ft->signal.length;
   return SOX_SUCCESS;
 }
 
 sox_effect_handler_t const * lsx_reverse_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "reverse", NULL, SOX_EFF_MODIFY, NULL, start, flow, drain, stop, NULL, sizeof(priv_t)
+    "reverse", "[-m memory-MiB]", SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
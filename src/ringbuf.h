@@ -0,0 +1,138 @@
+/* Single-producer/single-consumer ring buffer
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Unlike fifo_t, a ringbuf_t has a fixed capacity and never moves its
+ * contents, so one thread may write to it while another reads from it
+ * without any locking.  head is advanced only by the producer and tail
+ * only by the consumer; both run freely (wrapping at SIZE_MAX), so that
+ * head - tail is always the occupancy.  Each index is kept on a cache line
+ * of its own so that the two threads do not contend for it.
+ */
+
+#ifndef ringbuf_included
+#define ringbuf_included
+
+#include <string.h>
+
+#ifndef RINGBUF_LINE
+#define RINGBUF_LINE 64        /* Bytes per cache line (or more) */
+#endif
+
+typedef struct {
+  size_t value;
+  char pad[RINGBUF_LINE - sizeof(size_t)];
+} ringbuf_index_t;
+
+typedef struct {
+  char * data;
+  size_t item_size;    /* Size of each item in data */
+  size_t mask;         /* Capacity, in items, less 1; capacity is 2^n */
+  char pad[RINGBUF_LINE - sizeof(char *) - 2 * sizeof(size_t)];
+  ringbuf_index_t head;  /* Number of items ever written */
+  ringbuf_index_t tail;  /* Number of items ever read */
+} ringbuf_t;
+
+/* Loads and stores through which the two threads synchronise: a store
+ * publishes everything written before it to the thread that loads it. */
+UNUSED static size_t ringbuf_load(size_t const * p)
+{
+#if defined __ATOMIC_ACQUIRE
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+  size_t x = *(size_t const volatile *)p;
+  #ifdef _OPENMP
+  #pragma omp flush
+  #endif
+  return x;
+#endif
+}
+
+UNUSED static void ringbuf_store(size_t * p, size_t x)
+{
+#if defined __ATOMIC_RELEASE
+  __atomic_store_n(p, x, __ATOMIC_RELEASE);
+#else
+  #ifdef _OPENMP
+  #pragma omp flush
+  #endif
+  *(size_t volatile *)p = x;
+#endif
+}
+
+/* The other thread may change the result at any time, so take it once
+ * (e.g. not within min(), which evaluates its arguments twice). */
+
+/* Number of items that may be read; call from the consumer only */
+UNUSED static size_t ringbuf_occupancy(ringbuf_t * r)
+{
+  return ringbuf_load(&r->head.value) - r->tail.value;
+}
+
+/* Number of items that may be written; call from the producer only */
+UNUSED static size_t ringbuf_space(ringbuf_t * r)
+{
+  return r->mask + 1 - (r->head.value - ringbuf_load(&r->tail.value));
+}
+
+/* Writes up to n items; returns the number written */
+UNUSED static size_t ringbuf_write(ringbuf_t * r, size_t n, void const * data)
+{
+  size_t i = r->head.value & r->mask, space = ringbuf_space(r), n1;
+
+  n = min(n, space);
+  n1 = min(n, r->mask + 1 - i);
+  memcpy(r->data + i * r->item_size, data, n1 * r->item_size);
+  memcpy(r->data, (char const *)data + n1 * r->item_size,
+      (n - n1) * r->item_size);
+  ringbuf_store(&r->head.value, r->head.value + n);
+  return n;
+}
+
+/* Reads up to n items; returns the number read */
+UNUSED static size_t ringbuf_read(ringbuf_t * r, size_t n, void * data)
+{
+  size_t i = r->tail.value & r->mask, occupancy = ringbuf_occupancy(r), n1;
+
+  n = min(n, occupancy);
+  n1 = min(n, r->mask + 1 - i);
+  memcpy(data, r->data + i * r->item_size, n1 * r->item_size);
+  memcpy((char *)data + n1 * r->item_size, r->data,
+      (n - n1) * r->item_size);
+  ringbuf_store(&r->tail.value, r->tail.value + n);
+  return n;
+}
+
+UNUSED static void ringbuf_delete(ringbuf_t * r)
+{
+  lsx_free(r->data);
+}
+
+/* Capacity is min_items rounded up to a power of 2 */
+UNUSED static void ringbuf_create(ringbuf_t * r, size_t item_size,
+    size_t min_items)
+{
+  size_t capacity = 1;
+
+  while (capacity < min_items)
+    capacity <<= 1;
+  r->item_size = item_size;
+  r->mask = capacity - 1;
+  r->data = lsx_malloc(capacity * item_size);
+  r->head.value = r->tail.value = 0;
+}
+
+#endif
@@ -0,0 +1,857 @@
+/* libSoX RTP and UDP network audio
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio to and from the network, a packet of frames per datagram: `rtp'
+ * (RFC 3550) with payload L16 or L24 (RFC 3551/3190, as AES67 uses), PCMU,
+ * PCMA, or Opus (RFC 7587); `udp', the same payloads (or 32-bit) bare.  The
+ * file name is [host]:port, an IPv6 host in brackets: the address to listen
+ * on (a multicast group is joined), or the one to send to.
+ *
+ * Datagrams are received and sent in batches, by recvmmsg and sendmmsg where
+ * the system has them.  Received, they go to a jitter buffer that is filled
+ * to --device-periods packets (default 4) before any is read out, and again
+ * if ever it runs dry.  RTP packets are put in order by sequence number, late
+ * ones and duplicates dropped, and one found missing with that many packets'
+ * span buffered beyond it is concealed: by silence, or Opus's concealment.
+ * Sent, packets are of --device-period frames (default 1 ms, or 20 ms for
+ * PCMU, PCMA and Opus), paced by the clock to leave at the sample rate; only
+ * those already due go out together. */
+
+#define _GNU_SOURCE
+#include "sox_i.h"
+
+#if defined HAVE_GETADDRINFO && defined HAVE_NETDB_H
+
+#include "g711.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#if defined HAVE_SYS_TIME_H
+  #include <sys/time.h>
+#endif
+
+#if defined HAVE_OPUS && (defined STATIC_OPUS || !defined HAVE_LIBLTDL)
+  #define HAVE_RTP_OPUS 1
+  #include <opus.h>
+#endif
+
+#ifndef IPV6_JOIN_GROUP
+  #define IPV6_JOIN_GROUP IPV6_ADD_MEMBERSHIP
+#endif
+
+#define BATCH        16    /* Datagrams per recvmmsg or sendmmsg */
+#define MAX_DATAGRAM 9000  /* Longest taken: a jumbo frame's worth */
+#define RTP_HEADER   12
+#define DYNAMIC_PT   96    /* Payload type sent where none is static */
+#define IDLE_END     2     /* Seconds without packets that end input */
+#define MAX_SLIP     .2    /* Seconds behind that pacing gives up */
+#define MAX_OPUS     5760  /* Frames in an Opus packet at most (120 ms) */
+
+typedef sox_uint16_t sox_uint14_t;
+typedef sox_uint16_t sox_uint13_t;
+typedef sox_int16_t sox_int14_t;
+typedef sox_int16_t sox_int13_t;
+#define SOX_SAMPLE_TO_ULAW_BYTE(d,c) sox_14linear2ulaw(SOX_SAMPLE_TO_UNSIGNED(14,d,c) - 0x2000)
+#define SOX_SAMPLE_TO_ALAW_BYTE(d,c) sox_13linear2alaw(SOX_SAMPLE_TO_UNSIGNED(13,d,c) - 0x1000)
+
+typedef enum {payload_pcm, payload_ulaw, payload_alaw, payload_opus} payload_t;
+
+typedef struct {
+  sox_bool     rtp;
+  int          fd;
+  payload_t    payload;
+  unsigned     width;        /* Bytes per PCM sample */
+  sox_bool     big;          /* PCM samples are big-endian */
+  unsigned     pt;           /* RTP payload type */
+  uint32_t     ssrc;
+  uint8_t      * io;         /* BATCH datagrams, received or to send */
+  size_t       io_len[BATCH];
+  size_t       batch;        /* Datagrams in io, to send */
+  sox_sample_t * pcm;        /* A packet's samples */
+  size_t       pcm_pos, pcm_len;
+#if defined HAVE_RTP_OPUS
+  OpusDecoder  * decoder;
+  OpusEncoder  * encoder;
+  opus_int16   * opus_pcm;
+#endif
+
+  /* Reading: */
+  size_t       depth;        /* Packets to buffer against jitter */
+  size_t       slots;        /* In the jitter buffer: a power of 2 */
+  uint8_t      * jb;         /* slots payloads of up to MAX_DATAGRAM */
+  size_t       * jb_len;     /* 0 where a slot is empty */
+  sox_bool     started, primed, idle;
+  uint16_t     next, top;    /* Sequence numbers: to read; past any received */
+  size_t       last_frames;  /* In the last packet, for concealment */
+  sox_uint64_t received, lost, late, overrun, foreign;
+
+  /* Writing: */
+  struct sockaddr_storage dest;
+  socklen_t    dest_len;
+  size_t       period;       /* Frames per packet */
+  uint16_t     seq;
+  uint32_t     timestamp;
+  sox_bool     marker;
+  sox_uint64_t sent, frames_sent;
+  double       t0;           /* When the first packet left */
+} priv_t;
+
+static double now(void)
+{
+#if defined HAVE_CLOCK_GETTIME
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+  struct timeval t;
+
+  gettimeofday(&t, NULL);
+  return t.tv_sec + t.tv_usec * 1e-6;
+#endif
+}
+
+static void sleep_until(double when)
+{
+  double t;
+
+  while ((t = when - now()) > 0) {
+    struct timespec d;
+    d.tv_sec = (time_t)t;
+    d.tv_nsec = (long)((t - (double)d.tv_sec) * 1e9);
+    nanosleep(&d, NULL);
+  }
+}
+
+/*------------------------------- Sockets ----------------------------------*/
+
+/* Splits [rtp://|udp://][host]:port, the host maybe [IPv6] or empty */
+static int parse_address(sox_format_t * ft, char * * host, char * * port)
+{
+  char const * s = ft->filename, * colon, * end;
+
+  if (!strncasecmp(s, "rtp://", (size_t)6) || !strncasecmp(s, "udp://", (size_t)6))
+    s += 6;
+  if (*s == '[') {
+    end = strchr(++s, ']');
+    colon = end? end + 1 : NULL;
+  }
+  else end = colon = strrchr(s, ':');
+  if (!colon || *colon != ':' || !colon[1]) {
+    lsx_fail_errno(ft, SOX_EINVAL, "`%s' is not [host]:port", ft->filename);
+    return SOX_EOF;
+  }
+  *host = lsx_malloc((size_t)(end - s) + 1);
+  memcpy(*host, s, (size_t)(end - s));
+  (*host)[end - s] = '\0';
+  *port = lsx_strdup(colon + 1);
+  return SOX_SUCCESS;
+}
+
+/* Binds to a unicast address, or to the port of a multicast group joined */
+static int listen_on(int fd, struct addrinfo const * a)
+{
+  struct sockaddr_storage any;
+  int one = 1, size = 1 << 20;
+
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *)&one, (socklen_t)sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (void *)&size, (socklen_t)sizeof(size));
+  memcpy(&any, a->ai_addr, (size_t)a->ai_addrlen);
+  if (a->ai_family == AF_INET) {
+    struct sockaddr_in * in = (struct sockaddr_in *)&any;
+    if (IN_MULTICAST(ntohl(in->sin_addr.s_addr))) {
+      struct ip_mreq mreq;
+      mreq.imr_multiaddr = in->sin_addr;
+      mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+      in->sin_addr.s_addr = htonl(INADDR_ANY);
+      return bind(fd, (struct sockaddr *)&any, a->ai_addrlen) ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, (void *)&mreq,
+            (socklen_t)sizeof(mreq));
+    }
+  }
+  else if (a->ai_family == AF_INET6) {
+    struct sockaddr_in6 * in6 = (struct sockaddr_in6 *)&any;
+    if (IN6_IS_ADDR_MULTICAST(&in6->sin6_addr)) {
+      struct ipv6_mreq mreq;
+      mreq.ipv6mr_multiaddr = in6->sin6_addr;
+      mreq.ipv6mr_interface = 0;
+      in6->sin6_addr = in6addr_any;
+      return bind(fd, (struct sockaddr *)&any, a->ai_addrlen) ||
+        setsockopt(fd, IPPROTO_IPV6, IPV6_JOIN_GROUP, (void *)&mreq,
+            (socklen_t)sizeof(mreq));
+    }
+  }
+  return bind(fd, a->ai_addr, a->ai_addrlen);
+}
+
+static int open_socket(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  struct addrinfo hints, * addrs, * a;
+  char * host, * port;
+  int err;
+
+  if (parse_address(ft, &host, &port) != SOX_SUCCESS)
+    return SOX_EOF;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = ft->mode == 'r'? AI_PASSIVE : 0;
+  if ((err = getaddrinfo(*host? host : NULL, port, &hints, &addrs))) {
+    lsx_fail_errno(ft, SOX_EINVAL, "can't find `%s': %s", ft->filename, gai_strerror(err));
+    free(host), free(port);
+    return SOX_EOF;
+  }
+  free(host), free(port);
+  for (p->fd = -1, a = addrs; a && p->fd < 0; a = a->ai_next) {
+    if ((p->fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) < 0)
+      continue;
+    if (ft->mode == 'w') {
+      memcpy(&p->dest, a->ai_addr, (size_t)a->ai_addrlen);
+      p->dest_len = a->ai_addrlen;
+    }
+    else if (listen_on(p->fd, a)) {
+      err = errno;
+      close(p->fd);
+      p->fd = -1;
+      errno = err;
+    }
+  }
+  err = errno;
+  freeaddrinfo(addrs);
+  if (p->fd < 0) {
+    lsx_fail_errno(ft, err, "can't open `%s'", ft->filename);
+    return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
+/* Takes the datagrams waiting, up to BATCH, into io; returns how many */
+static int receive_batch(priv_t * p)
+{
+  int n;
+#if defined HAVE_RECVMMSG
+  int i;
+  struct mmsghdr msgs[BATCH];
+  struct iovec iov[BATCH];
+
+  memset(msgs, 0, sizeof(msgs));
+  for (n = 0; n < BATCH; ++n) {
+    iov[n].iov_base = p->io + n * MAX_DATAGRAM;
+    iov[n].iov_len = MAX_DATAGRAM;
+    msgs[n].msg_hdr.msg_iov = &iov[n];
+    msgs[n].msg_hdr.msg_iovlen = 1;
+  }
+  if ((n = recvmmsg(p->fd, msgs, BATCH, MSG_DONTWAIT, NULL)) < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR? 0 : -1;
+  for (i = 0; i < n; ++i)  /* A truncated datagram is dropped */
+    p->io_len[i] = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)? 0 : msgs[i].msg_len;
+  return n;
+#else
+  ssize_t len;
+
+  for (n = 0; n < BATCH; ++n) {
+    if ((len = recv(p->fd, p->io + n * MAX_DATAGRAM, MAX_DATAGRAM, MSG_DONTWAIT)) < 0)
+      return n || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR? n : -1;
+    p->io_len[n] = (size_t)len;
+  }
+  return n;
+#endif
+}
+
+static int send_batch(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t done = 0;
+#if defined HAVE_SENDMMSG
+  struct mmsghdr msgs[BATCH];
+  struct iovec iov[BATCH];
+  size_t i;
+  int n;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < p->batch; ++i) {
+    iov[i].iov_base = p->io + i * MAX_DATAGRAM;
+    iov[i].iov_len = p->io_len[i];
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &p->dest;
+    msgs[i].msg_hdr.msg_namelen = p->dest_len;
+  }
+  while (done < p->batch) {
+    if ((n = sendmmsg(p->fd, msgs + done, (unsigned)(p->batch - done), 0)) < 0) {
+      if (errno == EINTR)
+        continue;
+      lsx_fail_errno(ft, errno, "can't send to `%s'", ft->filename);
+      return SOX_EOF;
+    }
+    done += n;
+  }
+#else
+  for (; done < p->batch; ++done)
+    if (sendto(p->fd, p->io + done * MAX_DATAGRAM, p->io_len[done], 0,
+          (struct sockaddr *)&p->dest, p->dest_len) < 0) {
+      if (errno == EINTR) {
+        --done;
+        continue;
+      }
+      lsx_fail_errno(ft, errno, "can't send to `%s'", ft->filename);
+      return SOX_EOF;
+    }
+#endif
+  p->batch = 0;
+  return SOX_SUCCESS;
+}
+
+/*------------------------------- Payloads ---------------------------------*/
+
+/* Checks the encoding, and settles what goes with it */
+static int set_payload(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  unsigned bits = ft->encoding.bits_per_sample;
+
+  switch (ft->encoding.encoding) {
+    case SOX_ENCODING_SIGN2:
+      if (bits != 16 && bits != 24 && (p->rtp || bits != 32)) {
+        lsx_fail_errno(ft, SOX_EFMT, "%u-bit samples aren't supported", bits);
+        return SOX_EOF;
+      }
+      p->payload = payload_pcm;
+      p->width = bits >> 3;
+      break;
+    case SOX_ENCODING_ULAW: p->payload = payload_ulaw; p->width = 1; break;
+    case SOX_ENCODING_ALAW: p->payload = payload_alaw; p->width = 1; break;
+#if defined HAVE_RTP_OPUS
+    case SOX_ENCODING_OPUS: {
+      int err = OPUS_OK;
+      if (ft->signal.rate != 48000) {
+        lsx_report("Opus is sent at 48000Hz");
+        ft->signal.rate = 48000;
+      }
+      if (ft->signal.channels > 2) {
+        lsx_report("Opus is sent in at most 2 channels");
+        ft->signal.channels = 2;
+      }
+      ft->encoding.bits_per_sample = 0;
+      p->payload = payload_opus;
+      p->opus_pcm = lsx_malloc(MAX_OPUS * ft->signal.channels * sizeof(*p->opus_pcm));
+      if (ft->mode == 'r')
+        p->decoder = opus_decoder_create(48000, (int)ft->signal.channels, &err);
+      else if ((p->encoder = opus_encoder_create(48000, (int)ft->signal.channels,
+              OPUS_APPLICATION_AUDIO, &err)) && ft->encoding.compression != HUGE_VAL)
+        opus_encoder_ctl(p->encoder, OPUS_SET_BITRATE(ft->encoding.compression * 1000));
+      if (err != OPUS_OK) {
+        lsx_fail_errno(ft, SOX_EFMT, "Opus: %s", opus_strerror(err));
+        return SOX_EOF;
+      }
+      break;
+    }
+#endif
+    default:
+      lsx_fail_errno(ft, SOX_EFMT, "%s encoding isn't supported",
+          sox_encodings_info[ft->encoding.encoding].name);
+      return SOX_EOF;
+  }
+  p->big = MACHINE_IS_BIGENDIAN != !!ft->encoding.reverse_bytes;
+  p->pcm = lsx_malloc(max(MAX_DATAGRAM, MAX_OPUS * ft->signal.channels) * sizeof(*p->pcm));
+  return SOX_SUCCESS;
+}
+
+/* Decodes a payload into pcm; returns the number of frames, or 0 */
+static size_t unpack(sox_format_t * ft, uint8_t const * d, size_t len)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t i, n, chans = ft->signal.channels;
+  SOX_SAMPLE_LOCALS;
+
+#if defined HAVE_RTP_OPUS
+  if (p->payload == payload_opus) {
+    int frames = opus_decode(p->decoder, d, (opus_int32)len, p->opus_pcm, MAX_OPUS, 0);
+    if (frames < 0)
+      return 0;
+    for (i = 0, n = (size_t)frames * chans; i < n; ++i)
+      p->pcm[i] = SOX_SIGNED_16BIT_TO_SAMPLE(p->opus_pcm[i],);
+    return (size_t)frames;
+  }
+#endif
+  n = len / p->width / chans * chans;
+  for (i = 0; i < n; ++i, d += p->width) switch (p->payload) {
+    case payload_ulaw: p->pcm[i] = SOX_SIGNED_16BIT_TO_SAMPLE(sox_ulaw2linear16(*d),); break;
+    case payload_alaw: p->pcm[i] = SOX_SIGNED_16BIT_TO_SAMPLE(sox_alaw2linear16(*d),); break;
+    default: switch (p->width) {
+      case 2: p->pcm[i] = (sox_sample_t)((p->big? (unsigned)d[0] << 24 | (unsigned)d[1] << 16 :
+          (unsigned)d[1] << 24 | (unsigned)d[0] << 16)); break;
+      case 3: p->pcm[i] = (sox_sample_t)((p->big?
+          (unsigned)d[0] << 24 | (unsigned)d[1] << 16 | (unsigned)d[2] << 8 :
+          (unsigned)d[2] << 24 | (unsigned)d[1] << 16 | (unsigned)d[0] << 8)); break;
+      default: p->pcm[i] = (sox_sample_t)((p->big?
+          (unsigned)d[0] << 24 | (unsigned)d[1] << 16 | (unsigned)d[2] << 8 | d[3] :
+          (unsigned)d[3] << 24 | (unsigned)d[2] << 16 | (unsigned)d[1] << 8 | d[0]));
+    }
+  }
+  return n / chans;
+}
+
+/* Encodes frames of pcm into d; returns the payload's length, or 0 */
+static size_t pack(sox_format_t * ft, uint8_t * d, size_t frames)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t i, n = frames * ft->signal.channels;
+  SOX_SAMPLE_LOCALS;
+
+#if defined HAVE_RTP_OPUS
+  if (p->payload == payload_opus) {
+    int len;
+    for (i = 0; i < n; ++i)
+      p->opus_pcm[i] = SOX_SAMPLE_TO_SIGNED_16BIT(p->pcm[i], ft->clips);
+    memset(p->opus_pcm + n, 0, (p->period - frames) * ft->signal.channels * sizeof(*p->opus_pcm));
+    len = opus_encode(p->encoder, p->opus_pcm, (int)p->period, d, MAX_DATAGRAM - RTP_HEADER);
+    if (len < 0)
+      lsx_fail_errno(ft, SOX_EFMT, "Opus: %s", opus_strerror(len));
+    return len < 0? 0 : (size_t)len;
+  }
+#endif
+  for (i = 0; i < n; ++i, d += p->width) {
+    uint32_t v = (uint32_t)p->pcm[i];
+    unsigned j;
+    switch (p->payload) {
+      case payload_ulaw: *d = SOX_SAMPLE_TO_ULAW_BYTE(p->pcm[i], ft->clips); continue;
+      case payload_alaw: *d = SOX_SAMPLE_TO_ALAW_BYTE(p->pcm[i], ft->clips); continue;
+      default: break;
+    }
+    if (p->width == 2)
+      v = (uint32_t)SOX_SAMPLE_TO_SIGNED_16BIT(p->pcm[i], ft->clips) << 16;
+    else if (p->width == 3)
+      v = (uint32_t)SOX_SAMPLE_TO_SIGNED_24BIT(p->pcm[i], ft->clips) << 8;
+    for (j = 0; j < p->width; ++j, v <<= 8)   /* The top bytes of v */
+      d[p->big? j : p->width - 1 - j] = (uint8_t)(v >> 24);
+  }
+  return n * p->width;
+}
+
+/*------------------------------- Reading ----------------------------------*/
+
+/* Moves the read position on to sequence number to, dropping what's passed */
+static void drop_to(priv_t * p, unsigned to0)
+{
+  uint16_t const to = (uint16_t)to0;
+
+  for (; p->next != to; ++p->next) {
+    size_t * len = &p->jb_len[p->next & (p->slots - 1)];
+    if (*len)
+      *len = 0, ++p->overrun;
+    else ++p->lost;
+  }
+  if ((uint16_t)(to - p->top) < 0x8000)
+    p->top = to;
+}
+
+/* Takes a datagram into the jitter buffer */
+static void take(priv_t * p, uint8_t const * d, size_t len)
+{
+  size_t header = 0, ahead, slot;
+  uint16_t seq = p->top;
+
+  if (p->rtp) {
+    unsigned pt;
+    uint32_t ssrc;
+    if (len < RTP_HEADER || d[0] >> 6 != 2)
+      return;
+    pt = d[1] & 0x7f;
+    ssrc = (uint32_t)d[8] << 24 | (uint32_t)d[9] << 16 | (uint32_t)d[10] << 8 | d[11];
+    header = RTP_HEADER + 4 * (d[0] & 15);
+    if ((d[0] & 0x10) && len >= header + 4)  /* Extension */
+      header += 4 + 4 * ((size_t)d[header + 2] << 8 | d[header + 3]);
+    if (d[0] & 0x20)                          /* Padding */
+      len -= min(len, d[len - 1]);
+    if (len <= header)
+      return;
+    if (!p->started)
+      p->pt = pt, p->ssrc = ssrc;
+    else if (pt != p->pt || ssrc != p->ssrc) {
+      ++p->foreign;
+      return;
+    }
+    seq = (uint16_t)(d[2] << 8 | d[3]);
+  }
+  else if (!len)
+    return;
+  ++p->received;
+  if (!p->started) {
+    p->started = sox_true;
+    p->next = p->top = seq;
+  }
+  if ((ahead = (uint16_t)(seq - p->next)) >= 0x8000) {
+    if ((uint16_t)(p->next - seq) <= p->slots) {
+      ++p->late;
+      return;
+    }
+    drop_to(p, p->top);          /* Far behind: the sender started again */
+    p->next = p->top = seq;
+  }
+  else if (ahead >= p->slots)    /* Too far ahead: make room */
+    drop_to(p, (unsigned)(seq - p->slots + 1));
+  if (p->jb_len[slot = seq & (p->slots - 1)]) {
+    ++p->late;
+    return;
+  }
+  memcpy(p->jb + slot * MAX_DATAGRAM, d + header, len - header);
+  p->jb_len[slot] = len - header;
+  if ((uint16_t)(seq - p->top) < 0x8000)
+    p->top = (uint16_t)(seq + 1);
+  p->idle = sox_false;
+}
+
+/* Waits up to timeout ms (-1: for ever) for datagrams and takes them; returns
+ * how many, or -1.  It's called only with fewer than depth packets' span
+ * buffered, so the batch fits unless packets are lost wholesale. */
+static int receive(priv_t * p, int timeout)
+{
+  struct pollfd pfd;
+  int i, n;
+
+  pfd.fd = p->fd;
+  pfd.events = POLLIN;
+  if ((n = poll(&pfd, (nfds_t)1, timeout)) <= 0)
+    return n < 0 && errno != EINTR? -1 : 0;
+  if ((n = receive_batch(p)) > 0)
+    for (i = 0; i < n; ++i)
+      take(p, p->io + i * MAX_DATAGRAM, p->io_len[i]);
+  return n;
+}
+
+/* Fills pcm in place of a packet lost; returns the number of frames */
+static size_t conceal(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+#if defined HAVE_RTP_OPUS
+  if (p->payload == payload_opus) {
+    int i, n = opus_decode(p->decoder, NULL, 0, p->opus_pcm, (int)p->last_frames, 0);
+    SOX_SAMPLE_LOCALS;
+    for (i = 0; i < n * (int)ft->signal.channels; ++i)
+      p->pcm[i] = SOX_SIGNED_16BIT_TO_SAMPLE(p->opus_pcm[i],);
+    return n > 0? (size_t)n : 0;
+  }
+#endif
+  memset(p->pcm, 0, p->last_frames * ft->signal.channels * sizeof(*p->pcm));
+  return p->last_frames;
+}
+
+static sox_bool next_packet(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  while (sox_true) {
+    size_t ahead = (uint16_t)(p->top - p->next), slot = p->next & (p->slots - 1);
+    int n;
+
+    if (!ahead)
+      p->primed = sox_false;           /* Run dry: fill up again */
+    else if (ahead >= p->depth)
+      p->primed = sox_true;
+    if (p->primed || p->idle) {
+      if (ahead && (p->jb_len[slot] || ahead >= p->depth || p->idle)) {
+        size_t frames = 0;
+        if (p->jb_len[slot])
+          frames = unpack(ft, p->jb + slot * MAX_DATAGRAM, p->jb_len[slot]);
+        else ++p->lost;
+        if (!frames)
+          frames = conceal(ft);
+        else p->last_frames = frames;
+        p->jb_len[slot] = 0;
+        ++p->next;
+        p->pcm_pos = 0;
+        p->pcm_len = frames * ft->signal.channels;
+        return sox_true;
+      }
+    }
+    if (p->idle && !ahead)
+      return sox_false;
+    if ((n = receive(p, IDLE_END * 1000)) < 0) {
+      lsx_fail_errno(ft, errno, "can't receive from `%s'", ft->filename);
+      return sox_false;
+    }
+    if (!n && !p->idle) {
+      lsx_report("`%s': no packets for %u seconds", ft->filename, IDLE_END);
+      p->idle = sox_true;
+    }
+  }
+}
+
+static int startread(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t len;
+
+  p->fd = -1;
+  p->depth = ft->context->device_periods? ft->context->device_periods : 4;
+  p->depth = min(p->depth, 0x1000);
+  for (p->slots = BATCH; p->slots < 2 * (p->depth + BATCH); p->slots <<= 1);
+  p->io = lsx_malloc((size_t)BATCH * MAX_DATAGRAM);
+  p->jb = lsx_malloc(p->slots * MAX_DATAGRAM);
+  p->jb_len = lsx_calloc(p->slots, sizeof(*p->jb_len));
+  if (open_socket(ft) != SOX_SUCCESS)
+    return SOX_EOF;
+
+  lsx_report("waiting for packets on `%s'", ft->filename);
+  while (!p->started)
+    if (receive(p, -1) < 0) {
+      lsx_fail_errno(ft, errno, "can't receive from `%s'", ft->filename);
+      return SOX_EOF;
+    }
+  if (p->rtp) {  /* A static payload type says what it is */
+    static struct {unsigned pt; sox_encoding_t e; unsigned bits, chans;} const
+      statics[] = {{0, SOX_ENCODING_ULAW, 8, 1}, {8, SOX_ENCODING_ALAW, 8, 1},
+        {10, SOX_ENCODING_SIGN2, 16, 2}, {11, SOX_ENCODING_SIGN2, 16, 1}};
+    size_t i;
+    for (i = 0; i < array_length(statics); ++i) if (p->pt == statics[i].pt) {
+      ft->encoding.encoding = statics[i].e;
+      ft->encoding.bits_per_sample = statics[i].bits;
+      ft->signal.channels = statics[i].chans;
+      ft->signal.rate = p->pt < 10? 8000 : 44100;
+      lsx_report("RTP payload type %u: %s", p->pt,
+          sox_encodings_info[ft->encoding.encoding].desc);
+    }
+  }
+  if (set_payload(ft) != SOX_SUCCESS)
+    return SOX_EOF;
+  len = p->jb_len[p->next & (p->slots - 1)];
+#if defined HAVE_RTP_OPUS
+  if (p->payload == payload_opus) {
+    int frames = opus_packet_get_nb_samples(p->jb + (p->next & (p->slots - 1)) * MAX_DATAGRAM,
+        (opus_int32)len, 48000);
+    p->last_frames = frames > 0? (size_t)frames : 960;
+  } else
+#endif
+  p->last_frames = max(len / p->width / ft->signal.channels, 1);
+  return SOX_SUCCESS;
+}
+
+static size_t sox_rtpread(sox_format_t * ft, sox_sample_t * buf, size_t len)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t done = 0, n;
+
+  while (done < len) {
+    if (p->pcm_pos == p->pcm_len && !next_packet(ft))
+      break;
+    n = min(len - done, p->pcm_len - p->pcm_pos);
+    memcpy(buf + done, p->pcm + p->pcm_pos, n * sizeof(*buf));
+    p->pcm_pos += n;
+    done += n;
+  }
+  return done;
+}
+
+/*------------------------------- Writing ----------------------------------*/
+
+static int startwrite(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t max_period;
+
+  p->fd = -1;
+  if (set_payload(ft) != SOX_SUCCESS || open_socket(ft) != SOX_SUCCESS)
+    return SOX_EOF;
+  p->pt = DYNAMIC_PT;
+  if (p->payload == payload_ulaw || p->payload == payload_alaw) {
+    if (ft->signal.rate == 8000 && ft->signal.channels == 1)
+      p->pt = p->payload == payload_ulaw? 0 : 8;
+  }
+  else if (p->payload == payload_pcm && p->width == 2 && ft->signal.rate == 44100 &&
+      ft->signal.channels <= 2)
+    p->pt = ft->signal.channels == 2? 10 : 11;
+  p->period = ft->context->device_period? ft->context->device_period :
+    (size_t)(ft->signal.rate / (p->payload == payload_pcm? 1000 : 50));
+  p->period = max(p->period, 1);
+  if (p->payload == payload_opus) {  /* The longest of Opus's that fits */
+    static size_t const sizes[] = {120, 240, 480, 960, 1920, 2880};
+    size_t i = array_length(sizes) - 1;
+    while (i && sizes[i] > p->period)
+      --i;
+    if (sizes[i] != p->period)
+      lsx_report("Opus packets are of %lu frames", (unsigned long)sizes[i]);
+    p->period = sizes[i];
+  }
+  else if (p->period > (max_period = (MAX_DATAGRAM - RTP_HEADER) / p->width / ft->signal.channels)) {
+    lsx_report("packets are of at most %lu frames", (unsigned long)max_period);
+    p->period = max_period;
+  }
+  p->io = lsx_malloc((size_t)BATCH * MAX_DATAGRAM);
+  p->seq = (uint16_t)RANQD1;
+  p->timestamp = (uint32_t)RANQD1;
+  p->ssrc = (uint32_t)RANQD1;
+  p->marker = sox_true;
+  return SOX_SUCCESS;
+}
+
+/* Sends the packet in pcm, when it is due; those already due are batched */
+static int send_packet(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t frames = p->pcm_len / ft->signal.channels, len;
+  uint8_t * d = p->io + p->batch * MAX_DATAGRAM;
+  double t = now(), due;
+
+  if (!p->sent)
+    p->t0 = t;
+  due = p->t0 + p->frames_sent / ft->signal.rate;
+  if (t - due > MAX_SLIP) {  /* After a stall, don't burst to catch up */
+    p->t0 += t - due;
+    due = t;
+  }
+  if (due > t) {
+    if (send_batch(ft) != SOX_SUCCESS)
+      return SOX_EOF;
+    d = p->io;
+    sleep_until(due);
+  }
+  if (p->rtp) {
+    d[0] = 0x80;
+    d[1] = (uint8_t)(p->pt | (p->marker? 0x80 : 0));
+    d[2] = (uint8_t)(p->seq >> 8), d[3] = (uint8_t)p->seq;
+    d[4] = (uint8_t)(p->timestamp >> 24), d[5] = (uint8_t)(p->timestamp >> 16);
+    d[6] = (uint8_t)(p->timestamp >> 8), d[7] = (uint8_t)p->timestamp;
+    d[8] = (uint8_t)(p->ssrc >> 24), d[9] = (uint8_t)(p->ssrc >> 16);
+    d[10] = (uint8_t)(p->ssrc >> 8), d[11] = (uint8_t)p->ssrc;
+  }
+  if (!(len = pack(ft, d + (p->rtp? RTP_HEADER : 0), frames)))
+    return SOX_EOF;
+  p->io_len[p->batch++] = len + (p->rtp? RTP_HEADER : 0);
+  if (p->payload == payload_opus)
+    frames = p->period;
+  ++p->seq;
+  p->timestamp += (uint32_t)frames;
+  p->marker = sox_false;
+  p->pcm_len = 0;
+  ++p->sent;
+  p->frames_sent += frames;
+  return p->batch == BATCH || due > t? send_batch(ft) : SOX_SUCCESS;
+}
+
+static size_t sox_rtpwrite(sox_format_t * ft, sox_sample_t const * buf, size_t len)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t done = 0, n, packet = p->period * ft->signal.channels;
+
+  while (done < len) {
+    n = min(len - done, packet - p->pcm_len);
+    memcpy(p->pcm + p->pcm_len, buf + done, n * sizeof(*buf));
+    p->pcm_len += n;
+    done += n;
+    if (p->pcm_len == packet && send_packet(ft) != SOX_SUCCESS)
+      return 0;
+  }
+  return send_batch(ft) == SOX_SUCCESS? done : 0;
+}
+
+/*------------------------------- Both -------------------------------------*/
+
+static int stop(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  int result = SOX_SUCCESS;
+
+  if (ft->mode == 'w' && p->fd >= 0) {
+    if (p->pcm_len >= ft->signal.channels)
+      result = send_packet(ft);
+    if (result == SOX_SUCCESS)
+      result = send_batch(ft);
+    lsx_report("sent %" PRIu64 " packets", p->sent);
+  }
+  else if (ft->mode == 'r' && p->started)
+    lsx_report("received %" PRIu64 " packets: %" PRIu64 " lost, %" PRIu64
+        " late or duplicated, %" PRIu64 " dropped to catch up, %" PRIu64
+        " of other streams", p->received, p->lost, p->late, p->overrun, p->foreign);
+  if (p->fd >= 0)
+    close(p->fd);
+#if defined HAVE_RTP_OPUS
+  if (p->decoder)
+    opus_decoder_destroy(p->decoder);
+  if (p->encoder)
+    opus_encoder_destroy(p->encoder);
+  free(p->opus_pcm);
+#endif
+  free(p->pcm);
+  free(p->jb_len);
+  free(p->jb);
+  free(p->io);
+  return result;
+}
+
+static int rtp_startread(sox_format_t * ft)
+{
+  ((priv_t *)ft->priv)->rtp = sox_true;
+  return startread(ft);
+}
+
+static int rtp_startwrite(sox_format_t * ft)
+{
+  ((priv_t *)ft->priv)->rtp = sox_true;
+  return startwrite(ft);
+}
+
+LSX_FORMAT_HANDLER(rtp)
+{
+  static char const * const names[] = {"rtp", NULL};
+  static unsigned const write_encodings[] = {
+    SOX_ENCODING_SIGN2, 24, 16, 0,
+    SOX_ENCODING_ULAW, 8, 0,
+    SOX_ENCODING_ALAW, 8, 0,
+#if defined HAVE_RTP_OPUS
+    SOX_ENCODING_OPUS, 0,
+#endif
+    0};
+  static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
+    "RTP network audio (L16, L24, PCMU, PCMA or Opus)",
+    names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO | SOX_FILE_BIG_END,
+    rtp_startread, sox_rtpread, stop,
+    rtp_startwrite, sox_rtpwrite, stop,
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+LSX_FORMAT_HANDLER(udp)
+{
+  static char const * const names[] = {"udp", NULL};
+  static unsigned const write_encodings[] = {
+    SOX_ENCODING_SIGN2, 32, 24, 16, 0,
+    SOX_ENCODING_ULAW, 8, 0,
+    SOX_ENCODING_ALAW, 8, 0,
+#if defined HAVE_RTP_OPUS
+    SOX_ENCODING_OPUS, 0,
+#endif
+    0};
+  static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
+    "Bare UDP network audio, a packet per datagram",
+    names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
+    startread, sox_rtpread, stop,
+    startwrite, sox_rtpwrite, stop,
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+#endif
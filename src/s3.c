@@ -0,0 +1,550 @@
+/* libSoX S3 output: multipart upload to object storage
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Writes an s3://bucket/key URL as a stdio stream, uploading it, part by
+ * part as it is written, to an S3-compatible object store (through http.c,
+ * so the endpoint must be http:), rather than to a local file first.
+ *
+ * The first part is held until the stream is closed, so that a format
+ * handler may seek back into it to patch its header (as WAV & AIFF do);
+ * it is then uploaded last, as part number 1, and the parts put in order
+ * by the store.  Other seeks are only within the part being filled.  An
+ * object that fits in one part is put in a single request instead.  With
+ * asynchronous I/O (sox_set_io_async; open_write asks for it), the parts
+ * are uploaded by the I/O thread whilst the effects run on.
+ *
+ * Requests are signed (AWS signature version 4) with the credentials in
+ * the environment: AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY, and maybe
+ * AWS_SESSION_TOKEN; AWS_REGION (else AWS_DEFAULT_REGION, else us-east-1)
+ * and AWS_ENDPOINT_URL_S3 (else AWS_ENDPOINT_URL, else the region's AWS
+ * endpoint) say where to.  Requests are path-style: endpoint/bucket/key.
+ */
+
+#define _GNU_SOURCE
+#include "sox_i.h"
+#include <string.h>
+
+#if defined HAVE_FOPENCOOKIE && defined HAVE_GETADDRINFO && defined HAVE_NETDB_H
+
+#include <ctype.h>
+#include <time.h>
+
+#define PART_SIZE LSX_S3_PART_SIZE
+#define ID_MAX    200           /* Longest upload ID accepted */
+#define QUERY_MAX (3 * ID_MAX + 40)
+
+/*------------------------------- SHA-256 ------------------------------------*/
+
+typedef struct {
+  uint32_t h[8];
+  uint64_t len;
+  unsigned char block[64];
+} sha256_t;
+
+static uint32_t const k256[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define ROR(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static void sha256_block(sha256_t * s, unsigned char const * p)
+{
+  uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  for (i = 0; i < 16; ++i, p += 4)
+    w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+  for (; i < 64; ++i)
+    w[i] = w[i - 16] + w[i - 7] +
+      (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ w[i - 15] >> 3) +
+      (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ w[i - 2] >> 10);
+  a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3];
+  e = s->h[4], f = s->h[5], g = s->h[6], h = s->h[7];
+  for (i = 0; i < 64; ++i) {
+    t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+      k256[i] + w[i];
+    t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
+  }
+  s->h[0] += a, s->h[1] += b, s->h[2] += c, s->h[3] += d;
+  s->h[4] += e, s->h[5] += f, s->h[6] += g, s->h[7] += h;
+}
+
+static void sha256_init(sha256_t * s)
+{
+  static uint32_t const h0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+    0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  memcpy(s->h, h0, sizeof(h0));
+  s->len = 0;
+}
+
+static void sha256_add(sha256_t * s, void const * data, size_t len)
+{
+  unsigned char const * p = data;
+  size_t used = (size_t)(s->len & 63);
+
+  s->len += len;
+  if (used) {
+    size_t n = min(len, 64 - used);
+    memcpy(s->block + used, p, n);
+    p += n, len -= n;
+    if (used + n < 64)
+      return;
+    sha256_block(s, s->block);
+  }
+  for (; len >= 64; p += 64, len -= 64)
+    sha256_block(s, p);
+  memcpy(s->block, p, len);
+}
+
+static void sha256_end(sha256_t * s, unsigned char digest[32])
+{
+  unsigned char pad[72] = {0x80};
+  uint64_t bits = s->len << 3;
+  size_t n = 64 - (size_t)((s->len + 8) & 63), i;
+
+  for (i = 0; i < 8; ++i)
+    pad[n + i] = (unsigned char)(bits >> (56 - 8 * i));
+  sha256_add(s, pad, n + 8);
+  for (i = 0; i < 32; ++i)
+    digest[i] = (unsigned char)(s->h[i >> 2] >> (24 - 8 * (i & 3)));
+}
+
+static void sha256_hex(void const * data, size_t len, char hex[65])
+{
+  sha256_t s;
+  unsigned char digest[32];
+  int i;
+
+  sha256_init(&s);
+  sha256_add(&s, data, len);
+  sha256_end(&s, digest);
+  for (i = 0; i < 32; ++i)
+    sprintf(hex + 2 * i, "%02x", digest[i]);
+}
+
+static void hmac_sha256(void const * key, size_t key_len, char const * text,
+    unsigned char mac[32])
+{
+  unsigned char k[64], pad[64];
+  sha256_t s;
+  int i;
+
+  memset(k, 0, sizeof(k));
+  memcpy(k, key, key_len); /* Keys here are never longer than a block */
+  for (i = 0; i < 64; ++i)
+    pad[i] = k[i] ^ 0x36;
+  sha256_init(&s);
+  sha256_add(&s, pad, sizeof(pad));
+  sha256_add(&s, text, strlen(text));
+  sha256_end(&s, mac);
+  for (i = 0; i < 64; ++i)
+    pad[i] = k[i] ^ 0x5c;
+  sha256_init(&s);
+  sha256_add(&s, pad, sizeof(pad));
+  sha256_add(&s, mac, (size_t)32);
+  sha256_end(&s, mac);
+}
+
+/*------------------------------- Requests -----------------------------------*/
+
+typedef struct {
+  char         * endpoint;    /* http://host[:port], without a final / */
+  char         * host;        /* As given in the Host header */
+  char         * path;        /* /bucket/key, URI-encoded */
+  char const   * key_id, * secret, * token, * region;
+  char         * upload_id;   /* Of the multipart upload, once begun */
+  char         * * etags;     /* Of the parts uploaded, from part 2 */
+  size_t       num_etags;
+  char         * first;       /* Part 1, held to the end */
+  size_t       first_len;
+  char         * part;        /* The part being filled, */
+  size_t       part_len;
+  off_t        part_start;    /* and where it is in the object */
+  off_t        pos, length;
+  sox_bool     failed;
+} s3_t;
+
+/* Appends s to d, URI-encoded as signature version 4 has it */
+static char * uri_encode(char * d, char const * s, sox_bool slash)
+{
+  for (; *s; ++s) {
+    unsigned char c = (unsigned char)*s;
+    if (isalnum(c) || strchr("-._~", c) || (slash && c == '/'))
+      *d++ = (char)c;
+    else d += sprintf(d, "%%%02X", c);
+  }
+  *d = '\0';
+  return d;
+}
+
+/* Returns the CRLF-terminated headers that sign a request; query must be
+ * in canonical form (parameters sorted, their values URI-encoded). */
+static char * sign_request(s3_t const * u, char const * method,
+    char const * query, void const * body, size_t len)
+{
+  time_t now = time(NULL);
+  char date[9], stamp[17], payload[65], canonical_hash[65], signature[65];
+  char * canonical, * to_sign, * headers, * scope, key[80];
+  unsigned char mac[32];
+  char const * signed_headers = u->token?
+    "host;x-amz-content-sha256;x-amz-date;x-amz-security-token" :
+    "host;x-amz-content-sha256;x-amz-date";
+  int i;
+
+  strftime(date, sizeof(date), "%Y%m%d", gmtime(&now));
+  strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", gmtime(&now));
+  sha256_hex(body, len, payload);
+
+  canonical = lsx_malloc(strlen(method) + strlen(u->path) + strlen(query) +
+      strlen(u->host) + (u->token? strlen(u->token) : 0) + 400);
+  sprintf(canonical, "%s\n%s\n%s\nhost:%s\nx-amz-content-sha256:%s\n"
+      "x-amz-date:%s\n%s%s%s\n%s\n%s", method, u->path, query, u->host,
+      payload, stamp, u->token? "x-amz-security-token:" : "",
+      u->token? u->token : "", u->token? "\n" : "", signed_headers, payload);
+  sha256_hex(canonical, strlen(canonical), canonical_hash);
+  free(canonical);
+
+  scope = lsx_malloc(strlen(u->region) + 40);
+  sprintf(scope, "%s/%s/s3/aws4_request", date, u->region);
+  to_sign = lsx_malloc(strlen(scope) + 200);
+  sprintf(to_sign, "AWS4-HMAC-SHA256\n%s\n%s\n%s", stamp, scope, canonical_hash);
+
+  sprintf(key, "AWS4%.60s", u->secret);
+  hmac_sha256(key, strlen(key), date, mac);
+  hmac_sha256(mac, sizeof(mac), u->region, mac);
+  hmac_sha256(mac, sizeof(mac), "s3", mac);
+  hmac_sha256(mac, sizeof(mac), "aws4_request", mac);
+  hmac_sha256(mac, sizeof(mac), to_sign, mac);
+  for (i = 0; i < 32; ++i)
+    sprintf(signature + 2 * i, "%02x", mac[i]);
+  free(to_sign);
+
+  headers = lsx_malloc(strlen(u->key_id) + strlen(scope) +
+      (u->token? strlen(u->token) : 0) + 500);
+  sprintf(headers, "x-amz-content-sha256: %s\r\nx-amz-date: %s\r\n%s%s%s"
+      "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s, SignedHeaders=%s, "
+      "Signature=%s\r\n", payload, stamp, u->token? "x-amz-security-token: " : "",
+      u->token? u->token : "", u->token? "\r\n" : "", u->key_id, scope,
+      signed_headers, signature);
+  free(scope);
+  return headers;
+}
+
+/* Returns a copy of the content of the first <name> element in xml */
+static char * xml_value(char const * xml, char const * name)
+{
+  char open[40], close[40], * value;
+  char const * a, * b;
+
+  sprintf(open, "<%.30s>", name);
+  sprintf(close, "</%.30s>", name);
+  if (!xml || !(a = strstr(xml, open)) || !(b = strstr(a += strlen(open), close)))
+    return NULL;
+  value = lsx_malloc((size_t)(b - a) + 1);
+  memcpy(value, a, (size_t)(b - a));
+  value[b - a] = '\0';
+  return value;
+}
+
+/* Makes a signed request; returns sox_true if it succeeded */
+static sox_bool send_request(s3_t * u, char const * method,
+    char const * query, void const * body, size_t len, char * * response,
+    char * * etag)
+{
+  char * headers = sign_request(u, method, query, body, len), * resp = NULL, * url;
+  int status;
+
+  url = lsx_malloc(strlen(u->endpoint) + strlen(u->path) + strlen(query) + 2);
+  sprintf(url, "%s%s%s%s", u->endpoint, u->path, *query? "?" : "", query);
+  status = lsx_http_exchange(method, url, headers, body, len, &resp,
+      etag? "ETag" : NULL, etag);
+  free(headers);
+  if (status == 200 && !strstr(resp, "<Error>")) {  /* Errors can be 200 */
+    lsx_debug("%s %s: %" PRIuPTR " bytes", method, url, len);
+    free(url);
+    if (response)
+      *response = resp;
+    else free(resp);
+    return sox_true;
+  }
+  if (status < 0)
+    lsx_fail("%s %s: %s", method, url, strerror(errno));
+  else {
+    char * code = xml_value(resp, "Code"), * message = xml_value(resp, "Message");
+    lsx_fail("%s %s: status %i%s%s%s%s", method, url, status,
+        code? " " : "", code? code : "", message? ": " : "", message? message : "");
+    free(code);
+    free(message);
+  }
+  free(url);
+  free(resp);
+  if (etag) {
+    free(*etag);
+    *etag = NULL;
+  }
+  errno = status == 403? EACCES : status == 404? ENOENT : EIO;
+  return sox_false;
+}
+
+static sox_bool upload_part(s3_t * u, unsigned n, void const * data, size_t len,
+    char * * etag)
+{
+  char query[QUERY_MAX], * q;
+
+  q = query + sprintf(query, "partNumber=%u&uploadId=", n);
+  uri_encode(q, u->upload_id, sox_false);
+  return send_request(u, "PUT", query, data, len, NULL, etag) && *etag;
+}
+
+/* Uploads the part being filled (as part 2 or later) */
+static sox_bool flush_part(s3_t * u)
+{
+  char * etag = NULL;
+
+  if (!u->upload_id) {
+    char * response;
+    if (!send_request(u, "POST", "uploads=", "", (size_t)0, &response, NULL))
+      return sox_false;
+    u->upload_id = xml_value(response, "UploadId");
+    free(response);
+    if (!u->upload_id || strlen(u->upload_id) > ID_MAX) {
+      lsx_fail("`%s': no upload ID given", u->path);
+      errno = EPROTO;
+      return sox_false;
+    }
+  }
+  if (!upload_part(u, (unsigned)u->num_etags + 2, u->part, u->part_len, &etag))
+    return sox_false;
+  lsx_revalloc(u->etags, u->num_etags + 1);
+  u->etags[u->num_etags++] = etag;
+  u->part_start += (off_t)u->part_len;
+  u->part_len = 0;
+  return sox_true;
+}
+
+static sox_bool complete(s3_t * u)
+{
+  char * etag = NULL, * xml, * p, query[QUERY_MAX];
+  size_t i, size = 100;
+  sox_bool ok;
+
+  if (!upload_part(u, 1u, u->first, u->first_len, &etag))
+    return sox_false;
+  for (i = 0; i < u->num_etags; ++i)
+    size += strlen(u->etags[i]) + 80;
+  p = xml = lsx_malloc(size + strlen(etag) + 80);
+  p += sprintf(p, "<CompleteMultipartUpload>");
+  for (i = 0; i <= u->num_etags; ++i)
+    p += sprintf(p, "<Part><PartNumber>%" PRIuPTR "</PartNumber><ETag>%s</ETag></Part>",
+        i + 1, i? u->etags[i - 1] : etag);
+  p += sprintf(p, "</CompleteMultipartUpload>");
+  free(etag);
+  strcpy(query, "uploadId=");
+  uri_encode(query + strlen(query), u->upload_id, sox_false);
+  ok = send_request(u, "POST", query, xml, (size_t)(p - xml), NULL, NULL);
+  free(xml);
+  return ok;
+}
+
+static void abort_upload(s3_t * u)
+{
+  char query[QUERY_MAX];
+  int err = errno;
+
+  strcpy(query, "uploadId=");
+  uri_encode(query + strlen(query), u->upload_id, sox_false);
+  send_request(u, "DELETE", query, "", (size_t)0, NULL, NULL);
+  errno = err;
+}
+
+/*-------------------------------- Stream ------------------------------------*/
+
+static ssize_t s3_write(void * cookie, char const * buf, size_t len)
+{
+  s3_t * u = cookie;
+  size_t done = 0;
+
+  while (done < len && !u->failed) {
+    size_t n;
+    if (u->pos < PART_SIZE) {            /* In part 1 */
+      n = min(len - done, (size_t)(PART_SIZE - u->pos));
+      memcpy(u->first + u->pos, buf + done, n);
+      u->first_len = max(u->first_len, (size_t)u->pos + n);
+    }
+    else {
+      size_t at = (size_t)(u->pos - u->part_start);
+      if (at == PART_SIZE && !(u->failed = !flush_part(u)))
+        at = 0;
+      if (u->failed)
+        break;
+      if (!u->part)
+        u->part = lsx_malloc((size_t)PART_SIZE);
+      n = min(len - done, PART_SIZE - at);
+      memcpy(u->part + at, buf + done, n);
+      u->part_len = max(u->part_len, at + n);
+    }
+    u->pos += (off_t)n;
+    u->length = max(u->length, u->pos);
+    done += n;
+  }
+  return u->failed? -1 : (ssize_t)done;
+}
+
+static int s3_seek(void * cookie, off64_t * offset, int whence)
+{
+  s3_t * u = cookie;
+  off_t pos = whence == SEEK_SET? *offset :
+    whence == SEEK_CUR? u->pos + *offset : u->length + *offset;
+
+  if (pos < 0 || pos > u->length) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (pos > (off_t)u->first_len && pos < u->part_start) { /* Uploaded */
+    errno = ESPIPE;
+    return -1;
+  }
+  *offset = u->pos = pos;
+  return 0;
+}
+
+static int s3_close(void * cookie)
+{
+  s3_t * u = cookie;
+  size_t i;
+  int ret;
+
+  if (!u->failed) {
+    if (!u->upload_id && !u->part_len)
+      u->failed = !send_request(u, "PUT", "", u->first, u->first_len, NULL, NULL);
+    else u->failed = (u->part_len && !flush_part(u)) || !complete(u);
+  }
+  if (u->failed && u->upload_id)
+    abort_upload(u);
+  ret = u->failed? -1 : 0;
+  for (i = 0; i < u->num_etags; ++i)
+    free(u->etags[i]);
+  free(u->etags);
+  free(u->upload_id);
+  free(u->first);
+  free(u->part);
+  free(u->endpoint);
+  free(u->host);
+  free(u->path);
+  free(u);
+  return ret;
+}
+
+static char const * env(char const * name, char const * alternative)
+{
+  char const * value = getenv(name);
+  return value && *value? value : alternative? getenv(alternative) : NULL;
+}
+
+sox_bool lsx_s3_handles(char const * url)
+{
+  return !strncasecmp(url, "s3://", (size_t)5);
+}
+
+FILE * lsx_s3_open(char const * url)
+{
+  cookie_io_functions_t io = {NULL, s3_write, s3_seek, s3_close};
+  s3_t * u = lsx_calloc(1, sizeof(*u));
+  char const * endpoint = env("AWS_ENDPOINT_URL_S3", "AWS_ENDPOINT_URL");
+  char const * host, * host_end;
+  FILE * fp;
+
+  u->key_id = env("AWS_ACCESS_KEY_ID", NULL);
+  u->secret = env("AWS_SECRET_ACCESS_KEY", NULL);
+  u->token = env("AWS_SESSION_TOKEN", NULL);
+  u->region = env("AWS_REGION", "AWS_DEFAULT_REGION");
+  if (!u->region || !*u->region)
+    u->region = "us-east-1";
+  if (!u->key_id || !u->secret || strlen(u->secret) > 60) {
+    lsx_fail("`%s': AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY must be set", url);
+    free(u);
+    errno = EACCES;
+    return NULL;
+  }
+  if (endpoint && *endpoint)
+    u->endpoint = lsx_strdup(endpoint);
+  else {
+    u->endpoint = lsx_malloc(strlen(u->region) + 40);
+    sprintf(u->endpoint, "http://s3.%s.amazonaws.com", u->region);
+  }
+  if (strncasecmp(u->endpoint, "http://", (size_t)7) || !u->endpoint[7]) {
+    lsx_fail("`%s': the endpoint `%s' is not an http: URL", url, u->endpoint);
+    free(u->endpoint);
+    free(u);
+    errno = EPROTONOSUPPORT;
+    return NULL;
+  }
+  while (u->endpoint[strlen(u->endpoint) - 1] == '/')
+    u->endpoint[strlen(u->endpoint) - 1] = '\0';
+  host = u->endpoint + 7;                  /* Host header as http.c sends it */
+  host_end = host + strcspn(host, "/");
+  if (*host_end) {
+    lsx_fail("`%s': the endpoint `%s' must not have a path", url, u->endpoint);
+    free(u->endpoint);
+    free(u);
+    errno = EINVAL;
+    return NULL;
+  }
+  u->host = lsx_malloc((size_t)(host_end - host) + 1);
+  memcpy(u->host, host, (size_t)(host_end - host));
+  u->host[host_end - host] = '\0';
+  if (host_end - host > 3 && !strcmp(host_end - 3, ":80"))
+    u->host[host_end - host - 3] = '\0';
+  u->path = lsx_malloc(3 * strlen(url) + 2);
+  *u->path = '/';
+  uri_encode(u->path + 1, url + 5, sox_true);
+  u->first = lsx_malloc((size_t)PART_SIZE);
+  u->part_start = PART_SIZE;
+  if (!(fp = fopencookie(u, "w+b", io))) {
+    u->failed = sox_true;
+    s3_close(u);
+    return NULL;
+  }
+  lsx_debug("`%s': uploading to %s%s", url, u->endpoint, u->path);
+  return fp;
+}
+
+#else
+
+sox_bool lsx_s3_handles(char const * url)
+{
+  return !strncasecmp(url, "s3://", (size_t)5);
+}
+
+FILE * lsx_s3_open(char const * url)
+{
+  lsx_fail("this build of SoX cannot write to `%s'", url);
+  errno = EPROTONOSUPPORT;
+  return NULL;
+}
+
+#endif
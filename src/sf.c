@@ -148,7 +148,7 @@ LSX_FORMAT_HANDLER(sf)
     names, SOX_FILE_LIT_END,
     startread, lsx_rawread, NULL,
     write_header, lsx_rawwrite, NULL,
-    lsx_rawseek, write_encodings, NULL, 0
+    lsx_rawseek, write_encodings, NULL, 0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -56,11 +56,19 @@ typedef struct {
     double      *window_end;
     size_t   window_size;
     double      rms_sum;
+    double      start_level, stop_level; /* As mean-square thresholds */
 
     char        leave_silence;
 
     /* State Machine */
     char        mode;
+
+    /* -o: where the audio that would be kept is, rather than the audio */
+    char        *index_name;
+    lsx_segments_t index;
+    uint64_t    pos;              /* Input samples (not wide) so far */
+    double      start_peak, start_sum2; /* Of the holdoffs' samples */
+    double      stop_peak, stop_sum2;
 } priv_t;
 
 static void clear_rms(sox_effect_t * effp)
@@ -86,12 +94,16 @@ static int sox_silence_getopts(sox_effect_t * effp, int argc, char **argv)
 
     /* check for option switches */
     silence->leave_silence = sox_false;
-    if (argc > 0)
+    for (; argc > 0; argc--, argv++)
     {
-        if (!strcmp("-l", *argv)) {
-            argc--; argv++;
+        if (!strcmp("-l", *argv))
             silence->leave_silence = sox_true;
+        else if (!strcmp("-o", *argv) && argc > 1) {
+            argc--; argv++;
+            free(silence->index_name);
+            silence->index_name = lsx_strdup(*argv);
         }
+        else break;
     }
 
     if (argc < 1)
@@ -221,6 +233,47 @@ static int sox_silence_getopts(sox_effect_t * effp, int argc, char **argv)
     return(SOX_SUCCESS);
 }
 
+static sox_bool aboveThreshold(sox_effect_t const * effp,
+    sox_sample_t value /* >= 0 */, double threshold, int unit)
+{
+  /* When scaling low bit data, noise values got scaled way up */
+  /* Only consider the original bits when looking for silence */
+  sox_sample_t masked_value = value & (-1 << (32 - effp->in_signal.precision));
+
+  double scaled_value = (double)masked_value / SOX_SAMPLE_MAX;
+
+  if (unit == '%')
+    scaled_value *= 100;
+  else if (unit == 'd')
+    scaled_value = linear_to_dB(scaled_value);
+
+  return scaled_value > threshold;
+}
+
+/* aboveThreshold() is monotonic, so applied to the RMS of the window as it was
+ * computed (the truncated root of the mean square), is equivalent to comparing
+ * the mean square with a level; this is the least such that passes. */
+static double mean_square_level(sox_effect_t const * effp,
+    double threshold, int unit)
+{
+  sox_sample_t lo = 0, hi = SOX_SAMPLE_MAX, mid;
+  double level, next;
+
+  if (!aboveThreshold(effp, SOX_SAMPLE_MAX, threshold, unit))
+    return HUGE_VAL;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (aboveThreshold(effp, mid, threshold, unit))
+      hi = mid;
+    else lo = mid + 1;
+  }
+  for (level = (double)lo * lo; sqrt(level) < lo;)
+    level = nextafter(level, HUGE_VAL);
+  while ((next = nextafter(level, 0.)) > 0 && sqrt(next) >= lo)
+    level = next;
+  return level;
+}
+
 static int sox_silence_start(sox_effect_t * effp)
 {
     priv_t *silence = (priv_t *)effp->priv;
@@ -257,74 +310,149 @@ static int sox_silence_start(sox_effect_t * effp)
     else
         silence->mode = SILENCE_COPY;
 
-    silence->start_holdoff = lsx_malloc(sizeof(sox_sample_t)*silence->start_duration);
+    silence->start_level = mean_square_level(effp, silence->start_threshold,
+        silence->start_unit);
+    silence->stop_level = mean_square_level(effp, silence->stop_threshold,
+        silence->stop_unit);
+
+    /* A period is found no sooner than after one wide sample */
+    silence->start_holdoff = lsx_malloc(sizeof(sox_sample_t)*
+        max(silence->start_duration, effp->in_signal.channels));
     silence->start_holdoff_offset = 0;
     silence->start_holdoff_end = 0;
     silence->start_found_periods = 0;
 
-    silence->stop_holdoff = lsx_malloc(sizeof(sox_sample_t)*silence->stop_duration);
+    silence->stop_holdoff = lsx_malloc(sizeof(sox_sample_t)*
+        max(silence->stop_duration, effp->in_signal.channels));
     silence->stop_holdoff_offset = 0;
     silence->stop_holdoff_end = 0;
     silence->stop_found_periods = 0;
 
     effp->out_signal.length = SOX_UNKNOWN_LEN; /* depends on input data */
 
+    silence->pos = 0;
+    if (silence->index_name) {
+        /* Just note where the audio is, and pass it all on in place */
+        effp->out_signal.length = effp->in_signal.length;
+        effp->handler.flags |= SOX_EFF_INPLACE;
+        effp->handler.flags &= ~SOX_EFF_RTSAFE;
+        return lsx_segments_open(effp, &silence->index, silence->index_name);
+    }
     return(SOX_SUCCESS);
 }
 
-static sox_bool aboveThreshold(sox_effect_t const * effp,
-    sox_sample_t value /* >= 0 */, double threshold, int unit)
+static void update_rms(sox_effect_t * effp, sox_sample_t sample)
 {
-  /* When scaling low bit data, noise values got scaled way up */
-  /* Only consider the original bits when looking for silence */
-  sox_sample_t masked_value = value & (-1 << (32 - effp->in_signal.precision));
+    priv_t * silence = (priv_t *) effp->priv;
 
-  double scaled_value = (double)masked_value / SOX_SAMPLE_MAX;
+    silence->rms_sum -= *silence->window_current;
+    *silence->window_current = ((double)sample * (double)sample);
+    silence->rms_sum += *silence->window_current;
 
-  if (unit == '%')
-    scaled_value *= 100;
-  else if (unit == 'd')
-    scaled_value = linear_to_dB(scaled_value);
+    silence->window_current++;
+    if (silence->window_current >= silence->window_end)
+        silence->window_current = silence->window;
+}
 
-  return scaled_value > threshold;
+/* Whether the RMS of the window, were the given wide sample added to it, is
+ * above the level for any (or all) of the channels.  As ever, each channel is
+ * tested against the window less its oldest sample (not one per channel). */
+static sox_bool tick_is_above(priv_t const * silence, sox_sample_t const * ibuf,
+    unsigned channels, double level, sox_bool all)
+{
+    double old = *silence->window_current;
+    unsigned j;
+
+    for (j = 0; j < channels; j++) {
+        double sum = silence->rms_sum - old + (double)ibuf[j] * (double)ibuf[j];
+        if ((sum / silence->window_size >= level) != all)
+            return !all;
+    }
+    return all;
 }
 
-static sox_sample_t compute_rms(sox_effect_t * effp, sox_sample_t sample)
+/* Consumes, into the RMS window, wide samples from ibuf (up to n of them)
+ * while tick_is_above() gives want; returns how many. */
+static size_t scan(sox_effect_t * effp, sox_sample_t const * ibuf, size_t n,
+    double level, sox_bool all, sox_bool want)
 {
     priv_t * silence = (priv_t *) effp->priv;
-    double new_sum;
-    sox_sample_t rms;
+    unsigned j, channels = effp->in_signal.channels;
+    size_t i;
+
+    for (i = 0; i < n; i++, ibuf += channels) {
+        if (tick_is_above(silence, ibuf, channels, level, all) != want)
+            break;
+        for (j = 0; j < channels; j++)
+            update_rms(effp, ibuf[j]);
+    }
+    return i;
+}
 
-    new_sum = silence->rms_sum;
-    new_sum -= *silence->window_current;
-    new_sum += ((double)sample * (double)sample);
+/* The number of wide samples needed to fill a holdoff buffer (at least 1) */
+static size_t ticks_to_fill(size_t end, size_t duration, unsigned channels)
+{
+    return end < duration? (duration - end + channels - 1) / channels : 1;
+}
 
-    rms = sqrt(new_sum / silence->window_size);
+/* Writes n samples from ibuf to obuf at out; with -o, rather notes where
+ * in the input they are, in being how many this flow has read so far. */
+static void put(sox_effect_t * effp, sox_sample_t * obuf, size_t out,
+    sox_sample_t const * ibuf, size_t n, size_t in)
+{
+    priv_t * silence = (priv_t *) effp->priv;
+    unsigned channels = effp->in_signal.channels;
+    double peak = 0, sum2 = 0;
 
-    return (rms);
+    if (!silence->index_name) {
+        memcpy(obuf + out, ibuf, n * sizeof(*ibuf));
+        return;
+    }
+    lsx_segments_measure(ibuf, n, &peak, &sum2);
+    lsx_segments_add(&silence->index, (silence->pos + in) / channels,
+                     (silence->pos + in + n) / channels, peak, sum2);
 }
 
-static void update_rms(sox_effect_t * effp, sox_sample_t sample)
+/* Adds n samples from ibuf to a holdoff buffer, holding end of them; with
+ * -o, just measures them. */
+static void hold(sox_effect_t * effp, sox_sample_t * holdoff, size_t end,
+    double * peak, double * sum2, sox_sample_t const * ibuf, size_t n)
 {
     priv_t * silence = (priv_t *) effp->priv;
 
-    silence->rms_sum -= *silence->window_current;
-    *silence->window_current = ((double)sample * (double)sample);
-    silence->rms_sum += *silence->window_current;
+    if (!silence->index_name)
+        memcpy(holdoff + end, ibuf, n * sizeof(*ibuf));
+    else {
+        if (!end)
+            *peak = *sum2 = 0;
+        lsx_segments_measure(ibuf, n, peak, sum2);
+    }
+}
 
-    silence->window_current++;
-    if (silence->window_current >= silence->window_end)
-        silence->window_current = silence->window;
+/* Writes n samples of a holdoff buffer, from offset, to obuf at out; with
+ * -o, notes where the end samples that it holds are in the input (ending at
+ * in), all at once, as the whole buffer is then flushed at once. */
+static void flush(sox_effect_t * effp, sox_sample_t * obuf, size_t out,
+    sox_sample_t const * holdoff, size_t offset, size_t end, size_t n,
+    double peak, double sum2, size_t in)
+{
+    priv_t * silence = (priv_t *) effp->priv;
+    unsigned channels = effp->in_signal.channels;
+
+    if (!silence->index_name)
+        memcpy(obuf + out, holdoff + offset, n * sizeof(*obuf));
+    else if (!offset && end)
+        lsx_segments_add(&silence->index, (silence->pos + in - end) / channels,
+                         (silence->pos + in) / channels, peak, sum2);
 }
 
 /* Process signed long samples from ibuf to obuf. */
 /* Return number of samples processed in isamp and osamp. */
-static int sox_silence_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
                     size_t *isamp, size_t *osamp)
 {
     priv_t * silence = (priv_t *) effp->priv;
-    int threshold;
-    size_t i, j;
+    size_t i, n = 0;
     size_t nrOfTicks, /* sometimes wide, sometimes non-wide samples */
       nrOfInSamplesRead, nrOfOutSamplesWritten; /* non-wide samples */
 
@@ -345,53 +473,46 @@ silence_trim:
             nrOfTicks = min((*isamp-nrOfInSamplesRead),
                             (*osamp-nrOfOutSamplesWritten)) /
                            effp->in_signal.channels;
-            for(i = 0; i < nrOfTicks; i++)
+            for(i = 0; i < nrOfTicks; i += n / effp->in_signal.channels)
             {
-                threshold = 0;
-                for (j = 0; j < effp->in_signal.channels; j++)
-                {
-                    threshold |= aboveThreshold(effp,
-                                                compute_rms(effp, ibuf[j]),
-                                                silence->start_threshold,
-                                                silence->start_unit);
-                }
-
-                if (threshold)
+                /* Below threshold: trash any holdoff */
+                n = scan(effp, ibuf, nrOfTicks - i, silence->start_level,
+                         sox_false, sox_false) * effp->in_signal.channels;
+                if (n)
+                    silence->start_holdoff_end = 0;
+                ibuf += n;
+                nrOfInSamplesRead += n;
+                i += n / effp->in_signal.channels;
+                if (i == nrOfTicks)
+                    break;
+
+                /* Above threshold: add to holdoff buffer */
+                n = scan(effp, ibuf, min(nrOfTicks - i, ticks_to_fill(
+                             silence->start_holdoff_end,
+                             silence->start_duration,
+                             effp->in_signal.channels)),
+                         silence->start_level, sox_false, sox_true) *
+                    effp->in_signal.channels;
+                hold(effp, silence->start_holdoff, silence->start_holdoff_end,
+                     &silence->start_peak, &silence->start_sum2, ibuf, n);
+                silence->start_holdoff_end += n;
+                ibuf += n;
+                nrOfInSamplesRead += n;
+
+                if (silence->start_holdoff_end >=
+                        silence->start_duration)
                 {
-                    /* Add to holdoff buffer */
-                    for (j = 0; j < effp->in_signal.channels; j++)
-                    {
-                        update_rms(effp, *ibuf);
-                        silence->start_holdoff[
-                            silence->start_holdoff_end++] = *ibuf++;
-                        nrOfInSamplesRead++;
-                    }
-
-                    if (silence->start_holdoff_end >=
-                            silence->start_duration)
+                    if (++silence->start_found_periods >=
+                            silence->start_periods)
                     {
-                        if (++silence->start_found_periods >=
-                                silence->start_periods)
-                        {
-                            silence->mode = SILENCE_TRIM_FLUSH;
-                            goto silence_trim_flush;
-                        }
-                        /* Trash holdoff buffer since its not
-                         * needed.  Start looking again.
-                         */
-                        silence->start_holdoff_offset = 0;
-                        silence->start_holdoff_end = 0;
+                        silence->mode = SILENCE_TRIM_FLUSH;
+                        goto silence_trim_flush;
                     }
-                }
-                else /* !above Threshold */
-                {
+                    /* Trash holdoff buffer since its not
+                     * needed.  Start looking again.
+                     */
+                    silence->start_holdoff_offset = 0;
                     silence->start_holdoff_end = 0;
-                    for (j = 0; j < effp->in_signal.channels; j++)
-                    {
-                        update_rms(effp, ibuf[j]);
-                    }
-                    ibuf += effp->in_signal.channels;
-                    nrOfInSamplesRead += effp->in_signal.channels;
                 }
             } /* for nrOfTicks */
             break;
@@ -403,11 +524,12 @@ silence_trim_flush:
                              silence->start_holdoff_offset),
                              (*osamp-nrOfOutSamplesWritten));
             nrOfTicks -= nrOfTicks % effp->in_signal.channels;
-            for(i = 0; i < nrOfTicks; i++)
-            {
-                *obuf++ = silence->start_holdoff[silence->start_holdoff_offset++];
-                nrOfOutSamplesWritten++;
-            }
+            flush(effp, obuf, nrOfOutSamplesWritten, silence->start_holdoff,
+                  silence->start_holdoff_offset, silence->start_holdoff_end,
+                  nrOfTicks, silence->start_peak, silence->start_sum2,
+                  nrOfInSamplesRead);
+            silence->start_holdoff_offset += nrOfTicks;
+            nrOfOutSamplesWritten += nrOfTicks;
 
             /* If fully drained holdoff then switch to copy mode */
             if (silence->start_holdoff_offset == silence->start_holdoff_end)
@@ -465,114 +587,114 @@ silence_copy:
                            effp->in_signal.channels;
             if (silence->stop)
             {
-                /* Case A */
-                for(i = 0; i < nrOfTicks; i++)
+                /* Case A; a run of wide samples is handled at a time */
+                for(i = 0; i < nrOfTicks; i += n / effp->in_signal.channels)
                 {
-                    threshold = 1;
-                    for (j = 0; j < effp->in_signal.channels; j++)
+                    if (!silence->stop_holdoff_end || silence->leave_silence)
                     {
-                        threshold &= aboveThreshold(effp,
-                                                    compute_rms(effp, ibuf[j]),
-                                                    silence->stop_threshold,
-                                                    silence->stop_unit);
+                        /* Case 1b
+                         * Not holding off so copy above-threshold
+                         * samples into output buffer.
+                         */
+                        n = scan(effp, ibuf, nrOfTicks - i,
+                                 silence->stop_level, sox_true, sox_true) *
+                            effp->in_signal.channels;
+                        put(effp, obuf, nrOfOutSamplesWritten, ibuf, n,
+                            nrOfInSamplesRead);
+                        ibuf += n;
+                        nrOfInSamplesRead += n;
+                        nrOfOutSamplesWritten += n;
+                        i += n / effp->in_signal.channels;
+                        if (i == nrOfTicks)
+                            break;
                     }
-
                     /* Case 1a
-                     * If above threshold, check to see if we where holding
-                     * off previously.  If so then flush this buffer.
-                     * We haven't incremented any pointers yet so nothing
-                     * is lost.
+                     * If above threshold, and we were holding off
+                     * previously, then flush this buffer.  We haven't
+                     * consumed this sample yet so nothing is lost.
                      *
                      * If user wants to leave_silence, then we
                      * were already copying the data and so no
-                     * need to flush the old data.  Just resume
-                     * copying as if we were not holding off.
+                     * need to flush the old data.
                      */
-                    if (threshold && silence->stop_holdoff_end
-                        && !silence->leave_silence)
+                    else if (tick_is_above(silence, ibuf,
+                                 effp->in_signal.channels,
+                                 silence->stop_level, sox_true))
                     {
                         silence->mode = SILENCE_COPY_FLUSH;
                         goto silence_copy_flush;
                     }
-                    /* Case 1b */
-                    else if (threshold)
-                    {
-                        /* Not holding off so copy into output buffer */
-                        for (j = 0; j < effp->in_signal.channels; j++)
-                        {
-                            update_rms(effp, *ibuf);
-                            *obuf++ = *ibuf++;
-                            nrOfInSamplesRead++;
-                            nrOfOutSamplesWritten++;
-                        }
+
+                    /* Case 2
+                     * Below threshold so add to holdoff buffer (and
+                     * copy to output buffer too if leave_silence).
+                     */
+                    n = scan(effp, ibuf, min(nrOfTicks - i, ticks_to_fill(
+                                 silence->stop_holdoff_end,
+                                 silence->stop_duration,
+                                 effp->in_signal.channels)),
+                             silence->stop_level, sox_true, sox_false) *
+                        effp->in_signal.channels;
+                    if (silence->leave_silence) {
+                        put(effp, obuf, nrOfOutSamplesWritten, ibuf, n,
+                            nrOfInSamplesRead);
+                        nrOfOutSamplesWritten += n;
                     }
-                    /* Case 2 */
-                    else if (!threshold)
-                    {
-                        /* Add to holdoff buffer */
-                        for (j = 0; j < effp->in_signal.channels; j++)
-                        {
-                            update_rms(effp, *ibuf);
-                            if (silence->leave_silence) {
-                                *obuf++ = *ibuf;
-                                nrOfOutSamplesWritten++;
-                            }
-                            silence->stop_holdoff[
-                                silence->stop_holdoff_end++] = *ibuf++;
-                            nrOfInSamplesRead++;
-                        }
+                    hold(effp, silence->stop_holdoff, silence->stop_holdoff_end,
+                         &silence->stop_peak, &silence->stop_sum2, ibuf, n);
+                    silence->stop_holdoff_end += n;
+                    ibuf += n;
+                    nrOfInSamplesRead += n;
 
-                        /* Check if holdoff buffer is greater than duration
+                    /* Check if holdoff buffer is greater than duration
+                     */
+                    if (silence->stop_holdoff_end >=
+                            silence->stop_duration)
+                    {
+                        /* Increment found counter and see if this
+                         * is the last period.  If so then exit.
                          */
-                        if (silence->stop_holdoff_end >=
-                                silence->stop_duration)
+                        if (++silence->stop_found_periods >=
+                                silence->stop_periods)
                         {
-                            /* Increment found counter and see if this
-                             * is the last period.  If so then exit.
-                             */
-                            if (++silence->stop_found_periods >=
-                                    silence->stop_periods)
+                            silence->stop_holdoff_offset = 0;
+                            silence->stop_holdoff_end = 0;
+                            if (!silence->restart)
                             {
-                                silence->stop_holdoff_offset = 0;
-                                silence->stop_holdoff_end = 0;
-                                if (!silence->restart)
-                                {
-                                    *isamp = nrOfInSamplesRead;
-                                    *osamp = nrOfOutSamplesWritten;
-                                    silence->mode = SILENCE_STOP;
-                                    /* Return SOX_EOF since no more processing */
-                                    return (SOX_EOF);
-                                }
-                                else
-                                {
-                                    silence->stop_found_periods = 0;
-                                    silence->start_found_periods = 0;
-                                    silence->start_holdoff_offset = 0;
-                                    silence->start_holdoff_end = 0;
-                                    clear_rms(effp);
-                                    silence->mode = SILENCE_TRIM;
-
-                                    goto silence_trim;
-                                }
+                                *isamp = nrOfInSamplesRead;
+                                *osamp = nrOfOutSamplesWritten;
+                                silence->mode = SILENCE_STOP;
+                                /* Return SOX_EOF since no more processing */
+                                return (SOX_EOF);
                             }
                             else
                             {
-                                /* Flush this buffer and start
-                                 * looking again.
-                                 */
-                                silence->mode = SILENCE_COPY_FLUSH;
-                                goto silence_copy_flush;
+                                silence->stop_found_periods = 0;
+                                silence->start_found_periods = 0;
+                                silence->start_holdoff_offset = 0;
+                                silence->start_holdoff_end = 0;
+                                clear_rms(effp);
+                                silence->mode = SILENCE_TRIM;
+
+                                goto silence_trim;
                             }
-                            break;
-                        } /* Filled holdoff buffer */
-                    } /* Detected silence */
+                        }
+                        else
+                        {
+                            /* Flush this buffer and start
+                             * looking again.
+                             */
+                            silence->mode = SILENCE_COPY_FLUSH;
+                            goto silence_copy_flush;
+                        }
+                    } /* Filled holdoff buffer */
                 } /* For # of samples */
             } /* Trimming off backend */
             else /* !(silence->stop) */
             {
                 /* Case B */
-                memcpy(obuf, ibuf, sizeof(sox_sample_t)*nrOfTicks*
-                                   effp->in_signal.channels);
+                put(effp, obuf, nrOfOutSamplesWritten, ibuf,
+                    nrOfTicks * effp->in_signal.channels, nrOfInSamplesRead);
                 nrOfInSamplesRead += (nrOfTicks*effp->in_signal.channels);
                 nrOfOutSamplesWritten += (nrOfTicks*effp->in_signal.channels);
             }
@@ -585,12 +707,12 @@ silence_copy_flush:
                                 silence->stop_holdoff_offset),
                             (*osamp-nrOfOutSamplesWritten));
             nrOfTicks -= nrOfTicks % effp->in_signal.channels;
-
-            for(i = 0; i < nrOfTicks; i++)
-            {
-                *obuf++ = silence->stop_holdoff[silence->stop_holdoff_offset++];
-                nrOfOutSamplesWritten++;
-            }
+            flush(effp, obuf, nrOfOutSamplesWritten, silence->stop_holdoff,
+                  silence->stop_holdoff_offset, silence->stop_holdoff_end,
+                  nrOfTicks, silence->stop_peak, silence->stop_sum2,
+                  nrOfInSamplesRead);
+            silence->stop_holdoff_offset += nrOfTicks;
+            nrOfOutSamplesWritten += nrOfTicks;
 
             /* If fully drained holdoff then return to copy mode */
             if (silence->stop_holdoff_offset == silence->stop_holdoff_end)
@@ -614,10 +736,33 @@ silence_copy_flush:
         return (SOX_SUCCESS);
 }
 
-static int sox_silence_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
+/* With -o, passes all of its input on, whilst the flow above only notes
+ * where in it is the audio that it would pass on */
+static int sox_silence_flow(sox_effect_t * effp, const sox_sample_t *ibuf,
+    sox_sample_t *obuf, size_t *isamp, size_t *osamp)
+{
+    priv_t * silence = (priv_t *) effp->priv;
+    size_t n = min(*isamp, *osamp), done, in, out;
+
+    if (!silence->index_name)
+        return flow(effp, ibuf, obuf, isamp, osamp);
+    n -= n % effp->in_signal.channels;
+    if (obuf != ibuf) /* Pass on audio unaffected */
+        memcpy(obuf, ibuf, n * sizeof(*obuf));
+    *isamp = *osamp = n;
+    for (done = 0; done < n && silence->mode != SILENCE_STOP; done += in) {
+        in = n - done, out = SIZE_MAX;
+        flow(effp, ibuf + done, NULL, &in, &out);
+        silence->pos += in;
+        if (!in && silence->mode != SILENCE_STOP)
+            break;
+    }
+    return SOX_SUCCESS;
+}
+
+static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
     priv_t * silence = (priv_t *) effp->priv;
-    size_t i;
     size_t nrOfTicks, nrOfOutSamplesWritten = 0; /* non-wide samples */
 
     /* Only if in flush mode will there be possible samples to write
@@ -629,11 +774,11 @@ static int sox_silence_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *os
         nrOfTicks = min((silence->stop_holdoff_end -
                             silence->stop_holdoff_offset), *osamp);
         nrOfTicks -= nrOfTicks % effp->in_signal.channels;
-        for(i = 0; i < nrOfTicks; i++)
-        {
-            *obuf++ = silence->stop_holdoff[silence->stop_holdoff_offset++];
-            nrOfOutSamplesWritten++;
-        }
+        flush(effp, obuf, (size_t)0, silence->stop_holdoff,
+              silence->stop_holdoff_offset, silence->stop_holdoff_end,
+              nrOfTicks, silence->stop_peak, silence->stop_sum2, (size_t)0);
+        silence->stop_holdoff_offset += nrOfTicks;
+        nrOfOutSamplesWritten = nrOfTicks;
 
         /* If fully drained holdoff then stop */
         if (silence->stop_holdoff_offset == silence->stop_holdoff_end)
@@ -651,15 +796,31 @@ static int sox_silence_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *os
         return SOX_SUCCESS;
 }
 
+static int sox_silence_drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
+{
+    priv_t * silence = (priv_t *) effp->priv;
+    size_t n = SIZE_MAX;
+
+    if (!silence->index_name)
+        return drain(effp, obuf, osamp);
+    drain(effp, NULL, &n);
+    *osamp = 0;
+    return SOX_EOF;
+}
+
 static int sox_silence_stop(sox_effect_t * effp)
 {
   priv_t * silence = (priv_t *) effp->priv;
+  int result = SOX_SUCCESS;
+
+  if (silence->index_name && silence->index.file)
+    result = lsx_segments_close(effp, &silence->index);
 
   free(silence->window);
   free(silence->start_holdoff);
   free(silence->stop_holdoff);
 
-  return(SOX_SUCCESS);
+  return result;
 }
 
 static int lsx_kill(sox_effect_t * effp)
@@ -668,20 +829,21 @@ static int lsx_kill(sox_effect_t * effp)
 
   free(silence->start_duration_str);
   free(silence->stop_duration_str);
+  free(silence->index_name);
 
   return SOX_SUCCESS;
 }
 
 static sox_effect_handler_t sox_silence_effect = {
   "silence",
-  "[ -l ] above_periods [ duration threshold[d|%] ] [ below_periods duration threshold[d|%] ]",
-  SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_LENGTH,
+  "[ -l ] [ -o index-file ] above_periods [ duration threshold[d|%] ] [ below_periods duration threshold[d|%] ]",
+  SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_LENGTH | SOX_EFF_RTSAFE,
   sox_silence_getopts,
   sox_silence_start,
   sox_silence_flow,
   sox_silence_drain,
   sox_silence_stop,
-  lsx_kill, sizeof(priv_t)
+  lsx_kill, sizeof(priv_t), NULL, NULL, NULL, NULL
 };
 
 const sox_effect_handler_t *lsx_silence_effect_fn(void)
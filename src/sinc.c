@@ -36,6 +36,7 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
   lsx_getopt_init(argc, argv, "+ra:b:p:MILt:n:", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   b->filter_ptr = &b->filter;
+  b->cheap_ptr = &b->cheap_filter;
   p->phase = 50;
   p->beta = -1;
   while (i < 2) {
@@ -97,30 +98,34 @@ static double * lpf(double Fn, double Fc, double tbw, int * num_taps, double att
   return lsx_make_lpf(*num_taps |= 1, Fc, *beta, 0., 1., sox_false);
 }
 
-static int start(sox_effect_t * effp)
+/* Designs the filter into f (or has it from the design cache), with the
+ * transition bands tbw (0: 5% of the Nyquist frequency), or the lengths
+ * num_taps (0: as tbw needs), given */
+static int design(sox_effect_t * effp, dft_filter_t * f, double const * tbw,
+    int * num_taps)
 {
   priv_t * p = (priv_t *)effp->priv;
-  dft_filter_t * f = p->base.filter_ptr;
-
-  if (!f->num_taps) {
-    double Fn = effp->in_signal.rate * .5;
-    double * h[2];
-    int i, n, post_peak, longer;
+  double Fn = effp->in_signal.rate * .5;
+  double * h[2], key[11];
+  double const * design = NULL;
+  int i, n, post_peak, longer;
 
-    if (p->Fc0 >= Fn || p->Fc1 >= Fn) {
-      lsx_fail("filter frequency must be less than sample-rate / 2");
-      return SOX_EOF;
-    }
-    h[0] = lpf(Fn, p->Fc0, p->tbw0, &p->num_taps[0], p->att, &p->beta,p->round);
-    h[1] = lpf(Fn, p->Fc1, p->tbw1, &p->num_taps[1], p->att, &p->beta,p->round);
+  key[0] = Fn, key[1] = p->Fc0, key[2] = p->Fc1, key[3] = tbw[0];
+  key[4] = tbw[1], key[5] = num_taps[0], key[6] = num_taps[1];
+  key[7] = p->att, key[8] = p->beta, key[9] = p->phase, key[10] = p->round;
+  if (effp->global_info->plot == sox_plot_off)
+    design = lsx_design_get("sinc", key, 11, &n, &post_peak);
+  if (!design) {
+    h[0] = lpf(Fn, p->Fc0, tbw[0], &num_taps[0], p->att, &p->beta, p->round);
+    h[1] = lpf(Fn, p->Fc1, tbw[1], &num_taps[1], p->att, &p->beta, p->round);
     if (h[0])
-      invert(h[0], p->num_taps[0]);
+      invert(h[0], num_taps[0]);
 
-    longer = p->num_taps[1] > p->num_taps[0];
-    n = p->num_taps[longer];
+    longer = num_taps[1] > num_taps[0];
+    n = num_taps[longer];
     if (h[0] && h[1]) {
-      for (i = 0; i < p->num_taps[!longer]; ++i)
-        h[longer][i + (n - p->num_taps[!longer])/2] += h[!longer][i];
+      for (i = 0; i < num_taps[!longer]; ++i)
+        h[longer][i + (n - num_taps[!longer])/2] += h[!longer][i];
 
       if (p->Fc0 < p->Fc1)
         invert(h[longer], n);
@@ -139,7 +144,39 @@ static int start(sox_effect_t * effp)
           effp->global_info->plot, title, -p->beta * 10 - 25, 5.);
       return SOX_EOF;
     }
-    lsx_set_dft_filter(f, h[longer], n, post_peak);
+    design = lsx_design_put("sinc", key, 11, h[longer], n, post_peak);
+  }
+  lsx_set_dft_filter_design(f, design, n, post_peak);
+  return SOX_SUCCESS;
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  sox_context_t const * context = effp->global_info->global_info;
+  dft_filter_t * f = p->base.filter_ptr;
+
+  if (!f->num_taps) {
+    double Fn = effp->in_signal.rate * .5, tbw[2] = {p->tbw0, p->tbw1};
+    int i, num_taps[2];
+
+    if (p->Fc0 >= Fn || p->Fc1 >= Fn) {
+      lsx_fail("filter frequency must be less than sample-rate / 2");
+      return SOX_EOF;
+    }
+    /* For the governor, a linear-phase filter has a cheaper one too, with
+     * transition bands 4 times as wide (or a quarter of the taps): */
+    if (context->governor && context->chain_mode == SOX_CHAIN_REALTIME &&
+        p->phase == 50 && effp->global_info->plot == sox_plot_off) {
+      double wide[2];
+      for (i = 0; i < 2; ++i) {
+        num_taps[i] = p->num_taps[i]? max(p->num_taps[i] / 4, 11) : 0;
+        wide[i] = num_taps[i]? 0 : 4 * (tbw[i]? tbw[i] : Fn * .05);
+      }
+      design(effp, p->base.cheap_ptr, wide, num_taps);
+    }
+    if (design(effp, f, tbw, p->num_taps) != SOX_SUCCESS)
+      return SOX_EOF;
   }
   return lsx_dft_filter_effect_fn()->start(effp);
 }
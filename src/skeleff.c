@@ -135,7 +135,8 @@ const sox_effect_handler_t *lsx_skel_effect_fn(void)
    */
   static sox_effect_handler_t sox_skel_effect = {
     "skel", "[OPTION]", SOX_EFF_MCHAN,
-    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &sox_skel_effect;
 }
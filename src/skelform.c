@@ -211,7 +211,7 @@ LSX_FORMAT_HANDLER(skel)
     names, 0,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    seek, encodings, NULL, sizeof(priv_t)
+    seek, encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
 
   return &handler;
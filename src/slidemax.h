@@ -0,0 +1,76 @@
+/* Sliding-window maximum
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* The maximum of the last `window' values pushed, in constant (amortised)
+ * time per value whatever the window's length: a monotonic deque holds only
+ * those values that may yet be the maximum (each greater than all those
+ * pushed after it), oldest first, in a ring of 2^n slots.  A value leaves at
+ * the back when a greater one arrives, or at the front when it falls out of
+ * the window; so each value is handled at most twice.  For a minimum, push
+ * negated values. */
+
+#ifndef slidemax_included
+#define slidemax_included
+
+typedef struct {
+  double * value;
+  uint64_t * at;        /* When each value was pushed */
+  size_t mask;          /* Slots, less 1 */
+  size_t head, tail;    /* The deque: slots head to tail - 1 (mod mask + 1) */
+  uint64_t now, window;
+} slidemax_t;
+
+UNUSED static void slidemax_clear(slidemax_t * s)
+{
+  s->head = s->tail = 0;
+  s->now = 0;
+}
+
+UNUSED static void slidemax_create(slidemax_t * s, size_t window)
+{
+  size_t n = 1;
+
+  while (n < window + 1)
+    n <<= 1;
+  s->value = lsx_malloc(n * sizeof(*s->value));
+  s->at = lsx_malloc(n * sizeof(*s->at));
+  s->mask = n - 1;
+  s->window = window? window : 1;
+  slidemax_clear(s);
+}
+
+UNUSED static void slidemax_delete(slidemax_t * s)
+{
+  free(s->value);
+  free(s->at);
+}
+
+/* Pushes x; returns the maximum of it and the window - 1 values before it */
+UNUSED static double slidemax_push(slidemax_t * s, double x)
+{
+  size_t m = s->mask;
+
+  while (s->tail != s->head && s->value[(s->tail - 1) & m] <= x)
+    --s->tail;
+  s->value[s->tail & m] = x;
+  s->at[s->tail++ & m] = s->now;
+  if (s->now++ - s->at[s->head & m] >= s->window)
+    ++s->head;
+  return s->value[s->head & m];
+}
+
+#endif
@@ -412,7 +412,7 @@ LSX_FORMAT_HANDLER(smp)
     "Turtle Beach SampleVision", names, SOX_FILE_LIT_END | SOX_FILE_MONO,
     sox_smpstartread, sox_smpread, NULL,
     sox_smpstartwrite, sox_smpwrite, sox_smpstopwrite,
-    sox_smpseek, write_encodings, NULL, sizeof(priv_t)
+    sox_smpseek, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
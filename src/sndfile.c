@@ -492,7 +492,7 @@ static int stopwrite(sox_format_t * ft)
 static int seek(sox_format_t * ft, uint64_t offset)
 {
   priv_t * sf = (priv_t *)ft->priv;
-  sf->sf_seek(sf->sf_file, (sf_count_t)(offset / ft->signal.channels), SEEK_CUR);
+  sf->sf_seek(sf->sf_file, (sf_count_t)(offset / ft->signal.channels), SEEK_SET);
   return SOX_SUCCESS;
 }
 
@@ -535,7 +535,7 @@ LSX_FORMAT_HANDLER(sndfile)
     "Pseudo format to use libsndfile", names, 0,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    seek, write_encodings, NULL, sizeof(priv_t)
+    seek, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
 
   return &format;
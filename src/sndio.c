@@ -236,7 +236,7 @@ LSX_FORMAT_HANDLER(sndio)
     startread, readsamples, stopany,
     startwrite, writesamples, stopany,
     NULL, write_encodings, NULL,
-    sizeof(struct sndio_priv)
+    sizeof(struct sndio_priv), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
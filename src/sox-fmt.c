@@ -15,16 +15,249 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define _GNU_SOURCE /* For memfd_create */
 #include "sox_i.h"
 #include <string.h>
 
 static char const magic[2][4] = {".SoX", "XoS."};
 #define FIXED_HDR     (4 + 8 + 8 + 4 + 4) /* Without magic */
+#define FLOAT_SAMPLES 0x10000 /* In the channels word: samples are float32 */
+#define RECORD_HDR    (4 + 4) /* Tag, bytes; then bytes (a multiple of 8) */
+
+#if defined HAVE_MEMFD_CREATE && defined __linux__ && defined __ATOMIC_SEQ_CST
+#define HAVE_SHM_RING 1
+
+/* Between sox processes joined by a pipe (sox ... -p | sox - ...), the audio
+ * may go instead through a ring in memory that both map.  The writer offers
+ * the ring (a memfd) in a header record giving its pid and descriptor; a
+ * reader that can open it through /proc says that it has attached, and the
+ * writer, once it sees this, closes its end of the pipe and goes on in the
+ * ring.  The reader takes the pipe to its end before turning to the ring, so
+ * nothing is lost or reordered however the two race, and a reader that does
+ * not attach (an older sox, another program, a file) just reads the pipe.
+ * Either side sleeps on a futex in the ring when it must wait for the other,
+ * checking now and then that the other has not died. */
+
+#include "ringbuf.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define SHM_TAG     0x6d687331 /* "shm1" */
+#define SHM_RECORD  (4 + 4 + 8)  /* pid, fd, token */
+#define SHM_BYTES   ((size_t)1 << 20)
+#define SHM_POLL_NS 100000000L
+
+enum {to_reader, to_writer}; /* Who waits, on seq[]; whose peer is gone[] */
+
+typedef struct {
+  uint64_t token;       /* As in the offer, lest that be stale */
+  uint32_t reader;      /* The reader's pid, once it has attached */
+  uint32_t gone[2];     /* The writer has finished; the reader has */
+  uint32_t waiting[2];  /* The reader/writer may be asleep on seq[] */
+  uint32_t seq[2];      /* Bumped on data for the reader/space for the writer */
+  char pad[RINGBUF_LINE - 8 - 7 * 4];
+  ringbuf_index_t head; /* Bytes ever written */
+  ringbuf_index_t tail; /* Bytes ever read */
+} shm_t;
+
+typedef struct {
+  shm_t * shm;          /* Mapped, once offered (writer) or attached (reader) */
+  int fd;               /* The writer's memfd */
+  pid_t peer;
+  sox_bool in_ring;     /* Writer: has left the pipe; reader: pipe is done */
+  sox_bool gone;        /* The ring is finished with */
+} priv_t;
+
+static uint32_t shm_load(uint32_t const * p)
+{
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+static void shm_store(uint32_t * p, uint32_t x)
+{
+  __atomic_store_n(p, x, __ATOMIC_SEQ_CST);
+}
+
+/* Wake the side that may be waiting for what has just been published */
+static void shm_signal(shm_t * s, int side)
+{
+  __atomic_add_fetch(&s->seq[side], 1, __ATOMIC_SEQ_CST);
+  if (shm_load(&s->waiting[side]))
+    syscall((long)SYS_futex, &s->seq[side], FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/* Sleep until *index moves from was, or the peer finishes; false if the
+ * peer has died */
+static sox_bool shm_await(shm_t * s, int side, size_t * index, size_t was,
+    pid_t peer)
+{
+  struct timespec t = {0, SHM_POLL_NS};
+  uint32_t seen = shm_load(&s->seq[side]);
+  sox_bool alive = sox_true;
+
+  shm_store(&s->waiting[side], 1);
+  if (__atomic_load_n(index, __ATOMIC_SEQ_CST) == was &&
+      !shm_load(&s->gone[side]) &&
+      syscall((long)SYS_futex, &s->seq[side], FUTEX_WAIT, seen, &t, NULL, 0) &&
+      errno == ETIMEDOUT)
+    alive = kill(peer, 0) == 0 || errno != ESRCH;
+  shm_store(&s->waiting[side], 0);
+  return alive;
+}
+
+static size_t shm_write(priv_t * p, char const * buf, size_t len)
+{
+  shm_t * s = p->shm;
+  char * data = (char *)(s + 1);
+  size_t done = 0, head = s->head.value;
+
+  while (done < len && !shm_load(&s->gone[to_writer])) {
+    size_t tail = ringbuf_load(&s->tail.value), at = head & (SHM_BYTES - 1);
+    size_t n = min(SHM_BYTES - (head - tail), len - done), n1;
+
+    if (!n) {
+      if (!shm_await(s, to_writer, &s->tail.value, tail, p->peer))
+        break;
+      continue;
+    }
+    n1 = min(n, SHM_BYTES - at);
+    memcpy(data + at, buf + done, n1);
+    memcpy(data, buf + done + n1, n - n1);
+    __atomic_store_n(&s->head.value, head += n, __ATOMIC_SEQ_CST);
+    shm_signal(s, to_reader);
+    done += n;
+  }
+  return done;
+}
+
+static size_t shm_read(priv_t * p, char * buf, size_t len)
+{
+  shm_t * s = p->shm;
+  char const * data = (char const *)(s + 1);
+  size_t done = 0, tail = s->tail.value;
+
+  while (done < len && !p->gone) {
+    size_t head = ringbuf_load(&s->head.value), at = tail & (SHM_BYTES - 1);
+    size_t n = min(head - tail, len - done), n1;
+
+    if (!n) {
+      if (shm_load(&s->gone[to_reader]) &&
+          __atomic_load_n(&s->head.value, __ATOMIC_SEQ_CST) == tail)
+        p->gone = sox_true;
+      else if (!shm_await(s, to_reader, &s->head.value, head, p->peer))
+        p->gone = sox_true;
+      continue;
+    }
+    n1 = min(n, SHM_BYTES - at);
+    memcpy(buf + done, data + at, n1);
+    memcpy(buf + done + n1, data, n - n1);
+    __atomic_store_n(&s->tail.value, tail += n, __ATOMIC_SEQ_CST);
+    shm_signal(s, to_writer);
+    done += n;
+  }
+  return done;
+}
+
+static sox_bool is_fifo(sox_format_t * ft)
+{
+  struct stat st;
+
+  return ft->fp && !ft->seekable && !ft->encoding.reverse_bytes &&
+    !fstat(fileno((FILE *)ft->fp), &st) && S_ISFIFO(st.st_mode);
+}
+
+static shm_t * shm_map(int fd)
+{
+  void * m = mmap(NULL, sizeof(shm_t) + SHM_BYTES, PROT_READ | PROT_WRITE,
+      MAP_SHARED, fd, (off_t)0);
+  return m == MAP_FAILED? NULL : m;
+}
+
+/* Writer: make a ring to offer, if the output is a pipe */
+static void shm_offer(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  if (p->shm || !is_fifo(ft) ||
+      (p->fd = memfd_create("sox", MFD_CLOEXEC)) < 0)
+    return;
+  if (ftruncate(p->fd, (off_t)(sizeof(shm_t) + SHM_BYTES)) ||
+      !(p->shm = shm_map(p->fd))) {
+    close(p->fd);
+    p->fd = -1;
+    return;
+  }
+  p->shm->token = (uint64_t)time(NULL) << 32 ^ (uint64_t)getpid() << 16 ^
+    (uint64_t)(size_t)p->shm ^ (uint64_t)clock();
+}
+
+/* Reader: attach to an offered ring, if the input is a pipe from it */
+static void shm_attach(sox_format_t * ft, uint32_t pid, uint32_t fd,
+    uint64_t token)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  char name[40];
+  struct stat st;
+  int f;
+
+  if (p->shm || !is_fifo(ft))
+    return;
+  sprintf(name, "/proc/%u/fd/%u", pid, fd);
+  if ((f = open(name, O_RDWR | O_CLOEXEC)) < 0)
+    return;
+  if (!fstat(f, &st) && st.st_size == (off_t)(sizeof(shm_t) + SHM_BYTES) &&
+      (p->shm = shm_map(f)) != NULL) {
+    if (p->shm->token == token) {
+      p->peer = (pid_t)pid;
+      shm_store(&p->shm->reader, (uint32_t)getpid());
+      lsx_debug("attached to the ring of process %u", pid);
+    } else {
+      munmap(p->shm, sizeof(shm_t) + SHM_BYTES);
+      p->shm = NULL;
+    }
+  }
+  close(f);
+}
+
+static void shm_release(priv_t * p, int side)
+{
+  shm_store(&p->shm->gone[side], 1);
+  shm_signal(p->shm, side);
+  munmap(p->shm, sizeof(shm_t) + SHM_BYTES);
+  p->shm = NULL;
+}
+
+/* Writer: leave the pipe, if the reader has attached */
+static void shm_handover(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  int null;
+
+  if (ft->io_async || !shm_load(&p->shm->reader) || lsx_flush(ft) ||
+      (null = open("/dev/null", O_WRONLY)) < 0)
+    return;
+  if (dup2(null, fileno((FILE *)ft->fp)) >= 0) { /* The reader gets EOF */
+    p->peer = (pid_t)shm_load(&p->shm->reader);
+    p->in_ring = sox_true;
+    lsx_debug("writing to the ring of process %u", (unsigned)p->peer);
+  }
+  close(null);
+}
+
+#define PRIV_SIZE sizeof(priv_t)
+#endif
 
 static int startread(sox_format_t * ft)
 {
   char     magic_[sizeof(magic[0])];
-  uint32_t headers_bytes, num_channels, comments_bytes;
+  uint32_t headers_bytes, num_channels, comments_bytes, rest, tag, bytes;
   uint64_t num_samples;
   double   rate;
 
@@ -47,7 +280,7 @@ static int startread(sox_format_t * ft)
     return SOX_EOF;
 
   if (((headers_bytes + 4) & 7) || headers_bytes < FIXED_HDR + comments_bytes ||
-      (num_channels > 65535)) /* Reserve top 16 bits */ {
+      (num_channels & ~(FLOAT_SAMPLES | 65535))) /* Reserve top 15 bits */ {
     lsx_fail_errno(ft, SOX_EHDR, "invalid sox file format header");
     return SOX_EOF;
   }
@@ -63,12 +296,37 @@ static int startread(sox_format_t * ft)
   }
   
   /* Consume any bytes after the comments and before the start of the audio
-   * block.  These may include comment padding up to a multiple of 8 bytes,
-   * and further header information that might be defined in future. */
-  lsx_seeki(ft, (off_t)(headers_bytes - FIXED_HDR - comments_bytes), SEEK_CUR);
+   * block.  These are comment padding up to a multiple of 8 bytes, then
+   * records (each a tag, a byte count, and that many bytes) of further
+   * header information; those not known here are skipped. */
+  rest = headers_bytes - FIXED_HDR - comments_bytes;
+  lsx_seeki(ft, (off_t)(rest & 7), SEEK_CUR);
+  for (rest &= ~7u; rest >= RECORD_HDR; rest -= RECORD_HDR + bytes) {
+    if (lsx_readdw(ft, &tag) || lsx_readdw(ft, &bytes))
+      return SOX_EOF;
+    if (bytes > rest - RECORD_HDR) {
+      lsx_fail_errno(ft, SOX_EHDR, "invalid sox file format header");
+      return SOX_EOF;
+    }
+#ifdef HAVE_SHM_RING
+    if (tag == SHM_TAG && bytes >= SHM_RECORD) {
+      uint32_t pid, fd;
+      uint64_t token;
+      if (lsx_readdw(ft, &pid) || lsx_readdw(ft, &fd) ||
+          lsx_readqw(ft, &token))
+        return SOX_EOF;
+      shm_attach(ft, pid, fd, token);
+      lsx_seeki(ft, (off_t)(bytes - SHM_RECORD), SEEK_CUR);
+      continue;
+    }
+#endif
+    lsx_seeki(ft, (off_t)bytes, SEEK_CUR);
+  }
+  lsx_seeki(ft, (off_t)rest, SEEK_CUR);
 
-  return lsx_check_read_params(
-      ft, num_channels, rate, SOX_ENCODING_SIGN2, 32, num_samples, sox_true);
+  return lsx_check_read_params(ft, num_channels & 65535, rate,
+      num_channels & FLOAT_SAMPLES? SOX_ENCODING_FLOAT : SOX_ENCODING_SIGN2,
+      32, num_samples, sox_true);
 }
 
 static int write_header(sox_format_t * ft)
@@ -76,31 +334,124 @@ static int write_header(sox_format_t * ft)
   char * comments  = lsx_cat_comments(ft->oob.comments);
   size_t comments_len = strlen(comments);
   size_t comments_bytes = (comments_len + 7) & ~7u; /* Multiple of 8 bytes */
+  size_t records_bytes = 0;
   uint64_t size   = ft->olength? ft->olength : ft->signal.length;
   int error;
   uint32_t header;
+#ifdef HAVE_SHM_RING
+  priv_t * p = (priv_t *)ft->priv;
+
+  shm_offer(ft);
+  if (p->shm)
+    records_bytes += RECORD_HDR + SHM_RECORD;
+#endif
   memcpy(&header, magic[MACHINE_IS_BIGENDIAN], sizeof(header));
   error = 0
   ||lsx_writedw(ft, header)
-  ||lsx_writedw(ft, FIXED_HDR + (unsigned)comments_bytes)
+  ||lsx_writedw(ft, FIXED_HDR + (unsigned)(comments_bytes + records_bytes))
   ||lsx_writeqw(ft, size)
   ||lsx_writedf(ft, ft->signal.rate)
-  ||lsx_writedw(ft, ft->signal.channels)
+  ||lsx_writedw(ft, ft->signal.channels |
+      (ft->encoding.encoding == SOX_ENCODING_FLOAT? FLOAT_SAMPLES : 0))
   ||lsx_writedw(ft, (unsigned)comments_len)
   ||lsx_writechars(ft, comments, comments_len)
   ||lsx_padbytes(ft, comments_bytes - comments_len);
+#ifdef HAVE_SHM_RING
+  if (p->shm)
+    error = error
+    ||lsx_writedw(ft, SHM_TAG)
+    ||lsx_writedw(ft, SHM_RECORD)
+    ||lsx_writedw(ft, (unsigned)getpid())
+    ||lsx_writedw(ft, (unsigned)p->fd)
+    ||lsx_writeqw(ft, p->shm->token);
+#endif
   free(comments);
   return error? SOX_EOF: SOX_SUCCESS;
 }
 
+#ifdef HAVE_SHM_RING
+#define SHM_CHUNK 2048
+
+static size_t read_samples(sox_format_t * ft, sox_sample_t * buf, size_t len)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t i, n, done;
+
+  if (!p->shm || !p->in_ring) {
+    if ((n = lsx_rawread(ft, buf, len)) || !p->shm)
+      return n;
+    p->in_ring = sox_true; /* The pipe has ended */
+  }
+  if (ft->encoding.encoding != SOX_ENCODING_FLOAT)
+    return shm_read(p, (char *)buf, len * sizeof(*buf)) / sizeof(*buf);
+  for (done = 0; done < len; done += n) {
+    float f[SHM_CHUNK];
+    n = shm_read(p, (char *)f, min(len - done, SHM_CHUNK) * sizeof(*f));
+    if (!(n /= sizeof(*f)))
+      break;
+    for (i = 0; i < n; ++i) {
+      SOX_SAMPLE_LOCALS;
+      buf[done + i] = SOX_FLOAT_32BIT_TO_SAMPLE(f[i], ft->clips);
+    }
+  }
+  return done;
+}
+
+static size_t write_samples(sox_format_t * ft, sox_sample_t const * buf,
+    size_t len)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t i, n, done;
+
+  if (p->shm && !p->in_ring)
+    shm_handover(ft);
+  if (!p->in_ring)
+    return lsx_rawwrite(ft, buf, len);
+  if (ft->encoding.encoding != SOX_ENCODING_FLOAT)
+    done = shm_write(p, (char const *)buf, len * sizeof(*buf)) / sizeof(*buf);
+  else for (done = 0; done < len; done += n) {
+    float f[SHM_CHUNK];
+    n = min(len - done, SHM_CHUNK);
+    for (i = 0; i < n; ++i) {
+      SOX_SAMPLE_LOCALS;
+      f[i] = SOX_SAMPLE_TO_FLOAT_32BIT(buf[done + i], ft->clips);
+    }
+    if ((n = shm_write(p, (char const *)f, n * sizeof(*f)) / sizeof(*f)) == 0)
+      break;
+  }
+  if (done < len) {            /* As if the pipe were broken */
+    raise(SIGPIPE);
+    lsx_fail_errno(ft, EPIPE, "the reader has gone");
+  }
+  return done;
+}
+
+static int stop(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  if (p->shm)
+    shm_release(p, ft->mode == 'r'? to_writer : to_reader);
+  if (ft->mode == 'w' && p->fd > 0)
+    close(p->fd);
+  return SOX_SUCCESS;
+}
+#else
+#define read_samples  lsx_rawread
+#define write_samples lsx_rawwrite
+#define stop          NULL
+#define PRIV_SIZE     0
+#endif
+
 LSX_FORMAT_HANDLER(sox)
 {
   static char const * const names[] = {"sox", NULL};
-  static unsigned const write_encodings[] = {SOX_ENCODING_SIGN2, 32, 0, 0};
+  static unsigned const write_encodings[] = {
+    SOX_ENCODING_SIGN2, 32, 0, SOX_ENCODING_FLOAT, 32, 0, 0};
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
     "SoX native intermediate format", names, SOX_FILE_REWIND, 
-    startread, lsx_rawread, NULL, write_header, lsx_rawwrite, NULL,
-    lsx_rawseek, write_encodings, NULL, 0
+    startread, read_samples, stop, write_header, write_samples, stop,
+    lsx_rawseek, write_encodings, NULL, PRIV_SIZE, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -21,9 +21,11 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _GNU_SOURCE /* For sched_setaffinity */
 #include "soxconfig.h"
 #include "sox.h"
 #include "util.h"
+#include "soxomp.h"
 
 #include <ctype.h>
 #include <errno.h>
@@ -84,6 +86,28 @@
   #include <unistd.h>
 #endif
 
+#if defined HAVE_FORK && defined HAVE_SYS_WAIT_H
+  #include <sys/wait.h>
+  #define HAVE_BATCH 1
+#endif
+
+#if defined HAVE_BATCH && defined HAVE_SYS_SOCKET_H && defined HAVE_SYS_UN_H
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #define HAVE_DAEMON 1
+#endif
+
+#if defined HAVE_BATCH && defined HAVE_SCHED_SETAFFINITY && defined __linux__
+  #include <sched.h>
+  #define HAVE_BATCH_NUMA 1
+#endif
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+  #define HAVE_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 #ifdef HAVE_GETTIMEOFDAY
   #define TIME_FRAC 1e6
 #else
@@ -134,6 +158,29 @@ static lsx_enum_item const rg_modes[] = {
   {0, 0}};
 static rg_mode replay_gain_mode = RG_default;
 static sox_option_t show_progress = sox_option_default;
+static sox_bool show_profile = sox_false; /* --profile */
+static sox_bool show_startup = sox_false; /* --startup-profile */
+
+/* --metrics-fd, --metrics-file, --metrics-interval */
+static FILE * metrics_fp = NULL;
+static char const * metrics_filename = NULL;
+static double metrics_interval = 1;
+
+/* --plan: where the automatic channels & rate effects go among the user
+ * effects, if not after them */
+static sox_bool plan_chain = sox_false;
+static size_t plan_channels_at = SOX_SIZE_MAX, plan_rate_at = SOX_SIZE_MAX;
+
+/* --render-cache, --render-cache-at: the output of the first render_cut user
+ * effects is kept in, or (if render_hit) read back from, render_file */
+static char * render_cache_path = NULL;
+static size_t render_cache_at = 0;  /* 0: all but the last effect */
+static size_t render_cut = 0;
+static FILE * render_file = NULL;
+static char * render_name = NULL, * render_tmp = NULL;
+static sox_bool render_hit = sox_false, render_complete = sox_false;
+static sox_signalinfo_t render_signal;  /* Of the audio read back */
+static uint64_t render_read = 0;        /* Wide samples read back */
 
 
 /* Input & output files */
@@ -149,6 +196,8 @@ typedef struct {
   double replay_gain;
   sox_oob_t oob;
   sox_bool no_glob;
+  unsigned io_async;  /* Number of buffers, or 0 for synchronous I/O */
+  unsigned tee;       /* For a --tee output, the number of buffers queued */
 
   sox_format_t * ft;  /* libSoX file descriptor */
   uint64_t volume_clips;
@@ -160,6 +209,37 @@ static file_t * * files = NULL; /* Array tracking input and output files */
 static size_t file_count = 0;
 static size_t input_count = 0;
 static size_t output_count = 0;
+static file_t * * tees = NULL;  /* Outputs (--tee) given what ofile is */
+static size_t tee_count = 0;
+static sox_bool upload_failed = sox_false; /* Output s3: URL not completed */
+
+typedef struct {      /* A --split segment */
+  uint64_t start, end;  /* In output samples per channel; end 0: none */
+  char * filename;
+  sox_format_t * ft;
+  sox_bool done;
+} split_t;
+
+static char const * split_list = NULL; /* --split */
+static split_t * splits = NULL;
+static size_t split_count = 0;
+static sox_bool volatile splits_done = sox_false;
+static sox_bool split_failed = sox_false;
+
+typedef struct {      /* A --segment-time segment */
+  char * filename;
+  uint64_t length;      /* Samples per channel */
+  sox_format_t * ft;    /* While being encoded */
+  sox_bool failed;
+} stream_seg_t;
+
+static double segment_time = 0;         /* --segment-time; 0: none */
+static char * playlist = NULL;          /* --playlist */
+static stream_seg_t * stream_segs = NULL;
+static size_t stream_seg_count = 0;     /* Encoded so far */
+static sox_sample_t * seg_audio = NULL; /* Output since then, interleaved */
+static size_t seg_audio_len = 0, seg_audio_max = 0;
+static sox_bool segment_failed = sox_false;
 
 /* Effects */
 
@@ -173,7 +253,8 @@ static size_t user_efftab_size = 0;
 static sox_effects_chain_t *effects_chain = NULL;
 static sox_effect_t *save_output_eff = NULL;
 
-static struct { char *name; int argc; char **argv; size_t argv_size; } **user_effargs = NULL;
+typedef struct { char *name; int argc; char **argv; size_t argv_size; } effargs_t;
+static effargs_t **user_effargs = NULL;
 static size_t *user_effargs_size = NULL;  /* array: size of user_effargs for each chain */
 /* Size of memory structures related to effects arguments (user_effargs[i],
  * user_effargs[i][j].argv) to be extended in steps of EFFARGS_STEP */
@@ -187,7 +268,32 @@ static sox_bool very_first_effchain = sox_true;
      optimize_trim() hack. */
 static char *effects_filename = NULL;
 static char * play_rate_arg = NULL;
+static sox_bool preview = sox_false;
 static char *norm_level = NULL;
+static int decode_ahead = -1; /* Buffers per input file; 0: none, -1: default */
+static unsigned segments = 0; /* --segments: processes to use, at most */
+static int sox_argc;          /* For --manifest */
+static char * * sox_argv;
+#define MAX_SEGMENTS 64
+#define SOX_BUFMIN 16 /* --buffer must be more */
+static sox_bool autotune = sox_false;       /* --autotune */
+static char * tuning_filename = NULL;       /* --autotune=FILENAME */
+static char const * checkpoint_filename = NULL; /* --checkpoint */
+static double checkpoint_interval = 60;     /* --checkpoint-interval */
+static struct timeval checkpoint_time;      /* Of the last checkpoint */
+
+/* The checkpoint (see write_checkpoint), as read for --resume */
+typedef struct {
+  char const * input, * output;   /* Filenames */
+  uint64_t length;                /* Of the input, in wide samples */
+  double rates[2];                /* Of the input, and of the output */
+  uint64_t start, in, out, offset;/* Its position */
+  int argc;                       /* Arguments of the checkpointing run */
+  char * * argv;
+  char * * lines;                 /* Of the file, holding the above */
+} checkpoint_t;
+
+static checkpoint_t * resume_point = NULL; /* Set with --resume */
 
 /* Flowing */
 
@@ -203,9 +309,25 @@ static sox_bool output_eof = sox_false;
 static sox_bool user_abort = sox_false;
 static sox_bool user_skip = sox_false;
 static sox_bool user_restart_eff = sox_false;
+static char * control_filename = NULL;      /* --control */
+static int control_fd = -1;
+static char control_buf[4096];              /* Of a line not yet complete */
+static size_t control_len = 0;
+/* With --segments, this process's part of the audio (see flow_in_segments): */
+static uint64_t read_limit = 0;             /* Input wide samples; 0: none */
+static uint64_t output_skip = 0;            /* Output wide samples to discard */
+static uint64_t output_left = UINT64_MAX;   /* Output wide samples to give */
+static FILE * segment_file = NULL;          /* If set, to take the output */
 static int success = 0;
 static int cleanup_called = 0;
-static sox_sample_t omax[2], omin[2];
+
+/* Each output channel's highest and lowest samples since they were last
+ * taken: by the level meter (see display_status), and by --metrics */
+typedef struct {
+  unsigned     chans;
+  sox_sample_t * max, * min;
+} peaks_t;
+static peaks_t meter_peaks, metrics_peaks;
 
 #ifdef HAVE_TERMIOS_H
 #include <termios.h>
@@ -217,6 +339,20 @@ static sox_bool stdin_is_a_tty, is_player, is_guarded, do_guarded_norm, no_dithe
 
 struct timeval load_timeofday;
 
+/* For --startup-profile: when each stage of start-up (from load_timeofday)
+ * was done; the stages are taken in this order */
+typedef enum {startup_init, startup_options, startup_inputs, startup_effects,
+  startup_output, startup_chain, startup_first_sample, startup_stages} startup_t;
+static char const * const startup_names[] = {"library init", "options",
+  "open inputs", "parse effects", "open output", "build chain", "first sample"};
+static struct timeval startup_time[startup_stages];
+
+static void startup_done(startup_t stage)
+{
+  if (!startup_time[stage].tv_sec)
+    gettimeofday(&startup_time[stage], NULL);
+}
+
 static void cleanup(void)
 {
   size_t i;
@@ -249,7 +385,28 @@ static void cleanup(void)
     free(ofile);
   }
 
+  for (i = 0; i < tee_count; i++) {
+    if (tees[i]->ft) {
+      if (!success && tees[i]->ft->io_type == lsx_io_file) {
+        struct stat st;
+        if (!stat(tees[i]->ft->filename, &st) &&
+            (st.st_mode & S_IFMT) == S_IFREG)
+          unlink(tees[i]->ft->filename);
+      }
+      sox_close(tees[i]->ft);
+    }
+    free(tees[i]->filename);
+    free(tees[i]);
+  }
+
   free(files);
+  free(tees);
+  for (i = 0; i < split_count; i++) {
+    if (splits[i].ft)
+      sox_close(splits[i].ft);
+    free(splits[i].filename);
+  }
+  free(splits);
 
 #ifdef HAVE_TERMIOS_H
   if (original_termios_saved)
@@ -260,10 +417,18 @@ static void cleanup(void)
 
   free(sox_globals.tmp_path);
   sox_globals.tmp_path = NULL;
+  free(sox_globals.design_cache_path);
+  sox_globals.design_cache_path = NULL;
+  free(sox_globals.decode_cache_path);
+  sox_globals.decode_cache_path = NULL;
+  free(render_cache_path);
+  free(render_name);
+  free(render_tmp);
 
   free(play_rate_arg);
   free(effects_filename);
   free(norm_level);
+  free(tuning_filename);
 
   sox_quit();
 
@@ -406,10 +571,11 @@ static void display_file_info(sox_format_t * ft, file_t * f, sox_bool full)
     uint64_t ws = ft->signal.length / ft->signal.channels;
     char const * text, * text2 = NULL;
     fprintf(output,
-        "Duration       : %s = %" PRIu64 " samples %c %g CDDA sectors\n",
+        "Duration       : %s = %" PRIu64 " samples %c %g CDDA sectors%s\n",
         str_time((double)ws / ft->signal.rate),
         ws, "~="[ft->signal.rate == 44100],
-        (double)ws / ft->signal.rate * 44100 / 588);
+        (double)ws / ft->signal.rate * 44100 / 588,
+        ft->length_estimated? " (estimated)" : "");
     if (ft->mode == 'r' && (text = size_and_bitrate(ft, &text2))) {
       fprintf(output, "File Size      : %s\n", text);
       if (text2)
@@ -470,6 +636,9 @@ static void progress_to_next_input_file(file_t * f, sox_effect_t * effp)
   }
   read_wide_samples = 0;
   input_wide_samples = f->ft->signal.length / f->ft->signal.channels;
+  if (decode_ahead > 0 && is_serial(combine_method) &&
+      current_input + 1 < input_count)   /* Prefetch the next input file */
+    sox_set_decode_ahead(files[current_input + 1]->ft, (unsigned)decode_ahead);
   if (show_progress && (sox_globals.verbosity < 3 ||
                         (is_serial(combine_method) && input_count > 1)))
     display_file_info(f->ft, f, sox_false);
@@ -484,20 +653,29 @@ static void progress_to_next_input_file(file_t * f, sox_effect_t * effp)
 
 /* Read up to max `wide' samples.  A wide sample contains one sample per channel
  * from the input audio. */
-static size_t sox_read_wide(sox_format_t * ft, sox_sample_t * buf, size_t max)
+static size_t read_wide(sox_format_t * ft, sox_sample_t * buf, size_t max)
 {
   size_t len = max / combiner_signal.channels;
-  len = sox_read(ft, buf, len * ft->signal.channels) / ft->signal.channels;
-  if (!len && ft->sox_errno)
+  return sox_read(ft, buf, len * ft->signal.channels) / ft->signal.channels;
+}
+
+static void report_read_error(sox_format_t * ft)
+{
+  if (ft->sox_errno)
     lsx_fail("`%s' %s: %s",
         ft->filename, ft->sox_errstr, sox_strerror(ft->sox_errno));
-  return len;
 }
 
-static void balance_input(sox_sample_t * buf, size_t ws, file_t * f)
+static size_t sox_read_wide(sox_format_t * ft, sox_sample_t * buf, size_t max)
 {
-  size_t s = ws * f->ft->signal.channels;
+  size_t len = read_wide(ft, buf, max);
+  if (!len)
+    report_read_error(ft);
+  return len;
+}
 
+static void balance_input(sox_sample_t * buf, size_t s, file_t * f)
+{
   if (f->volume != 1) while (s--) {
     double d = f->volume * *buf;
     *buf++ = SOX_ROUND_CLIP_COUNT(d, f->volume_clips);
@@ -509,16 +687,30 @@ static void balance_input(sox_sample_t * buf, size_t ws, file_t * f)
 typedef struct {
   sox_sample_t * * ibuf;
   size_t *         ilen;
+  double *         acc;    /* The block of output being mixed/multiplied */
+  sox_sample_t * * planes; /* Where each channel is read to, if planar */
 } input_combiner_t;
 
+/* Mixing and multiplying are done a block of output at a time, in doubles;
+ * each input's volume (balance) is applied as it is folded into the block,
+ * and the result is rounded and clipped just once, on leaving it. */
+#define COMBINE_BLOCK_LEN 2048  /* Samples; 16KiB, to stay in L1 cache */
+
 static int combiner_start(sox_effect_t *effp)
 {
   input_combiner_t * z = (input_combiner_t *) effp->priv;
   uint64_t ws;
   size_t i;
 
-  if (is_serial(combine_method))
+  if (is_serial(combine_method)) {
     progress_to_next_input_file(files[current_input], effp);
+    /* Where the decoder's output is uninterleaved, it is given as is to
+     * effects that take it so (see sox_read_planar) */
+    if (files[current_input]->ft->handler.read_planar && decode_ahead <= 0) {
+      effp->handler.flags |= SOX_EFF_PLANAR;
+      z->planes = lsx_malloc(effp->out_signal.channels * sizeof(*z->planes));
+    }
+  }
   else {
     ws = 0;
     z->ibuf = lsx_malloc(input_count * sizeof(*z->ibuf));
@@ -528,8 +720,12 @@ static int combiner_start(sox_effect_t *effp)
       ws = max(ws, input_wide_samples);
     }
     input_wide_samples = ws; /* Output length is that of longest input file. */
+    if (combine_method != sox_merge)
+      z->acc = lsx_malloc(max(COMBINE_BLOCK_LEN, effp->in_signal.channels) *
+          sizeof(*z->acc));
   }
   z->ilen = lsx_malloc(input_count * sizeof(*z->ilen));
+  effp->history = 0;
   return SOX_SUCCESS;
 }
 
@@ -540,16 +736,143 @@ static sox_bool can_segue(size_t i)
     files[i]->ft->signal.rate     == files[i - 1]->ft->signal.rate;
 }
 
+/* acc[k] += v * x[k] (mix) or acc[k] *= v * x[k] (multiply), for k < n */
+static void combine_run(double * acc, sox_sample_t const * x, size_t n,
+    double v, sox_bool mult)
+{
+  size_t k = 0;
+
+#if defined HAVE_SSE2
+  __m128d vv = _mm_set1_pd(v);
+  for (; k + 4 <= n; k += 4) {
+    __m128i xi = _mm_loadu_si128((__m128i const *)(x + k));
+    __m128d lo = _mm_mul_pd(vv, _mm_cvtepi32_pd(xi));
+    __m128d hi = _mm_mul_pd(vv, _mm_cvtepi32_pd(_mm_shuffle_epi32(xi, 0xee)));
+    __m128d a0 = _mm_loadu_pd(acc + k), a1 = _mm_loadu_pd(acc + k + 2);
+    _mm_storeu_pd(acc + k,     mult? _mm_mul_pd(a0, lo) : _mm_add_pd(a0, lo));
+    _mm_storeu_pd(acc + k + 2, mult? _mm_mul_pd(a1, hi) : _mm_add_pd(a1, hi));
+  }
+#endif
+  if (mult) for (; k < n; ++k)
+    acc[k] *= v * x[k];
+  else for (; k < n; ++k)
+    acc[k] += v * x[k];
+}
+
+/* Folds one input into the block: frames [b, b + n) of the output, which has
+ * chans channels.  Where the input is short (of length or of channels), it
+ * contributes silence. */
+static void combine_input(double * acc, size_t b, size_t n, unsigned chans,
+    sox_sample_t const * ibuf, size_t ilen, file_t * f, sox_bool mult)
+{
+  unsigned c = f->ft->signal.channels, s;
+  size_t m = ilen > b? min(n, ilen - b) : 0, ws;
+  double v = f->volume;
+  sox_sample_t const * x = ibuf + b * c;
+
+  if (mult) /* Scale to +-1 here, so as to leave the first input's range */
+    v *= -1. / SOX_SAMPLE_MIN;
+
+  if (c == chans && fabs(f->volume) <= 1) /* No clipping of the input */
+    combine_run(acc, x, m * c, v, mult);
+  else for (ws = 0; ws < m; ++ws, x += c) {
+    double * a = acc + ws * chans;
+    for (s = 0; s < c; ++s) {
+      double d = f->volume * x[s];  /* Clip as would the input on its own */
+      if (d > SOX_SAMPLE_MAX)
+        d = SOX_SAMPLE_MAX, ++f->volume_clips;
+      else if (d < SOX_SAMPLE_MIN)
+        d = SOX_SAMPLE_MIN, ++f->volume_clips;
+      if (mult)
+        a[s] *= d * (-1. / SOX_SAMPLE_MIN);
+      else a[s] += d;
+    }
+    if (mult) for (; s < chans; ++s)
+      a[s] = 0;
+  }
+  if (mult)
+    memset(acc + m * chans, 0, (n - m) * chans * sizeof(*acc));
+}
+
+static void combine_block(input_combiner_t * z, sox_sample_t * obuf,
+    size_t b, size_t n, unsigned chans)
+{
+  sox_bool mult = combine_method == sox_multiply;
+  size_t i, k, len = n * chans;
+
+  memset(z->acc, 0, len * sizeof(*z->acc));
+  for (i = 0; i < input_count; ++i) {
+    if (mult && !i) /* The first input is the multiplicand */
+      combine_input(z->acc, b, n, chans, z->ibuf[i], z->ilen[i],
+          files[i], sox_false);
+    else combine_input(z->acc, b, n, chans, z->ibuf[i], z->ilen[i],
+          files[i], mult);
+  }
+  for (k = 0; k < len; ++k)
+    obuf[k] = SOX_ROUND_CLIP_COUNT(z->acc[k], mixing_clips);
+}
+
+/* sox_merge: like a multi-track recorder, each input to its own channels */
+static void merge_inputs(input_combiner_t * z, sox_sample_t * obuf,
+    size_t olen, unsigned chans)
+{
+  size_t i, ws;
+  unsigned c, s;
+
+  for (i = 0; i < input_count; obuf += c, ++i) {
+    file_t * f = files[i];
+    sox_sample_t const * x = z->ibuf[i];
+    sox_sample_t * p = obuf;
+
+    c = f->ft->signal.channels;
+    if (f->volume == 1)
+      for (ws = 0; ws < z->ilen[i]; ++ws, p += chans, x += c)
+        for (s = 0; s < c; ++s)
+          p[s] = x[s];
+    else for (ws = 0; ws < z->ilen[i]; ++ws, p += chans, x += c)
+      for (s = 0; s < c; ++s) {
+        double d = f->volume * x[s];
+        p[s] = SOX_ROUND_CLIP_COUNT(d, f->volume_clips);
+      }
+    for (; ws < olen; ++ws, p += chans)
+      for (s = 0; s < c; ++s)
+        p[s] = 0;
+  }
+}
+
+/* As sox_read_wide, but into the channel buffers of a planar obuf */
+static size_t read_planar(sox_effect_t * effp, sox_sample_t * obuf, size_t max)
+{
+  input_combiner_t * z = (input_combiner_t *) effp->priv;
+  sox_format_t * ft = files[current_input]->ft;
+  unsigned c, chans = effp->out_signal.channels;
+  size_t len;
+
+  for (c = 0; c < chans; ++c)
+    z->planes[c] = obuf + c * (effp->obufsiz / chans);
+  len = sox_read_planar(ft, z->planes, max / chans);
+  if (!len)
+    report_read_error(ft);
+  return len;
+}
+
 static int combiner_drain(sox_effect_t *effp, sox_sample_t * obuf, size_t * osamp)
 {
   input_combiner_t * z = (input_combiner_t *) effp->priv;
-  size_t ws, s, i;
+  unsigned chans = effp->in_signal.channels;
+  size_t ws, i;
   size_t olen = 0;
 
   if (is_serial(combine_method)) {
     while (sox_true) {
-      if (!user_skip)
-        olen = sox_read_wide(files[current_input]->ft, obuf, *osamp);
+      if (!user_skip) {
+        size_t max = *osamp;
+        if (read_limit)
+          max = (size_t)min(max, (read_limit - min(read_limit,
+                  read_wide_samples)) * chans);
+        olen = !max? 0 : effp->planar? read_planar(effp, obuf, max) :
+          sox_read_wide(files[current_input]->ft, obuf, max);
+      }
       if (olen == 0) {   /* If EOF, go to the next input file. */
         if (++current_input < input_count) {
           if (combine_method == sox_sequence && !can_segue(current_input))
@@ -558,46 +881,41 @@ static int combiner_drain(sox_effect_t *effp, sox_sample_t * obuf, size_t * osam
           continue;
         }
       }
-      balance_input(obuf, olen, files[current_input]);
+      if (effp->planar) for (i = 0; i < chans; ++i)
+        balance_input(z->planes[i], olen, files[current_input]);
+      else balance_input(obuf, olen * chans, files[current_input]);
       break;
     } /* while */
   } /* is_serial */ else { /* else is_parallel() */
-    sox_sample_t * p = obuf;
+    size_t len = *osamp;
+    /* The inputs are independent, so may be read (decoded) concurrently,
+     * unless they are already (--decode-ahead); the test is outside the
+     * pragma so as to spare the cost of entering a parallel region when
+     * there will be only one thread. */
+    size_t readers = sox_globals.threads?
+        min(input_count, sox_globals.threads) : input_count;
+    if (sox_globals.use_threads && readers > 1 && decode_ahead <= 0) {
+      #pragma omp parallel for schedule(dynamic) num_threads((int)readers)
+      for (i = 0; i < input_count; ++i)
+        z->ilen[i] = read_wide(files[i]->ft, z->ibuf[i], len);
+    }
+    else for (i = 0; i < input_count; ++i)
+      z->ilen[i] = read_wide(files[i]->ft, z->ibuf[i], len);
     for (i = 0; i < input_count; ++i) {
-      z->ilen[i] = sox_read_wide(files[i]->ft, z->ibuf[i], *osamp);
-      balance_input(z->ibuf[i], z->ilen[i], files[i]);
+      if (!z->ilen[i])
+        report_read_error(files[i]->ft);
       olen = max(olen, z->ilen[i]);
     }
-    for (ws = 0; ws < olen; ++ws) { /* wide samples */
-      if (combine_method == sox_mix || combine_method == sox_mix_power) {
-        for (s = 0; s < effp->in_signal.channels; ++s, ++p) { /* sum samples */
-          *p = 0;
-          for (i = 0; i < input_count; ++i)
-            if (ws < z->ilen[i] && s < files[i]->ft->signal.channels) {
-              /* Cast to double prevents integer overflow */
-              double sample = *p + (double)z->ibuf[i][ws * files[i]->ft->signal.channels + s];
-              *p = SOX_ROUND_CLIP_COUNT(sample, mixing_clips);
-            }
-        }
-      } /* sox_mix */ else if (combine_method == sox_multiply)  {
-        for (s = 0; s < effp->in_signal.channels; ++s, ++p) { /* multiply samples */
-          i = 0;
-          *p = ws < z->ilen[i] && s < files[i]->ft->signal.channels?
-            z->ibuf[i][ws * files[i]->ft->signal.channels + s] : 0;
-          for (++i; i < input_count; ++i) {
-            double sample = *p * (-1. / SOX_SAMPLE_MIN) * (ws < z->ilen[i] && s < files[i]->ft->signal.channels? z->ibuf[i][ws * files[i]->ft->signal.channels + s] : 0);
-            *p = SOX_ROUND_CLIP_COUNT(sample, mixing_clips);
-          }
-        }
-      } /* sox_multiply */ else { /* sox_merge: like a multi-track recorder */
-        for (i = 0; i < input_count; ++i)
-          for (s = 0; s < files[i]->ft->signal.channels; ++s)
-            *p++ = (ws < z->ilen[i]) * z->ibuf[i][ws * files[i]->ft->signal.channels + s];
-      } /* sox_merge */
-    } /* wide samples */
+    if (combine_method == sox_merge)
+      merge_inputs(z, obuf, olen, chans);
+    else {
+      size_t block = max(COMBINE_BLOCK_LEN / chans, 1);
+      for (ws = 0; ws < olen; ws += block)
+        combine_block(z, obuf + ws * chans, ws, min(block, olen - ws), chans);
+    }
   } /* is_parallel */
   read_wide_samples += olen;
-  olen *= effp->in_signal.channels;
+  olen *= chans;
   *osamp = olen;
 
   input_eof = olen ? sox_false : sox_true;
@@ -618,8 +936,11 @@ static int combiner_stop(sox_effect_t *effp)
     for (i = 0; i < input_count; i++)
       free(z->ibuf[i]);
     free(z->ibuf);
+    free(z->acc);
   }
   free(z->ilen);
+  free(z->planes);
+  z->planes = NULL;
 
   return SOX_SUCCESS;
 }
@@ -628,7 +949,7 @@ static sox_effect_handler_t const * input_combiner_effect_fn(void)
 {
   static sox_effect_handler_t handler = { "input", 0, SOX_EFF_MCHAN |
     SOX_EFF_MODIFY, 0, combiner_start, 0, combiner_drain,
-    combiner_stop, 0, sizeof(input_combiner_t)
+    combiner_stop, 0, sizeof(input_combiner_t), 0, 0, 0, 0
   };
   return &handler;
 }
@@ -638,50 +959,215 @@ static int ostart(sox_effect_t *effp)
   unsigned prec = effp->out_signal.precision;
   if (effp->in_signal.mult && effp->in_signal.precision > prec)
     *effp->in_signal.mult *= 1 - (1 << (31 - prec)) * (1. / SOX_SAMPLE_MAX);
+  effp->history = 0;
+  /* Where the encoder takes uninterleaved input, it is given it as is from
+   * effects that give it so (see sox_write_planar) */
+  if (ofile->ft && ofile->ft->handler.write_planar && !segment_time)
+    effp->handler.flags |= SOX_EFF_PLANAR;
   return SOX_SUCCESS;
 }
 
+/* Merges the peaks found for the lanes of a span into those of their
+ * channels: lane j's channel is j % chans, or is c if the buffer was a
+ * single channel's */
+static void merge_peaks(peaks_t * p, unsigned chans, unsigned c,
+    sox_sample_t const * hi, sox_sample_t const * lo, size_t span)
+{
+  size_t j;
+
+  if (p->chans != chans) {
+    lsx_revalloc(p->max, chans);
+    lsx_revalloc(p->min, chans);
+    memset(p->max, 0, chans * sizeof(*p->max));
+    memset(p->min, 0, chans * sizeof(*p->min));
+    p->chans = chans;
+  }
+  for (j = 0; j < span; ++j) {
+    unsigned k = c < chans? c : (unsigned)(j % chans);
+    p->max[k] = max(p->max[k], hi[j]);
+    p->min[k] = min(p->min[k], lo[j]);
+  }
+}
+
+#define PEAK_LANES 8  /* Samples compared at once, as two vectors */
+
+#if defined HAVE_SSE2   /* (Which has no _mm_max_epi32 or _mm_min_epi32) */
+static __m128i max_epi32(__m128i a, __m128i b)
+{
+  __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+static __m128i min_epi32(__m128i a, __m128i b)
+{
+  __m128i gt = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+}
+#endif
+
+/* Finds the peaks of each lane of a span (a multiple of PEAK_LANES) over
+ * all of the spans of buf, a vector of lanes at a time */
+static void find_peaks(sox_sample_t const * buf, size_t len,
+    sox_sample_t * hi, sox_sample_t * lo, size_t span)
+{
+  size_t i, j, k, n, spans = len / span;
+
+  for (j = 0; j < span; j += PEAK_LANES) {
+    sox_sample_t h[PEAK_LANES] = {0}, l[PEAK_LANES] = {0};
+    sox_sample_t const * x = buf + j;
+#if defined HAVE_SSE2
+    __m128i h0 = _mm_setzero_si128(), h1 = h0, l0 = h0, l1 = h0;
+    for (n = spans; n; --n, x += span) {
+      __m128i a = _mm_loadu_si128((__m128i const *)x);
+      __m128i b = _mm_loadu_si128((__m128i const *)(x + 4));
+      h0 = max_epi32(h0, a), h1 = max_epi32(h1, b);
+      l0 = min_epi32(l0, a), l1 = min_epi32(l1, b);
+    }
+    _mm_storeu_si128((__m128i *)h, h0), _mm_storeu_si128((__m128i *)(h + 4), h1);
+    _mm_storeu_si128((__m128i *)l, l0), _mm_storeu_si128((__m128i *)(l + 4), l1);
+#else
+    for (n = spans; n; --n, x += span)
+      for (k = 0; k < PEAK_LANES; ++k) {
+        h[k] = max(h[k], x[k]);
+        l[k] = min(l[k], x[k]);
+      }
+#endif
+    for (k = 0; k < PEAK_LANES; ++k) {
+      i = spans * span + j + k;  /* The part-span at the end */
+      hi[j + k] = i < len? max(h[k], buf[i]) : h[k];
+      lo[j + k] = i < len? min(l[k], buf[i]) : l[k];
+    }
+  }
+}
+
+/* Tracks the peaks of interleaved output for the meter and the metrics;
+ * or, if c < chans, of one channel's buffer of planar output.  Interleaved
+ * output is taken as spans of the least multiple of PEAK_LANES that is
+ * whole frames, so that each lane is always of the same channel. */
+static void track_peaks(sox_sample_t const * buf, size_t len, unsigned chans,
+    unsigned c)
+{
+  static sox_sample_t * hi, * lo;
+  static size_t span, alloc;
+  sox_bool metrics = metrics_fp || metrics_filename;
+
+  if (!show_progress && !metrics)
+    return;
+  for (span = PEAK_LANES; c >= chans && span % chans; span += PEAK_LANES);
+  if (alloc < span) {
+    lsx_revalloc(hi, span);
+    lsx_revalloc(lo, alloc = span);
+  }
+  find_peaks(buf, len, hi, lo, span);
+  if (show_progress)
+    merge_peaks(&meter_peaks, chans, c, hi, lo, span);
+  if (metrics)
+    merge_peaks(&metrics_peaks, chans, c, hi, lo, span);
+}
+
+/* The peak level of a channel, 0 to 1, since its peaks were last taken */
+static double peak_level(peaks_t const * p, unsigned c)
+{
+  double const MAX = SOX_SAMPLE_MAX, MIN = SOX_SAMPLE_MIN;
+  return c < p->chans? max(p->max[c] / MAX, p->min[c] / MIN) : 0;
+}
+
+static void clear_peaks(peaks_t * p)
+{
+  if (p->chans) {
+    memset(p->max, 0, p->chans * sizeof(*p->max));
+    memset(p->min, 0, p->chans * sizeof(*p->min));
+  }
+}
+
+static sox_bool gather_segments(sox_sample_t const *, size_t);
+static void write_checkpoint(void);
+static sox_bool since(struct timeval *, double, sox_bool);
+
+/* Writes the channel buffers of a planar ibuf straight to the output file,
+ * where nothing else is to be done with them; otherwise interleaves them
+ * into a buffer of the same size, and returns it, to be written as usual. */
+static sox_sample_t const * output_planar(sox_effect_t * effp,
+    sox_sample_t const * ibuf, size_t n, size_t * len)
+{
+  static sox_sample_t const * * planes;
+  static sox_sample_t * buf;
+  static size_t buf_len;
+  unsigned c, chans = effp->in_signal.channels;
+  size_t i, ws = n / chans;
+
+  if (!segment_file && !output_skip && output_left == UINT64_MAX) {
+    lsx_revalloc(planes, chans);
+    for (c = 0; c < chans; ++c) {
+      planes[c] = ibuf + c * (effp->ibufsiz / chans);
+      track_peaks(planes[c], ws, chans, c);
+    }
+    *len = ws? sox_write_planar(ofile->ft, planes, ws) * chans : 0;
+    return NULL;
+  }
+  if (buf_len < effp->ibufsiz)
+    lsx_revalloc(buf, buf_len = effp->ibufsiz);
+  for (c = 0; c < chans; ++c)
+    for (i = 0; i < ws; ++i)
+      buf[i * chans + c] = ibuf[c * (effp->ibufsiz / chans) + i];
+  return buf;
+}
+
 static int output_flow(sox_effect_t *effp, sox_sample_t const * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp)
 {
-  size_t len;
+  size_t len = 0, n;
 
   (void)effp, (void)obuf;
-  if (show_progress) for (len = 0; len < *isamp; len += effp->in_signal.channels) {
-    omax[0] = max(omax[0], ibuf[len]);
-    omin[0] = min(omin[0], ibuf[len]);
-    if (effp->in_signal.channels > 1) {
-      omax[1] = max(omax[1], ibuf[len + 1]);
-      omin[1] = min(omin[1], ibuf[len + 1]);
-    }
-    else {
-      omax[1] = omax[0];
-      omin[1] = omin[0];
-    }
+  if (*isamp)
+    startup_done(startup_first_sample);
+  n = *isamp;
+  if (effp->planar && !(ibuf = output_planar(effp, ibuf, n, &len)))
+    goto written;
+  track_peaks(ibuf, n, effp->in_signal.channels, UINT_MAX);
+  if (output_skip || output_left != UINT64_MAX) { /* --segments */
+    size_t chans = effp->in_signal.channels, skip;
+    skip = (size_t)min(output_skip, n / chans);
+    ibuf += skip * chans, n -= skip * chans, output_skip -= skip;
+    n = (size_t)min(n / chans, output_left) * chans;
+    output_left -= n / chans;
   }
+  if (segment_file)
+    len = fwrite(ibuf, sizeof(*ibuf), n, segment_file);
+  else if (segment_time)
+    len = gather_segments(ibuf, n)? n : 0;
+  else len = n? sox_write(ofile->ft, ibuf, n) : 0;
+written:
   *osamp = 0;
-  len = *isamp? sox_write(ofile->ft, ibuf, *isamp) : 0;
-  output_samples += len / ofile->ft->signal.channels;
-  output_eof = (len != *isamp) ? sox_true: sox_false;
-  if (len != *isamp) {
-    if (ofile->ft->sox_errno)
+  output_samples += len / effp->in_signal.channels;
+  output_eof = (len != n) ? sox_true: sox_false;
+  if (len != n) {
+    if (segment_file)
+      lsx_fail("error writing temporary file: %s", strerror(errno));
+    else if (!segment_time && ofile->ft->sox_errno)
       lsx_fail("`%s' %s: %s", ofile->ft->filename,
           ofile->ft->sox_errstr, sox_strerror(ofile->ft->sox_errno));
     return SOX_EOF;
   }
-  return SOX_SUCCESS;
+  if (splits_done && (ofile->ft->handler.flags & SOX_FILE_PHONY))
+    return SOX_EOF;  /* Nothing more is wanted */
+  if (checkpoint_filename && since(&checkpoint_time, checkpoint_interval, sox_false))
+    write_checkpoint();
+  return output_left? SOX_SUCCESS : SOX_EOF;
 }
 
 static sox_effect_handler_t const * output_effect_fn(void)
 {
   static sox_effect_handler_t handler = {"output", 0, SOX_EFF_MCHAN |
-    SOX_EFF_MODIFY | SOX_EFF_PREC, NULL, ostart, output_flow, NULL, NULL, NULL, 0
+    SOX_EFF_MODIFY | SOX_EFF_PREC, NULL, ostart, output_flow, NULL, NULL, NULL, 0, NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
 
 static void auto_effect(sox_effects_chain_t *, char const *, int, char **,
     sox_signalinfo_t *, int *);
+static void add_split(sox_effects_chain_t *, sox_signalinfo_t *);
 
 static int add_effect(sox_effects_chain_t * chain, sox_effect_t * effp,
     sox_signalinfo_t * in, sox_signalinfo_t const * out, int * guard) {
@@ -1043,132 +1529,671 @@ static void create_user_effects(void)
   }
 }
 
-/* Add all user effects to the chain.  If the output effect's rate or
- * channel count do not match the end of the effects chain then
- * insert effects to correct this.
- *
- * This can be called with the input effect already in the effects
- * chain from a previous run.  Also, it use a pre-existing
- * output effect if its been saved into save_output_eff.
- */
-static void add_effects(sox_effects_chain_t *chain)
+/* Branch the chain, at the output effect, to each --tee output */
+static void add_tees(sox_effects_chain_t * chain, sox_signalinfo_t * signal)
 {
-  sox_signalinfo_t signal = combiner_signal;
-  int guard = is_guarded - 1;
   size_t i;
-  sox_effect_t * effp;
-  char * rate_arg = is_player ? (play_rate_arg ? play_rate_arg : "-l") : NULL;
 
-  /* 1st `effect' in the chain is the input combiner_signal.
-   * add it only if its not there from a previous run.  */
-  if (chain->length == 0) {
-    effp = sox_create_effect(input_combiner_effect_fn());
-    sox_add_effect(chain, effp, &signal, &ofile->ft->signal);
+  for (i = 0; i < tee_count; ++i) {
+    file_t * f = tees[i];
+    sox_effects_chain_t * branch = sox_add_branch(chain, &f->ft->encoding);
+    sox_signalinfo_t branch_signal = *signal;
+    sox_effect_t * effp;
+    char * arg = (char *)f->ft;
+
+    if (!branch)
+      exit(2);
+    if (signal->rate != f->ft->signal.rate ||
+        signal->channels != f->ft->signal.channels) {
+      lsx_fail("`%s': output must be of %gHz %u-channel audio, as was `%s'",
+          f->filename, signal->rate, signal->channels, ofile->filename);
+      exit(1);
+    }
+    effp = sox_create_effect(sox_find_effect("output"));
+    if (sox_effect_options(effp, 1, &arg) != SOX_SUCCESS ||
+        sox_add_effect(branch, effp, &branch_signal, &f->ft->signal) != SOX_SUCCESS)
+      exit(2);
     free(effp);
+    if (sox_version_info()->flags & sox_version_have_threads)
+      sox_set_branch_async(chain, branch, (size_t)f->tee);
   }
+}
 
-  /* Add user specified effects; stop before `dither' */
-  for (i = 0; i < nuser_effects[current_eff_chain] &&
-      strcmp(user_efftab[i]->handler.name, "dither"); i++) {
-    if (add_effect(chain, user_efftab[i], &signal, &ofile->ft->signal,
-          &guard) != SOX_SUCCESS)
-      exit(2); /* Effects chain should have displayed an error message */
-    free(user_efftab[i]);
+/* For --plan: the signal after effp, given that before it; false if it
+ * can not be known until the effect is started */
+static sox_bool predict(sox_effect_t const * effp, sox_signalinfo_t * s)
+{
+  if (effp->handler.flags & SOX_EFF_CHAN) {
+    if (!effp->out_signal.channels)
+      return sox_false;
+    s->channels = effp->out_signal.channels;
   }
+  if (effp->handler.flags & SOX_EFF_RATE) {
+    if (!effp->out_signal.rate)
+      return sox_false;
+    s->rate = effp->out_signal.rate;
+  }
+  return sox_true;
+}
 
-  /* Add auto effects if still needed at this point */
-  if (signal.channels < ofile->ft->signal.channels &&
-      signal.rate != ofile->ft->signal.rate)
-    auto_effect(chain, "rate", rate_arg != NULL, &rate_arg, &signal, &guard);
-  if (signal.channels != ofile->ft->signal.channels)
-    auto_effect(chain, "channels", 0, NULL, &signal, &guard);
-  if (signal.rate != ofile->ft->signal.rate)
-    auto_effect(chain, "rate", rate_arg != NULL, &rate_arg, &signal, &guard);
+static sox_bool predict_all(sox_signalinfo_t * s, size_t n)
+{
+  size_t i;
 
-  if (is_guarded && (do_guarded_norm || !(signal.mult && *signal.mult == 1))) {
-    char *args[2];
-    int no_guard = -1;
-    args[0] = do_guarded_norm? "-nh" : guard? "-rh" : "-h";
-    args[1] = norm_level;
-    auto_effect(chain, "gain", norm_level ? 2 : 1, args, &signal, &no_guard);
-    guard = 1;
-  }
+  for (s[0] = combiner_signal, i = 0; i < n; ++i)
+    if (s[i + 1] = s[i], !predict(user_efftab[i], &s[i + 1]))
+      return sox_false;
+  return sox_true;
+}
 
-  if (i == nuser_effects[current_eff_chain] && !no_dither && signal.precision >
-      ofile->ft->signal.precision && ofile->ft->signal.precision < 24)
-    auto_effect(chain, "dither", 0, NULL, &signal, &guard);
+/* Whether a mix of channels, or a down-sampling, may as well be done
+ * before effp as after */
+static sox_bool mix_passes(sox_effect_t const * effp)
+{
+  unsigned flags = effp->handler.flags;
+  return (flags & SOX_EFF_LINEAR) && !(flags & SOX_EFF_CHAN);
+}
 
-  /* Add user specified effects from `dither' onwards */
-  for (; i < nuser_effects[current_eff_chain]; i++, guard = 2) {
-    if (add_effect(chain, user_efftab[i], &signal, &ofile->ft->signal,
-          &guard) != SOX_SUCCESS)
-      exit(2); /* Effects chain should have displayed an error message */
-    free(user_efftab[i]);
+static sox_bool rate_passes(sox_effect_t const * effp,
+    sox_signalinfo_t const * in, sox_signalinfo_t const * out)
+{
+  return (effp->handler.flags & SOX_EFF_TIMEINV) &&
+    !(effp->handler.flags & SOX_EFF_RATE) && out->channels >= in->channels;
+}
+
+/* Samples per second put through the chain's effects, as a measure of
+ * their cost, with the auto effects where given */
+static double plan_cost(size_t n, size_t channels_at, size_t rate_at)
+{
+  sox_signalinfo_t s = combiner_signal;
+  sox_signalinfo_t const * out = &ofile->ft->signal;
+  double cost = 0;
+  size_t i;
+
+  for (i = 0; i <= n; ++i) {
+    if (i == channels_at)
+      cost += s.channels * s.rate, s.channels = out->channels;
+    if (i == rate_at)
+      cost += s.channels * s.rate, s.rate = out->rate;
+    if (i < n) {
+      cost += s.channels * s.rate;
+      predict(user_efftab[i], &s);
+    }
   }
+  if (s.channels < out->channels && s.rate != out->rate)
+    cost += s.channels * s.rate, s.rate = out->rate;
+  if (s.channels != out->channels)
+    cost += s.channels * s.rate, s.channels = out->channels;
+  if (s.rate != out->rate)
+    cost += s.channels * s.rate;
+  return cost;
+}
 
-  if (!save_output_eff)
-  {
-    /* Last `effect' in the chain is the output file */
-    effp = sox_create_effect(output_effect_fn());
-    if (sox_add_effect(chain, effp, &signal, &ofile->ft->signal) != SOX_SUCCESS)
-      exit(2);
-    free(effp);
+/* With --plan, moves each of the first n user effects that mixes channels
+ * down, or down-samples, ahead of the effects before it that give the
+ * same result either way (per SOX_EFF_LINEAR and SOX_EFF_TIMEINV), and
+ * finds where the auto effects that would do so may go likewise. */
+static void plan_effects(size_t n)
+{
+  sox_signalinfo_t * s = lsx_malloc((n + 1) * sizeof(*s));
+  sox_signalinfo_t const * out = &ofile->ft->signal;
+  effargs_t args;
+  double before, after;
+  size_t i, j;
+
+  plan_channels_at = plan_rate_at = SOX_SIZE_MAX;
+  if (!predict_all(s, n)) {
+    lsx_report("plan: effects' channels or rate unknown; chain left as given");
+    free(s);
+    return;
   }
-  else
-  {
-    sox_push_effect_last(chain, save_output_eff);
-    save_output_eff = NULL;
+  before = plan_cost(n, SOX_SIZE_MAX, SOX_SIZE_MAX);
+
+  for (i = 1; i < n; ++i) for (j = i; j; --j) {
+    sox_effect_t * a = user_efftab[j - 1], * b = user_efftab[j];
+    unsigned flags = b->handler.flags;
+    sox_bool mixes_down = (flags & SOX_EFF_CHAN) && (flags & SOX_EFF_LINEAR) &&
+      s[j + 1].channels < s[j].channels;
+    sox_bool rate_down = (flags & SOX_EFF_RATE) && (flags & SOX_EFF_LINEAR) &&
+      !(flags & SOX_EFF_CHAN) && s[j + 1].rate < s[j].rate;
+
+    if (!(mixes_down && mix_passes(a)) &&
+        !(rate_down && rate_passes(a, &s[j - 1], &s[j])))
+      break;
+    lsx_report("plan: `%s' moved ahead of `%s'", b->handler.name, a->handler.name);
+    user_efftab[j - 1] = b, user_efftab[j] = a;
+    args = user_effargs[current_eff_chain][j - 1]; /* Kept in step */
+    user_effargs[current_eff_chain][j - 1] = user_effargs[current_eff_chain][j];
+    user_effargs[current_eff_chain][j] = args;
+    predict_all(s, n);
   }
 
-  for (i = 0; i < chain->length; ++i) {
-    char const * format = sox_globals.verbosity > 3?
-      "effects chain: %-10s %7gHz %2u channels %7s %2u bits %s" :
-      "effects chain: %-10s %7gHz %2u channels";
-    sox_effect_t const * effp = &chain->effects[i][0];
-    lsx_report(format, effp->handler.name, effp->out_signal.rate,
-        effp->out_signal.channels,
-        (effp->handler.flags & SOX_EFF_MCHAN)? "(multi)" : "",
-        effp->out_signal.precision,
-        effp->out_signal.length != SOX_UNKNOWN_LEN ?
-          str_time(effp->out_signal.length/effp->out_signal.channels/effp->out_signal.rate) :
-          "unknown length"
-        );
+  if (s[n].channels > out->channels) {
+    for (i = n; i && mix_passes(user_efftab[i - 1]); --i);
+    if (i < n) {
+      plan_channels_at = i;
+      lsx_report("plan: `channels' put ahead of `%s'", user_efftab[i]->handler.name);
+    }
+  }
+  if (s[n].rate > out->rate) {
+    j = s[n].channels > out->channels? min(plan_channels_at, n) : 0;
+    for (i = n; i > j && rate_passes(user_efftab[i - 1], &s[i - 1], &s[i]); --i);
+    if (i < n) {
+      plan_rate_at = i;
+      lsx_report("plan: `rate' put ahead of `%s'", user_efftab[i]->handler.name);
+    }
   }
+  after = plan_cost(n, plan_channels_at, plan_rate_at);
+  if (after < before)
+    lsx_report("plan: estimated %g samples/s through the effects, down from %g (%.0f%% less)",
+        after, before, 100 * (1 - after / before));
+  free(s);
 }
 
-static int advance_eff_chain(void)
+/* --render-cache: the audio that leaves the first render_cut user effects is
+ * kept in a file named by the hash of a key that identifies it: the input
+ * files (by name, identity, size and modification & status-change times,
+ * to the nanosecond where stat gives them) and how they are read and
+ * combined, those effects with their arguments, and whatever else is able to
+ * alter that audio.  A later run that has the same key reads the file in
+ * place of the inputs and those effects.  The file is local, so in the
+ * machine's byte order: RENDER_MAGIC; the key's length (32-bit) and the key;
+ * rate (double), channels & precision (unsigned); then the samples.  Files
+ * named in the effects' arguments (e.g. noisered's profile) are not part of
+ * the key. */
+
+#define RENDER_MAGIC "SoX render 1\n"
+
+static void key_add(char * * key, size_t * len, char const * s)
 {
-  sox_bool reuse_output = sox_true;
+  size_t n = strlen(s) + 1;  /* With the NUL, to separate it from the next */
 
-  very_first_effchain = sox_false;
+  *key = lsx_realloc(*key, *len + n);
+  memcpy(*key + *len, s, n);
+  *len += n;
+}
 
-  /* If input file reached EOF then delete all effects in current
-   * chain and restart the current chain.
-   *
-   * This is only used with sox_sequence combine mode even though
-   * we do not specifically check for that method.
-   */
-  if (input_eof)
-    sox_delete_effects(effects_chain);
-  else
-  {
-    /* If user requested to restart this effect chain then
-     * do not advance to next.  Usually, this is because
-     * an option to current effect was changed.
-     */
-    if (user_restart_eff)
-      user_restart_eff = sox_false;
-    /* Effect chain stopped so advance to next effect chain but
-     * quite if no more chains exist.
-     */
-    else if (++current_eff_chain >= eff_chain_count)
-      return SOX_EOF;
+static void key_add_num(char * * key, size_t * len, char const * what, double x)
+{
+  char buf[64];
 
-    while (nuser_effects[current_eff_chain] == 1 &&
-           is_pseudo_effect(user_effargs[current_eff_chain][0].name))
-    {
-      if (strcmp("newfile", user_effargs[current_eff_chain][0].name) == 0)
-      {
+  sprintf(buf, "%s %.17g", what, x);
+  key_add(key, len, buf);
+}
+
+/* The key for the output of the first n user effects; NULL, having said
+ * why, if it can not be identified so */
+static char * render_key(size_t n, char const * rate_arg, size_t * len)
+{
+  char * key = NULL;
+  size_t i;
+  int j;
+
+  *len = 0;
+  key_add(&key, len, sox_version());
+  for (i = 0; i < input_count; ++i) {
+    file_t const * f = files[i];
+    sox_format_t const * ft = f->ft;
+    struct stat st;
+
+    if (!strcmp(ft->filetype, "null"))
+      key_add(&key, len, "null");
+    else if (stat(ft->filename, &st) || (st.st_mode & S_IFMT) != S_IFREG) {
+      lsx_report("render cache: `%s' is not a regular file", ft->filename);
+      free(key);
+      return NULL;
+    }
+    else {
+      key_add(&key, len, ft->filename);
+      key_add_num(&key, len, "size", (double)st.st_size);
+      key_add_num(&key, len, "device", (double)st.st_dev);
+      key_add_num(&key, len, "inode", (double)st.st_ino);
+      key_add_num(&key, len, "mtime", (double)st.st_mtime);
+      key_add_num(&key, len, "mtime ns", (double)ST_MTIME_NSEC(st));
+      key_add_num(&key, len, "ctime", (double)st.st_ctime);
+      key_add_num(&key, len, "ctime ns", (double)ST_CTIME_NSEC(st));
+    }
+    key_add(&key, len, ft->filetype);
+    key_add_num(&key, len, "rate", ft->signal.rate);
+    key_add_num(&key, len, "channels", (double)ft->signal.channels);
+    key_add_num(&key, len, "precision", (double)ft->signal.precision);
+    key_add_num(&key, len, "length", (double)ft->signal.length);
+    key_add_num(&key, len, "encoding", (double)ft->encoding.encoding);
+    key_add_num(&key, len, "bits", (double)ft->encoding.bits_per_sample);
+    key_add_num(&key, len, "reverse", (double)(ft->encoding.reverse_bytes |
+          ft->encoding.reverse_nibbles << 2 | ft->encoding.reverse_bits << 4));
+    key_add_num(&key, len, "volume", f->volume);
+    key_add_num(&key, len, "replay-gain", f->replay_gain);
+  }
+  key_add_num(&key, len, "combine", (double)combine_method);
+  key_add_num(&key, len, "rate", combiner_signal.rate);
+  key_add_num(&key, len, "channels", (double)combiner_signal.channels);
+  key_add_num(&key, len, "precision", (double)combiner_signal.precision);
+  /* These decide the automatic effects that go among the user effects */
+  key_add_num(&key, len, "output rate", ofile->ft->signal.rate);
+  key_add_num(&key, len, "output channels", (double)ofile->ft->signal.channels);
+  key_add_num(&key, len, "guard", (double)is_guarded);
+  key_add_num(&key, len, "plan", (double)plan_chain);
+  key_add_num(&key, len, "float-chain", (double)sox_globals.float_chain);
+  key_add(&key, len, rate_arg? rate_arg : "");
+  for (i = 0; i < n; ++i) {
+    effargs_t const * e = &user_effargs[current_eff_chain][i];
+    key_add_num(&key, len, e->name, (double)e->argc);
+    for (j = 0; j < e->argc; ++j)
+      key_add(&key, len, e->argv[j]);
+  }
+  return key;
+}
+
+static char * render_file_name(char const * key, size_t key_len)
+{
+  char * name = lsx_malloc(strlen(render_cache_path) + 32);
+  uint64_t hash = 14695981039346656037u; /* FNV-1a, as for design files */
+  size_t i;
+
+  for (i = 0; i < key_len; ++i)
+    hash = (hash ^ (unsigned char)key[i]) * 1099511628211u;
+  sprintf(name, "%s/%08lx%08lx.render", render_cache_path,
+      (unsigned long)(hash >> 32), (unsigned long)(hash & 0xffffffff));
+  return name;
+}
+
+/* Opens the file named, if it holds the audio for key; sets render_signal */
+static FILE * open_render_file(char const * name, char const * key, size_t key_len)
+{
+  FILE * file = fopen(name, "rb");
+  char magic[sizeof(RENDER_MAGIC) - 1], * k = NULL;
+  uint32_t len;
+  unsigned x[2];
+  struct stat st;
+  sox_bool ok;
+
+  if (!file)
+    return NULL;
+  ok = fread(magic, sizeof(magic), (size_t)1, file) == 1 &&
+    !memcmp(magic, RENDER_MAGIC, sizeof(magic)) &&
+    fread(&len, sizeof(len), (size_t)1, file) == 1 && len == key_len &&
+    fread(k = lsx_malloc(key_len), key_len, (size_t)1, file) == 1 &&
+    !memcmp(k, key, key_len) &&
+    fread(&render_signal.rate, sizeof(render_signal.rate), (size_t)1, file) == 1 &&
+    fread(x, sizeof(x), (size_t)1, file) == 1 && x[0] && render_signal.rate > 0 &&
+    !fstat(fileno(file), &st);
+  free(k);
+  if (!ok) {
+    fclose(file);
+    return NULL;
+  }
+  render_signal.channels = x[0];
+  render_signal.precision = x[1];
+  render_signal.length = ((uint64_t)st.st_size - sizeof(magic) - sizeof(len) -
+      key_len - sizeof(render_signal.rate) - sizeof(x)) / sizeof(sox_sample_t);
+  render_signal.length -= render_signal.length % x[0];
+  return file;
+}
+
+/* Readies --render-cache for the n user effects before `dither'; returns how
+ * many of them not to add to the chain, as their output is to be read back */
+static size_t start_render_cache(size_t n, char const * rate_arg)
+{
+  char * key;
+  size_t key_len, i;
+  uint32_t len;
+
+  if (render_cache_at > n)
+    lsx_warn("render cache: there are only %" PRIuPTR " effects to cache", n);
+  render_cut = render_cache_at? min(render_cache_at, n) : n? n - 1 : 0;
+  if (!render_cut) {
+    lsx_report("render cache: no effects to cache");
+    return 0;
+  }
+  if (!very_first_effchain || eff_chain_count > 1 || interactive ||
+      combine_method == sox_sequence) {
+    lsx_report("render cache: not used with several effects chains, "
+        "`--combine sequence' or --interactive");
+    return render_cut = 0;
+  }
+  if (!(key = render_key(render_cut, rate_arg, &key_len)))
+    return render_cut = 0;
+  render_name = render_file_name(key, key_len);
+
+  if ((render_file = open_render_file(render_name, key, key_len))) {
+    lsx_report("render cache: reading `%s' in place of the input and %"
+        PRIuPTR " effect(s)", render_name, render_cut);
+    render_signal.mult = combiner_signal.mult;
+    render_hit = sox_true;
+    for (i = 0; i < render_cut; ++i)
+      sox_delete_effect(user_efftab[i]);
+    free(key);
+    return render_cut;
+  }
+
+  render_tmp = lsx_malloc(strlen(render_name) + 32);
+#ifdef HAVE_UNISTD_H
+  sprintf(render_tmp, "%s.%lu.tmp", render_name, (unsigned long)getpid());
+#else
+  sprintf(render_tmp, "%s.tmp", render_name);
+#endif
+  len = (uint32_t)key_len;
+  if (!(render_file = fopen(render_tmp, "wb")) ||
+      fwrite(RENDER_MAGIC, sizeof(RENDER_MAGIC) - 1, (size_t)1, render_file) != 1 ||
+      fwrite(&len, sizeof(len), (size_t)1, render_file) != 1 ||
+      fwrite(key, key_len, (size_t)1, render_file) != 1) {
+    lsx_warn("render cache: can't write `%s': %s", render_tmp, strerror(errno));
+    if (render_file) {
+      fclose(render_file);
+      unlink(render_tmp);
+      render_file = NULL;
+    }
+  }
+  else lsx_report("render cache: keeping the output of %" PRIuPTR
+      " effect(s) in `%s'", render_cut, render_name);
+  free(key);
+  return 0;
+}
+
+/* Stops writing the cache file (after an error, or not having had all of
+ * the audio), and removes it */
+static void drop_render_file(void)
+{
+  fclose(render_file);
+  render_file = NULL;
+  unlink(render_tmp);
+}
+
+static int render_writer_start(sox_effect_t * effp)
+{
+  unsigned x[2];
+
+  x[0] = effp->in_signal.channels;
+  x[1] = effp->in_signal.precision;
+  if (fwrite(&effp->in_signal.rate, sizeof(effp->in_signal.rate), (size_t)1,
+        render_file) != 1 || fwrite(x, sizeof(x), (size_t)1, render_file) != 1) {
+    lsx_warn("render cache: can't write `%s': %s", render_tmp, strerror(errno));
+    drop_render_file();
+  }
+  return SOX_SUCCESS;
+}
+
+static int render_writer_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  size_t len = min(*isamp, *osamp);
+
+  (void)effp;
+  if (obuf != ibuf)
+    memcpy(obuf, ibuf, len * sizeof(*obuf));
+  *isamp = *osamp = len;
+  if (render_file && len &&
+      fwrite(ibuf, sizeof(*ibuf), len, render_file) != len) {
+    lsx_warn("render cache: can't write `%s': %s", render_tmp, strerror(errno));
+    drop_render_file();
+  }
+  return SOX_SUCCESS;
+}
+
+static int render_writer_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  (void)effp, (void)obuf;
+  render_complete = sox_true;  /* Everything has passed through */
+  *osamp = 0;
+  return SOX_EOF;
+}
+
+static int render_writer_stop(sox_effect_t * effp)
+{
+  int result;
+
+  (void)effp;
+  if (!render_file)
+    return SOX_SUCCESS;
+  if (!render_complete) {
+    lsx_report("render cache: not all of the audio was rendered; not kept");
+    drop_render_file();
+    return SOX_SUCCESS;
+  }
+  result = fclose(render_file);
+  render_file = NULL;
+  if (!result && rename(render_tmp, render_name)) {
+    unlink(render_name);  /* Some systems will not rename over a file */
+    result = rename(render_tmp, render_name);
+  }
+  if (result) {
+    lsx_warn("render cache: can't keep `%s': %s", render_name, strerror(errno));
+    unlink(render_tmp);
+  }
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * render_writer_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"cache", 0, SOX_EFF_MCHAN |
+    SOX_EFF_MODIFY | SOX_EFF_INPLACE, NULL, render_writer_start,
+    render_writer_flow, render_writer_drain, render_writer_stop, NULL, 0, NULL,
+    NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+/* In place of the input combiner, when the cache file is read back */
+static int render_reader_start(sox_effect_t * effp)
+{
+  (void)effp;
+  input_wide_samples = (uint64_t)(render_signal.length /
+      render_signal.channels * combiner_signal.rate / render_signal.rate);
+  read_wide_samples = 0;
+  return SOX_SUCCESS;
+}
+
+static int render_reader_drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * osamp)
+{
+  unsigned chans = effp->out_signal.channels;
+  size_t len = fread(obuf, sizeof(*obuf), *osamp / chans * chans, render_file);
+
+  len -= len % chans;
+  render_read += len / chans;
+  read_wide_samples = (uint64_t)(render_read *
+      combiner_signal.rate / render_signal.rate);
+  *osamp = len;
+  if ((input_eof = !len))
+    current_input = input_count;
+  return len? SOX_SUCCESS : SOX_EOF;
+}
+
+static int render_reader_stop(sox_effect_t * effp)
+{
+  (void)effp;
+  fclose(render_file);
+  render_file = NULL;
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * render_reader_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"cache", 0, SOX_EFF_MCHAN |
+    SOX_EFF_MODIFY, NULL, render_reader_start, NULL, render_reader_drain,
+    render_reader_stop, NULL, 0, NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+/* Adds, at user effect i, the effect that writes the cache file, if due */
+static void add_render_writer(sox_effects_chain_t * chain, size_t i,
+    sox_signalinfo_t * signal)
+{
+  sox_effect_t * effp;
+
+  if (i != render_cut || !render_file || render_hit)
+    return;
+  effp = sox_create_effect(render_writer_effect_fn());
+  if (sox_add_effect(chain, effp, signal, &ofile->ft->signal) != SOX_SUCCESS)
+    exit(2);
+  free(effp);
+}
+
+/* Add all user effects to the chain.  If the output effect's rate or
+ * channel count do not match the end of the effects chain then
+ * insert effects to correct this.
+ *
+ * This can be called with the input effect already in the effects
+ * chain from a previous run.  Also, it use a pre-existing
+ * output effect if its been saved into save_output_eff.
+ */
+static void add_effects(sox_effects_chain_t *chain)
+{
+  sox_signalinfo_t signal = combiner_signal;
+  int guard = is_guarded - 1;
+  size_t i, n, from = 0;
+  sox_effect_t * effp;
+  sox_bool to_device = is_player || (ofile->ft->handler.flags &
+      (SOX_FILE_DEVICE | SOX_FILE_PHONY)) == SOX_FILE_DEVICE;
+  char * rate_arg = is_player && play_rate_arg ? play_rate_arg :
+      preview && to_device ? "-q" : is_player ? "-l" : NULL;
+
+  for (n = 0; n < nuser_effects[current_eff_chain] &&
+      strcmp(user_efftab[n]->handler.name, "dither"); n++);
+  if (plan_chain)
+    plan_effects(n);
+
+  /* 1st `effect' in the chain is the input combiner_signal (or the render
+   * cache, read back).  Add it only if its not there from a previous run. */
+  if (chain->length == 0) {
+    if (render_cache_path)
+      from = start_render_cache(n, rate_arg);
+    if (render_hit) {
+      signal = render_signal;
+      effp = sox_create_effect(render_reader_effect_fn());
+    }
+    else effp = sox_create_effect(input_combiner_effect_fn());
+    sox_add_effect(chain, effp, &signal, &ofile->ft->signal);
+    free(effp);
+  }
+
+  /* Add user specified effects; stop before `dither' */
+  for (i = from; i < n; i++) {
+    add_render_writer(chain, i, &signal);
+    if (i == plan_channels_at)
+      auto_effect(chain, "channels", 0, NULL, &signal, &guard);
+    if (i == plan_rate_at)
+      auto_effect(chain, "rate", rate_arg != NULL, &rate_arg, &signal, &guard);
+    if (add_effect(chain, user_efftab[i], &signal, &ofile->ft->signal,
+          &guard) != SOX_SUCCESS)
+      exit(2); /* Effects chain should have displayed an error message */
+    free(user_efftab[i]);
+  }
+  add_render_writer(chain, i, &signal);
+
+  /* Add auto effects if still needed at this point */
+  if (signal.channels < ofile->ft->signal.channels &&
+      signal.rate != ofile->ft->signal.rate)
+    auto_effect(chain, "rate", rate_arg != NULL, &rate_arg, &signal, &guard);
+  if (signal.channels != ofile->ft->signal.channels)
+    auto_effect(chain, "channels", 0, NULL, &signal, &guard);
+  if (signal.rate != ofile->ft->signal.rate)
+    auto_effect(chain, "rate", rate_arg != NULL, &rate_arg, &signal, &guard);
+
+  if (is_guarded && (do_guarded_norm || !(signal.mult && *signal.mult == 1))) {
+    char *args[2];
+    int no_guard = -1;
+    args[0] = do_guarded_norm? "-nh" : guard? "-rh" : "-h";
+    args[1] = norm_level;
+    auto_effect(chain, "gain", norm_level ? 2 : 1, args, &signal, &no_guard);
+    guard = 1;
+  }
+
+  if (i == nuser_effects[current_eff_chain] && !no_dither && signal.precision >
+      ofile->ft->signal.precision && ofile->ft->signal.precision < 24)
+    auto_effect(chain, "dither", 0, NULL, &signal, &guard);
+
+  /* Add user specified effects from `dither' onwards */
+  for (; i < nuser_effects[current_eff_chain]; i++, guard = 2) {
+    if (add_effect(chain, user_efftab[i], &signal, &ofile->ft->signal,
+          &guard) != SOX_SUCCESS)
+      exit(2); /* Effects chain should have displayed an error message */
+    free(user_efftab[i]);
+  }
+
+  add_tees(chain, &signal);
+  add_split(chain, &signal);
+
+  /* A dither last is applied as the output file packs its samples: */
+  if (!segment_time && sox_fuse_output(chain, ofile->ft))
+    lsx_report("effects chain: %-10s fused with the output file",
+        ofile->ft->quantiser->handler.name);
+
+  if (!save_output_eff)
+  {
+    /* Last `effect' in the chain is the output file */
+    effp = sox_create_effect(output_effect_fn());
+    if (sox_add_effect(chain, effp, &signal, &ofile->ft->signal) != SOX_SUCCESS)
+      exit(2);
+    free(effp);
+  }
+  else
+  {
+    sox_push_effect_last(chain, save_output_eff);
+    save_output_eff = NULL;
+  }
+
+  for (i = 0; i < chain->length; ++i) {
+    char const * format = sox_globals.verbosity > 3?
+      "effects chain: %-10s %7gHz %2u channels %7s %2u bits %s" :
+      "effects chain: %-10s %7gHz %2u channels";
+    sox_effect_t const * effp = &chain->effects[i][0];
+    lsx_report(format, effp->handler.name, effp->out_signal.rate,
+        effp->out_signal.channels,
+        (effp->handler.flags & SOX_EFF_MCHAN)? "(multi)" : "",
+        effp->out_signal.precision,
+        effp->out_signal.length != SOX_UNKNOWN_LEN ?
+          str_time(effp->out_signal.length/effp->out_signal.channels/effp->out_signal.rate) :
+          "unknown length"
+        );
+  }
+  for (i = 0; i < chain->length; ++i)
+    if (chain->effects[i][0].latency > 0)
+      lsx_report("effects chain: %-10s latency %g ms",
+          chain->effects[i][0].handler.name, chain->effects[i][0].latency * 1000);
+  lsx_report("effects chain: total latency %g ms",
+      sox_effects_chain_latency(chain) * 1000);
+}
+
+static int advance_eff_chain(void)
+{
+  sox_bool reuse_output = sox_true;
+
+  very_first_effchain = sox_false;
+
+  /* If input file reached EOF then delete all effects in current
+   * chain and restart the current chain.  The output effect is kept, to
+   * be reused if the next input gives the output the same signal (see
+   * process()), so that a device isn't reopened, nor a file truncated.
+   *
+   * This is only used with sox_sequence combine mode even though
+   * we do not specifically check for that method.
+   */
+  if (input_eof) {
+    sox_effect_t * output = sox_pop_effect_last(effects_chain);
+    sox_delete_effects(effects_chain);
+    save_output_eff = output;
+  }
+  else
+  {
+    /* If user requested to restart this effect chain then
+     * do not advance to next.  Usually, this is because
+     * an option to current effect was changed.
+     */
+    if (user_restart_eff)
+      user_restart_eff = sox_false;
+    /* Effect chain stopped so advance to next effect chain but
+     * quite if no more chains exist.
+     */
+    else if (++current_eff_chain >= eff_chain_count)
+      return SOX_EOF;
+
+    while (nuser_effects[current_eff_chain] == 1 &&
+           is_pseudo_effect(user_effargs[current_eff_chain][0].name))
+    {
+      if (strcmp("newfile", user_effargs[current_eff_chain][0].name) == 0)
+      {
         if (++current_eff_chain >= eff_chain_count)
           return SOX_EOF;
         reuse_output = sox_false;
@@ -1188,10 +2213,14 @@ static int advance_eff_chain(void)
 
 static uint64_t total_clips(void)
 {
-  size_t i;
+  size_t i, f;
   uint64_t clips = 0;
-  for (i = 0; i < file_count; ++i)
+  for (i = 0; i < file_count; ++i) {
+    sox_effect_t const * q = files[i]->ft->quantiser;
     clips += files[i]->ft->clips + files[i]->volume_clips;
+    for (f = 0; q && f < q->flows; ++f)
+      clips += q[f].clips;
+  }
   return clips + mixing_clips + sox_effects_clips(effects_chain);
 }
 
@@ -1213,7 +2242,6 @@ static double min_headroom = MIN_HEADROOM;
 
 static char const * vu(unsigned channel)
 {
-  static struct timeval then;
   static char const * const text[][2] = {
     /* White: 2dB steps */
     {"", ""}, {"-", "-"}, {"=", "="}, {"-=", "=-"},
@@ -1224,12 +2252,27 @@ static char const * vu(unsigned channel)
     {"!=====", "=====!"},
   };
   int const red = 1, white = array_length(text) - red;
-  double const MAX = SOX_SAMPLE_MAX, MIN = SOX_SAMPLE_MIN;
-  double linear = max(omax[channel] / MAX, omin[channel] / MIN);
+  /* Mono is shown on both meters */
+  double linear = peak_level(&meter_peaks, meter_peaks.chans > 1? channel : 0);
   double dB = linear_to_dB(linear);
   int vu_dB = linear? floor(2 * white + red + dB) : 0;
   int index = vu_dB < 2 * white? max(vu_dB / 2, 0) : min(vu_dB - white, red + white - 1);
-  omax[channel] = omin[channel] = 0;
+
+  return text[index][channel];
+}
+
+/* The meters show the first two channels, but the headroom is that of the
+ * loudest channel; then the peaks are taken */
+static char * headroom(void)
+{
+  static struct timeval then;
+  double linear = 0, dB;
+  unsigned c;
+
+  for (c = 0; c < meter_peaks.chans; ++c)
+    linear = max(linear, peak_level(&meter_peaks, c));
+  clear_peaks(&meter_peaks);
+  dB = linear_to_dB(linear);
   if (-dB < min_headroom) {
     gettimeofday(&then, NULL);
     min_headroom = -dB;
@@ -1237,11 +2280,6 @@ static char const * vu(unsigned channel)
   else if (since(&then, 3., sox_false))
     min_headroom = -dB;
 
-  return text[index][channel];
-}
-
-static char * headroom(void)
-{
   if (min_headroom < MIN_HEADROOM) {
     static char buff[10];
     unsigned h = (unsigned)(min_headroom * 10);
@@ -1265,30 +2303,385 @@ static void display_status(sox_bool all_done)
       left_time = max(in_time - read_time, 0);
       percentage = max(100. * read_wide_samples / input_wide_samples, 0);
     }
-    fprintf(stderr, "\rIn:%-5s %s [%s] Out:%-5s [%6s|%-6s] %s Clip:%-5s",
+    static char last[128];
+    char line[128], meters[16];
+
+    /* (In this order, as headroom() takes the peaks) */
+    sprintf(meters, "[%6s|%-6s]", vu(0), vu(1));
+    snprintf(line, sizeof(line), "\rIn:%-5s %s [%s] Out:%-5s %s %s Clip:%-5s",
       lsx_sigfigs3p(percentage), str_time(read_time), str_time(left_time),
       lsx_sigfigs3((double)output_samples),
-      vu(0), vu(1), headroom(), lsx_sigfigs3((double)total_clips()));
+      meters, headroom(), lsx_sigfigs3((double)total_clips()));
+    if (strcmp(line, last)) {   /* E.g. not whilst paused */
+      fputs(line, stderr);
+      strcpy(last, line);
+    }
   }
   if (all_done)
     fputc('\n', stderr);
 }
 
+/* For --profile: the counters kept for each effect of the chain (since it
+ * was added to the chain), and the most memory each has held */
+static void report_profile(void)
+{
+  sox_mem_stats_t m;
+  size_t e;
+
+  fprintf(stderr, "%s: %-12s %6s %6s %6s %6s %6s %8s %8s %12s %6s\n", myname,
+      "effect", "calls", "block", "in", "out", "clips",
+      "wall/s", "cpu/s", "interleave/s", "mem");
+  for (e = 0; e < effects_chain->length; ++e) {
+    sox_effect_stats_t s;
+
+    sox_effects_chain_stats(effects_chain, e, &s);
+    sox_effects_chain_memory(effects_chain, e, &m);
+    fprintf(stderr, "%s: %-12s %6s %6s %6s %6s %6s %8.3f %8.3f %12.3f %6s\n",
+        myname, effects_chain->effects[e][0].handler.name,
+        lsx_sigfigs3((double)(s.flows + s.drains)),
+        lsx_sigfigs3(s.flows? (double)s.samples_in / s.flows : 0.),
+        lsx_sigfigs3((double)s.samples_in), lsx_sigfigs3((double)s.samples_out),
+        lsx_sigfigs3((double)s.clips),
+        s.wall_time, s.cpu_time, s.interleave_time,
+        lsx_sigfigs3((double)m.peak));
+  }
+  sox_effects_chain_memory(effects_chain, effects_chain->length, &m);
+  fprintf(stderr, "%s: %-12s %s\n", myname, "chain mem", lsx_sigfigs3((double)m.peak));
+}
+
+static void report_startup(void)
+{
+  struct timeval const * then = &load_timeofday;
+  int stage;
+
+  fprintf(stderr, "%s: %-14s %8s %8s\n", myname, "start-up", "ms", "total");
+  for (stage = 0; stage < startup_stages; ++stage) {
+    struct timeval const * t = &startup_time[stage];
+    if (t->tv_sec) {   /* Else it wasn't done (e.g. on a remux) */
+      fprintf(stderr, "%s: %-14s %8.3f %8.3f\n", myname, startup_names[stage],
+          (t->tv_sec - then->tv_sec + (t->tv_usec - then->tv_usec) / TIME_FRAC) * 1e3,
+          (t->tv_sec - load_timeofday.tv_sec +
+           (t->tv_usec - load_timeofday.tv_usec) / TIME_FRAC) * 1e3);
+      then = t;
+    }
+  }
+}
+
+/* For --metrics-fd and --metrics-file: the state of the processing so far,
+ * as written for another program (e.g. one that orchestrates many runs)
+ * rather than as shown on a terminal. */
+typedef struct {
+  double   elapsed;     /* Seconds since processing began */
+  double   progress;    /* Of the input, 0 to 1; -1 if its length is unknown */
+  double   throughput;  /* Wide samples read per second */
+  uint64_t in, length, out, clips;
+  int64_t  rss;         /* Resident set, in bytes; -1 where not known */
+  sox_mem_stats_t mem;  /* Of libSoX */
+} metrics_t;
+
+static struct timeval metrics_start;
+
+static void get_metrics(metrics_t * m)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  m->elapsed = now.tv_sec - metrics_start.tv_sec +
+      (now.tv_usec - metrics_start.tv_usec) / TIME_FRAC;
+  m->in = read_wide_samples;
+  m->length = input_wide_samples;
+  m->progress = input_wide_samples?
+      min(1., (double)read_wide_samples / input_wide_samples) : -1;
+  m->throughput = m->elapsed > 0? read_wide_samples / m->elapsed : 0;
+  m->out = output_samples;
+  m->clips = total_clips();
+  m->rss = -1;
+#if defined __linux__ && defined HAVE_UNISTD_H
+  {
+    FILE * statm = fopen("/proc/self/statm", "r");
+    unsigned long size, resident;
+    if (statm) {
+      if (fscanf(statm, "%lu %lu", &size, &resident) == 2)
+        m->rss = (int64_t)resident * sysconf(_SC_PAGESIZE);
+      fclose(statm);
+    }
+  }
+#endif
+  sox_memory_stats(&m->mem);
+}
+
+/* One JSON object per line */
+static void write_metrics_json(metrics_t const * m, sox_bool all_done)
+{
+  size_t e;
+  unsigned c;
+
+  fprintf(metrics_fp, "{\"elapsed\":%.3f,\"done\":%s,\"in\":%" PRIu64
+      ",\"length\":%" PRIu64 ",\"progress\":%.4f,\"throughput\":%.0f"
+      ",\"out\":%" PRIu64 ",\"clips\":%" PRIu64 ",\"rss\":%" PRId64
+      ",\"mem\":%" PRIu64 ",\"mem_peak\":%" PRIu64 ",\"effects\":[",
+      m->elapsed, all_done? "true" : "false", m->in, m->length, m->progress,
+      m->throughput, m->out, m->clips, m->rss, m->mem.current, m->mem.peak);
+  for (e = 0; effects_chain && e < effects_chain->length; ++e) {
+    sox_effect_stats_t st;
+
+    sox_effects_chain_stats(effects_chain, e, &st);
+    fprintf(metrics_fp, "%s{\"name\":\"%s\",\"in\":%" PRIu64 ",\"out\":%"
+        PRIu64 ",\"clips\":%" PRIu64 ",\"wall\":%.6f,\"cpu\":%.6f",
+        e? "," : "", effects_chain->effects[e][0].handler.name,
+        st.samples_in, st.samples_out, st.clips, st.wall_time, st.cpu_time);
+    if (sox_globals.governor)
+      fprintf(metrics_fp, ",\"degrade\":%u,\"degradations\":%" PRIu64,
+          effects_chain->effects[e][0].degrade, st.degradations);
+    fputc('}', metrics_fp);
+  }
+  fputs("],\"peaks\":[", metrics_fp);
+  for (c = 0; c < metrics_peaks.chans; ++c)
+    fprintf(metrics_fp, "%s%.6f", c? "," : "", peak_level(&metrics_peaks, c));
+  fputs("]}\n", metrics_fp);
+  fflush(metrics_fp);
+}
+
+/* A Prometheus (node_exporter) text file, replaced whole each time */
+static void write_metrics_file(metrics_t const * m)
+{
+  char * tmp = lsx_malloc(strlen(metrics_filename) + 5);
+  FILE * fp;
+  size_t e;
+  unsigned c;
+
+  sprintf(tmp, "%s.tmp", metrics_filename);
+  if (!(fp = fopen(tmp, "w"))) {
+    lsx_warn("can't write metrics file `%s': %s", tmp, strerror(errno));
+    free(tmp);
+    metrics_filename = NULL;
+    return;
+  }
+  fprintf(fp,
+      "# TYPE sox_elapsed_seconds gauge\nsox_elapsed_seconds %.3f\n"
+      "# TYPE sox_input_samples_total counter\nsox_input_samples_total %" PRIu64 "\n"
+      "# TYPE sox_input_length_samples gauge\nsox_input_length_samples %" PRIu64 "\n"
+      "# TYPE sox_progress_ratio gauge\nsox_progress_ratio %.4f\n"
+      "# TYPE sox_throughput_samples_per_second gauge\nsox_throughput_samples_per_second %.0f\n"
+      "# TYPE sox_output_samples_total counter\nsox_output_samples_total %" PRIu64 "\n"
+      "# TYPE sox_clips_total counter\nsox_clips_total %" PRIu64 "\n"
+      "# TYPE sox_memory_bytes gauge\nsox_memory_bytes %" PRIu64 "\n"
+      "# TYPE sox_memory_peak_bytes gauge\nsox_memory_peak_bytes %" PRIu64 "\n",
+      m->elapsed, m->in, m->length, m->progress, m->throughput, m->out,
+      m->clips, m->mem.current, m->mem.peak);
+  if (m->rss >= 0)
+    fprintf(fp, "# TYPE sox_resident_memory_bytes gauge\n"
+        "sox_resident_memory_bytes %" PRId64 "\n", m->rss);
+  if (effects_chain && effects_chain->length)
+    fputs("# TYPE sox_effect_samples_in_total counter\n"
+          "# TYPE sox_effect_samples_out_total counter\n"
+          "# TYPE sox_effect_clips_total counter\n"
+          "# TYPE sox_effect_wall_seconds_total counter\n"
+          "# TYPE sox_effect_cpu_seconds_total counter\n", fp);
+  if (effects_chain && effects_chain->length && sox_globals.governor)
+    fputs("# TYPE sox_effect_degrade_level gauge\n"
+          "# TYPE sox_effect_degradations_total counter\n", fp);
+  for (e = 0; effects_chain && e < effects_chain->length; ++e) {
+    sox_effect_stats_t st;
+    char const * name = effects_chain->effects[e][0].handler.name;
+
+    sox_effects_chain_stats(effects_chain, e, &st);
+    fprintf(fp,
+        "sox_effect_samples_in_total{effect=\"%s\",index=\"%lu\"} %" PRIu64 "\n"
+        "sox_effect_samples_out_total{effect=\"%s\",index=\"%lu\"} %" PRIu64 "\n"
+        "sox_effect_clips_total{effect=\"%s\",index=\"%lu\"} %" PRIu64 "\n"
+        "sox_effect_wall_seconds_total{effect=\"%s\",index=\"%lu\"} %.6f\n"
+        "sox_effect_cpu_seconds_total{effect=\"%s\",index=\"%lu\"} %.6f\n",
+        name, (unsigned long)e, st.samples_in, name, (unsigned long)e, st.samples_out,
+        name, (unsigned long)e, st.clips, name, (unsigned long)e, st.wall_time,
+        name, (unsigned long)e, st.cpu_time);
+    if (sox_globals.governor)
+      fprintf(fp,
+          "sox_effect_degrade_level{effect=\"%s\",index=\"%lu\"} %u\n"
+          "sox_effect_degradations_total{effect=\"%s\",index=\"%lu\"} %" PRIu64 "\n",
+          name, (unsigned long)e, effects_chain->effects[e][0].degrade,
+          name, (unsigned long)e, st.degradations);
+  }
+  if (metrics_peaks.chans)
+    fputs("# TYPE sox_output_peak_ratio gauge\n", fp);
+  for (c = 0; c < metrics_peaks.chans; ++c)
+    fprintf(fp, "sox_output_peak_ratio{channel=\"%u\"} %.6f\n", c + 1,
+        peak_level(&metrics_peaks, c));
+  if (fclose(fp) || rename(tmp, metrics_filename)) {
+    lsx_warn("can't write metrics file `%s': %s", metrics_filename, strerror(errno));
+    metrics_filename = NULL;
+  }
+  free(tmp);
+}
+
+/* The effects' levels of degradation (see --governor), in all; a change to
+ * them is exported at once, rather than at the next interval */
+static unsigned degraded(void)
+{
+  unsigned sum = 0;
+  size_t e;
+
+  for (e = 0; effects_chain && e < effects_chain->length; ++e)
+    sum += effects_chain->effects[e][0].degrade;
+  return sum;
+}
+
+static void export_metrics(sox_bool all_done)
+{
+  static struct timeval then;
+  static unsigned last_degraded;
+  unsigned now_degraded = degraded();
+  metrics_t m;
+
+  if (!metrics_fp && !metrics_filename)
+    return;
+  if (!all_done && now_degraded == last_degraded &&
+      !since(&then, metrics_interval, sox_false))
+    return;
+  last_degraded = now_degraded;
+  get_metrics(&m);
+  if (metrics_fp)
+    write_metrics_json(&m, all_done);
+  if (metrics_filename)
+    write_metrics_file(&m);
+  clear_peaks(&metrics_peaks);
+}
+
 #ifdef HAVE_TERMIOS_H
-static int kbhit(void)
+static int readable(int fd)
 {
   struct timeval time_val = {0, 0};
   fd_set fdset;
 
   FD_ZERO(&fdset);
-  FD_SET(fileno(stdin), &fdset);
-  select(fileno(stdin) + 1, &fdset, NULL, NULL, &time_val);
-  return FD_ISSET(fileno(stdin), &fdset);
+  FD_SET(fd, &fdset);
+  select(fd + 1, &fdset, NULL, NULL, &time_val);
+  return FD_ISSET(fd, &fdset);
+}
+
+static int kbhit(void)
+{
+  return readable(fileno(stdin));
 }
 #elif !defined(HAVE_CONIO_H)
 #define kbhit() 0
 #endif
 
+/* With --control: carries out a line such as `equalizer#2 1k 1q +3', having
+ * the 2nd equalizer effect in the chain (or with no #N, the first) take the
+ * given options in place of those it has, without restarting (see
+ * sox_effect_update).  The options are then kept for the effect as the user
+ * gave it, should the chain be restarted. */
+static void control(char * line)
+{
+  char * argv[64], * name, * hash;
+  int argc = 0;
+  size_t n = 1, i, j;
+
+  for (name = strtok(line, " \t\r"); name && argc < (int)array_length(argv);
+      name = strtok(NULL, " \t\r"))
+    argv[argc++] = name;
+  if (!argc || *argv[0] == '#')
+    return;
+  if ((hash = strchr(argv[0], '#')) != NULL) {
+    *hash++ = '\0';
+    n = strtoul(hash, &hash, 10);
+    if (!n || *hash) {
+      lsx_warn("control: bad effect number after `%s#'", argv[0]);
+      return;
+    }
+  }
+  for (i = 0, j = n; i < effects_chain->length; ++i)
+    if (!strcmp(effects_chain->effects[i]->handler.name, argv[0]) && !--j)
+      break;
+  if (i == effects_chain->length) {
+    if (n > 1)
+      lsx_warn("control: the effects chain has no `%s#%lu'", argv[0], (unsigned long)n);
+    else lsx_warn("control: the effects chain has no `%s' effect", argv[0]);
+    return;
+  }
+  if (sox_effect_update(effects_chain->effects[i], argc - 1, argv + 1) != SOX_SUCCESS)
+    return;
+  for (i = 0, j = n; i < nuser_effects[current_eff_chain]; ++i) {
+    effargs_t * args = &user_effargs[current_eff_chain][i];
+    int k;
+
+    if (strcmp(args->name, argv[0]) || --j)
+      continue;
+    for (k = 0; k < args->argc; ++k)
+      free(args->argv[k]);
+    if ((size_t)argc - 1 > args->argv_size)
+      lsx_revalloc(args->argv, args->argv_size = argc - 1);
+    for (k = 1; k < argc; ++k)
+      args->argv[k - 1] = lsx_strdup(argv[k]);
+    args->argc = argc - 1;
+    break;
+  }
+}
+
+/* Reads from the --control file, and carries out, whatever whole lines it has
+ * for us */
+static void read_control(void)
+{
+#ifdef HAVE_TERMIOS_H
+  ssize_t n;
+  char * line, * end;
+
+  while (control_fd >= 0 && readable(control_fd)) {
+    n = read(control_fd, control_buf + control_len,
+        sizeof(control_buf) - 1 - control_len);
+    if (n <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (!strcmp(control_filename, "-") || n < 0) /* A FIFO may reopen */
+        control_fd = -1;
+      break;
+    }
+    control_len += n;
+    control_buf[control_len] = '\0';
+    for (line = control_buf; (end = strchr(line, '\n')) != NULL; line = end + 1) {
+      *end = '\0';
+      if (effects_chain)
+        control(line);
+    }
+    control_len -= line - control_buf;
+    memmove(control_buf, line, control_len);
+    if (control_len == sizeof(control_buf) - 1) {
+      lsx_warn("control: line too long");
+      control_len = 0;
+    }
+  }
+#endif
+}
+
+static void open_control(void)
+{
+  if (!control_filename || control_fd >= 0)
+    return;
+#ifdef HAVE_TERMIOS_H
+  if (!strcmp(control_filename, "-")) {
+    size_t i;
+    for (i = 0; i < input_count; ++i)
+      if (!strcmp(files[i]->filename, "-")) {
+        lsx_fail("--control can't read from stdin when an input file does");
+        exit(1);
+      }
+    control_fd = fileno(stdin);
+    interactive = sox_false;
+  }
+  else if ((control_fd = open(control_filename, O_RDONLY | O_NONBLOCK)) < 0) {
+    lsx_fail("can't open control file `%s': %s", control_filename, strerror(errno));
+    exit(1);
+  }
+  if (sox_globals.chain_mode == SOX_CHAIN_PIPELINED) {
+    lsx_warn("--control: not running the effects pipelined");
+    sox_globals.chain_mode = SOX_CHAIN_SERIAL;
+  }
+#else
+  lsx_warn("--control is not supported on this platform");
+#endif
+}
+
 #ifdef HAVE_SOUNDCARD_H
 #include <sys/ioctl.h>
 static void adjust_volume(int delta)
@@ -1391,37 +2784,87 @@ static int update_status(sox_bool all_done, void * client_data)
     }
   }
 
+  read_control();
   display_status(all_done || user_abort);
+  export_metrics(all_done || user_abort);
   return (user_abort || user_restart_eff) ? SOX_EOF : SOX_SUCCESS;
 }
 
 static void optimize_trim(void)
 {
-  /* Speed hack.  If the "trim" effect is the first effect then peek inside its
-   * "effect descriptor" and see what the start location is.  This has to be
-   * done after its start() is called to have the correct location.  Also, only
-   * do this when only working with one input file.  This is because the logic
-   * to do it for multiple files is complex and probably never used.  The same
-   * is true for a restarted or additional effects chain (relative positioning
-   * within the file and possible samples still buffered in the input effect
-   * would have to be taken into account).  This hack is a huge time savings
-   * when trimming gigs of audio data into managable chunks.  */
+  /* Speed hack.  If a "trim" effect is preceded only by effects that alter
+   * neither rate nor length, and whose history is bounded (e.g. vol, remix,
+   * highpass), seek the input file to the trim's start, less that history,
+   * which the trim then discards (see sox_effects_chain_seek).  This has to be
+   * done after trim's start() is called to have the correct location, and for
+   * a chain that starts at the start of a serially read file: the first, or,
+   * with --combine sequence, one of another signal.  If another file follows,
+   * its length must be known, so that the trim may go on counting into it.
+   * A chain restarted part-way through a file is not sought (relative
+   * positioning within the file and samples still buffered in the input
+   * effect would have to be taken into account).  This hack is a huge time
+   * savings when trimming gigs of audio data into managable chunks.  */
+  sox_format_t * ft;
+  uint64_t wide;
+
+  if (!is_serial(combine_method) || current_input >= input_count)
+    return;
+  ft = files[current_input]->ft;
+  if (current_input + 1 < input_count && ft->signal.length == SOX_UNKNOWN_LEN)
+    return;
+  if (sox_effects_chain_seek(effects_chain, ft, &wide) == SOX_SUCCESS)
+    read_wide_samples = wide;
+}
+
+/* Similarly, if gain (or norm) is the first effect and is to scan the audio
+ * (e.g. gain -n), let it scan the (seekable) input file directly, then seek
+ * back, rather than spool the audio to a temporary file. */
+static void optimize_gain(void)
+{
+  char const * name;
+
   if (input_count == 1 && very_first_effchain && effects_chain->length > 1 &&
-      strcmp(effects_chain->effects[1][0].handler.name, "trim") == 0) {
-    if (files[0]->ft->handler.seek && files[0]->ft->seekable){
-      uint64_t offset = sox_trim_get_start(&effects_chain->effects[1][0]);
-      if (offset && sox_seek(files[0]->ft, offset, SOX_SEEK_SET) == SOX_SUCCESS) {
-        read_wide_samples = offset / files[0]->ft->signal.channels;
-        /* Assuming a failed seek stayed where it was.  If the seek worked then
-         * reset the start location of trim so that it thinks user didn't
-         * request a skip.  */
-        sox_trim_clear_start(&effects_chain->effects[1][0]);
-        lsx_debug("optimize_trim successful");
-      }
+      files[0]->volume == 1) {
+    name = effects_chain->effects[1][0].handler.name;
+    if (!strcmp(name, "gain") || !strcmp(name, "norm")) {
+      int result = sox_gain_scan(&effects_chain->effects[1][0], files[0]->ft);
+      if (result == SOX_SUCCESS)
+        lsx_debug("optimize_gain successful");
+      else if (result != SOX_EOF)
+        exit(2);
+    }
+  }
+}
+
+/* Likewise, if reverse is the first effect, have it read the (seekable) input
+ * file backwards, rather than store all of the audio. */
+static void optimize_reverse(void)
+{
+  if (input_count == 1 && very_first_effchain && effects_chain->length > 1 &&
+      files[0]->volume == 1 &&
+      !strcmp(effects_chain->effects[1][0].handler.name, "reverse")) {
+    int result = sox_reverse_from_file(&effects_chain->effects[1][0], files[0]->ft);
+    if (result == SOX_SUCCESS) {
+      read_wide_samples = files[0]->ft->signal.length / files[0]->ft->signal.channels;
+      lsx_debug("optimize_reverse successful");
     }
+    else if (result != SOX_EOF)
+      exit(2);
   }
 }
 
+/* Likewise, if repeat is the first effect, have it read the (seekable) input
+ * file again for each repeat, rather than store all of the audio. */
+static void optimize_repeat(void)
+{
+  if (input_count == 1 && very_first_effchain && effects_chain->length > 1 &&
+      files[0]->volume == 1 &&
+      !strcmp(effects_chain->effects[1][0].handler.name, "repeat") &&
+      sox_repeat_from_file(&effects_chain->effects[1][0], files[0]->ft) ==
+      SOX_SUCCESS)
+    lsx_debug("optimize_repeat successful");
+}
+
 static sox_bool overwrite_permitted(char const * filename)
 {
   char c;
@@ -1516,17 +2959,31 @@ static char *fndup_with_count(const char *filename, size_t count)
     return expand_fn;
 }
 
-static void open_output_file(void)
+/* Whether the comments of input file j, which its handler may leave unread
+ * (see sox_read_comments), are wanted: for replay gain, for its details to
+ * be shown, or, the first input's, for the output files */
+static sox_bool input_comments_wanted(size_t j)
+{
+  sox_format_handler_t const * handler = ofile->filetype?
+      sox_find_format(ofile->filetype, sox_false) : NULL;
+  sox_bool to_device = handler && (handler->flags & SOX_FILE_DEVICE);
+  sox_comments_t p = ofile->oob.comments;
+
+  if ((replay_gain_mode != RG_off && (replay_gain_mode != RG_default || is_player)) ||
+      sox_globals.verbosity > 2 || show_progress == sox_option_yes ||
+      (show_progress == sox_option_default && to_device))
+    return sox_true;
+  return !j && (tee_count || (!to_device && !(p && !**p)));
+}
+
+/* The out-of-band data for output file f: the first input file's, with
+ * comments as given for f; the caller is to delete the comments */
+static sox_oob_t output_oob(file_t const * f)
 {
   double factor;
   int i;
-  sox_comments_t p = ofile->oob.comments;
+  sox_comments_t p = f->oob.comments;
   sox_oob_t oob = files[0]->ft->oob;
-  char *expand_fn;
-
-  /* Skip opening file if we are not recreating output effect */
-  if (save_output_eff)
-    return;
 
   oob.comments = sox_copy_comments(files[0]->ft->oob.comments);
 
@@ -1549,29 +3006,505 @@ static void open_output_file(void)
     oob.loops[i].start = oob.loops[i].start * factor;
     oob.loops[i].length = oob.loops[i].length * factor;
   }
+  return oob;
+}
+
+static void open_output_file(void)
+{
+  sox_oob_t oob;
+  char *expand_fn;
+
+  /* Skip opening file if we are not recreating output effect */
+  if (save_output_eff)
+    return;
+
+  oob = output_oob(ofile);
+  if (output_method == sox_multiple || segment_time)
+    expand_fn = fndup_with_count(ofile->filename, ++output_count);
+  else
+    expand_fn = lsx_strdup(ofile->filename);
+  if (resume_point)  /* Carried on from where the checkpoint has it */
+    ofile->ft = sox_open_write_resume(expand_fn, &ofile->signal,
+        &ofile->encoding, ofile->filetype, &oob,
+        resume_point->out * ofile->signal.channels, resume_point->offset);
+  else ofile->ft = sox_open_write(expand_fn, &ofile->signal, &ofile->encoding,
+      ofile->filetype, &oob, overwrite_permitted);
+  sox_delete_comments(&oob.comments);
+  free(expand_fn);
+
+  if (!ofile->ft)
+    /* sox_open_write() will call lsx_warn for most errors.
+     * Rely on that printing something. */
+    exit(2);
+  if (segment_time && ((ofile->ft->handler.flags &
+          (SOX_FILE_DEVICE | SOX_FILE_PHONY)) || !strcmp(ofile->filename, "-"))) {
+    lsx_fail("--segment-time: the output must be to files");
+    exit(1);
+  }
+  if (ofile->io_async)
+    sox_set_io_async(ofile->ft, ofile->io_async);
+
+  /* If whether to enable the progress display (similar to that of ogg123) has
+   * not been specified by the user, auto turn on when outputting to an audio
+   * device: */
+  if (show_progress == sox_option_default)
+    show_progress = (ofile->ft->handler.flags & SOX_FILE_DEVICE) != 0 &&
+                    (ofile->ft->handler.flags & SOX_FILE_PHONY) == 0;
+
+  report_file_info(ofile);
+}
+
+/* Open the --tee outputs (once, for all output files), to be written with
+ * the output file's signal, and its encoding unless given otherwise */
+static void open_tee_files(void)
+{
+  size_t i;
+
+  for (i = 0; i < tee_count; ++i) if (!tees[i]->ft) {
+    file_t * f = tees[i];
+    sox_signalinfo_t signal = ofile->ft->signal;
+    sox_encodinginfo_t t = f->encoding;
+    sox_oob_t oob = output_oob(f);
+
+    if ((f->signal.rate && f->signal.rate != signal.rate) ||
+        (f->signal.channels && f->signal.channels != signal.channels)) {
+      lsx_fail("`%s': a --tee output must have the same rate and channels as `%s'",
+          f->filename, ofile->filename);
+      exit(1);
+    }
+    if (!t.encoding)
+      t.encoding = ofile->ft->encoding.encoding;
+    if (!t.bits_per_sample)
+      t.bits_per_sample = ofile->ft->encoding.bits_per_sample;
+    if (sox_format_supports_encoding(f->filename, f->filetype, &t))
+      f->encoding = t;
+    f->ft = sox_open_write(f->filename, &signal, &f->encoding, f->filetype,
+        &oob, overwrite_permitted);
+    sox_delete_comments(&oob.comments);
+    if (!f->ft)
+      exit(2);
+    if (f->io_async)
+      sox_set_io_async(f->ft, f->io_async);
+    report_file_info(f);
+  }
+}
+
+/* --split: segments of the output, listed in a file (a line each: START END
+ * FILENAME, END being - for the end of the audio), each written to a file of
+ * its own as the one pass reaches it; they may overlap.  They are written
+ * on a branch of the chain (as the --tee outputs), so that, with threads,
+ * their files are opened, encoded and closed alongside the processing. */
+#define SPLIT_BUFFERS 16
+
+typedef struct {
+  uint64_t pos;         /* Output samples per channel so far */
+  size_t first, next;   /* splits[first..next) have been opened */
+} split_priv_t;
+
+static int split_cmp(void const * a, void const * b)
+{
+  uint64_t x = ((split_t const *)a)->start, y = ((split_t const *)b)->start;
+  return x < y? -1 : x > y;
+}
+
+static void read_split_list(sox_rate_t rate)
+{
+  FILE * file = fopen(split_list, "r");
+  char line[FILENAME_MAX + 128];
+  unsigned n;
+
+  if (!file) {
+    lsx_fail("--split: can't open `%s': %s", split_list, strerror(errno));
+    exit(1);
+  }
+  for (n = 1; fgets(line, (int)sizeof(line), file); ++n) {
+    char const * s = line + strspn(line, " \t\r\n");
+    split_t sp;
+    size_t len = 0;
+
+    if (!*s || *s == '#')
+      continue;
+    memset(&sp, 0, sizeof(sp));
+    if (!(s = lsx_parsesamples(rate, s, &sp.start, 't')) ||
+        !strchr(" \t", *s) || !*s)
+      s = NULL;
+    else if (*(s += strspn(s, " \t")) == '-' && s[1] && strchr(" \t", s[1]))
+      ++s;
+    else if (!(s = lsx_parsesamples(rate, s, &sp.end, 't')) ||
+        !*s || !strchr(" \t", *s) || sp.end <= sp.start)
+      s = NULL;
+    if (s) {
+      s += strspn(s, " \t");
+      for (len = strlen(s); len && strchr(" \t\r\n", s[len - 1]); --len);
+    }
+    if (!s || !len) {
+      lsx_fail("--split: `%s' line %u: expected START END FILENAME",
+          split_list, n);
+      exit(1);
+    }
+    sp.filename = lsx_malloc(len + 1);
+    memcpy(sp.filename, s, len);
+    sp.filename[len] = '\0';
+    lsx_revalloc(splits, split_count + 1);
+    splits[split_count++] = sp;
+  }
+  fclose(file);
+  qsort(splits, split_count, sizeof(*splits), split_cmp);
+}
+
+/* Opens a segment's file, encoded as the output file unless that is a null
+ * one (-n), in which case as the input */
+static void open_split(split_t * sp, sox_signalinfo_t const * signal)
+{
+  sox_signalinfo_t s = *signal;
+  sox_encodinginfo_t e, t = (ofile->ft->handler.flags & SOX_FILE_PHONY)?
+    combiner_encoding : ofile->ft->encoding;
+  sox_oob_t oob = output_oob(ofile);
+
+  sox_init_encodinginfo(&e);
+  if (sox_format_supports_encoding(sp->filename, NULL, &t))
+    e.encoding = t.encoding, e.bits_per_sample = t.bits_per_sample;
+  s.length = sp->end? (sp->end - sp->start) * s.channels : SOX_UNSPEC;
+  sp->ft = sox_open_write(sp->filename, &s, &e, NULL, &oob,
+      overwrite_permitted);
+  sox_delete_comments(&oob.comments);
+  if (!sp->ft) {
+    sp->done = split_failed = sox_true;
+    lsx_fail("--split: can't open `%s'", sp->filename);
+  }
+}
+
+static void close_split(split_t * sp)
+{
+  if (sp->ft->clips)
+    lsx_warn("`%s' output clipped %" PRIu64 " samples; decrease volume?",
+        sp->ft->filename, sp->ft->clips);
+  sox_close(sp->ft);
+  sp->ft = NULL;
+  sp->done = sox_true;
+}
+
+static int split_flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  split_priv_t * p = (split_priv_t *)effp->priv;
+  unsigned chans = effp->in_signal.channels;
+  uint64_t end = p->pos + *isamp / chans;
+  size_t i;
+
+  (void)obuf;
+  *osamp = 0;
+  for (; p->next < split_count && splits[p->next].start < end; ++p->next)
+    if (!splits[p->next].done)
+      open_split(&splits[p->next], &effp->in_signal);
+  for (i = p->first; i < p->next; ++i) {
+    split_t * sp = &splits[i];
+    uint64_t from = max(sp->start, p->pos);
+    uint64_t to = sp->end? min(sp->end, end) : end;
+    size_t n = to > from? (size_t)(to - from) * chans : 0;
+
+    if (!sp->ft)
+      continue;
+    if (n && sox_write(sp->ft, ibuf + (size_t)(from - p->pos) * chans, n) != n) {
+      lsx_fail("`%s' %s: %s", sp->ft->filename, sp->ft->sox_errstr,
+          sox_strerror(sp->ft->sox_errno));
+      split_failed = sox_true;
+      close_split(sp);
+    }
+    else if (sp->end && sp->end <= end)
+      close_split(sp);
+  }
+  while (p->first < p->next && !splits[p->first].ft)
+    ++p->first;
+  p->pos = end;
+  if (p->first == split_count)
+    splits_done = sox_true;
+  return SOX_SUCCESS;
+}
+
+static int split_stop(sox_effect_t * effp)
+{
+  split_priv_t * p = (split_priv_t *)effp->priv;
+  size_t i;
+
+  for (i = p->first; i < p->next; ++i)
+    if (splits[i].ft)
+      close_split(&splits[i]);
+  for (; i < split_count; ++i)
+    if (!splits[i].done)
+      lsx_warn("--split: `%s' starts after the end of the audio",
+          splits[i].filename);
+  return SOX_SUCCESS;
+}
+
+static sox_effect_handler_t const * split_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"split", 0, SOX_EFF_MCHAN |
+    SOX_EFF_MODIFY | SOX_EFF_PREC, NULL, NULL, split_flow, NULL, split_stop,
+    NULL, sizeof(split_priv_t), NULL, NULL, NULL, NULL
+  };
+  return &handler;
+}
+
+/* Branch the chain, at the output effect, to the --split segments */
+static void add_split(sox_effects_chain_t * chain, sox_signalinfo_t * signal)
+{
+  sox_effects_chain_t * branch;
+  sox_signalinfo_t branch_signal = *signal;
+  sox_effect_t * effp;
+
+  if (!split_list)
+    return;
+  if (!splits)
+    read_split_list(signal->rate);
+  if (!(branch = sox_add_branch(chain, NULL)))
+    exit(2);
+  effp = sox_create_effect(split_effect_fn());
+  if (sox_add_effect(branch, effp, &branch_signal, &branch_signal) != SOX_SUCCESS)
+    exit(2);
+  free(effp);
+  if (sox_version_info()->flags & sox_version_have_threads)
+    sox_set_branch_async(chain, branch, (size_t)SPLIT_BUFFERS);
+}
+
+/* --segment-time: the output is cut into segments of SECONDS (the last may
+ * be shorter) at exact samples, segment k (from 0) starting at sample
+ * k * SECONDS * rate, rounded; each is written to a file of its own, named as
+ * with `newfile' (%n in the output filename, else a count before its
+ * extension), and a playlist of them (--playlist): HLS or, for .mpd, DASH.
+ * The output effect gathers the audio of as many segments as there are
+ * threads (with --multi-threaded), then these are encoded at once, each by
+ * an encoder of its own; the first segment is to the output file as opened.
+ * Encoders that prime record that in each file (sox_globals.gapless), so
+ * that every segment decodes to just its own samples. */
+static uint64_t segment_start(size_t k)
+{
+  return (uint64_t)(k * segment_time * ofile->ft->signal.rate + .5);
+}
+
+static size_t segment_threads(void)
+{
+  return !sox_globals.use_threads? 1 : sox_globals.threads?
+    sox_globals.threads : (size_t)omp_get_max_threads();
+}
+
+static void encode_segment(stream_seg_t * s, sox_sample_t const * buf)
+{
+  size_t n = (size_t)s->length * ofile->ft->signal.channels;
+
+  if (s->ft && n && sox_write(s->ft, buf, n) != n)
+    s->failed = sox_true;
+  else if (s->ft && s->ft != ofile->ft) { /* Not flushed before it's closed */
+    if (s->ft->clips)
+      lsx_warn("`%s' output clipped %" PRIu64 " samples; decrease volume?",
+          s->ft->filename, s->ft->clips);
+    s->failed = sox_close(s->ft) != SOX_SUCCESS;
+    s->ft = NULL;
+  }
+}
+
+/* Encodes the next n segments from seg_audio; if last, the last of them is
+ * what remains of it */
+static void encode_segments(size_t n, sox_bool last)
+{
+  sox_signalinfo_t signal = ofile->ft->signal;
+  unsigned chans = signal.channels;
+  uint64_t from = segment_start(stream_seg_count), end = from;
+  size_t i, threads = min(n, segment_threads());
+  size_t * offset = lsx_malloc(n * sizeof(*offset));
+
+  lsx_revalloc(stream_segs, stream_seg_count + n);
+  for (i = 0; i < n; ++i) {
+    size_t k = stream_seg_count + i;
+    stream_seg_t * s = &stream_segs[k];
+    uint64_t start = end;
+    sox_oob_t oob;
+
+    end = last && i == n - 1? from + seg_audio_len / chans : segment_start(k + 1);
+    memset(s, 0, sizeof(*s));
+    offset[i] = (size_t)(start - from) * chans;
+    s->length = end - start;
+    s->filename = fndup_with_count(ofile->filename, k + 1);
+    if (!k) {
+      s->ft = ofile->ft;
+      continue;
+    }
+    oob = output_oob(ofile);
+    signal.length = s->length * chans;
+    s->ft = sox_open_write(s->filename, &signal, &ofile->ft->encoding,
+        ofile->filetype, &oob, overwrite_permitted);
+    sox_delete_comments(&oob.comments);
+    if (!s->ft) {
+      lsx_fail("--segment-time: can't open `%s'", s->filename);
+      s->failed = sox_true;
+    }
+  }
+  if (threads > 1) {
+    #pragma omp parallel for schedule(dynamic) num_threads((int)threads)
+    for (i = 0; i < n; ++i)
+      encode_segment(&stream_segs[stream_seg_count + i], seg_audio + offset[i]);
+  }
+  else for (i = 0; i < n; ++i)
+    encode_segment(&stream_segs[stream_seg_count + i], seg_audio + offset[i]);
+  for (i = 0; i < n; ++i) {
+    stream_seg_t * s = &stream_segs[stream_seg_count + i];
+    if (s->failed && s->ft) {
+      lsx_fail("`%s' %s: %s", s->ft->filename, s->ft->sox_errstr,
+          sox_strerror(s->ft->sox_errno));
+      if (s->ft != ofile->ft)
+        sox_close(s->ft);
+    }
+    segment_failed |= s->failed;
+  }
+  free(offset);
+  seg_audio_len -= (size_t)(end - from) * chans;
+  memmove(seg_audio, seg_audio + (size_t)(end - from) * chans,
+      seg_audio_len * sizeof(*seg_audio));
+  stream_seg_count += n;
+}
 
-  if (output_method == sox_multiple)
-    expand_fn = fndup_with_count(ofile->filename, ++output_count);
-  else
-    expand_fn = lsx_strdup(ofile->filename);
-  ofile->ft = sox_open_write(expand_fn, &ofile->signal, &ofile->encoding,
-      ofile->filetype, &oob, overwrite_permitted);
-  sox_delete_comments(&oob.comments);
-  free(expand_fn);
+static sox_bool gather_segments(sox_sample_t const * ibuf, size_t n)
+{
+  unsigned chans = ofile->ft->signal.channels;
+  size_t batch = segment_threads();
+
+  if (!n)
+    return !segment_failed;
+  if (seg_audio_len + n > seg_audio_max) {
+    seg_audio_max = max(seg_audio_len + n, 2 * seg_audio_max);
+    lsx_revalloc(seg_audio, seg_audio_max);
+  }
+  memcpy(seg_audio + seg_audio_len, ibuf, n * sizeof(*ibuf));
+  seg_audio_len += n;
+  while (!segment_failed && (segment_start(stream_seg_count + batch) -
+        segment_start(stream_seg_count)) * chans <= seg_audio_len)
+    encode_segments(batch, sox_false);
+  return !segment_failed;
+}
 
-  if (!ofile->ft)
-    /* sox_open_write() will call lsx_warn for most errors.
-     * Rely on that printing something. */
-    exit(2);
+/* Encodes the segments that remain after the output effect's last flow */
+static void finish_segments(void)
+{
+  unsigned chans = ofile->ft->signal.channels;
+  uint64_t from = segment_start(stream_seg_count);
+  size_t n = 0;
+
+  while ((segment_start(stream_seg_count + n + 1) - from) * chans < seg_audio_len)
+    ++n;
+  if (!segment_failed && (seg_audio_len || !stream_seg_count))
+    encode_segments(n + 1, sox_true);
+  free(seg_audio);
+  seg_audio = NULL;
+  seg_audio_len = seg_audio_max = 0;
+}
 
-  /* If whether to enable the progress display (similar to that of ogg123) has
-   * not been specified by the user, auto turn on when outputting to an audio
-   * device: */
-  if (show_progress == sox_option_default)
-    show_progress = (ofile->ft->handler.flags & SOX_FILE_DEVICE) != 0 &&
-                    (ofile->ft->handler.flags & SOX_FILE_PHONY) == 0;
+/* The output filename without %n, and with extension ext instead of its own */
+static char * default_playlist(char const * ext)
+{
+  char const * fn = ofile->filename, * end = fn + strlen(fn), * dot = end;
+  char * name = lsx_malloc(strlen(fn) + strlen(ext) + sizeof("playlist"));
+  char * n = name;
+
+  while (dot > fn && *dot != '.' && *dot != '/')
+    --dot;
+  if (*dot == '.')
+    end = dot;
+  while (fn < end) {
+    if (fn[0] == '%' && fn[1] >= '1' && fn[1] <= '9' && fn[2] == 'n')
+      fn += 3;
+    else if (fn[0] == '%' && fn[1] == 'n')
+      fn += 2;
+    else *n++ = *fn++;
+  }
+  while (n > name && strchr("-_.", n[-1]))
+    --n;
+  if (n == name || n[-1] == '/')
+    strcpy(n, "playlist"), n += strlen(n);
+  strcpy(n, ext);
+  return name;
+}
 
-  report_file_info(ofile);
+static void fputs_xml(char const * s, FILE * f)
+{
+  for (; *s; ++s) switch (*s) {
+    case '&': fputs("&amp;", f); break;
+    case '<': fputs("&lt;", f); break;
+    case '>': fputs("&gt;", f); break;
+    case '"': fputs("&quot;", f); break;
+    default: putc(*s, f);
+  }
+}
+
+/* Writes the playlist of segments of the given signal and file type; they
+ * are given relative to its directory */
+static void write_playlist(sox_signalinfo_t const * signal, char const * type)
+{
+  sox_rate_t rate = signal->rate;
+  char const * slash = strrchr(playlist, '/');
+  size_t dir_len = slash? (size_t)(slash - playlist + 1) : 0, i;
+  size_t len = strlen(playlist);
+  sox_bool dash = len > 4 && !strcasecmp(playlist + len - 4, ".mpd");
+  double longest = 0, bandwidth = 0;
+  uint64_t total = 0;
+  FILE * f = fopen(playlist, "w");
+
+  if (!f) {
+    lsx_fail("--playlist: can't create `%s': %s", playlist, strerror(errno));
+    segment_failed = sox_true;
+    return;
+  }
+  for (i = 0; i < stream_seg_count; ++i) {
+    stream_seg_t const * s = &stream_segs[i];
+    struct stat st;
+
+    longest = max(longest, s->length / rate);
+    total += s->length;
+    if (s->length && !stat(s->filename, &st))
+      bandwidth = max(bandwidth, 8. * st.st_size * rate / s->length);
+  }
+  if (dash) {
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"static\"\n"
+        "    profiles=\"urn:mpeg:dash:profile:full:2011\"\n"
+        "    mediaPresentationDuration=\"PT%.3fS\" minBufferTime=\"PT%.3fS\">\n"
+        "  <Period>\n"
+        "    <AdaptationSet contentType=\"audio\" mimeType=\"audio/%s\">\n"
+        "      <Representation id=\"1\" bandwidth=\"%.0f\" audioSamplingRate=\"%.0f\">\n"
+        "        <AudioChannelConfiguration schemeIdUri=\"urn:mpeg:dash:23003:3:audio_channel_configuration:2011\" value=\"%u\"/>\n"
+        "        <SegmentList timescale=\"%.0f\">\n"
+        "          <SegmentTimeline>\n",
+        total / rate, longest,
+        !strcmp(type, "mp3") || !strcmp(type, "mp2")? "mpeg" : type,
+        ceil(bandwidth), rate, signal->channels, rate);
+    for (total = i = 0; i < stream_seg_count; total += stream_segs[i++].length)
+      fprintf(f, "            <S t=\"%" PRIu64 "\" d=\"%" PRIu64 "\"/>\n",
+          total, stream_segs[i].length);
+    fputs("          </SegmentTimeline>\n", f);
+    for (i = 0; i < stream_seg_count; ++i) {
+      char const * name = stream_segs[i].filename;
+      fputs("          <SegmentURL media=\"", f);
+      fputs_xml(strncmp(name, playlist, dir_len)? name : name + dir_len, f);
+      fputs("\"/>\n", f);
+    }
+    fputs("        </SegmentList>\n      </Representation>\n"
+        "    </AdaptationSet>\n  </Period>\n</MPD>\n", f);
+  }
+  else {
+    fprintf(f, "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%.0f\n"
+        "#EXT-X-MEDIA-SEQUENCE:0\n#EXT-X-PLAYLIST-TYPE:VOD\n", ceil(longest));
+    for (i = 0; i < stream_seg_count; ++i) {
+      char const * name = stream_segs[i].filename;
+      fprintf(f, "#EXTINF:%.6f,\n%s\n", stream_segs[i].length / rate,
+          strncmp(name, playlist, dir_len)? name : name + dir_len);
+    }
+    fputs("#EXT-X-ENDLIST\n", f);
+  }
+  if (fclose(f)) {
+    lsx_fail("--playlist: error writing `%s': %s", playlist, strerror(errno));
+    segment_failed = sox_true;
+  }
+  else lsx_report("%" PRIuPTR " segments, listed in `%s'", stream_seg_count,
+      playlist);
 }
 
 static void sigint(int s)
@@ -1717,6 +3650,13 @@ static void calculate_output_signal_parameters(void)
   ofile->signal.length = (uint64_t)(olen * ofile->signal.channels * ofile->signal.rate / combiner_signal.rate + .5);
 }
 
+static sox_bool is_sox_format(file_t const * f)
+{
+  char const * type = f->filetype? f->filetype :
+    lsx_find_file_extension(f->filename);
+  return type && !strcasecmp(type, "sox");
+}
+
 static void set_combiner_and_output_encoding_parameters(void)
 {
   /* The input encoding parameters passed to the effects chain are those of
@@ -1727,6 +3667,12 @@ static void set_combiner_and_output_encoding_parameters(void)
    * if given: */
   ofile->encoding = ofile_encoding_options;
 
+  /* A .sox file holds float32 samples (which an older SoX can't read) only if
+   * asked to, or if it is a sox pipe (-p) from the float chain: */
+  if (!ofile->encoding.encoding && is_sox_format(ofile))
+    ofile->encoding.encoding = sox_globals.float_chain &&
+      !strcmp(ofile->filename, "-")? SOX_ENCODING_FLOAT : SOX_ENCODING_SIGN2;
+
   /* Get unspecified output file encoding attributes from the input file and
    * set the output file to the resultant encoding if this is supported by the
    * output file type; if not, the output file handler should select an
@@ -1742,24 +3688,937 @@ static void set_combiner_and_output_encoding_parameters(void)
   }
 }
 
+/* --segments: the input file, if long enough, is divided into up to
+ * `segments' consecutive segments, each processed at once by a process of
+ * its own.  A process starts reading some way before its segment (the
+ * chain's history, so that by the segment the effects are as if they had
+ * been given all the audio before it) and stops some way after it (the
+ * chain's history and latency, so that the segment's output is complete
+ * before the effects are drained); the output from outside the segment is
+ * discarded.  Segments start where input and output samples coincide, so
+ * that, but for floating-point rounding, the output is as if unsegmented.
+ * The first segment is processed here, into the output file; the others
+ * into temporary files, appended to the output file in turn.  An analysis
+ * effect that can give partial results (e.g. stats; see sox_effect_save)
+ * covers just its process's segment, and the partial results of the others
+ * are merged into it here, in turn, before it reports.
+ *
+ * With --manifest, the segments are only planned, in a file from which each
+ * may then be rendered (sox --render), e.g. on a machine of its own, to a
+ * part file, and the parts joined into the output file (sox --stitch). */
+
+typedef struct {
+  uint64_t from, start, end; /* Input: read from, the segment's start & end */
+  uint64_t read_end;         /* Input: read to; 0: to the end */
+  uint64_t skip, length;     /* Output: to discard, to give; 0: all */
+} segment_t;
+
+typedef struct {
+  unsigned n;                     /* Number of segments */
+  uint64_t s[MAX_SEGMENTS + 1];   /* Their starts, and the end, in the input */
+  uint64_t pre, post;             /* Input to read before & after each */
+  uint64_t grid, per;             /* Input & output samples that coincide */
+} segments_t;
+
+static uint64_t gcd(uint64_t a, uint64_t b)
+{
+  while (b) {
+    uint64_t t = a % b;
+    a = b, b = t;
+  }
+  return a;
+}
+
+/* Is the encoding plain enough for a seek to land on exactly the sample
+ * asked for, and for decoding then encoding to give back the same data? */
+static sox_bool is_exact_encoding(sox_encoding_t encoding)
+{
+  switch (encoding) {
+    case SOX_ENCODING_SIGN2: case SOX_ENCODING_UNSIGNED:
+    case SOX_ENCODING_FLOAT: case SOX_ENCODING_ULAW: case SOX_ENCODING_ALAW:
+    case SOX_ENCODING_FLAC:
+      return sox_true;
+    default: return sox_false;
+  }
+}
+
+/* Can the effect give a partial result of its analysis of a segment? */
+static sox_bool gives_partial(sox_effect_t * effp)
+{
+  size_t len;
+  void * partial = effp->in_signal.rate == combiner_signal.rate?
+    sox_effect_save(effp, &len) : NULL;
+
+  free(partial);
+  return partial != NULL;
+}
+
+/* As sox_effects_chain_history, but if analyses (whose partial results are
+ * to be merged) are allowed, that of their analysis for effects that give
+ * partial results */
+static double segments_history(sox_bool analyses)
+{
+  double history = 0;
+  size_t e;
+
+  for (e = 0; e < effects_chain->length; ++e) {
+    sox_effect_t * effp = effects_chain->effects[e];
+    history += analyses && effp->history == HUGE_VAL && gives_partial(effp)?
+      effp->span_history : effp->history;
+  }
+  return history;
+}
+
+/* Can the output be got by processing the input in parts, each with the
+ * pre-roll (and post-roll) in g, to give the same output as at once?
+ * Returns why not, or NULL. */
+static char const * check_segments(segments_t * g, sox_bool analyses)
+{
+  sox_format_t * ft = files[0]->ft;
+  double ri = combiner_signal.rate, ro = ofile->ft->signal.rate;
+  double history = segments_history(analyses);
+  double latency = sox_effects_chain_latency(effects_chain);
+  size_t e;
+
+  for (e = 1; e + 1 < effects_chain->length &&
+      !(effects_chain->effects[e][0].handler.flags & SOX_EFF_LENGTH); ++e);
+  if (input_count != 1 || !is_serial(combine_method))
+    return "there is more than one input file";
+  if (!is_exact_encoding(ft->encoding.encoding) || !ft->seekable ||
+      !ft->handler.seek)
+    return "the input file is not exactly seekable";
+  if (tee_count || split_list || is_player || interactive ||
+      (ofile->ft->handler.flags & (SOX_FILE_DEVICE | SOX_FILE_PHONY)) ==
+      SOX_FILE_DEVICE)
+    return "the output is not to a file alone";
+  if (e + 1 < effects_chain->length)
+    return "an effect may alter the audio's length";
+  if (history == HUGE_VAL)
+    return "an effect's history is unbounded (or unknown)";
+  if (ri != floor(ri) || ro != floor(ro) || ri < 1 || ro < 1)
+    return "a sample-rate is not an integer";
+
+  g->grid = (uint64_t)ri / gcd((uint64_t)ri, (uint64_t)ro);
+  g->per = (uint64_t)ro / gcd((uint64_t)ri, (uint64_t)ro);
+  /* Pre-roll, and post-roll (which also covers rounding), in whole grids: */
+  g->pre  = (uint64_t)ceil(history * ri / g->grid) * g->grid;
+  g->post = (uint64_t)ceil((history + latency) * ri / g->grid) * g->grid;
+  return NULL;
+}
+
+/* Divides the input left to read into segments; returns why it can't be,
+ * or NULL. */
+static char const * plan_segments(segments_t * g, sox_bool analyses)
+{
+  uint64_t len = input_wide_samples - min(read_wide_samples, input_wide_samples);
+  uint64_t whole;
+  char const * why = check_segments(g, analyses);
+  double min_len;
+  unsigned k;
+
+  if (why)
+    return why;
+  if (!len)
+    return "the length of the input left to read is not known";
+  whole = (len + g->grid - 1) / g->grid * g->grid;
+  g->pre = min(g->pre, whole);
+  g->post = min(g->post, whole);
+  /* Each segment to be worth a process: at least 1s, & 4x its overheads */
+  min_len = max(combiner_signal.rate, 4. * (g->pre + g->post + g->grid));
+  g->n = (unsigned)min(segments, floor(len / min_len));
+  if (g->n < 2)
+    return "the input is too short";
+  for (k = 0; k < g->n; ++k)
+    g->s[k] = read_wide_samples + len / g->grid * k / g->n * g->grid;
+  g->s[g->n] = read_wide_samples + len;
+  return NULL;
+}
+
+static segment_t get_segment(segments_t const * g, unsigned k)
+{
+  segment_t seg;
+  sox_bool last = k + 1 == g->n;
+
+  seg.start = g->s[k];
+  seg.end = g->s[k + 1];
+  seg.from = seg.start - min(g->pre, seg.start - g->s[0]);
+  seg.read_end = last? 0 : min(seg.end + g->post, g->s[g->n]);
+  seg.skip = (seg.start - seg.from) / g->grid * g->per;
+  seg.length = last? 0 : (seg.end - seg.start) / g->grid * g->per;
+  return seg;
+}
+
+/* Has the input file (at read_wide_samples) and the output limited to the
+ * segment */
+static sox_bool start_segment(sox_format_t * ft, segment_t const * seg)
+{
+  if (seg->from != read_wide_samples &&
+      sox_seek(ft, seg->from * ft->signal.channels, SOX_SEEK_SET) != SOX_SUCCESS) {
+    lsx_fail("`%s': can't seek to sample %" PRIu64, ft->filename, seg->from);
+    return sox_false;
+  }
+  read_wide_samples = seg->from;
+  read_limit = seg->read_end;
+  output_skip = seg->skip;
+  output_left = seg->length? seg->length : UINT64_MAX;
+  return sox_true;
+}
+
+/* Has the analyses that give partial results (see plan_segments) cover
+ * just the segment */
+static void span_segment(segments_t const * g, segment_t const * seg)
+{
+  size_t e, f;
+
+  for (e = 0; e < effects_chain->length; ++e) {
+    sox_effect_t * effp = effects_chain->effects[e];
+    if (effp->handler.save && effp->history == HUGE_VAL)
+      for (f = 0; f < effp->flows; ++f) {
+        effp[f].span.lead_in = seg->start - seg->from;
+        effp[f].span.length = seg->read_end? seg->end - seg->start : 0;
+        effp[f].span.offset = seg->start - g->s[0];
+      }
+  }
+}
+
+/* After flowing, did the segment give all of its output? */
+static sox_bool end_segment(segment_t const * seg)
+{
+  sox_bool ok = seg->length? output_left == 0 : !output_eof;
+
+  read_limit = 0;
+  output_skip = 0;
+  output_left = UINT64_MAX;
+  current_input = input_count; /* As if the input had been read to its end */
+  input_eof = sox_true;
+  output_eof = sox_false;
+  return ok;
+}
+
+#ifdef HAVE_BATCH
+/* As lsx_tmpfile (which libSoX does not export): deleted on closing */
+static FILE * segment_tmpfile(void)
+{
+  char const * dir = sox_globals.tmp_path;
+  char * name;
+  FILE * fp = NULL;
+  int fd;
+
+  if (!dir || !*dir)
+    return tmpfile();
+  name = lsx_malloc(strlen(dir) + sizeof("/sox-XXXXXX"));
+  sprintf(name, "%s/sox-XXXXXX", dir);
+  if ((fd = mkstemp(name)) >= 0) {
+    unlink(name);
+    if (!(fp = fdopen(fd, "w+b")))
+      close(fd);
+  }
+  free(name);
+  return fp;
+}
+
+/* Counts passed back, after the samples and the analyses' partial results,
+ * from a segment's process: */
+#define SEGMENT_COUNTS (2 * effects_chain->length + 4)
+
+/* For a forked process, another reader of f's input, so as not to share the
+ * file offset of the one inherited: a clone of it, without parsing the header
+ * again, where the format allows; else the file opened afresh. */
+static sox_format_t * reopen_input(file_t * f)
+{
+  sox_format_t * ft = NULL;
+
+  if (f->ft && (f->ft->handler.flags & SOX_FILE_CLONE) && f->ft->seekable)
+    ft = sox_open_read_clone(f->ft);
+  return ft? ft : sox_open_read(f->filename, &f->signal, &f->encoding, f->filetype);
+}
+
+/* Run in a forked process: processes the segment to the temporary file fp;
+ * returns the process's exit status. */
+static int flow_segment(segment_t const * seg, FILE * fp)
+{
+  file_t * f = files[0];
+  uint64_t * counts;
+  size_t e, i;
+  sox_bool ok;
+
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  sox_globals.use_threads = sox_false; /* No OpenMP after fork; and no need */
+  show_progress = sox_option_no;
+
+  f->ft = reopen_input(f);
+  read_wide_samples = 0;
+  if (!f->ft || !start_segment(f->ft, seg))
+    return 1;
+  output_samples = 0;
+  segment_file = fp;
+  sox_flow_effects(effects_chain, NULL, NULL);
+  ok = end_segment(seg);
+
+  counts = lsx_calloc(SEGMENT_COUNTS, sizeof(*counts));
+  for (e = 0; e < effects_chain->length; ++e)
+    for (i = 0; i < effects_chain->effects[e][0].flows; ++i)
+      counts[e] += effects_chain->effects[e][i].clips;
+  counts[e++] = f->ft->clips;
+  counts[e++] = f->volume_clips;
+  counts[e++] = mixing_clips;
+  counts[e++] = output_samples;
+  for (i = 0; i < effects_chain->length; ++i, ++e) {
+    sox_effect_t * effp = effects_chain->effects[i];
+    if (effp->handler.save && effp->history == HUGE_VAL) {
+      size_t len = 0;
+      void * partial = sox_effect_save(effp, &len);
+      ok &= partial && fwrite(partial, (size_t)1, len, fp) == len;
+      counts[e] = len;
+      free(partial);
+    }
+  }
+  ok &= fwrite(counts, sizeof(*counts), e, fp) == e && !fflush(fp);
+  return !ok;
+}
+
+/* Appends a segment's output, from its temporary file, to the output file */
+static sox_bool append_segment(FILE * fp)
+{
+  size_t e, i, chans = ofile->ft->signal.channels, len;
+  size_t n = SEGMENT_COUNTS, max = max(sox_globals.bufsiz / chans, 1);
+  uint64_t * counts = lsx_malloc(n * sizeof(*counts)), left;
+  sox_sample_t * buf = lsx_malloc(max * chans * sizeof(*buf));
+  sox_bool ok = !fseek(fp, -(long)(n * sizeof(*counts)), SEEK_END) &&
+    fread(counts, sizeof(*counts), n, fp) == n && !fseek(fp, 0L, SEEK_SET);
+
+  if (ok) {
+    for (e = 0; e < effects_chain->length; ++e)
+      effects_chain->effects[e][0].clips += counts[e];
+    files[0]->ft->clips += counts[e++];
+    files[0]->volume_clips += counts[e++];
+    mixing_clips += counts[e++];
+    for (left = counts[e++]; ok && left; left -= len) {
+      len = (size_t)min(left, max);
+      ok = fread(buf, sizeof(*buf), len * chans, fp) == len * chans &&
+        sox_write(ofile->ft, buf, len * chans) == len * chans;
+      output_samples += len;
+    }
+    if (!ok && ofile->ft->sox_errno)
+      lsx_fail("`%s' %s: %s", ofile->ft->filename,
+          ofile->ft->sox_errstr, sox_strerror(ofile->ft->sox_errno));
+    for (i = 0; ok && i < effects_chain->length; ++i, ++e)
+      if (counts[e]) {
+        void * partial = lsx_malloc((size_t)counts[e]);
+        ok = fread(partial, (size_t)1, (size_t)counts[e], fp) == counts[e] &&
+          sox_effect_merge(effects_chain->effects[i], partial,
+              (size_t)counts[e]) == SOX_SUCCESS;
+        free(partial);
+      }
+  }
+  else lsx_fail("error reading temporary file: %s", strerror(errno));
+  free(buf);
+  free(counts);
+  return ok;
+}
+#endif
+
+static int flow_in_segments(void)
+{
+#ifdef HAVE_BATCH
+  segments_t g;
+  segment_t seg;
+  pid_t pid[MAX_SEGMENTS];
+  FILE * tmp[MAX_SEGMENTS];
+  char const * why = plan_segments(&g, sox_true);
+  unsigned k, started;
+  sox_bool ok;
+
+  if (why) {
+    lsx_warn("--segments: processing as one segment, as %s", why);
+    return sox_flow_effects(effects_chain, update_status, NULL);
+  }
+  for (k = 1; k < g.n; ++k)
+    if (!(tmp[k] = segment_tmpfile())) {
+      lsx_fail("can't create temporary file: %s", strerror(errno));
+      exit(2);
+    }
+  lsx_report("processing in %u segments; pre-roll %gs, post-roll %gs", g.n,
+      g.pre / combiner_signal.rate, g.post / combiner_signal.rate);
+  fflush(NULL); /* So that buffered output is not duplicated */
+  for (started = 1; started < g.n; ++started) {
+    seg = get_segment(&g, started);
+    span_segment(&g, &seg);
+    if ((pid[started] = fork()) == 0)
+      _exit(flow_segment(&seg, tmp[started]));
+    else if (pid[started] < 0) {
+      lsx_fail("can't start a process: %s", strerror(errno));
+      break;
+    }
+  }
+
+  seg = get_segment(&g, 0);
+  span_segment(&g, &seg);
+  ok = started == g.n && start_segment(files[0]->ft, &seg);
+  if (ok)
+    sox_flow_effects(effects_chain, update_status, NULL);
+  ok &= end_segment(&seg);
+  for (k = 1; k < started; ++k) {
+    int status;
+    if (!ok || user_abort)
+      kill(pid[k], SIGTERM);
+    if (waitpid(pid[k], &status, 0) != pid[k] || !WIFEXITED(status) ||
+        WEXITSTATUS(status)) {
+      if (ok && !user_abort)
+        lsx_fail("processing of segment %u failed", k + 1);
+      ok = sox_false;
+    }
+    if (ok && !user_abort) {
+      ok = append_segment(tmp[k]);
+      read_wide_samples = g.s[k + 1];
+      update_status(k + 1 == g.n, NULL);
+    }
+  }
+  for (k = 1; k < g.n; ++k)
+    fclose(tmp[k]);
+  if (!ok && !user_abort)
+    exit(2); /* Having failed part way through the output */
+  return user_abort? SOX_EOF : SOX_SUCCESS;
+#else
+  lsx_warn("--segments: processing as one segment, as processes can't be forked on this platform");
+  return sox_flow_effects(effects_chain, update_status, NULL);
+#endif
+}
+
+/* With --autotune, the buffer sizes (--buffer) tried, in samples, besides
+ * that given; and the input, in seconds, that each trial processes */
+static size_t const tune_bufsizs[] = {1024, 4096, 16384, 65536};
+#define TUNE_SECONDS 4
+
+/* The shape of the chain, as a tuning file's key: the input's signal, the
+ * user's effects, and the output's signal */
+static char * chain_shape(void)
+{
+  size_t i, n = nuser_effects[current_eff_chain], len = 64;
+  char * shape;
+
+  for (i = 0; i < n; ++i)
+    len += strlen(user_efftab[i]->handler.name) + 1;
+  shape = lsx_malloc(len);
+  len = sprintf(shape, "%ux%g", combiner_signal.channels, combiner_signal.rate);
+  for (i = 0; i < n; ++i)
+    len += sprintf(shape + len, " %s", user_efftab[i]->handler.name);
+  sprintf(shape + len, " %ux%g", ofile->ft->signal.channels,
+      ofile->ft->signal.rate);
+  return shape;
+}
+
+/* Finds shape's line (the last, if more than one) in the tuning file; a
+ * line is BUFFER THREADS SHAPE */
+static sox_bool read_tuning(char const * shape, size_t * bufsiz, sox_bool * threads)
+{
+  FILE * fp = fopen(tuning_filename, "r");
+  char line[1024];
+  sox_bool found = sox_false;
+
+  if (!fp)
+    return sox_false;
+  while (fgets(line, (int)sizeof(line), fp)) {
+    unsigned long b;
+    int t, n;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (sscanf(line, "%lu %d %n", &b, &t, &n) == 2 && !strcmp(line + n, shape) &&
+        b > SOX_BUFMIN)
+      *bufsiz = b, *threads = t != 0, found = sox_true;
+  }
+  fclose(fp);
+  return found;
+}
+
+static void write_tuning(char const * shape, size_t bufsiz, sox_bool threads)
+{
+  FILE * fp = fopen(tuning_filename, "a");
+
+  if (!fp || fprintf(fp, "%lu %d %s\n", (unsigned long)bufsiz, threads, shape) < 0 ||
+      fclose(fp))
+    lsx_warn("--autotune: can't write `%s': %s", tuning_filename, strerror(errno));
+}
+
+#ifdef HAVE_BATCH
+/* What a trial finds, as passed back from its process */
+typedef struct {
+  double   seconds;     /* Wall-clock time taken to flow the chain */
+  double   cpu, par;    /* CPU time of all effects, & of those with flows > 1 */
+  uint64_t samples;     /* Input wide samples read */
+  size_t   flows;       /* Most flows of an effect */
+} trial_t;
+
+/* Run in a forked process: builds the chain, with buffers of bufsiz, and
+ * flows the start of the input through it, the output discarded; writes
+ * what it finds to fp; returns the process's exit status. */
+static int tune_trial(size_t bufsiz, FILE * fp)
+{
+  file_t * f = files[0];
+  struct timeval then, now;
+  trial_t t;
+  size_t e;
+
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  sox_globals.use_threads = sox_false; /* No OpenMP after fork */
+  sox_globals.bufsiz = bufsiz;
+  sox_globals.profile = sox_true;      /* For the effects' CPU times */
+  show_progress = sox_option_no;
+
+  f->ft = reopen_input(f);
+  if (!f->ft || !(segment_file = fopen("/dev/null", "wb")))
+    return 1;
+  add_effects(effects_chain);
+  read_wide_samples = 0;
+  read_limit = (uint64_t)max(1, TUNE_SECONDS * combiner_signal.rate);
+  gettimeofday(&then, NULL);
+  sox_flow_effects(effects_chain, NULL, NULL);
+  gettimeofday(&now, NULL);
+
+  t.seconds = now.tv_sec - then.tv_sec + (now.tv_usec - then.tv_usec) / TIME_FRAC;
+  t.cpu = t.par = 0;
+  t.flows = 1;
+  for (e = 0; e < effects_chain->length; ++e) {
+    sox_effect_stats_t stats;
+    sox_effects_chain_stats(effects_chain, e, &stats);
+    t.cpu += stats.cpu_time;
+    if (effects_chain->effects[e][0].flows > 1)
+      t.par += stats.cpu_time;
+    t.flows = max(t.flows, effects_chain->effects[e][0].flows);
+  }
+  t.samples = read_wide_samples;
+  return fwrite(&t, sizeof(t), (size_t)1, fp) != 1 || fflush(fp);
+}
+
+static sox_bool run_trial(size_t bufsiz, trial_t * t)
+{
+  FILE * fp = segment_tmpfile();
+  sox_bool ok = sox_false;
+  int status;
+  pid_t pid;
+
+  if (!fp)
+    return sox_false;
+  fflush(NULL); /* So that buffered output is not duplicated */
+  if ((pid = fork()) == 0)
+    _exit(tune_trial(bufsiz, fp));
+  ok = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+    !WEXITSTATUS(status) && !fseek(fp, 0L, SEEK_SET) &&
+    fread(t, sizeof(*t), (size_t)1, fp) == 1 && t->samples;
+  fclose(fp);
+  return ok;
+}
+#endif
+
+/* With --autotune, before the chain is built: has it built with the buffer
+ * size (--buffer) with which it processed the start of the input fastest,
+ * and run with its channels processed in parallel (--multi-threaded) if the
+ * effects' CPU times (see --profile) show that to be worth it; the choice
+ * is kept in the tuning file, if any, for later runs of a chain of the same
+ * shape, which then use it as is. */
+static void tune_chain(void)
+{
+  char * shape = chain_shape();
+  size_t bufsiz = sox_globals.bufsiz, i, flows;
+  sox_bool threads = sox_globals.use_threads;
+  char const * why = NULL;
+
+  if (tuning_filename && read_tuning(shape, &bufsiz, &threads)) {
+    lsx_report("autotune: --buffer %lu%s, from `%s'", (unsigned long)bufsiz,
+        threads? " --multi-threaded" : "", tuning_filename);
+    sox_globals.bufsiz = bufsiz;
+    sox_globals.use_threads = threads;
+    free(shape);
+    return;
+  }
+  if (input_count != 1 || !is_serial(combine_method))
+    why = "there is more than one input file";
+  else if (files[0]->ft->io_type != lsx_io_file || !files[0]->ft->seekable)
+    why = "the input is not a seekable file";
+  else if (tee_count || split_list || segment_time || control_filename ||
+      render_cache_path || is_player || interactive ||
+      (ofile->ft->handler.flags & (SOX_FILE_DEVICE | SOX_FILE_PHONY)) ==
+      SOX_FILE_DEVICE)
+    why = "the output is not to a file alone";
+#ifdef HAVE_BATCH
+  if (!why) {
+    trial_t t, best;
+    double best_rate = 0;
+
+    for (i = 0; i <= array_length(tune_bufsizs); ++i) {
+      size_t b = i? tune_bufsizs[i - 1] : sox_globals.bufsiz;
+      double rate;
+      if (i && b == sox_globals.bufsiz)
+        continue;
+      if (!run_trial(b, &t)) {
+        why = "a trial run failed";
+        break;
+      }
+      rate = t.samples / max(t.seconds, 1e-6);
+      lsx_debug("autotune: --buffer %lu: %g samples/s", (unsigned long)b, rate);
+      /* Another size must be clearly faster than that given: */
+      if (!i || rate > best_rate * (bufsiz == sox_globals.bufsiz? 1.05 : 1))
+        best_rate = rate, best = t, bufsiz = b;
+    }
+    if (!why) {
+      /* Speed-up, by Amdahl's law, of processing the channels in parallel: */
+      double p = best.cpu > 0? best.par / best.cpu : 0, speedup;
+      long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+      flows = min(best.flows, (size_t)max(cpus, 1));
+      if (sox_globals.threads)
+        flows = min(flows, sox_globals.threads);
+      speedup = 1 / (1 - p + p / flows);
+#ifdef HAVE_OPENMP
+      threads = speedup >= 1.2;
+#else
+      threads = sox_false;
+#endif
+      lsx_report("autotune: --buffer %lu%s (%g samples/s; effects by channel "
+          "took %.0f%% of the CPU time, so threads would give at most %.2gx)",
+          (unsigned long)bufsiz, threads? " --multi-threaded" : "", best_rate,
+          p * 100, speedup);
+      sox_globals.bufsiz = bufsiz;
+      sox_globals.use_threads = threads;
+      if (tuning_filename)
+        write_tuning(shape, bufsiz, threads);
+    }
+  }
+#else
+  if (!why)
+    why = "processes can't be forked on this platform";
+#endif
+  if (why)
+    lsx_warn("--autotune: not tuning, as %s", why);
+  free(shape);
+}
+
+/* The manifest (see --manifest), as read for --render and --stitch */
+typedef struct {
+  char const * input, * output, * part[MAX_SEGMENTS];  /* Filenames */
+  uint64_t length;                /* Of the input, in wide samples */
+  double rates[2];                /* Of the input, and of the output */
+  unsigned n;                     /* Number of segments */
+  segment_t seg[MAX_SEGMENTS];
+  int argc;                       /* Arguments of the planning run of SoX */
+  char * * argv;
+  char * * lines;                 /* Of the file, holding the above */
+} manifest_t;
+
+static manifest_t * manifest = NULL; /* Set with --render */
+static char const * manifest_filename = NULL; /* --manifest */
+
+/* The file to which a segment is rendered: that of the output, with .partN
+ * inserted before any extension */
+static char * part_filename(char const * filename, unsigned k)
+{
+  char const * ext = strrchr(filename, '.'), * slash = LAST_SLASH(filename);
+  char * name = lsx_malloc(strlen(filename) + sizeof(".part") + 10);
+
+  if (!ext || (slash && ext < slash))
+    ext = filename + strlen(filename);
+  sprintf(name, "%.*s.part%u%s", (int)(ext - filename), filename, k, ext);
+  return name;
+}
+
+/* With --manifest: writes the plan of the segments, then exits (without
+ * having written the output file). */
+static void write_manifest(void)
+{
+  segments_t g;
+  char const * why = plan_segments(&g, sox_false);
+  FILE * fp;
+  unsigned k;
+  int i;
+
+  if (!why && (ofile->ft->io_type != lsx_io_file ||
+        !is_exact_encoding(ofile->ft->encoding.encoding)))
+    why = "the output is not a file with lossless (e.g. PCM) encoding";
+  for (i = 1; !why && i < sox_argc; ++i)
+    if (strchr(sox_argv[i], '\n'))
+      why = "an argument contains a new-line";
+  if (why) {
+    lsx_fail("can't plan segments, as %s", why);
+    exit(1);
+  }
+  if (!(fp = fopen(manifest_filename, "w"))) {
+    lsx_fail("can't create manifest `%s': %s", manifest_filename, strerror(errno));
+    exit(1);
+  }
+  fprintf(fp,
+    "# SoX segment manifest.  Render segment N (e.g. on a machine of its own)\n"
+    "# with `sox --render %s N', then join the parts with\n"
+    "# `sox --stitch %s'.\n"
+    "sox-manifest 1\n"
+    "# input LENGTH FILENAME; LENGTH in samples (per channel)\n"
+    "input %" PRIu64 " %s\n"
+    "# rates INPUT OUTPUT\n"
+    "rates %.17g %.17g\n"
+    "output %s\n"
+    "# The arguments of SoX, one per line:\n",
+    manifest_filename, manifest_filename, input_wide_samples, files[0]->filename,
+    combiner_signal.rate, ofile->ft->signal.rate, ofile->filename);
+  for (i = 1; i < sox_argc; ++i)
+    fprintf(fp, "arg %s\n", sox_argv[i]);
+  fprintf(fp,
+    "# segment N FROM START END TO SKIP LENGTH PART: input is read from FROM\n"
+    "# (START less the pre-roll) to TO (0: to the end); of the output, SKIP\n"
+    "# samples are discarded and LENGTH (0: the rest) kept, which are those\n"
+    "# of input START to END.\n");
+  for (k = 0; k < g.n; ++k) {
+    segment_t seg = get_segment(&g, k);
+    char * part = part_filename(ofile->filename, k + 1);
+    fprintf(fp, "segment %u %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+        " %" PRIu64 " %" PRIu64 " %s\n", k + 1, seg.from, seg.start, seg.end,
+        seg.read_end, seg.skip, seg.length, part);
+    free(part);
+  }
+  if (fclose(fp)) {
+    lsx_fail("error writing manifest `%s': %s", manifest_filename, strerror(errno));
+    exit(1);
+  }
+  lsx_report("planned %u segments in `%s'", g.n, manifest_filename);
+  /* The output file was opened only to set up the effects chain: */
+  sox_close(ofile->ft);
+  ofile->ft = NULL;
+  unlink(ofile->filename);
+  exit(0);
+}
+
+/* With --render: processes the segment to its part file */
+static int flow_rendered_segment(void)
+{
+  segment_t const * seg = &manifest->seg[manifest->n - 1];
+
+  if (input_count != 1 || input_wide_samples != manifest->length ||
+      combiner_signal.rate != manifest->rates[0] ||
+      ofile->ft->signal.rate != manifest->rates[1]) {
+    lsx_fail("`%s' or its processing differs from that planned in the manifest",
+        files[0]->filename);
+    exit(1);
+  }
+  if (!start_segment(files[0]->ft, seg))
+    exit(2);
+  sox_flow_effects(effects_chain, update_status, NULL);
+  if (!end_segment(seg) && !user_abort) {
+    lsx_fail("segment %u is incomplete", manifest->n);
+    exit(2);
+  }
+  return user_abort? SOX_EOF : SOX_SUCCESS;
+}
+
+/* With --checkpoint, every checkpoint_interval seconds, the point that the
+ * output file has safely reached (flushed to the storage) is recorded, with
+ * the arguments of SoX, in checkpoint_filename.  If the processing is cut
+ * short (e.g. its machine lost), `sox --resume FILENAME' carries on from the
+ * point: the output file is cut back to it and written on from there (see
+ * sox_open_write_resume); the effects are brought back to their state there
+ * as a segment's are (see --segments), by reading the input from the point
+ * less the pre-roll that their history needs, and discarding the output of
+ * the pre-roll.  So the point is taken on the grid on which input and output
+ * samples coincide.  On success, the file is removed. */
+
+static segments_t checkpoint_grid;  /* Its grid and pre-roll */
+static uint64_t checkpoint_start;   /* Input: where the output starts */
+
+/* Readies --checkpoint, or turns it off if it can't be done */
+static void start_checkpoints(void)
+{
+  sox_format_t * ft = ofile->ft;
+  char const * why = check_segments(&checkpoint_grid, sox_false);
+  int i;
+
+  if (!why && (ft->io_type != lsx_io_file || !ft->seekable ||
+        !(ft->handler.flags & SOX_FILE_RAWPCM) ||
+        !is_exact_encoding(ft->encoding.encoding) ||
+        (ft->encoding.bits_per_sample & 7)))
+    why = "the output is not a file with plain PCM encoding";
+  if (!why && (ofile->io_async || sox_globals.direct_io || segment_time ||
+        output_method == sox_multiple || eff_chain_count > 1))
+    why = "the output is not written straight to one file";
+  if (!why && (segments > 1 || manifest || manifest_filename))
+    why = "the processing is in segments";
+  for (i = 1; !why && i < sox_argc; ++i)
+    if (strchr(sox_argv[i], '\n'))
+      why = "an argument contains a new-line";
+  if (why) {
+    lsx_warn("--checkpoint: not checkpointing, as %s", why);
+    checkpoint_filename = NULL;
+    return;
+  }
+  checkpoint_start = resume_point? resume_point->start : read_wide_samples;
+  gettimeofday(&checkpoint_time, NULL);
+}
+
+/* Records the point that the output has reached, in whole grids, once the
+ * output file is on the storage up to it */
+static void write_checkpoint(void)
+{
+  sox_format_t * ft = ofile->ft;
+  segments_t const * g = &checkpoint_grid;
+  uint64_t out = output_samples / g->per * g->per;
+  uint64_t in = checkpoint_start + out / g->per * g->grid;
+  uint64_t offset = ft->tell_off - (output_samples - out) *
+    ft->signal.channels * (ft->encoding.bits_per_sample >> 3);
+  char * tmp = lsx_malloc(strlen(checkpoint_filename) + sizeof(".tmp"));
+  int argc = resume_point? resume_point->argc : sox_argc - 1, i;
+  char * * argv = resume_point? resume_point->argv : sox_argv + 1;
+  FILE * fp = NULL;
+
+  sprintf(tmp, "%s.tmp", checkpoint_filename);
+  if (!fflush((FILE *)ft->fp) &&
+#ifdef HAVE_FSYNC
+      !fsync(fileno((FILE *)ft->fp)) &&
+#endif
+      (fp = fopen(tmp, "w"))) {
+    fprintf(fp,
+      "# SoX checkpoint.  If the processing is cut short, carry it on from\n"
+      "# here with `sox --resume %s'.\n"
+      "sox-checkpoint 1\n"
+      "# input LENGTH FILENAME; LENGTH in samples (per channel)\n"
+      "input %" PRIu64 " %s\n"
+      "# rates INPUT OUTPUT\n"
+      "rates %.17g %.17g\n"
+      "output %s\n"
+      "# position START IN OUT OFFSET: the output began at input sample START,\n"
+      "# and has reached input sample IN, output sample OUT (per channel), and\n"
+      "# byte OFFSET of the output file\n"
+      "position %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n"
+      "# The arguments of SoX, one per line:\n",
+      checkpoint_filename, input_wide_samples, files[0]->filename,
+      combiner_signal.rate, ft->signal.rate, ofile->filename,
+      checkpoint_start, in, out, offset);
+    for (i = 0; i < argc; ++i)
+      fprintf(fp, "arg %s\n", argv[i]);
+  }
+  if (!fp || fflush(fp) ||
+#ifdef HAVE_FSYNC
+      fsync(fileno(fp)) ||
+#endif
+      fclose(fp) || rename(tmp, checkpoint_filename))
+    lsx_warn("--checkpoint: can't write `%s': %s", checkpoint_filename, strerror(errno));
+  else lsx_debug("checkpoint at output sample %" PRIu64, out);
+  free(tmp);
+}
+
+/* With --resume: carries on the processing from the checkpoint */
+static int flow_resumed(void)
+{
+  checkpoint_t const * cp = resume_point;
+  segments_t const * g = &checkpoint_grid;
+  segment_t seg;
+
+  if (!checkpoint_filename || input_count != 1 ||
+      strcmp(files[0]->filename, cp->input) || input_wide_samples != cp->length ||
+      combiner_signal.rate != cp->rates[0] || ofile->ft->signal.rate != cp->rates[1] ||
+      cp->in < cp->start || cp->in != cp->start + cp->out / g->per * g->grid) {
+    lsx_fail("`%s' or its processing differs from that checkpointed",
+        files[0]->filename);
+    exit(1);
+  }
+  seg.start = cp->in;
+  seg.end = seg.read_end = seg.length = 0;
+  seg.from = seg.start - min(g->pre, seg.start - cp->start);
+  seg.skip = (seg.start - seg.from) / g->grid * g->per;
+  if (!start_segment(files[0]->ft, &seg))
+    exit(2);
+  output_samples = cp->out;
+  lsx_report("resuming at output sample %" PRIu64 ", with a pre-roll of %gs",
+      cp->out, (double)(seg.start - seg.from) / combiner_signal.rate);
+  return sox_flow_effects(effects_chain, update_status, NULL);
+}
+
+/* With no effects in the chain (e.g. `sox in.wav out.aiff'), the samples
+ * are copied straight from the input file to the output, in blocks large
+ * enough to make few system calls, rather than a buffer at a time through
+ * the chain; the codecs' conversions (raw PCM: SIMD, where available) are
+ * then the only work done on them. */
+#define REMUX_BLOCK (1 << 18)  /* Samples (1MiB) */
+
+static sox_bool can_remux(void)
+{
+  return effects_chain->length == 2 && input_count == 1 &&
+    is_serial(combine_method) && files[0]->volume == 1 && !tee_count &&
+    !split_list && !manifest && !segment_time && !checkpoint_filename &&
+    files[0]->ft->signal.channels == ofile->ft->signal.channels;
+}
+
+static int remux(void)
+{
+  sox_format_t * ft = files[0]->ft;
+  unsigned chans = ft->signal.channels;
+  size_t max = REMUX_BLOCK / chans * chans, len, done = 0;
+  sox_sample_t * buf = lsx_malloc(max * sizeof(*buf));
+  int status = SOX_SUCCESS;
+
+  lsx_debug("remuxing, bypassing the effects chain");
+  while (!user_abort && (len = sox_read(ft, buf, max)) != 0) {
+    len -= len % chans;
+    track_peaks(buf, len, chans, UINT_MAX);
+    done = sox_write(ofile->ft, buf, len);
+    startup_done(startup_first_sample);
+    read_wide_samples += len / chans;
+    output_samples += done / chans;
+    if (done != len) {
+      if (ofile->ft->sox_errno)
+        lsx_fail("`%s' %s: %s", ofile->ft->filename,
+            ofile->ft->sox_errstr, sox_strerror(ofile->ft->sox_errno));
+      status = SOX_EOF;
+      break;
+    }
+    update_status(sox_false, NULL);
+  }
+  if (status == SOX_SUCCESS && !user_abort)
+    report_read_error(ft);
+  update_status(sox_true, NULL);
+  free(buf);
+  current_input = input_count; /* As if the input had been read to its end */
+  input_eof = sox_true;
+  return user_abort? SOX_EOF : status;
+}
+
 static int process(void)
 {         /* Input(s) -> Balancing -> Combiner -> Effects -> Output */
   int flow_status;
 
+  sox_signalinfo_t was = ofile->signal;
+
   create_user_effects();
 
   calculate_combiner_signal_parameters();
   set_combiner_and_output_encoding_parameters();
   calculate_output_signal_parameters();
+  if (save_output_eff && input_eof && (ofile->signal.rate != was.rate ||
+        ofile->signal.channels != was.channels)) {
+    sox_delete_effect(save_output_eff);  /* Reopened for the new signal */
+    save_output_eff = NULL;
+    sox_close(ofile->ft);
+    ofile->ft = NULL;
+  }
   open_output_file();
+  open_tee_files();
+  startup_done(startup_output);
 
   if (!effects_chain)
     effects_chain = sox_create_effects_chain(&combiner_encoding,
                                              &ofile->ft->encoding);
+  if (render_cache_path && (manifest || (segments > 1 && eff_chain_count == 1))) {
+    lsx_report("render cache: not used when rendering in segments");
+    free(render_cache_path);
+    render_cache_path = NULL;
+  }
+  if (autotune && very_first_effchain && !manifest && !render_hit)
+    tune_chain();
   add_effects(effects_chain);
 
-  if (very_first_effchain)
+  /* Else the input is not read, or not from the start of a file: */
+  if ((very_first_effchain || input_eof) && !render_hit) {
     optimize_trim();
+    optimize_gain();
+    optimize_reverse();
+    optimize_repeat();
+  }
+  startup_done(startup_chain);
 
 #if defined(HAVE_TERMIOS_H) || defined(HAVE_CONIO_H)
   if (stdin_is_a_tty) {
@@ -1773,6 +4632,7 @@ static int process(void)
     interactive = sox_false;
   }
 #endif
+  open_control();
 #ifdef HAVE_TERMIOS_H
   /* Prepare terminal for interactive mode and save the original termios
      settings. Do this only once, otherwise the "original" settings won't
@@ -1792,6 +4652,8 @@ static int process(void)
 
   signal(SIGTERM, sigint); /* Stop gracefully, as soon as we possibly can. */
   signal(SIGINT , sigint); /* Either skip current input or behave as SIGTERM. */
+  if (very_first_effchain)
+    gettimeofday(&metrics_start, NULL);
   if (very_first_effchain) {
     struct timeval now;
     double d;
@@ -1799,7 +4661,30 @@ static int process(void)
     d = now.tv_sec - load_timeofday.tv_sec + (now.tv_usec - load_timeofday.tv_usec) / TIME_FRAC;
     lsx_debug("start-up time = %g", d);
   }
-  flow_status = sox_flow_effects(effects_chain, update_status, NULL);
+  if (checkpoint_filename && very_first_effchain)
+    start_checkpoints();
+  if (resume_point && very_first_effchain)
+    flow_status = flow_resumed();
+  else if (can_remux())
+    flow_status = remux();
+  else if (manifest)
+    flow_status = flow_rendered_segment();
+  else if (segments > 1 && very_first_effchain && eff_chain_count == 1) {
+    if (manifest_filename)
+      write_manifest();
+    flow_status = flow_in_segments();
+  }
+  else flow_status = sox_flow_effects(effects_chain, update_status, NULL);
+  if (checkpoint_filename) {
+    if (user_abort)     /* E.g. SIGTERM: its machine is to be taken */
+      write_checkpoint();
+    else if (flow_status == SOX_SUCCESS)
+      remove(checkpoint_filename);
+  }
+  if (show_startup && very_first_effchain)
+    report_startup();
+  if (show_profile)
+    report_profile();
 
   /* Don't return SOX_EOF if
    * 1) input reach EOF and there are more input files to process or
@@ -1924,23 +4809,70 @@ static void usage(char const * message)
   static char const * const lines2[] = {
 "",
 "GLOBAL OPTIONS (gopts) (can be specified at any point before the first effect):",
+"--autotune[=FILENAME]    Time the start of the input with several --buffer",
+"                         sizes, and process the rest with the fastest (and",
+"                         --multi-threaded if it would help); keep the choice",
+"                         for chains of the same shape in FILENAME",
+"--batch FILENAME [-j N]  Run each line of FILENAME as a SoX command, N at once",
+"                         (with --numa, each on the NUMA node least in use)",
 "--buffer BYTES           Set the size of all processing buffers (default 8192)",
+"--checkpoint FILENAME    Record in FILENAME, every --checkpoint-interval SECS",
+"                         (default 60), the point that the output file has",
+"                         reached, for `sox --resume FILENAME' to carry on from",
 "--clobber                Don't prompt to overwrite output file (default)",
+"--codec-threads N        Let a file's codec use up to N threads (e.g. ADPCM)",
 "--combine concatenate    Concatenate all input files (default for sox, rec)",
 "--combine sequence       Sequence all input files (default for play)",
+"--control FILENAME       While processing, read lines of EFFECT[#N] OPTIONS from",
+"                         FILENAME (- for stdin), and change the options of the",
+"                         (Nth) EFFECT in the chain (e.g. vol, equalizer) to them",
+"--daemon SOCKET [-j N]   Run jobs sent to the Unix socket SOCKET, N at once"
+  };
+  static char const * const linesDecodeAhead[] = {
+"--decode-ahead[=BUFFERS] Decode input files on threads of their own, up to",
+"                         BUFFERS (default 4; 0 for none) buffers ahead"
+  };
+  static char const * const lines3[] = {
+"--decode-cache DIRECTORY Keep compressed input files, as decoded, in",
+"                         DIRECTORY, and read them from there later",
 "-D, --no-dither          Don't dither automatically",
+"--design-cache DIRECTORY Keep filter designs in DIRECTORY for reuse",
+"--device-period FRAMES   Set the period size of audio devices' buffers",
+"--device-periods NUM     Set the number of periods in audio devices' buffers",
+"--device-poll            Drive audio devices (OSS) by poll(), without",
+"                         blocking, the chain computing a --buffer ahead",
+"--dft-block NUM          Partition long DFT filters in blocks of 2^NUM samples",
 "--dft-min NUM            Minimum size (log2) for DFT processing (default 10)",
+"--direct-io              With --write-block, bypass the page cache (where able)",
 "--effects-file FILENAME  File containing effects and options",
+"--fast-math              Let effects use fast approximations of exp, log, sin",
+"--fifo-max BYTES         Hold no more than BYTES in each of the FIFOs of rate,",
+"                         tempo, and the DFT filters (default: no limit)",
+"--float-chain            Pass float samples between effects that support it",
+"--governor[=LOAD]        With --realtime, lower effects' quality while they",
+"                         take over LOAD (default .7) of the audio's time",
 "-G, --guard              Use temporary files to guard against clipping",
+"--header-prefetch BYTES  Read the first BYTES of an input file at once, to parse",
+"                         its header from (default 65536; 0: don't)",
 "-h, --help               Display version number and usage information",
 "--help-effect NAME       Show usage of effect NAME, or NAME=all for all",
 "--help-format NAME       Show info on format NAME, or NAME=all for all",
 "--i, --info              Behave as soxi(1)",
-"--input-buffer BYTES     Override the input buffer size (default: as --buffer)",
+"--input-buffer BYTES     Override the input buffer size (default: as --buffer)"
+  };
+  static char const * const linesIoUring[] = {
+"--io-uring               Do asynchronous I/O (--io-async) to regular files",
+"                         through io_uring"
+  };
+  static char const * const lines4[] = {
 "--no-clobber             Prompt to overwrite output file",
 "-m, --combine mix        Mix multiple input files (instead of concatenating)",
 "--combine mix-power      Mix to equal power (instead of concatenating)",
-"-M, --combine merge      Merge multiple input files (instead of concatenating)"
+"-M, --combine merge      Merge multiple input files (instead of concatenating)",
+"--metrics-fd FD          Write progress & metrics, as JSON lines, to FD",
+"--metrics-file FILENAME  Keep progress & metrics, in Prometheus text format,",
+"                         in FILENAME",
+"--metrics-interval SECS  Write metrics every SECS (default 1) and at the end"
   };
   static char const * const linesMagic[] = {
 "--magic                  Use `magic' file-type detection"
@@ -1948,16 +4880,53 @@ static void usage(char const * message)
   static char const * const linesThreads[] = {
 "--multi-threaded         Enable parallel effects channels processing"
   };
-  static char const * const lines3[] = {
-"--norm                   Guard (see --guard) & normalise",
+  static char const * const lines5[] = {
+"--norm                   Guard (see --guard) & normalise"
+  };
+  static char const * const linesPipelined[] = {
+"--pipelined              Run each effect of the chain on its own thread"
+  };
+  static char const * const lines6[] = {
+"--plan                   Mix channels down and down-sample earlier in the",
+"                         effects chain where that gives the same result",
 "--play-rate-arg ARG      Default `rate' argument for auto-resample with `play'",
+"--playlist FILENAME      With --segment-time, the playlist to write: DASH if",
+"                         FILENAME ends .mpd, else HLS (default: the output",
+"                         filename without %n, ending .m3u8)",
 "--plot gnuplot|octave    Generate script to plot response of filter effect",
+"--plugin-manifest DIR    Write DIR/formats.manifest listing its format plugins",
+"--preview                Quick (rate -q) auto-resample for a playback device",
+"--profile                Report the time taken by, etc., each effect",
 "-q, --no-show-progress   Run in quiet mode; opposite of -S",
+"--realtime[=FRAMES]      Push blocks of FRAMES (default: --device-period, or",
+"                         256) through the whole effects chain in turn",
+"--realtime-safe[=FRAMES] As --realtime, at real-time priority with memory",
+"                         locked; report effects that allocate while running",
+"--render-cache DIRECTORY Keep the output of all but the last effect in",
+"                         DIRECTORY, and read it back for a later run that",
+"                         has the same input(s) and effects up to there",
+"--render-cache-at N      With --render-cache, keep the output of the first N",
+"                         effects instead",
 "--replay-gain track|album|off  Default: off (sox, rec), track (play)",
+"--retag [FOPTS] FILE ... Replace just the comments (--comment, etc.) of each",
+"                         file, in place, without re-encoding its audio",
 "-R                       Use default random numbers (same on each run of SoX)",
 "-S, --show-progress      Display progress while processing audio data",
+"--segment-time SECONDS   Cut the output into segments of SECONDS, each to a",
+"                         file of its own (%n in the output filename: the",
+"                         segment's number), encoded in parallel; see --playlist",
+"--segments N             Process a long input file as up to N segments at once",
+"--segments N --manifest FILENAME  Only plan the segments, in FILENAME, for",
+"                         --render FILENAME N (each) and --stitch FILENAME",
 "--single-threaded        Disable parallel effects channels processing",
+"--split FILENAME         Also write each segment of the output that FILENAME",
+"                         lists (a line each: START END OUTFILE; END - for",
+"                         the end) to OUTFILE, in the one pass",
+"--startup-profile        Report the time taken by each stage of start-up, to",
+"                         the first output sample",
 "--temp DIRECTORY         Specify the directory to use for temporary files",
+"--threads N              Have at most N threads busy at once, in all; implies",
+"                         --multi-threaded, or if N is 1, --single-threaded",
 "-T, --combine multiply   Multiply samples of corresponding channels from all",
 "                         input files (instead of concatenating)",
 "--version                Display version number of SoX and exit",
@@ -1966,6 +4935,8 @@ static void usage(char const * message)
 "                           2: warnings",
 "                           3: details of processing",
 "                           4-6: increasing levels of debug messages",
+"--write-block BYTES      Write output files in aligned blocks of BYTES, with",
+"                         their expected length preallocated",
 "FORMAT OPTIONS (fopts):",
 "Input file format options need only be supplied for files that are headerless.",
 "Output files will have the same format as the input file where possible and not",
@@ -1976,7 +4947,7 @@ static void usage(char const * message)
 "-t|--type FILETYPE       File type of audio",
 "-e|--encoding ENCODING   Set encoding (ENCODING may be one of signed-integer,",
 "                         unsigned-integer, floating-point, mu-law, a-law,",
-"                         ima-adpcm, ms-adpcm, gsm-full-rate)",
+"                         ima-adpcm, ms-adpcm, gsm-full-rate, opus)",
 "-b|--bits BITS           Encoded sample size in bits",
 "-N|--reverse-nibbles     Encoded nibble-order",
 "-X|--reverse-bits        Encoded bit-order",
@@ -1988,6 +4959,11 @@ static void usage(char const * message)
 "--add-comment TEXT       Append output file comment",
 "--comment TEXT           Specify comment text for the output file",
 "--comment-file FILENAME  File containing comment text for the output file",
+"--io-async[=BUFFERS]     Read ahead/write behind the file on a thread of its",
+"                         own, with BUFFERS (default 2) buffers in flight",
+"--tee[=BUFFERS]          Write the output to this file too; it is encoded on a",
+"                         thread of its own, with up to BUFFERS (default 4)",
+"                         buffers queued for it",
 #if HAVE_GLOB_H
 "--no-glob                Don't `glob' wildcard match the following filename",
 #endif
@@ -2010,14 +4986,29 @@ static void usage(char const * message)
       puts(linesPopen[i]);
   for (i = 0; i < array_length(lines2); ++i)
     puts(lines2[i]);
+  if (info->flags & sox_version_have_threads)
+    for (i = 0; i < array_length(linesDecodeAhead); ++i)
+      puts(linesDecodeAhead[i]);
+  for (i = 0; i < array_length(lines3); ++i)
+    puts(lines3[i]);
+  if (info->flags & sox_version_have_io_uring)
+    for (i = 0; i < array_length(linesIoUring); ++i)
+      puts(linesIoUring[i]);
+  for (i = 0; i < array_length(lines4); ++i)
+    puts(lines4[i]);
   if (info->flags & sox_version_have_magic)
     for (i = 0; i < array_length(linesMagic); ++i)
       puts(linesMagic[i]);
   if (info->flags & sox_version_have_threads)
     for (i = 0; i < array_length(linesThreads); ++i)
       puts(linesThreads[i]);
-  for (i = 0; i < array_length(lines3); ++i)
-    puts(lines3[i]);
+  for (i = 0; i < array_length(lines5); ++i)
+    puts(lines5[i]);
+  if (info->flags & sox_version_have_threads)
+    for (i = 0; i < array_length(linesPipelined); ++i)
+      puts(linesPipelined[i]);
+  for (i = 0; i < array_length(lines6); ++i)
+    puts(lines6[i]);
   display_supported_formats();
   display_supported_effects();
   printf("EFFECT OPTIONS (effopts): effect dependent; see --help-effect\n");
@@ -2042,7 +5033,7 @@ static void usage_effect(char const * name)
       const sox_effect_handler_t *e = sox_effect_fns[i]();
       if (e && e->name && (!strcmp("all", name) || !strcmp(e->name, name))) {
         printf("%s %s\n", e->name, e->usage? e->usage : "");
-        if (e->flags & (SOX_EFF_DEPRECATED | SOX_EFF_ALPHA | SOX_EFF_INTERNAL))
+        if (e->flags & (SOX_EFF_DEPRECATED | SOX_EFF_ALPHA | SOX_EFF_INTERNAL | SOX_EFF_RTSAFE))
           putchar('\n');
         if (e->flags & SOX_EFF_DEPRECATED)
           printf("`%s' is deprecated\n", e->name);
@@ -2050,6 +5041,10 @@ static void usage_effect(char const * name)
           printf("`%s' is experimental/incomplete\n", e->name);
         if (e->flags & SOX_EFF_INTERNAL)
           printf("`%s' is libSoX-only\n", e->name);
+        if (e->flags & SOX_EFF_RTSAFE)
+          printf("`%s' is realtime-safe\n", e->name);
+        if (e->flags & SOX_EFF_OPTIONAL)
+          printf("`%s' may be bypassed by --governor\n", e->name);
         printf("\n\n");
       }
     }
@@ -2194,6 +5189,47 @@ static struct lsx_option_t const long_options[] = {
   {"no-clobber"      , lsx_option_arg_none    , NULL, 0},
   {"multi-threaded"  , lsx_option_arg_none    , NULL, 0},
   {"dft-min"         , lsx_option_arg_required, NULL, 0},
+  {"pipelined"       , lsx_option_arg_none    , NULL, 0},
+  {"float-chain"     , lsx_option_arg_none    , NULL, 0},
+  {"dft-block"       , lsx_option_arg_required, NULL, 0},
+  {"design-cache"    , lsx_option_arg_required, NULL, 0},
+  {"profile"         , lsx_option_arg_none    , NULL, 0},
+  {"io-async"        , lsx_option_arg_optional, NULL, 0},
+  {"codec-threads"   , lsx_option_arg_required, NULL, 0},
+  {"plugin-manifest" , lsx_option_arg_required, NULL, 0},
+  {"tee"             , lsx_option_arg_optional, NULL, 0},
+  {"decode-ahead"    , lsx_option_arg_optional, NULL, 0},
+  {"device-period"   , lsx_option_arg_required, NULL, 0},
+  {"device-periods"  , lsx_option_arg_required, NULL, 0},
+  {"realtime"        , lsx_option_arg_optional, NULL, 0},
+  {"io-uring"        , lsx_option_arg_none    , NULL, 0},
+  {"write-block"     , lsx_option_arg_required, NULL, 0},
+  {"direct-io"       , lsx_option_arg_none    , NULL, 0},
+  {"segments"        , lsx_option_arg_required, NULL, 0},
+  {"manifest"        , lsx_option_arg_required, NULL, 0},
+  {"metrics-fd"      , lsx_option_arg_required, NULL, 0},
+  {"metrics-file"    , lsx_option_arg_required, NULL, 0},
+  {"metrics-interval", lsx_option_arg_required, NULL, 0},
+  {"plan"            , lsx_option_arg_none    , NULL, 0},
+  {"render-cache"    , lsx_option_arg_required, NULL, 0},
+  {"render-cache-at" , lsx_option_arg_required, NULL, 0},
+  {"decode-cache"    , lsx_option_arg_required, NULL, 0},
+  {"threads"         , lsx_option_arg_required, NULL, 0},
+  {"preview"         , lsx_option_arg_none    , NULL, 0},
+  {"split"           , lsx_option_arg_required, NULL, 0},
+  {"startup-profile" , lsx_option_arg_none    , NULL, 0},
+  {"realtime-safe"   , lsx_option_arg_optional, NULL, 0},
+  {"segment-time"    , lsx_option_arg_required, NULL, 0},
+  {"playlist"        , lsx_option_arg_required, NULL, 0},
+  {"header-prefetch" , lsx_option_arg_required, NULL, 0},
+  {"control"         , lsx_option_arg_required, NULL, 0},
+  {"fifo-max"        , lsx_option_arg_required, NULL, 0},
+  {"autotune"        , lsx_option_arg_optional, NULL, 0},
+  {"device-poll"     , lsx_option_arg_none    , NULL, 0},
+  {"checkpoint"      , lsx_option_arg_required, NULL, 0},
+  {"checkpoint-interval", lsx_option_arg_required, NULL, 0},
+  {"fast-math"       , lsx_option_arg_none    , NULL, 0},
+  {"governor"        , lsx_option_arg_optional, NULL, 0},
 
   {"bits"            , lsx_option_arg_required, NULL, 'b'},
   {"channels"        , lsx_option_arg_required, NULL, 'c'},
@@ -2251,7 +5287,7 @@ static lsx_enum_item const plot_methods[] = {
 enum {
   encoding_signed_integer, encoding_unsigned_integer, encoding_floating_point,
   encoding_ms_adpcm, encoding_ima_adpcm, encoding_oki_adpcm,
-  encoding_gsm_full_rate, encoding_u_law, encoding_a_law};
+  encoding_gsm_full_rate, encoding_u_law, encoding_a_law, encoding_opus};
 
 static lsx_enum_item const encodings[] = {
   {"signed-integer", encoding_signed_integer},
@@ -2264,6 +5300,7 @@ static lsx_enum_item const encodings[] = {
   {"u-law", encoding_u_law},
   {"mu-law", encoding_u_law},
   {"a-law", encoding_a_law},
+  {"opus", encoding_opus},
   {0, 0}};
 
 static int enum_option(char const * arg, int option_index, lsx_enum_item const * items)
@@ -2305,7 +5342,6 @@ static char parse_gopts_and_fopts(file_t * f)
         break;
 
       case 1:
-#define SOX_BUFMIN 16
         if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i <= SOX_BUFMIN) {
           lsx_fail("Buffer size `%s' must be > %d", optstate.arg, SOX_BUFMIN);
           exit(1);
@@ -2386,6 +5422,215 @@ static char parse_gopts_and_fopts(file_t * f)
         }
         sox_globals.log2_dft_min_size = i;
         break;
+      case 26:
+        if (info->flags & sox_version_have_threads)
+          sox_globals.chain_mode = SOX_CHAIN_PIPELINED;
+        else
+          lsx_warn("this build of SoX does not support threads");
+        break;
+      case 27: sox_globals.float_chain = sox_true; break;
+      case 28:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 6 || i > 16) {
+          lsx_fail("DFT block size must be in range 6 to 16");
+          exit(1);
+        }
+        sox_globals.log2_dft_block_size = i;
+        break;
+      case 29: sox_globals.design_cache_path = lsx_strdup(optstate.arg); break;
+      case 30: sox_globals.profile = show_profile = sox_true; break;
+      case 31:
+        i = 2;
+        if (optstate.arg && (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 ||
+              i < 2 || i > 16)) {
+          lsx_fail("Number of I/O buffers must be in range 2 to 16");
+          exit(1);
+        }
+        if (info->flags & sox_version_have_threads)
+          f->io_async = i;
+        else
+          lsx_warn("this build of SoX does not support threads");
+        break;
+      case 32:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 1 || i > 128) {
+          lsx_fail("Number of codec threads must be in range 1 to 128");
+          exit(1);
+        }
+        sox_globals.codec_threads = i;
+        break;
+      case 33:
+        exit(sox_write_format_manifest(optstate.arg) == SOX_SUCCESS? 0 : 1);
+        break;
+      case 34:
+        i = 4;
+        if (optstate.arg && (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 ||
+              i < 1 || i > 64)) {
+          lsx_fail("Number of --tee buffers must be in range 1 to 64");
+          exit(1);
+        }
+        f->tee = i;
+        break;
+      case 35:
+        i = 4;
+        if (optstate.arg && (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 ||
+              i < 0 || i > 64)) {
+          lsx_fail("Number of decode-ahead buffers must be in range 0 to 64");
+          exit(1);
+        }
+        if (info->flags & sox_version_have_threads)
+          decode_ahead = i;
+        else
+          lsx_warn("this build of SoX does not support threads");
+        break;
+      case 36:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 16 || i > 65536) {
+          lsx_fail("Device period must be in range 16 to 65536 frames");
+          exit(1);
+        }
+        sox_globals.device_period = i;
+        break;
+      case 37:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 2 || i > 64) {
+          lsx_fail("Number of device periods must be in range 2 to 64");
+          exit(1);
+        }
+        sox_globals.device_periods = i;
+        break;
+      case 55:
+        sox_globals.realtime_safe = sox_true;
+        /* Fall through */
+      case 38:
+        i = 0;
+        if (optstate.arg && (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 ||
+              i < 1 || i > 65536)) {
+          lsx_fail("Realtime block size must be in range 1 to 65536 frames");
+          exit(1);
+        }
+        sox_globals.chain_mode = SOX_CHAIN_REALTIME;
+        sox_globals.realtime_block = i;
+        break;
+      case 39:
+        if (info->flags & sox_version_have_io_uring)
+          sox_globals.io_uring = sox_true;
+        else
+          lsx_warn("this build of SoX does not support io_uring");
+        break;
+      case 40:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 4096) {
+          lsx_fail("Write block size must be at least 4096 bytes");
+          exit(1);
+        }
+        sox_globals.write_block = i;
+        break;
+      case 41: sox_globals.direct_io = sox_true; break;
+      case 42:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 1 || i > MAX_SEGMENTS) {
+          lsx_fail("Number of segments must be in range 1 to %i", MAX_SEGMENTS);
+          exit(1);
+        }
+        segments = i;
+        break;
+      case 43: manifest_filename = optstate.arg; break;
+      case 44:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 1 ||
+            !(metrics_fp = fdopen(i, "w"))) {
+          lsx_fail("Metrics file descriptor must be open for writing");
+          exit(1);
+        }
+        sox_globals.profile = sox_true; /* For the effects' timings */
+        break;
+      case 45:
+        metrics_filename = optstate.arg;
+        sox_globals.profile = sox_true;
+        break;
+      case 46:
+        if (sscanf(optstate.arg, "%lf %c", &metrics_interval, &dummy) != 1 ||
+            metrics_interval < 0) {
+          lsx_fail("Metrics interval must be a number of seconds");
+          exit(1);
+        }
+        break;
+      case 47: plan_chain = sox_true; break;
+      case 48:
+        free(render_cache_path);
+        render_cache_path = lsx_strdup(optstate.arg);
+        break;
+      case 49:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 1) {
+          lsx_fail("--render-cache-at requires a number of effects");
+          exit(1);
+        }
+        render_cache_at = i;
+        break;
+      case 50:
+        free(sox_globals.decode_cache_path);
+        sox_globals.decode_cache_path = lsx_strdup(optstate.arg);
+        break;
+      case 51:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 1 || i > 1024) {
+          lsx_fail("Number of threads must be in range 1 to 1024");
+          exit(1);
+        }
+        sox_globals.threads = i;
+        sox_globals.use_threads = i > 1;
+        break;
+      case 52: preview = sox_true; break;
+      case 53: split_list = optstate.arg; break;
+      case 54: show_startup = sox_true; break;
+      case 56:
+        if (sscanf(optstate.arg, "%lf %c", &segment_time, &dummy) != 1 ||
+            segment_time <= 0) {
+          lsx_fail("--segment-time requires a number of seconds");
+          exit(1);
+        }
+        sox_globals.gapless = sox_true;
+        break;
+      case 57:
+        free(playlist);
+        playlist = lsx_strdup(optstate.arg);
+        break;
+      case 58:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 0) {
+          lsx_fail("Header prefetch size `%s' must be >= 0", optstate.arg);
+          exit(1);
+        }
+        sox_globals.header_prefetch = i;
+        break;
+      case 59:
+        free(control_filename);
+        control_filename = lsx_strdup(optstate.arg);
+        sox_globals.updatable = sox_true;
+        break;
+      case 60:
+        if (sscanf(optstate.arg, "%i %c", &i, &dummy) != 1 || i < 0) {
+          lsx_fail("FIFO size `%s' must be >= 0", optstate.arg);
+          exit(1);
+        }
+        sox_globals.fifo_max = i;
+        break;
+      case 61:
+        autotune = sox_true;
+        free(tuning_filename);
+        tuning_filename = optstate.arg? lsx_strdup(optstate.arg) : NULL;
+        break;
+      case 62: sox_globals.device_poll = sox_true; break;
+      case 63: checkpoint_filename = optstate.arg; break;
+      case 64:
+        if (sscanf(optstate.arg, "%lf %c", &checkpoint_interval, &dummy) != 1 ||
+            checkpoint_interval < 0) {
+          lsx_fail("Checkpoint interval must be a number of seconds");
+          exit(1);
+        }
+        break;
+      case 65: sox_globals.fast_math = sox_true; break;
+      case 66:
+        sox_globals.governor = .7;
+        if (optstate.arg && (sscanf(optstate.arg, "%lf %c",
+                &sox_globals.governor, &dummy) != 1 ||
+              sox_globals.governor <= 0 || sox_globals.governor > 1)) {
+          lsx_fail("Governor load must be more than 0 and at most 1");
+          exit(1);
+        }
+        break;
       }
       break;
 
@@ -2477,6 +5722,7 @@ static char parse_gopts_and_fopts(file_t * f)
         if (f->encoding.bits_per_sample == 0)
           f->encoding.bits_per_sample = 8;
         break;
+      case encoding_opus:             f->encoding.encoding = SOX_ENCODING_OPUS;      break;
       }
       break;
 
@@ -2583,6 +5829,11 @@ static int add_file(file_t const * const opts, char const * const filename)
   if (!filename)
     usage("missing filename"); /* No return */
   f->filename = lsx_strdup(filename);
+  if (f->tee) {
+    lsx_revalloc(tees, tee_count + 1);
+    tees[tee_count++] = f;
+    return 0;
+  }
   files = lsx_realloc(files, (file_count + 1) * sizeof(*files));
   files[file_count++] = f;
   return 0;
@@ -2685,13 +5936,71 @@ static void parse_options_and_filenames(int argc, char **argv)
 
 static double soxi_total;
 static size_t soxi_file_count;
+static sox_bool soxi_probe;
 
 typedef enum {Full, Type, Rate, Channels, Samples, Duration, Duration_secs,
     Bits, Bitrate, Precision, Encoding, Annotation} soxi_t;
+typedef enum {Text, Tsv, Json} soxi_format_t;
+
+/* Writes s as a JSON string, or as a TSV field (with \t, \n and \\ escaped) */
+static void soxi_put_string(char const * s, soxi_format_t format)
+{
+  if (format == Json)
+    putchar('"');
+  for (; *s; ++s) {
+    unsigned char c = *s;
+    if (c == '\\' || (c == '"' && format == Json))
+      printf("\\%c", c);
+    else if (c == '\t')
+      fputs("\\t", stdout);
+    else if (c == '\n')
+      fputs("\\n", stdout);
+    else if (c < ' ' && format == Json)
+      printf("\\u%04x", c);
+    else putchar(c);
+  }
+  if (format == Json)
+    putchar('"');
+}
+
+/* One line per file, of the fields named in soxi_record_header */
+static char const soxi_record_header[] = "file\ttype\trate\tchannels\tsamples"
+    "\tduration\testimated\tbits\tprecision\tencoding\tbitrate\n";
 
-static int soxi1(soxi_t const * type, char const * filename)
+static void soxi_record(sox_format_t * ft, soxi_format_t format)
+{
+  uint64_t ws = ft->signal.length / max(ft->signal.channels, 1);
+  double secs = (double)ws / max(ft->signal.rate, 1);
+  double bitrate = secs? 8. * lsx_filelength(ft) / secs : 0;
+  char const * sep = format == Json? ", " : "\t";
+
+  if (format == Json)
+    fputs("{\"file\": ", stdout);
+  soxi_put_string(ft->filename, format);
+  printf(format == Json? ", \"type\": " : "\t");
+  soxi_put_string(ft->filetype, format);
+  printf(format == Json? ", \"rate\": %g, \"channels\": %u, \"samples\": %" PRIu64
+      ", \"duration\": %f, \"estimated\": %s, \"bits\": %u, \"precision\": %u"
+      ", \"encoding\": " : "\t%g\t%u\t%" PRIu64 "\t%f\t%s\t%u\t%u\t",
+      ft->signal.rate, ft->signal.channels, ws, secs,
+      format == Json? (ft->length_estimated? "true" : "false") :
+      ft->length_estimated? "1" : "0",
+      ft->encoding.bits_per_sample, ft->signal.precision);
+  soxi_put_string(sox_encodings_info[ft->encoding.encoding].desc, format);
+  printf("%s%s%.0f%s\n", sep, format == Json? "\"bitrate\": " : "", bitrate,
+      format == Json? "}" : "");
+}
+
+/* With -P, only the header is read (see sox_open_probe) */
+static sox_format_t * soxi_open(char const * filename)
+{
+  return soxi_probe? sox_open_probe(filename, NULL) :
+      sox_open_read(filename, NULL, NULL, NULL);
+}
+
+/* Shows what's asked of the file, and closes it; returns 1 on failure */
+static int soxi_show(soxi_t const * type, soxi_format_t format, sox_format_t * ft)
 {
-  sox_format_t * ft = sox_open_read(filename, NULL, NULL, NULL);
   double secs;
   uint64_t ws;
   char const * text = NULL;
@@ -2705,12 +6014,16 @@ static int soxi1(soxi_t const * type, char const * filename)
     soxi_total = -2;
   if (soxi_total >= 0) soxi_total += *type == Samples? ws : secs;
 
-  switch (*type) {
+  if (format == Text && (*type == Annotation || *type == Full))
+    sox_read_comments(ft);
+  if (format != Text)
+    soxi_record(ft, format);
+  else switch (*type) {
     case Type: printf("%s\n", ft->filetype); break;
     case Rate: printf("%g\n", ft->signal.rate); break;
     case Channels: printf("%u\n", ft->signal.channels); break;
     case Samples: if (soxi_total ==-1) printf("%" PRIu64 "\n", ws); break;
-    case Duration: if (soxi_total ==-1) printf("%s\n", str_time(secs)); break;
+    case Duration: if (soxi_total ==-1) printf("%s%s\n", ft->length_estimated? "~" : "", str_time(secs)); break;
     case Duration_secs: if (soxi_total ==-1) printf("%f\n", secs); break;
     case Bits: printf("%u\n", ft->encoding.bits_per_sample); break;
     case Bitrate: size_and_bitrate(ft, &text); puts(text? text : "0"); break;
@@ -2723,18 +6036,37 @@ static int soxi1(soxi_t const * type, char const * filename)
     break;
     case Full: display_file_info(ft, NULL, sox_false); break;
   }
+  fflush(stdout);  /* So that results stream out as they are found */
   return !!sox_close(ft);
 }
 
+static int soxi_add_file(char * * * filenames, char const * filename)
+{
+  size_t n = 0;
+
+  if (*filenames)
+    for (; (*filenames)[n]; ++n);
+  lsx_revalloc(*filenames, n + 2);
+  (*filenames)[n] = lsx_strdup(filename);
+  (*filenames)[n + 1] = NULL;
+  return SOX_SUCCESS;
+}
+
 static void soxi_usage(int return_code)
 {
   display_SoX_version(stdout);
   printf(
     "\n"
-    "Usage: soxi [-V[level]] [-T] [-t|-r|-c|-s|-d|-D|-b|-B|-p|-e|-a] infile1 ...\n"
+    "Usage: soxi [-V[level]] [-T] [-P] [-j N] [-f tsv|json] [-t|-r|-c|-s|-d|-D|-b|-B|-p|-e|-a]\n"
+    "            infile1 ...\n"
     "\n"
     "-V[n]\tIncrement or set verbosity level (default is 2)\n"
     "-T\tWith -s, -d or -D, display the total across all given files\n"
+    "-P\tRead file headers only; durations not in a header may be\n"
+    "\testimated (shown with ~ by -d) or unavailable\n"
+    "-j N\tExamine up to N files at once (results are in the order given)\n"
+    "-f tsv|json\tShow all of the following for each file, as a line of\n"
+    "\ttab-separated values (after a header line) or a JSON object\n"
     "\n"
     "-t\tShow detected file-type\n"
     "-r\tShow sample-rate\n"
@@ -2757,10 +6089,13 @@ static void soxi_usage(int return_code)
 
 static int soxi(int argc, char * const * argv)
 {
-  static char const opts[] = "trcsdDbBpea?TV::";
+  static char const opts[] = "trcsdDbBpea?TV::Pj:f:";
   soxi_t type = Full;
-  int opt, num_errors = 0;
+  soxi_format_t format = Text;
+  int opt, num_errors = 0, jobs = 1;
   sox_bool do_total = sox_false;
+  char * * filenames = NULL;
+  long i, n = 0;
 
   if (argc < 2)
     soxi_usage(0);
@@ -2782,10 +6117,28 @@ static int soxi(int argc, char * const * argv)
     }
     else if (opt == 'T')
       do_total = sox_true;
+    else if (opt == 'P')
+      soxi_probe = sox_true;
+    else if (opt == 'j') {
+      char dummy;
+      if (sscanf(optstate.arg, "%d %c", &jobs, &dummy) != 1 || jobs < 1) {
+        lsx_fail("Number of jobs `%s' is not a positive integer", optstate.arg);
+        exit(1);
+      }
+    }
+    else if (opt == 'f') {
+      if (!strcmp(optstate.arg, "tsv"))
+        format = Tsv;
+      else if (!strcmp(optstate.arg, "json"))
+        format = Json;
+      else soxi_usage(1);
+    }
     else if ((type = 1 + (strchr(opts, opt) - opts)) > Annotation)
       soxi_usage(1);
 
-  if (type == Full)
+  if (format != Text)
+    do_total = sox_false, type = Samples;
+  else if (type == Full)
     do_total = sox_true;
   else if (do_total && (type < Samples || type > Duration_secs)) {
     fprintf(stderr, "soxi: ignoring -T; n/a with other given option");
@@ -2794,9 +6147,27 @@ static int soxi(int argc, char * const * argv)
   soxi_total = -!do_total;
   for (; optstate.ind < argc; ++optstate.ind) {
     if (sox_is_playlist(argv[optstate.ind]))
-      num_errors += (sox_parse_playlist((sox_playlist_callback_t)soxi1, &type, argv[optstate.ind]) != SOX_SUCCESS);
-    else num_errors += soxi1(&type, argv[optstate.ind]);
+      num_errors += (sox_parse_playlist((sox_playlist_callback_t)soxi_add_file, &filenames, argv[optstate.ind]) != SOX_SUCCESS);
+    else soxi_add_file(&filenames, argv[optstate.ind]);
+  }
+  if (filenames)
+    for (; filenames[n]; ++n);
+  if (format == Tsv)
+    fputs(soxi_record_header, stdout);
+  if (jobs > 1)
+    sox_format_init();  /* Load any plugins now, not from the jobs at once */
+
+  #pragma omp parallel for ordered if(jobs > 1 && n > 1) num_threads(jobs) \
+      schedule(dynamic)
+  for (i = 0; i < n; ++i) {
+    sox_format_t * ft = soxi_open(filenames[i]);
+    #pragma omp ordered
+    num_errors += soxi_show(&type, format, ft);
   }
+  for (i = 0; i < n; ++i)
+    free(filenames[i]);
+  free(filenames);
+
   if (type == Full) {
     if (soxi_file_count > 1 && soxi_total > 0)
       printf("Total Duration of %u files: %s\n", (unsigned)soxi_file_count, str_time(soxi_total));
@@ -2848,6 +6219,657 @@ static sox_bool cmp_comment_text(char const * c1, char const * c2)
   return c1 && c2 && !strcasecmp(c1, c2);
 }
 
+/* For --batch: reads the named file (or stdin, for "-"), and returns its
+ * lines, less any that are blank or comments (starting with #). */
+static char * * read_batch_file(char const * filename, char const * what,
+    size_t * count, size_t * * line_nums)
+{
+  FILE * file = strcmp(filename, "-")? fopen(filename, "r") : stdin;
+  size_t len = 0, size = 0, n, num = 0;
+  char * text = NULL, * s, * * lines = NULL;
+
+  if (!file) {
+    lsx_fail("Cannot open %s file `%s': %s", what, filename, strerror(errno));
+    exit(1);
+  }
+  do {
+    if (len + 1 >= size)
+      text = lsx_realloc(text, size += 4096);
+    len += n = fread(text + len, (size_t)1, size - len - 1, file);
+  } while (n);
+  if (ferror(file)) {
+    lsx_fail("Error reading %s file `%s': %s", what, filename, strerror(errno));
+    exit(1);
+  }
+  if (file != stdin)
+    fclose(file);
+  text[len] = '\0';
+
+  for (*count = 0, *line_nums = NULL, s = strtok(text, "\n"); s;
+      s = strtok(NULL, "\n")) {
+    char * t = s;
+    for (++num; isspace(*t); ++t);
+    if (*t && *t != '#') {
+      lsx_revalloc(lines, *count + 1);
+      lsx_revalloc(*line_nums, *count + 1);
+      lines[*count] = s, (*line_nums)[(*count)++] = num;
+    }
+  }
+  return lines;
+}
+
+#ifdef HAVE_BATCH_NUMA
+/* Reads a list such as "0-3,8-11", as sysfs gives CPUs and nodes, into set;
+ * returns whether there was anything in it */
+static sox_bool read_cpu_list(char const * path, cpu_set_t * set)
+{
+  FILE * file = fopen(path, "r");
+  char text[4096], * s = text, * end;
+  sox_bool ok = file && fgets(text, (int)sizeof(text), file);
+
+  if (file)
+    fclose(file);
+  CPU_ZERO(set);
+  while (ok && isdigit((unsigned char)*s)) {
+    unsigned long lo = strtoul(s, &end, 10), hi = lo;
+    if (*end == '-')
+      hi = strtoul(end + 1, &end, 10);
+    for (; lo <= hi && lo < CPU_SETSIZE; ++lo)
+      CPU_SET(lo, set);
+    s = end + (*end == ',');
+  }
+  return ok && CPU_COUNT(set);
+}
+
+/* For --batch --numa: the CPUs of each online NUMA node that has any, and
+ * its number; returns how many such nodes there are (0 if it can't tell) */
+static size_t numa_nodes(cpu_set_t * * cpus, unsigned * * ids)
+{
+  cpu_set_t online;
+  size_t n = 0;
+  unsigned node;
+  char path[64];
+
+  *cpus = NULL, *ids = NULL;
+  if (!read_cpu_list("/sys/devices/system/node/online", &online))
+    return 0;
+  for (node = 0; node < CPU_SETSIZE; ++node) if (CPU_ISSET(node, &online)) {
+    lsx_revalloc(*cpus, n + 1);
+    lsx_revalloc(*ids, n + 1);
+    sprintf(path, "/sys/devices/system/node/node%u/cpulist", node);
+    if (read_cpu_list(path, *cpus + n))
+      (*ids)[n++] = node;
+  }
+  return n;
+}
+#endif
+
+/* Handles `sox --batch FILENAME [-j NUM] [--numa] [gopts]': runs each line
+ * of the file as the options, files, & effects for a run of SoX of its own,
+ * in up to NUM processes at once, with gopts common to all.  The processes
+ * are forked from this one, so share its initialisation (e.g. of the format
+ * handlers); with --design-cache, they share filter designs too.  With
+ * --numa, each job goes to the NUMA node with fewest running, and its
+ * process is bound to that node's CPUs before it allocates anything, so
+ * that (first-touch) its buffers, arenas and threads all stay on the node;
+ * the jobs and their time on each node are reported at the end.  Returns
+ * only in the process of a job, with *argc & *argv set to the job's
+ * arguments; otherwise exits with the worst status of the jobs. */
+static void batch(int * argc, char * * * argv)
+{
+#ifdef HAVE_BATCH
+  char * * args = *argv, * * lines, * * common;
+  size_t i, j, count, * line_nums, num_common = 0, jobs = 1, running = 0;
+  pid_t * pids, pid;
+  int status, worst = 0;
+  sox_bool numa = sox_false;
+  size_t nodes = 0, * node_of = NULL, * node_running = NULL, * node_done = NULL;
+  double * node_busy = NULL;
+  struct timeval * started = NULL, batch_start, now;
+#ifdef HAVE_BATCH_NUMA
+  cpu_set_t * cpus = NULL;
+  unsigned * node_ids = NULL;
+#endif
+
+  if (*argc < 3)
+    usage("--batch requires a filename");
+  common = lsx_calloc((size_t)*argc, sizeof(*common));
+  for (i = 3; i < (size_t)*argc; ++i) {
+    char dummy;
+    int n;
+    if (!strcmp(args[i], "--numa"))
+      numa = sox_true;
+    else if (strcmp(args[i], "-j") && strcmp(args[i], "--jobs"))
+      common[num_common++] = args[i];
+    else if (++i < (size_t)*argc &&
+        sscanf(args[i], "%d %c", &n, &dummy) == 1 && n > 0)
+      jobs = n;
+    else usage("-j|--jobs requires a positive number of jobs");
+  }
+  lines = read_batch_file(args[2], "batch", &count, &line_nums);
+  pids = lsx_calloc(count, sizeof(*pids));
+  if (numa) {
+#ifdef HAVE_BATCH_NUMA
+    nodes = numa_nodes(&cpus, &node_ids);
+#endif
+    if (!nodes)
+      lsx_warn("cannot find this machine's NUMA nodes; ignoring --numa");
+    node_of = lsx_calloc(count, sizeof(*node_of));
+    started = lsx_calloc(count, sizeof(*started));
+    node_running = lsx_calloc(nodes, sizeof(*node_running));
+    node_done = lsx_calloc(nodes, sizeof(*node_done));
+    node_busy = lsx_calloc(nodes, sizeof(*node_busy));
+  }
+  sox_format_init();       /* Once for all jobs (some formats are plugins) */
+  gettimeofday(&batch_start, NULL);
+
+  for (i = 0; i < count || running; ) {
+    if (i < count && running < jobs) {
+      if (nodes) {
+        for (j = 1, node_of[i] = 0; j < nodes; ++j)
+          if (node_running[j] < node_running[node_of[i]])
+            node_of[i] = j;
+        gettimeofday(&started[i], NULL);
+      }
+      fflush(NULL);
+      if ((pids[i] = fork()) < 0) {
+        lsx_fail("Cannot start batch job at line %" PRIuPTR ": %s",
+            line_nums[i], strerror(errno));
+        exit(2);
+      }
+      if (!pids[i]) {                      /* This is the job's process */
+        int line_argc;
+        char * * line_argv;
+#ifdef HAVE_BATCH_NUMA
+        if (nodes && sched_setaffinity(0, sizeof(*cpus), &cpus[node_of[i]]))
+          lsx_warn("cannot bind batch job at line %" PRIuPTR " to NUMA node %u: %s",
+              line_nums[i], node_ids[node_of[i]], strerror(errno));
+        free(cpus), free(node_ids);
+#endif
+        free(node_of), free(started);
+        free(node_running), free(node_done), free(node_busy);
+        line_argv = strtoargv(lines[i], &line_argc);
+        *argv = lsx_calloc(num_common + line_argc + 2, sizeof(**argv));
+        (*argv)[0] = args[0];
+        memcpy(*argv + 1, common, num_common * sizeof(*common));
+        memcpy(*argv + 1 + num_common, line_argv, line_argc * sizeof(*line_argv));
+        *argc = num_common + line_argc + 1;
+        free(line_argv), free(common), free(pids), free(line_nums);
+        return;                  /* N.B. lines & its text are still in use */
+      }
+      if (nodes)
+        ++node_running[node_of[i]];
+      ++i, ++running;
+    }
+    else if ((pid = wait(&status)) >= 0) {
+      for (j = 0; j < i && pids[j] != pid; ++j);
+      --running;
+      if (nodes && j < i) {
+        size_t node = node_of[j];
+        gettimeofday(&now, NULL);
+        --node_running[node], ++node_done[node];
+        node_busy[node] += now.tv_sec - started[j].tv_sec +
+            (now.tv_usec - started[j].tv_usec) / TIME_FRAC;
+      }
+      status = WIFEXITED(status)? WEXITSTATUS(status) : 2;
+      if (status) {
+        lsx_warn("batch job at line %" PRIuPTR " failed (exit status %i)",
+            line_nums[j], status);
+        worst = max(worst, status);
+      }
+    }
+    else break;
+  }
+#ifdef HAVE_BATCH_NUMA
+  if (nodes) {
+    double elapsed;
+    gettimeofday(&now, NULL);
+    elapsed = now.tv_sec - batch_start.tv_sec +
+        (now.tv_usec - batch_start.tv_usec) / TIME_FRAC;
+    for (j = 0; j < nodes; ++j)
+      fprintf(stderr, "%s: NUMA node %u: %" PRIuPTR " jobs, %.1f job-seconds, %.1f jobs/hour\n",
+          myname, node_ids[j], node_done[j], node_busy[j],
+          elapsed > 0? node_done[j] * 3600 / elapsed : 0.);
+  }
+#endif
+  exit(worst);
+#else
+  (void)argc, (void)argv;
+  lsx_fail("--batch is not available on this platform");
+  exit(1);
+#endif
+}
+
+#ifdef HAVE_DAEMON
+#define DAEMON_DFT_MAX ((size_t)1 << 17) /* Longest DFT to ready tables for */
+#define DAEMON_LINE_MAX 65536
+
+static int daemon_pipe[2] = {-1, -1}; /* Wakes the daemon on a signal */
+static sig_atomic_t volatile daemon_stopping;
+
+static void daemon_signal(int sig)
+{
+  int saved_errno = errno;
+  char c = 0;
+
+  if (sig != SIGCHLD)
+    daemon_stopping = 1;
+  if (write(daemon_pipe[1], &c, (size_t)1) < 0) {} /* Already due to wake if full */
+  errno = saved_errno;
+}
+
+/* In a job's process: reads the job's line from its connection (byte by byte,
+ * so as to leave what follows for the job to read as its standard input),
+ * and connects the standard streams to it */
+static char * daemon_job(int conn)
+{
+  char * line = lsx_malloc((size_t)DAEMON_LINE_MAX);
+  size_t len = 0;
+
+  while (len < DAEMON_LINE_MAX - 1 && read(conn, line + len, (size_t)1) == 1 &&
+      line[len] != '\n')
+    ++len;
+  line[len] = '\0';
+  if (dup2(conn, 0) < 0 || dup2(conn, 1) < 0 || dup2(conn, 2) < 0)
+    exit(2);
+  close(conn);
+  stdin_is_a_tty = sox_false;
+  return line;
+}
+#endif
+
+/* Handles `sox --daemon SOCKET [-j NUM] [gopts]': listens on the Unix
+ * socket SOCKET for jobs, running up to NUM at once, each as a run of SoX in
+ * a process forked from this one, so that jobs start without SoX's start-up:
+ * the format handlers (and any plugins) are loaded, the DFT tables made, and
+ * (with --design-cache) the filter designs that earlier jobs made are loaded
+ * into memory, once, here.  A client connects, writes a line of the options,
+ * files & effects for the job, as for --batch, and may then write what the
+ * job is to read as its standard input; it reads back the job's standard
+ * output & error, then a last line `exit STATUS', then end of file.  Further
+ * jobs wait in the socket's queue whilst NUM are running.  Returns only in
+ * the process of a job, with *argc & *argv set to the job's arguments;
+ * otherwise runs until SIGTERM or SIGINT, then (once the running jobs are
+ * done) removes SOCKET and exits. */
+static void serve(int * argc, char * * * argv)
+{
+#ifdef HAVE_DAEMON
+  char * * args = *argv, * * common, * path, * line;
+  size_t i, num_common = 0, jobs = 1, running = 0;
+  int listener, * conns, status;
+  pid_t * pids, pid;
+  struct sockaddr_un addr;
+  struct stat st;
+
+  if (*argc < 3)
+    usage("--daemon requires a socket filename");
+  path = args[2];
+  common = lsx_calloc((size_t)*argc, sizeof(*common));
+  for (i = 3; i < (size_t)*argc; ++i) {
+    char dummy;
+    int n;
+    if (strcmp(args[i], "-j") && strcmp(args[i], "--jobs")) {
+      if (!strcmp(args[i], "--design-cache") && i + 1 < (size_t)*argc)
+        sox_globals.design_cache_path = lsx_strdup(args[i + 1]);
+      common[num_common++] = args[i];
+    }
+    else if (++i < (size_t)*argc &&
+        sscanf(args[i], "%d %c", &n, &dummy) == 1 && n > 0)
+      jobs = n;
+    else usage("-j|--jobs requires a positive number of jobs");
+  }
+  if (strlen(path) >= sizeof(addr.sun_path))
+    usage("--daemon socket filename is too long");
+
+  sox_format_init();
+  sox_warm_caches(DAEMON_DFT_MAX);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+    unlink(path);                        /* Left by an earlier daemon */
+  if ((listener = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(listener, (struct sockaddr *)&addr, (socklen_t)sizeof(addr)) ||
+      listen(listener, 128) || pipe(daemon_pipe)) {
+    lsx_fail("Cannot listen on `%s': %s", path, strerror(errno));
+    exit(1);
+  }
+  fcntl(daemon_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(daemon_pipe[1], F_SETFL, O_NONBLOCK);
+  signal(SIGPIPE, SIG_IGN);              /* A client may hang up early */
+  signal(SIGCHLD, daemon_signal);
+  signal(SIGTERM, daemon_signal);
+  signal(SIGINT, daemon_signal);
+  pids = lsx_calloc(jobs, sizeof(*pids));
+  conns = lsx_calloc(jobs, sizeof(*conns));
+
+  while (!daemon_stopping || running) {
+    fd_set fds;
+    char buf[64];
+    int conn, n = max(listener, daemon_pipe[0]);
+
+    FD_ZERO(&fds);
+    FD_SET(daemon_pipe[0], &fds);
+    if (running < jobs && !daemon_stopping)
+      FD_SET(listener, &fds);
+    if (select(n + 1, &fds, NULL, NULL, NULL) < 0) {
+      if (errno == EINTR)
+        continue;
+      lsx_fail("Cannot wait for jobs: %s", strerror(errno));
+      break;
+    }
+    while (read(daemon_pipe[0], buf, sizeof(buf)) > 0);
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (i = 0; i < jobs && pids[i] != pid; ++i);
+      if (i == jobs)
+        continue;
+      status = WIFEXITED(status)? WEXITSTATUS(status) : 2;
+      n = sprintf(buf, "exit %i\n", status);
+      if (write(conns[i], buf, (size_t)n) != n)
+        lsx_debug("client of job %u hung up", (unsigned)pid);
+      close(conns[i]);
+      pids[i] = 0, --running;
+      sox_warm_caches((size_t)0);        /* Designs that the job made */
+    }
+
+    if (!daemon_stopping && running < jobs && FD_ISSET(listener, &fds) &&
+        (conn = accept(listener, NULL, NULL)) >= 0) {
+      for (i = 0; pids[i]; ++i);
+      fflush(NULL);
+      if ((pid = fork()) < 0) {
+        lsx_warn("Cannot start job: %s", strerror(errno));
+        close(conn);
+        continue;
+      }
+      if (!pid) {                        /* This is the job's process */
+        int line_argc;
+        char * * line_argv;
+        size_t j;
+
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        for (j = 0; j < jobs; ++j) if (pids[j])
+          close(conns[j]);               /* Only their jobs may hold them */
+        close(listener);
+        close(daemon_pipe[0]), close(daemon_pipe[1]);
+        line = daemon_job(conn);
+        line_argv = strtoargv(line, &line_argc);
+        *argv = lsx_calloc(num_common + line_argc + 2, sizeof(**argv));
+        (*argv)[0] = args[0];
+        memcpy(*argv + 1, common, num_common * sizeof(*common));
+        memcpy(*argv + 1 + num_common, line_argv, line_argc * sizeof(*line_argv));
+        *argc = num_common + line_argc + 1;
+        free(line_argv), free(common), free(pids), free(conns);
+        return;                     /* N.B. line & its text are still in use */
+      }
+      pids[i] = pid, conns[i] = conn, ++running;
+    }
+  }
+  close(listener);
+  unlink(path);
+  exit(0);
+#else
+  (void)argc, (void)argv;
+  lsx_fail("--daemon is not available on this platform");
+  exit(1);
+#endif
+}
+
+/* Reads count numbers, each followed by a space, from *s */
+static sox_bool read_numbers(char * * s, uint64_t * x, int count)
+{
+  char * end;
+
+  for (; count--; ++x, *s = end + 1) {
+    if (!isdigit((unsigned char)**s))
+      return sox_false;
+    *x = strtoull(*s, &end, 10);
+    if (*end != ' ')
+      return sox_false;
+  }
+  return sox_true;
+}
+
+static manifest_t * read_manifest(char const * filename)
+{
+  size_t count, * line_nums, i;
+  char * * lines = read_batch_file(filename, "manifest", &count, &line_nums);
+  manifest_t * m = lsx_calloc(1, sizeof(*m));
+  sox_bool version_ok = sox_false;
+
+  m->lines = lines;
+  for (i = 0; i < count; ++i) {
+    char * s = lines[i];
+    uint64_t x[7];
+    int n;
+
+    if (!strcmp(s, "sox-manifest 1"))
+      version_ok = sox_true;
+    else if (!strncmp(s, "input ", (size_t)6) && (s += 6, read_numbers(&s, x, 1)) && *s)
+      m->length = x[0], m->input = s;
+    else if (sscanf(s, "rates %lf %lf%n", &m->rates[0], &m->rates[1], &n) == 2 &&
+        !s[n]);
+    else if (!strncmp(s, "output ", (size_t)7) && s[7])
+      m->output = s + 7;
+    else if (!strncmp(s, "arg ", (size_t)4)) {
+      lsx_revalloc(m->argv, m->argc + 1);
+      m->argv[m->argc++] = s + 4;
+    }
+    else if (!strncmp(s, "segment ", (size_t)8) && (s += 8, read_numbers(&s, x, 7)) &&
+        *s && x[0] == m->n + 1 && m->n < MAX_SEGMENTS) {
+      segment_t * seg = &m->seg[m->n];
+      seg->from = x[1], seg->start = x[2], seg->end = x[3];
+      seg->read_end = x[4], seg->skip = x[5], seg->length = x[6];
+      m->part[m->n++] = s;
+    }
+    else {
+      lsx_fail("manifest `%s' line %" PRIuPTR ": not understood", filename,
+          line_nums[i]);
+      exit(1);
+    }
+  }
+  if (!version_ok || !m->input || !m->output || !m->rates[0] || !m->n || !m->argc) {
+    lsx_fail("`%s' is not a complete SoX segment manifest", filename);
+    exit(1);
+  }
+  free(line_nums);
+  return m;
+}
+
+/* Handles `sox --render MANIFEST N [gopts]': sets *argc & *argv to the
+ * arguments of SoX given in the manifest (after gopts), with which segment N
+ * is to be rendered to its part file (see flow_rendered_segment). */
+static void render(int * argc, char * * * argv)
+{
+  char * * args = *argv, dummy;
+  unsigned k;
+
+  if (*argc < 4 || sscanf(args[3], "%u %c", &k, &dummy) != 1)
+    usage("--render requires a manifest filename and a segment number");
+  manifest = read_manifest(args[2]);
+  if (k < 1 || k > manifest->n) {
+    lsx_fail("the manifest has no segment %u", k);
+    exit(1);
+  }
+  manifest->n = k;   /* Henceforth, the segment to render */
+  *argv = lsx_calloc((size_t)(*argc - 4 + manifest->argc + 2), sizeof(**argv));
+  (*argv)[0] = args[0];
+  memcpy(*argv + 1, args + 4, (*argc - 4) * sizeof(*args));
+  memcpy(*argv + *argc - 3, manifest->argv, manifest->argc * sizeof(*args));
+  *argc += manifest->argc - 3;
+}
+
+static checkpoint_t * read_checkpoint(char const * filename)
+{
+  size_t count, * line_nums, i;
+  char * * lines = read_batch_file(filename, "checkpoint", &count, &line_nums);
+  checkpoint_t * cp = lsx_calloc(1, sizeof(*cp));
+  sox_bool version_ok = sox_false, position_ok = sox_false;
+
+  cp->lines = lines;
+  for (i = 0; i < count; ++i) {
+    char * s = lines[i];
+    uint64_t x[4];
+    int n;
+
+    if (!strcmp(s, "sox-checkpoint 1"))
+      version_ok = sox_true;
+    else if (!strncmp(s, "input ", (size_t)6) && (s += 6, read_numbers(&s, x, 1)) && *s)
+      cp->length = x[0], cp->input = s;
+    else if (sscanf(s, "rates %lf %lf%n", &cp->rates[0], &cp->rates[1], &n) == 2 &&
+        !s[n]);
+    else if (!strncmp(s, "output ", (size_t)7) && s[7])
+      cp->output = s + 7;
+    else if (!strncmp(s, "position ", (size_t)9) && (s += 9, read_numbers(&s, x, 3)) &&
+        isdigit((unsigned char)*s) && (x[3] = strtoull(s, &s, 10), !*s)) {
+      cp->start = x[0], cp->in = x[1], cp->out = x[2], cp->offset = x[3];
+      position_ok = sox_true;
+    }
+    else if (!strncmp(s, "arg ", (size_t)4)) {
+      lsx_revalloc(cp->argv, cp->argc + 1);
+      cp->argv[cp->argc++] = s + 4;
+    }
+    else {
+      lsx_fail("checkpoint `%s' line %" PRIuPTR ": not understood", filename,
+          line_nums[i]);
+      exit(1);
+    }
+  }
+  if (!version_ok || !cp->input || !cp->output || !cp->rates[0] ||
+      !position_ok || !cp->argc) {
+    lsx_fail("`%s' is not a complete SoX checkpoint", filename);
+    exit(1);
+  }
+  free(line_nums);
+  return cp;
+}
+
+/* Handles `sox --resume CHECKPOINT [gopts]': sets *argc & *argv to the
+ * arguments of SoX given in the checkpoint (after gopts), with which the
+ * processing is carried on from it (see flow_resumed). */
+static void resume(int * argc, char * * * argv)
+{
+  char * * args = *argv;
+
+  if (*argc < 3)
+    usage("--resume requires a checkpoint filename");
+  resume_point = read_checkpoint(args[2]);
+  *argv = lsx_calloc((size_t)(*argc - 3 + resume_point->argc + 2), sizeof(**argv));
+  (*argv)[0] = args[0];
+  memcpy(*argv + 1, args + 3, (*argc - 3) * sizeof(*args));
+  memcpy(*argv + *argc - 2, resume_point->argv, resume_point->argc * sizeof(*args));
+  *argc += resume_point->argc - 2;
+}
+
+/* Handles `sox --stitch MANIFEST': joins the parts rendered from the manifest
+ * into its output file, decoding & encoding (losslessly) just the audio
+ * data, so that the output file's header is written afresh; returns the exit
+ * status. */
+static int stitch(char const * filename)
+{
+  manifest_t * m = manifest = read_manifest(filename);
+  sox_format_t * parts[MAX_SEGMENTS] = {NULL}, * out = NULL;
+  sox_signalinfo_t signal;
+  sox_sample_t * buf = lsx_malloc(sox_globals.bufsiz * sizeof(*buf));
+  size_t len = 0;
+  unsigned k, opened;
+  int status = 1;
+
+  for (opened = 0; opened < m->n; ++opened) {
+    sox_format_t * ft = parts[opened] =
+      sox_open_read(m->part[opened], NULL, NULL, NULL);
+    if (!ft)
+      break;
+    if (opened && (ft->signal.rate != parts[0]->signal.rate ||
+          ft->signal.channels != parts[0]->signal.channels ||
+          ft->encoding.encoding != parts[0]->encoding.encoding ||
+          ft->encoding.bits_per_sample != parts[0]->encoding.bits_per_sample)) {
+      lsx_fail("`%s' is not in the same format as `%s'", m->part[opened],
+          m->part[0]);
+      sox_close(ft);
+      break;
+    }
+  }
+  if (opened == m->n) {
+    signal = parts[0]->signal;
+    for (k = 1; k < m->n; ++k)
+      signal.length += parts[k]->signal.length;
+    out = sox_open_write(m->output, &signal, &parts[0]->encoding,
+        parts[0]->filetype, &parts[0]->oob, overwrite_permitted);
+  }
+  if (out) {
+    for (k = 0; k < m->n; ++k) {
+      while ((len = sox_read(parts[k], buf, sox_globals.bufsiz)) != 0 &&
+          sox_write(out, buf, len) == len);
+      if (len || parts[k]->sox_errno) {
+        sox_format_t * ft = len? out : parts[k];
+        lsx_fail("`%s' %s: %s", ft->filename, ft->sox_errstr,
+            sox_strerror(ft->sox_errno));
+        break;
+      }
+    }
+    if (k == m->n)
+      status = 0;
+    if (sox_close(out) != SOX_SUCCESS || status) {
+      status = 1;
+      unlink(m->output);
+    }
+  }
+  while (opened--)
+    sox_close(parts[opened]);
+  free(buf);
+  return status;
+}
+
+/* Handles `sox --retag [FOPTS] FILE ...': replaces just the comments of each
+ * file as given by its --comment, --add-comment or --comment-file options,
+ * rewriting its header or tags in place (see sox_rewrite_comments) rather
+ * than re-encoding it; returns the exit status. */
+static int retag(int argc, char **argv)
+{
+  size_t i;
+  int status = 0;
+
+  parse_options_and_filenames(argc, argv);
+  input_count = file_count ? file_count - 1 : 0;  /* For cleanup */
+  if (optstate.ind < argc)
+    usage("--retag takes no effects");
+  if (!file_count)
+    usage("--retag requires at least one filename");
+  for (i = 0; i < file_count; ++i)
+    if (!files[i]->oob.comments)
+      usage("--retag requires comment options for each file");
+  for (i = 0; i < file_count; ++i) {
+    file_t * f = files[i];
+    sox_comments_t p = f->oob.comments, comments = NULL;
+    sox_bool append = **p != '\0'; /* --add-comment, else replace */
+    sox_format_t * ft = NULL;
+
+    if (append && !(ft = sox_open_probe(f->filename, f->filetype)))
+      status = 2;
+    else {
+      if (append) {
+        sox_read_comments(ft);
+        comments = sox_copy_comments(ft->oob.comments);
+        sox_close(ft);
+      }
+      else ++p;
+      while (*p)
+        sox_append_comment(&comments, *p++);
+      if (sox_rewrite_comments(f->filename, f->filetype, comments) != SOX_SUCCESS)
+        status = 2;
+    }
+    sox_delete_comments(&comments);
+    if (i + 1 == file_count || files[i + 1]->oob.comments != f->oob.comments)
+      sox_delete_comments(&f->oob.comments); /* Shared by a glob's files */
+  }
+  return status;
+}
+
 int main(int argc, char **argv)
 {
   size_t i;
@@ -2856,6 +6878,7 @@ int main(int argc, char **argv)
   gettimeofday(&load_timeofday, NULL);
   myname = argv[0];
   sox_globals.output_message_handler = output_message;
+  sox_globals.defer_comments = sox_true;
 
   if (0 != sox_basename(mybase, sizeof(mybase), myname))
   {
@@ -2873,6 +6896,7 @@ int main(int argc, char **argv)
 
   if (sox_init() != SOX_SUCCESS)
     exit(1);
+  startup_done(startup_init);
 
   stdin_is_a_tty = isatty(fileno(stdin));
   errno = 0; /* Both isatty & fileno may set errno. */
@@ -2882,13 +6906,44 @@ int main(int argc, char **argv)
   if (sox_mode == sox_soxi)
     exit(soxi(argc, argv));
 
+  if (argc > 1 && !strcmp(argv[1], "--batch"))
+    batch(&argc, &argv);                 /* Returns only in a batch job */
+  else if (argc > 1 && !strcmp(argv[1], "--daemon"))
+    serve(&argc, &argv);                 /* Returns only in a daemon's job */
+  if (argc > 1 && !strcmp(argv[1], "--render"))
+    render(&argc, &argv);
+  else if (argc > 1 && !strcmp(argv[1], "--resume"))
+    resume(&argc, &argv);
+  else if (argc > 1 && !strcmp(argv[1], "--retag"))
+    exit(retag(argc - 1, argv + 1));
+  else if (argc > 1 && !strcmp(argv[1], "--stitch")) {
+    if (argc != 3)
+      usage("--stitch requires a manifest filename");
+    exit(stitch(argv[2]));
+  }
+  sox_argc = argc, sox_argv = argv;
+
   parse_options_and_filenames(argc, argv);
+  startup_done(startup_options);
 
   if (sox_globals.verbosity > 2)
     display_SoX_version(stderr);
 
   input_count = file_count ? file_count - 1 : 0;
 
+  if (manifest) {   /* --render: the output is to the segment's part file */
+    if (!file_count || strcmp(ofile->filename, manifest->output)) {
+      lsx_fail("the output file differs from the manifest's");
+      exit(1);
+    }
+    free(ofile->filename);
+    ofile->filename = lsx_strdup(manifest->part[manifest->n - 1]);
+  }
+  if (resume_point && (!file_count || strcmp(ofile->filename, resume_point->output))) {
+    lsx_fail("the output file differs from the checkpoint's");
+    exit(1);
+  }
+
   if (file_count) {
     sox_format_handler_t const * handler =
       sox_write_handler(ofile->filename, ofile->filetype, NULL);
@@ -2903,6 +6958,11 @@ int main(int argc, char **argv)
   if (combine_method == sox_sequence && input_count == 1)
     combine_method = sox_concatenate;
 
+  /* So that there need be no gap between the files played */
+  if (is_player && is_serial(combine_method) && input_count > 1 &&
+      decode_ahead < 0 && (sox_version_info()->flags & sox_version_have_threads))
+    decode_ahead = 4;
+
   /* Make sure we got at least the required # of input filenames */
   if (input_count < (size_t)(is_serial(combine_method) ? 1 : 2))
     usage("Not enough input filenames specified");
@@ -2919,6 +6979,9 @@ int main(int argc, char **argv)
             "\tuse the `gain' or `vol' effect to set the output file volume");
   if (ofile->signal.length != SOX_UNSPEC)
     usage("--ignore-length can be given only for an input file");
+  for (i = 0; i < tee_count; ++i)
+    if (tees[i]->volume != HUGE_VAL || tees[i]->signal.length != SOX_UNSPEC)
+      usage("-v and --ignore-length can be given only for an input file");
 
   signal(SIGINT, SIG_IGN); /* So child pipes aren't killed by track skip */
   for (i = 0; i < input_count; i++) {
@@ -2947,6 +7010,12 @@ int main(int argc, char **argv)
       /* sox_open_read() will call lsx_warn for most errors.
        * Rely on that printing something. */
       exit(2);
+    if (input_comments_wanted(j))
+      sox_read_comments(files[j]->ft);
+    if (f->io_async)
+      sox_set_io_async(files[j]->ft, f->io_async);
+    if (decode_ahead > 0 && (is_parallel(combine_method) || !j))
+      sox_set_decode_ahead(files[j]->ft, (unsigned)decode_ahead);
     if (show_progress == sox_option_default &&
         (files[j]->ft->handler.flags & SOX_FILE_DEVICE) != 0 &&
         (files[j]->ft->handler.flags & SOX_FILE_PHONY) == 0)
@@ -2966,6 +7035,7 @@ int main(int argc, char **argv)
 
   for (i = 0; i < input_count; i++)
     set_replay_gain(files[i]->ft->oob.comments, files[i]);
+  startup_done(startup_inputs);
 
   signal(SIGINT, SIG_DFL);
 
@@ -2973,6 +7043,14 @@ int main(int argc, char **argv)
   add_eff_chain();
   parse_effects(argc, argv);
   eff_chain_count++;
+  startup_done(startup_effects);
+  if (segment_time && (eff_chain_count > 1 || segments ||
+        combine_method == sox_sequence)) {
+    lsx_fail("--segment-time can't be used with `newfile', `restart', --segments or --combine sequence");
+    exit(1);
+  }
+  if (segment_time && !playlist)
+    playlist = default_playlist(".m3u8");
   /* Note: Purposely not calling add_eff_chain() to save some
    * memory although it would be more consistent to do so.
    */
@@ -3016,6 +7094,8 @@ int main(int argc, char **argv)
       ofile->ft = NULL;
     }
   }
+  if (segment_time && ofile->ft)
+    finish_segments();
 
   sox_delete_effects_chain(effects_chain);
   delete_eff_chains();
@@ -3028,6 +7108,11 @@ int main(int argc, char **argv)
                        files[i]->ft->handler.names[0] : files[i]->ft->filename,
           files[i]->ft->clips);
 
+  for (i = 0; i < tee_count; ++i)
+    if (tees[i]->ft->clips != 0)
+      lsx_warn("`%s' output clipped %" PRIu64 " samples; decrease volume?",
+          tees[i]->ft->filename, tees[i]->ft->clips);
+
   if (mixing_clips > 0)
     lsx_warn("mix-combining clipped %" PRIu64 " samples; decrease volume?", mixing_clips);
 
@@ -3047,7 +7132,28 @@ int main(int argc, char **argv)
 
   success = 1; /* Signal success to cleanup so the output file isn't removed. */
 
+  /* An upload is completed only as it is closed, and that may fail */
+  if (file_count && ofile->ft && ofile->ft->io_type == lsx_io_upload) {
+    upload_failed = sox_close(ofile->ft) != SOX_SUCCESS;
+    ofile->ft = NULL;
+  }
+
+  /* The playlist gives sizes; the first segment's is known once closed */
+  if (segment_time && file_count && ofile->ft) {
+    sox_signalinfo_t signal = ofile->ft->signal;
+    char const * type = ofile->ft->handler.names[0];
+
+    segment_failed |= sox_close(ofile->ft) != SOX_SUCCESS;
+    ofile->ft = NULL;
+    if (!segment_failed)
+      write_playlist(&signal, type);
+  }
+  for (i = 0; i < stream_seg_count; ++i)
+    free(stream_segs[i].filename);
+  free(stream_segs);
+  free(playlist);
+
   cleanup();
 
-  return 0;
+  return split_failed || upload_failed || segment_failed? 2 : 0;
 }
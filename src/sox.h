@@ -556,7 +556,8 @@ typedef enum sox_version_flags_t {
     sox_version_have_popen = 1,   /**< popen = 1. */
     sox_version_have_magic = 2,   /**< magic = 2. */
     sox_version_have_threads = 4, /**< threads = 4. */
-    sox_version_have_memopen = 8  /**< memopen = 8. */
+    sox_version_have_memopen = 8, /**< memopen = 8. */
+    sox_version_have_io_uring = 16 /**< io_uring = 16. */
 } sox_version_flags_t;
 
 /**
@@ -619,6 +620,16 @@ typedef enum sox_plot_t {
     sox_plot_data     /**< Plot data = 3. */
 } sox_plot_t;
 
+/**
+Client API:
+How sox_flow_effects schedules the effects of a chain.
+*/
+typedef enum sox_chain_mode_t {
+    SOX_CHAIN_SERIAL,   /**< Run all effects in turn on the calling thread = 0. */
+    SOX_CHAIN_PIPELINED,/**< Run each effect on its own thread (needs OpenMP) = 1. */
+    SOX_CHAIN_REALTIME  /**< As serial, but push blocks of sox_globals.realtime_block frames through the whole chain in turn, for bounded latency = 2. */
+} sox_chain_mode_t;
+
 /**
 Client API:
 Loop modes: upper 4 bits mask the loop blass, lower 4 bits describe
@@ -640,7 +651,9 @@ typedef enum lsx_io_type
 {
     lsx_io_file, /**< File is a real file = 0. */
     lsx_io_pipe, /**< File is a pipe (no seeking) = 1. */
-    lsx_io_url   /**< File is a URL (no seeking) = 2. */
+    lsx_io_url,  /**< File is a URL (no seeking) = 2. */
+    lsx_io_mem,  /**< File is a caller's buffer, read as a map (see SOX_FILE_MMAP) = 3. */
+    lsx_io_upload /**< File is an s3: URL, uploaded as it is written (seeking only back into its first part) = 4. */
 } lsx_io_type;
 
 /*****************************************************************************
@@ -1076,6 +1089,9 @@ if clipping occurs.
 #define SOX_FILE_MONO    0x0100 /**< Client API: Do channel restrictions allow mono? */
 #define SOX_FILE_STEREO  0x0200 /**< Client API: Do channel restrictions allow stereo? */
 #define SOX_FILE_QUAD    0x0400 /**< Client API: Do channel restrictions allow quad? */
+#define SOX_FILE_MMAP    0x0800 /**< Client API: Reads only through lsx_ I/O, so input may be memory-mapped */
+#define SOX_FILE_RAWPCM  0x1000 /**< Client API: Writes integer PCM only through lsx_rawwrite, so a quantiser may be fused with it (see sox_fuse_output) */
+#define SOX_FILE_CLONE   0x2000 /**< Client API: Private data holds nothing owned once startread is done, and seek resets the reader, so a reader may be cloned (see sox_open_read_clone) */
 
 #define SOX_FILE_CHANS   (SOX_FILE_MONO | SOX_FILE_STEREO | SOX_FILE_QUAD) /**< Client API: No channel restrictions */
 #define SOX_FILE_LIT_END (SOX_FILE_ENDIAN | 0)                             /**< Client API: File is little-endian */
@@ -1092,6 +1108,13 @@ if clipping occurs.
 #define SOX_EFF_MODIFY   256         /**< Client API: Effect does not modify sample values (but might remove or duplicate samples or insert zeros) */
 #define SOX_EFF_ALPHA    512         /**< Client API: Effect is experimental/incomplete */
 #define SOX_EFF_INTERNAL 1024        /**< Client API: Effect present in libSoX but not valid for use by SoX command-line tools */
+#define SOX_EFF_PLANAR   2048        /**< Client API: MCHAN effect can also take and give uninterleaved (planar) buffers; see sox_effect_t.planar */
+#define SOX_EFF_SEEK     4096        /**< Client API: Effect has no history and alters neither rate nor length, so input it would be given can instead be skipped, e.g. by seeking */
+#define SOX_EFF_INPLACE  8192        /**< Client API: Effect's flow may be given the same buffer as ibuf and obuf; it must then take all of its input, and write no sample before reading the one at the same position */
+#define SOX_EFF_LINEAR   16384       /**< Client API: Effect is linear (its output for a sum of signals is the sum of its outputs for each) and, unless SOX_EFF_CHAN, treats each channel alike and apart; so channels may be mixed before it instead of after */
+#define SOX_EFF_TIMEINV  32768       /**< Client API: Effect is SOX_EFF_LINEAR, time-invariant and has no parameters in samples or Hz (e.g. it just scales or mixes), so may be given audio down-sampled beforehand instead of after */
+#define SOX_EFF_RTSAFE   65536       /**< Client API: Effect is realtime-safe: once started, its flow and drain neither allocate memory, nor wait on locks or I/O (see sox_globals_t.realtime_safe) */
+#define SOX_EFF_OPTIONAL 131072      /**< Client API: Effect's output is its input and it makes nothing else (no file or report) that would then cover only part of the audio, so may be bypassed whilst a chain is short of time (see sox_globals_t.governor) */
 
 /**
 Client API:
@@ -1216,6 +1239,41 @@ typedef int (LSX_API * sox_format_handler_seek)(
     sox_uint64_t offset /**< Sample offset to which reader should be positioned. */
     );
 
+/**
+Client API:
+Callback to replace the comments of a file in place, without re-encoding
+its audio, used by sox_format_handler.rewrite_comments.
+@returns SOX_SUCCESS if successful.
+*/
+typedef int (LSX_API * sox_format_handler_rewrite_comments)(
+    LSX_PARAM_IN_Z char const * path, /**< Path to the file (not stdio). */
+    LSX_PARAM_IN_OPT sox_comments_t comments /**< The new comments (all of them), or NULL for none. */
+    );
+
+/**
+Client API:
+Callback to read (decode) a block of samples into a buffer per channel,
+used by sox_format_handler.read_planar.
+@returns number of samples read into each buffer, or 0 if unsuccessful.
+*/
+typedef size_t (LSX_API * sox_format_handler_read_planar)(
+    LSX_PARAM_INOUT sox_format_t * ft, /**< Format pointer. */
+    LSX_PARAM_IN sox_sample_t * const * bufs, /**< Buffers (one per channel) to which samples are written. */
+    size_t len /**< Number of samples available in each buffer. */
+    );
+
+/**
+Client API:
+Callback to write (encode) a block of samples from a buffer per channel,
+used by sox_format_handler.write_planar.
+@returns number of samples written from each buffer, or 0 if unsuccessful.
+*/
+typedef size_t (LSX_API * sox_format_handler_write_planar)(
+    LSX_PARAM_INOUT sox_format_t * ft, /**< Format pointer. */
+    LSX_PARAM_IN sox_sample_t const * const * bufs, /**< Buffers (one per channel) from which samples are read. */
+    size_t len /**< Number of samples in each buffer. */
+    );
+
 /**
 Client API:
 Callback to parse command-line arguments (called once per effect),
@@ -1264,6 +1322,48 @@ typedef int (LSX_API * sox_effect_handler_drain)(
     LSX_PARAM_INOUT size_t *osamp /**< On entry, contains capacity of obuf; on exit, contains number of samples written. */
     );
 
+/**
+Client API:
+Callback to process float samples (nominally in the range [-1,1), and not
+clipped), used by sox_effect_t.flow_float when
+sox_globals.float_chain is set.
+@returns SOX_SUCCESS if successful.
+*/
+typedef int (LSX_API * sox_effect_handler_flow_float)(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect pointer. */
+    LSX_PARAM_IN_COUNT(*isamp) float const * ibuf, /**< Buffer from which to read samples. */
+    LSX_PARAM_OUT_CAP_POST_COUNT(*osamp,*osamp) float * obuf, /**< Buffer to which samples are written. */
+    LSX_PARAM_INOUT size_t *isamp, /**< On entry, contains capacity of ibuf; on exit, contains number of samples consumed. */
+    LSX_PARAM_INOUT size_t *osamp /**< On entry, contains capacity of obuf; on exit, contains number of samples written. */
+    );
+
+/**
+Client API:
+Callback to finish getting float output after input is complete,
+used by sox_effect_t.drain_float.
+@returns SOX_SUCCESS if successful.
+*/
+typedef int (LSX_API * sox_effect_handler_drain_float)(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect pointer. */
+    LSX_PARAM_OUT_CAP_POST_COUNT(*osamp,*osamp) float *obuf, /**< Buffer to which samples are written. */
+    LSX_PARAM_INOUT size_t *osamp /**< On entry, contains capacity of obuf; on exit, contains number of samples written. */
+    );
+
+/**
+Client API:
+Callback to process samples straight to packed signed 16-bit integers, as
+they are to be written to a file, used by sox_effect_t.pack.
+@returns SOX_SUCCESS if successful.
+*/
+typedef int (LSX_API * sox_effect_handler_pack)(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect pointer (of the flow). */
+    LSX_PARAM_IN sox_sample_t const * ibuf, /**< The flow's first input sample; the rest follow every stride samples. */
+    LSX_PARAM_OUT void * obuf, /**< Where the first output goes; the rest follow every 2 * stride bytes. */
+    size_t len, /**< Number of samples to process. */
+    size_t stride, /**< Distance between samples of the flow, e.g. the number of interleaved channels. */
+    sox_bool swap /**< True if the output's bytes are to be swapped from the CPU's order. */
+    );
+
 /**
 Client API:
 Callback to shut down effect (called once per flow),
@@ -1284,6 +1384,59 @@ typedef int (LSX_API * sox_effect_handler_kill)(
     LSX_PARAM_INOUT sox_effect_t * effp /**< Effect pointer. */
     );
 
+/**
+Client API:
+Callback to return an effect to its state just after start, keeping (not
+freeing or redesigning) whatever start set up (called once per flow),
+used by sox_effect_handler.reset.
+@returns SOX_SUCCESS if successful.
+*/
+typedef int (LSX_API * sox_effect_handler_reset)(
+    LSX_PARAM_INOUT sox_effect_t * effp /**< Effect pointer. */
+    );
+
+/**
+Client API:
+Callback to give what the effect's analysis has gathered (over its span) as
+a partial result (called once per flow, after drain), used by
+sox_effect_handler.save; see sox_effect_save.
+@returns the size of the partial result, which is written to buf only if it
+is at most len; 0 if the effect, as configured, can't give one.
+*/
+typedef size_t (LSX_API * sox_effect_handler_save)(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect pointer. */
+    LSX_PARAM_OUT_BYTECAP(len) void * buf, /**< Buffer for the partial result (may be NULL if len is 0). */
+    size_t len /**< Size of buf in bytes. */
+    );
+
+/**
+Client API:
+Callback to add, to what the effect's analysis has gathered, a partial
+result that was saved by another instance of it, covering the audio that
+follows (called once per flow, after drain), used by
+sox_effect_handler.merge; see sox_effect_merge.
+@returns SOX_SUCCESS if successful.
+*/
+typedef int (LSX_API * sox_effect_handler_merge)(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect pointer. */
+    LSX_PARAM_IN_BYTECOUNT(len) void const * buf, /**< The partial result. */
+    size_t len /**< Size of the partial result in bytes. */
+    );
+
+/**
+Client API:
+Callback to change the effect's options while it runs, without its being
+restarted (called once per flow), used by sox_effect_handler.update; see
+sox_effect_update.
+@returns SOX_SUCCESS if successful, or SOX_EOF if the options are invalid,
+or can't be changed in place.
+*/
+typedef int (LSX_API * sox_effect_handler_update)(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect pointer. */
+    int argc, /**< Number of arguments in argv. */
+    LSX_PARAM_IN_COUNT(argc) char * argv[] /**< Array of command-line arguments, argv[0] being the effect's name. */
+    );
+
 /**
 Client API:
 Callback called while flow is running (called once per buffer),
@@ -1306,6 +1459,19 @@ typedef int (LSX_API * sox_playlist_callback_t)(
     LSX_PARAM_IN_Z char const * filename
     );
 
+/**
+Client API:
+Callback to take each frame of features made by a features effect,
+set by sox_set_features_callback.
+@returns SOX_SUCCESS to continue, other value to stop the effect.
+*/
+typedef int (LSX_API * sox_features_callback_t)(
+    void * client_data,
+    unsigned channel, /**< Of the audio the frame is from, counting from 0. */
+    LSX_PARAM_IN_COUNT(len) float const * frame, /**< MFCCs, or log-mel energies. */
+    size_t len /**< Number of values in frame. */
+    );
+
 /*****************************************************************************
 Structures:
 *****************************************************************************/
@@ -1317,7 +1483,7 @@ function.
 */
 typedef struct sox_version_info_t {
     size_t       size;         /**< structure size = sizeof(sox_version_info_t) */
-    sox_version_flags_t flags; /**< feature flags = popen | magic | threads | memopen */
+    sox_version_flags_t flags; /**< feature flags = popen | magic | threads | memopen | io_uring */
     sox_uint32_t version_code; /**< version number = 0x140400 */
     char const * version;      /**< version string = sox_version(), for example, "14.4.0" */
     char const * version_extra;/**< version extra info or null = "PACKAGE_EXTRA", for example, "beta" */
@@ -1328,6 +1494,26 @@ typedef struct sox_version_info_t {
     /* new info should be added at the end for version backwards-compatibility. */
 } sox_version_info_t;
 
+/**
+Client API:
+A back-end for batches of real DFTs (e.g. on a GPU), set in
+sox_globals_t.fft_backend; libSoX's DFT-based effects give it the batches
+that they transform, other than in SOX_CHAIN_REALTIME chains.  Each transform
+is as libSoX's own: len (a power of 2) values in place; type 1 (forward)
+gives the spectrum packed as re[0], re[len/2], then re, im of each bin in
+turn; type -1 (inverse) takes that, giving len/2 times the signal.
+*/
+typedef struct sox_fft_backend_t {
+  char const * name;     /**< For messages, e.g. "cuda" */
+  size_t       min_batch; /**< Fewest transforms worth giving it; smaller batches are done on the CPU */
+  /** Transforms count consecutive arrays, each of len doubles, at data.
+  @returns SOX_SUCCESS, or otherwise to have the CPU do the batch instead. */
+  int (LSX_API * rdft_batch)(void * client_data, int len, int type, size_t count, double * data);
+  /** As rdft_batch, but of floats; may be NULL. */
+  int (LSX_API * rdft_batch_f)(void * client_data, int len, int type, size_t count, float * data);
+  void       * client_data; /**< Passed to rdft_batch and rdft_batch_f */
+} sox_fft_backend_t;
+
 /**
 Client API:
 Global parameters (for effects & formats), returned from the sox_get_globals
@@ -1355,7 +1541,7 @@ typedef struct sox_globals_t {
 
   char const * stdin_in_use_by;  /**< Private: tracks the name of the handler currently using stdin */
   char const * stdout_in_use_by; /**< Private: tracks the name of the handler currently using stdout */
-  char const * subsystem;        /**< Private: tracks the name of the handler currently writing an output message */
+  char const * subsystem;        /**< Private: no longer used (see lsx_set_subsystem) */
   char       * tmp_path;         /**< Private: client-configured path to use for temporary files */
   sox_bool     use_magic;        /**< Private: true if client has requested use of 'magic' file-type detection */
   sox_bool     use_threads;      /**< Private: true if client has requested parallel effects processing */
@@ -1365,8 +1551,47 @@ typedef struct sox_globals_t {
   Plugins should use similarly-sized DFTs to get best performance.
   */
   size_t       log2_dft_min_size;
+
+  sox_chain_mode_t chain_mode;   /**< How sox_flow_effects schedules the effects; see sox_chain_mode_t */
+  sox_bool     float_chain;      /**< true if effects that set flow_float should pass float samples to each other */
+
+  /**
+  Log to base 2 of the block size (in samples) in which DFT filters with
+  longer responses are partitioned, to bound their latency; 0 for none.
+  */
+  size_t       log2_dft_block_size;
+
+  char       * design_cache_path; /**< Directory in which to keep filter designs between runs, or NULL */
+  sox_bool     profile;          /**< true if sox_flow_effects should keep each effect's stats (see sox_effects_chain_stats) */
+  size_t       codec_threads;    /**< Threads a format handler may use to encode or decode one file (0 or 1: no more than the caller's) */
+  size_t       device_period;    /**< Frames per period of an audio device's buffer (0: derived from bufsiz) */
+  unsigned     device_periods;   /**< Periods in an audio device's buffer (0: the handler's default) */
+  size_t       realtime_block;   /**< Frames per block in SOX_CHAIN_REALTIME mode (0: device_period, or else 256) */
+  sox_bool     io_uring;         /**< true if asynchronous I/O (see sox_set_io_async) to regular files should go through io_uring, where available */
+  size_t       write_block;      /**< If nonzero, regular output files are written in page-aligned blocks of this many bytes, with space preallocated where their length is known */
+  sox_bool     direct_io;        /**< true if writes of write_block blocks should bypass the page cache (O_DIRECT), where able */
+  char       * decode_cache_path; /**< Directory in which to keep input files of compressed encodings as decoded, for later reads of them, or NULL */
+  size_t       threads;          /**< If nonzero, most threads that libSoX's parallel regions may have busy at once, in all, counting the threads that fork them; otherwise, as many as they ask for */
+  sox_bool     realtime_safe;    /**< true if a SOX_CHAIN_REALTIME chain should run at real-time priority with memory locked, and count each effect's allocations in flow and drain (see sox_effect_t.rt_allocations) */
+  sox_bool     defer_comments;   /**< true if format handlers may leave comments whose reading costs extra seeks (e.g. MP3's ID3 tags at the end of the file) unread until sox_read_comments is called */
+  size_t       header_prefetch;  /**< Bytes at the start of a seekable input file or URL to read at once, where its handler reads only through lsx_ I/O (SOX_FILE_MMAP), so that its header is parsed from memory; 0: none */
+  sox_fft_backend_t const * fft_backend; /**< If not NULL, to take batches of DFTs from effects (see sox_fft_backend_t) */
+  sox_bool     gapless;          /**< true if encoders that prime (add a delay and padding to the audio) should record these in each file they write, where the format allows, so that it decodes to just its own samples */
+  sox_bool     updatable;        /**< true if effects that can take sox_effect_update should be kept for it as chains are built: not dropped for having no effect as configured, nor fused with the effect before them */
+  size_t       fifo_max;         /**< If nonzero, bytes that each FIFO of an effect that buffers (rate, tempo, the DFT filters) should hold, at most, before the effect takes less input; 0: as the effect needs */
+  sox_bool     device_poll;      /**< true if audio devices that can (OSS) should be driven without blocking, waiting in poll() only when a bufsiz ring of output ahead of the device is full, or for input */
+  sox_bool     fast_math;        /**< true if effects may use vectorised approximations of exp, log10, sin and cos instead of libm, at an error below 1e-9 */
+  double       governor;         /**< If nonzero, in SOX_CHAIN_REALTIME mode, the most of the audio's duration (e.g. .7) that the effects between the first and the last may take in flow and drain before their quality is lowered (see sox_effect_t.degrade); it is raised again once they take less than half of that */
 } sox_globals_t;
 
+/**
+Client API:
+A set of libSoX settings under which files are opened and effects chains
+run (see sox_create_context); the global settings, returned from
+sox_get_globals, are the default context.
+*/
+typedef sox_globals_t sox_context_t;
+
 /**
 Client API:
 Signal parameters; members should be set to SOX_UNSPEC (= 0) if unknown.
@@ -1459,6 +1684,23 @@ typedef struct sox_fileinfo_t {
   size_t        pos;                  /**< Position in buffer */
 } sox_fileinfo_t;
 
+/**
+Client API:
+A magic number by which files of a format may be recognised when opened for
+reading: length bytes at offset and, unless length2 is 0, length2 bytes at
+offset2.  Bytes must lie within the first 4096 of the file (256 if the file
+is to be recognised when read from a pipe).  An array of signatures is
+terminated by one with length 0.
+*/
+typedef struct sox_format_signature_t {
+  unsigned     offset;                /**< Position of bytes in the file */
+  unsigned     length;                /**< Number of bytes to compare */
+  char         const * bytes;         /**< Bytes expected (may include NULs) */
+  unsigned     offset2;               /**< Position of bytes2 in the file */
+  unsigned     length2;               /**< Number of bytes2 to compare, or 0 */
+  char         const * bytes2;        /**< Further bytes expected */
+} sox_format_signature_t;
+
 /**
 Client API:
 Handler structure defined by each format.
@@ -1503,6 +1745,32 @@ struct sox_format_handler_t {
   The buffer will be provided via format.priv in each call to the handler.
   */
   size_t       priv_size;
+
+  /**
+  Magic numbers by which the format's files may be auto-detected, or NULL.
+  Needed only by formats not already known to auto-detection (see
+  sox_format_signature_t).
+  */
+  sox_format_signature_t const * signatures;
+
+  /**
+  Replaces a file's comments in place, rewriting only its header or tag
+  region, or NULL if not supported.
+  */
+  sox_format_handler_rewrite_comments rewrite_comments;
+
+  /**
+  Reads samples as read does, but uninterleaved, into a buffer per channel,
+  or NULL; for a decoder whose output is so, saving it interleaving them
+  for an effects chain that would uninterleave them (see sox_read_planar).
+  */
+  sox_format_handler_read_planar read_planar;
+
+  /**
+  Writes samples as write does, but from a buffer per channel, or NULL (see
+  sox_write_planar).
+  */
+  sox_format_handler_write_planar write_planar;
 };
 
 /**
@@ -1561,6 +1829,23 @@ struct sox_format_t {
   sox_uint64_t     data_start;      /**< Offset at which headers end and sound data begins (set by lsx_check_read_params) */
   sox_format_handler_t handler;     /**< Format handler for this file */
   void             * priv;          /**< Format handler's private data area */
+  /* The following items were added in libsox.so.4. */
+  unsigned char const * map;        /**< Input file's contents, if memory-mapped (see SOX_FILE_MMAP) */
+  sox_uint64_t     map_size;        /**< Length of map in bytes (of the file, for a clone read with pread; see shared) */
+  sox_bool         map_eof;         /**< Has a read of map gone past its end? */
+  void             * shared;        /**< Input shared with clones of this reader, if any (see sox_open_read_clone) */
+  unsigned char    * head;          /**< Start of the input file, read at once for its header to be parsed from, until reading or seeking leaves it (see sox_globals_t.header_prefetch) */
+  size_t           head_len;        /**< Length of head in bytes */
+  int              (*read_comments)(sox_format_t * ft); /**< If not NULL, reads the comments that startread left unread (see sox_read_comments) */
+  void             * io_async;      /**< Asynchronous I/O state, if any (see sox_set_io_async) */
+  void             * write_buf;     /**< Stdio buffer of write_block blocks, if any (see sox_globals_t.write_block) */
+  sox_effect_t     * quantiser;     /**< Effect (all of its flows) applied by lsx_rawwrite as it packs samples, if any (see sox_fuse_output); deleted by sox_close */
+  sox_bool         direct_io;       /**< Is being written with O_DIRECT (see sox_globals_t.direct_io) */
+  sox_bool         probe;           /**< Opened by sox_open_probe: the handler should read only what it must to fill in signal, encoding and oob */
+  sox_bool         length_estimated;/**< signal.length is an estimate (e.g. extrapolated from an MP3's bit-rate), not a count */
+  void             * decode_ahead;  /**< Decode-ahead state, if any (see sox_set_decode_ahead) */
+  void             * decode_cache;  /**< Decoded-audio cache state, if any (see sox_globals_t.decode_cache_path) */
+  sox_context_t    * context;       /**< Settings under which the file was opened (see sox_open_context_read) */
 };
 
 /**
@@ -1598,8 +1883,60 @@ struct sox_effect_handler_t {
   sox_effect_handler_stop stop;       /**< Called to shut down effect (called once per flow). */
   sox_effect_handler_kill kill;       /**< Called to shut down effect (called once per effect). */
   size_t       priv_size;             /**< Size of private data SoX should pre-allocate for effect */
+  sox_effect_handler_reset reset;     /**< Called by sox_effects_chain_reset (once per flow); NULL if the effect cannot be reset. */
+  sox_effect_handler_save save;       /**< Called by sox_effect_save (once per flow); NULL if the effect gives no partial results. */
+  sox_effect_handler_merge merge;     /**< Called by sox_effect_merge (once per flow); set if save is. */
+  sox_effect_handler_update update;   /**< Called by sox_effect_update (once per flow); NULL if the effect's options can't be changed while it runs. */
 };
 
+/**
+Client API:
+The part of its input that an effect's analysis is to cover, for partial
+results (see sox_effect_save); all zero (the default) for all of it.  Wide
+samples before the span are seen only to settle the effect's filters, and
+any after it are ignored.
+*/
+typedef struct sox_effect_span_t {
+  sox_uint64_t lead_in;         /**< Wide samples of input before the span */
+  sox_uint64_t length;          /**< Wide samples in the span; 0: to the end of the input */
+  sox_uint64_t offset;          /**< Where the span starts in the whole of the audio that is being analysed in parts, so that an effect that analyses blocks of it keeps to the same blocks */
+} sox_effect_span_t;
+
+/**
+Client API:
+Counters kept for an effect by sox_flow_effects whilst sox_globals.profile
+(or governor) is set; see sox_effects_chain_stats.  The average block size is
+samples_in / flows.
+*/
+typedef struct sox_effect_stats_t {
+  sox_uint64_t flows;           /**< Number of times the effect's flow was called (for all of its flows at once) */
+  sox_uint64_t drains;          /**< Number of times the effect's drain was called (likewise) */
+  sox_uint64_t samples_in;      /**< Samples taken by flow */
+  sox_uint64_t samples_out;     /**< Samples given by flow and drain */
+  sox_uint64_t clips;           /**< Clips, as counted in sox_effect_t.clips, of all flows */
+  double       wall_time;       /**< Seconds spent in flow and drain */
+  double       cpu_time;        /**< CPU seconds used in flow and drain by the calling thread */
+  double       interleave_time; /**< Seconds spent rearranging the effect's buffers (interleaving, converting between integer and float, etc.) */
+  sox_uint64_t degradations;    /**< Number of times sox_globals.governor lowered the effect's quality, or bypassed it */
+} sox_effect_stats_t;
+
+/**
+Client API:
+Memory counters, kept by libSoX's allocator for the process as a whole (see
+sox_memory_stats) and for each effect and effects chain (see
+sox_effects_chain_memory).  Memory is charged to an effect whilst its
+handler's start, flow, drain, stop and kill run, and to a chain for the
+same and whilst it allocates its buffers; an effect's memory is deemed
+returned when it is deleted.  current and peak are kept only where the C
+library can give an allocation's size (malloc_usable_size).
+*/
+typedef struct sox_mem_stats_t {
+  sox_uint64_t allocations; /**< Number of blocks allocated */
+  sox_uint64_t allocated;   /**< Bytes allocated in all (including by growing blocks) */
+  sox_uint64_t current;     /**< Bytes now held */
+  sox_uint64_t peak;        /**< Most bytes held at once */
+} sox_mem_stats_t;
+
 /**
 Client API:
 Effect information.
@@ -1620,6 +1957,27 @@ struct sox_effect_t {
   size_t                   obeg;      /**< output buffer: start of valid data section */
   size_t                   oend;      /**< output buffer: one past valid data section (oend-obeg is length of current content) */
   size_t               imin;          /**< minimum input buffer content required for calling this effect's flow function; set via lsx_effect_set_imin() */
+  /* The following items were added in libsox.so.4. */
+  sox_effect_handler_flow_float flow_float;   /**< If set (by the handler's start function), may be called instead of flow, with float samples */
+  sox_effect_handler_drain_float drain_float; /**< Called instead of drain if flow_float is; may be NULL only if the handler has no drain */
+  sox_effect_handler_pack pack; /**< If set (by the handler's start function), the effect quantises to at most 16 bits, and may be moved to the output file to be applied as samples are packed (see sox_fuse_output) */
+  double               latency;       /**< Algorithmic delay in seconds, i.e. the most by which the effect's output can lag its input (set by the handler's start function); see sox_effects_chain_latency */
+  double               history;       /**< How far back, in seconds, input can still affect the effect's output: 0 if the handler has SOX_EFF_SEEK, else HUGE_VAL (unbounded or unknown) unless set by the handler's start function; see sox_effects_chain_history */
+  double               span_history;  /**< How much input, in seconds, the effect's analysis needs to see before its span, to be as if it had seen all of the audio before it (set by the start function of a handler with save) */
+  sox_effect_span_t    span;          /**< The part of the input that the effect's analysis covers (set by the client, in each flow, before the chain is flowed) */
+  unsigned             degrade_steps; /**< Steps by which the effect can lower its quality to take less time, e.g. by switching to a shorter filter (set by the handler's start function; 0: none) */
+  unsigned             degrade;       /**< Steps below its configured quality at which sox_globals.governor has the effect run, from its next flow: a SOX_EFF_OPTIONAL effect is bypassed at 1 or more; others take up to degrade_steps */
+  /* The following items are private to the libSoX effects chain functions. */
+  size_t               block;         /**< number of samples (per flow) that suits each call of this effect's flow function, e.g. a filter's block; set via lsx_effect_set_block() */
+  size_t               ibufsiz;       /**< size in samples of the input buffer (the previous effect's obuf); set by sox_flow_effects */
+  size_t               obufsiz;       /**< size in samples of obuf: sox_globals.bufsiz, or more to suit imin or block of this or the next effect; set by sox_flow_effects */
+  sox_bool             planar;        /**< set by sox_flow_effects for a SOX_EFF_PLANAR effect if its buffers are to be uninterleaved; channel c then starts c*(ibufsiz/channels) samples after channel 0 in the input, and c*(obufsiz/channels) in the output */
+  sox_bool             use_float;     /**< set by sox_flow_effects if flow_float and drain_float are to be used */
+  sox_effect_stats_t   stats;         /**< kept in the first flow only, whilst sox_globals.profile (or, in SOX_CHAIN_REALTIME mode, governor) is set; clips is not used */
+  sox_mem_stats_t      mem;           /**< memory held by the effect (all flows); kept in the first flow only */
+  sox_mem_stats_t      * chain_mem;   /**< memory counters of the chain to which the effect belongs */
+  struct lsx_arena_t   * arena;       /**< memory of the effect (of all flows), including priv; freed by sox_delete_effect */
+  sox_uint64_t         rt_allocations; /**< allocations (all flows) made by its flow and drain whilst the chain ran realtime-safe; kept in the first flow only */
 };
 
 /**
@@ -1635,6 +1993,11 @@ typedef struct sox_effects_chain_t {
   /* The following items are private to the libSoX effects chain functions. */
   size_t table_size;                       /**< Size of effects table (including unused entries) */
   sox_sample_t *il_buf;                    /**< Channel interleave buffer */
+  sox_bool pulling;                        /**< Is being run by sox_effects_chain_pull */
+  size_t pull_effect;                      /**< Effect being drained by sox_effects_chain_pull */
+  sox_bool pull_draining;                  /**< Has pull_effect more to drain? */
+  sox_mem_stats_t mem;                     /**< Memory held by the chain, including by its effects */
+  sox_bool input_lent;                     /**< effects[0]'s output buffer is lent by its caller, so may not be given to effects[1] */
 } sox_effects_chain_t;
 
 /*****************************************************************************
@@ -1678,6 +2041,31 @@ as an lvalue.
 */
 #define sox_globals (*sox_get_globals())
 
+/**
+Client API:
+Creates a context, with a copy of the current global settings, for files
+and effects chains whose settings are to be independent of those of
+others (e.g. chains with different buffer sizes running concurrently).
+Messages, and the use of stdin and stdout, remain global.  Returned
+context must be deleted with sox_delete_context(), after the files and
+chains that use it have been closed.
+@returns The new context.
+*/
+LSX_RETURN_VALID
+sox_context_t *
+LSX_API
+sox_create_context(void);
+
+/**
+Client API:
+Deletes a context created by sox_create_context().
+*/
+void
+LSX_API
+sox_delete_context(
+    LSX_PARAM_INOUT sox_context_t * context /**< Context to be deleted. */
+    );
+
 /**
 Client API:
 Returns a pointer to the list of available encodings.
@@ -1809,6 +2197,20 @@ void
 LSX_API
 sox_format_quit(void);
 
+/**
+Client API:
+Writes a manifest of the format handler plugins in a directory to a file
+named formats.manifest there: a line for each plugin, giving its file name
+(less extension) and then the names of the formats that it handles.  This
+lets sox_find_format() load just the plugin that it needs.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_write_format_manifest(
+    LSX_PARAM_IN_OPT_Z char const * dir /**< Plugin directory, or NULL for the default */
+    );
+
 /**
 Client API:
 Initialize effects library.
@@ -1827,6 +2229,22 @@ int
 LSX_API
 sox_quit(void);
 
+/**
+Client API:
+Readies the effects library's caches ahead of work, e.g. in a server that
+forks a process per job, so that the jobs find them ready: makes the DFT
+tables for each power-of-2 length up to max_dft_len, and loads into memory
+those filter designs kept in sox_globals.design_cache_path that it doesn't
+already hold (whilst memory allows).  May be called again, e.g. to pick up
+designs that jobs have made since.
+@returns the number of designs loaded.
+*/
+size_t
+LSX_API
+sox_warm_caches(
+    size_t max_dft_len /**< Greatest DFT length to ready tables for, or 0 for none */
+    );
+
 /**
 Client API:
 Returns the table of format handler names and functions.
@@ -1858,9 +2276,27 @@ sox_open_read(
     LSX_PARAM_IN_OPT_Z char             const * filetype   /**< Previously-determined file type, or NULL to auto-detect. */
     );
 
+/**
+Client API:
+As sox_open_read, but the file is decoded under the settings of the given
+context, rather than the global ones.
+@returns The handle for the new session, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_context_read(
+    LSX_PARAM_IN     sox_context_t            * context,   /**< Context whose settings are to be used (required). */
+    LSX_PARAM_IN_Z   char               const * path,      /**< Path to file to be opened (required). */
+    LSX_PARAM_IN_OPT sox_signalinfo_t   const * signal,    /**< Information already known about audio stream, or NULL if none. */
+    LSX_PARAM_IN_OPT sox_encodinginfo_t const * encoding,  /**< Information already known about sample encoding, or NULL if none. */
+    LSX_PARAM_IN_OPT_Z char             const * filetype   /**< Previously-determined file type, or NULL to auto-detect. */
+    );
+
 /**
 Client API:
 Opens a decoding session for a memory buffer. Returned handle must be closed with sox_close().
+The buffer is read in place (raw PCM without even a copy), so must be left unchanged until then.
 @returns The handle for the new session, or null on failure.
 */
 LSX_RETURN_OPT
@@ -1874,6 +2310,70 @@ sox_open_mem_read(
     LSX_PARAM_IN_OPT_Z char             const * filetype    /**< Previously-determined file type, or NULL to auto-detect. */
     );
 
+/**
+Client API:
+Opens a file just to learn its format, length and comments, from its header:
+the file is not scanned or decoded to find what the header doesn't give, so
+the length may be an estimate (see sox_format_t.length_estimated) or
+unknown.  The handle should not be read from; it must be closed with
+sox_close().
+@returns The handle for the file, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_probe(
+    LSX_PARAM_IN_Z   char               const * path,      /**< Path to file to be opened (required). */
+    LSX_PARAM_IN_OPT_Z char             const * filetype   /**< Previously-determined file type, or NULL to auto-detect. */
+    );
+
+/**
+Client API:
+Opens another reader of an input file from one already open, without opening
+the file again or parsing its header: the clone shares the original's
+memory-map of the file or, if it has none, a descriptor of it, which it reads
+with pread(), so each reader keeps its own position and the two may be read
+concurrently (from different threads) and closed in either order.  The clone
+starts at the beginning of the audio, wherever the original is.  Only
+seekable inputs of handlers with SOX_FILE_CLONE in sox_format_t.handler.flags
+can be cloned.  The clone must be closed with sox_close().
+@returns The handle for the clone, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_read_clone(
+    LSX_PARAM_INOUT sox_format_t * ft /**< Format pointer of an open reader (e.g. from sox_open_read). */
+    );
+
+/**
+Client API:
+Reads into ft->oob.comments any comments of an input file that its format
+handler left unread when it was opened (see sox_globals_t.defer_comments);
+the file is left where it was.  Call before sox_set_decode_ahead.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_read_comments(
+    LSX_PARAM_INOUT sox_format_t * ft /**< Format pointer (e.g. just opened with sox_open_read). */
+    );
+
+/**
+Client API:
+Replaces the comments of an existing file, rewriting only its header or tag
+region (into padding or space freed, where possible) rather than decoding
+and re-encoding its audio; see sox_format_handler_t.rewrite_comments.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_rewrite_comments(
+    LSX_PARAM_IN_Z   char const * path,     /**< Path to file to be rewritten (required). */
+    LSX_PARAM_IN_OPT_Z char const * filetype, /**< Previously-determined file type, or NULL to auto-detect. */
+    LSX_PARAM_IN_OPT sox_comments_t comments /**< The new comments (all of them), or NULL for none. */
+    );
+
 /**
 Client API:
 Returns true if the format handler for the specified file type supports the specified encoding.
@@ -1918,6 +2418,50 @@ sox_open_write(
     LSX_PARAM_IN_OPT   sox_bool           (LSX_API * overwrite_permitted)(LSX_PARAM_IN_Z char const * filename) /**< Called if file exists to determine whether overwrite is ok. */
     );
 
+/**
+Client API:
+Opens an output file that was being written (with sox_open_write, and the
+same arguments) when its writing stopped, to carry on writing it from a point
+that had been reached: its header is written again, and the file cut off at
+offset and written on from there, as if olength samples had been written;
+sox_close then updates the header for the length written in all.  Only
+seekable files of handlers with SOX_FILE_RAWPCM, in plain PCM (or u-law,
+A-law or floating-point) encodings, can be resumed, and only if the header
+comes out the same size as before.
+@returns The new session handle, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_write_resume(
+    LSX_PARAM_IN_Z     char               const * path,     /**< Path to file to be written (required). */
+    LSX_PARAM_IN       sox_signalinfo_t   const * signal,   /**< Information about desired audio stream (required). */
+    LSX_PARAM_IN_OPT   sox_encodinginfo_t const * encoding, /**< Information about desired sample encoding, or NULL to use defaults. */
+    LSX_PARAM_IN_OPT_Z char               const * filetype, /**< Previously-determined file type, or NULL to auto-detect. */
+    LSX_PARAM_IN_OPT   sox_oob_t          const * oob,      /**< Out-of-band data to add to file, or NULL if none. */
+    sox_uint64_t                                  olength,  /**< Samples (* channels) in the file up to offset. */
+    sox_uint64_t                                  offset    /**< Byte offset in the file from which to write. */
+    );
+
+/**
+Client API:
+As sox_open_write, but the file is encoded under the settings of the given
+context, rather than the global ones.
+@returns The new session handle, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_format_t *
+LSX_API
+sox_open_context_write(
+    LSX_PARAM_IN       sox_context_t            * context,  /**< Context whose settings are to be used (required). */
+    LSX_PARAM_IN_Z     char               const * path,     /**< Path to file to be written (required). */
+    LSX_PARAM_IN       sox_signalinfo_t   const * signal,   /**< Information about desired audio stream (required). */
+    LSX_PARAM_IN_OPT   sox_encodinginfo_t const * encoding, /**< Information about desired sample encoding, or NULL to use defaults. */
+    LSX_PARAM_IN_OPT_Z char               const * filetype, /**< Previously-determined file type, or NULL to auto-detect. */
+    LSX_PARAM_IN_OPT   sox_oob_t          const * oob,      /**< Out-of-band data to add to file, or NULL if none. */
+    LSX_PARAM_IN_OPT   sox_bool           (LSX_API * overwrite_permitted)(LSX_PARAM_IN_Z char const * filename) /**< Called if file exists to determine whether overwrite is ok. */
+    );
+
 /**
 Client API:
 Opens an encoding session for a memory buffer. Returned handle must be closed with sox_close().
@@ -1978,6 +2522,35 @@ sox_write(
     size_t len /**< Number of samples available in buf. */
     );
 
+/**
+Client API:
+Reads samples from a decoding session into a buffer per channel: straight
+from the decoder if its handler has read_planar (and the file is not being
+decoded ahead or from the decode cache), else by way of sox_read.
+@returns Number of samples decoded into each buffer, or 0 for EOF.
+*/
+size_t
+LSX_API
+sox_read_planar(
+    LSX_PARAM_INOUT sox_format_t * ft, /**< Format pointer. */
+    LSX_PARAM_IN sox_sample_t * const * bufs, /**< Buffers (ft->signal.channels of them) to which samples are read. */
+    size_t len /**< Number of samples available in each buffer. */
+    );
+
+/**
+Client API:
+Writes samples to an encoding session from a buffer per channel: straight
+to the encoder if its handler has write_planar, else by way of sox_write.
+@returns Number of samples encoded from each buffer.
+*/
+size_t
+LSX_API
+sox_write_planar(
+    LSX_PARAM_INOUT sox_format_t * ft, /**< Format pointer. */
+    LSX_PARAM_IN sox_sample_t const * const * bufs, /**< Buffers (ft->signal.channels of them) from which samples are written. */
+    size_t len /**< Number of samples in each buffer. */
+    );
+
 /**
 Client API:
 Closes an encoding or decoding session.
@@ -2002,6 +2575,38 @@ sox_seek(
     int whence /**< Set to SOX_SEEK_SET. */
     );
 
+/**
+Client API:
+Has the file's data read ahead, or written behind, by a thread of its own
+whilst sox_flow_effects runs, so that slow storage need not hold up the
+effects; has no effect for a device, a memory-mapped input, or a build of
+SoX without thread support.  With the file's context's io_uring set, a
+regular file is read or written through an io_uring where available.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_set_io_async(
+    LSX_PARAM_INOUT sox_format_t * ft, /**< Format pointer (e.g. just opened with sox_open_read or sox_open_write). */
+    unsigned buffers /**< Number of I/O buffers (2 or more) in flight, e.g. 2 for double buffering. */
+    );
+
+/**
+Client API:
+Has the input file decoded ahead by a thread of its own whilst
+sox_flow_effects runs, so that several inputs (e.g. files being mixed) are
+decoded at once, and alongside the effects; at other times, sox_read decodes
+directly.  Call before sox_flow_effects; has no effect for a device or a
+build of SoX without thread support.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_set_decode_ahead(
+    LSX_PARAM_INOUT sox_format_t * ft, /**< Format pointer (e.g. just opened with sox_open_read). */
+    unsigned buffers /**< Number of buffers (1 or more) of samples to decode ahead. */
+    );
+
 /**
 Client API:
 Finds a format handler by name.
@@ -2068,6 +2673,20 @@ sox_effect_options(
     LSX_PARAM_IN_COUNT(argc) char * const argv[] /**< Array of command-line options. */
     );
 
+/**
+Client API:
+Has a features effect (after sox_effect_options, before sox_add_effect) give
+its frames to callback, rather than write them to a file.
+@returns SOX_SUCCESS if successful, or SOX_EOF if effp is not a features effect.
+*/
+int
+LSX_API
+sox_set_features_callback(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< A features effect. */
+    LSX_PARAM_IN sox_features_callback_t callback, /**< Callback for each frame. */
+    LSX_PARAM_IN_OPT void * client_data /**< Passed on to callback. */
+    );
+
 /**
 Client API:
 Returns an array containing the known effect handlers.
@@ -2097,6 +2716,21 @@ sox_create_effects_chain(
     LSX_PARAM_IN sox_encodinginfo_t const * out_enc /**< Output encoding. */
     );
 
+/**
+Client API:
+As sox_create_effects_chain, but the chain (and the effects added to it) is
+run under the settings of the given context, rather than the global ones.
+@returns Handle, or null on failure.
+*/
+LSX_RETURN_OPT
+sox_effects_chain_t *
+LSX_API
+sox_create_context_effects_chain(
+    LSX_PARAM_IN sox_context_t * context,           /**< Context whose settings are to be used (required). */
+    LSX_PARAM_IN sox_encodinginfo_t const * in_enc, /**< Input encoding. */
+    LSX_PARAM_IN sox_encodinginfo_t const * out_enc /**< Output encoding. */
+    );
+
 /**
 Client API:
 Closes an effects chain.
@@ -2134,6 +2768,118 @@ sox_flow_effects(
     LSX_PARAM_IN_OPT void * client_data /**< Data to pass into callback. */
     );
 
+/**
+Client API:
+Runs the effects chain, on the calling thread, only as far as is needed to
+give len samples from its last effect, which (unlike with sox_flow_effects)
+is not an output effect: the chain's output is returned to the caller
+instead.  Samples made beyond len are kept for the next call, so a chain can
+be driven a block at a time, e.g. from an event loop.  The chain's
+chain_mode is ignored.  Once the end has been reached (or an effect has
+failed), the chain is left as sox_flow_effects leaves it.
+@returns The number of samples written to buf: len unless the end has been
+reached.
+*/
+size_t
+LSX_API
+sox_effects_chain_pull(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain to run. */
+    LSX_PARAM_OUT_CAP_POST_COUNT(len,return) sox_sample_t * buf, /**< Buffer to which to write the chain's output. */
+    size_t len /**< Number of samples wanted. */
+    );
+
+/**
+Client API:
+Returns the effects in a chain that has been run to the state they were in
+just after being added, without redesigning filters or freeing buffers, so
+that the chain may be run again, e.g. for the next of several files.  If in
+(or out) is given, the chain's input (or output) effect is pointed to that
+file instead; its rate and channels must be those the chain was built for.
+@returns SOX_SUCCESS if successful, or SOX_EOF if the chain cannot be reset
+(it is then unchanged, and must be rebuilt instead).
+*/
+int
+LSX_API
+sox_effects_chain_reset(
+    LSX_PARAM_INOUT  sox_effects_chain_t * chain, /**< Effects chain to reset. */
+    LSX_PARAM_IN_OPT sox_format_t * in, /**< New input file for an input effect, or NULL. */
+    LSX_PARAM_IN_OPT sox_format_t * out /**< New output file for an output effect, or NULL. */
+    );
+
+/**
+Client API:
+Seeks the input of an effects chain that has been started (its effects added,
+or the chain reset) but not yet run, so that the audio that the chain's first
+trim effect would discard need not be decoded: where the effects before the
+trim alter neither rate nor length, and have bounded history (see
+sox_effects_chain_history), the file is sought to the trim's start less that
+history; that pre-roll primes the effects and is then discarded by the trim.
+ft is the file from which the chain's first effect reads, from its start, one
+wide sample for each of its own; if NULL, the file of the chain's input
+effect.  To start at a time T, a client adds "trim T" after the input.
+@returns SOX_SUCCESS if the file was sought, with *position set to the wide
+sample sought to; else SOX_EOF, with the file and chain unchanged.
+*/
+int
+LSX_API
+sox_effects_chain_seek(
+    LSX_PARAM_INOUT  sox_effects_chain_t * chain, /**< Effects chain to seek. */
+    LSX_PARAM_IN_OPT sox_format_t * ft, /**< File from which the chain's first effect reads, or NULL. */
+    LSX_PARAM_OUT sox_uint64_t * position /**< Receives the wide sample of ft sought to. */
+    );
+
+/**
+Client API:
+Starts a branch (fan-out) at the end of the chain as built so far: the audio
+leaving the chain's last effect is also flowed, without copying where possible,
+through the returned chain, whose first effect holds it.  Effects, and then an
+output (or see sox_add_merge), are added to the branch as to any chain, starting
+with the signal branch->effects[0]->out_signal.  The chain itself must go on to
+an output of its own; its branches are flowed by sox_flow_effects (getting the
+audio up to where the chain stops taking input), and deleted with it.
+@returns The new branch, or null if the chain is empty.
+*/
+LSX_RETURN_OPT
+sox_effects_chain_t *
+LSX_API
+sox_add_branch(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain to branch from. */
+    LSX_PARAM_IN_OPT sox_encodinginfo_t const * out_enc /**< Output encoding for the branch. */
+    );
+
+/**
+Client API:
+Has the branch run on a thread of its own while sox_flow_effects runs the chain,
+so that e.g. a slow encoder at its end holds up neither the chain nor its other
+branches; the chain waits for it only once bufs buffers' worth (of
+sox_globals.bufsiz samples) are queued for it.  Has no effect on a branch that
+is merged, or where threads are not available.
+@returns SOX_SUCCESS if successful, or SOX_EOF if branch is not a branch of chain.
+*/
+int
+LSX_API
+sox_set_branch_async(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain the branch is from. */
+    LSX_PARAM_INOUT sox_effects_chain_t * branch, /**< Branch returned by sox_add_branch. */
+    size_t bufs /**< Size of its queue, in buffers; 0 to run it synchronously. */
+    );
+
+/**
+Client API:
+Ends a branch of the chain (fan-in): adds to the chain an effect that mixes the
+output of the branch (which is to have no output of its own) into the chain's
+audio.  Both must have the same rate and channels; the shorter is padded with
+silence.
+@returns SOX_SUCCESS if successful.
+*/
+int
+LSX_API
+sox_add_merge(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain to merge into. */
+    LSX_PARAM_INOUT sox_effects_chain_t * branch, /**< A branch from chain, returned by sox_add_branch. */
+    LSX_PARAM_INOUT sox_signalinfo_t * in /**< Input signal for the merge effect; updated as by sox_add_effect. */
+    );
+
 /**
 Client API:
 Gets the number of clips that occurred while running an effects chain.
@@ -2145,6 +2891,111 @@ sox_effects_clips(
     LSX_PARAM_IN sox_effects_chain_t * chain /**< Effects chain from which to read clip information. */
     );
 
+/**
+Client API:
+Gets the latency of an effects chain: the sum of its effects' algorithmic
+delays (sox_effect_t.latency) plus, in SOX_CHAIN_REALTIME mode, the duration
+of a block.
+@returns the chain's latency in seconds.
+*/
+double
+LSX_API
+sox_effects_chain_latency(
+    LSX_PARAM_IN sox_effects_chain_t const * chain /**< Effects chain whose latency is wanted. */
+    );
+
+/**
+Client API:
+Gets the history of an effects chain: the sum of its effects' histories
+(sox_effect_t.history), i.e. how much input must precede a point in the
+audio for the chain's output thereafter to be as if it had been given all
+the audio from the start; a client may so process segments of the audio
+separately, e.g. concurrently.
+@returns the chain's history in seconds, or HUGE_VAL if unbounded or unknown.
+*/
+double
+LSX_API
+sox_effects_chain_history(
+    LSX_PARAM_IN sox_effects_chain_t const * chain /**< Effects chain whose history is wanted. */
+    );
+
+/**
+Client API:
+Gets the counters kept, whilst sox_globals.profile was set, for effect n of
+an effects chain (0 being the input and chain->length - 1 the output).
+@returns SOX_SUCCESS if successful, or SOX_EOF if there is no effect n.
+*/
+int
+LSX_API
+sox_effects_chain_stats(
+    LSX_PARAM_IN  sox_effects_chain_t const * chain, /**< Effects chain from which to read the counters. */
+    size_t n, /**< Index of the effect in the chain. */
+    LSX_PARAM_OUT sox_effect_stats_t * stats /**< Receives the effect's counters. */
+    );
+
+/**
+Client API:
+Sets the ratio of effect n of an effects chain, a rate effect given the -V
+option, whilst it runs: from now on it takes ratio times as much input for
+each sample of output as it would at its nominal rates (limited to the range
+given to -V).  To be called between calls of the chain's effects, e.g. from
+sox_flow_effects' callback.
+@returns SOX_SUCCESS if successful, SOX_EOF if n is out of range, or
+SOX_EINVAL if effect n is not such a rate effect.
+*/
+int
+LSX_API
+sox_effects_chain_adjust_rate(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain holding the rate effect. */
+    size_t n, /**< Index of the rate effect in the chain. */
+    double ratio /**< Multiplier of the nominal ratio of input to output samples, e.g. 1.0001. */
+    );
+
+/**
+Client API:
+Sets the ratio of effect n of an effects chain, a rate effect given the -V
+option, by feedback: excess is how far (in seconds of audio) a buffer that
+the rate effect fills or drains (e.g. one between the chain and a device or
+network stream with a clock of its own) is above its target fill level, or
+below it, if negative.  Called, like sox_effects_chain_adjust_rate, as often
+as the level is measured, this settles the ratio to that which holds the
+level at its target, with the time constant given by the rate effect's -T
+option; the ratio changes smoothly, so the stream need not be restarted.
+@returns SOX_SUCCESS if successful, SOX_EOF if n is out of range, or
+SOX_EINVAL if effect n is not such a rate effect.
+*/
+int
+LSX_API
+sox_effects_chain_rate_feedback(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain holding the rate effect. */
+    size_t n, /**< Index of the rate effect in the chain. */
+    double excess /**< Seconds by which the buffer's fill exceeds its target. */
+    );
+
+/**
+Client API:
+Gets the memory counters of effect n of an effects chain, or, if n is
+chain->length, of the chain as a whole (its buffers and all of its effects).
+@returns SOX_SUCCESS if successful, or SOX_EOF if n is out of range.
+*/
+int
+LSX_API
+sox_effects_chain_memory(
+    LSX_PARAM_IN  sox_effects_chain_t const * chain, /**< Effects chain from which to read the counters. */
+    size_t n, /**< Index of the effect in the chain, or chain->length. */
+    LSX_PARAM_OUT sox_mem_stats_t * stats /**< Receives the counters. */
+    );
+
+/**
+Client API:
+Gets the memory counters of all that libSoX has allocated in this process.
+*/
+void
+LSX_API
+sox_memory_stats(
+    LSX_PARAM_OUT sox_mem_stats_t * stats /**< Receives the counters. */
+    );
+
 /**
 Client API:
 Shuts down an effect (calls stop on each of its flows).
@@ -2179,6 +3030,81 @@ sox_pop_effect_last(
     LSX_PARAM_INOUT sox_effects_chain_t *chain /**< Effects chain from which to remove an effect. */
     );
 
+/**
+Client API:
+If the last effect of the chain (e.g. dither) can quantise as samples are
+packed (sox_effect_t.pack), and ft writes signed 16-bit PCM through libSoX's
+raw writer (SOX_FILE_RAWPCM), moves the effect from the chain to ft, to be
+applied by sox_write in the same pass as the packing; the effect's input is
+then to be written to ft, as whole wide samples.  Any effect that ft held
+from a previous chain is deleted.
+@returns true if the effect was moved.
+*/
+sox_bool
+LSX_API
+sox_fuse_output(
+    LSX_PARAM_INOUT sox_effects_chain_t * chain, /**< Effects chain whose last effect is to be moved. */
+    LSX_PARAM_INOUT sox_format_t * ft /**< Output file, opened for writing. */
+    );
+
+/**
+Client API:
+Gives what an analysis effect (e.g. stats) has gathered over its span (see
+sox_effect_t.span), once it has been flowed and drained, as a partial
+result: a block of bytes that may be kept or passed to another process or
+machine, and merged, by sox_effect_merge, into the same effect (with the
+same options) having analysed the audio before it.  Merging the partial
+results of consecutive spans in turn gives the effect the same state (but
+for floating-point rounding) as if it had analysed all of them, so that its
+stop function then reports on the whole.
+@returns the partial result, to be freed with free(), or NULL if the effect,
+as configured, can't give one.
+*/
+LSX_RETURN_OPT
+void *
+LSX_API
+sox_effect_save(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect (its first flow). */
+    LSX_PARAM_OUT size_t * len /**< Receives the size of the partial result in bytes. */
+    );
+
+/**
+Client API:
+Merges a partial result from sox_effect_save into an effect that has been
+flowed and drained over the audio just before that of the partial result.
+@returns SOX_SUCCESS if successful, or SOX_EOF if the partial result is not
+of this effect, or is corrupt.
+*/
+int
+LSX_API
+sox_effect_merge(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect (its first flow). */
+    LSX_PARAM_IN_BYTECOUNT(len) void const * partial, /**< The partial result. */
+    size_t len /**< Its size in bytes. */
+    );
+
+/**
+Client API:
+Changes the options of an effect (e.g. vol, equalizer or compand) in a
+chain while it runs, without restarting it or the chain.  The options are
+as for sox_effect_options; a change of gain or of a filter's response is
+ramped in over 20ms, so as not to click.  Call it between calls to the
+effects' flow functions, e.g. from the sox_flow_effects callback (so not
+with SOX_CHAIN_PIPELINED), on the chain's copy of the effect; for the effect
+to be there to change, have sox_globals.updatable set as the chain is
+built.
+@returns SOX_SUCCESS if successful, or SOX_EOF if the options are invalid,
+or the effect can't change them in place (e.g. because it would have to
+redesign a filter, or change the signal's rate or channels).
+*/
+int
+LSX_API
+sox_effect_update(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Effect (its first flow) in a running chain. */
+    int argc, /**< Number of arguments in argv. */
+    LSX_PARAM_IN_COUNT(argc) char * const argv[] /**< Array of command-line options. */
+    );
+
 /**
 Client API:
 Shut down and delete an effect.
@@ -2232,6 +3158,54 @@ sox_trim_clear_start(
     LSX_PARAM_INOUT sox_effect_t * effp /**< Trim effect. */
     );
 
+/**
+Client API:
+If the gain (or norm) effect is to scan the audio before applying gain (e.g.
+gain -n), and is fed directly, and unmodified, from the given seekable file,
+reads the file through and seeks it back to the start, so that the effect need
+not spool the audio to a temporary file.  The result is kept in the design
+cache (see sox_globals_t.design_cache_path), keyed by the file's identity.
+@returns SOX_SUCCESS if done, SOX_EOF if not attempted (nothing has been read),
+or another error code if the file could not be rewound.
+*/
+int
+LSX_API
+sox_gain_scan(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Gain effect (flow 0). */
+    LSX_PARAM_INOUT sox_format_t * ft    /**< File feeding the effect. */
+    );
+
+/**
+Client API:
+If the reverse effect is fed directly, and unmodified, from the given file, and
+the file is seekable and of an encoding in which seeking is exact, has the
+effect read the file backwards itself, rather than store the audio; the file is
+left positioned at its end, so that reading it forwards yields nothing more.
+@returns SOX_SUCCESS if done, SOX_EOF if not attempted, or another error code if
+the file could not be rewound after a failed attempt.
+*/
+int
+LSX_API
+sox_reverse_from_file(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Reverse effect. */
+    LSX_PARAM_INOUT sox_format_t * ft    /**< File feeding the effect. */
+    );
+
+/**
+Client API:
+If the repeat effect is fed directly, and unmodified, from the start of the
+given file, and the file is seekable and of an encoding in which seeking is
+exact, has the effect read the file again for each repeat, rather than store
+the audio.
+@returns SOX_SUCCESS if done, or SOX_EOF if not attempted.
+*/
+int
+LSX_API
+sox_repeat_from_file(
+    LSX_PARAM_INOUT sox_effect_t * effp, /**< Repeat effect. */
+    LSX_PARAM_INOUT sox_format_t * ft    /**< File feeding the effect. */
+    );
+
 /**
 Client API:
 Returns true if the specified file is a known playlist file type.
@@ -2291,6 +3265,17 @@ exist in the public header because sox (the application) currently uses them.
 These may be changed or removed in future versions of libSoX.
 *****************************************************************************/
 
+/**
+Plugins API:
+Sets the name (e.g. of the source file) that the messages reported next by
+the calling thread are attributed to; each thread has its own.
+*/
+void
+LSX_API
+lsx_set_subsystem(
+    LSX_PARAM_IN_Z char const * name /**< Name to pass to the output_message_handler. */
+    );
+
 /**
 Plugins API:
 Print a fatal error in libSoX.
@@ -2339,25 +3324,25 @@ lsx_debug_impl(
 Plugins API:
 Report a fatal error in libSoX; printf-style arguments must follow.
 */
-#define lsx_fail       sox_get_globals()->subsystem=__FILE__,lsx_fail_impl
+#define lsx_fail       lsx_set_subsystem(__FILE__),lsx_fail_impl
 
 /**
 Plugins API:
 Report a warning in libSoX; printf-style arguments must follow.
 */
-#define lsx_warn       sox_get_globals()->subsystem=__FILE__,lsx_warn_impl
+#define lsx_warn       lsx_set_subsystem(__FILE__),lsx_warn_impl
 
 /**
 Plugins API:
 Report an informational message in libSoX; printf-style arguments must follow.
 */
-#define lsx_report     sox_get_globals()->subsystem=__FILE__,lsx_report_impl
+#define lsx_report     lsx_set_subsystem(__FILE__),lsx_report_impl
 
 /**
 Plugins API:
 Report a debug message in libSoX; printf-style arguments must follow.
 */
-#define lsx_debug      sox_get_globals()->subsystem=__FILE__,lsx_debug_impl
+#define lsx_debug      lsx_set_subsystem(__FILE__),lsx_debug_impl
 
 /**
 Plugins API:
@@ -2619,6 +3604,22 @@ lsx_filelength(
     LSX_PARAM_IN sox_format_t * ft
     );
 
+/**
+Plugins API:
+Parses a time or sample count (e.g. "1:30.5", "4410s"), as given to trim;
+def ('t' or 's') says which a bare number is.
+@returns A pointer to the character after the parsed text, or null if it
+could not be parsed.
+*/
+char const *
+LSX_API
+lsx_parsesamples(
+    sox_rate_t rate, /**< Sample rate for converting times. */
+    LSX_PARAM_IN_Z char const * str, /**< Text to parse. */
+    LSX_PARAM_OUT sox_uint64_t * samples, /**< Receives the number of samples. */
+    int def /**< 't' or 's': the unit of a bare number. */
+    );
+
 /* WARNING END */
 
 #if defined(__cplusplus)
@@ -0,0 +1,720 @@
+/* libSoX benchmarks
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/* Times each effect, each effects chain of a few common ones, and each
+ * built-in codec, on a signal synthesised in memory (so that neither the
+ * disc nor the system's state is measured), and writes the results as JSON,
+ * one benchmark to a line, for test/benchcmp.pl to compare between builds.
+ *
+ * Usage: sox_bench [-j] [-d seconds] [-n repeats] [-o file] [-v] [name ...]
+ *
+ * The input lasts the given seconds (default 10) at 44.1 kHz, stereo; each
+ * benchmark is run the given number of times (default 3), and the fastest
+ * run is reported.  For an effect or chain, the time is that spent in its
+ * effects (as counted by sox_effects_chain_stats), excluding the reading
+ * and writing of the signal; for a codec, it is that spent encoding it to,
+ * or decoding it from, memory.  With names, only the benchmarks whose names
+ * contain one of them are run.
+ *
+ * With -j, end-to-end jobs are run instead, as a production chain would be:
+ * each reads a file (synthesised beforehand by the synth effect, in the
+ * current directory), runs its effects, and writes a file; for each, the
+ * wall and CPU time of the whole job, the peak memory of its chain (as
+ * counted by libSoX), and the bytes read and written are reported.  A job
+ * whose formats or effects are not in this build is skipped. */
+
+#include "sox.h"
+#include "util.h"
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+  #include <sys/time.h>
+#endif
+
+/* Options for the effects that need some; others are given none */
+static char const * const effect_args[][2] = {
+  {"allpass"   , "1000 0.707q"},
+  {"band"      , "1000 200"},
+  {"bandpass"  , "1000 200"},
+  {"bandreject", "1000 200"},
+  {"bass"      , "+3"},
+  {"bend"      , "0.5,100,1"},
+  {"biquad"    , "0.5 0.2 0.1 1 -0.3 0.1"},
+  {"chorus"    , "0.7 0.9 55 0.4 0.25 2 -t"},
+  {"channels"  , "1"},
+  {"compand"   , "0.3,1 6:-70,-60,-20 -5 -90 0.2"},
+  {"dcshift"   , "0.1"},
+  {"delay"     , "0.5 1"},
+  {"downsample", "2"},
+  {"echo"      , "0.8 0.88 60 0.4"},
+  {"echos"     , "0.8 0.7 700 0.25 700 0.3"},
+  {"equalizer" , "1000 1q 3"},
+  {"fade"      , "q 0.5"},
+  {"fir"       , "0.25 0.5 0.25"},
+  {"gain"      , "-3"},
+  {"highpass"  , "100"},
+  {"lowpass"   , "3000"},
+  {"mcompand"  , "\"0.005,0.1 -47,-40,-34,-34,-17,-33\" 100 \"0.003,0.05 -47,-40,-34,-34,-17,-33\""},
+  {"pad"       , "0 1"},
+  {"phaser"    , "0.8 0.74 3 0.4 0.5 -t"},
+  {"pitch"     , "200"},
+  {"rate"      , "48k"},
+  {"remix"     , "2 1"},
+  {"repeat"    , "1"},
+  {"silence"   , "1 0.1 1%"},
+  {"sinc"      , "100-8k"},
+  {"speed"     , "1.1"},
+  {"splice"    , "1"},
+  {"stretch"   , "1.1"},
+  {"synth"     , "sine mix 440"},
+  {"tempo"     , "1.1"},
+  {"treble"    , "+3"},
+  {"tremolo"   , "6"},
+  {"trim"      , "1"},
+  {"upsample"  , "2"},
+  {"vol"       , "0.5"},
+};
+
+/* Effects that need files (e.g. a noise profile), or write them */
+static char const * const effects_skipped[] = {
+  "firfit", "noiseprof", "noisered", "spectrogram",
+};
+
+/* Common chains */
+static char const * const chains[] = {
+  "rate 48k",
+  "rate -v 96k",
+  "gain -3 rate 22050 dither -s",
+  "highpass 80 lowpass 12k compand 0.01,0.2 -60,-40,-10 -5",
+  "sinc 100-8k rate 16k",
+  "reverb 50 remix -",
+  "tempo 1.25 rate 48k",
+  "remix - highpass 300 lowpass 3400 rate 8k",
+};
+
+/* End-to-end jobs (-j) */
+#define NOISE_PROFILE "sox_bench-noise.prof"
+static struct {
+  char const * name;
+  char const * in_type;      /* Input is synthesised as this */
+  unsigned     channels;
+  double       rate;
+  char const * synth;        /* Arguments of synth, after its length */
+  char const * effects;
+  char const * out_type;
+  unsigned     out_channels, out_bits;
+  double       out_rate;
+} const jobs[] = {
+  {"mp3-flac", "mp3", 2, 44100, "sine 50-12000 pinknoise",
+    "rate 48k norm -1", "flac", 2, 24, 48000},
+  {"wav-ogg", "wav", 1, 48000, "pinknoise sine mix 440",
+    "noisered " NOISE_PROFILE " 0.2 compand 0.01,0.2 -60,-40,-10 -5",
+    "ogg", 1, 0, 48000},
+  {"remix16-wav", "wav", 16, 48000, "sine 100-1000 sine 200-2000 pinknoise",
+    "remix 1-8 9-16 sinc 20-20k dither -s", "wav", 2, 16, 48000},
+  {"spectrogram", "wav", 2, 44100, "sine 50-12000 pinknoise",
+    "spectrogram -x 160 -y 64 -r -o sox_bench-thumb.png", "null", 2, 0, 44100},
+};
+
+static struct {
+  sox_bool     jobs;
+  double       seconds;
+  unsigned     repeats;
+  char       * * names;
+  int          num_names;
+  FILE       * json;
+  char       * buffer;         /* The input, in `sox' format */
+  size_t       buffer_size;
+  sox_signalinfo_t signal;
+  sox_sample_t * samples;      /* The input, for the codecs */
+  size_t       num_samples;
+} bench;
+
+static double now(void)
+{
+#if defined HAVE_CLOCK_GETTIME
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#elif defined HAVE_GETTIMEOFDAY
+  struct timeval t;
+
+  gettimeofday(&t, NULL);
+  return t.tv_sec + t.tv_usec * 1e-6;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static sox_bool wanted(char const * name)
+{
+  int i;
+
+  for (i = 0; i < bench.num_names; ++i)
+    if (strstr(name, bench.names[i]))
+      return sox_true;
+  return bench.num_names == 0;
+}
+
+static void json_string(char const * s)
+{
+  putc('"', bench.json);
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\')
+      putc('\\', bench.json);
+    putc(*s, bench.json);
+  }
+  putc('"', bench.json);
+}
+
+static sox_bool first_result = sox_true;
+
+/* Writes a result, with any extra (JSON members), and a line of the table
+ * on stderr */
+static void report(char const * kind, char const * name, char const * args,
+    sox_uint64_t samples, double seconds, char const * extra)
+{
+  double rate = seconds > 0? samples / seconds : 0;
+  double ns = samples? seconds * 1e9 / samples : 0;
+
+  fprintf(stderr, "%-7s %-12s %-40.40s %12.0f %9.2f\n",
+      kind, name, args, rate, ns);
+  fputs(first_result? "\n  " : ",\n  ", bench.json);
+  first_result = sox_false;
+  fputs("{\"kind\": ", bench.json);
+  json_string(kind);
+  fputs(", \"name\": ", bench.json);
+  json_string(name);
+  fputs(", \"args\": ", bench.json);
+  json_string(args);
+  fprintf(bench.json, ", \"samples\": %" PRIu64 ", \"seconds\": %.6f"
+      ", \"samples_per_second\": %.0f, \"ns_per_sample\": %.3f%s}",
+      samples, seconds, rate, ns, extra);
+}
+
+/* Synthesises the input: a chirp on each channel, a little apart, with a
+ * little noise; samples are kept for the codecs, and the whole is written
+ * in `sox' format for the effects to read with sox_open_mem_read */
+static int synthesise(void)
+{
+  size_t i, c, chans = 2, len;
+  double rate = 44100;
+  sox_uint32_t ran = 1;
+  sox_format_t * out;
+
+  bench.signal.rate = rate;
+  bench.signal.channels = (unsigned)chans;
+  bench.signal.precision = SOX_SAMPLE_PRECISION;
+  len = (size_t)(bench.seconds * rate + .5);
+  bench.num_samples = len * chans;
+  bench.samples = malloc(bench.num_samples * sizeof(*bench.samples));
+  for (i = 0; i < len; ++i) for (c = 0; c < chans; ++c) {
+    double t = (double)i / rate, f = 50 + 10000 * t / bench.seconds * (1 + c * .1);
+    ran = 1664525 * ran + 1013904223;
+    bench.samples[i * chans + c] = (sox_sample_t)(SOX_SAMPLE_MAX *
+        (.5 * sin(M_PI * f * t) + .01 * ((double)ran / 4294967296. - .5)));
+  }
+  out = sox_open_memstream_write(&bench.buffer, &bench.buffer_size,
+      &bench.signal, NULL, "sox", NULL);
+  if (!out)
+    return SOX_EOF;
+  if (sox_write(out, bench.samples, bench.num_samples) != bench.num_samples) {
+    sox_close(out);
+    return SOX_EOF;
+  }
+  return sox_close(out);
+}
+
+/* Adds the effects given in text (e.g. "rate -v 96k"); a word begins a new
+ * effect if it is the name of one.  Words may be quoted (e.g. for mcompand).
+ * Some effects (e.g. spectrogram's -o) keep pointers to their arguments, so
+ * the words are kept until the next call, by when the chain has gone */
+static int add_effects(sox_effects_chain_t * chain, char const * text,
+    sox_signalinfo_t * signal)
+{
+  static char copy[256];
+  char * argv[32], * word;
+  int argc = 0, i, n, result = SOX_SUCCESS;
+  sox_signalinfo_t target;
+
+  strncpy(copy, text, sizeof(copy) - 1);
+  copy[sizeof(copy) - 1] = '\0';
+  for (word = copy; *word && argc < (int)array_length(argv); ) {
+    char end = *word == '"'? '"' : ' ';
+
+    argv[argc++] = word += end == '"';
+    for (; *word && *word != end; ++word);
+    if (*word)
+      *word++ = '\0';
+    for (; *word == ' '; ++word);
+  }
+  for (i = 0; result == SOX_SUCCESS && i < argc; i += n) {
+    sox_effect_t * effp = sox_create_effect(sox_find_effect(argv[i]));
+
+    for (n = 1; i + n < argc && !sox_find_effect(argv[i + n]); ++n);
+    target = *signal;
+    target.precision = 16; /* e.g. for dither */
+    if (sox_effect_options(effp, n - 1, argv + i + 1) != SOX_SUCCESS ||
+        sox_add_effect(chain, effp, signal, &target) != SOX_SUCCESS)
+      result = SOX_EOF;
+    free(effp);
+  }
+  return result;
+}
+
+/* Adds the input or output effect for ft */
+static int add_file(sox_effects_chain_t * chain, char const * name,
+    sox_format_t * ft, sox_signalinfo_t * signal)
+{
+  sox_effect_t * effp = sox_create_effect(sox_find_effect(name));
+  char * args[1];
+  int result;
+
+  args[0] = (char *)ft;
+  result = sox_effect_options(effp, 1, args) == SOX_SUCCESS &&
+      sox_add_effect(chain, effp, signal, &ft->signal) == SOX_SUCCESS?
+      SOX_SUCCESS : SOX_EOF;
+  free(effp);
+  return result;
+}
+
+/* Makes a chain from in, through the effects given in text, to out */
+static sox_effects_chain_t * make_chain(sox_format_t * in,
+    sox_format_t * out, char const * text)
+{
+  sox_effects_chain_t * chain =
+      sox_create_effects_chain(&in->encoding, &out->encoding);
+  sox_signalinfo_t signal = in->signal;
+
+  if (add_file(chain, "input", in, &signal) != SOX_SUCCESS ||
+      add_effects(chain, text, &signal) != SOX_SUCCESS ||
+      add_file(chain, "output", out, &signal) != SOX_SUCCESS) {
+    sox_delete_effects_chain(chain);
+    return NULL;
+  }
+  return chain;
+}
+
+/* Runs the effects given in text; on success, gives the seconds spent in
+ * them, and the number of samples that they took */
+static int run_effects(char const * text, double * seconds,
+    sox_uint64_t * samples)
+{
+  sox_format_t * in, * out;
+  sox_effects_chain_t * chain;
+  sox_encodinginfo_t encoding = {SOX_ENCODING_SIGN2, 16, 0, sox_option_default,
+      sox_option_default, sox_option_default, sox_false}; /* e.g. for dither */
+  int result = SOX_EOF;
+  size_t e;
+
+  if (!(in = sox_open_mem_read(bench.buffer, bench.buffer_size, NULL, NULL, "sox")))
+    return SOX_EOF;
+  if (!(out = sox_open_write("", &in->signal, &encoding, "null", NULL, NULL))) {
+    sox_close(in);
+    return SOX_EOF;
+  }
+  if (!(chain = make_chain(in, out, text)))
+    goto error;
+  if (sox_flow_effects(chain, NULL, NULL) == SOX_SUCCESS) {
+    sox_effect_stats_t stats;
+
+    *seconds = 0;
+    for (e = 1; e + 1 < chain->length; ++e) {
+      sox_effects_chain_stats(chain, e, &stats);
+      *seconds += stats.wall_time;
+    }
+    sox_effects_chain_stats(chain, (size_t)0, &stats);
+    *samples = stats.samples_out;
+    result = SOX_SUCCESS;
+  }
+  sox_delete_effects_chain(chain);
+error:
+  sox_close(out);
+  sox_close(in);
+  return result;
+}
+
+static void bench_effects(char const * kind, char const * name,
+    char const * text)
+{
+  double seconds, best = HUGE_VAL;
+  sox_uint64_t samples = 0;
+  unsigned i;
+
+  if (!wanted(name))
+    return;
+  for (i = 0; i < bench.repeats; ++i) {
+    if (run_effects(text, &seconds, &samples) != SOX_SUCCESS) {
+      fprintf(stderr, "%-7s %-12s skipped\n", kind, name);
+      return;
+    }
+    best = min(best, seconds);
+  }
+  report(kind, name, text + strlen(name) + (text[strlen(name)] == ' '),
+      samples, best, "");
+}
+
+static void bench_all_effects(void)
+{
+  sox_effect_fn_t const * fns = sox_get_effect_fns();
+  char text[256];
+  size_t i, j;
+
+  for (i = 0; fns[i]; ++i) {
+    sox_effect_handler_t const * eh = fns[i]();
+    char const * args = "";
+
+    if (!eh || !eh->name || (eh->flags & (SOX_EFF_INTERNAL | SOX_EFF_DEPRECATED)))
+      continue;
+    for (j = 0; j < array_length(effects_skipped); ++j)
+      if (!strcmp(eh->name, effects_skipped[j]))
+        break;
+    if (j < array_length(effects_skipped))
+      continue;
+    for (j = 0; j < array_length(effect_args); ++j)
+      if (!strcmp(eh->name, effect_args[j][0]))
+        args = effect_args[j][1];
+    sprintf(text, "%s%s%s", eh->name, *args? " " : "", args);
+    bench_effects("effect", eh->name, text);
+  }
+  for (i = 0; i < array_length(chains); ++i) {
+    char name[32];
+
+    sprintf(name, "chain%" PRIuPTR, i + 1);
+    if (wanted(name)) {
+      double seconds, best = HUGE_VAL;
+      sox_uint64_t samples = 0;
+      unsigned r;
+
+      for (r = 0; r < bench.repeats; ++r) {
+        if (run_effects(chains[i], &seconds, &samples) != SOX_SUCCESS)
+          break;
+        best = min(best, seconds);
+      }
+      if (r < bench.repeats)
+        fprintf(stderr, "%-7s %-12s skipped\n", "chain", name);
+      else report("chain", name, chains[i], samples, best, "");
+    }
+  }
+}
+
+/* Encodes the input to memory in the given format, and decodes it again;
+ * gives the seconds that each took, and the number of samples decoded */
+static int run_codec(char const * name, sox_signalinfo_t const * signal,
+    sox_sample_t const * samples, size_t num_samples,
+    double * encode, double * decode, sox_uint64_t * decoded)
+{
+  sox_format_t * ft;
+  sox_signalinfo_t signal1;
+  sox_encodinginfo_t encoding1;
+  char * buffer = NULL;
+  size_t buffer_size = 0, n;
+  sox_sample_t * buf;
+  double t0;
+  int result = SOX_EOF;
+
+  /* A memory stream cannot be seeked, so headers are written in advance */
+  signal1 = *signal;
+  signal1.length = num_samples;
+  if (!(ft = sox_open_memstream_write(&buffer, &buffer_size, &signal1, NULL,
+          name, NULL)))
+    return SOX_EOF;
+  signal1 = ft->signal, encoding1 = ft->encoding;
+  t0 = now();
+  n = sox_write(ft, samples, num_samples);
+  sox_close(ft); /* May fail in trying to seek, but its header is written */
+  if (n != num_samples || !buffer_size) {
+    free(buffer);
+    return SOX_EOF;
+  }
+  *encode = now() - t0;
+
+  /* Headerless formats need to be told what they hold */
+  signal1.length = 0;
+  if (!(ft = sox_open_mem_read(buffer, buffer_size, &signal1, &encoding1, name))) {
+    free(buffer);
+    return SOX_EOF;
+  }
+  buf = malloc(sox_globals.bufsiz * sizeof(*buf));
+  *decoded = 0;
+  t0 = now();
+  while ((n = sox_read(ft, buf, sox_globals.bufsiz)) != 0)
+    *decoded += n;
+  *decode = now() - t0;
+  if (ft->sox_errno == SOX_SUCCESS && *decoded)
+    result = SOX_SUCCESS;
+  sox_close(ft);
+  free(buf);
+  free(buffer);
+  return result;
+}
+
+static void bench_codecs(void)
+{
+  sox_format_tab_t const * fns = sox_get_format_fns();
+  sox_signalinfo_t mono8k = bench.signal;
+  sox_sample_t * samples8k;
+  size_t i, n8k;
+
+  /* For codecs of telephony, etc.: every 5.5th sample of channel 0 */
+  mono8k.rate = 8000, mono8k.channels = 1;
+  n8k = (size_t)(bench.num_samples / bench.signal.channels * mono8k.rate /
+      bench.signal.rate);
+  samples8k = malloc(n8k * sizeof(*samples8k));
+  for (i = 0; i < n8k; ++i)
+    samples8k[i] = bench.samples[(size_t)(i * bench.signal.rate /
+        mono8k.rate) * bench.signal.channels];
+
+  for (i = 0; fns[i].fn; ++i) {
+    sox_format_handler_t const * handler = fns[i].fn();
+    char const * name = handler->names[0];
+    double encode = HUGE_VAL, decode = HUGE_VAL, e, d;
+    sox_uint64_t decoded = 0;
+    sox_bool narrow = sox_false;
+    unsigned r;
+
+    if ((handler->flags & (SOX_FILE_DEVICE | SOX_FILE_PHONY)) ||
+        !handler->write || !handler->read || !wanted(name))
+      continue;
+    for (r = 0; r < bench.repeats; ++r) {
+      int result = narrow? SOX_EOF : run_codec(name, &bench.signal,
+          bench.samples, bench.num_samples, &e, &d, &decoded);
+
+      if (result != SOX_SUCCESS && (narrow || r == 0)) {
+        narrow = sox_true;
+        result = run_codec(name, &mono8k, samples8k, n8k, &e, &d, &decoded);
+      }
+      if (result != SOX_SUCCESS)
+        break;
+      encode = min(encode, e), decode = min(decode, d);
+    }
+    if (r < bench.repeats) {
+      fprintf(stderr, "%-7s %-12s skipped\n", "codec", name);
+      continue;
+    }
+    report("encode", name, narrow? "8k mono" : "", decoded, encode, "");
+    report("decode", name, narrow? "8k mono" : "", decoded, decode, "");
+  }
+  free(samples8k);
+}
+
+/* Writes, to path in the given format, what synth makes of args for the
+ * given seconds (from the null file, as with sox -n) */
+static int synth_file(char const * path, char const * type,
+    unsigned channels, double rate, double seconds, char const * args)
+{
+  sox_signalinfo_t signal = {0, 0, 16, 0, NULL};
+  sox_format_t * in, * out;
+  sox_effects_chain_t * chain;
+  char text[256];
+  int result = SOX_EOF;
+
+  signal.rate = rate, signal.channels = channels;
+  if (!(in = sox_open_read("", &signal, NULL, "null")))
+    return SOX_EOF;
+  if (!(out = sox_open_write(path, &signal, NULL, type, NULL, NULL))) {
+    sox_close(in);
+    return SOX_EOF;
+  }
+  sprintf(text, "synth %g %s", seconds, args);
+  if ((chain = make_chain(in, out, text))) {
+    sox_flow_effects(chain, NULL, NULL); /* Gives SOX_EOF as synth ends */
+    result = out->sox_errno? SOX_EOF : SOX_SUCCESS;
+    sox_delete_effects_chain(chain);
+  }
+  sox_close(out);
+  sox_close(in);
+  return result;
+}
+
+typedef struct {
+  double       wall, cpu;
+  sox_uint64_t samples, mem_peak, bytes_read, bytes_written;
+} job_result_t;
+
+/* Runs a job, from in_path to out_path */
+static int run_job(size_t j, char const * in_path, char const * out_path,
+    job_result_t * r)
+{
+  sox_signalinfo_t signal = {0, 0, 0, 0, NULL};
+  sox_encodinginfo_t encoding;
+  sox_format_t * in, * out;
+  sox_effects_chain_t * chain;
+  sox_effect_stats_t stats;
+  sox_mem_stats_t mem;
+  double t0 = now();
+  clock_t c0 = clock();
+  int result = SOX_EOF;
+
+  signal.rate = jobs[j].out_rate, signal.channels = jobs[j].out_channels;
+  sox_init_encodinginfo(&encoding);
+  encoding.bits_per_sample = jobs[j].out_bits;
+  if (!(in = sox_open_read(in_path, NULL, NULL, NULL)))
+    return SOX_EOF;
+  signal.precision = in->signal.precision;
+  if (!(out = sox_open_write(out_path, &signal, &encoding, jobs[j].out_type,
+          NULL, NULL))) {
+    sox_close(in);
+    return SOX_EOF;
+  }
+  if ((chain = make_chain(in, out, jobs[j].effects))) {
+    sox_flow_effects(chain, NULL, NULL);
+    result = in->sox_errno || out->sox_errno? SOX_EOF : SOX_SUCCESS;
+    sox_effects_chain_stats(chain, (size_t)0, &stats);
+    r->samples = stats.samples_out;
+    sox_effects_chain_memory(chain, chain->length, &mem);
+    r->mem_peak = mem.peak;
+    sox_delete_effects_chain(chain);
+  }
+  r->bytes_read = in->tell_off;
+  r->bytes_written = out->tell_off;
+  sox_close(out);
+  sox_close(in);
+  r->wall = now() - t0;
+  r->cpu = (double)(clock() - c0) / CLOCKS_PER_SEC;
+  return result;
+}
+
+static void bench_jobs(void)
+{
+  char in_path[64], out_path[64], extra[256];
+  size_t j;
+
+  if (synth_file(NOISE_PROFILE ".wav", "wav", 1, 48000., 2., "pinknoise") !=
+      SOX_SUCCESS)
+    fprintf(stderr, "can't synthesise the noise profile's input\n");
+  else {
+    sox_format_t * in = sox_open_read(NOISE_PROFILE ".wav", NULL, NULL, NULL);
+    sox_format_t * out = in? sox_open_write("", &in->signal, NULL, "null",
+        NULL, NULL) : NULL;
+    sox_effects_chain_t * chain = out?
+        make_chain(in, out, "noiseprof " NOISE_PROFILE) : NULL;
+
+    if (chain) {
+      sox_flow_effects(chain, NULL, NULL);
+      sox_delete_effects_chain(chain);
+    }
+    if (out)
+      sox_close(out);
+    if (in)
+      sox_close(in);
+    remove(NOISE_PROFILE ".wav");
+  }
+  for (j = 0; j < array_length(jobs); ++j) {
+    job_result_t best, r;
+    unsigned i;
+
+    if (!wanted(jobs[j].name))
+      continue;
+    sprintf(in_path, "sox_bench-in.%s", jobs[j].in_type);
+    sprintf(out_path, "sox_bench-out.%s", jobs[j].out_type);
+    memset(&best, 0, sizeof(best));
+    best.wall = HUGE_VAL;
+    if (synth_file(in_path, jobs[j].in_type, jobs[j].channels, jobs[j].rate,
+          bench.seconds, jobs[j].synth) != SOX_SUCCESS)
+      i = 0;
+    else for (i = 0; i < bench.repeats; ++i) {
+      if (run_job(j, in_path, out_path, &r) != SOX_SUCCESS)
+        break;
+      if (r.wall < best.wall)
+        best = r;
+    }
+    remove(in_path);
+    remove(out_path);
+    if (i < bench.repeats) {
+      fprintf(stderr, "%-7s %-12s skipped\n", "job", jobs[j].name);
+      continue;
+    }
+    sprintf(extra, ", \"cpu_seconds\": %.6f, \"mem_peak\": %" PRIu64
+        ", \"bytes_read\": %" PRIu64 ", \"bytes_written\": %" PRIu64,
+        best.cpu, best.mem_peak, best.bytes_read, best.bytes_written);
+    sprintf(extra + strlen(extra), ", \"in_type\": \"%s\", \"out_type\": \"%s\"",
+        jobs[j].in_type, jobs[j].out_type);
+    report("job", jobs[j].name, jobs[j].effects, best.samples, best.wall,
+        extra);
+  }
+  remove(NOISE_PROFILE);
+  remove("sox_bench-thumb.png");
+}
+
+int main(int argc, char * argv[])
+{
+  char const * json_name = NULL;
+  unsigned verbosity = 1; /* Failures only, by default */
+  int i;
+
+  bench.seconds = 10;
+  bench.repeats = 3;
+  for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+    if (!strcmp(argv[i], "-j"))
+      bench.jobs = sox_true;
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+      bench.seconds = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      bench.repeats = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      json_name = argv[++i];
+    else if (!strcmp(argv[i], "-v"))
+      ++verbosity;
+    else break;
+  }
+  if ((i < argc && argv[i][0] == '-') || bench.seconds <= 0 || bench.repeats < 1) {
+    fprintf(stderr,
+        "Usage: %s [-j] [-d seconds] [-n repeats] [-o file] [-v] [name ...]\n",
+        argv[0]);
+    return 1;
+  }
+  bench.names = argv + i;
+  bench.num_names = argc - i;
+  bench.json = json_name? fopen(json_name, "w") : stdout;
+  if (!bench.json) {
+    perror(json_name);
+    return 1;
+  }
+
+  if (sox_init() != SOX_SUCCESS)
+    return 1;
+  sox_globals.verbosity = verbosity;
+  sox_globals.profile = sox_true;
+  if (synthesise() != SOX_SUCCESS) {
+    fprintf(stderr, "%s: can't synthesise the input\n", argv[0]);
+    return 1;
+  }
+
+  fprintf(bench.json, "{\"version\": \"%s\", \"arch\": ", sox_version());
+  json_string(sox_version_info()->arch? sox_version_info()->arch : "");
+  fprintf(bench.json, ", \"seconds\": %g, \"repeats\": %u, \"results\": [",
+      bench.seconds, bench.repeats);
+  fprintf(stderr, "%-7s %-12s %-40s %12s %9s\n",
+      "kind", "name", "args", "samples/s", "ns/sample");
+  if (bench.jobs)
+    bench_jobs();
+  else {
+    bench_all_effects();
+    bench_codecs();
+  }
+  fputs("\n]}\n", bench.json);
+
+  if (json_name)
+    fclose(bench.json);
+  free(bench.samples);
+  free(bench.buffer);
+  sox_quit();
+  return 0;
+}
@@ -26,15 +26,42 @@
 
 #include "util.h"
 
-#if defined(LSX_EFF_ALIAS)
+/* A message is given only if its level is at most both sox_globals.verbosity
+ * and LSX_MAX_VERBOSITY (set when libSoX is configured).  Unlike sox.h's
+ * macros, these make the check where the message is, before its arguments
+ * are evaluated, so that a message not given costs only the check, and one
+ * above LSX_MAX_VERBOSITY nothing at all. */
+#ifndef LSX_MAX_VERBOSITY
+#define LSX_MAX_VERBOSITY 6
+#endif
+
+#define lsx_message(level, subsys, impl, args) ((void)( \
+    LSX_MAX_VERBOSITY >= (level) && sox_get_globals()->verbosity >= (level) && \
+    (lsx_set_subsystem(subsys), impl args, 0)))
+
 #undef lsx_debug
 #undef lsx_fail
 #undef lsx_report
 #undef lsx_warn
-#define lsx_debug sox_globals.subsystem=effp->handler.name,lsx_debug_impl
-#define lsx_fail sox_globals.subsystem=effp->handler.name,lsx_fail_impl
-#define lsx_report sox_globals.subsystem=effp->handler.name,lsx_report_impl
-#define lsx_warn sox_globals.subsystem=effp->handler.name,lsx_warn_impl
+#if defined(LSX_EFF_ALIAS)
+#define lsx_fail(...)   lsx_message(1, effp->handler.name, lsx_fail_impl, (__VA_ARGS__))
+#define lsx_warn(...)   lsx_message(2, effp->handler.name, lsx_warn_impl, (__VA_ARGS__))
+#define lsx_report(...) lsx_message(3, effp->handler.name, lsx_report_impl, (__VA_ARGS__))
+#define lsx_debug(...)  lsx_message(4, effp->handler.name, lsx_debug_impl, (__VA_ARGS__))
+#else
+#define lsx_fail(...)   lsx_message(1, __FILE__, lsx_fail_impl, (__VA_ARGS__))
+#define lsx_warn(...)   lsx_message(2, __FILE__, lsx_warn_impl, (__VA_ARGS__))
+#define lsx_report(...) lsx_message(3, __FILE__, lsx_report_impl, (__VA_ARGS__))
+#define lsx_debug(...)  lsx_message(4, __FILE__, lsx_debug_impl, (__VA_ARGS__))
+#endif
+
+/* For data of which each thread should have its own copy */
+#if defined __GNUC__
+  #define LSX_THREAD_LOCAL __thread
+#elif defined _MSC_VER
+  #define LSX_THREAD_LOCAL __declspec(thread)
+#else
+  #define LSX_THREAD_LOCAL  /* Then shared by all threads */
 #endif
 
 #define RANQD1 ranqd1(sox_globals.ranqd1)
@@ -55,12 +82,40 @@ assert_static(sizeof(off_t) == _FILE_OFFSET_BITS >> 3, OFF_T_BUILD_PROBLEM);
 #endif
 
 FILE * lsx_tmpfile(void);
+void lsx_thread_wait(unsigned * waits);
+
+/* What lsx_realtime_enter changed, for lsx_realtime_leave to restore */
+typedef struct {
+  sox_bool raised, locked;
+  int policy, priority;         /* Those before (POSIX) */
+  void * task;                  /* MMCSS (Windows) */
+} lsx_realtime_t;
+lsx_realtime_t lsx_realtime_enter(void);
+void lsx_realtime_leave(lsx_realtime_t saved);
 
 void lsx_debug_more_impl(char const * fmt, ...) LSX_PRINTF12;
 void lsx_debug_most_impl(char const * fmt, ...) LSX_PRINTF12;
 
-#define lsx_debug_more sox_get_globals()->subsystem=__FILE__,lsx_debug_more_impl
-#define lsx_debug_most sox_get_globals()->subsystem=__FILE__,lsx_debug_most_impl
+#define lsx_debug_more(...) lsx_message(5, __FILE__, lsx_debug_more_impl, (__VA_ARGS__))
+#define lsx_debug_most(...) lsx_message(6, __FILE__, lsx_debug_most_impl, (__VA_ARGS__))
+
+/* Static tracepoints, provider `sox', for perf, bpftrace, SystemTap, etc. to
+ * attach to at run time.  With <sys/sdt.h> each is a single nop until
+ * attached; without it, they compile to nothing. */
+#if defined HAVE_SYS_SDT_H
+  #include <sys/sdt.h>
+  #define lsx_trace1(name, a) DTRACE_PROBE1(sox, name, a)
+  #define lsx_trace2(name, a, b) DTRACE_PROBE2(sox, name, a, b)
+  #define lsx_trace3(name, a, b, c) DTRACE_PROBE3(sox, name, a, b, c)
+  #define lsx_trace4(name, a, b, c, d) DTRACE_PROBE4(sox, name, a, b, c, d)
+  #define lsx_trace5(name, a, b, c, d, e) DTRACE_PROBE5(sox, name, a, b, c, d, e)
+#else
+  #define lsx_trace1(name, a) (void)0
+  #define lsx_trace2(name, a, b) (void)0
+  #define lsx_trace3(name, a, b, c) (void)0
+  #define lsx_trace4(name, a, b, c, d) (void)0
+  #define lsx_trace5(name, a, b, c, d, e) (void)0
+#endif
 
 /* Digitise one cycle of a wave and store it as
  * a table of samples of a specified data-type.
@@ -73,12 +128,105 @@ void lsx_generate_wave_table(
     double min,         /* Minimum value on the y-axis. (e.g. -1) */
     double max,         /* Maximum value on the y-axis. (e.g. +1) */
     double phase);      /* Phase at 1st point; 0..2pi. (e.g. pi/2 for cosine) */
-char const * lsx_parsesamples(sox_rate_t rate, const char *str, uint64_t *samples, int def);
+
+/* Delay line, written and read a block at a time */
+typedef struct {
+  double * buf;
+  size_t len, pos;      /* pos: where the next sample is to be written */
+} lsx_delay_t;
+void lsx_delay_create(lsx_delay_t * d, size_t max_delay, size_t max_block);
+void lsx_delay_write(lsx_delay_t * d, double const * in, size_t n);
+void lsx_delay_read(lsx_delay_t const * d, size_t delay, double * out, size_t n);
+void lsx_delay_read_var(lsx_delay_t const * d, double const * delays,
+    double * out, size_t n);
+void lsx_delay_delete(lsx_delay_t * d);
+
+/* Low-frequency oscillator: a wave table read a block at a time */
+typedef struct {
+  double * table;
+  size_t len, pos;
+} lsx_lfo_t;
+void lsx_lfo_create(lsx_lfo_t * l, lsx_wave_t wave_type, sox_data_t data_type,
+    size_t len, double min, double max, double phase);
+void lsx_lfo_read(lsx_lfo_t const * l, size_t offset, double * out, size_t n);
+void lsx_lfo_advance(lsx_lfo_t * l, size_t n);
+void lsx_lfo_delete(lsx_lfo_t * l);
+
+/* Audio held by an effect until it is drained (e.g. by reverse or repeat):
+ * in memory up to a limit, beyond which it spills to a temporary file; this
+ * is then memory-mapped (where possible) to be read back */
+#define LSX_STORE_MEMORY 64     /* MiB held in memory by default */
+typedef struct {
+  char const    * name;         /* Of the effect that holds the audio */
+  size_t        max_len;        /* Samples to hold in memory */
+  sox_sample_t  * buf;          /* Audio held in memory */
+  size_t        buf_size;
+  uint64_t      len;            /* Samples written */
+  FILE          * tmp_file;     /* Or else spilled here */
+  sox_sample_t  * map;          /* Mapped tmp_file (or NULL) */
+  size_t        map_len;        /* Bytes */
+  sox_bool      sealed;         /* Written to no more */
+} lsx_store_t;
+void lsx_store_create(lsx_store_t * s, sox_effect_t const * effp,
+    double max_memory);
+int lsx_store_write(lsx_store_t * s, sox_sample_t const * buf, size_t len);
+int lsx_store_seal(lsx_store_t * s);
+sox_sample_t const * lsx_store_data(lsx_store_t const * s);
+int lsx_store_read(lsx_store_t * s, uint64_t pos, sox_sample_t * buf, size_t len);
+void lsx_store_prefetch(lsx_store_t const * s, uint64_t pos, size_t len);
+void lsx_store_delete(lsx_store_t * s);
+sox_bool lsx_rereadable(sox_format_t const * ft);
+void lsx_samples_to_float(float * d, sox_sample_t const * s, size_t step,
+    size_t n, sox_uint64_t * clips);
+void lsx_float_to_samples(sox_sample_t * d, size_t step, float const * s,
+    size_t n, sox_uint64_t * clips);
+
+/* A partial result (see sox_effect_save), written or read a field at a time
+ * in a fixed (little-endian) layout, so that one function of an effect can
+ * do both.  Writing beyond size only counts the bytes needed; reading beyond
+ * it gives zeros, and sets error. */
+typedef struct {
+  unsigned char * data;         /* When reading, not written to */
+  size_t        size, pos;
+  sox_bool      reading, error;
+} lsx_partial_t;
+void lsx_partial_bytes(lsx_partial_t * s, void * x, size_t n);
+void lsx_partial_u64(lsx_partial_t * s, uint64_t * x);
+void lsx_partial_i32(lsx_partial_t * s, int32_t * x);
+void lsx_partial_f64(lsx_partial_t * s, double * x);
+/* Of len wide samples of an effect's input from position pos, the number
+ * that its span covers, after the *lead that come before it */
+size_t lsx_span(sox_effect_t const * effp, uint64_t pos, size_t len,
+    size_t * lead);
+
+/* An index of segments of an effect's input (e.g. silence -o), written as
+ * lines of START END PEAK RMS (START & END in samples, as 1234s; PEAK & RMS
+ * in dBFS) or, if the file's name ends in .json, as a JSON array.  Segments
+ * added that adjoin or overlap the last are joined to it. */
+typedef struct {
+  FILE      * file;
+  sox_bool  json;
+  unsigned  channels;
+  size_t    count;              /* Segments written */
+  sox_bool  open;               /* Whether there's a segment not yet written */
+  uint64_t  start, end;         /* Its wide samples */
+  double    peak, sum2;         /* Of its samples' magnitudes & squares */
+} lsx_segments_t;
+int lsx_segments_open(sox_effect_t * effp, lsx_segments_t * s,
+    char const * filename);
+void lsx_segments_measure(sox_sample_t const * buf, size_t n, double * peak,
+    double * sum2);
+int lsx_segments_add(lsx_segments_t * s, uint64_t start, uint64_t end,
+    double peak, double sum2);
+int lsx_segments_close(sox_effect_t * effp, lsx_segments_t * s);
+/* char const * lsx_parsesamples(sox_rate_t rate, const char *str, uint64_t *samples, int def); Moved to sox.h. */
 char const * lsx_parseposition(sox_rate_t rate, const char *str, uint64_t *samples, uint64_t latest, uint64_t end, int def);
 int lsx_parse_note(char const * text, char * * end_ptr);
 double lsx_parse_frequency_k(char const * text, char * * end_ptr, int key);
 #define lsx_parse_frequency(a, b) lsx_parse_frequency_k(a, b, INT_MAX)
 FILE * lsx_open_input_file(sox_effect_t * effp, char const * filename, sox_bool text_mode);
+double * lsx_read_audio_file(sox_effect_t * effp, char const * filename,
+    unsigned * channels, size_t * length);
 
 void lsx_prepare_spline3(double const * x, double const * y, int n,
     double start_1d, double end_1d, double * y_2d);
@@ -89,11 +237,41 @@ double lsx_bessel_I_0(double x);
 int lsx_set_dft_length(int num_taps);
 void init_fft_cache(void);
 void clear_fft_cache(void);
+void init_design_cache(void);
+void clear_design_cache(void);
+double const * lsx_design_get(char const * name, double const * params,
+    int num_params, int * len, int * extra);
+double const * lsx_design_put(char const * name, double const * params,
+    int num_params, double * data, int len, int extra);
+void lsx_design_release(double const * data);
 #define lsx_is_power_of_2(x) !(x < 2 || (x & (x - 1)))
 void lsx_safe_rdft(int len, int type, double * d);
 void lsx_safe_cdft(int len, int type, double * d);
+void lsx_safe_rdft_f(int len, int type, float * d);
+void lsx_safe_cdft_f(int len, int type, float * d);
+void lsx_safe_rdft_batch(int len, int type, size_t count, double * d,
+    sox_context_t const * context);
+void lsx_safe_rdft_batch_f(int len, int type, size_t count, float * d,
+    sox_context_t const * context);
 void lsx_power_spectrum(int n, double const * in, double * out);
 void lsx_power_spectrum_f(int n, float const * in, float * out);
+typedef struct {
+  size_t n, search, stride;
+  int dft_length;
+  double * x, * y, * energy;
+} lsx_match_t;
+void lsx_match_create(lsx_match_t * m, size_t n, size_t search, size_t stride);
+size_t lsx_match(lsx_match_t * m);
+void lsx_match_delete(lsx_match_t * m);
+void lsx_fir_convolve(double const * h, int n, double const * in,
+    double * out, size_t len);
+void lsx_sos_filter(double const * coefs, size_t num_sections,
+    double * state, size_t chans, sox_sample_t const * in, sox_sample_t * out,
+    size_t len, sox_uint64_t * clips);
+void lsx_exp_n(double * x, size_t n, sox_bool fast);
+void lsx_log10_n(double * x, size_t n, sox_bool fast);
+void lsx_sin_n(double * x, size_t n, sox_bool fast);
+void lsx_cos_n(double * x, size_t n, sox_bool fast);
 void lsx_apply_hann_f(float h[], const int num_points);
 void lsx_apply_hann(double h[], const int num_points);
 void lsx_apply_hamming(double h[], const int num_points);
@@ -116,6 +294,7 @@ double * lsx_design_lpf(
     double beta);   /* <0: value will be estimated */
 void lsx_fir_to_phase(double * * h, int * len,
     int * post_len, double phase0);
+double const * lsx_half_band_coefs(int * num_coefs);
 void lsx_plot_fir(double * h, int num_points, sox_rate_t rate, sox_plot_t type, char const * title, double y1, double y2);
 void lsx_save_samples(sox_sample_t * const dest, double const * const src,
     size_t const n, sox_uint64_t * const clips);
@@ -140,6 +319,9 @@ void lsx_load_samples(double * const dest, sox_sample_t const * const src,
 
 /* Read and write basic data types from "ft" stream. */
 size_t lsx_readbuf(sox_format_t * ft, void *buf, size_t len);
+void const * lsx_read_mapped(sox_format_t * ft, size_t size, size_t len,
+    size_t * nread);
+size_t lsx_shared_read(sox_format_t * ft, void * buf, size_t len);
 int lsx_skipbytes(sox_format_t * ft, size_t n);
 int lsx_padbytes(sox_format_t * ft, size_t n);
 size_t lsx_writebuf(sox_format_t * ft, void const *buf, size_t len);
@@ -198,6 +380,9 @@ int lsx_eof(sox_format_t * ft);
 int lsx_error(sox_format_t * ft);
 int lsx_flush(sox_format_t * ft);
 int lsx_seeki(sox_format_t * ft, off_t offset, int whence);
+void lsx_end_direct_io(sox_format_t * ft);
+void lsx_prefetch(sox_format_t * ft, size_t len);
+void lsx_end_prefetch(sox_format_t * ft);
 int lsx_unreadb(sox_format_t * ft, unsigned ub);
 /* uint64_t lsx_filelength(sox_format_t * ft); Temporarily Moved to sox.h. */
 off_t lsx_tell(sox_format_t * ft);
@@ -206,6 +391,11 @@ void lsx_rewind(sox_format_t * ft);
 
 int lsx_offset_seek(sox_format_t * ft, off_t byte_offset, off_t to_sample);
 
+/* For sox_format_handler_t.rewrite_comments: */
+int lsx_rewrite_chunk(char const * path, char const * magic,
+    sox_bool big_endian, char const * const * ids, char const * after,
+    char const * filler, char const * id, void const * data, size_t len);
+
 void lsx_fail_errno(sox_format_t *, int, const char *, ...)
 #ifdef __GNUC__
 __attribute__ ((format (printf, 3, 4)));
@@ -219,11 +409,127 @@ typedef struct sox_formats_globals { /* Global parameters (for formats) */
 
 
 
+/*------------------------ Implemented in io_async.c -------------------------*/
+
+#if defined HAVE_LINUX_IO_URING_H && defined HAVE_SYS_MMAN_H && defined HAVE_OPENMP
+  #define HAVE_IO_URING 1  /* Asynchronous I/O may go through io_uring */
+#endif
+
+size_t lsx_io_async_pending(void);
+void lsx_io_async_start(void);
+void lsx_io_async_stop(void);
+void lsx_io_async_serve(size_t * stop);
+size_t lsx_io_async_read(sox_format_t * ft, void * buf, size_t len);
+size_t lsx_io_async_write(sox_format_t * ft, void const * buf, size_t len);
+int lsx_io_async_flush(sox_format_t * ft);
+int lsx_io_async_seek(sox_format_t * ft, off_t offset, int whence);
+int lsx_io_async_eof(sox_format_t * ft);
+int lsx_io_async_error(sox_format_t * ft);
+void lsx_io_async_clearerr(sox_format_t * ft);
+int lsx_io_async_unreadb(sox_format_t * ft, unsigned b);
+int lsx_io_async_close(sox_format_t * ft);
+
+
+
+/*--------------------------- Implemented in cpu.c ---------------------------*/
+
+/* Where the compiler can build code for an instruction set whatever its -m
+ * options, kernels for that set are built with LSX_TARGET(set) and chosen
+ * at run-time by their module's lsx_..._dispatch(), from the features that
+ * sox_init found; otherwise, only those that -m allows are built. */
+#if defined __GNUC__ && (defined __x86_64__ || defined __i386__) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+  #define HAVE_LSX_TARGET 1
+  #define LSX_TARGET(set) __attribute__((target(set)))
+#else
+  #define LSX_TARGET(set)
+#endif
+
+#define LSX_CPU_SSE2    0x001u
+#define LSX_CPU_SSSE3   0x002u
+#define LSX_CPU_SSE41   0x004u
+#define LSX_CPU_AVX     0x008u
+#define LSX_CPU_AVX2    0x010u
+#define LSX_CPU_FMA     0x020u
+#define LSX_CPU_AVX512F 0x040u
+#define LSX_CPU_NEON    0x100u
+
+unsigned lsx_cpu_features(void);
+void lsx_cpu_init(void);
+void lsx_raw_dispatch(unsigned cpu);
+void lsx_rate_dispatch(unsigned cpu);
+void lsx_adpcm_dispatch(unsigned cpu);
+void lsx_adpcms_dispatch(unsigned cpu);
+
+/* The thread budget (see threads.c): lsx_threads_take asks for n threads, the
+ * caller's own included, for a parallel region, and gives how many it may
+ * have (at least 1); lsx_threads_for asks for as many as will share out work
+ * among items, but no more than OpenMP's default team (lsx_effect_threads:
+ * for an effect, and only with use_threads); lsx_threads_give gives them
+ * back once the region has joined. */
+size_t lsx_threads_take(sox_context_t const * context, size_t n);
+size_t lsx_threads_for(sox_context_t const * context, size_t items);
+size_t lsx_effect_threads(sox_effect_t const * effp, size_t items);
+void lsx_threads_give(sox_context_t const * context, size_t n);
+
+
+
+/*---------------------- Implemented in decode_ahead.c -----------------------*/
+
+size_t lsx_decode_ahead_pending(void);
+size_t lsx_decode_ahead_start(void);
+void lsx_decode_ahead_stop(void);
+void lsx_decode_ahead_serve(size_t n, size_t * stop);
+size_t lsx_decode_ahead_read(sox_format_t * ft, sox_sample_t * buf, size_t len);
+int lsx_decode_ahead_seek(sox_format_t * ft, uint64_t offset);
+void lsx_decode_ahead_close(sox_format_t * ft);
+
+
+
+/*---------------------- Implemented in decode_cache.c -----------------------*/
+
+void lsx_decode_cache_open(sox_format_t * ft);
+sox_bool lsx_decode_cache_hit(sox_format_t const * ft);
+size_t lsx_decode_cache_read(sox_format_t * ft, sox_sample_t * buf, size_t len);
+int lsx_decode_cache_seek(sox_format_t * ft, uint64_t offset);
+void lsx_decode_cache_close(sox_format_t * ft);
+
+
+
+/*-------------------------- Implemented in lv2.c ----------------------------*/
+
+size_t lsx_lv2_work_pending(void);
+void lsx_lv2_work_serve(size_t * stop);
+
+
+
+/*-------------------------- Implemented in http.c ---------------------------*/
+
+sox_bool lsx_http_handles(char const * url);
+FILE * lsx_http_open(char const * url);
+sox_bool lsx_http_stream(FILE * fp);
+sox_bool lsx_http_seekable(FILE * fp);
+sox_uint64_t lsx_http_length(FILE * fp);
+int lsx_http_exchange(char const * method, char const * url,
+    char const * headers, void const * body, size_t len, char * * response,
+    char const * want, char * * wanted);
+
+
+
+/*--------------------------- Implemented in s3.c ----------------------------*/
+
+#define LSX_S3_PART_SIZE (8 << 20) /* Bytes; the store's minimum is 5MiB */
+sox_bool lsx_s3_handles(char const * url);
+FILE * lsx_s3_open(char const * url);
+
+
+
 /*------------------------------ File Handlers -------------------------------*/
 
 int lsx_check_read_params(sox_format_t * ft, unsigned channels,
     sox_rate_t rate, sox_encoding_t encoding, unsigned bits_per_sample,
     uint64_t num_samples, sox_bool check_length);
+size_t lsx_decode(sox_format_t * ft, sox_sample_t * buf, size_t len);
 #define LSX_FORMAT_HANDLER(name) \
 sox_format_handler_t const * lsx_##name##_format_fn(void); \
 sox_format_handler_t const * lsx_##name##_format_fn(void)
@@ -250,6 +556,7 @@ char * lsx_cat_comments(sox_comments_t comments);
 
 int lsx_flow_copy(sox_effect_t * effp, const sox_sample_t * ibuf,
     sox_sample_t * obuf, size_t * isamp, size_t * osamp);
+int lsx_reset_stateless(sox_effect_t * effp);
 int lsx_usage(sox_effect_t * effp);
 char * lsx_usage_lines(char * * usage, char const * const * lines, size_t n);
 #define EFFECT(f) extern sox_effect_handler_t const * lsx_##f##_effect_fn(void);
@@ -293,7 +600,47 @@ char * lsx_usage_lines(char * * usage, char const * const * lines, size_t n);
 }
 #define GETOPT_NUMERIC(state, ch, name, min, max) GETOPT_LOCAL_NUMERIC(state, ch, p->name, min, max)
 
+/* Frames over which an effect ramps in a change made by sox_effect_update */
+#define lsx_update_ramp(effp) ((size_t)((effp)->in_signal.rate * .02) + 1)
+
 int lsx_effect_set_imin(sox_effect_t * effp, size_t imin);
+void lsx_effect_set_block(sox_effect_t * effp, size_t block);
+void lsx_trim_set_read(sox_effect_t * effp, uint64_t wide);
+
+/* Zeroed, aligned memory that lasts as long as the effect: it is shared by
+ * all flows, is freed with them by sox_delete_effect, and must not be freed
+ * by the handler itself */
+#define lsx_effect_calloc(effp, n, s) lsx_arena_alloc((effp)->arena, (n) * (s))
+
+/* If effp (just started, in flow 0) is a biquad filter, and so is the chain's
+ * last effect, fuses effp into that, returning true; effp is then unused.
+ * Likewise for vol after vol, and rate after rate (where the last effect may
+ * instead be removed, if the two cancel out). */
+sox_bool lsx_biquad_fuse(sox_effects_chain_t * chain, sox_effect_t * effp);
+sox_bool lsx_vol_fuse(sox_effects_chain_t * chain, sox_effect_t * effp);
+sox_bool lsx_rate_fuse(sox_effects_chain_t * chain, sox_effect_t * effp);
+
+/* Varying the ratio of a rate effect given -V (rate.c), for
+ * sox_effects_chain_adjust_rate and sox_effects_chain_rate_feedback */
+int lsx_rate_adjust(sox_effect_t * effp, double ratio);
+int lsx_rate_feedback(sox_effect_t * effp, double excess);
+
+/* Branches (branch.c): each is run by its branch point, through these */
+void lsx_start_branch(sox_effects_chain_t * chain);
+int lsx_flow_branch(sox_effects_chain_t * chain,
+    sox_sample_t const * buf, size_t len);
+int lsx_drain_branch(sox_effects_chain_t * chain);
+sox_bool lsx_has_merge(sox_effects_chain_t const * chain);
+sox_bool lsx_has_async_branches(sox_effects_chain_t * chain);
+size_t lsx_start_async_branches(sox_effects_chain_t * chain);
+void lsx_serve_async_branch(sox_effects_chain_t * chain, size_t n);
+void lsx_end_async_branches(sox_effects_chain_t * chain);
+void lsx_finish_async_branches(sox_effects_chain_t * chain, sox_bool ran);
+
+/* Offset between channels of a planar (effp->planar) flow's input, and of
+ * its flow or drain output */
+#define lsx_iplane_size(effp) ((effp)->ibufsiz / (effp)->in_signal.channels)
+#define lsx_oplane_size(effp) ((effp)->obufsiz / (effp)->out_signal.channels)
 
 int lsx_effects_init(void);
 int lsx_effects_quit(void);
@@ -16,3 +16,671 @@
  */
 
 #include "sox_sample_test.h"
+#include "sox_i.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+  #include <sys/time.h>
+#endif
+
+/* Kernels that have versions for several instruction sets are run, in each
+ * version that this CPU can run, on the same randomised and edge-case input
+ * (clipping boundaries, NaN, infinities, denormals) as their portable
+ * version, at every length up to MAX_N (so through each kernel's tail) and
+ * at unaligned addresses; outputs and clip counts must match bit for bit.
+ * The FFT's vector kernels, chosen at build time, are switched off to run
+ * its portable code (lsx_fft4g_vec); both are checked against a direct DFT
+ * too, within a tolerance.  With -v, each version's speed is reported too,
+ * in ns/sample. */
+
+#include "fft4g.h"
+#include "g711.h"
+#include "raw_vec.h"
+typedef double sample_t;
+#include "rate_dot.h"
+
+#define MAX_N   67     /* Longest length checked */
+#define GUARD   16     /* Bytes after the output that must not be written */
+#define BENCH_N ((size_t)4096) /* Samples per call when timing */
+
+static unsigned cpu;
+static sox_bool verbose;
+static uint32_t seed = 1;
+
+static uint32_t rnd(void) /* xorshift32 */
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void fail(char const * kernel, char const * isa, char const * what,
+    size_t n, size_t offset)
+{
+  fprintf(stderr, "sox_sample_test: %s (%s): %s, at length %lu, offset %lu\n",
+      kernel, isa, what, (unsigned long)n, (unsigned long)offset);
+  exit(1);
+}
+
+static double now(void)
+{
+#if defined HAVE_CLOCK_GETTIME
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#elif defined HAVE_GETTIMEOFDAY
+  struct timeval t;
+
+  gettimeofday(&t, NULL);
+  return t.tv_sec + t.tv_usec * 1e-6;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/* Repeats stmt, which processes per_run samples, for a tenth of a second,
+ * then reports the time that it took per sample */
+#define TIME(kernel, isa, stmt, per_run) do { \
+  double t0_ = now(), t_; \
+  size_t samples_ = 0; \
+  do {stmt; samples_ += per_run;} while ((t_ = now() - t0_) < .1); \
+  printf("%-16s %-6s %8.3f ns/sample\n", kernel, isa, t_ * 1e9 / (double)samples_); \
+} while (0)
+
+/*------------------------------- Raw I/O ---------------------------------*/
+
+typedef struct {
+  char const      * name, * isa;
+  unsigned        cpu;          /* The LSX_CPU_... that it needs */
+  size_t          size;         /* Bytes of each value in the file */
+  raw_unpack_fn_t unpack, unpack_c;
+  raw_pack_fn_t   pack, pack_c;
+} raw_kernel_t;
+
+static raw_kernel_t const raw_kernels[] = {
+#if defined HAVE_RAW_VEC_SSSE3
+  {"unpack_s16", "ssse3", LSX_CPU_SSSE3, 2, unpack_s16_ssse3, unpack_s16_c, NULL, NULL},
+  {"unpack_s24", "ssse3", LSX_CPU_SSSE3, 3, unpack_s24_ssse3, unpack_s24_c, NULL, NULL},
+  {"unpack_s32", "ssse3", LSX_CPU_SSSE3, 4, unpack_s32_ssse3, unpack_s32_c, NULL, NULL},
+  {"unpack_f32", "ssse3", LSX_CPU_SSSE3, 4, unpack_f32_ssse3, unpack_f32_c, NULL, NULL},
+  {"pack_s16"  , "ssse3", LSX_CPU_SSSE3, 2, NULL, NULL, pack_s16_ssse3, pack_s16_c},
+  {"pack_s24"  , "ssse3", LSX_CPU_SSSE3, 3, NULL, NULL, pack_s24_ssse3, pack_s24_c},
+  {"pack_s32"  , "ssse3", LSX_CPU_SSSE3, 4, NULL, NULL, pack_s32_ssse3, pack_s32_c},
+  {"pack_f32"  , "ssse3", LSX_CPU_SSSE3, 4, NULL, NULL, pack_f32_ssse3, pack_f32_c},
+  {"pack_ulaw" , "ssse3", LSX_CPU_SSSE3, 1, NULL, NULL, pack_ulaw_ssse3, pack_ulaw_c},
+  {"pack_alaw" , "ssse3", LSX_CPU_SSSE3, 1, NULL, NULL, pack_alaw_ssse3, pack_alaw_c},
+#endif
+  {NULL, NULL, 0, 0, NULL, NULL, NULL, NULL}
+};
+
+/* File values for f32: special, and at and about the clipping boundaries */
+static float const edge_floats[] = {
+  0.f, -0.f, 1.f, -1.f, .5f, -.5f, 1 - FLT_EPSILON / 2, -1 + FLT_EPSILON / 2,
+  1 + FLT_EPSILON, -1 - FLT_EPSILON, FLT_MIN, -FLT_MIN, FLT_MIN / 4,
+  -FLT_MIN / 4, FLT_MAX, -FLT_MAX, 1e30f, 2.f, -2.f,
+};
+
+static void fill_samples(sox_sample_t * s, size_t n)
+{
+  sox_sample_t const edge_samples[] = { /* At clipping and rounding edges */
+    SOX_SAMPLE_MIN, SOX_SAMPLE_MIN + 1, -1, 0, 1, SOX_SAMPLE_MAX,
+    SOX_SAMPLE_MAX - 1, SOX_SAMPLE_MAX - 63, SOX_SAMPLE_MAX - 64,
+    SOX_SAMPLE_MAX - 127, SOX_SAMPLE_MAX - 128, SOX_SAMPLE_MAX - (1 << 7),
+    SOX_SAMPLE_MAX - (1 << 15), SOX_SAMPLE_MAX - (1 << 15) + 1,
+    SOX_SAMPLE_MAX - (1 << 17), SOX_SAMPLE_MAX - (1 << 17) + 1,
+    SOX_SAMPLE_MAX - (1 << 18), SOX_SAMPLE_MAX - (1 << 18) + 1,
+    (1 << 15) - 1, 1 << 15, -(1 << 15), -(1 << 15) - 1, (1 << 7), -(1 << 7),
+    (1 << 17), -(1 << 17) - 1, (1 << 18), -(1 << 18) - 1,
+  };
+  size_t i;
+
+  for (i = 0; i < n; ++i)
+    s[i] = rnd() & 1? edge_samples[rnd() % array_length(edge_samples)] :
+      (sox_sample_t)rnd();
+}
+
+static void fill_bytes(uint8_t * p, size_t n, raw_kernel_t const * k)
+{
+  size_t i;
+
+  for (i = 0; i < n * k->size; ++i)
+    p[i] = (uint8_t)rnd();
+  if (k->unpack_c == unpack_f32_c)
+    for (i = 0; i < n; ++i) {
+      float x;
+      switch (rnd() % 4) {
+        case 0: x = edge_floats[rnd() % array_length(edge_floats)]; break;
+        case 1: x = rnd() & 1? (float)HUGE_VAL : rnd() & 1? -(float)HUGE_VAL : (float)(HUGE_VAL - HUGE_VAL); break;
+        case 2: x = (float)((double)(int32_t)rnd() / (1u << 30)); break;
+        default: continue;    /* Random bits */
+      }
+      memcpy(p + i * 4, &x, sizeof(x));
+    }
+}
+
+static void test_raw(raw_kernel_t const * k)
+{
+  uint8_t bytes[MAX_N * 4 + 4], out[2][MAX_N * 4 + 4 + GUARD];
+  sox_sample_t samples[MAX_N + 1], outs[2][MAX_N + 1 + GUARD];
+  size_t n, offset, j;
+  int swap;
+
+  for (swap = 0; swap < 2; ++swap) for (n = 0; n <= MAX_N; ++n)
+    for (offset = 0; offset < 4; ++offset) {
+      sox_uint64_t clips[2];
+      memset(out, 0x5a, sizeof(out));
+      memset(outs, 0x5a, sizeof(outs));
+      if (k->unpack) {
+        fill_bytes(bytes + offset, n, k);
+        clips[0] = k->unpack(outs[0] + (offset & 1), bytes + offset, n, swap);
+        clips[1] = k->unpack_c(outs[1] + (offset & 1), bytes + offset, n, swap);
+        if (memcmp(outs[0], outs[1], sizeof(outs[0])))
+          fail(k->name, k->isa, "samples differ from the portable version's", n, offset);
+      } else {
+        fill_samples(samples + (offset & 1), n);
+        clips[0] = k->pack(out[0] + offset, samples + (offset & 1), n, swap);
+        clips[1] = k->pack_c(out[1] + offset, samples + (offset & 1), n, swap);
+        if (memcmp(out[0], out[1], sizeof(out[0])))
+          fail(k->name, k->isa, "bytes differ from the portable version's", n, offset);
+      }
+      if (clips[0] != clips[1])
+        fail(k->name, k->isa, "clip count differs from the portable version's", n, offset);
+    }
+
+  if (verbose) {
+    static uint8_t b[BENCH_N * 4];
+    static sox_sample_t s[BENCH_N];
+    for (j = 0; j < 2; ++j) {
+      char const * isa = j? "c" : k->isa;
+      if (k->unpack) {
+        raw_unpack_fn_t fn = j? k->unpack_c : k->unpack;
+        fill_bytes(b, BENCH_N, k);
+        TIME(k->name, isa, fn(s, b, BENCH_N, sox_false), BENCH_N);
+      } else {
+        raw_pack_fn_t fn = j? k->pack_c : k->pack;
+        fill_samples(s, BENCH_N);
+        TIME(k->name, isa, fn(b, s, BENCH_N, sox_false), BENCH_N);
+      }
+    }
+  }
+}
+
+/* The versions that raw.c gets from raw_vec_init, as for this CPU */
+static void test_raw_dispatch(void)
+{
+  raw_kernel_t k[10];
+  size_t i;
+
+  raw_vec_init(cpu);
+  memset(k, 0, sizeof(k));
+  #define UNPACK(i, type, bytes) k[i].name = "unpack_" #type, \
+    k[i].size = bytes, k[i].unpack = raw_unpack_##type, k[i].unpack_c = unpack_##type##_c
+  #define PACK(i, type, bytes) k[i].name = "pack_" #type, \
+    k[i].size = bytes, k[i].pack = raw_pack_##type, k[i].pack_c = pack_##type##_c
+  UNPACK(0, s16, 2); UNPACK(1, s24, 3); UNPACK(2, s32, 4); UNPACK(3, f32, 4);
+  PACK(4, s16, 2); PACK(5, s24, 3); PACK(6, s32, 4); PACK(7, f32, 4);
+  PACK(8, ulaw, 1); PACK(9, alaw, 1);
+  #undef UNPACK
+  #undef PACK
+  for (i = 0; i < array_length(k); ++i) {
+    k[i].isa = "auto";
+    test_raw(&k[i]);
+  }
+}
+
+/* The G.711 kernels, portable and dispatched, against the tables that they
+ * replaced (as raw.c used them), for every 14 or 13-bit value, with samples
+ * at and about its rounding edges */
+typedef sox_int16_t sox_int14_t;
+typedef sox_int16_t sox_int13_t;
+typedef sox_uint16_t sox_uint14_t;
+typedef sox_uint16_t sox_uint13_t;
+
+static void test_law(void)
+{
+  static sox_sample_t samples[3 << 16];
+  static uint8_t ref[2][3 << 16], out[2][3 << 16];
+  sox_uint64_t ref_clips[2] = {0, 0}, clips[2];
+  size_t i, j;
+  SOX_SAMPLE_LOCALS;
+
+  for (i = 0; i < 1 << 16; ++i) for (j = 0; j < 3; ++j) {
+    sox_sample_t x = (sox_sample_t)((uint32_t)i << 16) + (sox_sample_t)j - 1;
+    samples[3 * i + j] = x;
+    ref[0][3 * i + j] = sox_14linear2ulaw(
+        SOX_SAMPLE_TO_UNSIGNED(14, x, ref_clips[0]) - 0x2000);
+    ref[1][3 * i + j] = sox_13linear2alaw(
+        SOX_SAMPLE_TO_UNSIGNED(13, x, ref_clips[1]) - 0x1000);
+  }
+  for (j = 0; j < 2; ++j) {
+    char const * isa = j? "auto" : "c";
+    size_t const n = array_length(samples);
+    clips[0] = (j? raw_pack_ulaw : pack_ulaw_c)(out[0], samples, n, sox_false);
+    clips[1] = (j? raw_pack_alaw : pack_alaw_c)(out[1], samples, n, sox_false);
+    if (memcmp(out[0], ref[0], n) || clips[0] != ref_clips[0])
+      fail("pack_ulaw", isa, "differs from the table's", n, (size_t)0);
+    if (memcmp(out[1], ref[1], n) || clips[1] != ref_clips[1])
+      fail("pack_alaw", isa, "differs from the table's", n, (size_t)0);
+  }
+}
+
+/*---------------------------- Save and load ------------------------------*/
+
+#if defined __SSE2__ || defined _M_X64 || \
+    (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define HAVE_SAVE_SAMPLES_SSE2 1
+
+/* lsx_save_samples' SSE2 version: to nearest (even), clipped beyond
+ * SOX_SAMPLE_MAX + .5 and SOX_SAMPLE_MIN - .5, with NaN going to MIN */
+static sox_sample_t save_sample_c(double x, sox_uint64_t * clips)
+{
+  if (x >= SOX_SAMPLE_MAX + .5)
+    return ++*clips, SOX_SAMPLE_MAX;
+  if (!(x >= SOX_SAMPLE_MIN - .5))
+    return ++*clips, SOX_SAMPLE_MIN;
+  return (sox_sample_t)rint(x);
+}
+
+static double edge_double(void)
+{
+  double const edges[] = {
+    SOX_SAMPLE_MAX, SOX_SAMPLE_MAX + .5, SOX_SAMPLE_MAX + .49999999,
+    SOX_SAMPLE_MAX - .5, SOX_SAMPLE_MAX + 1., SOX_SAMPLE_MIN,
+    SOX_SAMPLE_MIN - .5, SOX_SAMPLE_MIN - .50000001, SOX_SAMPLE_MIN + .5,
+    SOX_SAMPLE_MIN - 1., .5, -.5, 1.5, -1.5, 2.5, -2.5, 0., -0., 1e300,
+    -1e300, DBL_MIN, -DBL_MIN, DBL_MIN / 4, -DBL_MIN / 4,
+  };
+  switch (rnd() % 4) {
+    case 0: return edges[rnd() % array_length(edges)];
+    case 1: return rnd() & 1? HUGE_VAL : rnd() & 1? -HUGE_VAL : HUGE_VAL - HUGE_VAL;
+    case 2: return (double)(int32_t)rnd() + (rnd() % 4) * .25;
+    default: return (double)(int32_t)rnd() * ((rnd() & 7) + .5) / 4;
+  }
+}
+
+static void test_save_load(void)
+{
+  double d[MAX_N + 3], dl[MAX_N + 3 + GUARD];
+  sox_sample_t s[2][MAX_N + 3 + GUARD];
+  size_t n, offset, i;
+
+  for (n = 0; n <= MAX_N; ++n) for (offset = 0; offset < 4; ++offset) {
+    sox_uint64_t clips[2] = {0, 0};
+    memset(s, 0x5a, sizeof(s));
+    for (i = 0; i < n; ++i)
+      d[offset + i] = edge_double();
+    lsx_save_samples(s[0] + offset, d + offset, n, &clips[0]);
+    for (i = 0; i < n; ++i)
+      s[1][offset + i] = save_sample_c(d[offset + i], &clips[1]);
+    if (memcmp(s[0], s[1], sizeof(s[0])))
+      fail("save_samples", "sse2", "samples differ from the reference", n, offset);
+    if (clips[0] != clips[1])
+      fail("save_samples", "sse2", "clip count differs from the reference", n, offset);
+
+    memset(dl, 0x5a, sizeof(dl));
+    fill_samples(s[0] + offset, n);
+    lsx_load_samples(dl + offset, s[0] + offset, n);
+    for (i = 0; i < sizeof(dl) / sizeof(dl[0]); ++i) {
+      sox_bool in = i >= offset && i < offset + n;
+      double x;
+      memset(&x, 0x5a, sizeof(x));
+      if (memcmp(&dl[i], in? &(double){s[0][i]} : &x, sizeof(x)))
+        fail("load_samples", "sse2", "values differ from the reference", n, offset);
+    }
+  }
+
+  if (verbose) {
+    static double b[BENCH_N];
+    static sox_sample_t o[BENCH_N];
+    sox_uint64_t clips = 0;
+    for (i = 0; i < BENCH_N; ++i)
+      b[i] = (double)(int32_t)rnd() * .999;
+    TIME("save_samples", "sse2", lsx_save_samples(o, b, BENCH_N, &clips), BENCH_N);
+    TIME("save_samples", "c", for (i = 0; i < BENCH_N; ++i) o[i] = save_sample_c(b[i], &clips), BENCH_N);
+    TIME("load_samples", "sse2", lsx_load_samples(b, o, BENCH_N), BENCH_N);
+  }
+}
+#endif
+
+/*----------------------------- Rate filters ------------------------------*/
+
+typedef struct {
+  char const     * isa;
+  unsigned       cpu;
+  rate_dot_fn_t  dot;
+  rate_dots_fn_t dot2, dot4;
+} dot_kernel_t;
+
+static dot_kernel_t const dot_kernels[] = {
+#if defined HAVE_RATE_DOT_SSE2
+  {"sse2", LSX_CPU_SSE2, rate_dot_sse2, rate_dot2_sse2, rate_dot4_sse2},
+#endif
+#if defined HAVE_RATE_DOT_AVX
+  {"avx" , LSX_CPU_AVX , rate_dot_avx , rate_dot2_avx , rate_dot4_avx },
+#endif
+#if defined HAVE_RATE_DOT_NEON
+  {"neon", 0           , rate_dot_neon, rate_dot2_neon, rate_dot4_neon},
+#endif
+  {NULL, 0, NULL, NULL, NULL}
+};
+
+static double rnd_double(void)
+{
+  return (double)(int32_t)rnd() / (1u << 31) * ldexp(1., (int)(rnd() % 16) - 8);
+}
+
+static void test_dot(dot_kernel_t const * k)
+{
+  double a[64 + 1], b[4][64 + 1], r[2][4];
+  int n, offset, i, j;
+
+  for (n = 4; n <= 64; n += 4) for (offset = 0; offset < 2; ++offset) {
+    sample_t const * bs[4];
+    for (i = 0; i < n; ++i) {
+      a[offset + i] = rnd_double();
+      for (j = 0; j < 4; ++j)
+        b[j][offset + i] = rnd() % 16? rnd_double() : 0.;
+    }
+    for (j = 0; j < 4; ++j)
+      bs[j] = b[j] + offset;
+    r[0][0] = k->dot(a + offset, bs[0], n);
+    r[1][0] = rate_dot_c(a + offset, bs[0], n);
+    if (memcmp(r[0], r[1], sizeof(r[0][0])))
+      fail("rate_dot", k->isa, "sum differs from the portable version's", (size_t)n, (size_t)offset);
+    k->dot2(a + offset, bs, n, r[0]);
+    rate_dot2_c(a + offset, bs, n, r[1]);
+    if (memcmp(r[0], r[1], 2 * sizeof(r[0][0])))
+      fail("rate_dot2", k->isa, "sums differ from the portable version's", (size_t)n, (size_t)offset);
+    k->dot4(a + offset, bs, n, r[0]);
+    rate_dot4_c(a + offset, bs, n, r[1]);
+    if (memcmp(r[0], r[1], sizeof(r[0])))
+      fail("rate_dot4", k->isa, "sums differ from the portable version's", (size_t)n, (size_t)offset);
+  }
+
+  if (verbose) {
+    sample_t const * bs[4];
+    volatile double sink;
+    for (j = 0; j < 4; ++j)
+      bs[j] = b[j];
+    TIME("rate_dot(64)", k->isa, sink = k->dot(a, b[0], 64), 64);
+    TIME("rate_dot(64)", "c", sink = rate_dot_c(a, b[0], 64), 64);
+    TIME("rate_dot4(64)", k->isa, k->dot4(a, bs, 64, r[0]), 256);
+    TIME("rate_dot4(64)", "c", rate_dot4_c(a, bs, 64, r[0]), 256);
+    (void)sink;
+  }
+}
+
+/* rate_dots, with the versions that rate_dot_init picks for this CPU, for
+ * each number of lanes up to 7 (so each mix of 4, 2 and 1 at a time) */
+static void test_dots(void)
+{
+  double a[64], b[7][64], r[2][7];
+  sample_t const * bs[7];
+  int n, lanes, i, j;
+
+  rate_dot_init(cpu);
+  for (n = 4; n <= 64; n += 4) for (lanes = 1; lanes <= 7; ++lanes) {
+    for (i = 0; i < n; ++i) {
+      a[i] = rnd_double();
+      for (j = 0; j < lanes; ++j)
+        b[j][i] = rnd_double();
+    }
+    for (j = 0; j < lanes; ++j)
+      bs[j] = b[j], r[1][j] = rate_dot_c(a, b[j], n);
+    rate_dots(a, bs, n, lanes, r[0]);
+    if (memcmp(r[0], r[1], (size_t)lanes * sizeof(r[0][0])))
+      fail("rate_dots", "auto", "sums differ from the portable version's", (size_t)n, (size_t)0);
+  }
+}
+
+/*--------------------------------- FFT -----------------------------------*/
+
+/* Runs lsx_safe_rdft(_f) and lsx_safe_cdft(_f), forwards and backwards,
+ * with the vector kernels and without; the results must be identical */
+static void test_fft_vec(double const * x, int n)
+{
+  static double d[2][4096];
+  static float f[2][4096];
+  int type, i, v;
+
+  for (type = -1; type <= 1; type += 2) {
+    for (v = 0; v < 2; ++v) {
+      lsx_fft4g_vec = !v;
+      for (i = 0; i < n; ++i)
+        d[v][i] = x[i], f[v][i] = (float)x[i];
+      lsx_safe_rdft(n, type, d[v]);
+      lsx_safe_rdft_f(n, type, f[v]);
+    }
+    lsx_fft4g_vec = 1;
+    if (memcmp(d[0], d[1], n * sizeof(d[0][0])))
+      fail("rdft", "double", "differs from the portable version's", (size_t)n, (size_t)0);
+    if (memcmp(f[0], f[1], n * sizeof(f[0][0])))
+      fail("rdft", "float", "differs from the portable version's", (size_t)n, (size_t)0);
+    for (v = 0; v < 2; ++v) {
+      lsx_fft4g_vec = !v;
+      for (i = 0; i < n; ++i)
+        d[v][i] = x[i], f[v][i] = (float)x[i];
+      lsx_safe_cdft(n, type, d[v]);
+      lsx_safe_cdft_f(n, type, f[v]);
+    }
+    lsx_fft4g_vec = 1;
+    if (memcmp(d[0], d[1], n * sizeof(d[0][0])))
+      fail("cdft", "double", "differs from the portable version's", (size_t)n, (size_t)0);
+    if (memcmp(f[0], f[1], n * sizeof(f[0][0])))
+      fail("cdft", "float", "differs from the portable version's", (size_t)n, (size_t)0);
+  }
+}
+
+/* Checks lsx_safe_rdft(_f) against a direct DFT: with Ooura's packing,
+ * a[2k] = Σ x[j]cos(2πjk/n), a[2k+1] = Σ x[j]sin(2πjk/n), a[1] = a[n] */
+static void test_fft(void)
+{
+  static double x[4096], d[1024];
+  static float f[1024];
+  int n, i, j, k;
+
+  for (n = 4; n <= 4096; n <<= 1) {
+    for (i = 0; i < n; ++i)
+      x[i] = rnd_double();
+    test_fft_vec(x, n);
+  }
+
+  for (n = 4; n <= 1024; n <<= 1) {
+    double sum = 0, tol, tol_f;
+    for (i = 0; i < n; ++i) {
+      x[i] = d[i] = rnd_double();
+      f[i] = (float)x[i];
+      sum += fabs(x[i]);
+    }
+    tol = 64 * DBL_EPSILON * log((double)n) / log(2.) * sum;
+    tol_f = 64 * FLT_EPSILON * log((double)n) / log(2.) * sum;
+    lsx_safe_rdft(n, 1, d);
+    lsx_safe_rdft_f(n, 1, f);
+    for (k = 0; k <= n / 2; ++k) {
+      double re = 0, im = 0;
+      for (j = 0; j < n; ++j) {
+        double w = 2 * M_PI * (double)((long)j * k % n) / n;
+        re += x[j] * cos(w);
+        im += x[j] * sin(w);
+      }
+      i = k == n / 2? 1 : 2 * k;
+      if (fabs(d[i] - re) > tol || (k && k < n / 2 && fabs(d[i + 1] - im) > tol))
+        fail("rdft", "double", "differs from the DFT", (size_t)n, (size_t)0);
+      if (fabs(f[i] - re) > tol_f || (k && k < n / 2 && fabs(f[i + 1] - im) > tol_f))
+        fail("rdft", "float", "differs from the DFT", (size_t)n, (size_t)0);
+    }
+  }
+
+  if (verbose) {
+    for (i = 0; i < 1024; ++i)
+      d[i] = rnd_double(), f[i] = (float)d[i];
+    TIME("rdft(1024)", "vec", lsx_safe_rdft(1024, 1, d), 1024);
+    TIME("rdft_f(1024)", "vec", lsx_safe_rdft_f(1024, 1, f), 1024);
+    lsx_fft4g_vec = 0;
+    TIME("rdft(1024)", "c", lsx_safe_rdft(1024, 1, d), 1024);
+    TIME("rdft_f(1024)", "c", lsx_safe_rdft_f(1024, 1, f), 1024);
+    lsx_fft4g_vec = 1;
+  }
+}
+
+/*------------------------- Second-order sections -------------------------*/
+
+#define SOS_CHANS    5
+#define SOS_SECTIONS 3
+
+/* lsx_sos_filter, one sample of one channel at a time, as the biquad effect
+ * does it */
+static void sos_c(double const * k, size_t num_sections, double * state,
+    size_t chans, sox_sample_t const * in, sox_sample_t * out, size_t len,
+    sox_uint64_t * clips)
+{
+  size_t i, s, c;
+
+  for (i = 0; i < len; ++i) for (c = 0; c < chans; ++c) {
+    double x = in[i * chans + c];
+    for (s = 0; s < num_sections; ++s) {
+      double * st = state + 4 * s * chans + c, o0;
+      o0 = x * k[5 * s] + st[0] * k[5 * s + 1] + st[chans] * k[5 * s + 2] -
+        st[2 * chans] * k[5 * s + 3] - st[3 * chans] * k[5 * s + 4];
+      st[chans] = st[0], st[0] = x;
+      st[3 * chans] = st[2 * chans], st[2 * chans] = o0;
+      x = (sox_sample_t)SOX_ROUND_CLIP_COUNT(o0, *clips);
+    }
+    out[i * chans + c] = (sox_sample_t)x;
+  }
+}
+
+/* Runs random stable sections, with gain enough to clip, over noise with
+ * full-scale edges, in two calls (so carrying the state across) */
+static void test_sos(void)
+{
+  double k[5 * SOS_SECTIONS], state[2][4 * SOS_SECTIONS * SOS_CHANS];
+  sox_sample_t in[MAX_N * SOS_CHANS], out[2][MAX_N * SOS_CHANS];
+  size_t n, chans, sections, i;
+
+  for (n = 0; n <= MAX_N; ++n)
+  for (chans = 1; chans <= SOS_CHANS; ++chans)
+  for (sections = 1; sections <= SOS_SECTIONS; ++sections) {
+    sox_uint64_t clips[2] = {0, 0};
+    size_t half = n / 2 * chans;
+
+    for (i = 0; i < sections; ++i) {
+      double a2 = rnd() / 4294967296. * .98;
+      double a1 = (rnd() / 4294967296. * 2 - 1) * (1 + a2);
+      k[5 * i] = rnd() / 4294967296. * 4 - 2;
+      k[5 * i + 1] = rnd() / 4294967296. * 4 - 2;
+      k[5 * i + 2] = rnd() / 4294967296. * 4 - 2;
+      k[5 * i + 3] = a1, k[5 * i + 4] = a2;
+    }
+    for (i = 0; i < n * chans; ++i)
+      in[i] = rnd() % 4? (sox_sample_t)rnd() : rnd() & 1? SOX_SAMPLE_MAX : SOX_SAMPLE_MIN;
+    memset(state, 0, sizeof(state));
+    memset(out, 0x5a, sizeof(out));
+    lsx_sos_filter(k, sections, state[0], chans, in, out[0], n / 2, &clips[0]);
+    lsx_sos_filter(k, sections, state[0], chans, in + half, out[0] + half,
+        n - n / 2, &clips[0]);
+    sos_c(k, sections, state[1], chans, in, out[1], n, &clips[1]);
+    if (memcmp(out[0], out[1], sizeof(out[0])))
+      fail("sos_filter", "lanes", "samples differ from the reference", n, chans);
+    if (memcmp(state[0], state[1], sizeof(state[0])))
+      fail("sos_filter", "lanes", "state differs from the reference", n, chans);
+    if (clips[0] != clips[1])
+      fail("sos_filter", "lanes", "clip count differs from the reference", n, chans);
+  }
+
+  if (verbose) {
+    static sox_sample_t b[BENCH_N], o[BENCH_N];
+    sox_uint64_t clips = 0;
+    for (i = 0; i < BENCH_N; ++i)
+      b[i] = (sox_sample_t)rnd() >> 2;
+    for (i = 0; i < 5; ++i)
+      k[i] = i < 3? .3 : -.2;
+    memset(state, 0, sizeof(state));
+    TIME("sos_filter", "lanes", lsx_sos_filter(k, (size_t)1, state[0], (size_t)2, b, o, BENCH_N / 2, &clips), BENCH_N);
+    TIME("sos_filter", "c", sos_c(k, (size_t)1, state[1], (size_t)2, b, o, BENCH_N / 2, &clips), BENCH_N);
+  }
+}
+
+/*------------------------------ Fast maths --------------------------------*/
+
+/* Checks the --fast-math approximations against libm (which their exact
+ * versions are), over their documented ranges, to their documented error */
+static void test_fast_math(void)
+{
+  static double x[BENCH_N], y[BENCH_N];
+  size_t n, i;
+
+  for (n = 1; n <= BENCH_N; n = n < MAX_N? n + 1 : n * 2) {
+    for (i = 0; i < n; ++i)
+      x[i] = y[i] = (double)(int32_t)rnd() / (1u << 31) * 708;
+    lsx_exp_n(x, n, sox_false);
+    lsx_exp_n(y, n, sox_true);
+    for (i = 0; i < n; ++i) if (fabs(y[i] - x[i]) > 3e-10 * x[i])
+      fail("exp_n", "fast", "differs from exp", n, i);
+
+    for (i = 0; i < n; ++i)
+      x[i] = y[i] = ldexp(1. + rnd() / 4294967296., (int)(rnd() % 2000) - 1000);
+    lsx_log10_n(x, n, sox_false);
+    lsx_log10_n(y, n, sox_true);
+    for (i = 0; i < n; ++i) if (fabs(y[i] - x[i]) > 1e-11)
+      fail("log10_n", "fast", "differs from log10", n, i);
+
+    for (i = 0; i < n; ++i)
+      x[i] = y[i] = (double)(int32_t)rnd() / (1u << 31) * (1 << 20);
+    lsx_sin_n(x, n, sox_false);
+    lsx_sin_n(y, n, sox_true);
+    for (i = 0; i < n; ++i) if (fabs(y[i] - x[i]) > 1e-11)
+      fail("sin_n", "fast", "differs from sin", n, i);
+    for (i = 0; i < n; ++i)
+      x[i] = y[i] = (double)(int32_t)rnd() / (1u << 31) * 10;
+    lsx_cos_n(x, n, sox_false);
+    lsx_cos_n(y, n, sox_true);
+    for (i = 0; i < n; ++i) if (fabs(y[i] - x[i]) > 1e-11)
+      fail("cos_n", "fast", "differs from cos", n, i);
+  }
+
+  if (verbose) {
+    for (i = 0; i < BENCH_N; ++i)
+      x[i] = (double)(int32_t)rnd() / (1u << 31);
+    TIME("exp_n", "libm", (memcpy(y, x, sizeof(y)), lsx_exp_n(y, BENCH_N, sox_false)), BENCH_N);
+    TIME("exp_n", "fast", (memcpy(y, x, sizeof(y)), lsx_exp_n(y, BENCH_N, sox_true)), BENCH_N);
+    TIME("sin_n", "libm", (memcpy(y, x, sizeof(y)), lsx_sin_n(y, BENCH_N, sox_false)), BENCH_N);
+    TIME("sin_n", "fast", (memcpy(y, x, sizeof(y)), lsx_sin_n(y, BENCH_N, sox_true)), BENCH_N);
+    for (i = 0; i < BENCH_N; ++i)
+      x[i] = fabs(x[i]) + 1e-9;
+    TIME("log10_n", "libm", (memcpy(y, x, sizeof(y)), lsx_log10_n(y, BENCH_N, sox_false)), BENCH_N);
+    TIME("log10_n", "fast", (memcpy(y, x, sizeof(y)), lsx_log10_n(y, BENCH_N, sox_true)), BENCH_N);
+  }
+}
+
+int main(int argc, char * * argv)
+{
+  size_t i;
+
+  verbose = argc > 1 && !strcmp(argv[1], "-v");
+  test_macros();
+  if (sox_init() != SOX_SUCCESS)
+    return 1;
+  cpu = lsx_cpu_features();
+  for (i = 0; raw_kernels[i].name; ++i)
+    if (cpu & raw_kernels[i].cpu)
+      test_raw(&raw_kernels[i]);
+  test_raw_dispatch();
+  test_law();
+#if defined HAVE_SAVE_SAMPLES_SSE2
+  test_save_load();
+#endif
+  for (i = 0; dot_kernels[i].isa; ++i)
+    if (!dot_kernels[i].cpu || (cpu & dot_kernels[i].cpu))
+      test_dot(&dot_kernels[i]);
+  test_dots();
+  test_fft();
+  test_sos();
+  test_fast_math();
+  sox_quit();
+  return 0;
+}
@@ -145,7 +145,8 @@
   #pragma warning(push, 1)
 #endif
 
-int main()
+/* The scalar conversion macros */
+static int test_macros(void)
 {
   sox_int8_t int8;
   sox_int16_t int16;
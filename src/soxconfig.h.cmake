@@ -7,11 +7,18 @@
 #cmakedefine HAVE_AMRWB               1
 #cmakedefine HAVE_AO                  1
 #cmakedefine HAVE_BYTESWAP_H          1
+#cmakedefine HAVE_CLOCK_GETTIME       1
 #cmakedefine HAVE_COREAUDIO           1
+#cmakedefine HAVE_DIRENT_H            1
+#cmakedefine HAVE_FALLOCATE           1
 #cmakedefine HAVE_FENV_H              1
 #cmakedefine HAVE_FLAC                1
 #cmakedefine HAVE_FMEMOPEN            1
+#cmakedefine HAVE_FOPENCOOKIE         1
+#cmakedefine HAVE_FORK                1
+#cmakedefine HAVE_FSYNC               1
 #cmakedefine HAVE_FSEEKO              1
+#cmakedefine HAVE_GETADDRINFO         1
 #cmakedefine HAVE_GETTIMEOFDAY        1
 #cmakedefine HAVE_GLOB_H              1
 #define HAVE_GSM                      1
@@ -21,18 +28,27 @@
 #cmakedefine HAVE_LAME_LAME_H         1
 #cmakedefine HAVE_LAME_SET_VBR_QUALITY 1
 #define HAVE_LPC10                    1
+#cmakedefine HAVE_LINUX_IO_URING_H    1
 #cmakedefine HAVE_LRINT               1
+#cmakedefine HAVE_MALLOC_USABLE_SIZE  1
 #cmakedefine HAVE_LTDL_H              1
 #cmakedefine HAVE_MACHINE_SOUNDCARD_H 1
 #cmakedefine HAVE_MAD_H               1
 #cmakedefine HAVE_MAGIC               1
+#cmakedefine HAVE_MEMFD_CREATE        1
 #cmakedefine HAVE_MKSTEMP             1
+#cmakedefine HAVE_MMAP                1
 #cmakedefine HAVE_MP3                 1
+#cmakedefine HAVE_NETDB_H             1
 #cmakedefine HAVE_OGG_VORBIS          1
 #cmakedefine HAVE_OSS                 1
 #cmakedefine HAVE_PNG                 1
 #cmakedefine HAVE_POPEN               1
+#cmakedefine HAVE_PREAD               1
 #cmakedefine HAVE_PULSEAUDIO          1
+#cmakedefine HAVE_RECVMMSG            1
+#cmakedefine HAVE_SCHED_SETAFFINITY   1
+#cmakedefine HAVE_SENDMMSG            1
 #cmakedefine HAVE_SNDFILE             1
 #cmakedefine HAVE_SNDFILE_1_0_18      1
 #cmakedefine HAVE_SNDIO               1
@@ -42,17 +58,26 @@
 #cmakedefine HAVE_STRING_H            1
 #cmakedefine HAVE_STRINGS_H           1
 #cmakedefine HAVE_STRRSTR             1
+#cmakedefine HAVE_STRUCT_STAT_ST_MTIM  1
+#cmakedefine HAVE_STRUCT_STAT_ST_MTIMESPEC 1
 #cmakedefine HAVE_SUN_AUDIO           1
 #cmakedefine HAVE_SUN_AUDIOIO_H       1
 #cmakedefine HAVE_SYS_AUDIOIO_H       1
+#cmakedefine HAVE_SYS_MMAN_H          1
+#cmakedefine HAVE_SYS_SDT_H           1
+#cmakedefine HAVE_SYS_SOCKET_H        1
 #cmakedefine HAVE_SYS_SOUNDCARD_H     1
 #cmakedefine HAVE_SYS_STAT_H          1
 #cmakedefine HAVE_SYS_TIMEB_H         1
 #cmakedefine HAVE_SYS_TIME_H          1
 #cmakedefine HAVE_SYS_TYPES_H         1
+#cmakedefine HAVE_SYS_UN_H            1
 #cmakedefine HAVE_SYS_UTSNAME_H       1
+#cmakedefine HAVE_SYS_WAIT_H          1
 #cmakedefine HAVE_TERMIOS_H           1
 #cmakedefine HAVE_UNISTD_H            1
 #cmakedefine HAVE_VSNPRINTF           1
 #cmakedefine HAVE_WAVPACK             1
 #cmakedefine WORDS_BIGENDIAN          1
+
+#define LSX_MAX_VERBOSITY ${MAX_VERBOSITY}
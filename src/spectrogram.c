@@ -40,6 +40,7 @@
 #define is_p2(x) !(x & (x - 1))
 
 #define MAX_X_SIZE 200000
+#define FAST_BATCH 64     /* DFTs computed at once with -f */
 
 typedef enum {Window_Hann, Window_Hamming, Window_Bartlett, Window_Rectangular, Window_Kaiser, Window_Dolph} win_type_t;
 static lsx_enum_item const window_options[] = {
@@ -51,29 +52,60 @@ static lsx_enum_item const window_options[] = {
   LSX_ENUM_ITEM(Window_,Dolph)
   {0, 0}};
 
+/* With other than png, the values are written, a column at a time, as 32-bit
+ * little-endian floats: raw, or as .npy (shape: columns, rows) */
+typedef enum {Format_png, Format_float, Format_npy} format_t;
+static lsx_enum_item const format_options[] = {
+  LSX_ENUM_ITEM(Format_,png)
+  LSX_ENUM_ITEM(Format_,float)
+  LSX_ENUM_ITEM(Format_,npy)
+  {0, 0}};
+
+#define NPY_HEADER_LEN 128 /* Fixed, so the shape can be filled in at the end */
+
+/* Mixed-radix complex FFT (radices 4, 2, then odd factors), as in KISS FFT;
+ * it gives the real DFT of twice its length where dft_size is not 2^n. */
+typedef struct {double r, i;} cplx_t;
+
+typedef struct {
+  int        n, max_radix;     /* Complex length (dft_size / 2) */
+  int        factors[64];      /* Radix & remaining length, for each stage */
+  cplx_t     * twiddles;       /* exp(-2 pi i k / n), k < n */
+  cplx_t     * split;          /* exp(-pi i k / n), k <= n */
+} mr_fft_t;
+
 typedef struct {
   /* Parameters */
   double     pixels_per_sec, window_adjust;
   int        x_size0, y_size, Y_size, dB_range, gain, spectrum_points, perm;
   sox_bool   monochrome, light_background, high_colour, slack_overlap, no_axes;
-  sox_bool   raw, alt_palette, truncate;
+  sox_bool   raw, alt_palette, truncate, fast, linear;
   win_type_t win_type;
+  format_t   format;
+  int        mel_bands, chunk_cols;
   char const * out_name, * title, * comment;
   char const *duration_str, *start_time_str;
   sox_bool   using_stdout; /* output image to stdout */
 
   /* Shared work area */
-  double     * shared, * * shared_ptr;
+  mr_fft_t   * shared, * * shared_ptr;
 
   /* Per-channel work area */
   int        WORK;  /* Start of work area is marked by this dummy variable. */
   uint64_t   skip;
   int        dft_size, step_size, block_steps, block_num, rows, cols, read;
-  int        x_size, end, end_min, last_end;
+  int        x_size, end, end_min, last_end, batch, batched, cols_max;
   sox_bool   truncated;
-  double     buf[MAX_FFT_SIZE], dft_buf[MAX_FFT_SIZE], window[MAX_FFT_SIZE+1];
-  double     block_norm, max, magnitudes[(MAX_FFT_SIZE>>1) + 1];
-  float      * dBfs;
+  double     * buf, * window, * magnitudes;
+  double     * dfts;        /* batch windowed steps, each DFT'd to its power */
+  float      * dfts_f;      /* With -f and a power-of-2 size, as transformed */
+  double     block_norm, max;
+  png_byte   * colours;     /* Palette index of each pixel, column by column */
+  FILE       * file;        /* Of the chunk being written, with -F float/npy */
+  int        chunk, chunk_done;
+  uint32_t   * values;      /* A column, as the floats' bits to be written */
+  int        * mel_at;      /* For each bin, the mel band edge below it, */
+  double     * mel_w, * mel;/* how near it is to the next, & each band's sum */
 } priv_t;
 
 #define secs(cols) \
@@ -107,7 +139,7 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   char const * next;
   int c;
   lsx_getopt_t optstate;
-  lsx_getopt_init(argc, argv, "+S:d:x:X:y:Y:z:Z:q:p:W:w:st:c:AarmlhTo:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  lsx_getopt_init(argc, argv, "+S:d:x:X:y:Y:z:Z:q:p:W:w:st:c:AarmlhTfo:F:LM:k:", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   p->dB_range = 120, p->spectrum_points = 249, p->perm = 1; /* Non-0 defaults */
   p->out_name = "spectrogram.png", p->comment = "Created by SoX";
@@ -122,6 +154,10 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
     GETOPT_NUMERIC(optstate, 'q', spectrum_points, 0 , p->spectrum_points)
     GETOPT_NUMERIC(optstate, 'p', perm          ,  1 , 6)
     GETOPT_NUMERIC(optstate, 'W', window_adjust , -10, 10)
+    GETOPT_NUMERIC(optstate, 'M', mel_bands     ,  1 , 1024)
+    GETOPT_NUMERIC(optstate, 'k', chunk_cols    ,  1 , INT_MAX)
+    case 'F': p->format = lsx_enum_option(c, optstate.arg, format_options);     break;
+    case 'L': p->linear           = sox_true;   break;
     case 'w': p->win_type = lsx_enum_option(c, optstate.arg, window_options);   break;
     case 's': p->slack_overlap    = sox_true;   break;
     case 'A': p->alt_palette      = sox_true;   break;
@@ -131,6 +167,7 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
     case 'l': p->light_background = sox_true;   break;
     case 'h': p->high_colour      = sox_true;   break;
     case 'T': p->truncate         = sox_true;   break;
+    case 'f': p->fast             = sox_true;   break;
     case 't': p->title            = optstate.arg; break;
     case 'c': p->comment          = optstate.arg; break;
     case 'o': p->out_name         = optstate.arg; break;
@@ -150,6 +187,19 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
     lsx_fail("only one of -y, -Y may be given");
     return SOX_EOF;
   }
+  if (p->format == INT_MAX)
+    return lsx_usage(effp);
+  if (p->format == Format_png && (p->linear || p->mel_bands || p->chunk_cols)) {
+    lsx_fail("-L, -M and -k apply only with -F float or -F npy");
+    return SOX_EOF;
+  }
+  if (p->format != Format_png && !strcmp(p->out_name, "spectrogram.png"))
+    p->out_name = p->format == Format_npy? "spectrogram.npy" : "spectrogram.f32";
+  if (p->format != Format_png && !strcmp(p->out_name, "-") &&
+      (p->format == Format_npy || p->chunk_cols)) {
+    lsx_fail("-F npy and -k cannot write to stdout");
+    return SOX_EOF;
+  }
   p->gain = -p->gain;
   --p->perm;
   p->spectrum_points += 2;
@@ -172,7 +222,7 @@ static double make_window(priv_t * p, int end)
   double sum = 0, * w = end < 0? p->window : p->window + end;
   int i, n = 1 + p->dft_size - abs(end);
 
-  if (end) memset(p->window, 0, sizeof(p->window));
+  if (end) memset(p->window, 0, (p->dft_size + 1) * sizeof(*p->window));
   for (i = 0; i < n; ++i) w[i] = 1;
   switch (p->win_type) {
     case Window_Hann: lsx_apply_hann(w, n); break;
@@ -190,27 +240,135 @@ static double make_window(priv_t * p, int end)
   return sum;
 }
 
-static double * rdft_init(int n)
+static mr_fft_t * mr_init(int n)
+{
+  mr_fft_t * f = lsx_calloc(1, sizeof(*f));
+  int i, p = 4, m = n, * factor = f->factors;
+
+  f->n = n;
+  f->twiddles = lsx_malloc(n * sizeof(*f->twiddles));
+  f->split = lsx_malloc((n + 1) * sizeof(*f->split));
+  for (i = 0; i < n; ++i)
+    f->twiddles[i].r = cos(2 * M_PI * i / n), f->twiddles[i].i = -sin(2 * M_PI * i / n);
+  for (i = 0; i <= n; ++i)
+    f->split[i].r = cos(M_PI * i / n), f->split[i].i = -sin(M_PI * i / n);
+  do {
+    while (m % p) {
+      p = p == 4? 2 : p == 2? 3 : p + 2;
+      if (p * p > m)
+        p = m;
+    }
+    *factor++ = p, *factor++ = m /= p;
+    f->max_radix = max(f->max_radix, p);
+  } while (m > 1);
+  return f;
+}
+
+static void mr_delete(mr_fft_t * f)
+{
+  if (f) {
+    free(f->twiddles);
+    free(f->split);
+    free(f);
+  }
+}
+
+#define cmul(a,b) c.r = a.r * b.r - a.i * b.i, c.i = a.r * b.i + a.i * b.r
+
+static void mr_work(mr_fft_t const * f, cplx_t * out, cplx_t const * in,
+    int stride, int const * factor, cplx_t * scratch)
+{
+  int p = factor[0], m = factor[1], u, k, q, t;
+  cplx_t const * tw = f->twiddles;
+  cplx_t * o, c, s0, s1, s2, s3, s4, s5;
+
+  if (m == 1) for (o = out; o < out + p; ++o, in += stride)
+    *o = *in;
+  else for (o = out; o < out + p * m; o += m, in += stride)
+    mr_work(f, o, in, stride * p, factor + 2, scratch);
+
+  if (p == 2) for (u = 0; u < m; ++u) {
+    cmul(out[u + m], tw[u * stride]);
+    out[u + m].r = out[u].r - c.r, out[u + m].i = out[u].i - c.i;
+    out[u].r += c.r, out[u].i += c.i;
+  }
+  else if (p == 4) for (u = 0; u < m; ++u) {
+    cmul(out[u + m], tw[u * stride]), s0 = c;
+    cmul(out[u + 2 * m], tw[2 * u * stride]), s1 = c;
+    cmul(out[u + 3 * m], tw[3 * u * stride]), s2 = c;
+    s5.r = out[u].r - s1.r, s5.i = out[u].i - s1.i;
+    out[u].r += s1.r, out[u].i += s1.i;
+    s3.r = s0.r + s2.r, s3.i = s0.i + s2.i;
+    s4.r = s0.r - s2.r, s4.i = s0.i - s2.i;
+    out[u + 2 * m].r = out[u].r - s3.r, out[u + 2 * m].i = out[u].i - s3.i;
+    out[u].r += s3.r, out[u].i += s3.i;
+    out[u + m].r = s5.r + s4.i, out[u + m].i = s5.i - s4.r;
+    out[u + 3 * m].r = s5.r - s4.i, out[u + 3 * m].i = s5.i + s4.r;
+  }
+  else for (u = 0; u < m; ++u) {       /* Any radix: O(p^2) */
+    for (q = 0, k = u; q < p; ++q, k += m)
+      scratch[q] = out[k];
+    for (k = u; k < p * m; k += m) {
+      out[k] = scratch[0];
+      for (q = 1, t = 0; q < p; ++q) {
+        if ((t += stride * k) >= f->n)
+          t -= f->n;
+        cmul(scratch[q], tw[t]);
+        out[k].r += c.r, out[k].i += c.i;
+      }
+    }
+  }
+}
+
+/* Power spectrum (n + 1 bins) of the real DFT of x[2n], which may be out;
+ * work has room for n + max_radix complex numbers. */
+static void mr_power(mr_fft_t const * f, double const * x, double * out,
+    cplx_t * work)
 {
-  double * q = lsx_malloc(2 * (n / 2 + 1) * n * sizeof(*q)), * p = q;
-  int i, j;
-  for (j = 0; j <= n / 2; ++j) for (i = 0; i < n; ++i)
-    *p++ = cos(2 * M_PI * j * i / n), *p++ = sin(2 * M_PI * j * i / n);
-  return q;
+  int k, n = f->n;
+  cplx_t * z = work;
+
+  mr_work(f, z, (cplx_t const *)x, 1, f->factors, work + n);
+  for (k = 0; k <= n; ++k) {  /* Split z into the DFTs of the even & odd x */
+    cplx_t a = z[k % n], b = z[(n - k) % n], e, o, c;
+    e.r = .5 * (a.r + b.r), e.i = .5 * (a.i - b.i);
+    o.r = .5 * (a.i + b.i), o.i = -.5 * (a.r - b.r);
+    cmul(o, f->split[k]);
+    out[k] = sqr(e.r + c.r) + sqr(e.i + c.i);
+  }
 }
 
-#define _ re += in[i] * *q++, im += in[i++] * *q++,
-static void rdft_p(double const * q, double const * in, double * out, int n)
+/* Edges equally spaced on the mel scale, 0 Hz to Nyquist, of triangular
+ * bands: each bin falls partly to the band whose centre is the edge below
+ * it, and partly to the next, as in HTK. */
+static void init_mel(sox_effect_t * effp)
 {
-  int i, j;
-  for (j = 0; j <= n / 2; ++j) {
-    double re = 0, im = 0;
-    for (i = 0; i < (n & ~7);) _ _ _ _ _ _ _ _ 0;
-    while (i < n) _ 0;
-    *out++ += re * re + im * im;
+  priv_t * p = (priv_t *)effp->priv;
+  double top = 2595 * log10(1 + effp->in_signal.rate / 2 / 700);
+  double lo = 0, hi = top / (p->mel_bands + 1);
+  int i, j = 0;
+
+  p->mel_at = lsx_malloc(p->rows * sizeof(*p->mel_at));
+  p->mel_w = lsx_malloc(p->rows * sizeof(*p->mel_w));
+  p->mel = lsx_malloc(p->mel_bands * sizeof(*p->mel));
+  for (i = 0; i < p->rows; ++i) {
+    double m = 2595 * log10(1 + effp->in_signal.rate / 2 * i / (p->rows - 1) / 700);
+    while (m >= hi && j <= p->mel_bands)
+      lo = hi, hi = top * (++j + 1) / (p->mel_bands + 1);
+    p->mel_at[i] = j;
+    p->mel_w[i] = (m - lo) / (hi - lo);
   }
 }
 
+static void init_values(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  if (p->mel_bands)
+    init_mel(effp);
+  p->values = lsx_malloc((p->mel_bands? p->mel_bands : p->rows) * sizeof(*p->values));
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -256,21 +414,41 @@ static int start(sox_effect_t * effp)
     }
     break;
   }
+  if (p->format != Format_png) {
+    if (p->using_stdout && effp->in_signal.channels > 1) {
+      lsx_fail("-F float to stdout is for one channel only");
+      return SOX_EOF;
+    }
+    if (!p->x_size0 && !p->duration_str) /* No width to fit to */
+      p->x_size = INT_MAX;
+  }
 
   if (p->y_size) {
     p->dft_size = 2 * (p->y_size - 1);
     if (!is_p2(p->dft_size) && !effp->flow)
-      p->shared = rdft_init(p->dft_size);
+      p->shared = mr_init(p->dft_size >> 1);
   } else {
    int y = max(32, (p->Y_size? p->Y_size : 550) / effp->in_signal.channels - 2);
    for (p->dft_size = 128; p->dft_size <= y; p->dft_size <<= 1);
   }
-  if (is_p2(p->dft_size) && !effp->flow)
-    lsx_safe_rdft(p->dft_size, 1, p->dft_buf);
   lsx_debug("duration=%g x_size=%i pixels_per_sec=%g dft_size=%i", duration, p->x_size, pixels_per_sec, p->dft_size);
 
   p->end = p->dft_size;
   p->rows = (p->dft_size >> 1) + 1;
+  p->batch = p->fast? FAST_BATCH : 1;
+  p->buf = lsx_calloc(p->dft_size, sizeof(*p->buf));
+  p->window = lsx_calloc(p->dft_size + 1, sizeof(*p->window));
+  p->magnitudes = lsx_calloc(p->rows, sizeof(*p->magnitudes));
+  p->dfts = lsx_calloc(p->batch * p->dft_size, sizeof(*p->dfts));
+  if (is_p2(p->dft_size) && p->fast)
+    p->dfts_f = lsx_calloc(p->batch * p->dft_size, sizeof(*p->dfts_f));
+  if (is_p2(p->dft_size) && !effp->flow) {  /* Set up the FFT tables */
+    lsx_safe_rdft(p->dft_size, 1, p->dfts);
+    if (p->fast)
+      lsx_safe_rdft_f(p->dft_size, 1, p->dfts_f);
+  }
+  if (p->format != Format_png)
+    init_values(effp);
   actual = make_window(p, p->last_end = 0);
   lsx_debug("window_density=%g", actual / p->dft_size);
   p->step_size = (p->slack_overlap? sqrt(actual * p->dft_size) : actual) + .5;
@@ -287,23 +465,181 @@ static int start(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
+static void free_work(priv_t * p)
+{
+  free(p->buf);
+  free(p->window);
+  free(p->magnitudes);
+  free(p->dfts);
+  free(p->dfts_f);
+  free(p->colours);
+  free(p->values);
+  free(p->mel_at);
+  free(p->mel_w);
+  free(p->mel);
+}
+
+enum {Background, Text, Labels, Grid, fixed_palette};
+
+static unsigned colour(priv_t const * p, double x)
+{
+  unsigned c = x < -p->dB_range? 0 : x >= 0? p->spectrum_points - 1 :
+      1 + (1 + x / p->dB_range) * (p->spectrum_points - 2);
+  return fixed_palette + c;
+}
+
+static void npy_header(priv_t const * p, char * h)
+{
+  int n = sprintf(h + 10,
+      "{'descr': '<f4', 'fortran_order': False, 'shape': (%i, %i), }",
+      p->chunk_done, p->mel_bands? p->mel_bands : p->rows);
+  memcpy(h, "\223NUMPY\1\0", (size_t)8);
+  h[8] = (NPY_HEADER_LEN - 10) & 255, h[9] = (NPY_HEADER_LEN - 10) >> 8;
+  memset(h + 10 + n, ' ', (size_t)(NPY_HEADER_LEN - 11 - n));
+  h[NPY_HEADER_LEN - 1] = '\n';
+}
+
+/* Names are out_name with -<channel> (if more than one) and -<chunk> (with
+ * -k) put before its extension */
+static int open_chunk(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  char const * ext = strrchr(p->out_name, '.');
+  size_t base_len = ext? (size_t)(ext - p->out_name) : strlen(p->out_name);
+  char * name = lsx_malloc(strlen(p->out_name) + 40), * n = name;
+  char header[NPY_HEADER_LEN + 1];
+
+  if (p->using_stdout) {
+    SET_BINARY_MODE(stdout);
+    p->file = stdout;
+    return SOX_SUCCESS;
+  }
+  memcpy(n, p->out_name, base_len);
+  n += base_len;
+  if (effp->in_signal.channels > 1)
+    n += sprintf(n, "-%i", effp->flow + 1);
+  if (p->chunk_cols)
+    n += sprintf(n, "-%04i", p->chunk);
+  strcpy(n, ext? ext : "");
+  if (!(p->file = fopen(name, "wb")))
+    lsx_fail("failed to create `%s': %s", name, strerror(errno));
+  else if (p->format == Format_npy) {
+    npy_header(p, header);
+    if (fwrite(header, (size_t)NPY_HEADER_LEN, (size_t)1, p->file) != 1) {
+      lsx_fail("error writing `%s': %s", name, strerror(errno));
+      fclose(p->file);
+      p->file = NULL;
+    }
+  }
+  free(name);
+  return p->file? SOX_SUCCESS : SOX_EOF;
+}
+
+static int close_chunk(priv_t * p)
+{
+  char header[NPY_HEADER_LEN + 1];
+  int result = SOX_SUCCESS;
+
+  if (p->format == Format_npy) {
+    npy_header(p, header);
+    if (fseeko(p->file, (off_t)0, SEEK_SET) ||
+        fwrite(header, (size_t)NPY_HEADER_LEN, (size_t)1, p->file) != 1)
+      result = SOX_EOF;
+  }
+  if (p->file == stdout? fflush(p->file) : fclose(p->file))
+    result = SOX_EOF;
+  if (result != SOX_SUCCESS)
+    lsx_fail("error writing `%s': %s", p->out_name, strerror(errno));
+  p->file = NULL;
+  p->chunk_done = 0;
+  ++p->chunk;
+  return result;
+}
+
+/* Writes the column in magnitudes out as values, rather than colours */
+static int write_column(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  double * x = p->magnitudes;   /* Cleared after, so a work space */
+  double lowest = -p->gain - p->dB_range; /* i.e. as -Z & -z */
+  union {float f; uint32_t u;} v;
+  int i, n = p->rows;
+
+  if (p->mel_bands) {
+    memset(p->mel, 0, p->mel_bands * sizeof(*p->mel));
+    for (i = 0; i < p->rows; ++i) {
+      int j = p->mel_at[i];
+      if (j && j <= p->mel_bands)
+        p->mel[j - 1] += (1 - p->mel_w[i]) * x[i];
+      if (j < p->mel_bands)
+        p->mel[j] += p->mel_w[i] * x[i];
+    }
+    x = p->mel, n = p->mel_bands;
+  }
+  for (i = 0; i < n; ++i)
+    x[i] *= p->block_norm;      /* Power */
+  for (i = 0; p->linear && i < n; ++i) {
+    v.f = sqrt(x[i]);
+    if (MACHINE_IS_BIGENDIAN)
+      v.u = lsx_swapdw(v.u);
+    p->values[i] = v.u;
+  }
+  lsx_log10_n(x, (size_t)n, effp->global_info->global_info->fast_math);
+  for (i = 0; i < n; ++i) {
+    double dBfs = 10 * x[i];
+    if (!p->linear) {
+      v.f = max(dBfs, lowest);
+      if (MACHINE_IS_BIGENDIAN)
+        v.u = lsx_swapdw(v.u);
+      p->values[i] = v.u;
+    }
+    p->max = max(dBfs, p->max);
+  }
+  if (!p->file && open_chunk(effp) != SOX_SUCCESS)
+    return SOX_EOF;
+  if (fwrite(p->values, sizeof(*p->values), (size_t)n, p->file) != (size_t)n) {
+    lsx_fail("error writing `%s': %s", p->out_name, strerror(errno));
+    return SOX_EOF;
+  }
+  ++p->cols;
+  if (++p->chunk_done == p->chunk_cols)
+    return close_chunk(p);
+  return SOX_SUCCESS;
+}
+
 static int do_column(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
+  png_byte * column;
   int i;
 
   if (p->cols == p->x_size) {
     p->truncated = sox_true;
     if (!effp->flow)
-      lsx_report("PNG truncated at %g seconds", secs(p->cols));
+      lsx_report("%s truncated at %g seconds",
+          p->format == Format_png? "PNG" : "output", secs(p->cols));
     return p->truncate? SOX_EOF : SOX_SUCCESS;
   }
-  ++p->cols;
-  p->dBfs = lsx_realloc(p->dBfs, p->cols * p->rows * sizeof(*p->dBfs));
-    /* FIXME: allocate in larger steps (for several columns) */
+  if (p->format != Format_png) {
+    i = write_column(effp);
+    memset(p->magnitudes, 0, p->rows * sizeof(*p->magnitudes));
+    p->block_num = 0;
+    if (i != SOX_SUCCESS)
+      p->truncated = sox_true;
+    return i;
+  }
+  if (p->cols == p->cols_max) {
+    p->cols_max = min(p->x_size, max(64, p->cols_max * 2));
+    p->colours = lsx_realloc(p->colours, p->cols_max * p->rows * sizeof(*p->colours));
+  }
+  column = p->colours + p->cols++ * p->rows;
+  for (i = 0; i < p->rows; ++i)
+    p->magnitudes[i] *= p->block_norm;
+  lsx_log10_n(p->magnitudes, (size_t)p->rows,
+      effp->global_info->global_info->fast_math);
   for (i = 0; i < p->rows; ++i) {
-    double dBfs = 10 * log10(p->magnitudes[i] * p->block_norm);
-    p->dBfs[(p->cols - 1) * p->rows + i] = dBfs + p->gain;
+    double dBfs = 10 * p->magnitudes[i];
+    column[i] = colour(p, (float)(dBfs + p->gain));
     p->max = max(dBfs, p->max);
   }
   memset(p->magnitudes, 0, p->rows * sizeof(*p->magnitudes));
@@ -311,6 +647,72 @@ static int do_column(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
+/* Replaces the windowed step d with its power spectrum; work is big enough
+ * for the transform being used. */
+static void power(priv_t const * p, double * d, void * work)
+{
+  int i, n = p->dft_size;
+
+  if (!is_p2(n))
+    mr_power(*p->shared_ptr, d, d, work);
+  else {
+    double d1;
+    lsx_safe_rdft(n, 1, d);
+    d1 = d[1];
+    d[0] = sqr(d[0]);
+    for (i = 1; i < n >> 1; ++i)
+      d[i] = sqr(d[2*i]) + sqr(d[2*i+1]);
+    d[n >> 1] = sqr(d1);
+  }
+}
+
+/* Computes the batched steps (together, if the batch is big enough) and adds
+ * them, in order, into columns.  With -f, the batch is transformed in one
+ * call, so that it may go to the FFT back-end. */
+static int flush(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  sox_context_t const * context = effp->global_info->global_info;
+  size_t work_size = !is_p2(p->dft_size)?
+      ((*p->shared_ptr)->n + (*p->shared_ptr)->max_radix) * sizeof(cplx_t) : 0;
+  int i, j, n = p->batched, len = p->dft_size;
+
+  p->batched = 0;
+  if (p->dfts_f) {
+    for (i = 0; i < n * len; ++i)
+      p->dfts_f[i] = (float)p->dfts[i];
+    lsx_safe_rdft_batch_f(len, 1, (size_t)n, p->dfts_f,
+        context->use_threads? context : NULL);
+    for (j = 0; j < n; ++j) {
+      float const * f = p->dfts_f + j * len;
+      double * d = p->dfts + j * len;
+      d[0] = sqr(f[0]);
+      for (i = 1; i < len >> 1; ++i)
+        d[i] = sqr((double)f[2*i]) + sqr((double)f[2*i+1]);
+      d[len >> 1] = sqr(f[1]);
+    }
+  }
+  else {
+    size_t threads = lsx_effect_threads(effp, (size_t)n);
+    #pragma omp parallel if(threads > 1) num_threads((int)threads) private(j)
+    {
+      void * work = work_size? lsx_malloc(work_size) : NULL;
+      #pragma omp for schedule(static)
+      for (j = 0; j < n; ++j)
+        power(p, p->dfts + j * len, work);
+      free(work);
+    }
+    lsx_threads_give(context, threads);
+  }
+  for (j = 0; j < n && !p->truncated; ++j) {
+    double const * d = p->dfts + j * len;
+    for (i = 0; i < p->rows; ++i) p->magnitudes[i] += d[i];
+    if (++p->block_num == p->block_steps && do_column(effp) == SOX_EOF)
+      return SOX_EOF;
+  }
+  return SOX_SUCCESS;
+}
+
 static int flow(sox_effect_t * effp,
     const sox_sample_t * ibuf, sox_sample_t * obuf,
     size_t * isamp, size_t * osamp)
@@ -331,6 +733,8 @@ static int flow(sox_effect_t * effp,
     p->skip = 0;
   }
   while (!p->truncated) {
+    double * d;
+
     if (p->read == p->step_size) {
       memmove(p->buf, p->buf + p->step_size,
           (p->dft_size - p->step_size) * sizeof(*p->buf));
@@ -344,16 +748,12 @@ static int flow(sox_effect_t * effp,
 
     if ((p->end = max(p->end, p->end_min)) != p->last_end)
       make_window(p, p->last_end = p->end);
-    for (i = 0; i < p->dft_size; ++i) p->dft_buf[i] = p->buf[i] * p->window[i];
-    if (is_p2(p->dft_size)) {
-      lsx_safe_rdft(p->dft_size, 1, p->dft_buf);
-      p->magnitudes[0] += sqr(p->dft_buf[0]);
-      for (i = 1; i < p->dft_size >> 1; ++i)
-        p->magnitudes[i] += sqr(p->dft_buf[2*i]) + sqr(p->dft_buf[2*i+1]);
-      p->magnitudes[p->dft_size >> 1] += sqr(p->dft_buf[1]);
-    }
-    else rdft_p(*p->shared_ptr, p->dft_buf, p->magnitudes, p->dft_size);
-    if (++p->block_num == p->block_steps && do_column(effp) == SOX_EOF)
+    d = p->dfts + p->batched * p->dft_size;
+    for (i = 0; i < p->dft_size; ++i) d[i] = p->buf[i] * p->window[i];
+    /* Flush when full, or at the column that would pass x_size: */
+    if ((++p->batched == p->batch || (uint64_t)p->batched ==
+        ((uint64_t)p->x_size - p->cols + 1) * p->block_steps - p->block_num)
+        && flush(effp) == SOX_EOF)
       return SOX_EOF;
   }
   return SOX_SUCCESS;
@@ -373,7 +773,8 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf_, size_t * osamp)
       isamp += p->step_size - left_over;
     lsx_debug("cols=%i left=%i end=%i", p->cols, p->read, p->end);
     p->end = 0, p->end_min = -p->dft_size;
-    if (flow(effp, ibuf, obuf, &isamp, &isamp) == SOX_SUCCESS && p->block_num) {
+    if (flow(effp, ibuf, obuf, &isamp, &isamp) == SOX_SUCCESS &&
+        flush(effp) == SOX_SUCCESS && p->block_num) {
       p->block_norm *= (double)p->block_steps / p->block_num;
       do_column(effp);
     }
@@ -385,15 +786,6 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf_, size_t * osamp)
   return SOX_SUCCESS;
 }
 
-enum {Background, Text, Labels, Grid, fixed_palette};
-
-static unsigned colour(priv_t const * p, double x)
-{
-  unsigned c = x < -p->dB_range? 0 : x >= 0? p->spectrum_points - 1 :
-      1 + (1 + x / p->dB_range) * (p->spectrum_points - 2);
-  return fixed_palette + c;
-}
-
 static void make_palette(priv_t const * p, png_color * palette)
 {
   int i;
@@ -481,11 +873,20 @@ static unsigned char * font;
 #define font_y 12
 #define font_X (font_x + 1)
 
-#define pixel(x,y) pixels[(y) * cols + (x)]
-#define print_at(x,y,c,t) print_at_(pixels,cols,x,y,c,t,0)
-#define print_up(x,y,c,t) print_at_(pixels,cols,x,y,c,t,1)
+/* The image is drawn, and written, a band of rows at a time; drawing outside
+ * the current band goes to the sink. */
+typedef struct {
+  png_byte   * pixels, sink;
+  int        cols, y0, rows;
+} band_t;
+#define band_rows 64
+
+#define pixel(x,y) (*((unsigned)((y) - b->y0) < (unsigned)b->rows? \
+    &b->pixels[((y) - b->y0) * b->cols + (x)] : &b->sink))
+#define print_at(x,y,c,t) print_at_(b,x,y,c,t,0)
+#define print_up(x,y,c,t) print_at_(b,x,y,c,t,1)
 
-static void print_at_(png_byte * pixels, int cols, int x, int y, int c, char const * text, int orientation)
+static void print_at_(band_t * b, int x, int y, int c, char const * text, int orientation)
 {
   for (;*text; ++text) {
     int pos = ((*text < ' ' || *text > '~'? '~' + 1 : *text) - ' ') * font_y;
@@ -527,58 +928,26 @@ static int axis(double to, int max_steps, double * limit, char * * prefix)
 #define spectrum_width 14
 #define right 35
 
-static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
+static void draw(sox_effect_t * effp, band_t * b, int rows, int cols)
 {
   priv_t *    p        = (priv_t *) effp->priv;
-  FILE *      file;
-  uLong       font_len = 96 * font_y;
   int         chans    = effp->in_signal.channels;
   int         c_rows   = p->rows * chans + chans - 1;
-  int         rows     = p->raw? c_rows : below + c_rows + 30 + 20 * !!p->title;
-  int         cols     = p->raw? p->cols : left + p->cols + between + spectrum_width + right;
-  png_byte *  pixels   = lsx_malloc(cols * rows * sizeof(*pixels));
-  png_bytepp  png_rows = lsx_malloc(rows * sizeof(*png_rows));
-  png_structp png      = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0,0);
-  png_infop   png_info = png_create_info_struct(png);
-  png_color   palette[256];
   int         i, j, k, base, step, tick_len = 3 - p->no_axes;
   char        text[200], * prefix;
   double      limit;
 
-  free(p->shared);
-  if (p->using_stdout) {
-    SET_BINARY_MODE(stdout);
-    file = stdout;
-  } else {
-    file = fopen(p->out_name, "wb");
-    if (!file) {
-      lsx_fail("failed to create `%s': %s", p->out_name, strerror(errno));
-      goto error;
-    }
-  }
-  lsx_debug("signal-max=%g", p->max);
-  font = lsx_malloc(font_len);
-  assert(uncompress(font, &font_len, fixed, sizeof(fixed)-1) == Z_OK);
-  make_palette(p, palette);
-  memset(pixels, Background, cols * rows * sizeof(*pixels));
-  png_init_io(png, file);
-  png_set_PLTE(png, png_info, palette, fixed_palette + p->spectrum_points);
-  png_set_IHDR(png, png_info, (png_uint_32)cols, (png_uint_32)rows, 8,
-      PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
-      PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-  for (j = 0; j < rows; ++j)               /* Put (0,0) at bottom-left of PNG */
-    png_rows[rows - 1 - j] = (png_bytep)(pixels + j * cols);
+  memset(b->pixels, Background, b->rows * cols * sizeof(*b->pixels));
 
   /* Spectrogram */
   for (k = 0; k < chans; ++k) {
     priv_t * q = (priv_t *)(effp - effp->flow + k)->priv;
     base = !p->raw * below + (chans - 1 - k) * (p->rows + 1);
-    for (j = 0; j < p->rows; ++j) {
+    for (j = max(0, b->y0 - base); j < min(p->rows, b->y0 + b->rows - base); ++j)
       for (i = 0; i < p->cols; ++i)
-        pixel(!p->raw * left + i, base + j) = colour(p, q->dBfs[i*p->rows + j]);
-      if (!p->raw && !p->no_axes)                                 /* Y-axis lines */
-        pixel(left - 1, base + j) = pixel(left + p->cols, base + j) = Grid;
-    }
+        pixel(!p->raw * left + i, base + j) = q->colours[i*p->rows + j];
+    if (!p->raw && !p->no_axes) for (j = 0; j < p->rows; ++j)  /* Y-axis lines */
+      pixel(left - 1, base + j) = pixel(left + p->cols, base + j) = Grid;
     if (!p->raw && !p->no_axes) for (i = -1; i <= p->cols; ++i)   /* X-axis lines */
       pixel(left + i, base - 1) = pixel(left + i, base + p->rows) = Grid;
   }
@@ -631,9 +1000,9 @@ static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
     base = below + (c_rows - k) / 2;
     print_at(cols - right - 2 - font_X, base - 13, Text, "dBFS");/* Axis label */
     for (j = 0; j < k; ++j) {                            /* Spectrum */
-      png_byte b = colour(p, p->dB_range * (j / (k - 1.) - 1));
+      png_byte c = colour(p, p->dB_range * (j / (k - 1.) - 1));
       for (i = 0; i < spectrum_width; ++i)
-        pixel(cols - right - 1 - i, base + j) = b;
+        pixel(cols - right - 1 - i, base + j) = c;
     }
     step = 10 * ceil(p->dB_range / 10. * (font_y + 2) / (k - 1));
     for (i = 0; i <= p->dB_range; i += step) {           /* (Tick) labels */
@@ -642,36 +1011,92 @@ static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
       print_at(cols - right + 1, base + y + 5, Labels, text);
     }
   }
+}
+
+static int stop(sox_effect_t * effp) /* only called, by end(), on flow 0 */
+{
+  priv_t *    p        = (priv_t *) effp->priv;
+  FILE *      file;
+  uLong       font_len = 96 * font_y;
+  int         chans    = effp->in_signal.channels;
+  int         c_rows   = p->rows * chans + chans - 1;
+  int         rows     = p->raw? c_rows : below + c_rows + 30 + 20 * !!p->title;
+  int         cols     = p->raw? p->cols : left + p->cols + between + spectrum_width + right;
+  png_structp png      = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0,0);
+  png_infop   png_info = png_create_info_struct(png);
+  png_color   palette[256];
+  band_t      band, * b = &band;
+  int         j;
+
+  b->cols = cols;
+  b->pixels = lsx_malloc(min(rows, band_rows) * cols * sizeof(*b->pixels));
+  mr_delete(p->shared);
+  if (p->using_stdout) {
+    SET_BINARY_MODE(stdout);
+    file = stdout;
+  } else {
+    file = fopen(p->out_name, "wb");
+    if (!file) {
+      lsx_fail("failed to create `%s': %s", p->out_name, strerror(errno));
+      goto error;
+    }
+  }
+  lsx_debug("signal-max=%g", p->max);
+  font = lsx_malloc(font_len);
+  assert(uncompress(font, &font_len, fixed, sizeof(fixed)-1) == Z_OK);
+  make_palette(p, palette);
+  png_init_io(png, file);
+  png_set_PLTE(png, png_info, palette, fixed_palette + p->spectrum_points);
+  png_set_IHDR(png, png_info, (png_uint_32)cols, (png_uint_32)rows, 8,
+      PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+      PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_write_info(png, png_info);
+  for (b->y0 = rows; b->y0 > 0;) {       /* Put (0,0) at bottom-left of PNG */
+    b->rows = min(b->y0, band_rows);
+    b->y0 -= b->rows;
+    draw(effp, b, rows, cols);
+    for (j = b->rows - 1; j >= 0; --j)
+      png_write_row(png, b->pixels + j * cols);
+  }
+  png_write_end(png, png_info);
   free(font);
-  png_set_rows(png, png_info, png_rows);
-  png_write_png(png, png_info, PNG_TRANSFORM_IDENTITY, NULL);
   if (!p->using_stdout)
     fclose(file);
 error: png_destroy_write_struct(&png, &png_info);
-  free(png_rows);
-  free(pixels);
-  free(p->dBfs);
+  free(b->pixels);
+  free_work(p);
   return SOX_SUCCESS;
 }
 
 static int end(sox_effect_t * effp)
 {
   priv_t *p = (priv_t *)effp->priv;
+  int result = SOX_SUCCESS;
+
+  if (p->format != Format_png) {
+    lsx_debug("signal-max=%g", p->max);
+    if (p->file)
+      result = close_chunk(p);
+    if (!effp->flow)
+      mr_delete(p->shared);
+    free_work(p);
+    return result;
+  }
   if (effp->flow == 0)
     return stop(effp);
-  free(p->dBfs);
+  free_work(p);
   return SOX_SUCCESS;
 }
 
 sox_effect_handler_t const * lsx_spectrogram_effect_fn(void)
 {
   static sox_effect_handler_t handler = {"spectrogram", 0, SOX_EFF_MODIFY,
-    getopts, start, flow, drain, end, 0, sizeof(priv_t)};
+    getopts, start, flow, drain, end, 0, sizeof(priv_t), 0, 0, 0, 0};
   static char const * lines[] = {
     "[options]",
     "\t-x num\tX-axis size in pixels; default derived or 800",
     "\t-X num\tX-axis pixels/second; default derived or 100",
-    "\t-y num\tY-axis size in pixels (per channel); slow if not 1 + 2^n",
+    "\t-y num\tY-axis size in pixels (per channel); fastest if 1 + 2^n",
     "\t-Y num\tY-height total (i.e. not per channel); default 550",
     "\t-z num\tZ-axis range in dB; default 120",
     "\t-Z num\tZ-axis maximum in dBFS; default 0",
@@ -681,6 +1106,7 @@ sox_effect_handler_t const * lsx_spectrogram_effect_fn(void)
     "\t-s\tSlack overlap of windows",
     "\t-a\tSuppress axis lines",
     "\t-r\tRaw spectrogram; no axes or legends",
+    "\t-f\tFast: single-precision DFTs, batched (in parallel if multi-threaded)",
     "\t-l\tLight background",
     "\t-m\tMonochrome",
     "\t-h\tHigh colour",
@@ -689,6 +1115,10 @@ sox_effect_handler_t const * lsx_spectrogram_effect_fn(void)
     "\t-t text\tTitle text",
     "\t-c text\tComment text",
     "\t-o text\tOutput file name; default `spectrogram.png'",
+    "\t-F name\tOutput format: png(default)/float/npy; float & npy are 32-bit",
+    "\t-L\tLinear magnitudes rather than dBFS (float/npy only)",
+    "\t-M num\tThis many mel bands rather than the DFT bins (float/npy only)",
+    "\t-k num\tA new file every num columns (float/npy only)",
     "\t-d time\tAudio duration to fit to X-axis; e.g. 1:00, 48",
     "\t-S position\tStart the spectrogram at the given input position",
   };
@@ -325,7 +325,8 @@ const sox_effect_handler_t* lsx_speexdsp_effect_fn(void)
    */
   static sox_effect_handler_t descriptor = {
     "speexdsp", 0, SOX_EFF_PREC | SOX_EFF_GAIN | SOX_EFF_ALPHA,
-    getopts, start, flow, drain, stop, NULL, sizeof(priv_t)
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   static char const * lines[] = {
     "Uses the Speex DSP library to improve perceived sound quality.",
@@ -22,8 +22,339 @@
 #include "sox_i.h"
 #include <string.h>
 
+/* Shorten (T. Robinson's lossless coder, as embedded in Sphere files by
+ * NIST's w_encode and by the LDC): the stream is read through a 64-bit bit
+ * buffer, and decoded a block at a time. */
+#define SHN_TYPESIZE     4  /* Rice parameters of the header's fields */
+#define SHN_CHANSIZE     0
+#define SHN_BLOCKSIZE    8  /* log2 of the default blocksize */
+#define SHN_LPCQSIZE     2
+#define SHN_NSKIPSIZE    1
+#define SHN_FNSIZE       2  /* and of each block's */
+#define SHN_ENERGYSIZE   3
+#define SHN_BITSHIFTSIZE 2
+#define SHN_VERBATIM_CKSIZE 5
+#define SHN_VERBATIM_BYTE 8
+#define SHN_ULONGSIZE    2
+#define SHN_LPCQUANT     5
+#define SHN_NWRAP        3
+
+enum {SHN_DIFF0, SHN_DIFF1, SHN_DIFF2, SHN_DIFF3, SHN_QUIT, SHN_SETBLOCKSIZE,
+  SHN_BITSHIFT, SHN_QLPC, SHN_ZERO, SHN_VERBATIM};
+
+enum {SHN_S8 = 1, SHN_U8, SHN_S16HL, SHN_U16HL, SHN_S16LH, SHN_U16LH};
+
+typedef struct {
+  sox_bool   shorten;
+  /* Bit reader */
+  uint64_t   bits;              /* The next nbits bits, left-aligned */
+  unsigned   nbits;
+  unsigned char in[4096];       /* Read ahead of bits */
+  size_t     in_pos, in_len;
+  sox_bool   error, quit;
+  /* Decoder */
+  unsigned   version, type, channels, blocksize, max_blocksize;
+  unsigned   nwrap, nmean, bitshift, chan, sample_bits;
+  int32_t    lpcqoffset, mean;
+  int32_t    * decoded;         /* Per channel: nwrap past, then blocksize */
+  int32_t    * offset;          /* Per channel: the last max(nmean, 1) means */
+  int32_t    coefs[256];
+  sox_sample_t * out;           /* A decoded block, interleaved */
+  size_t     out_pos, out_len;
+} priv_t;
+
+static void shn_fill(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  while (p->nbits <= 56) {
+    if (p->in_pos == p->in_len) {
+      p->in_pos = 0;
+      if (!(p->in_len = lsx_readbuf(ft, p->in, sizeof(p->in))))
+        return;
+    }
+    p->bits |= (uint64_t)p->in[p->in_pos++] << (56 - p->nbits);
+    p->nbits += 8;
+  }
+}
+
+/* Takes k (<= 32) bits from the stream */
+static uint32_t shn_bits(sox_format_t * ft, unsigned k)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  uint32_t x;
+
+  if (!k)
+    return 0;
+  if (p->nbits < k && (shn_fill(ft), p->nbits < k)) {
+    p->error = sox_true;
+    return 0;
+  }
+  x = (uint32_t)(p->bits >> (64 - k));
+  p->bits <<= k;
+  p->nbits -= k;
+  return x;
+}
+
+static unsigned shn_clz(uint64_t x)
+{
+#if defined __GNUC__
+  return (unsigned)__builtin_clzll(x);
+#else
+  unsigned n = 0;
+  for (; !(x >> 63); x <<= 1)
+    ++n;
+  return n;
+#endif
+}
+
+/* A Rice code: zeros (the high part) ended by a one, then k bits */
+static uint32_t shn_uvar(sox_format_t * ft, unsigned k)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  uint32_t n = 0;
+  unsigned z;
+
+  while (!p->bits) {   /* Bits beyond nbits are zero */
+    n += p->nbits;
+    p->nbits = 0;
+    shn_fill(ft);
+    if (!p->nbits) {
+      p->error = sox_true;
+      return 0;
+    }
+  }
+  z = shn_clz(p->bits);
+  p->bits <<= z;
+  p->bits <<= 1;
+  p->nbits -= z + 1;
+  return (n + z) << k | shn_bits(ft, k);
+}
+
+static int32_t shn_svar(sox_format_t * ft, unsigned k)
+{
+  uint32_t u = shn_uvar(ft, k + 1);
+  return u & 1? ~(int32_t)(u >> 1) : (int32_t)(u >> 1);
+}
+
+/* A header field: from version 1, its Rice parameter comes first */
+static uint32_t shn_uint(sox_format_t * ft, unsigned k)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  if (p->version && (k = shn_uvar(ft, SHN_ULONGSIZE)) > 31) {
+    p->error = sox_true;
+    return 0;
+  }
+  return shn_uvar(ft, k);
+}
+
+static int shn_start(sox_format_t * ft, unsigned channels)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  unsigned maxnlpc = 0, nskip, i;
+
+  if (shn_bits(ft, 32) != 0x616a6b67 /* ajkg */ ||
+      (p->version = shn_bits(ft, 8)) > 3) {
+    lsx_fail_errno(ft, SOX_EHDR, "shorten: bad magic word or version");
+    return SOX_EOF;
+  }
+  p->type = shn_uint(ft, SHN_TYPESIZE);
+  p->channels = shn_uint(ft, SHN_CHANSIZE);
+  p->blocksize = 1 << SHN_BLOCKSIZE;
+  if (p->version) {
+    p->blocksize = shn_uint(ft, SHN_BLOCKSIZE);
+    maxnlpc = shn_uint(ft, SHN_LPCQSIZE);
+    p->nmean = shn_uint(ft, 0);
+    for (nskip = shn_uint(ft, SHN_NSKIPSIZE); nskip && !p->error; --nskip)
+      shn_bits(ft, 8);
+  }
+  if (p->error || !p->blocksize || p->blocksize > 65535 ||
+      maxnlpc > array_length(p->coefs) || p->nmean > 32768) {
+    lsx_fail_errno(ft, SOX_EHDR, "shorten: bad header");
+    return SOX_EOF;
+  }
+  if (p->channels != channels) {
+    lsx_fail_errno(ft, SOX_EHDR, "shorten: %u channels, where the Sphere header has %u", p->channels, channels);
+    return SOX_EOF;
+  }
+  if (p->type < SHN_S8 || p->type > SHN_U16LH) {
+    lsx_fail_errno(ft, SOX_EFMT, "shorten: file type %u is not supported", p->type);
+    return SOX_EOF;
+  }
+  p->sample_bits = p->type <= SHN_U8? 8 : 16;
+  p->mean = p->type == SHN_U8? 0x80 : p->type == SHN_U16HL || p->type == SHN_U16LH? 0x8000 : 0;
+  p->nwrap = max(SHN_NWRAP, maxnlpc);
+  p->lpcqoffset = p->version > 1? 1 << SHN_LPCQUANT : 0;
+  p->max_blocksize = p->blocksize;
+  p->decoded = lsx_calloc((size_t)p->channels * (p->nwrap + p->blocksize), sizeof(*p->decoded));
+  p->offset = lsx_malloc((size_t)p->channels * max(p->nmean, 1) * sizeof(*p->offset));
+  for (i = 0; i < p->channels * max(p->nmean, 1); ++i)
+    p->offset[i] = p->mean;
+  p->out = lsx_malloc((size_t)p->channels * p->blocksize * sizeof(*p->out));
+  return SOX_SUCCESS;
+}
+
+static void shn_lpc(sox_format_t * ft, unsigned cmd, int32_t * x, unsigned k, int32_t coffset)
+{
+  static int32_t const fixed[4][3] = {{0, 0, 0}, {1, 0, 0}, {2, -1, 0}, {3, -3, 1}};
+  priv_t * p = (priv_t *)ft->priv;
+  int32_t const * coefs = cmd == SHN_QLPC? p->coefs : fixed[cmd];
+  unsigned order = cmd, qshift = 0, i, j;
+  int32_t init;
+
+  if (k > 30) {
+    p->error = sox_true;
+    return;
+  }
+  if (cmd == SHN_QLPC) {
+    if ((order = shn_uvar(ft, SHN_LPCQSIZE)) > p->nwrap) {
+      p->error = sox_true;
+      return;
+    }
+    for (i = 0; i < order; ++i)
+      p->coefs[i] = shn_svar(ft, SHN_LPCQUANT);
+    qshift = SHN_LPCQUANT;
+    if (coffset) for (i = 1; i <= order; ++i)
+      x[-(int)i] = (int32_t)((uint32_t)x[-(int)i] - (uint32_t)coffset);
+  }
+  init = !order? coffset : cmd == SHN_QLPC? p->lpcqoffset : 0;
+  for (i = 0; i < p->blocksize; ++i) {
+    int32_t sum = init;
+    for (j = 0; j < order; ++j)
+      sum = (int32_t)((uint32_t)sum + (uint32_t)coefs[j] * (uint32_t)x[(int)(i - j) - 1]);
+    x[i] = (int32_t)((uint32_t)shn_svar(ft, k) + (uint32_t)(sum >> qshift));
+  }
+  if (cmd == SHN_QLPC && coffset) for (i = 0; i < p->blocksize; ++i)
+    x[i] = (int32_t)((uint32_t)x[i] + (uint32_t)coffset);
+}
+
+/* Decodes the stream until it has a block of each channel, and puts it in
+ * p->out; returns its length, or 0 at the end */
+static size_t shn_block(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  unsigned cmd, n, i, c;
+
+  while (!p->quit && !p->error) {
+    switch (cmd = shn_uvar(ft, SHN_FNSIZE)) {
+      case SHN_QUIT:
+        p->quit = sox_true;
+        break;
+      case SHN_SETBLOCKSIZE:
+        for (n = 0; p->blocksize >> (n + 1); ++n);
+        if (!(n = shn_uint(ft, n)) || n > p->max_blocksize)
+          p->error = sox_true;
+        else p->blocksize = n;
+        break;
+      case SHN_BITSHIFT:
+        if ((p->bitshift = shn_uvar(ft, SHN_BITSHIFTSIZE)) > 32)
+          p->error = sox_true;
+        break;
+      case SHN_VERBATIM:
+        for (n = shn_uvar(ft, SHN_VERBATIM_CKSIZE); n && !p->error; --n)
+          shn_uvar(ft, SHN_VERBATIM_BYTE);
+        break;
+      case SHN_DIFF0: case SHN_DIFF1: case SHN_DIFF2: case SHN_DIFF3:
+      case SHN_QLPC: case SHN_ZERO: {
+        int32_t * x = p->decoded + p->chan * (p->nwrap + p->max_blocksize) + p->nwrap;
+        int32_t * offset = p->offset + p->chan * max(p->nmean, 1);
+        int32_t coffset = offset[0];
+
+        if (p->nmean) {   /* The mean of the last nmean blocks */
+          int64_t sum = p->version < 2? 0 : p->nmean / 2;
+          for (i = 0; i < p->nmean; ++i)
+            sum += offset[i];
+          coffset = (int32_t)(sum / p->nmean);
+          if (p->version >= 2 && p->bitshift)
+            coffset = coffset >> (p->bitshift - 1) >> 1;
+        }
+        if (cmd == SHN_ZERO)
+          memset(x, 0, p->blocksize * sizeof(*x));
+        else {
+          n = shn_uvar(ft, SHN_ENERGYSIZE);
+          shn_lpc(ft, cmd, x, p->version? n : n - 1, coffset);
+        }
+        if (p->nmean) {
+          int64_t sum = p->version < 2? 0 : p->blocksize / 2;
+          for (i = 0; i < p->blocksize; ++i)
+            sum += x[i];
+          memmove(offset, offset + 1, (p->nmean - 1) * sizeof(*offset));
+          sum /= p->blocksize;
+          offset[p->nmean - 1] = p->version < 2? (int32_t)sum :
+            p->bitshift == 32? 0 : (int32_t)((uint32_t)sum << p->bitshift);
+        }
+        for (i = 1; i <= p->nwrap; ++i)   /* For the next block's prediction */
+          x[-(int)i] = x[(int)(p->blocksize - i)];
+        if (++p->chan < p->channels)
+          break;
+        p->chan = 0;
+        for (c = 0; c < p->channels; ++c) {
+          int32_t const * y = p->decoded + c * (p->nwrap + p->max_blocksize) + p->nwrap;
+          sox_sample_t * o = p->out + c;
+          int32_t lo = -(1 << (p->sample_bits - 1)), hi = -lo - 1;
+          int32_t bias = p->mean? 1 << (p->sample_bits - 1) : 0;
+
+          for (i = 0; i < p->blocksize; ++i, o += p->channels) {
+            int32_t v = p->bitshift == 32? 0 :
+              (int32_t)((uint32_t)y[i] << p->bitshift) - bias;
+            v = v < lo? lo : v > hi? hi : v;
+            *o = (sox_sample_t)((uint32_t)v << (32 - p->sample_bits));
+          }
+        }
+        p->out_pos = 0;
+        return p->out_len = (size_t)p->blocksize * p->channels;
+      }
+      default:
+        p->error = sox_true;
+    }
+  }
+  if (p->error)
+    lsx_fail_errno(ft, SOX_EFMT, "shorten: corrupt or truncated data");
+  p->quit = sox_true;
+  p->error = sox_false;
+  return 0;
+}
+
+static size_t read_samples(sox_format_t * ft, sox_sample_t * buf, size_t len)
+{
+  priv_t * p = (priv_t *)ft->priv;
+  size_t done = 0, n;
+
+  if (!p->shorten)
+    return lsx_rawread(ft, buf, len);
+  while (done < len && (p->out_pos < p->out_len || shn_block(ft))) {
+    n = min(len - done, p->out_len - p->out_pos);
+    memcpy(buf + done, p->out + p->out_pos, n * sizeof(*buf));
+    p->out_pos += n;
+    done += n;
+  }
+  return done;
+}
+
+static int seek(sox_format_t * ft, uint64_t offset)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  if (!p->shorten)
+    return lsx_rawseek(ft, offset);
+  lsx_fail_errno(ft, SOX_ENOTSUP, "can't seek in shorten-compressed data");
+  return SOX_EOF;
+}
+
+static int stop_read(sox_format_t * ft)
+{
+  priv_t * p = (priv_t *)ft->priv;
+
+  free(p->decoded);
+  free(p->offset);
+  free(p->out);
+  return SOX_SUCCESS;
+}
+
 static int start_read(sox_format_t * ft)
 {
+  priv_t * p = (priv_t *)ft->priv;
   unsigned long header_size_ul = 0, num_samples_ul = 0;
   sox_encoding_t encoding = SOX_ENCODING_SIGN2;
   size_t     header_size, bytes_read;
@@ -75,7 +406,18 @@ static int start_read(sox_format_t * ft)
     else if (strncmp(buf, "sample_rate ", (size_t)12) == 0)
       sscanf(buf, "%53s %15s %u", fldname, fldtype, &rate);
     else if (strncmp(buf, "sample_coding", (size_t)13) == 0) {
+      char * embedded;
+
       sscanf(buf, "%63s %15s %127s", fldname, fldtype, fldsval);
+      if ((embedded = strchr(fldsval, ','))) {   /* e.g. pcm,embedded-shorten-v2.00 */
+        *embedded++ = '\0';
+        if (strncmp(embedded, "embedded-shorten", (size_t)16)) {
+          lsx_fail_errno(ft, SOX_EFMT, "sph: unsupported coding `%s'", embedded);
+          free(buf);
+          return SOX_EOF;
+        }
+        p->shorten = sox_true;
+      }
       if (!strcasecmp(fldsval, "ulaw") || !strcasecmp(fldsval, "mu-law"))
         encoding = SOX_ENCODING_ULAW;
       else if (!strcasecmp(fldsval, "pcm"))
@@ -121,22 +463,26 @@ static int start_read(sox_format_t * ft)
   }
   free(buf);
 
-  if (ft->seekable) {
+  if (ft->seekable && !p->shorten) {
     /* Check first four bytes of data to see if it's shorten compressed. */
     char           shorten_check[4];
 
     if (lsx_readchars(ft, shorten_check, sizeof(shorten_check)))
       return SOX_EOF;
     lsx_seeki(ft, -(off_t)sizeof(shorten_check), SEEK_CUR);
-
-    if (!memcmp(shorten_check, "ajkg", sizeof(shorten_check))) {
-      lsx_fail_errno(ft, SOX_EFMT,
-                     "File uses shorten compression, cannot handle this.");
-      return (SOX_EOF);
-    }
+    p->shorten = !memcmp(shorten_check, "ajkg", sizeof(shorten_check));
   }
 
   num_samples = num_samples_ul;
+  if (p->shorten) {
+    int result = lsx_check_read_params(ft, channels, (sox_rate_t)rate, encoding,
+        bytes_per_sample << 3, (uint64_t)num_samples * channels, sox_false);
+    if (result != SOX_SUCCESS || shn_start(ft, channels) != SOX_SUCCESS)
+      return SOX_EOF;
+    ft->encoding.encoding = p->mean? SOX_ENCODING_UNSIGNED : SOX_ENCODING_SIGN2;
+    ft->encoding.bits_per_sample = p->sample_bits;
+    return SOX_SUCCESS;
+  }
   return lsx_check_read_params(ft, channels, (sox_rate_t)rate, encoding,
       bytes_per_sample << 3, (uint64_t)num_samples * channels, sox_true);
 }
@@ -191,9 +537,9 @@ LSX_FORMAT_HANDLER(sphere)
   };
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
     "SPeech HEader Resources; defined by NIST", names, SOX_FILE_REWIND,
-    start_read, lsx_rawread, NULL,
+    start_read, read_samples, stop_read,
     write_header, lsx_rawwrite, NULL,
-    lsx_rawseek, write_encodings, NULL, 0
+    seek, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
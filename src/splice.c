@@ -33,11 +33,26 @@ static double difference(
 static size_t best_overlap_position(sox_sample_t const * f1,
     sox_sample_t const * f2, uint64_t overlap, uint64_t search, size_t channels)
 {
-  size_t i, best_pos = 0;
-  double diff, least_diff = difference(f2, f1, (size_t) (channels * overlap));
+  size_t i, best_pos = 0, n = (size_t)(channels * overlap);
+  double diff, least_diff;
+  lsx_match_t match;
 
+  if (search > 1) {
+    lsx_match_create(&match, n, (size_t)search, channels);
+    if (search * n > (size_t)match.dft_length * 16) { /* Where DFT is faster */
+      for (i = 0; i < (search - 1) * channels + n; ++i)
+        match.x[i] = f2[i];
+      for (i = 0; i < n; ++i)
+        match.y[i] = f1[i];
+      best_pos = lsx_match(&match);
+      lsx_match_delete(&match);
+      return best_pos;
+    }
+    lsx_match_delete(&match);
+  }
+  least_diff = difference(f2, f1, n);
   for (i = 1; i < search; ++i) { /* linear search */
-    diff = difference(f2 + channels * i, f1, (size_t) (channels * overlap));
+    diff = difference(f2 + channels * i, f1, n);
     if (diff < least_diff)
       least_diff = diff, best_pos = i;
   }
@@ -296,7 +311,8 @@ sox_effect_handler_t const * lsx_splice_effect_fn(void)
     "\n  excess    At the end of part 1 & the start of part2 (default 0.005)"
     "\n  leeway    Before part2 (default 0.005; set to 0 for cross-fade)",
     SOX_EFF_MCHAN | SOX_EFF_LENGTH,
-    create, start, flow, drain, stop, lsx_kill, sizeof(priv_t)
+    create, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
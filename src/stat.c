@@ -25,7 +25,9 @@ typedef struct {
   double dsum1, dsum2;          /* deltas */
   double scale;                 /* scale-factor */
   double last;                  /* previous sample */
+  double first;                 /* first sample */
   uint64_t read;               /* samples processed */
+  uint64_t pos;                 /* wide samples seen, in or out of the span */
   int volume;
   int srms;
   int fft;
@@ -33,9 +35,11 @@ typedef struct {
   float *re_in;
   float *re_out;
   unsigned long fft_size;
-  unsigned long fft_offset;
+  unsigned long fft_offset;     /* Into the batch of blocks at re_in */
 } priv_t;
 
+#define FREQ_BATCH 16UL         /* -freq blocks transformed together */
+
 
 /*
  * Process options
@@ -95,6 +99,7 @@ static int sox_stat_start(sox_effect_t * effp)
 
   stat->last = 0;
   stat->read = 0;
+  stat->pos = 0;
 
   for (i = 0; i < 4; i++)
     stat->bin[i] = 0;
@@ -104,7 +109,7 @@ static int sox_stat_start(sox_effect_t * effp)
 
   if (stat->fft) {
     stat->fft_offset = 0;
-    stat->re_in = lsx_malloc(sizeof(float) * stat->fft_size);
+    stat->re_in = lsx_malloc(sizeof(float) * stat->fft_size * FREQ_BATCH);
     stat->re_out = lsx_malloc(sizeof(float) * (stat->fft_size / 2 + 1));
   }
 
@@ -112,16 +117,28 @@ static int sox_stat_start(sox_effect_t * effp)
 }
 
 /*
- * Print power spectrum to given stream
+ * Print power spectra of the first `blocks' blocks of re_in to stderr,
+ * transforming them together (through the float FFT back-end, if any)
  */
-static void print_power_spectrum(unsigned samples, double rate, float *re_in, float *re_out)
+static void print_power_spectra(sox_effect_t * effp, unsigned long blocks)
 {
-  float ffa = rate / samples;
-  unsigned i;
+  priv_t * stat = (priv_t *) effp->priv;
+  sox_context_t const * context = effp->global_info->global_info;
+  int n = (int)stat->fft_size;
+  float ffa = effp->in_signal.rate / n, * d = stat->re_in, * out = stat->re_out;
+  unsigned long b;
+  int i;
 
-  lsx_power_spectrum_f((int)samples, re_in, re_out);
-  for (i = 0; i < samples / 2; i++) /* FIXME: should be <= samples / 2 */
-    fprintf(stderr, "%f  %f\n", ffa * i, re_out[i]);
+  lsx_safe_rdft_batch_f(n, 1, (size_t)blocks, d,
+      context->use_threads? context : NULL);
+  for (b = 0; b < blocks; ++b, d += n) {
+    out[0] = sqr(d[0]);
+    for (i = 2; i < n; i += 2)
+      out[i >> 1] = sqr(d[i]) + sqr(d[i + 1]);
+    out[i >> 1] = sqr(d[1]);
+    for (i = 0; i < n / 2; i++) /* FIXME: should be <= n / 2 */
+      fprintf(stderr, "%f  %f\n", ffa * i, out[i]);
+  }
 }
 
 /*
@@ -133,20 +150,29 @@ static int sox_stat_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
 {
   priv_t * stat = (priv_t *) effp->priv;
   int done, x, len = min(*isamp, *osamp);
+  size_t chans = effp->in_signal.channels, lead;
   short count = 0;
 
+  if (obuf != ibuf)
+    memcpy(obuf, ibuf, len * sizeof(*obuf));
+  *isamp = *osamp = len;
+  len = lsx_span(effp, stat->pos, len / chans, &lead) * chans;
+  stat->pos += *isamp / chans;
+  ibuf += lead * chans;
+
   if (len) {
     if (stat->read == 0)          /* 1st sample */
-      stat->min = stat->max = stat->mid = stat->last = (*ibuf)/stat->scale;
+      stat->min = stat->max = stat->mid = stat->last = stat->first =
+        (*ibuf)/stat->scale;
 
     if (stat->fft) {
       for (x = 0; x < len; x++) {
         SOX_SAMPLE_LOCALS;
         stat->re_in[stat->fft_offset++] = SOX_SAMPLE_TO_FLOAT_32BIT(ibuf[x], effp->clips);
 
-        if (stat->fft_offset >= stat->fft_size) {
+        if (stat->fft_offset >= stat->fft_size * FREQ_BATCH) {
           stat->fft_offset = 0;
-          print_power_spectrum((unsigned) stat->fft_size, effp->in_signal.rate, stat->re_in, stat->re_out);
+          print_power_spectra(effp, FREQ_BATCH);
         }
 
       }
@@ -157,7 +183,6 @@ static int sox_stat_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
       double delta, samp = (double)lsamp / stat->scale;
       /* work in scaled levels for both sample and delta */
       stat->bin[(lsamp >> 30) + 2]++;
-      *obuf++ = lsamp;
 
       if (stat->volume == 2) {
           fprintf(stderr,"%08lx ",lsamp);
@@ -192,9 +217,6 @@ static int sox_stat_flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_samp
     stat->read += len;
   }
 
-  *isamp = *osamp = len;
-  /* Process all samples */
-
   return SOX_SUCCESS;
 }
 
@@ -210,12 +232,12 @@ static int sox_stat_drain(sox_effect_t * effp, sox_sample_t *obuf UNUSED, size_t
    * samples.
    */
   if (stat->fft && stat->fft_offset) {
-    unsigned int x;
+    unsigned long x, blocks = (stat->fft_offset + stat->fft_size - 1) / stat->fft_size;
 
-    for (x = stat->fft_offset; x < stat->fft_size; x++)
+    for (x = stat->fft_offset; x < blocks * stat->fft_size; x++)
       stat->re_in[x] = 0;
 
-    print_power_spectrum((unsigned) stat->fft_size, effp->in_signal.rate, stat->re_in, stat->re_out);
+    print_power_spectra(effp, blocks);
   }
 
   *osamp = 0;
@@ -318,16 +340,100 @@ static int sox_stat_stop(sox_effect_t * effp)
 
 }
 
+/*
+ * Write or read what has been gathered, as a partial result.
+ */
+static void stat_partial(lsx_partial_t * s, priv_t * stat)
+{
+  int i;
+
+  lsx_partial_u64(s, &stat->read);
+  lsx_partial_f64(s, &stat->min);
+  lsx_partial_f64(s, &stat->max);
+  lsx_partial_f64(s, &stat->asum);
+  lsx_partial_f64(s, &stat->sum1);
+  lsx_partial_f64(s, &stat->sum2);
+  lsx_partial_f64(s, &stat->dmin);
+  lsx_partial_f64(s, &stat->dmax);
+  lsx_partial_f64(s, &stat->dsum1);
+  lsx_partial_f64(s, &stat->dsum2);
+  lsx_partial_f64(s, &stat->first);
+  lsx_partial_f64(s, &stat->last);
+  for (i = 0; i < 4; i++) {
+    uint64_t bin = stat->bin[i];
+    lsx_partial_u64(s, &bin);
+    stat->bin[i] = (unsigned long)bin;
+  }
+}
+
+static size_t sox_stat_save(sox_effect_t * effp, void * buf, size_t len)
+{
+  priv_t * stat = (priv_t *) effp->priv;
+  lsx_partial_t s;
+
+  if (stat->fft || stat->volume == 2) /* printed as it went along */
+    return 0;
+  memset(&s, 0, sizeof(s));
+  s.data = buf, s.size = len;
+  stat_partial(&s, stat);
+  return s.pos;
+}
+
+/*
+ * Add a partial result for the samples that follow those seen; the delta
+ * from the last of these to the first of those is the one not yet counted.
+ */
+static int sox_stat_merge(sox_effect_t * effp, void const * buf, size_t len)
+{
+  priv_t * stat = (priv_t *) effp->priv, q = *stat;
+  lsx_partial_t s;
+  double delta;
+  int i;
+
+  memset(&s, 0, sizeof(s));
+  s.data = (unsigned char *)buf, s.size = len, s.reading = sox_true;
+  stat_partial(&s, &q);
+  if (s.error || s.pos != len)
+    return SOX_EOF;
+  if (!q.read)
+    return SOX_SUCCESS;
+  if (!stat->read) {
+    *stat = q;
+    return SOX_SUCCESS;
+  }
+  stat->min = min(stat->min, q.min);
+  stat->max = max(stat->max, q.max);
+  stat->mid = stat->min / 2 + stat->max / 2;
+  stat->asum += q.asum;
+  stat->sum1 += q.sum1;
+  stat->sum2 += q.sum2;
+
+  delta = fabs(q.first - stat->last);
+  stat->dmin = min(min(stat->dmin, q.dmin), delta);
+  stat->dmax = max(max(stat->dmax, q.dmax), delta);
+  stat->dsum1 += q.dsum1 + delta;
+  stat->dsum2 += q.dsum2 + delta * delta;
+
+  stat->last = q.last;
+  stat->read += q.read;
+  for (i = 0; i < 4; i++)
+    stat->bin[i] += q.bin[i];
+  return SOX_SUCCESS;
+}
+
 static sox_effect_handler_t sox_stat_effect = {
   "stat",
   "[ -s N ] [ -rms ] [-freq] [ -v ] [ -d ]",
-  SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+  SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INPLACE,
   sox_stat_getopts,
   sox_stat_start,
   sox_stat_flow,
   sox_stat_drain,
   sox_stat_stop,
-  NULL, sizeof(priv_t)
+  NULL, sizeof(priv_t), NULL,
+  sox_stat_save,
+  sox_stat_merge,
+  NULL
 };
 
 const sox_effect_handler_t *lsx_stat_effect_fn(void)
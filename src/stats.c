@@ -19,22 +19,36 @@
 #include <ctype.h>
 #include <string.h>
 
+#define BLOCK 512 /* Samples reduced at a time */
+
 typedef struct {
   int       scale_bits, hex_bits;
   double    time_constant, scale;
+  char      * period_str;
 
-  double    last, sigma_x, sigma_x2, avg_sigma_x2, min_sigma_x2, max_sigma_x2;
+  double    sigma_x, sigma_x2, avg_sigma_x2, min_sigma_x2, max_sigma_x2;
   double    min, max, mult, min_run, min_runs, max_run, max_runs;
   off_t     num_samples, tc_samples, min_count, max_count;
+  off_t     min_lead, max_lead;  /* Samples from the first at min, max */
   uint32_t  mask;
+  sox_sample_t last, imin, imax;
+
+  uint64_t  period, w_samples;  /* Periodic (windowed) output */
+  sox_sample_t w_min, w_max;
+  int64_t   w_sigma_x;
+  double    w_sigma_x2;
+
+  uint64_t  pos;                /* Input seen, in or out of the span */
 } priv_t;
 
 static int getopts(sox_effect_t * effp, int argc, char **argv)
 {
   priv_t * p = (priv_t *)effp->priv;
   int c;
+  uint64_t dummy;
+  char const * next;
   lsx_getopt_t optstate;
-  lsx_getopt_init(argc, argv, "+x:b:w:s:", NULL, lsx_getopt_flag_none, 1, &optstate);
+  lsx_getopt_init(argc, argv, "+x:b:w:s:p:", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   p->time_constant = .05;
   p->scale = 1;
@@ -43,6 +57,9 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
     GETOPT_NUMERIC(optstate, 'b', scale_bits    ,  2 , 32)
     GETOPT_NUMERIC(optstate, 'w', time_constant ,  .01 , 10)
     GETOPT_NUMERIC(optstate, 's', scale         ,  -99, 99)
+    case 'p': next = lsx_parsesamples(1e5, optstate.arg, &dummy, 't');
+      if (next && !*next && dummy) {p->period_str = lsx_strdup(optstate.arg); break;}
+      return lsx_usage(effp);
     default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
   }
   if (p->hex_bits)
@@ -50,6 +67,15 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   return optstate.ind != argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static void window_reset(priv_t * p)
+{
+  p->w_samples = 0;
+  p->w_min = SOX_SAMPLE_MAX;
+  p->w_max = SOX_SAMPLE_MIN;
+  p->w_sigma_x = 0;
+  p->w_sigma_x2 = 0;
+}
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -60,51 +86,166 @@ static int start(sox_effect_t * effp)
   p->sigma_x = p->sigma_x2 = p->avg_sigma_x2 = p->max_sigma_x2 = 0;
   p->min = p->min_sigma_x2 = 2;
   p->max = -p->min;
+  p->imin = SOX_SAMPLE_MAX;
+  p->imax = SOX_SAMPLE_MIN;
+  p->min_count = p->max_count = 0;
+  p->min_run = p->min_runs = p->max_run = p->max_runs = 0;
+  p->min_lead = p->max_lead = 0;
   p->num_samples = 0;
+  p->pos = 0;
   p->mask = 0;
+  p->period = 0;
+  if (p->period_str)
+    lsx_parsesamples(effp->in_signal.rate, p->period_str, &p->period, 't');
+  window_reset(p);
+  /* Enough for the moving average to settle to within rounding: */
+  effp->span_history = 40 * p->time_constant;
   return SOX_SUCCESS;
 }
 
-static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
-    sox_sample_t * obuf, size_t * ilen, size_t * olen)
+/* Emit one machine-readable line for the window just ended:
+ * start-time channel DC min max peak-dB RMS-dB */
+static void window_output(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
-  size_t len = *ilen = *olen = min(*ilen, *olen);
-  memcpy(obuf, ibuf, len * sizeof(*obuf));
-
-  for (; len--; ++ibuf, ++p->num_samples) {
-    double d = SOX_SAMPLE_TO_FLOAT_64BIT(*ibuf,);
+  double n = p->w_samples, scale = 1. / (SOX_SAMPLE_MAX + 1.);
+  double min = p->w_min * scale, max = p->w_max * scale;
+
+  fprintf(stderr, "%.3f\t%u\t%.6f\t%.6f\t%.6f\t%.2f\t%.2f\n",
+      (p->num_samples - n) / effp->in_signal.rate, (unsigned)effp->flow + 1,
+      p->w_sigma_x * scale / n, min, max, linear_to_dB(max(-min, max)),
+      linear_to_dB(sqrt(p->w_sigma_x2 / n)));
+  window_reset(p);
+}
 
-    if (d < p->min)
-      p->min = d, p->min_count = 1, p->min_run = 1, p->min_runs = 0;
-    else if (d == p->min) {
-      ++p->min_count;
-      p->min_run = d == p->last? p->min_run + 1 : 1;
-    }
-    else if (p->last == p->min)
-      p->min_runs += sqr(p->min_run);
-
-    if (d > p->max)
-      p->max = d, p->max_count = 1, p->max_run = 1, p->max_runs = 0;
-    else if (d == p->max) {
-      ++p->max_count;
-      p->max_run = d == p->last? p->max_run + 1 : 1;
-    }
-    else if (p->last == p->max)
-      p->max_runs += sqr(p->max_run);
-
-    p->sigma_x += d;
-    p->sigma_x2 += sqr(d);
-    p->avg_sigma_x2 = p->avg_sigma_x2 * p->mult + (1 - p->mult) * sqr(d);
-
-    if (p->num_samples >= p->tc_samples) {
-      if (p->avg_sigma_x2 > p->max_sigma_x2)
-        p->max_sigma_x2 = p->avg_sigma_x2;
-      if (p->avg_sigma_x2 < p->min_sigma_x2)
-        p->min_sigma_x2 = p->avg_sigma_x2;
+/* Update the statistics with samples equal to the level `m': the count of
+ * such samples, and the (squared) lengths of their runs. */
+static void runs(sox_sample_t const * x, size_t len, sox_sample_t m,
+    sox_sample_t last, off_t * count, double * run, double * runs)
+{
+  for (; len--; last = *x++)
+    if (*x == m) {
+      ++*count;
+      *run = last == m? *run + 1 : 1;
     }
-    p->last = d;
-    p->mask |= *ibuf;
+    else if (last == m)
+      *runs += sqr(*run);
+}
+
+/* If all n samples so far have been at the level `m', extends their count,
+ * `lead', by those of x that continue so. */
+static void lead(sox_sample_t const * x, size_t len, sox_sample_t m, off_t n,
+    off_t * lead)
+{
+  for (; *lead == n && len--; ++n)
+    if (*x++ == m)
+      ++*lead;
+}
+
+/* Before the span, the moving average alone is kept up to date */
+static void settle(priv_t * p, sox_sample_t const * x, size_t len)
+{
+  double a = p->avg_sigma_x2;
+  size_t i;
+
+  for (i = 0; i < len; ++i)
+    a = a * p->mult + (1 - p->mult) * sqr(SOX_SAMPLE_TO_FLOAT_64BIT(x[i],));
+  p->avg_sigma_x2 = a;
+}
+
+/* Statistics for a block of (at most BLOCK) samples.  Min, max, mask and the
+ * sums are plain reductions that vectorise; the run-length bookkeeping only
+ * visits blocks that reach the current min or max. */
+static void block(priv_t * p, sox_sample_t const * x, size_t len,
+    uint64_t span_offset)
+{
+  double d[BLOCK], s2[4] = {0, 0, 0, 0}, sigma_x2, a = p->avg_sigma_x2;
+  double mult = p->mult, mult1 = 1 - p->mult;
+  sox_sample_t lo = SOX_SAMPLE_MAX, hi = SOX_SAMPLE_MIN;
+  uint32_t mask = 0;
+  int64_t sigma_x = 0;
+  size_t i, j, tc;
+  off_t n;
+
+  for (i = 0; i < len; ++i) {
+    lo = min(lo, x[i]);
+    hi = max(hi, x[i]);
+    mask |= x[i];
+    sigma_x += x[i];
+    d[i] = sqr(SOX_SAMPLE_TO_FLOAT_64BIT(x[i],));
+  }
+  for (i = 0; i + 4 <= len; i += 4)
+    for (j = 0; j < 4; ++j)
+      s2[j] += d[i + j];
+  for (; i < len; ++i)
+    s2[0] += d[i];
+  sigma_x2 = (s2[0] + s2[1]) + (s2[2] + s2[3]);
+
+  /* The moving average is a recurrence, so stays sample by sample: */
+  n = p->num_samples + (off_t)span_offset;
+  tc = n >= p->tc_samples? 0 : min(len, (size_t)(p->tc_samples - n));
+  for (i = 0; i < tc; ++i)
+    a = a * mult + mult1 * d[i];
+  for (; i < len; ++i) {
+    a = a * mult + mult1 * d[i];
+    p->max_sigma_x2 = max(p->max_sigma_x2, a);
+    p->min_sigma_x2 = min(p->min_sigma_x2, a);
+  }
+  p->avg_sigma_x2 = a;
+
+  if (lo < p->imin)
+    p->imin = lo, p->min_count = 0, p->min_run = 0, p->min_runs = 0,
+      p->min_lead = 0;
+  if (lo == p->imin) {
+    runs(x, len, lo, p->last, &p->min_count, &p->min_run, &p->min_runs);
+    lead(x, len, lo, p->num_samples, &p->min_lead);
+  }
+  else if (p->last == p->imin)
+    p->min_runs += sqr(p->min_run);
+
+  if (hi > p->imax)
+    p->imax = hi, p->max_count = 0, p->max_run = 0, p->max_runs = 0,
+      p->max_lead = 0;
+  if (hi == p->imax) {
+    runs(x, len, hi, p->last, &p->max_count, &p->max_run, &p->max_runs);
+    lead(x, len, hi, p->num_samples, &p->max_lead);
+  }
+  else if (p->last == p->imax)
+    p->max_runs += sqr(p->max_run);
+
+  p->min = SOX_SAMPLE_TO_FLOAT_64BIT(p->imin,);
+  p->max = SOX_SAMPLE_TO_FLOAT_64BIT(p->imax,);
+  p->sigma_x += SOX_SAMPLE_TO_FLOAT_64BIT((double)sigma_x,);
+  p->sigma_x2 += sigma_x2;
+  p->mask |= mask;
+  p->last = x[len - 1];
+  p->num_samples += len;
+
+  p->w_min = min(p->w_min, lo);
+  p->w_max = max(p->w_max, hi);
+  p->w_sigma_x += sigma_x;
+  p->w_sigma_x2 += sigma_x2;
+  p->w_samples += len;
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t * ilen, size_t * olen)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t n, lead, len = *ilen = *olen = min(*ilen, *olen);
+  if (obuf != ibuf)
+    memcpy(obuf, ibuf, len * sizeof(*obuf));
+
+  len = lsx_span(effp, p->pos, len, &lead);
+  p->pos += *ilen;
+  settle(p, ibuf, lead);
+  for (ibuf += lead; len; ibuf += n, len -= n) {
+    n = min(len, BLOCK);
+    if (p->period)
+      n = min(n, p->period - p->w_samples);
+    block(p, ibuf, n, effp->span.offset);
+    if (p->period && p->w_samples == p->period)
+      window_output(effp);
   }
   return SOX_SUCCESS;
 }
@@ -113,10 +254,12 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * olen)
 {
   priv_t * p = (priv_t *)effp->priv;
 
-  if (p->last == p->min)
+  if (p->num_samples && p->last == p->imin)
     p->min_runs += sqr(p->min_run);
-  if (p->last == p->max)
+  if (p->num_samples && p->last == p->imax)
     p->max_runs += sqr(p->max_run);
+  if (p->period && p->w_samples)
+    window_output(effp);
 
   (void)obuf, *olen = 0;
   return SOX_SUCCESS;
@@ -290,10 +433,131 @@ static int stop(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
+static void partial_off(lsx_partial_t * s, off_t * x)
+{
+  uint64_t u = (uint64_t)*x;
+  lsx_partial_u64(s, &u);
+  *x = (off_t)u;
+}
+
+/* Writes or reads what has been gathered, as a partial result */
+static void partial(lsx_partial_t * s, priv_t * p)
+{
+  int32_t mask = (int32_t)p->mask;
+
+  partial_off(s, &p->num_samples);
+  lsx_partial_f64(s, &p->sigma_x);
+  lsx_partial_f64(s, &p->sigma_x2);
+  lsx_partial_f64(s, &p->min_sigma_x2);
+  lsx_partial_f64(s, &p->max_sigma_x2);
+  lsx_partial_i32(s, &mask);
+  p->mask = (uint32_t)mask;
+  lsx_partial_i32(s, &p->last);
+  lsx_partial_i32(s, &p->imin);
+  partial_off(s, &p->min_count);
+  partial_off(s, &p->min_lead);
+  lsx_partial_f64(s, &p->min_run);
+  lsx_partial_f64(s, &p->min_runs);
+  lsx_partial_i32(s, &p->imax);
+  partial_off(s, &p->max_count);
+  partial_off(s, &p->max_lead);
+  lsx_partial_f64(s, &p->max_run);
+  lsx_partial_f64(s, &p->max_runs);
+}
+
+static size_t save(sox_effect_t * effp, void * buf, size_t len)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  lsx_partial_t s;
+
+  if (p->period)  /* Its lines would be of its span alone */
+    return 0;
+  memset(&s, 0, sizeof(s));
+  s.data = buf, s.size = len;
+  partial(&s, p);
+  return s.pos;
+}
+
+/* A level (the min or the max) of the samples, with its count and runs */
+typedef struct {
+  sox_sample_t * level;
+  off_t        * count, * lead;
+  double       * run, * runs;
+} level_t;
+
+static level_t level(priv_t * p, sox_bool is_max)
+{
+  level_t l;
+
+  l.level = is_max? &p->imax : &p->imin;
+  l.count = is_max? &p->max_count : &p->min_count;
+  l.lead = is_max? &p->max_lead : &p->min_lead;
+  l.run = is_max? &p->max_run : &p->min_run;
+  l.runs = is_max? &p->max_runs : &p->min_runs;
+  return l;
+}
+
+/* Merges the level of q (whose samples follow p's) into that of p; a run at
+ * the level that ends p's samples and one that starts q's are one run. */
+static void merge_level(priv_t * p, priv_t * q, sox_bool is_max)
+{
+  level_t a = level(p, is_max), b = level(q, is_max);
+  sox_bool joined = p->last == *a.level && *b.lead;
+
+  if (!q->num_samples)
+    return;
+  if (!p->num_samples || (is_max? *b.level > *a.level : *b.level < *a.level)) {
+    *a.level = *b.level, *a.count = *b.count;
+    *a.run = *b.run, *a.runs = *b.runs;
+    *a.lead = p->num_samples? 0 : *b.lead;
+  }
+  else if (*b.level == *a.level) {
+    *a.count += *b.count;
+    *a.runs += *b.runs + (joined? 2 * *a.run * *b.lead : 0);
+    *a.run = joined && *b.lead == q->num_samples? *a.run + *b.run : *b.run;
+    if (*a.lead == p->num_samples)
+      *a.lead += *b.lead;
+  }
+}
+
+static int merge(sox_effect_t * effp, void const * buf, size_t len)
+{
+  priv_t * p = (priv_t *)effp->priv, q = *p;
+  lsx_partial_t s;
+
+  memset(&s, 0, sizeof(s));
+  s.data = (unsigned char *)buf, s.size = len, s.reading = sox_true;
+  partial(&s, &q);
+  if (s.error || s.pos != len)
+    return SOX_EOF;
+  merge_level(p, &q, sox_false);
+  merge_level(p, &q, sox_true);
+  p->min = SOX_SAMPLE_TO_FLOAT_64BIT(p->imin,);
+  p->max = SOX_SAMPLE_TO_FLOAT_64BIT(p->imax,);
+  p->sigma_x += q.sigma_x;
+  p->sigma_x2 += q.sigma_x2;
+  p->min_sigma_x2 = min(p->min_sigma_x2, q.min_sigma_x2);
+  p->max_sigma_x2 = max(p->max_sigma_x2, q.max_sigma_x2);
+  p->mask |= q.mask;
+  if (q.num_samples)
+    p->last = q.last;
+  p->num_samples += q.num_samples;
+  return SOX_SUCCESS;
+}
+
+static int lsx_kill(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  free(p->period_str);
+  return SOX_SUCCESS;
+}
+
 sox_effect_handler_t const * lsx_stats_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "stats", "[-b bits|-x bits|-s scale] [-w window-time]", SOX_EFF_MODIFY,
-    getopts, start, flow, drain, stop, NULL, sizeof(priv_t)};
+    "stats", "[-b bits|-x bits|-s scale] [-w window-time] [-p period]",
+    SOX_EFF_MODIFY | SOX_EFF_INPLACE | SOX_EFF_RTSAFE,
+    getopts, start, flow, drain, stop, lsx_kill, sizeof(priv_t), NULL, save,
+    merge, NULL};
   return &handler;
 }
@@ -41,15 +41,17 @@ typedef struct {
 
   size_t segment;         /* buffer size */
   size_t index;        /* next available element */
-  sox_sample_t *ibuf;      /* input buffer */
+  sox_sample_t *ibuf;      /* input buffer (circular, from istart) */
+  size_t istart;
   size_t ishift;       /* input shift */
 
   size_t oindex;       /* next evailable element */
-  double * obuf;   /* output buffer */
+  double * obuf;   /* output buffer (circular, from ostart) */
+  size_t ostart;
   size_t oshift;       /* output shift */
 
   size_t overlap;        /* fading size */
-  double * fade_coefs;   /* fading, 1.0 -> 0.0 */
+  double * coefs;        /* per element: fade in, 1.0 steady, fade out */
 
 } priv_t;
 
@@ -138,7 +140,6 @@ static int start(sox_effect_t * effp)
   p->segment = (int)(effp->out_signal.rate * 0.001 * p->window);
   /* start in the middle of an input to avoid initial fading... */
   p->index = p->segment / 2;
-  p->ibuf = lsx_malloc(p->segment * sizeof(sox_sample_t));
 
   /* the shift ratio deal with the longest of ishift/oshift
      hence ishift<=segment and oshift<=segment. */
@@ -153,25 +154,21 @@ static int start(sox_effect_t * effp)
   assert(p->oshift <= p->segment);
 
   p->oindex = p->index; /* start as synchronized */
-  p->obuf = lsx_malloc(p->segment * sizeof(double));
+  p->ibuf = lsx_calloc(p->segment, sizeof(*p->ibuf));
+  p->obuf = lsx_calloc(p->segment, sizeof(*p->obuf));
   p->overlap = (int)(p->fading * p->segment);
-  p->fade_coefs = lsx_malloc(p->overlap * sizeof(double));
-
-  /* initialize buffers */
-  for (i = 0; i<p->segment; i++)
-    p->ibuf[i] = 0;
-
-  for (i = 0; i<p->segment; i++)
-    p->obuf[i] = 0.0;
+  p->coefs = lsx_malloc(p->segment * sizeof(*p->coefs));
 
+  for (i = 0; i < p->segment; i++)
+    p->coefs[i] = 1.0;
   if (p->overlap>1) {
     double slope = 1.0 / (p->overlap - 1);
-    p->fade_coefs[0] = 1.0;
-    for (i = 1; i < p->overlap - 1; i++)
-      p->fade_coefs[i] = slope * (p->overlap - i - 1);
-    p->fade_coefs[p->overlap - 1] = 0.0;
-  } else if (p->overlap == 1)
-    p->fade_coefs[0] = 1.0;
+    for (i = 1; i < p->overlap - 1; i++)  /* fade out is 1.0 -> 0.0 */
+      p->coefs[p->segment - p->overlap + i] = slope * (p->overlap - i - 1);
+    p->coefs[p->segment - 1] = 0.0;
+  }
+  for (i = 0; i < p->overlap; i++)        /* fade in mirrors fade out */
+    p->coefs[i] = p->coefs[p->segment - 1 - i];
 
   lsx_debug("start: (factor=%g segment=%g shift=%g overlap=%g)\nstate=%d\n"
       "segment=%" PRIuPTR "\nindex=%" PRIuPTR "\n"
@@ -184,22 +181,57 @@ static int start(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
-/* accumulates input ibuf to output obuf with fading fade_coefs */
+/* accumulates input ibuf to output obuf with fading coefs */
 static void combine(priv_t * p)
 {
-  size_t i;
+  size_t i, j, n, ii = p->istart, oi = p->ostart;
+
+  for (i = 0; i < p->segment; i += n) {  /* in pieces that don't wrap */
+    double * obuf = p->obuf + oi;
+    sox_sample_t const * ibuf = p->ibuf + ii;
+    double const * coefs = p->coefs + i;
+
+    n = min(p->segment - i, p->segment - max(ii, oi));
+    for (j = 0; j < n; j++)
+      obuf[j] += coefs[j] * ibuf[j];
+    if ((ii += n) == p->segment) ii = 0;
+    if ((oi += n) == p->segment) oi = 0;
+  }
+}
 
-  /* fade in */
-  for (i = 0; i < p->overlap; i++)
-    p->obuf[i] += p->fade_coefs[p->overlap - 1 - i] * p->ibuf[i];
+/* copies n samples from buf to ibuf, from (logical) index i */
+static void input(priv_t * p, size_t i, sox_sample_t const * buf, size_t n)
+{
+  size_t n1;
+
+  if ((i += p->istart) >= p->segment) i -= p->segment;
+  n1 = min(n, p->segment - i);
+  if (buf) {
+    memcpy(p->ibuf + i, buf, n1 * sizeof(*buf));
+    memcpy(p->ibuf, buf + n1, (n - n1) * sizeof(*buf));
+  } else {
+    memset(p->ibuf + i, 0, n1 * sizeof(*p->ibuf));
+    memset(p->ibuf, 0, (n - n1) * sizeof(*p->ibuf));
+  }
+}
 
-  /* steady state */
-  for (; i < p->segment - p->overlap; i++)
-    p->obuf[i] += p->ibuf[i];
+/* outputs obuf from (logical) index p->oindex, up to index end */
+static size_t output(sox_effect_t * effp, sox_sample_t * buf, size_t n,
+    size_t end)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  size_t i, j;
 
-  /* fade out */
-  for (; i<p->segment; i++)
-    p->obuf[i] += p->fade_coefs[i - p->segment + p->overlap] * p->ibuf[i];
+  n = min(n, end - p->oindex);
+  if ((j = p->ostart + p->oindex) >= p->segment) j -= p->segment;
+  for (i = 0; i < n; i++) {
+    float f = p->obuf[j];
+    SOX_SAMPLE_CLIP_COUNT(f, effp->clips);
+    buf[i] = f < SOX_SAMPLE_MAX? f : SOX_SAMPLE_MAX; /* (float)MAX is 2^31 */
+    if (++j == p->segment) j = 0;
+  }
+  p->oindex += n;
+  return n;
 }
 
 /*
@@ -210,14 +242,13 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
 {
   priv_t * p = (priv_t *) effp->priv;
   size_t iindex = 0, oindex = 0;
-  size_t i;
 
   while (iindex<*isamp && oindex<*osamp) {
     if (p->state == input_state) {
       size_t tocopy = min(*isamp-iindex,
                              p->segment-p->index);
 
-      memcpy(p->ibuf + p->index, ibuf + iindex, tocopy * sizeof(sox_sample_t));
+      input(p, p->index, ibuf + iindex, tocopy);
 
       iindex += tocopy;
       p->index += tocopy;
@@ -227,8 +258,8 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
         combine(p);
 
         /* shift input */
-        for (i = 0; i + p->ishift < p->segment; i++)
-          p->ibuf[i] = p->ibuf[i+p->ishift];
+        if ((p->istart += p->ishift) >= p->segment)
+          p->istart -= p->segment;
 
         p->index -= p->ishift;
 
@@ -238,23 +269,19 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
     }
 
     if (p->state == output_state) {
-      while (p->oindex < p->oshift && oindex < *osamp) {
-        float f;
-        f = p->obuf[p->oindex++];
-        SOX_SAMPLE_CLIP_COUNT(f, effp->clips);
-        obuf[oindex++] = f;
-      }
+      if (p->oindex < p->oshift)
+        oindex += output(effp, obuf + oindex, *osamp - oindex, p->oshift);
 
       if (p->oindex >= p->oshift && oindex<*osamp) {
-        p->oindex -= p->oshift;
+        size_t n1 = min(p->oshift, p->segment - p->ostart);
 
-        /* shift internal output buffer */
-        for (i = 0; i + p->oshift < p->segment; i++)
-          p->obuf[i] = p->obuf[i + p->oshift];
+        p->oindex -= p->oshift;
 
-        /* pad with 0 */
-        for (; i < p->segment; i++)
-          p->obuf[i] = 0.0;
+        /* shift internal output buffer, padding with 0 */
+        memset(p->obuf + p->ostart, 0, n1 * sizeof(*p->obuf));
+        memset(p->obuf, 0, (p->oshift - n1) * sizeof(*p->obuf));
+        if ((p->ostart += p->oshift) >= p->segment)
+          p->ostart -= p->segment;
 
         p->state = input_state;
       }
@@ -275,25 +302,16 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
 static int drain(sox_effect_t * effp, sox_sample_t *obuf, size_t *osamp)
 {
   priv_t * p = (priv_t *) effp->priv;
-  size_t i;
-  size_t oindex = 0;
 
   if (p->state == input_state) {
-    for (i=p->index; i<p->segment; i++)
-      p->ibuf[i] = 0;
+    input(p, p->index, NULL, p->segment - p->index);
 
     combine(p);
 
     p->state = output_state;
   }
 
-  while (oindex<*osamp && p->oindex<p->index) {
-    float f = p->obuf[p->oindex++];
-    SOX_SAMPLE_CLIP_COUNT(f, effp->clips);
-    obuf[oindex++] = f;
-  }
-
-  *osamp = oindex;
+  *osamp = p->oindex < p->index? output(effp, obuf, *osamp, p->index) : 0;
 
   if (p->oindex == p->index)
     return SOX_EOF;
@@ -308,7 +326,7 @@ static int stop(sox_effect_t * effp)
 
   free(p->ibuf);
   free(p->obuf);
-  free(p->fade_coefs);
+  free(p->coefs);
   return SOX_SUCCESS;
 }
 
@@ -320,7 +338,8 @@ const sox_effect_handler_t *lsx_stretch_effect_fn(void)
     "       (expansion, frame in ms, lin/..., unit<1.0, unit<0.5)\n"
     "       (defaults: 1.0 20 lin ...)",
     SOX_EFF_LENGTH,
-    getopts, start, flow, drain, stop, NULL, sizeof(priv_t)
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
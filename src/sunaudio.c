@@ -333,7 +333,7 @@ static int sunstartwrite(sox_format_t * ft)
         return(SOX_EOF);
     }
 
-    pPriv->cOutput = sox_globals.bufsiz >> pPriv->sample_shift;
+    pPriv->cOutput = ft->context->bufsiz >> pPriv->sample_shift;
     pPriv->pOutput = lsx_malloc((size_t)pPriv->cOutput << pPriv->sample_shift);
 
     return (SOX_SUCCESS);
@@ -514,7 +514,7 @@ LSX_FORMAT_HANDLER(sunau)
     names, SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
     sunstartread, sunread, sunstop,
     sunstartwrite, sunwrite, sunstop,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -39,8 +39,9 @@ static int flow(sox_effect_t *effp, const sox_sample_t *ibuf,
   while (len--) {
     size_t i;
     for (i = 0; i + 1 < channels; i += 2) {
-      *obuf++ = ibuf[1];
-      *obuf++ = ibuf[0];
+      sox_sample_t s0 = ibuf[0], s1 = ibuf[1]; /* ibuf may be obuf */
+      *obuf++ = s1;
+      *obuf++ = s0;
       ibuf += 2;
     }
     if (channels % 2)
@@ -54,9 +55,9 @@ sox_effect_handler_t const *lsx_swap_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "swap", NULL,
-    SOX_EFF_MCHAN | SOX_EFF_MODIFY,
+    SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_SEEK | SOX_EFF_INPLACE | SOX_EFF_RTSAFE,
     NULL, start, flow, NULL, NULL, NULL,
-    0
+    0, NULL, NULL, NULL, NULL
   };
   return &handler;
 }
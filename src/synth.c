@@ -95,6 +95,10 @@ typedef struct {
 
   double * buffer;
   size_t buffer_len, pos;
+
+  sox_bool constant_freq;       /* I.e. not sweeping */
+  uint64_t phase_acc, phase_inc; /* If so, 0.64 fixed-point */
+  size_t draws_offset;          /* Of its random numbers, in those of a frame */
 } channel_t;
 
 
@@ -110,6 +114,12 @@ typedef struct {
   size_t        number_of_channels;
   sox_bool      no_headroom;
   double        gain;
+  double        * sine_table;
+  size_t        draws_per_frame;
+  int32_t       * draws;        /* Random numbers for a block */
+  double        * block;        /* A channel's worth of a block */
+  size_t        block_len;
+  sox_bool      fast_math;      /* Whether lsx_exp_n may approximate */
 } priv_t;
 
 
@@ -321,12 +331,40 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
 
 
 
+/* Sine is read from a table, with linear interpolation between its points
+ * (which is accurate to better than the LSB of a 24-bit sample).  Each point
+ * is stored together with the step to the next. */
+#define SINE_BITS  13
+#define SINE_LEN   (1 << SINE_BITS)
+
+static double * make_sine_table(void)
+{
+  double * t = lsx_malloc(2 * SINE_LEN * sizeof(*t));
+  int i;
+
+  for (i = 0; i < SINE_LEN; ++i)
+    t[2 * i] = sin(2 * M_PI * i / SINE_LEN);
+  for (i = 0; i < SINE_LEN; ++i)
+    t[2 * i + 1] = (i + 1 < SINE_LEN? t[2 * i + 2] : 0) - t[2 * i];
+  return t;
+}
+
+/* phase is [0, 1) in 0.64 fixed-point */
+static double sine_at(double const * t, uint64_t phase)
+{
+  double const * p = t + 2 * (phase >> (64 - SINE_BITS));
+  return p[0] + p[1] * ((uint32_t)(phase >> (32 - SINE_BITS)) * (1. / 4294967296.));
+}
+
+#define to_fixed(x) ((uint64_t)ldexp(x, 64)) /* [0, 1) to 0.64 fixed-point */
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
   size_t i, j, k;
 
   p->samples_done = 0;
+  p->draws_per_frame = p->block_len = 0;
 
   if (p->length_str) {
     if (lsx_parsesamples(effp->in_signal.rate, p->length_str, &p->samples_to_do, 't') == NULL)
@@ -430,6 +468,18 @@ static int start(sox_effect_t * effp)
           (log(chan->freq2) - log(chan->freq)) / p->samples_to_do : 1;
         break;
     }
+    chan->constant_freq = chan->sweep == Linear && chan->freq == chan->freq2;
+    if (chan->constant_freq) {
+      chan->phase_inc = to_fixed(fmod(chan->freq / effp->in_signal.rate, 1.));
+      /* Rounded up, so that a whole number of cycles wraps round to 0: */
+      chan->phase_inc += chan->phase_inc >> 52;
+      chan->phase_acc = to_fixed(fmod(chan->phase, 1.));
+    }
+    if (chan->type == synth_sine && !p->sine_table)
+      p->sine_table = make_sine_table();
+    chan->draws_offset = p->draws_per_frame;
+    p->draws_per_frame += chan->type == synth_tpdfnoise? 2 :
+        chan->type >= synth_noise && chan->type != synth_pluck;
     lsx_debug("type=%s, combine=%s, samples_to_do=%" PRIu64 ", f1=%g, f2=%g, "
               "offset=%g, phase=%g, p1=%g, p2=%g, p3=%g mult=%g",
         lsx_find_enum_value(chan->type, synth_type)->text,
@@ -438,207 +488,310 @@ static int start(sox_effect_t * effp)
         chan->offset, chan->phase, chan->p1, chan->p2, chan->p3, chan->mult);
   }
   p->gain = 1;
+  p->fast_math = effp->global_info->global_info->fast_math;
   effp->out_signal.mult = p->no_headroom? NULL : &p->gain;
   effp->out_signal.length = p->samples_to_do ?
     p->samples_to_do * effp->out_signal.channels : SOX_UNKNOWN_LEN;
   return SOX_SUCCESS;
 }
 
-#define elapsed_time_s p->samples_done / effp->in_signal.rate
-
-static int flow(sox_effect_t * effp, const sox_sample_t * ibuf, sox_sample_t * obuf,
-    size_t * isamp, size_t * osamp)
+/* Fills phase[] ([0, 1)) for len samples from sample n; when not sweeping,
+ * this is done with a fixed-point phase accumulator. */
+static void tone_phases(channel_t * chan, double * phase, uint64_t n,
+    size_t len, double rate, sox_bool fast)
 {
-  priv_t * p = (priv_t *) effp->priv;
-  unsigned len = min(*isamp, *osamp) / effp->in_signal.channels;
-  unsigned c, done;
-  int result = SOX_SUCCESS;
-
-  for (done = 0; done < len && result == SOX_SUCCESS; ++done) {
-    for (c = 0; c < effp->in_signal.channels; c++) {
-      sox_sample_t synth_input = *ibuf++;
-      channel_t *  chan = &p->channels[c];
-      double synth_out;              /* [-1, 1] */
-
-      if (chan->type < synth_noise) { /* Need to calculate phase: */
-        double phase;            /* [0, 1) */
-        switch (chan->sweep) {
-          case Linear:
-            phase = (chan->freq + p->samples_done * chan->mult) *
-                elapsed_time_s;
-            break;
-          case Square:
-            phase = (chan->freq + sign(chan->mult) * 
-                sqr(p->samples_done * chan->mult)) * elapsed_time_s;
-            break;
-          case Exp:
-            phase = chan->freq * exp(chan->mult * elapsed_time_s);
-            break;
-          case Exp_cycle: default: {
-            double f = chan->freq * exp(p->samples_done * chan->mult);
-            double cycle_elapsed_time_s = elapsed_time_s - chan->cycle_start_time_s;
-            if (f * cycle_elapsed_time_s >= 1) {  /* move to next cycle */
-              chan->cycle_start_time_s += 1 / f;
-              cycle_elapsed_time_s = elapsed_time_s - chan->cycle_start_time_s;
-            }
-            phase = f * cycle_elapsed_time_s;
-            break;
-          }
-        }
-        phase = fmod(phase + chan->phase, 1.0);
-
-        switch (chan->type) {
-          case synth_sine:
-            synth_out = sin(2 * M_PI * phase);
-            break;
-
-          case synth_square:
-            /* |_______           | +1
-             * |       |          |
-             * |_______|__________|  0
-             * |       |          |
-             * |       |__________| -1
-             * |                  |
-             * 0       p1          1
-             */
-            synth_out = -1 + 2 * (phase < chan->p1);
-            break;
-
-          case synth_sawtooth:
-            /* |           __| +1
-             * |        __/  |
-             * |_______/_____|  0
-             * |  __/        |
-             * |_/           | -1
-             * |             |
-             * 0             1
-             */
-            synth_out = -1 + 2 * phase;
-            break;
-
-          case synth_triangle:
-            /* |    .    | +1
-             * |   / \   |
-             * |__/___\__|  0
-             * | /     \ |
-             * |/       \| -1
-             * |         |
-             * 0   p1    1
-             */
-
-            if (phase < chan->p1)
-              synth_out = -1 + 2 * phase / chan->p1;          /* In rising part of period */
-            else
-              synth_out = 1 - 2 * (phase - chan->p1) / (1 - chan->p1); /* In falling part */
-            break;
-
-          case synth_trapezium:
-            /* |    ______             |+1
-             * |   /      \            |
-             * |__/________\___________| 0
-             * | /          \          |
-             * |/            \_________|-1
-             * |                       |
-             * 0   p1    p2   p3       1
-             */
-            if (phase < chan->p1)       /* In rising part of period */
-              synth_out = -1 + 2 * phase / chan->p1;
-            else if (phase < chan->p2)  /* In high part of period */
-              synth_out = 1;
-            else if (phase < chan->p3)  /* In falling part */
-              synth_out = 1 - 2 * (phase - chan->p2) / (chan->p3 - chan->p2);
-            else                        /* In low part of period */
-              synth_out = -1;
-            break;
-
-          case synth_exp:
-            /* |             |              | +1
-             * |            | |             |
-             * |          _|   |_           | 0
-             * |       __-       -__        |
-             * |____---             ---____ | f(p2)
-             * |                            |
-             * 0             p1             1
-             */
-            synth_out = dB_to_linear(chan->p2 * -200);  /* 0 ..  1 */
-            if (phase < chan->p1)
-              synth_out = synth_out * exp(phase * log(1 / synth_out) / chan->p1);
-            else
-              synth_out = synth_out * exp((1 - phase) * log(1 / synth_out) / (1 - chan->p1));
-            synth_out = synth_out * 2 - 1;      /* map 0 .. 1 to -1 .. +1 */
-            break;
-
-          default: synth_out = 0;
+  size_t i;
+
+  if (chan->constant_freq) {
+    uint64_t acc = chan->phase_acc;
+    for (i = 0; i < len; ++i, acc += chan->phase_inc)
+      phase[i] = ldexp((double)(acc >> 11), -53);
+    return;
+  }
+  switch (chan->sweep) {
+    case Linear:
+      for (i = 0; i < len; ++i, ++n)
+        phase[i] = (chan->freq + n * chan->mult) * n / rate;
+      break;
+    case Square:
+      for (i = 0; i < len; ++i, ++n)
+        phase[i] = (chan->freq + sign(chan->mult) * sqr(n * chan->mult)) * n / rate;
+      break;
+    case Exp:
+      for (i = 0; i < len; ++i, ++n)
+        phase[i] = chan->mult * n / rate;
+      lsx_exp_n(phase, len, fast);
+      for (i = 0; i < len; ++i)
+        phase[i] = chan->freq * phase[i];
+      break;
+    case Exp_cycle: default:
+      for (i = 0; i < len; ++i)
+        phase[i] = (n + i) * chan->mult;
+      lsx_exp_n(phase, len, fast);
+      for (i = 0; i < len; ++i, ++n) {
+        double f = chan->freq * phase[i];
+        double cycle_elapsed_time_s = n / rate - chan->cycle_start_time_s;
+        if (f * cycle_elapsed_time_s >= 1) {  /* move to next cycle */
+          chan->cycle_start_time_s += 1 / f;
+          cycle_elapsed_time_s = n / rate - chan->cycle_start_time_s;
         }
-      } else switch (chan->type) {
-        case synth_whitenoise:
-          synth_out = DRANQD1;
-          break;
+        phase[i] = f * cycle_elapsed_time_s;
+      }
+      break;
+  }
+  for (i = 0; i < len; ++i)
+    phase[i] = fmod(phase[i] + chan->phase, 1.0);
+}
+
+/* Generates len samples ([-1, 1]) of a tone */
+static void tone(priv_t * p, channel_t * chan, double * out, size_t len,
+    double rate)
+{
+  size_t i;
+
+  if (chan->type == synth_sine && chan->constant_freq) {
+    uint64_t acc = chan->phase_acc;
+    for (i = 0; i < len; ++i, acc += chan->phase_inc)
+      out[i] = sine_at(p->sine_table, acc);
+    chan->phase_acc = acc;
+    return;
+  }
+  tone_phases(chan, out, p->samples_done, len, rate, p->fast_math);
+  if (chan->constant_freq)
+    chan->phase_acc += len * chan->phase_inc;
+
+  switch (chan->type) {
+    case synth_sine:
+      for (i = 0; i < len; ++i)
+        out[i] = sine_at(p->sine_table, to_fixed(out[i]));
+      break;
 
-        case synth_tpdfnoise:
-          synth_out = .5 * (DRANQD1 + DRANQD1);
-          break;
+    case synth_square:
+      /* |_______           | +1
+       * |       |          |
+       * |_______|__________|  0
+       * |       |          |
+       * |       |__________| -1
+       * |                  |
+       * 0       p1          1
+       */
+      for (i = 0; i < len; ++i)
+        out[i] = -1 + 2 * (out[i] < chan->p1);
+      break;
+
+    case synth_sawtooth:
+      /* |           __| +1
+       * |        __/  |
+       * |_______/_____|  0
+       * |  __/        |
+       * |_/           | -1
+       * |             |
+       * 0             1
+       */
+      for (i = 0; i < len; ++i)
+        out[i] = -1 + 2 * out[i];
+      break;
 
-        case synth_pinknoise: { /* "Paul Kellet's refined method" */
+    case synth_triangle:
+      /* |    .    | +1
+       * |   / \   |
+       * |__/___\__|  0
+       * | /     \ |
+       * |/       \| -1
+       * |         |
+       * 0   p1    1
+       */
+      for (i = 0; i < len; ++i) {
+        double phase = out[i];
+        if (phase < chan->p1)
+          out[i] = -1 + 2 * phase / chan->p1;          /* In rising part of period */
+        else
+          out[i] = 1 - 2 * (phase - chan->p1) / (1 - chan->p1); /* In falling part */
+      }
+      break;
+
+    case synth_trapezium:
+      /* |    ______             |+1
+       * |   /      \            |
+       * |__/________\___________| 0
+       * | /          \          |
+       * |/            \_________|-1
+       * |                       |
+       * 0   p1    p2   p3       1
+       */
+      for (i = 0; i < len; ++i) {
+        double phase = out[i];
+        if (phase < chan->p1)       /* In rising part of period */
+          out[i] = -1 + 2 * phase / chan->p1;
+        else if (phase < chan->p2)  /* In high part of period */
+          out[i] = 1;
+        else if (phase < chan->p3)  /* In falling part */
+          out[i] = 1 - 2 * (phase - chan->p2) / (chan->p3 - chan->p2);
+        else                        /* In low part of period */
+          out[i] = -1;
+      }
+      break;
+
+    case synth_exp: {
+      /* |             |              | +1
+       * |            | |             |
+       * |          _|   |_           | 0
+       * |       __-       -__        |
+       * |____---             ---____ | f(p2)
+       * |                            |
+       * 0             p1             1
+       */
+      double base = dB_to_linear(chan->p2 * -200);  /* 0 ..  1 */
+      double k = log(1 / base);
+      for (i = 0; i < len; ++i) {
+        double phase = out[i];
+        if (phase < chan->p1)
+          out[i] = phase * k / chan->p1;
+        else
+          out[i] = (1 - phase) * k / (1 - chan->p1);
+      }
+      lsx_exp_n(out, len, p->fast_math);
+      for (i = 0; i < len; ++i)
+        out[i] = base * out[i] * 2 - 1;      /* map 0 .. 1 to -1 .. +1 */
+      break;
+    }
+
+    default: memset(out, 0, len * sizeof(*out));
+  }
+}
+
+/* Generates len samples ([-1, 1]) of noise or pluck; noise takes its random
+ * numbers from draws[], at a stride of p->draws_per_frame. */
+static void noise(priv_t * p, channel_t * chan, double * out, size_t len,
+    int32_t const * draws)
+{
+  size_t i, stride = p->draws_per_frame;
+
+  draws += chan->draws_offset;
+  switch (chan->type) {
+    case synth_whitenoise:
+      for (i = 0; i < len; ++i, draws += stride)
+        out[i] = draws[0] * (1. / (65536. * 32768.));
+      break;
+
+    case synth_tpdfnoise:
+      for (i = 0; i < len; ++i, draws += stride)
+        out[i] = .5 * (draws[0] * (1. / (65536. * 32768.)) +
+                       draws[1] * (1. / (65536. * 32768.)));
+      break;
+
+    case synth_pinknoise: { /* "Paul Kellet's refined method" */
 #define _ .125 / (65536. * 32768.)
-          double d = RANQD1;
-          chan->c0 = .99886 * chan->c0 + d * (.0555179*_); 
-          chan->c1 = .99332 * chan->c1 + d * (.0750759*_); 
-          chan->c2 = .96900 * chan->c2 + d * (.1538520*_); 
-          chan->c3 = .86650 * chan->c3 + d * (.3104856*_); 
-          chan->c4 = .55000 * chan->c4 + d * (.5329522*_); 
-          chan->c5 = -.7616 * chan->c5 - d * (.0168980*_); 
-          synth_out = chan->c0 + chan->c1 + chan->c2 + chan->c3
-                    + chan->c4 + chan->c5 + chan->c6 + d * (.5362*_); 
-          chan->c6 = d * (.115926*_); 
-          break;
+      double c0 = chan->c0, c1 = chan->c1, c2 = chan->c2, c3 = chan->c3;
+      double c4 = chan->c4, c5 = chan->c5, c6 = chan->c6;
+      for (i = 0; i < len; ++i, draws += stride) {
+        double d = draws[0];
+        c0 = .99886 * c0 + d * (.0555179*_);
+        c1 = .99332 * c1 + d * (.0750759*_);
+        c2 = .96900 * c2 + d * (.1538520*_);
+        c3 = .86650 * c3 + d * (.3104856*_);
+        c4 = .55000 * c4 + d * (.5329522*_);
+        c5 = -.7616 * c5 - d * (.0168980*_);
+        out[i] = c0 + c1 + c2 + c3 + c4 + c5 + c6 + d * (.5362*_);
+        c6 = d * (.115926*_);
+      }
+      chan->c0 = c0, chan->c1 = c1, chan->c2 = c2, chan->c3 = c3;
+      chan->c4 = c4, chan->c5 = c5, chan->c6 = c6;
+      break;
 #undef _
-        }
+    }
 
-        case synth_brownnoise:
-          do synth_out = chan->lp_last_out + DRANQD1 * (1. / 16);
-          while (fabs(synth_out) > 1);
-          chan->lp_last_out = synth_out;
-          break;
+    case synth_brownnoise: /* Re-draws, if any, come directly from the PRNG */
+      for (i = 0; i < len; ++i, draws += stride) {
+        double d = chan->lp_last_out + draws[0] * (1. / (65536. * 32768.)) * (1. / 16);
+        while (fabs(d) > 1)
+          d = chan->lp_last_out + DRANQD1 * (1. / 16);
+        out[i] = chan->lp_last_out = d;
+      }
+      break;
 
-        case synth_pluck: {
-          double d = chan->buffer[chan->pos];
+    case synth_pluck:
+      for (i = 0; i < len; ++i) {
+        double d = chan->buffer[chan->pos];
 
-          chan->hp_last_out = 
-             (d - chan->hp_last_in) * chan->c3 + chan->hp_last_out * chan->c2;
-          chan->hp_last_in = d;
-        
-          synth_out = range_limit(chan->hp_last_out, -1, 1);
+        chan->hp_last_out =
+           (d - chan->hp_last_in) * chan->c3 + chan->hp_last_out * chan->c2;
+        chan->hp_last_in = d;
 
-          chan->lp_last_out = d = d * chan->c1 + chan->lp_last_out * chan->c0;
+        out[i] = range_limit(chan->hp_last_out, -1, 1);
 
-          chan->ap_last_out = chan->buffer[chan->pos] =
-            (d - chan->ap_last_out) * chan->c4 + chan->ap_last_in;
-          chan->ap_last_in = d;
+        chan->lp_last_out = d = d * chan->c1 + chan->lp_last_out * chan->c0;
 
-          chan->pos = chan->pos + 1 == chan->buffer_len? 0 : chan->pos + 1;
-          break;
-        }
+        chan->ap_last_out = chan->buffer[chan->pos] =
+          (d - chan->ap_last_out) * chan->c4 + chan->ap_last_in;
+        chan->ap_last_in = d;
 
-        default: synth_out = 0;
+        chan->pos = chan->pos + 1 == chan->buffer_len? 0 : chan->pos + 1;
       }
+      break;
 
-      /* Add offset, but prevent clipping: */
-      synth_out = synth_out * (1 - fabs(chan->offset)) + chan->offset;
+    default: memset(out, 0, len * sizeof(*out));
+  }
+}
 
-      switch (chan->combine) {
-        case synth_create: synth_out *=  SOX_SAMPLE_MAX; break;
-        case synth_mix   : synth_out = (synth_out * SOX_SAMPLE_MAX + synth_input) * .5; break;
-        case synth_amod  : synth_out = (synth_out + 1) * synth_input * .5; break;
-        case synth_fmod  : synth_out *=  synth_input; break;
-      }
-      *obuf++ = synth_out < 0? synth_out * p->gain - .5 : synth_out * p->gain + .5;
+/* The audio is generated a block at a time, one channel at a time, so that
+ * the per-sample work is a tight loop for the channel's type.  The random
+ * numbers for the block are drawn up front, in the same order as they would
+ * be for generating a frame at a time. */
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf, sox_sample_t * obuf,
+    size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *) effp->priv;
+  size_t chans = effp->in_signal.channels, c, i;
+  size_t len = min(*isamp, *osamp) / chans;
+
+  if (p->samples_to_do)
+    len = min(len, p->samples_to_do - p->samples_done);
+  if (len > p->block_len) {
+    p->block_len = len;
+    p->block = lsx_realloc(p->block, len * sizeof(*p->block));
+    p->draws = lsx_realloc(p->draws, len * p->draws_per_frame * sizeof(*p->draws));
+  }
+  for (i = 0; i < len * p->draws_per_frame; ++i)
+    p->draws[i] = RANQD1;
+
+  for (c = 0; c < chans; ++c) {
+    channel_t * chan = &p->channels[c];
+    double * out = p->block, mult = 1 - fabs(chan->offset);
+
+    if (chan->type < synth_noise)
+      tone(p, chan, out, len, effp->in_signal.rate);
+    else noise(p, chan, out, len, p->draws);
+
+    /* Add offset, but prevent clipping: */
+    for (i = 0; i < len; ++i)
+      out[i] = out[i] * mult + chan->offset;
+
+    switch (chan->combine) {
+      case synth_create:
+        for (i = 0; i < len; ++i)
+          out[i] *= SOX_SAMPLE_MAX;
+        break;
+      case synth_mix:
+        for (i = 0; i < len; ++i)
+          out[i] = (out[i] * SOX_SAMPLE_MAX + ibuf[i * chans + c]) * .5;
+        break;
+      case synth_amod:
+        for (i = 0; i < len; ++i)
+          out[i] = (out[i] + 1) * ibuf[i * chans + c] * .5;
+        break;
+      case synth_fmod:
+        for (i = 0; i < len; ++i)
+          out[i] *= ibuf[i * chans + c];
+        break;
     }
-    if (++p->samples_done == p->samples_to_do)
-      result = SOX_EOF;
+    for (i = 0; i < len; ++i)
+      obuf[i * chans + c] =
+        out[i] < 0? out[i] * p->gain - .5 : out[i] * p->gain + .5;
   }
-  *isamp = *osamp = done * effp->in_signal.channels;
-  return result;
+  p->samples_done += len;
+  *isamp = *osamp = len * chans;
+  return p->samples_to_do && p->samples_done == p->samples_to_do? SOX_EOF : SOX_SUCCESS;
 }
 
 
@@ -651,6 +804,10 @@ static int stop(sox_effect_t * effp)
   for (i = 0; i < p->number_of_channels; ++i)
     free(p->channels[i].buffer);
   free(p->channels);
+  free(p->sine_table);
+  free(p->draws);
+  free(p->block);
+  p->sine_table = NULL, p->draws = NULL, p->block = NULL;
   return SOX_SUCCESS;
 }
 
@@ -671,7 +828,8 @@ const sox_effect_handler_t *lsx_synth_effect_fn(void)
   static sox_effect_handler_t handler = {
     "synth", "[-j KEY] [-n] [length [offset [phase [p1 [p2 [p3]]]]]]] {type [combine] [[%]freq[k][:|+|/|-[%]freq2[k]] [offset [phase [p1 [p2 [p3]]]]]]}",
     SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_GAIN,
-    getopts, start, flow, 0, stop, lsx_kill, sizeof(priv_t)
+    getopts, start, flow, 0, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -31,11 +31,16 @@ typedef struct {
   size_t overlap;        /* In wide samples */
 
   size_t process_size;   /* # input wide samples needed to process 1 segment */
+  sox_bool use_match;    /* Whether the linear search is by lsx_match */
+  sox_bool downmix;      /* Whether to search on the channels' sum */
 
   /* Buffers: */
   fifo_t input_fifo;
   float * overlap_buf;
+  float * mix_win;       /* The search window, downmixed */
+  float * mix_overlap;   /* overlap_buf, downmixed */
   fifo_t output_fifo;
+  lsx_match_t match;
 
   /* Counters: */
   uint64_t samples_in;
@@ -56,28 +61,56 @@ static float difference(const float * a, const float * b, size_t length)
   return diff;
 }
 
+/* Sums the channels of n wide samples, to search on (with -d) */
+static void downmix(tempo_t * t, float const * in, float * out, size_t n)
+{
+  size_t i, j;
+
+  for (i = 0; i < n; ++i, in += t->channels) {
+    float sum = in[0];
+    for (j = 1; j < t->channels; ++j)
+      sum += in[j];
+    out[i] = sum;
+  }
+}
+
 /* Find where the two segments are most alike over the overlap period. */
 static size_t tempo_best_overlap_position(tempo_t * t, float const * new_win)
 {
-  float * f = t->overlap_buf;
+  float const * f = t->overlap_buf;
+  size_t chans = t->channels;
   size_t j, best_pos, prev_best_pos = (t->search + 1) >> 1, step = 64;
   size_t i = best_pos = t->quick_search? prev_best_pos : 0;
-  float diff, least_diff = difference(new_win + t->channels * i, f, t->channels * t->overlap);
+  float diff, least_diff;
   int k = 0;
 
+  if (t->downmix) {  /* So that the cost is as for one channel */
+    downmix(t, new_win, t->mix_win, max(t->search, 1) - 1 + t->overlap);
+    new_win = t->mix_win, f = t->mix_overlap, chans = 1;
+  }
+  least_diff = difference(new_win + chans * i, f, chans * t->overlap);
+
   if (t->quick_search) do { /* hierarchical search */
     for (k = -1; k <= 1; k += 2) for (j = 1; j < 4 || step == 64; ++j) {
       i = prev_best_pos + k * j * step;
       if ((int)i < 0 || i >= t->search)
         break;
-      diff = difference(new_win + t->channels * i, f, t->channels * t->overlap);
+      diff = difference(new_win + chans * i, f, chans * t->overlap);
       if (diff < least_diff)
         least_diff = diff, best_pos = i;
     }
     prev_best_pos = best_pos;
   } while (step >>= 2);
+  else if (t->use_match) {   /* linear search, all positions at once */
+    size_t n = chans * t->overlap;
+    for (j = 0; j < (t->search - 1) * chans + n; ++j)
+      t->match.x[j] = new_win[j];
+    for (j = 0; j < n; ++j)
+      t->match.y[j] = f[j];
+    best_pos = lsx_match(&t->match);
+  }
   else for (i = 1; i < t->search; i++) { /* linear search */
-    diff = difference(new_win + t->channels * i, f, t->channels * t->overlap);
+    diff = difference(new_win + chans * i, f, chans * t->overlap);
     if (diff < least_diff)
       least_diff = diff, best_pos = i;
   }
@@ -124,6 +157,8 @@ static void tempo_process(tempo_t * t)
            (float *) fifo_read_ptr(&t->input_fifo) +
            t->channels * (offset + t->segment - t->overlap),
            t->channels * t->overlap * sizeof(*(t->overlap_buf)));
+    if (t->downmix)
+      downmix(t, t->overlap_buf, t->mix_overlap, t->overlap);
 
     /* Advance through the input stream */
     skip = t->factor * (++t->segments_total * (t->segment - t->overlap)) + 0.5;
@@ -132,6 +167,18 @@ static void tempo_process(tempo_t * t)
   }
 }
 
+/* The input that can be taken now without either FIFO going over its cap
+ * (see sox_globals_t.fifo_max), but at least 1 so as to progress */
+static size_t tempo_room(tempo_t const * t, size_t n)
+{
+  double out_room = fifo_room(&t->output_fifo) * t->factor;
+
+  n = min(n, fifo_room(&t->input_fifo));
+  if (out_room < n)
+    n = out_room;
+  return max(n, 1);
+}
+
 static float * tempo_input(tempo_t * t, float const * samples, size_t n)
 {
   t->samples_in += n;
@@ -164,11 +211,13 @@ static void tempo_flush(tempo_t * t)
 }
 
 static void tempo_setup(tempo_t * t,
-  double sample_rate, sox_bool quick_search, double factor,
+  double sample_rate, sox_bool quick_search, sox_bool downmix, double factor,
   double segment_ms, double search_ms, double overlap_ms)
 {
-  size_t max_skip;
+  size_t max_skip, chans;
   t->quick_search = quick_search;
+  t->downmix = downmix && t->channels > 1;
+  chans = t->downmix? 1 : t->channels;
   t->factor = factor;
   t->segment = sample_rate * segment_ms / 1000 + .5;
   t->search  = sample_rate * search_ms / 1000 + .5;
@@ -177,6 +226,17 @@ static void tempo_setup(tempo_t * t,
   if (t->overlap * 2 > t->segment)
     t->overlap -= 8;
   t->overlap_buf = lsx_malloc(t->overlap * t->channels * sizeof(*t->overlap_buf));
+  if (t->downmix) {
+    t->mix_win = lsx_malloc((t->search + t->overlap) * sizeof(*t->mix_win));
+    t->mix_overlap = lsx_malloc(t->overlap * sizeof(*t->mix_overlap));
+  }
+  if (!quick_search && t->search > 1) {
+    lsx_match_create(&t->match, chans * t->overlap, t->search, chans);
+    t->use_match = t->search * chans * t->overlap >
+      (size_t)t->match.dft_length * 16; /* Roughly, where DFT is faster */
+    if (!t->use_match)
+      lsx_match_delete(&t->match);
+  }
   max_skip = ceil(factor * (t->segment - t->overlap));
   t->process_size = max(max_skip + t->overlap, t->segment) + t->search;
   memset(fifo_reserve(&t->input_fifo, t->search / 2), 0, (t->search / 2) * t->channels * sizeof(float));
@@ -184,7 +244,14 @@ static void tempo_setup(tempo_t * t,
 
 static void tempo_delete(tempo_t * t)
 {
+  lsx_debug("FIFOs' high-water marks: input %lu, output %lu bytes",
+      (unsigned long)t->input_fifo.high_water,
+      (unsigned long)t->output_fifo.high_water);
   free(t->overlap_buf);
+  free(t->mix_win);
+  free(t->mix_overlap);
+  if (t->use_match)
+    lsx_match_delete(&t->match);
   fifo_delete(&t->output_fifo);
   fifo_delete(&t->input_fifo);
   free(t);
@@ -203,7 +270,7 @@ static tempo_t * tempo_create(size_t channels)
 
 typedef struct {
   tempo_t     * tempo;
-  sox_bool    quick_search;
+  sox_bool    quick_search, downmix;
   double      factor, segment_ms, search_ms, overlap_ms;
 } priv_t;
 
@@ -217,11 +284,12 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   static const double searches_div[] = {5.587, 6,  2.14, 2};
   int c;
   lsx_getopt_t optstate;
-  lsx_getopt_init(argc, argv, "+qmls", NULL, lsx_getopt_flag_none, 1, &optstate);
+  lsx_getopt_init(argc, argv, "+qdmls", NULL, lsx_getopt_flag_none, 1, &optstate);
 
   p->segment_ms = p->search_ms = p->overlap_ms = HUGE_VAL;
   while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
     case 'q': p->quick_search  = sox_true;   break;
+    case 'd': p->downmix       = sox_true;   break;
     case 'm': profile = Music; break;
     case 's': profile = Speech; break;
     case 'l': profile = Linear; p->search_ms = 0; break;
@@ -256,8 +324,12 @@ static int start(sox_effect_t * effp)
     return SOX_EFF_NULL;
 
   p->tempo = tempo_create((size_t)effp->in_signal.channels);
-  tempo_setup(p->tempo, effp->in_signal.rate, p->quick_search, p->factor,
+  tempo_setup(p->tempo, effp->in_signal.rate, p->quick_search, p->downmix, p->factor,
       p->segment_ms, p->search_ms, p->overlap_ms);
+  fifo_limit(&p->tempo->input_fifo, effp->global_info->global_info->fifo_max,
+      2 * p->tempo->process_size);
+  fifo_limit(&p->tempo->output_fifo, effp->global_info->global_info->fifo_max,
+      2 * p->tempo->segment);
 
   effp->out_signal.length = SOX_UNKNOWN_LEN;
   if (effp->in_signal.length != SOX_UNKNOWN_LEN) {
@@ -281,8 +353,9 @@ static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
     *obuf++ = SOX_FLOAT_32BIT_TO_SAMPLE(*s++, effp->clips);
 
   if (*isamp && odone < *osamp) {
-    float * t = tempo_input(p->tempo, NULL, *isamp / effp->in_signal.channels);
-    for (i = *isamp; i; --i)
+    size_t n = tempo_room(p->tempo, *isamp / effp->in_signal.channels);
+    float * t = tempo_input(p->tempo, NULL, n);
+    for (i = *isamp = n * effp->in_signal.channels; i; --i)
       *t++ = SOX_SAMPLE_TO_FLOAT_32BIT(*ibuf++, effp->clips);
     tempo_process(p->tempo);
   }
@@ -310,9 +383,10 @@ static int stop(sox_effect_t * effp)
 sox_effect_handler_t const * lsx_tempo_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "tempo", "[-q] [-m | -s | -l] factor [segment-ms [search-ms [overlap-ms]]]",
+    "tempo", "[-q] [-d] [-m | -s | -l] factor [segment-ms [search-ms [overlap-ms]]]",
     SOX_EFF_MCHAN | SOX_EFF_LENGTH,
-    getopts, start, flow, drain, stop, NULL, sizeof(priv_t)
+    getopts, start, flow, drain, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   return &handler;
 }
@@ -323,7 +397,10 @@ static int pitch_getopts(sox_effect_t * effp, int argc, char **argv)
 {
   double d;
   char dummy, arg[100], **argv2 = lsx_malloc(argc * sizeof(*argv2));
-  int result, pos = (argc > 1 && !strcmp(argv[1], "-q"))? 2 : 1;
+  int result, pos = 1;
+
+  while (pos < argc && (!strcmp(argv[pos], "-q") || !strcmp(argv[pos], "-d")))
+    ++pos;
 
   if (argc <= pos || sscanf(argv[pos], "%lf %c", &d, &dummy) != 1)
     return lsx_usage(effp);
@@ -351,7 +428,7 @@ sox_effect_handler_t const * lsx_pitch_effect_fn(void)
   static sox_effect_handler_t handler;
   handler = *lsx_tempo_effect_fn();
   handler.name = "pitch";
-  handler.usage = "[-q] shift-in-cents [segment-ms [search-ms [overlap-ms]]]",
+  handler.usage = "[-q] [-d] shift-in-cents [segment-ms [search-ms [overlap-ms]]]",
   handler.getopts = pitch_getopts;
   handler.start = pitch_start;
   handler.flags &= ~SOX_EFF_LENGTH;
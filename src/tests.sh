@@ -259,6 +259,24 @@ else
 fi
 rm output.u8
 
+# Changes through --control are ramped in, then as if given from the start
+echo "vol 0.5" > control.txt
+echo "equalizer 1k 1q 6" >> control.txt
+${bindir}/sox${EXEEXT} -R --control control.txt -c 1 -r 8000 -n output.s32 synth 2 sine 300 vol 1 equalizer 1k 1q 0
+${bindir}/sox${EXEEXT} -R -c 1 -r 8000 -n input.s32 synth 2 sine 300 vol 0.5 equalizer 1k 1q 6
+${bindir}/sox${EXEEXT} -r 8000 -c 1 output.s32 output-tail.s32 trim 0.1
+${bindir}/sox${EXEEXT} -r 8000 -c 1 input.s32 input-tail.s32 trim 0.1
+if cmp -s input.s32 output.s32; then
+  echo "*FAIL* control (not ramped)"
+  exit 1
+elif cmp -s input-tail.s32 output-tail.s32; then
+  echo "ok     control"
+else
+  echo "*FAIL* control"
+  exit 1
+fi
+rm -f control.txt input.s32 output.s32 input-tail.s32 output-tail.s32
+
 echo "Checked $vectors vectors"
 
 channels=2
@@ -0,0 +1,66 @@
+/* libSoX thread budget: bounds the threads that libSoX has busy at once
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Every parallel region in libSoX (effects' channels, codecs' blocks and
+ * channels, the helpers of a chain: branches, decode-ahead, I/O) takes its
+ * threads from here before it forks, and gives them back once joined.  The
+ * threads themselves are the OpenMP runtime's, which it keeps pooled and
+ * reuses from region to region; what is kept here is how many of them, in
+ * the whole process, are lent to regions at once (beyond the threads that
+ * fork them, which are already counted, or are the client's).  With the
+ * context's threads setting N (sox --threads N), that is at most N - 1, so
+ * at most N threads are busy however regions nest or run side by side; a
+ * region that finds the budget spent runs with fewer threads, or none but
+ * its caller's.  With N = 0 (the default), regions are not held back. */
+
+#include "sox_i.h"
+
+static size_t lent; /* Threads lent to regions, beyond those that forked them */
+
+size_t lsx_threads_take(sox_context_t const * context, size_t n)
+{
+  size_t more = 0;
+
+  if (n < 2 || !context->threads)
+    return max(n, 1);
+  #pragma omp critical (lsx_threads)
+  {
+    if (lent + 1 < context->threads)
+      more = min(n - 1, context->threads - 1 - lent);
+    lent += more;
+  }
+  return more + 1;
+}
+
+size_t lsx_threads_for(sox_context_t const * context, size_t items)
+{
+  return lsx_threads_take(context, min(items, (size_t)omp_get_max_threads()));
+}
+
+size_t lsx_effect_threads(sox_effect_t const * effp, size_t items)
+{
+  sox_context_t const * context = effp->global_info->global_info;
+  return context->use_threads? lsx_threads_for(context, items) : 1;
+}
+
+void lsx_threads_give(sox_context_t const * context, size_t n)
+{
+  if (n < 2 || !context->threads)
+    return;
+  #pragma omp critical (lsx_threads)
+  lent -= n - 1;
+}
@@ -15,33 +15,141 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+/* The gain is a sine LFO, (1 - depth) + depth * (1 + sin) / 2, computed a
+ * block of frames at a time and applied to all channels alike; the sine is
+ * read from a table, with a fixed-point phase accumulator, exactly as synth
+ * (that tremolo once ran as: synth sine fmod speed 100-depth/2 25) makes it,
+ * so that the output is unchanged. */
+
 #include "sox_i.h"
 
+#define SINE_BITS  13
+#define SINE_LEN   (1 << SINE_BITS)
+#define BLOCK      1024                 /* Frames */
+
+typedef struct {
+  double speed, depth;
+
+  double offset, * sine_table, gain;
+  uint64_t phase_acc, phase_inc;        /* 0.64 fixed-point */
+  double block[BLOCK];
+} priv_t;
+
 static int getopts(sox_effect_t * effp, int argc, char * * argv)
 {
-  double speed, depth = 40;
+  priv_t * p = (priv_t *)effp->priv;
   char dummy;     /* To check for extraneous chars. */
-  char offset[100];
-  char * args[] = {0, "sine", "fmod", 0, 0, "25"};
 
+  p->depth = 40;
   if (argc < 2 || argc > 3 ||
-      sscanf(argv[1], "%lf %c", &speed, &dummy) != 1 || speed < 0 ||
-      (argc > 2 && sscanf(argv[2], "%lf %c", &depth, &dummy) != 1) ||
-      depth <= 0 || depth > 100)
+      sscanf(argv[1], "%lf %c", &p->speed, &dummy) != 1 || p->speed < 0 ||
+      (argc > 2 && sscanf(argv[2], "%lf %c", &p->depth, &dummy) != 1) ||
+      p->depth <= 0 || p->depth > 100)
     return lsx_usage(effp);
-  args[0] = argv[0];
-  args[3] = argv[1];
-  sprintf(offset, "%g", 100 - depth / 2);
-  args[4] = offset;
-  return lsx_synth_effect_fn()->getopts(effp, (int)array_length(args), args);
+  return SOX_SUCCESS;
+}
+
+#define to_fixed(x) ((uint64_t)ldexp(x, 64)) /* [0, 1) to 0.64 fixed-point */
+
+static int flow_float(sox_effect_t *, float const *, float *, size_t *, size_t *);
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  int i;
+
+  p->offset = (100 - p->depth / 2) / 100;
+  p->phase_inc = to_fixed(fmod(p->speed / effp->in_signal.rate, 1.));
+  /* Rounded up, so that a whole number of cycles wraps round to 0: */
+  p->phase_inc += p->phase_inc >> 52;
+  p->phase_acc = to_fixed(.25);
+  p->sine_table = lsx_malloc(2 * SINE_LEN * sizeof(*p->sine_table));
+  for (i = 0; i < SINE_LEN; ++i)
+    p->sine_table[2 * i] = sin(2 * M_PI * i / SINE_LEN);
+  for (i = 0; i < SINE_LEN; ++i)  /* Each point with the step to the next */
+    p->sine_table[2 * i + 1] = (i + 1 < SINE_LEN?
+        p->sine_table[2 * i + 2] : 0) - p->sine_table[2 * i];
+  p->gain = 1;
+  effp->out_signal.mult = &p->gain;
+  effp->flow_float = flow_float;
+  return SOX_SUCCESS;
+}
+
+/* Fills the block with the next n (at most BLOCK) frames' gains */
+static void lfo(priv_t * p, size_t n)
+{
+  double mult = 1 - p->offset, offset = p->offset;
+  double const * t = p->sine_table;
+  uint64_t acc = p->phase_acc, inc = p->phase_inc;
+  size_t i;
+
+  for (i = 0; i < n; ++i, acc += inc) {
+    double const * q = t + 2 * (acc >> (64 - SINE_BITS));
+    double s = q[0] + q[1] * ((uint32_t)(acc >> (32 - SINE_BITS)) *
+        (1. / 4294967296.));
+    p->block[i] = s * mult + offset;
+  }
+  p->phase_acc = acc;
+}
+
+static int flow(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, c, i, n;
+  size_t len = min(*isamp, *osamp) / chans, done;
+
+  for (done = 0; done < len; done += n) {
+    n = min(len - done, BLOCK);
+    lfo(p, n);
+    for (c = 0; c < chans; ++c) {
+      sox_sample_t const * in = ibuf + done * chans + c;
+      sox_sample_t * out = obuf + done * chans + c;
+      for (i = 0; i < n; ++i) {
+        double x = p->block[i] * in[i * chans] * p->gain;
+        out[i * chans] = x < 0? x - .5 : x + .5;
+      }
+    }
+  }
+  *isamp = *osamp = len * chans;
+  return SOX_SUCCESS;
+}
+
+static int flow_float(sox_effect_t * effp, float const * ibuf, float * obuf,
+    size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels, c, i, n;
+  size_t len = min(*isamp, *osamp) / chans, done;
+
+  for (done = 0; done < len; done += n) {
+    n = min(len - done, BLOCK);
+    lfo(p, n);
+    for (i = 0; i < n; ++i)
+      p->block[i] *= p->gain;
+    for (i = 0; i < n; ++i, ibuf += chans, obuf += chans)
+      for (c = 0; c < chans; ++c)
+        obuf[c] = ibuf[c] * (float)p->block[i];
+  }
+  *isamp = *osamp = len * chans;
+  return SOX_SUCCESS;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  free(p->sine_table);
+  p->sine_table = NULL;
+  return SOX_SUCCESS;
 }
 
 sox_effect_handler_t const * lsx_tremolo_effect_fn(void)
 {
-  static sox_effect_handler_t handler;
-  handler = *lsx_synth_effect_fn();
-  handler.name = "tremolo";
-  handler.usage = "speed_Hz [depth_percent]";
-  handler.getopts = getopts;
+  static sox_effect_handler_t handler = {"tremolo",
+    "speed_Hz [depth_percent]", SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_RTSAFE,
+    getopts, start, flow, NULL, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
+  };
   return &handler;
 }
@@ -187,9 +187,9 @@ sox_effect_handler_t const *lsx_trim_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
     "trim", "{position}",
-    SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_MODIFY,
+    SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_MODIFY | SOX_EFF_RTSAFE,
     parse, start, flow, drain, NULL, lsx_kill,
-    sizeof(priv_t)
+    sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -214,3 +214,11 @@ void sox_trim_clear_start(sox_effect_t *effp)
     priv_t *p = (priv_t*) effp->priv;
     p->samples_read = p->num_pos ? p->pos[0].sample : 0;
 }
+
+/* As sox_trim_clear_start, but for input sought to the given wide sample,
+ * at or before the start (see sox_effects_chain_seek) */
+void lsx_trim_set_read(sox_effect_t *effp, uint64_t wide)
+{
+    priv_t *p = (priv_t*) effp->priv;
+    p->samples_read = wide;
+}
@@ -376,7 +376,7 @@ LSX_FORMAT_HANDLER(txw)
     "Yamaha TX-16W sampler", names, SOX_FILE_MONO,
     startread, read_samples, NULL,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, write_rates, sizeof(priv_t)
+    NULL, write_encodings, write_rates, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
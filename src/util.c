@@ -46,6 +46,16 @@ int lsx_strncasecmp(char const * s1, char const * s2, size_t n)
 #endif
 }
 
+/* FNV-1a, of the name as lower-case, for tables looked up with strcasecmp */
+unsigned lsx_hash_name(char const * name)
+{
+  uint32_t hash = 2166136261u;
+
+  for (; *name; ++name)
+    hash = (hash ^ (unsigned char)tolower((unsigned char)*name)) * 16777619u;
+  return hash;
+}
+
 sox_bool lsx_strends(char const * str, char const * end)
 {
   size_t str_len = strlen(str), end_len = strlen(end);
@@ -116,8 +126,8 @@ int lsx_enum_option(int c, char const * arg, lsx_enum_item const * items)
 char const * lsx_sigfigs3(double number)
 {
   static char const symbols[] = "\0kMGTPEZY";
-  static char string[16][10];   /* FIXME: not thread-safe */
-  static unsigned n;            /* ditto */
+  static LSX_THREAD_LOCAL char string[16][10];
+  static LSX_THREAD_LOCAL unsigned n;
   unsigned a, b, c;
   sprintf(string[n = (n+1) & 15], "%#.3g", number);
   switch (sscanf(string[n], "%u.%ue%u", &a, &b, &c)) {
@@ -135,8 +145,8 @@ char const * lsx_sigfigs3(double number)
 
 char const * lsx_sigfigs3p(double percentage)
 {
-  static char string[16][10];
-  static unsigned n;
+  static LSX_THREAD_LOCAL char string[16][10];
+  static LSX_THREAD_LOCAL unsigned n;
   sprintf(string[n = (n+1) & 15], "%.1f%%", percentage);
   if (strlen(string[n]) < 5)
     sprintf(string[n], "%.2f%%", percentage);
@@ -164,16 +174,13 @@ int lsx_open_dllibrary(
   const char* failed_funcname = NULL;
 
 #ifdef HAVE_LIBLTDL
-  if (library_names && library_names[0])
+  int ltdl_failed = 0;
+
+  /* ltdl's state is global, so it is used by one thread at a time */
+  #pragma omp critical(lsx_ltdl)
+  if (library_names && library_names[0] && !(ltdl_failed = lt_dlinit() != 0))
   {
     const char* const* libname;
-    if (lt_dlinit())
-    {
-      lsx_fail(
-        "Unable to load %s - failed to initialize ltdl.",
-        library_description);
-      return 1;
-    }
 
     for (libname = library_names; *libname; libname++)
     {
@@ -211,6 +218,13 @@ int lsx_open_dllibrary(
     if (!dl)
       lt_dlexit();
   }
+  if (ltdl_failed)
+  {
+    lsx_fail(
+      "Unable to load %s - failed to initialize ltdl.",
+      library_description);
+    return 1;
+  }
 #endif /* HAVE_LIBLTDL */
 
   if (!dl)
@@ -297,8 +311,11 @@ void lsx_close_dllibrary(
 #ifdef HAVE_LIBLTDL
   if (dl)
   {
-    lt_dlclose(dl);
-    lt_dlexit();
+    #pragma omp critical(lsx_ltdl)
+    {
+      lt_dlclose(dl);
+      lt_dlexit();
+    }
   }
 #endif /* HAVE_LIBLTDL */
 }
@@ -167,6 +167,19 @@
   #define SET_BINARY_MODE(file)
 #endif
 
+/* Nanoseconds of a struct stat's modification and status-change times, where
+ * it has them; else 0 */
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+  #define ST_MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+  #define ST_CTIME_NSEC(st) ((st).st_ctim.tv_nsec)
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+  #define ST_MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+  #define ST_CTIME_NSEC(st) ((st).st_ctimespec.tv_nsec)
+#else
+  #define ST_MTIME_NSEC(st) 0
+  #define ST_CTIME_NSEC(st) 0
+#endif
+
 #ifdef WORDS_BIGENDIAN
   #define MACHINE_IS_BIGENDIAN 1
   #define MACHINE_IS_LITTLEENDIAN 0
@@ -225,6 +238,7 @@
 
 extern int lsx_strcasecmp(const char *s1, const char *st);
 extern int lsx_strncasecmp(char const *s1, char const *s2, size_t n);
+extern unsigned lsx_hash_name(char const * name);
 
 #ifndef HAVE_STRCASECMP
 #define strcasecmp(s1, s2) lsx_strcasecmp((s1), (s2))
@@ -19,7 +19,8 @@
 #include <string.h>
 
 typedef struct {
-  double    * dftBuf, * noiseSpectrum, * spectrum, * measures, meanMeas;
+  float     * dftBuf, * noiseSpectrum, * spectrum;
+  double    * measures, meanMeas;
 } chan_t;
 
 typedef struct {                /* Configuration parameters: */
@@ -36,8 +37,14 @@ typedef struct {                /* Configuration parameters: */
   int       bootCountMax, bootCount;
   double    noiseTcUpMult, noiseTcDownMult;
   double    measureTcMult, triggerMeasTcMult;
-  double    * spectrumWindow, * cepstrumWindow;
+  float     * spectrumWindow, * cepstrumWindow;
   chan_t    * channels;
+  char      * indexName;        /* -o: where the audio would start, instead */
+  lsx_segments_t index;
+  uint64_t  pos_ns;             /* Input samples so far */
+  sox_bool  hasTriggered;
+  uint64_t  indexStart;         /* Wide sample at which the audio would start */
+  double    indexPeak, indexSum2;
 } priv_t;
 
 #define GETOPT_FREQ(optstate, c, name, min) \
@@ -48,7 +55,7 @@ typedef struct {                /* Configuration parameters: */
 static int create(sox_effect_t * effp, int argc, char * * argv)
 {
   priv_t * p = (priv_t *)effp->priv;
-  #define opt_str "+b:N:n:r:f:m:M:h:l:H:L:T:t:s:g:p:"
+  #define opt_str "+b:N:n:r:f:m:M:h:l:H:L:T:t:s:g:p:o:"
   int c;
   lsx_getopt_t optstate;
   lsx_getopt_init(argc, argv, opt_str, NULL, lsx_getopt_flag_none, 1, &optstate);
@@ -91,11 +98,17 @@ static int create(sox_effect_t * effp, int argc, char * * argv)
     GETOPT_NUMERIC(optstate, 's', searchTime    ,  .1 , 4)
     GETOPT_NUMERIC(optstate, 'g', gapTime       ,  .1 , 1)
     GETOPT_NUMERIC(optstate, 'p', preTriggerTime,   0 , 4)
+    case 'o': free(p->indexName); p->indexName = lsx_strdup(optstate.arg); break;
     default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
   }
   return optstate.ind !=argc? lsx_usage(effp) : SOX_SUCCESS;
 }
 
+static int flowTrigger(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * ilen, size_t * olen);
+static int flowIndex(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * ilen, size_t * olen);
+
 static int start(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
@@ -131,7 +144,7 @@ static int start(sox_effect_t * effp)
   lsx_Calloc(p->spectrumWindow, p->measureLen_ws);
   for (i = 0; i < p->measureLen_ws; ++i)
     p->spectrumWindow[i] = -2./ SOX_SAMPLE_MIN / sqrt((double)p->measureLen_ws);
-  lsx_apply_hann(p->spectrumWindow, (int)p->measureLen_ws);
+  lsx_apply_hann_f(p->spectrumWindow, (int)p->measureLen_ws);
 
   p->spectrumStart = p->hpFilterFreq / effp->in_signal.rate * p->dftLen_ws + .5;
   p->spectrumStart = max(p->spectrumStart, 1);
@@ -141,7 +154,7 @@ static int start(sox_effect_t * effp)
   lsx_Calloc(p->cepstrumWindow, p->spectrumEnd - p->spectrumStart);
   for (i = 0; i < p->spectrumEnd - p->spectrumStart; ++i)
     p->cepstrumWindow[i] = 2 / sqrt((double)p->spectrumEnd - p->spectrumStart);
-  lsx_apply_hann(p->cepstrumWindow,(int)(p->spectrumEnd - p->spectrumStart));
+  lsx_apply_hann_f(p->cepstrumWindow,(int)(p->spectrumEnd - p->spectrumStart));
 
   p->cepstrumStart = ceil(effp->in_signal.rate * .5 / p->lpLifterFreq);
   p->cepstrumEnd  = floor(effp->in_signal.rate * .5 / p->hpLifterFreq);
@@ -159,6 +172,16 @@ static int start(sox_effect_t * effp)
   p->bootCount = p->measuresIndex = p->flushedLen_ns = p->samplesIndex_ns = 0;
 
   effp->out_signal.length = SOX_UNKNOWN_LEN; /* depends on input data */
+  p->pos_ns = 0;
+  p->hasTriggered = sox_false;
+  if (p->indexName) {
+    /* Just note where the audio starts, and pass it all on in place */
+    effp->out_signal.length = effp->in_signal.length;
+    effp->handler.flags |= SOX_EFF_INPLACE;
+    effp->handler.flow = flowIndex;
+    return lsx_segments_open(effp, &p->index, p->indexName);
+  }
+  effp->handler.flow = flowTrigger;
   return SOX_SUCCESS;
 }
 
@@ -184,31 +207,34 @@ static int flowFlush(sox_effect_t * effp, sox_sample_t const * ibuf,
   return SOX_SUCCESS;
 }
 
+/* Single precision suffices for the measurement, which ends in a log */
 static double measure(
     priv_t * p, chan_t * c, size_t index_ns, unsigned step_ns, int bootCount)
 {
-  double mult, result = 0;
+  float mult;
+  double result = 0;
   size_t i;
 
   for (i = 0; i < p->measureLen_ws; ++i, index_ns = (index_ns + step_ns) % p->samplesLen_ns)
     c->dftBuf[i] = p->samples[index_ns] * p->spectrumWindow[i];
   memset(c->dftBuf + i, 0, (p->dftLen_ws - i) * sizeof(*c->dftBuf));
-  lsx_safe_rdft((int)p->dftLen_ws, 1, c->dftBuf);
+  lsx_safe_rdft_f((int)p->dftLen_ws, 1, c->dftBuf);
 
   memset(c->dftBuf, 0, p->spectrumStart * sizeof(*c->dftBuf));
+  mult = bootCount >= 0? bootCount / (1.f + bootCount) : p->measureTcMult;
   for (i = p->spectrumStart; i < p->spectrumEnd; ++i) {
-    double d = sqrt(sqr(c->dftBuf[2 * i]) + sqr(c->dftBuf[2 * i + 1]));
-    mult = bootCount >= 0? bootCount / (1. + bootCount) : p->measureTcMult;
+    float d = sqrt(sqr(c->dftBuf[2 * i]) + sqr(c->dftBuf[2 * i + 1]));
+    float mult2;
     c->spectrum[i] = c->spectrum[i] * mult + d * (1 - mult);
     d = sqr(c->spectrum[i]);
-    mult = bootCount >= 0? 0 :
+    mult2 = bootCount >= 0? 0 :
         d > c->noiseSpectrum[i]? p->noiseTcUpMult : p->noiseTcDownMult;
-    c->noiseSpectrum[i] = c->noiseSpectrum[i] * mult + d * (1 - mult);
+    c->noiseSpectrum[i] = c->noiseSpectrum[i] * mult2 + d * (1 - mult2);
     d = sqrt(max(0, d - p->noiseReductionAmount * c->noiseSpectrum[i]));
     c->dftBuf[i] = d * p->cepstrumWindow[i - p->spectrumStart];
   }
   memset(c->dftBuf + i, 0, ((p->dftLen_ws >> 1) - i) * sizeof(*c->dftBuf));
-  lsx_safe_rdft((int)p->dftLen_ws >> 1, 1, c->dftBuf);
+  lsx_safe_rdft_f((int)p->dftLen_ws >> 1, 1, c->dftBuf);
 
   for (i = p->cepstrumStart; i < p->cepstrumEnd; ++i)
     result += sqr(c->dftBuf[2 * i]) + sqr(c->dftBuf[2 * i + 1]);
@@ -222,19 +248,36 @@ static int flowTrigger(sox_effect_t * effp, sox_sample_t const * ibuf,
   priv_t * p = (priv_t *)effp->priv;
   sox_bool hasTriggered = sox_false;
   size_t i, idone = 0, numMeasuresToFlush = 0;
+  unsigned const chans = effp->in_signal.channels;
 
   while (idone < *ilen && !hasTriggered) {
-    p->measureTimer_ns -= effp->in_signal.channels;
-    for (i = 0; i < effp->in_signal.channels; ++i, ++idone) {
-      chan_t * c = &p->channels[i];
-      p->samples[p->samplesIndex_ns++] = *ibuf++;
-      if (!p->measureTimer_ns) {
-        size_t x = (p->samplesIndex_ns + p->samplesLen_ns - p->measureLen_ns) % p->samplesLen_ns;
-        double meas = measure(p, c, x, effp->in_signal.channels, p->bootCount);
+    /* Buffer whole samples up to the next measurement (or buffer wrap) */
+    size_t n = min(*ilen - idone, p->measureTimer_ns);
+    n = min(n, p->samplesLen_ns - p->samplesIndex_ns);
+    n -= n % chans;
+    memcpy(p->samples + p->samplesIndex_ns, ibuf, n * sizeof(*ibuf));
+    ibuf += n, idone += n;
+    p->samplesIndex_ns += n;
+    p->measureTimer_ns -= n;
+
+    if (!p->measureTimer_ns) {
+      /* The channels are independent, so are measured concurrently;
+       * channel i's window ends i + 1 samples into the latest sample. */
+      size_t x = p->samplesIndex_ns + p->samplesLen_ns - chans + 1 - p->measureLen_ns;
+      size_t threads = lsx_effect_threads(effp, (size_t)chans);
+      int j;
+
+      #pragma omp parallel for if(threads > 1) num_threads((int)threads) schedule(static)
+      for (j = 0; j < (int)chans; ++j) {
+        chan_t * c = &p->channels[j];
+        double meas = measure(p, c, (x + j) % p->samplesLen_ns, chans, p->bootCount);
         c->measures[p->measuresIndex] = meas;
         c->meanMeas = c->meanMeas * p->triggerMeasTcMult +
             meas *(1 - p->triggerMeasTcMult);
-
+      }
+      lsx_threads_give(effp->global_info->global_info, threads);
+      for (i = 0; i < chans; ++i) {
+        chan_t * c = &p->channels[i];
         if (hasTriggered |= c->meanMeas >= p->triggerLevel) {
           unsigned n = p->measuresLen, k = p->measuresIndex;
           unsigned j, jTrigger = n, jZero = n;
@@ -246,8 +289,8 @@ static int flowTrigger(sox_effect_t * effp, sox_sample_t const * ibuf,
           j = min(j, jZero);
           numMeasuresToFlush = range_limit(j, numMeasuresToFlush, n);
         }
-        lsx_debug_more("%12g %12g %u",
-            meas, c->meanMeas, (unsigned)numMeasuresToFlush);
+        lsx_debug_more("%12g %12g %u", c->measures[p->measuresIndex],
+            c->meanMeas, (unsigned)numMeasuresToFlush);
       }
     }
     if (p->samplesIndex_ns == p->samplesLen_ns)
@@ -259,8 +302,28 @@ static int flowTrigger(sox_effect_t * effp, sox_sample_t const * ibuf,
       if (p->bootCount >= 0)
         p->bootCount = p->bootCount == p->bootCountMax? -1 : p->bootCount + 1;
     }
+    if (!n && idone < *ilen) /* Part of a sample: hold it over */
+      break;
+  }
+  if (hasTriggered && p->indexName) {
+    /* The audio would start with the held samples not flushed, less any
+     * from before the input's start */
+    size_t held = (p->measuresLen - numMeasuresToFlush) * p->measurePeriod_ns;
+    size_t k;
+
+    held = (size_t)min(p->samplesLen_ns - held, p->pos_ns + idone);
+    k = (p->samplesIndex_ns + p->samplesLen_ns - held) % p->samplesLen_ns;
+    p->indexStart = (p->pos_ns + idone - held) / chans;
+    p->indexPeak = p->indexSum2 = 0;
+    lsx_segments_measure(p->samples + k, min(held, p->samplesLen_ns - k),
+        &p->indexPeak, &p->indexSum2);
+    if (k + held > p->samplesLen_ns)
+      lsx_segments_measure(p->samples, k + held - p->samplesLen_ns,
+          &p->indexPeak, &p->indexSum2);
+    p->hasTriggered = sox_true;
+    *olen = 0;
   }
-  if (hasTriggered) {
+  else if (hasTriggered) {
     size_t ilen1 = *ilen - idone;
     p->flushedLen_ns = (p->measuresLen - numMeasuresToFlush) * p->measurePeriod_ns;
     p->samplesIndex_ns = (p->samplesIndex_ns + p->flushedLen_ns) % p->samplesLen_ns;
@@ -272,6 +335,28 @@ static int flowTrigger(sox_effect_t * effp, sox_sample_t const * ibuf,
   return SOX_SUCCESS;
 }
 
+/* With -o, passes all of its input on, measuring it from where the audio
+ * would start; the one segment ends with the input */
+static int flowIndex(sox_effect_t * effp, sox_sample_t const * ibuf,
+    sox_sample_t * obuf, size_t * ilen, size_t * olen)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t n = min(*ilen, *olen), done = 0, none = 0;
+
+  n -= n % effp->in_signal.channels;
+  if (obuf != ibuf) /* Pass on audio unaffected */
+    memcpy(obuf, ibuf, n * sizeof(*obuf));
+  *ilen = *olen = n;
+  if (!p->hasTriggered) {
+    done = n;
+    flowTrigger(effp, ibuf, NULL, &done, &none);
+  }
+  if (p->hasTriggered)
+    lsx_segments_measure(ibuf + done, n - done, &p->indexPeak, &p->indexSum2);
+  p->pos_ns += n;
+  return SOX_SUCCESS;
+}
+
 static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * olen)
 {
   size_t ilen = 0;
@@ -281,8 +366,16 @@ static int drain(sox_effect_t * effp, sox_sample_t * obuf, size_t * olen)
 static int stop(sox_effect_t * effp)
 {
   priv_t * p = (priv_t *)effp->priv;
+  int result = SOX_SUCCESS;
   unsigned i;
 
+  if (p->indexName && p->index.file) {
+    if (p->hasTriggered)
+      lsx_segments_add(&p->index, p->indexStart,
+          p->pos_ns / effp->in_signal.channels, p->indexPeak, p->indexSum2);
+    result = lsx_segments_close(effp, &p->index);
+  }
+
   for (i = 0; i < effp->in_signal.channels; ++i) {
     chan_t * c = &p->channels[i];
     free(c->measures);
@@ -294,6 +387,14 @@ static int stop(sox_effect_t * effp)
   free(p->cepstrumWindow);
   free(p->spectrumWindow);
   free(p->samples);
+  return result;
+}
+
+static int lsx_kill(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+
+  free(p->indexName);
   return SOX_SUCCESS;
 }
 
@@ -301,7 +402,8 @@ sox_effect_handler_t const * lsx_vad_effect_fn(void)
 {
   static sox_effect_handler_t handler = {"vad", NULL,
     SOX_EFF_MCHAN | SOX_EFF_LENGTH | SOX_EFF_MODIFY,
-    create, start, flowTrigger, drain, stop, NULL, sizeof(priv_t)
+    create, start, flowTrigger, drain, stop, lsx_kill, sizeof(priv_t), NULL,
+    NULL, NULL, NULL
   };
   static char const * lines[] = {
     "[options]",
@@ -310,6 +412,7 @@ sox_effect_handler_t const * lsx_vad_effect_fn(void)
     "\t-s search-time                  (1 s)",
     "\t-g allowed-gap                  (0.25 s)",
     "\t-p pre-trigger-time             (0 s)",
+    "\t-o index-file                   (none)",
     "Advanced options:",
     "\t-b noise-est-boot-time          (0.35 s)",
     "\t-N noise-est-time-constant-up   (0.1 s)",
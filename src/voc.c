@@ -809,7 +809,7 @@ LSX_FORMAT_HANDLER(voc)
     names, SOX_FILE_LIT_END | SOX_FILE_MONO | SOX_FILE_STEREO,
     startread, read_samples, NULL,
     startwrite, write_samples, stopwrite,
-    NULL, write_encodings, NULL, sizeof(priv_t)
+    NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
@@ -15,13 +15,20 @@
 
 #include "sox_i.h"
 
+#define MAX_FUSED 16
+
 typedef struct {
   double    gain; /* amplitude gain. */
+  double    fused_gains[MAX_FUSED]; /* Of following vol effects */
+  size_t    num_fused;
   sox_bool  uselimiter;
   double    limiterthreshhold;
   double    limitergain;
   uint64_t  limited; /* number of limited values to report. */
   uint64_t  totalprocessed;
+  double    gain_step; /* Per frame, while ramping to a new gain */
+  double    new_gain;
+  size_t    ramp;      /* Frames left to ramp */
 } priv_t;
 
 enum {vol_amplitude, vol_dB, vol_power};
@@ -76,6 +83,7 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
       return lsx_usage(effp);
 
     vol->uselimiter = sox_true;
+    effp->handler.flags &= ~(SOX_EFF_LINEAR | SOX_EFF_TIMEINV);
     /* The following equation is derived so that there is no
      * discontinuity in output amplitudes */
     /* and a SOX_SAMPLE_MAX input always maps to a SOX_SAMPLE_MAX output
@@ -88,6 +96,9 @@ static int getopts(sox_effect_t * effp, int argc, char **argv)
   return SOX_SUCCESS;
 }
 
+static int flow_float(sox_effect_t * effp, const float *ibuf, float *obuf,
+                      size_t *isamp, size_t *osamp);
+
 /*
  * Start processing
  */
@@ -95,31 +106,28 @@ static int start(sox_effect_t * effp)
 {
     priv_t * vol = (priv_t *) effp->priv;
 
-    if (vol->gain == 1)
+    if (vol->gain == 1 && !effp->global_info->global_info->updatable)
       return SOX_EFF_NULL;
 
     vol->limited = 0;
     vol->totalprocessed = 0;
+    vol->ramp = 0;
+    if (!vol->uselimiter) /* The limiter works only with sox_sample_t */
+      effp->flow_float = flow_float;
 
     return SOX_SUCCESS;
 }
 
 /*
- * Process data.
+ * Process len samples.
  */
-static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
-                size_t *isamp, size_t *osamp)
+static void process(sox_effect_t * effp, const sox_sample_t *ibuf,
+                    sox_sample_t *obuf, register size_t len)
 {
     priv_t * vol = (priv_t *) effp->priv;
     register double gain = vol->gain;
     register double limiterthreshhold = vol->limiterthreshhold;
     register double sample;
-    register size_t len;
-
-    len = min(*osamp, *isamp);
-
-    /* report back dealt with amount. */
-    *isamp = len; *osamp = len;
 
     if (vol->uselimiter)
     {
@@ -155,13 +163,134 @@ static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obu
     else
     {
         /* quite basic, with clipping */
-        for (;len>0; len--)
+        if (!vol->num_fused) for (;len>0; len--)
         {
                 sample = gain * *ibuf++;
                 SOX_SAMPLE_CLIP_COUNT(sample, effp->clips);
                 *obuf++ = sample;
         }
+        else for (;len>0; len--)
+        {
+                size_t i;
+
+                sample = gain * *ibuf++;
+                SOX_SAMPLE_CLIP_COUNT(sample, effp->clips);
+                for (i = 0; i < vol->num_fused; ++i) {
+                        sample = vol->fused_gains[i] * (sox_sample_t)sample;
+                        SOX_SAMPLE_CLIP_COUNT(sample, effp->clips);
+                }
+                *obuf++ = sample;
+        }
     }
+}
+
+/*
+ * Ramp the gain (see update) over the first n frames.
+ */
+static void advance(priv_t * vol, size_t n)
+{
+    vol->gain += vol->gain_step * n;
+    if (!(vol->ramp -= n))
+        vol->gain = vol->new_gain;
+}
+
+static size_t ramp(sox_effect_t * effp, const sox_sample_t *ibuf,
+                   sox_sample_t *obuf, size_t n)
+{
+    priv_t * vol = (priv_t *) effp->priv;
+    size_t chans = effp->in_signal.channels, c, i;
+    size_t step = effp->planar ? 1 : chans;
+    size_t istride = effp->planar ? lsx_iplane_size(effp) : 1;
+    size_t ostride = effp->planar ? lsx_oplane_size(effp) : 1;
+    double sample;
+
+    for (c = 0; c < chans; ++c)
+        for (i = 0; i < n; ++i) {
+            sample = (vol->gain + vol->gain_step * (i + 1)) *
+                ibuf[c * istride + i * step];
+            SOX_SAMPLE_CLIP_COUNT(sample, effp->clips);
+            obuf[c * ostride + i * step] = sample;
+        }
+    advance(vol, n);
+    return n;
+}
+
+static size_t ramp_float(sox_effect_t * effp, const float *ibuf, float *obuf,
+                         size_t n)
+{
+    priv_t * vol = (priv_t *) effp->priv;
+    size_t chans = effp->in_signal.channels, c, i;
+    size_t step = effp->planar ? 1 : chans;
+    size_t istride = effp->planar ? lsx_iplane_size(effp) : 1;
+    size_t ostride = effp->planar ? lsx_oplane_size(effp) : 1;
+
+    for (c = 0; c < chans; ++c)
+        for (i = 0; i < n; ++i)
+            obuf[c * ostride + i * step] =
+                (vol->gain + vol->gain_step * (i + 1)) *
+                ibuf[c * istride + i * step];
+    advance(vol, n);
+    return n;
+}
+
+/*
+ * Process data.
+ */
+static int flow(sox_effect_t * effp, const sox_sample_t *ibuf, sox_sample_t *obuf,
+                size_t *isamp, size_t *osamp)
+{
+    priv_t * vol = (priv_t *) effp->priv;
+    size_t chans = effp->in_signal.channels;
+    size_t len = min(*osamp, *isamp), n = 0;
+
+    if (vol->ramp)
+        n = ramp(effp, ibuf, obuf, min(vol->ramp, len / chans));
+    if (effp->planar) { /* Each channel's samples are in a buffer of its own */
+        size_t istride = lsx_iplane_size(effp), ostride = lsx_oplane_size(effp);
+        size_t c;
+
+        len /= chans;
+        for (c = 0; c < chans; ++c)
+            process(effp, ibuf + c * istride + n, obuf + c * ostride + n, len - n);
+        len *= chans;
+    }
+    else process(effp, ibuf + n * chans, obuf + n * chans, len - n * chans);
+
+    /* report back dealt with amount. */
+    *isamp = len; *osamp = len;
+    return SOX_SUCCESS;
+}
+
+/*
+ * Process float data (without the limiter); clipping is left to the chain.
+ */
+static int flow_float(sox_effect_t * effp, const float *ibuf, float *obuf,
+                      size_t *isamp, size_t *osamp)
+{
+    priv_t * vol = (priv_t *) effp->priv;
+    float gain = vol->gain;
+    size_t chans = effp->planar ? effp->in_signal.channels : 1;
+    size_t istride = effp->planar ? lsx_iplane_size(effp) : 0;
+    size_t ostride = effp->planar ? lsx_oplane_size(effp) : 0;
+    size_t len = min(*osamp, *isamp) / chans, c, i, j, n = 0;
+
+    if (vol->ramp) {
+        n = ramp_float(effp, ibuf, obuf,
+            min(vol->ramp, len * chans / effp->in_signal.channels));
+        n *= effp->planar ? 1 : effp->in_signal.channels;
+        gain = vol->gain;
+    }
+    for (c = 0; c < chans; ++c)
+        for (i = n; i < len; ++i)
+            obuf[c * ostride + i] = gain * ibuf[c * istride + i];
+    for (j = 0; j < vol->num_fused; ++j) {
+        gain = vol->fused_gains[j];
+        for (c = 0; c < chans; ++c)
+            for (i = 0; i < len; ++i)
+                obuf[c * ostride + i] = gain * obuf[c * ostride + i];
+    }
+
+    *isamp = *osamp = len * chans;
     return SOX_SUCCESS;
 }
 
@@ -175,10 +304,63 @@ static int stop(sox_effect_t * effp)
   return SOX_SUCCESS;
 }
 
+static int reset(sox_effect_t * effp)
+{
+  priv_t * vol = (priv_t *) effp->priv;
+  stop(effp); /* Reports on the run just done */
+  vol->limited = vol->totalprocessed = 0;
+  return SOX_SUCCESS;
+}
+
+/*
+ * Change the gain while running: ramped in, unless with the limiter.
+ */
+static int update(sox_effect_t * effp, int argc, char **argv)
+{
+  priv_t * vol = (priv_t *) effp->priv, new_vol = *vol;
+  sox_effect_t e = *effp;
+
+  e.priv = &new_vol;
+  if (getopts(&e, argc, argv) != SOX_SUCCESS)
+    return SOX_EOF;
+  if (new_vol.uselimiter != vol->uselimiter || vol->num_fused) {
+    lsx_fail("can't change the limiter, or a fused gain, while running");
+    return SOX_EOF;
+  }
+  if (vol->uselimiter) {
+    vol->gain = new_vol.gain;
+    vol->limitergain = new_vol.limitergain;
+    vol->limiterthreshhold = new_vol.limiterthreshhold;
+  } else {
+    vol->new_gain = new_vol.gain;
+    vol->ramp = lsx_update_ramp(effp);
+    vol->gain_step = (vol->new_gain - vol->gain) / vol->ramp;
+  }
+  return SOX_SUCCESS;
+}
+
+/* A vol following another (neither with a limiter) is applied in the same
+ * pass, each gain still followed by clipping (and, with integer samples,
+ * truncation) as though a separate effect, so the result is unchanged. */
+sox_bool lsx_vol_fuse(sox_effects_chain_t * chain, sox_effect_t * effp)
+{
+  sox_effect_t * last = chain->length? chain->effects[chain->length - 1] : NULL;
+  priv_t * p, * q = (priv_t *)effp->priv;
+
+  if (!last || last->handler.start != start || effp->handler.start != start)
+    return sox_false;
+  p = (priv_t *)last->priv;
+  if (p->uselimiter || q->uselimiter || p->num_fused == MAX_FUSED)
+    return sox_false;
+  p->fused_gains[p->num_fused++] = q->gain;
+  return sox_true;
+}
+
 sox_effect_handler_t const * lsx_vol_effect_fn(void)
 {
   static sox_effect_handler_t handler = {
-    "vol", vol_usage, SOX_EFF_MCHAN | SOX_EFF_GAIN, getopts, start, flow, 0, stop, 0, sizeof(priv_t)
+    "vol", vol_usage, SOX_EFF_MCHAN | SOX_EFF_GAIN | SOX_EFF_PLANAR | SOX_EFF_SEEK | SOX_EFF_INPLACE | SOX_EFF_LINEAR | SOX_EFF_TIMEINV | SOX_EFF_RTSAFE, getopts, start, flow, 0, stop, 0, sizeof(priv_t), reset,
+    NULL, NULL, update
   };
   return &handler;
 }
@@ -31,6 +31,16 @@ size_t lsx_vox_read(sox_format_t * ft, sox_sample_t *buffer, size_t len)
   return lsx_adpcm_read(ft, (adpcm_io_t *)ft->priv, buffer, len);
 }
 
+int lsx_vox_seek(sox_format_t * ft, uint64_t offset)
+{
+  adpcm_io_t * state = (adpcm_io_t *)ft->priv;
+  int result = lsx_rawseek(ft, offset);
+
+  if (result == SOX_SUCCESS)   /* To a whole byte & frame */
+    state->store.flag = 0, state->lane = 0;
+  return result;
+}
+
 int lsx_vox_stopread(sox_format_t * ft)
 {
   return lsx_adpcm_stopread(ft, (adpcm_io_t *)ft->priv);
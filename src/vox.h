@@ -18,6 +18,7 @@
 int lsx_vox_start(sox_format_t * ft);
 int lsx_ima_start(sox_format_t * ft);
 size_t lsx_vox_read(sox_format_t * ft, sox_sample_t *buffer, size_t len);
+int lsx_vox_seek(sox_format_t * ft, uint64_t offset);
 int lsx_vox_stopread(sox_format_t * ft);
 size_t lsx_vox_write(sox_format_t * ft, const sox_sample_t *buffer, size_t length);
 int lsx_vox_stopwrite(sox_format_t * ft);
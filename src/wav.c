@@ -73,7 +73,6 @@ typedef struct {
     unsigned short samplesPerBlock;
     unsigned short blockAlign;
     size_t dataStart;           /* need to for seeking */
-    char           * comment;
     int ignoreSize;                 /* ignoreSize allows us to process 32-bit WAV files that are
                                      * greater then 2 Gb and can't be represented by the
                                      * 32-bit size field. */
@@ -87,15 +86,19 @@ typedef struct {
     short         *samples;         /* interleaved samples buffer */
     short         *samplePtr;       /* Pointer to current sample  */
     short         *sampleTop;       /* End of samples-buffer      */
-    unsigned short blockSamplesRemaining;/* Samples remaining per channel */
+    size_t         blockSamplesRemaining;/* Samples remaining per channel */
     int            state[16];       /* step-size info for *ADPCM writes */
+    size_t         blocks;          /* ADPCM: blocks to code at once */
+    unsigned       threads;         /* ADPCM: threads to code them with */
+    sox_bool       blocksEnd;       /* ADPCM: no more blocks to read */
 
     /* following used by GSM 6.10 wav */
     gsm            gsmhandle;
     gsm_signal     *gsmsample;
     int            gsmindex;
+    int            gsmcount;        /* samples decoded into gsmsample */
     size_t      gsmbytecount;    /* counts bytes written to data block */
-    sox_bool       isRF64;          /* True if file being read is a RF64 */
+    sox_bool       isRF64;          /* True if file read or written is a RF64 */
     uint64_t       ds64_dataSize;   /* Size of data chunk from ds64 header */
 } priv_t;
 
@@ -105,83 +108,94 @@ static int wavwritehdr(sox_format_t *, int);
 
 
 /****************************************************************************/
-/* IMA ADPCM Support Functions Section                                      */
+/* Common ADPCM Read Function                                               */
 /****************************************************************************/
 
-/*
- *
- * ImaAdpcmReadBlock - Grab and decode complete block of samples
- *
- */
-static unsigned short  ImaAdpcmReadBlock(sox_format_t * ft)
-{
-    priv_t *       wav = (priv_t *) ft->priv;
-    size_t bytesRead;
-    int samplesThisBlock;
-
-    /* Pull in the packet and check the header */
-    bytesRead = lsx_readbuf(ft, wav->packet, (size_t)wav->blockAlign);
-    samplesThisBlock = wav->samplesPerBlock;
-    if (bytesRead < wav->blockAlign)
-    {
-        /* If it looks like a valid header is around then try and */
-        /* work with partial blocks.  Specs say it should be null */
-        /* padded but I guess this is better than trailing quiet. */
-        samplesThisBlock = lsx_ima_samples_in((size_t)0, (size_t)ft->signal.channels, bytesRead, (size_t) 0);
-        if (samplesThisBlock == 0 || samplesThisBlock > wav->samplesPerBlock)
-        {
-            lsx_warn("Premature EOF on .wav input file");
-            return 0;
-        }
-    }
-
-    wav->samplePtr = wav->samples;
-
-    /* For a full block, the following should be true: */
-    /* wav->samplesPerBlock = blockAlign - 8byte header + 1 sample in header */
-    lsx_ima_block_expand_i(ft->signal.channels, wav->packet, wav->samples, samplesThisBlock);
-    return samplesThisBlock;
+/* With --codec-threads, blocks (which are coded independently) are read and
+ * decoded several at a time, and written several at a time, their channels
+ * (whose states carry from block to block) encoded at once. */
+#define ADPCM_BLOCKS_PER_THREAD 4
 
+static void AdpcmSetBlocks(sox_format_t * ft, priv_t * wav)
+{
+    wav->threads = 1;
+    if (ft->context->codec_threads > 1)
+        wav->threads = (unsigned)ft->context->codec_threads;
+    wav->blocks = wav->threads > 1? ADPCM_BLOCKS_PER_THREAD * wav->threads : 1;
 }
 
-/****************************************************************************/
-/* MS ADPCM Support Functions Section                                       */
-/****************************************************************************/
-
 /*
  *
- * AdpcmReadBlock - Grab and decode complete block of samples
+ * AdpcmReadBlocks - Grab and decode complete blocks of samples; want is the
+ * number of samples/channel still in the file (unless ignoreSize).
  *
  */
-static unsigned short  AdpcmReadBlock(sox_format_t * ft)
+static size_t AdpcmReadBlocks(sox_format_t * ft, uint64_t want)
 {
     priv_t *       wav = (priv_t *) ft->priv;
-    size_t bytesRead;
-    int samplesThisBlock;
-    const char *errmsg;
-
-    /* Pull in the packet and check the header */
-    bytesRead = lsx_readbuf(ft, wav->packet, (size_t) wav->blockAlign);
-    samplesThisBlock = wav->samplesPerBlock;
-    if (bytesRead < wav->blockAlign)
+    unsigned chans = ft->signal.channels;
+    size_t nblocks = wav->blocks, bytesRead, full, rem;
+    size_t samplesThisBlock, samples, threads;
+    const char *errmsg = NULL;
+
+    if (wav->blocksEnd)
+        return 0;
+    if (!wav->ignoreSize && want < (uint64_t)nblocks * wav->samplesPerBlock)
+        nblocks = max(1, (want + wav->samplesPerBlock - 1) / wav->samplesPerBlock);
+
+    /* Pull in the packets */
+    bytesRead = lsx_readbuf(ft, wav->packet, nblocks * wav->blockAlign);
+    full = bytesRead / wav->blockAlign;
+    rem = bytesRead % wav->blockAlign;
+    samples = full * wav->samplesPerBlock;
+
+    threads = lsx_threads_take(ft->context, min(wav->threads, full));
+    if (wav->formatTag == WAVE_FORMAT_IMA_ADPCM)
+        lsx_ima_blocks_expand_i(chans, wav->packet, (size_t)wav->blockAlign,
+            wav->samples, wav->samplesPerBlock, full, (unsigned)threads);
+    else errmsg = lsx_ms_adpcm_blocks_expand_i(wav->ms_adpcm_data, chans,
+            wav->nCoefs, wav->lsx_ms_adpcm_i_coefs, wav->packet,
+            (size_t)wav->blockAlign, wav->samples, wav->samplesPerBlock, full,
+            (unsigned)threads);
+    lsx_threads_give(ft->context, threads);
+
+    if (rem || !full)
     {
+        unsigned char *packet = wav->packet + full * wav->blockAlign;
+        short *obuff = wav->samples + samples * chans;
+
         /* If it looks like a valid header is around then try and */
         /* work with partial blocks.  Specs say it should be null */
         /* padded but I guess this is better than trailing quiet. */
-        samplesThisBlock = lsx_ms_adpcm_samples_in((size_t)0, (size_t)ft->signal.channels, bytesRead, (size_t)0);
+        samplesThisBlock = wav->formatTag == WAVE_FORMAT_IMA_ADPCM?
+            lsx_ima_samples_in((size_t)0, (size_t)chans, rem, (size_t)0) :
+            lsx_ms_adpcm_samples_in((size_t)0, (size_t)chans, rem, (size_t)0);
         if (samplesThisBlock == 0 || samplesThisBlock > wav->samplesPerBlock)
         {
             lsx_warn("Premature EOF on .wav input file");
-            return 0;
+            wav->blocksEnd = full != 0; /* Don't warn again */
+        }
+        else if (wav->formatTag == WAVE_FORMAT_IMA_ADPCM)
+        {
+            lsx_ima_block_expand_i(chans, packet, obuff, (int)samplesThisBlock);
+            samples += samplesThisBlock;
+        }
+        else
+        {
+            const char *e = lsx_ms_adpcm_block_expand_i(wav->ms_adpcm_data,
+                chans, wav->nCoefs, wav->lsx_ms_adpcm_i_coefs, packet, obuff,
+                (int)samplesThisBlock);
+            if (e)
+                errmsg = e;
+            samples += samplesThisBlock;
         }
     }
 
-    errmsg = lsx_ms_adpcm_block_expand_i(wav->ms_adpcm_data, ft->signal.channels, wav->nCoefs, wav->lsx_ms_adpcm_i_coefs, wav->packet, wav->samples, samplesThisBlock);
-
     if (errmsg)
         lsx_warn("%s", errmsg);
 
-    return samplesThisBlock;
+    wav->samplePtr = wav->samples;
+    return samples;
 }
 
 /****************************************************************************/
@@ -191,31 +205,35 @@ static unsigned short  AdpcmReadBlock(sox_format_t * ft)
 static int xxxAdpcmWriteBlock(sox_format_t * ft)
 {
     priv_t * wav = (priv_t *) ft->priv;
-    size_t chans, ct;
+    size_t chans, ct, blockSize, nblocks, threads;
     short *p;
 
     chans = ft->signal.channels;
     p = wav->samplePtr;
     ct = p - wav->samples;
     if (ct>=chans) {
+        blockSize = chans * wav->samplesPerBlock;
+        nblocks = (ct + blockSize - 1) / blockSize;
         /* zero-fill samples if needed to complete block */
-        for (p = wav->samplePtr; p < wav->sampleTop; p++) *p=0;
+        for (p = wav->samplePtr; p < wav->samples + nblocks * blockSize; p++) *p=0;
         /* compress the samples to wav->packet */
+        threads = lsx_threads_take(ft->context, min(wav->threads, chans));
         if (wav->formatTag == WAVE_FORMAT_ADPCM) {
-            lsx_ms_adpcm_block_mash_i((unsigned) chans, wav->samples, wav->samplesPerBlock, wav->state, wav->packet, wav->blockAlign);
+            lsx_ms_adpcm_blocks_mash_i((unsigned) chans, wav->samples, wav->samplesPerBlock, wav->state, wav->packet, wav->blockAlign, nblocks, (unsigned)threads);
         }else{ /* WAVE_FORMAT_IMA_ADPCM */
-            lsx_ima_block_mash_i((unsigned) chans, wav->samples, wav->samplesPerBlock, wav->state, wav->packet, 9);
+            lsx_ima_blocks_mash_i((unsigned) chans, wav->samples, wav->samplesPerBlock, wav->state, wav->packet, (size_t)wav->blockAlign, 9, nblocks, (unsigned)threads);
         }
-        /* write the compressed packet */
-        if (lsx_writebuf(ft, wav->packet, (size_t) wav->blockAlign) != wav->blockAlign)
+        lsx_threads_give(ft->context, threads);
+        /* write the compressed packets */
+        if (lsx_writebuf(ft, wav->packet, nblocks * wav->blockAlign) != nblocks * wav->blockAlign)
         {
             lsx_fail_errno(ft,SOX_EOF,"write error");
             return (SOX_EOF);
         }
         /* update lengths and samplePtr */
-        wav->dataLength += wav->blockAlign;
+        wav->dataLength += nblocks * wav->blockAlign;
         if (pad_nsamps)
-          wav->numSamples += wav->samplesPerBlock;
+          wav->numSamples += nblocks * wav->samplesPerBlock;
         else
           wav->numSamples += ct/chans;
         wav->samplePtr = wav->samples;
@@ -226,7 +244,10 @@ static int xxxAdpcmWriteBlock(sox_format_t * ft)
 /****************************************************************************/
 /* WAV GSM6.10 support functions                                            */
 /****************************************************************************/
-/* create the gsm object, malloc buffer for 160*2 samples */
+/* WAV GSM blocks (two frames each) read at a time */
+#define GSM_BLOCKS 16
+
+/* create the gsm object, malloc buffer for GSM_BLOCKS*160*2 samples */
 static int wavgsminit(sox_format_t * ft)
 {
     int valueP=1;
@@ -244,8 +265,9 @@ static int wavgsminit(sox_format_t * ft)
         return (SOX_EOF);
     }
 
-    wav->gsmsample=lsx_malloc(sizeof(gsm_signal)*160*2);
+    wav->gsmsample=lsx_malloc(sizeof(gsm_signal)*160*2*GSM_BLOCKS);
     wav->gsmindex=0;
+    wav->gsmcount=160*2;
     return (SOX_SUCCESS);
 }
 
@@ -257,45 +279,46 @@ static void wavgsmdestroy(sox_format_t * ft)
     free(wav->gsmsample);
 }
 
+/* Blocks are read GSM_BLOCKS at a time, and decoded into wav->gsmsample,
+ * from where wav->gsmcount samples are copied out */
 static size_t wavgsmread(sox_format_t * ft, sox_sample_t *buf, size_t len)
 {
     priv_t *       wav = (priv_t *) ft->priv;
-    size_t done=0;
-    int bytes;
-    gsm_byte    frame[65];
+    size_t done=0, bytes, i, n;
+    gsm_byte    frame[65*GSM_BLOCKS];
 
     ft->sox_errno = SOX_SUCCESS;
 
   /* copy out any samples left from the last call */
-    while(wav->gsmindex && (wav->gsmindex<160*2) && (done < len))
+    while(wav->gsmindex && (wav->gsmindex<wav->gsmcount) && (done < len))
         buf[done++]=SOX_SIGNED_16BIT_TO_SAMPLE(wav->gsmsample[wav->gsmindex++],);
 
   /* read and decode loop, possibly leaving some samples in wav->gsmsample */
     while (done < len) {
         wav->gsmindex=0;
-        bytes = lsx_readbuf(ft, frame, (size_t)65);
-        if (bytes <=0)
-            return done;
-        if (bytes<65) {
-            lsx_warn("invalid wav gsm frame size: %d bytes",bytes);
+        n = min(GSM_BLOCKS, (len - done + 160*2 - 1) / (160*2));
+        bytes = lsx_readbuf(ft, frame, 65*n);
+        if (bytes % 65)
+            lsx_warn("invalid wav gsm frame size: %d bytes", (int)(bytes % 65));
+        n = bytes / 65;
+        if (!n)
             return done;
+        for (i = 0; i < n; ++i) {
+            /* decode the long 33 byte half, then the short 32 byte half */
+            if(gsm_decode(wav->gsmhandle,frame+i*65, wav->gsmsample+i*320)<0 ||
+               gsm_decode(wav->gsmhandle,frame+i*65+33, wav->gsmsample+i*320+160)<0)
+            {
+                lsx_fail_errno(ft,SOX_EOF,"error during gsm decode");
+                return 0;
+            }
         }
-        /* decode the long 33 byte half */
-        if(gsm_decode(wav->gsmhandle,frame, wav->gsmsample)<0)
-        {
-            lsx_fail_errno(ft,SOX_EOF,"error during gsm decode");
-            return 0;
-        }
-        /* decode the short 32 byte half */
-        if(gsm_decode(wav->gsmhandle,frame+33, wav->gsmsample+160)<0)
-        {
-            lsx_fail_errno(ft,SOX_EOF,"error during gsm decode");
-            return 0;
-        }
+        wav->gsmcount = (int)n*160*2;
 
-        while ((wav->gsmindex <160*2) && (done < len)){
+        while ((wav->gsmindex < wav->gsmcount) && (done < len)){
             buf[done++]=SOX_SIGNED_16BIT_TO_SAMPLE(wav->gsmsample[(wav->gsmindex)++],);
         }
+        if (bytes % 65)
+            break;
     }
 
     return done;
@@ -411,6 +434,48 @@ static int sndfile_workaround(uint64_t *len, sox_format_t *ft) {
     return SOX_SUCCESS;
 }
 
+/* LIST INFO sub-chunks, as comments: */
+static char const * const info_keys[][2] = {
+  {"INAM", "Title"},
+  {"IART", "Artist"},
+  {"IPRD", "Album"},
+  {"ITRK", "Tracknumber"},
+  {"ICRD", "Year"},
+  {"IGNR", "Genre"},
+  {"ICMT", "Comment"},
+  {"ICOP", "Copyright"},
+  {"ISFT", "Software"},
+  {"IENG", "Engineer"},
+  {"ISBJ", "Subject"},
+  {"IKEY", "Keywords"},
+  {NULL, NULL}
+};
+
+static char const * info_key(char const * id)
+{
+  int i;
+  for (i = 0; info_keys[i][0]; ++i)
+    if (!strncmp(id, info_keys[i][0], (size_t)4))
+      return info_keys[i][1];
+  return NULL;
+}
+
+/* Appends a comment from an INFO sub-chunk; an ICMT is taken as it is. */
+static void append_info(sox_format_t * ft, char const * id, char const * text)
+{
+  char const * key = info_key(id);
+  char * comment;
+
+  if (!strncmp(id, "ICMT", (size_t)4)) {
+    sox_append_comment(&ft->oob.comments, text);
+    return;
+  }
+  comment = lsx_malloc(strlen(key) + strlen(text) + 2);
+  sprintf(comment, "%s=%s", key, text);
+  sox_append_comment(&ft->oob.comments, comment);
+  free(comment);
+}
+
 static int findChunk(sox_format_t * ft, const char *Label, uint64_t *len)
 {
     char magic[5];
@@ -513,14 +578,14 @@ static int startread(sox_format_t * ft)
     uint64_t      qwDataLength;    /* length of sound data in bytes */
     size_t    bytesPerBlock = 0;
     int    bytespersample;          /* bytes per sample (per channel */
-    char text[256];
     uint32_t      dwLoopPos;
 
     ft->sox_errno = SOX_SUCCESS;
     wav->ignoreSize = ft->signal.length == SOX_IGNORE_LENGTH;
 
     if (lsx_reads(ft, magic, (size_t)4) == SOX_EOF || (strncmp("RIFF", magic, (size_t)4) != 0 &&
-                                             strncmp("RIFX", magic, (size_t)4) != 0 && strncmp("RF64", magic, (size_t)4)!=0 ))
+                                             strncmp("RIFX", magic, (size_t)4) != 0 && strncmp("RF64", magic, (size_t)4)!=0 &&
+                                             strncmp("BW64", magic, (size_t)4)!=0 ))
     {
         lsx_fail_errno(ft,SOX_EHDR,"WAVE: RIFF header not found");
         return SOX_EOF;
@@ -534,7 +599,7 @@ static int startread(sox_format_t * ft)
     }
     else ft->encoding.reverse_bytes = MACHINE_IS_BIGENDIAN;
 
-    if (strncmp("RF64", magic, (size_t)4) == 0)
+    if (strncmp("RF64", magic, (size_t)4) == 0 || strncmp("BW64", magic, (size_t)4) == 0)
     {
         wav->isRF64 = sox_true;
     }
@@ -778,7 +843,8 @@ static int startread(sox_format_t * ft)
             lsx_fail_errno(ft,SOX_EOF,"ADPCM file nCoefs (%.4hx) makes no sense", wav->nCoefs);
             return SOX_EOF;
         }
-        wav->packet = lsx_malloc((size_t)wav->blockAlign);
+        AdpcmSetBlocks(ft, wav);
+        wav->packet = lsx_malloc(wav->blocks * wav->blockAlign);
 
         len -= 4;
 
@@ -788,11 +854,11 @@ static int startread(sox_format_t * ft)
             return SOX_EOF;
         }
 
-        wav->samples = lsx_malloc(wChannels*wav->samplesPerBlock*sizeof(short));
+        wav->samples = lsx_malloc(wav->blocks*wChannels*wav->samplesPerBlock*sizeof(short));
 
         /* nCoefs, lsx_ms_adpcm_i_coefs used by adpcm.c */
         wav->lsx_ms_adpcm_i_coefs = lsx_malloc(wav->nCoefs * 2 * sizeof(short));
-        wav->ms_adpcm_data = lsx_ms_adpcm_alloc(wChannels);
+        wav->ms_adpcm_data = lsx_ms_adpcm_alloc(wChannels * (unsigned)wav->blocks);
         {
             int i, errct=0;
             for (i=0; len>=2 && i < 2*wav->nCoefs; i++) {
@@ -830,10 +896,11 @@ static int startread(sox_format_t * ft)
             return SOX_EOF;
         }
 
-        wav->packet = lsx_malloc((size_t)wav->blockAlign);
+        AdpcmSetBlocks(ft, wav);
+        wav->packet = lsx_malloc(wav->blocks * wav->blockAlign);
         len -= 2;
 
-        wav->samples = lsx_malloc(wChannels*wav->samplesPerBlock*sizeof(short));
+        wav->samples = lsx_malloc(wav->blocks*wChannels*wav->samplesPerBlock*sizeof(short));
 
         bytespersample = 2;  /* AFTER de-compression */
         break;
@@ -913,8 +980,10 @@ static int startread(sox_format_t * ft)
 
     /* ds64 size will have been applied in findChunk */
     qwDataLength = len;
-    /* XXX - does MS_UNSPEC apply to RF64 files? */
-    if (qwDataLength == MS_UNSPEC) {
+    /* MS_UNSPEC is what we write to pipes; 0xffffffff without a ds64, or
+     * all ones in it, is how others (and RF64 streams) say "unknown". */
+    if (qwDataLength == MS_UNSPEC || qwDataLength == 0xffffffff ||
+        qwDataLength == ~(uint64_t)0) {
       wav->ignoreSize = 1;
       lsx_debug("WAV Chunk data's length is value often used in pipes or 4G files.  Ignoring length.");
     }
@@ -943,7 +1012,6 @@ static int startread(sox_format_t * ft)
                          (size_t)wav->blockAlign, (size_t)wav->samplesPerBlock);
         lsx_debug_more("datalen %ld, numSamples %lu",qwDataLength, (unsigned long)wav->numSamples);
         wav->blockSamplesRemaining = 0;        /* Samples left in buffer */
-        lsx_ima_init_table();
         ft->signal.length = wav->numSamples*ft->signal.channels;
         break;
 
@@ -1008,9 +1076,6 @@ static int startread(sox_format_t * ft)
         if (lsx_seeki(ft, (off_t)len, SEEK_CUR) == SOX_SUCCESS &&
             findChunk(ft, "LIST", &len) != SOX_EOF)
         {
-            wav->comment = lsx_malloc((size_t)256);
-            /* Initialize comment to a NULL string */
-            wav->comment[0] = 0;
             while(!lsx_eof(ft))
             {
                 if (lsx_reads(ft,magic,(size_t)4) == SOX_EOF)
@@ -1037,43 +1102,22 @@ static int startread(sox_format_t * ft)
                     if (lsx_readdw(ft,&len_tmp) == SOX_EOF)
                         break;
                     len = len_tmp;
-                    if (strncmp(magic,"ICRD",(size_t)4) == 0)
+                    if (info_key(magic))
                     {
-                        lsx_debug("Chunk ICRD");
-                        if (len > 254)
+                        char * text;
+                        lsx_debug("Chunk %.4s", magic);
+                        if (len > 65535)
                         {
-                            lsx_warn("Possible buffer overflow hack attack (ICRD)!");
+                            lsx_warn("Possible buffer overflow hack attack (%.4s)!", magic);
                             break;
                         }
-                        lsx_reads(ft,text, (size_t)len);
-                        if (strlen(wav->comment) + strlen(text) < 254)
-                        {
-                            if (wav->comment[0] != 0)
-                                strcat(wav->comment,"\n");
-
-                            strcat(wav->comment,text);
-                        }
-                        if (strlen(text) < len)
-                           lsx_seeki(ft, (off_t)(len - strlen(text)), SEEK_CUR);
-                    }
-                    else if (strncmp(magic,"ISFT",(size_t)4) == 0)
-                    {
-                        lsx_debug("Chunk ISFT");
-                        if (len > 254)
-                        {
-                            lsx_warn("Possible buffer overflow hack attack (ISFT)!");
-                            break;
-                        }
-                        lsx_reads(ft,text, (size_t)len);
-                        if (strlen(wav->comment) + strlen(text) < 254)
-                        {
-                            if (wav->comment[0] != 0)
-                                strcat(wav->comment,"\n");
-
-                            strcat(wav->comment,text);
-                        }
-                        if (strlen(text) < len)
-                           lsx_seeki(ft, (off_t)(len - strlen(text)), SEEK_CUR);
+                        text = lsx_malloc((size_t)len + 1);
+                        text[lsx_readbuf(ft, text, (size_t)len)] = 0;
+                        if (*text)
+                            append_info(ft, magic, text);
+                        free(text);
+                        if (len & 1)
+                            lsx_seeki(ft, (off_t)1, SEEK_CUR);
                     }
                     else if (strncmp(magic,"cue ",(size_t)4) == 0)
                     {
@@ -1102,6 +1146,11 @@ static int startread(sox_format_t * ft)
         lsx_clearerr(ft);
         lsx_seeki(ft,(off_t)wav->dataStart,SEEK_SET);
     }
+    /* A clone's copy of priv would share the ADPCM and GSM buffers */
+    if (ft->encoding.encoding == SOX_ENCODING_IMA_ADPCM ||
+        ft->encoding.encoding == SOX_ENCODING_MS_ADPCM ||
+        ft->encoding.encoding == SOX_ENCODING_GSM)
+        ft->handler.flags &= ~SOX_FILE_CLONE;
     return lsx_rawstartread(ft);
 }
 
@@ -1134,10 +1183,8 @@ static size_t read_samples(sox_format_t * ft, sox_sample_t *buf, size_t len)
             while (done < len) { /* Still want data? */
                 /* See if need to read more from disk */
                 if (wav->blockSamplesRemaining == 0) {
-                    if (wav->formatTag == WAVE_FORMAT_IMA_ADPCM)
-                        wav->blockSamplesRemaining = ImaAdpcmReadBlock(ft);
-                    else
-                        wav->blockSamplesRemaining = AdpcmReadBlock(ft);
+                    wav->blockSamplesRemaining = AdpcmReadBlocks(ft,
+                        wav->numSamples - done / ft->signal.channels);
                     if (wav->blockSamplesRemaining == 0)
                     {
                         /* Don't try to read any more samples */
@@ -1219,8 +1266,6 @@ static int stopread(sox_format_t * ft)
     free(wav->samples);
     free(wav->lsx_ms_adpcm_i_coefs);
     free(wav->ms_adpcm_data);
-    free(wav->comment);
-    wav->comment = NULL;
 
     switch (ft->encoding.encoding)
     {
@@ -1252,14 +1297,15 @@ static int startwrite(sox_format_t * ft)
             return rc;
     }
 
-    wav->numSamples = 0;
+    /* Not 0 if being resumed (see sox_open_write_resume) */
+    wav->numSamples = ft->olength / ft->signal.channels;
     wav->dataLength = 0;
-    if (!ft->signal.length && !ft->seekable)
-        lsx_warn("Length in output .wav header will be wrong since can't seek to fix it");
-
     rc = wavwritehdr(ft, 0);  /* also calculates various wav->* info */
     if (rc != 0)
         return rc;
+    /* RF64 can say that the length is unknown */
+    if (!ft->signal.length && !ft->seekable && !wav->isRF64)
+        lsx_warn("Length in output .wav header will be wrong since can't seek to fix it");
 
     wav->packet = NULL;
     wav->samples = NULL;
@@ -1269,14 +1315,14 @@ static int startwrite(sox_format_t * ft)
         size_t ch, sbsize;
 
         case WAVE_FORMAT_IMA_ADPCM:
-            lsx_ima_init_table();
         /* intentional case fallthru! */
         case WAVE_FORMAT_ADPCM:
             /* #channels already range-checked for overflow in wavwritehdr() */
             for (ch=0; ch<ft->signal.channels; ch++)
                 wav->state[ch] = 0;
-            sbsize = ft->signal.channels * wav->samplesPerBlock;
-            wav->packet = lsx_malloc((size_t)wav->blockAlign);
+            AdpcmSetBlocks(ft, wav);
+            sbsize = wav->blocks * ft->signal.channels * wav->samplesPerBlock;
+            wav->packet = lsx_malloc(wav->blocks * wav->blockAlign);
             wav->samples = lsx_malloc(sbsize*sizeof(short));
             wav->sampleTop = wav->samples + sbsize;
             wav->samplePtr = wav->samples;
@@ -1347,6 +1393,23 @@ dwSamplesWritten - (fact header) the number of samples written (after padding
                    to a complete block eg for GSM)
 dwDataLength     - (data chunk header) the number of (valid) data bytes written
 
+Where the known length does not fit in 32 bits, or with the "rf64" and
+"bw64" (ITU-R BS.2088) file types, a 'ds64' chunk is placed between 'WAVE'
+and 'fmt ', making an RF64 (EBU Tech 3306) file:
+
+12 - 15    'ds64'
+16 - 19    dwDs64Size = 28
+20 - 27    qwRiffLength
+28 - 35    qwDataLength
+36 - 43    qwSamplesWritten
+44 - 47    dwTableLength = 0
+
+with 0xffffffff written in the 32-bit fields that it replaces.  If the
+length of an "rf64" or "bw64" file is not known, even to a pipe, all of
+its sizes are written as "unknown" (all ones) and readers take the data
+to run to end of file.  No room is kept for a ds64 chunk in a plain .wav
+file of unknown length.
+
 */
 
 static int wavwritehdr(sox_format_t * ft, int second_header)
@@ -1379,8 +1442,12 @@ static int wavwritehdr(sox_format_t * ft, int second_header)
 
     /* internal variables, intermediate values etc */
     int bytespersample; /* (uncompressed) bytes per sample (per channel) */
-    long blocksWritten = 0;
+    uint64_t blocksWritten = 0;
+    uint64_t qwRiffLength, qwDataLength, qwSamplesWritten; /* for ds64 */
     sox_bool isExtensible = sox_false;    /* WAVE_FORMAT_EXTENSIBLE? */
+    sox_bool hasFact, unknown = sox_false;
+    sox_bool isRIFX = ft->encoding.reverse_bytes == MACHINE_IS_LITTLEENDIAN;
+    char const * magic;
 
     if (ft->signal.channels > UINT16_MAX) {
         lsx_fail_errno(ft, SOX_EOF, "Too many channels (%u)",
@@ -1468,37 +1535,72 @@ static int wavwritehdr(sox_format_t * ft, int second_header)
     wav->blockAlign = wBlockAlign;
     wav->samplesPerBlock = wSamplesPerBlock;
 
+    if (wFormatTag == WAVE_FORMAT_PCM && (wBitsPerSample > 16 || wChannels > 2)
+        && strcmp(ft->filetype, "wavpcm")) {
+      isExtensible = sox_true;
+      wFmtSize += 2 + 22;
+    }
+    else if (wFormatTag != WAVE_FORMAT_PCM)
+        wFmtSize += 2+wExtSize; /* plus ExtData */
+    hasFact = isExtensible || wFormatTag != WAVE_FORMAT_PCM; /* PCM omits the "fact" chunk */
+
     /* When creating header, use length hint given by input file.  If no
-     * hint then write default value.  Also, use default value even
-     * on header update if more then 32-bit length needs to be written.
+     * hint then write default value, later fixed up if we can seek.
      */
-    if ((!second_header && !ft->signal.length) || 
-        wav->numSamples > 0xffffffff) { 
+    if (!second_header && !ft->signal.length) {
         /* adjust for blockAlign */
+        unknown = sox_true;
         blocksWritten = MS_UNSPEC/wBlockAlign;
-        dwDataLength = blocksWritten * wBlockAlign;
-        dwSamplesWritten = blocksWritten * wSamplesPerBlock;
+        qwSamplesWritten = blocksWritten * wSamplesPerBlock;
     } else {    /* fixup with real length */
-        dwSamplesWritten = 
+        qwSamplesWritten =
             second_header? wav->numSamples : ft->signal.length / wChannels;
-        blocksWritten = (dwSamplesWritten+wSamplesPerBlock-1)/wSamplesPerBlock;
-        dwDataLength = blocksWritten * wBlockAlign;
+        blocksWritten = (qwSamplesWritten+wSamplesPerBlock-1)/wSamplesPerBlock;
     }
+    qwDataLength = blocksWritten * wBlockAlign;
 
     if (wFormatTag == WAVE_FORMAT_GSM610)
-        dwDataLength = (dwDataLength+1) & ~1u; /* round up to even */
+        qwDataLength = (qwDataLength+1) & ~(uint64_t)1; /* round up to even */
 
-    if (wFormatTag == WAVE_FORMAT_PCM && (wBitsPerSample > 16 || wChannels > 2)
-        && strcmp(ft->filetype, "wavpcm")) {
-      isExtensible = sox_true;
-      wFmtSize += 2 + 22;
-    }
-    else if (wFormatTag != WAVE_FORMAT_PCM)
-        wFmtSize += 2+wExtSize; /* plus ExtData */
+    qwRiffLength = 4 + (8+wFmtSize) + (8+qwDataLength+qwDataLength%2);
+    if (hasFact)
+        qwRiffLength += (8+dwFactSize);
 
-    wRiffLength = 4 + (8+wFmtSize) + (8+dwDataLength+dwDataLength%2);
-    if (isExtensible || wFormatTag != WAVE_FORMAT_PCM) /* PCM omits the "fact" chunk */
-        wRiffLength += (8+dwFactSize);
+    /* Decide, once, whether to write a ds64 chunk */
+    if (!second_header) {
+        sox_bool rf64 = !strcmp(ft->filetype, "rf64") || !strcmp(ft->filetype, "bw64");
+
+        wav->isRF64 = rf64 || qwRiffLength + 36 > 0xffffffff;
+        if (isRIFX && wav->isRF64) {
+            if (rf64)
+                lsx_warn("RF64 is little-endian only; writing RIFX instead");
+            wav->isRF64 = sox_false;
+        }
+    }
+    if (wav->isRF64)
+        qwRiffLength += 36;
+
+    if (wav->isRF64) {
+        if (unknown) /* streaming: the reader takes all to end of file */
+            qwRiffLength = qwDataLength = qwSamplesWritten = ~(uint64_t)0;
+        wRiffLength = dwDataLength = 0xffffffff;
+        dwSamplesWritten = min(qwSamplesWritten, 0xffffffff);
+    }
+    else if (qwRiffLength > 0xffffffff) {
+        /* No room for the real length, so as for an unknown one */
+        lsx_warn("Length in output .wav header will be wrong: it does not fit in 32 bits");
+        blocksWritten = MS_UNSPEC/wBlockAlign;
+        dwDataLength = blocksWritten * wBlockAlign;
+        dwSamplesWritten = blocksWritten * wSamplesPerBlock;
+        wRiffLength = 4 + (8+wFmtSize) + (8+dwDataLength+dwDataLength%2);
+        if (hasFact)
+            wRiffLength += (8+dwFactSize);
+    }
+    else {
+        wRiffLength = qwRiffLength;
+        dwDataLength = qwDataLength;
+        dwSamplesWritten = qwSamplesWritten;
+    }
 
     /* dwAvgBytesPerSec <-- this is BEFORE compression, isn't it? guess not. */
     dwAvgBytesPerSec = (double)wBlockAlign*ft->signal.rate / (double)wSamplesPerBlock + 0.5;
@@ -1508,16 +1610,26 @@ static int wavwritehdr(sox_format_t * ft, int second_header)
     /* If user specified opposite swap than we think, assume they are
      * asking to write a RIFX file.
      */
-    if (ft->encoding.reverse_bytes == MACHINE_IS_LITTLEENDIAN)
+    if (isRIFX)
     {
         if (!second_header)
             lsx_report("Requested to swap bytes so writing RIFX header");
-        lsx_writes(ft, "RIFX");
+        magic = "RIFX";
     }
-    else
-        lsx_writes(ft, "RIFF");
+    else if (!wav->isRF64)
+        magic = "RIFF";
+    else magic = strcmp(ft->filetype, "bw64")? "RF64" : "BW64";
+    lsx_writes(ft, magic);
     lsx_writedw(ft, wRiffLength);
     lsx_writes(ft, "WAVE");
+    if (wav->isRF64) {
+        lsx_writes(ft, "ds64");
+        lsx_writedw(ft, 28);
+        lsx_writeqw(ft, qwRiffLength);
+        lsx_writeqw(ft, qwDataLength);
+        lsx_writeqw(ft, qwSamplesWritten);
+        lsx_writedw(ft, 0);          /* no table of other chunks' sizes */
+    }
     lsx_writes(ft, "fmt ");
     lsx_writedw(ft, wFmtSize);
     lsx_writew(ft, isExtensible ? WAVE_FORMAT_EXTENSIBLE : wFormatTag);
@@ -1593,14 +1705,15 @@ static int wavwritehdr(sox_format_t * ft, int second_header)
         lsx_debug("        %d byte/sec, %d block align, %d bits/samp",
                 dwAvgBytesPerSec, wBlockAlign, wBitsPerSample);
     } else {
-        lsx_debug("Finished writing Wave file, %u data bytes %lu samples",
-                dwDataLength, (unsigned long)wav->numSamples);
+        lsx_debug("Finished writing Wave file, %lu data bytes %lu samples",
+                (unsigned long)qwDataLength, (unsigned long)wav->numSamples);
         if (wFormatTag == WAVE_FORMAT_GSM610){
-            lsx_debug("GSM6.10 format: %li blocks %u padded samples %u padded data bytes",
-                    blocksWritten, dwSamplesWritten, dwDataLength);
-            if (wav->gsmbytecount != dwDataLength)
-                lsx_warn("help ! internal inconsistency - data_written %u gsmbytecount %lu",
-                        dwDataLength, (unsigned long)wav->gsmbytecount);
+            lsx_debug("GSM6.10 format: %lu blocks %lu padded samples %lu padded data bytes",
+                    (unsigned long)blocksWritten, (unsigned long)qwSamplesWritten,
+                    (unsigned long)qwDataLength);
+            if (wav->gsmbytecount != qwDataLength)
+                lsx_warn("help ! internal inconsistency - data_written %lu gsmbytecount %lu",
+                        (unsigned long)qwDataLength, (unsigned long)wav->gsmbytecount);
 
         }
     }
@@ -1679,11 +1792,11 @@ static int stopwrite(sox_format_t * ft)
         /* All samples are already written out. */
         /* If file header needs fixing up, for example it needs the */
         /* the number of samples in a field, seek back and write them here. */
-        if (ft->signal.length && wav->numSamples <= 0xffffffff && 
-            wav->numSamples == ft->signal.length)
+        if (ft->signal.length &&
+            wav->numSamples * ft->signal.channels == ft->signal.length)
           return SOX_SUCCESS;
         if (!ft->seekable)
-          return SOX_EOF;
+          return ft->signal.length || !wav->isRF64? SOX_EOF : SOX_SUCCESS;
 
         if (lsx_seeki(ft, (off_t)0, SEEK_SET) != 0)
         {
@@ -1750,7 +1863,31 @@ static int seek(sox_format_t * ft, uint64_t offset)
 {
   priv_t *   wav = (priv_t *) ft->priv;
 
-  if (ft->encoding.bits_per_sample & 7)
+  if (ft->encoding.encoding == SOX_ENCODING_IMA_ADPCM ||
+      ft->encoding.encoding == SOX_ENCODING_MS_ADPCM) {
+    /* Blocks are coded independently: go to the one containing the
+     * offset, then decode it and drop the samples before the offset. */
+    uint64_t total = ft->signal.length / ft->signal.channels;
+    uint64_t wide = offset / ft->signal.channels;
+    uint64_t block = wide / wav->samplesPerBlock;
+    size_t skip = wide % wav->samplesPerBlock;
+
+    ft->sox_errno = lsx_seeki(ft,
+        (off_t)wav->dataStart + (off_t)(block * wav->blockAlign), SEEK_SET);
+    if (ft->sox_errno == SOX_SUCCESS) {
+      wav->blocksEnd = sox_false;
+      wav->numSamples = total - min(total, block * wav->samplesPerBlock);
+      wav->blockSamplesRemaining = 0;
+      if (skip) {
+        wav->blockSamplesRemaining = AdpcmReadBlocks(ft, wav->numSamples);
+        skip = min(skip, wav->blockSamplesRemaining);
+        wav->samplePtr += skip * ft->signal.channels;
+        wav->blockSamplesRemaining -= skip;
+        wav->numSamples -= min(wav->numSamples, skip);
+      }
+    }
+  }
+  else if (ft->encoding.bits_per_sample & 7)
     lsx_fail_errno(ft, SOX_ENOTSUP, "seeking not supported with this encoding");
   else if (wav->formatTag == WAVE_FORMAT_GSM610) {
     int alignment;
@@ -1769,23 +1906,68 @@ static int seek(sox_format_t * ft, uint64_t offset)
       alignment = offset % wav->samplesPerBlock;
       if (alignment != 0)
           new_offset += (wav->samplesPerBlock - alignment);
-      wav->numSamples = ft->signal.length - (new_offset / ft->signal.channels);
+      wav->numSamples = (ft->signal.length - new_offset) / ft->signal.channels;
     }
   } else {
     double wide_sample = offset - (offset % ft->signal.channels);
     double to_d = wide_sample * ft->encoding.bits_per_sample / 8;
     off_t to = to_d;
     ft->sox_errno = (to != to_d)? SOX_EOF : lsx_seeki(ft, (off_t)wav->dataStart + (off_t)to, SEEK_SET);
-    if (ft->sox_errno == SOX_SUCCESS)
-      wav->numSamples -= (size_t)wide_sample / ft->signal.channels;
+    if (ft->sox_errno == SOX_SUCCESS)     /* The offset is absolute */
+      wav->numSamples = (ft->signal.length - (uint64_t)wide_sample) / ft->signal.channels;
   }
 
   return ft->sox_errno;
 }
 
+/* The comments become a LIST INFO chunk: "key=value" ones with a known key,
+ * sub-chunks for that key, and the rest, ICMT sub-chunks.  So that startread
+ * finds it, the chunk is put after the data chunk. */
+static int rewrite_comments(char const * path, sox_comments_t comments)
+{
+  static char const * const ids[] = {"LISTINFO", NULL};
+  char * data = NULL;
+  size_t len = 4, i, j;
+  int result;
+
+  for (i = 0; comments && comments[i]; ++i) {
+    char const * text = comments[i], * eq = strchr(text, '=');
+    char const * id = "ICMT";
+    size_t n;
+
+    for (j = 0; eq && info_keys[j][0]; ++j)
+      if (strlen(info_keys[j][1]) == (size_t)(eq - text) &&
+          !strncasecmp(text, info_keys[j][1], (size_t)(eq - text))) {
+        id = info_keys[j][0];
+        text = eq + 1;
+        break;
+      }
+    n = strlen(text) + 1;
+    if (n > 65535) {
+      lsx_fail("`%s': comment too long for a WAV INFO chunk", path);
+      free(data);
+      return SOX_EOF;
+    }
+    data = lsx_realloc(data, len + 8 + n + 1);
+    memcpy(data + len, id, (size_t)4);
+    data[len + 4] = n & 255, data[len + 5] = n >> 8 & 255;
+    data[len + 6] = data[len + 7] = 0;
+    memcpy(data + len + 8, text, n);
+    len += 8 + n;
+    if (n & 1)
+      data[len++] = 0;
+  }
+  if (data)
+    memcpy(data, "INFO", (size_t)4);
+  result = lsx_rewrite_chunk(path, "RIFF", sox_false, ids, "data", "JUNK",
+      "LIST", data, len);
+  free(data);
+  return result;
+}
+
 LSX_FORMAT_HANDLER(wav)
 {
-  static char const * const names[] = {"wav", "wavpcm", "amb", NULL};
+  static char const * const names[] = {"wav", "wavpcm", "amb", "rf64", "bw64", NULL};
   static unsigned const write_encodings[] = {
     SOX_ENCODING_SIGN2, 16, 24, 32, 0,
     SOX_ENCODING_UNSIGNED, 8, 0,
@@ -1797,10 +1979,11 @@ LSX_FORMAT_HANDLER(wav)
     SOX_ENCODING_FLOAT, 32, 64, 0,
     0};
   static sox_format_handler_t const handler = {SOX_LIB_VERSION_CODE,
-    "Microsoft audio format", names, SOX_FILE_LIT_END,
+    "Microsoft audio format", names, SOX_FILE_LIT_END | SOX_FILE_MMAP | SOX_FILE_RAWPCM | SOX_FILE_CLONE,
     startread, read_samples, stopread,
     startwrite, write_samples, stopwrite,
-    seek, write_encodings, NULL, sizeof(priv_t)
+    seek, write_encodings, NULL, sizeof(priv_t), NULL, rewrite_comments,
+    NULL, NULL
   };
   return &handler;
 }
@@ -304,7 +304,7 @@ static int start(sox_format_t* ft)
           (unsigned)fmt.Format.wBitsPerSample);
   }
 
-  priv->buf_len = ((sox_globals.bufsiz >> priv->sample_shift) + 31) & ~31u;
+  priv->buf_len = ((ft->context->bufsiz >> priv->sample_shift) + 31) & ~31u;
   priv->data = lsx_malloc((priv->buf_len * num_buffers) << priv->sample_shift);
   if (!priv->data)
   {
@@ -528,7 +528,7 @@ LSX_FORMAT_HANDLER(waveaudio)
   SOX_FILE_DEVICE | SOX_FILE_NOSTDIO,
   start, waveread, stop,
   start, wavewrite, stop,
-  NULL, write_encodings, NULL, sizeof(priv_t)
+  NULL, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
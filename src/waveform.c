@@ -0,0 +1,310 @@
+/* libSoX effect: waveform overview, as min/max/RMS at several zoom levels
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Audio is passed unmodified.  The minimum, maximum and sum of squares of
+ * each bucket of `zoom' frames (of all channels together, or of each with
+ * -s) are found a block at a time, by loops that the compiler vectorises;
+ * each finished bucket is merged into the bucket of the next level, which
+ * is `factor' times as long, and so on, so every level costs one pass.
+ *
+ * The peak file (little-endian throughout):
+ *   "SXPK", version (1), flags (bit 0: 8-bit values, else 16-bit),
+ *   sample rate, channels, levels: each a 32-bit unsigned;
+ *   then for each level, frames per bucket and number of buckets (32-bit);
+ *   then for each level in turn, for each bucket, for each channel:
+ *   min, max and RMS, as signed 8- or 16-bit values (RMS >= 0).
+ * A bucket at the end may be short. */
+
+#include "sox_i.h"
+#include <string.h>
+#include <errno.h>
+
+/* For SET_BINARY_MODE: */
+#include <fcntl.h>
+#ifdef HAVE_IO_H
+  #include <io.h>
+#endif
+
+#define MAX_LEVELS 16
+
+typedef struct {
+  sox_sample_t  min, max;
+  double        sum2;
+} bucket_t;
+
+typedef struct {
+  size_t        len;        /* Frames per bucket */
+  size_t        frames;     /* Frames in acc so far */
+  bucket_t      * acc;      /* A bucket being gathered, for each channel */
+  unsigned char * data;     /* Finished buckets, as they are to be written */
+  size_t        num, bytes, size;
+} level_t;
+
+typedef struct {
+  char          * filename;
+  FILE          * file;
+  unsigned      zoom, factor, num_levels, bits;
+  sox_bool      split;
+  unsigned      chans;      /* Of the overview: 1, or with -s, all */
+  level_t       levels[MAX_LEVELS];
+} priv_t;
+
+static int create(sox_effect_t * effp, int argc, char * * argv)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  lsx_getopt_t optstate;
+  double len;
+  int c;
+
+  p->zoom = 256, p->factor = 4, p->num_levels = 5, p->bits = 16;
+  lsx_getopt_init(argc, argv, "+z:f:l:b:s", NULL, lsx_getopt_flag_none, 1, &optstate);
+  while ((c = lsx_getopt(&optstate)) != -1) switch (c) {
+    GETOPT_NUMERIC(optstate, 'z', zoom, 1, 1048576)
+    GETOPT_NUMERIC(optstate, 'f', factor, 2, 256)
+    GETOPT_NUMERIC(optstate, 'l', num_levels, 1, MAX_LEVELS)
+    GETOPT_NUMERIC(optstate, 'b', bits, 8, 16)
+    case 's': p->split = sox_true; break;
+    default: lsx_fail("invalid option `-%c'", optstate.opt); return lsx_usage(effp);
+  }
+  if (p->bits != 8 && p->bits != 16) {
+    lsx_fail("bits must be 8 or 16");
+    return SOX_EOF;
+  }
+  len = p->zoom * pow((double)p->factor, p->num_levels - 1.);
+  if (len > UINT32_MAX) {
+    lsx_fail("the coarsest level's buckets would be too long");
+    return SOX_EOF;
+  }
+  argc -= optstate.ind, argv += optstate.ind;
+  if (argc == 1)
+    p->filename = argv[0];
+  else if (argc > 1)
+    return lsx_usage(effp);
+  return SOX_SUCCESS;
+}
+
+static void clear(priv_t * p, level_t * l)
+{
+  unsigned c;
+
+  l->frames = 0;
+  for (c = 0; c < p->chans; ++c) {
+    l->acc[c].min = SOX_SAMPLE_MAX;
+    l->acc[c].max = SOX_SAMPLE_MIN;
+    l->acc[c].sum2 = 0;
+  }
+}
+
+static int start(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned k;
+
+  /* As noiseprof: stdout if no file is given, but never stderr */
+  if (!p->filename || !strcmp(p->filename, "-")) {
+    if (effp->global_info->global_info->stdout_in_use_by) {
+      lsx_fail("stdout already in use by `%s'", effp->global_info->global_info->stdout_in_use_by);
+      return SOX_EOF;
+    }
+    effp->global_info->global_info->stdout_in_use_by = effp->handler.name;
+    SET_BINARY_MODE(stdout);
+    p->file = stdout;
+  }
+  else if ((p->file = fopen(p->filename, "wb")) == NULL) {
+    lsx_fail("can't open peak file `%s': %s", p->filename, strerror(errno));
+    return SOX_EOF;
+  }
+
+  p->chans = p->split? effp->in_signal.channels : 1;
+  for (k = 0; k < p->num_levels; ++k) {
+    level_t * l = &p->levels[k];
+    l->len = k? p->levels[k - 1].len * p->factor : p->zoom;
+    l->acc = lsx_malloc(p->chans * sizeof(*l->acc));
+    clear(p, l);
+  }
+  return SOX_SUCCESS;
+}
+
+/* Gathers n samples, each stride from the last, into b */
+static void reduce(bucket_t * b, sox_sample_t const * x, size_t n, size_t stride)
+{
+  sox_sample_t lo = b->min, hi = b->max;
+  double s[4] = {0, 0, 0, 0};
+  size_t i, j;
+
+  if (stride == 1) {
+    for (i = 0; i < n; ++i) {
+      lo = min(lo, x[i]);
+      hi = max(hi, x[i]);
+    }
+    /* Lanes of their own, as the sum may not be re-ordered otherwise */
+    for (i = 0; i + 4 <= n; i += 4)
+      for (j = 0; j < 4; ++j)
+        s[j] += (double)x[i + j] * x[i + j];
+    for (; i < n; ++i)
+      s[0] += (double)x[i] * x[i];
+  }
+  else for (i = 0; i < n; ++i) {
+    sox_sample_t d = x[i * stride];
+    lo = min(lo, d);
+    hi = max(hi, d);
+    s[0] += (double)d * d;
+  }
+  b->min = lo, b->max = hi;
+  b->sum2 += s[0] + s[1] + s[2] + s[3];
+}
+
+/* Appends l's bucket, as it is to be written, to its data */
+static void put(priv_t * p, level_t * l, size_t samples_per_chan)
+{
+  size_t need = p->chans * 3 * (p->bits >> 3), c, clips = 0;
+  unsigned char * d;
+
+  while (l->bytes + need > l->size)
+    l->data = lsx_realloc(l->data, l->size = max(l->size * 2, 4096));
+  d = l->data + l->bytes;
+  for (c = 0; c < p->chans; ++c) {
+    bucket_t const * b = &l->acc[c];
+    double rms = sqrt(b->sum2 / samples_per_chan);
+    sox_sample_t v[3];
+    int i;
+
+    v[0] = b->min, v[1] = b->max;
+    v[2] = rms < SOX_SAMPLE_MAX? (sox_sample_t)rms : SOX_SAMPLE_MAX;
+    for (i = 0; i < 3; ++i) {
+      SOX_SAMPLE_LOCALS;
+      if (p->bits == 8)
+        *d++ = (unsigned char)SOX_SAMPLE_TO_SIGNED_8BIT(v[i], clips);
+      else {
+        unsigned x = (unsigned short)SOX_SAMPLE_TO_SIGNED_16BIT(v[i], clips);
+        *d++ = x & 0xff;
+        *d++ = x >> 8;
+      }
+    }
+  }
+  l->bytes += need;
+  ++l->num;
+}
+
+/* Writes out level k's bucket, merges it into level k + 1's, and clears it */
+static void finish(sox_effect_t * effp, unsigned k)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  level_t * l = &p->levels[k];
+  unsigned c;
+
+  put(p, l, l->frames * (p->split? 1 : effp->in_signal.channels));
+  if (k + 1 < p->num_levels) {
+    level_t * next = l + 1;
+    for (c = 0; c < p->chans; ++c) {
+      next->acc[c].min = min(next->acc[c].min, l->acc[c].min);
+      next->acc[c].max = max(next->acc[c].max, l->acc[c].max);
+      next->acc[c].sum2 += l->acc[c].sum2;
+    }
+    next->frames += l->frames;
+    if (next->frames == next->len)
+      finish(effp, k + 1);
+  }
+  clear(p, l);
+}
+
+static int flow(sox_effect_t * effp, const sox_sample_t * ibuf,
+    sox_sample_t * obuf, size_t * isamp, size_t * osamp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  size_t chans = effp->in_signal.channels;
+  size_t len = min(*isamp, *osamp) / chans, n, c;
+  level_t * l = &p->levels[0];
+
+  if (obuf != ibuf) /* Pass on audio unaffected */
+    memcpy(obuf, ibuf, len * chans * sizeof(*obuf));
+  *isamp = *osamp = len * chans;
+
+  for (; len; len -= n, ibuf += n * chans) {
+    n = min(len, l->len - l->frames);
+    if (p->split)
+      for (c = 0; c < chans; ++c)
+        reduce(&l->acc[c], ibuf + c, n, chans);
+    else reduce(&l->acc[0], ibuf, n * chans, (size_t)1);
+    l->frames += n;
+    if (l->frames == l->len)
+      finish(effp, 0);
+  }
+  return SOX_SUCCESS;
+}
+
+static void put32(unsigned char * d, size_t x)
+{
+  d[0] = x & 0xff, d[1] = (x >> 8) & 0xff, d[2] = (x >> 16) & 0xff, d[3] = (x >> 24) & 0xff;
+}
+
+static int stop(sox_effect_t * effp)
+{
+  priv_t * p = (priv_t *)effp->priv;
+  unsigned char header[24 + 8 * MAX_LEVELS];
+  size_t header_len = 24 + 8 * p->num_levels;
+  int result = SOX_SUCCESS;
+  unsigned k;
+
+  /* Short buckets at the end, at every level */
+  for (k = 0; k < p->num_levels; ++k)
+    if (p->levels[k].frames)
+      finish(effp, k);
+
+  memcpy(header, "SXPK", (size_t)4);
+  put32(header + 4, (size_t)1);
+  put32(header + 8, (size_t)(p->bits == 8));
+  put32(header + 12, (size_t)(effp->in_signal.rate + .5));
+  put32(header + 16, (size_t)p->chans);
+  put32(header + 20, (size_t)p->num_levels);
+  for (k = 0; k < p->num_levels; ++k) {
+    put32(header + 24 + 8 * k, p->levels[k].len);
+    put32(header + 28 + 8 * k, p->levels[k].num);
+  }
+  if (fwrite(header, header_len, (size_t)1, p->file) != 1)
+    result = SOX_EOF;
+  for (k = 0; k < p->num_levels; ++k) {
+    level_t * l = &p->levels[k];
+    if (result == SOX_SUCCESS && l->bytes &&
+        fwrite(l->data, l->bytes, (size_t)1, p->file) != 1)
+      result = SOX_EOF;
+    free(l->data);
+    free(l->acc);
+  }
+  if (result != SOX_SUCCESS)
+    lsx_fail("error writing peak file: %s", strerror(errno));
+  if (p->file != stdout && fclose(p->file) && result == SOX_SUCCESS) {
+    lsx_fail("error writing peak file: %s", strerror(errno));
+    result = SOX_EOF;
+  }
+  return result;
+}
+
+sox_effect_handler_t const * lsx_waveform_effect_fn(void)
+{
+  static sox_effect_handler_t handler = {"waveform",
+    "[-z frames] [-f factor] [-l levels] [-b 8|16] [-s] [peak-file]"
+    "\n  -z frames  Frames per bucket at the finest level (256)"
+    "\n  -f factor  Each level's buckets this many times the last's (4)"
+    "\n  -l levels  Number of levels (5)"
+    "\n  -b bits    Bits per value (16)"
+    "\n  -s         Each channel separately, rather than all together",
+    SOX_EFF_MCHAN | SOX_EFF_MODIFY | SOX_EFF_INPLACE,
+    create, start, flow, NULL, stop, NULL, sizeof(priv_t), NULL,
+    NULL, NULL, NULL};
+  return &handler;
+}
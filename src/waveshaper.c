@@ -0,0 +1,177 @@
+/* libSoX waveshaper: memoryless non-linearity, optionally over-sampled
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* A curve may be tabulated, as a cubic for each of a number of equal
+ * intervals, fitted to the curve at the ends and thirds of the interval;
+ * looking up is then much cheaper than calling libm, and (with the
+ * intervals used by contrast) is accurate to well below 32-bit resolution.
+ *
+ * Over-sampling (by 2 or 4) keeps the harmonics that shaping adds above
+ * the base-band from aliasing: each factor of 2 is an up-sampling and a
+ * down-sampling by the shortest of rate's half-band FIRs.  Each of these
+ * delays the signal, by num_coefs samples at the lower of its two rates,
+ * so the output lags the input by `delay' samples. */
+
+#include "sox_i.h"
+#include "waveshaper.h"
+#include <string.h>
+
+void lsx_waveshaper_table(lsx_waveshaper_t * p, double (* curve)(double x,
+    void * data), void * data, double lo, double hi, size_t intervals)
+{
+  double h = (hi - lo) / intervals, y0 = curve(lo, data);
+  size_t i;
+
+  p->table = lsx_malloc(4 * intervals * sizeof(*p->table));
+  p->intervals = intervals;
+  p->lo = lo;
+  p->scale = intervals / (hi - lo);
+  for (i = 0; i < intervals; ++i) {
+    double x = lo + i * h, * c = p->table + 4 * i;
+    double y1 = curve(x + h / 3, data), y2 = curve(x + h * 2 / 3, data);
+    double y3 = curve(i + 1 == intervals? hi : x + h, data);
+    c[0] = y0;
+    c[1] = (-11 * y0 + 18 * y1 -  9 * y2 + 2 * y3) * .5;
+    c[2] = ( 18 * y0 - 45 * y1 + 36 * y2 - 9 * y3) * .5;
+    c[3] = ( -9 * y0 + 27 * y1 - 27 * y2 + 9 * y3) * .5;
+    y0 = y3;
+  }
+}
+
+void lsx_waveshaper_start(lsx_waveshaper_t * p, unsigned factor, size_t max_len)
+{
+  double const * coefs;
+  int i, n;
+
+  p->factor = factor;
+  p->max_len = max_len;
+  p->delay = 0;
+  if (factor == 1)
+    return;
+  coefs = lsx_half_band_coefs(&p->num_coefs);
+  n = p->num_coefs;
+  p->coefs = lsx_malloc(n * sizeof(*p->coefs));
+  p->coefs2 = lsx_malloc(n * sizeof(*p->coefs2));
+  for (i = 0; i < n; ++i)
+    p->coefs[i] = coefs[i], p->coefs2[i] = 2 * coefs[i];
+  p->up[0] = lsx_calloc(2 * n + max_len, sizeof(double));
+  p->down[0] = lsx_calloc(4 * n + factor * max_len, sizeof(double));
+  p->delay = 2 * n;
+  if (factor == 4) {
+    p->up[1] = lsx_calloc(2 * n + 2 * max_len, sizeof(double));
+    p->down[1] = lsx_calloc(4 * n + 2 * max_len, sizeof(double));
+    p->delay += n;
+  }
+}
+
+void lsx_waveshaper_stop(lsx_waveshaper_t * p)
+{
+  free(p->table);
+  free(p->coefs);
+  free(p->coefs2);
+  free(p->up[0]);
+  free(p->up[1]);
+  free(p->down[0]);
+  free(p->down[1]);
+  memset(p, 0, sizeof(*p));
+}
+
+/* Up-sample by 2: `in' holds 2n samples of history then m new ones; out is
+ * given 2m samples, lagging the new ones by n (c is 2x the odd taps). */
+static void up(double const * c, int n, double const * in, size_t m,
+    double * out)
+{
+  size_t i;
+
+  for (i = 0; i < m; ++i, ++in) {
+    double sum = 0;
+    int j;
+    for (j = 0; j < n; ++j)
+      sum += (in[n - j] + in[n + 1 + j]) * c[j];
+    out[2 * i] = in[n];
+    out[2 * i + 1] = sum;
+  }
+}
+
+/* Down-sample by 2: `in' holds 4n samples of history then 2m new ones; out
+ * is given m samples, lagging the new ones by 2n (at the higher rate). */
+static void down(double const * c, int n, double const * in, size_t m,
+    double * out)
+{
+  size_t i;
+
+  for (i = 0, in += 2 * n; i < m; ++i, in += 2) {
+    double sum = in[0] * .5;
+    int j;
+    for (j = 0; j < n; ++j)
+      sum += (in[-(2 * j + 1)] + in[2 * j + 1]) * c[j];
+    out[i] = sum;
+  }
+}
+
+static void shape(lsx_waveshaper_t * p, double * x, size_t len)
+{
+  double const * table = p->table;
+  double lo = p->lo, scale = p->scale, top = p->intervals;
+  size_t i, last = p->intervals - 1;
+
+  if (p->shape) {
+    p->shape(p->data, x, len);
+    return;
+  }
+  for (i = 0; i < len; ++i) {
+    double u = (x[i] - lo) * scale, t;
+    size_t k;
+    double const * c;
+    u = u < 0? 0 : u > top? top : u;
+    k = min((size_t)u, last);
+    t = u - k;
+    c = table + 4 * k;
+    x[i] = ((c[3] * t + c[2]) * t + c[1]) * t + c[0];
+  }
+}
+
+/* Shapes len (<= max_len) samples of x in place; the result lags by delay. */
+void lsx_waveshaper_shape(lsx_waveshaper_t * p, double * x, size_t len)
+{
+  int n = p->num_coefs;
+  size_t h = 2 * n, m = p->factor * len;
+  double * hi = p->down[0] + 2 * h;
+
+  if (p->factor == 1) {
+    shape(p, x, len);
+    return;
+  }
+  memcpy(p->up[0] + h, x, len * sizeof(*x));
+  up(p->coefs2, n, p->up[0], len, p->factor == 4? p->up[1] + h : hi);
+  memmove(p->up[0], p->up[0] + len, h * sizeof(*x));
+  if (p->factor == 4) {
+    up(p->coefs2, n, p->up[1], 2 * len, hi);
+    memmove(p->up[1], p->up[1] + 2 * len, h * sizeof(*x));
+  }
+  shape(p, hi, m);
+  if (p->factor == 4) {
+    down(p->coefs, n, p->down[0], 2 * len, p->down[1] + 2 * h);
+    memmove(p->down[0], p->down[0] + m, 2 * h * sizeof(*x));
+    down(p->coefs, n, p->down[1], len, x);
+    memmove(p->down[1], p->down[1] + 2 * len, 2 * h * sizeof(*x));
+  }
+  else {
+    down(p->coefs, n, p->down[0], len, x);
+    memmove(p->down[0], p->down[0] + m, 2 * h * sizeof(*x));
+  }
+}
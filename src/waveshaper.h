@@ -0,0 +1,39 @@
+/* libSoX waveshaper: memoryless non-linearity, optionally over-sampled
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or (at
+ * your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Shapes a block of samples in place; used by contrast & overdrive. */
+typedef void (* lsx_shape_t)(void * data, double * x, size_t len);
+
+typedef struct {
+  lsx_shape_t shape;        /* If NULL, the table is used */
+  void        * data;
+  double      * table;      /* A cubic (4 coefs) for each interval */
+  size_t      intervals;
+  double      lo, scale;    /* Of the table's domain */
+  unsigned    factor;       /* Over-sampling: 1, 2 or 4 */
+  size_t      delay;        /* Of the output, in samples at the base rate */
+  size_t      max_len;
+  int         num_coefs;    /* Half-band FIR's odd taps */
+  double      * coefs, * coefs2;
+  double      * up[2], * down[2]; /* Stages' history & input */
+} lsx_waveshaper_t;
+
+void lsx_waveshaper_table(lsx_waveshaper_t * p, double (* curve)(double x,
+    void * data), void * data, double lo, double hi, size_t intervals);
+void lsx_waveshaper_start(lsx_waveshaper_t * p, unsigned factor, size_t max_len);
+void lsx_waveshaper_shape(lsx_waveshaper_t * p, double * x, size_t len);
+void lsx_waveshaper_stop(lsx_waveshaper_t * p);
@@ -190,7 +190,7 @@ LSX_FORMAT_HANDLER(wavpack)
     names, 0,
     start_read, read_samples, stop_read,
     start_write, write_samples, stop_write,
-    seek, write_encodings, NULL, sizeof(priv_t)
+    seek, write_encodings, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
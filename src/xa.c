@@ -291,7 +291,7 @@ LSX_FORMAT_HANDLER(xa)
     names, SOX_FILE_LIT_END,
     startread, read_samples, stopread,
     NULL, NULL, NULL,
-    NULL, NULL, NULL, sizeof(priv_t)
+    NULL, NULL, NULL, sizeof(priv_t), NULL, NULL, NULL, NULL
   };
   return &handler;
 }
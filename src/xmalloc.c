@@ -19,6 +19,52 @@
 
 #include "sox_i.h"
 #include <stdlib.h>
+#if defined HAVE_MALLOC_USABLE_SIZE
+  #include <malloc.h>
+  #define block_size(p) ((p)? malloc_usable_size(p) : 0)
+#endif
+
+static sox_mem_stats_t total;
+static LSX_THREAD_LOCAL lsx_mem_tag_t tags;
+
+/* Counts, in *s, a block of added bytes (new if is_new) and the return of
+ * removed bytes; safe to call from several threads at once. */
+static void count(sox_mem_stats_t * s, size_t added, size_t removed,
+    sox_bool is_new)
+{
+#if defined __ATOMIC_RELAXED
+  sox_uint64_t cur, x;
+
+  if (is_new)
+    __atomic_fetch_add(&s->allocations, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&s->allocated, added, __ATOMIC_RELAXED);
+  do {
+    cur = __atomic_load_n(&s->current, __ATOMIC_RELAXED);
+    x = cur + added - min(cur + added, removed);
+  } while (!__sync_bool_compare_and_swap(&s->current, cur, x));
+  do cur = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+  while (x > cur && !__sync_bool_compare_and_swap(&s->peak, cur, x));
+#else
+  #ifdef _OPENMP
+  #pragma omp critical (lsx_mem)
+  #endif
+  {
+    s->allocations += is_new;
+    s->allocated += added;
+    s->current += added - min(s->current + added, removed);
+    s->peak = max(s->peak, s->current);
+  }
+#endif
+}
+
+static void count_all(size_t added, size_t removed, sox_bool is_new)
+{
+  count(&total, added, removed, is_new);
+  if (tags.a)
+    count(tags.a, added, removed, is_new);
+  if (tags.b)
+    count(tags.b, added, removed, is_new);
+}
 
 /* Resize an allocated memory area; abort if not possible.
  *
@@ -29,8 +75,13 @@
  */
 void *lsx_realloc(void *ptr, size_t newsize)
 {
+#if defined block_size
+  size_t old_size = block_size(ptr);
+#endif
+  sox_bool is_new = !ptr;
+
   if (ptr && newsize == 0) {
-    free(ptr);
+    lsx_free(ptr);
     return NULL;
   }
 
@@ -39,5 +90,115 @@ void *lsx_realloc(void *ptr, size_t newsize)
     exit(2);
   }
 
+#if defined block_size
+  count_all(block_size(ptr), old_size, is_new);
+#else
+  count_all(newsize, (size_t)0, is_new);
+#endif
   return ptr;
 }
+
+void lsx_free(void * ptr)
+{
+#if defined block_size
+  if (ptr)
+    count_all((size_t)0, block_size(ptr), sox_false);
+#endif
+  free(ptr);
+}
+
+lsx_mem_tag_t lsx_mem_tag(sox_mem_stats_t * a, sox_mem_stats_t * b)
+{
+  lsx_mem_tag_t saved = tags;
+
+  tags.a = a;
+  tags.b = b;
+  return saved;
+}
+
+void lsx_mem_untag(lsx_mem_tag_t saved)
+{
+  tags = saved;
+}
+
+void lsx_mem_release(sox_mem_stats_t * stats, sox_mem_stats_t * parent)
+{
+  size_t held = (size_t)stats->current;
+
+  count(stats, (size_t)0, held, sox_false);
+  if (parent)
+    count(parent, (size_t)0, held, sox_false);
+}
+
+void sox_memory_stats(sox_mem_stats_t * stats)
+{
+  *stats = total;
+}
+
+/* Arena memory comes from blocks of at least this size; a request of half
+ * this or more is given a block of its own, so as not to waste the rest of
+ * the current one. */
+#define ARENA_BLOCK (1 << 14)
+
+typedef struct block {
+  struct block * next;
+} block_t;
+
+struct lsx_arena_t {
+  block_t * blocks;  /* Further blocks, most recent first */
+  char * free;       /* Unused part of the current block */
+  char * end;
+};
+
+static char * align(void * p)
+{
+  size_t mis = (size_t)p % LSX_ARENA_ALIGN;
+  return (char *)p + (mis? LSX_ARENA_ALIGN - mis : 0);
+}
+
+/* The arena's first block holds the arena itself and size bytes */
+lsx_arena_t * lsx_arena_create(size_t size)
+{
+  size_t len = sizeof(lsx_arena_t) + LSX_ARENA_ALIGN +
+      (size + LSX_ARENA_ALIGN - 1) / LSX_ARENA_ALIGN * LSX_ARENA_ALIGN;
+  lsx_arena_t * arena = lsx_malloc(len);
+
+  arena->blocks = NULL;
+  arena->free = align(arena + 1);
+  arena->end = (char *)arena + len;
+  return arena;
+}
+
+void * lsx_arena_alloc(lsx_arena_t * arena, size_t size)
+{
+  char * p;
+
+  size = (size + LSX_ARENA_ALIGN - 1) / LSX_ARENA_ALIGN * LSX_ARENA_ALIGN;
+  if (size > (size_t)(arena->end - arena->free)) {
+    size_t len = max(size, ARENA_BLOCK);
+    block_t * block = lsx_malloc(sizeof(*block) + LSX_ARENA_ALIGN + len);
+
+    block->next = arena->blocks;
+    arena->blocks = block;
+    p = align(block + 1);
+    if (size >= ARENA_BLOCK / 2)
+      return memset(p, 0, size);
+    arena->free = p;
+    arena->end = p + len;
+  }
+  p = arena->free;
+  arena->free += size;
+  return memset(p, 0, size);
+}
+
+void lsx_arena_free(lsx_arena_t * arena)
+{
+  if (arena) {
+    block_t * block = arena->blocks, * next;
+    for (; block; block = next) {
+      next = block->next;
+      lsx_free(block);
+    }
+    lsx_free(arena);
+  }
+}
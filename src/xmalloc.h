@@ -24,11 +24,32 @@
 #include <string.h>
 
 #define lsx_malloc(size) lsx_realloc(NULL, (size))
-#define lsx_calloc(n,s) (((n)*(s))? memset(lsx_malloc((n)*(s)),0,(n)*(s)) : NULL)
+#define lsx_calloc(n,s) (((n)*(s) != 0)? memset(lsx_malloc((n)*(s)),0,(n)*(s)) : NULL)
 #define lsx_Calloc(v,n)  v = lsx_calloc(n,sizeof(*(v)))
 #define lsx_strdup(p) ((p)? strcpy((char *)lsx_malloc(strlen(p) + 1), p) : NULL)
 #define lsx_memdup(p,s) ((p)? memcpy(lsx_malloc(s), p, s) : NULL)
 #define lsx_valloc(v,n)  v = lsx_malloc((n)*sizeof(*(v)))
 #define lsx_revalloc(v,n)  v = lsx_realloc(v, (n)*sizeof(*(v)))
 
+/* As free, but counted (see sox_mem_stats_t) */
+void lsx_free(void * ptr);
+
+/* Whilst tagged, this thread's allocations and frees are also counted in a
+ * and b (either may be NULL); lsx_mem_untag restores the previous tags. */
+typedef struct {struct sox_mem_stats_t * a, * b;} lsx_mem_tag_t;
+lsx_mem_tag_t lsx_mem_tag(struct sox_mem_stats_t * a,
+    struct sox_mem_stats_t * b);
+void lsx_mem_untag(lsx_mem_tag_t saved);
+/* Deems what is now held in *stats returned, also to *parent if given */
+void lsx_mem_release(struct sox_mem_stats_t * stats,
+    struct sox_mem_stats_t * parent);
+
+/* An arena gives zeroed memory, aligned for SIMD and to cache lines, from a
+ * few large blocks; none of it is freed until the whole arena is. */
+#define LSX_ARENA_ALIGN 64
+typedef struct lsx_arena_t lsx_arena_t;
+lsx_arena_t * lsx_arena_create(size_t size);
+void * lsx_arena_alloc(lsx_arena_t * arena, size_t size);
+void lsx_arena_free(lsx_arena_t * arena);
+
 #endif
@@ -0,0 +1,87 @@
+#!/usr/bin/perl -w
+
+# benchcmp.pl -- compare two sets of results from sox_bench.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+
+# Usage: benchcmp.pl [-t percent] old.json new.json
+#
+# Lists the change in ns/sample of each benchmark found in both files, and
+# exits with status 1 if any has slowed by more than the given percentage
+# (default 10).  For end-to-end jobs (sox_bench -j), the changes in CPU
+# time and in peak memory are listed too, and growth in either by more
+# than the percentage also counts against the new results.  sox_bench
+# writes one result to a line, so no JSON module is needed here.
+
+use strict;
+
+my $threshold = 10;
+if (@ARGV && $ARGV[0] eq '-t') {
+  shift;
+  $threshold = shift;
+}
+die "Usage: $0 [-t percent] old.json new.json\n" unless @ARGV == 2;
+
+sub results {
+  my ($file) = @_;
+  my (%ns, %cpu, %mem, @order);
+  open(my $fh, '<', $file) or die "$0: can't open `$file': $!\n";
+  while (<$fh>) {
+    next unless /"kind": "([^"]*)", "name": "([^"]*)".*"ns_per_sample": ([0-9.]+)/;
+    my $key = "$1 $2";
+    push @order, $key;
+    $ns{$key} = $3;
+    $cpu{$key} = $1 if /"cpu_seconds": ([0-9.]+)/;
+    $mem{$key} = $1 if /"mem_peak": ([0-9]+)/;
+  }
+  close $fh;
+  return (\%ns, \@order, \%cpu, \%mem);
+}
+
+my ($old, undef, $old_cpu, $old_mem) = results($ARGV[0]);
+my ($new, $order, $new_cpu, $new_mem) = results($ARGV[1]);
+my $slower = 0;
+
+printf "%-20s %12s %12s %8s\n", "benchmark", "old ns/smp", "new ns/smp", "change";
+foreach my $key (@$order) {
+  next unless exists $old->{$key} && $old->{$key} > 0;
+  my $change = 100 * ($new->{$key} - $old->{$key}) / $old->{$key};
+  my $flag = $change > $threshold ? "  SLOWER" : "";
+  $slower++ if $flag;
+  printf "%-20s %12.3f %12.3f %+7.1f%%%s\n",
+      $key, $old->{$key}, $new->{$key}, $change, $flag;
+}
+foreach my $what (["cpu s", $old_cpu, $new_cpu],
+                  ["mem peak", $old_mem, $new_mem]) {
+  my ($name, $o, $n) = @$what;
+  my @keys = grep { exists $o->{$_} && $o->{$_} > 0 && exists $n->{$_} } @$order;
+  next unless @keys;
+  printf "\n%-20s %12s %12s %8s\n", "job", "old $name", "new $name", "change";
+  foreach my $key (@keys) {
+    my $change = 100 * ($n->{$key} - $o->{$key}) / $o->{$key};
+    my $flag = $change > $threshold ? "  LARGER" : "";
+    $slower++ if $flag;
+    printf "%-20s %12s %12s %+7.1f%%%s\n", $key, $o->{$key}, $n->{$key},
+        $change, $flag;
+  }
+}
+foreach my $key (sort keys %$old) {
+  print "$key: missing from $ARGV[1]\n" unless exists $new->{$key};
+}
+if ($slower) {
+  print "$slower result(s) grew by more than $threshold%\n";
+  exit 1;
+}
+exit 0;